@@ -0,0 +1,81 @@
+#!/usr/bin/env python
+########################################################
+#
+# Report flash strings repeated in the sources
+#
+# Every F("...") and PSTR("...") is a flash copy of its own. Lists the literals
+# found more than once in src/ which are not in the shared table of
+# src/WebStrings.h, with the bytes a table entry would save, and the table
+# strings still written as F("...").
+# Run by PlatformIO before building (extra_scripts, summary only), or by hand:
+#   python flash_strings.py [min. count]
+#
+########################################################
+import io
+import os
+import re
+import sys
+from collections import Counter
+
+try:
+    SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+except NameError:
+    SCRIPT_DIR = os.getcwd()  # PlatformIO runs the extra scripts from the project directory
+SRC_DIR = os.path.join(SCRIPT_DIR, 'src')
+TABLE = os.path.join(SRC_DIR, 'WebStrings.h')
+
+LITERAL = re.compile(r'\b(?:F|PSTR)\(\s*"((?:[^"\\]|\\.)*)"\s*\)')
+TABLE_ENTRY = re.compile(r'X\((\w+),\s*"((?:[^"\\]|\\.)*)"\)')
+
+
+def read(path):
+    with io.open(path, 'r', encoding='utf-8', errors='replace') as f:
+        return f.read()
+
+
+def table_strings():
+    return dict((text, name) for name, text in TABLE_ENTRY.findall(read(TABLE)))
+
+
+def count_literals():
+    counts = Counter()
+    files = {}
+    for name in sorted(os.listdir(SRC_DIR)):
+        if not name.endswith(('.ino', '.h')) or name == 'WebStrings.h':
+            continue
+        for text in LITERAL.findall(read(os.path.join(SRC_DIR, name))):
+            counts[text] += 1
+            files.setdefault(text, set()).add(name)
+    return counts, files
+
+
+def report(min_count, summary):
+    table = table_strings()
+    counts, files = count_literals()
+    repeated = []
+    for text, count in counts.items():
+        if count >= min_count and len(text) > 1:
+            # The escapes count as one byte, plus the terminating NUL
+            size = len(re.sub(r'\\.', '_', text)) + 1
+            repeated.append(((count - 1) * size, count, text))
+    repeated.sort(reverse=True)
+    saving = sum(r[0] for r in repeated)
+    in_table = [(text, counts[text]) for text in table if counts[text] > 0]
+
+    if summary:
+        print('Flash strings: %d literals repeated, %d bytes, %d table strings still as F() or PSTR(), see flash_strings.py'
+              % (len(repeated), saving, len(in_table)))
+        return
+    print('%-7s %-6s %-6s %s' % ('Bytes', 'Count', 'Files', 'String'))
+    for bytes_saved, count, text in repeated:
+        print('%-7d %-6d %-6d "%s"' % (bytes_saved, count, len(files[text]), text))
+    print('Total: %d literals repeated %d times or more, %d bytes' % (len(repeated), min_count, saving))
+    for text, count in in_table:
+        print('In the table as WEB_STR_%s, still %d times as F() or PSTR(): "%s"' % (table[text], count, text))
+
+
+try:
+    Import('env')  # Run by PlatformIO
+    report(3, True)
+except NameError:
+    report(int(sys.argv[1]) if len(sys.argv) > 1 else 2, False)
@@ -66,14 +66,26 @@ static void (*ISRList[NR_CONCURRENT_SOFT_SERIALS])() = {
       */
 };
 
-ESPeasySoftwareSerial::ESPeasySoftwareSerial(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic, uint16_t buffSize) {
+ESPeasySoftwareSerial::ESPeasySoftwareSerial(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic, uint16_t buffSize, uint16_t isrBuffSize) {
    m_rxValid = m_txValid = m_txEnableValid = false;
    m_buffer = NULL;
+   m_isrBuffer = NULL;
+   m_isrBuffSize = 0;
+   m_isrInPos = m_isrOutPos = 0;
+   m_rxCurBit = -1;
+   m_rxCurByte = 0;
+   m_rxStartCycle = 0;
+   m_overruns = m_framingErrors = 0;
    m_invert = inverse_logic;
+   m_rxLevel = true;
    if (isValidGPIOpin(receivePin)) {
       m_rxPin = receivePin;
       m_buffSize = buffSize;
       m_buffer = (uint8_t*)malloc(m_buffSize);
+      if (isrBuffSize > 0) {
+         m_isrBuffer = (uint32_t*)malloc(isrBuffSize * sizeof(uint32_t));
+         if (m_isrBuffer != NULL) m_isrBuffSize = isrBuffSize;
+      }
       if (m_buffer != NULL) {
          m_rxValid = true;
          m_inPos = m_outPos = 0;
@@ -107,6 +119,8 @@ ESPeasySoftwareSerial::~ESPeasySoftwareSerial() {
    }
    if (m_buffer)
       free(m_buffer);
+   if (m_isrBuffer)
+      free(m_isrBuffer);
 }
 
 bool ESPeasySoftwareSerial::isValidGPIOpin(uint8_t pin) {
@@ -156,7 +170,13 @@ void ESPeasySoftwareSerial::setTransmitEnablePin(uint8_t transmitEnablePin) {
 void ESPeasySoftwareSerial::enableRx(bool on) {
    if (m_rxValid) {
       if (on) {
-         attachInterrupt(m_rxPin, ISRList[pinToIndex(m_rxPin)], m_invert ? RISING : FALLING);
+         if (m_isrBuffer != NULL) {
+            m_rxCurBit = -1;
+            m_rxLevel = true;
+            attachInterrupt(m_rxPin, ISRList[pinToIndex(m_rxPin)], CHANGE);
+         } else {
+            attachInterrupt(m_rxPin, ISRList[pinToIndex(m_rxPin)], m_invert ? RISING : FALLING);
+         }
       } else {
          detachInterrupt(m_rxPin);
       }
@@ -164,7 +184,9 @@ void ESPeasySoftwareSerial::enableRx(bool on) {
 }
 
 int ESPeasySoftwareSerial::read() {
-   if (!m_rxValid || (m_inPos == m_outPos)) return -1;
+   if (!m_rxValid) return -1;
+   rxBits();
+   if (m_inPos == m_outPos) return -1;
    uint8_t ch = m_buffer[m_outPos];
    m_outPos = (m_outPos+1) % m_buffSize;
    return ch;
@@ -172,6 +194,7 @@ int ESPeasySoftwareSerial::read() {
 
 int ESPeasySoftwareSerial::available() {
    if (!m_rxValid) return 0;
+   rxBits();
    int avail = m_inPos - m_outPos;
    if (avail < 0) avail += m_buffSize;
    return avail;
@@ -206,15 +229,22 @@ size_t ESPeasySoftwareSerial::write(uint8_t b) {
 }
 
 void ESPeasySoftwareSerial::flush() {
-   m_inPos = m_outPos = 0;
+   rxBits();
+   m_outPos = m_inPos;
 }
 
 int ESPeasySoftwareSerial::peek() {
-   if (!m_rxValid || (m_inPos == m_outPos)) return -1;
+   if (!m_rxValid) return -1;
+   rxBits();
+   if (m_inPos == m_outPos) return -1;
    return m_buffer[m_outPos];
 }
 
 void ICACHE_RAM_ATTR ESPeasySoftwareSerial::rxRead() {
+   if (m_isrBuffer != NULL) {
+      rxEdge();
+      return;
+   }
    // Advance the starting point for the samples but compensate for the
    // initial delay which occurs before the interrupt is delivered
    unsigned long wait = m_bitTime + m_bitTime/3 - 500;
@@ -231,12 +261,90 @@ void ICACHE_RAM_ATTR ESPeasySoftwareSerial::rxRead() {
    WAIT;
    // Store the received value in the buffer unless we have an overflow
    uint16_t next = (m_inPos+1) % m_buffSize;
-   if (next != m_inPos) {
+   if (next != m_outPos) {
       m_buffer[m_inPos] = rec;
       m_inPos = next;
+   } else {
+      ++m_overruns;
    }
    // Must clear this bit in the interrupt register,
    // it gets set even when interrupts are disabled
    GPIO_REG_WRITE(GPIO_STATUS_W1TC_ADDRESS, 1 << m_rxPin);
 }
+
+// Edge capture: only store when the edge occurred and the level after it.
+void ICACHE_RAM_ATTR ESPeasySoftwareSerial::rxEdge() {
+   const uint32_t cycle = ESP.getCycleCount();
+   const bool level = GPIP(m_rxPin);
+   const uint16_t next = (m_isrInPos + 1) % m_isrBuffSize;
+   if (next != m_isrOutPos) {
+      m_isrBuffer[m_isrInPos] = level ? (cycle | 1) : (cycle & ~1UL);
+      m_isrInPos = next;
+   } else {
+      ++m_overruns;
+   }
+   GPIO_REG_WRITE(GPIO_STATUS_W1TC_ADDRESS, 1 << m_rxPin);
+}
+
+// Decode the captured edges into bytes.
+void ESPeasySoftwareSerial::rxBits() {
+   if (m_isrBuffer == NULL) return;
+   while (m_isrOutPos != m_isrInPos) {
+      const uint32_t edge = m_isrBuffer[m_isrOutPos];
+      m_isrOutPos = (m_isrOutPos + 1) % m_isrBuffSize;
+      rxDecode(edge & ~1UL, ((edge & 1) != 0) != m_invert);
+   }
+   if (m_rxCurBit < 0) return;
+   // The last bits of a byte up to the stop bit may have the same level, without
+   // edges. When the byte time has passed without a new edge, they have the level
+   // of the line. Read the time first, an edge stored after it is of the next byte.
+   const uint32_t now = ESP.getCycleCount();
+   if (m_isrOutPos == m_isrInPos && now - m_rxStartCycle > 10 * m_bitTime) {
+      rxFill(10, m_rxLevel);
+   }
+}
+
+void ESPeasySoftwareSerial::rxDecode(uint32_t cycle, bool level) {
+   if (m_rxCurBit >= 0) {
+      // The level before the edge lasted up to the bit the edge is in.
+      rxFill((cycle - m_rxStartCycle + m_bitTime / 2) / m_bitTime, !level);
+   }
+   m_rxLevel = level;
+   if (m_rxCurBit < 0 && !level) {
+      // Start bit
+      m_rxCurBit = 0;
+      m_rxCurByte = 0;
+      m_rxStartCycle = cycle;
+   }
+}
+
+// Bits after the last one decoded, up to (not including) bit 'bits', have the level.
+// Bit 0 is the start bit, 1-8 the data bits and 9 the stop bit.
+void ESPeasySoftwareSerial::rxFill(uint32_t bits, bool level) {
+   if (bits > 10) bits = 10;
+   for (uint32_t bit = m_rxCurBit + 1; bit < bits; ++bit) {
+      if (bit <= 8) {
+         if (level) m_rxCurByte |= 1 << (bit - 1);
+         m_rxCurBit = bit;
+      } else {
+         if (level) {
+            rxStore(m_rxCurByte);
+         } else {
+            ++m_framingErrors;
+         }
+         m_rxCurBit = -1;
+         return;
+      }
+   }
+}
+
+void ESPeasySoftwareSerial::rxStore(uint8_t rec) {
+   const uint16_t next = (m_inPos + 1) % m_buffSize;
+   if (next == m_outPos) {
+      ++m_overruns;
+      return;
+   }
+   m_buffer[m_inPos] = rec;
+   m_inPos = next;
+}
 #endif
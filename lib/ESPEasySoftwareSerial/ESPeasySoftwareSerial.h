@@ -30,12 +30,18 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 // This class is compatible with the corresponding AVR one,
 // the constructor however has an optional rx buffer size.
 // Speed up to 115200 can be used.
+//
+// With isrBuffSize > 0 the receive interrupt only stores the time and level
+// of each edge on the rx pin, in a ring of isrBuffSize edges. The bits are
+// decoded from the edges outside the interrupt, in available(), read() and
+// peek(). A byte takes at most 10 edges. Without it the interrupt samples
+// the bits of a whole byte, with a busy wait of 10 bit times.
 
 
 class ESPeasySoftwareSerial : public Stream
 {
 public:
-   ESPeasySoftwareSerial(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic = false, uint16_t buffSize = 64);
+   ESPeasySoftwareSerial(uint8_t receivePin, uint8_t transmitPin, bool inverse_logic = false, uint16_t buffSize = 64, uint16_t isrBuffSize = 0);
    virtual ~ESPeasySoftwareSerial();
 
    void begin(long speed);
@@ -54,21 +60,46 @@ public:
 
    void rxRead();
 
+   // Bytes lost because the rx buffer or the edge ring was full
+   uint32_t overruns() const { return m_overruns; }
+   // Bytes dropped because the stop bit was not received
+   uint32_t framingErrors() const { return m_framingErrors; }
+
    using Print::write;
 
 private:
    bool isValidGPIOpin(uint8_t pin);
    uint8_t pinToIndex(uint8_t pin);
 
+   void rxEdge();
+   void rxBits();
+   void rxDecode(uint32_t cycle, bool level);
+   void rxFill(uint32_t bits, bool level);
+   void rxStore(uint8_t rec);
+
    // Member variables
    uint8_t m_rxPin, m_txPin, m_txEnablePin;
    bool m_rxValid, m_txValid, m_txEnableValid;
    bool m_invert;
    unsigned long m_bitTime;
-   uint16_t m_inPos, m_outPos;
+   volatile uint16_t m_inPos;
+   uint16_t m_outPos;
    uint16_t m_buffSize;
    uint8_t *m_buffer;
 
+   // Edge capture, the level after the edge is in bit 0 of the cycle count
+   volatile uint16_t m_isrInPos;
+   uint16_t m_isrOutPos;
+   uint16_t m_isrBuffSize;
+   uint32_t *m_isrBuffer;
+   int8_t m_rxCurBit;          // -1 while waiting for a start bit, else the last bit decoded
+   uint8_t m_rxCurByte;
+   uint32_t m_rxStartCycle;    // Start of the start bit
+   bool m_rxLevel;             // Line level after the last edge
+
+   volatile uint32_t m_overruns;
+   uint32_t m_framingErrors;
+
 };
 
 // If only one tx or rx wanted then use this as parameter for the unused pin
@@ -158,13 +158,13 @@ void HLW8012::setResistors(double current, double voltage_upstream, double volta
     }
 }
 
-void HLW8012::cf_interrupt() {
+void ICACHE_RAM_ATTR HLW8012::cf_interrupt() {
     unsigned long now = micros();
     _power_pulse_width = now - _last_cf_interrupt;
     _last_cf_interrupt = now;
 }
 
-void HLW8012::cf1_interrupt() {
+void ICACHE_RAM_ATTR HLW8012::cf1_interrupt() {
 
     unsigned long now = micros();
     unsigned long pulse_width;
@@ -1,7 +1,7 @@
 #include "HT16K33.h"
 #include <Wire.h>
 
-CHT16K33::CHT16K33(void)
+CHT16K33::CHT16K33(void) : _shownValid(false)
 {
   
 };
@@ -22,6 +22,7 @@ void CHT16K33::Init(uint8_t addr)
 
   SetBrightness(15);
   ClearRowBuffer();
+  _shownValid = false;
   TransmitRowBuffer();
 };
 
@@ -37,15 +38,36 @@ void CHT16K33::SetBrightness(uint8_t b)
 
 void CHT16K33::TransmitRowBuffer(void)
 {
+  // First and last row which changed, the rows between are sent as well (auto increment)
+  int8_t first = -1;
+  int8_t last = -1;
+  for (byte i=0; i<8; i++)
+  {
+    if (_shownValid && _shownBuffer[i] == _rowBuffer[i])
+      continue;
+    if (first < 0)
+      first = i;
+    last = i;
+  }
+  if (first < 0)
+    return;
+
   // Display Memory
   Wire.beginTransmission(_addr);
-  Wire.write(0); // start data at address 0
-  for (byte i=0; i<8; i++)
+  Wire.write(first * 2); // start data at address of the first changed row
+  for (byte i=first; i<=last; i++)
   {
     Wire.write(_rowBuffer[i] & 0xFF);
     Wire.write(_rowBuffer[i] >> 8);
   }
-  Wire.endTransmission();
+  if (Wire.endTransmission() != 0)
+  {
+    _shownValid = false;  // Unknown what the display shows, send all next time
+    return;
+  }
+  for (byte i=first; i<=last; i++)
+    _shownBuffer[i] = _rowBuffer[i];
+  _shownValid = true;
 };
 
 void CHT16K33::ClearRowBuffer(void)
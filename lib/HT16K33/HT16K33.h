@@ -17,7 +17,7 @@ class CHT16K33 {
 
   // LED output and control
   void SetBrightness(uint8_t b);
-  void TransmitRowBuffer(void);
+  void TransmitRowBuffer(void);    // Sends the rows which differ from the display only
 
   //KeyPad Scan
   uint8_t ReadKeys(void);
@@ -25,6 +25,8 @@ class CHT16K33 {
 protected:
   uint8_t _addr;
   uint16_t _rowBuffer[8];
+  uint16_t _shownBuffer[8];        // Display RAM as last transmitted
+  bool _shownValid;
   uint16_t _keyBuffer[3];
   byte _keydown;
 
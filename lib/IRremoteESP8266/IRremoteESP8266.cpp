@@ -69,6 +69,7 @@ uint32_t ICACHE_FLASH_ATTR IRtimer::elapsed() {
 
 IRsend::IRsend(int IRsendPin) {
 	IRpin = IRsendPin;
+	_recorder = NULL;
 }
 
 void ICACHE_FLASH_ATTR IRsend::begin() {
@@ -498,6 +499,10 @@ void ICACHE_FLASH_ATTR IRsend::sendDenon (unsigned long data,  int nbits) {
 void ICACHE_FLASH_ATTR IRsend::mark(unsigned int usec) {
   // Sends an IR mark for the specified number of microseconds.
   // The mark output is modulated at the PWM frequency.
+  if (_recorder != NULL) {
+    _recorder->mark(usec);
+    return;
+  }
   IRtimer usecTimer = IRtimer();
   while (usecTimer.elapsed() < usec) {
     digitalWrite(IRpin, HIGH);
@@ -517,6 +522,10 @@ void ICACHE_FLASH_ATTR IRsend::space(unsigned long time) {
   // Sends an IR space for the specified number of microseconds.
   // A space is no output, so the PWM output is disabled.
   ledOff();
+  if (_recorder != NULL) {
+    _recorder->space(time);
+    return;
+  }
   if (time == 0) return;
   if (time <= 16383)  // delayMicroseconds is only accurate to 16383us.
     delayMicroseconds(time);
@@ -533,6 +542,7 @@ void ICACHE_FLASH_ATTR IRsend::enableIROut(int khz) {
 
   // T = 1/f but we need T/2 in microsecond and f is in kHz
   halfPeriodicTime = 500/khz;
+  if (_recorder != NULL) _recorder->carrier(khz);
 }
 
 
@@ -726,12 +736,16 @@ extern "C" {
 
 static ETSTimer timer;
 volatile irparams_t irparams;
+static void (*frameCallback)() = NULL;
 
 static void ICACHE_RAM_ATTR read_timeout(void *arg __attribute__((unused))) {
   os_intr_lock();
-  if (irparams.rawlen)
+  const bool stopped = irparams.rawlen != 0;
+  if (stopped)
     irparams.rcvstate = STATE_STOP;
   os_intr_unlock();
+  if (stopped && frameCallback != NULL)
+    frameCallback();
 }
 
 static void ICACHE_RAM_ATTR gpio_intr() {
@@ -796,6 +810,10 @@ void ICACHE_FLASH_ATTR IRrecv::disableIRIn() {
   detachInterrupt(irparams.recvpin);
 }
 
+void ICACHE_FLASH_ATTR IRrecv::setFrameCallback(void (*callback)()) {
+  frameCallback = callback;
+}
+
 void ICACHE_FLASH_ATTR IRrecv::resume() {
   irparams.rcvstate = STATE_IDLE;
   irparams.rawlen = 0;
@@ -833,6 +851,14 @@ void ICACHE_FLASH_ATTR IRrecv::copyIrParams(irparams_t *dest) {
 //   A boolean indicating if an IR message is ready or not.
 bool ICACHE_FLASH_ATTR IRrecv::decode(decode_results *results,
                                       irparams_t *save) {
+  return decode(results, save, IR_PROTOCOLS_ALL);
+}
+
+// As decode(), but only the protocols in the mask are tried. Every decoder
+// checks the header timing first, so skipping the unused ones saves most of
+// the time spent on a frame nobody listens for.
+bool ICACHE_FLASH_ATTR IRrecv::decode(decode_results *results,
+                                      irparams_t *save, uint32_t protocols) {
   // Proceed only if an IR message been received.
   if (irparams.rcvstate != STATE_STOP) {
     return false;
@@ -855,95 +881,65 @@ bool ICACHE_FLASH_ATTR IRrecv::decode(decode_results *results,
     results->overflow = save->overflow;
   }
 
-#ifdef DEBUG
-  Serial.println("Attempting NEC decode");
-#endif
-  if (decodeNEC(results)) {
+  if (decodeProtocols(results, protocols)) {
     return true;
   }
+  // Throw away and start over
+  if (!resumed)  // Check if we have already resumed.
+    resume();
+  return false;
+}
 
-#ifdef DEBUG
-  Serial.println("Attempting Sony decode");
-#endif
-  if (decodeSony(results)) {
-    return true;
+bool ICACHE_FLASH_ATTR IRrecv::copyFrame(irparams_t *dest) {
+  if (irparams.rcvstate != STATE_STOP) {
+    return false;
   }
-  /*
-#ifdef DEBUG
-  Serial.println("Attempting Sanyo decode");
-#endif
-  if (decodeSanyo(results)) {
+  copyIrParams(dest);
+  resume();
+  return true;
+}
+
+bool ICACHE_FLASH_ATTR IRrecv::decodeFrame(decode_results *results,
+                                           irparams_t *frame,
+                                           uint32_t protocols) {
+  results->rawbuf = frame->rawbuf;
+  results->rawlen = frame->rawlen;
+  results->overflow = frame->overflow;
+  return decodeProtocols(results, protocols);
+}
+
+bool ICACHE_FLASH_ATTR IRrecv::decodeProtocols(decode_results *results,
+                                               uint32_t protocols) {
+  if ((protocols & IR_PROTOCOL_BIT(NEC)) && decodeNEC(results))
     return true;
-  }*/
-#ifdef DEBUG
-  Serial.println("Attempting Mitsubishi decode");
-#endif
-  if (decodeMitsubishi(results)) {
+  if ((protocols & IR_PROTOCOL_BIT(SONY)) && decodeSony(results))
     return true;
-  }
-#ifdef DEBUG
-  Serial.println("Attempting RC5 decode");
-#endif
-  if (decodeRC5(results)) {
+  // Sanyo is left out, it matches too many other frames.
+  if ((protocols & IR_PROTOCOL_BIT(MITSUBISHI)) && decodeMitsubishi(results))
     return true;
-  }
-#ifdef DEBUG
-  Serial.println("Attempting RC6 decode");
-#endif
-  if (decodeRC6(results)) {
+  if ((protocols & IR_PROTOCOL_BIT(RC5)) && decodeRC5(results))
     return true;
-  }
-#ifdef DEBUG
-  Serial.println("Attempting RC-MM decode");
-#endif
-  if (decodeRCMM(results)) {
+  if ((protocols & IR_PROTOCOL_BIT(RC6)) && decodeRC6(results))
     return true;
-  }
-#ifdef DEBUG
-  Serial.println("Attempting Panasonic decode");
-#endif
-  if (decodePanasonic(results)) {
+  if ((protocols & IR_PROTOCOL_BIT(RCMM)) && decodeRCMM(results))
     return true;
-  }
-#ifdef DEBUG
-  Serial.println("Attempting LG decode");
-#endif
-  if (decodeLG(results)) {
-      return true;
-  }
-#ifdef DEBUG
-  Serial.println("Attempting JVC decode");
-#endif
-  if (decodeJVC(results)) {
+  if ((protocols & IR_PROTOCOL_BIT(PANASONIC)) && decodePanasonic(results))
     return true;
-  }
-#ifdef DEBUG
-  Serial.println("Attempting SAMSUNG decode");
-#endif
-  if (decodeSAMSUNG(results)) {
+  if ((protocols & IR_PROTOCOL_BIT(LG)) && decodeLG(results))
     return true;
-  }
-#ifdef DEBUG
-  Serial.println("Attempting Whynter decode");
-#endif
-  if (decodeWhynter(results)) {
+  if ((protocols & IR_PROTOCOL_BIT(JVC)) && decodeJVC(results))
     return true;
-  }
-#ifdef DEBUG
-  Serial.println("Attempting Denon decode");
-#endif
-  if (decodeDenon(results)) {
+  if ((protocols & IR_PROTOCOL_BIT(SAMSUNG)) && decodeSAMSUNG(results))
+    return true;
+  if ((protocols & IR_PROTOCOL_BIT(WHYNTER)) && decodeWhynter(results))
+    return true;
+  if ((protocols & IR_PROTOCOL_BIT(DENON)) && decodeDenon(results))
     return true;
-  }
   // decodeHash returns a hash on any input.
   // Thus, it needs to be last in the list.
   // If you add any decodes, add them before this.
-  if (decodeHash(results)) {
+  if ((protocols & IR_PROTOCOL_HASH) && decodeHash(results))
     return true;
-  }
-  // Throw away and start over
-  if (!resumed)  // Check if we have already resumed.
-    resume();
   return false;
 }
 
@@ -1585,7 +1581,7 @@ bool ICACHE_FLASH_ATTR IRrecv::decodeJVC(decode_results *results) {
   // Check for repeat
   if (results->rawlen - 1 == 33 &&
       matchMark(results->rawbuf[offset], JVC_BIT_MARK) &&
-      matchMark(results->rawbuf[irparams.rawlen-1], JVC_BIT_MARK)) {
+      matchMark(results->rawbuf[results->rawlen-1], JVC_BIT_MARK)) {
     results->bits = 0;
     results->value = REPEAT;
     results->decode_type = JVC;
@@ -92,6 +92,12 @@ public:
 // Decoded value for NEC when a repeat code is received
 #define REPEAT 0xffffffff
 
+// Protocol mask for decode(), a bit per decode_type_t. decodeHash() uses the
+// bit of UNUSED, it gives a hash for any frame the other decoders skipped.
+#define IR_PROTOCOL_BIT(type) (1UL << (type))
+#define IR_PROTOCOL_HASH      IR_PROTOCOL_BIT(UNUSED)
+#define IR_PROTOCOLS_ALL      0xFFFFFFFFUL
+
 #define SEND_PROTOCOL_NEC      case NEC: sendNEC(data, nbits); break;
 #define SEND_PROTOCOL_PIONEER  case PIONEER: sendPioneer(data, nbits, 1, 0ul); break;
 #define SEND_PROTOCOL_SONY     case SONY: sendSony(data, nbits); break;
@@ -114,12 +120,21 @@ class IRrecv
 public:
   IRrecv(int recvpin);
   bool decode(decode_results *results, irparams_t *save=NULL);
+  // Only try the protocols in the mask, see IR_PROTOCOL_BIT().
+  bool decode(decode_results *results, irparams_t *save, uint32_t protocols);
+  // Decode a frame taken earlier with copyFrame().
+  bool decodeFrame(decode_results *results, irparams_t *frame, uint32_t protocols);
+  // Copy a complete frame and restart the receiver. False when there is none.
+  bool copyFrame(irparams_t *dest);
+  // Called from the receive timer when a frame is complete, NULL to disable.
+  void setFrameCallback(void (*callback)());
   void enableIRIn();
   void disableIRIn();
   void resume();
   private:
   // These are called by decode
   void copyIrParams(irparams_t *dest);
+  bool decodeProtocols(decode_results *results, uint32_t protocols);
   int getRClevel(decode_results *results, int *offset, int *used, int t1);
   bool decodeNEC(decode_results *results);
   bool decodeSony(decode_results *results);
@@ -156,11 +171,22 @@ public:
 #define VIRTUAL
 #endif
 
+// Receives the marks and spaces instead of the IR LED, see IRsend::setRecorder()
+class IRsendRecorder
+{
+public:
+  virtual void carrier(int khz) = 0;
+  virtual void mark(unsigned int usec) = 0;
+  virtual void space(unsigned long usec) = 0;
+};
+
 class IRsend
 {
 public:
   IRsend(int IRsendPin);
   void begin();
+  // While set, the send functions return at once and the recorder gets the signal.
+  void setRecorder(IRsendRecorder* recorder) { _recorder = recorder; }
   void send(int type, unsigned long data, int nbits) {
     switch (type) {
         SEND_PROTOCOL_NEC
@@ -218,6 +244,7 @@ public:
 private:
   int halfPeriodicTime;
   int IRpin;
+  IRsendRecorder* _recorder;
   void sendMitsubishiACChunk(unsigned char data);
   void sendData(uint16_t onemark, uint32_t onespace,
                 uint16_t zeromark, uint32_t zerospace,
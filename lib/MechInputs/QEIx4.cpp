@@ -124,6 +124,8 @@ QEIx4::QEIx4()
 	_state = 0;
 	_limitMin = LONG_MIN;
 	_limitMax = LONG_MAX;
+	_changeCallback = NULL;
+	_changeArg = NULL;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -222,6 +224,8 @@ void QEIx4::processStateMachine()
 		}
 
 		if (bCounterChange) {   // has counter changed?
+			if (!_bHasChanged && _changeCallback)   // only the first change until read()
+				_changeCallback(_changeArg);
 			_bHasChanged = true;
 		}
 	}
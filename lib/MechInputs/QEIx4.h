@@ -98,6 +98,16 @@ public:
     return _bHasChanged;
   }
 
+	/** Sets a function called from the interrupt when the counter changes after the last read().
+	*
+	* @param        Function, must be in IRAM. NULL to remove
+	* @param        Argument passed to the function
+	*/
+	void setChangeCallback(void (*callback)(void* arg), void* arg=NULL) {
+		_changeArg = arg;
+		_changeCallback = callback;
+	}
+
   void loop();
 
 protected:
@@ -123,6 +133,8 @@ protected:
   long _limitMax;
 	uint16_t _state;
 	uint16_t _eMode;
+	void (*_changeCallback)(void* arg);
+	void* _changeArg;
 
 private:
 	static uint16_t __stateLUT[32];
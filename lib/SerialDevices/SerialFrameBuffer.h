@@ -0,0 +1,186 @@
+/*-------------------------------------------------------------------------
+  Frame synchronisation for serial sensors
+
+  Collects the bytes received from a sensor and finds the frames in them,
+  described by a SerialFrameFormat: the header bytes, a fixed length or a
+  length field, the checksum and an optional tail byte.
+  A complete frame is kept in place in the buffer and can be read with
+  Frame() and the GetXX() helpers until the next byte is added, no copy
+  is made.
+  When a byte does not fit the format (header, length, checksum or tail)
+  only the first byte is dropped, the next frame is searched for in the
+  bytes already received. So after a lost byte the following frame is
+  found again at once, instead of waiting for the buffer to run empty.
+
+  Part of the SerialDevices library, GNU Lesser General Public License.
+  -------------------------------------------------------------------------*/
+
+#ifndef _SERIALFRAMEBUFFER_H_
+#define _SERIALFRAMEBUFFER_H_
+
+#include "Arduino.h"
+
+#define SERIALFRAME_MAX_HEADER      4
+#define SERIALFRAME_NO_LENGTH_FIELD 0xFF
+
+enum SerialFrameChecksum : byte {
+  SERIALFRAME_CHECKSUM_NONE,
+  SERIALFRAME_CHECKSUM_SUM8,      // Sum of the bytes, 1 byte
+  SERIALFRAME_CHECKSUM_NEG_SUM8,  // Two's complement of the sum (MH-Z19), 1 byte
+  SERIALFRAME_CHECKSUM_SUM16_BE,  // Sum of the bytes, 2 bytes big endian (PMSx003)
+  SERIALFRAME_CHECKSUM_CRC16_LE   // Modbus CRC16, 2 bytes little endian
+};
+
+struct SerialFrameFormat
+{
+  byte header[SERIALFRAME_MAX_HEADER];
+  byte headerMask[SERIALFRAME_MAX_HEADER];  // 0x00 for a byte which may have any value
+  byte headerLength;
+  byte length;           // Frame length, or the maximum when there is a length field
+  byte lengthOffset;     // SERIALFRAME_NO_LENGTH_FIELD for frames of a fixed length
+  byte lengthSize;       // 1, or 2 for a big endian length field
+  byte lengthAdd;        // Added to the length field for the frame length
+  SerialFrameChecksum checksum;
+  byte checksumStart;    // First byte of the checksum, it runs up to the checksum
+  byte tailLength;       // 0 or 1, after the checksum
+  byte tail;
+};
+
+template <uint16_t SIZE>
+class SerialFrameBuffer
+{
+public:
+  SerialFrameBuffer(const SerialFrameFormat& format) :
+    _format(format), _count(0), _ready(false), _frames(0), _errors(0), _skipped(0) {}
+
+  void Clear() {
+    _count = 0;
+    _ready = false;
+  }
+
+  // Add a received byte. Returns true when it completes a frame.
+  bool AddData(byte b) {
+    if (_ready) Clear();
+    if (_count >= SIZE) Drop();
+    _buffer[_count++] = b;
+    byte state;
+    while ((state = Check()) == FRAME_INVALID) Drop();
+    if (state != FRAME_COMPLETE) return false;
+    _ready = true;
+    ++_frames;
+    return true;
+  }
+
+  // Add bytes up to the end of a frame. Returns the number of bytes used,
+  // check Available() for a frame and call again for the rest.
+  uint16_t AddData(const byte* data, uint16_t length) {
+    for (uint16_t i = 0; i < length; ++i)
+      if (AddData(data[i])) return i + 1;
+    return length;
+  }
+
+  // Complete frame, until the next byte is added.
+  bool Available() const        { return _ready; }
+  const byte* Frame() const     { return _buffer; }
+  uint16_t FrameLength() const  { return _ready ? _count : 0; }
+
+  byte Get8(uint16_t offset) const     { return _buffer[offset]; }
+  uint16_t Get16BE(uint16_t offset) const {
+    return (static_cast<uint16_t>(_buffer[offset]) << 8) | _buffer[offset + 1];
+  }
+  uint32_t Get24BE(uint16_t offset) const {
+    return (static_cast<uint32_t>(_buffer[offset]) << 16) | Get16BE(offset + 1);
+  }
+
+  // Frames found, checksum or tail errors and bytes dropped to find the next frame.
+  unsigned long Frames() const  { return _frames; }
+  unsigned long Errors() const  { return _errors; }
+  unsigned long Skipped() const { return _skipped; }
+
+  // Checksum of a frame to send, over the bytes from checksumStart up to length.
+  static uint16_t Checksum(SerialFrameChecksum type, const byte* data, uint16_t length) {
+    uint16_t sum = 0;
+    if (type == SERIALFRAME_CHECKSUM_CRC16_LE) {
+      sum = 0xFFFF;
+      for (uint16_t i = 0; i < length; ++i) {
+        sum ^= data[i];
+        for (byte bit = 0; bit < 8; ++bit)
+          sum = (sum & 1) ? (sum >> 1) ^ 0xA001 : sum >> 1;
+      }
+      return sum;
+    }
+    for (uint16_t i = 0; i < length; ++i)
+      sum += data[i];
+    switch (type) {
+      case SERIALFRAME_CHECKSUM_SUM8:     return sum & 0xFF;
+      case SERIALFRAME_CHECKSUM_NEG_SUM8: return (0x100 - (sum & 0xFF)) & 0xFF;
+      case SERIALFRAME_CHECKSUM_SUM16_BE: return sum;
+      default:                            return 0;
+    }
+  }
+
+private:
+  enum { FRAME_INCOMPLETE, FRAME_COMPLETE, FRAME_INVALID };
+
+  static byte ChecksumSize(SerialFrameChecksum type) {
+    switch (type) {
+      case SERIALFRAME_CHECKSUM_NONE:     return 0;
+      case SERIALFRAME_CHECKSUM_SUM8:
+      case SERIALFRAME_CHECKSUM_NEG_SUM8: return 1;
+      default:                            return 2;
+    }
+  }
+
+  // Drop the first byte, the next frame may start at the second one.
+  void Drop() {
+    if (_count == 0) return;
+    --_count;
+    memmove(_buffer, _buffer + 1, _count);
+    ++_skipped;
+  }
+
+  // Whether the bytes in the buffer are the start of a frame.
+  byte Check() {
+    for (byte i = 0; i < _format.headerLength && i < _count; ++i)
+      if ((_buffer[i] & _format.headerMask[i]) != (_format.header[i] & _format.headerMask[i]))
+        return FRAME_INVALID;
+    uint16_t length = _format.length;
+    if (_format.lengthOffset != SERIALFRAME_NO_LENGTH_FIELD) {
+      if (_count < _format.lengthOffset + _format.lengthSize) return FRAME_INCOMPLETE;
+      length = _buffer[_format.lengthOffset];
+      if (_format.lengthSize == 2) length = Get16BE(_format.lengthOffset);
+      length += _format.lengthAdd;
+      const byte minimum = _format.lengthOffset + _format.lengthSize + ChecksumSize(_format.checksum) + _format.tailLength;
+      if (length > _format.length || length > SIZE || length < minimum) return FRAME_INVALID;
+    }
+    if (_count < length) return FRAME_INCOMPLETE;
+
+    const byte checksumSize = ChecksumSize(_format.checksum);
+    const uint16_t checksumOffset = length - _format.tailLength - checksumSize;
+    if (_format.tailLength != 0 && _buffer[length - 1] != _format.tail) {
+      ++_errors;
+      return FRAME_INVALID;
+    }
+    if (checksumSize != 0) {
+      const uint16_t sum = Checksum(_format.checksum, _buffer + _format.checksumStart, checksumOffset - _format.checksumStart);
+      uint16_t expected = _buffer[checksumOffset];
+      if (_format.checksum == SERIALFRAME_CHECKSUM_SUM16_BE) expected = Get16BE(checksumOffset);
+      if (_format.checksum == SERIALFRAME_CHECKSUM_CRC16_LE) expected |= static_cast<uint16_t>(_buffer[checksumOffset + 1]) << 8;
+      if (sum != expected) {
+        ++_errors;
+        return FRAME_INVALID;
+      }
+    }
+    return FRAME_COMPLETE;
+  }
+
+  const SerialFrameFormat& _format;
+  byte _buffer[SIZE];
+  uint16_t _count;
+  bool _ready;
+  unsigned long _frames;
+  unsigned long _errors;
+  unsigned long _skipped;
+};
+
+#endif
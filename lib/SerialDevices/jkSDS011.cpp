@@ -25,7 +25,15 @@
 #ifdef ESP8266  // Needed for precompile issues.
 #include "jkSDS011.h"
 
-CjkSDS011::CjkSDS011(int16_t pinRX, int16_t pinTX)
+// Head 0xAA, command, 6 data bytes, the sum of the data bytes and tail 0xAB
+static const SerialFrameFormat SDS011_FRAME = {
+  { 0xAA }, { 0xFF }, 1,
+  10, SERIALFRAME_NO_LENGTH_FIELD, 0, 0,
+  SERIALFRAME_CHECKSUM_SUM8, 2,
+  1, 0xAB
+};
+
+CjkSDS011::CjkSDS011(int16_t pinRX, int16_t pinTX) : _data(SDS011_FRAME)
 {
   _sws = ! ( pinRX < 0 || pinRX == 3 );
   _pm2_5 = NAN;
@@ -34,11 +42,10 @@ CjkSDS011::CjkSDS011(int16_t pinRX, int16_t pinTX)
   _pm2_5avr = 0;
   _pm10_avr = 0;
   _avr = 0;
-  _data.SetPacketLength(10);
   _command.SetPacketLength(19);
   _working_period = -1;
   _sleepmode_active = false;
-  _serial = new ESPeasySoftwareSerial(pinRX, pinTX);
+  _serial = new ESPeasySoftwareSerial(pinRX, pinTX, false, 64, 200);  // Edges of 2 frames
   _serial->begin(9600);
 }
 
@@ -107,14 +114,14 @@ int CjkSDS011::GetWorkingPeriod() {
 }
 
 void CjkSDS011::ParseCommandReply() {
-  switch(_data[2]) {
+  switch(_data.Get8(2)) {
     case 6: // Enable/Disable sleep mode.
-      if (_data[3] == 0)
-        _sleepmode_active = _data[4];
+      if (_data.Get8(3) == 0)
+        _sleepmode_active = _data.Get8(4);
       break;
     case 8: // Set/Get working period
-      if (_data[3] == 0)
-        _working_period = _data[4];
+      if (_data.Get8(3) == 0)
+        _working_period = _data.Get8(4);
       break;
     default:
       // Not implemented.
@@ -126,25 +133,17 @@ void CjkSDS011::Process()
 {
   while (_serial->available())
   {
-  	_data.AddData(_serial->read());
-
-    if (_data[0] == 0xAA && _data[9] == 0xAB)   // correct packet frame?
+    if (_data.AddData(_serial->read()))   // correct packet frame and checksum
     {
-      byte checksum = 0;
-      for (byte i=2; i<= 7; i++)
-        checksum += _data[i];
-      if (checksum != _data[8])
-        continue;
-
-      switch(_data[1]) {
+      switch(_data.Get8(1)) {
         case 0xC0:     // SDS011 or SDS018?
-          _pm2_5 = (float)((_data[3] << 8) | _data[2]) * 0.1;
-          _pm10_ = (float)((_data[5] << 8) | _data[4]) * 0.1;
+          _pm2_5 = (float)((_data.Get8(3) << 8) | _data.Get8(2)) * 0.1;
+          _pm10_ = (float)((_data.Get8(5) << 8) | _data.Get8(4)) * 0.1;
           _available = true;
           break;
         case 0xCF:    // SDS198?
-          _pm2_5 = (float)((_data[5] << 8) | _data[4]);
-          _pm10_ = (float)((_data[3] << 8) | _data[2]);
+          _pm2_5 = (float)((_data.Get8(5) << 8) | _data.Get8(4));
+          _pm10_ = (float)((_data.Get8(3) << 8) | _data.Get8(2));
           _available = true;
           break;
         case 0xC5:   // Reply on command ID 0xB4
@@ -29,6 +29,7 @@
 #include "Arduino.h"
 //#include "SensorSerial.h"
 #include "SensorSerialBuffer.h"
+#include "SerialFrameBuffer.h"
 #include "ESPeasySoftwareSerial.h"
 
 
@@ -65,7 +66,7 @@ private:
 
 //  SensorSerial _serial;
   ESPeasySoftwareSerial *_serial;
-  CSensorSerialBuffer _data;
+  SerialFrameBuffer<10> _data;
   CSensorSerialBuffer _command;
   float _pm2_5;
   float _pm10_;
@@ -60,41 +60,29 @@ class SH1106Wire : public OLEDDisplay {
 
     void display(void) {
       #ifdef OLEDDISPLAY_DOUBLE_BUFFER
-        uint8_t minBoundY = ~0;
-        uint8_t maxBoundY = 0;
-
-        uint8_t minBoundX = ~0;
-        uint8_t maxBoundX = 0;
-
         uint8_t x, y;
 
-        // Calculate the Y bounding box of changes
+        // Send only the changed columns of each 8 pixel page which changed,
         // and copy buffer[pos] to buffer_back[pos];
+        byte k = 0;
         for (y = 0; y < (DISPLAY_HEIGHT / 8); y++) {
+          uint8_t minBoundX = ~0;
+          uint8_t maxBoundX = 0;
           for (x = 0; x < DISPLAY_WIDTH; x++) {
            uint16_t pos = x + y * DISPLAY_WIDTH;
            if (buffer[pos] != buffer_back[pos]) {
-             minBoundY = _min(minBoundY, y);
-             maxBoundY = _max(maxBoundY, y);
              minBoundX = _min(minBoundX, x);
              maxBoundX = _max(maxBoundX, x);
            }
            buffer_back[pos] = buffer[pos];
-         }
-         yield();
-        }
-
-        // If the minBoundY wasn't updated
-        // we can savely assume that buffer_back[pos] == buffer[pos]
-        // holdes true for all values of pos
-        if (minBoundY == ~0) return;
+          }
+          // Page unchanged
+          if (minBoundX == (uint8_t)(~0)) continue;
 
-        // Calculate the colum offset
-        uint8_t minBoundXp2H = (minBoundX + 2) & 0x0F;
-        uint8_t minBoundXp2L = 0x10 | ((minBoundX + 2) >> 4 );
+          // Calculate the colum offset
+          uint8_t minBoundXp2H = (minBoundX + 2) & 0x0F;
+          uint8_t minBoundXp2L = 0x10 | ((minBoundX + 2) >> 4 );
 
-        byte k = 0;
-        for (y = minBoundY; y <= maxBoundY; y++) {
           sendCommand(0xB0 + y);
           sendCommand(minBoundXp2H);
           sendCommand(minBoundXp2L);
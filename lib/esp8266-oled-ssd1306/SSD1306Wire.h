@@ -56,44 +56,33 @@ class SSD1306Wire : public OLEDDisplay {
     void display(void) {
       const int x_offset = (128 - this->width()) / 2;
       #ifdef OLEDDISPLAY_DOUBLE_BUFFER
-        uint8_t minBoundY = ~0;
-        uint8_t maxBoundY = 0;
-
-        uint8_t minBoundX = ~0;
-        uint8_t maxBoundX = 0;
         uint8_t x, y;
 
-        // Calculate the Y bounding box of changes
+        // Send only the changed columns of each 8 pixel page which changed,
         // and copy buffer[pos] to buffer_back[pos];
         for (y = 0; y < (this->height() / 8); y++) {
+          uint8_t minBoundX = ~0;
+          uint8_t maxBoundX = 0;
           for (x = 0; x < this->width(); x++) {
            uint16_t pos = x + y * this->width();
            if (buffer[pos] != buffer_back[pos]) {
-             minBoundY = _min(minBoundY, y);
-             maxBoundY = _max(maxBoundY, y);
              minBoundX = _min(minBoundX, x);
              maxBoundX = _max(maxBoundX, x);
            }
            buffer_back[pos] = buffer[pos];
-         }
-         yield();
-        }
-
-        // If the minBoundY wasn't updated
-        // we can savely assume that buffer_back[pos] == buffer[pos]
-        // holdes true for all values of pos
-         if (minBoundY == (uint8_t)(~0)) return;
+          }
+          // Page unchanged
+          if (minBoundX == (uint8_t)(~0)) continue;
 
-        sendCommand(COLUMNADDR);
-        sendCommand(x_offset + minBoundX);
-        sendCommand(x_offset + maxBoundX);
+          sendCommand(COLUMNADDR);
+          sendCommand(x_offset + minBoundX);
+          sendCommand(x_offset + maxBoundX);
 
-        sendCommand(PAGEADDR);
-        sendCommand(minBoundY);
-        sendCommand(maxBoundY);
+          sendCommand(PAGEADDR);
+          sendCommand(y);
+          sendCommand(y);
 
-        byte k = 0;
-        for (y = minBoundY; y <= maxBoundY; y++) {
+          byte k = 0;
           for (x = minBoundX; x <= maxBoundX; x++) {
             if (k == 0) {
               Wire.beginTransmission(_address);
@@ -106,12 +95,11 @@ class SSD1306Wire : public OLEDDisplay {
               k = 0;
             }
           }
+          if (k != 0) {
+            Wire.endTransmission();
+          }
           yield();
         }
-
-        if (k != 0) {
-          Wire.endTransmission();
-        }
       #else
 
         sendCommand(COLUMNADDR);
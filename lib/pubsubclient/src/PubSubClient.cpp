@@ -9,6 +9,7 @@
 
 PubSubClient::PubSubClient() {
     this->_state = MQTT_DISCONNECTED;
+    this->_publishRemaining = 0;
     this->_client = NULL;
     this->stream = NULL;
     setCallback(NULL);
@@ -16,24 +17,28 @@ PubSubClient::PubSubClient() {
 
 PubSubClient::PubSubClient(Client& client) {
     this->_state = MQTT_DISCONNECTED;
+    this->_publishRemaining = 0;
     setClient(client);
     this->stream = NULL;
 }
 
 PubSubClient::PubSubClient(IPAddress addr, uint16_t port, Client& client) {
     this->_state = MQTT_DISCONNECTED;
+    this->_publishRemaining = 0;
     setServer(addr, port);
     setClient(client);
     this->stream = NULL;
 }
 PubSubClient::PubSubClient(IPAddress addr, uint16_t port, Client& client, Stream& stream) {
     this->_state = MQTT_DISCONNECTED;
+    this->_publishRemaining = 0;
     setServer(addr,port);
     setClient(client);
     setStream(stream);
 }
 PubSubClient::PubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client) {
     this->_state = MQTT_DISCONNECTED;
+    this->_publishRemaining = 0;
     setServer(addr, port);
     setCallback(callback);
     setClient(client);
@@ -41,6 +46,7 @@ PubSubClient::PubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATUR
 }
 PubSubClient::PubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client, Stream& stream) {
     this->_state = MQTT_DISCONNECTED;
+    this->_publishRemaining = 0;
     setServer(addr,port);
     setCallback(callback);
     setClient(client);
@@ -49,18 +55,21 @@ PubSubClient::PubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATUR
 
 PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, Client& client) {
     this->_state = MQTT_DISCONNECTED;
+    this->_publishRemaining = 0;
     setServer(ip, port);
     setClient(client);
     this->stream = NULL;
 }
 PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, Client& client, Stream& stream) {
     this->_state = MQTT_DISCONNECTED;
+    this->_publishRemaining = 0;
     setServer(ip,port);
     setClient(client);
     setStream(stream);
 }
 PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client) {
     this->_state = MQTT_DISCONNECTED;
+    this->_publishRemaining = 0;
     setServer(ip, port);
     setCallback(callback);
     setClient(client);
@@ -68,6 +77,7 @@ PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE,
 }
 PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client, Stream& stream) {
     this->_state = MQTT_DISCONNECTED;
+    this->_publishRemaining = 0;
     setServer(ip,port);
     setCallback(callback);
     setClient(client);
@@ -76,18 +86,21 @@ PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE,
 
 PubSubClient::PubSubClient(const char* domain, uint16_t port, Client& client) {
     this->_state = MQTT_DISCONNECTED;
+    this->_publishRemaining = 0;
     setServer(domain,port);
     setClient(client);
     this->stream = NULL;
 }
 PubSubClient::PubSubClient(const char* domain, uint16_t port, Client& client, Stream& stream) {
     this->_state = MQTT_DISCONNECTED;
+    this->_publishRemaining = 0;
     setServer(domain,port);
     setClient(client);
     setStream(stream);
 }
 PubSubClient::PubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client) {
     this->_state = MQTT_DISCONNECTED;
+    this->_publishRemaining = 0;
     setServer(domain,port);
     setCallback(callback);
     setClient(client);
@@ -95,6 +108,7 @@ PubSubClient::PubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGN
 }
 PubSubClient::PubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGNATURE, Client& client, Stream& stream) {
     this->_state = MQTT_DISCONNECTED;
+    this->_publishRemaining = 0;
     setServer(domain,port);
     setCallback(callback);
     setClient(client);
@@ -423,6 +437,69 @@ boolean PubSubClient::publish_P(const char* topic, const uint8_t* payload, unsig
     return rc == tlen + 3 + llen + plength;
 }
 
+boolean PubSubClient::beginPublish(const char* topic, unsigned long plength, boolean retained) {
+    if (!connected()) {
+        return false;
+    }
+    // Maximum remaining length of an MQTT packet
+    if (plength > 268435455UL - 2 - strlen(topic)) {
+        return false;
+    }
+    // Leave room in the buffer for header and variable length field
+    uint16_t length = 5;
+    length = writeString(topic,buffer,length);
+    uint8_t header = MQTTPUBLISH;
+    if (retained) {
+        header |= 1;
+    }
+    uint8_t lenBuf[4];
+    uint8_t llen = 0;
+    uint8_t digit;
+    unsigned long len = plength + length - 5;
+    do {
+        digit = len % 128;
+        len = len / 128;
+        if (len > 0) {
+            digit |= 0x80;
+        }
+        lenBuf[llen++] = digit;
+    } while(len>0);
+
+    buffer[4-llen] = header;
+    for (int i=0;i<llen;i++) {
+        buffer[5-llen+i] = lenBuf[i];
+    }
+    const uint16_t hlen = length - (4-llen);
+    uint16_t rc = _client->write(buffer+(4-llen),hlen);
+    lastOutActivity = millis();
+    _publishRemaining = plength;
+    return (rc == hlen);
+}
+
+boolean PubSubClient::endPublish() {
+    const boolean result = (_publishRemaining == 0);
+    _publishRemaining = 0;
+    return result;
+}
+
+size_t PubSubClient::write(uint8_t data) {
+    return write(&data, 1);
+}
+
+size_t PubSubClient::write(const uint8_t *buf, size_t size) {
+    if (size > _publishRemaining) {
+        // More than announced in beginPublish(), would corrupt the stream
+        size = _publishRemaining;
+    }
+    if (size == 0) {
+        return 0;
+    }
+    size_t rc = _client->write(buf,size);
+    _publishRemaining -= rc;
+    lastOutActivity = millis();
+    return rc;
+}
+
 boolean PubSubClient::write(uint8_t header, uint8_t* buf, uint16_t length) {
     uint8_t lenBuf[4];
     uint8_t llen = 0;
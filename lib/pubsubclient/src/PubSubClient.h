@@ -81,7 +81,7 @@
 #define MQTT_CALLBACK_SIGNATURE void (*callback)(char*, uint8_t*, unsigned int)
 #endif
 
-class PubSubClient {
+class PubSubClient : public Print {
 private:
    Client* _client;
    uint8_t buffer[MQTT_MAX_PACKET_SIZE];
@@ -100,6 +100,7 @@ private:
    uint16_t port;
    Stream* stream;
    int _state;
+   unsigned long _publishRemaining;
 public:
    PubSubClient();
    PubSubClient(Client& client);
@@ -134,6 +135,14 @@ public:
    boolean publish(const char* topic, const uint8_t * payload, unsigned int plength);
    boolean publish(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
    boolean publish_P(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
+   // Start to publish a message, the payload is written directly to the client using
+   // write() and not staged in the packet buffer, so it is not limited by MQTT_MAX_PACKET_SIZE.
+   // Exactly plength bytes must be written before calling endPublish().
+   boolean beginPublish(const char* topic, unsigned long plength, boolean retained);
+   // Returns true when the complete payload was written.
+   boolean endPublish();
+   virtual size_t write(uint8_t);
+   virtual size_t write(const uint8_t *buffer, size_t size);
    boolean subscribe(const char* topic);
    boolean subscribe(const char* topic, uint8_t qos);
    boolean unsubscribe(const char* topic);
@@ -34,6 +34,19 @@ sections = OrderedDict([
 ])
 
 
+# Functions marked HOT_IRAM_ATTR in the source, placed in IRAM with -DFEATURE_IRAM_HOT
+hot_iram_functions = [
+    "timeDiff",
+    "timePassedSince",
+    "usecPassedSince",
+    "timeOutReached",
+    "handle_schedule",
+    "msecTimerHandlerStruct::getNextId",
+    "getPluginId",
+    "findPluginIndex",
+    "Plugin_003_pulsecheck",
+]
+
 def abort(txt):
     raise(Exception("error: "+txt))
 
@@ -83,6 +96,51 @@ def analyse_memory(elfFile):
     # print("Free IRam : %d" % usedIRAM)
     return(ret)
 
+# size and section of the functions in the list
+def analyse_functions(elfFile, functions):
+    command = "%s -t -C '%s' " % (objectDumpBin, elfFile)
+    response = subprocess.check_output(shlex.split(command))
+    if isinstance(response, bytes):
+        response = response.decode('utf-8')
+    ret={}
+    for line in response.split('\n'):
+        # 40100f2c g     F .text	00000038 timeDiff(unsigned long, unsigned long)
+        if '\t' not in line:
+            continue
+        (left, right) = line.split('\t', 1)
+        fields = right.split(' ', 1)
+        if len(fields) < 2:
+            continue
+        name = fields[1].split('(')[0]
+        if name in functions:
+            ret[name] = (left.split()[-1], int(fields[0], 16))
+    return(ret)
+
+# IRAM budget of the hot set: build with and without FEATURE_IRAM_HOT
+def analyse_iram():
+    subprocess.check_call("platformio run --silent --environment "+env, shell=True)
+    base=analyse_memory(".pioenvs/"+env+"/firmware.elf")
+    os.environ["PLATFORMIO_BUILD_FLAGS"] = "-DFEATURE_IRAM_HOT"
+    try:
+        subprocess.check_call("platformio run --silent --environment "+env, shell=True)
+    finally:
+        del os.environ["PLATFORMIO_BUILD_FLAGS"]
+    hot=analyse_memory(".pioenvs/"+env+"/firmware.elf")
+    functions=analyse_functions(".pioenvs/"+env+"/firmware.elf", hot_iram_functions)
+
+    output_format="{:<40}|{:<14}|{:<11}"
+    print(output_format.format("function", "section", "bytes"))
+    for name in hot_iram_functions:
+        if name in functions:
+            (section, size) = functions[name]
+            print(output_format.format(name, section, size))
+        else:
+            print(output_format.format(name, "not linked", ""))
+
+    print("\nIRAM used without FEATURE_IRAM_HOT: %d" % base['text'])
+    print("IRAM used with FEATURE_IRAM_HOT   : %d (+%d)" % (hot['text'], hot['text'] - base['text']))
+    print("IRAM free with FEATURE_IRAM_HOT   : %d of %d" % (TOTAL_IRAM - hot['text'], TOTAL_IRAM))
+
 # reenable all plugins and libs
 def enable_all():
 
@@ -116,14 +174,19 @@ try:
 
 
     ################### start
-    if len(sys.argv) < 1:
-        print("Usage: \n\t%s%s <path_to_objdump>" % sys.argv[0])
+    if len(sys.argv) < 2:
+        print("Usage: \n\t%s <path_to_objdump> [plugins...]\n\t%s <path_to_objdump> --iram" % (sys.argv[0], sys.argv[0]))
         sys.exit(1)
 
     objectDumpBin = sys.argv[1]
 
     enable_all()
 
+    if len(sys.argv) > 2 and sys.argv[2] == "--iram":
+        print("Analysing the IRAM use of FEATURE_IRAM_HOT for env {} ...\n".format(env))
+        analyse_iram()
+        sys.exit(0)
+
 
     #get list of all plugins
     plugins=glob.glob("src/_[CPN]*.ino")
@@ -0,0 +1,170 @@
+//********************************************************************************
+// Timed bit-bang transfers
+// For sensors with a two wire protocol of their own, like the HX711 and SHT1X.
+// The clock loops run from IRAM with a fixed pulse width. Interrupts are
+// blocked during the high phase of every clock pulse only: a WiFi interrupt can
+// make the gap between two bits longer, which these sensors allow, but not a
+// clock pulse. The HX711 powers down when the clock is high for 60 usec.
+// bitBangReadyBegin() sends the task PLUGIN_INTERRUPT_EVENT with
+// event->Par1 = BITBANG_EVENT_READY on the falling edge of a data ready line,
+// once per bitBangReadyArm(), so the line does not have to be polled.
+//********************************************************************************
+#define BITBANG_PULSE_USEC           1    // Clock high and low time
+#define BITBANG_READY_SLOTS          2
+#define BITBANG_EVENT_READY       0xF2    // Interrupt event type, next to the SerialRx ones
+
+#if defined(ESP32)
+  portMUX_TYPE bitBangMux = portMUX_INITIALIZER_UNLOCKED;
+  #define BITBANG_LOCK      portENTER_CRITICAL(&bitBangMux);
+  #define BITBANG_UNLOCK    portEXIT_CRITICAL(&bitBangMux);
+#else
+  #define BITBANG_LOCK      { const uint32_t savedPS = xt_rsil(15);
+  #define BITBANG_UNLOCK    xt_wsr_ps(savedPS); }
+#endif
+
+struct BitBangReadyStruct
+{
+  BitBangReadyStruct() : pin(-1), TaskIndex(-1), armed(false) {}
+
+  int8_t pin;
+  int8_t TaskIndex;
+  volatile bool armed;
+} bitBangReady[BITBANG_READY_SLOTS];
+
+struct BitBangStatsStruct
+{
+  BitBangStatsStruct() : transfers(0), readyEvents(0), errors(0) {}
+
+  unsigned long transfers;
+  unsigned long readyEvents;
+  unsigned long errors;       // Reported by the plugins, see bitBangError()
+} bitBangStats;
+
+uint32_t bitBangShiftIn(int8_t dataPin, int8_t clockPin, byte bits) ICACHE_RAM_ATTR;
+void bitBangShiftOut(int8_t dataPin, int8_t clockPin, uint32_t value, byte bits) ICACHE_RAM_ATTR;
+void bitBangPulses(int8_t clockPin, byte count) ICACHE_RAM_ATTR;
+void bitBangReadyEdge(byte slot) ICACHE_RAM_ATTR;
+void bitBangReadyInterrupt0() ICACHE_RAM_ATTR;
+void bitBangReadyInterrupt1() ICACHE_RAM_ATTR;
+
+// Reads 'bits' bits, MSB first. The data line is sampled at the end of the clock high phase.
+uint32_t bitBangShiftIn(int8_t dataPin, int8_t clockPin, byte bits) {
+  uint32_t value = 0;
+  for (byte i = 0; i < bits; ++i) {
+    BITBANG_LOCK
+    digitalWrite(clockPin, HIGH);
+    delayMicroseconds(BITBANG_PULSE_USEC);
+    value = (value << 1) | (digitalRead(dataPin) ? 1 : 0);
+    digitalWrite(clockPin, LOW);
+    BITBANG_UNLOCK
+    delayMicroseconds(BITBANG_PULSE_USEC);
+  }
+  ++bitBangStats.transfers;
+  return value;
+}
+
+// Writes 'bits' bits, MSB first. The data pin must be an output.
+void bitBangShiftOut(int8_t dataPin, int8_t clockPin, uint32_t value, byte bits) {
+  for (byte i = bits; i > 0; --i) {
+    digitalWrite(dataPin, (value >> (i - 1)) & 1);
+    delayMicroseconds(BITBANG_PULSE_USEC);
+    BITBANG_LOCK
+    digitalWrite(clockPin, HIGH);
+    delayMicroseconds(BITBANG_PULSE_USEC);
+    digitalWrite(clockPin, LOW);
+    BITBANG_UNLOCK
+  }
+  ++bitBangStats.transfers;
+}
+
+// Clock pulses without data, e.g. the HX711 gain selection.
+void bitBangPulses(int8_t clockPin, byte count) {
+  for (byte i = 0; i < count; ++i) {
+    BITBANG_LOCK
+    digitalWrite(clockPin, HIGH);
+    delayMicroseconds(BITBANG_PULSE_USEC);
+    digitalWrite(clockPin, LOW);
+    BITBANG_UNLOCK
+    delayMicroseconds(BITBANG_PULSE_USEC);
+  }
+}
+
+// A read which failed the validation of the plugin, counted in the stats.
+void bitBangError() {
+  ++bitBangStats.errors;
+}
+
+//********************************************************************************
+// Data ready interrupt
+//********************************************************************************
+void bitBangReadyEdge(byte slot) {
+  BitBangReadyStruct& ready = bitBangReady[slot];
+  // Only the first edge, the data bits which follow toggle the line as well.
+  if (!ready.armed) return;
+  ready.armed = false;
+  ++bitBangStats.readyEvents;
+  pushInterruptEvent(ready.TaskIndex, BITBANG_EVENT_READY, 0);
+}
+
+void bitBangReadyInterrupt0() {
+  bitBangReadyEdge(0);
+}
+
+void bitBangReadyInterrupt1() {
+  bitBangReadyEdge(1);
+}
+
+// Returns false when all slots are in use, the plugin then has to poll the line.
+bool bitBangReadyBegin(byte TaskIndex, int8_t pin) {
+  bitBangReadyEnd(TaskIndex);
+  if (pin < 0) return false;
+  for (byte slot = 0; slot < BITBANG_READY_SLOTS; ++slot) {
+    if (bitBangReady[slot].TaskIndex < 0) {
+      bitBangReady[slot].pin = pin;
+      bitBangReady[slot].TaskIndex = TaskIndex;
+      bitBangReady[slot].armed = true;
+      if (slot == 0) attachInterrupt(pin, bitBangReadyInterrupt0, FALLING);
+      else           attachInterrupt(pin, bitBangReadyInterrupt1, FALLING);
+      return true;
+    }
+  }
+  addLog(LOG_LEVEL_ERROR, F("BitBang: No free data ready interrupt"));
+  return false;
+}
+
+void bitBangReadyEnd(byte TaskIndex) {
+  for (byte slot = 0; slot < BITBANG_READY_SLOTS; ++slot) {
+    if (bitBangReady[slot].TaskIndex == TaskIndex) {
+      detachInterrupt(bitBangReady[slot].pin);
+      bitBangReady[slot].armed = false;
+      bitBangReady[slot].pin = -1;
+      bitBangReady[slot].TaskIndex = -1;
+    }
+  }
+}
+
+// Wait for the next falling edge, after the data of the previous one has been read.
+void bitBangReadyArm(byte TaskIndex) {
+  for (byte slot = 0; slot < BITBANG_READY_SLOTS; ++slot) {
+    if (bitBangReady[slot].TaskIndex == TaskIndex)
+      bitBangReady[slot].armed = true;
+  }
+}
+
+bool bitBangReadyUsed(byte TaskIndex) {
+  for (byte slot = 0; slot < BITBANG_READY_SLOTS; ++slot) {
+    if (bitBangReady[slot].TaskIndex == TaskIndex) return true;
+  }
+  return false;
+}
+
+// Bit-bang stats as: transfers/ready events/errors
+String getBitBangStats() {
+  String result;
+  result += bitBangStats.transfers;
+  result += '/';
+  result += bitBangStats.readyEvents;
+  result += '/';
+  result += bitBangStats.errors;
+  return result;
+}
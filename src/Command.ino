@@ -22,154 +22,133 @@
 
 /*********************************************************************************************\
  * Registers command
+ * Keep the table sorted on the (lower case) command name, it is searched with a binary search.
 \*********************************************************************************************/
-bool doExecuteCommand(const char * cmd, struct EventStruct *event, const char* line) {
-  // Simple macro to match command to function call.
-  #define COMMAND_CASE(S,C) if (strcmp_P(cmd_lc, PSTR(S)) == 0) return (C(event,line));
+typedef bool (*CommandFunction)(struct EventStruct *event, const char* line);
 
-  String tmpcmd;
-  tmpcmd = cmd;
-  tmpcmd.toLowerCase();
-  String log = F("Command: ");
-  log += tmpcmd;
-  addLog(LOG_LEVEL_INFO, log);
-  char cmd_lc[INPUT_COMMAND_SIZE];
-  tmpcmd.toCharArray(cmd_lc, tmpcmd.length() + 1);
-  switch (cmd_lc[0]) {
-    case 'a': {
-	  COMMAND_CASE("accessinfo"             , Command_AccessInfo_Ls);              // Network Command
-      break;
-    }
-    case 'b': {
-	  COMMAND_CASE("background"             , Command_Background);                 // Diagnostic.h
-    #ifdef CPLUGIN_012
-	  COMMAND_CASE("blynkget"               , Command_Blynk_Get);
-    #endif
-	  COMMAND_CASE("build"                  , Command_Settings_Build);             // Settings.h
-      break;
-    }
-    case 'c': {
-	  COMMAND_CASE("clearaccessblock"       , Command_AccessInfo_Clear);           // Network Command
-	  COMMAND_CASE("clearrtcram"            , Command_RTC_Clear);                  // RTC.h
-	  COMMAND_CASE("config"                 , Command_Task_RemoteConfig);          // Tasks.h
-      break;
-    }
-    case 'd': {
-	  COMMAND_CASE("debug"                  , Command_Debug);                      // Diagnostic.h
-	  COMMAND_CASE("deepsleep"              , Command_System_deepSleep);           // System.h
-	  COMMAND_CASE("delay"                  , Command_Delay);                      // Timers.h
-	  COMMAND_CASE("dns"                    , Command_DNS);                        // Network Command
-	  COMMAND_CASE("dst"                    , Command_DST);                        // Time.h
-      break;
-    }
-    case 'e': {
-	  COMMAND_CASE("erase"                  , Command_WiFi_Erase);                 // WiFi.h
-	  COMMAND_CASE("event"                  , Command_Rules_Events);               // Rule.h
-	  COMMAND_CASE("executerules"           , Command_Rules_Execute);              // Rule.h
-      break;
-    }
-    case 'g': {
-	  COMMAND_CASE("gateway"                , Command_Gateway);                    // Network Command
-      break;
-    }
-    case 'i': {
-	  COMMAND_CASE("i2cscanner"             , Command_i2c_Scanner);                // i2c.h
-	  COMMAND_CASE("ip"                     , Command_IP);                         // Network Command
-      break;
-    }
-    case 'l': {
-	  COMMAND_CASE("load"                   , Command_Settings_Load);              // Settings.h
-	  COMMAND_CASE("logentry"               , Command_logentry);                   // Diagnostic.h
-	  COMMAND_CASE("lowmem"                 , Command_Lowmem);                     // Diagnostic.h
-      break;
-    }
-    case 'm': {
-	  COMMAND_CASE("malloc"                 , Command_Malloc);                     // Diagnostic.h
-	  COMMAND_CASE("meminfo"                , Command_MemInfo);                    // Diagnostic.h
-    COMMAND_CASE("meminfodetail"          , Command_MemInfo_detail);             // Diagnostic.h
-	  COMMAND_CASE("messagedelay"           , Command_MQTT_messageDelay);          // MQTT.h
-	  COMMAND_CASE("mqttretainflag"         , Command_MQTT_Retain);                // MQTT.h
-      break;
-    }
-    case 'n': {
-	  COMMAND_CASE("name"                   , Command_Settings_Name);              // Settings.h
-	  COMMAND_CASE("nosleep"                , Command_System_NoSleep);             // System.h
-	  COMMAND_CASE("notify"                 , Command_Notifications_Notify);       // Notifications.h
-	  COMMAND_CASE("ntphost"                , Command_NTPHost);                    // Time.h
-      break;
-    }
-    case 'p': {
-	  COMMAND_CASE("password"               , Command_Settings_Password);          // Settings.h
-	  COMMAND_CASE("publish"                , Command_MQTT_Publish);               // MQTT.h
-      break;
-    }
-    case 'r': {
-	  COMMAND_CASE("reboot"                 , Command_System_Reboot);              // System.h
-	  COMMAND_CASE("reset"                  , Command_Settings_Reset);             // Settings.h
-	  COMMAND_CASE("resetflashwritecounter" , Command_RTC_resetFlashWriteCounter); // RTC.h
-	  COMMAND_CASE("restart"                , Command_System_Restart);             // System.h
-	  COMMAND_CASE("rules"                  , Command_Rules_UseRules);             // Rule.h
-      break;
-    }
-    case 's': {
-	  COMMAND_CASE("save"                   , Command_Settings_Save);              // Settings.h
-	#if FEATURE_SD
-	  COMMAND_CASE("sdcard"                 , Command_SD_LS);                      // SDCARDS.h
-	  COMMAND_CASE("sdremove"               , Command_SD_Remove);                  // SDCARDS.h
-	#endif
-	  COMMAND_CASE("sendto"                 , Command_UPD_SendTo);                 // UDP.h
-	  COMMAND_CASE("sendtohttp"             , Command_HTTP_SendToHTTP);            // HTTP.h
-	  COMMAND_CASE("sendtoudp"              , Command_UDP_SendToUPD);              // UDP.h
-	  COMMAND_CASE("serialfloat"            , Command_SerialFloat);                // Diagnostic.h
-	  COMMAND_CASE("settings"               , Command_Settings_Print);             // Settings.h
-	  COMMAND_CASE("subnet"                 , Command_Subnet);                     // Network Command
-	  COMMAND_CASE("sysload"                , Command_SysLoad);                    // Diagnostic.h
-      break;
-    }
-    case 't': {
-	  COMMAND_CASE("taskclear"              , Command_Task_Clear);                 // Tasks.h
-	  COMMAND_CASE("taskclearall"           , Command_Task_ClearAll);              // Tasks.h
-	  COMMAND_CASE("taskrun"                , Command_Task_Run);                   // Tasks.h
-	  COMMAND_CASE("taskvalueset"           , Command_Task_ValueSet);              // Tasks.h
-	  COMMAND_CASE("taskvaluesetandrun"     , Command_Task_ValueSetAndRun);        // Tasks.h
-	  COMMAND_CASE("timerpause"             , Command_Timer_Pause);                // Timers.h
-	  COMMAND_CASE("timerresume"            , Command_Timer_Resume);               // Timers.h
-	  COMMAND_CASE("timerset"               , Command_Timer_Set);                  // Timers.h
-	  COMMAND_CASE("timezone"               , Command_TimeZone);                   // Time.h
-      break;
-    }
-    case 'u': {
-	  COMMAND_CASE("udpport"                , Command_UDP_Port);                   // UDP.h
-	  COMMAND_CASE("udptest"                , Command_UDP_Test);                   // UDP.h
-	  COMMAND_CASE("unit"                   , Command_Settings_Unit);              // Settings.h
-	  COMMAND_CASE("usentp"                 , Command_useNTP);                     // Time.h
-      break;
-    }
-    case 'w': {
-	  COMMAND_CASE("wdconfig"               , Command_WD_Config);                  // WD.h
-	  COMMAND_CASE("wdread"                 , Command_WD_Read);                    // WD.h
-	  COMMAND_CASE("wifiapmode"             , Command_Wifi_APMode);                // WiFi.h
-	  COMMAND_CASE("wificonnect"            , Command_Wifi_Connect);               // WiFi.h
-	  COMMAND_CASE("wifidisconnect"         , Command_Wifi_Disconnect);            // WiFi.h
-	  COMMAND_CASE("wifikey"                , Command_Wifi_Key);                   // WiFi.h
-	  COMMAND_CASE("wifikey2"               , Command_Wifi_Key2);                  // WiFi.h
-	  COMMAND_CASE("wifimode"               , Command_Wifi_Mode);                  // WiFi.h
-	  COMMAND_CASE("wifiscan"               , Command_Wifi_Scan);                  // WiFi.h
-	  COMMAND_CASE("wifissid"               , Command_Wifi_SSID);                  // WiFi.h
-	  COMMAND_CASE("wifissid2"              , Command_Wifi_SSID2);                 // WiFi.h
-	  COMMAND_CASE("wifistamode"            , Command_Wifi_STAMode);               // WiFi.h
-      break;
-    }
-    default:
-      break;
+struct CommandTableEntry {
+  char name[23];  // Longest command + 1
+  CommandFunction function;
+};
+
+const CommandTableEntry commandTable[] PROGMEM = {
+  { "accessinfo",             Command_AccessInfo_Ls },                // Network Command
+  { "background",             Command_Background },                   // Diagnostic.h
+  { "benchmark",              Command_Benchmark },                    // Diagnostic.h
+#ifdef CPLUGIN_012
+  { "blynkget",               Command_Blynk_Get },
+#endif
+  { "build",                  Command_Settings_Build },               // Settings.h
+  { "clearaccessblock",       Command_AccessInfo_Clear },             // Network Command
+  { "clearrtcram",            Command_RTC_Clear },                    // RTC.h
+  { "config",                 Command_Task_RemoteConfig },            // Tasks.h
+  { "debug",                  Command_Debug },                        // Diagnostic.h
+  { "deepsleep",              Command_System_deepSleep },             // System.h
+  { "delay",                  Command_Delay },                        // Timers.h
+  { "dns",                    Command_DNS },                          // Network Command
+  { "dst",                    Command_DST },                          // Time.h
+  { "erase",                  Command_WiFi_Erase },                   // WiFi.h
+  { "event",                  Command_Rules_Events },                 // Rule.h
+  { "executerules",           Command_Rules_Execute },                // Rule.h
+  { "gateway",                Command_Gateway },                      // Network Command
+  { "i2cscanner",             Command_i2c_Scanner },                  // i2c.h
+  { "ip",                     Command_IP },                           // Network Command
+  { "load",                   Command_Settings_Load },                // Settings.h
+  { "logentry",               Command_logentry },                     // Diagnostic.h
+  { "lowmem",                 Command_Lowmem },                       // Diagnostic.h
+  { "malloc",                 Command_Malloc },                       // Diagnostic.h
+  { "meminfo",                Command_MemInfo },                      // Diagnostic.h
+  { "meminfodetail",          Command_MemInfo_detail },               // Diagnostic.h
+  { "messagedelay",           Command_MQTT_messageDelay },            // MQTT.h
+  { "mqttretainflag",         Command_MQTT_Retain },                  // MQTT.h
+  { "name",                   Command_Settings_Name },                // Settings.h
+  { "nosleep",                Command_System_NoSleep },               // System.h
+  { "notify",                 Command_Notifications_Notify },         // Notifications.h
+  { "ntphost",                Command_NTPHost },                      // Time.h
+  { "password",               Command_Settings_Password },            // Settings.h
+  { "publish",                Command_MQTT_Publish },                 // MQTT.h
+  { "reboot",                 Command_System_Reboot },                // System.h
+  { "reset",                  Command_Settings_Reset },               // Settings.h
+  { "resetflashwritecounter", Command_RTC_resetFlashWriteCounter },   // RTC.h
+  { "restart",                Command_System_Restart },               // System.h
+  { "rules",                  Command_Rules_UseRules },               // Rule.h
+  { "rulesbenchmark",         Command_Rules_Benchmark },              // Rule.h
+  { "save",                   Command_Settings_Save },                // Settings.h
+#ifdef FEATURE_SCHEDULER_PROBE
+  { "schedulerprobe",         Command_SchedulerProbe },               // Diagnostic.h
+#endif
+#if FEATURE_SD
+  { "sdcard",                 Command_SD_LS },                        // SDCARDS.h
+  { "sdremove",               Command_SD_Remove },                    // SDCARDS.h
+#endif
+  { "sendto",                 Command_UPD_SendTo },                   // UDP.h
+  { "sendtoack",              Command_UPD_SendToAck },                // UDP.h
+  { "sendtohttp",             Command_HTTP_SendToHTTP },              // HTTP.h
+  { "sendtoudp",              Command_UDP_SendToUPD },                // UDP.h
+  { "serialbatch",            Command_SerialBatch },                  // Diagnostic.h
+  { "serialfloat",            Command_SerialFloat },                  // Diagnostic.h
+  { "settings",               Command_Settings_Print },               // Settings.h
+  { "subnet",                 Command_Subnet },                       // Network Command
+  { "sysload",                Command_SysLoad },                      // Diagnostic.h
+  { "taskclear",              Command_Task_Clear },                   // Tasks.h
+  { "taskclearall",           Command_Task_ClearAll },                // Tasks.h
+  { "taskrun",                Command_Task_Run },                     // Tasks.h
+  { "taskvalueset",           Command_Task_ValueSet },                // Tasks.h
+  { "taskvaluesetandrun",     Command_Task_ValueSetAndRun },          // Tasks.h
+  { "timerpause",             Command_Timer_Pause },                  // Timers.h
+  { "timerresume",            Command_Timer_Resume },                 // Timers.h
+  { "timerset",               Command_Timer_Set },                    // Timers.h
+  { "timerset_ms",            Command_Timer_Set_ms },                 // Timers.h
+  { "timezone",               Command_TimeZone },                     // Time.h
+  { "timingbaseline",         Command_TimingBaseline },               // Diagnostic.h
+  { "udpport",                Command_UDP_Port },                     // UDP.h
+  { "udptest",                Command_UDP_Test },                     // UDP.h
+  { "unit",                   Command_Settings_Unit },                // Settings.h
+  { "usentp",                 Command_useNTP },                       // Time.h
+  { "wdconfig",               Command_WD_Config },                    // WD.h
+  { "wdread",                 Command_WD_Read },                      // WD.h
+  { "wifiapmode",             Command_Wifi_APMode },                  // WiFi.h
+  { "wificonnect",            Command_Wifi_Connect },                 // WiFi.h
+  { "wifidisconnect",         Command_Wifi_Disconnect },              // WiFi.h
+  { "wifikey",                Command_Wifi_Key },                     // WiFi.h
+  { "wifikey2",               Command_Wifi_Key2 },                    // WiFi.h
+  { "wifimode",               Command_Wifi_Mode },                    // WiFi.h
+  { "wifiscan",               Command_Wifi_Scan },                    // WiFi.h
+  { "wifissid",               Command_Wifi_SSID },                    // WiFi.h
+  { "wifissid2",              Command_Wifi_SSID2 },                   // WiFi.h
+  { "wifistamode",            Command_Wifi_STAMode },                 // WiFi.h
+};
+
+// Lower cases cmd in place.
+bool doExecuteCommand(char * cmd, struct EventStruct *event, const char* line) {
+  for (char* c = cmd; *c != 0; ++c)
+    *c = tolower(*c);
+  if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+    String log = F("Command: ");
+    log += cmd;
+    addLog(LOG_LEVEL_INFO, log);
+  }
+  int first = 0;
+  int last = sizeof(commandTable) / sizeof(commandTable[0]) - 1;
+  while (first <= last) {
+    const int middle = (first + last) / 2;
+    const int compare = strcmp_P(cmd, commandTable[middle].name);
+    if (compare == 0) {
+      CommandFunction function = reinterpret_cast<CommandFunction>(pgm_read_dword(&commandTable[middle].function));
+      return function(event, line);
+    }
+    if (compare < 0)
+      last = middle - 1;
+    else
+      first = middle + 1;
+  }
+  if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+    String errorUnknown = F("Command unknown: \"");
+    errorUnknown += cmd;
+    errorUnknown += '\"';
+    addLog(LOG_LEVEL_INFO, errorUnknown);
   }
-  String errorUnknown = F("Command unknown: \"");
-  errorUnknown += cmd_lc;
-  errorUnknown += '\"';
-  addLog(LOG_LEVEL_INFO, errorUnknown);
   return false;
-
-  #undef COMMAND_CASE
 }
 
 void ExecuteCommand(byte source, const char *Line)
@@ -177,22 +156,24 @@ void ExecuteCommand(byte source, const char *Line)
   checkRAM(F("ExecuteCommand"));
   String status = "";
   boolean success = false;
-  char TmpStr1[INPUT_COMMAND_SIZE];
-  TmpStr1[0] = 0;
   char cmd[INPUT_COMMAND_SIZE];
   cmd[0] = 0;
-  struct EventStruct TempEvent;
+  PooledEvent pooled;
+  struct EventStruct& TempEvent = *pooled.event;
   // FIXME TD-er: Not sure what happens now, but TaskIndex cannot be set here
   // since commands can originate from anywhere.
   TempEvent.Source = source;
-  GetArgv(Line, cmd, 1);
-  if (GetArgv(Line, TmpStr1, 2)) TempEvent.Par1 = str2int(TmpStr1);
-  if (GetArgv(Line, TmpStr1, 3)) TempEvent.Par2 = str2int(TmpStr1);
-  if (GetArgv(Line, TmpStr1, 4)) TempEvent.Par3 = str2int(TmpStr1);
-  if (GetArgv(Line, TmpStr1, 5)) TempEvent.Par4 = str2int(TmpStr1);
-  if (GetArgv(Line, TmpStr1, 6)) TempEvent.Par5 = str2int(TmpStr1);
+  CommandArgsStruct args;
+  parseCommandArgs(args, Line);
+  getCommandArg(args, 1, cmd, INPUT_COMMAND_SIZE);
+  TempEvent.Par1 = getCommandArgInt(args, 2);
+  TempEvent.Par2 = getCommandArgInt(args, 3);
+  TempEvent.Par3 = getCommandArgInt(args, 4);
+  TempEvent.Par4 = getCommandArgInt(args, 5);
+  TempEvent.Par5 = getCommandArgInt(args, 6);
+  TempEvent.Args = &args;
 
-  success = doExecuteCommand((char*)&cmd[0], &TempEvent, Line);
+  success = doExecuteCommand(cmd, &TempEvent, Line);
   yield();
 
   if (success)
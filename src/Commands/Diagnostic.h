@@ -29,6 +29,13 @@ bool Command_SysLoad(struct EventStruct *event, const char* Line)
   return success;
 }
 
+// serialbatch,1 lets a serial console line hold several commands, separated by ';'
+bool Command_SerialBatch(struct EventStruct *event, const char* Line)
+{
+  setSerialBatchMode(event->Par1 != 0);
+  return true;
+}
+
 bool Command_SerialFloat(struct EventStruct *event, const char* Line)
 {
   bool success = true;
@@ -94,11 +101,166 @@ bool Command_Background(struct EventStruct *event, const char* Line)
   return success;
 }
 
+/*********************************************************************************************\
+ * Micro benchmark of the rules, formula and command parsing functions and the scheduler
+ * benchmark[,<msec per case>]
+ * Prints a JSON array with per case the number of calls, usec per call and the free heap
+ * change over all calls (negative = kept). Run it on an idle node, the loop is blocked.
+\*********************************************************************************************/
+void benchmarkCalculate() {
+  float result;
+  Calculate("(23.5*1.8)+32", &result);
+}
+
+void benchmarkCalculateLong() {
+  float result;
+  Calculate("((1013.25/(1-0.0065*420/(12.5+273.15))^5.255)-3)*0.9", &result);
+}
+
+// As a task value formula, compiled once.
+void benchmarkFormulaCompiled() {
+  static CompiledFormulaStruct compiled;
+  if (compiled.code.empty()) {
+    RPNProgram program;
+    compileFormula("(%value%*1.8)+32", true, program);
+    compiled.code.assign(program.code, program.code + program.codeLength);
+    compiled.constants.assign(program.constants, program.constants + program.constantCount);
+  }
+  evaluateFormula(compiled.code.data(), compiled.code.size(), compiled.constants.data(), 23.5, 0);
+}
+
+void benchmarkParseTemplate() {
+  String tmp = F("Name: %sysname% Up: %uptime% min Time: %systime% Load: %sysload%");
+  parseTemplate(tmp, tmp.length());
+}
+
+// [task#value] placeholders of the first enabled task with a named value, see Command_Benchmark
+String benchmarkTaskTemplate;
+
+void benchmarkParseTemplateTask() {
+  parseTemplate(benchmarkTaskTemplate, 0);
+}
+
+void benchmarkRuleMatch() {
+  static const RuleEventStruct event(F("Switch#State=1"));
+  String rule = F("switch#state=1");
+  ruleMatch(event, rule);
+}
+
+void benchmarkRuleMatchCompare() {
+  static const RuleEventStruct event(F("Bme280#Temperature=22.75"), 22.75);
+  String rule = F("bme280#temperature>20");
+  ruleMatch(event, rule);
+}
+
+void benchmarkConditionMatch() {
+  conditionMatch(F("22.75 >= 20"));
+}
+
+void benchmarkParseString() {
+  parseString(F("pulse,12,1,500"), 3);
+}
+
+void benchmarkGetArgv() {
+  char arg[INPUT_COMMAND_SIZE];
+  GetArgv("pulse,12,1,500", arg, 4);
+}
+
+void benchmarkCommandArgs() {
+  CommandArgsStruct args;
+  parseCommandArgs(args, "pulse,12,1,500");
+  getCommandArgInt(args, 2);
+  getCommandArgInt(args, 3);
+  getCommandArgInt(args, 4);
+}
+
+void benchmarkTimeStringToSeconds() {
+  timeStringToSeconds(F("12:34:56"));
+}
+
+void benchmarkScheduler() {
+  msecTimerHandlerStruct handler;
+  const unsigned long now = millis();
+  for (unsigned long id = 1; id <= 32; ++id)
+    handler.registerAt(id, now - 1000 + (id * 7919) % 1000);
+  unsigned long timer;
+  while (handler.getNextId(timer) != 0) {}
+}
+
+void runBenchmarkCase(const __FlashStringHelper* name, void (*function)(), unsigned long duration, String& result) {
+  unsigned long calls = 0;
+  const unsigned long freeBefore = FreeMem();
+  const unsigned long start = micros();
+  while (usecPassedSince(start) < static_cast<long>(duration * 1000)) {
+    for (byte i = 0; i < 10; ++i)
+      function();
+    calls += 10;
+    delay(0);
+  }
+  const long usec = usecPassedSince(start);
+  const long heapChange = static_cast<long>(FreeMem()) - static_cast<long>(freeBefore);
+  if (result.length() > 1) result += ',';
+  result += F("\n{\"name\":\"");
+  result += name;
+  result += F("\",\"calls\":");
+  result += calls;
+  result += F(",\"usec\":");
+  result += static_cast<float>(usec) / calls;
+  result += F(",\"per_sec\":");
+  result += static_cast<unsigned long>(calls * 1000000.0 / usec);
+  result += F(",\"heap\":");
+  result += heapChange;
+  result += '}';
+}
+
+bool Command_Benchmark(struct EventStruct *event, const char* Line)
+{
+  const unsigned long duration = (event->Par1 > 0 && event->Par1 <= 5000) ? event->Par1 : 200;
+  String result = F("[");
+  runBenchmarkCase(F("Calculate"), benchmarkCalculate, duration, result);
+  runBenchmarkCase(F("CalculateLong"), benchmarkCalculateLong, duration, result);
+  runBenchmarkCase(F("formulaCompiled"), benchmarkFormulaCompiled, duration, result);
+  runBenchmarkCase(F("parseTemplate"), benchmarkParseTemplate, duration, result);
+  for (byte x = 0; x < TASKS_MAX && benchmarkTaskTemplate.length() == 0; x++) {
+    if (!Settings.TaskDeviceEnabled[x]) continue;
+    LoadTaskSettings(x);
+    if (ExtraTaskSettings.TaskDeviceName[0] == 0 || ExtraTaskSettings.TaskDeviceValueNames[0][0] == 0) continue;
+    String placeholder = '[';
+    placeholder += ExtraTaskSettings.TaskDeviceName;
+    placeholder += '#';
+    placeholder += ExtraTaskSettings.TaskDeviceValueNames[0];
+    benchmarkTaskTemplate = F("Value: ");
+    benchmarkTaskTemplate += placeholder;
+    benchmarkTaskTemplate += F("] Formatted: ");
+    benchmarkTaskTemplate += placeholder;
+    benchmarkTaskTemplate += F("#D2.1#P6] Out: ");
+    benchmarkTaskTemplate += placeholder;
+    benchmarkTaskTemplate += F("#O]");
+  }
+  if (benchmarkTaskTemplate.length() != 0) {
+    runBenchmarkCase(F("parseTemplateTask"), benchmarkParseTemplateTask, duration, result);
+    benchmarkTaskTemplate = String();
+  }
+  runBenchmarkCase(F("ruleMatch"), benchmarkRuleMatch, duration, result);
+  runBenchmarkCase(F("ruleMatchCompare"), benchmarkRuleMatchCompare, duration, result);
+  runBenchmarkCase(F("conditionMatch"), benchmarkConditionMatch, duration, result);
+  runBenchmarkCase(F("parseString"), benchmarkParseString, duration, result);
+  runBenchmarkCase(F("GetArgv"), benchmarkGetArgv, duration, result);
+  runBenchmarkCase(F("commandArgs"), benchmarkCommandArgs, duration, result);
+  runBenchmarkCase(F("timeStringToSeconds"), benchmarkTimeStringToSeconds, duration, result);
+  runBenchmarkCase(F("scheduler32"), benchmarkScheduler, duration, result);
+  result += F("\n]");
+  Serial.println(result);
+  if (printToWeb)
+    printWebString += result;
+  return true;
+}
+
 
 bool Command_Debug(struct EventStruct *event, const char* Line)
 {
   char TmpStr1[INPUT_COMMAND_SIZE];
-  if (GetArgv(Line, TmpStr1, 2)) {
+  if (GetArgv(event, Line, TmpStr1, 2)) {
     setLogLevelFor(LOG_TO_SERIAL, event->Par1);
   }
   else{
@@ -109,6 +271,48 @@ bool Command_Debug(struct EventStruct *event, const char* Line)
   return true;
 }
 
+// timingbaseline,save[,<threshold %>] or timingbaseline,clear, see TimingBaseline.ino
+bool Command_TimingBaseline(struct EventStruct *event, const char* Line)
+{
+  String subcommand = parseString(Line, 2);
+  if (subcommand == F("save")) {
+    const int saved = saveTimingBaseline(event->Par2 > 0 ? event->Par2 : 0);
+    Serial.print(F("Timing baseline: "));
+    Serial.print(saved);
+    Serial.println(F(" stats saved"));
+    return saved > 0;
+  }
+  if (subcommand == F("clear")) {
+    clearTimingBaseline();
+    return true;
+  }
+  return false;
+}
+
+#ifdef FEATURE_SCHEDULER_PROBE
+// schedulerprobe arms a timer of each type (schedulerprobe,<type> only of that type),
+// schedulerprobe,check shows the types they were dispatched as.
+bool Command_SchedulerProbe(struct EventStruct *event, const char* Line)
+{
+  String subcommand = parseString(Line, 2);
+  if (subcommand.length() == 0) {
+    armSchedulerProbes(0);
+    return true;
+  }
+  if (event->Par1 > 0 && event->Par1 <= UDP_GROUP_TIMER) {
+    armSchedulerProbes(event->Par1);
+    return true;
+  }
+  if (subcommand != F("check"))
+    return false;
+  const String result = getSchedulerProbeResult();
+  Serial.println(result);
+  if (printToWeb)
+    printWebString += result;
+  return true;
+}
+#endif // FEATURE_SCHEDULER_PROBE
+
 bool Command_logentry(struct EventStruct *event, const char* Line)
 {
   return true;
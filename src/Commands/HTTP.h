@@ -5,9 +5,8 @@
 bool Command_HTTP_SendToHTTP(struct EventStruct *event, const char* Line)
 {
   if (wifiStatus == ESPEASY_WIFI_SERVICES_INITIALIZED) {
-      String strLine = Line;
-      String host = parseString(strLine, 2);
-      String port = parseString(strLine, 3);
+      String host = parseCommandArg(event, Line, 2, false, true);
+      String port = parseCommandArg(event, Line, 3, false, true);
       if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
         String log = F("SendToHTTP: Host: ");
         log += host;
@@ -16,7 +15,7 @@ bool Command_HTTP_SendToHTTP(struct EventStruct *event, const char* Line)
         addLog(LOG_LEVEL_DEBUG, log);
       }
       if (!isInt(port)) return false;
-      String path = parseStringToEndKeepCase(strLine, 4);
+      String path = parseCommandArg(event, Line, 4, true, false);
       if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
         String log = F("SendToHTTP: Path: ");
         log += path;
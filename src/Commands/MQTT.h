@@ -21,7 +21,7 @@ bool Command_MQTT_UseUnitNameAsClientId(struct EventStruct *event, const char* L
 bool Command_MQTT_messageDelay(struct EventStruct *event, const char* Line)
 {
   char TmpStr1[INPUT_COMMAND_SIZE];
-  if (GetArgv(Line, TmpStr1, 2)) {
+  if (GetArgv(event, Line, TmpStr1, 2)) {
     Settings.MessageDelay = event->Par1;
   }
   else{
@@ -6,7 +6,7 @@ bool Command_Notifications_Notify(struct EventStruct *event, const char* Line)
 {
   char TmpStr1[INPUT_COMMAND_SIZE];
   String message = "";
-  if (GetArgv(Line, TmpStr1, 3))
+  if (GetArgv(event, Line, TmpStr1, 3))
     message = TmpStr1;
 
   if (event->Par1 > 0)
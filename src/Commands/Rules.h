@@ -8,7 +8,7 @@ bool Command_Rules_Execute (struct EventStruct *event, const char* Line)
 {
    bool success = true;
    char TmpStr1[INPUT_COMMAND_SIZE];
-   if (GetArgv(Line, TmpStr1, 2))
+   if (GetArgv(event, Line, TmpStr1, 2))
    {
     String fileName = TmpStr1;
     String event = "";
@@ -36,4 +36,75 @@ bool Command_Rules_Events(struct EventStruct *event, const char* Line)
   return true;
 }
 
+// rulesbenchmark,<events>,<names>,<from file>
+// Processes the events Bench#E<n>=<value>, n cycling through 0..<names>-1, without the
+// rules queue. Shows the events/sec, usec per event, heap change and the rules files read
+// as JSON. With <from file> 1 the rules cache is released during the run.
+bool Command_Rules_Benchmark(struct EventStruct *event, const char* Line)
+{
+  const unsigned long events = (event->Par1 > 0 && event->Par1 <= 100000) ? event->Par1 : 100;
+  const unsigned long names = event->Par2 > 0 ? event->Par2 : 1;
+  const bool fromFile = event->Par3 != 0;
+  if (fromFile) {
+    for (byte x = 0; x < RULESETS_MAX; x++)
+      releaseCompiledRuleSet(x);
+  }
+  const unsigned long cacheHits = rulesCacheHits;
+  const unsigned long cacheMisses = rulesCacheMisses;
+  const unsigned long fileReads = rulesFileReads;
+  const unsigned long freeBefore = FreeMem();
+  unsigned long freeMin = freeBefore;
+  unsigned long usecMax = 0;
+  String text;
+  const unsigned long start = micros();
+  for (unsigned long i = 0; i < events; ++i) {
+    text = F("Bench#E");
+    text += i % names;
+    text += '=';
+    text += i % 100;
+    const unsigned long eventStart = micros();
+    const RuleEventStruct ruleEvent(text);
+    rulesProcessingNow(ruleEvent);
+    const unsigned long usec = usecPassedSince(eventStart);
+    if (usec > usecMax) usecMax = usec;
+    const unsigned long freeHeap = FreeMem();
+    if (freeHeap < freeMin) freeMin = freeHeap;
+    delay(0);
+  }
+  const long usec = usecPassedSince(start);
+  const long heapChange = static_cast<long>(FreeMem()) - static_cast<long>(freeBefore);
+  if (fromFile)
+    checkRuleSets();
+
+  String result = F("{\"events\":");
+  result += events;
+  result += F(",\"names\":");
+  result += names;
+  result += F(",\"from_file\":");
+  result += fromFile ? 1 : 0;
+  result += F(",\"per_sec\":");
+  result += static_cast<unsigned long>(events * 1000000.0 / usec);
+  result += F(",\"usec\":");
+  result += static_cast<float>(usec) / events;
+  result += F(",\"usec_max\":");
+  result += usecMax;
+  result += F(",\"heap\":");
+  result += heapChange;
+  result += F(",\"heap_min\":");
+  result += static_cast<long>(freeMin) - static_cast<long>(freeBefore);
+  result += F(",\"sets_cached\":");
+  result += rulesCacheHits - cacheHits;
+  result += F(",\"sets_file\":");
+  result += rulesCacheMisses - cacheMisses;
+  result += F(",\"file_reads\":");
+  result += rulesFileReads - fileReads;
+  result += F(",\"cache_bytes\":");
+  result += getCompiledRuleSetsBytes();
+  result += '}';
+  Serial.println(result);
+  if (printToWeb)
+    printWebString += result;
+  return true;
+}
+
 #endif // COMMAND_RULES_H
\ No newline at end of file
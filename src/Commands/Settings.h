@@ -5,7 +5,7 @@
 bool Command_Settings_Build(struct EventStruct *event, const char* Line)
 {
   char TmpStr1[INPUT_COMMAND_SIZE];
-  if (GetArgv(Line, TmpStr1, 2)) {
+  if (GetArgv(event, Line, TmpStr1, 2)) {
     Settings.Build = event->Par1;
   }
   else{
@@ -19,7 +19,7 @@ bool Command_Settings_Build(struct EventStruct *event, const char* Line)
 bool Command_Settings_Unit(struct EventStruct *event, const char* Line)
 {
   char TmpStr1[INPUT_COMMAND_SIZE];
-  if (GetArgv(Line, TmpStr1, 2)) {
+  if (GetArgv(event, Line, TmpStr1, 2)) {
     Settings.Unit = event->Par1;
   }
   else{
@@ -66,20 +66,21 @@ bool Command_Settings_Load(struct EventStruct *event, const char* Line)
 bool Command_Settings_Print(struct EventStruct *event, const char* Line)
 {
   char str[20];
-  Serial.println();
-
-  Serial.println(F("System Info"));
   IPAddress ip = WiFi.localIP();
   sprintf_P(str, PSTR("%u.%u.%u.%u"), ip[0], ip[1], ip[2], ip[3]);
-  Serial.print(F("  IP Address    : ")); Serial.println(str);
-  Serial.print(F("  Build         : ")); Serial.println((int)BUILD);
-  Serial.print(F("  Name          : ")); Serial.println(Settings.Name);
-  Serial.print(F("  Unit          : ")); Serial.println((int)Settings.Unit);
-  Serial.print(F("  WifiSSID      : ")); Serial.println(SecuritySettings.WifiSSID);
-  Serial.print(F("  WifiKey       : ")); Serial.println(SecuritySettings.WifiKey);
-  Serial.print(F("  WifiSSID2     : ")); Serial.println(SecuritySettings.WifiSSID2);
-  Serial.print(F("  WifiKey2      : ")); Serial.println(SecuritySettings.WifiKey2);
-  Serial.print(F("  Free mem      : ")); Serial.println(FreeMem());
+
+  String reply;
+  reply += F("\r\nSystem Info\r\n");
+  reply += F("  IP Address    : "); reply += str; reply += F("\r\n");
+  reply += F("  Build         : "); reply += (int)BUILD; reply += F("\r\n");
+  reply += F("  Name          : "); reply += Settings.Name; reply += F("\r\n");
+  reply += F("  Unit          : "); reply += (int)Settings.Unit; reply += F("\r\n");
+  reply += F("  WifiSSID      : "); reply += SecuritySettings.WifiSSID; reply += F("\r\n");
+  reply += F("  WifiKey       : "); reply += SecuritySettings.WifiKey; reply += F("\r\n");
+  reply += F("  WifiSSID2     : "); reply += SecuritySettings.WifiSSID2; reply += F("\r\n");
+  reply += F("  WifiKey2      : "); reply += SecuritySettings.WifiKey2; reply += F("\r\n");
+  reply += F("  Free mem      : "); reply += FreeMem();
+  serialConsolePrintln(reply);
   return true;
 }
 
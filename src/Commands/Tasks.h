@@ -22,11 +22,12 @@ bool Command_Task_ValueSet(struct EventStruct *event, const char* Line)
 {
   bool success = true;
   char TmpStr1[INPUT_COMMAND_SIZE];
-  if (GetArgv(Line, TmpStr1, 4))
+  if (GetArgv(event, Line, TmpStr1, 4))
   {
     float result = 0;
     Calculate(TmpStr1, &result);
     UserVar[(VARS_PER_TASK * (event->Par1 - 1)) + event->Par2 - 1] = result;
+    publishTaskValues(event->Par1 - 1);
   }
   else
   {
@@ -40,7 +41,7 @@ bool Command_Task_ValueSetAndRun(struct EventStruct *event, const char* Line)
 {
   bool success = true;
   char TmpStr1[INPUT_COMMAND_SIZE];
-  if (GetArgv(Line, TmpStr1, 4))
+  if (GetArgv(event, Line, TmpStr1, 4))
   {
     float result = 0;
     Calculate(TmpStr1, &result);
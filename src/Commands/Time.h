@@ -14,7 +14,7 @@ bool Command_NTPHost (struct EventStruct *event, const char* Line)
 bool Command_useNTP (struct EventStruct *event, const char* Line)
 {
   char TmpStr1[INPUT_COMMAND_SIZE];
-  if (GetArgv(Line, TmpStr1, 2)) {
+  if (GetArgv(event, Line, TmpStr1, 2)) {
     Settings.UseNTP = event->Par1;
   }
   else{
@@ -28,7 +28,7 @@ bool Command_useNTP (struct EventStruct *event, const char* Line)
 bool Command_TimeZone (struct EventStruct *event, const char* Line)
 {
   char TmpStr1[INPUT_COMMAND_SIZE];
-  if (GetArgv(Line, TmpStr1, 2)) {
+  if (GetArgv(event, Line, TmpStr1, 2)) {
     Settings.TimeZone = event->Par1;
   }
   else{
@@ -42,7 +42,7 @@ bool Command_TimeZone (struct EventStruct *event, const char* Line)
 bool Command_DST (struct EventStruct *event, const char* Line)
 {
   char TmpStr1[INPUT_COMMAND_SIZE];
-  if (GetArgv(Line, TmpStr1, 2)) {
+  if (GetArgv(event, Line, TmpStr1, 2)) {
     Settings.DST = event->Par1;
   }
   else{
@@ -1,27 +1,22 @@
 #ifndef COMMAND_TIMER_H
 #define COMMAND_TIMER_H
 
-
-bool Command_Timer_Set (struct EventStruct *event, const char* Line)
+// The timers run in the scheduler, see setRulesTimer()
+bool Command_Timer_Set_Msec (struct EventStruct *event, unsigned long msec)
 {
   bool success = false;
   if (event->Par1>=1 && event->Par1<=RULES_TIMER_MAX)
   {
       success = true;
-      int timerId= event->Par1-1;
-      if (event->Par2)
+      if (msec)
       {
         //start new timer
-        RulesTimer[timerId].interval = event->Par2*1000;
-        RulesTimer[timerId].paused = false;
-        RulesTimer[timerId].timestamp = millis() + (1000 * event->Par2);
+        setRulesTimer(event->Par1, msec);
       }
       else
       {
         //disable existing timer
-        RulesTimer[timerId].interval = 0;
-        RulesTimer[timerId].paused = false;
-        RulesTimer[timerId].timestamp = 0L;
+        clearRulesTimer(event->Par1);
       }
   }
   else
@@ -31,23 +26,29 @@ bool Command_Timer_Set (struct EventStruct *event, const char* Line)
   return success;
 }
 
+bool Command_Timer_Set (struct EventStruct *event, const char* Line)
+{
+  return Command_Timer_Set_Msec(event, event->Par2 > 0 ? 1000UL * event->Par2 : 0);
+}
+
+bool Command_Timer_Set_ms (struct EventStruct *event, const char* Line)
+{
+  return Command_Timer_Set_Msec(event, event->Par2 > 0 ? event->Par2 : 0);
+}
+
 bool Command_Timer_Pause (struct EventStruct *event, const char* Line)
 {
   bool success = false;
   if (event->Par1>=1 && event->Par1<=RULES_TIMER_MAX)
   {
       success = true;
-      int timerId = event->Par1-1;
-      if (RulesTimer[timerId].paused == false)
+      if (!rulesTimerPaused(event->Par1))
       {
-        long delta = timePassedSince(RulesTimer[timerId].timestamp);
-        if(RulesTimer[timerId].timestamp != 0L && delta < 0)
+        if (pauseRulesTimer(event->Par1))
         {
           String eventName = F("Rules#TimerPause=");
           eventName += event->Par1;
           rulesProcessing(eventName);
-          RulesTimer[timerId].paused = true;
-          RulesTimer[timerId].interval = -delta; // set remaind time
         }
       }
       else
@@ -68,17 +69,12 @@ bool Command_Timer_Resume (struct EventStruct *event, const char* Line)
   if (event->Par1>=1 && event->Par1<=RULES_TIMER_MAX)
   {
       success = true;
-      int timerId = event->Par1-1;
-      if (RulesTimer[timerId].paused == true)
+      if (rulesTimerPaused(event->Par1))
       {
-        if(RulesTimer[timerId].interval > 0 && RulesTimer[timerId].timestamp != 0L)
-        {
-          String eventName = F("Rules#TimerResume=");
-          eventName += event->Par1;
-          rulesProcessing(eventName);
-          RulesTimer[timerId].timestamp = millis() + (RulesTimer[timerId].interval);
-          RulesTimer[timerId].paused = false;
-        }
+        String eventName = F("Rules#TimerResume=");
+        eventName += event->Par1;
+        rulesProcessing(eventName);
+        resumeRulesTimer(event->Par1);
       }
       else
       {
@@ -21,29 +21,50 @@ bool Command_UDP_Port(struct EventStruct *event, const char* Line)
    1);
 }
 
-bool Command_UPD_SendTo(struct EventStruct *event, const char* Line)
+// <units>,<command>, units as a unit number (0 = all known nodes, one message each),
+// or a group like "2;5;9", "2-7" or "*" for all nodes, sent in one datagram.
+bool Command_UPD_SendToUnits(const char* Line, byte nameLength, bool ack)
 {
   String eventName = Line;
-  eventName = eventName.substring(7);
+  eventName = eventName.substring(nameLength);
   int index = eventName.indexOf(',');
-  if (index > 0)
+  if (index <= 0)
+    return true;
+  String units = eventName.substring(0, index);
+  units.trim();
+  eventName = eventName.substring(index + 1);
+  if (!ack && isInt(units))
   {
-    eventName = eventName.substring(index + 1);
-    SendUDPCommand(event->Par1, (char*)eventName.c_str(), eventName.length());
+    SendUDPCommand(units.toInt(), (char*)eventName.c_str(), eventName.length());
+    return true;
   }
+  uint32_t mask = 0;
+  if (!parseUnitMask(units, mask))
+    return false;
+  sendUDPGroupCommand(mask, eventName, ack);
   return true;
 }
 
+bool Command_UPD_SendTo(struct EventStruct *event, const char* Line)
+{
+  return Command_UPD_SendToUnits(Line, 7, false);
+}
+
+// Like sendto, each unit acknowledges, the units which did not are sent it again.
+bool Command_UPD_SendToAck(struct EventStruct *event, const char* Line)
+{
+  return Command_UPD_SendToUnits(Line, 10, true);
+}
+
 
 bool Command_UDP_SendToUPD(struct EventStruct *event, const char* Line)
 {
   bool success = false;
   if (wifiStatus == ESPEASY_WIFI_SERVICES_INITIALIZED) {
-    String strLine = Line;
-    String ip = parseString(strLine, 2);
-    String port = parseString(strLine, 3);
+    String ip = parseCommandArg(event, Line, 2, false, true);
+    String port = parseCommandArg(event, Line, 3, false, true);
     if (!isInt(port)) return success;
-    String message = parseStringToEndKeepCase(strLine, 4);
+    String message = parseCommandArg(event, Line, 4, true, false);
     IPAddress UDP_IP;
     if(UDP_IP.fromString(ip)) {
       portUDP.beginPacket(UDP_IP, port.toInt());
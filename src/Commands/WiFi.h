@@ -73,7 +73,7 @@ bool Command_Wifi_STAMode (struct EventStruct *event, const char* Line)
 bool Command_Wifi_Mode (struct EventStruct *event, const char* Line)
 {
   char TmpStr1[INPUT_COMMAND_SIZE];
-  if (GetArgv(Line, TmpStr1, 2)) {
+  if (GetArgv(event, Line, TmpStr1, 2)) {
     WiFiMode_t mode = WIFI_MODE_MAX;
     if(event->Par1 > 0)
     {
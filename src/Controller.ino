@@ -1,21 +1,74 @@
 //********************************************************************************
 // Interface for Sending to Controllers
 //********************************************************************************
+// Mark the values (or settings) of a task as changed, to be reported by /json
+void markTaskValuesChanged(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return;
+  lastTaskValueSequence[TaskIndex] = ++taskValueSequence;
+  publishTaskValues(TaskIndex);
+}
+
+// Typed task values, see TaskValueStoreStruct. The float of the value is written to UserVar too.
+TaskValueStoreStruct* getTaskValueStore(byte TaskIndex, byte varNr) {
+  if (TaskIndex >= TASKS_MAX || varNr >= VARS_PER_TASK) return NULL;
+  if (taskValueStore[TaskIndex] == NULL)
+    taskValueStore[TaskIndex] = new TaskValueStoreStruct();
+  return taskValueStore[TaskIndex];
+}
+
+void setTaskValueInt32(byte TaskIndex, byte varNr, int32_t value) {
+  TaskValueStoreStruct* store = getTaskValueStore(TaskIndex, varNr);
+  if (store == NULL) return;
+  store->types[varNr] = TASK_VALUE_INT32;
+  store->raw[varNr].i64 = 0;
+  store->raw[varNr].i32 = value;
+  UserVar[TaskIndex * VARS_PER_TASK + varNr] = value;
+}
+
+void setTaskValueInt64(byte TaskIndex, byte varNr, int64_t value) {
+  TaskValueStoreStruct* store = getTaskValueStore(TaskIndex, varNr);
+  if (store == NULL) return;
+  store->types[varNr] = TASK_VALUE_INT64;
+  store->raw[varNr].i64 = value;
+  UserVar[TaskIndex * VARS_PER_TASK + varNr] = value;
+}
+
+void setTaskValueDouble(byte TaskIndex, byte varNr, double value) {
+  TaskValueStoreStruct* store = getTaskValueStore(TaskIndex, varNr);
+  if (store == NULL) return;
+  store->types[varNr] = TASK_VALUE_DOUBLE;
+  store->raw[varNr].d = value;
+  UserVar[TaskIndex * VARS_PER_TASK + varNr] = value;
+}
+
+// All values of the task are float again, e.g. at its PLUGIN_INIT.
+void clearTaskValueTypes(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX || taskValueStore[TaskIndex] == NULL) return;
+  delete taskValueStore[TaskIndex];
+  taskValueStore[TaskIndex] = NULL;
+}
+
 void sendData(struct EventStruct *event)
 {
   START_TIMER;
   checkRAM(F("sendData"));
  LoadTaskSettings(event->TaskIndex);
+  markTaskValuesChanged(event->TaskIndex);
+  sendWebEventTaskValues(event);
   if (Settings.UseRules)
     createRuleEvents(event->TaskIndex);
 
   if (Settings.UseValueLogger && Settings.InitSPI && Settings.Pin_sd_cs >= 0)
     SendValueLogger(event->TaskIndex);
+#ifdef FEATURE_TIMESERIES
+  addTimeSeriesValues(event->TaskIndex);
+#endif
 
 //  if (!Settings.TaskDeviceSendData[event->TaskIndex])
 //    return false;
 
-  if (Settings.MessageDelay != 0)
+  // With the controller queue enabled, the message delay is applied when draining the queue.
+  if (Settings.ControllerQueueDepth == 0 && Settings.MessageDelay != 0)
   {
     const long dif = timePassedSince(lastSend);
     if (dif > 0 && dif < static_cast<long>(Settings.MessageDelay))
@@ -41,13 +94,19 @@ void sendData(struct EventStruct *event)
     if (Settings.TaskDeviceSendData[event->ControllerIndex][event->TaskIndex] &&
         Settings.ControllerEnabled[event->ControllerIndex] && Settings.Protocol[event->ControllerIndex])
     {
-      event->ProtocolIndex = getProtocolIndex(Settings.Protocol[event->ControllerIndex]);
+      event->ProtocolIndex = getProtocolIndex_from_ControllerIndex(event->ControllerIndex);
       if (validUserVar(event)) {
-        CPlugin_ptr[event->ProtocolIndex](CPLUGIN_PROTOCOL_SEND, event, dummyString);
+        if (Settings.ControllerQueueDepth == 0) {
+          controllerDiagCurrent = nextControllerDiagSequence(x);
+          CPluginSendCall(CPLUGIN_PROTOCOL_SEND, event);
+          controllerDiagCurrent = 0;
+          bootProfileStep(BOOT_STEP_SEND);
+        } else
+          enqueueControllerData(event);
       } else {
         String log = F("Invalid value detected for controller ");
         String controllerName;
-        CPlugin_ptr[event->ProtocolIndex](CPLUGIN_GET_DEVICENAME, event, controllerName);
+        getCPluginFunction(event->ProtocolIndex)(CPLUGIN_GET_DEVICENAME, event, controllerName);
         log += controllerName;
         addLog(LOG_LEVEL_DEBUG, log);
       }
@@ -55,19 +114,872 @@ void sendData(struct EventStruct *event)
   }
 
   PluginCall(PLUGIN_EVENT_OUT, event, dummyString);
+  taskTriggerDependents(event->TaskIndex);
   lastSend = millis();
+  if (firstSendMoment == 0) {
+    // Main part of the time awake for battery powered nodes using deep sleep.
+    firstSendMoment = lastSend;
+    if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+      String log = lastBootCause == BOOT_CAUSE_DEEP_SLEEP ? F("SLEEP: Wake to first send: ") : F("INIT : Boot to first send: ");
+      log += firstSendMoment;
+      log += F(" ms");
+      if (wifiFastConnectIP) log += F(" (cached IP config)");
+      addLog(LOG_LEVEL_INFO, log);
+    }
+  }
   STOP_TIMER(SEND_DATA_STATS);
 }
 
+/*********************************************************************************************\
+ * Controller queue, samples are sent from the scheduler so sendData() does not block
+\*********************************************************************************************/
+void enqueueControllerData(struct EventStruct *event)
+{
+  const byte controllerIndex = event->ControllerIndex;
+  controllerQueueElementStruct element;
+  // The time of the sample, when it was taken before (see TaskGroup.ino)
+  element.enqueued = controllerSampleMillis != 0 ? controllerSampleMillis : millis();
+  element.sequence = nextControllerDiagSequence(controllerIndex);
+  element.idx = event->idx;
+  element.TaskIndex = event->TaskIndex;
+  element.BaseVarIndex = event->BaseVarIndex;
+  element.sensorType = event->sensorType;
+  TaskValueSnapshot snapshot;
+  getTaskValueSnapshot(event->TaskIndex, snapshot);
+  for (byte i = 0; i < VARS_PER_TASK; ++i) {
+    element.values[i] = snapshot.values[i];
+  }
+  controllerQueueStruct& queue = ControllerQueue[controllerIndex];
+  scheduledRadioWake();
+  if (queue.count >= Settings.ControllerQueueDepth && Settings.ControllerBacklogFileSize != 0) {
+    // Keep the oldest sample on file instead of dropping it.
+    spillControllerQueue(controllerIndex);
+  }
+  if (!queue.push(element, Settings.ControllerQueueDepth, Settings.ControllerQueueDropPolicy)) {
+    addLogFmt(LOG_LEVEL_DEBUG, LOG_FMT_CTRL_QUEUE_FULL, controllerIndex + 1);
+  }
+  scheduleControllerQueue(controllerIndex);
+}
+
+// Let getTaskValueSnapshot() return these values of the task to the calling RTOS task, until
+// clearControllerSampleValues(). The type of a value is kept when the value did not change.
+void setControllerSampleValues(byte controllerIndex, byte TaskIndex, const float* values)
+{
+  if (controllerIndex >= CONTROLLER_MAX) return;
+  ControllerSampleValuesStruct& sample = controllerSampleValues[controllerIndex];
+  sample.TaskIndex = TASKS_MAX;
+  getTaskValueSnapshot(TaskIndex, sample.snapshot);
+  for (byte i = 0; i < VARS_PER_TASK; ++i) {
+    if (memcmp(&sample.snapshot.values[i], &values[i], sizeof(float)) == 0) continue;
+    sample.snapshot.values[i] = values[i];
+    sample.snapshot.raw[i].i64 = 0;
+    sample.snapshot.raw[i].f = values[i];
+    sample.snapshot.types[i] = TASK_VALUE_FLOAT;
+  }
+#ifdef USE_RTOS_MULTITASKING
+  sample.owner = xTaskGetCurrentTaskHandle();
+#endif
+  sample.TaskIndex = TaskIndex;
+}
+
+void clearControllerSampleValues(byte controllerIndex)
+{
+  if (controllerIndex < CONTROLLER_MAX)
+    controllerSampleValues[controllerIndex].TaskIndex = TASKS_MAX;
+}
+
+// Set the queue timer, taking the message delay since the last send into account.
+void scheduleControllerQueue(byte controllerIndex)
+{
+  unsigned long wait = 0;
+  if (Settings.MessageDelay != 0)
+  {
+    const long dif = timePassedSince(controllerLastSend[controllerIndex]);
+    if (dif >= 0 && dif < static_cast<long>(Settings.MessageDelay))
+      wait = Settings.MessageDelay - dif;
+  }
+  const controllerQueueStruct& queue = ControllerQueue[controllerIndex];
+  // Replay a backlog gradually, so it does not starve the loop.
+  if (queue.onFile() != 0 && wait < CONTROLLER_BACKLOG_REPLAY_INTERVAL)
+    wait = CONTROLLER_BACKLOG_REPLAY_INTERVAL;
+  // New samples do not cut the back off of a failed send short.
+  if (queue.retries != 0) {
+    const long left = -timePassedSince(queue.retryDue);
+    if (left > 0 && static_cast<unsigned long>(left) > wait)
+      wait = left;
+  }
+  setControllerQueueTimer(controllerIndex, wait);
+}
+
+// Run process_controller_queue() after 'wait' msec, from the delivery task of the
+// controller when running RTOS tasks, else from the scheduler.
+void setControllerQueueTimer(byte controllerIndex, unsigned long wait)
+{
+#ifdef USE_RTOS_MULTITASKING
+  const TaskHandle_t task = rtosTaskStats[RTOS_TASK_CONTROLLER + controllerIndex].handle;
+  if (task != NULL) {
+    controllerDelivery[controllerIndex].due = millis() + wait;
+    controllerDelivery[controllerIndex].scheduled = true;
+    xTaskNotifyGive(task);
+    return;
+  }
+#endif
+  setTimer(CONTROLLER_QUEUE_TIMER, controllerIndex, wait);
+}
+
+void process_controller_queue(unsigned long controllerIndex)
+{
+  if (controllerIndex >= CONTROLLER_MAX) return;
+  if (Settings.MessageDelay != 0 &&
+      timePassedSince(controllerLastSend[controllerIndex]) < static_cast<long>(Settings.MessageDelay)) {
+    scheduleControllerQueue(controllerIndex);
+    return;
+  }
+  if (!controllerConnected(controllerIndex)) {
+    // Keep the samples until the controller can be reached again.
+    setControllerQueueTimer(controllerIndex, CONTROLLER_BACKLOG_RETRY_INTERVAL);
+    return;
+  }
+  controllerQueueStruct& queue = ControllerQueue[controllerIndex];
+  if (queue.retries != 0 && !timeOutReached(queue.retryDue)) {
+    scheduleControllerQueue(controllerIndex);
+    return;
+  }
+  controllerQueueElementStruct element;
+  // A sample on file is only skipped once sent, samples in RAM are put back when the send failed.
+  bool fromFile = queue.onFile() != 0;
+  if (fromFile && !readControllerBacklog(controllerIndex, element)) {
+    clearControllerBacklog(controllerIndex);
+    fromFile = false;
+  }
+  if (!fromFile && !queue.pop(element)) return;
+
+  bool success = true;
+  if (Settings.ControllerEnabled[controllerIndex] && Settings.Protocol[controllerIndex] &&
+      Settings.TaskDeviceSendData[controllerIndex][element.TaskIndex])
+  {
+    struct EventStruct TempEvent;
+    TempEvent.TaskIndex = element.TaskIndex;
+    TempEvent.BaseVarIndex = element.BaseVarIndex;
+    TempEvent.sensorType = element.sensorType;
+    TempEvent.idx = element.idx;
+    TempEvent.ControllerIndex = controllerIndex;
+    TempEvent.ProtocolIndex = getProtocolIndex_from_ControllerIndex(controllerIndex);
+    LoadTaskSettings(element.TaskIndex);
+
+    // The controller reads the values as they were queued.
+    setControllerSampleValues(controllerIndex, element.TaskIndex, element.values);
+    controllerSampleMillis = element.enqueued;
+    controllerDiagCurrent = element.sequence;
+    success = CPluginSendCall(CPLUGIN_PROTOCOL_SEND, &TempEvent) ||
+              TempEvent.ProtocolIndex >= CPLUGIN_MAX || !Protocol[TempEvent.ProtocolIndex].reportsSendResult;
+    bootProfileStep(BOOT_STEP_SEND);
+    controllerSampleMillis = 0;
+    controllerDiagCurrent = 0;
+    clearControllerSampleValues(controllerIndex);
+  }
+  if (!success && ++queue.retries < CONTROLLER_SEND_RETRIES) {
+    // Keep the sample at the head of the queue and try again later.
+    if (!fromFile && !queue.unpop(element, Settings.ControllerQueueDepth)) {
+      // Newer samples filled the queue during the send.
+      addLogFmt(LOG_LEVEL_DEBUG, LOG_FMT_CTRL_QUEUE_FULL, controllerIndex + 1);
+    } else {
+      unsigned long wait = CONTROLLER_BACKLOG_RETRY_INTERVAL << (queue.retries - 1);
+      if (wait > CONTROLLER_SEND_RETRY_MAX_INTERVAL) wait = CONTROLLER_SEND_RETRY_MAX_INTERVAL;
+      addLogFmt(LOG_LEVEL_DEBUG, LOG_FMT_CTRL_SEND_RETRY, controllerIndex + 1, queue.retries, wait);
+      queue.retryDue = millis() + wait;
+      controllerLastSend[controllerIndex] = millis();
+      scheduleControllerQueue(controllerIndex);
+      return;
+    }
+  } else if (!success) {
+    addLogFmt(LOG_LEVEL_ERROR, LOG_FMT_CTRL_SEND_DROPPED, controllerIndex + 1, queue.retries);
+    ++queue.dropped;
+  }
+  queue.retries = 0;
+  if (fromFile)
+    skipControllerBacklogRecord(controllerIndex);
+  if (success)
+    queue.markSent(timePassedSince(element.enqueued));
+  controllerLastSend[controllerIndex] = millis();
+  lastSend = controllerLastSend[controllerIndex];
+  if (queue.count > 0 || queue.onFile() != 0)
+    scheduleControllerQueue(controllerIndex);
+}
+
+#ifdef USE_RTOS_MULTITASKING
+/*********************************************************************************************\
+ * Controller delivery tasks (ESP32)
+ * Each controller drains its own queue from its own task, in queue order. While a HTTP
+ * controller waits for the reply of its server the state lock is released (see
+ * RTOSStateRelease), so a slow server only delays the samples of its own controller.
+ * When the heap is low, only one controller sends at a time.
+\*********************************************************************************************/
+#define CONTROLLER_DELIVERY_HEAP_LOW     12000  // Free heap below which deliveries do not overlap
+#define CONTROLLER_DELIVERY_HEAP_RETRY     100  // msec to wait for the other delivery
+
+void RTOS_TaskController(void * parameter)
+{
+  const byte controllerIndex = reinterpret_cast<uint32_t>(parameter);
+  controllerDeliveryStruct& delivery = controllerDelivery[controllerIndex];
+  while (true) {
+    TickType_t wait = portMAX_DELAY;
+    if (delivery.scheduled) {
+      const long left = -timePassedSince(delivery.due);
+      wait = left > 0 ? pdMS_TO_TICKS(left) : 0;
+    }
+    if (wait != 0) {
+      // Woken early when the queue is scheduled again.
+      ulTaskNotifyTake(pdTRUE, wait);
+      continue;
+    }
+    RTOSStateLock stateLock;
+    if (!delivery.scheduled || !timeOutReached(delivery.due)) continue;
+    if (controllerDeliveriesActive != 0 && ESP.getFreeHeap() < CONTROLLER_DELIVERY_HEAP_LOW) {
+      ++delivery.deferred;
+      delivery.due = millis() + CONTROLLER_DELIVERY_HEAP_RETRY;
+      continue;
+    }
+    delivery.scheduled = false;
+    const unsigned long start = micros();
+    ++controllerDeliveriesActive;
+    process_controller_queue(controllerIndex);
+    --controllerDeliveriesActive;
+    addRTOSTaskBusyTime(RTOS_TASK_CONTROLLER + controllerIndex, start);
+  }
+}
+
+bool isControllerDeliveryTask()
+{
+  const TaskHandle_t current = xTaskGetCurrentTaskHandle();
+  for (byte x = 0; x < CONTROLLER_MAX; ++x) {
+    if (rtosTaskStats[RTOS_TASK_CONTROLLER + x].handle == current)
+      return true;
+  }
+  return false;
+}
+#endif
+
+// Check whether the controller can be reached, without trying to connect.
+bool controllerConnected(byte controllerIndex)
+{
+  if (!WiFiConnected()) return false;
+  const byte ProtocolIndex = getProtocolIndex_from_ControllerIndex(controllerIndex);
+  if (ProtocolIndex < CPLUGIN_MAX && Protocol[ProtocolIndex].usesMQTT)
+    return MQTTclient.connected();
+  return true;
+}
+
+/*********************************************************************************************\
+ * Controller backlog, a full queue is moved to a file on SPIFFS and replayed oldest first
+\*********************************************************************************************/
+String getControllerBacklogFileName(byte controllerIndex)
+{
+  String fileName = F(FILE_BACKLOG);
+  fileName += controllerIndex + 1;
+  fileName += F(".dat");
+  return fileName;
+}
+
+// Move the oldest sample in RAM to the backlog file.
+bool spillControllerQueue(byte controllerIndex)
+{
+  controllerQueueStruct& queue = ControllerQueue[controllerIndex];
+  const unsigned long maxRecords = (static_cast<unsigned long>(Settings.ControllerBacklogFileSize) * 1024) /
+                                   sizeof(controllerQueueElementStruct);
+  if (queue.count == 0 || queue.fileRecords >= maxRecords) return false;
+  // A new file is started once all samples on file were sent, see clearControllerBacklog().
+  fs::File f = SPIFFS.open(getControllerBacklogFileName(controllerIndex), queue.fileRecords == 0 ? "w" : "a");
+  if (!f) return false;
+  const controllerQueueElementStruct& element = queue.elements[queue.head];
+  const size_t written = f.write(reinterpret_cast<const uint8_t*>(&element), sizeof(element));
+  f.close();
+  if (written != sizeof(element)) {
+    addLog(LOG_LEVEL_ERROR, F("CTRL : Could not write backlog file"));
+    return false;
+  }
+  controllerQueueElementStruct dummy;
+  queue.pop(dummy);
+  ++queue.fileRecords;
+  return true;
+}
+
+// Read the oldest sample on file, it stays there until skipControllerBacklogRecord().
+bool readControllerBacklog(byte controllerIndex, controllerQueueElementStruct& element)
+{
+  controllerQueueStruct& queue = ControllerQueue[controllerIndex];
+  fs::File f = SPIFFS.open(getControllerBacklogFileName(controllerIndex), "r");
+  if (!f) return false;
+  bool success = f.seek(queue.fileRead * sizeof(element), fs::SeekSet) &&
+                 f.read(reinterpret_cast<uint8_t*>(&element), sizeof(element)) == sizeof(element);
+  f.close();
+  if (!success) {
+    addLog(LOG_LEVEL_ERROR, F("CTRL : Could not read backlog file"));
+    return false;
+  }
+  if (queue.fileRead < queue.fileRecovered) {
+    // Queued before the reboot, the millis() have no meaning now.
+    element.enqueued = millis();
+  }
+  return true;
+}
+
+void skipControllerBacklogRecord(byte controllerIndex)
+{
+  controllerQueueStruct& queue = ControllerQueue[controllerIndex];
+  ++queue.fileRead;
+  if (queue.onFile() == 0)
+    clearControllerBacklog(controllerIndex);
+}
+
+void clearControllerBacklog(byte controllerIndex)
+{
+  controllerQueueStruct& queue = ControllerQueue[controllerIndex];
+  if (queue.fileRecords != 0)
+    SPIFFS.remove(getControllerBacklogFileName(controllerIndex));
+  queue.fileRecords = 0;
+  queue.fileRead = 0;
+  queue.fileRecovered = 0;
+}
+
+// Called at boot, continue with the backlog files left before the reboot.
+void initControllerBacklog()
+{
+  for (byte x = 0; x < CONTROLLER_MAX; ++x) {
+    const String fileName = getControllerBacklogFileName(x);
+    if (!SPIFFS.exists(fileName)) continue;
+    controllerQueueStruct& queue = ControllerQueue[x];
+    if (Settings.ControllerBacklogFileSize != 0 && Settings.ControllerEnabled[x]) {
+      fs::File f = SPIFFS.open(fileName, "r");
+      if (f) {
+        queue.fileRecords = f.size() / sizeof(controllerQueueElementStruct);
+        f.close();
+      }
+    }
+    queue.fileRead = 0;
+    queue.fileRecovered = queue.fileRecords;
+    if (queue.fileRecords == 0) {
+      SPIFFS.remove(fileName);
+    } else {
+      String log = F("CTRL : Backlog of controller ");
+      log += x + 1;
+      log += F(": ");
+      log += queue.fileRecords;
+      log += F(" samples");
+      addLog(LOG_LEVEL_INFO, log);
+      scheduleControllerQueue(x);
+    }
+  }
+}
+
+// Queue stats as: queued/max queued/dropped/sent/avg latency/max latency (msec)/on file
+String getControllerQueueStats(byte controllerIndex)
+{
+  const controllerQueueStruct& queue = ControllerQueue[controllerIndex];
+  String result;
+  result += queue.count;
+  result += '/';
+  result += queue.maxCount;
+  result += '/';
+  result += queue.dropped;
+  result += '/';
+  result += queue.sent;
+  result += '/';
+  result += queue.sent == 0 ? 0 : queue.latencyTotal / queue.sent;
+  result += '/';
+  result += queue.latencyMax;
+  result += '/';
+  result += queue.onFile();
+  return result;
+}
+
+/*********************************************************************************************\
+ * Persistent HTTP connections for the HTTP controllers
+\*********************************************************************************************/
+// Send a HTTP request over the kept-alive connection of the controller, connecting when needed.
+// Returns false when no connection could be made, or no reply was received (also not after the
+// retry on a new connection), so the sample is kept.
+// With body, a reply body up to CONTROLLER_HTTP_BODY_MAX bytes is returned instead of skipped.
+bool sendControllerHttpRequest(byte controllerIndex, ControllerSettingsStruct& ControllerSettings,
+                               const String& request, String& statusLine, String* body)
+{
+  statusLine = "";
+  if (body != NULL) *body = "";
+  if (controllerIndex >= CONTROLLER_MAX) return false;
+  controllerConnectionStruct& conn = ControllerConnections[controllerIndex];
+  const unsigned long start = millis();
+  for (byte attempt = 0; attempt < 2; ++attempt) {
+    const bool reuse = conn.client.connected();
+    if (!reuse) {
+      conn.client.stop();
+      socketAvailable(SOCKET_CONTROLLER);
+      registerSocketClient(conn.client, SOCKET_CONTROLLER);
+      START_TIMER;
+      const bool connected = ControllerSettings.connectToHost(conn.client);
+      STOP_TIMER_CONTROLLER(controllerIndex, CONTROLLER_CONNECT_STATS);
+      if (!connected)
+        return false;
+      ++conn.connects;
+    }
+    // Discard anything left from a previous reply.
+    while (conn.client.available())
+      conn.client.read();
+    // With the diagnostic header, see ControllerDiagnostic.ino
+    const String diagRequest = getControllerDiagRequest(controllerIndex, request);
+    const String& send = diagRequest.length() != 0 ? diagRequest : request;
+    if (conn.client.print(send) == send.length()) {
+      ControllerStats[controllerIndex].bytesSent += send.length();
+      START_TIMER;
+      const bool replied = readHttpResponse(conn.client, statusLine, body);
+      STOP_TIMER_CONTROLLER(controllerIndex, CONTROLLER_REPLY_STATS);
+      if (replied) {
+        conn.markRequest(timePassedSince(start));
+        return true;
+      }
+    }
+    // The server may have closed the kept-alive connection, then retry once on a new one.
+    // A connection still open just did not reply in time, so do not send twice.
+    const bool retry = reuse && !conn.client.connected();
+    conn.client.stop();
+    if (!retry) break;
+  }
+  ++conn.failed;
+  return false;
+}
+
+void closeControllerConnection(byte controllerIndex)
+{
+  if (controllerIndex < CONTROLLER_MAX)
+    ControllerConnections[controllerIndex].client.stop();
+}
+
+// Read a single HTTP reply, so the connection can be used for the next request.
+// The connection is closed when the server asks for it, or the end of the reply is unknown.
+bool readHttpResponse(WiFiClient& client, String& statusLine, String* body)
+{
+  unsigned long timer = millis() + CONTROLLER_HTTP_REPLY_TIMEOUT;
+  {
+#ifdef USE_RTOS_MULTITASKING
+    RTOSStateRelease release;
+#endif
+    while (!client.available() && !timeOutReached(timer)) {
+#ifdef USE_RTOS_MULTITASKING
+      if (release.released) {
+        delay(1);
+        continue;
+      }
+#endif
+      yield();
+    }
+  }
+  if (!client.available())
+    return false;
+  if (!safeReadStringUntil(client, statusLine, '\n', 1024, CONTROLLER_HTTP_READ_TIMEOUT)) {
+    client.stop();
+    return statusLine.length() > 0;
+  }
+  statusLine.trim();
+  addLog(LOG_LEVEL_DEBUG_MORE, statusLine);
+
+  long contentLength = -1;
+  bool chunked = false;
+  bool keepAlive = statusLine.startsWith(F("HTTP/1.1"));
+  bool headersComplete = false;
+  String line;
+  while (safeReadStringUntil(client, line, '\n', 1024, CONTROLLER_HTTP_READ_TIMEOUT)) {
+    line.trim();
+    if (line.length() == 0) {
+      headersComplete = true;
+      break;
+    }
+    addLog(LOG_LEVEL_DEBUG_MORE, line);
+    line.toLowerCase();
+    if (line.startsWith(F("content-length:"))) {
+      contentLength = line.substring(15).toInt();
+    } else if (line.startsWith(F("transfer-encoding:"))) {
+      chunked = line.indexOf(F("chunked")) != -1;
+    } else if (line.startsWith(F("connection:"))) {
+      keepAlive = line.indexOf(F("close")) == -1;
+    }
+  }
+
+  bool complete = false;
+  if (headersComplete) {
+    if (chunked)
+      complete = skipHttpChunkedBody(client, body);
+    else if (contentLength >= 0)
+      complete = skipHttpBytes(client, contentLength, body);
+  }
+  if (!complete || !keepAlive)
+    client.stop();
+  return true;
+}
+
+// Appends the bytes to body when set, up to CONTROLLER_HTTP_BODY_MAX.
+bool skipHttpBytes(WiFiClient& client, long count, String* body)
+{
+  byte buf[64];
+  const unsigned long timer = millis() + CONTROLLER_HTTP_READ_TIMEOUT;
+  while (count > 0 && !timeOutReached(timer)) {
+    const int available = client.available();
+    if (available > 0) {
+      const int read = client.read(buf, count < static_cast<long>(sizeof(buf)) ? count : sizeof(buf));
+      if (read > 0) {
+        count -= read;
+        for (int i = 0; body != NULL && i < read && body->length() < CONTROLLER_HTTP_BODY_MAX; ++i)
+          *body += static_cast<char>(buf[i]);
+      }
+    } else if (!client.connected()) {
+      return false;
+    } else {
+      delay(1);
+    }
+  }
+  return count == 0;
+}
+
+bool skipHttpChunkedBody(WiFiClient& client, String* body)
+{
+  String line;
+  while (safeReadStringUntil(client, line, '\n', 64, CONTROLLER_HTTP_READ_TIMEOUT)) {
+    const long chunkSize = strtol(line.c_str(), NULL, 16);
+    if (chunkSize == 0) {
+      // Skip optional trailer headers up to the final empty line.
+      while (safeReadStringUntil(client, line, '\n', 1024, CONTROLLER_HTTP_READ_TIMEOUT)) {
+        line.trim();
+        if (line.length() == 0) return true;
+      }
+      return false;
+    }
+    // Chunk data is followed by CRLF
+    if (!skipHttpBytes(client, chunkSize, body) || !skipHttpBytes(client, 2)) return false;
+  }
+  return false;
+}
+
+// Connection stats as: requests/new connections/reused %/failed/avg latency/max latency (msec)
+String getControllerConnectionStats(byte controllerIndex)
+{
+  const controllerConnectionStruct& conn = ControllerConnections[controllerIndex];
+  String result;
+  result += conn.requests;
+  result += '/';
+  result += conn.connects;
+  result += '/';
+  const unsigned long total = conn.requests + conn.failed;
+  result += (total == 0 || conn.connects >= total) ? 0 : (100 * (total - conn.connects)) / total;
+  result += '/';
+  result += conn.failed;
+  result += '/';
+  result += conn.requests == 0 ? 0 : conn.latencyTotal / conn.requests;
+  result += '/';
+  result += conn.latencyMax;
+  return result;
+}
+
+/*********************************************************************************************\
+ * Minimum interval between requests of rate limited controllers (ThingSpeak, Emoncms).
+ * Values sent within the interval are merged per field into a pending record, which is sent
+ * from the controller timer as soon as the interval has passed.
+\*********************************************************************************************/
+void initControllerRateLimit(byte controllerIndex, unsigned int defaultInterval)
+{
+  if (controllerIndex >= CONTROLLER_MAX) return;
+  rateLimitConfigStruct config;
+  LoadCustomControllerSettings(controllerIndex, (byte*)&config, sizeof(config));
+  rateLimitStruct& limit = ControllerRateLimit[controllerIndex];
+  limit.interval = config.MinInterval == 0 ? defaultInterval : config.MinInterval;
+  if (limit.interval > CONTROLLER_RATE_LIMIT_MAX)
+    limit.interval = CONTROLLER_RATE_LIMIT_MAX;
+  limit.mergeMode = config.MergeMode > CONTROLLER_MERGE_AVERAGE ? CONTROLLER_MERGE_LAST : config.MergeMode;
+  limit.fieldCount = 0;
+  msecTimerHandler.remove(getMixedId(CONTROLLER_TIMER, controllerIndex));
+}
+
+void addControllerRateLimitForm(byte controllerIndex, unsigned int defaultInterval)
+{
+  rateLimitConfigStruct config;
+  LoadCustomControllerSettings(controllerIndex, (byte*)&config, sizeof(config));
+  addFormNumericBox(F("Minimum Send Interval"), F("ratelimitinterval"), config.MinInterval, 0, CONTROLLER_RATE_LIMIT_MAX);
+  addUnit(F("ms"));
+  String note = F("0 = default (");
+  note += defaultInterval;
+  note += F(" ms)");
+  addFormNote(note);
+  String options[2];
+  options[0] = F("Last value");
+  options[1] = F("Average");
+  int optionValues[2] = { CONTROLLER_MERGE_LAST, CONTROLLER_MERGE_AVERAGE };
+  addFormSelector(F("Merge Values"), F("ratelimitmerge"), 2, options, optionValues, config.MergeMode);
+  addFormNote(F("Values sent within the interval are combined in the next request"));
+}
+
+void saveControllerRateLimit(byte controllerIndex)
+{
+  rateLimitConfigStruct config;
+  config.MinInterval = getFormItemInt(F("ratelimitinterval"), 0);
+  config.MergeMode = getFormItemInt(F("ratelimitmerge"), CONTROLLER_MERGE_LAST);
+  SaveCustomControllerSettings(controllerIndex, (byte*)&config, sizeof(config));
+}
+
+// Check whether a request may be sent now, otherwise set the controller timer for when it may.
+bool controllerRequestAllowed(byte controllerIndex)
+{
+  const rateLimitStruct& limit = ControllerRateLimit[controllerIndex];
+  if (limit.interval == 0 || limit.lastSend == 0) return true;
+  const long passed = timePassedSince(limit.lastSend);
+  if (passed < 0 || passed >= static_cast<long>(limit.interval)) return true;
+  setControllerTimer(controllerIndex, limit.interval - passed);
+  return false;
+}
+
+// Merge the event values into the pending record of the controller, the field number is idx + value index.
+// Returns true when the record may be sent now.
+bool mergeControllerValues(struct EventStruct *event)
+{
+  rateLimitStruct& limit = ControllerRateLimit[event->ControllerIndex];
+  const byte valueCount = getValueCountFromSensorType(event->sensorType);
+  TaskValueSnapshot snapshot;
+  getTaskValueSnapshot(event->TaskIndex, snapshot);
+  for (byte x = 0; x < valueCount && x < VARS_PER_TASK; x++)
+  {
+    const int field = event->idx + x;
+    byte i = 0;
+    while (i < limit.fieldCount && limit.fields[i].field != field) ++i;
+    if (i == limit.fieldCount) {
+      if (limit.fieldCount >= CONTROLLER_RATE_LIMIT_FIELDS) {
+        addLog(LOG_LEVEL_ERROR, F("CTRL : Too many fields in pending request, value dropped"));
+        continue;
+      }
+      limit.fields[i] = rateLimitFieldStruct();
+      limit.fields[i].field = field;
+      ++limit.fieldCount;
+    } else {
+      ++limit.merged;
+    }
+    rateLimitFieldStruct& entry = limit.fields[i];
+    entry.decimals = ExtraTaskSettings.TaskDeviceValueDecimals[x];
+    entry.isLong = event->sensorType == SENSOR_TYPE_LONG;
+    if (entry.isLong) {
+      entry.lastLong = snapshot.getLong();
+      ++entry.count;
+    } else {
+      entry.last = snapshot.values[x];
+      if (isValidFloat(entry.last)) {
+        entry.sum += entry.last;
+        ++entry.count;
+      }
+    }
+  }
+  if (controllerRequestAllowed(event->ControllerIndex)) return true;
+  addLogFmt(LOG_LEVEL_DEBUG, LOG_FMT_CTRL_RATE_LIMITED, limit.fieldCount, event->ControllerIndex + 1);
+  return false;
+}
+
+String formatControllerField(const rateLimitFieldStruct& entry, byte mergeMode)
+{
+  if (entry.isLong)
+    return String(entry.lastLong);
+  if (mergeMode == CONTROLLER_MERGE_AVERAGE && entry.count > 1)
+    return toString(entry.sum / entry.count, entry.decimals);
+  return toString(entry.last, entry.decimals);
+}
+
+// Start a new interval. A request that could not be sent keeps the pending record and tries again later.
+// The server answered, but not with 200 OK. The fields are not sent again, count and log it.
+void logControllerRefused(byte controllerIndex, const String& statusLine)
+{
+  ++ControllerRateLimit[controllerIndex].refused;
+  if (loglevelActiveFor(LOG_LEVEL_ERROR)) {
+    String log = F("HTTP : Controller ");
+    log += controllerIndex + 1;
+    log += F(" refused: ");
+    log += statusLine;
+    addLog(LOG_LEVEL_ERROR, log);
+  }
+}
+
+void markControllerRequest(byte controllerIndex, bool sent)
+{
+  rateLimitStruct& limit = ControllerRateLimit[controllerIndex];
+  limit.lastSend = millis();
+  if (sent) {
+    limit.fieldCount = 0;
+  } else {
+    setControllerTimer(controllerIndex, limit.interval > CONTROLLER_RATE_LIMIT_RETRY ? limit.interval : CONTROLLER_RATE_LIMIT_RETRY);
+  }
+}
+
+/*********************************************************************************************\
+ * Batches of timestamped records for controllers with a bulk upload (ThingSpeak, Emoncms,
+ * Generic HTTP Advanced). At CPLUGIN_PROTOCOL_SEND the controller formats a record of the
+ * values with getControllerSampleTime() and adds it with addControllerBatchRecord(). When the
+ * batch is due (count, age or size) the controller sends all records in a single request,
+ * the age is checked from the controller timer.
+\*********************************************************************************************/
+void initControllerBatch(byte controllerIndex, const controllerBatchConfigStruct& config)
+{
+  if (controllerIndex >= CONTROLLER_MAX) return;
+  controllerBatchStruct& batch = ControllerBatch[controllerIndex];
+  batch.config = config;
+  if (batch.config.MaxRecords > CONTROLLER_BATCH_MAX_RECORDS)
+    batch.config.MaxRecords = CONTROLLER_BATCH_MAX_RECORDS;
+  if (batch.config.MaxAge > CONTROLLER_BATCH_MAX_AGE)
+    batch.config.MaxAge = CONTROLLER_BATCH_MAX_AGE;
+  batch.body = "";
+  batch.count = 0;
+  if (batch.config.MaxRecords != 0)
+    batch.body.reserve(CONTROLLER_BATCH_MAX_BYTES);
+}
+
+void addControllerBatchForm(const controllerBatchConfigStruct& config)
+{
+  addFormNumericBox(F("Batch Records"), F("ctrlbatchrecords"), config.MaxRecords, 0, CONTROLLER_BATCH_MAX_RECORDS);
+  addFormNumericBox(F("Batch Max. Age"), F("ctrlbatchage"), config.MaxAge, 0, CONTROLLER_BATCH_MAX_AGE);
+  addUnit(F("sec"));
+  addFormNote(F("Samples are timestamped and sent in one bulk request when this many are collected, the first is this old or the request reaches 2 kB. 0 records = a request per sample"));
+}
+
+void readControllerBatchForm(controllerBatchConfigStruct& config)
+{
+  config.MaxRecords = getFormItemInt(F("ctrlbatchrecords"), 0);
+  config.MaxAge = getFormItemInt(F("ctrlbatchage"), 0);
+}
+
+// Batches need the time, without it every sample is sent at once.
+bool controllerBatching(byte controllerIndex)
+{
+  return controllerIndex < CONTROLLER_MAX && ControllerBatch[controllerIndex].config.MaxRecords != 0 && year() >= 2000;
+}
+
+// Unix time of the values being sent, a sample from the controller queue was taken earlier.
+uint32_t getControllerSampleTime()
+{
+  uint32_t time = getUnixTime();
+  if (controllerSampleMillis != 0) {
+    const long age = timePassedSince(controllerSampleMillis);
+    if (age > 0) time -= age / 1000;
+  }
+  return time;
+}
+
+// ISO 8601 in UTC: 2018-06-14T12:12:22Z
+String getControllerSampleTimeISO()
+{
+  timeStruct ts;
+  breakTime(getControllerSampleTime(), ts);
+  String result = getDateTimeString(ts, '-', ':', 'T', false);
+  result += 'Z';
+  return result;
+}
+
+// Add a record, separated from the previous one. Returns true when the batch is due.
+bool addControllerBatchRecord(byte controllerIndex, const String& record, char separator)
+{
+  controllerBatchStruct& batch = ControllerBatch[controllerIndex];
+  if (batch.body.length() + record.length() + 1 > 2 * CONTROLLER_BATCH_MAX_BYTES) {
+    // The batch could not be sent for a while
+    ++batch.dropped;
+    return true;
+  }
+  if (batch.count == 0) {
+    batch.firstRecord = millis();
+    batch.firstSequence = controllerDiagCurrent;
+    if (batch.config.MaxAge != 0)
+      setControllerTimer(controllerIndex, batch.config.MaxAge * 1000UL);
+  } else if (separator != 0) {
+    batch.body += separator;
+  }
+  batch.body += record;
+  batch.lastSequence = controllerDiagCurrent;
+  ++batch.count;
+  return controllerBatchDue(controllerIndex);
+}
+
+bool controllerBatchDue(byte controllerIndex)
+{
+  const controllerBatchStruct& batch = ControllerBatch[controllerIndex];
+  if (batch.count == 0) return false;
+  if (batch.flush) return true;
+  if (batch.count >= batch.config.MaxRecords || batch.body.length() >= CONTROLLER_BATCH_MAX_BYTES) return true;
+  return batch.config.MaxAge != 0 && timePassedSince(batch.firstRecord) >= static_cast<long>(batch.config.MaxAge * 1000UL);
+}
+
+// After the bulk request. A batch which could not be sent is kept and sent again from the controller timer.
+void markControllerBatchSent(byte controllerIndex, bool sent)
+{
+  controllerBatchStruct& batch = ControllerBatch[controllerIndex];
+  if (!sent) {
+    setControllerTimer(controllerIndex, CONTROLLER_RATE_LIMIT_RETRY);
+    return;
+  }
+  ++batch.requests;
+  batch.records += batch.count;
+  batch.body = "";
+  batch.count = 0;
+  batch.flush = false;
+}
+
+// Send the records collected so far, from deepSleepStart() before the ESP powers down.
+void flushControllerBatches()
+{
+  for (byte x = 0; x < CONTROLLER_MAX; x++) {
+    if (ControllerBatch[x].count == 0) continue;
+    ControllerBatch[x].flush = true;
+    process_controller_timer(x);
+  }
+}
+
+// Batch stats of all controllers as: requests/records/dropped
+String getControllerBatchStats()
+{
+  unsigned long requests = 0, records = 0, dropped = 0;
+  for (byte x = 0; x < CONTROLLER_MAX; x++) {
+    requests += ControllerBatch[x].requests;
+    records += ControllerBatch[x].records;
+    dropped += ControllerBatch[x].dropped;
+  }
+  String result;
+  result += requests;
+  result += '/';
+  result += records;
+  result += '/';
+  result += dropped;
+  return result;
+}
+
 boolean validUserVar(struct EventStruct *event) {
   byte valueCount = getValueCountFromSensorType(event->sensorType);
-  for (int i = 0; i < valueCount; ++i) {
-    const float f(UserVar[event->BaseVarIndex + i]);
+  TaskValueSnapshot snapshot;
+  getTaskValueSnapshot(event->TaskIndex, snapshot);
+  for (int i = 0; i < valueCount && i < VARS_PER_TASK; ++i) {
+    const float f(snapshot.values[i]);
     if (!isValidFloat(f)) return false;
   }
   return true;
 }
 
+/*********************************************************************************************\
+ * Publish template of a controller, compiled once instead of parsed for every send.
+ * See compileControllerTemplate().
+\*********************************************************************************************/
+void initControllerPublishTemplate(byte controllerIndex, bool urlEncode)
+{
+  if (controllerIndex >= CONTROLLER_MAX) return;
+  ControllerSettingsStruct ControllerSettings;
+  LoadControllerSettings(controllerIndex, (byte*)&ControllerSettings, sizeof(ControllerSettings));
+  compileControllerTemplate(ControllerPublishTemplate[controllerIndex], ControllerSettings.Publish, urlEncode, false);
+}
+
+// Compiled at CPLUGIN_INIT of the controller, or else at its first send.
+const ControllerTemplateStruct& getControllerPublishTemplate(byte controllerIndex, const ControllerSettingsStruct& ControllerSettings, bool urlEncode)
+{
+  ControllerTemplateStruct& tmpl = ControllerPublishTemplate[controllerIndex];
+  if (!tmpl.valid)
+    compileControllerTemplate(tmpl, ControllerSettings.Publish, urlEncode, false);
+  return tmpl;
+}
+
 /*********************************************************************************************\
  * Handle incoming MQTT messages
 \*********************************************************************************************/
@@ -110,12 +1022,13 @@ void callback(char* c_topic, byte* b_payload, unsigned int length) {
   // sprintf_P(log, PSTR("%s%s"), "MQTT : Payload: ", c_payload);
   // addLog(LOG_LEVEL_DEBUG, log);
 
-  struct EventStruct TempEvent;
+  PooledEvent pooled;
+  struct EventStruct& TempEvent = *pooled.event;
   // TD-er: This one cannot set the TaskIndex, but that may seem to work out.... hopefully.
   TempEvent.String1 = c_topic;
   TempEvent.String2 = c_payload;
-  byte ProtocolIndex = getProtocolIndex(Settings.Protocol[enabledMqttController]);
-  CPlugin_ptr[ProtocolIndex](CPLUGIN_PROTOCOL_RECV, &TempEvent, dummyString);
+  byte ProtocolIndex = getProtocolIndex_from_ControllerIndex(enabledMqttController);
+  getCPluginFunction(ProtocolIndex)(CPLUGIN_PROTOCOL_RECV, &TempEvent, dummyString);
 }
 
 
@@ -134,11 +1047,10 @@ bool MQTTConnect(int controller_idx)
     updateMQTTclient_connected();
   }
   mqtt = WiFiClient(); // workaround see: https://github.com/esp8266/Arduino/issues/4497#issuecomment-373023864
-  if (ControllerSettings.UseDNS) {
-    MQTTclient.setServer(ControllerSettings.getHost().c_str(), ControllerSettings.Port);
-  } else {
-    MQTTclient.setServer(ControllerSettings.getIP(), ControllerSettings.Port);
-  }
+  socketAvailable(SOCKET_MQTT);
+  registerSocketClient(mqtt, SOCKET_MQTT);
+  // checkHostReachable() did resolve the hostname using the DNS cache.
+  MQTTclient.setServer(ControllerSettings.getIP(), ControllerSettings.Port);
   MQTTclient.setCallback(callback);
 
   // MQTT needs a unique clientname to subscribe to broker
@@ -180,18 +1092,24 @@ bool MQTTConnect(int controller_idx)
   uint8_t willQos = 0;
   boolean willRetain = true;
 
+  START_TIMER;
   if ((SecuritySettings.ControllerUser[controller_idx] != 0) && (SecuritySettings.ControllerPassword[controller_idx] != 0)) {
     MQTTresult = MQTTclient.connect(clientid.c_str(), SecuritySettings.ControllerUser[controller_idx], SecuritySettings.ControllerPassword[controller_idx],
                                     LWTTopic.c_str(), willQos, willRetain, LWTMessageDisconnect.c_str());
   } else {
     MQTTresult = MQTTclient.connect(clientid.c_str(), LWTTopic.c_str(), willQos, willRetain, LWTMessageDisconnect.c_str());
   }
+  STOP_TIMER_CONTROLLER(controller_idx, CONTROLLER_CONNECT_STATS);
   yield();
 
   if (!MQTTresult) {
     addLog(LOG_LEVEL_ERROR, F("MQTT : Failed to connect to broker"));
+    // Only when no TCP connection was made, not when the broker refused the login.
+    if (MQTTclient.state() == MQTT_CONNECT_FAILED)
+      setHostReachable(ControllerSettings.getIP(), false);
     return false;
   }
+  setHostReachable(ControllerSettings.getIP(), true);
   MQTTclient_should_reconnect = false;
   String log = F("MQTT : Connected to broker with client ID: ");
   log += clientid;
@@ -221,7 +1139,7 @@ bool MQTTCheck(int controller_idx)
   if (!WiFiConnected(10)) {
     return false;
   }
-  byte ProtocolIndex = getProtocolIndex(Settings.Protocol[controller_idx]);
+  byte ProtocolIndex = getProtocolIndex_from_ControllerIndex(controller_idx);
   if (Protocol[ProtocolIndex].usesMQTT)
   {
     if (MQTTclient_should_reconnect || !MQTTclient.connected())
@@ -257,14 +1175,35 @@ void SendStatus(byte source, String status)
       MQTTStatus(status);
       break;
     case VALUE_SOURCE_SERIAL:
-      Serial.println(status);
+      serialConsolePrintln(status);
       break;
   }
 }
 
 boolean MQTTpublish(int controller_idx, const char* topic, const char* payload, boolean retained)
 {
-  if (MQTTclient.publish(topic, payload, retained)) {
+  String diagPayload;
+  if (controllerDiagCurrent != 0 && controller_idx >= 0 && controller_idx < CONTROLLER_MAX) {
+    // A sample, tagged for the load tests (see ControllerDiagnostic.ino)
+    diagPayload = payload;
+    if (addControllerDiagToPayload(diagPayload, controller_idx))
+      payload = diagPayload.c_str();
+  }
+  const size_t payloadLength = strlen(payload);
+  bool published;
+  if (MQTT_MAX_PACKET_SIZE >= 5 + 2 + strlen(topic) + payloadLength) {
+    published = MQTTclient.publish(topic, payload, retained);
+  } else {
+    // Too large for the packet buffer, write the payload directly to the connection.
+    published = MQTTclient.beginPublish(topic, payloadLength, retained);
+    if (published) {
+      MQTTclient.write(reinterpret_cast<const uint8_t*>(payload), payloadLength);
+      published = MQTTclient.endPublish();
+    }
+  }
+  if (published) {
+    if (controller_idx >= 0 && controller_idx < CONTROLLER_MAX)
+      ControllerStats[controller_idx].bytesSent += strlen(topic) + payloadLength;
     setIntervalTimerOverride(TIMER_MQTT, 10); // Make sure the MQTT is being processed as soon as possible.
     return true;
   }
@@ -272,6 +1211,333 @@ boolean MQTTpublish(int controller_idx, const char* topic, const char* payload,
   return false;
 }
 
+void countMQTTJson(void* context, const char* data, unsigned int length)
+{
+}
+
+// context: the bytes still to write, as announced by beginPublish()
+void writeMQTTJson(void* context, const char* data, unsigned int length)
+{
+  unsigned long& remaining = *static_cast<unsigned long*>(context);
+  if (length > remaining) length = remaining;
+  MQTTclient.write(reinterpret_cast<const uint8_t*>(data), length);
+  remaining -= length;
+}
+
+// Publish the JSON of writeJson without a buffer for the whole payload: it is called once to
+// count the length, then writes straight to the connection. So it must write the same both
+// times, from values taken before (context).
+boolean MQTTpublishJson(int controller_idx, const char* topic, void (*writeJson)(JsonWriter& json, void* context),
+                        void* context, boolean retained)
+{
+  if (controllerDiagCurrent != 0) {
+    // Tagged for the load tests, which needs the payload
+    String payload;
+    JsonWriter json(payload);
+    writeJson(json, context);
+    return MQTTpublish(controller_idx, topic, payload.c_str(), retained);
+  }
+  JsonWriter counter(countMQTTJson, NULL);
+  writeJson(counter, context);
+  const unsigned long payloadLength = counter.length();
+  bool published = MQTTclient.beginPublish(topic, payloadLength, retained);
+  if (published) {
+    unsigned long remaining = payloadLength;
+    JsonWriter json(writeMQTTJson, &remaining);
+    writeJson(json, context);
+    // Keep the stream valid if it came out shorter
+    for (; remaining != 0; --remaining)
+      MQTTclient.write(' ');
+    published = MQTTclient.endPublish();
+  }
+  if (published) {
+    if (controller_idx >= 0 && controller_idx < CONTROLLER_MAX)
+      ControllerStats[controller_idx].bytesSent += strlen(topic) + payloadLength;
+    setIntervalTimerOverride(TIMER_MQTT, 10); // Make sure the MQTT is being processed as soon as possible.
+    return true;
+  }
+  addLog(LOG_LEVEL_DEBUG, F("MQTT : publish failed"));
+  return false;
+}
+
+/*********************************************************************************************\
+ * Task payload modes of the MQTT controllers: one message per value, or one JSON message
+ * per task which can be combined with other tasks within a batch window. With the node
+ * snapshot the tasks do not publish, a timer publishes the values of all tasks at once.
+\*********************************************************************************************/
+void initMQTTPayloadConfig(byte controllerIndex)
+{
+  if (controllerIndex >= CONTROLLER_MAX) return;
+  mqttBatchStruct& batch = MQTTBatch[controllerIndex];
+  LoadCustomControllerSettings(controllerIndex, (byte*)&batch.config, sizeof(batch.config));
+  if (batch.config.PayloadMode > MQTT_PAYLOAD_NODE_SNAPSHOT)
+    batch.config.PayloadMode = MQTT_PAYLOAD_SINGLE_VALUE;
+  if (batch.config.BatchWindow > MQTT_BATCH_WINDOW_MAX)
+    batch.config.BatchWindow = MQTT_BATCH_WINDOW_MAX;
+  if (batch.config.SnapshotInterval == 0)
+    batch.config.SnapshotInterval = MQTT_SNAPSHOT_INTERVAL_DEF;
+  if (batch.config.SnapshotInterval > MQTT_SNAPSHOT_INTERVAL_MAX)
+    batch.config.SnapshotInterval = MQTT_SNAPSHOT_INTERVAL_MAX;
+  batch.tasks = 0;
+  batch.topic = "";
+  batch.payload = "";
+  msecTimerHandler.remove(getMixedId(MQTT_BATCH_TIMER, controllerIndex));
+  msecTimerHandler.remove(getMixedId(NODE_SNAPSHOT_TIMER, controllerIndex));
+  batch.topic.reserve(sizeof(ControllerSettingsStruct::Publish) + 32);
+  if (batch.config.PayloadMode != MQTT_PAYLOAD_SINGLE_VALUE)
+    batch.payload.reserve(MQTT_MAX_PACKET_SIZE);
+  if (batch.config.PayloadMode == MQTT_PAYLOAD_NODE_SNAPSHOT && Settings.ControllerEnabled[controllerIndex])
+    setTimer(NODE_SNAPSHOT_TIMER, controllerIndex, batch.config.SnapshotInterval * 1000UL);
+}
+
+void addMQTTPayloadConfigForm(byte controllerIndex)
+{
+  MQTTPayloadConfigStruct config;
+  LoadCustomControllerSettings(controllerIndex, (byte*)&config, sizeof(config));
+  String options[3];
+  options[0] = F("Message per value");
+  options[1] = F("JSON message per task");
+  options[2] = F("JSON snapshot of all tasks");
+  int optionValues[3] = { MQTT_PAYLOAD_SINGLE_VALUE, MQTT_PAYLOAD_JSON_TASK, MQTT_PAYLOAD_NODE_SNAPSHOT };
+  addFormSelector(F("Payload"), F("mqttpayloadmode"), 3, options, optionValues, config.PayloadMode);
+  addFormNumericBox(F("Batch Window"), F("mqttbatchwindow"), config.BatchWindow, 0, MQTT_BATCH_WINDOW_MAX);
+  addUnit(F("ms"));
+  addFormNote(F("JSON per task only. Tasks sent within this time are combined in one message, 0 = message per task"));
+  addFormNumericBox(F("Snapshot Interval"), F("mqttsnapshotinterval"),
+                    config.SnapshotInterval == 0 ? MQTT_SNAPSHOT_INTERVAL_DEF : config.SnapshotInterval, 1, MQTT_SNAPSHOT_INTERVAL_MAX);
+  addUnit(F("sec"));
+  addFormNote(F("Snapshot only. The last values of all tasks in one message, the tasks do not publish themselves"));
+}
+
+void saveMQTTPayloadConfig(byte controllerIndex)
+{
+  MQTTPayloadConfigStruct config;
+  config.PayloadMode = getFormItemInt(F("mqttpayloadmode"), MQTT_PAYLOAD_SINGLE_VALUE);
+  config.BatchWindow = getFormItemInt(F("mqttbatchwindow"), 0);
+  config.SnapshotInterval = getFormItemInt(F("mqttsnapshotinterval"), MQTT_SNAPSHOT_INTERVAL_DEF);
+  SaveCustomControllerSettings(controllerIndex, (byte*)&config, sizeof(config));
+}
+
+// Append the task values as JSON object members: "Temperature":21.5,"Humidity":45
+void appendMQTTTaskJson(String& payload, struct EventStruct *event)
+{
+  const byte valueCount = getValueCountFromSensorType(event->sensorType);
+  for (byte x = 0; x < valueCount; x++)
+  {
+    if (x != 0) payload += ',';
+    payload += to_json_object_value(ExtraTaskSettings.TaskDeviceValueNames[x], formatUserVarNoCheck(event, x));
+  }
+}
+
+// Topic for a batch of tasks: the publish template up to the first task related variable.
+void setMQTTBatchTopic(String& topic, const String& publishTemplate)
+{
+  topic = publishTemplate;
+  int cut = topic.length();
+  const String taskVars[] = { F("%tskname%"), F("%id%"), F("%valname%") };
+  for (byte i = 0; i < 3; ++i) {
+    const int pos = topic.indexOf(taskVars[i]);
+    if (pos != -1 && pos < cut) cut = pos;
+  }
+  topic.remove(cut);
+  while (topic.length() > 1 && topic.endsWith("/"))
+    topic.remove(topic.length() - 1);
+  parseSystemVariables(topic, false);
+}
+
+bool MQTTpublishTaskValues(struct EventStruct *event, const ControllerSettingsStruct& ControllerSettings)
+{
+  const byte controllerIndex = event->ControllerIndex;
+  mqttBatchStruct& batch = MQTTBatch[controllerIndex];
+  String& topic = batch.topic;
+  if (batch.config.PayloadMode == MQTT_PAYLOAD_NODE_SNAPSHOT)
+    return true;  // In the next snapshot
+  const ControllerTemplateStruct& publishTemplate = getControllerPublishTemplate(controllerIndex, ControllerSettings, false);
+  bool success = true;
+
+  if (batch.config.PayloadMode != MQTT_PAYLOAD_JSON_TASK) {
+    char value[FORMAT_VALUE_BUFFER_SIZE];
+    const byte valueCount = getValueCountFromSensorType(event->sensorType);
+    for (byte x = 0; x < valueCount; x++)
+    {
+      formatUserVarNoCheck(event, x, value);
+      topic = "";
+      appendControllerTemplate(topic, publishTemplate, event, x, value);
+      if (!MQTTpublish(controllerIndex, topic.c_str(), value, Settings.MQTTRetainFlag))
+        success = false;
+      if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+        String log = F("MQTT : ");
+        log += topic;
+        log += ' ';
+        log += value;
+        addLog(LOG_LEVEL_DEBUG, log);
+      }
+    }
+    return success;
+  }
+
+  String& payload = batch.payload;
+  if (batch.config.BatchWindow == 0) {
+    topic = "";
+    appendControllerTemplate(topic, publishTemplate, event, CONTROLLER_TEMPLATE_NO_VALUE, NULL);
+    payload = "{";
+    appendMQTTTaskJson(payload, event);
+    payload += '}';
+    success = MQTTpublish(controllerIndex, topic.c_str(), payload.c_str(), Settings.MQTTRetainFlag);
+    if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+      String log = F("MQTT : ");
+      log += topic;
+      log += ' ';
+      log += payload;
+      addLog(LOG_LEVEL_DEBUG, log);
+    }
+    payload = "";
+    return success;
+  }
+
+  // Batch: {"Task1":{"Temperature":21.5},"Task2":{...}}
+  if (batch.tasks == 0) {
+    setMQTTBatchTopic(topic, ControllerSettings.Publish);
+    payload = "{";
+    setTimer(MQTT_BATCH_TIMER, controllerIndex, batch.config.BatchWindow);
+  }
+  const unsigned int start = payload.length();
+  if (batch.tasks != 0) payload += ',';
+  payload += '"';
+  payload += getTaskDeviceName(event->TaskIndex);
+  payload += F("\":{");
+  appendMQTTTaskJson(payload, event);
+  payload += '}';
+  ++batch.tasks;
+
+  // Packet needs room for the fixed header, topic and closing accolade.
+  const unsigned int maxPayload = MQTT_MAX_PACKET_SIZE - 8 - topic.length();
+  if (payload.length() > maxPayload && batch.tasks > 1) {
+    // Does not fit anymore, send what we had and start a new batch with this task.
+    String entry = payload.substring(start + 1);
+    payload.remove(start);
+    --batch.tasks;
+    success = flushMQTTBatch(controllerIndex);
+    payload = "{";
+    payload += entry;
+    batch.tasks = 1;
+    setTimer(MQTT_BATCH_TIMER, controllerIndex, batch.config.BatchWindow);
+  }
+  return success;
+}
+
+void process_mqtt_batch(unsigned long controllerIndex)
+{
+  if (controllerIndex >= CONTROLLER_MAX) return;
+  flushMQTTBatch(controllerIndex);
+}
+
+bool flushMQTTBatch(byte controllerIndex)
+{
+  mqttBatchStruct& batch = MQTTBatch[controllerIndex];
+  if (batch.tasks == 0) return true;
+  batch.payload += '}';
+  const bool success = MQTTpublish(controllerIndex, batch.topic.c_str(), batch.payload.c_str(), Settings.MQTTRetainFlag);
+  if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+    String log = F("MQTT : ");
+    log += batch.topic;
+    log += F(" batch of ");
+    log += batch.tasks;
+    log += F(" tasks, ");
+    log += batch.payload.length();
+    log += getWebString(WEB_STR_BYTES);
+    addLog(LOG_LEVEL_DEBUG, log);
+  }
+  batch.payload = "";
+  batch.tasks = 0;
+  msecTimerHandler.remove(getMixedId(MQTT_BATCH_TIMER, controllerIndex));
+  return success;
+}
+
+void process_node_snapshot(unsigned long controllerIndex)
+{
+  if (controllerIndex >= CONTROLLER_MAX) return;
+  const mqttBatchStruct& batch = MQTTBatch[controllerIndex];
+  if (batch.config.PayloadMode != MQTT_PAYLOAD_NODE_SNAPSHOT || !Settings.ControllerEnabled[controllerIndex]) return;
+  setTimer(NODE_SNAPSHOT_TIMER, controllerIndex, batch.config.SnapshotInterval * 1000UL);
+  publishNodeSnapshot(controllerIndex);
+}
+
+// The last values of all tasks, read together before formatting:
+// {"Time":1539512345,"Tasks":{"Task1":{"Temperature":21.5},"Task2":{...}}}
+// A snapshot too large for a packet is split per task, each part with the same time.
+bool publishNodeSnapshot(byte controllerIndex)
+{
+  mqttBatchStruct& batch = MQTTBatch[controllerIndex];
+  TaskValueSnapshot* snapshots = new TaskValueSnapshot[TASKS_MAX];
+  bool valid[TASKS_MAX];
+  for (byte TaskIndex = 0; TaskIndex < TASKS_MAX; TaskIndex++)
+    valid[TaskIndex] = Settings.TaskDeviceNumber[TaskIndex] != 0 && Settings.TaskDeviceEnabled[TaskIndex] &&
+                       getTaskValueSnapshot(TaskIndex, snapshots[TaskIndex]) &&
+                       snapshots[TaskIndex].timestamp != 0;
+
+  ControllerSettingsStruct ControllerSettings;
+  LoadControllerSettings(controllerIndex, (byte*)&ControllerSettings, sizeof(ControllerSettings));
+  String& topic = batch.topic;
+  setMQTTBatchTopic(topic, ControllerSettings.Publish);
+  String head = F("{\"Time\":");
+  head += getUnixTime();
+  head += F(",\"Tasks\":{");
+  const unsigned int maxPayload = MQTT_MAX_PACKET_SIZE - 8 - topic.length();
+
+  String& payload = batch.payload;
+  payload = head;
+  byte tasks = 0;
+  bool success = true;
+  char value[FORMAT_VALUE_BUFFER_SIZE];
+  String entry;
+  for (byte TaskIndex = 0; TaskIndex < TASKS_MAX; TaskIndex++) {
+    if (!valid[TaskIndex]) continue;
+    const byte DeviceIndex = getDeviceIndex(Settings.TaskDeviceNumber[TaskIndex]);
+    const byte valueCount = Device[DeviceIndex].ValueCount;
+    if (valueCount == 0) continue;
+    LoadTaskSettings(TaskIndex);
+    const TaskValueSnapshot& snapshot = snapshots[TaskIndex];
+    entry = '"';
+    entry += ExtraTaskSettings.TaskDeviceName;
+    entry += F("\":{");
+    for (byte x = 0; x < valueCount && x < VARS_PER_TASK; x++) {
+      if (x != 0) entry += ',';
+      if (Device[DeviceIndex].VType == SENSOR_TYPE_LONG)
+        ultoa(snapshot.getLong(), value, 10);
+      else
+        formatTaskValue(snapshot, x, ExtraTaskSettings.TaskDeviceValueDecimals[x], value);
+      entry += to_json_object_value(ExtraTaskSettings.TaskDeviceValueNames[x], value);
+    }
+    entry += '}';
+    if (tasks != 0 && payload.length() + entry.length() + 3 > maxPayload) {
+      payload += F("}}");
+      if (!MQTTpublish(controllerIndex, topic.c_str(), payload.c_str(), Settings.MQTTRetainFlag))
+        success = false;
+      payload = head;
+      tasks = 0;
+    }
+    if (tasks != 0) payload += ',';
+    payload += entry;
+    ++tasks;
+  }
+  delete[] snapshots;
+  payload += F("}}");
+  if (!MQTTpublish(controllerIndex, topic.c_str(), payload.c_str(), Settings.MQTTRetainFlag))
+    success = false;
+  if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+    String log = F("MQTT : ");
+    log += topic;
+    log += F(" snapshot, ");
+    log += payload.length();
+    log += getWebString(WEB_STR_BYTES);
+    addLog(LOG_LEVEL_DEBUG, log);
+  }
+  payload = "";
+  if (success) ++batch.snapshots;
+  return success;
+}
+
 /*********************************************************************************************\
  * Send status info back to channel where request came from
 \*********************************************************************************************/
@@ -0,0 +1,106 @@
+//********************************************************************************
+// Controller diagnostics (Settings.ControllerDiagnostic)
+// For load tests with test/controlleremu.py: every sample sent to a controller is
+// tagged with the unit, the controller, the controller plugin, a sequence number per
+// controller and the unix time of the sample and of the send (sec with msec), e.g.
+//   u=3,c=1,p=2,n=1234,t=1546300800.123,s=1546300800.456
+// HTTP controllers send it as header X-ESPEasy-Diag (see sendControllerHttpRequest()),
+// MQTT controllers in the payload: as member "diag" of a JSON object, else appended
+// as " diag:<tag>", like the UDP and telnet controllers do for each message.
+// The sequence is taken when sendData() hands the sample to the controller, so it is
+// kept in the controller queue and the backlog file: a gap is a lost sample, a repeat
+// a duplicate. A bulk request of a batch has the range of its records, n=first-last.
+// Messages which are not a sample (status, LWT, node snapshots, MQTT batch windows)
+// and the binary frames of C013 are not tagged. The times need the clock set by NTP.
+// controllerDiagSequence and controllerDiagCurrent are in ESPEasy-Globals.h, they
+// are used by Controller.ino.
+//********************************************************************************
+
+// Called by sendData() for each controller the sample is sent to, 0 when not used.
+unsigned long nextControllerDiagSequence(byte controllerIndex) {
+  if (!Settings.ControllerDiagnostic || controllerIndex >= CONTROLLER_MAX) return 0;
+  return ++controllerDiagSequence[controllerIndex];
+}
+
+void appendDiagTime(String& tag, unsigned long timestamp) {
+  const uint64_t msec = getUnixTimeMsec(timestamp);
+  tag += static_cast<uint32_t>(msec / 1000);
+  tag += '.';
+  const unsigned int fraction = msec % 1000;
+  if (fraction < 100) tag += '0';
+  if (fraction < 10) tag += '0';
+  tag += fraction;
+}
+
+// Tag of the message being sent by the controller, empty when it is not a sample.
+String getControllerDiagTag(byte controllerIndex) {
+  String tag;
+  if (!Settings.ControllerDiagnostic || controllerIndex >= CONTROLLER_MAX) return tag;
+  unsigned long first = controllerDiagCurrent;
+  unsigned long last = first;
+  unsigned long sampleMillis = controllerSampleMillis != 0 ? controllerSampleMillis : millis();
+  const controllerBatchStruct& batch = ControllerBatch[controllerIndex];
+  if (batch.count != 0 && controllerBatching(controllerIndex)) {
+    // The bulk request, timed from its first record
+    first = batch.firstSequence;
+    last = batch.lastSequence;
+    sampleMillis = batch.firstRecord;
+  }
+  if (first == 0) return tag;
+  tag = F("u=");
+  tag += Settings.Unit;
+  tag += F(",c=");
+  tag += controllerIndex + 1;
+  tag += F(",p=");
+  tag += Settings.Protocol[controllerIndex];
+  tag += F(",n=");
+  tag += first;
+  if (last != first) {
+    tag += '-';
+    tag += last;
+  }
+  tag += F(",t=");
+  appendDiagTime(tag, sampleMillis);
+  tag += F(",s=");
+  appendDiagTime(tag, millis());
+  return tag;
+}
+
+// Append " diag:<tag>" to a text message, returns false when not tagged.
+bool appendControllerDiagTag(String& message, byte controllerIndex) {
+  const String tag = getControllerDiagTag(controllerIndex);
+  if (tag.length() == 0) return false;
+  message += F(" diag:");
+  message += tag;
+  return true;
+}
+
+// MQTT payloads, a JSON object gets the tag as member "diag".
+bool addControllerDiagToPayload(String& payload, byte controllerIndex) {
+  if (!payload.startsWith(F("{")) || !payload.endsWith(F("}")))
+    return appendControllerDiagTag(payload, controllerIndex);
+  const String tag = getControllerDiagTag(controllerIndex);
+  if (tag.length() == 0) return false;
+  payload.remove(payload.length() - 1);
+  if (payload.length() > 1) payload += ',';
+  payload += F("\"diag\":\"");
+  payload += tag;
+  payload += F("\"}");
+  return true;
+}
+
+// HTTP request with the header added after the request line, empty when not tagged.
+String getControllerDiagRequest(byte controllerIndex, const String& request) {
+  String result;
+  const int lineEnd = request.indexOf(F("\r\n"));
+  if (lineEnd < 0) return result;
+  const String tag = getControllerDiagTag(controllerIndex);
+  if (tag.length() == 0) return result;
+  result.reserve(request.length() + tag.length() + 20);
+  result = request.substring(0, lineEnd + 2);
+  result += F("X-ESPEasy-Diag: ");
+  result += tag;
+  result += F("\r\n");
+  result += request.substring(lineEnd + 2);
+  return result;
+}
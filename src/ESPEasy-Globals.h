@@ -163,6 +163,13 @@
 //add this if you want SD support (add 10k flash)
 //#define FEATURE_SD
 
+//add this for a history of task values in SPIFFS, queried with /timeseries (40k SPIFFS, 2k RAM)
+//#define FEATURE_TIMESERIES
+
+// Execution trace of the last events, download as Chrome trace JSON at /trace
+// Uses 12 bytes of RAM per event (128 on ESP8266, 512 on ESP32)
+//#define FEATURE_TRACE
+
 // ********************************************************************************
 //   DO NOT CHANGE ANYTHING BELOW THIS LINE
 // ********************************************************************************
@@ -203,6 +210,31 @@
 #define TIMER_MQTT                          5
 #define TIMER_STATISTICS                    6
 
+// Timer types of the scheduler, kept in the upper bits of the timer id, see getMixedId()
+// The lower TIMER_ID_SHIFT bits are the id, up to 255 timer types.
+#define TIMER_ID_SHIFT                      24
+#define CONST_INTERVAL_TIMER                1
+#define GENERIC_TIMER                       2
+#define SYSTEM_TIMER                        3
+#define TASK_DEVICE_TIMER                   4
+#define CONTROLLER_QUEUE_TIMER              5
+#define MQTT_BATCH_TIMER                    6
+#define CONTROLLER_TIMER                    7
+#define NTP_TIMER                           8
+#define NODE_ANNOUNCE_TIMER                 9
+#define HOST_CHECK_TIMER                    10
+#define OUTPUT_SEQUENCER_TIMER              11
+#define RULES_TIMER                         12
+#define CLOCK_TIMER                         13
+#define NODE_SNAPSHOT_TIMER                 14
+#define TASK_INIT_TIMER                     15
+#define NOTIFICATION_TIMER                  16
+#define SLEEP_SAMPLES_TIMER                 17
+#define RADIO_TIMER                         18
+#define UDP_GROUP_TIMER                     19
+// Keep the highest timer type here
+static_assert(UDP_GROUP_TIMER < (1UL << (32 - TIMER_ID_SHIFT)), "Timer type does not fit in the mixed timer id");
+
 #define PLUGIN_INIT_ALL                     1
 #define PLUGIN_INIT                         2
 #define PLUGIN_READ                         3
@@ -228,7 +260,15 @@
 #define PLUGIN_EXIT                        23
 #define PLUGIN_GET_CONFIG                  24
 #define PLUGIN_UNCONDITIONAL_POLL          25
+
+// Periodic calls a plugin handles, set in Device[].PeriodicCallbacks at PLUGIN_DEVICE_ADD.
+// PluginCall only dispatches these functions to tasks running a plugin that subscribed to them.
+#define PLUGIN_CALLBACK_FIFTY_PER_SECOND   0x01
+#define PLUGIN_CALLBACK_TEN_PER_SECOND     0x02
+#define PLUGIN_CALLBACK_ONCE_A_SECOND      0x04
+#define PLUGIN_CALLBACK_NR_TYPES              3
 #define PLUGIN_REQUEST                     26
+#define PLUGIN_INTERRUPT_EVENT             27  // Event pushed by an interrupt handler, see pushInterruptEvent()
 
 #define CPLUGIN_PROTOCOL_ADD                1
 #define CPLUGIN_PROTOCOL_TEMPLATE           2
@@ -241,6 +281,7 @@
 #define CPLUGIN_TASK_CHANGE_NOTIFICATION    9
 #define CPLUGIN_INIT                       10
 #define CPLUGIN_UDP_IN                     11
+#define CPLUGIN_TIMER_IN                   12  // Called on timers set with setControllerTimer()
 
 #define CONTROLLER_HOSTNAME                 1
 #define CONTROLLER_IP                       2
@@ -259,6 +300,7 @@
 #define NPLUGIN_WEBFORM_LOAD                4
 #define NPLUGIN_WRITE                       5
 #define NPLUGIN_NOTIFY                      6
+#define NPLUGIN_TIMER_IN                    7  // See setNotificationTimer()
 #define NPLUGIN_NOT_FOUND                 255
 
 
@@ -296,13 +338,25 @@
 #define CPLUGIN_MAX                        16
 #define NPLUGIN_MAX                         4
 #define UNIT_MAX                           32 // Only relevant for UDP unicast message 'sweeps' and the nodelist.
-#define RULES_TIMER_MAX                     8
+#define RULES_TIMER_MAX                   256 // Highest timer number, only running and paused timers use memory.
 #define PINSTATE_TABLE_MAX                 32
+#define PINSTATE_INDEX_SIZE                64 // Power of 2, > PINSTATE_TABLE_MAX
 #define RULES_MAX_SIZE                   2048
 #define RULES_MAX_NESTING_LEVEL             3
+
+#define CONTROLLER_QUEUE_MAX_DEPTH          8
+#define CONTROLLER_QUEUE_DEFAULT_DEPTH      4
+#define CONTROLLER_QUEUE_DROP_OLDEST        0
+#define CONTROLLER_QUEUE_DROP_NEWEST        1
+#define CONTROLLER_BACKLOG_RETRY_INTERVAL   1000  // msec between checks while a controller is offline
+#define CONTROLLER_BACKLOG_REPLAY_INTERVAL    20  // msec between samples replayed from file
+#define CONTROLLER_SEND_RETRIES                8  // Failed sends of a sample before it is dropped
+#define CONTROLLER_SEND_RETRY_MAX_INTERVAL 60000  // msec, the retry interval doubles up to this
 #define RULESETS_MAX                        4
 #define RULES_BUFFER_SIZE                  64
+#define IDLE_SLEEP_MAX_MSEC                20  // Max. sleep time in Eco power mode, limits response time
 #define NAME_FORMULA_LENGTH_MAX            40
+#define FORMAT_VALUE_BUFFER_SIZE           24  // Formatted task value, see formatFloat()
 
 #define PIN_MODE_UNDEFINED                  0
 #define PIN_MODE_INPUT                      1
@@ -405,20 +459,49 @@ bool showSettingsFileLayout = false;
 #include "Custom.h"
 #endif
 
+/*
+        Hot code in IRAM. Built with -DFEATURE_IRAM_HOT the functions marked HOT_IRAM_ATTR run from
+    IRAM instead of through the flash cache, so a cache miss does not add to their run time:
+    the scheduler (handle_schedule() and the timer heap), the time helpers, the plugin lookup
+    of PluginCall() and the pulse counter interrupt. The RFID and encoder interrupts only call
+    pushInterruptEvent(), which is always in IRAM.
+    IRAM is scarce on ESP8266, check the budget with "memanalyzer.py <objdump> --iram".
+*/
+#ifdef FEATURE_IRAM_HOT
+  #if defined(ESP32)
+    #define HOT_IRAM_ATTR IRAM_ATTR
+  #else
+    #define HOT_IRAM_ATTR ICACHE_RAM_ATTR
+  #endif
+#else
+  #define HOT_IRAM_ATTR
+#endif
+
 #include "WebStaticData.h"
+#include "WebStaticData_gz.h"
+#include "WebStrings.h"
 #include "ESPEasyTimeTypes.h"
 #include "I2CTypes.h"
+#include "MQTTTopicTrie.h"
+#include "JsonWriter.h"
 #include <I2Cdev.h>
 #include <map>
+#include <vector>
 
 #define FS_NO_GLOBALS
 #if defined(ESP8266)
   #include "core_version.h"
   #define NODE_TYPE_ID                        NODE_TYPE_ID_ESP_EASYM_STD
   #define FILE_CONFIG       "config.dat"
+  #define FILE_CONFIG_CRC   "config.crc"
   #define FILE_SECURITY     "security.dat"
   #define FILE_NOTIFICATION "notification.dat"
   #define FILE_RULES        "rules1.txt"
+  #define FILE_BACKLOG      "backlog"
+  #define FILE_SLEEP_SAMPLES "samples.dat"
+  #define FILE_TIMING_BASELINE "timingbase.dat"
+  #define FILE_TIMESERIES   "timeseries.dat"
+  #define FILE_SNAPSHOT_TMP "snapshot.tmp"
   #include <lwip/init.h>
   #ifndef LWIP_VERSION_MAJOR
     #error
@@ -434,8 +517,7 @@ bool showSettingsFileLayout = false;
   ESP8266WebServer WebServer(80);
   #include <DNSServer.h>
   #include <Servo.h>
-  #include <ESP8266HTTPUpdateServer.h>
-  ESP8266HTTPUpdateServer httpUpdater(true);
+  #include <Updater.h>
   #ifndef LWIP_OPEN_SRC
   #define LWIP_OPEN_SRC
   #endif
@@ -450,6 +532,9 @@ bool showSettingsFileLayout = false;
   extern "C" {
   #include "spi_flash.h"
   }
+  extern "C" {
+  #include "umm_malloc/umm_malloc.h"
+  }
   extern "C" uint32_t _SPIFFS_start;
   extern "C" uint32_t _SPIFFS_end;
   extern "C" uint32_t _SPIFFS_page;
@@ -472,15 +557,34 @@ bool showSettingsFileLayout = false;
   #define NODE_TYPE_ID                        NODE_TYPE_ID_ESP_EASY32_STD
   #define ICACHE_RAM_ATTR IRAM_ATTR
   #define FILE_CONFIG       "/config.dat"
+  #define FILE_CONFIG_CRC   "/config.crc"
   #define FILE_SECURITY     "/security.dat"
   #define FILE_NOTIFICATION "/notification.dat"
   #define FILE_RULES        "/rules1.txt"
+  #define FILE_BACKLOG      "/backlog"
+  #define FILE_SLEEP_SAMPLES "/samples.dat"
+  #define FILE_TIMING_BASELINE "/timingbase.dat"
+  #define FILE_TIMESERIES   "/timeseries.dat"
+  #define FILE_SNAPSHOT_TMP "/snapshot.tmp"
   #include <WiFi.h>
   #include  "esp32_ping.h"
   #include <ESP32WebServer.h>
+  #include <Update.h>
+  #include <lwip/sockets.h>
   #include "SPIFFS.h"
   #include <rom/rtc.h>
-  ESP32WebServer WebServer(80);
+  // Adds a way to hand the current client over to a deferred response (see WebServer.ino),
+  // so the next request is accepted while the previous page is still being sent.
+  class ESPEasyWebServer : public ESP32WebServer {
+  public:
+    ESPEasyWebServer(int port) : ESP32WebServer(port) {}
+
+    void releaseClient() {
+      _currentClient = WiFiClient();
+      _currentStatus = HC_NONE;
+    }
+  };
+  ESPEasyWebServer WebServer(80);
   #ifdef FEATURE_MDNS
     #include <ESPmDNS.h>
   #endif
@@ -563,6 +667,9 @@ bool WiFiConnected(uint32_t timeout_ms);
 bool WiFiConnected();
 bool hostReachable(const IPAddress& ip);
 bool hostReachable(const String& hostname);
+void setHostReachable(const IPAddress& ip, bool reachable);
+bool resolveHostByName(const char* hostname, IPAddress& ip);
+void invalidateHostByName(const char* hostname);
 void formatMAC(const uint8_t* mac, char (&strMAC)[20]);
 void formatIP(const IPAddress& ip, char (&strIP)[20]);
 String to_json_object_value(const String& object, const String& value);
@@ -658,6 +765,17 @@ struct SettingsStruct
     SyslogFacility = DEFAULT_SYSLOG_FACILITY;
     StructSize = 0;
     MQTTUseUnitNameAsClientId = 0;
+    EcoPowerMode = false;
+    ControllerQueueDepth = CONTROLLER_QUEUE_DEFAULT_DEPTH;
+    ControllerQueueDropPolicy = CONTROLLER_QUEUE_DROP_OLDEST;
+    ControllerBacklogFileSize = 0;
+    StallBudget = 0;
+    StallEvent = false;
+    DeepSleepSensorFirst = false;
+    DeepSleepBatchWakes = 0;
+    DeepSleepBatchFlash = false;
+    RadioOffMax = 0;
+    ControllerDiagnostic = false;
 
     for (byte i = 0; i < CONTROLLER_MAX; ++i) {
       Protocol[i] = 0;
@@ -699,6 +817,10 @@ struct SettingsStruct
     TaskDeviceDataFeed[task] = 0;
     TaskDeviceTimer[task] = 0;
     TaskDeviceEnabled[task] = false;
+    TaskDeviceI2CClock[task] = 0;
+    TaskDeviceSampleInterval[task] = 0;
+    TaskDeviceTriggerMask[task] = 0;
+    TaskDeviceGroup[task] = 0;
   }
 
   unsigned long PID;
@@ -784,6 +906,21 @@ struct SettingsStruct
   //TODO: document config.dat somewhere here
   float         Latitude;
   float         Longitude;
+  boolean       EcoPowerMode;  // Sleep in the main loop until the next scheduled timer is due.
+  byte          ControllerQueueDepth;       // Samples queued per controller, 0 = send from sendData() directly.
+  byte          ControllerQueueDropPolicy;  // CONTROLLER_QUEUE_DROP_xxx, what to do when a queue is full.
+  uint16_t      ControllerBacklogFileSize;  // kB per controller to move a full queue to SPIFFS, 0 = RAM only.
+  uint16_t      StallBudget;   // msec, a plugin call, controller send, web page or rules event taking longer is logged. 0 = off.
+  boolean       StallEvent;    // Send System#Stall=<msec> to the rules on a stall.
+  byte          TaskDeviceI2CClock[TASKS_MAX];  // I2C clock in 100 kHz steps during the calls of an I2C task, 0 = default.
+  uint16_t      TaskDeviceSampleInterval[TASKS_MAX];  // msec between reads, aggregated and sent at the task interval. 0 = send every read.
+  uint32_t      TaskDeviceTriggerMask[TASKS_MAX];     // Run the task when one of these tasks sent (bit n = task n+1), see TaskTrigger.ino
+  boolean       DeepSleepSensorFirst;  // Wake from deep sleep without RF, and with RF only to send, see SleepWake.ino
+  byte          DeepSleepBatchWakes;   // Wakes without RF to collect samples, sent in a batch, see SleepWakeSamples.ino. 0 = send at the next wake.
+  boolean       DeepSleepBatchFlash;   // Samples which do not fit in RTC memory go to SPIFFS.
+  uint16_t      RadioOffMax;   // sec the WiFi radio is off at most between sends, see ScheduledRadio.ino. 0 = always on.
+  byte          TaskDeviceGroup[TASKS_MAX];  // Read together with the other tasks of the group, see TaskGroup.ino. 0 = no group.
+  boolean       ControllerDiagnostic;  // Tag the samples sent to controllers for load tests, see ControllerDiagnostic.ino
 
   // FIXME @TD-er: As discussed in #1292, the CRC for the settings is now disabled.
   // make sure crc is the last value in the struct
@@ -836,12 +973,15 @@ struct ControllerSettingsStruct
     if (!WiFiConnected(10)) {
       return false; // Not connected, so no use in wasting time to connect to a host.
     }
-    if (quick && ipSet()) return true;
     if (UseDNS) {
+      // The DNS cache makes this cheap. When not quick, a connection just failed,
+      // so the cached address may be outdated.
+      if (!quick) invalidateHostByName(HostName);
       if (!updateIPcache()) {
         return false;
       }
     }
+    if (quick && ipSet()) return true;
     return hostReachable(getIP());
   }
 
@@ -854,10 +994,15 @@ struct ControllerSettingsStruct
     while (retry > 0 && !connected) {
       --retry;
       connected = client.connect(getIP(), Port);
-      if (connected) return true;
+      if (connected) {
+        setHostReachable(getIP(), true);
+        return true;
+      }
       if (!checkHostReachable(false))
         return false;
     }
+    // Skip this host for a while, instead of waiting for the connect timeout on every send.
+    setHostReachable(getIP(), false);
     return false;
   }
 
@@ -899,7 +1044,7 @@ private:
     }
     if (!WiFiConnected()) return false;
     IPAddress tmpIP;
-    if (WiFi.hostByName(HostName, tmpIP)) {
+    if (resolveHostByName(HostName, tmpIP)) {
       for (byte x = 0; x < 4; x++) {
         IP[x] = tmpIP[x];
       }
@@ -910,6 +1055,237 @@ private:
 
 };
 
+/*********************************************************************************************\
+ * TCP socket budget, the subsystems sharing the TCP connections. See Networking.ino
+\*********************************************************************************************/
+#define SOCKET_MQTT                 0  // Reserved
+#define SOCKET_CONTROLLER           1  // Reserved
+#define SOCKET_WEB_EVENTS           2
+#define SOCKET_SER2NET              3
+#define SOCKET_P1_GATEWAY           4
+#define SOCKET_OTHER                5  // Email, reporting
+#define SOCKET_TYPES                6
+#define SOCKET_RESERVED_TYPES       2  // Types below this get a reserved connection
+
+bool socketAvailable(byte type);
+void acquireSocketLease(byte type);
+void releaseSocketLease(byte type);
+
+// A connection held for the lifetime of a function, e.g. a WiFiClient on the stack.
+struct SocketLease
+{
+  explicit SocketLease(byte socketType) : type(socketType), granted(socketAvailable(socketType)) {
+    if (granted) acquireSocketLease(type);
+  }
+  ~SocketLease() {
+    if (granted) releaseSocketLease(type);
+  }
+
+  const byte type;
+  const bool granted;
+};
+
+/*********************************************************************************************\
+ * Kept-alive HTTP connection per controller, see sendControllerHttpRequest()
+\*********************************************************************************************/
+#define CONTROLLER_HTTP_REPLY_TIMEOUT     200  // msec to wait for the reply to start
+#define CONTROLLER_HTTP_READ_TIMEOUT     1000  // msec to read the rest of the reply
+#define CONTROLLER_HTTP_BODY_MAX          256  // Bytes of a reply body kept, see sendControllerHttpRequest()
+
+struct controllerConnectionStruct
+{
+  controllerConnectionStruct() :
+    requests(0), connects(0), failed(0), latencyTotal(0), latencyMax(0) {}
+
+  void markRequest(unsigned long latency) {
+    ++requests;
+    latencyTotal += latency;
+    if (latency > latencyMax) latencyMax = latency;
+  }
+
+  WiFiClient client;
+  unsigned long requests;      // Requests with a reply
+  unsigned long connects;      // New TCP connections made
+  unsigned long failed;        // Requests without a reply
+  unsigned long latencyTotal;
+  unsigned long latencyMax;
+} ControllerConnections[CONTROLLER_MAX];
+
+/*********************************************************************************************\
+ * Task payload mode of the MQTT controllers, see MQTTpublishTaskValues()
+\*********************************************************************************************/
+#define MQTT_PAYLOAD_SINGLE_VALUE   0  // One message per value
+#define MQTT_PAYLOAD_JSON_TASK      1  // One JSON message per task
+#define MQTT_PAYLOAD_NODE_SNAPSHOT  2  // One JSON message with the values of all tasks, at an interval
+#define MQTT_BATCH_WINDOW_MAX    5000  // msec
+#define MQTT_SNAPSHOT_INTERVAL_DEF 60  // sec
+#define MQTT_SNAPSHOT_INTERVAL_MAX 3600
+
+// Stored as custom controller settings, all zero means one message per value.
+struct MQTTPayloadConfigStruct
+{
+  MQTTPayloadConfigStruct() : PayloadMode(MQTT_PAYLOAD_SINGLE_VALUE), BatchWindow(0), SnapshotInterval(0) {}
+  byte          PayloadMode;
+  unsigned int  BatchWindow;       // msec to collect tasks into a single message, 0 = publish per task
+  unsigned int  SnapshotInterval;  // sec between node snapshots, 0 = MQTT_SNAPSHOT_INTERVAL_DEF
+};
+
+struct mqttBatchStruct
+{
+  mqttBatchStruct() : tasks(0), snapshots(0) {}
+
+  MQTTPayloadConfigStruct config;
+  String topic;    // Preallocated, reused for every publish
+  String payload;  // Preallocated in JSON mode
+  byte tasks;      // Tasks collected in the pending batch
+  unsigned long snapshots;  // Node snapshots published
+} MQTTBatch[CONTROLLER_MAX];
+
+/*********************************************************************************************\
+ * Minimum send interval of rate limited HTTP controllers, see mergeControllerValues()
+\*********************************************************************************************/
+#define CONTROLLER_MERGE_LAST          0  // Send the last value of a field
+#define CONTROLLER_MERGE_AVERAGE       1  // Send the average of the values merged into a field
+#define CONTROLLER_RATE_LIMIT_FIELDS   8  // Fields kept in the pending record
+#define CONTROLLER_RATE_LIMIT_MAX  65000  // msec
+#define CONTROLLER_RATE_LIMIT_RETRY 5000  // msec before sending a pending record again after a failure
+#define THINGSPEAK_MIN_INTERVAL    15000  // msec, updates sent more often are refused
+
+// Stored as custom controller settings, all zero means the default interval of the controller.
+struct rateLimitConfigStruct
+{
+  rateLimitConfigStruct() : MinInterval(0), MergeMode(CONTROLLER_MERGE_LAST) {}
+  unsigned int  MinInterval;  // msec between requests, 0 = controller default
+  byte          MergeMode;
+};
+
+struct rateLimitFieldStruct
+{
+  rateLimitFieldStruct() : field(0), sum(0), last(0), lastLong(0), count(0), decimals(0), isLong(false) {}
+
+  int field;               // Field number, idx + value index
+  float sum;
+  float last;
+  unsigned long lastLong;  // Value of a SENSOR_TYPE_LONG task, does not fit a float
+  unsigned int count;      // Values merged since the last request
+  byte decimals;
+  bool isLong;
+};
+
+struct rateLimitStruct
+{
+  rateLimitStruct() : interval(0), mergeMode(CONTROLLER_MERGE_LAST), lastSend(0), fieldCount(0), merged(0), refused(0) {}
+
+  unsigned int interval;
+  byte mergeMode;
+  unsigned long lastSend;  // Start of the current window
+  byte fieldCount;
+  unsigned long merged;    // Values merged into a pending record instead of being sent
+  unsigned long refused;   // Requests answered with another status than 200, see logControllerRefused()
+  rateLimitFieldStruct fields[CONTROLLER_RATE_LIMIT_FIELDS];
+} ControllerRateLimit[CONTROLLER_MAX];
+
+/*********************************************************************************************\
+ * Batches of timestamped records for controllers with a bulk upload, see addControllerBatchRecord()
+\*********************************************************************************************/
+#define CONTROLLER_BATCH_MAX_RECORDS   100
+#define CONTROLLER_BATCH_MAX_AGE      3600  // sec
+#define CONTROLLER_BATCH_MAX_BYTES    2048  // The batch is sent when its records reach this size
+
+// Part of the custom controller settings, all zero means a request per sample.
+struct controllerBatchConfigStruct
+{
+  controllerBatchConfigStruct() : MaxRecords(0), MaxAge(0) {}
+  byte          MaxRecords;  // Records per request, 0 = no batches
+  uint16_t      MaxAge;      // sec, the batch is sent when its first record is this old. 0 = only when full
+};
+
+struct controllerBatchStruct
+{
+  controllerBatchStruct() : count(0), flush(false), firstRecord(0), firstSequence(0), lastSequence(0),
+    requests(0), records(0), dropped(0) {}
+
+  controllerBatchConfigStruct config;
+  String body;                // Records formatted by the controller, joined by its separator
+  byte count;
+  bool flush;                 // Send at the next timer, e.g. before deep sleep
+  unsigned long firstRecord;  // millis()
+  unsigned long firstSequence;  // Diagnostic sequence of the records, see ControllerDiagnostic.ino
+  unsigned long lastSequence;
+  unsigned long requests;     // Bulk requests sent
+  unsigned long records;      // Records sent in them
+  unsigned long dropped;      // No room while the controller could not be reached
+} ControllerBatch[CONTROLLER_MAX];
+
+/*********************************************************************************************\
+ * Controller templates compiled at CPLUGIN_INIT, see compileControllerTemplate()
+\*********************************************************************************************/
+#define CONTROLLER_TEMPLATE_NO_VALUE  255  // varIndex of a send for all values, %valname% is left out
+
+struct ControllerTemplateStruct
+{
+  ControllerTemplateStruct() : urlEncode(false), sections(false), conversions(false), valid(false) {}
+
+  String compiled;   // Literal text with the variables replaced by a token and their code
+  bool urlEncode;
+  bool sections;     // %1%..%/1% parts are only sent when the task has that many values
+  bool conversions;  // Has %c_xxx%() conversions, done on the result of every send
+  bool valid;
+} ControllerPublishTemplate[CONTROLLER_MAX];
+
+/*********************************************************************************************\
+ * DNS cache shared by controllers, notifications and NTP, see resolveHostByName()
+\*********************************************************************************************/
+#define DNS_CACHE_SIZE               8
+#define DNS_CACHE_TTL           300000  // msec to keep a resolved address
+#define DNS_CACHE_NEGATIVE_TTL   30000  // msec to remember a failed lookup
+
+struct dnsCacheEntryStruct
+{
+  dnsCacheEntryStruct() : expires(0), lastUsed(0), resolved(false) {}
+
+  String hostname;   // Empty when the entry is not used
+  IPAddress ip;
+  unsigned long expires;
+  unsigned long lastUsed;
+  bool resolved;     // false for a cached failed lookup
+};
+
+struct dnsCacheStruct
+{
+  dnsCacheStruct() : hits(0), misses(0), failed(0) {}
+
+  int find(const char* hostname) const {
+    for (byte i = 0; i < DNS_CACHE_SIZE; ++i) {
+      if (entries[i].hostname.length() != 0 && strcasecmp(entries[i].hostname.c_str(), hostname) == 0)
+        return i;
+    }
+    return -1;
+  }
+
+  // Reuse the entry of the host, or else an empty one, or else the least recently used one.
+  int slotFor(const char* hostname) const {
+    int slot = find(hostname);
+    if (slot >= 0) return slot;
+    slot = 0;
+    for (byte i = 0; i < DNS_CACHE_SIZE; ++i) {
+      if (entries[i].hostname.length() == 0) return i;
+      if (static_cast<long>(entries[slot].lastUsed - entries[i].lastUsed) > 0) slot = i;
+    }
+    return slot;
+  }
+
+  void invalidate(const char* hostname) {
+    const int slot = find(hostname);
+    if (slot >= 0) entries[slot].hostname = "";
+  }
+
+  dnsCacheEntryStruct entries[DNS_CACHE_SIZE];
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long failed;
+} dnsCache;
+
 struct NotificationSettingsStruct
 {
   NotificationSettingsStruct() : Port(0), Pin1(0), Pin2(0) {
@@ -963,6 +1339,15 @@ struct ExtraTaskSettingsStruct
       TaskDevicePluginConfigLong[i] = 0;
       TaskDevicePluginConfig[i] = 0;
     }
+    for (byte i = 0; i < VARS_PER_TASK; ++i) {
+      TaskDeviceDeadband[i] = 0;
+      TaskDeviceDeadbandPercent[i] = 0;
+    }
+    TaskDeviceMinReportInterval = 0;
+    TaskDeviceMaxReportInterval = 0;
+    for (byte i = 0; i < VARS_PER_TASK; ++i) {
+      TaskDeviceAggregation[i] = 0;
+    }
   }
 
   bool checkUniqueValueNames() {
@@ -1008,26 +1393,289 @@ struct ExtraTaskSettingsStruct
   long    TaskDevicePluginConfigLong[PLUGIN_EXTRACONFIGVAR_MAX];
   byte    TaskDeviceValueDecimals[VARS_PER_TASK];
   int16_t TaskDevicePluginConfig[PLUGIN_EXTRACONFIGVAR_MAX];
+  // Report by exception, see SensorReport.ino. All 0 (older settings) sends every read.
+  float    TaskDeviceDeadband[VARS_PER_TASK];         // Absolute change
+  float    TaskDeviceDeadbandPercent[VARS_PER_TASK];  // Change in % of the value last sent
+  uint16_t TaskDeviceMinReportInterval;               // sec
+  uint16_t TaskDeviceMaxReportInterval;               // sec, sent after it even without a change
+  byte     TaskDeviceAggregation[VARS_PER_TASK];      // TASK_AGGREGATE_xxx of the samples, see SensorAggregate.ino
 } ExtraTaskSettings;
 
+/*********************************************************************************************\
+ * RAM copies of the most recently loaded ExtraTaskSettings, to limit reads from SPIFFS
+ * Each entry takes sizeof(ExtraTaskSettingsStruct), so on ESP8266 it is only built with
+ * e.g. -D EXTRA_TASK_SETTINGS_CACHE_SIZE=3, else every load is a miss.
+\*********************************************************************************************/
+#ifndef EXTRA_TASK_SETTINGS_CACHE_SIZE
+  #if defined(ESP32)
+    #define EXTRA_TASK_SETTINGS_CACHE_SIZE    8
+  #else
+    #define EXTRA_TASK_SETTINGS_CACHE_SIZE    0
+  #endif
+#endif
+
+#if EXTRA_TASK_SETTINGS_CACHE_SIZE > 0
+struct ExtraTaskSettingsCacheStruct
+{
+  ExtraTaskSettingsCacheStruct() : hits(0), misses(0), useCounter(0) {
+    clear();
+  }
+
+  void clear() {
+    for (byte i = 0; i < EXTRA_TASK_SETTINGS_CACHE_SIZE; ++i) {
+      entries[i].TaskIndex = TASKS_MAX;
+      lastUsed[i] = 0;
+    }
+  }
+
+  // Copy the cached settings of the task to dest, returns false when not cached.
+  bool restore(byte TaskIndex, struct ExtraTaskSettingsStruct& dest) {
+    const int pos = find(TaskIndex);
+    if (pos < 0) {
+      ++misses;
+      return false;
+    }
+    ++hits;
+    lastUsed[pos] = ++useCounter;
+    dest = entries[pos];
+    return true;
+  }
+
+  // Store a copy, replacing the entry of the same task or else the least recently used one.
+  void store(const struct ExtraTaskSettingsStruct& settings) {
+    if (settings.TaskIndex >= TASKS_MAX) return;
+    int pos = find(settings.TaskIndex);
+    if (pos < 0) {
+      pos = 0;
+      for (byte i = 1; i < EXTRA_TASK_SETTINGS_CACHE_SIZE; ++i) {
+        if (lastUsed[i] < lastUsed[pos]) pos = i;
+      }
+    }
+    entries[pos] = settings;
+    lastUsed[pos] = ++useCounter;
+  }
+
+  void invalidate(byte TaskIndex) {
+    const int pos = find(TaskIndex);
+    if (pos >= 0) {
+      entries[pos].TaskIndex = TASKS_MAX;
+      lastUsed[pos] = 0;
+    }
+  }
+
+  int find(byte TaskIndex) const {
+    if (TaskIndex >= TASKS_MAX) return -1;
+    for (byte i = 0; i < EXTRA_TASK_SETTINGS_CACHE_SIZE; ++i) {
+      if (entries[i].TaskIndex == TaskIndex) return i;
+    }
+    return -1;
+  }
+
+  struct ExtraTaskSettingsStruct entries[EXTRA_TASK_SETTINGS_CACHE_SIZE];
+  unsigned long lastUsed[EXTRA_TASK_SETTINGS_CACHE_SIZE];
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long useCounter;
+} ExtraTaskSettingsCache;
+#else
+// No cache, only the counters, so the loads still show in the statistics.
+struct ExtraTaskSettingsCacheStruct
+{
+  ExtraTaskSettingsCacheStruct() : hits(0), misses(0) {}
+
+  void clear() {}
+
+  bool restore(byte TaskIndex, struct ExtraTaskSettingsStruct& dest) {
+    ++misses;
+    return false;
+  }
+
+  void store(const struct ExtraTaskSettingsStruct& settings) {}
+
+  void invalidate(byte TaskIndex) {}
+
+  unsigned long hits;
+  unsigned long misses;
+} ExtraTaskSettingsCache;
+#endif
+
+/*********************************************************************************************\
+ * Case insensitive hash of each task and value name, to find a task by name without
+ * loading the settings of all tasks. See findTaskIndexByName()
+\*********************************************************************************************/
+struct TaskNameIndexStruct
+{
+  TaskNameIndexStruct() : valid(false) {}
+
+  uint32_t nameHash[TASKS_MAX];  // 0 = no name
+  uint32_t valueHash[TASKS_MAX][VARS_PER_TASK];
+  bool valid;                    // Built on first use, after loading the settings
+} TaskNameIndex;
+
+/*********************************************************************************************\
+ * Expressions compiled to RPN, see compileFormula() and Calculate()
+\*********************************************************************************************/
+#define RPN_CODE_MAX     64  // Max. instructions, an expression has at most INPUT_COMMAND_SIZE tokens
+#define RPN_STACK_SIZE   10  // Max. values on the stack during evaluation
+
+#define RPN_OP_CONST      0  // Push the next constant
+#define RPN_OP_VALUE      1  // Push %value%
+#define RPN_OP_PVALUE     2  // Push %pvalue%
+#define RPN_OP_ADD        3
+#define RPN_OP_SUB        4
+#define RPN_OP_MUL        5
+#define RPN_OP_DIV        6
+#define RPN_OP_POW        7
+#define RPN_OP_NEG        8
+
+struct RPNProgram
+{
+  RPNProgram() : codeLength(0), constantCount(0) {}
+
+  byte code[RPN_CODE_MAX];
+  float constants[RPN_CODE_MAX];
+  byte codeLength;
+  byte constantCount;
+};
+
+// Compiled task value formula, only the operands are bound per sample.
+struct CompiledFormulaStruct
+{
+  CompiledFormulaStruct() : hash(0), error(0) {}
+
+  uint32_t hash;           // Of the formula text, compiled again when it changed
+  byte error;              // Compile error, the formula is not applied
+  std::vector<byte> code;
+  std::vector<float> constants;
+};
+
+std::map<int,CompiledFormulaStruct> compiledFormulas;  // Key: TaskIndex * VARS_PER_TASK + varNr
+
+// Number of String copies made while copying an EventStruct, reported in the timing stats.
+unsigned long eventstruct_string_allocs = 0;
+
+/*********************************************************************************************\
+ * Command line split once in arguments, see parseCommandArgs()
+\*********************************************************************************************/
+#define COMMAND_ARGS_MAX  10
+
+struct CommandArgsStruct
+{
+  CommandArgsStruct() : line(NULL), count(0), truncated(false) {}
+
+  const char* line;
+  uint16_t start[COMMAND_ARGS_MAX];   // Offset in line, without quotes
+  uint16_t length[COMMAND_ARGS_MAX];
+  byte count;
+  bool truncated;                     // Line has more than COMMAND_ARGS_MAX arguments
+};
+
 struct EventStruct
 {
   EventStruct() :
     Source(0), TaskIndex(TASKS_MAX), ControllerIndex(0), ProtocolIndex(0), NotificationIndex(0),
     BaseVarIndex(0), idx(0), sensorType(0), Par1(0), Par2(0), Par3(0), Par4(0), Par5(0),
-    OriginTaskIndex(0), Data(NULL) {}
+    OriginTaskIndex(0), Args(NULL), Data(NULL) {}
   EventStruct(const struct EventStruct& event):
         Source(event.Source), TaskIndex(event.TaskIndex), ControllerIndex(event.ControllerIndex)
         , ProtocolIndex(event.ProtocolIndex), NotificationIndex(event.NotificationIndex)
         , BaseVarIndex(event.BaseVarIndex), idx(event.idx), sensorType(event.sensorType)
         , Par1(event.Par1), Par2(event.Par2), Par3(event.Par3), Par4(event.Par4), Par5(event.Par5)
-        , OriginTaskIndex(event.OriginTaskIndex), Data(event.Data) {
-          String1 = event.String1;
-          String2 = event.String2;
-          String3 = event.String3;
-          String4 = event.String4;
-          String5 = event.String5;
+        , OriginTaskIndex(event.OriginTaskIndex), Args(event.Args), Data(event.Data) {
+          copyStrings(event);
         }
+  EventStruct(struct EventStruct&& event):
+        Source(event.Source), TaskIndex(event.TaskIndex), ControllerIndex(event.ControllerIndex)
+        , ProtocolIndex(event.ProtocolIndex), NotificationIndex(event.NotificationIndex)
+        , BaseVarIndex(event.BaseVarIndex), idx(event.idx), sensorType(event.sensorType)
+        , Par1(event.Par1), Par2(event.Par2), Par3(event.Par3), Par4(event.Par4), Par5(event.Par5)
+        , OriginTaskIndex(event.OriginTaskIndex), Args(event.Args)
+        , String1(std::move(event.String1)), String2(std::move(event.String2)), String3(std::move(event.String3))
+        , String4(std::move(event.String4)), String5(std::move(event.String5))
+        , Data(event.Data) {}
+
+  EventStruct& operator=(const struct EventStruct& event) {
+    if (this != &event) {
+      copyValues(event);
+      copyStrings(event);
+    }
+    return *this;
+  }
+
+  EventStruct& operator=(struct EventStruct&& event) {
+    if (this != &event) {
+      copyValues(event);
+      String1 = std::move(event.String1);
+      String2 = std::move(event.String2);
+      String3 = std::move(event.String3);
+      String4 = std::move(event.String4);
+      String5 = std::move(event.String5);
+    }
+    return *this;
+  }
+
+  void copyValues(const struct EventStruct& event) {
+    Source = event.Source;
+    TaskIndex = event.TaskIndex;
+    ControllerIndex = event.ControllerIndex;
+    ProtocolIndex = event.ProtocolIndex;
+    NotificationIndex = event.NotificationIndex;
+    BaseVarIndex = event.BaseVarIndex;
+    idx = event.idx;
+    sensorType = event.sensorType;
+    Par1 = event.Par1;
+    Par2 = event.Par2;
+    Par3 = event.Par3;
+    Par4 = event.Par4;
+    Par5 = event.Par5;
+    OriginTaskIndex = event.OriginTaskIndex;
+    Args = event.Args;
+    Data = event.Data;
+  }
+
+  // Copying an empty String may still allocate a buffer, so only copy non-empty strings.
+  void copyStrings(const struct EventStruct& event) {
+    copyString(String1, event.String1);
+    copyString(String2, event.String2);
+    copyString(String3, event.String3);
+    copyString(String4, event.String4);
+    copyString(String5, event.String5);
+  }
+
+  static void copyString(String& dest, const String& source) {
+    if (source.length() == 0) {
+      if (dest.length() != 0) dest = String();
+    } else {
+      dest = source;
+      ++eventstruct_string_allocs;
+    }
+  }
+
+  // Back to the values of a new event. The strings are emptied, but keep their
+  // buffers, so a pooled event reuses them, see acquireEvent().
+  void clear() {
+    Source = 0;
+    TaskIndex = TASKS_MAX;
+    ControllerIndex = 0;
+    ProtocolIndex = 0;
+    NotificationIndex = 0;
+    BaseVarIndex = 0;
+    idx = 0;
+    sensorType = 0;
+    Par1 = 0;
+    Par2 = 0;
+    Par3 = 0;
+    Par4 = 0;
+    Par5 = 0;
+    OriginTaskIndex = 0;
+    Args = NULL;
+    String1 = "";
+    String2 = "";
+    String3 = "";
+    String4 = "";
+    String5 = "";
+    Data = NULL;
+  }
 
   byte Source;
   byte TaskIndex; // index position in TaskSettings array, 0-11
@@ -1045,6 +1693,7 @@ struct EventStruct
   int Par4;
   int Par5;
   byte OriginTaskIndex;
+  const CommandArgsStruct* Args;  // Arguments of the command being executed, see ExecuteCommand()
   String String1;
   String String2;
   String String3;
@@ -1053,98 +1702,316 @@ struct EventStruct
   byte *Data;
 };
 
-#define LOG_STRUCT_MESSAGE_SIZE 128
+struct EventStruct* acquireEvent();
+void releaseEvent(struct EventStruct* event);
+
+// Event from the pool for the life time of the scope, see Memory.ino:
+//   PooledEvent pooled;
+//   struct EventStruct& TempEvent = *pooled.event;
+struct PooledEvent
+{
+  PooledEvent() : event(acquireEvent()) {}
+  ~PooledEvent() { releaseEvent(event); }
+
+  struct EventStruct* event;
+
+private:
+  PooledEvent(const PooledEvent&);
+  PooledEvent& operator=(const PooledEvent&);
+};
+
+/*********************************************************************************************\
+ * Samples waiting to be sent to a controller, see sendData() and process_controller_queue()
+\*********************************************************************************************/
+struct controllerQueueElementStruct
+{
+  controllerQueueElementStruct() :
+    enqueued(0), sequence(0), idx(0), TaskIndex(0), BaseVarIndex(0), sensorType(0) {
+    for (byte i = 0; i < VARS_PER_TASK; ++i) values[i] = 0.0;
+  }
+
+  unsigned long enqueued;   // millis() when queued, used for the latency stats
+  unsigned long sequence;   // Diagnostic sequence, see ControllerDiagnostic.ino
+  int idx;
+  byte TaskIndex;
+  byte BaseVarIndex;
+  byte sensorType;
+  float values[VARS_PER_TASK];  // UserVar values at the time of sendData()
+};
+
+struct controllerQueueStruct
+{
+  controllerQueueStruct() :
+    head(0), count(0), maxCount(0), dropped(0), sent(0), latencyTotal(0), latencyMax(0),
+    fileRecords(0), fileRead(0), fileRecovered(0), retryDue(0), retries(0) {}
+
+  // Returns false when the queue was full and a sample was dropped.
+  bool push(const controllerQueueElementStruct& element, byte depth, byte dropPolicy) {
+    if (depth > CONTROLLER_QUEUE_MAX_DEPTH) depth = CONTROLLER_QUEUE_MAX_DEPTH;
+    bool result = true;
+    if (count >= depth) {
+      ++dropped;
+      result = false;
+      if (dropPolicy == CONTROLLER_QUEUE_DROP_NEWEST || count == 0) return false;
+      while (count >= depth) {
+        head = (head + 1) % CONTROLLER_QUEUE_MAX_DEPTH;
+        --count;
+      }
+    }
+    elements[(head + count) % CONTROLLER_QUEUE_MAX_DEPTH] = element;
+    ++count;
+    if (count > maxCount) maxCount = count;
+    return result;
+  }
+
+  bool pop(controllerQueueElementStruct& element) {
+    if (count == 0) return false;
+    element = elements[head];
+    head = (head + 1) % CONTROLLER_QUEUE_MAX_DEPTH;
+    --count;
+    return true;
+  }
+
+  // Put a popped sample back at the head, when it could not be sent.
+  bool unpop(const controllerQueueElementStruct& element, byte depth) {
+    if (depth > CONTROLLER_QUEUE_MAX_DEPTH) depth = CONTROLLER_QUEUE_MAX_DEPTH;
+    if (count >= depth) {
+      ++dropped;
+      return false;
+    }
+    head = (head + CONTROLLER_QUEUE_MAX_DEPTH - 1) % CONTROLLER_QUEUE_MAX_DEPTH;
+    elements[head] = element;
+    ++count;
+    if (count > maxCount) maxCount = count;
+    return true;
+  }
+
+  void clear() {
+    head = 0;
+    count = 0;
+  }
+
+  // Samples on file are older than the ones in RAM, so they are sent first.
+  unsigned long onFile() const {
+    return fileRecords - fileRead;
+  }
+
+  void markSent(unsigned long latency) {
+    ++sent;
+    latencyTotal += latency;
+    if (latency > latencyMax) latencyMax = latency;
+  }
+
+  controllerQueueElementStruct elements[CONTROLLER_QUEUE_MAX_DEPTH];
+  byte head;
+  byte count;
+  byte maxCount;
+  unsigned long dropped;
+  unsigned long sent;
+  unsigned long latencyTotal;
+  unsigned long latencyMax;
+  unsigned long fileRecords;  // Samples written to the backlog file
+  unsigned long fileRead;     // Samples of the backlog file already sent
+  unsigned long fileRecovered; // Samples on file from before the reboot, their millis() are not valid
+  unsigned long retryDue;     // millis() of the next try, after a failed send
+  byte retries;               // Failed sends of the sample at the head
+} ControllerQueue[CONTROLLER_MAX];
+
+unsigned long controllerSampleMillis = 0;  // millis() at sendData() of the sample sent from the queue, 0 = now
+
+unsigned long controllerLastSend[CONTROLLER_MAX];
+
+#define LOG_STRUCT_MESSAGE_SIZE 128   // Max. length of a log line, including the 0 terminator
+// Log lines are stored as variable length records in one buffer, so short lines use less RAM.
 #ifdef ESP32
-  #define LOG_STRUCT_MESSAGE_LINES 30
+  #define LOG_STRUCT_ARENA_SIZE  4096
 #else
   #if defined(PLUGIN_BUILD_TESTING) || defined(PLUGIN_BUILD_DEV)
-    #define LOG_STRUCT_MESSAGE_LINES 10
+    #define LOG_STRUCT_ARENA_SIZE  1280
   #else
-    #define LOG_STRUCT_MESSAGE_LINES 15
+    #define LOG_STRUCT_ARENA_SIZE  1920
   #endif
 #endif
+#define LOG_STRUCT_MAX_LINES         (LOG_STRUCT_ARENA_SIZE / 32)
+#define LOG_STRUCT_RECORD_HEADER     6  // timestamp (4 bytes), log level, length
+
+// Structured log lines: an index in logFormats[] (PROGMEM, see Misc.ino) and up to
+// LOG_FMT_MAX_ARGS binary arguments. Text is only rendered when a log output reads the line.
+#define LOG_FMT_MAX_ARGS             3
+#define LOG_FMT_FLAG              0x80  // Set in the log level byte of a structured record
+#define LOG_FMT_SW_SWITCH_STATE      0
+#define LOG_FMT_SW_STATE             1
+#define LOG_FMT_CTRL_RATE_LIMITED    2
+#define LOG_FMT_CTRL_QUEUE_FULL      3
+#define LOG_FMT_CTRL_SEND_RETRY      4
+#define LOG_FMT_CTRL_SEND_DROPPED    5
+#define LOG_FMT_NRELEMENTS           6
+String renderLogFmt(byte fmt, const uint32_t* args);
+void addToLogFmt(byte logLevel, byte fmt, uint32_t arg1 = 0, uint32_t arg2 = 0, uint32_t arg3 = 0);
+uint32_t logFmtFloat(float value);
 
 struct LogStruct {
-    LogStruct() : write_idx(0), read_idx(0) {
-      for (int i = 0; i < LOG_STRUCT_MESSAGE_LINES; ++i) {
-        Message[i].reserve(LOG_STRUCT_MESSAGE_SIZE);
-        timeStamp[i] = 0;
-        log_level[i] = 0;
-      }
-    }
+    LogStruct() : head(0), lineCount(0), lineSequence(0), readSequence(0) {}
 
+    // Oldest lines are dropped until the new record fits, so appending is O(1) amortized.
     void add(const byte loglevel, const char *line) {
-      write_idx = (write_idx + 1) % LOG_STRUCT_MESSAGE_LINES;
-      if (write_idx == read_idx) {
-        // Buffer full, move read_idx to overwrite oldest entry.
-        read_idx = (read_idx + 1) % LOG_STRUCT_MESSAGE_LINES;
-      }
-      timeStamp[write_idx] = millis();
-      log_level[write_idx] = loglevel;
       unsigned linelength = strlen(line);
       if (linelength > LOG_STRUCT_MESSAGE_SIZE-1)
         linelength = LOG_STRUCT_MESSAGE_SIZE-1;
-      Message[write_idx] = "";
-      for (unsigned i = 0; i < linelength; ++i) {
-        Message[write_idx] += *(line + i);
-      }
+      byte* text = addRecord(loglevel, linelength, linelength + 1);
+      memcpy(text, line, linelength);
+      text[linelength] = 0;
+    }
+
+    // Structured line, stored as format index and arguments.
+    void addFmt(const byte loglevel, const byte fmt, const uint32_t* args) {
+      const unsigned size = 1 + LOG_FMT_MAX_ARGS * sizeof(uint32_t);
+      byte* data = addRecord(loglevel | LOG_FMT_FLAG, size, size);
+      data[0] = fmt;
+      memcpy(data + 1, args, LOG_FMT_MAX_ARGS * sizeof(uint32_t));
     }
 
     // Read the next item and append it to the given string.
     // Returns whether new lines are available.
     bool get(String& output, const String& lineEnd) {
       if (!isEmpty()) {
-        read_idx = (read_idx + 1) % LOG_STRUCT_MESSAGE_LINES;
-        output += formatLine(read_idx, lineEnd);
+        output += formatLine(nextReadIndex(), lineEnd);
       }
       return !isEmpty();
     }
 
-    String get_logjson_formatted(bool& logLinesAvailable, unsigned long& timestamp) {
+    // Index of the next unread line, -1 when there is none.
+    int readNextIndex(bool& logLinesAvailable, unsigned long& timestamp) {
       logLinesAvailable = false;
       if (isEmpty()) {
-        return "";
+        return -1;
       }
-      read_idx = (read_idx + 1) % LOG_STRUCT_MESSAGE_LINES;
-      timestamp = timeStamp[read_idx];
-      String output = logjson_formatLine(read_idx);
-      if (isEmpty()) return output;
-      output += ",\n";
-      logLinesAvailable = true;
-      return output;
+      const int index = nextReadIndex();
+      timestamp = getTimeStamp(index);
+      logLinesAvailable = !isEmpty();
+      return index;
     }
 
+    // Line number counted from the oldest line in the buffer.
     bool get(String& output, const String& lineEnd, int line) {
-      int tmpread((write_idx + 1+line) % LOG_STRUCT_MESSAGE_LINES);
-      if (timeStamp[tmpread] != 0) {
-        output += formatLine(tmpread, lineEnd);
+      const int index = getIndexBySequence(firstSequence() + line);
+      if (index >= 0) {
+        output += formatLine(index, lineEnd);
       }
       return !isEmpty();
     }
 
     bool getAll(String& output, const String& lineEnd) {
-      int tmpread((write_idx + 1) % LOG_STRUCT_MESSAGE_LINES);
       bool someAdded = false;
-      while (tmpread != write_idx) {
-        if (timeStamp[tmpread] != 0) {
-          output += formatLine(tmpread, lineEnd);
-          someAdded = true;
-        }
-        tmpread = (tmpread + 1)% LOG_STRUCT_MESSAGE_LINES;
+      for (unsigned long sequence = firstSequence(); sequence <= lineSequence; ++sequence) {
+        output += formatLine(getIndexBySequence(sequence), lineEnd);
+        someAdded = true;
       }
       return someAdded;
     }
 
-    bool isEmpty() {
-      return (write_idx == read_idx);
+    bool isEmpty() const {
+      return readSequence >= lineSequence;
+    }
+
+    // Number of lines in the buffer.
+    unsigned int size() const {
+      return lineCount;
+    }
+
+    // Every added line gets the next sequence number, starting at 1.
+    unsigned long lastSequence() const {
+      return lineSequence;
+    }
+
+    // Oldest sequence number still in the buffer.
+    unsigned long firstSequence() const {
+      return lineSequence - lineCount + 1;
+    }
+
+    // Buffer index of the line with this sequence number, -1 when not available (anymore).
+    // Does not change the read position, so any number of readers can keep their own cursor.
+    // The index is valid until the next line is added.
+    int getIndexBySequence(unsigned long sequence) const {
+      if (sequence < firstSequence() || sequence > lineSequence || sequence == 0) return -1;
+      return sequence % LOG_STRUCT_MAX_LINES;
+    }
+
+    // Append the line with this sequence number JSON formatted, without changing the read position.
+    bool getLogjsonBySequence(unsigned long sequence, String& output) {
+      const int index = getIndexBySequence(sequence);
+      if (index < 0) return false;
+      output += logjson_formatLine(index);
+      return true;
+    }
+
+    unsigned long getTimeStamp(int index) const {
+      unsigned long timestamp;
+      memcpy(&timestamp, arena + lineOffset[index], sizeof(timestamp));
+      return timestamp;
+    }
+    byte getLogLevel(int index) const { return arena[lineOffset[index] + 4] & ~LOG_FMT_FLAG; }
+
+    // Structured lines are rendered here, when a reader needs the text.
+    String getMessage(int index) const {
+      const byte* record = arena + lineOffset[index];
+      if (record[4] & LOG_FMT_FLAG) {
+        uint32_t args[LOG_FMT_MAX_ARGS];
+        memcpy(args, record + LOG_STRUCT_RECORD_HEADER + 1, sizeof(args));
+        return renderLogFmt(record[LOG_STRUCT_RECORD_HEADER], args);
+      }
+      return String(reinterpret_cast<const char*>(record + LOG_STRUCT_RECORD_HEADER));
     }
 
   private:
+    // Make room for a record with a payload of size bytes, returns where to store the payload.
+    // A record is never split at the end of the arena, the next one then starts at 0 again.
+    byte* addRecord(const byte loglevel, const byte length, const unsigned size) {
+      const unsigned recordSize = LOG_STRUCT_RECORD_HEADER + size;
+      if (lineCount == LOG_STRUCT_MAX_LINES)
+        removeOldest();
+      if (head + recordSize > LOG_STRUCT_ARENA_SIZE) {
+        // Lines stored after head are the oldest, drop them and wrap.
+        while (lineCount > 0 && oldestOffset() >= head)
+          removeOldest();
+        head = 0;
+      }
+      while (lineCount > 0 && oldestOffset() >= head && oldestOffset() < head + recordSize)
+        removeOldest();
+
+      const unsigned long timestamp = millis();
+      byte* record = arena + head;
+      memcpy(record, &timestamp, sizeof(timestamp));
+      record[4] = loglevel;
+      record[5] = length;
+      ++lineSequence;
+      ++lineCount;
+      lineOffset[lineSequence % LOG_STRUCT_MAX_LINES] = head;
+      head += recordSize;
+      return record + LOG_STRUCT_RECORD_HEADER;
+    }
+
+    uint16_t oldestOffset() const {
+      return lineOffset[firstSequence() % LOG_STRUCT_MAX_LINES];
+    }
+
+    void removeOldest() {
+      --lineCount;
+    }
+
+    // Position of the legacy read cursor, skipping lines which were already dropped.
+    int nextReadIndex() {
+      if (readSequence + 1 < firstSequence())
+        readSequence = firstSequence() - 1;
+      ++readSequence;
+      return getIndexBySequence(readSequence);
+    }
+
     String formatLine(int index, const String& lineEnd) {
       String output;
-      output += timeStamp[index];
+      output += getTimeStamp(index);
       output += " : ";
-      output += Message[index];
+      output += getMessage(index);
       output += lineEnd;
       return output;
     }
@@ -1152,36 +2019,45 @@ struct LogStruct {
     String logjson_formatLine(int index) {
       String output;
       output.reserve(LOG_STRUCT_MESSAGE_SIZE + 64);
-      output = "{";
-      output += to_json_object_value("timestamp", String(timeStamp[index]));
-      output += ",\n";
-      output += to_json_object_value("text",  Message[index]);
-      output += ",\n";
-      output += to_json_object_value("level", String(log_level[index]));
-      output += "}";
+      JsonWriter json(output);
+      writeLogJsonLine(json, index);
       return output;
     }
 
+    void writeLogJsonLine(JsonWriter& json, int index) const {
+      json.beginObject();
+      json.member(F("timestamp"), getTimeStamp(index));
+      json.member(F("text"), getMessage(index));
+      json.member(F("level"), static_cast<int>(getLogLevel(index)));
+      json.endObject();
+    }
+
 
-    int write_idx;
-    int read_idx;
-    unsigned long timeStamp[LOG_STRUCT_MESSAGE_LINES];
-    byte log_level[LOG_STRUCT_MESSAGE_LINES];
-    String Message[LOG_STRUCT_MESSAGE_LINES];
+    uint16_t head;                 // Write position in arena
+    uint16_t lineCount;
+    unsigned long lineSequence;    // Sequence number of the newest line
+    unsigned long readSequence;    // Last line read by get() and readNextIndex()
+    uint16_t lineOffset[LOG_STRUCT_MAX_LINES];  // Record offset, by sequence % LOG_STRUCT_MAX_LINES
+    byte arena[LOG_STRUCT_ARENA_SIZE];
 
 } Logging;
 
 byte highest_active_log_level = 0;
 bool log_to_serial_disabled = false;
+// Syslog lines are queued and sent from backgroundtasks(), see syslog()
+unsigned long syslogSent = 0;
+unsigned long syslogDropped = 0;  // Queue was full
 // Do this in a template to prevent casting to String when not needed.
 #define addLog(L,S) if (loglevelActiveFor(L)) { addToLog(L,S); }
+// Structured log line, e.g. addLogFmt(LOG_LEVEL_INFO, LOG_FMT_SW_STATE, logFmtFloat(value))
+#define addLogFmt(L, ...) if (loglevelActiveFor(L)) { addToLogFmt(L, __VA_ARGS__); }
 
 struct DeviceStruct
 {
   DeviceStruct() :
-    Number(0), Type(0), VType(0), Ports(0),
+    Number(0), Type(0), VType(0), Ports(0), ValueCount(0), PeriodicCallbacks(0),
     PullUpOption(false), InverseLogicOption(false), FormulaOption(false),
-    ValueCount(0), Custom(false), SendDataOption(false), GlobalSyncOption(false),
+    Custom(false), SendDataOption(false), GlobalSyncOption(false),
     TimerOption(false), TimerOptional(false), DecimalsOnly(false) {}
 
   bool connectedToGPIOpins() {
@@ -1189,35 +2065,38 @@ struct DeviceStruct
   }
 
 
+  // The options are bit fields, this table is in RAM for every plugin in the build.
   byte Number;  // Plugin ID number.   (PLUGIN_ID_xxx)
   byte Type;    // How the device is connected. e.g. DEVICE_TYPE_SINGLE => connected through 1 datapin
   byte VType;   // Type of value the plugin will return, used only for Domoticz
   byte Ports;   // Port to use when device has multiple I/O pins  (N.B. not used much)
-  boolean PullUpOption;       // Allow to set internal pull-up resistors.
-  boolean InverseLogicOption; // Allow to invert the boolean state (e.g. a switch)
-  boolean FormulaOption;      // Allow to enter a formula to convert values during read. (not possible with Custom enabled)
   byte ValueCount;            // The number of output values of a plugin. The value should match the number of keys PLUGIN_VALUENAME1_xxx
-  boolean Custom;
-  boolean SendDataOption;     // Allow to send data to a controller.
-  boolean GlobalSyncOption;   // No longer used. Was used for ESPeasy values sync between nodes
-  boolean TimerOption;        // Allow to set the "Interval" timer for the plugin.
-  boolean TimerOptional;      // When taskdevice timer is not set and not optional, use default "Interval" delay (Settings.Delay)
-  boolean DecimalsOnly;       // Allow to set the number of decimals (otherwise treated a 0 decimals)
+  byte PeriodicCallbacks;     // Bitmap of PLUGIN_CALLBACK_xxx, the periodic calls handled by the plugin
+  boolean PullUpOption : 1;       // Allow to set internal pull-up resistors.
+  boolean InverseLogicOption : 1; // Allow to invert the boolean state (e.g. a switch)
+  boolean FormulaOption : 1;      // Allow to enter a formula to convert values during read. (not possible with Custom enabled)
+  boolean Custom : 1;
+  boolean SendDataOption : 1;     // Allow to send data to a controller.
+  boolean GlobalSyncOption : 1;   // No longer used. Was used for ESPeasy values sync between nodes
+  boolean TimerOption : 1;        // Allow to set the "Interval" timer for the plugin.
+  boolean TimerOptional : 1;      // When taskdevice timer is not set and not optional, use default "Interval" delay (Settings.Delay)
+  boolean DecimalsOnly : 1;       // Allow to set the number of decimals (otherwise treated a 0 decimals)
 } Device[DEVICES_MAX + 1]; // 1 more because first device is empty device
 
 struct ProtocolStruct
 {
   ProtocolStruct() :
-    Number(0), usesMQTT(false), usesAccount(false), usesPassword(false),
-    defaultPort(0), usesTemplate(false), usesID(false), Custom(false) {}
+    defaultPort(0), Number(0), usesMQTT(false), usesAccount(false), usesPassword(false),
+    usesTemplate(false), usesID(false), Custom(false), reportsSendResult(false) {}
+  uint16_t defaultPort;
   byte Number;
-  boolean usesMQTT;
-  boolean usesAccount;
-  boolean usesPassword;
-  int defaultPort;
-  boolean usesTemplate;
-  boolean usesID;
-  boolean Custom;
+  boolean usesMQTT : 1;
+  boolean usesAccount : 1;
+  boolean usesPassword : 1;
+  boolean usesTemplate : 1;
+  boolean usesID : 1;
+  boolean Custom : 1;
+  boolean reportsSendResult : 1;  // CPLUGIN_PROTOCOL_SEND returns false on failure, the queue keeps the sample
 } Protocol[CPLUGIN_MAX];
 
 struct NotificationStruct
@@ -1229,24 +2108,37 @@ struct NotificationStruct
   byte usesGPIO;
 } Notification[NPLUGIN_MAX];
 
+#define NODE_AGE_INTERVAL               30000 // msec, unit of the age shown in the node list
+#define NODE_MAX_AGE                       10 // Removed from the list when not seen for longer
+
 struct NodeStruct
 {
   NodeStruct() :
-    age(0), build(0), nodeName(NULL), nodeType(0)
+    lastSeen(0), build(0), nodeName(NULL), nodeType(0)
     {
       for (byte i = 0; i < 4; ++i) ip[i] = 0;
+      for (byte i = 0; i < 6; ++i) mac[i] = 0;
     }
+
+  // Age in NODE_AGE_INTERVAL, computed instead of counted for every node.
+  unsigned long getAge() const { return (millis() - lastSeen) / NODE_AGE_INTERVAL; }
+
   byte ip[4];
-  byte age;
+  byte mac[6];             // STA MAC from the sysinfo message, used as ESP-NOW peer address
+  unsigned long lastSeen;  // millis() of the last sysinfo message
   uint16_t build;
   char* nodeName;
   byte nodeType;
 } Nodes[UNIT_MAX];
+// Bit per unit in Nodes[] with an IP, so the list can be walked without checking all units.
+uint32_t activeNodes = 0;
+static_assert(UNIT_MAX <= 32, "activeNodes has one bit per unit");
 
 struct systemTimerStruct
 {
   systemTimerStruct() :
-    timer(0), plugin(0), TaskIndex(-1), Par1(0), Par2(0), Par3(0), Par4(0), Par5(0) {}
+    timer(0), plugin(0), TaskIndex(-1), Par1(0), Par2(0), Par3(0), Par4(0), Par5(0),
+    key(0), nextFree(-1), used(false) {}
 
   unsigned long timer;
   byte plugin;
@@ -1256,8 +2148,78 @@ struct systemTimerStruct
   int Par3;
   int Par4;
   int Par5;
+  unsigned long key;   // Unique key created from plugin and Par1, see createSystemTimerId()
+  int8_t nextFree;     // Next slot in the free list
+  bool used;
 };
-std::map<unsigned long, systemTimerStruct> systemTimers;
+
+// Each task may hold a conversion and a duty cycle timer (see SensorConversion.ino and
+// SensorDutyCycle.ino), plus the timers of plugin commands like pulse and longpulse.
+#ifdef ESP32
+  #define SYSTEM_TIMER_POOL_SIZE  (2 * TASKS_MAX + 16)
+#else
+  #define SYSTEM_TIMER_POOL_SIZE  (2 * TASKS_MAX + 8)
+#endif
+static_assert(SYSTEM_TIMER_POOL_SIZE < 128, "systemTimerStruct::nextFree is an int8_t");
+
+// Preallocated pool of system timers.
+// Slots are addressed by index and unused slots are kept in a free list.
+// Together with the fixed id index of msecTimerHandler, arming, cancelling
+// and firing a timer does not allocate on the heap.
+struct systemTimerPoolStruct
+{
+  systemTimerPoolStruct() : freeHead(0), inUse(0), highWater(0), overflowCount(0) {
+    for (int i = 0; i < SYSTEM_TIMER_POOL_SIZE; ++i) {
+      slots[i].nextFree = (i + 1) < SYSTEM_TIMER_POOL_SIZE ? (i + 1) : -1;
+    }
+  }
+
+  // Return the slot index already used for this key.
+  // Return -1 when the key is not present.
+  int find(unsigned long key) const {
+    for (int i = 0; i < SYSTEM_TIMER_POOL_SIZE; ++i) {
+      if (slots[i].used && slots[i].key == key) return i;
+    }
+    return -1;
+  }
+
+  // Return the slot index for this key, allocate a new one if not yet present.
+  // Return -1 when the pool is exhausted.
+  int acquire(unsigned long key) {
+    int slot = find(key);
+    if (slot >= 0) return slot;
+    if (freeHead < 0) {
+      ++overflowCount;
+      return -1;
+    }
+    slot = freeHead;
+    freeHead = slots[slot].nextFree;
+    slots[slot].nextFree = -1;
+    slots[slot].used = true;
+    slots[slot].key = key;
+    ++inUse;
+    if (inUse > highWater) highWater = inUse;
+    return slot;
+  }
+
+  void release(int slot) {
+    if (!isUsed(slot)) return;
+    slots[slot].used = false;
+    slots[slot].nextFree = freeHead;
+    freeHead = slot;
+    --inUse;
+  }
+
+  bool isUsed(int slot) const {
+    return slot >= 0 && slot < SYSTEM_TIMER_POOL_SIZE && slots[slot].used;
+  }
+
+  systemTimerStruct slots[SYSTEM_TIMER_POOL_SIZE];
+  int8_t freeHead;
+  uint8_t inUse;
+  uint8_t highWater;
+  unsigned long overflowCount;
+} systemTimers;
 
 struct pinStatesStruct
 {
@@ -1265,14 +2227,38 @@ struct pinStatesStruct
   byte index;
   byte mode;
   uint16_t value;
+  unsigned long sequence;  // pinStateSequence of the last change
 } pinStates[PINSTATE_TABLE_MAX];
 
+// Open addressed index on (plugin, index): the slot in pinStates[] + 1, 0 = empty.
+// Entries are only added, pinStates[] is filled in order up to pinStateCount.
+byte pinStateIndex[PINSTATE_INDEX_SIZE];
+byte pinStateCount = 0;
+unsigned long pinStateSequence = 0;  // Incremented on each change of a pin state
+
+
+// RTC memory regions, in the order of their layout, see RTCMemory.ino
+#define RTC_REGION_STRUCT       0
+#define RTC_REGION_USERVAR      1
+#define RTC_REGION_WIFI         2
+#define RTC_REGION_ENERGY       3
+#define RTC_REGION_SLEEP        4
+#define RTC_REGION_SAMPLES      5
+#define RTC_REGION_BOOT         6
+#define RTC_REGIONS             7
+
+// RTCStruct.layoutVersion, to be raised when a region is added or changed
+#define RTC_LAYOUT_VERSION      2
+
+// RTCStruct.deepSleepState
+#define DEEP_SLEEP_STATE_RF     1   // Sleeping, wakes with RF
+#define DEEP_SLEEP_STATE_NO_RF  2   // Sleeping, wakes without RF, see SleepWake.ino
 
-// this offsets are in blocks, bytes = blocks * 4
-#define RTC_BASE_STRUCT 64
-#define RTC_BASE_USERVAR 74
+// A due report in a wake without RF, see sleepWakeHoldReport()
+#define SLEEP_REPORT_SEND       0   // Send now, the wake has RF
+#define SLEEP_REPORT_HELD       1   // Sent in the next wake, with RF
+#define SLEEP_REPORT_STORED     2   // Kept as a sample, sent in a batch later
 
-//max 40 bytes: ( 74 - 64 ) * 4
 struct RTCStruct
 {
   byte ID1;
@@ -1280,12 +2266,74 @@ struct RTCStruct
   boolean unused1;
   byte factoryResetCounter;
   byte deepSleepState;
-  byte unused2;
+  byte layoutVersion;
   byte flashDayCounter;
   unsigned long flashCounter;
   unsigned long bootCounter;
 } RTC;
 
+// A cached DHCP address is used at most this long (sec, awake and asleep), then DHCP is done again to renew the lease.
+#define WIFI_RTC_IP_MAX_AGE 1800
+
+// Connection of the last wake, to reconnect after deep sleep without scan and DHCP.
+// See tryConnectWiFi()
+struct RTC_WiFiStruct
+{
+  uint8_t  bssid[6];
+  uint8_t  channel;        // 0 when not valid
+  uint8_t  wifiSettings;   // lastWiFiSettings used for the connection
+  uint32_t ip;             // 0 when static IP settings are used
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns1;
+  uint32_t dns2;
+  uint32_t ipAge;          // sec since the address was obtained by DHCP
+} RTC_WiFi;
+
+#define RTC_ENERGY_METERS 2
+
+// Energy counted by the power meters (P076, P077), kept over a reboot. See PowerMeter.ino
+struct RTC_EnergyStruct
+{
+  double   energy[RTC_ENERGY_METERS];     // Wh
+  int8_t   TaskIndex[RTC_ENERGY_METERS];  // -1 when not used
+  uint8_t  unused[2];
+} RTC_Energy;
+
+#define RTC_SLEEP_TASKS 4
+
+// Last reports of the tasks over the deep sleep wakes without RF, see SleepWake.ino
+struct RTC_SleepStruct
+{
+  float    value[RTC_SLEEP_TASKS][VARS_PER_TASK];  // As last sent
+  uint32_t reportAge[RTC_SLEEP_TASKS];   // sec since sent, at the wake
+  int8_t   TaskIndex[RTC_SLEEP_TASKS];   // -1 when not used
+  uint32_t pendingTasks;                 // To be sent in the wake with RF (bit n = task n+1)
+  uint16_t wakesWithoutRF;               // Since the last wake with RF
+  uint16_t unused;
+} RTC_Sleep;
+
+#define RTC_SAMPLE_RECORDS 3
+
+// Samples of the wakes without RF, sent in batches, see SleepWakeSamples.ino
+struct RTC_SampleRecord
+{
+  uint32_t clock;          // RTC_Samples.clock when taken
+  int8_t   TaskIndex;
+  uint8_t  unused;
+  uint16_t checksum;       // getChecksum16() of the fields before it and the values
+  float    value[VARS_PER_TASK];
+};
+
+struct RTC_SampleStruct
+{
+  uint32_t clock;          // sec over the wakes and sleeps, at the start of this wake
+  uint8_t  count;          // Records in RTC memory
+  uint8_t  wakes;          // Since the records were last sent
+  uint16_t unused;
+  RTC_SampleRecord record[RTC_SAMPLE_RECORDS];
+} RTC_Samples;
+
 
 int deviceCount = -1;
 int protocolCount = -1;
@@ -1296,16 +2344,247 @@ String printWebString = "";
 boolean printToWebJSON = false;
 
 float UserVar[VARS_PER_TASK * TASKS_MAX];
-struct rulesTimerStatus
+
+// Type of a task value. Plugins write UserVar as float, unless they set the value
+// with setTaskValueInt32(), setTaskValueInt64() or setTaskValueDouble(). These keep
+// the typed value and write its float to UserVar, for the formulas and float readers.
+// When UserVar was changed afterwards (formula, taskvalueset) the value is a float again.
+#define TASK_VALUE_FLOAT   0
+#define TASK_VALUE_INT32   1
+#define TASK_VALUE_INT64   2
+#define TASK_VALUE_DOUBLE  3
+
+union TaskValueRaw
 {
-  unsigned long timestamp;
-  unsigned int interval; //interval in milliseconds
-  boolean paused;
-} RulesTimer[RULES_TIMER_MAX];
+  float   f;
+  int32_t i32;
+  int64_t i64;
+  double  d;
+};
+
+inline float taskValueRawToFloat(const TaskValueRaw& raw, byte type) {
+  switch (type) {
+    case TASK_VALUE_INT32:  return raw.i32;
+    case TASK_VALUE_INT64:  return raw.i64;
+    case TASK_VALUE_DOUBLE: return raw.d;
+  }
+  return raw.f;
+}
+
+// Typed values of a task, only allocated for tasks setting a typed value.
+struct TaskValueStoreStruct
+{
+  TaskValueStoreStruct() {
+    for (byte i = 0; i < VARS_PER_TASK; ++i) {
+      types[i] = TASK_VALUE_FLOAT;
+      raw[i].i64 = 0;
+    }
+  }
+
+  byte types[VARS_PER_TASK];
+  TaskValueRaw raw[VARS_PER_TASK];
+};
+TaskValueStoreStruct* taskValueStore[TASKS_MAX] = {NULL};
+
+// Published copy of the values of each task, for the readers (controllers,
+// rules, web, P2P) which may run in another RTOS task than the plugin.
+// The plugins keep writing UserVar, publishTaskValues() copies the set of a
+// task under a sequence lock: the sequence is odd while writing and readers
+// retry until they read the same even sequence before and after the copy.
+// Each value is kept in its type, the float view is made by the reader.
+struct TaskValueSnapshot
+{
+  TaskValueSnapshot() : timestamp(0), sequence(0) {
+    for (byte i = 0; i < VARS_PER_TASK; ++i) {
+      values[i] = 0;
+      raw[i].i64 = 0;
+      types[i] = TASK_VALUE_FLOAT;
+      changed[i] = 0;
+    }
+  }
+
+  // SENSOR_TYPE_LONG is stored as 2 x 16 bit in the first two values, unless set as integer.
+  unsigned long getLong() const {
+    if (isInteger(0)) return static_cast<unsigned long>(getInt64(0));
+    return (unsigned long)values[0] + ((unsigned long)values[1] << 16);
+  }
+
+  bool isInteger(byte varNr) const {
+    return types[varNr] == TASK_VALUE_INT32 || types[varNr] == TASK_VALUE_INT64;
+  }
+
+  int64_t getInt64(byte varNr) const {
+    switch (types[varNr]) {
+      case TASK_VALUE_INT32: return raw[varNr].i32;
+      case TASK_VALUE_INT64: return raw[varNr].i64;
+    }
+    return llround(getDouble(varNr));
+  }
+
+  double getDouble(byte varNr) const {
+    switch (types[varNr]) {
+      case TASK_VALUE_INT32:  return raw[varNr].i32;
+      case TASK_VALUE_INT64:  return raw[varNr].i64;
+      case TASK_VALUE_DOUBLE: return raw[varNr].d;
+    }
+    return raw[varNr].f;
+  }
+
+  float values[VARS_PER_TASK];           // Every value as float
+  TaskValueRaw raw[VARS_PER_TASK];
+  byte types[VARS_PER_TASK];             // TASK_VALUE_xxx
+  unsigned long changed[VARS_PER_TASK];  // millis() when the value last changed, 0 = never
+  unsigned long timestamp;  // millis() when published
+  uint32_t sequence;        // Even, increases with every publish
+};
+
+struct TaskValueSeqLockStruct
+{
+  TaskValueSeqLockStruct() : sequence(0), timestamp(0) {
+    for (byte i = 0; i < VARS_PER_TASK; ++i) {
+      raw[i].i64 = 0;
+      types[i] = TASK_VALUE_FLOAT;
+      changed[i] = 0;
+    }
+  }
+
+  volatile uint32_t sequence;
+  volatile unsigned long timestamp;
+  TaskValueRaw raw[VARS_PER_TASK];
+  byte types[VARS_PER_TASK];
+  unsigned long changed[VARS_PER_TASK];
+} taskValueSeqLock[TASKS_MAX];
+
+#define TASK_VALUE_SNAPSHOT_RETRIES  100
+
+// Changes of task values, for clients polling /json?since=... and the /json ETag.
+// Bumped by publishTaskValues() when a value changed and by markTaskValuesChanged().
+unsigned long taskValueSequence = 0;
+unsigned long lastTaskValueSequence[TASKS_MAX] = {0};
+
+// Single writer per task, plugins only run in one task at a time.
+inline void publishTaskValues(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return;
+  TaskValueSeqLockStruct& lock = taskValueSeqLock[TaskIndex];
+  TaskValueStoreStruct* store = taskValueStore[TaskIndex];
+  const int BaseVarIndex = TaskIndex * VARS_PER_TASK;
+  const unsigned long now = millis();
+  bool valuesChanged = false;
+  ++lock.sequence;
+  __sync_synchronize();
+  for (byte i = 0; i < VARS_PER_TASK; ++i) {
+    const float value = UserVar[BaseVarIndex + i];
+    TaskValueRaw raw;
+    byte type = TASK_VALUE_FLOAT;
+    // Unless changed as float since it was set, e.g. by a formula
+    if (store != NULL && store->types[i] != TASK_VALUE_FLOAT &&
+        taskValueRawToFloat(store->raw[i], store->types[i]) == value) {
+      type = store->types[i];
+      raw = store->raw[i];
+    } else {
+      raw.i64 = 0;  // The unused bytes are compared as well
+      raw.f = value;
+    }
+    if (raw.i64 != lock.raw[i].i64 || type != lock.types[i]) {
+      lock.raw[i].i64 = raw.i64;
+      lock.types[i] = type;
+      lock.changed[i] = now;
+      valuesChanged = true;
+    }
+  }
+  lock.timestamp = now;
+  __sync_synchronize();
+  ++lock.sequence;
+  if (valuesChanged)
+    lastTaskValueSequence[TaskIndex] = ++taskValueSequence;
+}
+
+// Values of the queued sample a controller is sending, see setControllerSampleValues().
+// Only the sending RTOS task reads these instead of the published values, UserVar is not touched.
+struct ControllerSampleValuesStruct
+{
+  ControllerSampleValuesStruct() : TaskIndex(TASKS_MAX) {
+#ifdef USE_RTOS_MULTITASKING
+    owner = NULL;
+#endif
+  }
+
+  bool isReader() const {
+#ifdef USE_RTOS_MULTITASKING
+    return owner == xTaskGetCurrentTaskHandle();
+#else
+    return true;
+#endif
+  }
+
+  TaskValueSnapshot snapshot;
+  byte TaskIndex;  // TASKS_MAX when not sending a queued sample
+#ifdef USE_RTOS_MULTITASKING
+  TaskHandle_t owner;
+#endif
+} controllerSampleValues[CONTROLLER_MAX];
+
+// Lock free copy of the last published values of a task.
+// Returns false when no consistent copy could be made, e.g. for an invalid task.
+inline bool getTaskValueSnapshot(byte TaskIndex, TaskValueSnapshot& snapshot) {
+  if (TaskIndex >= TASKS_MAX) return false;
+  for (byte x = 0; x < CONTROLLER_MAX; ++x) {
+    const ControllerSampleValuesStruct& sample = controllerSampleValues[x];
+    if (sample.TaskIndex == TaskIndex && sample.isReader()) {
+      snapshot = sample.snapshot;
+      return true;
+    }
+  }
+  const TaskValueSeqLockStruct& lock = taskValueSeqLock[TaskIndex];
+  for (int retry = 0; retry < TASK_VALUE_SNAPSHOT_RETRIES; ++retry) {
+    const uint32_t before = lock.sequence;
+    if (before & 1) continue;  // Being written
+    __sync_synchronize();
+    for (byte i = 0; i < VARS_PER_TASK; ++i) {
+      snapshot.raw[i].i64 = lock.raw[i].i64;
+      snapshot.types[i] = lock.types[i];
+      snapshot.changed[i] = lock.changed[i];
+    }
+    snapshot.timestamp = lock.timestamp;
+    __sync_synchronize();
+    if (lock.sequence == before) {
+      for (byte i = 0; i < VARS_PER_TASK; ++i)
+        snapshot.values[i] = taskValueRawToFloat(snapshot.raw[i], snapshot.types[i]);
+      snapshot.sequence = before;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Running rule timers are RULES_TIMER entries of msecTimerHandler, paused ones keep their remaining msec here.
+std::map<unsigned int, unsigned long> RulesTimerPaused;
 
 msecTimerHandlerStruct msecTimerHandler;
 
 unsigned long timermqtt_interval;
+unsigned long lastRun50TimesPerSecond = 0;
+bool run50TimesPerSecondRunning = false;  // A plugin may send web content and so wait in handle_schedule_while_waiting()
+
+// Names and formatted values of a task for /json, rebuilt when its sequence or values changed,
+// so a poll does not load the settings and format the values of every task. See getJsonTask()
+struct JsonTaskCacheStruct
+{
+  JsonTaskCacheStruct() : sequence(0), published(1), deviceNumber(0) {
+    for (byte i = 0; i < VARS_PER_TASK; ++i) {
+      formatted[i][0] = 0;
+      decimals[i] = 0;
+    }
+  }
+
+  unsigned long sequence;        // lastTaskValueSequence[] when built
+  uint32_t published;            // taskValueSeqLock[].sequence when formatted, odd = not yet
+  byte deviceNumber;
+  String taskName;
+  String valueNames[VARS_PER_TASK];
+  byte decimals[VARS_PER_TASK];
+  char formatted[VARS_PER_TASK][FORMAT_VALUE_BUFFER_SIZE];
+};
 unsigned long lastSend;
 unsigned long lastWeb;
 byte cmd_within_mainloop = 0;
@@ -1321,12 +2600,69 @@ float vcc = -1.0;
 boolean WebLoggedIn = false;
 int WebLoggedInTimer = 300;
 
-boolean (*Plugin_ptr[PLUGIN_MAX])(byte, struct EventStruct*, String&);
-std::vector<byte> Plugin_id;
-std::vector<int> Task_id_to_Plugin_id;
+/*********************************************************************************************\
+ * Plugins and controllers built in, in flash. The tables are generated by the preprocessor from
+ * the enabled set (define_plugin_sets.h) in __Plugin.ino and __CPlugin.ino, sorted by number.
+ * The index in the table is also the index in Device[] and Protocol[].
+\*********************************************************************************************/
+typedef boolean (*PluginFunction)(byte, struct EventStruct*, String&);
+
+struct PluginRegistryEntry
+{
+  byte id;                  // PLUGIN_ID_xxx or CPLUGIN_ID_xxx
+  PluginFunction function;
+};
+
+extern const PluginRegistryEntry PluginRegistry[] PROGMEM;
+extern const byte PluginRegistryCount;
+extern const PluginRegistryEntry CPluginRegistry[] PROGMEM;
+extern const byte CPluginRegistryCount;
+
+// Number of the plugin at this index, 0 beyond the last one.
+inline byte getPluginNumber(byte x) {
+  return x < PluginRegistryCount ? pgm_read_byte(&PluginRegistry[x].id) : 0;
+}
+
+inline PluginFunction getPluginFunction(byte x) {
+  return (PluginFunction)pgm_read_ptr(&PluginRegistry[x].function);
+}
+
+inline byte getCPluginNumber(byte x) {
+  return x < CPluginRegistryCount ? pgm_read_byte(&CPluginRegistry[x].id) : 0;
+}
+
+inline PluginFunction getCPluginFunction(byte x) {
+  return (PluginFunction)pgm_read_ptr(&CPluginRegistry[x].function);
+}
+
+int Task_id_to_Plugin_id[TASKS_MAX];
 
-boolean (*CPlugin_ptr[CPLUGIN_MAX])(byte, struct EventStruct*, String&);
-byte CPlugin_id[CPLUGIN_MAX];
+// Index caches for Device[], Protocol[] and Notification[], maintained by updateTaskPluginCache().
+// Entries are verified against Settings on use, see getDeviceIndex_from_TaskIndex() and friends.
+byte Task_id_to_DeviceIndex[TASKS_MAX];
+byte Controller_id_to_ProtocolIndex[CONTROLLER_MAX];
+byte Notification_id_to_NPluginIndex[NOTIFICATION_MAX];
+
+// Base of the state a plugin keeps per task, see PluginTaskData.ino.
+// Deleted by the core, the destructor of the plugin's struct does the cleanup.
+struct PluginTaskData_base
+{
+  virtual ~PluginTaskData_base() {}
+};
+
+// Device[] indices sorted by plugin name, built once by buildSortedDeviceIndex()
+std::vector<byte> DeviceIndex_sorted;
+std::vector<byte> DeviceIndex_by_Number; // Device index per plugin number, see getDeviceIndex()
+
+// Per periodic callback type (index of the PLUGIN_CALLBACK_xxx bit) the tasks subscribed to it.
+// Rebuilt in updateTaskPluginCache()
+struct periodicTaskListStruct {
+  periodicTaskListStruct() {
+    for (byte i = 0; i < PLUGIN_CALLBACK_NR_TYPES; ++i) count[i] = 0;
+  }
+  byte count[PLUGIN_CALLBACK_NR_TYPES];
+  byte tasks[PLUGIN_CALLBACK_NR_TYPES][TASKS_MAX];
+} periodicTaskList;
 
 boolean (*NPlugin_ptr[NPLUGIN_MAX])(byte, struct EventStruct*, String&);
 byte NPlugin_id[NPLUGIN_MAX];
@@ -1403,6 +2739,9 @@ uint8_t lastWiFiSettings = 0;
 String last_ssid;
 bool bssid_changed = false;
 uint8_t last_channel = 0;
+bool wifiFastConnect = false;    // Connect using RTC_WiFi, set when woken from deep sleep
+bool wifiFastConnectIP = false;  // The IP config of RTC_WiFi is set, no DHCP
+unsigned long firstSendMoment = 0; // millis() of the first sendData() after boot
 WiFiDisconnectReason lastDisconnectReason = WIFI_DISCONNECT_REASON_UNSPECIFIED;
 unsigned long lastConnectMoment = 0;
 unsigned long lastDisconnectMoment = 0;
@@ -1417,6 +2756,31 @@ uint8_t lastMacDisconnectedAPmode[6] = {0};
 uint8_t  scan_done_number = 0;
 //uint8_t  scan_done_scan_id = 0;
 
+// Access points found by the WiFi scans, kept between scans. See ESPEasyWifi.ino
+#define WIFI_SCAN_CACHE_SIZE          12
+#define WIFI_SCAN_CACHE_MAX_AGE   300000   // msec, older entries are not shown or used
+
+struct WiFiScanCacheStruct
+{
+  WiFiScanCacheStruct() :
+    lastSeen(0), rssiX4(0), channel(0), encryption(0), hidden(false)
+  {
+    ssid[0] = 0;
+    for (byte i = 0; i < 6; ++i) bssid[i] = 0;
+  }
+
+  bool used() const  { return channel != 0; }
+  int rssi() const   { return rssiX4 / 4; }
+
+  char ssid[33];
+  uint8_t bssid[6];
+  unsigned long lastSeen;
+  int16_t rssiX4;       // Running average of the RSSI, times 4
+  uint8_t channel;
+  uint8_t encryption;
+  bool hidden;
+} WiFiScanCache[WIFI_SCAN_CACHE_SIZE];
+
 // Semaphore like booleans for processing data gathered from WiFi events.
 bool processedConnect = true;
 bool processedDisconnect = true;
@@ -1453,20 +2817,299 @@ bool shouldReboot=false;
 bool firstLoop=true;
 
 boolean activeRuleSets[RULESETS_MAX];
+byte rulesNestingLevel = 0;
+
+// Do not keep rules in RAM when free memory would drop below this value.
+#define RULES_COMPILE_MIN_FREE_MEM      8000
+// Release the rules kept in RAM when free memory drops below this value while running.
+#define RULES_CACHE_RELEASE_MEM         4000
+// Max. bytes of all rules sets kept in RAM, larger sets are processed from file.
+#ifndef RULES_CACHE_MAX_BYTES
+  #if defined(ESP32)
+    #define RULES_CACHE_MAX_BYTES      16384
+  #else
+    #define RULES_CACHE_MAX_BYTES       6144
+  #endif
+#endif
+
+// Line of a rules set held in RAM, see compileRuleSet()
+struct compiledRuleLineStruct
+{
+  compiledRuleLineStruct() : nextEndOnIndex(0), hasTemplate(false) {}
+
+  String line;              // Comments stripped, trimmed unless hasTemplate is set
+  uint16_t nextEndOnIndex;  // Index of the first "endon" line after this one
+  boolean hasTemplate;      // Line contains markup and must be parsed by parseTemplate() first
+};
+std::vector<compiledRuleLineStruct> compiledRuleSets[RULESETS_MAX];
+boolean compiledRuleSetValid[RULESETS_MAX];
+unsigned int compiledRuleSetBytes[RULESETS_MAX];
+boolean compiledRuleSetsReleased = false; // Released due to low memory, compiled again when memory is available
+unsigned long rulesCacheHits = 0;   // Rules sets processed from RAM
+unsigned long rulesCacheMisses = 0; // Rules sets processed from file
+unsigned long rulesFileReads = 0;   // SPIFFS reads of rulesProcessingFile()
+
+// Top level "on ... do" line of a compiled rules set, used to find the blocks an event may trigger
+struct compiledRuleTriggerStruct
+{
+  compiledRuleTriggerStruct() : lineIndex(0), synchronous(false), clockSet(0) {}
+
+  uint16_t lineIndex;       // Index in compiledRuleSets[]
+  String eventName;         // Lower case event name, empty when it cannot be determined (e.g. "*")
+  bool synchronous;         // "on <event> sync do", processed by the caller, never queued
+  unsigned long clockSet;   // Clock#Time triggers: the time as string2TimeLong(), 0 when not known
+};
+std::vector<compiledRuleTriggerStruct> compiledRuleTriggers[RULESETS_MAX];
+boolean compiledRuleTriggersValid[RULESETS_MAX];
+
+// Event processed by the rules, like "Bme280#Temperature=22.75".
+// The name and value are split once, when the event is created, instead of for every
+// "on" line. Events of tasks (see createRuleEvents()) get the value as float, events
+// from text (UDP, HTTP, serial) have it parsed from the text.
+struct RuleEventStruct
+{
+  RuleEventStruct() : nameLength(0), hasValue(false), value(0) {}
+
+  RuleEventStruct(const String& event) : text(event), nameLength(event.length()), hasValue(false), value(0) {
+    if (text.charAt(0) == '!') return;  // Literal event, matched on the text
+    const int equalsPos = text.indexOf('=');
+    if (equalsPos > 0) {
+      nameLength = equalsPos;
+      hasValue = true;
+      value = atof(text.c_str() + equalsPos + 1);
+    }
+  }
+
+  // Text of the event is only used for logging and %eventvalue%.
+  RuleEventStruct(const String& event, float eventValue) : text(event), nameLength(event.length()), hasValue(true), value(eventValue) {
+    const int equalsPos = text.indexOf('=');
+    if (equalsPos > 0) nameLength = equalsPos;
+  }
+
+  // As stored in the rules queue.
+  RuleEventStruct(const char* event, uint16_t eventNameLength, bool eventHasValue, float eventValue) :
+    text(event), nameLength(eventNameLength), hasValue(eventHasValue), value(eventValue) {}
+
+  bool isLiteral() const { return text.charAt(0) == '!'; }
+  String getName() const { return text.substring(0, nameLength); }
+
+  String text;
+  uint16_t nameLength;     // Part of the text before the '='
+  bool hasValue;
+  float value;
+};
+
+// State of the rules parser while processing the lines of a rules set
+struct rulesProcessingStateStruct
+{
+  rulesProcessingStateStruct() :
+    match(false), codeBlock(false), isCommand(false), conditional(false),
+    condition(false), ifBranche(false), ifBrancheJustMatch(false) {}
+
+  boolean match;
+  boolean codeBlock;
+  boolean isCommand;
+  boolean conditional;
+  boolean condition;
+  boolean ifBranche;
+  boolean ifBrancheJustMatch;
+};
 
 boolean       UseRTOSMultitasking;
 
+// Rules events queued for the rules task (RTOS_TaskRules), or without it for the
+// scheduler, which processes them for at most RULES_QUEUE_BUDGET msec per run.
+// With RTOS only accessed while holding the RTOS state lock. An event with the
+// same name as a queued one replaces it (the last value wins), so a busy sensor
+// does not fill the queue. Timer events (Rules#Timer, Clock#Time) go first.
+#define RULES_QUEUE_SIZE   16
+#define RULES_QUEUE_BUDGET 10   // msec
+
+// The fields of the RuleEventStruct, its text in a memory block (see allocBlock()).
+struct rulesQueueEntry
+{
+  rulesQueueEntry() : text(NULL), nameLength(0), hasValue(false), value(0), enqueued(0), priority(false) {}
+
+  char* text;
+  uint16_t nameLength;
+  bool hasValue;
+  float value;
+  unsigned long enqueued;   // micros()
+  bool priority;
+};
+
+struct rulesQueueStruct
+{
+  rulesQueueStruct() : first(0), count(0), maxCount(0), queued(0), coalesced(0), full(0),
+                       dropped(0), latencyTotal(0), latencyMax(0), processed(0) {}
+
+  rulesQueueEntry entries[RULES_QUEUE_SIZE];
+  byte first;
+  byte count;
+  byte maxCount;
+  unsigned long queued;
+  unsigned long coalesced;    // Replaced a queued event with the same name
+  unsigned long full;         // Processed by the caller, since the queue was full
+  unsigned long dropped;      // Value events pushed out of a full queue by a timer event
+  unsigned long latencyTotal; // usec from queued to processed
+  unsigned long latencyMax;
+  unsigned long processed;
+} rulesQueue;
+
+#ifdef USE_RTOS_MULTITASKING
+// Run time, core and stack use of the FreeRTOS tasks, see ESPEasyStatistics.ino
+// The busy time is measured around the work of each task loop, since the
+// run time stats of FreeRTOS are not enabled in the Arduino ESP32 SDK.
+#define RTOS_TASK_LOOP      0  // Arduino loopTask, also without RTOS multitasking
+#define RTOS_TASK_SERVERS   1
+#define RTOS_TASK_SERIAL    2
+#define RTOS_TASK_10PS      3
+#define RTOS_TASK_RULES     4
+#define RTOS_TASK_CONTROLLER 5  // One delivery task per controller, see Controller.ino
+#define RTOS_TASK_COUNT     (RTOS_TASK_CONTROLLER + CONTROLLER_MAX)
+
+struct rtosTaskStatsStruct
+{
+  rtosTaskStatsStruct() : handle(NULL), busyUsec(0), runs(0), load(0.0), runsPerSec(0.0), core(0) {}
+
+  TaskHandle_t handle;
+  volatile uint32_t busyUsec;  // Since the last update of load
+  volatile uint32_t runs;      // Task loops with work, since the last update
+  float load;                  // % of the time busy in the last statistics interval
+  float runsPerSec;
+  byte core;
+} rtosTaskStats[RTOS_TASK_COUNT];
+
+unsigned long rtosTaskStatsStart = 0;
+#endif
+
+#if defined(ESP32)
+// Load of each core, measured with a FreeRTOS idle hook per core, see ESPEasyStatistics.ino
+#include <esp_freertos_hooks.h>
+struct coreLoadStruct
+{
+  coreLoadStruct() : idleTicks(0), lastIdleTick(0), load(0.0) {}
+
+  volatile uint32_t idleTicks;       // Ticks in which the idle task ran, since the last update
+  volatile TickType_t lastIdleTick;
+  float load;                        // % of the ticks without idle time in the last statistics interval
+} coreLoad[portNUM_PROCESSORS];
+
+TickType_t coreLoadStart = 0;
+#endif
+
+#ifdef USE_RTOS_MULTITASKING
+// The network task runs on core 0 next to the WiFi and TCP/IP stack, the loop
+// task and the 10 per second task on core 1. Plugins, rules, controllers and
+// web handlers share the settings, UserVar and the task settings buffer, so
+// they only run while holding this (recursive) mutex.
+SemaphoreHandle_t rtosStateMutex = NULL;
+
+struct RTOSStateLock {
+  RTOSStateLock() : locked(false) { lock(); }
+  ~RTOSStateLock() { unlock(); }
+
+  void lock() {
+    if (locked || rtosStateMutex == NULL) return;
+    xSemaphoreTakeRecursive(rtosStateMutex, portMAX_DELAY);
+    locked = true;
+  }
+
+  void unlock() {
+    if (!locked) return;
+    xSemaphoreGiveRecursive(rtosStateMutex);
+    locked = false;
+  }
+
+  bool locked;
+};
+
+// Gives up the state lock while a controller delivery task waits for its server,
+// so the other tasks and controllers continue meanwhile. Only code that uses
+// nothing but the connection of that controller may run while it is released.
+bool isControllerDeliveryTask();
+
+struct RTOSStateRelease {
+  RTOSStateRelease() : released(false) {
+    if (rtosStateMutex != NULL && isControllerDeliveryTask())
+      released = xSemaphoreGiveRecursive(rtosStateMutex) == pdTRUE;
+  }
+  ~RTOSStateRelease() {
+    if (released) xSemaphoreTakeRecursive(rtosStateMutex, portMAX_DELAY);
+  }
+
+  bool released;
+};
+
+// Next delivery of each controller queue, set by scheduleControllerQueue()
+struct controllerDeliveryStruct
+{
+  controllerDeliveryStruct() : due(0), scheduled(false), deferred(0) {}
+
+  volatile unsigned long due;      // millis()
+  volatile bool scheduled;
+  unsigned long deferred;          // Delayed by low heap while another controller was sending
+} controllerDelivery[CONTROLLER_MAX];
+
+byte controllerDeliveriesActive = 0;
+#endif
+
+// Events pushed by interrupt handlers of plugins, drained by the scheduler in the
+// main loop and sent to the task as PLUGIN_INTERRUPT_EVENT (event->Par1 = type,
+// event->Par2 = value, event->Data points to the InterruptEventStruct).
+// Single producer, single consumer without locks: all GPIO interrupts run in the
+// same interrupt context and only the main loop removes events.
+#define INTERRUPT_EVENT_QUEUE_SIZE   32  // Power of 2
+#define INTERRUPT_EVENT_QUEUE_MASK   (INTERRUPT_EVENT_QUEUE_SIZE - 1)
+#define INTERRUPT_EVENT_BURST        16  // Max. events handled per call
+
+struct InterruptEventStruct
+{
+  unsigned long timestamp;  // micros() in the interrupt
+  uint32_t value;
+  byte TaskIndex;
+  byte type;                // Plugin specific
+};
+
+struct InterruptEventQueueStruct
+{
+  InterruptEventQueueStruct() : head(0), tail(0), dropped(0), processed(0), maxUsed(0), maxLatency(0) {}
+
+  InterruptEventStruct events[INTERRUPT_EVENT_QUEUE_SIZE];
+  volatile uint16_t head;          // Only written by the interrupt handlers
+  volatile uint16_t tail;          // Only written by the main loop
+  volatile unsigned long dropped;  // Queue full
+  unsigned long processed;
+  uint16_t maxUsed;
+  unsigned long maxLatency;        // usec from interrupt to dispatch
+} interruptEventQueue;
+
+bool pushInterruptEvent(byte TaskIndex, byte type, uint32_t value) ICACHE_RAM_ATTR;
+
 void (*MainLoopCall_ptr)(void);
 
+// Histogram buckets of power of 2: bucket b holds [2^(b-1), 2^b) usec, the last one >= 4.2 sec
+#define TIMING_STATS_BUCKETS  24
+
 class TimingStats {
     public:
-      TimingStats() : _timeTotal(0.0), _count(0), _maxVal(0), _minVal(4294967295) {}
+      TimingStats() : _timeTotal(0.0), _count(0), _maxVal(0), _minVal(4294967295) {
+          memset(_histogram, 0, sizeof(_histogram));
+      }
 
       void add(unsigned long time) {
           _timeTotal += time;
           ++_count;
           if (time > _maxVal) _maxVal = time;
           if (time < _minVal) _minVal = time;
+          byte bucket = (time == 0) ? 0 : 32 - __builtin_clz(time);
+          if (bucket >= TIMING_STATS_BUCKETS) bucket = TIMING_STATS_BUCKETS - 1;
+          if (_histogram[bucket] == 0xFFFF) {
+              // Keep the shape, rounding up so rare samples are not lost.
+              for (byte i = 0; i < TIMING_STATS_BUCKETS; ++i)
+                  _histogram[i] = (_histogram[i] + 1) / 2;
+          }
+          ++_histogram[bucket];
       }
 
       void reset() {
@@ -1474,12 +3117,17 @@ class TimingStats {
           _count = 0;
           _maxVal = 0;
           _minVal = 4294967295;
+          memset(_histogram, 0, sizeof(_histogram));
       }
 
       bool isEmpty() const {
           return _count == 0;
       }
 
+      unsigned int getCount() const {
+          return _count;
+      }
+
       float getAvg() const {
         if (_count == 0) return 0.0;
         return _timeTotal / _count;
@@ -1496,11 +3144,35 @@ class TimingStats {
           return _count;
       }
 
+      // Estimate, interpolated within the histogram bucket. percentile in 0 .. 100
+      unsigned long getPercentile(byte percentile) const {
+          if (_count == 0) return 0;
+          unsigned long total = 0;
+          for (byte i = 0; i < TIMING_STATS_BUCKETS; ++i)
+              total += _histogram[i];
+          const float target = total * percentile / 100.0;
+          unsigned long before = 0;
+          for (byte i = 0; i < TIMING_STATS_BUCKETS; ++i) {
+              if (_histogram[i] == 0 || before + _histogram[i] < target) {
+                  before += _histogram[i];
+                  continue;
+              }
+              const unsigned long lower = (i == 0) ? 0 : (1ul << (i - 1));
+              const unsigned long upper = (i == 0) ? 1 : (1ul << i);
+              unsigned long value = lower + (upper - lower) * ((target - before) / _histogram[i]);
+              if (i == TIMING_STATS_BUCKETS - 1 || value > _maxVal) value = _maxVal;
+              if (value < _minVal) value = _minVal;
+              return value;
+          }
+          return _maxVal;
+      }
+
     private:
       float _timeTotal;
       unsigned int _count;
       unsigned long _maxVal;
       unsigned long _minVal;
+      uint16_t _histogram[TIMING_STATS_BUCKETS];
 };
 
 String getLogLine(const TimingStats& stats) {
@@ -1516,6 +3188,12 @@ String getLogLine(const TimingStats& stats) {
     log += minVal;
     log += '/';
     log += maxVal;
+    log += F(" p50/p90/p99 ");
+    log += stats.getPercentile(50);
+    log += '/';
+    log += stats.getPercentile(90);
+    log += '/';
+    log += stats.getPercentile(99);
     log += F(" usec");
     return log;
 }
@@ -1550,8 +3228,9 @@ String getPluginFunctionName(int function) {
         case PLUGIN_GET_CONFIG:            return F("GET_CONFIG          ");
         case PLUGIN_UNCONDITIONAL_POLL:    return F("UNCONDITIONAL_POLL  ");
         case PLUGIN_REQUEST:               return F("REQUEST             ");
+        case PLUGIN_INTERRUPT_EVENT:       return F("INTERRUPT_EVENT     ");
     }
-    return F("Unknown");
+    return getWebString(WEB_STR_UNKNOWN);
 }
 
 bool mustLogFunction(int function) {
@@ -1582,6 +3261,7 @@ bool mustLogFunction(int function) {
         case PLUGIN_GET_CONFIG:            return false;
         case PLUGIN_UNCONDITIONAL_POLL:    return false;
         case PLUGIN_REQUEST:               return true;
+        case PLUGIN_INTERRUPT_EVENT:       return true;
     }
     return false;
 }
@@ -1590,6 +3270,7 @@ std::map<int,TimingStats> pluginStats;
 std::map<int,TimingStats> miscStats;
 unsigned long timediff_calls = 0;
 unsigned long timediff_cpu_cycles_total = 0;
+unsigned long eventstruct_string_allocs_start = 0;
 
 #define LOADFILE_STATS        0
 #define LOOP_STATS            1
@@ -1603,16 +3284,243 @@ unsigned long timediff_cpu_cycles_total = 0;
 #define PROC_SYS_TIMER        9
 #define SET_NEW_TIMER        10
 #define TIME_DIFF_COMPUTE    11
+#define EVENT_STRING_ALLOCS  12
+#define WEB_TX_WAIT_STATS    13
+#define SAVEFILE_STATS       14
+#define ADD_LOG_STATS        15  // addToLog(), excluding building the line
+#define ADD_LOG_FMT_STATS    16  // addToLogFmt()
+#define PARSE_TEMPLATE_STATS 17
+#define PLUGIN_CALL_INTERRUPT 18  // PLUGIN_INTERRUPT_EVENT, see processInterruptEvents()
+#define OLED_FRAME_STATS     19  // Frame pushed to an OLED display (P023, P036)
+
+// Bytes transferred by LoadFromFile() and SaveToFile() / ClearInFile()
+unsigned long loadFileBytes = 0;
+unsigned long saveFileBytes = 0;
 
 
 
 
 
 #define START_TIMER const unsigned statisticsTimerStart(micros());
-#define STOP_TIMER_TASK(T,F)  if (mustLogFunction(F)) pluginStats[T*32 + F].add(usecPassedSince(statisticsTimerStart));
+/*********************************************************************************************\
+ * Dispatches: scheduler timers, plugin calls, controller sends, web pages and rules events.
+ * Their end is reported to the execution trace (Trace.ino) and the stall detector (checkStall())
+\*********************************************************************************************/
+#define DISPATCH_SCHEDULER    1  // id: timer type, arg: timer id
+#define DISPATCH_PLUGIN       2  // id: plugin function, arg: plugin index
+#define DISPATCH_CONTROLLER   3  // id: controller stat, arg: controller index
+#define DISPATCH_WEB          4  // id: web route
+#define DISPATCH_RULES        5
+#ifdef FEATURE_TRACE
+  #define TRACE_EVENT(C,I,A,S)  traceEvent(C, I, A, S);
+#else
+  #define TRACE_EVENT(C,I,A,S)
+#endif
+#define DISPATCH_END(C,I,A,S)  TRACE_EVENT(C,I,A,S) if (Settings.StallBudget != 0) checkStall(C, I, A, S);
+#define DISPATCH_START         const unsigned long dispatchStart(micros());
+#define DISPATCH_DONE(C,I,A)   DISPATCH_END(C, I, A, dispatchStart)
+
+struct stallStatsStruct
+{
+  stallStatsStruct() : count(0), maxUsec(0) {}
+
+  unsigned long count;
+  unsigned long maxUsec;
+};
+
+std::map<uint32_t,stallStatsStruct> stallStats;  // Key: category << 16 | arg << 8 | id
+byte dispatchTimerType = 0;         // Timer handled by handle_schedule(), the context of a stall. 0 = none
+unsigned long dispatchTimerId = 0;
+bool stallReportedInTimer = false;  // Do not report the timer again when a call within it stalled
+unsigned long stallEventMsec = 0;   // System#Stall event to send, 0 = none
+bool stallEventRunning = false;
+
+#define STOP_TIMER_TASK(T,F)  if (mustLogFunction(F)) pluginStats[T*32 + F].add(usecPassedSince(statisticsTimerStart)); DISPATCH_END(DISPATCH_PLUGIN, F, T, statisticsTimerStart)
 #define STOP_TIMER_LOADFILE miscStats[LOADFILE_STATS].add(usecPassedSince(statisticsTimerStart));
 #define STOP_TIMER(L)       miscStats[L].add(usecPassedSince(statisticsTimerStart));
 
+/*********************************************************************************************\
+ * Timing statistics per controller
+\*********************************************************************************************/
+#define CONTROLLER_CONNECT_STATS  0  // Connect to the host or broker
+#define CONTROLLER_SEND_STATS     1  // Controller plugin call which sends, including the reply
+#define CONTROLLER_REPLY_STATS    2  // Wait for and read the reply
+#define CONTROLLER_STATS_COUNT    3
+
+struct controllerStatsStruct
+{
+  controllerStatsStruct() : failures(0), bytesSent(0) {}
+
+  void reset() {
+    for (byte i = 0; i < CONTROLLER_STATS_COUNT; ++i)
+      stats[i].reset();
+    failures = 0;
+    bytesSent = 0;
+  }
+
+  bool isEmpty() const {
+    for (byte i = 0; i < CONTROLLER_STATS_COUNT; ++i)
+      if (!stats[i].isEmpty()) return false;
+    return failures == 0 && bytesSent == 0;
+  }
+
+  TimingStats stats[CONTROLLER_STATS_COUNT];
+  unsigned long failures;   // Samples the controller failed to send
+  unsigned long bytesSent;
+} ControllerStats[CONTROLLER_MAX];
+
+// Controller diagnostics, see ControllerDiagnostic.ino
+unsigned long controllerDiagSequence[CONTROLLER_MAX];  // Last sequence per controller
+unsigned long controllerDiagCurrent = 0;  // Sequence of the sample being sent, 0 = not a sample
+
+#define STOP_TIMER_CONTROLLER(C,L)  if ((C) < CONTROLLER_MAX) ControllerStats[C].stats[L].add(usecPassedSince(statisticsTimerStart)); DISPATCH_END(DISPATCH_CONTROLLER, L, C, statisticsTimerStart)
+
+
+/*********************************************************************************************\
+ * Heap use per task and plugin function, and per controller, see PluginCall() and CPluginCall()
+ * There is no allocation hook, so the calls which left less free heap are counted instead.
+\*********************************************************************************************/
+unsigned long FreeMem(void);
+uint32_t getMaxFreeBlock();
+
+struct heapStatsStruct
+{
+  heapStatsStruct() : calls(0), retainedCalls(0), heapDeltaTotal(0), heapDeltaMin(0), maxBlockDropMax(0) {}
+
+  void add(uint32_t freeBefore, uint32_t freeAfter, uint32_t blockBefore, uint32_t blockAfter) {
+    const long delta = static_cast<long>(freeAfter) - static_cast<long>(freeBefore);
+    ++calls;
+    if (delta < 0) ++retainedCalls;
+    heapDeltaTotal += delta;
+    if (delta < heapDeltaMin) heapDeltaMin = delta;
+    if (blockBefore > blockAfter && (blockBefore - blockAfter) > maxBlockDropMax)
+      maxBlockDropMax = blockBefore - blockAfter;
+  }
+
+  unsigned long calls;
+  unsigned long retainedCalls;  // Calls which left less free heap, e.g. kept an allocation
+  long heapDeltaTotal;          // Sum of the free heap changes, negative is heap kept
+  long heapDeltaMin;            // Largest decrease in a single call
+  uint32_t maxBlockDropMax;     // Largest decrease of the largest free block in a single call
+};
+
+std::map<int,heapStatsStruct> taskHeapStats;        // Key: TaskIndex * 32 + Function
+std::map<int,heapStatsStruct> controllerHeapStats;  // Key: ControllerIndex * 32 + Function
+
+// Init and exit are included, that is where most plugins allocate and free.
+#define MUST_LOG_HEAP_FUNCTION(F)  (mustLogFunction(F) || (F) == PLUGIN_INIT || (F) == PLUGIN_EXIT)
+#define START_HEAP_STATS(F)  const bool heapStatsActive(MUST_LOG_HEAP_FUNCTION(F)); \
+                             const uint32_t heapStatsFreeStart(heapStatsActive ? FreeMem() : 0); \
+                             const uint32_t heapStatsBlockStart(heapStatsActive ? getMaxFreeBlock() : 0);
+// The free heap is read before the statistics entry is created.
+#define STOP_HEAP_STATS_TASK(T,F)  if (heapStatsActive) { const uint32_t freeEnd(FreeMem()); const uint32_t blockEnd(getMaxFreeBlock()); \
+                                     taskHeapStats[(T)*32 + (F)].add(heapStatsFreeStart, freeEnd, heapStatsBlockStart, blockEnd); }
+#define START_HEAP_STATS_CONTROLLER  const bool heapStatsActive(true); \
+                                     const uint32_t heapStatsFreeStart(FreeMem()); \
+                                     const uint32_t heapStatsBlockStart(getMaxFreeBlock());
+#define STOP_HEAP_STATS_CONTROLLER(C,F)  if (heapStatsActive && (C) < CONTROLLER_MAX) { const uint32_t freeEnd(FreeMem()); const uint32_t blockEnd(getMaxFreeBlock()); \
+                                           controllerHeapStats[(C)*32 + (F)].add(heapStatsFreeStart, freeEnd, heapStatsBlockStart, blockEnd); }
+
+
+/*********************************************************************************************\
+ * Statistics per web page (route), see runWebRoute()
+\*********************************************************************************************/
+#define WEB_ROUTE_ROOT         0
+#define WEB_ROUTE_CONFIG       1
+#define WEB_ROUTE_CONTROLLERS  2
+#define WEB_ROUTE_DEVICES      3
+#define WEB_ROUTE_JSON         4
+#define WEB_ROUTE_LOG_JSON     5
+#define WEB_ROUTE_CONTROL      6
+#define WEB_ROUTE_SYSINFO      7
+#define WEB_ROUTE_FILE         8  // Files and custom pages, served by handleNotFound()
+#define WEB_ROUTE_METRICS      9
+#define WEB_ROUTE_COUNT       10
+
+struct webRouteStatsStruct
+{
+  webRouteStatsStruct() : bytesSent(0), chunks(0), blockedTotal(0), blockedMax(0),
+    minFreeHeap(0xFFFFFFFF), maxHeapUse(0), heapUseEstimate(0), rejected(0) {}
+
+  bool isEmpty() const {
+    return render.isEmpty() && rejected == 0;
+  }
+
+  TimingStats render;         // Time spent in the handler
+  unsigned long bytesSent;    // Total over all calls
+  unsigned long chunks;       // Total over all calls
+  unsigned long blockedTotal; // msec waiting for the client in sendContentBlocking()
+  unsigned long blockedMax;
+  uint32_t minFreeHeap;       // Lowest free heap seen while rendering
+  uint32_t maxHeapUse;        // Largest drop in free heap during a call
+  uint32_t heapUseEstimate;   // Running average of the drop in free heap
+  unsigned long rejected;     // Not served due to low memory, see webRouteAdmitted()
+} WebRouteStats[WEB_ROUTE_COUNT];
+
+// Steps of setup(), and the milestones after it, see bootProfileStep()
+#define BOOT_STEP_SERIAL       0
+#define BOOT_STEP_RTC          1
+#define BOOT_STEP_SPIFFS       2
+#define BOOT_STEP_MD5          3
+#define BOOT_STEP_SETTINGS     4
+#define BOOT_STEP_HARDWARE     5
+#define BOOT_STEP_PLUGINS      6
+#define BOOT_STEP_CONTROLLERS  7
+#define BOOT_STEP_WAKE         8
+#define BOOT_STEP_NETWORK      9
+#define BOOT_STEP_NTP         10
+#define BOOT_STEP_BOOT        11   // End of setup()
+#define BOOT_STEP_WIFI        12   // WiFi connected, with IP
+#define BOOT_STEP_TIME        13   // Time set
+#define BOOT_STEP_SEND        14   // First send to a controller
+#define BOOT_STEPS            15
+#define BOOT_PROFILE_SLOW_INIT 50  // msec, task inits to report in the log
+
+unsigned long bootProfile[BOOT_STEPS];  // micros() at the end of the step, 0 = not done (yet)
+unsigned long taskInitDuration[TASKS_MAX]; // usec
+
+// The profile of this boot, the next boot shows it as the last one. See ESPEasyStatistics.ino
+struct RTC_BootProfileStruct
+{
+  uint16_t msec[BOOT_STEPS];   // bootProfile[] in msec, 0xFFFF when later
+  uint16_t unused;
+} RTC_BootProfile, lastBootProfile;
+bool lastBootProfileValid = false;
+
+String getWebRouteName(byte route) {
+    switch (route) {
+        case WEB_ROUTE_ROOT:        return F("/");
+        case WEB_ROUTE_CONFIG:      return F("/config");
+        case WEB_ROUTE_CONTROLLERS: return F("/controllers");
+        case WEB_ROUTE_DEVICES:     return F("/devices");
+        case WEB_ROUTE_JSON:        return F("/json");
+        case WEB_ROUTE_LOG_JSON:    return F("/logjson");
+        case WEB_ROUTE_CONTROL:     return F("/control");
+        case WEB_ROUTE_SYSINFO:     return F("/sysinfo");
+        case WEB_ROUTE_FILE:        return F("files");
+        case WEB_ROUTE_METRICS:     return F("/metrics");
+    }
+    return getWebString(WEB_STR_UNKNOWN);
+}
+
+String getCPluginFunctionName(int function) {
+    switch (function) {
+        case CPLUGIN_PROTOCOL_SEND: return F("PROTOCOL_SEND");
+        case CPLUGIN_INIT:          return F("INIT");
+        case CPLUGIN_UDP_IN:        return F("UDP_IN");
+        case CPLUGIN_TIMER_IN:      return F("TIMER_IN");
+    }
+    return String(function);
+}
+
+String getControllerStatsName(int stat) {
+    switch (stat) {
+        case CONTROLLER_CONNECT_STATS: return F("Connect");
+        case CONTROLLER_SEND_STATS:    return F("Send   ");
+        case CONTROLLER_REPLY_STATS:   return F("Reply  ");
+    }
+    return getWebString(WEB_STR_UNKNOWN);
+}
 
 String getMiscStatsName(int stat) {
     switch (stat) {
@@ -1628,8 +3536,16 @@ String getMiscStatsName(int stat) {
         case PROC_SYS_TIMER:        return F("proc_system_timer() ");
         case SET_NEW_TIMER:         return F("setNewTimerAt()     ");
         case TIME_DIFF_COMPUTE:     return F("timeDiff()          ");
+        case EVENT_STRING_ALLOCS:   return F("EventStruct String  ");
+        case WEB_TX_WAIT_STATS:     return F("Web TX wait         ");
+        case SAVEFILE_STATS:        return F("Save File");
+        case ADD_LOG_STATS:         return F("addToLog()          ");
+        case ADD_LOG_FMT_STATS:     return F("addToLogFmt()       ");
+        case PARSE_TEMPLATE_STATS:  return F("parseTemplate()     ");
+        case PLUGIN_CALL_INTERRUPT: return F("Plugin interrupt ev ");
+        case OLED_FRAME_STATS:      return F("OLED frame          ");
     }
-    return F("Unknown");
+    return getWebString(WEB_STR_UNKNOWN);
 }
 
 // These wifi event functions must be in a .h-file because otherwise the preprocessor
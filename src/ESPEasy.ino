@@ -87,9 +87,16 @@
 // Blynk_get prototype
 boolean Blynk_get(const String& command, byte controllerIndex,float *data = NULL );
 
+// Persistent HTTP controller connections, the reply body only when asked for
+bool sendControllerHttpRequest(byte controllerIndex, ControllerSettingsStruct& ControllerSettings,
+                               const String& request, String& statusLine, String* body = NULL);
+bool readHttpResponse(WiFiClient& client, String& statusLine, String* body = NULL);
+bool skipHttpBytes(WiFiClient& client, long count, String* body = NULL);
+bool skipHttpChunkedBody(WiFiClient& client, String* body = NULL);
+
 int firstEnabledBlynkController() {
   for (byte i = 0; i < CONTROLLER_MAX; ++i) {
-    byte ProtocolIndex = getProtocolIndex(Settings.Protocol[i]);
+    byte ProtocolIndex = getProtocolIndex_from_ControllerIndex(i);
     if (Protocol[ProtocolIndex].Number == 12 && Settings.ControllerEnabled[i]) {
       return i;
     }
@@ -108,9 +115,6 @@ void setup()
   WiFi.setAutoReconnect(false);
   setWifiMode(WIFI_OFF);
 
-  Plugin_id.resize(PLUGIN_MAX);
-  Task_id_to_Plugin_id.resize(TASKS_MAX);
-
   checkRAM(F("setup"));
   #if defined(ESP32)
     for(byte x = 0; x < 16; x++)
@@ -123,6 +127,7 @@ void setup()
   // Serial.print("\n\n\nBOOOTTT\n\n\n");
 
   initLog();
+  bootProfileStep(BOOT_STEP_SERIAL);
 
 #if defined(ESP32)
   WiFi.onEvent(WiFiEvent);
@@ -154,15 +159,20 @@ void setup()
 
 
   //warm boot
+  bool wokeWithoutRF = false;
   if (readFromRTC())
   {
     RTC.bootCounter++;
     readUserVarFromRTC();
+    readEnergyFromRTC();
+    readBootProfileFromRTC();
 
-    if (RTC.deepSleepState == 1)
+    if (RTC.deepSleepState != 0)
     {
+      wokeWithoutRF = RTC.deepSleepState == DEEP_SLEEP_STATE_NO_RF;
       log = F("INIT : Rebooted from deepsleep #");
       lastBootCause=BOOT_CAUSE_DEEP_SLEEP;
+      wifiFastConnect = readWiFiFromRTC();
     }
     else
       log = F("INIT : Warm boot #");
@@ -187,9 +197,12 @@ void setup()
   saveToRTC();
 
   addLog(LOG_LEVEL_INFO, log);
+  bootProfileStep(BOOT_STEP_RTC);
 
   fileSystemCheck();
+  bootProfileStep(BOOT_STEP_SPIFFS);
   progMemMD5check();
+  bootProfileStep(BOOT_STEP_MD5);
   LoadSettings();
 
 //  setWifiMode(WIFI_STA);
@@ -219,6 +232,8 @@ void setup()
 
   if (Settings.Build != BUILD)
     BuildFixes();
+  sleepWakeBoot(wokeWithoutRF);
+  bootProfileStep(BOOT_STEP_SETTINGS);
 
 
   log = F("INIT : Free RAM:");
@@ -230,13 +245,17 @@ void setup()
 
   checkRAM(F("hardwareInit"));
   hardwareInit();
+  bootProfileStep(BOOT_STEP_HARDWARE);
 
   timermqtt_interval = 250; // Interval for checking MQTT
   timerAwakeFromDeepSleep = millis();
 
   PluginInit();
+  bootProfileStep(BOOT_STEP_PLUGINS);
   CPluginInit();
+  initControllerBacklog();
   NPluginInit();
+  bootProfileStep(BOOT_STEP_CONTROLLERS);
   log = F("INFO : Plugins: ");
   log += deviceCount + 1;
   log += getPluginDescriptionString();
@@ -254,36 +273,44 @@ void setup()
     String event = F("System#Wake");
     rulesProcessing(event);
   }
+  bootProfileStep(BOOT_STEP_WAKE);
 
-  if (!selectValidWiFiSettings()) {
-    wifiSetup = true;
-  }
-/*
-  // FIXME TD-er:
-  // Async scanning for wifi doesn't work yet like it should.
-  // So no selection of strongest network yet.
-  if (selectValidWiFiSettings()) {
-    WifiScanAsync();
-  }
-*/
-  WiFiConnectRelaxed();
+  // No network in a deep sleep wake without RF, see SleepWake.ino
+  if (!sleepWakeWithoutRF()) {
+    if (!selectValidWiFiSettings()) {
+      wifiSetup = true;
+    }
+  /*
+    // FIXME TD-er:
+    // Async scanning for wifi doesn't work yet like it should.
+    // So no selection of strongest network yet.
+    if (selectValidWiFiSettings()) {
+      WifiScanAsync();
+    }
+  */
+    WiFiConnectRelaxed();
+    setWiFiSleepMode();
 
-  #ifdef FEATURE_REPORTING
-  ReportStatus();
-  #endif
+    #ifdef FEATURE_REPORTING
+    ReportStatus();
+    #endif
 
-  #ifdef FEATURE_ARDUINO_OTA
-  ArduinoOTAInit();
-  #endif
+    #ifdef FEATURE_ARDUINO_OTA
+    ArduinoOTAInit();
+    #endif
 
-  // setup UDP
-  if (Settings.UDPPort != 0)
-    portUDP.begin(Settings.UDPPort);
+    // setup UDP
+    if (Settings.UDPPort != 0)
+      portUDP.begin(Settings.UDPPort);
 
-  sendSysInfoUDP(3);
+    sendSysInfoUDP(3);
 
-  if (Settings.UseNTP)
-    initTime();
+    bootProfileStep(BOOT_STEP_NETWORK);
+
+    if (Settings.UseNTP)
+      initTime();
+  }
+  bootProfileStep(BOOT_STEP_NTP);
 
 #if FEATURE_ADC_VCC
   vcc = ESP.getVcc() / 1000.0;
@@ -296,16 +323,30 @@ void setup()
   }
 
   writeDefaultCSS();
+  bootProfileStep(BOOT_STEP_BOOT);
 
   UseRTOSMultitasking = Settings.UseRTOSMultitasking;
   #ifdef USE_RTOS_MULTITASKING
     if(UseRTOSMultitasking){
       log = F("RTOS : Launching tasks");
       addLog(LOG_LEVEL_INFO, log);
-      xTaskCreatePinnedToCore(RTOS_TaskServers, "RTOS_TaskServers", 8192, NULL, 1, NULL, 1);
-      xTaskCreatePinnedToCore(RTOS_TaskSerial, "RTOS_TaskSerial", 8192, NULL, 1, NULL, 1);
-      xTaskCreatePinnedToCore(RTOS_Task10ps, "RTOS_Task10ps", 8192, NULL, 1, NULL, 1);
+      rtosStateMutex = xSemaphoreCreateRecursiveMutex();
+      // Network on core 0 (PRO_CPU) with the WiFi stack, plugins on core 1 (APP_CPU) with the loop task.
+      xTaskCreatePinnedToCore(RTOS_TaskServers, "RTOS_TaskServers", 8192, NULL, 1, &rtosTaskStats[RTOS_TASK_SERVERS].handle, 0);
+      xTaskCreatePinnedToCore(RTOS_TaskSerial, "RTOS_TaskSerial", 8192, NULL, 1, &rtosTaskStats[RTOS_TASK_SERIAL].handle, 0);
+      xTaskCreatePinnedToCore(RTOS_Task10ps, "RTOS_Task10ps", 8192, NULL, 1, &rtosTaskStats[RTOS_TASK_10PS].handle, 1);
+      xTaskCreatePinnedToCore(RTOS_TaskRules, "RTOS_TaskRules", 8192, NULL, 1, &rtosTaskStats[RTOS_TASK_RULES].handle, 1);
+      for (uint32_t x = 0; x < CONTROLLER_MAX; ++x)
+        xTaskCreatePinnedToCore(RTOS_TaskController, "RTOS_TaskController", 8192, reinterpret_cast<void*>(x), 1, &rtosTaskStats[RTOS_TASK_CONTROLLER + x].handle, 1);
+      if (Settings.Pin_i2c_sda != -1)
+        I2C_startWorker();
     }
+    rtosTaskStats[RTOS_TASK_LOOP].handle = xTaskGetCurrentTaskHandle();
+    rtosTaskStats[RTOS_TASK_LOOP].core = xPortGetCoreID();
+    rtosTaskStatsStart = micros();
+  #endif
+  #if defined(ESP32)
+    initCoreLoadStats();
   #endif
 
 //  #ifndef ESP32
@@ -321,41 +362,95 @@ void setup()
   setIntervalTimerOverride(TIMER_30SEC,   1333); // timer for watchdog once per 30 sec
   setIntervalTimerOverride(TIMER_MQTT,    88); // timer for interaction with MQTT
   setIntervalTimerOverride(TIMER_STATISTICS, 2222);
+  logBootProfile();
 }
 
 #ifdef USE_RTOS_MULTITASKING
+#define RTOS_SERIAL_POLL_MSEC   10  // The UART driver has no receive callback here, see SerialRx.ino
+
+// Web server and UDP. Blocks for a single tick when idle, so a request is
+// picked up within 1 msec while the idle task of core 0 still gets to run.
 void RTOS_TaskServers( void * parameter )
 {
  while (true){
-  delay(100);
+  ulTaskNotifyTake(pdTRUE, 1);
+  RTOSStateLock stateLock;
+  const unsigned long start = micros();
   WebServer.handleClient();
+  processWebResponses();
   checkUDP();
+  addRTOSTaskBusyTime(RTOS_TASK_SERVERS, start);
  }
 }
 
 void RTOS_TaskSerial( void * parameter )
 {
  while (true){
-    delay(100);
-    if (Settings.UseSerial)
-    if (Serial.available())
-      if (!PluginCall(PLUGIN_SERIAL_IN, 0, dummyString))
-        serial();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RTOS_SERIAL_POLL_MSEC));
+    if (!Settings.UseSerial || (!serialRxPending() && !serialConsolePending())) continue;
+    RTOSStateLock stateLock;
+    const unsigned long start = micros();
+    serialRxProcess();
+    if (serialRxAvailable() > 0 && !PluginCall(PLUGIN_SERIAL_IN, 0, dummyString))
+      serial();
+    processSerialConsole();
+    addRTOSTaskBusyTime(RTOS_TASK_SERIAL, start);
  }
 }
 
+// Runs run10TimesPerSecond() at a fixed 100 msec rate. A notification
+// (see notifyEventBuffer) wakes it in between to process queued rules events.
 void RTOS_Task10ps( void * parameter )
 {
+ const TickType_t period = pdMS_TO_TICKS(100);
+ TickType_t nextRun = xTaskGetTickCount() + period;
  while (true){
-    delay(100);
-    run10TimesPerSecond();
+    const TickType_t now = xTaskGetTickCount();
+    const int32_t ticksLeft = static_cast<int32_t>(nextRun - now);
+    if (ticksLeft > 0)
+      ulTaskNotifyTake(pdTRUE, ticksLeft);
+    RTOSStateLock stateLock;
+    const unsigned long start = micros();
+    if (static_cast<int32_t>(xTaskGetTickCount() - nextRun) >= 0) {
+      run10TimesPerSecond();
+      nextRun += period;
+      if (static_cast<int32_t>(xTaskGetTickCount() - nextRun) >= 0)
+        nextRun = xTaskGetTickCount() + period; // Fell behind, do not try to catch up
+    } else {
+      processEventBuffer();
+    }
+    addRTOSTaskBusyTime(RTOS_TASK_10PS, start);
+ }
+}
+
+// Processes the queued rules events, one event per lock so the loop task
+// and the other tasks can run in between.
+void RTOS_TaskRules( void * parameter )
+{
+ while (true){
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    bool more = true;
+    while (more) {
+      RTOSStateLock stateLock;
+      const unsigned long start = micros();
+      more = processRulesQueue();
+      addRTOSTaskBusyTime(RTOS_TASK_RULES, start);
+    }
  }
 }
 #endif
 
+// Wake the task processing eventBuffer, instead of waiting for the next 100 msec run.
+void notifyEventBuffer() {
+  #ifdef USE_RTOS_MULTITASKING
+  if (UseRTOSMultitasking && rtosTaskStats[RTOS_TASK_10PS].handle != NULL)
+    xTaskNotifyGive(rtosTaskStats[RTOS_TASK_10PS].handle);
+  #endif
+}
+
 int firstEnabledMQTTController() {
   for (byte i = 0; i < CONTROLLER_MAX; ++i) {
-    byte ProtocolIndex = getProtocolIndex(Settings.Protocol[i]);
+    byte ProtocolIndex = getProtocolIndex_from_ControllerIndex(i);
     if (Protocol[ProtocolIndex].usesMQTT && Settings.ControllerEnabled[i]) {
       return i;
     }
@@ -366,7 +461,7 @@ int firstEnabledMQTTController() {
 bool getControllerProtocolDisplayName(byte ProtocolIndex, byte parameterIdx, String& protoDisplayName) {
   EventStruct tmpEvent;
   tmpEvent.idx=parameterIdx;
-  return CPlugin_ptr[ProtocolIndex](CPLUGIN_GET_PROTOCOL_DISPLAY_NAME, &tmpEvent, protoDisplayName);
+  return getCPluginFunction(ProtocolIndex)(CPLUGIN_GET_PROTOCOL_DISPLAY_NAME, &tmpEvent, protoDisplayName);
 }
 
 void updateLoopStats() {
@@ -381,6 +476,9 @@ void updateLoopStats() {
   lastLoopStart = micros();
   if (usecSince <= 0 || usecSince > 10000000)
     return; // No loop should take > 10 sec.
+#ifdef FEATURE_TRACE
+  checkTraceFreeze(usecSince);
+#endif
   if (shortestLoop > static_cast<unsigned long>(usecSince)) {
     shortestLoop = usecSince;
     loopCounterMax = 30 * 1000000 / usecSince;
@@ -396,6 +494,13 @@ void updateLoopStats_30sec(byte loglevel) {
     loopCounterMax = loopCounterLast;
 
   msecTimerHandler.updateIdleTimeStats();
+  I2C_updateStats();
+#ifdef USE_RTOS_MULTITASKING
+  updateRTOSTaskStats();
+#endif
+#if defined(ESP32)
+  updateCoreLoadStats();
+#endif
 
   if (loglevelActiveFor(loglevel)) {
     String log = F("LoopStats: shortestLoop: ");
@@ -410,6 +515,8 @@ void updateLoopStats_30sec(byte loglevel) {
     log += loopCounterLast;
     log += F(" countFindPluginId: ");
     log += countFindPluginId;
+    log += F(" sleep%: ");
+    log += getSleepTimePct();
     addLog(loglevel, log);
   }
   countFindPluginId = 0;
@@ -421,6 +528,45 @@ float getCPUload() {
   return 100.0 - msecTimerHandler.getIdleTimePct();
 }
 
+float getSleepTimePct() {
+  return msecTimerHandler.getSleepTimePct();
+}
+
+/*********************************************************************************************\
+ * Eco power mode: sleep until the next scheduled timer is due.
+ * ESP8266: delay() allows the WiFi modem (and light) sleep to kick in,
+ * ESP32: a wait for a task notification, so other tasks can run and an
+ *        interrupt event (pushInterruptEvent) ends the sleep right away.
+ * Interrupts and the network stack remain active, and the max. sleep time
+ * is limited by IDLE_SLEEP_MAX_MSEC to keep web, UDP and GPIO handling responsive.
+\*********************************************************************************************/
+void idleSleep() {
+  if (!Settings.EcoPowerMode || isDeepSleepEnabled()) return;
+  // Do not delay (re)connecting WiFi
+  if (wifiStatus != ESPEASY_WIFI_SERVICES_INITIALIZED && !scheduledRadioOff()) return;
+  #ifdef FEATURE_ARDUINO_OTA
+  if (ArduinoOTAtriggered) return;
+  #endif
+  const unsigned long sleep_msec = msecTimerHandler.msecUntilNextDue(IDLE_SLEEP_MAX_MSEC);
+  if (sleep_msec == 0 || interruptEventPending()) return;
+  const unsigned long start = micros();
+  #ifdef USE_RTOS_MULTITASKING
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sleep_msec));
+  #else
+  delay(sleep_msec);
+  #endif
+  msecTimerHandler.recordSleep(usecPassedSince(start));
+}
+
+void setWiFiSleepMode() {
+  #if defined(ESP8266)
+  WiFi.setSleepMode(Settings.EcoPowerMode ? WIFI_LIGHT_SLEEP : WIFI_MODEM_SLEEP);
+  #endif
+  #if defined(ESP32)
+  WiFi.setSleep(Settings.EcoPowerMode);
+  #endif
+}
+
 int getLoopCountPerSec() {
   return loopCounterLast / 30;
 }
@@ -433,6 +579,9 @@ int getLoopCountPerSec() {
 \*********************************************************************************************/
 void loop()
 {
+  #ifdef USE_RTOS_MULTITASKING
+  RTOSStateLock stateLock;
+  #endif
   if(MainLoopCall_ptr)
       MainLoopCall_ptr();
 
@@ -461,6 +610,7 @@ void loop()
   bool firstLoopWiFiConnected = wifiStatus == ESPEASY_WIFI_SERVICES_INITIALIZED && firstLoop;
   if (firstLoopWiFiConnected) {
      firstLoop = false;
+     sleepWakeConnected();
      timerAwakeFromDeepSleep = millis(); // Allow to run for "awake" number of seconds, now we have wifi.
    }
 
@@ -481,12 +631,22 @@ void loop()
   }
 
   backgroundtasks();
+  #ifdef USE_RTOS_MULTITASKING
+  // Let the network and 10 per second task take the state, also when not sleeping.
+  stateLock.unlock();
+  #endif
+  idleSleep();
+  #ifdef USE_RTOS_MULTITASKING
+  yield();
+  stateLock.lock();
+  #endif
 
   if (readyForSleep()){
     if (Settings.UseRules)
     {
       String event = F("System#Sleep");
       rulesProcessing(event);
+      flushRulesQueue();
     }
     // Flush outstanding MQTT messages
     runPeriodicalMQTT();
@@ -523,7 +683,7 @@ void runPeriodicalMQTT() {
 void updateMQTTclient_connected() {
   if (MQTTclient_connected != MQTTclient.connected()) {
     MQTTclient_connected = !MQTTclient_connected;
-    if (!MQTTclient_connected)
+    if (!MQTTclient_connected && !scheduledRadioOff())
       addLog(LOG_LEVEL_ERROR, F("MQTT : Connection lost"));
     if (Settings.UseRules) {
       String event = MQTTclient_connected ? F("MQTT#Connected") : F("MQTT#Disconnected");
@@ -546,15 +706,20 @@ void updateMQTTclient_connected() {
 \*********************************************************************************************/
 
 void run50TimesPerSecond() {
+  if (run50TimesPerSecondRunning) return;
+  run50TimesPerSecondRunning = true;
+  lastRun50TimesPerSecond = millis();
   START_TIMER;
   PluginCall(PLUGIN_FIFTY_PER_SECOND, 0, dummyString);
   STOP_TIMER(PLUGIN_CALL_50PS);
+  run50TimesPerSecondRunning = false;
 }
 
 /*********************************************************************************************\
  * Tasks that run 10 times per second
 \*********************************************************************************************/
 void run10TimesPerSecond() {
+  I2C_scanStep();
   {
     START_TIMER;
     PluginCall(PLUGIN_TEN_PER_SECOND, 0, dummyString);
@@ -565,14 +730,19 @@ void run10TimesPerSecond() {
     PluginCall(PLUGIN_UNCONDITIONAL_POLL, 0, dummyString);
     STOP_TIMER(PLUGIN_CALL_10PSU);
   }
+  processEventBuffer();
+  #ifndef USE_RTOS_MULTITASKING
+    WebServer.handleClient();
+  #endif
+}
+
+// Rules event queued by a web request or MQTT command.
+void processEventBuffer() {
   if (Settings.UseRules && eventBuffer.length() > 0)
   {
     rulesProcessing(eventBuffer);
     eventBuffer = "";
   }
-  #ifndef USE_RTOS_MULTITASKING
-    WebServer.handleClient();
-  #endif
 }
 
 
@@ -583,6 +753,13 @@ void runOncePerSecond()
 {
   START_TIMER;
   updateLogLevelCache();
+  closeIdleCachedReadFile();
+  processValueLogger();
+  processBackgroundWiFiScan();
+  processScheduledRadio();
+  processWebOptionsCache();
+  processJsonTaskCache();
+  processHeapTrend();
   dailyResetCounter++;
   if (dailyResetCounter > 86400) // 1 day elapsed... //86400
   {
@@ -597,6 +774,17 @@ void runOncePerSecond()
     if (connectionFailures > Settings.ConnectionFailuresThreshold)
       delayedReboot(60);
 
+  if (stallEventMsec != 0)
+  {
+    String event = F("System#Stall=");
+    event += stallEventMsec;
+    stallEventMsec = 0;
+    // A slow System#Stall rule must not trigger the next event.
+    stallEventRunning = true;
+    rulesProcessing(event);
+    stallEventRunning = false;
+  }
+
   if (cmd_within_mainloop != 0)
   {
     switch (cmd_within_mainloop)
@@ -621,18 +809,10 @@ void runOncePerSecond()
   }
   WifiCheck();
 
-  // clock events
-  if (Settings.UseNTP)
-    checkTime();
-
 //  unsigned long start = micros();
   PluginCall(PLUGIN_ONCE_A_SECOND, 0, dummyString);
 //  unsigned long elapsed = micros() - start;
 
-  if (Settings.UseRules)
-    rulesTimers();
-
-
   if (SecuritySettings.Password[0] != 0)
   {
     if (WebLoggedIn)
@@ -644,9 +824,7 @@ void runOncePerSecond()
   // I2C Watchdog feed
   if (Settings.WDI2CAddress != 0)
   {
-    Wire.beginTransmission(Settings.WDI2CAddress);
-    Wire.write(0xA5);
-    Wire.endTransmission();
+    I2C_write8(Settings.WDI2CAddress, 0xA5);
   }
 
 /*
@@ -673,11 +851,31 @@ void runOncePerSecond()
 void logTimerStatistics() {
   byte loglevel = LOG_LEVEL_DEBUG;
   updateLoopStats_30sec(loglevel);
+  checkTimingBaseline();
   logStatistics(loglevel, true);
   if (loglevelActiveFor(loglevel)) {
     String queueLog = F("Scheduler stats: (called/tasks/max_length/idle%) ");
     queueLog += msecTimerHandler.getQueueStats();
     addLog(loglevel, queueLog);
+    queueLog = F("System timer pool: (in use/high water/size/overflow) ");
+    queueLog += getSystemTimerPoolStats();
+    addLog(loglevel, queueLog);
+    for (byte x = 0; x < CONTROLLER_MAX; x++) {
+      if (Settings.ControllerEnabled[x] && Settings.Protocol[x]) {
+        queueLog = F("Controller ");
+        queueLog += x + 1;
+        queueLog += F(" queue: (queued/max/dropped/sent/avg latency/max latency/on file) ");
+        queueLog += getControllerQueueStats(x);
+        addLog(loglevel, queueLog);
+      }
+      if (ControllerConnections[x].connects != 0) {
+        queueLog = F("Controller ");
+        queueLog += x + 1;
+        queueLog += F(" HTTP: (requests/connects/reused %/failed/avg latency/max latency) ");
+        queueLog += getControllerConnectionStats(x);
+        addLog(loglevel, queueLog);
+      }
+    }
   }
 }
 
@@ -702,10 +900,10 @@ void runEach30Seconds()
   }
   sendSysInfoUDP(1);
   refreshNodeList();
+  checkRulesCacheMemory();
 
   #if defined(ESP8266)
-  if (Settings.UseSSDP)
-    SSDP_update();
+  SSDP_manage();
   #endif
 #if FEATURE_ADC_VCC
   vcc = ESP.getVcc() / 1000.0;
@@ -741,15 +939,22 @@ void SensorSendTask(byte TaskIndex)
     byte varIndex = TaskIndex * VARS_PER_TASK;
 
     boolean success = false;
-    byte DeviceIndex = getDeviceIndex(Settings.TaskDeviceNumber[TaskIndex]);
+    byte DeviceIndex = getDeviceIndex_from_TaskIndex(TaskIndex);
     LoadTaskSettings(TaskIndex);
 
-    struct EventStruct TempEvent;
+    PooledEvent pooled;
+    struct EventStruct& TempEvent = *pooled.event;
     TempEvent.TaskIndex = TaskIndex;
     TempEvent.BaseVarIndex = varIndex;
     // TempEvent.idx = Settings.TaskDeviceID[TaskIndex]; todo check
     TempEvent.sensorType = Device[DeviceIndex].VType;
 
+    taskTriggerDone(TaskIndex);
+    if (!taskInitReady(TaskIndex))
+      return;  // Init not done yet, or failed, see TaskInit.ino
+    if (taskConversionPending(TaskIndex))
+      return;  // Values of the previous read are not yet collected, see SensorConversion.ino
+
     float preValue[VARS_PER_TASK]; // store values before change, in case we need it in the formula
     for (byte varNr = 0; varNr < VARS_PER_TASK; varNr++)
       preValue[varNr] = UserVar[varIndex + varNr];
@@ -760,28 +965,42 @@ void SensorSendTask(byte TaskIndex)
       success = true;
 
     if (success)
+      SensorSendTaskValues(&TempEvent, preValue);
+    else
+      sleepWakeTaskRead(TaskIndex);
+  }
+}
+
+/*********************************************************************************************\
+ * apply the formulas and send the values read by a task
+\*********************************************************************************************/
+void SensorSendTaskValues(struct EventStruct *event, const float *preValue)
+{
+  const byte TaskIndex = event->TaskIndex;
+  const byte varIndex = event->BaseVarIndex;
+  sleepWakeTaskRead(TaskIndex);
+  START_TIMER;
+  for (byte varNr = 0; varNr < VARS_PER_TASK; varNr++)
+  {
+    if (ExtraTaskSettings.TaskDeviceFormula[varNr][0] != 0)
     {
-      START_TIMER;
-      for (byte varNr = 0; varNr < VARS_PER_TASK; varNr++)
-      {
-        if (ExtraTaskSettings.TaskDeviceFormula[varNr][0] != 0)
-        {
-          String spreValue = String(preValue[varNr]);
-          String formula = ExtraTaskSettings.TaskDeviceFormula[varNr];
-          float value = UserVar[varIndex + varNr];
-          float result = 0;
-          String svalue = String(value);
-          formula.replace(F("%pvalue%"), spreValue);
-          formula.replace(F("%value%"), svalue);
-          byte error = Calculate(formula.c_str(), &result);
-          if (error == 0)
-            UserVar[varIndex + varNr] = result;
-        }
-      }
-      STOP_TIMER(COMPUTE_FORMULA_STATS);
-      sendData(&TempEvent);
+      float result = 0;
+      byte error = calculateTaskFormula(TaskIndex, varNr, UserVar[varIndex + varNr], preValue[varNr], &result);
+      if (error == 0)
+        UserVar[varIndex + varNr] = result;
     }
   }
+  STOP_TIMER(COMPUTE_FORMULA_STATS);
+  // Sample added to the aggregates of the interval (see SensorAggregate.ino),
+  // or no change beyond the deadband (see SensorReport.ino)
+  if (taskAggregateDue(event) && taskReportDue(event)) {
+    // A sample of a task group has the time of the group read, see TaskGroup.ino
+    const unsigned long groupMillis = taskGroupSampleMillis(TaskIndex);
+    if (groupMillis != 0) controllerSampleMillis = groupMillis;
+    sendData(event);
+    if (groupMillis != 0) controllerSampleMillis = 0;
+  }
+  taskGroupDone(TaskIndex, true);
 }
 
 
@@ -806,15 +1025,54 @@ void backgroundtasks()
     tcpCleanup();
   #endif
 
+  processInterruptEvents();
+  processI2CQueue();
+  processAdcSampling();
+  #ifdef USES_NEOPIXEL_OUTPUT
+    processNeoPixelOutput();
+  #endif
+  processTonePlayer();
+  processModbusTCP();
+  processModbusRTU();
+  processMeterBus();
+
+  #ifdef USES_P020
+    Plugin_020_process();
+  #endif
+  #ifdef USES_P035
+    Plugin_035_process();
+  #endif
+  #ifdef USES_P054
+    Plugin_054_process();
+  #endif
+  #ifdef USES_P075
+    Plugin_075_process();
+  #endif
+
   if(!UseRTOSMultitasking){
-    if (Settings.UseSerial)
-      if (Serial.available())
+    if (Settings.UseSerial) {
+      serialRxProcess();
+      if (serialRxAvailable() > 0)
         if (!PluginCall(PLUGIN_SERIAL_IN, 0, dummyString))
           serial();
+      processSerialConsole();
+    }
     WebServer.handleClient();
     checkUDP();
   }
 
+  processWebEvents();
+  #if defined(ESP32)
+    processWebResponses();
+  #endif
+  processSyslogQueue();
+  #if defined(ESP8266)
+  SSDP_processQueue();
+  #endif
+  #ifdef USES_C013
+    C013_processESPNowQueue();
+  #endif
+
   // process DNS, only used if the ESP has no valid WiFi config
   if (dnsServerActive)
     dnsServer.processNextRequest();
@@ -6,7 +6,7 @@ void logStatistics(byte loglevel, bool clearLog) {
         if (!x.second.isEmpty()) {
             const int pluginId = x.first/32;
             String P_name = "";
-            Plugin_ptr[pluginId](PLUGIN_GET_DEVICENAME, NULL, P_name);
+            getPluginFunction(pluginId)(PLUGIN_GET_DEVICENAME, NULL, P_name);
             log = F("PluginStats P_");
             log += pluginId + 1;
             log += '_';
@@ -19,6 +19,28 @@ void logStatistics(byte loglevel, bool clearLog) {
             if (clearLog) x.second.reset();
         }
     }
+    for (byte x = 0; x < CONTROLLER_MAX; x++) {
+        controllerStatsStruct& stats = ControllerStats[x];
+        if (stats.isEmpty()) continue;
+        String prefix = F("ControllerStats ");
+        prefix += getControllerStatsLabel(x);
+        prefix += ' ';
+        for (byte i = 0; i < CONTROLLER_STATS_COUNT; ++i) {
+            if (stats.stats[i].isEmpty()) continue;
+            log = prefix;
+            log += getControllerStatsName(i);
+            log += ' ';
+            log += getLogLine(stats.stats[i]);
+            addLog(loglevel, log);
+        }
+        log = prefix;
+        log += F("failures: ");
+        log += stats.failures;
+        log += F(" bytes sent: ");
+        log += stats.bytesSent;
+        addLog(loglevel, log);
+        if (clearLog) stats.reset();
+    }
     for (auto& x: miscStats) {
         if (!x.second.isEmpty()) {
             log = getMiscStatsName(x.first);
@@ -28,6 +50,59 @@ void logStatistics(byte loglevel, bool clearLog) {
             if (clearLog) x.second.reset();
         }
     }
+    log = F("ExtraTaskSettings cache: hits: ");
+    log += ExtraTaskSettingsCache.hits;
+    log += F(" misses: ");
+    log += ExtraTaskSettingsCache.misses;
+    addLog(loglevel, log);
+    if (clearLog) {
+      ExtraTaskSettingsCache.hits = 0;
+      ExtraTaskSettingsCache.misses = 0;
+    }
+    log = F("Rules cache: bytes: ");
+    log += getCompiledRuleSetsBytes();
+    log += '/';
+    log += RULES_CACHE_MAX_BYTES;
+    log += F(" hits: ");
+    log += rulesCacheHits;
+    log += F(" misses: ");
+    log += rulesCacheMisses;
+    if (rulesCacheHits + rulesCacheMisses > 0) {
+      log += F(" hit rate: ");
+      log += (100 * rulesCacheHits) / (rulesCacheHits + rulesCacheMisses);
+      log += '%';
+    }
+    addLog(loglevel, log);
+    if (clearLog) {
+      rulesCacheHits = 0;
+      rulesCacheMisses = 0;
+    }
+    if (Settings.Syslog_IP[0] != 0) {
+      log = F("Syslog: sent: ");
+      log += syslogSent;
+      log += F(" dropped: ");
+      log += syslogDropped;
+      addLog(loglevel, log);
+      if (clearLog) {
+        syslogSent = 0;
+        syslogDropped = 0;
+      }
+    }
+#ifdef USE_RTOS_MULTITASKING
+    for (byte i = 0; i < RTOS_TASK_COUNT; ++i) {
+      if (rtosTaskStats[i].handle == NULL) continue;
+      log = F("RTOS task ");
+      log += getRTOSTaskName(i);
+      log += F(": core: ");
+      log += rtosTaskStats[i].core;
+      log += F(" load: ");
+      log += rtosTaskStats[i].load;
+      log += F("% stack free: ");
+      log += getRTOSTaskStackFree(i);
+      log += getWebString(WEB_STR_BYTES);
+      addLog(loglevel, log);
+    }
+#endif
     log = getMiscStatsName(TIME_DIFF_COMPUTE);
     log += F(" stats: Count: ");
     log += timediff_calls;
@@ -38,5 +113,319 @@ void logStatistics(byte loglevel, bool clearLog) {
       timediff_calls = 0;
       timediff_cpu_cycles_total = 0;
     }
+    log = getMiscStatsName(EVENT_STRING_ALLOCS);
+    log += F(" stats: Count: ");
+    log += eventstruct_string_allocs;
+    log += F(" - per second: ");
+    log += getEventStringAllocsPerSecond();
+    addLog(loglevel, log);
+    if (clearLog) {
+      eventstruct_string_allocs = 0;
+      eventstruct_string_allocs_start = millis();
+    }
+  }
+}
+
+// Clear all timing statistics, e.g. to measure the jitter of a plugin over a fixed period.
+void resetTimingStats() {
+  for (auto& x: pluginStats)
+    x.second.reset();
+  for (auto& x: miscStats)
+    x.second.reset();
+  for (byte x = 0; x < CONTROLLER_MAX; x++)
+    ControllerStats[x].reset();
+  for (byte x = 0; x < WEB_ROUTE_COUNT; x++)
+    WebRouteStats[x].render.reset();
+  taskHeapStats.clear();
+  controllerHeapStats.clear();
+  stallStats.clear();
+}
+
+// Like "C_1_ThingSpeak"
+String getControllerStatsLabel(byte controllerIndex) {
+  String label = F("C_");
+  label += controllerIndex + 1;
+  label += '_';
+  if (Settings.Protocol[controllerIndex] != 0) {
+    String C_name;
+    getCPluginFunction(getProtocolIndex_from_ControllerIndex(controllerIndex))(CPLUGIN_GET_DEVICENAME, NULL, C_name);
+    label += C_name;
+  }
+  return label;
+}
+
+// Like "P_4 PLUGIN_READ", as shown in the trace and the stall log
+String getDispatchName(byte category, byte id, byte arg) {
+  String name;
+  switch (category) {
+    case DISPATCH_SCHEDULER:
+      name = getSchedulerTimerName(id, arg);
+      break;
+    case DISPATCH_PLUGIN:
+      name = F("P_");
+      name += getPluginNumber(arg);
+      name += ' ';
+      name += getPluginFunctionName(id);
+      name.trim();
+      break;
+    case DISPATCH_CONTROLLER:
+      name = getControllerStatsLabel(arg);
+      name += ' ';
+      name += getControllerStatsName(id);
+      name.trim();
+      break;
+    case DISPATCH_WEB:
+      name = getWebRouteName(id);
+      break;
+    case DISPATCH_RULES:
+      name = F("Rules event");
+      break;
+  }
+  return name;
+}
+
+// Called at the end of a dispatch when Settings.StallBudget is set, see DISPATCH_END.
+// Logs and counts the dispatches above the budget, those are the ones blocking the loop.
+void checkStall(byte category, byte id, byte arg, unsigned long start) {
+  const long usec = usecPassedSince(start);
+  if (usec < static_cast<long>(Settings.StallBudget) * 1000) return;
+  if (category == DISPATCH_SCHEDULER) {
+    if (stallReportedInTimer) return;
+  } else {
+    stallReportedInTimer = true;
+  }
+  stallStatsStruct& stats = stallStats[(static_cast<uint32_t>(category) << 16) | (static_cast<uint32_t>(arg) << 8) | id];
+  ++stats.count;
+  if (static_cast<unsigned long>(usec) > stats.maxUsec) stats.maxUsec = usec;
+  if (loglevelActiveFor(LOG_LEVEL_ERROR)) {
+    String log = F("STALL: ");
+    log += getDispatchName(category, id, arg);
+    log += F(" took ");
+    log += usec / 1000;
+    log += F(" msec");
+    if (category != DISPATCH_SCHEDULER && dispatchTimerType != 0) {
+      log += F(" in ");
+      log += getSchedulerTimerName(dispatchTimerType, dispatchTimerId);
+    }
+    if (category != DISPATCH_RULES && rulesNestingLevel != 0)
+      log += F(" from rules");
+    log += F(" count: ");
+    log += stats.count;
+    addLog(LOG_LEVEL_ERROR, log);
   }
+  if (Settings.StallEvent && Settings.UseRules && !stallEventRunning)
+    stallEventMsec = usec / 1000;
+}
+
+float getEventStringAllocsPerSecond() {
+  const long msec = timePassedSince(eventstruct_string_allocs_start);
+  if (msec <= 0) return 0.0;
+  return static_cast<float>(eventstruct_string_allocs) * 1000.0 / static_cast<float>(msec);
+}
+
+/*********************************************************************************************\
+ * Boot profile
+ * bootProfileStep() is called at the end of each step of setup(), and at the milestones
+ * after it: WiFi connected, time set and the first send. The profile is kept in RTC memory
+ * (RTC_REGION_BOOT), so after a reboot or a deep sleep wake the profile of the boot before
+ * is shown as well. At the first send System#BootProfile=<msec> is sent to the rules.
+\*********************************************************************************************/
+String getBootStepName(byte step) {
+  switch (step) {
+    case BOOT_STEP_SERIAL:      return F("Serial");
+    case BOOT_STEP_RTC:         return F("RTC");
+    case BOOT_STEP_SPIFFS:      return F("SPIFFS");
+    case BOOT_STEP_MD5:         return F("MD5");
+    case BOOT_STEP_SETTINGS:    return F("Settings");
+    case BOOT_STEP_HARDWARE:    return F("Hardware");
+    case BOOT_STEP_PLUGINS:     return F("Plugins");
+    case BOOT_STEP_CONTROLLERS: return F("Controllers");
+    case BOOT_STEP_WAKE:        return F("Wake");
+    case BOOT_STEP_NETWORK:     return F("Network");
+    case BOOT_STEP_NTP:         return F("NTP");
+    case BOOT_STEP_BOOT:        return F("Boot");
+    case BOOT_STEP_WIFI:        return F("WiFi connected");
+    case BOOT_STEP_TIME:        return F("Time set");
+    case BOOT_STEP_SEND:        return F("First send");
+  }
+  return getWebString(WEB_STR_UNKNOWN);
+}
+
+// Called by setup() before the profile of this boot is saved.
+void readBootProfileFromRTC() {
+  lastBootProfileValid = readRTCRegion(RTC_REGION_BOOT) && RTC_BootProfile.msec[BOOT_STEP_BOOT] != 0;
+  if (lastBootProfileValid) lastBootProfile = RTC_BootProfile;
+}
+
+void saveBootProfileToRTC() {
+  for (byte step = 0; step < BOOT_STEPS; ++step) {
+    const unsigned long msec = bootProfile[step] / 1000;
+    RTC_BootProfile.msec[step] = bootProfile[step] == 0 ? 0 : (msec < 0xFFFF ? msec : 0xFFFF);
+  }
+  RTC_BootProfile.unused = 0;
+  saveRTCRegion(RTC_REGION_BOOT);
+}
+
+// msec of the step of setup() since the step done before it, or of the milestone since boot.
+// -1 when not done.
+long getBootStepMsec(const uint16_t msec[], byte step) {
+  if (msec[step] == 0) return -1;
+  if (step > BOOT_STEP_BOOT) return msec[step];
+  for (int prev = step - 1; prev >= 0; --prev) {
+    if (msec[prev] != 0) return msec[step] - msec[prev];
+  }
+  return msec[step];
+}
+
+// Record the end of a step of setup() or a milestone, once per boot.
+void bootProfileStep(byte step) {
+  if (step >= BOOT_STEPS || bootProfile[step] != 0) return;
+  bootProfile[step] = micros();
+  if (bootProfile[step] == 0) bootProfile[step] = 1;
+  // The earlier steps are saved at the end of setup(), after the last profile was read from RTC
+  if (step < BOOT_STEP_BOOT) return;
+  saveBootProfileToRTC();
+  if (step == BOOT_STEP_SEND) {
+    logBootProfile();
+    if (Settings.UseRules) {
+      String event = F("System#BootProfile=");
+      event += bootProfile[step] / 1000;
+      rulesProcessing(event);
+    }
+  }
+}
+
+void logBootProfile() {
+  if (!loglevelActiveFor(LOG_LEVEL_INFO)) return;
+  String log;
+  log.reserve(160);
+  log = F("INIT : Boot (msec):");
+  for (byte step = 0; step < BOOT_STEPS; ++step) {
+    const long msec = getBootStepMsec(RTC_BootProfile.msec, step);
+    if (msec < 0) continue;
+    log += ' ';
+    log += getBootStepName(step);
+    log += ' ';
+    log += msec;
+  }
+  addLog(LOG_LEVEL_INFO, log);
+}
+
+// The last boot as: end of setup()/WiFi/time/first send in msec since boot, empty when not known.
+String getLastBootProfileStats() {
+  String result;
+  if (!lastBootProfileValid) return result;
+  for (byte step = BOOT_STEP_BOOT; step < BOOT_STEPS; ++step) {
+    if (step != BOOT_STEP_BOOT) result += '/';
+    if (lastBootProfile.msec[step] == 0) result += '-';
+    else result += lastBootProfile.msec[step];
+  }
+  return result;
+}
+
+// The task inits run after setup(), see TaskInit.ino
+void logSlowTaskInit(byte TaskIndex) {
+  if (taskInitDuration[TaskIndex] / 1000 < BOOT_PROFILE_SLOW_INIT || !loglevelActiveFor(LOG_LEVEL_INFO)) return;
+  String log = F("INIT : Slow init task ");
+  log += TaskIndex + 1;
+  log += F(": ");
+  log += taskInitDuration[TaskIndex] / 1000;
+  log += F(" msec");
+  addLog(LOG_LEVEL_INFO, log);
+}
+
+#ifdef USE_RTOS_MULTITASKING
+String getRTOSTaskName(byte index) {
+  switch (index) {
+    case RTOS_TASK_LOOP:    return F("loopTask");
+    case RTOS_TASK_SERVERS: return F("RTOS_TaskServers");
+    case RTOS_TASK_SERIAL:  return F("RTOS_TaskSerial");
+    case RTOS_TASK_10PS:    return F("RTOS_Task10ps");
+    case RTOS_TASK_RULES:   return F("RTOS_TaskRules");
+  }
+  if (index >= RTOS_TASK_CONTROLLER && index < RTOS_TASK_COUNT) {
+    String name = F("RTOS_TaskController");
+    name += index - RTOS_TASK_CONTROLLER + 1;
+    return name;
+  }
+  return F("unknown");
+}
+
+// Called from the task itself, with the time its work started.
+void addRTOSTaskBusyTime(byte index, unsigned long start) {
+  rtosTaskStats[index].busyUsec += usecPassedSince(start);
+  ++rtosTaskStats[index].runs;
+  rtosTaskStats[index].core = xPortGetCoreID();
+}
+
+// Lowest free stack since the task was started, in bytes.
+unsigned long getRTOSTaskStackFree(byte index) {
+  if (rtosTaskStats[index].handle == NULL) return 0;
+  return uxTaskGetStackHighWaterMark(rtosTaskStats[index].handle);
+}
+
+// Compute the load of each task over the last interval, called every 30 sec.
+void updateRTOSTaskStats() {
+  const long interval = usecPassedSince(rtosTaskStatsStart);
+  if (interval <= 0) return;
+  rtosTaskStatsStart = micros();
+  // The loop task is busy whenever the scheduler is not idle.
+  rtosTaskStats[RTOS_TASK_LOOP].load = getCPUload();
+  rtosTaskStats[RTOS_TASK_LOOP].runsPerSec = getLoopCountPerSec();
+  for (byte i = RTOS_TASK_LOOP + 1; i < RTOS_TASK_COUNT; ++i) {
+    const uint32_t busy = rtosTaskStats[i].busyUsec;
+    const uint32_t runs = rtosTaskStats[i].runs;
+    rtosTaskStats[i].busyUsec = 0;
+    rtosTaskStats[i].runs = 0;
+    rtosTaskStats[i].load = 100.0 * static_cast<float>(busy) / static_cast<float>(interval);
+    rtosTaskStats[i].runsPerSec = 1000000.0 * static_cast<float>(runs) / static_cast<float>(interval);
+  }
+}
+#endif
+
+#if defined(ESP32)
+/*********************************************************************************************\
+ * Core load
+ * The idle hook is called each time the idle task of that core runs before it waits for
+ * the next interrupt (the hook returns true, so the core still sleeps while idle).
+ * A tick counts as idle when the hook ran during it, so the load is the part of the
+ * ticks in which higher priority tasks and interrupts left no room for the idle task.
+\*********************************************************************************************/
+bool coreIdleHook(byte core) {
+  coreLoadStruct& stats = coreLoad[core];
+  const TickType_t now = xTaskGetTickCount();
+  if (now != stats.lastIdleTick) {
+    stats.lastIdleTick = now;
+    ++stats.idleTicks;
+  }
+  return true;
+}
+
+bool coreIdleHook0() { return coreIdleHook(0); }
+bool coreIdleHook1() { return coreIdleHook(1); }
+
+void initCoreLoadStats() {
+  coreLoadStart = xTaskGetTickCount();
+  esp_register_freertos_idle_hook_for_cpu(coreIdleHook0, 0);
+  esp_register_freertos_idle_hook_for_cpu(coreIdleHook1, 1);
+}
+
+// Called every 30 sec.
+void updateCoreLoadStats() {
+  const TickType_t now = xTaskGetTickCount();
+  const uint32_t ticks = now - coreLoadStart;
+  if (ticks == 0) return;
+  coreLoadStart = now;
+  for (byte core = 0; core < portNUM_PROCESSORS; ++core) {
+    uint32_t idle = coreLoad[core].idleTicks;
+    coreLoad[core].idleTicks = 0;
+    if (idle > ticks) idle = ticks;
+    coreLoad[core].load = 100.0 - (100.0 * static_cast<float>(idle) / static_cast<float>(ticks));
+  }
+}
+
+float getCoreLoad(byte core) {
+  if (core >= portNUM_PROCESSORS) return 0.0;
+  return coreLoad[core].load;
 }
+#endif
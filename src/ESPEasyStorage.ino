@@ -3,6 +3,9 @@
   Look here for error # reference: https://github.com/pellepl/spiffs/blob/master/src/spiffs.h
   \*********************************************************************************************/
 #define SPIFFS_CHECK(result, fname) if (!(result)) { return(FileError(__LINE__, fname)); }
+// Settings files are read and written in blocks of (at most) a SPIFFS page,
+// aligned to the page boundaries in the file.
+#define SPIFFS_BLOCK_SIZE  256
 String FileError(int line, const char * fname)
 {
    String err = F("FS   : Error while reading/writing ");
@@ -22,7 +25,9 @@ void flashCount()
   if (RTC.flashDayCounter <= MAX_FLASHWRITES_PER_DAY)
     RTC.flashDayCounter++;
   RTC.flashCounter++;
-  saveToRTC();
+  setRTCRegionDirty(RTC_REGION_STRUCT, &RTC.flashDayCounter, sizeof(RTC.flashDayCounter));
+  setRTCRegionDirty(RTC_REGION_STRUCT, &RTC.flashCounter, sizeof(RTC.flashCounter));
+  flushRTCRegion(RTC_REGION_STRUCT);
 }
 
 String flashGuard()
@@ -52,15 +57,13 @@ String BuildFixes()
   if (Settings.Build < 145)
   {
     String fname=F(FILE_NOTIFICATION);
+    closeCachedReadFile();
     fs::File f = SPIFFS.open(fname, "w");
     SPIFFS_CHECK(f, fname.c_str());
 
     if (f)
     {
-      for (int x = 0; x < 4096; x++)
-      {
-        SPIFFS_CHECK(f.write(0), fname.c_str());
-      }
+      SPIFFS_CHECK(writeBlocks(f, 0, NULL, 4096), fname.c_str());
       f.close();
     }
   }
@@ -114,6 +117,7 @@ void fileSystemCheck()
       ResetFactory();
     }
     f.close();
+    initSettingsPartition();
   }
   else
   {
@@ -151,6 +155,13 @@ String SaveSettings(void)
     if (err.length())
      return(err);
 //  }
+  // The region CRC below replaces the disabled MD5 check.
+  updateSettingsCrc(BasicSettings_Type, 0, FILE_CONFIG);
+  // Task or controller may now use another plugin, so rebuild the lookup caches.
+  updateTaskPluginCache();
+  rebuildTaskTriggers();
+  rebuildTaskGroups();
+  invalidateWebOptions();
 
   memcpy( SecuritySettings.ProgmemMd5, CRCValues.runTimeMD5, 16);
   md5.begin();
@@ -182,6 +193,10 @@ String LoadSettings()
   err=LoadFromFile((char*)FILE_CONFIG, 0, (byte*)&Settings, sizeof( SettingsStruct));
   if (err.length())
     return(err);
+  verifySettingsCrc(BasicSettings_Type, 0, FILE_CONFIG);
+  updateTaskPluginCache();
+  rebuildTaskTriggers();
+  rebuildTaskGroups();
 
     // FIXME @TD-er: As discussed in #1292, the CRC for the settings is now disabled.
 /*
@@ -216,6 +231,9 @@ String LoadSettings()
   }
   setUseStaticIP(useStaticIP());
   ExtraTaskSettings.clear(); // make sure these will not contain old settings.
+  ExtraTaskSettingsCache.clear();
+  TaskNameIndex.valid = false;
+  invalidateWebOptions();
   return(err);
 }
 
@@ -322,8 +340,17 @@ String SaveTaskSettings(byte TaskIndex)
   if (ExtraTaskSettings.TaskIndex != TaskIndex)
     return F("SaveTaskSettings taskIndex does not match");
   String err = SaveToFile(TaskSettings_Type, TaskIndex, (char*)FILE_CONFIG, (byte*)&ExtraTaskSettings, sizeof(struct ExtraTaskSettingsStruct));
-  if (err.length() == 0)
+  if (err.length() == 0) {
+    ExtraTaskSettingsCache.store(ExtraTaskSettings);
+    updateTaskNameIndex(TaskIndex);
+    taskReportReset(TaskIndex);
+    taskAggregateReset(TaskIndex);
+    markTaskValuesChanged(TaskIndex);
+    invalidateWebOptions();
     err = checkTaskSettings(TaskIndex);
+  } else {
+    ExtraTaskSettingsCache.invalidate(TaskIndex);
+  }
   return err;
 }
 
@@ -336,6 +363,8 @@ String LoadTaskSettings(byte TaskIndex)
   checkRAM(F("LoadTaskSettings"));
   if (ExtraTaskSettings.TaskIndex == TaskIndex)
     return(String()); //already loaded
+  if (ExtraTaskSettingsCache.restore(TaskIndex, ExtraTaskSettings))
+    return(String());
   ExtraTaskSettings.clear();
   String result = "";
   result = LoadFromFile(TaskSettings_Type, TaskIndex, (char*)FILE_CONFIG, (byte*)&ExtraTaskSettings, sizeof(struct ExtraTaskSettingsStruct));
@@ -350,6 +379,10 @@ String LoadTaskSettings(byte TaskIndex)
     //the plugin call should populate ExtraTaskSettings with its default values.
     PluginCall(PLUGIN_GET_DEVICEVALUENAMES, &TempEvent, dummyString);
   }
+  if (result.length() == 0) {
+    ExtraTaskSettingsCache.store(ExtraTaskSettings);
+    updateTaskNameIndex(TaskIndex);
+  }
 
   return result;
 }
@@ -455,6 +488,120 @@ String LoadNotificationSettings(int NotificationIndex, byte* memAddress, int dat
 
 
 
+/********************************************************************************************\
+  Write data (or zeros when data is NULL) at the current position of the file, which is
+  'position' from the start. Returns false when not all data could be written.
+  \*********************************************************************************************/
+bool writeBlocks(fs::File& f, int position, const byte* data, int datasize)
+{
+  byte zeros[SPIFFS_BLOCK_SIZE];
+  if (data == NULL) memset(zeros, 0, sizeof(zeros));
+  int written = 0;
+  while (written < datasize) {
+    // Up to the next page boundary
+    int blockSize = SPIFFS_BLOCK_SIZE - ((position + written) % SPIFFS_BLOCK_SIZE);
+    if (blockSize > (datasize - written)) blockSize = datasize - written;
+    const byte* block = (data == NULL) ? zeros : data + written;
+    if (f.write(block, blockSize) != static_cast<size_t>(blockSize))
+      return false;
+    written += blockSize;
+  }
+  return true;
+}
+
+/********************************************************************************************\
+  Cached read handle for the settings files.
+  Loading settings means many small reads from config.dat and each SPIFFS open has to scan
+  the lookup pages. The handle of the last read file is kept open, so bulk loads (PluginInit,
+  the devices page, /json) pay a single open. Any write to a settings file, upload, delete or
+  unmount must call closeCachedReadFile() first.
+  \*********************************************************************************************/
+#define FILE_CACHE_IDLE_TIMEOUT  5000  // msec, close the cached handle when not used
+
+fs::File cachedReadFile;
+String cachedReadFileName;
+unsigned long cachedReadFileLastUse = 0;
+
+fs::File& getCachedReadFile(const char* fname)
+{
+  cachedReadFileLastUse = millis();
+  if (cachedReadFile && cachedReadFileName == fname)
+    return cachedReadFile;
+  closeCachedReadFile();
+  cachedReadFile = SPIFFS.open(fname, "r");
+  if (cachedReadFile)
+    cachedReadFileName = fname;
+  return cachedReadFile;
+}
+
+void closeCachedReadFile()
+{
+  if (cachedReadFile)
+    cachedReadFile.close();
+  cachedReadFileName = "";
+}
+
+// Called once a second, so the handle does not stay open when not used.
+void closeIdleCachedReadFile()
+{
+  if (cachedReadFile && timePassedSince(cachedReadFileLastUse) > FILE_CACHE_IDLE_TIMEOUT)
+    closeCachedReadFile();
+}
+
+// On an error config.dat may be partly written, its copy in the settings partition is then not used.
+#define WRITE_CHANGED_CHECK(result, fname) if (!(result)) { \
+    if (strcmp(fname, FILE_CONFIG) == 0) invalidateSettingsPartition(); \
+    return(FileError(__LINE__, fname)); }
+
+/********************************************************************************************\
+  Write data (or zeros when data is NULL) at index in the file, but only the pages which
+  differ from what is on flash. Saves flash erase cycles and time when little has changed.
+  The flash guard is only applied when something needs to be written.
+  \*********************************************************************************************/
+String writeChangedBlocks(const char* fname, int index, const byte* data, int datasize, int& changedBytes)
+{
+  changedBytes = 0;
+  closeCachedReadFile();
+  fs::File f = SPIFFS.open(fname, "r+");
+  WRITE_CHANGED_CHECK(f, fname);
+
+  byte onFlash[SPIFFS_BLOCK_SIZE];
+  bool flashGuardChecked = false;
+  int pos = 0;
+  while (pos < datasize) {
+    int blockSize = SPIFFS_BLOCK_SIZE - ((index + pos) % SPIFFS_BLOCK_SIZE);
+    if (blockSize > (datasize - pos)) blockSize = datasize - pos;
+    WRITE_CHANGED_CHECK(f.seek(index + pos, fs::SeekSet), fname);
+    bool differs = f.read(onFlash, blockSize) != static_cast<size_t>(blockSize);
+    if (!differs) {
+      if (data == NULL) {
+        for (int i = 0; i < blockSize && !differs; ++i)
+          differs = onFlash[i] != 0;
+      } else {
+        differs = memcmp(onFlash, data + pos, blockSize) != 0;
+      }
+    }
+    if (differs) {
+      if (!flashGuardChecked) {
+        const String flashErr = flashGuard();
+        if (flashErr.length()) {
+          if (strcmp(fname, FILE_CONFIG) == 0) invalidateSettingsPartition();
+          return flashErr;
+        }
+        flashGuardChecked = true;
+      }
+      WRITE_CHANGED_CHECK(f.seek(index + pos, fs::SeekSet), fname);
+      WRITE_CHANGED_CHECK(writeBlocks(f, index + pos, (data == NULL) ? NULL : data + pos, blockSize), fname);
+      changedBytes += blockSize;
+    }
+    pos += blockSize;
+  }
+  f.close();
+  if (changedBytes != 0)
+    writeSettingsPartition(fname, index, data, datasize);
+  return String();
+}
+
 /********************************************************************************************\
   Init a file with zeros on SPIFFS
   \*********************************************************************************************/
@@ -462,14 +609,12 @@ String InitFile(const char* fname, int datasize)
 {
   checkRAM(F("InitFile"));
   FLASH_GUARD();
+  closeCachedReadFile();
 
   fs::File f = SPIFFS.open(fname, "w");
   SPIFFS_CHECK(f, fname);
 
-  for (int x = 0; x < datasize ; x++)
-  {
-    SPIFFS_CHECK(f.write(0), fname);
-  }
+  SPIFFS_CHECK(writeBlocks(f, 0, NULL, datasize), fname);
   f.close();
 
   //OK
@@ -490,22 +635,23 @@ String SaveToFile(char* fname, int index, byte* memAddress, int datasize)
   }
 
   checkRAM(F("SaveToFile"));
-  FLASH_GUARD();
-
-  fs::File f = SPIFFS.open(fname, "r+");
-  SPIFFS_CHECK(f, fname);
-
-  SPIFFS_CHECK(f.seek(index, fs::SeekSet), fname);
-  byte *pointerToByteToSave = memAddress;
-  for (int x = 0; x < datasize ; x++)
-  {
-    SPIFFS_CHECK(f.write(*pointerToByteToSave), fname);
-    pointerToByteToSave++;
+  START_TIMER;
+  int changedBytes;
+  String err = writeChangedBlocks(fname, index, memAddress, datasize, changedBytes);
+  if (err.length())
+    return err;
+  saveFileBytes += changedBytes;
+  STOP_TIMER(SAVEFILE_STATS);
+  if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+    String log = changedBytes == 0 ? F("FILE : Unchanged ") : F("FILE : Saved ");
+    log=log+fname;
+    if (changedBytes != 0) {
+      log += F(" (");
+      log += changedBytes;
+      log += F(" bytes)");
+    }
+    addLog(LOG_LEVEL_INFO, log);
   }
-  f.close();
-  String log = F("FILE : Saved ");
-  log=log+fname;
-  addLog(LOG_LEVEL_INFO, log);
 
   //OK
   return String();
@@ -525,17 +671,13 @@ String ClearInFile(char* fname, int index, int datasize)
   }
 
   checkRAM(F("ClearInFile"));
-  FLASH_GUARD();
-
-  fs::File f = SPIFFS.open(fname, "r+");
-  SPIFFS_CHECK(f, fname);
-
-  SPIFFS_CHECK(f.seek(index, fs::SeekSet), fname);
-  for (int x = 0; x < datasize ; x++)
-  {
-    SPIFFS_CHECK(f.write(0), fname);
-  }
-  f.close();
+  START_TIMER;
+  int changedBytes;
+  String err = writeChangedBlocks(fname, index, NULL, datasize, changedBytes);
+  if (err.length())
+    return err;
+  saveFileBytes += changedBytes;
+  STOP_TIMER(SAVEFILE_STATS);
 
   //OK
   return String();
@@ -558,11 +700,20 @@ String LoadFromFile(char* fname, int offset, byte* memAddress, int datasize)
 
   checkRAM(F("LoadFromFile"));
 
-  fs::File f = SPIFFS.open(fname, "r+");
+  if (readSettingsPartition(fname, offset, memAddress, datasize)) {
+    loadFileBytes += datasize;
+    STOP_TIMER(LOADFILE_STATS);
+    return(String());
+  }
+  fs::File& f = getCachedReadFile(fname);
   SPIFFS_CHECK(f, fname);
   SPIFFS_CHECK(f.seek(offset, fs::SeekSet), fname);
-  SPIFFS_CHECK(f.read(memAddress,datasize), fname);
-  f.close();
+  if (!f.read(memAddress,datasize)) {
+    // Do not keep a handle which failed to read
+    closeCachedReadFile();
+    return(FileError(__LINE__, fname));
+  }
+  loadFileBytes += datasize;
 
   STOP_TIMER(LOADFILE_STATS);
 
@@ -606,7 +757,10 @@ String LoadFromFile(SettingsType settingsType, int index, char* fname, byte* mem
   }
   if (datasize > max_size)
     return getSettingsFileDatasizeError(read, settingsType, index, datasize, max_size);
-  return(LoadFromFile(fname, offset, memAddress, datasize));
+  String err = LoadFromFile(fname, offset, memAddress, datasize);
+  if (err.length() == 0)
+    verifySettingsCrc(settingsType, index, fname);
+  return err;
 }
 
 String SaveToFile(SettingsType settingsType, int index, char* fname, byte* memAddress, int datasize) {
@@ -617,7 +771,10 @@ String SaveToFile(SettingsType settingsType, int index, char* fname, byte* memAd
   }
   if (datasize > max_size)
     return getSettingsFileDatasizeError(read, settingsType, index, datasize, max_size);
-  return(SaveToFile(fname, offset, memAddress, datasize));
+  String err = SaveToFile(fname, offset, memAddress, datasize);
+  if (err.length() == 0)
+    updateSettingsCrc(settingsType, index, fname);
+  return err;
 }
 
 String ClearInFile(SettingsType settingsType, int index, char* fname) {
@@ -626,7 +783,131 @@ String ClearInFile(SettingsType settingsType, int index, char* fname) {
   if (!getAndLogSettingsParameters(read, settingsType, index, offset, max_size)) {
     return getSettingsFileIndexRangeError(read, settingsType, index);
   }
-  return(ClearInFile(fname, offset, max_size));
+  String err = ClearInFile(fname, offset, max_size);
+  if (err.length() == 0)
+    updateSettingsCrc(settingsType, index, fname);
+  return err;
+}
+
+/********************************************************************************************\
+  CRC32 per settings region (Settings, each task, controller and notification slot), kept in
+  config.crc next to config.dat. A region is checked the first time it is loaded after boot
+  and its CRC is updated when it is saved, so no boot time hash over the whole file is needed.
+  A stored CRC of 0 means unknown (new or replaced files), the CRC on flash is then taken over.
+  \*********************************************************************************************/
+#define SETTINGS_CRC_REGIONS  (1 + 2 * TASKS_MAX + 2 * CONTROLLER_MAX + NOTIFICATION_MAX)
+#define SETTINGS_CRC_UNKNOWN  0
+
+uint32_t settingsCrc[SETTINGS_CRC_REGIONS];
+byte settingsCrcVerified[(SETTINGS_CRC_REGIONS + 7) / 8];
+bool settingsCrcLoaded = false;
+
+// Regions are numbered in the order of SettingsType, returns -1 when out of range.
+int getSettingsCrcIndex(SettingsType settingsType, int index) {
+  int region = 0;
+  for (int st = 0; st < SettingsType_MAX; ++st) {
+    int max_index, offset, max_size, struct_size;
+    getSettingsParameters(static_cast<SettingsType>(st), 0, max_index, offset, max_size, struct_size);
+    if (st == settingsType)
+      return (index >= 0 && index < max_index) ? region + index : -1;
+    region += max_index;
+  }
+  return -1;
+}
+
+void loadSettingsCrcTable() {
+  if (settingsCrcLoaded) return;
+  settingsCrcLoaded = true;
+  memset(settingsCrc, 0, sizeof(settingsCrc));
+  memset(settingsCrcVerified, 0, sizeof(settingsCrcVerified));
+  fs::File f = SPIFFS.open(FILE_CONFIG_CRC, "r");
+  if (!f) return;
+  // A table of another size (other build) is ignored and rebuilt.
+  if (f.size() != sizeof(settingsCrc) || f.read((uint8_t*)settingsCrc, sizeof(settingsCrc)) != sizeof(settingsCrc))
+    memset(settingsCrc, 0, sizeof(settingsCrc));
+  f.close();
+}
+
+// Forget all CRCs, must be called when config.dat or notification.dat is replaced as a whole.
+void clearSettingsCrc() {
+  SPIFFS.remove(FILE_CONFIG_CRC);
+  settingsCrcLoaded = false;
+  invalidateSettingsPartition();
+}
+
+// Only the 4 bytes of the region are written. This goes along with a settings save,
+// so it is not counted as an extra flash write.
+void writeSettingsCrc(int region) {
+  fs::File f = SPIFFS.open(FILE_CONFIG_CRC, "r+");
+  if (f && f.size() == sizeof(settingsCrc)) {
+    if (f.seek(region * sizeof(uint32_t), fs::SeekSet))
+      f.write((const uint8_t*)&settingsCrc[region], sizeof(uint32_t));
+  } else {
+    if (f) f.close();
+    f = SPIFFS.open(FILE_CONFIG_CRC, "w");
+    if (f) f.write((const uint8_t*)settingsCrc, sizeof(settingsCrc));
+  }
+  if (f) f.close();
+}
+
+bool getSettingsRegionCrc(SettingsType settingsType, int index, const char* fname, uint32_t& crc) {
+  int offset, max_size;
+  if (!getSettingsParameters(settingsType, index, offset, max_size))
+    return false;
+  fs::File& f = getCachedReadFile(fname);
+  if (!f || !f.seek(offset, fs::SeekSet))
+    return false;
+  crc = 0;
+  byte buf[128];
+  while (max_size > 0) {
+    const int size = max_size < static_cast<int>(sizeof(buf)) ? max_size : sizeof(buf);
+    if (f.read(buf, size) != static_cast<size_t>(size)) {
+      closeCachedReadFile();
+      return false;
+    }
+    crc = crc32Update(crc, buf, size);
+    max_size -= size;
+  }
+  // 0 is used to mark an unknown CRC.
+  if (crc == SETTINGS_CRC_UNKNOWN) crc = 1;
+  return true;
+}
+
+// Check the region the first time it is loaded after boot.
+void verifySettingsCrc(SettingsType settingsType, int index, const char* fname) {
+  const int region = getSettingsCrcIndex(settingsType, index);
+  if (region < 0) return;
+  loadSettingsCrcTable();
+  if (bitRead(settingsCrcVerified[region >> 3], region & 7)) return;
+  uint32_t crc;
+  if (!getSettingsRegionCrc(settingsType, index, fname, crc)) return;
+  bitSet(settingsCrcVerified[region >> 3], region & 7);
+  if (settingsCrc[region] == SETTINGS_CRC_UNKNOWN) {
+    settingsCrc[region] = crc;
+    writeSettingsCrc(region);
+  } else if (settingsCrc[region] != crc) {
+    String log = F("CRC  : ");
+    log += getSettingsTypeString(settingsType);
+    if (settingsType != BasicSettings_Type) {
+      log += ' ';
+      log += index + 1;
+    }
+    log += F(" CRC ...FAIL");
+    addLog(LOG_LEVEL_ERROR, log);
+  }
+}
+
+// Store the CRC of the region as it is on flash now, after a save or clear.
+void updateSettingsCrc(SettingsType settingsType, int index, const char* fname) {
+  const int region = getSettingsCrcIndex(settingsType, index);
+  if (region < 0) return;
+  loadSettingsCrcTable();
+  uint32_t crc;
+  if (!getSettingsRegionCrc(settingsType, index, fname, crc)) return;
+  bitSet(settingsCrcVerified[region >> 3], region & 7);
+  if (settingsCrc[region] == crc) return;
+  settingsCrc[region] = crc;
+  writeSettingsCrc(region);
 }
 
 /********************************************************************************************\
@@ -2,7 +2,8 @@
 #define ESPEASY_TIMETYPES_H_
 
 #include <stdint.h>
-#include <list>
+#include <string.h>
+#include <vector>
 
 struct  timeStruct {
   timeStruct() : Second(0), Minute(0), Hour(0), Wday(0), Day(0), Month(0), Year(0) {}
@@ -70,8 +71,9 @@ long timePassedSince(unsigned long timestamp);
 boolean timeOutReached(unsigned long timer);
 long usecPassedSince(unsigned long timestamp);
 boolean usecTimeOutReached(unsigned long timer);
-void setSystemTimer(unsigned long timer, byte plugin, short taskIndex, int Par1,
+bool setSystemTimer(unsigned long timer, byte plugin, short taskIndex, int Par1,
   int Par2 = 0, int Par3 = 0, int Par4 = 0, int Par5 = 0);
+bool clearSystemTimer(byte plugin, int Par1);
 
 
 
@@ -80,6 +82,14 @@ void setSystemTimer(unsigned long timer, byte plugin, short taskIndex, int Par1,
  * TimerHandler Used by the Scheduler
 \*********************************************************************************************/
 
+// Slots of the id index of the timer heap, a power of 2. At most 3/4 of it is used.
+#ifdef ESP32
+  #define TIMER_HEAP_INDEX_SIZE   512
+#else
+  #define TIMER_HEAP_INDEX_SIZE   256
+#endif
+#define TIMER_HEAP_MAX_ITEMS    (TIMER_HEAP_INDEX_SIZE * 3 / 4)
+
 struct timer_id_couple {
   timer_id_couple(unsigned long id, unsigned long newtimer) : _id(id), _timer(newtimer) {}
 
@@ -99,39 +109,74 @@ struct timer_id_couple {
 
 struct msecTimerHandlerStruct {
 
-  msecTimerHandlerStruct() : get_called(0), get_called_ret_id(0), max_queue_length(0),
-      last_exec_time_usec(0), total_idle_time_usec(0), is_idle(false), idle_time_pct(0.0)
+  msecTimerHandlerStruct() : get_called(0), get_called_ret_id(0), max_queue_length(0), dropped(0),
+      last_exec_time_usec(0), total_idle_time_usec(0), total_sleep_time_usec(0), is_idle(false),
+      idle_time_pct(0.0), sleep_time_pct(0.0)
   {
     last_log_start_time = millis();
+    memset(_heap_index, 0, sizeof(_heap_index));
   }
 
-  void registerAt(unsigned long id, unsigned long timer) {
+  // Return false when the timer is not set, because TIMER_HEAP_MAX_ITEMS are scheduled.
+  bool registerAt(unsigned long id, unsigned long timer) {
     timer_id_couple item(id, timer);
-    insert(item);
+    return insert(item);
   }
 
   // Check if timeout has been reached and also return its set timer.
   // Return 0 if no item has reached timeout moment.
-  unsigned long getNextId(unsigned long& timer) {
+  HOT_IRAM_ATTR unsigned long getNextId(unsigned long& timer) {
     ++get_called;
-    if (_timer_ids.empty()) {
+    if (_timer_heap.empty()) {
       recordIdle();
       return 0;
     }
-    timer_id_couple item = _timer_ids.front();
+    // The first element of the heap is always the first one due.
+    const timer_id_couple item = _timer_heap.front();
     if (!timeOutReached(item._timer)) {
       recordIdle();
       return 0;
     }
     recordRunning();
-    unsigned long size = _timer_ids.size();
+    unsigned long size = _timer_heap.size();
     if (size > max_queue_length) max_queue_length = size;
-    _timer_ids.pop_front();
+    removeAt(0);
     timer = item._timer;
     ++get_called_ret_id;
     return item._id;
   }
 
+  // Return the number of msec until the first timer is due, at most max_msec.
+  // Return 0 when a timer is already due.
+  unsigned long msecUntilNextDue(unsigned long max_msec) const {
+    if (_timer_heap.empty()) return max_msec;
+    const long passed = timePassedSince(_timer_heap.front()._timer);
+    if (passed >= 0) return 0;
+    const unsigned long due = static_cast<unsigned long>(-passed);
+    return due < max_msec ? due : max_msec;
+  }
+
+  // Time spent sleeping is also counted as idle time.
+  void recordSleep(unsigned long usec) {
+    total_sleep_time_usec += usec;
+  }
+
+  // Get the timer of a scheduled id. Return false when the id is not scheduled.
+  bool getTimer(unsigned long id, unsigned long& timer) const {
+    const size_t slot = findSlot(id);
+    if (_heap_index[slot] == 0) return false;
+    timer = _timer_heap[_heap_index[slot] - 1]._timer;
+    return true;
+  }
+
+  // Remove a scheduled id. Return false when the id was not scheduled.
+  bool remove(unsigned long id) {
+    const size_t slot = findSlot(id);
+    if (_heap_index[slot] == 0) return false;
+    removeAt(_heap_index[slot] - 1);
+    return true;
+  }
+
   String getQueueStats() {
 
     String result;
@@ -152,32 +197,145 @@ struct msecTimerHandlerStruct {
     const long duration = timePassedSince(last_log_start_time);
     last_log_start_time = millis();
     idle_time_pct = total_idle_time_usec / duration / 10.0;
+    sleep_time_pct = total_sleep_time_usec / duration / 10.0;
     total_idle_time_usec = 0;
+    total_sleep_time_usec = 0;
   }
 
   float getIdleTimePct() {
     return idle_time_pct;
   }
 
+  size_t getQueueLength() const {
+    return _timer_heap.size();
+  }
+
+  unsigned long getMaxQueueLength() const {
+    return max_queue_length;
+  }
+
+  // Timers not set because TIMER_HEAP_MAX_ITEMS were scheduled.
+  unsigned long getDroppedCount() const {
+    return dropped;
+  }
+
+  float getSleepTimePct() {
+    return sleep_time_pct;
+  }
+
 private:
-  struct match_id {
-    match_id(unsigned long id) : _id(id) {}
-    bool operator() (const timer_id_couple& item) { return _id == item._id; }
-    unsigned long _id;
-  };
-
-  void insert(const timer_id_couple& item) {
-    if (item._id == 0) return;
-
-    // Make sure only one is present with the same id.
-    _timer_ids.remove_if(match_id(item._id));
-    const bool mustSort = !_timer_ids.empty();
-    _timer_ids.push_front(item);
-    if (mustSort)
-      _timer_ids.sort(); // TD-er: Must check if this is an expensive operation.
-    // It should be a relative light operation, to insert into a sorted list.
-    // Perhaps it is better to use std::set ????
-    // Keep in mind: order is based on timer, uniqueness is based on id.
+  // The timers are kept in a binary min-heap, ordered on their timer value.
+  // _heap_index is an open addressing hash table (linear probing) of the
+  // position + 1 of each id in the heap, 0 is an empty slot. So uniqueness on
+  // id can be kept without scanning the heap, and setting a timer does not
+  // allocate: the heap only grows up to the highest number of timers set.
+  // Insert, update and remove are O(log n), looking up the next due is O(1).
+  // Keep in mind: order is based on timer, uniqueness is based on id.
+  bool insert(const timer_id_couple& item) {
+    if (item._id == 0) return false;
+
+    const size_t slot = findSlot(item._id);
+    if (_heap_index[slot] != 0) {
+      // Already scheduled, only update its timer and restore the heap order.
+      const size_t pos = _heap_index[slot] - 1;
+      _timer_heap[pos]._timer = item._timer;
+      if (!siftUp(pos)) siftDown(pos);
+      return true;
+    }
+    if (_timer_heap.size() >= TIMER_HEAP_MAX_ITEMS) {
+      ++dropped;
+      return false;
+    }
+    _timer_heap.push_back(item);
+    const size_t pos = _timer_heap.size() - 1;
+    _heap_index[slot] = pos + 1;
+    siftUp(pos);
+    return true;
+  }
+
+  static size_t hashSlot(unsigned long id) {
+    return (static_cast<uint32_t>(id * 2654435761UL) >> 16) & (TIMER_HEAP_INDEX_SIZE - 1);
+  }
+
+  // Slot of the id, or the empty slot where it is to be added.
+  size_t findSlot(unsigned long id) const {
+    size_t slot = hashSlot(id);
+    while (_heap_index[slot] != 0 && _timer_heap[_heap_index[slot] - 1]._id != id)
+      slot = (slot + 1) & (TIMER_HEAP_INDEX_SIZE - 1);
+    return slot;
+  }
+
+  // Empty the slot, moving back the entries after it which would no longer be found.
+  void eraseSlot(size_t slot) {
+    size_t next = slot;
+    while (true) {
+      next = (next + 1) & (TIMER_HEAP_INDEX_SIZE - 1);
+      if (_heap_index[next] == 0) break;
+      const size_t home = hashSlot(_timer_heap[_heap_index[next] - 1]._id);
+      // Keep it when its home slot lies cyclically in (slot, next]
+      const bool keep = slot <= next ? (slot < home && home <= next) : (slot < home || home <= next);
+      if (keep) continue;
+      _heap_index[slot] = _heap_index[next];
+      slot = next;
+    }
+    _heap_index[slot] = 0;
+  }
+
+  void removeAt(size_t pos) {
+    // The index is updated while the heap still matches it
+    eraseSlot(findSlot(_timer_heap[pos]._id));
+    const size_t last = _timer_heap.size() - 1;
+    if (pos != last) {
+      _heap_index[findSlot(_timer_heap[last]._id)] = pos + 1;
+      _timer_heap[pos] = _timer_heap[last];
+    }
+    _timer_heap.pop_back();
+    if (pos < _timer_heap.size()) {
+      if (!siftUp(pos)) siftDown(pos);
+    }
+  }
+
+  // Compare using timeDiff to handle a wrap around of millis()
+  bool isEarlier(size_t a, size_t b) const {
+    return timeDiff(_timer_heap[a]._timer, _timer_heap[b]._timer) > 0;
+  }
+
+  void swapItems(size_t a, size_t b) {
+    // Look up the slots before the heap no longer matches the index
+    const size_t slotA = findSlot(_timer_heap[a]._id);
+    const size_t slotB = findSlot(_timer_heap[b]._id);
+    const timer_id_couple tmp = _timer_heap[a];
+    _timer_heap[a] = _timer_heap[b];
+    _timer_heap[b] = tmp;
+    _heap_index[slotA] = b + 1;
+    _heap_index[slotB] = a + 1;
+  }
+
+  // Return true when the item was moved.
+  bool siftUp(size_t pos) {
+    bool moved = false;
+    while (pos > 0) {
+      const size_t parent = (pos - 1) / 2;
+      if (!isEarlier(pos, parent)) break;
+      swapItems(pos, parent);
+      pos = parent;
+      moved = true;
+    }
+    return moved;
+  }
+
+  void siftDown(size_t pos) {
+    const size_t size = _timer_heap.size();
+    while (true) {
+      const size_t left = 2 * pos + 1;
+      const size_t right = left + 1;
+      size_t first = pos;
+      if (left < size && isEarlier(left, first)) first = left;
+      if (right < size && isEarlier(right, first)) first = right;
+      if (first == pos) return;
+      swapItems(pos, first);
+      pos = first;
+    }
   }
 
   void recordIdle() {
@@ -197,16 +355,20 @@ private:
   unsigned long get_called;
   unsigned long get_called_ret_id;
   unsigned long max_queue_length;
+  unsigned long dropped;
 
   // Compute idle system time
   unsigned long last_exec_time_usec;
   unsigned long total_idle_time_usec;
+  unsigned long total_sleep_time_usec;
   unsigned long last_log_start_time;
   bool is_idle;
   float idle_time_pct;
+  float sleep_time_pct;
 
-  // The list of set timers
-  std::list<timer_id_couple> _timer_ids;
+  // The heap of set timers and the position + 1 of each id in it.
+  std::vector<timer_id_couple> _timer_heap;
+  uint16_t _heap_index[TIMER_HEAP_INDEX_SIZE];
 };
 
 
@@ -33,6 +33,9 @@ void processConnect() {
   if (useStaticIP()) {
     setupStaticIPconfig();
     markGotIP();
+  } else if (wifiFastConnectIP) {
+    // Cached IP config is already set, there is no DHCP.
+    markGotIP();
   }
   logConnectionStatus();
 }
@@ -73,6 +76,8 @@ void processGotIP() {
     String log = F("WIFI : ");
     if (useStaticIP()) {
       log += F("Static IP: ");
+    } else if (wifiFastConnectIP) {
+      log += F("Cached IP: ");
     } else {
       log += F("DHCP IP: ");
     }
@@ -103,6 +108,7 @@ void processGotIP() {
     }
     WiFi.config(ip, gw, subnet);
   }
+  saveWiFiConnection();
 
   #ifdef FEATURE_MDNS
 
@@ -136,6 +142,7 @@ void processGotIP() {
   statusLED(true);
 //  WiFi.scanDelete();
   wifiStatus = ESPEASY_WIFI_SERVICES_INITIALIZED;
+  bootProfileStep(BOOT_STEP_WIFI);
   setWebserverRunning(true);
   wifi_connect_attempt = 0;
   if (wifiSetup) {
@@ -193,49 +200,155 @@ void processDisableAPmode() {
   }
 }
 
+// Merge the scan result into the scan cache. Called for the scan done event (ESP32)
+// and by the background scan when its result is ready.
 void processScanDone() {
   if (processedScanDone) return;
   processedScanDone = true;
-  if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+  const int found = WiFi.scanComplete();
+  if (found < 0) return;  // Already handled
+  if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
     String log = F("WIFI  : Scan finished, found: ");
-    log += scan_done_number;
-    addLog(LOG_LEVEL_INFO, log);
+    log += found;
+    addLog(LOG_LEVEL_DEBUG, log);
   }
+  for (int i = 0; i < found; ++i)
+    addToWiFiScanCache(i);
+  WiFi.scanDelete();
+}
 
-  int bestScanID = -1;
-  int32_t bestRssi = -1000;
-  uint8_t bestWiFiSettings = lastWiFiSettings;
-  if (selectValidWiFiSettings()) {
-    bool done = false;
-    String lastWiFiSettingsSSID = getLastWiFiSettingsSSID();
-    for (int settingNr = 0; !done && settingNr < 2; ++settingNr) {
-      for (int i = 0; i < scan_done_number; ++i) {
-        if (WiFi.SSID(i) == lastWiFiSettingsSSID) {
-          int32_t rssi = WiFi.RSSI(i);
-          if (bestRssi < rssi) {
-            bestRssi = rssi;
-            bestScanID = i;
-            bestWiFiSettings = lastWiFiSettings;
-          }
-        }
-      }
-      if (!selectNextWiFiSettings()) done = true;
+//********************************************************************************
+// WiFi scan cache
+// While connected, one channel is scanned every WIFI_SCAN_CHANNEL_INTERVAL, so the
+// radio only leaves the channel of the AP for a single channel scan at a time.
+// The web scanner page and the AP selection at connect use the cache.
+//********************************************************************************
+#define WIFI_SCAN_CHANNELS              13
+#define WIFI_SCAN_CHANNEL_INTERVAL   10000   // msec
+#define WIFI_SCAN_TIMEOUT             5000   // msec, scan result not received
+
+byte wifiScanChannel = 0;               // Last channel scanned by the background scan
+bool wifiScanRunning = false;
+unsigned long wifiScanStarted = 0;
+unsigned long wifiScanLastSweep = 0;    // All channels scanned, 0 = not yet
+
+// Store scan result i, an AP already in the cache is updated and its RSSI averaged.
+void addToWiFiScanCache(int i) {
+  const uint8_t* bssid = WiFi.BSSID(i);
+  if (bssid == NULL) return;
+  int slot = -1;
+  int oldest = 0;
+  for (byte x = 0; x < WIFI_SCAN_CACHE_SIZE; ++x) {
+    if (WiFiScanCache[x].used() && memcmp(WiFiScanCache[x].bssid, bssid, 6) == 0) {
+      slot = x;
+      break;
     }
-    if (bestScanID >= 0) {
-      if (loglevelActiveFor(LOG_LEVEL_INFO)) {
-        String log = F("WIFI  : Selected: ");
-        log += formatScanResult(bestScanID, " ");
-        addLog(LOG_LEVEL_INFO, log);
-      }
-      lastWiFiSettings = bestWiFiSettings;
-      uint8_t * scanbssid = WiFi.BSSID(bestScanID);
-      if (scanbssid) {
-        for (int i = 0; i < 6 ; ++i) {
-          lastBSSID[i] = *(scanbssid + i);
-        }
+    if (!WiFiScanCache[oldest].used()) continue;
+    if (!WiFiScanCache[x].used() || timePassedSince(WiFiScanCache[x].lastSeen) > timePassedSince(WiFiScanCache[oldest].lastSeen))
+      oldest = x;
+  }
+  const int16_t rssiX4 = WiFi.RSSI(i) * 4;
+  if (slot < 0) {
+    slot = oldest;
+    WiFiScanCache[slot].rssiX4 = rssiX4;
+    memcpy(WiFiScanCache[slot].bssid, bssid, 6);
+  } else {
+    WiFiScanCache[slot].rssiX4 += (rssiX4 - WiFiScanCache[slot].rssiX4) / 4;
+  }
+  WiFiScanCacheStruct& ap = WiFiScanCache[slot];
+  strncpy(ap.ssid, WiFi.SSID(i).c_str(), sizeof(ap.ssid) - 1);
+  ap.ssid[sizeof(ap.ssid) - 1] = 0;
+  ap.channel = WiFi.channel(i);
+  ap.encryption = WiFi.encryptionType(i);
+  #ifdef ESP32
+  ap.hidden = ap.ssid[0] == 0;
+  #else
+  ap.hidden = WiFi.isHidden(i);
+  #endif
+  ap.lastSeen = millis();
+}
+
+bool isWiFiScanCacheEntryValid(byte index) {
+  return WiFiScanCache[index].used() && timePassedSince(WiFiScanCache[index].lastSeen) < WIFI_SCAN_CACHE_MAX_AGE;
+}
+
+bool isWiFiScanCacheComplete() {
+  return wifiScanLastSweep != 0 && timePassedSince(wifiScanLastSweep) < WIFI_SCAN_CACHE_MAX_AGE;
+}
+
+// Called once a second.
+void processBackgroundWiFiScan() {
+  if (wifiScanRunning) {
+    if (WiFi.scanComplete() == WIFI_SCAN_RUNNING && timePassedSince(wifiScanStarted) < WIFI_SCAN_TIMEOUT)
+      return;
+    wifiScanRunning = false;
+    processedScanDone = false;
+    processScanDone();
+    #ifdef ESP32
+    wifiScanLastSweep = millis();
+    #else
+    if (wifiScanChannel == WIFI_SCAN_CHANNELS)
+      wifiScanLastSweep = millis();
+    #endif
+    return;
+  }
+  // Only while connected, a scan would disturb connecting and clients of our own AP.
+  if (!WiFiConnected() || WifiIsAP(WiFi.getMode())) return;
+  #ifdef ESP32
+  // No per channel scan in this core, all channels with a short dwell time.
+  if (timePassedSince(wifiScanStarted) < WIFI_SCAN_CHANNEL_INTERVAL * WIFI_SCAN_CHANNELS) return;
+  WiFi.scanNetworks(true, true, false, 100);
+  #else
+  if (timePassedSince(wifiScanStarted) < WIFI_SCAN_CHANNEL_INTERVAL) return;
+  wifiScanChannel = (wifiScanChannel % WIFI_SCAN_CHANNELS) + 1;
+  WiFi.scanNetworks(true, true, wifiScanChannel);
+  #endif
+  wifiScanRunning = true;
+  wifiScanStarted = millis();
+}
+
+// Blocking scan of all channels, to fill the cache when the background scan
+// did not yet cover all channels.
+void scanAllWiFiChannels() {
+  if (wifiScanRunning) {
+    while (WiFi.scanComplete() == WIFI_SCAN_RUNNING && timePassedSince(wifiScanStarted) < WIFI_SCAN_TIMEOUT)
+      delay(10);
+    wifiScanRunning = false;
+  }
+  WiFi.scanDelete();
+  const int found = WiFi.scanNetworks(false, true);
+  for (int i = 0; i < found; ++i)
+    addToWiFiScanCache(i);
+  WiFi.scanDelete();
+  wifiScanLastSweep = millis();
+}
+
+// Select the strongest AP in the cache matching one of the WiFi settings.
+// Sets lastWiFiSettings and lastBSSID, returns false when none was found.
+bool selectBestCachedAP() {
+  const uint8_t current = lastWiFiSettings;
+  uint8_t bestWiFiSettings = current;
+  int best = -1;
+  for (int settingNr = 0; settingNr < 2; ++settingNr) {
+    if (settingNr != 0 && !selectNextWiFiSettings()) break;
+    const char* ssid = getLastWiFiSettingsSSID();
+    for (byte x = 0; x < WIFI_SCAN_CACHE_SIZE; ++x) {
+      if (!isWiFiScanCacheEntryValid(x) || strcmp(WiFiScanCache[x].ssid, ssid) != 0) continue;
+      if (best < 0 || WiFiScanCache[x].rssiX4 > WiFiScanCache[best].rssiX4) {
+        best = x;
+        bestWiFiSettings = lastWiFiSettings;
       }
     }
   }
+  lastWiFiSettings = bestWiFiSettings;
+  if (best < 0) return false;
+  memcpy(lastBSSID, WiFiScanCache[best].bssid, 6);
+  if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+    String log = F("WIFI  : Selected: ");
+    log += formatScanCacheResult(best, " ");
+    addLog(LOG_LEVEL_INFO, log);
+  }
+  return true;
 }
 
 void resetWiFi() {
@@ -434,6 +547,75 @@ String WifiGetHostname()
 }
 
 
+//********************************************************************************
+// Fast reconnect after deep sleep
+// The BSSID, channel and (DHCP) IP config of the connection are kept in RTC memory,
+// so after waking up the connection can be made without scan and DHCP.
+//********************************************************************************
+void saveWiFiConnection() {
+  if (!wifiFastConnectIP) {
+    RTC_WiFi.ipAge = 0;  // Renewed by DHCP
+  }
+  const uint8_t* bssid = WiFi.BSSID();
+  if (bssid != NULL) {
+    memcpy(RTC_WiFi.bssid, bssid, sizeof(RTC_WiFi.bssid));
+  }
+  RTC_WiFi.channel = WiFi.channel();
+  RTC_WiFi.wifiSettings = lastWiFiSettings;
+  if (useStaticIP()) {
+    RTC_WiFi.ip = 0;
+  } else {
+    RTC_WiFi.ip = WiFi.localIP();
+    RTC_WiFi.gateway = WiFi.gatewayIP();
+    RTC_WiFi.subnet = WiFi.subnetMask();
+    RTC_WiFi.dns1 = WiFi.dnsIP(0);
+    RTC_WiFi.dns2 = WiFi.dnsIP(1);
+  }
+  saveWiFiToRTC();
+  // Later reconnects use the normal procedure.
+  wifiFastConnect = false;
+}
+
+// Connect with the cached connection, returns false when it cannot be used.
+bool tryFastConnectWiFi(const char* ssid, const char* passphrase) {
+  if (!wifiFastConnect || RTC_WiFi.wifiSettings != lastWiFiSettings) return false;
+  wifiFastConnectIP = !useStaticIP() && RTC_WiFi.ip != 0 && RTC_WiFi.ipAge < WIFI_RTC_IP_MAX_AGE;
+  if (wifiFastConnectIP) {
+    WiFi.config(IPAddress(RTC_WiFi.ip), IPAddress(RTC_WiFi.gateway), IPAddress(RTC_WiFi.subnet),
+                IPAddress(RTC_WiFi.dns1), IPAddress(RTC_WiFi.dns2));
+  }
+  if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+    String log = F("WIFI : Fast connect, Ch: ");
+    log += RTC_WiFi.channel;
+    if (wifiFastConnectIP) {
+      log += F(" IP: ");
+      log += formatIP(IPAddress(RTC_WiFi.ip));
+    }
+    addLog(LOG_LEVEL_INFO, log);
+  }
+  WiFi.begin(ssid, passphrase, RTC_WiFi.channel, RTC_WiFi.bssid);
+  return true;
+}
+
+// Back to a scan and DHCP, after a failed fast connect or for a later reconnect.
+void stopFastConnectWiFi() {
+  if (wifiFastConnect) {
+    addLog(LOG_LEVEL_INFO, F("WIFI : Fast connect failed"));
+    wifiFastConnect = false;
+    // Probably a different AP or channel now.
+    RTC_WiFi.channel = 0;
+    saveWiFiToRTC();
+  }
+  if (wifiFastConnectIP) {
+    wifiFastConnectIP = false;
+    if (!useStaticIP()) {
+      // All zero enables DHCP again
+      WiFi.config(IPAddress(0u), IPAddress(0u), IPAddress(0u));
+      setUseStaticIP(false);
+    }
+  }
+}
+
 bool useStaticIP() {
   return (Settings.IP[0] != 0 && Settings.IP[0] != 255);
 }
@@ -584,6 +766,15 @@ bool tryConnectWiFi() {
   if (wifi_connect_attempt > 5) {
     setAP(true);
   }
+  if (wifiFastConnect && wifi_connect_attempt == 0) {
+    lastWiFiSettings = RTC_WiFi.wifiSettings;
+    if (!selectValidWiFiSettings()) {
+      stopFastConnectWiFi();
+    }
+  }
+  if (!wifiFastConnect && wifi_connect_attempt == 0) {
+    selectBestCachedAP();
+  }
   const char* ssid = getLastWiFiSettingsSSID();
   const char* passphrase = getLastWiFiSettingsPassphrase();
   if (loglevelActiveFor(LOG_LEVEL_INFO)) {
@@ -593,10 +784,15 @@ bool tryConnectWiFi() {
     log += wifi_connect_attempt;
     addLog(LOG_LEVEL_INFO, log);
   }
+  if (wifi_connect_attempt != 0 || !wifiFastConnect) {
+    stopFastConnectWiFi();
+  }
   setupStaticIPconfig();
   last_wifi_connect_attempt_moment = millis();
   switch (wifi_connect_attempt) {
     case 0:
+      if (tryFastConnectWiFi(ssid, passphrase))
+        break;
       if (lastBSSID[0] == 0)
         WiFi.begin(ssid, passphrase);
       else
@@ -688,24 +884,48 @@ String formatScanResult(int i, const String& separator) {
   result += F(" (");
   result += WiFi.RSSI(i);
   result += F("dBm) ");
-  switch (WiFi.encryptionType(i)) {
+  result += getWiFiEncryptionName(WiFi.encryptionType(i));
+  return result;
+}
+
+String getWiFiEncryptionName(uint8_t encryption) {
+  switch (encryption) {
   #ifdef ESP32
-    case WIFI_AUTH_OPEN: result += F("open"); break;
-    case WIFI_AUTH_WEP:  result += F("WEP"); break;
-    case WIFI_AUTH_WPA_PSK: result += F("WPA/PSK"); break;
-    case WIFI_AUTH_WPA2_PSK: result += F("WPA2/PSK"); break;
-    case WIFI_AUTH_WPA_WPA2_PSK: result += F("WPA/WPA2/PSK"); break;
-    case WIFI_AUTH_WPA2_ENTERPRISE: result += F("WPA2 Enterprise"); break;
+    case WIFI_AUTH_OPEN: return F("open");
+    case WIFI_AUTH_WEP:  return F("WEP");
+    case WIFI_AUTH_WPA_PSK: return F("WPA/PSK");
+    case WIFI_AUTH_WPA2_PSK: return F("WPA2/PSK");
+    case WIFI_AUTH_WPA_WPA2_PSK: return F("WPA/WPA2/PSK");
+    case WIFI_AUTH_WPA2_ENTERPRISE: return F("WPA2 Enterprise");
   #else
-    case ENC_TYPE_WEP: result += F("WEP"); break;
-    case ENC_TYPE_TKIP: result += F("WPA/PSK"); break;
-    case ENC_TYPE_CCMP: result += F("WPA2/PSK"); break;
-    case ENC_TYPE_NONE: result += F("open"); break;
-    case ENC_TYPE_AUTO: result += F("WPA/WPA2/PSK"); break;
+    case ENC_TYPE_WEP: return F("WEP");
+    case ENC_TYPE_TKIP: return F("WPA/PSK");
+    case ENC_TYPE_CCMP: return F("WPA2/PSK");
+    case ENC_TYPE_NONE: return F("open");
+    case ENC_TYPE_AUTO: return F("WPA/WPA2/PSK");
   #endif
     default:
       break;
   }
+  return "";
+}
+
+// Like formatScanResult(), for an entry of the scan cache.
+String formatScanCacheResult(byte index, const String& separator) {
+  const WiFiScanCacheStruct& ap = WiFiScanCache[index];
+  String result = ap.ssid;
+  if (ap.hidden) {
+    result += F("#Hidden#");
+  }
+  result += separator;
+  result += formatMAC(ap.bssid);
+  result += separator;
+  result += F("Ch:");
+  result += ap.channel;
+  result += F(" (");
+  result += ap.rssi();
+  result += F("dBm) ");
+  result += getWiFiEncryptionName(ap.encryption);
   return result;
 }
 
@@ -719,7 +939,7 @@ String SDKwifiStatusToString(uint8_t sdk_wifistatus) {
     case STATION_CONNECT_FAIL:   return F("STATION_CONNECT_FAIL");
     case STATION_GOT_IP:         return F("STATION_GOT_IP");
   }
-  return F("Unknown");
+  return getWebString(WEB_STR_UNKNOWN);
 }
 #endif
 
@@ -780,7 +1000,7 @@ void logConnectionStatus() {
 //********************************************************************************
 void WifiCheck()
 {
-  if(wifiSetup)
+  if(wifiSetup || sleepWakeWithoutRF() || scheduledRadioOff())
     return;
 
   processDisableAPmode();
@@ -864,7 +1084,7 @@ String getLastDisconnectReason() {
     case WIFI_DISCONNECT_REASON_AUTH_FAIL:                  reason += F("Auth fail");                break;
     case WIFI_DISCONNECT_REASON_ASSOC_FAIL:                 reason += F("Assoc fail");               break;
     case WIFI_DISCONNECT_REASON_HANDSHAKE_TIMEOUT:          reason += F("Handshake timeout");        break;
-    default:  reason += F("Unknown"); 	  break;
+    default:  reason += getWebString(WEB_STR_UNKNOWN); 	  break;
   }
   return reason;
 }
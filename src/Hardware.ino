@@ -35,6 +35,7 @@ void hardwareInit()
     String log = F("INIT : I2C");
     addLog(LOG_LEVEL_INFO, log);
     Wire.begin(Settings.Pin_i2c_sda, Settings.Pin_i2c_scl);
+    I2C_init();
       if(Settings.WireClockStretchLimit)
       {
         String log = F("INIT : I2C custom clockstretchlimit:");
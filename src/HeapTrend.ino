@@ -0,0 +1,49 @@
+//********************************************************************************
+// Heap trend, for the soak tests (see test/soak.py)
+// A node running for days can have plenty of free heap while the largest free
+// block shrinks, until e.g. a MQTT reconnect cannot allocate its buffers. Once per
+// second the free heap and the largest free block are sampled, the lowest values
+// since boot are kept. Together with the current values and the lowest free heap
+// seen by checkRAM() they are exported on /metrics and shown on the sysinfo page.
+// Fragmentation is 100 - largest free block * 100 / free heap.
+//********************************************************************************
+struct HeapTrendStruct
+{
+  HeapTrendStruct() : samples(0), minFree(0), minBlock(0), maxFragmentation(0) {}
+
+  unsigned long samples;
+  uint32_t minFree;
+  uint32_t minBlock;
+  byte maxFragmentation;  // %
+} heapTrend;
+
+byte getHeapFragmentation(uint32_t freeHeap, uint32_t maxBlock) {
+  if (freeHeap == 0 || maxBlock >= freeHeap) return 0;
+  return 100 - (static_cast<uint64_t>(maxBlock) * 100) / freeHeap;
+}
+
+// Called once per second.
+void processHeapTrend() {
+  const uint32_t freeHeap = FreeMem();
+  const uint32_t maxBlock = findMaxFreeBlock();
+  if (heapTrend.samples == 0 || freeHeap < heapTrend.minFree) heapTrend.minFree = freeHeap;
+  if (heapTrend.samples == 0 || maxBlock < heapTrend.minBlock) heapTrend.minBlock = maxBlock;
+  const byte fragmentation = getHeapFragmentation(freeHeap, maxBlock);
+  if (fragmentation > heapTrend.maxFragmentation) heapTrend.maxFragmentation = fragmentation;
+  ++heapTrend.samples;
+}
+
+// Heap trend as: largest free block/lowest/fragmentation %/highest %, empty before the first sample.
+String getHeapTrendStats() {
+  String result;
+  if (heapTrend.samples == 0) return result;
+  const uint32_t maxBlock = findMaxFreeBlock();
+  result += maxBlock;
+  result += '/';
+  result += heapTrend.minBlock;
+  result += '/';
+  result += getHeapFragmentation(FreeMem(), maxBlock);
+  result += '/';
+  result += heapTrend.maxFragmentation;
+  return result;
+}
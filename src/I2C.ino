@@ -1,32 +1,517 @@
+//**************************************************************************/
+// Bus arbitration, device clock and statistics of all I2C transfers
+//**************************************************************************/
+#define I2C_DEFAULT_CLOCK            100000
+#define I2C_DEVICE_CLOCKS_MAX        8
+#define I2C_TRANSACTION_QUEUE_SIZE   16
+#define I2C_BLOCK_CHUNK              32  // Smallest Wire buffer (ESP8266), longer blocks are read in parts
+
+struct I2CDeviceClockStruct {
+  I2CDeviceClockStruct() : address(0), clock(0) {}
+
+  uint8_t address;
+  uint32_t clock;
+} i2cDeviceClocks[I2C_DEVICE_CLOCKS_MAX];
+
+uint32_t i2cCurrentClock = I2C_DEFAULT_CLOCK;
+uint32_t i2cTaskClock = 0;  // Clock of the task being called, see I2C_setTaskClock()
+
+struct I2CStatsStruct {
+  I2CStatsStruct() : transactions(0), nacks(0), busyUsec(0), savedUsec(0), clockSwitches(0), queued(0), queueFull(0), maxQueued(0),
+                     lastTransactions(0), lastBusyUsec(0), lastUpdate(0), rate(0), busyPct(0) {}
+
+  unsigned long transactions;
+  unsigned long nacks;        // Also counts short reads
+  unsigned long busyUsec;
+  unsigned long savedUsec;    // Estimated bus time saved by the transfers above the default clock
+  unsigned long clockSwitches;
+  unsigned long queued;
+  unsigned long queueFull;
+  byte maxQueued;
+  // For the rate shown in sysinfo, see I2C_updateStats()
+  unsigned long lastTransactions;
+  unsigned long lastBusyUsec;
+  unsigned long lastUpdate;
+  float rate;
+  float busyPct;
+} i2cStats;
+
+unsigned long i2cTransferStart = 0;
+
+#ifdef USE_RTOS_MULTITASKING
+// Held during a transfer by the helpers below and the RTOS_TaskI2C worker.
+SemaphoreHandle_t i2cBusMutex = NULL;
+portMUX_TYPE i2cQueueMux = portMUX_INITIALIZER_UNLOCKED;
+TaskHandle_t i2cWorkerHandle = NULL;
+  #define I2C_QUEUE_LOCK    portENTER_CRITICAL(&i2cQueueMux);
+  #define I2C_QUEUE_UNLOCK  portEXIT_CRITICAL(&i2cQueueMux);
+#else
+  #define I2C_QUEUE_LOCK
+  #define I2C_QUEUE_UNLOCK
+#endif
+
+// Transfers wait in the queue until executed, then until their callback is called.
+struct I2CTransactionQueueStruct {
+  I2CTransactionQueueStruct() : first(0), count(0), executed(0) {}
+
+  I2CTransactionStruct entries[I2C_TRANSACTION_QUEUE_SIZE];
+  byte first;
+  byte count;     // Queued, including executed
+  byte executed;  // Done, callback not yet called
+} i2cQueue;
+
+void I2C_init() {
+  #ifdef USE_RTOS_MULTITASKING
+  if (i2cBusMutex == NULL)
+    i2cBusMutex = xSemaphoreCreateRecursiveMutex();
+  #endif
+  i2cCurrentClock = I2C_DEFAULT_CLOCK;
+}
+
+// Clock for the transfers to this device, 0 for the default.
+// For devices which are slower or faster than the others on the bus.
+bool I2C_setDeviceClock(uint8_t i2caddr, uint32_t clock) {
+  int freeSlot = -1;
+  for (byte i = 0; i < I2C_DEVICE_CLOCKS_MAX; ++i) {
+    if (i2cDeviceClocks[i].address == i2caddr) {
+      if (clock == 0) i2cDeviceClocks[i].address = 0;
+      i2cDeviceClocks[i].clock = clock;
+      return true;
+    }
+    if (i2cDeviceClocks[i].address == 0 && freeSlot < 0) freeSlot = i;
+  }
+  if (clock == 0) return true;
+  if (freeSlot < 0) {
+    addLog(LOG_LEVEL_ERROR, F("I2C  : Too many device clock settings"));
+    return false;
+  }
+  i2cDeviceClocks[freeSlot].address = i2caddr;
+  i2cDeviceClocks[freeSlot].clock = clock;
+  return true;
+}
+
+uint32_t I2C_getDeviceClock(uint8_t i2caddr) {
+  for (byte i = 0; i < I2C_DEVICE_CLOCKS_MAX; ++i) {
+    if (i2cDeviceClocks[i].address == i2caddr && i2caddr != 0)
+      return i2cDeviceClocks[i].clock;
+  }
+  return I2C_DEFAULT_CLOCK;
+}
+
+void I2C_switchClock(uint32_t clock) {
+  if (clock != i2cCurrentClock) {
+    Wire.setClock(clock);
+    i2cCurrentClock = clock;
+    ++i2cStats.clockSwitches;
+  }
+}
+
+// Clock set in the task settings, used for all transfers during a plugin call of the
+// task. It is switched right away, so libraries which use Wire directly run at it as well.
+void I2C_setTaskClock(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX || Settings.TaskDeviceI2CClock[TaskIndex] == 0) return;
+  if (Settings.Pin_i2c_sda == -1) return;
+  i2cTaskClock = Settings.TaskDeviceI2CClock[TaskIndex] * 100000UL;
+  I2C_switchClock(i2cTaskClock);
+}
+
+// For libraries which set the clock of the bus themselves, e.g. in connect().
+void I2C_restoreClock() {
+  if (Settings.Pin_i2c_sda == -1) return;
+  i2cCurrentClock = 0;
+  I2C_switchClock(i2cTaskClock != 0 ? i2cTaskClock : I2C_DEFAULT_CLOCK);
+}
+
+// After the plugin call, back to the default for the next task.
+void I2C_clearTaskClock() {
+  if (i2cTaskClock == 0) return;
+  i2cTaskClock = 0;
+  I2C_switchClock(I2C_DEFAULT_CLOCK);
+}
+
+// Take the bus for a transfer to the device, every transfer must be ended by I2C_endTransfer().
+void I2C_beginTransfer(uint8_t i2caddr) {
+  #ifdef USE_RTOS_MULTITASKING
+  if (i2cBusMutex != NULL)
+    xSemaphoreTakeRecursive(i2cBusMutex, portMAX_DELAY);
+  #endif
+  I2C_switchClock(i2cTaskClock != 0 ? i2cTaskClock : I2C_getDeviceClock(i2caddr));
+  i2cTransferStart = micros();
+}
+
+// Result as returned by Wire.endTransmission(), 0 for success.
+void I2C_endTransfer(uint8_t result) {
+  const long duration = usecPassedSince(i2cTransferStart);
+  i2cStats.busyUsec += duration;
+  if (i2cCurrentClock > I2C_DEFAULT_CLOCK)
+    i2cStats.savedUsec += duration * ((i2cCurrentClock - I2C_DEFAULT_CLOCK) / (float)I2C_DEFAULT_CLOCK);
+  ++i2cStats.transactions;
+  if (result != 0) ++i2cStats.nacks;
+  #ifdef USE_RTOS_MULTITASKING
+  if (i2cBusMutex != NULL)
+    xSemaphoreGiveRecursive(i2cBusMutex);
+  #endif
+}
+
+//**************************************************************************/
+// Queued transfers
+//**************************************************************************/
+// Returns false when the queue is full, the callback is then not called.
+bool I2C_queueTransaction(const I2CTransactionStruct& transaction) {
+  if (transaction.writeLength > I2C_TRANSACTION_MAX_DATA || transaction.readLength > I2C_TRANSACTION_MAX_DATA)
+    return false;
+  I2C_QUEUE_LOCK
+  if (i2cQueue.count >= I2C_TRANSACTION_QUEUE_SIZE) {
+    I2C_QUEUE_UNLOCK
+    ++i2cStats.queueFull;
+    return false;
+  }
+  i2cQueue.entries[(i2cQueue.first + i2cQueue.count) % I2C_TRANSACTION_QUEUE_SIZE] = transaction;
+  ++i2cQueue.count;
+  const byte count = i2cQueue.count;
+  I2C_QUEUE_UNLOCK
+  ++i2cStats.queued;
+  if (count > i2cStats.maxQueued) i2cStats.maxQueued = count;
+  #ifdef USE_RTOS_MULTITASKING
+  if (i2cWorkerHandle != NULL)
+    xTaskNotifyGive(i2cWorkerHandle);
+  #endif
+  return true;
+}
+
+void I2C_executeTransaction(I2CTransactionStruct& transaction) {
+  I2C_beginTransfer(transaction.address);
+  Wire.beginTransmission(transaction.address);
+  if (transaction.reg >= 0)
+    Wire.write((uint8_t)transaction.reg);
+  for (byte i = 0; i < transaction.writeLength; ++i)
+    Wire.write(transaction.data[i]);
+  transaction.result = Wire.endTransmission(transaction.readLength == 0);
+  if (transaction.result == 0 && transaction.readLength != 0) {
+    const byte count = Wire.requestFrom(transaction.address, transaction.readLength);
+    for (byte i = 0; i < transaction.readLength; ++i)
+      transaction.data[i] = Wire.available() ? Wire.read() : 0;
+    if (count != transaction.readLength)
+      transaction.result = I2C_RESULT_SHORT_READ;
+  }
+  I2C_endTransfer(transaction.result);
+}
+
+// Execute the next queued transfer, returns false when there is none.
+bool I2C_executeNextTransaction() {
+  I2C_QUEUE_LOCK
+  if (i2cQueue.executed >= i2cQueue.count) {
+    I2C_QUEUE_UNLOCK
+    return false;
+  }
+  // The slot is not touched by others until it is marked executed.
+  I2CTransactionStruct& transaction = i2cQueue.entries[(i2cQueue.first + i2cQueue.executed) % I2C_TRANSACTION_QUEUE_SIZE];
+  I2C_QUEUE_UNLOCK
+  I2C_executeTransaction(transaction);
+  I2C_QUEUE_LOCK
+  ++i2cQueue.executed;
+  I2C_QUEUE_UNLOCK
+  return true;
+}
+
+// Called from backgroundtasks(). Executes a transfer when there is no worker
+// task and calls the callbacks of the transfers that are done.
+void processI2CQueue() {
+  if (i2cQueue.count == 0) return;
+  #ifdef USE_RTOS_MULTITASKING
+  if (i2cWorkerHandle == NULL)
+  #endif
+    I2C_executeNextTransaction();
+  while (true) {
+    I2C_QUEUE_LOCK
+    if (i2cQueue.executed == 0) {
+      I2C_QUEUE_UNLOCK
+      return;
+    }
+    const I2CTransactionStruct transaction = i2cQueue.entries[i2cQueue.first];
+    i2cQueue.first = (i2cQueue.first + 1) % I2C_TRANSACTION_QUEUE_SIZE;
+    --i2cQueue.count;
+    --i2cQueue.executed;
+    I2C_QUEUE_UNLOCK
+    if (transaction.callback != NULL)
+      transaction.callback(transaction);
+  }
+}
+
+// Execute all queued transfers, e.g. before a direct read which depends on queued writes.
+// Plugins hold the state lock, so the worker task is not in the middle of a transfer.
+void I2C_flushQueue() {
+  while (I2C_executeNextTransaction()) {}
+  processI2CQueue();
+}
+
+#ifdef USE_RTOS_MULTITASKING
+// Executes the queued transfers, so the plugin queueing them does not wait
+// for the bus. Plugins which still use Wire directly only run under the state
+// lock, so it is taken for each transfer as well.
+void RTOS_TaskI2C( void * parameter )
+{
+ while (true){
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    bool more = true;
+    while (more) {
+      RTOSStateLock stateLock;
+      more = I2C_executeNextTransaction();
+    }
+ }
+}
+
+void I2C_startWorker() {
+  if (i2cWorkerHandle == NULL)
+    xTaskCreatePinnedToCore(RTOS_TaskI2C, "RTOS_TaskI2C", 4096, NULL, 1, &i2cWorkerHandle, 1);
+}
+#endif
+
+// Rate and bus use since the last call, called every 30 seconds.
+void I2C_updateStats() {
+  const long interval = timePassedSince(i2cStats.lastUpdate);
+  if (i2cStats.lastUpdate != 0 && interval > 0) {
+    i2cStats.rate = 1000.0 * (i2cStats.transactions - i2cStats.lastTransactions) / interval;
+    i2cStats.busyPct = (i2cStats.busyUsec - i2cStats.lastBusyUsec) / (10.0 * interval);
+  }
+  i2cStats.lastTransactions = i2cStats.transactions;
+  i2cStats.lastBusyUsec = i2cStats.busyUsec;
+  i2cStats.lastUpdate = millis();
+}
+
+String getI2CStats() {
+  String result;
+  result += toString(i2cStats.rate, 1);
+  result += '/';
+  result += i2cStats.transactions;
+  result += '/';
+  result += i2cStats.nacks;
+  result += '/';
+  result += toString(i2cStats.busyPct, 1);
+  result += F("%/");
+  result += i2cStats.queued;
+  result += '/';
+  result += i2cStats.queueFull;
+  result += '/';
+  result += i2cStats.maxQueued;
+  result += F(", ");
+  result += i2cStats.savedUsec / 1000;
+  result += F(" ms saved by ");
+  result += i2cStats.clockSwitches;
+  result += F(" clock switches");
+  return result;
+}
+
+//**************************************************************************/
+// Background bus scan
+// I2C_startScan() starts a scan, which probes I2C_SCAN_PER_STEP addresses every
+// 100 msec from run10TimesPerSecond(). A stuck bus or clock stretching then
+// does not block the loop or the web page. The result of the last complete
+// scan stays available while the next scan runs.
+//**************************************************************************/
+#define I2C_SCAN_LAST_ADDRESS     127
+#define I2C_SCAN_PER_STEP           8
+#define I2C_SCAN_MAX_AGE        60000  // msec, the web page starts a new scan for older results
+
+struct I2CScanStruct {
+  I2CScanStruct() : next(0), started(0), finished(0), duration(0), reportToSerial(false) {
+    memset(found, 0, sizeof(found));
+    memset(errors, 0, sizeof(errors));
+    memset(scanFound, 0, sizeof(scanFound));
+    memset(scanErrors, 0, sizeof(scanErrors));
+  }
+
+  uint8_t found[16];       // Bit per address, of the last complete scan
+  uint8_t errors[16];      // Other error than a NACK
+  uint8_t scanFound[16];   // Of the running scan
+  uint8_t scanErrors[16];
+  uint8_t next;            // Next address to probe, 0 when not running
+  unsigned long started;
+  unsigned long finished;  // millis() at the end of the last complete scan, 0 for none
+  unsigned long duration;
+  bool reportToSerial;     // Print the result when done, for the i2cscanner command
+} i2cScan;
+
+// With reportToSerial the result is printed when the scan is done.
+void I2C_startScan(bool reportToSerial) {
+  if (reportToSerial) i2cScan.reportToSerial = true;
+  if (i2cScan.next != 0) return;
+  memset(i2cScan.scanFound, 0, sizeof(i2cScan.scanFound));
+  memset(i2cScan.scanErrors, 0, sizeof(i2cScan.scanErrors));
+  i2cScan.started = millis();
+  i2cScan.next = 1;
+}
+
+// Called 10 times per second.
+void I2C_scanStep() {
+  if (i2cScan.next == 0) return;
+  if (Settings.Pin_i2c_sda != -1) {
+    for (byte n = 0; n < I2C_SCAN_PER_STEP && i2cScan.next <= I2C_SCAN_LAST_ADDRESS; ++n, ++i2cScan.next) {
+      const uint8_t address = i2cScan.next;
+      const uint8_t error = I2C_wakeup(address);
+      if (error == 0)      i2cScan.scanFound[address >> 3] |= 1 << (address & 7);
+      else if (error == 4) i2cScan.scanErrors[address >> 3] |= 1 << (address & 7);
+    }
+    if (i2cScan.next <= I2C_SCAN_LAST_ADDRESS) return;
+  }
+  memcpy(i2cScan.found, i2cScan.scanFound, sizeof(i2cScan.found));
+  memcpy(i2cScan.errors, i2cScan.scanErrors, sizeof(i2cScan.errors));
+  i2cScan.next = 0;
+  i2cScan.duration = timePassedSince(i2cScan.started);
+  i2cScan.finished = millis();
+  if (i2cScan.finished == 0) i2cScan.finished = 1;
+  if (i2cScan.reportToSerial) {
+    i2cScan.reportToSerial = false;
+    I2C_reportScan();
+  }
+}
+
+bool I2C_scanRunning() {
+  return i2cScan.next != 0;
+}
+
+// A complete scan is available.
+bool I2C_scanValid() {
+  return i2cScan.finished != 0;
+}
+
+// msec since the last complete scan.
+unsigned long I2C_scanAge() {
+  return I2C_scanValid() ? timePassedSince(i2cScan.finished) : 0;
+}
+
+unsigned long I2C_scanDuration() {
+  return i2cScan.duration;
+}
+
+// Addresses probed by the running scan.
+byte I2C_scanProgress() {
+  return i2cScan.next == 0 ? 0 : i2cScan.next - 1;
+}
+
+bool I2C_scanFound(uint8_t address) {
+  if (address > I2C_SCAN_LAST_ADDRESS) return false;
+  return i2cScan.found[address >> 3] & (1 << (address & 7));
+}
+
+bool I2C_scanError(uint8_t address) {
+  if (address > I2C_SCAN_LAST_ADDRESS) return false;
+  return i2cScan.errors[address >> 3] & (1 << (address & 7));
+}
+
+void I2C_reportScan() {
+  for (uint8_t address = 1; address <= I2C_SCAN_LAST_ADDRESS; address++) {
+    if (I2C_scanFound(address)) {
+      Serial.print(F("I2C  : Found 0x"));
+      Serial.println(String(address, HEX));
+    } else if (I2C_scanError(address)) {
+      Serial.print(F("I2C  : Error at 0x"));
+      Serial.println(String(address, HEX));
+    }
+  }
+}
+
 //**************************************************************************/
 // Central functions for I2C data transfers
 //**************************************************************************/
 bool I2C_read_bytes(uint8_t i2caddr, I2Cdata_bytes& data) {
   const uint8_t size = data.getSize();
-  return size == i2cdev.readBytes(i2caddr, data.getRegister(), size, data.get());
+  I2C_beginTransfer(i2caddr);
+  const bool success = size == i2cdev.readBytes(i2caddr, data.getRegister(), size, data.get());
+  I2C_endTransfer(success ? 0 : I2C_RESULT_SHORT_READ);
+  return success;
+}
+
+//**************************************************************************/
+// Reads length bytes of consecutive registers, starting at reg, in one transfer.
+// For devices which increment the register address while reading.
+//**************************************************************************/
+bool I2C_read_block(uint8_t i2caddr, uint8_t reg, uint8_t* data, uint8_t length) {
+  uint8_t done = 0;
+  while (done < length) {
+    const uint8_t chunk = (length - done) > I2C_BLOCK_CHUNK ? I2C_BLOCK_CHUNK : (length - done);
+    I2C_beginTransfer(i2caddr);
+    Wire.beginTransmission(i2caddr);
+    Wire.write((uint8_t)(reg + done));
+    uint8_t result = Wire.endTransmission(false);
+    if (result == 0) {
+      const byte count = Wire.requestFrom(i2caddr, chunk);
+      for (byte i = 0; i < chunk; ++i)
+        data[done + i] = Wire.available() ? Wire.read() : 0;
+      if (count != chunk) result = I2C_RESULT_SHORT_READ;
+    }
+    I2C_endTransfer(result);
+    if (result != 0) return false;
+    done += chunk;
+  }
+  return true;
+}
+
+//**************************************************************************/
+// Calibration data cache
+// Factory calibration registers do not change, so a block is only read from
+// the device once. Clear it when another chip may be at the address.
+//**************************************************************************/
+std::map<uint16_t, std::vector<uint8_t> > i2cCalibrationCache;  // Key: address << 8 | register
+
+bool I2C_read_calibration(uint8_t i2caddr, uint8_t reg, uint8_t* data, uint8_t length) {
+  const uint16_t key = (static_cast<uint16_t>(i2caddr) << 8) | reg;
+  auto it = i2cCalibrationCache.find(key);
+  if (it != i2cCalibrationCache.end() && it->second.size() == length) {
+    memcpy(data, &(it->second[0]), length);
+    return true;
+  }
+  if (!I2C_read_block(i2caddr, reg, data, length)) return false;
+  i2cCalibrationCache[key].assign(data, data + length);
+  return true;
+}
+
+void I2C_clear_calibration(uint8_t i2caddr) {
+  auto it = i2cCalibrationCache.lower_bound(static_cast<uint16_t>(i2caddr) << 8);
+  while (it != i2cCalibrationCache.end() && (it->first >> 8) == i2caddr)
+    it = i2cCalibrationCache.erase(it);
+}
+
+// Values in a block read by I2C_read_block()
+uint16_t I2C_block_LE16(const uint8_t* data, uint8_t offset) {
+  return data[offset] | (static_cast<uint16_t>(data[offset + 1]) << 8);
+}
+
+uint16_t I2C_block_BE16(const uint8_t* data, uint8_t offset) {
+  return (static_cast<uint16_t>(data[offset]) << 8) | data[offset + 1];
 }
 
 bool I2C_read_words(uint8_t i2caddr, I2Cdata_words& data) {
   const uint8_t size = data.getSize();
-  return size == i2cdev.readWords(i2caddr, data.getRegister(), size, data.get());
+  I2C_beginTransfer(i2caddr);
+  const bool success = size == i2cdev.readWords(i2caddr, data.getRegister(), size, data.get());
+  I2C_endTransfer(success ? 0 : I2C_RESULT_SHORT_READ);
+  return success;
 }
 
 
 //**************************************************************************/
-// Wake up I2C device
+// Wake up I2C device, also used to check if a device is present.
+// Returns the result of Wire.endTransmission(), 0 when the device acknowledged.
 //**************************************************************************/
-void I2C_wakeup(uint8_t i2caddr) {
+uint8_t I2C_wakeup(uint8_t i2caddr) {
+  I2C_beginTransfer(i2caddr);
   Wire.beginTransmission(i2caddr);
-  Wire.endTransmission();
+  const uint8_t result = Wire.endTransmission();
+  I2C_endTransfer(result);
+  return result;
 }
 
 //**************************************************************************/
 // Writes an 8 bit value over I2C
 //**************************************************************************/
 bool I2C_write8(uint8_t i2caddr, byte value) {
+  I2C_beginTransfer(i2caddr);
   Wire.beginTransmission(i2caddr);
   Wire.write((uint8_t)value);
-  return (Wire.endTransmission() == 0);
+  const uint8_t result = Wire.endTransmission();
+  I2C_endTransfer(result);
+  return result == 0;
 }
 
 
@@ -34,21 +519,27 @@ bool I2C_write8(uint8_t i2caddr, byte value) {
 // Writes an 8 bit value over I2C to a register
 //**************************************************************************/
 bool I2C_write8_reg(uint8_t i2caddr, byte reg, byte value) {
+  I2C_beginTransfer(i2caddr);
   Wire.beginTransmission(i2caddr);
   Wire.write((uint8_t)reg);
   Wire.write((uint8_t)value);
-  return (Wire.endTransmission() == 0);
+  const uint8_t result = Wire.endTransmission();
+  I2C_endTransfer(result);
+  return result == 0;
 }
 
 //**************************************************************************/
 // Writes an 16 bit value over I2C to a register
 //**************************************************************************/
 bool I2C_write16_reg(uint8_t i2caddr, byte reg, uint16_t value) {
+  I2C_beginTransfer(i2caddr);
   Wire.beginTransmission(i2caddr);
   Wire.write((uint8_t)reg);
   Wire.write((uint8_t)(value >> 8));
   Wire.write((uint8_t)value);
-  return (Wire.endTransmission() == 0);
+  const uint8_t result = Wire.endTransmission();
+  I2C_endTransfer(result);
+  return result == 0;
 }
 
 //**************************************************************************/
@@ -64,6 +555,7 @@ bool I2C_write16_LE_reg(uint8_t i2caddr, byte reg, uint16_t value) {
 uint8_t I2C_read8_reg(uint8_t i2caddr, byte reg, bool * is_ok) {
   uint8_t value;
 
+  I2C_beginTransfer(i2caddr);
   Wire.beginTransmission(i2caddr);
   Wire.write((uint8_t)reg);
   Wire.endTransmission(false);
@@ -72,6 +564,7 @@ uint8_t I2C_read8_reg(uint8_t i2caddr, byte reg, bool * is_ok) {
     *is_ok = (count == 1);
   }
   value = Wire.read();
+  I2C_endTransfer(count == 1 ? 0 : I2C_RESULT_SHORT_READ);
 
   return value;
 }
@@ -82,11 +575,13 @@ uint8_t I2C_read8_reg(uint8_t i2caddr, byte reg, bool * is_ok) {
 uint16_t I2C_read16_reg(uint8_t i2caddr, byte reg) {
   uint16_t value(0);
 
+  I2C_beginTransfer(i2caddr);
   Wire.beginTransmission(i2caddr);
   Wire.write((uint8_t)reg);
   Wire.endTransmission(false);
-  Wire.requestFrom(i2caddr, (byte)2);
+  const byte count = Wire.requestFrom(i2caddr, (byte)2);
   value = (Wire.read() << 8) | Wire.read();
+  I2C_endTransfer(count == 2 ? 0 : I2C_RESULT_SHORT_READ);
 
   return value;
 }
@@ -97,11 +592,13 @@ uint16_t I2C_read16_reg(uint8_t i2caddr, byte reg) {
 int32_t I2C_read24_reg(uint8_t i2caddr, byte reg) {
   int32_t value;
 
+  I2C_beginTransfer(i2caddr);
   Wire.beginTransmission(i2caddr);
   Wire.write((uint8_t)reg);
   Wire.endTransmission(false);
-  Wire.requestFrom(i2caddr, (byte)3);
+  const byte count = Wire.requestFrom(i2caddr, (byte)3);
   value = (((int32_t)Wire.read()) << 16) | (Wire.read() << 8) | Wire.read();
+  I2C_endTransfer(count == 3 ? 0 : I2C_RESULT_SHORT_READ);
 
   return value;
 }
@@ -112,11 +609,13 @@ int32_t I2C_read24_reg(uint8_t i2caddr, byte reg) {
 int32_t I2C_read32_reg(uint8_t i2caddr, byte reg) {
   int32_t value;
 
+  I2C_beginTransfer(i2caddr);
   Wire.beginTransmission(i2caddr);
   Wire.write((uint8_t)reg);
   Wire.endTransmission(false);
-  Wire.requestFrom(i2caddr, (byte)3);
+  const byte count = Wire.requestFrom(i2caddr, (byte)4);
   value = (((int32_t)Wire.read()) <<24) | (((uint32_t)Wire.read()) << 16) | (Wire.read() << 8) | Wire.read();
+  I2C_endTransfer(count == 4 ? 0 : I2C_RESULT_SHORT_READ);
 
   return value;
 }
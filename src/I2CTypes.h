@@ -50,3 +50,29 @@ private:
 
 typedef I2Cdata<uint8_t> I2Cdata_bytes;
 typedef I2Cdata<uint16_t> I2Cdata_words;
+
+//**************************************************************************/
+// Queued I2C transfer, see I2C_queueTransaction()
+// Writes the register (when reg >= 0) and writeLength bytes of data, then
+// reads readLength bytes into data. The callback is called from the main loop
+// when the transfer is done, with result 0 on success.
+//**************************************************************************/
+#define I2C_TRANSACTION_MAX_DATA     16
+#define I2C_RESULT_SHORT_READ       16  // Less bytes read than requested, the Wire results are 0..4
+
+struct I2CTransactionStruct;
+typedef void (*I2CTransactionCallback)(const I2CTransactionStruct& transaction);
+
+struct I2CTransactionStruct {
+  I2CTransactionStruct() :
+    address(0), reg(-1), writeLength(0), readLength(0), result(0), callback(NULL), arg(0) {}
+
+  uint8_t address;
+  int16_t reg;
+  uint8_t writeLength;
+  uint8_t readLength;
+  uint8_t data[I2C_TRANSACTION_MAX_DATA];
+  uint8_t result;
+  I2CTransactionCallback callback;  // May be NULL
+  uint32_t arg;                     // For the caller, e.g. the task index
+};
@@ -0,0 +1,202 @@
+#ifndef JSON_WRITER_H_
+#define JSON_WRITER_H_
+
+#include <Arduino.h>
+
+unsigned int formatFloat(double value, byte decimals, char* buffer);
+
+//**************************************************************************/
+// Streaming JSON writer, emits the text piece by piece to a write function
+// (e.g. the web server TXBuffer), a String or a fixed buffer.
+// Separators between members and array elements are added by the writer and
+// strings are escaped while writing, so no intermediate String is built.
+//**************************************************************************/
+#define JSON_WRITER_MAX_DEPTH  16
+
+class JsonWriter {
+public:
+  typedef void (*WriteFunction)(void* context, const char* data, unsigned int length);
+
+  JsonWriter(WriteFunction function, void* writeContext) :
+    write(function), context(writeContext), buffer(NULL), size(0), used(0), depth(0), notFirst(0), afterKey(false), lineBreaks(false) {}
+
+  // Appends to the String.
+  explicit JsonWriter(String& output) :
+    write(writeToString), context(&output), buffer(NULL), size(0), used(0), depth(0), notFirst(0), afterKey(false), lineBreaks(false) {}
+
+  // Into a fixed buffer, text which does not fit is dropped, see overflow().
+  JsonWriter(char* output, unsigned int outputSize) :
+    write(NULL), context(NULL), buffer(output), size(outputSize), used(0), depth(0), notFirst(0), afterKey(false), lineBreaks(false) {
+    if (size != 0) buffer[0] = 0;
+  }
+
+  void beginObject()                        { open('{'); }
+  void endObject()                          { close('}'); }
+  void beginArray()                         { open('['); }
+  void endArray()                           { close(']'); }
+
+  void key(const char* name)                { separator(); quoted(name, strlen(name)); raw(':'); afterKey = true; }
+  void key(const __FlashStringHelper* name) { separator(); quoted(name); raw(':'); afterKey = true; }
+
+  void value(const char* text)              { separator(); quoted(text, strlen(text)); }
+  void value(const String& text)            { separator(); quoted(text.c_str(), text.length()); }
+  void value(const __FlashStringHelper* text) { separator(); quoted(text); }
+  void value(unsigned long number)          { char str[12]; ultoa(number, str, 10); numberText(str); }
+  void value(long number)                   { char str[12]; ltoa(number, str, 10); numberText(str); }
+  void value(unsigned int number)           { value(static_cast<unsigned long>(number)); }
+  void value(int number)                    { value(static_cast<long>(number)); }
+  void value(float number, byte decimals)   { char str[24]; formatFloat(number, decimals, str); numberText(str); }
+  void valueBool(bool state)                { separator(); raw(state ? "true" : "false"); }
+  void valueNull()                          { separator(); raw("null"); }
+
+  // Text already formatted as number (e.g. by formatUserVar), quoted when it is not a valid number, like "nan".
+  void valueNumber(const char* text)        { numberText(text); }
+
+  template<typename K, typename V> void member(K name, const V& item)    { key(name); value(item); }
+  template<typename K> void member(K name, float number, byte decimals)  { key(name); value(number, decimals); }
+  template<typename K> void memberBool(K name, bool state)               { key(name); valueBool(state); }
+  template<typename K> void memberNumber(K name, const char* text)       { key(name); valueNumber(text); }
+
+  // Formatting only, not checked.
+  void raw(const char* text)               { emit(text, strlen(text)); }
+  void raw(char c)                         { emit(&c, 1); }
+
+  // A line end after each ',' to keep larger output readable.
+  void setLineBreaks(bool enabled)         { lineBreaks = enabled; }
+
+  // Text which did not fit in the fixed buffer.
+  bool overflow() const                    { return buffer != NULL && used >= size; }
+  unsigned int length() const              { return used; }
+
+  static void writeToString(void* output, const char* data, unsigned int length) {
+    String& str = *static_cast<String*>(output);
+    str.reserve(str.length() + length);
+    for (unsigned int i = 0; i < length; ++i)
+      str += data[i];
+  }
+
+private:
+  void emit(const char* data, unsigned int length) {
+    if (length == 0) return;
+    if (buffer == NULL) {
+      write(context, data, length);
+      used += length;
+      return;
+    }
+    if (used >= size) return;
+    unsigned int room = size - used - 1;
+    if (length > room) {
+      memcpy(buffer + used, data, room);
+      used = size;  // Marks the overflow
+      buffer[size - 1] = 0;
+      return;
+    }
+    memcpy(buffer + used, data, length);
+    used += length;
+    buffer[used] = 0;
+  }
+
+  // A ',' before every member or element except the first.
+  void separator() {
+    if (afterKey) {
+      afterKey = false;
+      return;
+    }
+    if (depth == 0) return;
+    const uint16_t mask = 1 << (depth - 1);
+    if (notFirst & mask)
+      raw(lineBreaks ? ",\n" : ",");
+    else
+      notFirst |= mask;
+  }
+
+  void open(char c) {
+    separator();
+    raw(c);
+    if (depth < JSON_WRITER_MAX_DEPTH) {
+      ++depth;
+      notFirst &= ~(1 << (depth - 1));
+    }
+  }
+
+  void close(char c) {
+    if (depth > 0) --depth;
+    raw(c);
+  }
+
+  void numberText(const char* text) {
+    const char* digits = (text[0] == '-') ? text + 1 : text;
+    if (isdigit(digits[0])) {
+      separator();
+      raw(text);
+    } else {
+      value(text);
+    }
+  }
+
+  // Escaped per chunk of plain characters.
+  void quoted(const char* text, unsigned int length) {
+    raw('"');
+    unsigned int start = 0;
+    for (unsigned int i = 0; i < length; ++i) {
+      const char c = text[i];
+      if (c != '"' && c != '\\' && static_cast<uint8_t>(c) >= 0x20) continue;
+      emit(text + start, i - start);
+      start = i + 1;
+      escape(c);
+    }
+    emit(text + start, length - start);
+    raw('"');
+  }
+
+  // Flash strings are copied in small parts.
+  void quoted(const __FlashStringHelper* text) {
+    PGM_P p = reinterpret_cast<PGM_P>(text);
+    raw('"');
+    char part[32];
+    unsigned int count = 0;
+    char c;
+    while ((c = pgm_read_byte(p++)) != 0) {
+      if (c == '"' || c == '\\' || static_cast<uint8_t>(c) < 0x20) {
+        emit(part, count);
+        count = 0;
+        escape(c);
+        continue;
+      }
+      part[count++] = c;
+      if (count == sizeof(part)) {
+        emit(part, count);
+        count = 0;
+      }
+    }
+    emit(part, count);
+    raw('"');
+  }
+
+  void escape(char c) {
+    char sequence[7] = { '\\', c, 0 };
+    switch (c) {
+      case '"':
+      case '\\': break;
+      case '\n': sequence[1] = 'n'; break;
+      case '\r': sequence[1] = 'r'; break;
+      case '\t': sequence[1] = 't'; break;
+      default:
+        snprintf_P(sequence, sizeof(sequence), PSTR("\\u%04x"), static_cast<uint8_t>(c));
+        break;
+    }
+    raw(sequence);
+  }
+
+  WriteFunction write;
+  void* context;
+  char* buffer;
+  unsigned int size;
+  unsigned int used;
+  byte depth;
+  uint16_t notFirst;  // Bit per nesting level, set when it has a member or element
+  bool afterKey;
+  bool lineBreaks;
+};
+
+#endif // JSON_WRITER_H_
@@ -0,0 +1,151 @@
+#ifndef MQTT_TOPIC_TRIE_H_
+#define MQTT_TOPIC_TRIE_H_
+
+#include <Arduino.h>
+#include <vector>
+
+//**************************************************************************/
+// Index of MQTT subscriptions, matching a topic against all of them in one pass.
+// Subscriptions are split in levels, which are stored as a tree. Levels may be
+// the wildcards "+" (any single level) and "#" (any remaining levels).
+// A leading or trailing '/' is ignored, for compatibility with the MQTT import plugin.
+//**************************************************************************/
+class MQTTTopicTrie {
+public:
+  typedef void (*MatchCallback)(uint16_t id, void* context);
+
+  MQTTTopicTrie() {
+    clear();
+  }
+
+  void clear() {
+    nodes.clear();
+    segments.clear();
+    entries.clear();
+    // Node 0 is the root, its children are the first levels.
+    nodes.push_back(newNode(0, 0));
+  }
+
+  bool isEmpty() const {
+    return entries.empty();
+  }
+
+  // Add a subscription, id is reported for every matching topic.
+  void add(const char* filter, uint16_t id) {
+    const char* pos = skipSlash(filter);
+    uint16_t parent = 0;
+    while (*pos != 0) {
+      const char* end = levelEnd(pos);
+      parent = findOrAddChild(parent, pos, end - pos);
+      if (*end == 0) break;
+      pos = end + 1;
+    }
+    if (parent == 0) return;
+    Entry entry;
+    entry.id = id;
+    entry.next = nodes[parent].firstEntry;
+    nodes[parent].firstEntry = entries.size();
+    entries.push_back(entry);
+  }
+
+  // Call callback for every subscription matching the topic, returns the number of matches.
+  unsigned int match(const char* topic, MatchCallback callback, void* context) const {
+    if (entries.empty()) return 0;
+    return matchLevel(nodes[0].child, skipSlash(topic), callback, context);
+  }
+
+private:
+  struct Node {
+    uint16_t segment;     // Offset of the level name in segments
+    uint8_t  length;
+    int16_t  child;       // First node of the next level
+    int16_t  sibling;     // Next node of the same level
+    int16_t  firstEntry;  // Subscriptions ending at this node
+  };
+
+  struct Entry {
+    uint16_t id;
+    int16_t  next;
+  };
+
+  static const char* skipSlash(const char* topic) {
+    return (*topic == '/') ? topic + 1 : topic;
+  }
+
+  static const char* levelEnd(const char* pos) {
+    while (*pos != 0 && *pos != '/') ++pos;
+    return pos;
+  }
+
+  bool isLevel(const Node& node, const char* name, uint8_t length) const {
+    return node.length == length && (length == 0 || memcmp(segments.data() + node.segment, name, length) == 0);
+  }
+
+  bool isWildcard(const Node& node, char wildcard) const {
+    return node.length == 1 && segments[node.segment] == wildcard;
+  }
+
+  static Node newNode(uint16_t segment, uint8_t length) {
+    Node node;
+    node.segment = segment;
+    node.length = length;
+    node.child = -1;
+    node.sibling = -1;
+    node.firstEntry = -1;
+    return node;
+  }
+
+  uint16_t findOrAddChild(uint16_t parent, const char* name, uint8_t length) {
+    for (int16_t i = nodes[parent].child; i >= 0; i = nodes[i].sibling) {
+      if (isLevel(nodes[i], name, length)) return i;
+    }
+    Node node = newNode(segments.size(), length);
+    segments.insert(segments.end(), name, name + length);
+    node.sibling = nodes[parent].child;
+    const uint16_t index = nodes.size();
+    nodes.push_back(node);
+    nodes[parent].child = index;
+    return index;
+  }
+
+  unsigned int reportEntries(const Node& node, MatchCallback callback, void* context) const {
+    unsigned int count = 0;
+    for (int16_t e = node.firstEntry; e >= 0; e = entries[e].next) {
+      callback(entries[e].id, context);
+      ++count;
+    }
+    return count;
+  }
+
+  unsigned int matchLevel(int16_t first, const char* pos, MatchCallback callback, void* context) const {
+    const char* end = levelEnd(pos);
+    const uint8_t length = end - pos;
+    const bool lastLevel = (*end == 0) || (*end == '/' && end[1] == 0);
+    unsigned int count = 0;
+    for (int16_t i = first; i >= 0; i = nodes[i].sibling) {
+      const Node& node = nodes[i];
+      if (isWildcard(node, '#')) {
+        count += reportEntries(node, callback, context);
+        continue;
+      }
+      if (!isWildcard(node, '+') && !isLevel(node, pos, length)) continue;
+      if (lastLevel) {
+        count += reportEntries(node, callback, context);
+        // "a/#" also matches "a"
+        for (int16_t c = node.child; c >= 0; c = nodes[c].sibling) {
+          if (isWildcard(nodes[c], '#'))
+            count += reportEntries(nodes[c], callback, context);
+        }
+      } else if (node.child >= 0) {
+        count += matchLevel(node.child, end + 1, callback, context);
+      }
+    }
+    return count;
+  }
+
+  std::vector<Node>  nodes;
+  std::vector<char>  segments;
+  std::vector<Entry> entries;
+};
+
+#endif // MQTT_TOPIC_TRIE_H_
@@ -0,0 +1,286 @@
+//********************************************************************************
+// Buffer allocation
+// Large buffers which are not used from interrupts or time critical code are
+// allocated with allocBuffer(). On ESP32 boards with PSRAM (WROVER, built with
+// BOARD_HAS_PSRAM) they are put in PSRAM, so the internal RAM stays available
+// for WiFi, lwIP and the hot data. Without PSRAM, or when it is full, the
+// buffer comes from internal RAM like a plain malloc().
+//********************************************************************************
+#define MEM_POOL_SERIAL           0  // Serial receive and ring buffers (SerialRx, P020, P044)
+#define MEM_POOL_WEB              1  // File transfer buffers of the web server
+#define MEM_POOL_SETTINGS         2  // Settings snapshot buffers
+#define MEM_POOL_ADC              3  // ADC sampling ring
+#define MEM_POOL_LED              4  // NeoPixel RMT items
+#define MEM_POOL_TONE             5  // Tone player note lists
+#define MEM_POOL_IR               6  // IR transmit queue (P035)
+#define MEM_POOL_OUTPUT           7  // Output sequencer steps
+#define MEM_POOL_NR               8
+#define MEM_PSRAM_MIN_SIZE      512  // Smaller buffers stay in internal RAM
+
+#if defined(ESP32) && defined(BOARD_HAS_PSRAM)
+  #define MEM_USE_PSRAM
+  #include <esp_heap_caps.h>
+  #include <soc/soc.h>
+#endif
+
+struct memPoolStatsStruct
+{
+  memPoolStatsStruct() : internalBytes(0), psramBytes(0), maxBytes(0), failed(0) {}
+
+  unsigned long internalBytes;  // In use
+  unsigned long psramBytes;
+  unsigned long maxBytes;       // Highest total in use
+  unsigned long failed;         // Allocations which could not be done at all
+} memPoolStats[MEM_POOL_NR];
+
+bool psramAvailable() {
+  #ifdef MEM_USE_PSRAM
+  return psramFound();
+  #else
+  return false;
+  #endif
+}
+
+bool isPsramBuffer(const void* buffer) {
+  #ifdef MEM_USE_PSRAM
+  const uint32_t address = reinterpret_cast<uint32_t>(buffer);
+  return address >= SOC_EXTRAM_DATA_LOW && address < SOC_EXTRAM_DATA_HIGH;
+  #else
+  return false;
+  #endif
+}
+
+// Returns NULL when there is no memory left. Release with freeBuffer(), using the same pool and size.
+void* allocBuffer(byte pool, size_t size) {
+  if (pool >= MEM_POOL_NR || size == 0) return NULL;
+  memPoolStatsStruct& stats = memPoolStats[pool];
+  void* buffer = NULL;
+  #ifdef MEM_USE_PSRAM
+  if (size >= MEM_PSRAM_MIN_SIZE && psramFound()) {
+    buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (buffer != NULL) stats.psramBytes += size;
+  }
+  #endif
+  if (buffer == NULL) {
+    buffer = malloc(size);
+    if (buffer == NULL) {
+      ++stats.failed;
+      return NULL;
+    }
+    stats.internalBytes += size;
+  }
+  const unsigned long total = stats.internalBytes + stats.psramBytes;
+  if (total > stats.maxBytes) stats.maxBytes = total;
+  return buffer;
+}
+
+void freeBuffer(byte pool, void* buffer, size_t size) {
+  if (buffer == NULL || pool >= MEM_POOL_NR) return;
+  memPoolStatsStruct& stats = memPoolStats[pool];
+  unsigned long& inUse = isPsramBuffer(buffer) ? stats.psramBytes : stats.internalBytes;
+  inUse = inUse > size ? inUse - size : 0;
+  free(buffer);
+}
+
+String getMemPoolName(byte pool) {
+  switch (pool) {
+    case MEM_POOL_SERIAL:   return F("Serial");
+    case MEM_POOL_WEB:      return F("Web");
+    case MEM_POOL_SETTINGS: return F("Settings");
+    case MEM_POOL_ADC:      return F("ADC");
+    case MEM_POOL_LED:      return F("LED");
+    case MEM_POOL_TONE:     return F("Tone");
+    case MEM_POOL_IR:       return F("IR");
+    case MEM_POOL_OUTPUT:   return F("Output");
+  }
+  return F("unknown");
+}
+
+// Pool usage as: internal/PSRAM/max bytes, failed allocations
+String getMemPoolStats(byte pool) {
+  if (pool >= MEM_POOL_NR) return "";
+  const memPoolStatsStruct& stats = memPoolStats[pool];
+  String result;
+  result += stats.internalBytes;
+  result += '/';
+  result += stats.psramBytes;
+  result += '/';
+  result += stats.maxBytes;
+  result += ' ';
+  result += stats.failed;
+  return result;
+}
+
+//********************************************************************************
+// Memory blocks
+// Small allocations which come and go while the node runs (the text of queued
+// rules events, ...) are taken with allocBlock() from a fixed set of blocks of
+// 32, 64, 128 and 256 bytes, reserved at boot. They then do not leave holes
+// between the longer lived allocations on the heap, which is what makes the
+// largest free block shrink over days. A request goes to the smallest class
+// with a free block, and to malloc() when all blocks which fit are in use or it
+// is larger than 256 bytes. Not to be used from interrupts.
+//********************************************************************************
+#define MEM_BLOCK_CLASSES         4
+#ifdef ESP32
+  #define MEM_BLOCK_SCALE         2
+#else
+  #define MEM_BLOCK_SCALE         1
+#endif
+#define MEM_BLOCK_MAX_SIZE      256
+
+#ifdef USE_RTOS_MULTITASKING
+portMUX_TYPE memBlockMux = portMUX_INITIALIZER_UNLOCKED;
+  #define MEM_BLOCK_LOCK    portENTER_CRITICAL(&memBlockMux);
+  #define MEM_BLOCK_UNLOCK  portEXIT_CRITICAL(&memBlockMux);
+#else
+  #define MEM_BLOCK_LOCK
+  #define MEM_BLOCK_UNLOCK
+#endif
+
+const uint16_t memBlockSize[MEM_BLOCK_CLASSES] = { 32, 64, 128, MEM_BLOCK_MAX_SIZE };
+// At most 32 per class, the used blocks are a bit mask
+const byte memBlockCount[MEM_BLOCK_CLASSES] = { 16 * MEM_BLOCK_SCALE, 8 * MEM_BLOCK_SCALE, 4 * MEM_BLOCK_SCALE, 2 * MEM_BLOCK_SCALE };
+#define MEM_BLOCK_STORAGE_SIZE  (2048 * MEM_BLOCK_SCALE)   // Sum of size * count
+
+uint32_t memBlockStorage[MEM_BLOCK_STORAGE_SIZE / sizeof(uint32_t)];
+
+struct memBlockClassStruct
+{
+  memBlockClassStruct() : storage(NULL), used(0), inUse(0), maxInUse(0), fallbacks(0) {}
+
+  byte* storage;
+  uint32_t used;              // Bit per block
+  byte inUse;
+  byte maxInUse;
+  unsigned long fallbacks;    // Fits, but taken from the heap as all blocks which fit were in use
+} memBlockClass[MEM_BLOCK_CLASSES];
+
+unsigned long memBlockLarge = 0;  // Larger than MEM_BLOCK_MAX_SIZE, from the heap
+
+void initMemBlocks() {
+  byte* storage = reinterpret_cast<byte*>(memBlockStorage);
+  for (byte cls = 0; cls < MEM_BLOCK_CLASSES; ++cls) {
+    memBlockClass[cls].storage = storage;
+    storage += memBlockSize[cls] * memBlockCount[cls];
+  }
+}
+
+// Returns NULL when there is no memory left. Release with freeBlock().
+void* allocBlock(size_t size) {
+  if (size == 0) return NULL;
+  if (memBlockClass[0].storage == NULL) initMemBlocks();
+  int firstFit = -1;
+  MEM_BLOCK_LOCK
+  for (byte cls = 0; cls < MEM_BLOCK_CLASSES; ++cls) {
+    if (size > memBlockSize[cls]) continue;
+    if (firstFit < 0) firstFit = cls;
+    memBlockClassStruct& blocks = memBlockClass[cls];
+    if (blocks.inUse == memBlockCount[cls]) continue;
+    const byte index = __builtin_ctz(~blocks.used);
+    blocks.used |= 1UL << index;
+    if (++blocks.inUse > blocks.maxInUse) blocks.maxInUse = blocks.inUse;
+    MEM_BLOCK_UNLOCK
+    return blocks.storage + index * memBlockSize[cls];
+  }
+  if (firstFit < 0) ++memBlockLarge;
+  else ++memBlockClass[firstFit].fallbacks;
+  MEM_BLOCK_UNLOCK
+  return malloc(size);
+}
+
+void freeBlock(void* block) {
+  if (block == NULL) return;
+  const byte* address = static_cast<const byte*>(block);
+  const byte* storage = reinterpret_cast<const byte*>(memBlockStorage);
+  if (address < storage || address >= storage + MEM_BLOCK_STORAGE_SIZE) {
+    free(block);
+    return;
+  }
+  MEM_BLOCK_LOCK
+  for (byte cls = MEM_BLOCK_CLASSES; cls-- > 0; ) {
+    memBlockClassStruct& blocks = memBlockClass[cls];
+    if (address < blocks.storage) continue;
+    const uint32_t bit = 1UL << ((address - blocks.storage) / memBlockSize[cls]);
+    if (blocks.used & bit) {
+      blocks.used &= ~bit;
+      --blocks.inUse;
+    }
+    break;
+  }
+  MEM_BLOCK_UNLOCK
+}
+
+// Block class usage as: in use/max in use/blocks, taken from the heap
+String getMemBlockStats(byte cls) {
+  if (cls >= MEM_BLOCK_CLASSES) return "";
+  const memBlockClassStruct& blocks = memBlockClass[cls];
+  String result;
+  result += blocks.inUse;
+  result += '/';
+  result += blocks.maxInUse;
+  result += '/';
+  result += memBlockCount[cls];
+  result += ' ';
+  result += blocks.fallbacks;
+  return result;
+}
+
+//********************************************************************************
+// Event pool
+// The scheduler, the command handler, UDP, MQTT and the task reads each used to
+// construct an EventStruct (with its five Strings) per call. They now take one
+// of EVENT_POOL_SIZE events with acquireEvent(), or a PooledEvent for the scope,
+// and give it back with releaseEvent(). A released event is cleared, its
+// Strings keep their buffers for the next user. Calls nest (e.g. a timer
+// running a command which sends from a task), when all events are in use a new
+// one is taken from the heap and counted. Not to be used from interrupts.
+//********************************************************************************
+#define EVENT_POOL_SIZE  4
+
+struct EventPoolStruct
+{
+  EventPoolStruct() : used(0), inUse(0), maxInUse(0), fallbacks(0) {}
+
+  struct EventStruct events[EVENT_POOL_SIZE];
+  byte used;                  // Bit per event
+  byte inUse;
+  byte maxInUse;              // Including the ones from the heap
+  unsigned long fallbacks;    // Taken from the heap as all were in use
+} eventPool;
+
+struct EventStruct* acquireEvent() {
+  if (++eventPool.inUse > eventPool.maxInUse) eventPool.maxInUse = eventPool.inUse;
+  for (byte i = 0; i < EVENT_POOL_SIZE; ++i) {
+    if (eventPool.used & (1 << i)) continue;
+    eventPool.used |= 1 << i;
+    return &eventPool.events[i];
+  }
+  ++eventPool.fallbacks;
+  return new EventStruct();
+}
+
+void releaseEvent(struct EventStruct* event) {
+  if (event == NULL) return;
+  --eventPool.inUse;
+  const int i = event - eventPool.events;
+  if (i < 0 || i >= EVENT_POOL_SIZE) {
+    delete event;
+    return;
+  }
+  event->clear();
+  eventPool.used &= ~(1 << i);
+}
+
+// Event pool usage as: in use/max in use/events, taken from the heap
+String getEventPoolStats() {
+  String result;
+  result += eventPool.inUse;
+  result += '/';
+  result += eventPool.maxInUse;
+  result += '/';
+  result += EVENT_POOL_SIZE;
+  result += ' ';
+  result += eventPool.fallbacks;
+  return result;
+}
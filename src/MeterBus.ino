@@ -0,0 +1,347 @@
+//********************************************************************************
+// Meter bus
+// Request/response transactions with slow meters on a serial port: optical
+// probes (Kamstrup) and M-Bus, at 300..2400 baud. A plugin queues a request and
+// gets the reply later, so a read does not block the loop for the hundreds of
+// msec a meter needs to answer. The requests of all tasks on the same pins are
+// sent one at a time from backgroundtasks():
+//   - the request is written at txBaud, when the reply comes at another rate
+//     (Kamstrup: request at 300, reply at 1200 baud) the port is switched after
+//     the request has left,
+//   - the reply is collected as it arrives, up to the end byte for text replies
+//     (METER_BUS_FRAME_LINE) or as an M-Bus frame found by SerialFrameBuffer,
+//   - it ends at the first byte timeout, the byte timeout or the end of the frame.
+// The reply is sent to the task as PLUGIN_INTERRUPT_EVENT with
+// event->Par1 = METER_BUS_EVENT_REPLY, event->Par2 the tag of the request and
+// event->Data pointing to the MeterBusTransaction, see meterBusTransaction().
+// With METER_BUS_PARITY7 the bytes are 7 bit with even parity in bit 7: it is
+// added to the request and checked and removed on the reply. M-Bus uses 8E1
+// (METER_BUS_8E1), which only the ESP32 UART can do. ESPeasySoftwareSerial stays
+// at 8N1 and the parity bit of a reply is taken as the stop bit.
+//   ESP8266: ESPeasySoftwareSerial on the given pins
+//   ESP32:   UART 1 (port 0) and UART 2 (port 1) on the given pins, the same
+//            UARTs as the Modbus RTU buses
+//********************************************************************************
+#if defined(ESP8266)
+  #include <ESPeasySoftwareSerial.h>
+#endif
+#include <SerialFrameBuffer.h>
+
+#define METER_BUS_PORTS               2
+#define METER_BUS_QUEUE               4    // Requests per port, including the one sent
+#define METER_BUS_MAX_REQUEST        32
+#define METER_BUS_MAX_REPLY         255
+#define METER_BUS_EVENT_REPLY      0xF4    // Interrupt event type, next to the Modbus RTU one
+#define METER_BUS_MIN_BYTE_TIMEOUT   50    // msec
+
+#define METER_BUS_FRAME_LINE          0    // Text up to the end byte
+#define METER_BUS_FRAME_MBUS          1    // M-Bus: single character 0xE5 or a long frame
+
+#define METER_BUS_PARITY7          0x01    // Option: 7 bit, even parity in bit 7
+#define METER_BUS_8E1              0x02    // Option: 8 bit with a parity bit (ESP32)
+
+#define METER_BUS_STATUS_OK           0
+#define METER_BUS_STATUS_TIMEOUT      1    // No reply at all
+#define METER_BUS_STATUS_INCOMPLETE   2    // Reply stopped before its end
+#define METER_BUS_STATUS_PARITY       3
+#define METER_BUS_STATUS_OVERFLOW     4    // Longer than METER_BUS_MAX_REPLY
+
+// M-Bus long frame: 68 L L 68 C A CI data CS 16, the checksum from C up to CS.
+// Frames with more than 249 user data bytes do not fit.
+const SerialFrameFormat meterBusLongFrame = {
+  { 0x68, 0, 0, 0x68 }, { 0xFF, 0, 0, 0xFF }, 4,
+  METER_BUS_MAX_REPLY, 1, 1, 6,
+  SERIALFRAME_CHECKSUM_SUM8, 4, 1, 0x16
+};
+
+struct MeterBusTransaction
+{
+  uint8_t request[METER_BUS_MAX_REQUEST];
+  byte requestLength;
+  unsigned long txBaud;
+  unsigned long rxBaud;
+  byte framing;
+  byte endByte;              // METER_BUS_FRAME_LINE
+  byte options;
+  unsigned int timeout;      // msec for the first byte of the reply
+  byte TaskIndex;
+  byte tag;                  // Returned in event->Par2
+  byte status;
+  const uint8_t* reply;      // Valid during the event
+  uint16_t replyLength;
+};
+
+struct MeterBusPort
+{
+  MeterBusPort() : port(NULL), rxPin(-1), txPin(-1), baud(0), parity(false), users(0), head(0), tail(0),
+    sending(false), waiting(false), txDone(0), lastByte(0), byteTimeout(0), rxLength(0),
+    parityErrors(0), frame(meterBusLongFrame) {}
+
+  Stream* port;
+  int8_t rxPin;
+  int8_t txPin;
+  unsigned long baud;        // Current rate of the port
+  bool parity;               // Opened as 8E1
+  byte users;
+  MeterBusTransaction queue[METER_BUS_QUEUE];
+  byte head;                 // Positions only increase, head - tail requests are queued
+  byte tail;
+  bool sending;              // Request at the tail is being written
+  bool waiting;              // Request at the tail is sent
+  unsigned long txDone;      // millis() when the request has left
+  unsigned long lastByte;    // millis() of the last byte received, or the end of the request
+  unsigned int byteTimeout;
+  uint8_t rx[METER_BUS_MAX_REPLY + 1];
+  uint16_t rxLength;
+  uint16_t parityErrors;
+  SerialFrameBuffer<METER_BUS_MAX_REPLY> frame;
+};
+
+struct MeterBusStatsStruct
+{
+  MeterBusStatsStruct() : requests(0), replies(0), timeouts(0), errors(0), rejected(0) {}
+
+  unsigned long requests;
+  unsigned long replies;
+  unsigned long timeouts;
+  unsigned long errors;      // Incomplete, parity or overflow
+  unsigned long rejected;    // Queue full
+} meterBusStats;
+
+MeterBusPort* meterBus[METER_BUS_PORTS] = { NULL };
+
+// Even parity of the lower 7 bits, in bit 7.
+uint8_t meterBusParity7(uint8_t c) {
+  uint8_t parity = 0;
+  for (uint8_t x = c & 0x7F; x != 0; x >>= 1)
+    parity ^= x & 1;
+  return (c & 0x7F) | (parity << 7);
+}
+
+void meterBusSetBaud(struct MeterBusPort* bus, unsigned long baud, bool parity) {
+  if (bus->baud == baud && bus->parity == parity) return;
+  bus->baud = baud;
+  bus->parity = parity;
+  #if defined(ESP8266)
+    static_cast<ESPeasySoftwareSerial*>(bus->port)->begin(baud);
+  #else
+    static_cast<HardwareSerial*>(bus->port)->begin(baud, parity ? SERIAL_8E1 : SERIAL_8N1, bus->rxPin, bus->txPin);
+  #endif
+}
+
+// Port on the pins, shared with the tasks using the same pins. Returns -1 when it can not be used.
+int meterBusBegin(int8_t rxPin, int8_t txPin) {
+  int free_slot = -1;
+  for (byte i = 0; i < METER_BUS_PORTS; ++i) {
+    MeterBusPort* bus = meterBus[i];
+    if (bus == NULL) {
+      if (free_slot < 0) free_slot = i;
+    } else if (bus->rxPin == rxPin && bus->txPin == txPin) {
+      ++bus->users;
+      return i;
+    }
+  }
+  if (free_slot < 0 || rxPin < 0 || txPin < 0) {
+    addLog(LOG_LEVEL_ERROR, F("Meter: No free port"));
+    return -1;
+  }
+  MeterBusPort* bus = new MeterBusPort();
+  if (bus == NULL) return -1;
+  #if defined(ESP8266)
+    // Decode outside the interrupt, the edges of a reply line fit
+    ESPeasySoftwareSerial* port = new ESPeasySoftwareSerial(rxPin, txPin, false, 128, 640);
+  #else
+    HardwareSerial* port = new HardwareSerial(free_slot == 0 ? 1 : 2);
+  #endif
+  if (port == NULL) {
+    delete bus;
+    return -1;
+  }
+  bus->port = port;
+  bus->rxPin = rxPin;
+  bus->txPin = txPin;
+  bus->users = 1;
+  meterBusSetBaud(bus, 2400, false);
+  meterBus[free_slot] = bus;
+  return free_slot;
+}
+
+void meterBusEnd(int portNr) {
+  if (portNr < 0 || portNr >= METER_BUS_PORTS || meterBus[portNr] == NULL) return;
+  MeterBusPort* bus = meterBus[portNr];
+  if (bus->users > 1) {
+    --bus->users;
+    return;
+  }
+  #if defined(ESP8266)
+    delete static_cast<ESPeasySoftwareSerial*>(bus->port);
+  #else
+    static_cast<HardwareSerial*>(bus->port)->end();
+    delete static_cast<HardwareSerial*>(bus->port);
+  #endif
+  delete bus;
+  meterBus[portNr] = NULL;
+}
+
+// Queue a request. The reply is read at rxBaud, for METER_BUS_FRAME_LINE up to endByte.
+// False when the queue of the port is full or the request too long.
+bool meterBusQueue(int portNr, byte TaskIndex, const uint8_t* request, byte length,
+                   unsigned long txBaud, unsigned long rxBaud, byte framing, byte endByte,
+                   byte options, unsigned int timeout, byte tag) {
+  if (portNr < 0 || portNr >= METER_BUS_PORTS || meterBus[portNr] == NULL) return false;
+  if (length > METER_BUS_MAX_REQUEST || txBaud == 0 || rxBaud == 0) return false;
+  MeterBusPort* bus = meterBus[portNr];
+  if (static_cast<byte>(bus->head - bus->tail) >= METER_BUS_QUEUE) {
+    ++meterBusStats.rejected;
+    return false;
+  }
+  MeterBusTransaction& t = bus->queue[bus->head % METER_BUS_QUEUE];
+  memcpy(t.request, request, length);
+  t.requestLength = length;
+  t.txBaud = txBaud;
+  t.rxBaud = rxBaud;
+  t.framing = framing;
+  t.endByte = endByte;
+  t.options = options;
+  t.timeout = timeout;
+  t.TaskIndex = TaskIndex;
+  t.tag = tag;
+  t.status = METER_BUS_STATUS_TIMEOUT;
+  t.reply = NULL;
+  t.replyLength = 0;
+  ++bus->head;
+  processMeterBusPort(bus);
+  return true;
+}
+
+// The transaction of a METER_BUS_EVENT_REPLY event, NULL for other events.
+const struct MeterBusTransaction* meterBusTransaction(struct EventStruct *event) {
+  if (event->Par1 != METER_BUS_EVENT_REPLY || event->Data == NULL) return NULL;
+  return reinterpret_cast<const MeterBusTransaction*>(event->Data);
+}
+
+void meterBusSend(struct MeterBusPort* bus) {
+  const MeterBusTransaction& t = bus->queue[bus->tail % METER_BUS_QUEUE];
+  meterBusSetBaud(bus, t.txBaud, t.options & METER_BUS_8E1);
+  while (bus->port->available() > 0) bus->port->read();   // Late bytes of a previous reply
+  // The UART sends in the background, the rate is switched when it is done.
+  // ESPeasySoftwareSerial only returns when the bytes are sent, it is done then.
+  bus->txDone = millis() + (t.requestLength * 11000UL) / t.txBaud + 1;
+  for (byte i = 0; i < t.requestLength; ++i)
+    bus->port->write((t.options & METER_BUS_PARITY7) ? meterBusParity7(t.request[i]) : t.request[i]);
+  bus->rxLength = 0;
+  bus->parityErrors = 0;
+  bus->frame.Clear();
+  // 30 characters of silence end a reply
+  bus->byteTimeout = max(static_cast<unsigned long>(METER_BUS_MIN_BYTE_TIMEOUT), 330000UL / t.rxBaud);
+  bus->sending = true;
+  ++meterBusStats.requests;
+}
+
+// Remove the transaction from the queue and send it to its task.
+void meterBusComplete(struct MeterBusPort* bus, byte status) {
+  MeterBusTransaction t = bus->queue[bus->tail % METER_BUS_QUEUE];
+  t.status = status;
+  if (t.framing == METER_BUS_FRAME_MBUS && bus->frame.Available()) {
+    t.reply = bus->frame.Frame();
+    t.replyLength = bus->frame.FrameLength();
+  } else {
+    bus->rx[bus->rxLength] = 0;   // Text replies can be used as a string
+    t.reply = bus->rx;
+    t.replyLength = bus->rxLength;
+  }
+  ++bus->tail;
+  bus->waiting = false;
+  switch (status) {
+    case METER_BUS_STATUS_OK:      ++meterBusStats.replies; break;
+    case METER_BUS_STATUS_TIMEOUT: ++meterBusStats.timeouts; break;
+    default:                       ++meterBusStats.errors; break;
+  }
+  if (t.TaskIndex < TASKS_MAX && Settings.TaskDeviceEnabled[t.TaskIndex]) {
+    struct EventStruct TempEvent;
+    TempEvent.TaskIndex = t.TaskIndex;
+    TempEvent.Par1 = METER_BUS_EVENT_REPLY;
+    TempEvent.Par2 = t.tag;
+    TempEvent.Data = (byte*)&t;
+    START_TIMER;
+    PluginCall(PLUGIN_INTERRUPT_EVENT, &TempEvent, dummyString);
+    STOP_TIMER(PLUGIN_CALL_INTERRUPT);
+  }
+  bus->frame.Clear();
+}
+
+// Add the received bytes to the reply. Returns true when it is complete.
+bool meterBusReceive(struct MeterBusPort* bus, struct MeterBusTransaction& t) {
+  while (bus->port->available() > 0) {
+    uint8_t c = bus->port->read();
+    bus->lastByte = millis();
+    if (t.options & METER_BUS_PARITY7) {
+      if (meterBusParity7(c) != c) ++bus->parityErrors;
+      c &= 0x7F;
+    }
+    if (t.framing == METER_BUS_FRAME_MBUS) {
+      // A single character acknowledge, only as the first byte
+      if (bus->rxLength == 0 && c == 0xE5) {
+        bus->rx[bus->rxLength++] = c;
+        return true;
+      }
+      ++bus->rxLength;
+      if (bus->frame.AddData(c)) return true;
+      continue;
+    }
+    if (bus->rxLength >= METER_BUS_MAX_REPLY) return true;
+    bus->rx[bus->rxLength++] = c;
+    if (c == t.endByte) return true;
+  }
+  return false;
+}
+
+void processMeterBusPort(struct MeterBusPort* bus) {
+  if (bus->sending) {
+    if (timePassedSince(bus->txDone) < 0) return;
+    const MeterBusTransaction& t = bus->queue[bus->tail % METER_BUS_QUEUE];
+    meterBusSetBaud(bus, t.rxBaud, t.options & METER_BUS_8E1);
+    bus->sending = false;
+    bus->waiting = true;
+    bus->lastByte = millis();
+  }
+  if (bus->waiting) {
+    MeterBusTransaction& t = bus->queue[bus->tail % METER_BUS_QUEUE];
+    if (meterBusReceive(bus, t)) {
+      byte status = METER_BUS_STATUS_OK;
+      if (bus->parityErrors != 0)                    status = METER_BUS_STATUS_PARITY;
+      else if (t.framing == METER_BUS_FRAME_LINE &&
+               bus->rx[bus->rxLength - 1] != t.endByte) status = METER_BUS_STATUS_OVERFLOW;
+      meterBusComplete(bus, status);
+    } else if (bus->rxLength == 0) {
+      if (timePassedSince(bus->lastByte) > static_cast<long>(t.timeout))
+        meterBusComplete(bus, METER_BUS_STATUS_TIMEOUT);
+    } else if (timePassedSince(bus->lastByte) > static_cast<long>(bus->byteTimeout)) {
+      meterBusComplete(bus, METER_BUS_STATUS_INCOMPLETE);
+    }
+    if (bus->waiting) return;
+  }
+  if (bus->head != bus->tail)
+    meterBusSend(bus);
+}
+
+// Called from backgroundtasks()
+void processMeterBus() {
+  for (byte i = 0; i < METER_BUS_PORTS; ++i)
+    if (meterBus[i] != NULL) processMeterBusPort(meterBus[i]);
+}
+
+// Meter bus stats as: requests/replies/timeouts/errors/rejected
+String getMeterBusStats() {
+  String result;
+  result += meterBusStats.requests;
+  result += '/';
+  result += meterBusStats.replies;
+  result += '/';
+  result += meterBusStats.timeouts;
+  result += '/';
+  result += meterBusStats.errors;
+  result += '/';
+  result += meterBusStats.rejected;
+  return result;
+}
@@ -44,6 +44,10 @@ bool readyForSleep()
 {
   if (!isDeepSleepEnabled())
     return false;
+  if (sleepWakeWithoutRF()) {
+    // Sleep again as soon as the tasks are read, see SleepWake.ino
+    return sleepWakeReadsDone() || timeOutReached(timerAwakeFromDeepSleep + 1000 * Settings.deepSleep);
+  }
   if (wifiStatus != ESPEASY_WIFI_SERVICES_INITIALIZED) {
     // Allow 6 seconds to connect to WiFi
     return timeOutReached(timerAwakeFromDeepSleep + 12000);
@@ -82,20 +86,36 @@ void deepSleepStart(int delay)
   // separate function that is called from above function or directly from rules, usign deepSleep as a one-shot
   String event = F("System#Sleep");
   rulesProcessing(event);
+  flushRulesQueue();
+  flushControllerBatches();
+  flushValueLogger();
+#ifdef FEATURE_TIMESERIES
+  flushTimeSeries();
+#endif
+  flushSyslogQueue();
 
 
-  RTC.deepSleepState = 1;
-  saveToRTC();
-
   if (delay > 4294 || delay < 0)
     delay = 4294;   //max sleep time ~1.2h
 
+  uint32_t sleepUsec = (uint32_t)delay * 1000000;
+  const bool wakeWithRF = sleepWakePrepare(delay, sleepUsec);
+  RTC.deepSleepState = wakeWithRF ? DEEP_SLEEP_STATE_RF : DEEP_SLEEP_STATE_NO_RF;
+  saveToRTC();
+
+  if (RTC_WiFi.channel != 0) {
+    // Age of a cached address includes the time awake and the sleep.
+    RTC_WiFi.ipAge += millis() / 1000 + delay;
+    setRTCRegionDirty(RTC_REGION_WIFI, &RTC_WiFi.ipAge, sizeof(RTC_WiFi.ipAge));
+  }
+  flushRTCMemory();
+
   addLog(LOG_LEVEL_INFO, F("SLEEP: Powering down to deepsleep..."));
   #if defined(ESP8266)
-    ESP.deepSleep((uint32_t)delay * 1000000, WAKE_RF_DEFAULT);
+    ESP.deepSleep(sleepUsec, wakeWithRF ? WAKE_RF_DEFAULT : WAKE_RF_DISABLED);
   #endif
   #if defined(ESP32)
-    esp_sleep_enable_timer_wakeup((uint32_t)delay * 1000000);
+    esp_sleep_enable_timer_wakeup(sleepUsec);
     esp_deep_sleep_start();
   #endif
 }
@@ -129,19 +149,117 @@ boolean remoteConfig(struct EventStruct *event, const String& string)
 
 int8_t getTaskIndexByName(String TaskNameSearch)
 {
+  return findTaskIndexByName(TaskNameSearch, false);
+}
+
+// FNV-1a of the lower case name, 0 only for an empty name.
+uint32_t getNameHash(const char* name, unsigned int length)
+{
+  if (length == 0) return 0;
+  uint32_t hash = 2166136261ul;
+  for (unsigned int i = 0; i < length; ++i) {
+    hash ^= static_cast<uint8_t>(tolower(name[i]));
+    hash *= 16777619ul;
+  }
+  return hash == 0 ? 1 : hash;
+}
+
+uint32_t getNameHash(const char* name)
+{
+  return getNameHash(name, strlen(name));
+}
+
+// Called when ExtraTaskSettings of the task were loaded from or saved to file.
+void updateTaskNameIndex(byte TaskIndex)
+{
+  if (TaskIndex >= TASKS_MAX || ExtraTaskSettings.TaskIndex != TaskIndex) return;
+  TaskNameIndex.nameHash[TaskIndex] = getNameHash(ExtraTaskSettings.TaskDeviceName);
+  for (byte z = 0; z < VARS_PER_TASK; z++)
+    TaskNameIndex.valueHash[TaskIndex][z] = getNameHash(ExtraTaskSettings.TaskDeviceValueNames[z]);
+}
 
+// Loads the settings of all tasks once.
+void buildTaskNameIndex()
+{
+  const byte loadedTaskIndex = ExtraTaskSettings.TaskIndex;
   for (byte x = 0; x < TASKS_MAX; x++)
   {
     LoadTaskSettings(x);
-    String TaskName = getTaskDeviceName(x);
-    if ((TaskName.length() != 0 ) && (TaskNameSearch.equalsIgnoreCase(TaskName)))
-    {
+    // Also for cached settings, which do not update the index when loaded.
+    updateTaskNameIndex(x);
+  }
+  TaskNameIndex.valid = true;
+  if (loadedTaskIndex < TASKS_MAX)
+    LoadTaskSettings(loadedTaskIndex);
+}
+
+// Quick check, the name may still differ when the hash matches.
+bool taskNameHashMatches(byte TaskIndex, uint32_t hash)
+{
+  if (!TaskNameIndex.valid) buildTaskNameIndex();
+  return hash != 0 && TaskNameIndex.nameHash[TaskIndex] == hash;
+}
+
+// True when the name and the zero terminated setting are equal, case insensitive.
+bool nameEquals(const char* name, unsigned int length, const char* setting)
+{
+  return strncasecmp(name, setting, length) == 0 && setting[length] == 0;
+}
+
+// First task with this name (case insensitive), or -1.
+// Only the settings of tasks with a matching hash are loaded, to rule out a collision.
+int8_t findTaskIndexByName(const char* name, unsigned int length, bool enabledOnly)
+{
+  const uint32_t hash = getNameHash(name, length);
+  for (byte x = 0; x < TASKS_MAX; x++)
+  {
+    if (!taskNameHashMatches(x, hash)) continue;
+    if (enabledOnly && !Settings.TaskDeviceEnabled[x]) continue;
+    LoadTaskSettings(x);
+    if (nameEquals(name, length, ExtraTaskSettings.TaskDeviceName))
       return x;
-    }
   }
   return -1;
 }
 
+int8_t findTaskIndexByName(const String& name, bool enabledOnly)
+{
+  return findTaskIndexByName(name.c_str(), name.length(), enabledOnly);
+}
+
+// Value of the task with this name (case insensitive), or -1. Loads the task settings.
+int8_t findTaskValueIndexByName(byte TaskIndex, const char* name, unsigned int length)
+{
+  const uint32_t hash = getNameHash(name, length);
+  if (hash == 0 || TaskIndex >= TASKS_MAX) return -1;
+  if (!TaskNameIndex.valid) buildTaskNameIndex();
+  for (byte z = 0; z < VARS_PER_TASK; z++)
+  {
+    if (TaskNameIndex.valueHash[TaskIndex][z] != hash) continue;
+    LoadTaskSettings(TaskIndex);
+    if (nameEquals(name, length, ExtraTaskSettings.TaskDeviceValueNames[z]))
+      return z;
+  }
+  return -1;
+}
+
+
+
+/*********************************************************************************************\
+   find pin mode & state (info table), the slot in pinStates[] or -1
+  \*********************************************************************************************/
+int findPinState(byte plugin, byte index)
+{
+  byte pos = (plugin * 31 + index) & (PINSTATE_INDEX_SIZE - 1);
+  for (byte probe = 0; probe < PINSTATE_INDEX_SIZE; ++probe) {
+    const byte slot = pinStateIndex[pos];
+    if (slot == 0) return -1;
+    if (pinStates[slot - 1].plugin == plugin && pinStates[slot - 1].index == index)
+      return slot - 1;
+    pos = (pos + 1) & (PINSTATE_INDEX_SIZE - 1);
+  }
+  return -1;
+}
 
 
 /*********************************************************************************************\
@@ -151,28 +269,28 @@ void setPinState(byte plugin, byte index, byte mode, uint16_t value)
 {
   // plugin number and index form a unique key
   // first check if this pin is already known
-  boolean reUse = false;
-  for (byte x = 0; x < PINSTATE_TABLE_MAX; x++)
-    if ((pinStates[x].plugin == plugin) && (pinStates[x].index == index))
-    {
+  const int x = findPinState(plugin, index);
+  if (x >= 0)
+  {
+    if (pinStates[x].mode != mode || pinStates[x].value != value) {
       pinStates[x].mode = mode;
       pinStates[x].value = value;
-      reUse = true;
-      break;
+      pinStates[x].sequence = ++pinStateSequence;
     }
-
-  if (!reUse)
-  {
-    for (byte x = 0; x < PINSTATE_TABLE_MAX; x++)
-      if (pinStates[x].plugin == 0)
-      {
-        pinStates[x].plugin = plugin;
-        pinStates[x].index = index;
-        pinStates[x].mode = mode;
-        pinStates[x].value = value;
-        break;
-      }
+    return;
   }
+  if (pinStateCount >= PINSTATE_TABLE_MAX)
+    return;
+  pinStatesStruct& entry = pinStates[pinStateCount++];
+  entry.plugin = plugin;
+  entry.index = index;
+  entry.mode = mode;
+  entry.value = value;
+  entry.sequence = ++pinStateSequence;
+  byte pos = (plugin * 31 + index) & (PINSTATE_INDEX_SIZE - 1);
+  while (pinStateIndex[pos] != 0)
+    pos = (pos + 1) & (PINSTATE_INDEX_SIZE - 1);
+  pinStateIndex[pos] = pinStateCount;
 }
 
 
@@ -181,14 +299,12 @@ void setPinState(byte plugin, byte index, byte mode, uint16_t value)
   \*********************************************************************************************/
 boolean getPinState(byte plugin, byte index, byte *mode, uint16_t *value)
 {
-  for (byte x = 0; x < PINSTATE_TABLE_MAX; x++)
-    if ((pinStates[x].plugin == plugin) && (pinStates[x].index == index))
-    {
-      *mode = pinStates[x].mode;
-      *value = pinStates[x].value;
-      return true;
-    }
-  return false;
+  const int x = findPinState(plugin, index);
+  if (x < 0)
+    return false;
+  *mode = pinStates[x].mode;
+  *value = pinStates[x].value;
+  return true;
 }
 
 
@@ -197,12 +313,21 @@ boolean getPinState(byte plugin, byte index, byte *mode, uint16_t *value)
   \*********************************************************************************************/
 boolean hasPinState(byte plugin, byte index)
 {
-  for (byte x = 0; x < PINSTATE_TABLE_MAX; x++)
-    if ((pinStates[x].plugin == plugin) && (pinStates[x].index == index))
-    {
-      return true;
-    }
-  return false;
+  return findPinState(plugin, index) >= 0;
+}
+
+
+String getPinModeString(byte mode)
+{
+  switch (mode)
+  {
+    case PIN_MODE_UNDEFINED: return F("undefined");
+    case PIN_MODE_INPUT:     return F("input");
+    case PIN_MODE_OUTPUT:    return F("output");
+    case PIN_MODE_PWM:       return F("PWM");
+    case PIN_MODE_SERVO:     return F("servo");
+  }
+  return "";
 }
 
 
@@ -219,16 +344,7 @@ String getPinStateJSON(boolean search, byte plugin, byte index, String& log, uin
   boolean found = false;
 
   if (search)
-  {
-    for (byte x = 0; x < PINSTATE_TABLE_MAX; x++)
-      if ((pinStates[x].plugin == plugin) && (pinStates[x].index == index))
-      {
-        mode = pinStates[x].mode;
-        value = pinStates[x].value;
-        found = true;
-        break;
-      }
-  }
+    found = getPinState(plugin, index, &mode, &value);
 
   if (!search || (search && found))
   {
@@ -239,24 +355,7 @@ String getPinStateJSON(boolean search, byte plugin, byte index, String& log, uin
     reply += F(",\n\"pin\": ");
     reply += index;
     reply += F(",\n\"mode\": \"");
-    switch (mode)
-    {
-      case PIN_MODE_UNDEFINED:
-        reply += F("undefined");
-        break;
-      case PIN_MODE_INPUT:
-        reply += F("input");
-        break;
-      case PIN_MODE_OUTPUT:
-        reply += F("output");
-        break;
-      case PIN_MODE_PWM:
-        reply += F("PWM");
-        break;
-      case PIN_MODE_SERVO:
-        reply += F("servo");
-        break;
-    }
+    reply += getPinModeString(mode);
     reply += F("\",\n\"state\": ");
     reply += value;
     reply += F("\n}\n");
@@ -266,6 +365,36 @@ String getPinStateJSON(boolean search, byte plugin, byte index, String& log, uin
 }
 
 
+/*********************************************************************************************\
+   report the pins changed after sequence using json, with the sequence to ask for the next time
+  \*********************************************************************************************/
+String getPinStatesChangedJSON(unsigned long sequence)
+{
+  printToWebJSON = true;
+  String reply = F("{\n\"sequence\": ");
+  reply += pinStateSequence;
+  reply += F(",\n\"pins\": [");
+  bool first = true;
+  for (byte x = 0; x < pinStateCount; x++)
+  {
+    if (pinStates[x].sequence <= sequence) continue;
+    if (!first) reply += ',';
+    first = false;
+    reply += F("\n{\"plugin\": ");
+    reply += pinStates[x].plugin;
+    reply += F(", \"pin\": ");
+    reply += pinStates[x].index;
+    reply += F(", \"mode\": \"");
+    reply += getPinModeString(pinStates[x].mode);
+    reply += F("\", \"state\": ");
+    reply += pinStates[x].value;
+    reply += '}';
+  }
+  reply += F("\n]\n}\n");
+  return reply;
+}
+
+
 /********************************************************************************************\
   Status LED
 \*********************************************************************************************/
@@ -353,23 +482,13 @@ void delayBackground(unsigned long delay)
 void parseCommandString(struct EventStruct *event, const String& string)
 {
   checkRAM(F("parseCommandString"));
-  char command[INPUT_COMMAND_SIZE];
-  command[0] = 0;
-  char TmpStr1[INPUT_COMMAND_SIZE];
-  TmpStr1[0] = 0;
-
-  string.toCharArray(command, INPUT_COMMAND_SIZE);
-  event->Par1 = 0;
-  event->Par2 = 0;
-  event->Par3 = 0;
-  event->Par4 = 0;
-  event->Par5 = 0;
-
-  if (GetArgv(command, TmpStr1, 2)) event->Par1 = str2int(TmpStr1);
-  if (GetArgv(command, TmpStr1, 3)) event->Par2 = str2int(TmpStr1);
-  if (GetArgv(command, TmpStr1, 4)) event->Par3 = str2int(TmpStr1);
-  if (GetArgv(command, TmpStr1, 5)) event->Par4 = str2int(TmpStr1);
-  if (GetArgv(command, TmpStr1, 6)) event->Par5 = str2int(TmpStr1);
+  CommandArgsStruct args;
+  parseCommandArgs(args, string.c_str());
+  event->Par1 = getCommandArgInt(args, 2);
+  event->Par2 = getCommandArgInt(args, 3);
+  event->Par3 = getCommandArgInt(args, 4);
+  event->Par4 = getCommandArgInt(args, 5);
+  event->Par5 = getCommandArgInt(args, 6);
 }
 
 /********************************************************************************************\
@@ -403,8 +522,9 @@ String checkTaskSettings(byte taskIndex) {
       return F("Warning: Task Device Name is empty. It is adviced to give tasks an unique name");
     }
   }
+  const uint32_t nameHash = getNameHash(deviceName.c_str());
   for (int i = 0; i < TASKS_MAX; ++i) {
-    if (i != taskIndex) {
+    if (i != taskIndex && taskNameHashMatches(i, nameHash)) {
       LoadTaskSettings(i);
       if (ExtraTaskSettings.TaskDeviceName[0] != 0) {
         if (strcasecmp(ExtraTaskSettings.TaskDeviceName, deviceName.c_str()) == 0) {
@@ -427,6 +547,8 @@ String checkTaskSettings(byte taskIndex) {
   \*********************************************************************************************/
 byte getDeviceIndex(byte Number)
 {
+  if (Number < DeviceIndex_by_Number.size())
+    return DeviceIndex_by_Number[Number];
   for (byte x = 0; x <= deviceCount ; x++) {
     if (Device[x].Number == Number) {
       return x;
@@ -435,12 +557,26 @@ byte getDeviceIndex(byte Number)
   return 0;
 }
 
+/********************************************************************************************\
+  Get device index of the plugin running in a task, using the cache in Task_id_to_DeviceIndex
+  \*********************************************************************************************/
+byte getDeviceIndex_from_TaskIndex(byte TaskIndex)
+{
+  if (TaskIndex >= TASKS_MAX) return 0;
+  byte DeviceIndex = Task_id_to_DeviceIndex[TaskIndex];
+  if (Device[DeviceIndex].Number != Settings.TaskDeviceNumber[TaskIndex]) {
+    DeviceIndex = getDeviceIndex(Settings.TaskDeviceNumber[TaskIndex]);
+    Task_id_to_DeviceIndex[TaskIndex] = DeviceIndex;
+  }
+  return DeviceIndex;
+}
+
 /********************************************************************************************\
   Find name of plugin given the plugin device index..
   \*********************************************************************************************/
 String getPluginNameFromDeviceIndex(byte deviceIndex) {
   String deviceName = "";
-  Plugin_ptr[deviceIndex](PLUGIN_GET_DEVICENAME, 0, deviceName);
+  getPluginFunction(deviceIndex)(PLUGIN_GET_DEVICENAME, 0, deviceName);
   return deviceName;
 }
 
@@ -458,6 +594,20 @@ byte getProtocolIndex(byte Number)
   return 0;
 }
 
+/********************************************************************************************\
+  Get protocol index of the controller, using the cache in Controller_id_to_ProtocolIndex
+  \*********************************************************************************************/
+byte getProtocolIndex_from_ControllerIndex(byte ControllerIndex)
+{
+  if (ControllerIndex >= CONTROLLER_MAX) return 0;
+  byte ProtocolIndex = Controller_id_to_ProtocolIndex[ControllerIndex];
+  if (Protocol[ProtocolIndex].Number != Settings.Protocol[ControllerIndex]) {
+    ProtocolIndex = getProtocolIndex(Settings.Protocol[ControllerIndex]);
+    Controller_id_to_ProtocolIndex[ControllerIndex] = ProtocolIndex;
+  }
+  return ProtocolIndex;
+}
+
 /********************************************************************************************\
   Get notificatoin protocol index (plugin index), by NPlugin_id
   \*********************************************************************************************/
@@ -471,6 +621,21 @@ byte getNotificationProtocolIndex(byte Number)
   return(NPLUGIN_NOT_FOUND);
 }
 
+/********************************************************************************************\
+  Get notification protocol index of a notifier, using the cache in Notification_id_to_NPluginIndex
+  \*********************************************************************************************/
+byte getNotificationProtocolIndex_from_NotifierIndex(byte NotifierIndex)
+{
+  if (NotifierIndex >= NOTIFICATION_MAX) return NPLUGIN_NOT_FOUND;
+  byte NotificationProtocolIndex = Notification_id_to_NPluginIndex[NotifierIndex];
+  if (NotificationProtocolIndex == NPLUGIN_NOT_FOUND ||
+      Notification[NotificationProtocolIndex].Number != Settings.Notification[NotifierIndex]) {
+    NotificationProtocolIndex = getNotificationProtocolIndex(Settings.Notification[NotifierIndex]);
+    Notification_id_to_NPluginIndex[NotifierIndex] = NotificationProtocolIndex;
+  }
+  return NotificationProtocolIndex;
+}
+
 /********************************************************************************************\
   Find positional parameter in a char string
   \*********************************************************************************************/
@@ -540,7 +705,110 @@ boolean GetArgv(const char *string, char *argv, unsigned int argv_size, unsigned
   return false;
 }
 
+/********************************************************************************************\
+  Split a command line once in arguments, instead of scanning it again for each argument.
+  Arguments are separated by ',' or ' ', a run of separators counts as one.
+  Arguments may be quoted with ", ' or [], the quotes are not part of the argument.
+  The line must stay unchanged as long as the arguments are used.
+  \*********************************************************************************************/
+void parseCommandArgs(CommandArgsStruct& args, const char* line)
+{
+  args.line = line;
+  args.count = 0;
+  args.truncated = false;
+  const char* pos = line;
+  while (true)
+  {
+    while (isParameterSeparatorChar(*pos)) ++pos;
+    if (*pos == 0) return;
+    if (args.count == COMMAND_ARGS_MAX) {
+      args.truncated = true;
+      return;
+    }
+    const char* start = pos;
+    const char* end;
+    if (isQuoteChar(*pos) || *pos == '[') {
+      const char closing = (*pos == '[') ? ']' : *pos;
+      start = ++pos;
+      while (*pos != 0 && *pos != closing) ++pos;
+      end = pos;
+      if (*pos != 0) ++pos;
+    } else {
+      while (*pos != 0 && !isParameterSeparatorChar(*pos)) ++pos;
+      end = pos;
+    }
+    args.start[args.count] = start - line;
+    args.length[args.count] = end - start;
+    ++args.count;
+  }
+}
+
+// Argument argc (1 = the command) copied into argv, like GetArgv()
+boolean getCommandArg(const CommandArgsStruct& args, unsigned int argc, char *argv, unsigned int argv_size)
+{
+  if (argc == 0) return false;
+  if (argc > args.count)
+    return args.truncated && GetArgv(args.line, argv, argv_size, argc);
+  const unsigned int length = args.length[argc - 1];
+  if ((length + 2) > argv_size) {
+    if (loglevelActiveFor(LOG_LEVEL_ERROR)) {
+      String log = F("GetArgv Error; argv_size exceeded. argc=");
+      log += argc;
+      log += F(" argv_size=");
+      log += argv_size;
+      addLog(LOG_LEVEL_ERROR, log);
+    }
+    return false;
+  }
+  memcpy(argv, args.line + args.start[argc - 1], length);
+  argv[length] = 0;
+  return true;
+}
+
+// Argument argc as number, 0 when missing.
+int getCommandArgInt(const CommandArgsStruct& args, unsigned int argc)
+{
+  char TmpStr1[INPUT_COMMAND_SIZE];
+  if (!getCommandArg(args, argc, TmpStr1, INPUT_COMMAND_SIZE)) return 0;
+  return str2int(TmpStr1);
+}
+
+// Argument argc, or the line from argument argc to the end.
+String getCommandArgString(const CommandArgsStruct& args, unsigned int argc, bool toEndOfString, bool toLowerCase)
+{
+  String result;
+  if (argc == 0 || argc > args.count) {
+    if (args.truncated)
+      result = parseString(args.line, argc, toEndOfString, toLowerCase);
+    return result;
+  }
+  const char* start = args.line + args.start[argc - 1];
+  if (toEndOfString) {
+    // Include the opening quote, the text is only unquoted when it ends with the same quote.
+    if (argc > 1 && (isQuoteChar(start[-1]) || start[-1] == '[')) --start;
+    result = start;
+    if (toLowerCase) result.toLowerCase();
+    return stripQuotes(result);
+  }
+  appendChars(result, start, args.length[argc - 1]);
+  if (toLowerCase) result.toLowerCase();
+  return result;
+}
+
+// For command handlers, uses the arguments parsed by ExecuteCommand() when available.
+boolean GetArgv(struct EventStruct *event, const char *Line, char *argv, unsigned int argc)
+{
+  if (event->Args != NULL && event->Args->line == Line)
+    return getCommandArg(*event->Args, argc, argv, INPUT_COMMAND_SIZE);
+  return GetArgv(Line, argv, argc);
+}
 
+String parseCommandArg(struct EventStruct *event, const char *Line, unsigned int argc, bool toEndOfString, bool toLowerCase)
+{
+  if (event->Args != NULL && event->Args->line == Line)
+    return getCommandArgString(*event->Args, argc, toEndOfString, toLowerCase);
+  return parseString(Line, argc, toEndOfString, toLowerCase);
+}
 
 
 /********************************************************************************************\
@@ -643,6 +911,7 @@ void ResetFactory(void)
   saveToRTC();
 
   //always format on factory reset, in case of corrupt SPIFFS
+  closeCachedReadFile();
   SPIFFS.end();
   Serial.println(F("RESET: formatting..."));
   SPIFFS.format();
@@ -665,6 +934,7 @@ void ResetFactory(void)
 
   fname=FILE_NOTIFICATION;
   InitFile(fname.c_str(), 4096);
+  clearSettingsCrc();
 
   fname=FILE_RULES;
   InitFile(fname.c_str(), 0);
@@ -816,6 +1086,29 @@ unsigned long FreeMem(void)
   #endif
 }
 
+// Largest block which can be allocated, 0 when the core cannot tell (ESP8266 before core 2.5.0)
+uint32_t getMaxFreeBlock()
+{
+  #if defined(ESP32)
+    return ESP.getMaxAllocHeap();
+  #elif defined(ARDUINO_ESP8266_RELEASE_2_5_0) || defined(ARDUINO_ESP8266_RELEASE_2_5_1) || defined(ARDUINO_ESP8266_RELEASE_2_5_2)
+    return ESP.getMaxFreeBlockSize();
+  #else
+    return 0;
+  #endif
+}
+
+// Largest block which can be allocated, on older ESP8266 cores by walking the heap, so not for every call.
+uint32_t findMaxFreeBlock()
+{
+  #if defined(ESP8266) && !defined(ARDUINO_ESP8266_RELEASE_2_5_0) && !defined(ARDUINO_ESP8266_RELEASE_2_5_1) && !defined(ARDUINO_ESP8266_RELEASE_2_5_2)
+    umm_info(NULL, 0);
+    return static_cast<uint32_t>(ummHeapInfo.maxFreeContiguousBlocks) * 8;  // umm_malloc blocks are 8 bytes
+  #else
+    return getMaxFreeBlock();
+  #endif
+}
+
 /********************************************************************************************\
   Get system information
   \*********************************************************************************************/
@@ -830,7 +1123,7 @@ String getLastBootCauseString() {
     case BOOT_CAUSE_EXT_WD:
        return F("External Watchdog");
   }
-  return F("Unknown");
+  return getWebString(WEB_STR_UNKNOWN);
 }
 
 #ifdef ESP32
@@ -862,7 +1155,7 @@ String getResetReasonString(byte icore) {
     reason += ')';
     return reason;
   }
-  return F("Unknown");
+  return getWebString(WEB_STR_UNKNOWN);
 }
 #endif
 
@@ -952,6 +1245,19 @@ boolean isFloat(const String& tBuf) {
   return isNumerical(tBuf, false);
 }
 
+/********************************************************************************************\
+  CRC32 (as used by zlib), start with crc = 0 and pass the result to continue with more data.
+  \*********************************************************************************************/
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t length) {
+  crc = ~crc;
+  while (length--) {
+    crc ^= *data++;
+    for (byte bit = 0; bit < 8; ++bit)
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
 boolean isValidFloat(float f) {
   if (f == NAN)      return false; //("NaN");
   if (f == INFINITY) return false; //("INFINITY");
@@ -1006,15 +1312,18 @@ String getNumerical(const String& tBuf, bool mustBeInteger) {
 }
 
 boolean isNumerical(const String& tBuf, bool mustBeInteger) {
-  const unsigned int bufLength = tBuf.length();
+  return isNumerical(tBuf.c_str(), tBuf.length(), mustBeInteger);
+}
+
+boolean isNumerical(const char* tBuf, unsigned int bufLength, bool mustBeInteger) {
   if (bufLength == 0) return false;
   boolean decPt = false;
   int firstDec = 0;
-  char c = tBuf.charAt(0);
+  char c = tBuf[0];
   if(c == '+' || c == '-')
     firstDec = 1;
   for(unsigned int x=firstDec; x < bufLength; ++x) {
-    c = tBuf.charAt(x);
+    c = tBuf[x];
     if(c == '.') {
       if (mustBeInteger) return false;
       // Only one decimal point allowed
@@ -1089,10 +1398,8 @@ void addToLog(byte logLevel, const __FlashStringHelper* flashString)
 
 bool SerialAvailableForWrite() {
   if (!Settings.UseSerial) return false;
-  #if defined(ESP8266)
-    if (!Serial.availableForWrite()) return false; // UART FIFO overflow or TX disabled.
-  #endif
-  return true;
+  // Log lines wait in the serial console ring, full when the UART is too slow or TX is disabled.
+  return serialConsoleTxRoom() > 0;
 }
 
 void disableSerialLog() {
@@ -1161,18 +1468,118 @@ boolean loglevelActive(byte logLevel, byte logLevelSettings) {
 }
 
 void addToLog(byte logLevel, const char *line)
+{
+  START_TIMER;
+  addToLogOutputs(logLevel, line);
+  if (loglevelActiveFor(LOG_TO_WEBLOG, logLevel)) {
+    Logging.add(logLevel, line);
+  }
+  STOP_TIMER(ADD_LOG_STATS);
+}
+
+/********************************************************************************************\
+  Structured logging, the format strings are only rendered when needed.
+  In the web log only the format index and arguments are stored, so a line which is never
+  viewed is never formatted. Serial, syslog and SD card still get the text right away.
+  Format specifiers: %u (unsigned), %d (signed), %f (float, 2 decimals, see logFmtFloat()), %%
+  \*********************************************************************************************/
+const char logFmt_SW_SWITCH_STATE[] PROGMEM   = "SW   : Switch state %u Output value %u";
+const char logFmt_SW_STATE[] PROGMEM          = "SW   : State %f";
+const char logFmt_CTRL_RATE_LIMITED[] PROGMEM = "CTRL : Rate limited, %u fields pending for controller %u";
+const char logFmt_CTRL_QUEUE_FULL[] PROGMEM   = "CTRL : Queue full, dropped sample for controller %u";
+const char logFmt_CTRL_SEND_RETRY[] PROGMEM   = "CTRL : Send failed for controller %u, retry %u in %u ms";
+const char logFmt_CTRL_SEND_DROPPED[] PROGMEM = "CTRL : Send failed for controller %u, dropped sample after %u tries";
+
+// Order must match the LOG_FMT_xxx defines.
+const char* const logFormats[LOG_FMT_NRELEMENTS] PROGMEM = {
+  logFmt_SW_SWITCH_STATE,
+  logFmt_SW_STATE,
+  logFmt_CTRL_RATE_LIMITED,
+  logFmt_CTRL_QUEUE_FULL,
+  logFmt_CTRL_SEND_RETRY,
+  logFmt_CTRL_SEND_DROPPED
+};
+
+// Float arguments are passed as their bit pattern.
+uint32_t logFmtFloat(float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+String renderLogFmt(byte fmt, const uint32_t* args)
+{
+  if (fmt >= LOG_FMT_NRELEMENTS) return F("Unknown log format");
+  const char* format = (const char*)pgm_read_dword(&logFormats[fmt]);
+  String line;
+  line.reserve(strlen_P(format) + 16);
+  byte arg = 0;
+  char c;
+  while ((c = pgm_read_byte(format++)) != 0) {
+    if (c != '%') {
+      line += c;
+      continue;
+    }
+    c = pgm_read_byte(format++);
+    if (c == 0) break;
+    if (c == '%') {
+      line += c;
+      continue;
+    }
+    switch (arg < LOG_FMT_MAX_ARGS ? c : 0) {
+      case 'u': line += args[arg]; break;
+      case 'd': line += static_cast<int32_t>(args[arg]); break;
+      case 'f': {
+        float value;
+        memcpy(&value, &args[arg], sizeof(value));
+        line += String(value);
+        break;
+      }
+      default:
+        line += '%';
+        line += c;
+        continue;
+    }
+    ++arg;
+  }
+  return line;
+}
+
+void addToLogFmt(byte logLevel, byte fmt, uint32_t arg1, uint32_t arg2, uint32_t arg3)
+{
+  START_TIMER;
+  const uint32_t args[LOG_FMT_MAX_ARGS] = { arg1, arg2, arg3 };
+  if (loglevelActiveFor(LOG_TO_SERIAL, logLevel) || loglevelActiveFor(LOG_TO_SYSLOG, logLevel)
+#ifdef FEATURE_SD
+      || loglevelActiveFor(LOG_TO_SDCARD, logLevel)
+#endif
+     ) {
+    String line = renderLogFmt(fmt, args);
+    addToLogOutputs(logLevel, line.c_str());
+  }
+  if (loglevelActiveFor(LOG_TO_WEBLOG, logLevel)) {
+    Logging.addFmt(logLevel, fmt, args);
+  }
+  STOP_TIMER(ADD_LOG_FMT_STATS);
+}
+
+// Serial, syslog and SD card, these need the formatted line right away.
+void addToLogOutputs(byte logLevel, const char *line)
 {
   if (loglevelActiveFor(LOG_TO_SERIAL, logLevel)) {
-    Serial.print(millis());
-    Serial.print(F(" : "));
-    Serial.println(line);
+    String serialLine;
+    serialLine.reserve(strlen(line) + 16);
+    serialLine += millis();
+    serialLine += F(" : ");
+    serialLine += line;
+    serialLine += F("\r\n");
+    // Dropped when the console ring is full, instead of waiting for the UART
+    serialConsoleWrite(reinterpret_cast<const uint8_t*>(serialLine.c_str()), serialLine.length(), false);
   }
   if (loglevelActiveFor(LOG_TO_SYSLOG, logLevel)) {
     syslog(logLevel, line);
   }
-  if (loglevelActiveFor(LOG_TO_WEBLOG, logLevel)) {
-    Logging.add(logLevel, line);
-  }
 
 #ifdef FEATURE_SD
   if (loglevelActiveFor(LOG_TO_SDCARD, logLevel)) {
@@ -1202,6 +1609,12 @@ void delayedReboot(int rebootDelay)
 }
 
 void reboot() {
+  flushValueLogger();
+#ifdef FEATURE_TIMESERIES
+  flushTimeSeries();
+#endif
+  flushSyslogQueue();
+  flushRTCMemory();
   #if defined(ESP32)
     ESP.restart();
   #else
@@ -1218,7 +1631,7 @@ boolean saveToRTC()
   #if defined(ESP32)
     return false;
   #else
-    if (!system_rtc_mem_write(RTC_BASE_STRUCT, (byte*)&RTC, sizeof(RTC)) || !readFromRTC())
+    if (!saveRTCRegion(RTC_REGION_STRUCT) || !readFromRTC())
     {
       addLog(LOG_LEVEL_ERROR, F("RTC  : Error while writing to RTC"));
       return(false);
@@ -1239,10 +1652,25 @@ void initRTC()
   memset(&RTC, 0, sizeof(RTC));
   RTC.ID1 = 0xAA;
   RTC.ID2 = 0x55;
+  RTC.layoutVersion = RTC_LAYOUT_VERSION;
   saveToRTC();
 
   memset(&UserVar, 0, sizeof(UserVar));
   saveUserVarToRTC();
+
+  memset(&RTC_WiFi, 0, sizeof(RTC_WiFi));
+  saveWiFiToRTC();
+
+  memset(&RTC_Energy, 0, sizeof(RTC_Energy));
+  for (byte i = 0; i < RTC_ENERGY_METERS; ++i)
+    RTC_Energy.TaskIndex[i] = -1;
+  saveEnergyToRTC();
+
+  clearSleepWakeRTC();
+  saveSleepWakeToRTC();
+
+  memset(&RTC_BootProfile, 0, sizeof(RTC_BootProfile));
+  saveRTCRegion(RTC_REGION_BOOT);
 }
 
 /********************************************************************************************\
@@ -1253,9 +1681,10 @@ boolean readFromRTC()
   #if defined(ESP32)
     return false;
   #else
-    if (!system_rtc_mem_read(RTC_BASE_STRUCT, (byte*)&RTC, sizeof(RTC)))
+    // Another layout version is read as a cold boot, the other regions are not valid
+    if (!readRTCRegion(RTC_REGION_STRUCT))
       return(false);
-    return (RTC.ID1 == 0xAA && RTC.ID2 == 0x55);
+    return (RTC.ID1 == 0xAA && RTC.ID2 == 0x55 && RTC.layoutVersion == RTC_LAYOUT_VERSION);
   #endif
 }
 
@@ -1269,12 +1698,7 @@ boolean saveUserVarToRTC()
     return false;
   #else
     //addLog(LOG_LEVEL_DEBUG, F("RTCMEM: saveUserVarToRTC"));
-    byte* buffer = (byte*)&UserVar;
-    size_t size = sizeof(UserVar);
-    uint32_t sum = getChecksum(buffer, size);
-    boolean ret = system_rtc_mem_write(RTC_BASE_USERVAR, buffer, size);
-    ret &= system_rtc_mem_write(RTC_BASE_USERVAR+(size>>2), (byte*)&sum, 4);
-    return ret;
+    return saveRTCRegion(RTC_REGION_USERVAR);
   #endif
 }
 
@@ -1288,631 +1712,697 @@ boolean readUserVarFromRTC()
     return false;
   #else
     //addLog(LOG_LEVEL_DEBUG, F("RTCMEM: readUserVarFromRTC"));
-    byte* buffer = (byte*)&UserVar;
-    size_t size = sizeof(UserVar);
-    boolean ret = system_rtc_mem_read(RTC_BASE_USERVAR, buffer, size);
-    uint32_t sumRAM = getChecksum(buffer, size);
-    uint32_t sumRTC = 0;
-    ret &= system_rtc_mem_read(RTC_BASE_USERVAR+(size>>2), (byte*)&sumRTC, 4);
-    if (!ret || sumRTC != sumRAM)
+    if (!readRTCRegion(RTC_REGION_USERVAR))
     {
       addLog(LOG_LEVEL_ERROR, F("RTC  : Checksum error on reading RTC user var"));
-      memset(buffer, 0, size);
+      memset(&UserVar, 0, sizeof(UserVar));
+      return false;
     }
-    return ret;
+    return true;
   #endif
 }
 
 
-uint32_t getChecksum(byte* buffer, size_t size)
+/********************************************************************************************\
+  Save and read the connection used for a fast reconnect, see RTC_WiFiStruct
+\*********************************************************************************************/
+boolean saveWiFiToRTC()
 {
-  uint32_t sum = 0x82662342;   //some magic to avoid valid checksum on new, uninitialized ESP
-  for (size_t i=0; i<size; i++)
-    sum += buffer[i];
-  return sum;
+  #if defined(ESP32)
+    return false;
+  #else
+    return saveRTCRegion(RTC_REGION_WIFI);
+  #endif
+}
+
+boolean readWiFiFromRTC()
+{
+  #if defined(ESP32)
+    return false;
+  #else
+    if (readRTCRegion(RTC_REGION_WIFI) && RTC_WiFi.channel != 0)
+      return true;
+    memset(&RTC_WiFi, 0, sizeof(RTC_WiFi));
+    return false;
+  #endif
 }
 
 
 /********************************************************************************************\
-  Parse string template
-  \*********************************************************************************************/
-String parseTemplate(String &tmpString, byte lineSize)
+  Save and read the energy counters of the power meters, see RTC_EnergyStruct
+\*********************************************************************************************/
+boolean saveEnergyToRTC()
 {
-  checkRAM(F("parseTemplate"));
-  String newString = "";
-  String tmpStringMid = "";
-  newString.reserve(lineSize);
-
-  // replace task template variables
-  int leftBracketIndex = tmpString.indexOf('[');
-  if (leftBracketIndex == -1)
-    newString = tmpString;
-  else
-  {
-    byte count = 0;
-    byte currentTaskIndex = ExtraTaskSettings.TaskIndex;
+  #if defined(ESP32)
+    return false;
+  #else
+    return saveRTCRegion(RTC_REGION_ENERGY);
+  #endif
+}
 
-    while (leftBracketIndex >= 0 && count < 10 - 1)
-    {
-      newString += tmpString.substring(0, leftBracketIndex);
-      tmpString = tmpString.substring(leftBracketIndex + 1);
-      int rightBracketIndex = tmpString.indexOf(']');
-      if (rightBracketIndex >= 0)
-      {
-        tmpStringMid = tmpString.substring(0, rightBracketIndex);
-        tmpString = tmpString.substring(rightBracketIndex + 1);
-        int hashtagIndex = tmpStringMid.indexOf('#');
-        if (hashtagIndex >= 0) {
-          String deviceName = tmpStringMid.substring(0, hashtagIndex);
-          String valueName = tmpStringMid.substring(hashtagIndex + 1);
-          String valueFormat = "";
-          hashtagIndex = valueName.indexOf('#');
-          if (hashtagIndex >= 0)
-          {
-            valueFormat = valueName.substring(hashtagIndex + 1);
-            valueName = valueName.substring(0, hashtagIndex);
-          }
+// Only the counter of the slot, for the frequent saves of a running meter.
+boolean saveEnergyCounterToRTC(byte slot)
+{
+  if (slot >= RTC_ENERGY_METERS) return false;
+  setRTCRegionDirty(RTC_REGION_ENERGY, &RTC_Energy.energy[slot], sizeof(RTC_Energy.energy[slot]));
+  return flushRTCRegion(RTC_REGION_ENERGY);
+}
 
-          if (deviceName.equalsIgnoreCase(F("Plugin")))
+boolean readEnergyFromRTC()
+{
+  #if defined(ESP32)
+    return false;
+  #else
+    if (readRTCRegion(RTC_REGION_ENERGY))
+      return true;
+    memset(&RTC_Energy, 0, sizeof(RTC_Energy));
+    for (byte i = 0; i < RTC_ENERGY_METERS; ++i)
+      RTC_Energy.TaskIndex[i] = -1;
+    return false;
+  #endif
+}
+
+
+uint32_t getChecksum(byte* buffer, size_t size)
+{
+  uint32_t sum = 0x82662342;   //some magic to avoid valid checksum on new, uninitialized ESP
+  for (size_t i=0; i<size; i++)
+    sum += buffer[i];
+  return sum;
+}
+
+// getChecksum() folded to 16 bits, for small records.
+uint16_t getChecksum16(byte* buffer, size_t size)
+{
+  const uint32_t sum = getChecksum(buffer, size);
+  return (sum >> 16) ^ (sum & 0xFFFF);
+}
+
+
+// Append length characters, without a temporary String.
+void appendChars(String& dest, const char* src, unsigned int length)
+{
+  for (unsigned int i = 0; i < length; ++i)
+    dest += src[i];
+}
+
+// Copy a part of the template to a zero filled buffer, truncated to fit.
+void copyTemplatePart(char (&dest)[NAME_FORMULA_LENGTH_MAX + 1], const char* src, unsigned int length)
+{
+  memset(dest, 0, sizeof(dest));
+  if (length > NAME_FORMULA_LENGTH_MAX) length = NAME_FORMULA_LENGTH_MAX;
+  memcpy(dest, src, length);
+}
+
+// Remove the first occurrence of c, returns true when found.
+bool removeTemplateFlag(char* format, char c)
+{
+  char* found = strchr(format, c);
+  if (found == NULL) return false;
+  memmove(found, found + 1, strlen(found));
+  return true;
+}
+
+/********************************************************************************************\
+  Apply the format of [task#value#transformation#justification] to value
+  Fill and errors of the justification go to newString directly, remaining is the length
+  of the template after the placeholder, used for right justification.
+  \*********************************************************************************************/
+void formatTemplateValue(String& newString, String& value, const char* format, unsigned int formatLength, unsigned int remaining, byte lineSize)
+{
+  // start changes by giig1967g - 2018-04-20
+  // Syntax: [task#value#transformation#justification]
+  char tempValueFormat[NAME_FORMULA_LENGTH_MAX + 1];
+  char valueJust[NAME_FORMULA_LENGTH_MAX + 1];
+  const char* hashtag = static_cast<const char*>(memchr(format, '#', formatLength));
+  if (hashtag != NULL) {
+    copyTemplatePart(tempValueFormat, format, hashtag - format); //Transformation part
+    copyTemplatePart(valueJust, hashtag + 1, formatLength - (hashtag - format) - 1); //Justification part
+  } else {
+    copyTemplatePart(tempValueFormat, format, formatLength);
+    copyTemplatePart(valueJust, format, 0);
+  }
+  if (tempValueFormat[0] == 0) return;
+
+  const int val = value == "0" ? 0 : 1; //to be used for GPIO status (0 or 1)
+  const float valFloat = value.toFloat();
+
+  const bool inverted = removeTemplateFlag(tempValueFormat, '!');
+  const bool rightJustify = removeTemplateFlag(tempValueFormat, 'R');
+  const int tempValueFormatLength = strlen(tempValueFormat);
+
+  //Check Transformation syntax
+  if (tempValueFormatLength > 0)
+  {
+    switch (tempValueFormat[0])
+    {
+      case 'V': //value = value without transformations
+        break;
+      case 'O':
+        value = val == inverted ? F("OFF") : F(" ON"); //(equivalent to XOR operator)
+        break;
+      case 'C':
+        value = val == inverted ? F("CLOSE") : F(" OPEN");
+        break;
+      case 'M':
+        value = val == inverted ? F("AUTO") : F(" MAN");
+        break;
+      case 'm':
+        value = val == inverted ? F("A") : F("M");
+        break;
+      case 'H':
+        value = val == inverted ? F("COLD") : F(" HOT");
+        break;
+      case 'U':
+        value = val == inverted ? F("DOWN") : F("  UP");
+        break;
+      case 'u':
+        value = val == inverted ? F("D") : F("U");
+        break;
+      case 'Y':
+        value = val == inverted ? F(" NO") : F("YES");
+        break;
+      case 'y':
+        value = val == inverted ? F("N") : F("Y");
+        break;
+      case 'X':
+        value = val == inverted ? F("O") : F("X");
+        break;
+      case 'I':
+        value = val == inverted ? F("OUT") : F(" IN");
+        break;
+      case 'Z' :// return "0" or "1"
+        value = val == inverted ? F("0") : F("1");
+        break;
+      case 'D' ://Dx.y min 'x' digits zero filled & 'y' decimal fixed digits
+        {
+          int x = 0;
+          int y = 0;
+          switch (tempValueFormatLength)
           {
-            String tmpString = tmpStringMid.substring(7);
-            tmpString.replace('#', ',');
-            if (PluginCall(PLUGIN_REQUEST, 0, tmpString))
-              newString += tmpString;
-          }
-          else
-            for (byte y = 0; y < TASKS_MAX; y++)
-            {
-              if (Settings.TaskDeviceEnabled[y])
+            case 2: //Dx
+              if (isDigit(tempValueFormat[1]))
+                x = (int)tempValueFormat[1]-'0';
+              break;
+            case 3: //D.y
+              if (tempValueFormat[1]=='.' && isDigit(tempValueFormat[2]))
+                y = (int)tempValueFormat[2]-'0';
+              break;
+            case 4: //Dx.y
+              if (isDigit(tempValueFormat[1]) && tempValueFormat[2]=='.' && isDigit(tempValueFormat[3]))
               {
-                LoadTaskSettings(y);
-                String taskDeviceName = getTaskDeviceName(y);
-                if (taskDeviceName.length() != 0)
-                {
-                  if (deviceName.equalsIgnoreCase(taskDeviceName))
-                  {
-                    boolean match = false;
-                    for (byte z = 0; z < VARS_PER_TASK; z++)
-                      if (valueName.equalsIgnoreCase(ExtraTaskSettings.TaskDeviceValueNames[z]))
-                      {
-                        // here we know the task and value, so find the uservar
-                        match = true;
-                        bool isvalid;
-                        String value = formatUserVar(y, z, isvalid);
-                        if (isvalid) {
-                          // start changes by giig1967g - 2018-04-20
-                          // Syntax: [task#value#transformation#justification]
-                          // valueFormat="transformation#justification"
-                          if (valueFormat.length() > 0) //do the checks only if a Format is defined to optimize loop
-                          {
-                            String valueJust = "";
-
-                            hashtagIndex = valueFormat.indexOf('#');
-                            if (hashtagIndex >= 0)
-                            {
-                              valueJust = valueFormat.substring(hashtagIndex + 1); //Justification part
-                              valueFormat = valueFormat.substring(0, hashtagIndex); //Transformation part
-                            }
-
-                            // valueFormat="transformation"
-                            // valueJust="justification"
-                            if (valueFormat.length() > 0) //do the checks only if a Format is defined to optimize loop
-                            {
-                              const int val = value == "0" ? 0 : 1; //to be used for GPIO status (0 or 1)
-                              const float valFloat = value.toFloat();
-
-                              String tempValueFormat = valueFormat;
-                              int tempValueFormatLength = tempValueFormat.length();
-                              const int invertedIndex = tempValueFormat.indexOf('!');
-                              const bool inverted = invertedIndex >= 0 ? 1 : 0;
-                              if (inverted)
-                                tempValueFormat.remove(invertedIndex,1);
-
-                              const int rightJustifyIndex = tempValueFormat.indexOf('R');
-                              const bool rightJustify = rightJustifyIndex >= 0 ? 1 : 0;
-                              if (rightJustify)
-                                tempValueFormat.remove(rightJustifyIndex,1);
-
-                              tempValueFormatLength = tempValueFormat.length(); //needed because could have been changed after '!' and 'R' removal
-
-                              //Check Transformation syntax
-                              if (tempValueFormatLength > 0)
-                              {
-                                switch (tempValueFormat[0])
-                                  {
-                                  case 'V': //value = value without transformations
-                                    break;
-                                  case 'O':
-                                    value = val == inverted ? F("OFF") : F(" ON"); //(equivalent to XOR operator)
-                                    break;
-                                  case 'C':
-                                    value = val == inverted ? F("CLOSE") : F(" OPEN");
-                                    break;
-                                  case 'M':
-                                    value = val == inverted ? F("AUTO") : F(" MAN");
-                                    break;
-                                  case 'm':
-                                    value = val == inverted ? F("A") : F("M");
-                                    break;
-                                  case 'H':
-                                    value = val == inverted ? F("COLD") : F(" HOT");
-                                    break;
-                                  case 'U':
-                                    value = val == inverted ? F("DOWN") : F("  UP");
-                                    break;
-                                  case 'u':
-                                    value = val == inverted ? F("D") : F("U");
-                                    break;
-                                  case 'Y':
-                                    value = val == inverted ? F(" NO") : F("YES");
-                                    break;
-                                  case 'y':
-                                    value = val == inverted ? F("N") : F("Y");
-                                    break;
-                                  case 'X':
-                                    value = val == inverted ? F("O") : F("X");
-                                    break;
-                                  case 'I':
-                                    value = val == inverted ? F("OUT") : F(" IN");
-                                    break;
-                                  case 'Z' :// return "0" or "1"
-                                    value = val == inverted ? F("0") : F("1");
-                                    break;
-                                  case 'D' ://Dx.y min 'x' digits zero filled & 'y' decimal fixed digits
-                                    {
-                                      int x;
-                                      int y;
-                                      x = 0;
-                                      y = 0;
-
-                                      switch (tempValueFormatLength)
-                                      {
-                                        case 2: //Dx
-                                          if (isDigit(tempValueFormat[1]))
-                                          {
-                                            x = (int)tempValueFormat[1]-'0';
-                                          }
-                                          break;
-                                        case 3: //D.y
-                                          if (tempValueFormat[1]=='.' && isDigit(tempValueFormat[2]))
-                                          {
-                                            y = (int)tempValueFormat[2]-'0';
-                                          }
-                                          break;
-                                        case 4: //Dx.y
-                                          if (isDigit(tempValueFormat[1]) && tempValueFormat[2]=='.' && isDigit(tempValueFormat[3]))
-                                          {
-                                            x = (int)tempValueFormat[1]-'0';
-                                            y = (int)tempValueFormat[3]-'0';
-                                          }
-                                          break;
-                                        case 1: //D
-                                        default: //any other combination x=0; y=0;
-                                          break;
-                                      }
-                                      value = toString(valFloat,y);
-                                      int indexDot;
-                                      indexDot = value.indexOf('.') > 0 ? value.indexOf('.') : value.length();
-                                      for (byte f = 0; f < (x - indexDot); f++)
-                                        value = "0" + value;
-                                      break;
-                                    }
-                                  case 'F' :// FLOOR (round down)
-                                    value = (int)floorf(valFloat);
-                                    break;
-                                  case 'E' :// CEILING (round up)
-                                    value = (int)ceilf(valFloat);
-                                    break;
-                                  default:
-                                    value = F("ERR");
-                                    break;
-                                  }
-
-                                  // Check Justification syntax
-                                  const int valueJustLength = valueJust.length();
-                                  if (valueJustLength > 0) //do the checks only if a Justification is defined to optimize loop
-                                  {
-                                    value.trim(); //remove right justification spaces for backward compatibility
-                                    switch (valueJust[0])
-                                    {
-                                    case 'P' :// Prefix Fill with n spaces: Pn
-                                      if (valueJustLength > 1)
-                                      {
-                                        if (isDigit(valueJust[1])) //Check Pn where n is between 0 and 9
-                                        {
-                                          int filler = valueJust[1] - value.length() - '0' ; //char '0' = 48; char '9' = 58
-                                          for (byte f = 0; f < filler; f++)
-                                            newString += " ";
-                                        }
-                                      }
-                                      break;
-                                    case 'S' :// Suffix Fill with n spaces: Sn
-                                      if (valueJustLength > 1)
-                                      {
-                                        if (isDigit(valueJust[1])) //Check Sn where n is between 0 and 9
-                                        {
-                                          int filler = valueJust[1] - value.length() - '0' ; //48
-                                          for (byte f = 0; f < filler; f++)
-                                            value += " ";
-                                        }
-                                      }
-                                      break;
-                                    case 'L': //left part of the string
-                                      if (valueJustLength > 1)
-                                      {
-                                        if (isDigit(valueJust[1])) //Check n where n is between 0 and 9
-                                        {
-                                          value = value.substring(0,(int)valueJust[1]-'0');
-                                        }
-                                      }
-                                      break;
-                                    case 'R': //Right part of the string
-                                      if (valueJustLength > 1)
-                                      {
-                                        if (isDigit(valueJust[1])) //Check n where n is between 0 and 9
-                                        {
-                                          value = value.substring(std::max(0,(int)value.length()-((int)valueJust[1]-'0')));
-                                         }
-                                      }
-                                      break;
-                                    case 'U': //Substring Ux.y where x=firstChar and y=number of characters
-                                      if (valueJustLength > 1)
-                                      {
-                                        if (isDigit(valueJust[1]) && valueJust[2]=='.' && isDigit(valueJust[3]) && valueJust[1] > '0' && valueJust[3] > '0')
-                                        {
-                                          value = value.substring(std::min((int)value.length(),(int)valueJust[1]-'0'-1),(int)valueJust[1]-'0'-1+(int)valueJust[3]-'0');
-                                        }
-                                        else
-                                        {
-                                          newString += F("ERR");
-                                        }
-                                      }
-                                      break;
-                                    default:
-                                      newString += F("ERR");
-                                      break;
-                                  }
-                                }
-                              }
-                              if (rightJustify)
-                              {
-                                int filler = lineSize - newString.length() - value.length() - tmpString.length() ;
-                                for (byte f = 0; f < filler; f++)
-                                  newString += " ";
-                              }
-                              {
-                                if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
-                                  String logFormatted = F("DEBUG: Formatted String='");
-                                  logFormatted += newString;
-                                  logFormatted += value;
-                                  logFormatted += "'";
-                                  addLog(LOG_LEVEL_DEBUG, logFormatted);
-                                }
-                              }
-                            }
-                          }
-                          //end of changes by giig1967g - 2018-04-18
-
-                          newString += String(value);
-                          {
-                            if (loglevelActiveFor(LOG_LEVEL_DEBUG_DEV)) {
-                              String logParsed = F("DEBUG DEV: Parsed String='");
-                              logParsed += newString;
-                              logParsed += "'";
-                              addLog(LOG_LEVEL_DEBUG_DEV, logParsed);
-                            }
-                          }
-                          break;
-                        }
-                      }
-                    if (!match) // try if this is a get config request
-                    {
-                      struct EventStruct TempEvent;
-                      TempEvent.TaskIndex = y;
-                      String tmpName = valueName;
-                      if (PluginCall(PLUGIN_GET_CONFIG, &TempEvent, tmpName))
-                        newString += tmpName;
-                    }
-                    break;
-                  }
-                }
+                x = (int)tempValueFormat[1]-'0';
+                y = (int)tempValueFormat[3]-'0';
               }
-            }
+              break;
+            case 1: //D
+            default: //any other combination x=0; y=0;
+              break;
+          }
+          value = toString(valFloat,y);
+          const int indexDot = value.indexOf('.') > 0 ? value.indexOf('.') : value.length();
+          for (byte f = 0; f < (x - indexDot); f++)
+            value = "0" + value;
+          break;
         }
+      case 'F' :// FLOOR (round down)
+        value = (int)floorf(valFloat);
+        break;
+      case 'E' :// CEILING (round up)
+        value = (int)ceilf(valFloat);
+        break;
+      default:
+        value = F("ERR");
+        break;
+    }
+
+    // Check Justification syntax
+    const int valueJustLength = strlen(valueJust);
+    if (valueJustLength > 0) //do the checks only if a Justification is defined to optimize loop
+    {
+      value.trim(); //remove right justification spaces for backward compatibility
+      switch (valueJust[0])
+      {
+        case 'P' :// Prefix Fill with n spaces: Pn
+          if (valueJustLength > 1 && isDigit(valueJust[1])) //Check Pn where n is between 0 and 9
+          {
+            int filler = valueJust[1] - value.length() - '0' ; //char '0' = 48; char '9' = 58
+            for (byte f = 0; f < filler; f++)
+              newString += ' ';
+          }
+          break;
+        case 'S' :// Suffix Fill with n spaces: Sn
+          if (valueJustLength > 1 && isDigit(valueJust[1])) //Check Sn where n is between 0 and 9
+          {
+            int filler = valueJust[1] - value.length() - '0' ; //48
+            for (byte f = 0; f < filler; f++)
+              value += ' ';
+          }
+          break;
+        case 'L': //left part of the string
+          if (valueJustLength > 1 && isDigit(valueJust[1])) //Check n where n is between 0 and 9
+            value = value.substring(0,(int)valueJust[1]-'0');
+          break;
+        case 'R': //Right part of the string
+          if (valueJustLength > 1 && isDigit(valueJust[1])) //Check n where n is between 0 and 9
+            value = value.substring(std::max(0,(int)value.length()-((int)valueJust[1]-'0')));
+          break;
+        case 'U': //Substring Ux.y where x=firstChar and y=number of characters
+          if (valueJustLength > 1)
+          {
+            if (isDigit(valueJust[1]) && valueJust[2]=='.' && isDigit(valueJust[3]) && valueJust[1] > '0' && valueJust[3] > '0')
+              value = value.substring(std::min((int)value.length(),(int)valueJust[1]-'0'-1),(int)valueJust[1]-'0'-1+(int)valueJust[3]-'0');
+            else
+              newString += F("ERR");
+          }
+          break;
+        default:
+          newString += F("ERR");
+          break;
       }
-      leftBracketIndex = tmpString.indexOf('[');
-      count++;
     }
-    checkRAM(F("parseTemplate2"));
-    newString += tmpString;
+  }
+  if (rightJustify)
+  {
+    int filler = lineSize - newString.length() - value.length() - remaining;
+    for (byte f = 0; f < filler; f++)
+      newString += ' ';
+  }
+  if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+    String logFormatted = F("DEBUG: Formatted String='");
+    logFormatted += newString;
+    logFormatted += value;
+    logFormatted += "'";
+    addLog(LOG_LEVEL_DEBUG, logFormatted);
+  }
+  //end of changes by giig1967g - 2018-04-18
+}
+
+/********************************************************************************************\
+  Parse string template
+  Replaces [task#value], [task#value#format] and [Plugin#...] in a single pass over the
+  template, writing into one reserved String. Tasks and values are found by the name index.
+  \*********************************************************************************************/
+String parseTemplate(String &tmpString, byte lineSize)
+{
+  checkRAM(F("parseTemplate"));
+  START_TIMER;
+  String newString;
+  const unsigned int length = tmpString.length();
+  newString.reserve(lineSize > length ? lineSize : length + 16);
+  const char* str = tmpString.c_str();
+  const byte currentTaskIndex = ExtraTaskSettings.TaskIndex;
+  unsigned int pos = 0;
 
-    if (currentTaskIndex != 255)
-      LoadTaskSettings(currentTaskIndex);
+  // replace task template variables
+  while (pos < length)
+  {
+    const char* left = strchr(str + pos, '[');
+    if (left == NULL) {
+      appendChars(newString, str + pos, length - pos);
+      break;
+    }
+    appendChars(newString, str + pos, left - (str + pos));
+    const char* mid = left + 1;
+    const char* right = strchr(mid, ']');
+    if (right == NULL) {
+      // A '[' without ']' is left out.
+      pos = mid - str;
+      continue;
+    }
+    pos = right + 1 - str;
+    const unsigned int midLength = right - mid;
+    const char* hashtag1 = static_cast<const char*>(memchr(mid, '#', midLength));
+    if (hashtag1 == NULL) continue;
+    const unsigned int deviceNameLength = hashtag1 - mid;
+    const char* valueName = hashtag1 + 1;
+    const char* hashtag2 = static_cast<const char*>(memchr(valueName, '#', right - valueName));
+    const unsigned int valueNameLength = (hashtag2 == NULL ? right : hashtag2) - valueName;
+
+    if (deviceNameLength == 6 && strncasecmp_P(mid, PSTR("Plugin"), 6) == 0)
+    {
+      String request;
+      appendChars(request, valueName, right - valueName);
+      request.replace('#', ',');
+      if (PluginCall(PLUGIN_REQUEST, 0, request))
+        newString += request;
+      continue;
+    }
+    const int8_t y = findTaskIndexByName(mid, deviceNameLength, true);
+    if (y < 0) continue;
+    const int8_t z = findTaskValueIndexByName(y, valueName, valueNameLength);
+    if (z < 0)
+    {
+      // try if this is a get config request
+      struct EventStruct TempEvent;
+      TempEvent.TaskIndex = y;
+      String tmpName;
+      appendChars(tmpName, valueName, valueNameLength);
+      if (PluginCall(PLUGIN_GET_CONFIG, &TempEvent, tmpName))
+        newString += tmpName;
+      continue;
+    }
+    // here we know the task and value, so find the uservar
+    bool isvalid;
+    String value = formatUserVar(y, z, isvalid);
+    if (!isvalid) continue;
+    if (hashtag2 != NULL)
+      formatTemplateValue(newString, value, hashtag2 + 1, right - hashtag2 - 1, length - pos, lineSize);
+    newString += value;
+    if (loglevelActiveFor(LOG_LEVEL_DEBUG_DEV)) {
+      String logParsed = F("DEBUG DEV: Parsed String='");
+      logParsed += newString;
+      logParsed += "'";
+      addLog(LOG_LEVEL_DEBUG_DEV, logParsed);
+    }
   }
+  checkRAM(F("parseTemplate2"));
+  if (currentTaskIndex != 255)
+    LoadTaskSettings(currentTaskIndex);
 
   parseSystemVariables(newString, false);
   parseStandardConversions(newString, false);
 
   // padding spaces
   while (newString.length() < lineSize)
-    newString += " ";
+    newString += ' ';
   checkRAM(F("parseTemplate3"));
+  STOP_TIMER(PARSE_TEMPLATE_STATS);
   return newString;
 }
 
 /********************************************************************************************\
   Calculate function for simple expressions
+  The expression is compiled once to RPN (shunting-yard), with constant parts folded.
+  Task value formulas keep their compiled form, see calculateTaskFormula().
   \*********************************************************************************************/
 #define CALCULATE_OK                            0
 #define CALCULATE_ERROR_STACK_OVERFLOW          1
 #define CALCULATE_ERROR_BAD_OPERATOR            2
 #define CALCULATE_ERROR_PARENTHESES_MISMATCHED  3
 #define CALCULATE_ERROR_UNKNOWN_TOKEN           4
-#define STACK_SIZE 10 // was 50
 #define TOKEN_MAX 20
 
-float globalstack[STACK_SIZE];
-float *sp = globalstack - 1;
-float *sp_max = &globalstack[STACK_SIZE - 1];
-
 #define is_operator(c)  (c == '+' || c == '-' || c == '*' || c == '/' || c == '^')
 
-int push(float value)
+// operators
+// precedence   operators         associativity
+// 4            ^                 left to right
+// 3            unary -           right to left
+// 2            * /               left to right
+// 1            + -               left to right
+int op_preced(const char c)
 {
-  if (sp != sp_max) // Full
+  switch (c)
   {
-    *(++sp) = value;
-    return 0;
+    case '^':
+      return 4;
+    case 'n': // unary minus
+      return 3;
+    case '*':
+    case '/':
+      return 2;
+    case '+':
+    case '-':
+      return 1;
   }
-  else
-    return CALCULATE_ERROR_STACK_OVERFLOW;
+  return 0;
 }
 
-float pop()
+byte op_code(const char c)
 {
-  if (sp != (globalstack - 1)) // empty
-    return *(sp--);
-  else
-    return 0.0;
+  switch (c)
+  {
+    case '+': return RPN_OP_ADD;
+    case '-': return RPN_OP_SUB;
+    case '*': return RPN_OP_MUL;
+    case '/': return RPN_OP_DIV;
+    case '^': return RPN_OP_POW;
+  }
+  return RPN_OP_NEG;
 }
 
-float apply_operator(char op, float first, float second)
+float apply_operator(byte op, float first, float second)
 {
   switch (op)
   {
-    case '+':
+    case RPN_OP_ADD:
       return first + second;
-    case '-':
+    case RPN_OP_SUB:
       return first - second;
-    case '*':
+    case RPN_OP_MUL:
       return first * second;
-    case '/':
+    case RPN_OP_DIV:
       return first / second;
-    case '^':
+    case RPN_OP_POW:
       return pow(first, second);
     default:
       return 0;
   }
 }
 
-char *next_token(char *linep)
-{
-  while (isspace(*(linep++)));
-  while (*linep && !isspace(*(linep++)));
-  return linep;
-}
-
-int RPNCalculate(char* token)
-{
-  if (token[0] == 0)
-    return 0; // geen moeite doen voor een lege string
-
-  if (is_operator(token[0]) && token[1] == 0)
-  {
-    float second = pop();
-    float first = pop();
-
-    if (push(apply_operator(token[0], first, second)))
-      return CALCULATE_ERROR_STACK_OVERFLOW;
-  }
-  else // Als er nog een is, dan deze ophalen
-    if (push(atof(token))) // is het een waarde, dan op de stack plaatsen
-      return CALCULATE_ERROR_STACK_OVERFLOW;
-
-  return 0;
-}
-
-// operators
-// precedence   operators         associativity
-// 3            !                 right to left
-// 2            * / %             left to right
-// 1            + - ^             left to right
-int op_preced(const char c)
+int emitCode(RPNProgram& program, byte op)
 {
-  switch (c)
-  {
-    case '^':
-      return 3;
-    case '*':
-    case '/':
-      return 2;
-    case '+':
-    case '-':
-      return 1;
-  }
-  return 0;
+  if (program.codeLength >= RPN_CODE_MAX)
+    return CALCULATE_ERROR_STACK_OVERFLOW;
+  program.code[program.codeLength++] = op;
+  return CALCULATE_OK;
 }
 
-bool op_left_assoc(const char c)
+int emitConstant(RPNProgram& program, float value)
 {
-  switch (c)
-  {
-    case '^':
-    case '*':
-    case '/':
-    case '+':
-    case '-':
-      return true;     // left to right
-      //case '!': return false;    // right to left
-  }
-  return false;
+  if (emitCode(program, RPN_OP_CONST) != CALCULATE_OK)
+    return CALCULATE_ERROR_STACK_OVERFLOW;
+  program.constants[program.constantCount++] = value;
+  return CALCULATE_OK;
 }
 
-unsigned int op_arg_count(const char c)
+// Operators on constants are computed right away.
+int emitOperator(RPNProgram& program, char c)
 {
-  switch (c)
-  {
-    case '^':
-    case '*':
-    case '/':
-    case '+':
-    case '-':
-      return 2;
-      //case '!': return 1;
+  const byte op = op_code(c);
+  byte* code = program.code;
+  const byte length = program.codeLength;
+  if (op == RPN_OP_NEG) {
+    if (length >= 1 && code[length - 1] == RPN_OP_CONST) {
+      program.constants[program.constantCount - 1] *= -1;
+      return CALCULATE_OK;
+    }
+  } else if (length >= 2 && code[length - 1] == RPN_OP_CONST && code[length - 2] == RPN_OP_CONST) {
+    float* constants = program.constants + program.constantCount - 2;
+    constants[0] = apply_operator(op, constants[0], constants[1]);
+    --program.constantCount;
+    --program.codeLength;
+    return CALCULATE_OK;
   }
-  return 0;
+  return emitCode(program, op);
 }
 
-
-int Calculate(const char *input, float* result)
+// Compiles the expression, with allowVariables also %value% and %pvalue%.
+int compileFormula(const char *input, bool allowVariables, RPNProgram& program)
 {
-  checkRAM(F("Calculate"));
-  const char *strpos = input, *strend = input + strlen(input);
-  char token[25];
-  char c, oc, *TokenPos = token;
   char stack[32];       // operator stack
   unsigned int sl = 0;  // stack length
-  char     sc;          // used for record stack element
-  int error = 0;
-
-  //*sp=0; // bug, it stops calculating after 50 times
-  sp = globalstack - 1;
-  oc=c=0;
-  while (strpos < strend)
+  int depth = 0;        // values on the stack while evaluating
+  bool expectOperand = true;
+  char prev = 0;        // previous operator, a '-' directly after one starts a number
+  int error = CALCULATE_OK;
+
+  program.codeLength = 0;
+  program.constantCount = 0;
+  const char *strpos = input;
+  while (*strpos != 0)
   {
-    // read one token from the input stream
-    oc = c;
-    c = *strpos;
-    if (c != ' ')
+    const char c = *strpos;
+    if (c == ' ') {
+      ++strpos;
+      continue;
+    }
+    if (expectOperand)
     {
-      // If the token is a number (identifier), then add it to the token queue.
-      if ((c >= '0' && c <= '9') || c == '.' || (c == '-' && is_operator(oc)))
+      if ((c >= '0' && c <= '9') || c == '.' ||
+          (c == '-' && is_operator(prev) && (isdigit(strpos[1]) || strpos[1] == '.')))
       {
-        *TokenPos = c;
-        ++TokenPos;
+        // If the token is a number, then add it to the output.
+        char token[TOKEN_MAX + 1];
+        byte tokenLength = 0;
+        do {
+          if (tokenLength == TOKEN_MAX) return CALCULATE_ERROR_UNKNOWN_TOKEN;
+          token[tokenLength++] = *strpos++;
+        } while (isdigit(*strpos) || *strpos == '.');
+        token[tokenLength] = 0;
+        error = emitConstant(program, atof(token));
+        ++depth;
+        expectOperand = false;
       }
-
-      // If the token is an operator, op1, then:
-      else if (is_operator(c))
+      else if (allowVariables && c == '%' && strncmp_P(strpos, PSTR("%value%"), 7) == 0)
       {
-        *(TokenPos) = 0;
-        error = RPNCalculate(token);
-        TokenPos = token;
-        if (error)return error;
-        while (sl > 0)
-        {
-          sc = stack[sl - 1];
-          // While there is an operator token, op2, at the top of the stack
-          // op1 is left-associative and its precedence is less than or equal to that of op2,
-          // or op1 has precedence less than that of op2,
-          // The differing operator priority decides pop / push
-          // If 2 operators have equal priority then associativity decides.
-          if (is_operator(sc) && ((op_left_assoc(c) && (op_preced(c) <= op_preced(sc))) || (op_preced(c) < op_preced(sc))))
-          {
-            // Pop op2 off the stack, onto the token queue;
-            *TokenPos = sc;
-            ++TokenPos;
-            *(TokenPos) = 0;
-            error = RPNCalculate(token);
-            TokenPos = token;
-            if (error)return error;
-            sl--;
-          }
-          else
-            break;
-        }
-        // push op1 onto the stack.
-        stack[sl] = c;
-        ++sl;
+        error = emitCode(program, RPN_OP_VALUE);
+        strpos += 7;
+        ++depth;
+        expectOperand = false;
       }
-      // If the token is a left parenthesis, then push it onto the stack.
-      else if (c == '(')
+      else if (allowVariables && c == '%' && strncmp_P(strpos, PSTR("%pvalue%"), 8) == 0)
       {
-        stack[sl] = c;
-        ++sl;
+        error = emitCode(program, RPN_OP_PVALUE);
+        strpos += 8;
+        ++depth;
+        expectOperand = false;
       }
-      // If the token is a right parenthesis:
-      else if (c == ')')
+      // If the token is a left parenthesis or unary minus, then push it onto the stack.
+      else if (c == '(' || c == '-')
       {
-        bool pe = false;
-        // Until the token at the top of the stack is a left parenthesis,
-        // pop operators off the stack onto the token queue
-        while (sl > 0)
-        {
-          *(TokenPos) = 0;
-          error = RPNCalculate(token);
-          TokenPos = token;
-          if (error)return error;
-          sc = stack[sl - 1];
-          if (sc == '(')
-          {
-            pe = true;
-            break;
-          }
-          else
-          {
-            *TokenPos = sc;
-            ++TokenPos;
-            sl--;
-          }
-        }
-        // If the stack runs out without finding a left parenthesis, then there are mismatched parentheses.
-        if (!pe)
-          return CALCULATE_ERROR_PARENTHESES_MISMATCHED;
-
-        // Pop the left parenthesis from the stack, but not onto the token queue.
-        sl--;
-
-        // If the token at the top of the stack is a function token, pop it onto the token queue.
-        if (sl > 0)
-          sc = stack[sl - 1];
-
+        if (sl == sizeof(stack)) return CALCULATE_ERROR_STACK_OVERFLOW;
+        stack[sl++] = c == '-' ? 'n' : c;
+        prev = 0;
+        ++strpos;
       }
       else
-        return CALCULATE_ERROR_UNKNOWN_TOKEN;
+        return is_operator(c) || c == ')' ? CALCULATE_ERROR_BAD_OPERATOR : CALCULATE_ERROR_UNKNOWN_TOKEN;
     }
-    ++strpos;
+    // If the token is an operator, op1, then:
+    else if (is_operator(c))
+    {
+      // While there is an operator op2 at the top of the stack with a precedence
+      // greater than or equal to op1 (all are left-associative), pop op2 to the output.
+      while (sl > 0 && stack[sl - 1] != '(' && op_preced(c) <= op_preced(stack[sl - 1]))
+      {
+        const char sc = stack[--sl];
+        if (sc != 'n') --depth;
+        error = emitOperator(program, sc);
+        if (error) return error;
+      }
+      // push op1 onto the stack.
+      if (sl == sizeof(stack)) return CALCULATE_ERROR_STACK_OVERFLOW;
+      stack[sl++] = c;
+      prev = c;
+      expectOperand = true;
+      ++strpos;
+    }
+    // If the token is a right parenthesis:
+    else if (c == ')')
+    {
+      // Until the token at the top of the stack is a left parenthesis,
+      // pop operators off the stack onto the output
+      while (sl > 0 && stack[sl - 1] != '(')
+      {
+        const char sc = stack[--sl];
+        if (sc != 'n') --depth;
+        error = emitOperator(program, sc);
+        if (error) return error;
+      }
+      // If the stack runs out without finding a left parenthesis, then there are mismatched parentheses.
+      if (sl == 0)
+        return CALCULATE_ERROR_PARENTHESES_MISMATCHED;
+      // Pop the left parenthesis from the stack, but not onto the output.
+      --sl;
+      ++strpos;
+    }
+    else
+      return CALCULATE_ERROR_UNKNOWN_TOKEN;
+
+    if (error) return error;
+    if (depth > RPN_STACK_SIZE) return CALCULATE_ERROR_STACK_OVERFLOW;
   }
+  if (expectOperand)
+    return CALCULATE_ERROR_BAD_OPERATOR;  // Empty or ends with an operator
   // When there are no more tokens to read:
   // While there are still operator tokens in the stack:
   while (sl > 0)
   {
-    sc = stack[sl - 1];
-    if (sc == '(' || sc == ')')
+    const char sc = stack[--sl];
+    if (sc == '(')
       return CALCULATE_ERROR_PARENTHESES_MISMATCHED;
+    error = emitOperator(program, sc);
+    if (error) return error;
+  }
+  return CALCULATE_OK;
+}
 
-    *(TokenPos) = 0;
-    error = RPNCalculate(token);
-    TokenPos = token;
-    if (error)return error;
-    *TokenPos = sc;
-    ++TokenPos;
-    --sl;
+// Only the operands are bound, compileFormula() made sure the stack does not overflow.
+float evaluateFormula(const byte* code, byte codeLength, const float* constants, float value, float pvalue)
+{
+  float stack[RPN_STACK_SIZE];
+  int sp = -1;
+  for (byte i = 0; i < codeLength; ++i)
+  {
+    switch (code[i])
+    {
+      case RPN_OP_CONST:
+        stack[++sp] = *constants++;
+        break;
+      case RPN_OP_VALUE:
+        stack[++sp] = value;
+        break;
+      case RPN_OP_PVALUE:
+        stack[++sp] = pvalue;
+        break;
+      case RPN_OP_NEG:
+        stack[sp] = -stack[sp];
+        break;
+      default:
+        --sp;
+        stack[sp] = apply_operator(code[i], stack[sp], stack[sp + 1]);
+        break;
+    }
   }
+  return stack[0];
+}
 
-  *(TokenPos) = 0;
-  error = RPNCalculate(token);
-  TokenPos = token;
+int Calculate(const char *input, float* result)
+{
+  checkRAM(F("Calculate"));
+  RPNProgram program;
+  const int error = compileFormula(input, false, program);
   if (error)
   {
     *result = 0;
     return error;
   }
-  *result = *sp;
+  *result = evaluateFormula(program.code, program.codeLength, program.constants, 0, 0);
   checkRAM(F("Calculate2"));
   return CALCULATE_OK;
 }
 
+// Case sensitive FNV-1a of the formula text.
+uint32_t getFormulaHash(const char* formula)
+{
+  uint32_t hash = 2166136261ul;
+  for (const char* c = formula; *c != 0; ++c) {
+    hash ^= static_cast<uint8_t>(*c);
+    hash *= 16777619ul;
+  }
+  return hash;
+}
+
+// Formula of a task value, with %value% and %pvalue% (previous value).
+// Compiled on first use and again when the formula text changed.
+int calculateTaskFormula(byte TaskIndex, byte varNr, float value, float pvalue, float* result)
+{
+  const char* formula = ExtraTaskSettings.TaskDeviceFormula[varNr];
+  const uint32_t hash = getFormulaHash(formula);
+  CompiledFormulaStruct& compiled = compiledFormulas[TaskIndex * VARS_PER_TASK + varNr];
+  if ((compiled.code.empty() && compiled.error == 0) || compiled.hash != hash)
+  {
+    RPNProgram program;
+    compiled.hash = hash;
+    compiled.error = compileFormula(formula, true, program);
+    compiled.code.assign(program.code, program.code + program.codeLength);
+    compiled.constants.assign(program.constants, program.constants + program.constantCount);
+    if (compiled.error != 0 && loglevelActiveFor(LOG_LEVEL_ERROR)) {
+      String log = F("CALC : Error ");
+      log += compiled.error;
+      log += F(" in formula: ");
+      log += formula;
+      addLog(LOG_LEVEL_ERROR, log);
+    }
+  }
+  if (compiled.error != 0)
+    return compiled.error;
+  *result = evaluateFormula(compiled.code.data(), compiled.code.size(), compiled.constants.data(), value, pvalue);
+  return CALCULATE_OK;
+}
+
 
 void checkRuleSets(){
 for (byte x=0; x < RULESETS_MAX; x++){
@@ -1934,7 +2424,242 @@ for (byte x=0; x < RULESETS_MAX; x++){
     Serial.print(" ");
     Serial.println(activeRuleSets[x]);
     }
+  compileRuleSet(x, fileName);
+  }
+}
+
+
+/********************************************************************************************\
+  Compile a rules file into a list of lines kept in RAM
+  - Comments, empty lines and "\r" are stripped.
+  - Lines without template markup are trimmed, so no parseTemplate() is needed on execution.
+  - Per line the index of the next "endon" line is kept, to skip blocks not matching the event.
+  When the file cannot be read, memory is low, or the sets together would exceed
+  RULES_CACHE_MAX_BYTES, the rules are processed from file.
+  \*********************************************************************************************/
+void compileRuleSet(byte ruleSet, const String& fileName)
+{
+  releaseCompiledRuleSet(ruleSet);
+  if (!activeRuleSets[ruleSet]) return;
+
+  fs::File f = SPIFFS.open(fileName, "r");
+  if (!f) return;
+  if (FreeMem() < (RULES_COMPILE_MIN_FREE_MEM + 2 * f.size())) {
+    f.close();
+    addLog(LOG_LEVEL_ERROR, F("Rules: Not enough memory to compile rules, use file"));
+    return;
+  }
+  if (getCompiledRuleSetsBytes() + f.size() > RULES_CACHE_MAX_BYTES) {
+    f.close();
+    addLog(LOG_LEVEL_INFO, String(F("Rules: Cache budget exceeded, use file ")) + fileName);
+    return;
+  }
+
+  std::vector<compiledRuleLineStruct>& compiled = compiledRuleSets[ruleSet];
+  String line;
+  byte buf[RULES_BUFFER_SIZE];
+  // Same line splitting as rulesProcessingFile(), so a last line without newline is ignored too.
+  while (f.available()) {
+    const int len = f.read((byte*)buf, RULES_BUFFER_SIZE);
+    for (int x = 0; x < len; x++) {
+      if (buf[x] != 10) {
+        line += char(buf[x]);
+        continue;
+      }
+      line.replace(F("\r"), "");
+      if (line.substring(0, 2) != F("//") && line.length() > 0) {
+        const int comment = line.indexOf(F("//"));
+        if (comment > 0)
+          line = line.substring(0, comment);
+        compiledRuleLineStruct ruleLine;
+        ruleLine.hasTemplate = ruleLineHasTemplate(line);
+        if (!ruleLine.hasTemplate)
+          line.trim();
+        if (line.length() > 0) {
+          ruleLine.line = line;
+          compiled.push_back(ruleLine);
+        }
+      }
+      line = "";
+    }
+  }
+  f.close();
+
+  uint16_t nextEndOn = compiled.size();
+  unsigned int bytes = 0;
+  for (int i = compiled.size() - 1; i >= 0; --i) {
+    bytes += compiled[i].line.length() + sizeof(compiledRuleLineStruct);
+    compiled[i].nextEndOnIndex = nextEndOn;
+    if (!compiled[i].hasTemplate && compiled[i].line.equalsIgnoreCase(F("endon")))
+      nextEndOn = i;
+  }
+  compiledRuleSetBytes[ruleSet] = bytes;
+  compiledRuleSetValid[ruleSet] = true;
+  compileRuleTriggers(ruleSet);
+
+  if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+    String log = F("Rules: Compiled ");
+    log += fileName;
+    log += F(" lines: ");
+    log += compiled.size();
+    log += F(" bytes: ");
+    log += bytes;
+    log += F(" triggers: ");
+    if (compiledRuleTriggersValid[ruleSet])
+      log += compiledRuleTriggers[ruleSet].size();
+    else
+      log += F("not indexed");
+    addLog(LOG_LEVEL_INFO, log);
+  }
+}
+
+void releaseCompiledRuleSet(byte ruleSet)
+{
+  compiledRuleSetValid[ruleSet] = false;
+  compiledRuleTriggersValid[ruleSet] = false;
+  compiledRuleSetBytes[ruleSet] = 0;
+  std::vector<compiledRuleLineStruct>().swap(compiledRuleSets[ruleSet]);
+  std::vector<compiledRuleTriggerStruct>().swap(compiledRuleTriggers[ruleSet]);
+}
+
+unsigned int getCompiledRuleSetsBytes()
+{
+  unsigned int total = 0;
+  for (byte x = 0; x < RULESETS_MAX; x++)
+    total += compiledRuleSetBytes[x];
+  return total;
+}
+
+/********************************************************************************************\
+  Free the rules kept in RAM when memory gets low and compile them again when it is
+  available. Called from rulesProcessing() and runEach30Seconds().
+  \*********************************************************************************************/
+void checkRulesCacheMemory()
+{
+  if (!compiledRuleSetsReleased) {
+    if (getCompiledRuleSetsBytes() == 0 || FreeMem() >= RULES_CACHE_RELEASE_MEM) return;
+    // Not while the rules are being processed, the lines are in use.
+    if (rulesNestingLevel != 0) return;
+    for (byte x = 0; x < RULESETS_MAX; x++)
+      releaseCompiledRuleSet(x);
+    compiledRuleSetsReleased = true;
+    addLog(LOG_LEVEL_ERROR, F("Rules: Low memory, released rules cache"));
+    return;
+  }
+  if (FreeMem() > 2 * RULES_COMPILE_MIN_FREE_MEM) {
+    compiledRuleSetsReleased = false;
+    checkRuleSets();
+  }
+}
+
+/********************************************************************************************\
+  Collect the top level "on" lines of a compiled rules set with the name of the event they
+  trigger on. Lines outside an "on" block have no effect, so processing can jump from one
+  candidate "on" line to the next.
+  The index is not used when a top level line starts with markup, since parseTemplate() may
+  turn it into an "on" line.
+  \*********************************************************************************************/
+void compileRuleTriggers(byte ruleSet)
+{
+  const std::vector<compiledRuleLineStruct>& compiled = compiledRuleSets[ruleSet];
+  std::vector<compiledRuleTriggerStruct>& triggers = compiledRuleTriggers[ruleSet];
+  bool inBlock = false;
+  for (unsigned int i = 0; i < compiled.size(); ++i) {
+    String line = compiled[i].line;
+    line.trim();
+    line.toLowerCase();
+    if (inBlock) {
+      if (!compiled[i].hasTemplate && line == F("endon"))
+        inBlock = false;
+    } else if (line.startsWith(F("on "))) {
+      compiledRuleTriggerStruct trigger;
+      trigger.lineIndex = i;
+      // Same split as processRuleLine()
+      const String rule = line.substring(3);
+      const int split = rule.indexOf(F(" do"));
+      String action;
+      if (split != -1) {
+        String eventTrigger = rule.substring(0, split);
+        if (eventTrigger.endsWith(F(" sync"))) {
+          trigger.synchronous = true;
+          eventTrigger = eventTrigger.substring(0, eventTrigger.length() - 5);
+        }
+        trigger.eventName = getRuleTriggerEventName(eventTrigger);
+        const int equalsPos = eventTrigger.indexOf('=');
+        if (trigger.eventName == F("clock#time") && equalsPos > 0) {
+          const String clockSet = eventTrigger.substring(equalsPos + 1);
+          if (!ruleLineHasTemplate(clockSet))
+            trigger.clockSet = string2TimeLong(clockSet);
+        }
+        action = rule.substring(split + 3);
+        action.trim();
+      }
+      inBlock = action.length() == 0;
+      triggers.push_back(trigger);
+    } else if (compiled[i].hasTemplate && ruleLineHasTemplate(line.substring(0, 1))) {
+      std::vector<compiledRuleTriggerStruct>().swap(triggers);
+      return;
+    }
   }
+  compiledRuleTriggersValid[ruleSet] = true;
+}
+
+// Name part of a rule trigger as matched by ruleMatch(), empty when any event may match.
+String getRuleTriggerEventName(const String& trigger)
+{
+  if (trigger == F("*"))
+    return "";
+  int comparePos = trigger.indexOf('>');
+  if (comparePos <= 0) comparePos = trigger.indexOf('<');
+  if (comparePos <= 0) comparePos = trigger.indexOf('=');
+  String name = comparePos > 0 ? trigger.substring(0, comparePos) : trigger;
+  // Brackets are ignored by ruleMatch(), other markup is only known after parseTemplate()
+  name.replace(F("["), F(""));
+  name.replace(F("]"), F(""));
+  if (ruleLineHasTemplate(name))
+    return "";
+  name.trim();
+  return name;
+}
+
+// Index of the first "on" line at or after lineIndex which may match the event name.
+// Returns the number of lines when there is none.
+unsigned int getNextRuleTriggerLine(byte ruleSet, unsigned int lineIndex, const String& eventName, unsigned int& cursor)
+{
+  const std::vector<compiledRuleTriggerStruct>& triggers = compiledRuleTriggers[ruleSet];
+  while (cursor < triggers.size()) {
+    const compiledRuleTriggerStruct& trigger = triggers[cursor];
+    if (trigger.lineIndex >= lineIndex &&
+        (trigger.eventName.length() == 0 || trigger.eventName == eventName))
+      return trigger.lineIndex;
+    ++cursor;
+  }
+  return compiledRuleSets[ruleSet].size();
+}
+
+// False when no rule can match a Clock#Time event, as far as known from the trigger index.
+bool rulesClockEventWanted(unsigned long clockEvent)
+{
+  for (byte x = 0; x < RULESETS_MAX; x++) {
+    if (!activeRuleSets[x]) continue;
+    if (!compiledRuleTriggersValid[x]) return true;
+    const std::vector<compiledRuleTriggerStruct>& triggers = compiledRuleTriggers[x];
+    for (unsigned int i = 0; i < triggers.size(); ++i) {
+      const compiledRuleTriggerStruct& trigger = triggers[i];
+      if (trigger.eventName.length() == 0) return true;
+      if (trigger.eventName == F("clock#time") &&
+          (trigger.clockSet == 0 || matchClockEvent(clockEvent, trigger.clockSet)))
+        return true;
+    }
+  }
+  return false;
+}
+
+// Check for markup parseTemplate() may replace, like [task#value], %sysvar%, {D} or &deg;
+boolean ruleLineHasTemplate(const String& line)
+{
+  return line.indexOf('[') != -1 || line.indexOf('%') != -1 ||
+         line.indexOf('{') != -1 || line.indexOf('&') != -1;
 }
 
 
@@ -1942,12 +2667,30 @@ for (byte x=0; x < RULESETS_MAX; x++){
   Rules processing
   \*********************************************************************************************/
 void rulesProcessing(String& event)
+{
+  const RuleEventStruct ruleEvent(event);
+  rulesProcessing(ruleEvent);
+}
+
+// The event is queued, for the rules task with RTOS multitasking or else for the
+// scheduler. Not when a rule marked it synchronous, it is raised by the rules
+// themselves (e.g. the "event" command) or the queue is full.
+void rulesProcessing(const RuleEventStruct& event)
+{
+  if (canQueueRuleEvent() && !isSynchronousRuleEvent(event) && queueRuleEvent(event))
+    return;
+  rulesProcessingNow(event);
+}
+
+void rulesProcessingNow(const RuleEventStruct& event)
 {
   checkRAM(F("rulesProcessing"));
+  checkRulesCacheMemory();
+  DISPATCH_START;
   unsigned long timer = millis();
   if (loglevelActiveFor(LOG_LEVEL_INFO)) {
     String log = F("EVENT: ");
-    log += event;
+    log += event.text;
     addLog(LOG_LEVEL_INFO, log);
   }
 
@@ -1961,25 +2704,208 @@ void rulesProcessing(String& event)
     #endif
     fileName += x+1;
     fileName += F(".txt");
-    if(activeRuleSets[x])
-      rulesProcessingFile(fileName, event);
+    if(activeRuleSets[x]) {
+      if (compiledRuleSetValid[x]) {
+        ++rulesCacheHits;
+        rulesProcessingCompiled(x, event);
+      } else {
+        ++rulesCacheMisses;
+        rulesProcessingFile(fileName, event);
+      }
+    }
   }
 
   if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
     String log = F("EVENT: ");
-    log += event;
+    log += event.text;
     log += F(" Processing time:");
     log += timePassedSince(timer);
     log += F(" milliSeconds");
     addLog(LOG_LEVEL_DEBUG, log);
   }
+  DISPATCH_DONE(DISPATCH_RULES, 0, 0);
+}
+
+/********************************************************************************************\
+  Rules event queue, see rulesQueueStruct. With RTOS called with the RTOS state lock held.
+  \*********************************************************************************************/
+bool canQueueRuleEvent()
+{
+  #ifdef USE_RTOS_MULTITASKING
+  if (rtosTaskStats[RTOS_TASK_RULES].handle != NULL)
+    return xTaskGetCurrentTaskHandle() != rtosTaskStats[RTOS_TASK_RULES].handle;
+  #endif
+  return rulesNestingLevel == 0;
+}
+
+// Timer events are processed before the queued value events.
+bool isPriorityRuleEvent(const RuleEventStruct& event)
+{
+  return event.text.startsWith(F("Rules#Timer")) || event.text.startsWith(F("Clock#Time"));
+}
+
+// Copy the event into the entry, its text into a memory block. False when there is no memory.
+bool setRulesQueueEntry(rulesQueueEntry& entry, const RuleEventStruct& event)
+{
+  const size_t size = event.text.length() + 1;
+  char* text = static_cast<char*>(allocBlock(size));
+  if (text == NULL) return false;
+  memcpy(text, event.text.c_str(), size);
+  freeBlock(entry.text);
+  entry.text = text;
+  entry.nameLength = event.nameLength;
+  entry.hasValue = event.hasValue;
+  entry.value = event.value;
+  return true;
+}
+
+bool queueRuleEvent(const RuleEventStruct& event)
+{
+  const bool priority = isPriorityRuleEvent(event);
+  // Timer events differ in their value (the timer number), so they are only replaced by an equal one.
+  const bool wholeText = event.isLiteral() || priority;
+  const size_t nameLength = wholeText ? event.text.length() : event.nameLength;
+  for (byte i = 0; i < rulesQueue.count; ++i) {
+    rulesQueueEntry& entry = rulesQueue.entries[(rulesQueue.first + i) % RULES_QUEUE_SIZE];
+    if (entry.priority != priority) continue;
+    const size_t queuedLength = wholeText ? strlen(entry.text) : entry.nameLength;
+    if (queuedLength == nameLength && strncasecmp(entry.text, event.text.c_str(), nameLength) == 0) {
+      // Keeps its place in the queue and enqueue time, so the latency is not reset.
+      if (!setRulesQueueEntry(entry, event)) return false;
+      ++rulesQueue.coalesced;
+      return true;
+    }
+  }
+  if (rulesQueue.count >= RULES_QUEUE_SIZE) {
+    if (!priority || !dropRuleQueueValueEvent()) {
+      ++rulesQueue.full;
+      return false;
+    }
+  }
+  rulesQueueEntry& entry = rulesQueue.entries[(rulesQueue.first + rulesQueue.count) % RULES_QUEUE_SIZE];
+  if (!setRulesQueueEntry(entry, event)) return false;
+  entry.enqueued = micros();
+  entry.priority = priority;
+  ++rulesQueue.count;
+  ++rulesQueue.queued;
+  if (rulesQueue.count > rulesQueue.maxCount)
+    rulesQueue.maxCount = rulesQueue.count;
+  #ifdef USE_RTOS_MULTITASKING
+  if (rtosTaskStats[RTOS_TASK_RULES].handle != NULL)
+    xTaskNotifyGive(rtosTaskStats[RTOS_TASK_RULES].handle);
+  #endif
+  return true;
+}
+
+// Remove the queued entry at pos, the entries before it move up.
+void removeRulesQueueEntry(byte pos)
+{
+  freeBlock(rulesQueue.entries[(rulesQueue.first + pos) % RULES_QUEUE_SIZE].text);
+  for (byte i = pos; i > 0; --i) {
+    rulesQueue.entries[(rulesQueue.first + i) % RULES_QUEUE_SIZE] =
+      rulesQueue.entries[(rulesQueue.first + i - 1) % RULES_QUEUE_SIZE];
+  }
+  rulesQueue.entries[rulesQueue.first] = rulesQueueEntry();
+  rulesQueue.first = (rulesQueue.first + 1) % RULES_QUEUE_SIZE;
+  --rulesQueue.count;
+}
+
+// Make room for a timer event in a full queue. Returns false when it only holds timer events.
+bool dropRuleQueueValueEvent()
+{
+  for (byte i = 0; i < rulesQueue.count; ++i) {
+    if (!rulesQueue.entries[(rulesQueue.first + i) % RULES_QUEUE_SIZE].priority) {
+      removeRulesQueueEntry(i);
+      ++rulesQueue.dropped;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Process the first queued timer event, or else the oldest event. Returns false when the queue is empty.
+bool processRulesQueue()
+{
+  if (rulesQueue.count == 0) return false;
+  byte pos = 0;
+  for (byte i = 0; i < rulesQueue.count; ++i) {
+    if (rulesQueue.entries[(rulesQueue.first + i) % RULES_QUEUE_SIZE].priority) {
+      pos = i;
+      break;
+    }
+  }
+  const rulesQueueEntry& entry = rulesQueue.entries[(rulesQueue.first + pos) % RULES_QUEUE_SIZE];
+  const RuleEventStruct event(entry.text, entry.nameLength, entry.hasValue, entry.value);
+  const unsigned long latency = usecPassedSince(entry.enqueued);
+  removeRulesQueueEntry(pos);
+  ++rulesQueue.processed;
+  rulesQueue.latencyTotal += latency;
+  if (latency > rulesQueue.latencyMax)
+    rulesQueue.latencyMax = latency;
+  rulesProcessingNow(event);
+  return true;
+}
+
+// Called from the scheduler when there is no rules task. At least one event is processed per call.
+void processRulesQueueBudget()
+{
+  #ifdef USE_RTOS_MULTITASKING
+  if (rtosTaskStats[RTOS_TASK_RULES].handle != NULL) return;
+  #endif
+  const unsigned long start = millis();
+  while (processRulesQueue() && timePassedSince(start) < RULES_QUEUE_BUDGET) {}
+}
+
+// Rules with "sync" after the event name of the "on" line, e.g. "on Switch#State sync do".
+// Only known for compiled rules sets, events for rules processed from file are queued.
+bool isSynchronousRuleEvent(const RuleEventStruct& event)
+{
+  String eventName;
+  for (byte x = 0; x < RULESETS_MAX; x++) {
+    if (!activeRuleSets[x] || !compiledRuleTriggersValid[x]) continue;
+    const std::vector<compiledRuleTriggerStruct>& triggers = compiledRuleTriggers[x];
+    for (unsigned int i = 0; i < triggers.size(); ++i) {
+      if (!triggers[i].synchronous) continue;
+      if (triggers[i].eventName.length() == 0) return true;
+      if (eventName.length() == 0) {
+        eventName = event.getName();
+        eventName.toLowerCase();
+      }
+      if (triggers[i].eventName == eventName) return true;
+    }
+  }
+  return false;
+}
 
+String getRulesQueueStats()
+{
+  String result;
+  result += rulesQueue.count;
+  result += '/';
+  result += rulesQueue.maxCount;
+  result += '/';
+  result += rulesQueue.coalesced;
+  result += '/';
+  result += rulesQueue.full;
+  result += '/';
+  result += rulesQueue.dropped;
+  result += '/';
+  result += rulesQueue.processed == 0 ? 0 : rulesQueue.latencyTotal / rulesQueue.processed;
+  result += '/';
+  result += rulesQueue.latencyMax;
+  return result;
+}
+
+// Process all queued rules events in the caller, e.g. before going to sleep.
+void flushRulesQueue()
+{
+  while (processRulesQueue()) {}
 }
 
 /********************************************************************************************\
   Rules processing
   \*********************************************************************************************/
-String rulesProcessingFile(String fileName, String& event)
+String rulesProcessingFile(String fileName, const RuleEventStruct& event)
 {
   checkRAM(F("rulesProcessingFile"));
   if (Settings.SerialLogLevel == LOG_LEVEL_DEBUG_DEV){
@@ -1988,263 +2914,327 @@ String rulesProcessingFile(String fileName, String& event)
     Serial.println(F("     flags CMI  parse output:"));
     }
 
-  static byte nestingLevel = 0;
   int data = 0;
-  String log = "";
 
-  nestingLevel++;
-  if (nestingLevel > RULES_MAX_NESTING_LEVEL)
+  rulesNestingLevel++;
+  if (rulesNestingLevel > RULES_MAX_NESTING_LEVEL)
   {
     addLog(LOG_LEVEL_ERROR, F("EVENT: Error: Nesting level exceeded!"));
-    nestingLevel--;
-    return (log);
+    rulesNestingLevel--;
+    return ("");
   }
 
   fs::File f = SPIFFS.open(fileName, "r+");
   SPIFFS_CHECK(f, fileName.c_str());
 
   String line = "";
-  boolean match = false;
-  boolean codeBlock = false;
-  boolean isCommand = false;
-  boolean conditional = false;
-  boolean condition = false;
-  boolean ifBranche = false;
-  boolean ifBrancheJustMatch = false;
+  rulesProcessingStateStruct state;
 
   byte buf[RULES_BUFFER_SIZE];
   int len = 0;
   while (f.available())
   {
-    len = f.read((byte*)buf, RULES_BUFFER_SIZE);
-    for (int x = 0; x < len; x++) {
-      data = buf[x];
+    len = f.read((byte*)buf, RULES_BUFFER_SIZE);
+    ++rulesFileReads;
+    for (int x = 0; x < len; x++) {
+      data = buf[x];
+
+      SPIFFS_CHECK(data >= 0, fileName.c_str());
+
+      if (data != 10)
+        line += char(data);
+
+      if (data == 10)    // if line complete, parse this rule
+      {
+        line.replace(F("\r"), "");
+        if (line.substring(0, 2) != F("//") && line.length() > 0)
+        {
+          int comment = line.indexOf(F("//"));
+          if (comment > 0)
+            line = line.substring(0, comment);
+
+          processRuleLine(line, event, state);
+        }
+
+        line = "";
+      }
+    }
+  }
+
+  rulesNestingLevel--;
+  checkRAM(F("rulesProcessingFile2"));
+  return (F(""));
+}
+
+/********************************************************************************************\
+  Rules processing of a rules set compiled by compileRuleSet()
+  \*********************************************************************************************/
+void rulesProcessingCompiled(byte ruleSet, const RuleEventStruct& event)
+{
+  checkRAM(F("rulesProcessingCompiled"));
+  rulesNestingLevel++;
+  if (rulesNestingLevel > RULES_MAX_NESTING_LEVEL)
+  {
+    addLog(LOG_LEVEL_ERROR, F("EVENT: Error: Nesting level exceeded!"));
+    rulesNestingLevel--;
+    return;
+  }
+
+  // Literal events (starting with '!') are matched on a prefix, so they cannot use the index.
+  const bool useTriggers = compiledRuleTriggersValid[ruleSet] && !event.isLiteral();
+  String eventName;
+  unsigned int triggerCursor = 0;
+  if (useTriggers) {
+    eventName = event.getName();
+    eventName.toLowerCase();
+  }
+
+  rulesProcessingStateStruct state;
+  unsigned int i = useTriggers ? getNextRuleTriggerLine(ruleSet, 0, eventName, triggerCursor) : 0;
+  while (compiledRuleSetValid[ruleSet] && i < compiledRuleSets[ruleSet].size())
+  {
+    const compiledRuleLineStruct& ruleLine = compiledRuleSets[ruleSet][i];
+    const uint16_t nextEndOn = ruleLine.nextEndOnIndex;
+    const bool blockStarted = !state.codeBlock;
+    String line = ruleLine.line;
+    processRuleLine(line, event, state);
+    if (blockStarted && state.codeBlock && !state.match) {
+      // Lines of a non matching block are ignored until "endon"
+      i = nextEndOn;
+    } else {
+      ++i;
+    }
+    if (useTriggers && !state.codeBlock) {
+      // Not in a block, continue at the next "on" line which may match this event.
+      i = getNextRuleTriggerLine(ruleSet, i, eventName, triggerCursor);
+    }
+  }
 
-      SPIFFS_CHECK(data >= 0, fileName.c_str());
+  rulesNestingLevel--;
+  checkRAM(F("rulesProcessingCompiled2"));
+}
 
-      if (data != 10)
-        line += char(data);
+/********************************************************************************************\
+  Process a single rules line, with comments already stripped
+  \*********************************************************************************************/
+void processRuleLine(String& line, const RuleEventStruct& event, rulesProcessingStateStruct& state)
+{
+  String log;
+  state.isCommand = true;
 
-      if (data == 10)    // if line complete, parse this rule
-      {
-        line.replace(F("\r"), "");
-        if (line.substring(0, 2) != F("//") && line.length() > 0)
-        {
-          isCommand = true;
+  if ((state.match || !state.codeBlock) && ruleLineHasTemplate(line)) {
+    // only parse [xxx#yyy] if we have a matching ruleblock or need to eval the "on" (no codeBlock)
+    // This to avoid waisting CPU time...
+    line = parseTemplate(line, line.length());
+  }
+  line.trim();
 
-          int comment = line.indexOf(F("//"));
-          if (comment > 0)
-            line = line.substring(0, comment);
+  String lineOrg = line; // store original line for future use
+  line.toLowerCase(); // convert all to lower case to make checks easier
 
-          if (match || !codeBlock) {
-            // only parse [xxx#yyy] if we have a matching ruleblock or need to eval the "on" (no codeBlock)
-            // This to avoid waisting CPU time...
-            line = parseTemplate(line, line.length());
-          }
-          line.trim();
 
-          String lineOrg = line; // store original line for future use
-          line.toLowerCase(); // convert all to lower case to make checks easier
+  String eventTrigger = "";
+  String action = "";
 
+  if (!state.codeBlock)  // do not check "on" rules if a block of actions is to be processed
+  {
+    if (line.startsWith(F("on ")))
+    {
+      line = line.substring(3);
+      int split = line.indexOf(F(" do"));
+      if (split != -1)
+      {
+        eventTrigger = line.substring(0, split);
+        action = lineOrg.substring(split + 7);
+        action.trim();
+        // Only used to decide if the event may be queued, see isSynchronousRuleEvent()
+        if (eventTrigger.endsWith(F(" sync")))
+          eventTrigger = eventTrigger.substring(0, eventTrigger.length() - 5);
+      }
+      if (eventTrigger == "*") // wildcard, always process
+        state.match = true;
+      else
+        state.match = ruleMatch(event, eventTrigger);
+      if (action.length() > 0) // single on/do/action line, no block
+      {
+        state.isCommand = true;
+        state.codeBlock = false;
+      }
+      else
+      {
+        state.isCommand = false;
+        state.codeBlock = true;
+      }
+    }
+  }
+  else
+  {
+    action = lineOrg;
+  }
 
-          String eventTrigger = "";
-          String action = "";
+  String lcAction = action;
+  lcAction.toLowerCase();
+  if (lcAction == F("endon")) // Check if action block has ended, then we will wait for a new "on" rule
+  {
+    state.isCommand = false;
+    state.codeBlock = false;
+    state.match = false;
+  }
 
-          if (!codeBlock)  // do not check "on" rules if a block of actions is to be processed
-          {
-            if (line.startsWith(F("on ")))
-            {
-              line = line.substring(3);
-              int split = line.indexOf(F(" do"));
-              if (split != -1)
-              {
-                eventTrigger = line.substring(0, split);
-                action = lineOrg.substring(split + 7);
-                action.trim();
-              }
-              if (eventTrigger == "*") // wildcard, always process
-                match = true;
-              else
-                match = ruleMatch(event, eventTrigger);
-              if (action.length() > 0) // single on/do/action line, no block
-              {
-                isCommand = true;
-                codeBlock = false;
-              }
-              else
-              {
-                isCommand = false;
-                codeBlock = true;
-              }
-            }
-          }
-          else
-          {
-            action = lineOrg;
-          }
+  if (Settings.SerialLogLevel == LOG_LEVEL_DEBUG_DEV){
+    Serial.print(F("RuleDebug: "));
+    Serial.print(state.codeBlock);
+    Serial.print(state.match);
+    Serial.print(state.isCommand);
+    Serial.print(F(": "));
+    Serial.println(line);
+  }
 
-          String lcAction = action;
-          lcAction.toLowerCase();
-          if (lcAction == F("endon")) // Check if action block has ended, then we will wait for a new "on" rule
-          {
-            isCommand = false;
-            codeBlock = false;
-            match = false;
-          }
+  if (state.match) // rule matched for one action or a block of actions
+  {
+    int split = lcAction.indexOf(F("if ")); // check for optional "if" condition
+    boolean elseif = lcAction.startsWith(F("elseif "));
+    if (elseif == false && split != -1)
+    {
+      state.conditional = true;
+      String check = lcAction.substring(split + 3);
 
-          if (Settings.SerialLogLevel == LOG_LEVEL_DEBUG_DEV){
-            Serial.print(F("RuleDebug: "));
-            Serial.print(codeBlock);
-            Serial.print(match);
-            Serial.print(isCommand);
-            Serial.print(F(": "));
-            Serial.println(line);
-          }
 
-          if (match) // rule matched for one action or a block of actions
-          {
-            int split = lcAction.indexOf(F("if ")); // check for optional "if" condition
-            boolean elseif = lcAction.startsWith(F("elseif "));
-            if (elseif == false && split != -1)
-            {
-              conditional = true;
-              String check = lcAction.substring(split + 3);
-
-
-              log = F("[if ");
-              log += check;
-              log += F("]=");
-              condition = ifBrancheJustMatch == false && conditionMatchExtended(check);
-              if(condition == true)
-              {
-                 ifBrancheJustMatch = true;
-              }
-              ifBranche = true;
-              isCommand = false;
-              log += condition ? F("true") : F("false");
-              addLog(LOG_LEVEL_DEBUG, log);
-            }
+      log = F("[if ");
+      log += check;
+      log += F("]=");
+      state.condition = state.ifBrancheJustMatch == false && conditionMatchExtended(check);
+      if(state.condition == true)
+      {
+         state.ifBrancheJustMatch = true;
+      }
+      state.ifBranche = true;
+      state.isCommand = false;
+      log += state.condition ? F("true") : F("false");
+      addLog(LOG_LEVEL_DEBUG, log);
+    }
 
-            if(elseif)
-            {
-              String check = lcAction.substring(7);
-              log = F("[elseif ");
-              log += check;
-              log += "]=";
-              condition = ifBrancheJustMatch == false && conditionMatchExtended(check);
-              if(condition == true)
-              {
-                 ifBrancheJustMatch = true;
-              }
-              ifBranche = true;
-              isCommand = false;
-              log += condition ? F("true") : F("false");
-              addLog(LOG_LEVEL_DEBUG, log);
-            }
+    if(elseif)
+    {
+      String check = lcAction.substring(7);
+      log = F("[elseif ");
+      log += check;
+      log += "]=";
+      state.condition = state.ifBrancheJustMatch == false && conditionMatchExtended(check);
+      if(state.condition == true)
+      {
+         state.ifBrancheJustMatch = true;
+      }
+      state.ifBranche = true;
+      state.isCommand = false;
+      log += state.condition ? F("true") : F("false");
+      addLog(LOG_LEVEL_DEBUG, log);
+    }
 
-            if (lcAction == "else") // in case of an "else" block of actions, set ifBranche to false
-            {
-              ifBranche = false;
-              isCommand = false;
-              if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
-                String log = F("else = ");
-                log += (conditional && (condition == ifBranche)) ? F("true") : F("false");
-                addLog(LOG_LEVEL_DEBUG, log);
-              }
-            }
+    if (lcAction == "else") // in case of an "else" block of actions, set ifBranche to false
+    {
+      state.ifBranche = false;
+      state.isCommand = false;
+      if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+        String log = F("else = ");
+        log += (state.conditional && (state.condition == state.ifBranche)) ? F("true") : F("false");
+        addLog(LOG_LEVEL_DEBUG, log);
+      }
+    }
 
-            if (lcAction == "endif") // conditional block ends here
-            {
-              conditional = false;
-              isCommand = false;
-              ifBranche = false;
-              ifBrancheJustMatch = false;
-            }
+    if (lcAction == "endif") // conditional block ends here
+    {
+      state.conditional = false;
+      state.isCommand = false;
+      state.ifBranche = false;
+      state.ifBrancheJustMatch = false;
+    }
 
-            // process the action if it's a command and unconditional, or conditional and the condition matches the if or else block.
-            if (isCommand && ((!conditional) || (conditional && (condition == ifBranche))))
-            {
-              if (event.charAt(0) == '!')
-              {
-                action.replace(F("%eventvalue%"), event); // substitute %eventvalue% with literal event string if starting with '!'
-              }
-              else
-              {
-                int equalsPos = event.indexOf("=");
-                if (equalsPos > 0)
-                {
-                  String tmpString = event.substring(equalsPos + 1);
-                  action.replace(F("%eventvalue%"), tmpString); // substitute %eventvalue% in actions with the actual value from the event
-                }
-              }
+    // process the action if it's a command and unconditional, or conditional and the condition matches the if or else block.
+    if (state.isCommand && ((!state.conditional) || (state.conditional && (state.condition == state.ifBranche))))
+    {
+      if (event.isLiteral())
+      {
+        action.replace(F("%eventvalue%"), event.text); // substitute %eventvalue% with literal event string if starting with '!'
+      }
+      else if (event.nameLength < event.text.length() && action.indexOf('%') != -1)
+      {
+        String tmpString = event.text.substring(event.nameLength + 1);
+        action.replace(F("%eventvalue%"), tmpString); // substitute %eventvalue% in actions with the actual value from the event
+      }
 
-              if (loglevelActiveFor(LOG_LEVEL_INFO)) {
-                String log = F("ACT  : ");
-                log += action;
-                addLog(LOG_LEVEL_INFO, log);
-              }
+      if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+        String log = F("ACT  : ");
+        log += action;
+        addLog(LOG_LEVEL_INFO, log);
+      }
 
-              struct EventStruct TempEvent;
-              parseCommandString(&TempEvent, action);
-              yield();
-              // Use a tmp string to call PLUGIN_WRITE, since PluginCall may inadvertenly alter the string.
-              String tmpAction(action);
-              if (!PluginCall(PLUGIN_WRITE, &TempEvent, tmpAction)) {
-                if (!tmpAction.equals(action)) {
-                  if (loglevelActiveFor(LOG_LEVEL_ERROR)) {
-                    String log = F("PLUGIN_WRITE altered the string: ");
-                    log += action;
-                    log += F(" to: ");
-                    log += tmpAction;
-                    addLog(LOG_LEVEL_ERROR, log);
-                  }
-                }
-                ExecuteCommand(VALUE_SOURCE_SYSTEM, action.c_str());
-              }
-              yield();
-            }
+      struct EventStruct TempEvent;
+      parseCommandString(&TempEvent, action);
+      yield();
+      // Use a tmp string to call PLUGIN_WRITE, since PluginCall may inadvertenly alter the string.
+      String tmpAction(action);
+      if (!PluginCall(PLUGIN_WRITE, &TempEvent, tmpAction)) {
+        if (!tmpAction.equals(action)) {
+          if (loglevelActiveFor(LOG_LEVEL_ERROR)) {
+            String log = F("PLUGIN_WRITE altered the string: ");
+            log += action;
+            log += F(" to: ");
+            log += tmpAction;
+            addLog(LOG_LEVEL_ERROR, log);
           }
         }
-
-        line = "";
+        ExecuteCommand(VALUE_SOURCE_SYSTEM, action.c_str());
       }
+      yield();
     }
   }
+}
 
-  nestingLevel--;
-  checkRAM(F("rulesProcessingFile2"));
-  return (F(""));
+
+/********************************************************************************************\
+  Equal compare of rule values. Values of task events are not rounded to their decimals, so
+  e.g. 21.4999 from a formula must still match "=21.5". Relative to the largest value, at
+  least 1.
+  \*********************************************************************************************/
+#define RULES_FLOAT_EPSILON  0.0001
+
+boolean rulesValuesEqual(float value1, float value2)
+{
+  float scale = fabs(value1) > fabs(value2) ? fabs(value1) : fabs(value2);
+  if (scale < 1) scale = 1;
+  return fabs(value1 - value2) <= RULES_FLOAT_EPSILON * scale;
 }
 
 
 /********************************************************************************************\
   Check if an event matches to a given rule
   \*********************************************************************************************/
-boolean ruleMatch(String& event, String& rule)
+boolean ruleMatch(const RuleEventStruct& event, const String& rule)
 {
   checkRAM(F("ruleMatch"));
-  boolean match = false;
-  String tmpEvent = event;
-  String tmpRule = rule;
-
-  //Ignore escape char
-  tmpRule.replace(F("["),F(""));
-  tmpRule.replace(F("]"),F(""));
+  const String& eventText = event.text;
 
   // Special handling of literal string events, they should start with '!'
-  if (event.charAt(0) == '!')
+  if (event.isLiteral())
   {
+    String tmpEvent = eventText;
+    String tmpRule = rule;
+    //Ignore escape char
+    tmpRule.replace(F("["),F(""));
+    tmpRule.replace(F("]"),F(""));
+
     int pos = rule.indexOf('#');
     if (pos == -1) // no # sign in rule, use 'wildcard' match on event 'source'
       {
-        tmpEvent = event.substring(0,rule.length());
+        tmpEvent = eventText.substring(0,rule.length());
         tmpRule = rule;
       }
 
     pos = rule.indexOf('*');
     if (pos != -1) // a * sign in rule, so use a'wildcard' match on message
       {
-        tmpEvent = event.substring(0,pos-1);
+        tmpEvent = eventText.substring(0,pos-1);
         tmpRule = rule.substring(0,pos-1);
       }
 
@@ -2254,20 +3244,16 @@ boolean ruleMatch(String& event, String& rule)
       return false;
   }
 
-  if (event.startsWith(F("Clock#Time"))) // clock events need different handling...
+  if (eventText.startsWith(F("Clock#Time"))) // clock events need different handling...
   {
-    int pos1 = event.indexOf("=");
+    int pos1 = event.nameLength;
     int pos2 = rule.indexOf("=");
-    if (pos1 > 0 && pos2 > 0)
+    if (event.hasValue && pos2 > 0)
     {
-      tmpEvent = event.substring(0, pos1);
-      tmpRule  = rule.substring(0, pos2);
-      if (tmpRule.equalsIgnoreCase(tmpEvent)) // if this is a clock rule
+      if (ruleNameEquals(rule.c_str(), pos2, eventText.c_str(), pos1)) // if this is a clock rule
       {
-        tmpEvent = event.substring(pos1 + 1);
-        tmpRule  = rule.substring(pos2 + 1);
-        unsigned long clockEvent = string2TimeLong(tmpEvent);
-        unsigned long clockSet = string2TimeLong(tmpRule);
+        unsigned long clockEvent = string2TimeLong(eventText.substring(pos1 + 1));
+        unsigned long clockSet = string2TimeLong(rule.substring(pos2 + 1));
         if (matchClockEvent(clockEvent, clockSet))
           return true;
         else
@@ -2276,17 +3262,6 @@ boolean ruleMatch(String& event, String& rule)
     }
   }
 
-
-  // parse event into verb and value
-  float value = 0;
-  int pos = event.indexOf("=");
-  if (pos)
-  {
-    tmpEvent = event.substring(pos + 1);
-    value = tmpEvent.toFloat();
-    tmpEvent = event.substring(0, pos);
-  }
-
   // parse rule
   int comparePos = 0;
   char compare = ' ';
@@ -2312,164 +3287,189 @@ boolean ruleMatch(String& event, String& rule)
     }
   }
 
-  float ruleValue = 0;
-
-  if (comparePos > 0)
-  {
-    tmpRule = rule.substring(comparePos + 1);
-    ruleValue = tmpRule.toFloat();
-    tmpRule = rule.substring(0, comparePos);
-  }
+  // Names are compared in place, the value of the event is already known.
+  const char* ruleText = rule.c_str();
+  const unsigned int ruleNameLength = compare == ' ' ? rule.length() : comparePos;
+  if (!ruleNameEquals(ruleText, ruleNameLength, eventText.c_str(), event.nameLength))
+    return false;
 
+  boolean match = false;
+  const float value = event.value;
+  const float ruleValue = compare == ' ' ? 0 : atof(ruleText + comparePos + 1);
   switch (compare)
   {
     case '>':
-      if (tmpRule.equalsIgnoreCase(tmpEvent) && value > ruleValue)
-        match = true;
+      match = value > ruleValue && !rulesValuesEqual(value, ruleValue);
       break;
 
     case '<':
-      if (tmpRule.equalsIgnoreCase(tmpEvent) && value < ruleValue)
-        match = true;
+      match = value < ruleValue && !rulesValuesEqual(value, ruleValue);
       break;
 
     case '=':
-      if (tmpRule.equalsIgnoreCase(tmpEvent) && value == ruleValue)
-        match = true;
+      match = rulesValuesEqual(value, ruleValue);
       break;
 
     case ' ':
-      if (tmpRule.equalsIgnoreCase(tmpEvent))
-        match = true;
+      match = true;
       break;
   }
   checkRAM(F("ruleMatch2"));
   return match;
 }
 
+// Case insensitive compare of the name in a rule with the name of an event, '[' and ']' in the rule are ignored.
+boolean ruleNameEquals(const char* rule, unsigned int ruleLength, const char* name, unsigned int nameLength)
+{
+  unsigned int pos = 0;
+  for (unsigned int i = 0; i < ruleLength; ++i) {
+    const char c = rule[i];
+    if (c == '[' || c == ']') continue;
+    if (pos >= nameLength || tolower(c) != tolower(name[pos])) return false;
+    ++pos;
+  }
+  return pos == nameLength;
+}
+
 
 /********************************************************************************************\
   Check expression
   \*********************************************************************************************/
 
 boolean conditionMatchExtended(String& check) {
-	int condAnd = -1;
-	int condOr = -1;
-	boolean rightcond = false;
-	boolean leftcond = conditionMatch(check); // initial check
-
-	do {
-		condAnd = check.indexOf(F(" and "));
-		condOr  = check.indexOf(F(" or "));
-
-		if (condAnd > 0 || condOr > 0) { // we got AND/OR
-			if (condAnd > 0	&& ((condOr < 0 && condOr < condAnd) || (condOr > 0 && condOr > condAnd))) { //AND is first
-				check = check.substring(condAnd + 5);
-				rightcond = conditionMatch(check);
-				leftcond = (leftcond && rightcond);
-			} else { //OR is first
-				check = check.substring(condOr + 4);
-				rightcond = conditionMatch(check);
-				leftcond = (leftcond || rightcond);
-			}
+	// Each condition is evaluated from its start to the end of the line, like conditionMatch(check).
+	const char* condition = check.c_str();
+	boolean leftcond = conditionMatch(condition); // initial check
+
+	while (true) {
+		const char* condAnd = strstr(condition, " and ");
+		const char* condOr  = strstr(condition, " or ");
+		// Positions 0 are not an AND/OR, same as in the String version
+		if (condAnd == condition) condAnd = NULL;
+		if (condOr == condition) condOr = NULL;
+		if (condAnd == NULL && condOr == NULL) break;
+		if (condAnd != NULL && (condOr == NULL || condOr > condAnd)) { //AND is first
+			condition = condAnd + 5;
+			leftcond = conditionMatch(condition) && leftcond;
+		} else { //OR is first
+			condition = condOr + 4;
+			leftcond = conditionMatch(condition) || leftcond;
 		}
-	} while (condAnd > 0 || condOr > 0);
+	}
 	return leftcond;
 }
 
 boolean conditionMatch(const String& check)
+{
+  return conditionMatch(check.c_str());
+}
+
+// Value of one side of a condition, as number or as time ("hh:mm" or "hh:mm:ss" in seconds).
+// The range is not terminated, atof() stops at the compare operator.
+float conditionValue(const char* text, unsigned int length, bool asTime)
+{
+  if (!asTime)
+    return atof(text);
+  float sec = atof(text) * 60 * 60;
+  const char* split = static_cast<const char*>(memchr(text, ':', length));
+  if (split != NULL) {
+    ++split;
+    sec += atof(split) * 60;
+    split = static_cast<const char*>(memchr(split, ':', length - (split - text)));
+    if (split != NULL) {
+      sec += atof(split + 1);
+    }
+  }
+  return sec;
+}
+
+// Compare the values in a condition, without copying the parts of the text.
+boolean conditionMatch(const char* check)
 {
   boolean match = false;
 
   char compare    = ' ';
 
-  int posStart = check.length();
+  const int length = strlen(check);
+  int posStart = length;
   int posEnd = posStart;
-  int comparePos  = 0;
+  const char* found;
 
-  if ((comparePos = check.indexOf("!="))>0 && comparePos<posStart) {
-	  posStart = comparePos;
+  if ((found = strstr(check, "!=")) != NULL && found > check && found - check < posStart) {
+	  posStart = found - check;
 	  posEnd = posStart+2;
 	  compare = '!'+'=';
   }
-  if ((comparePos = check.indexOf("<>"))>0 && comparePos<posStart) {
-	  posStart = comparePos;
+  if ((found = strstr(check, "<>")) != NULL && found > check && found - check < posStart) {
+	  posStart = found - check;
 	  posEnd = posStart+2;
 	  compare = '!'+'=';
   }
-  if ((comparePos = check.indexOf(">="))>0 && comparePos<posStart) {
-	  posStart = comparePos;
+  if ((found = strstr(check, ">=")) != NULL && found > check && found - check < posStart) {
+	  posStart = found - check;
 	  posEnd = posStart+2;
 	  compare = '>'+'=';
   }
-  if ((comparePos = check.indexOf("<="))>0 && comparePos<posStart) {
-	  posStart = comparePos;
+  if ((found = strstr(check, "<=")) != NULL && found > check && found - check < posStart) {
+	  posStart = found - check;
 	  posEnd = posStart+2;
 	  compare = '<'+'=';
   }
-  if ((comparePos = check.indexOf("<"))>0 && comparePos<posStart) {
-	  posStart = comparePos;
+  if ((found = strchr(check, '<')) != NULL && found > check && found - check < posStart) {
+	  posStart = found - check;
 	  posEnd = posStart+1;
 	  compare = '<';
   }
-  if ((comparePos = check.indexOf(">"))>0 && comparePos<posStart) {
-	  posStart = comparePos;
+  if ((found = strchr(check, '>')) != NULL && found > check && found - check < posStart) {
+	  posStart = found - check;
 	  posEnd = posStart+1;
 	  compare = '>';
   }
-  if ((comparePos = check.indexOf("="))>0 && comparePos<posStart) {
-	  posStart = comparePos;
+  if ((found = strchr(check, '=')) != NULL && found > check && found - check < posStart) {
+	  posStart = found - check;
 	  posEnd = posStart+1;
 	  compare = '=';
   }
 
-  float Value1 = 0;
-  float Value2 = 0;
-
-  if (compare > ' ')
-  {
-    String tmpCheck1 = check.substring(0, posStart);
-    String tmpCheck2 = check.substring(posEnd);
-    if (!isFloat(tmpCheck1) || !isFloat(tmpCheck2)) {
-        Value1 = timeStringToSeconds(tmpCheck1);
-        Value2 = timeStringToSeconds(tmpCheck2);
-    } else {
-        Value1 = tmpCheck1.toFloat();
-        Value2 = tmpCheck2.toFloat();
-    }
-  }
-  else
+  if (compare <= ' ')
     return false;
 
+  // Both sides are compared as time when one of them is not a plain number.
+  const bool asTime = !isNumerical(check, posStart, false) || !isNumerical(check + posEnd, length - posEnd, false);
+  const float Value1 = conditionValue(check, posStart, asTime);
+  const float Value2 = conditionValue(check + posEnd, length - posEnd, asTime);
+  // Times are whole seconds
+  const bool equal = asTime ? Value1 == Value2 : rulesValuesEqual(Value1, Value2);
+
   switch (compare)
   {
   case '>'+'=':
-	  if (Value1 >= Value2)
+	  if (Value1 >= Value2 || equal)
 		  match = true;
 	  break;
 
   case '<'+'=':
-	  if (Value1 <= Value2)
+	  if (Value1 <= Value2 || equal)
 		  match = true;
 	  break;
 
   case '!'+'=':
-	  if (Value1 != Value2)
+	  if (!equal)
 		  match = true;
 	  break;
 
   case '>':
-	  if (Value1 > Value2)
+	  if (Value1 > Value2 && !equal)
 		  match = true;
 	  break;
 
   case '<':
-	  if (Value1 < Value2)
+	  if (Value1 < Value2 && !equal)
 		  match = true;
 	  break;
 
   case '=':
-	  if (Value1 == Value2)
+	  if (equal)
 		  match = true;
 	  break;
   }
@@ -2477,27 +3477,6 @@ boolean conditionMatch(const String& check)
 }
 
 
-/********************************************************************************************\
-  Check rule timers
-  \*********************************************************************************************/
-void rulesTimers()
-{
-  for (byte x = 0; x < RULES_TIMER_MAX; x++)
-  {
-    if (!RulesTimer[x].paused && RulesTimer[x].timestamp != 0L) // timer active?
-    {
-      if (timeOutReached(RulesTimer[x].timestamp)) // timer finished?
-      {
-        RulesTimer[x].timestamp = 0L; // turn off this timer
-        String event = F("Rules#Timer=");
-        event += x + 1;
-        rulesProcessing(event);
-      }
-    }
-  }
-}
-
-
 /********************************************************************************************\
   Generate rule events based on task refresh
   \*********************************************************************************************/
@@ -2505,8 +3484,10 @@ void rulesTimers()
 void createRuleEvents(byte TaskIndex)
 {
   LoadTaskSettings(TaskIndex);
-  byte BaseVarIndex = TaskIndex * VARS_PER_TASK;
-  byte DeviceIndex = getDeviceIndex(Settings.TaskDeviceNumber[TaskIndex]);
+  // All events of this run use the same set of values.
+  TaskValueSnapshot snapshot;
+  getTaskValueSnapshot(TaskIndex, snapshot);
+  byte DeviceIndex = getDeviceIndex_from_TaskIndex(TaskIndex);
   byte sensorType = Device[DeviceIndex].VType;
   for (byte varNr = 0; varNr < Device[DeviceIndex].ValueCount; varNr++)
   {
@@ -2515,16 +3496,60 @@ void createRuleEvents(byte TaskIndex)
     eventString += ExtraTaskSettings.TaskDeviceValueNames[varNr];
     eventString += F("=");
 
-    if (sensorType == SENSOR_TYPE_LONG)
-      eventString += (unsigned long)UserVar[BaseVarIndex] + ((unsigned long)UserVar[BaseVarIndex + 1] << 16);
-    else
-      eventString += UserVar[BaseVarIndex + varNr];
+    // The value is passed along, so it is not parsed again from the text.
+    float value;
+    if (sensorType == SENSOR_TYPE_LONG) {
+      const unsigned long longValue = snapshot.getLong();
+      eventString += longValue;
+      value = longValue;
+    } else if (snapshot.types[varNr] != TASK_VALUE_FLOAT) {
+      // Typed values with all digits
+      char formatted[FORMAT_VALUE_BUFFER_SIZE];
+      formatTaskValue(snapshot, varNr, ExtraTaskSettings.TaskDeviceValueDecimals[varNr], formatted);
+      eventString += formatted;
+      value = snapshot.values[varNr];
+    } else {
+      value = snapshot.values[varNr];
+      eventString += value;
+    }
 
-    rulesProcessing(eventString);
+    const RuleEventStruct ruleEvent(eventString, value);
+    rulesProcessing(ruleEvent);
   }
 }
 
 
+/********************************************************************************************\
+  Value logger, lines are collected in RAM and appended to the SD card in one write
+  when the buffer is full, after VALUE_LOGGER_FLUSH_INTERVAL and before sleep or reboot.
+  With valid time the files are named YYMMDDnn.CSV, a new one is started every day
+  and when VALUE_LOGGER_MAX_FILE_SIZE is reached. Without valid time VALUES.CSV is used.
+  \*********************************************************************************************/
+#define VALUE_LOGGER_BUFFER_SIZE     1024    // Bytes collected before writing
+#define VALUE_LOGGER_FLUSH_INTERVAL 60000    // msec, max. age of a buffered line
+#define VALUE_LOGGER_MAX_FILE_SIZE  1048576  // Bytes per file before starting the next one
+#define VALUE_LOGGER_LINE_SIZE        128
+
+#ifdef FEATURE_SD
+#if defined(ESP32)
+  #define VALUE_LOGGER_OPEN_MODE FILE_APPEND
+#else
+  #define VALUE_LOGGER_OPEN_MODE FILE_WRITE    // Appends on ESP8266
+#endif
+
+char valueLoggerBuffer[VALUE_LOGGER_BUFFER_SIZE];
+uint16_t valueLoggerLength = 0;
+unsigned long valueLoggerFirstLine = 0; // millis() of the oldest buffered line
+unsigned long valueLoggerDate = 0;      // YYMMDD of the buffered lines, 0 = no valid time
+byte valueLoggerFileNr = 0;
+unsigned long valueLoggerFileDate = 0;  // Date of valueLoggerFileNr
+#endif
+
+unsigned long getValueLoggerDate() {
+  if (year() < 2000) return 0;
+  return (year() % 100) * 10000ul + tm.Month * 100ul + tm.Day;
+}
+
 void SendValueLogger(byte TaskIndex)
 {
   bool featureSD = false;
@@ -2532,35 +3557,87 @@ void SendValueLogger(byte TaskIndex)
     featureSD = true;
   #endif
 
-  String logger;
-  if (featureSD || loglevelActiveFor(LOG_LEVEL_DEBUG)) {
-    LoadTaskSettings(TaskIndex);
-    byte DeviceIndex = getDeviceIndex(Settings.TaskDeviceNumber[TaskIndex]);
-    for (byte varNr = 0; varNr < Device[DeviceIndex].ValueCount; varNr++)
-    {
-      logger += getDateString('-');
-      logger += F(" ");
-      logger += getTimeString(':');
-      logger += F(",");
-      logger += Settings.Unit;
-      logger += F(",");
-      logger += getTaskDeviceName(TaskIndex);
-      logger += F(",");
-      logger += ExtraTaskSettings.TaskDeviceValueNames[varNr];
-      logger += F(",");
-      logger += formatUserVarNoCheck(TaskIndex, varNr);
-      logger += F("\r\n");
-    }
+  if (!featureSD && !loglevelActiveFor(LOG_LEVEL_DEBUG)) return;
+
+  LoadTaskSettings(TaskIndex);
+  byte DeviceIndex = getDeviceIndex_from_TaskIndex(TaskIndex);
+  char line[VALUE_LOGGER_LINE_SIZE];
+  char formatted[FORMAT_VALUE_BUFFER_SIZE];
+  for (byte varNr = 0; varNr < Device[DeviceIndex].ValueCount; varNr++)
+  {
+    formatUserVarNoCheck(TaskIndex, varNr, formatted);
+    const int length = snprintf_P(line, sizeof(line), PSTR("%04d-%02d-%02d %02d:%02d:%02d,%u,%s,%s,%s\r\n"),
+      year(), tm.Month, tm.Day, tm.Hour, tm.Minute, tm.Second,
+      Settings.Unit,
+      ExtraTaskSettings.TaskDeviceName,
+      ExtraTaskSettings.TaskDeviceValueNames[varNr],
+      formatted);
+    if (length <= 0) continue;
+    addLog(LOG_LEVEL_DEBUG, line);
+#ifdef FEATURE_SD
+    appendValueLogger(line, min(length, (int)sizeof(line) - 1));
+#endif
+  }
+}
 
-    addLog(LOG_LEVEL_DEBUG, logger);
+#ifdef FEATURE_SD
+void appendValueLogger(const char* line, uint16_t length)
+{
+  const unsigned long date = getValueLoggerDate();
+  if (valueLoggerLength != 0 &&
+      (date != valueLoggerDate || valueLoggerLength + length > VALUE_LOGGER_BUFFER_SIZE)) {
+    // Keep every file to the lines of one day.
+    flushValueLogger();
+  }
+  if (valueLoggerLength == 0) {
+    valueLoggerFirstLine = millis();
+    valueLoggerDate = date;
+  }
+  memcpy(valueLoggerBuffer + valueLoggerLength, line, length);
+  valueLoggerLength += length;
+}
+
+String getValueLoggerFileName()
+{
+  if (valueLoggerDate == 0) return F("VALUES.CSV");
+  if (valueLoggerDate != valueLoggerFileDate) {
+    valueLoggerFileDate = valueLoggerDate;
+    valueLoggerFileNr = 0;
+  }
+  char filename[13];
+  snprintf_P(filename, sizeof(filename), PSTR("%06lu%02u.CSV"), valueLoggerDate, valueLoggerFileNr);
+  return filename;
+}
+#endif
+
+// Write the buffered value log lines to the SD card.
+void flushValueLogger()
+{
+#ifdef FEATURE_SD
+  if (valueLoggerLength == 0) return;
+  File logFile = SD.open(getValueLoggerFileName(), VALUE_LOGGER_OPEN_MODE);
+  while (logFile && valueLoggerDate != 0 && valueLoggerFileNr < 99 &&
+         logFile.size() + valueLoggerLength > VALUE_LOGGER_MAX_FILE_SIZE) {
+    logFile.close();
+    ++valueLoggerFileNr;
+    logFile = SD.open(getValueLoggerFileName(), VALUE_LOGGER_OPEN_MODE);
+  }
+  if (logFile) {
+    logFile.write((const uint8_t*)valueLoggerBuffer, valueLoggerLength);
+    logFile.close();
+  } else {
+    addLog(LOG_LEVEL_ERROR, F("SD   : Cannot open value log file"));
   }
+  valueLoggerLength = 0;
+#endif
+}
 
+// Flush the value log when the oldest line is waiting too long, called once a second.
+void processValueLogger()
+{
 #ifdef FEATURE_SD
-  String filename = F("VALUES.CSV");
-  File logFile = SD.open(filename, FILE_WRITE);
-  if (logFile)
-    logFile.print(logger);
-  logFile.close();
+  if (valueLoggerLength != 0 && timePassedSince(valueLoggerFirstLine) > VALUE_LOGGER_FLUSH_INTERVAL)
+    flushValueLogger();
 #endif
 }
 
@@ -2687,177 +3764,19 @@ void checkRAM( String &a ) {
 #define isdigit(n) (n >= '0' && n <= '9')
 
 /********************************************************************************************\
-  Generate a tone of specified frequency on pin
+  Generate a tone of specified frequency on pin, played in the background (see TonePlayer)
   \*********************************************************************************************/
 void tone(uint8_t _pin, unsigned int frequency, unsigned long duration) {
-  #ifdef ESP32
-    delay(duration);
-  #else
-    analogWriteFreq(frequency);
-    //NOTE: analogwrite reserves IRAM and uninitalized ram.
-    analogWrite(_pin,100);
-    delay(duration);
-    analogWrite(_pin,0);
-  #endif
+  tonePlayerTone(_pin, frequency, duration);
 }
 
 /********************************************************************************************\
-  Play RTTTL string on specified pin
+  Play RTTTL string on specified pin, played in the background (see TonePlayer)
   \*********************************************************************************************/
-void play_rtttl(uint8_t _pin, const char *p )
+bool play_rtttl(uint8_t _pin, const char *p )
 {
   checkRAM(F("play_rtttl"));
-  #define OCTAVE_OFFSET 0
-  // FIXME: Absolutely no error checking in here
-
-  const int notes[] = { 0,
-    262, 277, 294, 311, 330, 349, 370, 392, 415, 440, 466, 494,
-    523, 554, 587, 622, 659, 698, 740, 784, 831, 880, 932, 988,
-    1047, 1109, 1175, 1245, 1319, 1397, 1480, 1568, 1661, 1760, 1865, 1976,
-    2093, 2217, 2349, 2489, 2637, 2794, 2960, 3136, 3322, 3520, 3729, 3951
-  };
-
-
-
-  byte default_dur = 4;
-  byte default_oct = 6;
-  int bpm = 63;
-  int num;
-  long wholenote;
-  long duration;
-  byte note;
-  byte scale;
-
-  // format: d=N,o=N,b=NNN:
-  // find the start (skip name, etc)
-
-  while(*p != ':') p++;    // ignore name
-  p++;                     // skip ':'
-
-  // get default duration
-  if(*p == 'd')
-  {
-    p++; p++;              // skip "d="
-    num = 0;
-    while(isdigit(*p))
-    {
-      num = (num * 10) + (*p++ - '0');
-    }
-    if(num > 0) default_dur = num;
-    p++;                   // skip comma
-  }
-
-  // get default octave
-  if(*p == 'o')
-  {
-    p++; p++;              // skip "o="
-    num = *p++ - '0';
-    if(num >= 3 && num <=7) default_oct = num;
-    p++;                   // skip comma
-  }
-
-  // get BPM
-  if(*p == 'b')
-  {
-    p++; p++;              // skip "b="
-    num = 0;
-    while(isdigit(*p))
-    {
-      num = (num * 10) + (*p++ - '0');
-    }
-    bpm = num;
-    p++;                   // skip colon
-  }
-
-  // BPM usually expresses the number of quarter notes per minute
-  wholenote = (60 * 1000L / bpm) * 4;  // this is the time for whole note (in milliseconds)
-
-  // now begin note loop
-  while(*p)
-  {
-    // first, get note duration, if available
-    num = 0;
-    while(isdigit(*p))
-    {
-      num = (num * 10) + (*p++ - '0');
-    }
-
-    if (num) duration = wholenote / num;
-    else duration = wholenote / default_dur;  // we will need to check if we are a dotted note after
-
-    // now get the note
-    note = 0;
-
-    switch(*p)
-    {
-      case 'c':
-        note = 1;
-        break;
-      case 'd':
-        note = 3;
-        break;
-      case 'e':
-        note = 5;
-        break;
-      case 'f':
-        note = 6;
-        break;
-      case 'g':
-        note = 8;
-        break;
-      case 'a':
-        note = 10;
-        break;
-      case 'b':
-        note = 12;
-        break;
-      case 'p':
-      default:
-        note = 0;
-    }
-    p++;
-
-    // now, get optional '#' sharp
-    if(*p == '#')
-    {
-      note++;
-      p++;
-    }
-
-    // now, get optional '.' dotted note
-    if(*p == '.')
-    {
-      duration += duration/2;
-      p++;
-    }
-
-    // now, get scale
-    if(isdigit(*p))
-    {
-      scale = *p - '0';
-      p++;
-    }
-    else
-    {
-      scale = default_oct;
-    }
-
-    scale += OCTAVE_OFFSET;
-
-    if(*p == ',')
-      p++;       // skip comma for next note (or we may be at the end)
-
-    // now play the note
-    if(note)
-    {
-      tone(_pin, notes[(scale - 4) * 12 + note], duration);
-    }
-    else
-    {
-      delay(duration/10);
-    }
-  }
- checkRAM(F("play_rtttl2"));
+  return tonePlayerRtttl(_pin, p);
 }
 
 //#endif
@@ -2879,6 +3798,7 @@ void ArduinoOTAInit()
 
   ArduinoOTA.onStart([]() {
       Serial.println(F("OTA  : Start upload"));
+      closeCachedReadFile();
       SPIFFS.end(); //important, otherwise it fails
   });
 
@@ -1,16 +1,89 @@
-
 # ifndef MODBUS_H
 # define MODBUS_H
 
+//********************************************************************************
+// Modbus TCP master
+// A connection per slave address is kept open and shared by all tasks reading
+// from it. The registers are read in ranges (up to 125 registers per request)
+// into a register map in RAM, several requests are sent without waiting for the
+// replies and matched on their transaction ID. The values are taken from the map.
+// processModbusTCP() sends the requests and parses the replies, from
+// backgroundtasks().
+//********************************************************************************
 enum MODBUS_states_t {MODBUS_IDLE, MODBUS_RECEIVE, MODBUS_RECEIVE_PAYLOAD};
 enum MODBUS_registerTypes_t {signed16, unsigned16, signed32, unsigned32, signed64, unsigned64};
 
-#define MODBUS_FUNCTION_READ 4
+#define MODBUS_FUNCTION_READ_HOLDING 3
+#define MODBUS_FUNCTION_READ 4           // Input registers
+
+#define MODBUS_TCP_PORT              502
+#define MODBUS_TCP_CONNECTIONS         2
+#define MODBUS_TCP_RANGES              8   // Register map entries per connection
+#define MODBUS_TCP_PIPELINE            4   // Requests waiting for a reply per connection
+#define MODBUS_TCP_MAX_REGISTERS     125   // Per request, protocol limit
+#define MODBUS_TCP_TIMEOUT          2000   // msec for a reply
+#define MODBUS_TCP_RECONNECT        5000   // msec between connect attempts
+#define MODBUS_TCP_MBAP_SIZE           6   // Transaction ID, protocol ID, length
+#define MODBUS_TCP_MAX_FRAME   (MODBUS_TCP_MBAP_SIZE + 3 + 2 * MODBUS_TCP_MAX_REGISTERS)
+
+struct ModbusRegisterRange
+{
+  ModbusRegisterRange() : values(NULL), start(0), count(0), unit(0), function(0), users(0),
+    requested(false), valid(false), updated(0), replies(0), failures(0) {}
+
+  uint16_t* values;        // NULL when the entry is free
+  uint16_t start;
+  uint16_t count;
+  uint8_t unit;
+  uint8_t function;
+  byte users;
+  bool requested;          // Waiting to be sent
+  bool valid;
+  unsigned long updated;   // millis() of the last reply
+  unsigned long replies;   // Counters to see a new reply or failure
+  unsigned long failures;
+};
+
+struct ModbusPendingRequest
+{
+  uint16_t transactionId;
+  int8_t range;
+  unsigned long sent;
+};
+
+struct ModbusTCPConnection
+{
+  ModbusTCPConnection() : users(0), pendingCount(0), nextTransactionId(1), lastConnect(0), rxLength(0) {}
+
+  String host;
+  byte users;
+  WiFiClient client;
+  ModbusRegisterRange ranges[MODBUS_TCP_RANGES];
+  ModbusPendingRequest pending[MODBUS_TCP_PIPELINE];
+  byte pendingCount;
+  uint16_t nextTransactionId;
+  unsigned long lastConnect;
+  uint8_t rx[MODBUS_TCP_MAX_FRAME];
+  uint16_t rxLength;
+};
+
+struct ModbusTCPStatsStruct
+{
+  ModbusTCPStatsStruct() : requests(0), replies(0), registers(0), errors(0), timeouts(0), connects(0) {}
+
+  unsigned long requests;
+  unsigned long replies;
+  unsigned long registers;   // Read by the replies
+  unsigned long errors;      // Exception replies and invalid frames
+  unsigned long timeouts;
+  unsigned long connects;
+} modbusTCPStats;
 
 class Modbus
 {
   public:
     Modbus(void);
+    ~Modbus();
     bool handle();
     bool begin(uint8_t function, uint8_t ModbusID, uint16_t ModbusRegister, MODBUS_registerTypes_t type, char* IPaddress);
     double read() {
@@ -37,15 +110,12 @@ class Modbus
     bool tryRead (uint8_t ModbusID, uint16_t M_register,  MODBUS_registerTypes_t type, char* IPaddress, double &result);
 
   private:
-    WiFiClient *ModbusClient; // pointer to tcp client
+    int connection;           // Shared connection, -1 when none
+    int range;                // Register map entry of the current register
+    unsigned long replies;    // Counters of the range at the request
+    unsigned long failures;
     unsigned int errcnt;
-    char sendBuffer[12] =  {0, 1, 0, 0, 0, 6, 0x7e, 4, 0x9d, 7, 0, 1};
-    String LogString = "";    // for debug logging
-    unsigned long timeout;    // send and read timeout
     MODBUS_states_t TXRXstate;// state for handle() state machine
-    unsigned int RXavailable;
-    unsigned int payLoad;     // number of bytes to receive as payload. Payload may come as seperate frame.
-    bool hasTimeout();
     MODBUS_registerTypes_t incomingValue; // how to interpret the incoming value
     double result;                        // incoming value, converted to double
     bool resultReceived;                  // incoming value is valid ?
@@ -54,171 +124,405 @@ class Modbus
     };
     uint16_t currentRegister;
     uint8_t currentFunction;
+    uint8_t currentID;
+    void release();
 };
 #endif
 
+ModbusTCPConnection* modbusTCP[MODBUS_TCP_CONNECTIONS] = { NULL };
 
+// type is a MODBUS_registerTypes_t, as byte for the generated prototypes.
+byte modbusRegisterCount(byte type) {
+  switch (type) {
+    case signed64:
+    case unsigned64:
+      return 4;
+    case signed32:
+    case unsigned32:
+      return 2;
+    default:
+      break;
+  }
+  return 1;
+}
 
-Modbus::Modbus() : ModbusClient(nullptr), errcnt(0), timeout(0),
-                   TXRXstate(MODBUS_IDLE), RXavailable(0), payLoad(0) {}
+// Connection to a slave, shared with the tasks using the same host. Returns -1 when all are in use.
+int modbusTCPOpen(const String& host) {
+  int free_slot = -1;
+  for (byte i = 0; i < MODBUS_TCP_CONNECTIONS; ++i) {
+    if (modbusTCP[i] == NULL) {
+      if (free_slot < 0) free_slot = i;
+    } else if (modbusTCP[i]->host.equalsIgnoreCase(host)) {
+      ++modbusTCP[i]->users;
+      return i;
+    }
+  }
+  if (free_slot < 0) {
+    addLog(LOG_LEVEL_ERROR, F("MBTCP: No free connection"));
+    return -1;
+  }
+  ModbusTCPConnection* conn = new ModbusTCPConnection();
+  if (conn == NULL) return -1;
+  conn->host = host;
+  conn->users = 1;
+  conn->lastConnect = millis() - MODBUS_TCP_RECONNECT;
+  modbusTCP[free_slot] = conn;
+  return free_slot;
+}
 
-bool Modbus::begin(uint8_t function, uint8_t ModbusID, uint16_t ModbusRegister,  MODBUS_registerTypes_t type, char* IPaddress)
-{
-  currentRegister = ModbusRegister;
-  currentFunction = function;
-  incomingValue = type;
-  resultReceived = false;
-  ModbusClient = new WiFiClient();
-  ModbusClient->setNoDelay(true);
-  ModbusClient->setTimeout(200);
-  timeout = millis();
-  ModbusClient->flush();
-
-  if (ModbusClient->connected()) {
-    LogString += F(" already connected. ");
-  } else {
-    LogString += F("connect: ");      LogString += IPaddress;
-    if ( !ModbusClient->connect(IPaddress, 502)) {
-      LogString += F(" fail. ");
-      TXRXstate = MODBUS_IDLE;
-      errcnt++;
-      if (LogString.length() > 1 ) addLog(LOG_LEVEL_DEBUG, LogString);
-      return false;
+void modbusTCPClose(int connection) {
+  if (connection < 0 || connection >= MODBUS_TCP_CONNECTIONS || modbusTCP[connection] == NULL) return;
+  ModbusTCPConnection* conn = modbusTCP[connection];
+  if (conn->users > 1) {
+    --conn->users;
+    return;
+  }
+  conn->client.stop();
+  for (byte i = 0; i < MODBUS_TCP_RANGES; ++i)
+    delete[] conn->ranges[i].values;
+  delete conn;
+  modbusTCP[connection] = NULL;
+}
+
+struct ModbusRegisterRange* modbusTCPRange(int connection, int range) {
+  if (connection < 0 || connection >= MODBUS_TCP_CONNECTIONS || modbusTCP[connection] == NULL) return NULL;
+  if (range < 0 || range >= MODBUS_TCP_RANGES || modbusTCP[connection]->ranges[range].values == NULL) return NULL;
+  return &modbusTCP[connection]->ranges[range];
+}
+
+// Add registers to the register map of a connection, shared when another task reads
+// the same range. function is MODBUS_FUNCTION_READ_HOLDING or MODBUS_FUNCTION_READ.
+// Returns the range, -1 when the map is full.
+int modbusTCPAddRange(int connection, uint8_t unit, uint8_t function, uint16_t start, uint16_t count) {
+  if (connection < 0 || connection >= MODBUS_TCP_CONNECTIONS || modbusTCP[connection] == NULL) return -1;
+  if (count == 0 || count > MODBUS_TCP_MAX_REGISTERS) return -1;
+  ModbusTCPConnection* conn = modbusTCP[connection];
+  int free_slot = -1;
+  for (byte i = 0; i < MODBUS_TCP_RANGES; ++i) {
+    ModbusRegisterRange& r = conn->ranges[i];
+    if (r.values == NULL) {
+      if (free_slot < 0) free_slot = i;
+    } else if (r.unit == unit && r.function == function && r.start == start && r.count == count) {
+      ++r.users;
+      return i;
     }
   }
-  LogString += F(" OK, sending read request: ");
-
-  sendBuffer[6] = ModbusID ;
-  sendBuffer[7] = function;
-  sendBuffer[8] = (ModbusRegister >> 8) ;
-  sendBuffer[9] = (ModbusRegister & 0x00ff) ;
-  if ((incomingValue == signed64) || (incomingValue == unsigned64))
-    sendBuffer[11] = 4;
-  if ((incomingValue == signed32) || (incomingValue == unsigned32))
-    sendBuffer[11] = 2;
-  if ((incomingValue == signed16) || (incomingValue == unsigned16))
-    sendBuffer[11] = 1;
-  ModbusClient->flush();
-  ModbusClient->write(&sendBuffer[0], sizeof(sendBuffer));
-  for (unsigned int i = 0; i < sizeof(sendBuffer); i++) {
-    LogString += ((unsigned int)(sendBuffer[i]));
-    LogString += (" ");
+  if (free_slot < 0) {
+    addLog(LOG_LEVEL_ERROR, F("MBTCP: Register map full"));
+    return -1;
   }
-  TXRXstate = MODBUS_RECEIVE;
-  if (LogString.length() > 1 ) addLog(LOG_LEVEL_DEBUG, LogString);
+  ModbusRegisterRange& r = conn->ranges[free_slot];
+  r = ModbusRegisterRange();
+  r.values = new uint16_t[count];
+  if (r.values == NULL) return -1;
+  r.unit = unit;
+  r.function = function;
+  r.start = start;
+  r.count = count;
+  r.users = 1;
+  return free_slot;
+}
+
+void modbusTCPRemoveRange(int connection, int range) {
+  ModbusRegisterRange* r = modbusTCPRange(connection, range);
+  if (r == NULL) return;
+  if (r->users > 1) {
+    --r->users;
+    return;
+  }
+  ModbusTCPConnection* conn = modbusTCP[connection];
+  for (byte i = 0; i < conn->pendingCount; ++i)
+    if (conn->pending[i].range == range) conn->pending[i].range = -1;  // Reply is ignored
+  delete[] r->values;
+  *r = ModbusRegisterRange();
+}
+
+// Read the range again, sent by processModbusTCP(). A request not sent yet is not repeated.
+bool modbusTCPRequest(int connection, int range) {
+  ModbusRegisterRange* r = modbusTCPRange(connection, range);
+  if (r == NULL) return false;
+  r->requested = true;
+  processModbusTCP();
   return true;
 }
 
-bool Modbus::handle() {
-  unsigned int RXavailable = 0;
-  LogString = "";
-  int64_t rxValue = 0;
-  switch ( TXRXstate ) {
-
-    case MODBUS_IDLE:
-      // clean up;
-      if (ModbusClient) {
-        ModbusClient->flush();
-        ModbusClient->stop();
-        delete (ModbusClient);
-        delay(1);
-        ModbusClient = nullptr;
-      }
-      break;
+// Value of a register from the register map, false when it was not read (yet).
+bool modbusTCPValue(int connection, int range, uint16_t reg, byte type, double& value) {
+  const ModbusRegisterRange* r = modbusTCPRange(connection, range);
+  if (r == NULL || !r->valid) return false;
+  const byte words = modbusRegisterCount(type);
+  if (reg < r->start || reg + words > r->start + r->count) return false;
+  uint64_t rxValue = 0;
+  for (byte i = 0; i < words; ++i)
+    rxValue = (rxValue << 16) | r->values[reg - r->start + i];
+  switch (type) {
+    case signed16:   value = static_cast<int16_t>(rxValue); break;
+    case unsigned16: value = static_cast<uint16_t>(rxValue); break;
+    case signed32:   value = static_cast<int32_t>(rxValue); break;
+    case unsigned32: value = static_cast<uint32_t>(rxValue); break;
+    case signed64:   value = static_cast<int64_t>(rxValue); break;
+    case unsigned64: value = rxValue; break;
+  }
+  return true;
+}
 
-    case MODBUS_RECEIVE:
-      if  (hasTimeout())  break;
-      if  (ModbusClient->available() < 9)  break;
+void modbusTCPFail(struct ModbusTCPConnection* conn, int8_t range) {
+  if (range >= 0 && conn->ranges[range].values != NULL)
+    ++conn->ranges[range].failures;
+}
 
-      LogString += F("reading bytes: ");
-      for (int a = 0; a < 9; a++) {
-        payLoad = ModbusClient->read();
-        LogString += (payLoad);  LogString += F(" ");
-      }
-      LogString += F("> ");
-      if (payLoad > 8) {
-        LogString += F("Payload too large !? ");
-        errcnt++;
-        TXRXstate = MODBUS_IDLE;
-      }
+// Drop the connection and fail the requests waiting for a reply, the stream can not be trusted anymore.
+void modbusTCPDisconnect(struct ModbusTCPConnection* conn) {
+  conn->client.stop();
+  for (byte i = 0; i < conn->pendingCount; ++i)
+    modbusTCPFail(conn, conn->pending[i].range);
+  conn->pendingCount = 0;
+  conn->rxLength = 0;
+}
 
-    case MODBUS_RECEIVE_PAYLOAD:
-      if  (hasTimeout())  break;
-      RXavailable = ModbusClient->available();
-      if (payLoad != RXavailable) {
-        TXRXstate = MODBUS_RECEIVE_PAYLOAD;
-        break;
-      }
-      for (unsigned int i = 0; i < RXavailable; i++) {
-        rxValue = rxValue << 8;
-        char a = ModbusClient->read();
-        rxValue = rxValue | a;
-        LogString += ((int)a);  LogString += (" ");
+void modbusTCPSend(struct ModbusTCPConnection* conn, byte range) {
+  ModbusRegisterRange& r = conn->ranges[range];
+  const uint16_t transactionId = conn->nextTransactionId++;
+  const uint8_t request[12] = {
+    static_cast<uint8_t>(transactionId >> 8), static_cast<uint8_t>(transactionId & 0xFF),
+    0, 0,      // protocol ID
+    0, 6,      // length of what follows
+    r.unit, r.function,
+    static_cast<uint8_t>(r.start >> 8), static_cast<uint8_t>(r.start & 0xFF),
+    static_cast<uint8_t>(r.count >> 8), static_cast<uint8_t>(r.count & 0xFF)
+  };
+  r.requested = false;
+  if (conn->client.write(request, sizeof(request)) != sizeof(request)) {
+    modbusTCPFail(conn, range);
+    ++modbusTCPStats.errors;
+    modbusTCPDisconnect(conn);
+    return;
+  }
+  ModbusPendingRequest& pending = conn->pending[conn->pendingCount++];
+  pending.transactionId = transactionId;
+  pending.range = range;
+  pending.sent = millis();
+  ++modbusTCPStats.requests;
+}
+
+// Handle a complete reply frame in conn->rx.
+void modbusTCPReply(struct ModbusTCPConnection* conn, uint16_t frameLength) {
+  const uint8_t* rx = conn->rx;
+  const uint16_t transactionId = (rx[0] << 8) | rx[1];
+  byte p = 0;
+  while (p < conn->pendingCount && conn->pending[p].transactionId != transactionId) ++p;
+  if (p == conn->pendingCount) {
+    ++modbusTCPStats.errors;   // Not ours, or its request timed out
+    return;
+  }
+  const int8_t range = conn->pending[p].range;
+  for (byte i = p + 1; i < conn->pendingCount; ++i)
+    conn->pending[i - 1] = conn->pending[i];
+  --conn->pendingCount;
+  if (range < 0 || conn->ranges[range].values == NULL) return;
+
+  ModbusRegisterRange& r = conn->ranges[range];
+  const uint8_t function = rx[MODBUS_TCP_MBAP_SIZE + 1];
+  const uint8_t byteCount = rx[MODBUS_TCP_MBAP_SIZE + 2];
+  if (frameLength < MODBUS_TCP_MBAP_SIZE + 3 || rx[MODBUS_TCP_MBAP_SIZE] != r.unit || function != r.function ||
+      byteCount != 2 * r.count || frameLength != MODBUS_TCP_MBAP_SIZE + 3 + byteCount) {
+    // Also an exception reply: function | 0x80, exception code
+    ++modbusTCPStats.errors;
+    ++r.failures;
+    return;
+  }
+  const uint8_t* data = &rx[MODBUS_TCP_MBAP_SIZE + 3];
+  for (uint16_t i = 0; i < r.count; ++i)
+    r.values[i] = (data[2 * i] << 8) | data[2 * i + 1];
+  r.valid = true;
+  r.updated = millis();
+  ++r.replies;
+  ++modbusTCPStats.replies;
+  modbusTCPStats.registers += r.count;
+}
+
+void processModbusTCPConnection(struct ModbusTCPConnection* conn) {
+  if (!conn->client.connected()) {
+    if (conn->pendingCount > 0 || conn->rxLength > 0) modbusTCPDisconnect(conn);
+    bool requested = false;
+    for (byte i = 0; i < MODBUS_TCP_RANGES; ++i)
+      if (conn->ranges[i].values != NULL && conn->ranges[i].requested) requested = true;
+    if (!requested || !WiFiConnected() || timePassedSince(conn->lastConnect) < MODBUS_TCP_RECONNECT) return;
+    conn->lastConnect = millis();
+    if (!conn->client.connect(conn->host.c_str(), MODBUS_TCP_PORT)) {
+      for (byte i = 0; i < MODBUS_TCP_RANGES; ++i) {
+        if (conn->ranges[i].values != NULL && conn->ranges[i].requested) {
+          conn->ranges[i].requested = false;
+          ++conn->ranges[i].failures;
+        }
       }
-      switch (incomingValue) {
-        case signed16:
-          result = (int16_t) rxValue;
-          break;
-        case unsigned16:
-          result = (uint16_t) rxValue;
-          break;
-        case signed32:
-          result = (int32_t) rxValue;
-          break;
-        case unsigned32:
-          result = (uint32_t) rxValue;
-          break;
-        case signed64:
-          result = (int64_t) rxValue;
-          break;
-        case unsigned64:
-          result = (uint64_t) rxValue;
-          break;
+      ++modbusTCPStats.errors;
+      if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+        String log = F("MBTCP: connect ");
+        log += conn->host;
+        log += F(" failed");
+        addLog(LOG_LEVEL_DEBUG, log);
       }
+      return;
+    }
+    conn->client.setNoDelay(true);
+    ++modbusTCPStats.connects;
+  }
 
-      LogString += "value: "; LogString += result;
-      //if ((Settings.UseNTP) && (hour() == 0)) errcnt = 0;
+  // Parse what has arrived, the replies may come in any order.
+  int available = conn->client.available();
+  while (available > 0) {
+    uint16_t wanted = MODBUS_TCP_MBAP_SIZE;
+    if (conn->rxLength >= MODBUS_TCP_MBAP_SIZE) {
+      const uint16_t length = (conn->rx[4] << 8) | conn->rx[5];
+      wanted = length < 3 ? MODBUS_TCP_MAX_FRAME + 1 : wanted + length;   // At least unit, function and a byte
+    }
+    if (wanted > MODBUS_TCP_MAX_FRAME) {
+      ++modbusTCPStats.errors;
+      modbusTCPDisconnect(conn);
+      return;
+    }
+    if (conn->rxLength < wanted) {
+      int n = conn->client.read(&conn->rx[conn->rxLength], wanted - conn->rxLength);
+      if (n <= 0) break;
+      conn->rxLength += n;
+      available -= n;
+    }
+    if (conn->rxLength == wanted && wanted > MODBUS_TCP_MBAP_SIZE) {
+      modbusTCPReply(conn, wanted);
+      conn->rxLength = 0;
+    }
+  }
 
-      TXRXstate = MODBUS_IDLE;
+  for (byte i = 0; i < conn->pendingCount; ++i) {
+    if (timePassedSince(conn->pending[i].sent) > MODBUS_TCP_TIMEOUT) {
+      ++modbusTCPStats.timeouts;
+      modbusTCPDisconnect(conn);
+      return;
+    }
+  }
 
-      resultReceived = true;
-      break;
+  for (byte i = 0; i < MODBUS_TCP_RANGES && conn->pendingCount < MODBUS_TCP_PIPELINE; ++i) {
+    if (conn->ranges[i].values == NULL || !conn->ranges[i].requested) continue;
+    bool waiting = false;
+    for (byte p = 0; p < conn->pendingCount; ++p)
+      if (conn->pending[p].range == i) waiting = true;
+    if (waiting) continue;   // Sent again after the reply
+    modbusTCPSend(conn, i);
+    if (!conn->client.connected()) return;
+  }
+}
 
-    default:
-      LogString += F("default. ");
-      TXRXstate = MODBUS_IDLE;
-      break;
+// Called from backgroundtasks()
+void processModbusTCP() {
+  for (byte i = 0; i < MODBUS_TCP_CONNECTIONS; ++i)
+    if (modbusTCP[i] != NULL) processModbusTCPConnection(modbusTCP[i]);
+}
 
-  }
-  if (LogString.length() > 1 ) addLog(LOG_LEVEL_DEBUG, LogString);
-  return true;
+// Modbus TCP stats as: requests/replies/registers/errors/timeouts/connects
+String getModbusTCPStats() {
+  String result;
+  result += modbusTCPStats.requests;
+  result += '/';
+  result += modbusTCPStats.replies;
+  result += '/';
+  result += modbusTCPStats.registers;
+  result += '/';
+  result += modbusTCPStats.errors;
+  result += '/';
+  result += modbusTCPStats.timeouts;
+  result += '/';
+  result += modbusTCPStats.connects;
+  return result;
 }
 
-bool Modbus::hasTimeout()
+
+
+// A single register read on the shared Modbus TCP master, for one value at a time.
+Modbus::Modbus() : connection(-1), range(-1), replies(0), failures(0), errcnt(0),
+                   TXRXstate(MODBUS_IDLE), resultReceived(false),
+                   currentRegister(0), currentFunction(0), currentID(0) {}
+
+Modbus::~Modbus() {
+  release();
+}
+
+void Modbus::release() {
+  modbusTCPRemoveRange(connection, range);
+  modbusTCPClose(connection);
+  connection = -1;
+  range = -1;
+}
+
+bool Modbus::begin(uint8_t function, uint8_t ModbusID, uint16_t ModbusRegister,  MODBUS_registerTypes_t type, char* IPaddress)
 {
-  if   ( (millis() - timeout) > 10000) { // too many bytes or timeout
-    LogString += F("Modbus RX timeout. "); LogString += String(ModbusClient->available());
+  resultReceived = false;
+  TXRXstate = MODBUS_IDLE;
+  const byte count = modbusRegisterCount(type);
+  // Keep the connection and register map entry when reading the same register again
+  if (connection >= 0 && !modbusTCP[connection]->host.equalsIgnoreCase(IPaddress))
+    release();
+  if (connection < 0)
+    connection = modbusTCPOpen(IPaddress);
+  const ModbusRegisterRange* r = modbusTCPRange(connection, range);
+  if (r != NULL && (r->unit != ModbusID || r->function != function || r->start != ModbusRegister || r->count != count)) {
+    modbusTCPRemoveRange(connection, range);
+    range = -1;
+  }
+  if (range < 0)
+    range = modbusTCPAddRange(connection, ModbusID, function, ModbusRegister, count);
+  r = modbusTCPRange(connection, range);
+  if (r == NULL) {
     errcnt++;
+    return false;
+  }
+  currentRegister = ModbusRegister;
+  currentFunction = function;
+  currentID = ModbusID;
+  incomingValue = type;
+  replies = r->replies;
+  failures = r->failures;
+  TXRXstate = MODBUS_RECEIVE;
+  return modbusTCPRequest(connection, range);
+}
+
+bool Modbus::handle() {
+  if (TXRXstate == MODBUS_IDLE) return true;
+  processModbusTCP();
+  const ModbusRegisterRange* r = modbusTCPRange(connection, range);
+  if (r == NULL) {
     TXRXstate = MODBUS_IDLE;
     return true;
   }
-  return false;
+  if (r->failures != failures) {
+    errcnt++;
+    TXRXstate = MODBUS_IDLE;
+  } else if (r->replies != replies) {
+    resultReceived = modbusTCPValue(connection, range, currentRegister, incomingValue, result);
+    if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+      String log = F("MBTCP: value: ");
+      log += result;
+      addLog(LOG_LEVEL_DEBUG, log);
+    }
+    TXRXstate = MODBUS_IDLE;
+  }
+  return true;
 }
 
 
 
 // tryread can be called in a round robin fashion. It will initiate a read if Modbus is idle and update the result once it is available.
 // subsequent calls (if Modbus is busy etc. ) will return false and not update the result.
-// Use to read multiple values non blocking in an re-entrant function. Not tested yet.
+// Use to read multiple values non blocking in an re-entrant function.
 bool Modbus::tryRead (uint8_t ModbusID, uint16_t M_register,  MODBUS_registerTypes_t type, char* IPaddress, double &result) {
+  handle();
   if (isBusy()) return false;                                 // not done yet
   if (available()) {
-    if ((currentFunction == MODBUS_FUNCTION_READ ) && (currentRegister == M_register)) {
+    if ((currentFunction == MODBUS_FUNCTION_READ ) && (currentRegister == M_register) && (currentID == ModbusID)) {
       result = read();                                  // result belongs to this request.
       return true;
     }
-  } else {
-    begin(MODBUS_FUNCTION_READ, ModbusID, M_register, type, IPaddress);             // idle and no result -> begin read request
   }
+  begin(MODBUS_FUNCTION_READ, ModbusID, M_register, type, IPaddress);             // idle and no result -> begin read request
   return false;
 }
@@ -0,0 +1,335 @@
+//********************************************************************************
+// Modbus RTU master
+// Reads and writes registers of Modbus RTU slaves (SenseAir, energy meters) on a
+// serial bus without blocking: the plugins queue their requests, which are sent
+// one at a time from backgroundtasks() with the inter-frame silence of 3.5
+// characters between the frames. A bus is shared by all tasks using the same
+// pins, so several slaves can be read on one RS485 bus.
+// The reply is sent to the task as PLUGIN_INTERRUPT_EVENT with
+// event->Par1 = MODBUS_RTU_EVENT_REPLY, event->Par2 the tag of the request and
+// event->Data pointing to the ModbusRTUTransaction, see modbusRTUTransaction().
+//   ESP8266: ESPeasySoftwareSerial on the given pins
+//   ESP32:   UART 2 (bus 0) and UART 1 (bus 1) on the given pins
+//********************************************************************************
+#if defined(ESP8266)
+  #include <ESPeasySoftwareSerial.h>
+#endif
+
+#define MODBUS_RTU_BUSES              2
+#define MODBUS_RTU_QUEUE              8    // Requests per bus, including the one sent
+#define MODBUS_RTU_MAX_REGISTERS     16    // Per read request
+#define MODBUS_RTU_TIMEOUT          200    // msec for a reply
+#define MODBUS_RTU_EVENT_REPLY     0xF3    // Interrupt event type, next to the BitBang one
+#define MODBUS_RTU_MAX_FRAME  (5 + 2 * MODBUS_RTU_MAX_REGISTERS)
+
+#define MODBUS_RTU_READ_HOLDING       3
+#define MODBUS_RTU_READ_INPUT         4
+#define MODBUS_RTU_WRITE_SINGLE       6
+
+#define MODBUS_RTU_STATUS_OK          0
+#define MODBUS_RTU_STATUS_TIMEOUT     1
+#define MODBUS_RTU_STATUS_CRC         2
+#define MODBUS_RTU_STATUS_EXCEPTION   3    // The slave replied with an exception code
+#define MODBUS_RTU_STATUS_INVALID     4    // Wrong slave, function or length
+
+struct ModbusRTUTransaction
+{
+  uint8_t slave;
+  uint8_t function;
+  uint16_t reg;
+  uint16_t count;            // Registers to read, or the value to write
+  byte TaskIndex;
+  byte tag;                  // Returned in event->Par2
+  byte status;
+  byte exception;
+  uint16_t values[MODBUS_RTU_MAX_REGISTERS];
+};
+
+struct ModbusRTUBus
+{
+  ModbusRTUBus() : port(NULL), rxPin(-1), txPin(-1), baud(0), users(0), head(0), tail(0),
+    waiting(false), sent(0), lastActivity(0), frameGap(0), rxLength(0) {}
+
+  Stream* port;
+  int8_t rxPin;
+  int8_t txPin;
+  unsigned long baud;
+  byte users;
+  ModbusRTUTransaction queue[MODBUS_RTU_QUEUE];
+  byte head;                 // Positions only increase, head - tail requests are queued
+  byte tail;
+  bool waiting;              // Request at the tail is sent
+  unsigned long sent;        // millis()
+  unsigned long lastActivity;// micros() of the last byte sent or received
+  unsigned long frameGap;    // usec of silence between frames
+  uint8_t rx[MODBUS_RTU_MAX_FRAME];
+  byte rxLength;
+};
+
+struct ModbusRTUStatsStruct
+{
+  ModbusRTUStatsStruct() : requests(0), replies(0), crcErrors(0), exceptions(0), timeouts(0), rejected(0) {}
+
+  unsigned long requests;
+  unsigned long replies;
+  unsigned long crcErrors;
+  unsigned long exceptions;  // Exception replies and invalid frames
+  unsigned long timeouts;
+  unsigned long rejected;    // Queue full
+} modbusRTUStats;
+
+ModbusRTUBus* modbusRTU[MODBUS_RTU_BUSES] = { NULL };
+
+const uint16_t modbusRTUCRCTable[256] PROGMEM = {
+  0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+  0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+  0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+  0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+  0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+  0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+  0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+  0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+  0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+  0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+  0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+  0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+  0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+  0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+  0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+  0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+  0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+  0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+  0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+  0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+  0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+  0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+  0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+  0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+  0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+  0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+  0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+  0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+  0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+  0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+  0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+  0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040
+};
+
+uint16_t modbusRTUCRC(const uint8_t* data, byte length) {
+  uint16_t crc = 0xFFFF;
+  for (byte i = 0; i < length; ++i)
+    crc = (crc >> 8) ^ pgm_read_word(&modbusRTUCRCTable[(crc ^ data[i]) & 0xFF]);
+  return crc;
+}
+
+// Bus on the pins, shared with the tasks using the same pins. Returns -1 when it can not be used.
+int modbusRTUBegin(int8_t rxPin, int8_t txPin, unsigned long baud) {
+  int free_slot = -1;
+  for (byte i = 0; i < MODBUS_RTU_BUSES; ++i) {
+    ModbusRTUBus* bus = modbusRTU[i];
+    if (bus == NULL) {
+      if (free_slot < 0) free_slot = i;
+    } else if (bus->rxPin == rxPin && bus->txPin == txPin) {
+      if (bus->baud != baud) {
+        addLog(LOG_LEVEL_ERROR, F("MBRTU: Bus used at another baud rate"));
+        return -1;
+      }
+      ++bus->users;
+      return i;
+    }
+  }
+  if (free_slot < 0 || rxPin < 0 || txPin < 0 || baud == 0) {
+    addLog(LOG_LEVEL_ERROR, F("MBRTU: No free bus"));
+    return -1;
+  }
+  ModbusRTUBus* bus = new ModbusRTUBus();
+  if (bus == NULL) return -1;
+  #if defined(ESP8266)
+    // Decode outside the interrupt, the edges of the longest reply fit
+    ESPeasySoftwareSerial* port = new ESPeasySoftwareSerial(rxPin, txPin, false, 64, (5 + 2 * MODBUS_RTU_MAX_REGISTERS) * 10);
+    if (port != NULL) port->begin(baud);
+  #else
+    HardwareSerial* port = new HardwareSerial(free_slot == 0 ? 2 : 1);
+    if (port != NULL) port->begin(baud, SERIAL_8N1, rxPin, txPin);
+  #endif
+  if (port == NULL) {
+    delete bus;
+    return -1;
+  }
+  bus->port = port;
+  bus->rxPin = rxPin;
+  bus->txPin = txPin;
+  bus->baud = baud;
+  bus->users = 1;
+  // 3.5 characters of 11 bits, fixed at 1750 usec above 19200 baud
+  bus->frameGap = baud > 19200 ? 1750 : 38500000UL / baud;
+  bus->lastActivity = micros();
+  modbusRTU[free_slot] = bus;
+  return free_slot;
+}
+
+void modbusRTUEnd(int busNr) {
+  if (busNr < 0 || busNr >= MODBUS_RTU_BUSES || modbusRTU[busNr] == NULL) return;
+  ModbusRTUBus* bus = modbusRTU[busNr];
+  if (bus->users > 1) {
+    --bus->users;
+    return;
+  }
+  #if defined(ESP8266)
+    delete static_cast<ESPeasySoftwareSerial*>(bus->port);
+  #else
+    static_cast<HardwareSerial*>(bus->port)->end();
+    delete static_cast<HardwareSerial*>(bus->port);
+  #endif
+  delete bus;
+  modbusRTU[busNr] = NULL;
+}
+
+// Queue a read (count registers) or write (count is the value) of a register.
+// False when the queue of the bus is full.
+bool modbusRTUQueue(int busNr, byte TaskIndex, uint8_t slave, uint8_t function, uint16_t reg, uint16_t count, byte tag) {
+  if (busNr < 0 || busNr >= MODBUS_RTU_BUSES || modbusRTU[busNr] == NULL) return false;
+  if (function != MODBUS_RTU_WRITE_SINGLE && (count == 0 || count > MODBUS_RTU_MAX_REGISTERS)) return false;
+  ModbusRTUBus* bus = modbusRTU[busNr];
+  if (static_cast<byte>(bus->head - bus->tail) >= MODBUS_RTU_QUEUE) {
+    ++modbusRTUStats.rejected;
+    return false;
+  }
+  ModbusRTUTransaction& t = bus->queue[bus->head % MODBUS_RTU_QUEUE];
+  t.slave = slave;
+  t.function = function;
+  t.reg = reg;
+  t.count = count;
+  t.TaskIndex = TaskIndex;
+  t.tag = tag;
+  t.status = MODBUS_RTU_STATUS_TIMEOUT;
+  t.exception = 0;
+  ++bus->head;
+  processModbusRTUBus(bus);
+  return true;
+}
+
+// The transaction of a MODBUS_RTU_EVENT_REPLY event, NULL for other events.
+const struct ModbusRTUTransaction* modbusRTUTransaction(struct EventStruct *event) {
+  if (event->Par1 != MODBUS_RTU_EVENT_REPLY || event->Data == NULL) return NULL;
+  return reinterpret_cast<const ModbusRTUTransaction*>(event->Data);
+}
+
+void modbusRTUSend(struct ModbusRTUBus* bus) {
+  const ModbusRTUTransaction& t = bus->queue[bus->tail % MODBUS_RTU_QUEUE];
+  uint8_t frame[8] = {
+    t.slave, t.function,
+    static_cast<uint8_t>(t.reg >> 8), static_cast<uint8_t>(t.reg & 0xFF),
+    static_cast<uint8_t>(t.count >> 8), static_cast<uint8_t>(t.count & 0xFF),
+    0, 0
+  };
+  const uint16_t crc = modbusRTUCRC(frame, 6);
+  frame[6] = crc & 0xFF;
+  frame[7] = crc >> 8;
+  while (bus->port->available() > 0) bus->port->read();   // Late bytes of a previous reply
+  bus->rxLength = 0;
+  bus->port->write(frame, sizeof(frame));
+  bus->waiting = true;
+  bus->sent = millis();
+  bus->lastActivity = micros();
+  ++modbusRTUStats.requests;
+}
+
+// Length of the reply frame from its first bytes, 0 when not known yet.
+int modbusRTUReplyLength(const uint8_t* rx, byte length) {
+  if (length < 2) return 0;
+  if (rx[1] & 0x80) return 5;        // Exception: slave, function, code, CRC
+  switch (rx[1]) {
+    case MODBUS_RTU_READ_HOLDING:
+    case MODBUS_RTU_READ_INPUT:
+      return length < 3 ? 0 : 5 + rx[2];
+    case MODBUS_RTU_WRITE_SINGLE:
+      return 8;                      // Echo of the request
+  }
+  return MODBUS_RTU_MAX_FRAME + 1;
+}
+
+byte modbusRTUCheckReply(struct ModbusRTUTransaction& t, const uint8_t* rx, int length) {
+  if (length > MODBUS_RTU_MAX_FRAME) return MODBUS_RTU_STATUS_INVALID;
+  const uint16_t crc = modbusRTUCRC(rx, length - 2);
+  if (rx[length - 2] != (crc & 0xFF) || rx[length - 1] != (crc >> 8)) return MODBUS_RTU_STATUS_CRC;
+  if (rx[0] != t.slave || (rx[1] & 0x7F) != t.function) return MODBUS_RTU_STATUS_INVALID;
+  if (rx[1] & 0x80) {
+    t.exception = rx[2];
+    return MODBUS_RTU_STATUS_EXCEPTION;
+  }
+  if (t.function == MODBUS_RTU_WRITE_SINGLE) return MODBUS_RTU_STATUS_OK;
+  if (rx[2] != 2 * t.count) return MODBUS_RTU_STATUS_INVALID;
+  for (uint16_t i = 0; i < t.count; ++i)
+    t.values[i] = (rx[3 + 2 * i] << 8) | rx[4 + 2 * i];
+  return MODBUS_RTU_STATUS_OK;
+}
+
+// Remove the transaction from the queue and send it to its task.
+void modbusRTUComplete(struct ModbusRTUBus* bus, byte status) {
+  ModbusRTUTransaction t = bus->queue[bus->tail % MODBUS_RTU_QUEUE];
+  t.status = status;
+  ++bus->tail;
+  bus->waiting = false;
+  bus->lastActivity = micros();
+  switch (status) {
+    case MODBUS_RTU_STATUS_OK:      ++modbusRTUStats.replies; break;
+    case MODBUS_RTU_STATUS_TIMEOUT: ++modbusRTUStats.timeouts; break;
+    case MODBUS_RTU_STATUS_CRC:     ++modbusRTUStats.crcErrors; break;
+    default:                        ++modbusRTUStats.exceptions; break;
+  }
+  if (t.TaskIndex >= TASKS_MAX || !Settings.TaskDeviceEnabled[t.TaskIndex]) return;
+  struct EventStruct TempEvent;
+  TempEvent.TaskIndex = t.TaskIndex;
+  TempEvent.Par1 = MODBUS_RTU_EVENT_REPLY;
+  TempEvent.Par2 = t.tag;
+  TempEvent.Data = (byte*)&t;
+  START_TIMER;
+  PluginCall(PLUGIN_INTERRUPT_EVENT, &TempEvent, dummyString);
+  STOP_TIMER(PLUGIN_CALL_INTERRUPT);
+}
+
+void processModbusRTUBus(struct ModbusRTUBus* bus) {
+  if (bus->waiting) {
+    while (bus->port->available() > 0) {
+      const int c = bus->port->read();
+      if (bus->rxLength < MODBUS_RTU_MAX_FRAME) bus->rx[bus->rxLength++] = c;
+      bus->lastActivity = micros();
+    }
+    const int expected = modbusRTUReplyLength(bus->rx, bus->rxLength);
+    if (expected > MODBUS_RTU_MAX_FRAME) {
+      modbusRTUComplete(bus, MODBUS_RTU_STATUS_INVALID);
+    } else if (expected > 0 && bus->rxLength >= expected) {
+      ModbusRTUTransaction& t = bus->queue[bus->tail % MODBUS_RTU_QUEUE];
+      modbusRTUComplete(bus, modbusRTUCheckReply(t, bus->rx, expected));
+    } else if (timePassedSince(bus->sent) > MODBUS_RTU_TIMEOUT) {
+      modbusRTUComplete(bus, MODBUS_RTU_STATUS_TIMEOUT);
+    }
+    if (bus->waiting) return;
+  }
+  if (bus->head != bus->tail && usecPassedSince(bus->lastActivity) >= static_cast<long>(bus->frameGap))
+    modbusRTUSend(bus);
+}
+
+// Called from backgroundtasks()
+void processModbusRTU() {
+  for (byte i = 0; i < MODBUS_RTU_BUSES; ++i)
+    if (modbusRTU[i] != NULL) processModbusRTUBus(modbusRTU[i]);
+}
+
+// Modbus RTU stats as: requests/replies/CRC errors/exceptions/timeouts/rejected
+String getModbusRTUStats() {
+  String result;
+  result += modbusRTUStats.requests;
+  result += '/';
+  result += modbusRTUStats.replies;
+  result += '/';
+  result += modbusRTUStats.crcErrors;
+  result += '/';
+  result += modbusRTUStats.exceptions;
+  result += '/';
+  result += modbusRTUStats.timeouts;
+  result += '/';
+  result += modbusRTUStats.rejected;
+  return result;
+}
@@ -0,0 +1,234 @@
+#ifdef USES_NEOPIXEL_OUTPUT
+//********************************************************************************
+// NeoPixel output
+// Sends the frames of the NeoPixel plugins (P038, P041, P042, P070) by hardware,
+// instead of Adafruit_NeoPixel::show() which bit-bangs the WS2812 protocol with
+// interrupts disabled (30 usec per LED).
+// The pixels of the Adafruit_NeoPixel object are the front buffer, the plugin
+// keeps drawing in them. neoPixelShow() encodes them in the back buffer and
+// starts the transfer, then returns. A show() while the previous frame is still
+// sent is not lost: the latest pixels are sent from backgroundtasks() as soon as
+// the output is free.
+//   ESP32:   RMT channel 0-3 (the higher ones are used by the pulse capture)
+//   ESP8266: I2S DMA, only on GPIO 3 (I2S data out, the RX pin of Serial)
+// Other pins and strips too long for the DMA ring use Adafruit_NeoPixel::show().
+//********************************************************************************
+#include <Adafruit_NeoPixel.h>
+
+#define NEOPIXEL_BACKEND_SHOW    0   // Adafruit_NeoPixel::show(), blocking
+#define NEOPIXEL_BACKEND_RMT     1
+#define NEOPIXEL_BACKEND_I2S     2
+
+#if defined(ESP32)
+  #include <driver/rmt.h>
+  #define NEOPIXEL_SLOTS          4
+  #define NEOPIXEL_RMT_CLK_DIV    2     // 25 nsec per tick
+  #define NEOPIXEL_RMT_T0H       16     // 0.40 usec
+  #define NEOPIXEL_RMT_T0L       34     // 0.85 usec
+  #define NEOPIXEL_RMT_T1H       32     // 0.80 usec
+  #define NEOPIXEL_RMT_T1L       18     // 0.45 usec
+  #define NEOPIXEL_RMT_RESET   2400     // 60 usec low, latches the frame
+#else
+  #include <i2s.h>
+  #define NEOPIXEL_SLOTS          1     // A single I2S peripheral
+  #define NEOPIXEL_I2S_PIN        3
+  #define NEOPIXEL_I2S_RATE  100000     // 32 bit samples, 3.2 Mbit/s: 4 bits per WS2812 bit
+  #define NEOPIXEL_I2S_RESET      8     // Zero samples after a frame, 80 usec
+  // The core DMA ring holds 512 samples, one per pixel byte. The frame is written
+  // at once, a frame which does not fit would need refills in time.
+  #define NEOPIXEL_I2S_MAX_BYTES (512 - NEOPIXEL_I2S_RESET)
+#endif
+
+struct NeoPixelOutputStruct
+{
+  NeoPixelOutputStruct() : strip(NULL), numBytes(0), TaskIndex(-1), backend(NEOPIXEL_BACKEND_SHOW), pending(false)
+  #if defined(ESP32)
+    , items(NULL)
+  #endif
+    {}
+
+  Adafruit_NeoPixel* strip;
+  uint16_t numBytes;
+  int8_t TaskIndex;
+  byte backend;
+  bool pending;          // Shown while the previous frame was still sent
+  #if defined(ESP32)
+  rmt_item32_t* items;   // Back buffer, 8 items per pixel byte plus the reset
+  #endif
+} neoPixelOutput[NEOPIXEL_SLOTS];
+
+struct NeoPixelOutputStatsStruct
+{
+  NeoPixelOutputStatsStruct() : frames(0), merged(0), blocking(0) {}
+
+  unsigned long frames;     // Sent by RMT or DMA
+  unsigned long merged;     // Shows merged into the next frame while busy
+  unsigned long blocking;   // Sent by Adafruit_NeoPixel::show()
+} neoPixelOutputStats;
+
+#if defined(ESP32)
+size_t neoPixelItemsSize(uint16_t numBytes) {
+  return (static_cast<size_t>(numBytes) * 8 + 1) * sizeof(rmt_item32_t);
+}
+#endif
+
+// Use a hardware output for the strip of a task, called after strip->begin().
+// bytesPerPixel is 3 for RGB and 4 for RGBW strips.
+void neoPixelBegin(byte TaskIndex, class Adafruit_NeoPixel* strip, byte bytesPerPixel) {
+  neoPixelEnd(TaskIndex);
+  if (strip == NULL) return;
+  byte slot = 0;
+  while (slot < NEOPIXEL_SLOTS && neoPixelOutput[slot].TaskIndex >= 0) ++slot;
+  if (slot == NEOPIXEL_SLOTS) {
+    addLog(LOG_LEVEL_INFO, F("NeoPx: No free output, using bit-bang"));
+    return;
+  }
+  NeoPixelOutputStruct& output = neoPixelOutput[slot];
+  const int8_t pin = strip->getPin();
+  output.numBytes = strip->numPixels() * bytesPerPixel;
+  output.backend = NEOPIXEL_BACKEND_SHOW;
+  output.pending = false;
+  #if defined(ESP32)
+    const rmt_channel_t channel = static_cast<rmt_channel_t>(slot);
+    output.items = static_cast<rmt_item32_t*>(allocBuffer(MEM_POOL_LED, neoPixelItemsSize(output.numBytes)));
+    if (pin >= 0 && output.items != NULL) {
+      rmt_config_t config;
+      memset(&config, 0, sizeof(config));
+      config.rmt_mode = RMT_MODE_TX;
+      config.channel = channel;
+      config.gpio_num = static_cast<gpio_num_t>(pin);
+      config.clk_div = NEOPIXEL_RMT_CLK_DIV;
+      config.mem_block_num = 1;
+      config.tx_config.idle_output_en = true;
+      config.tx_config.idle_level = RMT_IDLE_LEVEL_LOW;
+      if (rmt_config(&config) == ESP_OK && rmt_driver_install(channel, 0, 0) == ESP_OK)
+        output.backend = NEOPIXEL_BACKEND_RMT;
+    }
+    if (output.backend == NEOPIXEL_BACKEND_SHOW) {
+      freeBuffer(MEM_POOL_LED, output.items, neoPixelItemsSize(output.numBytes));
+      output.items = NULL;
+    }
+  #else
+    if (pin == NEOPIXEL_I2S_PIN && output.numBytes <= NEOPIXEL_I2S_MAX_BYTES) {
+      i2s_begin();
+      i2s_set_rate(NEOPIXEL_I2S_RATE);
+      // i2s_begin() connects the bit and word clocks as well, they are not needed.
+      pinMode(2, INPUT);
+      pinMode(15, INPUT);
+      output.backend = NEOPIXEL_BACKEND_I2S;
+    }
+  #endif
+  if (output.backend == NEOPIXEL_BACKEND_SHOW) return;
+  output.strip = strip;
+  output.TaskIndex = TaskIndex;
+  if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+    String log = F("NeoPx: ");
+    log += output.backend == NEOPIXEL_BACKEND_RMT ? F("RMT") : F("I2S DMA");
+    log += F(" output on GPIO ");
+    log += pin;
+    addLog(LOG_LEVEL_INFO, log);
+  }
+}
+
+// Release the output of a task, e.g. at PLUGIN_EXIT or before deleting the strip.
+void neoPixelEnd(byte TaskIndex) {
+  for (byte slot = 0; slot < NEOPIXEL_SLOTS; ++slot) {
+    NeoPixelOutputStruct& output = neoPixelOutput[slot];
+    if (output.TaskIndex != TaskIndex) continue;
+    #if defined(ESP32)
+      const rmt_channel_t channel = static_cast<rmt_channel_t>(slot);
+      rmt_wait_tx_done(channel, portMAX_DELAY);
+      rmt_driver_uninstall(channel);
+      freeBuffer(MEM_POOL_LED, output.items, neoPixelItemsSize(output.numBytes));
+      output.items = NULL;
+    #else
+      while (!i2s_is_empty()) delay(0);
+      i2s_end();
+    #endif
+    output.strip = NULL;
+    output.TaskIndex = -1;
+    output.backend = NEOPIXEL_BACKEND_SHOW;
+    output.pending = false;
+  }
+}
+
+bool neoPixelBusy(byte slot) {
+  #if defined(ESP32)
+    return rmt_wait_tx_done(static_cast<rmt_channel_t>(slot), 0) != ESP_OK;
+  #else
+    return !i2s_is_empty();
+  #endif
+}
+
+// Encode the front buffer and start the transfer.
+void neoPixelSend(byte slot) {
+  NeoPixelOutputStruct& output = neoPixelOutput[slot];
+  const uint8_t* pixels = output.strip->getPixels();
+  output.pending = false;
+  #if defined(ESP32)
+    rmt_item32_t* item = output.items;
+    for (uint16_t i = 0; i < output.numBytes; ++i) {
+      for (uint8_t mask = 0x80; mask != 0; mask >>= 1, ++item) {
+        const bool one = pixels[i] & mask;
+        item->level0 = 1;
+        item->duration0 = one ? NEOPIXEL_RMT_T1H : NEOPIXEL_RMT_T0H;
+        item->level1 = 0;
+        item->duration1 = one ? NEOPIXEL_RMT_T1L : NEOPIXEL_RMT_T0L;
+      }
+    }
+    // A duration of 0 ends the transfer
+    item->level0 = 0;
+    item->duration0 = NEOPIXEL_RMT_RESET;
+    item->level1 = 0;
+    item->duration1 = 0;
+    rmt_write_items(static_cast<rmt_channel_t>(slot), output.items, output.numBytes * 8 + 1, false);
+  #else
+    // Each bit is sent as 1000 (0) or 1110 (1), the upper half word is sent first.
+    for (uint16_t i = 0; i < output.numBytes; ++i) {
+      uint32_t sample = 0;
+      for (uint8_t mask = 0x80; mask != 0; mask >>= 1)
+        sample = (sample << 4) | ((pixels[i] & mask) ? 0xE : 0x8);
+      i2s_write_sample_nb(sample);
+    }
+    for (byte i = 0; i < NEOPIXEL_I2S_RESET; ++i)
+      i2s_write_sample_nb(0);
+  #endif
+  ++neoPixelOutputStats.frames;
+}
+
+// Replaces strip->show(), returns before the frame is sent.
+void neoPixelShow(class Adafruit_NeoPixel* strip) {
+  if (strip == NULL) return;
+  for (byte slot = 0; slot < NEOPIXEL_SLOTS; ++slot) {
+    if (neoPixelOutput[slot].strip != strip) continue;
+    if (neoPixelBusy(slot)) {
+      if (neoPixelOutput[slot].pending) ++neoPixelOutputStats.merged;
+      neoPixelOutput[slot].pending = true;
+    } else {
+      neoPixelSend(slot);
+    }
+    return;
+  }
+  strip->show();
+  ++neoPixelOutputStats.blocking;
+}
+
+// Called from backgroundtasks(): send the frames shown while the output was busy.
+void processNeoPixelOutput() {
+  for (byte slot = 0; slot < NEOPIXEL_SLOTS; ++slot) {
+    if (neoPixelOutput[slot].pending && !neoPixelBusy(slot))
+      neoPixelSend(slot);
+  }
+}
+
+// NeoPixel output stats as: frames/merged/blocking
+String getNeoPixelOutputStats() {
+  String result;
+  result += neoPixelOutputStats.frames;
+  result += '/';
+  result += neoPixelOutputStats.merged;
+  result += '/';
+  result += neoPixelOutputStats.blocking;
+  return result;
+}
+#endif // USES_NEOPIXEL_OUTPUT
@@ -9,15 +9,40 @@
 
 /*********************************************************************************************\
    Syslog client
+   Lines are formatted into a queue, which is sent from backgroundtasks(). So logging never
+   waits for the network. Lines logged while WiFi is down are kept until it is connected.
+   When the queue is full, new lines are dropped and counted.
   \*********************************************************************************************/
+#ifdef ESP32
+  #define SYSLOG_QUEUE_SIZE       2048
+#else
+  #define SYSLOG_QUEUE_SIZE       1024
+#endif
+#define SYSLOG_MAX_LINE            255   // Including priority and host name
+#define SYSLOG_LINES_PER_PACKET      1   // More than 1 packs lines in one datagram, newline separated
+#define SYSLOG_BURST                 4   // Max. datagrams per call of processSyslogQueue()
+
+// Records of a length byte followed by the line.
+byte syslogQueue[SYSLOG_QUEUE_SIZE];
+unsigned int syslogQueueLength = 0;
+
+bool syslogActive()
+{
+  return Settings.Syslog_IP[0] != 0 && wifiStatus == ESPEASY_WIFI_SERVICES_INITIALIZED;
+}
+
 void syslog(byte logLevel, const char *message)
 {
-  if (Settings.Syslog_IP[0] != 0 && wifiStatus == ESPEASY_WIFI_SERVICES_INITIALIZED)
+  if (Settings.Syslog_IP[0] != 0)
   {
-    IPAddress broadcastIP(Settings.Syslog_IP[0], Settings.Syslog_IP[1], Settings.Syslog_IP[2], Settings.Syslog_IP[3]);
-    portUDP.beginPacket(broadcastIP, 514);
-    char str[256];
-    str[0] = 0;
+    const unsigned int available = SYSLOG_QUEUE_SIZE - syslogQueueLength;
+    if (available < 2) {
+      ++syslogDropped;
+      return;
+    }
+    // Format in place, behind the length byte.
+    char* str = reinterpret_cast<char*>(syslogQueue + syslogQueueLength + 1);
+    const unsigned int room = (available - 1) < (SYSLOG_MAX_LINE + 1) ? (available - 1) : (SYSLOG_MAX_LINE + 1);
     byte prio = Settings.SyslogFacility * 8;
     if ( logLevel == LOG_LEVEL_ERROR )
       prio += 3;  // syslog error
@@ -29,25 +54,80 @@ void syslog(byte logLevel, const char *message)
 	// An RFC3164 compliant message must be formated like :  "<PRIO>[TimeStamp ]Hostname TaskName: Message"
 
 	// Using Settings.Name as the Hostname (Hostname must NOT content space)
-    snprintf_P(str, sizeof(str), PSTR("<%u>%s EspEasy: %s"), prio, Settings.Name, message);
+    int length = snprintf_P(str, room, PSTR("<%u>%s EspEasy: %s"), prio, Settings.Name, message);
 
 	// Using Setting.Unit to build a Hostname
-    //snprintf_P(str, sizeof(str), PSTR("<7>EspEasy_%u ESP: %s"), Settings.Unit, message);
-    #if defined(ESP8266)
-      portUDP.write(str);
-    #endif
-    #if defined(ESP32)
-      portUDP.write((uint8_t*)str,strlen(str));
-    #endif
+    //snprintf_P(str, room, PSTR("<7>EspEasy_%u ESP: %s"), Settings.Unit, message);
+    if (length < 0) return;
+    if (static_cast<unsigned int>(length) >= room) {
+      if (room <= SYSLOG_MAX_LINE) {
+        // Does not fit in the queue.
+        ++syslogDropped;
+        return;
+      }
+      length = SYSLOG_MAX_LINE;
+    }
+    syslogQueue[syslogQueueLength] = length;
+    syslogQueueLength += 1 + length;
+  }
+}
+
+// Send queued lines, called from backgroundtasks().
+void processSyslogQueue()
+{
+  if (syslogQueueLength == 0) return;
+  if (Settings.Syslog_IP[0] == 0) {
+    // Syslog was disabled.
+    syslogQueueLength = 0;
+    return;
+  }
+  // Keep the lines while not connected.
+  if (!syslogActive()) return;
+  IPAddress broadcastIP(Settings.Syslog_IP[0], Settings.Syslog_IP[1], Settings.Syslog_IP[2], Settings.Syslog_IP[3]);
+  unsigned int pos = 0;
+  for (byte packet = 0; packet < SYSLOG_BURST && pos < syslogQueueLength; ++packet) {
+    portUDP.beginPacket(broadcastIP, 514);
+    for (byte line = 0; line < SYSLOG_LINES_PER_PACKET && pos < syslogQueueLength; ++line) {
+      const byte length = syslogQueue[pos];
+      if (line != 0) portUDP.write('\n');
+      portUDP.write(syslogQueue + pos + 1, length);
+      pos += 1 + length;
+      ++syslogSent;
+    }
     portUDP.endPacket();
   }
+  syslogQueueLength -= pos;
+  memmove(syslogQueue, syslogQueue + pos, syslogQueueLength);
+}
+
+// Send all queued lines, before a reboot or deep sleep.
+void flushSyslogQueue()
+{
+  while (syslogQueueLength != 0 && syslogActive()) {
+    processSyslogQueue();
+    delay(0);
+  }
 }
 
 
 /*********************************************************************************************\
    Check UDP messages (ESPEasy propiertary protocol)
   \*********************************************************************************************/
+#define UDP_PACKET_BUFFER_SIZE   256  // The C013 info message is about 190 bytes
+#define UDP_MAX_PACKETS_PER_CALL   8
+#define UDP_TIME_BUDGET           20  // msec per checkUDP() call
+
 boolean runningUPDCheck = false;
+char udpPacketBuffer[UDP_PACKET_BUFFER_SIZE + 1];  // Reused, +1 for the terminating 0
+
+// Counters shown on the sysinfo page
+unsigned long udpReceived = 0;
+unsigned long udpProcessed = 0;
+unsigned long udpTruncated = 0;
+unsigned long udpDropped = 0;   // Packets not handled, like unexpected NTP replies
+
+// Handle the packets which arrived since the last call, lwIP drops new packets when
+// they are not read in time.
 void checkUDP()
 {
   if (Settings.UDPPort == 0)
@@ -58,117 +138,401 @@ void checkUDP()
 
   runningUPDCheck = true;
 
-  // UDP events
-  int packetSize = portUDP.parsePacket();
-  if (packetSize)
-  {
+  const unsigned long start = millis();
+  for (byte count = 0; count < UDP_MAX_PACKETS_PER_CALL; ++count) {
+    if (count != 0 && timePassedSince(start) >= UDP_TIME_BUDGET) break;
+    const int packetSize = portUDP.parsePacket();
+    if (packetSize <= 0) break;
+    ++udpReceived;
     statusLED(true);
-
-    IPAddress remoteIP = portUDP.remoteIP();
     if (portUDP.remotePort() == 123)
     {
       // unexpected NTP reply, drop for now...
-      runningUPDCheck = false;
-      return;
+      ++udpDropped;
+      continue;
     }
-    char packetBuffer[128];
-    int len = portUDP.read(packetBuffer, 128);
-
-    if (packetBuffer[0] != 255)
-    {
-      packetBuffer[len] = 0;
-      addLog(LOG_LEVEL_DEBUG, packetBuffer);
-      struct EventStruct TempEvent;
-      String request = packetBuffer;
-      parseCommandString(&TempEvent, request);
-      TempEvent.Source = VALUE_SOURCE_SYSTEM;
-      if (!PluginCall(PLUGIN_WRITE, &TempEvent, request))
-        ExecuteCommand(VALUE_SOURCE_SYSTEM, packetBuffer);
+    const int len = portUDP.read(udpPacketBuffer, UDP_PACKET_BUFFER_SIZE);
+    if (len <= 0) continue;
+    if (packetSize > UDP_PACKET_BUFFER_SIZE) {
+      ++udpTruncated;
     }
-    else
+    processUDPPacket(len, portUDP.remoteIP());
+    ++udpProcessed;
+  }
+  #if defined(ESP32) // testing
+    portUDP.flush();
+  #endif
+  runningUPDCheck = false;
+}
+
+void processUDPPacket(int len, const IPAddress& remoteIP)
+{
+  char* packetBuffer = udpPacketBuffer;
+  packetBuffer[len] = 0;
+  if (packetBuffer[0] != 255)
+  {
+    executeUDPCommand(packetBuffer);
+  }
+  else
+  {
+    // binary data!
+    switch (packetBuffer[1])
     {
-      // binary data!
-      switch (packetBuffer[1])
-      {
 
-        case 1: // sysinfo message
+      case 1: // sysinfo message
+        {
+          byte mac[6];
+          byte ip[4];
+          byte unit = packetBuffer[12];
+          for (byte x = 0; x < 6; x++)
+            mac[x] = packetBuffer[x + 2];
+          for (byte x = 0; x < 4; x++)
+            ip[x] = packetBuffer[x + 8];
+
+          if (unit < UNIT_MAX)
           {
-            byte mac[6];
-            byte ip[4];
-            byte unit = packetBuffer[12];
-            for (byte x = 0; x < 6; x++)
-              mac[x] = packetBuffer[x + 2];
-            for (byte x = 0; x < 4; x++)
-              ip[x] = packetBuffer[x + 8];
-
-            if (unit < UNIT_MAX)
+            NodeStruct& node = updateNode(unit, ip);
+            memcpy(node.mac, mac, 6);
+            if (len >20) // extended packet size
             {
-              for (byte x = 0; x < 4; x++)
-                Nodes[unit].ip[x] = packetBuffer[x + 8];
-              Nodes[unit].age = 0; // reset 'age counter'
-              if (len >20) // extended packet size
-              {
-                Nodes[unit].build = packetBuffer[13] + 256*packetBuffer[14];
-                if (Nodes[unit].nodeName==0)
-                    Nodes[unit].nodeName =  (char *)malloc(26);
-                memcpy(Nodes[unit].nodeName,(byte*)packetBuffer+15,25);
-                Nodes[unit].nodeName[25]=0;
-                Nodes[unit].nodeType = packetBuffer[40];
+              node.build = packetBuffer[13] + 256*packetBuffer[14];
+              if (node.nodeName==0)
+                  node.nodeName =  (char *)malloc(26);
+              if (node.nodeName != 0) {
+                memcpy(node.nodeName,(byte*)packetBuffer+15,25);
+                node.nodeName[25]=0;
               }
+              node.nodeType = packetBuffer[40];
             }
-
-            char macaddress[20];
-            formatMAC(mac, macaddress);
-            char ipaddress[20];
-            formatIP(ip, ipaddress);
-            if (loglevelActiveFor(LOG_LEVEL_DEBUG_MORE)) {
-              char log[80];
-              sprintf_P(log, PSTR("UDP  : %s,%s,%u"), macaddress, ipaddress, unit);
-              addLog(LOG_LEVEL_DEBUG_MORE, log);
-            }
-            break;
           }
 
-        default:
-          {
-            struct EventStruct TempEvent;
-            TempEvent.Data = (byte*)packetBuffer;
-            TempEvent.Par1 = remoteIP[3];
-            PluginCall(PLUGIN_UDP_IN, &TempEvent, dummyString);
-            CPluginCall(CPLUGIN_UDP_IN, &TempEvent);
-            break;
+          char macaddress[20];
+          formatMAC(mac, macaddress);
+          char ipaddress[20];
+          formatIP(ip, ipaddress);
+          if (loglevelActiveFor(LOG_LEVEL_DEBUG_MORE)) {
+            char log[80];
+            sprintf_P(log, PSTR("UDP  : %s,%s,%u"), macaddress, ipaddress, unit);
+            addLog(LOG_LEVEL_DEBUG_MORE, log);
           }
-      }
+          break;
+        }
+
+      case UDP_GROUP_COMMAND:
+        processUDPGroupCommand(len, remoteIP);
+        break;
+
+      case UDP_GROUP_ACK:
+        processUDPGroupAck(len);
+        break;
+
+      default:
+        {
+          PooledEvent pooled;
+          struct EventStruct& TempEvent = *pooled.event;
+          TempEvent.Data = (byte*)packetBuffer;
+          TempEvent.Par1 = remoteIP[3];
+          TempEvent.Par2 = len;  // Received bytes, the rest of the buffer is not valid
+          PluginCall(PLUGIN_UDP_IN, &TempEvent, dummyString);
+          CPluginCall(CPLUGIN_UDP_IN, &TempEvent);
+          break;
+        }
     }
   }
-  #if defined(ESP32) // testing
-    portUDP.flush();
-  #endif
-  runningUPDCheck = false;
+}
+
+
+// A command received as text, or in a group command.
+void executeUDPCommand(char* command)
+{
+  addLog(LOG_LEVEL_DEBUG, command);
+  PooledEvent pooled;
+  struct EventStruct& TempEvent = *pooled.event;
+  String request = command;
+  parseCommandString(&TempEvent, request);
+  TempEvent.Source = VALUE_SOURCE_SYSTEM;
+  if (!PluginCall(PLUGIN_WRITE, &TempEvent, request))
+    ExecuteCommand(VALUE_SOURCE_SYSTEM, command);
 }
 
 
 /*********************************************************************************************\
    Send event using UDP message
+   Unit 0 sends it to all known nodes, one unicast message each without waiting in between.
   \*********************************************************************************************/
 void SendUDPCommand(byte destUnit, char* data, byte dataLength)
 {
   if (!WiFiConnected(100)) {
     return;
   }
-  byte firstUnit = 1;
-  byte lastUnit = UNIT_MAX - 1;
   if (destUnit != 0)
   {
-    firstUnit = destUnit;
-    lastUnit = destUnit;
+    sendUDP(destUnit, (byte*)data, dataLength);
+    return;
   }
-  for (int x = firstUnit; x <= lastUnit; x++)
+  uint32_t nodes = activeNodes;
+  while (nodes != 0)
   {
-    sendUDP(x, (byte*)data, dataLength);
-    delay(10);
+    const byte unit = __builtin_ctz(nodes);
+    nodes &= nodes - 1;
+    sendUDP(unit, (byte*)data, dataLength);
+    delay(0);
   }
-  delay(50);
+}
+
+
+/*********************************************************************************************\
+   Group commands
+   One datagram carries the command with the mask of the units which are to run it: broadcast
+   for more than one unit, so all nodes get it at the same time. The own unit is never part of
+   the mask. With an acknowledgement each unit replies, the units in the node list which did not
+   reply within UDP_GROUP_RETRY_INTERVAL get it again (the mask reduced to them), up to
+   UDP_GROUP_RETRIES times. Receivers run a retransmitted command only once, by the sequence
+   number per sender. When units are still missing SendTo#Failed=<number of units> is sent to
+   the rules. Nodes with an older build ignore group commands.
+   Command:  255, UDP_GROUP_COMMAND, sender unit, seq (2 bytes), flags, unit mask (4 bytes), command
+   Ack:      255, UDP_GROUP_ACK, unit, seq (2 bytes)
+  \*********************************************************************************************/
+#define UDP_GROUP_COMMAND          7
+#define UDP_GROUP_ACK              8
+#define UDP_GROUP_HEADER_SIZE     10
+#define UDP_GROUP_FLAG_ACK         1
+#define UDP_GROUP_PENDING          4   // Commands waiting for acknowledgements
+#define UDP_GROUP_RETRY_INTERVAL 100   // msec
+#define UDP_GROUP_RETRIES          3
+
+struct UDPGroupCommandStruct
+{
+  UDPGroupCommandStruct() : seq(0), expected(0), acked(0), retries(0), sent(0) {}
+
+  uint16_t seq;
+  uint32_t expected;             // Units in the node list at the time it was sent
+  uint32_t acked;
+  byte retries;
+  unsigned long sent;            // millis(), of the first send
+  String command;
+} udpGroupPending[UDP_GROUP_PENDING];
+
+uint16_t udpGroupSeq = 0;
+uint16_t udpGroupLastSeq[UNIT_MAX] = { 0 };   // Per sender, to run a retransmission only once
+
+unsigned long udpGroupSent = 0;
+unsigned long udpGroupRetransmits = 0;
+unsigned long udpGroupAcked = 0;
+unsigned long udpGroupFailed = 0;
+unsigned long udpGroupReceived = 0;
+unsigned long udpGroupMaxRoundTrip = 0;
+
+// Units like "2", "2;5;9", "2-7;12", or "*" and "0" for all units.
+bool parseUnitMask(const String& units, uint32_t& mask)
+{
+  mask = 0;
+  if (units == F("*") || units == F("0")) {
+    mask = 0xFFFFFFFFUL;
+    return true;
+  }
+  int start = 0;
+  while (start < static_cast<int>(units.length())) {
+    int end = units.indexOf(';', start);
+    if (end < 0) end = units.length();
+    const String part = units.substring(start, end);
+    const int dash = part.indexOf('-');
+    const String first = dash < 0 ? part : part.substring(0, dash);
+    const String last = dash < 0 ? part : part.substring(dash + 1);
+    if (!isInt(first) || !isInt(last)) return false;
+    const int from = first.toInt();
+    const int to = last.toInt();
+    if (from < 1 || to >= UNIT_MAX || from > to) return false;
+    for (int unit = from; unit <= to; ++unit)
+      mask |= 1UL << unit;
+    start = end + 1;
+  }
+  return mask != 0;
+}
+
+void sendUDPGroupPacket(uint16_t seq, byte flags, uint32_t mask, const String& command)
+{
+  byte header[UDP_GROUP_HEADER_SIZE];
+  header[0] = 255;
+  header[1] = UDP_GROUP_COMMAND;
+  header[2] = Settings.Unit;
+  header[3] = seq & 0xFF;
+  header[4] = seq >> 8;
+  header[5] = flags;
+  for (byte i = 0; i < 4; ++i)
+    header[6 + i] = (mask >> (8 * i)) & 0xFF;
+
+  IPAddress remoteNodeIP(255, 255, 255, 255);
+  // A single known unit gets it unicast
+  if ((mask & (mask - 1)) == 0 && (activeNodes & mask))
+    remoteNodeIP = Nodes[__builtin_ctz(mask)].ip;
+  statusLED(true);
+  portUDP.beginPacket(remoteNodeIP, Settings.UDPPort);
+  portUDP.write(header, UDP_GROUP_HEADER_SIZE);
+  portUDP.write(reinterpret_cast<const uint8_t*>(command.c_str()), command.length());
+  portUDP.endPacket();
+}
+
+// Send the command to the units in the mask, returns false when it cannot be sent.
+bool sendUDPGroupCommand(uint32_t mask, const String& command, bool ack)
+{
+  if (Settings.UDPPort == 0 || !WiFiConnected(100))
+    return false;
+  if (command.length() == 0 || command.length() > UDP_PACKET_BUFFER_SIZE - UDP_GROUP_HEADER_SIZE)
+    return false;
+  if (Settings.Unit < UNIT_MAX)
+    mask &= ~(1UL << Settings.Unit);
+  mask &= ~1UL;   // Unit 0 does not exist
+  if (mask == 0)
+    return false;
+  if (udpGroupSeq == 0)
+    udpGroupSeq = random(1, 0xFFFF);   // Not to be taken for a retransmission after a reboot
+  const uint16_t seq = udpGroupSeq++;
+  if (udpGroupSeq == 0) udpGroupSeq = 1;
+
+  const uint32_t expected = mask & activeNodes;
+  if (ack && expected != 0) {
+    // A free slot, else the oldest
+    byte slot = 0;
+    for (byte i = 0; i < UDP_GROUP_PENDING; ++i) {
+      if (udpGroupPending[i].expected == 0) {
+        slot = i;
+        break;
+      }
+      if (timeDiff(udpGroupPending[i].sent, udpGroupPending[slot].sent) > 0)
+        slot = i;
+    }
+    UDPGroupCommandStruct& pending = udpGroupPending[slot];
+    if (pending.expected != 0)
+      ++udpGroupFailed;
+    pending.seq = seq;
+    pending.expected = expected;
+    pending.acked = 0;
+    pending.retries = 0;
+    pending.sent = millis();
+    pending.command = command;
+    setUDPGroupTimer(slot, UDP_GROUP_RETRY_INTERVAL);
+  }
+  sendUDPGroupPacket(seq, ack ? UDP_GROUP_FLAG_ACK : 0, mask, command);
+  ++udpGroupSent;
+
+  if (loglevelActiveFor(LOG_LEVEL_DEBUG_MORE)) {
+    String log = F("UDP  : Group command ");
+    log += seq;
+    log += F(" to 0x");
+    log += String(mask, HEX);
+    addLog(LOG_LEVEL_DEBUG_MORE, log);
+  }
+  return true;
+}
+
+void processUDPGroupCommand(int len, const IPAddress& remoteIP)
+{
+  if (len <= UDP_GROUP_HEADER_SIZE)
+    return;
+  const byte* packet = reinterpret_cast<const byte*>(udpPacketBuffer);
+  const byte sender = packet[2];
+  const uint16_t seq = packet[3] | (packet[4] << 8);
+  uint32_t mask = 0;
+  for (byte i = 0; i < 4; ++i)
+    mask |= static_cast<uint32_t>(packet[6 + i]) << (8 * i);
+  if (Settings.Unit >= UNIT_MAX || (mask & (1UL << Settings.Unit)) == 0 || sender >= UNIT_MAX)
+    return;
+
+  if (packet[5] & UDP_GROUP_FLAG_ACK) {
+    byte reply[5] = { 255, UDP_GROUP_ACK, static_cast<byte>(Settings.Unit), packet[3], packet[4] };
+    portUDP.beginPacket(remoteIP, Settings.UDPPort);
+    portUDP.write(reply, sizeof(reply));
+    portUDP.endPacket();
+  }
+  if (udpGroupLastSeq[sender] == seq)
+    return;   // Retransmitted, already done
+  udpGroupLastSeq[sender] = seq;
+  ++udpGroupReceived;
+  executeUDPCommand(udpPacketBuffer + UDP_GROUP_HEADER_SIZE);
+}
+
+void processUDPGroupAck(int len)
+{
+  if (len < 5)
+    return;
+  const byte* packet = reinterpret_cast<const byte*>(udpPacketBuffer);
+  const byte unit = packet[2];
+  const uint16_t seq = packet[3] | (packet[4] << 8);
+  if (unit >= UNIT_MAX)
+    return;
+  for (byte slot = 0; slot < UDP_GROUP_PENDING; ++slot) {
+    UDPGroupCommandStruct& pending = udpGroupPending[slot];
+    if (pending.expected == 0 || pending.seq != seq)
+      continue;
+    pending.acked |= 1UL << unit;
+    if ((pending.expected & ~pending.acked) == 0) {
+      ++udpGroupAcked;
+      const unsigned long roundTrip = timePassedSince(pending.sent);
+      if (roundTrip > udpGroupMaxRoundTrip) udpGroupMaxRoundTrip = roundTrip;
+      pending.expected = 0;
+      pending.command = "";
+      clearUDPGroupTimer(slot);
+    }
+    return;
+  }
+}
+
+// Called by the scheduler, UDP_GROUP_RETRY_INTERVAL after a send.
+void process_udp_group_timer(unsigned long slot)
+{
+  if (slot >= UDP_GROUP_PENDING)
+    return;
+  UDPGroupCommandStruct& pending = udpGroupPending[slot];
+  const uint32_t missing = pending.expected & ~pending.acked;
+  if (missing == 0)
+    return;
+  if (pending.retries >= UDP_GROUP_RETRIES || !WiFiConnected(100)) {
+    ++udpGroupFailed;
+    const int count = __builtin_popcount(missing);
+    if (loglevelActiveFor(LOG_LEVEL_ERROR)) {
+      String log = F("UDP  : Group command ");
+      log += pending.seq;
+      log += F(" not acknowledged by ");
+      log += count;
+      log += F(" units (0x");
+      log += String(missing, HEX);
+      log += ')';
+      addLog(LOG_LEVEL_ERROR, log);
+    }
+    pending.expected = 0;
+    pending.command = "";
+    if (Settings.UseRules) {
+      String event = F("SendTo#Failed=");
+      event += count;
+      rulesProcessing(event);
+    }
+    return;
+  }
+  ++pending.retries;
+  ++udpGroupRetransmits;
+  sendUDPGroupPacket(pending.seq, UDP_GROUP_FLAG_ACK, missing, pending.command);
+  setUDPGroupTimer(slot, UDP_GROUP_RETRY_INTERVAL);
+}
+
+// Group command stats as: sent/retransmits/acknowledged/failed/received/max round trip msec,
+// empty when not used.
+String getUDPGroupStats()
+{
+  String result;
+  if (udpGroupSent == 0 && udpGroupReceived == 0) return result;
+  result += udpGroupSent;
+  result += '/';
+  result += udpGroupRetransmits;
+  result += '/';
+  result += udpGroupAcked;
+  result += '/';
+  result += udpGroupFailed;
+  result += '/';
+  result += udpGroupReceived;
+  result += '/';
+  result += udpGroupMaxRoundTrip;
+  return result;
 }
 
 
@@ -206,28 +570,70 @@ void sendUDP(byte unit, byte* data, byte size)
 /*********************************************************************************************\
    Refresh aging for remote units, drop if too old...
   \*********************************************************************************************/
+// Node seen at this IP, e.g. by its sysinfo message.
+NodeStruct& updateNode(byte unit, const byte* ip)
+{
+  NodeStruct& node = Nodes[unit];
+  memcpy(node.ip, ip, 4);
+  node.lastSeen = millis();
+  if (ip[0] != 0)
+    activeNodes |= (1UL << unit);
+  return node;
+}
+
+// Remove the nodes not seen for a while, only the active ones are checked.
 void refreshNodeList()
 {
-  for (byte counter = 0; counter < UNIT_MAX; counter++)
+  uint32_t nodes = activeNodes;
+  while (nodes != 0)
   {
-    if (Nodes[counter].ip[0] != 0)
+    const byte unit = __builtin_ctz(nodes);
+    nodes &= nodes - 1;
+    if (Nodes[unit].getAge() > NODE_MAX_AGE) // if entry to old, clear this node ip from the list.
     {
-      Nodes[counter].age++;  // increment age counter
-      if (Nodes[counter].age > 10) // if entry to old, clear this node ip from the list.
-        for (byte x = 0; x < 4; x++)
-          Nodes[counter].ip[x] = 0;
+      for (byte x = 0; x < 4; x++)
+        Nodes[unit].ip[x] = 0;
+      activeNodes &= ~(1UL << unit);
     }
   }
 }
 
 /*********************************************************************************************\
    Broadcast system info to other nodes. (to update node lists)
+   The repeats are sent from the scheduler, with a random delay so nodes powered on at the
+   same time do not all broadcast at once.
   \*********************************************************************************************/
+#define SYSINFO_REPEAT_INTERVAL   500  // msec between the repeats
+#define SYSINFO_MAX_JITTER        500  // msec, random delay added to each message
+
+byte sysInfoRepeatsPending = 0;
+
 void sendSysInfoUDP(byte repeats)
 {
   if (Settings.UDPPort == 0 || !WiFiConnected(100))
     return;
+  if (repeats > sysInfoRepeatsPending)
+    sysInfoRepeatsPending = repeats;
+  setNodeAnnounceTimer(random(0, SYSINFO_MAX_JITTER));
+}
 
+// Called by the scheduler
+void process_node_announce()
+{
+  if (sysInfoRepeatsPending == 0)
+    return;
+  --sysInfoRepeatsPending;
+  if (Settings.UDPPort == 0 || !WiFiConnected(100)) {
+    sysInfoRepeatsPending = 0;
+    return;
+  }
+  sendSysInfoPacket();
+  if (sysInfoRepeatsPending != 0)
+    setNodeAnnounceTimer(SYSINFO_REPEAT_INTERVAL + random(0, SYSINFO_MAX_JITTER));
+}
+
+void sendSysInfoPacket()
+{
   // TODO: make a nice struct of it and clean up
   // 1 byte 'binary token 255'
   // 1 byte id '1'
@@ -240,42 +646,35 @@ void sendSysInfoUDP(byte repeats)
 
   // send my info to the world...
   addLog(LOG_LEVEL_DEBUG_MORE, F("UDP  : Send Sysinfo message"));
-  for (byte counter = 0; counter < repeats; counter++)
-  {
-    uint8_t mac[] = {0, 0, 0, 0, 0, 0};
-    uint8_t* macread = WiFi.macAddress(mac);
-    byte data[80];
-    data[0] = 255;
-    data[1] = 1;
-    for (byte x = 0; x < 6; x++)
-      data[x + 2] = macread[x];
-    IPAddress ip = WiFi.localIP();
-    for (byte x = 0; x < 4; x++)
-      data[x + 8] = ip[x];
-    data[12] = Settings.Unit;
-    data[13] = Settings.Build & 0xff;
-    data[14] = Settings.Build >> 8;
-    memcpy((byte*)data+15,Settings.Name,25);
-    data[40] = NODE_TYPE_ID;
-    statusLED(true);
+  uint8_t mac[] = {0, 0, 0, 0, 0, 0};
+  uint8_t* macread = WiFi.macAddress(mac);
+  byte data[80];
+  memset(data, 0, sizeof(data));
+  data[0] = 255;
+  data[1] = 1;
+  for (byte x = 0; x < 6; x++)
+    data[x + 2] = macread[x];
+  IPAddress ip = WiFi.localIP();
+  for (byte x = 0; x < 4; x++)
+    data[x + 8] = ip[x];
+  data[12] = Settings.Unit;
+  data[13] = Settings.Build & 0xff;
+  data[14] = Settings.Build >> 8;
+  memcpy((byte*)data+15,Settings.Name,25);
+  data[40] = NODE_TYPE_ID;
+  statusLED(true);
 
-    IPAddress broadcastIP(255, 255, 255, 255);
-    portUDP.beginPacket(broadcastIP, Settings.UDPPort);
-    portUDP.write(data, 80);
-    portUDP.endPacket();
-    if (counter < (repeats - 1))
-      delay(500);
-  }
+  IPAddress broadcastIP(255, 255, 255, 255);
+  portUDP.beginPacket(broadcastIP, Settings.UDPPort);
+  portUDP.write(data, 80);
+  portUDP.endPacket();
 
   // store my own info also in the list...
   if (Settings.Unit < UNIT_MAX)
   {
-    IPAddress ip = WiFi.localIP();
-    for (byte x = 0; x < 4; x++)
-      Nodes[Settings.Unit].ip[x] = ip[x];
-    Nodes[Settings.Unit].age = 0;
-    Nodes[Settings.Unit].build = Settings.Build;
-    Nodes[Settings.Unit].nodeType = NODE_TYPE_ID;
+    NodeStruct& node = updateNode(Settings.Unit, data + 8);
+    node.build = Settings.Build;
+    node.nodeType = NODE_TYPE_ID;
   }
 }
 
@@ -339,6 +738,9 @@ void SSDP_schema(WiFiClient &client) {
 
 /********************************************************************************************\
   Global SSDP stuff
+  The listener only exists while SSDP is enabled and WiFi is connected, see SSDP_manage().
+  Searches are parsed in the receive callback and the responses queued, to be sent from
+  backgroundtasks() when their MX delay has passed. So nothing runs when SSDP is disabled.
   \*********************************************************************************************/
 typedef enum {
   NONE,
@@ -346,42 +748,69 @@ typedef enum {
   NOTIFY
 } ssdp_method_t;
 
-UdpContext* _server;
-
-IPAddress _respondToAddr;
-uint16_t  _respondToPort;
-
-bool _pending;
-unsigned short _delay;
-unsigned long _process_time;
-unsigned long _notify_time;
-
 #define SSDP_INTERVAL     1200
 #define SSDP_PORT         1900
 #define SSDP_METHOD_SIZE  10
 #define SSDP_URI_SIZE     2
 #define SSDP_BUFFER_SIZE  64
 #define SSDP_MULTICAST_TTL 2
+#define SSDP_QUEUE_SIZE   4     // Pending search responses
 
 static const IPAddress SSDP_MULTICAST_ADDR(239, 255, 255, 250);
 
+struct SSDP_responseStruct {
+  uint32_t addr;
+  uint16_t port;
+  unsigned long sendAt;
+};
+
+UdpContext* _server = NULL;
+uint32_t _serverIP = 0;       // Local IP the multicast group was joined on
+unsigned long _notify_time;
+
+SSDP_responseStruct ssdpQueue[SSDP_QUEUE_SIZE];
+volatile byte ssdpQueueCount = 0;
+unsigned long ssdpResponses = 0;
+unsigned long ssdpDropped = 0;
+
+
+/********************************************************************************************\
+  Start or stop SSDP to match the settings and the WiFi state, send the periodic notify.
+  Called each 30 seconds, after the settings are saved and when an IP is received.
+  \*********************************************************************************************/
+void SSDP_manage() {
+  const bool wanted = Settings.UseSSDP && WiFiConnected();
+  if (_server != NULL && (!wanted || _serverIP != (uint32_t)WiFi.localIP()))
+    SSDP_stop();
+  if (!wanted)
+    return;
+  if (_server == NULL) {
+    if (!SSDP_begin()) {
+      SSDP_stop();
+      addLog(LOG_LEVEL_ERROR, F("SSDP : Start failed"));
+    }
+    return;
+  }
+  if (_notify_time == 0 || timeOutReached(_notify_time + (SSDP_INTERVAL * 1000L))) {
+    _notify_time = millis();
+    SSDP_send(NOTIFY, SSDP_MULTICAST_ADDR, SSDP_PORT);
+  }
+}
+
 
 /********************************************************************************************\
   Launch SSDP listener and send initial notify
   \*********************************************************************************************/
 bool SSDP_begin() {
-  _pending = false;
-
-  if (_server) {
-    _server->unref();
-    _server = 0;
-  }
+  ssdpQueueCount = 0;
+  _notify_time = 0;
 
   _server = new UdpContext;
   _server->ref();
+  _serverIP = WiFi.localIP();
 
   ip_addr_t ifaddr;
-  ifaddr.addr = WiFi.localIP();
+  ifaddr.addr = _serverIP;
   ip_addr_t multicast_addr;
   multicast_addr.addr = (uint32_t) SSDP_MULTICAST_ADDR;
   if (igmp_joingroup(&ifaddr, &multicast_addr) != ERR_OK ) {
@@ -394,22 +823,37 @@ bool SSDP_begin() {
 
   _server->setMulticastInterface(ifaddr);
   _server->setMulticastTTL(SSDP_MULTICAST_TTL);
-  _server->onRx(&SSDP_update);
+  _server->onRx(&SSDP_receive);
   if (!_server->connect(multicast_addr, SSDP_PORT)) {
     return false;
   }
 
-  SSDP_update();
-
+  addLog(LOG_LEVEL_INFO, F("SSDP : Started"));
+  _notify_time = millis();
+  SSDP_send(NOTIFY, SSDP_MULTICAST_ADDR, SSDP_PORT);
   return true;
 }
 
+void SSDP_stop() {
+  if (_server == NULL)
+    return;
+  ip_addr_t ifaddr;
+  ifaddr.addr = _serverIP;
+  ip_addr_t multicast_addr;
+  multicast_addr.addr = (uint32_t) SSDP_MULTICAST_ADDR;
+  igmp_leavegroup(&ifaddr, &multicast_addr);
+  _server->unref();
+  _server = NULL;
+  _serverIP = 0;
+  ssdpQueueCount = 0;
+}
+
 
 /********************************************************************************************\
   Send SSDP messages (notify & responses)
   \*********************************************************************************************/
-void SSDP_send(byte method) {
-  char buffer[1460];
+void SSDP_send(byte method, uint32_t remoteAddress, uint16_t remotePort) {
+  char buffer[400];
   uint32_t ip = WiFi.localIP();
 
   uint32_t chipId = ESP.getChipId();
@@ -420,60 +864,91 @@ void SSDP_send(byte method) {
             (uint16_t) ((chipId >>  8) & 0xff),
             (uint16_t)   chipId        & 0xff  );
 
-  String _ssdp_response_template = F(
-                                     "HTTP/1.1 200 OK\r\n"
-                                     "EXT:\r\n"
-                                     "ST: upnp:rootdevice\r\n");
-
-  String _ssdp_notify_template = F(
-                                   "NOTIFY * HTTP/1.1\r\n"
-                                   "HOST: 239.255.255.250:1900\r\n"
-                                   "NT: upnp:rootdevice\r\n"
-                                   "NTS: ssdp:alive\r\n");
-
-  String _ssdp_packet_template = F(
-                                   "%s" // _ssdp_response_template / _ssdp_notify_template
-                                   "CACHE-CONTROL: max-age=%u\r\n" // SSDP_INTERVAL
-                                   "SERVER: Arduino/1.0 UPNP/1.1 ESPEasy/%u\r\n" // _modelNumber
-                                   "USN: uuid:%s\r\n" // _uuid
-                                   "LOCATION: http://%u.%u.%u.%u:80/ssdp.xml\r\n" // WiFi.localIP(),
-                                   "\r\n");
-
-  int len = snprintf(buffer, sizeof(buffer),
-                     _ssdp_packet_template.c_str(),
-                     (method == 0) ? _ssdp_response_template.c_str() : _ssdp_notify_template.c_str(),
-                     SSDP_INTERVAL,
-                     Settings.Build,
-                     uuid,
-                     IPADDR2STR(&ip)
-                    );
+  String header;
+  if (method == NONE)
+    header = F("HTTP/1.1 200 OK\r\n"
+               "EXT:\r\n"
+               "ST: upnp:rootdevice\r\n");
+  else
+    header = F("NOTIFY * HTTP/1.1\r\n"
+               "HOST: 239.255.255.250:1900\r\n"
+               "NT: upnp:rootdevice\r\n"
+               "NTS: ssdp:alive\r\n");
+
+  int len = snprintf_P(buffer, sizeof(buffer),
+                       PSTR("%s" // response / notify
+                            "CACHE-CONTROL: max-age=%u\r\n" // SSDP_INTERVAL
+                            "SERVER: Arduino/1.0 UPNP/1.1 ESPEasy/%u\r\n" // _modelNumber
+                            "USN: uuid:%s\r\n" // _uuid
+                            "LOCATION: http://%u.%u.%u.%u:80/ssdp.xml\r\n" // WiFi.localIP(),
+                            "\r\n"),
+                       header.c_str(),
+                       SSDP_INTERVAL,
+                       Settings.Build,
+                       uuid,
+                       IPADDR2STR(&ip)
+                      );
+  if (len >= static_cast<int>(sizeof(buffer))) len = sizeof(buffer) - 1;
 
   _server->append(buffer, len);
 
   ip_addr_t remoteAddr;
-  uint16_t remotePort;
-  if (method == 0) {
-    remoteAddr.addr = _respondToAddr;
-    remotePort = _respondToPort;
-  } else {
-    remoteAddr.addr = SSDP_MULTICAST_ADDR;
-    remotePort = SSDP_PORT;
-  }
+  remoteAddr.addr = remoteAddress;
   _server->send(&remoteAddr, remotePort);
   statusLED(true);
 }
 
 
 /********************************************************************************************\
-  SSDP message processing
+  Send the queued search responses, called from backgroundtasks()
   \*********************************************************************************************/
-void SSDP_update() {
+void SSDP_processQueue() {
+  if (ssdpQueueCount == 0)
+    return;
+  if (_server == NULL) {
+    ssdpQueueCount = 0;
+    return;
+  }
+  byte i = 0;
+  while (i < ssdpQueueCount) {
+    if (!timeOutReached(ssdpQueue[i].sendAt)) {
+      ++i;
+      continue;
+    }
+    SSDP_send(NONE, ssdpQueue[i].addr, ssdpQueue[i].port);
+    ++ssdpResponses;
+    // Keep the order, the callback only appends.
+    noInterrupts();
+    for (byte x = i + 1; x < ssdpQueueCount; ++x)
+      ssdpQueue[x - 1] = ssdpQueue[x];
+    --ssdpQueueCount;
+    interrupts();
+  }
+}
 
-  if (!_pending && _server->next()) {
+String getSSDPStats() {
+  if (_server == NULL)
+    return Settings.UseSSDP ? F("Not started") : F("Disabled");
+  String result = F("Active (");
+  result += ssdpResponses;
+  result += '/';
+  result += ssdpDropped;
+  result += ')';
+  return result;
+}
+
+
+/********************************************************************************************\
+  SSDP message processing, called from the receive callback for each datagram
+  \*********************************************************************************************/
+void SSDP_receive() {
+  while (_server->next()) {
     ssdp_method_t method = NONE;
+    bool _pending = false;
+    unsigned long _delay = 0;
 
-    _respondToAddr = _server->getRemoteAddress();
-    _respondToPort = _server->getRemotePort();
+    const uint32_t respondToAddr = _server->getRemoteAddress();
+    const uint16_t respondToPort = _server->getRemotePort();
 
     typedef enum {METHOD, URI, PROTO, KEY, VALUE, ABORT} states;
     states state = METHOD;
@@ -525,7 +1000,6 @@ void SSDP_update() {
         case KEY:
           if (cr == 4) {
             _pending = true;
-            _process_time = millis();
           }
           else if (c == ' ') {
             cursor = 0;
@@ -550,7 +1024,6 @@ void SSDP_update() {
                 // if the search type matches our type, we should respond instead of ABORT
                 if (strcmp_P(buffer, PSTR("urn:schemas-upnp-org:device:BinaryLight:1")) == 0) {
                   _pending = true;
-                  _process_time = millis();
                   state = KEY;
                 }
                 break;
@@ -582,19 +1055,19 @@ void SSDP_update() {
           break;
       }
     }
-  }
 
-  if (_pending && timeOutReached(_process_time + _delay)) {
-    _pending = false; _delay = 0;
-    SSDP_send(NONE);
-  } else if (_notify_time == 0 || timeOutReached(_notify_time + (SSDP_INTERVAL * 1000L))) {
-    _notify_time = millis();
-    SSDP_send(NOTIFY);
-  }
-
-  if (_pending) {
-    while (_server->next())
-      _server->flush();
+    if (!_pending)
+      continue;
+    // A burst of searches, e.g. from several control points, each get a response.
+    if (ssdpQueueCount >= SSDP_QUEUE_SIZE) {
+      ++ssdpDropped;
+      continue;
+    }
+    SSDP_responseStruct& response = ssdpQueue[ssdpQueueCount];
+    response.addr = respondToAddr;
+    response.port = respondToPort;
+    response.sendAt = millis() + _delay;
+    ++ssdpQueueCount;
   }
 }
 #endif
@@ -619,44 +1092,170 @@ bool WiFiConnected(uint32_t timeout_ms) {
   return true;
 }
 
-bool hostReachable(const IPAddress& ip) {
-  if (!WiFiConnected()) return false;
+/*********************************************************************************************\
+   Host reachability cache
+   Controllers report the result of their connection attempts with setHostReachable(). A host
+   that failed is reported down without trying, until its backoff time has passed, which doubles
+   with every failure. On ESP8266, down hosts are also pinged in the background from the
+   scheduler, so a host replying again is up before its backoff time ends.
+  \*********************************************************************************************/
+#define HOST_CACHE_SIZE            4       // Hosts tracked, the least recently used is replaced
+#define HOST_BACKOFF_MIN       10000       // msec after the first failure
+#define HOST_BACKOFF_MAX      300000
+#define HOST_PING_INTERVAL      5000       // msec between background pings of a down host
+#define HOST_PING_TIMEOUT       1000
 
-  return true; // Disabled ping as requested here:
-  // https://github.com/letscontrolit/ESPEasy/issues/1494#issuecomment-397872538
+#if defined(ESP8266)
+extern "C" {
+  #include <ping.h>
+}
+#endif
+
+struct HostReachabilityStruct
+{
+  HostReachabilityStruct() :
+    ip(0), downSince(0), lastUsed(0), lastPing(0), backoff(0), failures(0), down(false) {}
+
+  uint32_t ip;
+  unsigned long downSince;
+  unsigned long lastUsed;
+  unsigned long lastPing;
+  unsigned long backoff;   // msec from downSince until a connection is tried again
+  uint16_t failures;
+  bool down;
+} hostCache[HOST_CACHE_SIZE];
 
-/*
-  // Only do 1 ping at a time to return early
-  byte retry = 3;
-  while (retry > 0) {
 #if defined(ESP8266)
-    if (Ping.ping(ip, 1)) return true;
+struct ping_option hostPingOption;
+volatile bool hostPingReplied = false;
+int hostPingEntry = -1;           // Cache entry being pinged
+unsigned long hostPingStart = 0;
+
+// Called by the SDK for each reply or timeout, only records the result.
+void hostPingReceive(void* arg, void* pdata)
+{
+  const struct ping_resp* response = reinterpret_cast<const struct ping_resp*>(pdata);
+  if (response->ping_err != -1)
+    hostPingReplied = true;
+}
 #endif
-#if defined(ESP32)
-  if (ping_start(ip, 4, 0, 0, 5)) return true;
+
+// Entry of this host, a new one replaces the least recently used.
+byte getHostCacheEntry(const IPAddress& ip)
+{
+  const uint32_t address = ip;
+  byte oldest = 0;
+  for (byte i = 0; i < HOST_CACHE_SIZE; ++i) {
+    if (hostCache[i].ip == address)
+      return i;
+    if (hostCache[i].ip == 0 || (hostCache[oldest].ip != 0 && hostCache[i].lastUsed < hostCache[oldest].lastUsed))
+      oldest = i;
+  }
+#if defined(ESP8266)
+  if (hostPingEntry == oldest) hostPingEntry = -1;
 #endif
-    delay(50);
-    --retry;
+  hostCache[oldest] = HostReachabilityStruct();
+  hostCache[oldest].ip = address;
+  return oldest;
+}
+
+// Does not block, a down host is only tried again after its backoff time.
+bool hostReachable(const IPAddress& ip) {
+  if (!WiFiConnected()) return false;
+  HostReachabilityStruct& host = hostCache[getHostCacheEntry(ip)];
+  host.lastUsed = millis();
+  if (!host.down) return true;
+  if (timePassedSince(host.downSince) < static_cast<long>(host.backoff)) return false;
+  // Allow one attempt, setHostReachable() sets the next backoff when it fails.
+  host.down = false;
+  return true;
+}
+
+void setHostReachable(const IPAddress& ip, bool reachable) {
+  HostReachabilityStruct& host = hostCache[getHostCacheEntry(ip)];
+  host.lastUsed = millis();
+  if (reachable) {
+    if (host.failures != 0 && loglevelActiveFor(LOG_LEVEL_INFO)) {
+      String log = F("Host reachable again: ");
+      log += formatIP(ip);
+      addLog(LOG_LEVEL_INFO, log);
+    }
+    host.down = false;
+    host.failures = 0;
+    host.backoff = 0;
+    return;
   }
+  if (host.failures < 16) ++host.failures;
+  host.backoff = HOST_BACKOFF_MIN << (host.failures - 1);
+  if (host.backoff > HOST_BACKOFF_MAX) host.backoff = HOST_BACKOFF_MAX;
+  host.down = true;
+  host.downSince = millis();
   if (loglevelActiveFor(LOG_LEVEL_ERROR)) {
     String log = F("Host unreachable: ");
     log += formatIP(ip);
+    log += F(" retry in ");
+    log += host.backoff / 1000;
+    log += F(" s");
     addLog(LOG_LEVEL_ERROR, log);
   }
-  if (ip[1] == 0 && ip[2] == 0 && ip[3] == 0) {
-    // Work-around to fix connected but not able to communicate.
-    addLog(LOG_LEVEL_ERROR, F("Wifi  : Detected strange behavior, reconnect wifi."));
-    WifiDisconnect();
+#if defined(ESP8266)
+  setHostCheckTimer(HOST_PING_INTERVAL);
+#endif
+}
+
+// Scheduler timer, pings one down host at a time and handles the reply.
+void process_host_check() {
+#if defined(ESP8266)
+  if (hostPingEntry >= 0) {
+    HostReachabilityStruct& host = hostCache[hostPingEntry];
+    if (hostPingReplied) {
+      hostPingEntry = -1;
+      if (host.down)
+        setHostReachable(IPAddress(host.ip), true);
+    } else if (timePassedSince(hostPingStart) < HOST_PING_TIMEOUT + 100) {
+      setHostCheckTimer(100);
+      return;
+    } else {
+      hostPingEntry = -1;
+    }
+  }
+  if (!WiFiConnected()) return;
+
+  // Down host pinged longest ago.
+  int next = -1;
+  for (byte i = 0; i < HOST_CACHE_SIZE; ++i) {
+    if (!hostCache[i].down) continue;
+    if (next < 0 || hostCache[i].lastPing < hostCache[next].lastPing)
+      next = i;
   }
-  logConnectionStatus();
-  return false;
-*/
+  if (next < 0) return;
+  HostReachabilityStruct& host = hostCache[next];
+  if (timePassedSince(host.lastPing) < HOST_PING_INTERVAL && host.lastPing != 0) {
+    setHostCheckTimer(HOST_PING_INTERVAL - timePassedSince(host.lastPing));
+    return;
+  }
+  host.lastPing = millis();
+  memset(&hostPingOption, 0, sizeof(hostPingOption));
+  hostPingOption.count = 1;
+  hostPingOption.ip = host.ip;
+  hostPingOption.coarse_time = HOST_PING_TIMEOUT / 1000;
+  ping_regist_recv(&hostPingOption, hostPingReceive);
+  ping_regist_sent(&hostPingOption, NULL);
+  hostPingReplied = false;
+  if (ping_start(&hostPingOption)) {
+    hostPingEntry = next;
+    hostPingStart = millis();
+    setHostCheckTimer(100);
+  } else {
+    setHostCheckTimer(HOST_PING_INTERVAL);
+  }
+#endif
 }
 
 bool hostReachable(const String& hostname) {
   if (!WiFiConnected()) return false;
   IPAddress remote_addr;
-  if (WiFi.hostByName(hostname.c_str(), remote_addr)) {
+  if (resolveHostByName(hostname.c_str(), remote_addr)) {
     return hostReachable(remote_addr);
   }
   String log = F("Hostname cannot be resolved: ");
@@ -664,3 +1263,207 @@ bool hostReachable(const String& hostname) {
   addLog(LOG_LEVEL_ERROR, log);
   return false;
 }
+
+/*********************************************************************************************\
+   TCP socket budget
+   The web server, controllers, MQTT and plugins share a few lwIP TCP connections. Long lived
+   connections are registered with their WiFiClient, short ones hold a SocketLease. MQTT and
+   the controllers have a connection reserved while they were used recently, the other
+   subsystems are refused a new connection when only the reserved ones are left.
+  \*********************************************************************************************/
+#if defined(ESP8266)
+  #define SOCKET_BUDGET             5   // MEMP_NUM_TCP_PCB of the lwIP build
+#else
+  #define SOCKET_BUDGET            16
+#endif
+#if defined(ESP8266)
+  #define SOCKET_RESERVED_WEBSERVER 1   // The web server handles one client at a time
+#else
+  #define SOCKET_RESERVED_WEBSERVER 4   // The client being handled and WEB_RESPONSE_SLOTS deferred responses
+#endif
+#define SOCKET_MAX_REGISTERED      16
+#define SOCKET_RESERVE_TIME    600000   // msec a reserved type keeps its reservation after use
+
+WiFiClient* socketClients[SOCKET_MAX_REGISTERED];
+byte socketClientTypes[SOCKET_MAX_REGISTERED];
+byte socketClientCount = 0;
+byte socketLeases[SOCKET_TYPES] = { 0 };
+unsigned long socketLastUse[SOCKET_TYPES] = { 0 };
+unsigned long socketRefused = 0;
+
+// Register a WiFiClient with a fixed address, it is counted while connected.
+void registerSocketClient(WiFiClient& client, byte type)
+{
+  for (byte i = 0; i < socketClientCount; ++i) {
+    if (socketClients[i] == &client) {
+      socketClientTypes[i] = type;
+      return;
+    }
+  }
+  if (socketClientCount >= SOCKET_MAX_REGISTERED) {
+    addLog(LOG_LEVEL_ERROR, F("TCP  : Too many socket clients registered"));
+    return;
+  }
+  socketClients[socketClientCount] = &client;
+  socketClientTypes[socketClientCount] = type;
+  ++socketClientCount;
+}
+
+// Must be called before a registered WiFiClient is freed.
+void unregisterSocketClient(WiFiClient& client)
+{
+  for (byte i = 0; i < socketClientCount; ++i) {
+    if (socketClients[i] == &client) {
+      --socketClientCount;
+      socketClients[i] = socketClients[socketClientCount];
+      socketClientTypes[i] = socketClientTypes[socketClientCount];
+      return;
+    }
+  }
+}
+
+void acquireSocketLease(byte type)
+{
+  if (type < SOCKET_TYPES) ++socketLeases[type];
+}
+
+void releaseSocketLease(byte type)
+{
+  if (type < SOCKET_TYPES && socketLeases[type] != 0) --socketLeases[type];
+}
+
+// Connections in use per type, returns the total.
+byte getActiveSockets(byte (&active)[SOCKET_TYPES])
+{
+  byte total = 0;
+  for (byte type = 0; type < SOCKET_TYPES; ++type) {
+    active[type] = socketLeases[type];
+    total += socketLeases[type];
+  }
+  for (byte i = 0; i < socketClientCount; ++i) {
+    if (socketClients[i]->connected()) {
+      ++active[socketClientTypes[i]];
+      ++total;
+    }
+  }
+  return total;
+}
+
+// To be called before making or accepting a new connection. The reserved types always get one.
+bool socketAvailable(byte type)
+{
+  if (type >= SOCKET_TYPES) return false;
+  if (type < SOCKET_RESERVED_TYPES) {
+    socketLastUse[type] = millis();
+    return true;
+  }
+  byte active[SOCKET_TYPES];
+  int freeSockets = SOCKET_BUDGET - SOCKET_RESERVED_WEBSERVER - getActiveSockets(active);
+  for (byte reserved = 0; reserved < SOCKET_RESERVED_TYPES; ++reserved) {
+    // Also reserved after boot, before the first use.
+    if (active[reserved] == 0 && (socketLastUse[reserved] == 0 ? millis() < SOCKET_RESERVE_TIME : timePassedSince(socketLastUse[reserved]) < SOCKET_RESERVE_TIME))
+      --freeSockets;
+  }
+  if (freeSockets > 0)
+    return true;
+  ++socketRefused;
+  if (loglevelActiveFor(LOG_LEVEL_ERROR)) {
+    String log = F("TCP  : No connection left for ");
+    log += getSocketTypeName(type);
+    addLog(LOG_LEVEL_ERROR, log);
+  }
+  return false;
+}
+
+String getSocketTypeName(byte type)
+{
+  switch (type) {
+    case SOCKET_MQTT:        return F("MQTT");
+    case SOCKET_CONTROLLER:  return F("controller");
+    case SOCKET_WEB_EVENTS:  return F("web events");
+    case SOCKET_SER2NET:     return F("Ser2Net");
+    case SOCKET_P1_GATEWAY:  return F("P1 gateway");
+  }
+  return F("other");
+}
+
+String getSocketStats()
+{
+  byte active[SOCKET_TYPES];
+  String result;
+  result += getActiveSockets(active);
+  result += '/';
+  result += SOCKET_BUDGET;
+  result += F(" (");
+  for (byte type = 0; type < SOCKET_TYPES; ++type) {
+    if (type != 0) result += '/';
+    result += active[type];
+  }
+  result += F(") ");
+  result += socketRefused;
+  return result;
+}
+
+/*********************************************************************************************\
+   Resolve a hostname, using the DNS cache to avoid a blocking lookup on every call.
+   Failed lookups are cached too, for a shorter time.
+  \*********************************************************************************************/
+bool resolveHostByName(const char* hostname, IPAddress& ip) {
+  if (hostname == NULL || hostname[0] == 0) return false;
+  if (ip.fromString(hostname)) return true;  // Already an IP address
+  int slot = dnsCache.find(hostname);
+  if (slot >= 0 && !timeOutReached(dnsCache.entries[slot].expires)) {
+    dnsCacheEntryStruct& entry = dnsCache.entries[slot];
+    ++dnsCache.hits;
+    entry.lastUsed = millis();
+    ip = entry.ip;
+    return entry.resolved;
+  }
+  ++dnsCache.misses;
+  if (!WiFiConnected()) return false;
+  const bool resolved = WiFi.hostByName(hostname, ip);
+  if (!resolved) ++dnsCache.failed;
+
+  slot = dnsCache.slotFor(hostname);
+  dnsCacheEntryStruct& entry = dnsCache.entries[slot];
+  entry.hostname = hostname;
+  entry.ip = ip;
+  entry.resolved = resolved;
+  entry.lastUsed = millis();
+  entry.expires = entry.lastUsed + (resolved ? DNS_CACHE_TTL : DNS_CACHE_NEGATIVE_TTL);
+  return resolved;
+}
+
+void invalidateHostByName(const char* hostname) {
+  dnsCache.invalidate(hostname);
+}
+
+// DNS cache stats as: hits/misses/failed lookups/entries in use
+// Like "120/118/1/2"
+String getUDPStats() {
+  String result;
+  result += udpReceived;
+  result += '/';
+  result += udpProcessed;
+  result += '/';
+  result += udpTruncated;
+  result += '/';
+  result += udpDropped;
+  return result;
+}
+
+String getDnsCacheStats() {
+  byte inUse = 0;
+  for (byte i = 0; i < DNS_CACHE_SIZE; ++i) {
+    if (dnsCache.entries[i].hostname.length() != 0) ++inUse;
+  }
+  String result;
+  result += dnsCache.hits;
+  result += '/';
+  result += dnsCache.misses;
+  result += '/';
+  result += dnsCache.failed;
+  result += '/';
+  result += inUse;
+  return result;
+}
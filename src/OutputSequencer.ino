@@ -0,0 +1,190 @@
+//********************************************************************************
+// Output sequencer
+// Plays timed pulse patterns on up to 4 GPIO pins without polling, e.g. the bell
+// strikes of P055 and the pulse commands of P001. A pattern is compiled once into
+// a list of steps, each holding the active pins and how long they stay so. The
+// steps wait in a ring per slot and are played by the scheduler: every step sets
+// the timer of the slot to the end of the step, counted from the end of the
+// previous one so a pattern does not drift. After the last step all pins go back
+// to their idle level.
+//********************************************************************************
+#define OUTPUT_SEQUENCER_SLOTS          4
+#define OUTPUT_SEQUENCER_PINS           4    // Per slot, a step holds a bit per pin
+#define OUTPUT_SEQUENCER_STEPS         64    // Queued steps per slot, power of 2
+#define OUTPUT_SEQUENCER_MAX_MSEC  0x0FFFFFFFUL
+#define OUTPUT_SEQUENCER_LATE_MSEC     20    // A step started later is not shortened
+
+// A step as 32 bit: the active pins in the upper 4 bits, the duration in msec below.
+#define OUTPUT_SEQUENCER_STEP(levels, msec) ((static_cast<uint32_t>(levels) << 28) | \
+                                             (static_cast<uint32_t>(msec) & OUTPUT_SEQUENCER_MAX_MSEC))
+#define OUTPUT_SEQUENCER_LEVELS(step)      (static_cast<byte>((step) >> 28))
+#define OUTPUT_SEQUENCER_MSEC(step)        ((step) & OUTPUT_SEQUENCER_MAX_MSEC)
+
+struct OutputSequencerStruct
+{
+  OutputSequencerStruct() : steps(NULL), head(0), tail(0), plugin(0), TaskIndex(-1),
+    inverted(false), autoEnd(false), running(false), due(0)
+  {
+    for (byte i = 0; i < OUTPUT_SEQUENCER_PINS; ++i)
+      pins[i] = -1;
+  }
+
+  uint32_t* steps;       // Ring, NULL when the slot is free
+  uint8_t head;          // Wraps at 256, a multiple of the ring size
+  uint8_t tail;
+  byte plugin;           // Owner, pin states are set for it when there is no task
+  int8_t TaskIndex;      // -1 for commands without a task
+  int8_t pins[OUTPUT_SEQUENCER_PINS];
+  bool inverted;         // Active low
+  bool autoEnd;          // Release the slot after the last step
+  bool running;
+  unsigned long due;     // End of the current step
+} outputSequencer[OUTPUT_SEQUENCER_SLOTS];
+
+struct OutputSequencerStatsStruct
+{
+  OutputSequencerStatsStruct() : steps(0), patterns(0), rejected(0) {}
+
+  unsigned long steps;      // Played
+  unsigned long patterns;   // Played to the end
+  unsigned long rejected;   // No free slot or ring full
+} outputSequencerStats;
+
+void outputSequencerApply(struct OutputSequencerStruct& seq, byte levels) {
+  for (byte i = 0; i < OUTPUT_SEQUENCER_PINS; ++i) {
+    if (seq.pins[i] < 0) continue;
+    const byte level = (((levels >> i) & 1) != 0) != seq.inverted ? HIGH : LOW;
+    digitalWrite(seq.pins[i], level);
+    if (seq.TaskIndex < 0)
+      setPinState(seq.plugin, seq.pins[i], PIN_MODE_OUTPUT, level);
+  }
+}
+
+// Slot used by a plugin for a task, or for a pin when TaskIndex is -1. Returns -1 when not found.
+int outputSequencerFind(byte plugin, int8_t TaskIndex, int8_t pin) {
+  for (byte slot = 0; slot < OUTPUT_SEQUENCER_SLOTS; ++slot) {
+    const OutputSequencerStruct& seq = outputSequencer[slot];
+    if (seq.steps == NULL || seq.plugin != plugin || seq.TaskIndex != TaskIndex) continue;
+    if (TaskIndex >= 0 || seq.pins[0] == pin) return slot;
+  }
+  return -1;
+}
+
+// Take a slot for the pins and set them to the idle level. A slot already used by
+// the plugin for the task (or the first pin) is stopped and used again.
+// With autoEnd the slot is released after the pattern, see outputSequencerEnd().
+// Returns the slot, -1 when all are in use.
+int outputSequencerBegin(byte plugin, int8_t TaskIndex, const int8_t* pins, byte pinCount, bool inverted, bool autoEnd) {
+  if (pinCount == 0 || pinCount > OUTPUT_SEQUENCER_PINS) return -1;
+  int slot = outputSequencerFind(plugin, TaskIndex, pins[0]);
+  for (byte i = 0; slot < 0 && i < OUTPUT_SEQUENCER_SLOTS; ++i)
+    if (outputSequencer[i].steps == NULL) slot = i;
+  if (slot < 0) {
+    ++outputSequencerStats.rejected;
+    addLog(LOG_LEVEL_ERROR, F("Seq  : No free output sequencer"));
+    return -1;
+  }
+  OutputSequencerStruct& seq = outputSequencer[slot];
+  outputSequencerStop(slot);
+  if (seq.steps == NULL) {
+    seq.steps = static_cast<uint32_t*>(allocBuffer(MEM_POOL_OUTPUT, OUTPUT_SEQUENCER_STEPS * sizeof(uint32_t)));
+    if (seq.steps == NULL) {
+      ++outputSequencerStats.rejected;
+      return -1;
+    }
+  }
+  seq.plugin = plugin;
+  seq.TaskIndex = TaskIndex;
+  seq.inverted = inverted;
+  seq.autoEnd = autoEnd;
+  for (byte i = 0; i < OUTPUT_SEQUENCER_PINS; ++i) {
+    seq.pins[i] = i < pinCount ? pins[i] : -1;
+    if (seq.pins[i] >= 0) pinMode(seq.pins[i], OUTPUT);
+  }
+  outputSequencerApply(seq, 0);
+  return slot;
+}
+
+// Drop the queued steps and set the pins to the idle level.
+void outputSequencerStop(int slot) {
+  if (slot < 0 || slot >= OUTPUT_SEQUENCER_SLOTS) return;
+  OutputSequencerStruct& seq = outputSequencer[slot];
+  clearOutputSequencerTimer(slot);
+  seq.head = seq.tail = 0;
+  if (seq.running) {
+    seq.running = false;
+    outputSequencerApply(seq, 0);
+  }
+}
+
+// Stop and release the slot, e.g. at PLUGIN_EXIT. The pins stay outputs at the idle level.
+void outputSequencerEnd(int slot) {
+  if (slot < 0 || slot >= OUTPUT_SEQUENCER_SLOTS) return;
+  OutputSequencerStruct& seq = outputSequencer[slot];
+  outputSequencerStop(slot);
+  freeBuffer(MEM_POOL_OUTPUT, seq.steps, OUTPUT_SEQUENCER_STEPS * sizeof(uint32_t));
+  seq = OutputSequencerStruct();
+}
+
+// Append steps made with OUTPUT_SEQUENCER_STEP(), they are played after the ones
+// already queued. False when they do not all fit, nothing is queued then.
+bool outputSequencerQueue(int slot, const uint32_t* steps, byte count) {
+  if (slot < 0 || slot >= OUTPUT_SEQUENCER_SLOTS || count == 0) return false;
+  OutputSequencerStruct& seq = outputSequencer[slot];
+  if (seq.steps == NULL) return false;
+  const uint8_t queued = seq.head - seq.tail;
+  if (count > OUTPUT_SEQUENCER_STEPS - queued) {
+    ++outputSequencerStats.rejected;
+    return false;
+  }
+  for (byte i = 0; i < count; ++i)
+    seq.steps[(seq.head++) & (OUTPUT_SEQUENCER_STEPS - 1)] = steps[i];
+  if (!seq.running) {
+    seq.running = true;
+    seq.due = millis();
+    processOutputSequencer(slot);
+  }
+  return true;
+}
+
+bool outputSequencerBusy(int slot) {
+  if (slot < 0 || slot >= OUTPUT_SEQUENCER_SLOTS) return false;
+  return outputSequencer[slot].running;
+}
+
+// Called by the scheduler at the end of a step: start the next one.
+void processOutputSequencer(unsigned long slot) {
+  if (slot >= OUTPUT_SEQUENCER_SLOTS) return;
+  OutputSequencerStruct& seq = outputSequencer[slot];
+  if (!seq.running) return;
+  if (seq.head == seq.tail) {
+    seq.running = false;
+    outputSequencerApply(seq, 0);
+    ++outputSequencerStats.patterns;
+    if (seq.autoEnd) outputSequencerEnd(slot);
+    return;
+  }
+  const uint32_t step = seq.steps[(seq.tail++) & (OUTPUT_SEQUENCER_STEPS - 1)];
+  outputSequencerApply(seq, OUTPUT_SEQUENCER_LEVELS(step));
+  ++outputSequencerStats.steps;
+  // After a long loop the rest of the pattern shifts, instead of cutting this step short.
+  if (timePassedSince(seq.due) > OUTPUT_SEQUENCER_LATE_MSEC) seq.due = millis();
+  seq.due += OUTPUT_SEQUENCER_MSEC(step);
+  setOutputSequencerTimer(slot, seq.due);
+}
+
+// Output sequencer stats as: slots in use/steps/patterns/rejected
+String getOutputSequencerStats() {
+  byte inUse = 0;
+  for (byte slot = 0; slot < OUTPUT_SEQUENCER_SLOTS; ++slot)
+    if (outputSequencer[slot].steps != NULL) ++inUse;
+  String result;
+  result += inUse;
+  result += '/';
+  result += outputSequencerStats.steps;
+  result += '/';
+  result += outputSequencerStats.patterns;
+  result += '/';
+  result += outputSequencerStats.rejected;
+  return result;
+}
@@ -0,0 +1,77 @@
+//********************************************************************************
+// Per task plugin data
+// A plugin which keeps state per task derives a struct from PluginTaskData_base
+// and hands it to initPluginTaskData() in PLUGIN_INIT, instead of keeping static
+// arrays of TASKS_MAX or a single static instance. getPluginTaskData() returns
+// it by TaskIndex, NULL when the task did not init (yet). The core deletes it
+// after the PLUGIN_EXIT of the task, so tasks using another plugin or none do
+// not take its memory. A plugin which wants to keep its state over a new
+// PLUGIN_INIT (e.g. a counter, after its settings were saved) uses the data
+// still there, initPluginTaskData() deletes the data it replaces.
+// The bytes given with the data are shown on the sysinfo page.
+//********************************************************************************
+
+struct PluginTaskDataStruct
+{
+  PluginTaskDataStruct() : data(NULL), size(0) {}
+
+  PluginTaskData_base* data;
+  size_t size;                // As given by the plugin, the struct and its buffers
+} pluginTaskData[TASKS_MAX];
+
+void initPluginTaskData(byte TaskIndex, PluginTaskData_base* data, size_t size) {
+  if (TaskIndex >= TASKS_MAX) {
+    delete data;
+    return;
+  }
+  clearPluginTaskData(TaskIndex);
+  if (data == NULL) return;
+  pluginTaskData[TaskIndex].data = data;
+  pluginTaskData[TaskIndex].size = size;
+  if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+    String log = F("Task : Task ");
+    log += TaskIndex + 1;
+    log += F(" data ");
+    log += size;
+    log += getWebString(WEB_STR_BYTES);
+    addLog(LOG_LEVEL_DEBUG, log);
+  }
+}
+
+PluginTaskData_base* getPluginTaskData(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return NULL;
+  return pluginTaskData[TaskIndex].data;
+}
+
+// Called by PluginCall() after PLUGIN_EXIT.
+void clearPluginTaskData(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return;
+  PluginTaskDataStruct& entry = pluginTaskData[TaskIndex];
+  if (entry.data == NULL) return;
+  // Cleared first, an interrupt of the plugin then sees NULL
+  PluginTaskData_base* data = entry.data;
+  entry.data = NULL;
+  entry.size = 0;
+  delete data;
+}
+
+size_t getPluginTaskDataSize(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return 0;
+  return pluginTaskData[TaskIndex].size;
+}
+
+// Task data as: bytes/tasks
+String getPluginTaskDataStats() {
+  size_t bytes = 0;
+  byte tasks = 0;
+  for (byte i = 0; i < TASKS_MAX; ++i) {
+    if (pluginTaskData[i].data == NULL) continue;
+    bytes += pluginTaskData[i].size;
+    ++tasks;
+  }
+  String result;
+  result += bytes;
+  result += '/';
+  result += tasks;
+  return result;
+}
@@ -0,0 +1,191 @@
+//********************************************************************************
+// Power meter
+// Energy and interval statistics for the power measuring plugins (P076 HLW8012,
+// P077 CSE7766). The plugin passes every power reading to powerMeterSample(), as
+// often as the chip gives one (10/s or more). From these:
+//   - the energy is integrated per sample and saved in RTC memory once per
+//     second, so it survives a reboot (not a power loss),
+//   - the minimum, maximum and average power are kept for the task interval,
+//     powerMeterInterval() returns them at PLUGIN_READ and starts a new interval,
+//   - a power above the peak threshold fires <task>#Peak=<W> at once, e.g. for
+//     the inrush of a motor, and again only after the power dropped below 90%.
+// On ESP32 there is no RTC memory used, the energy starts at 0 after a reboot.
+//********************************************************************************
+#define POWER_METER_MAX_GAP        2000    // msec, a longer gap between samples is not integrated
+#define POWER_METER_SAVE_INTERVAL  1000    // msec between the saves to RTC memory
+
+struct PowerMeterStruct
+{
+  PowerMeterStruct() : TaskIndex(-1), lastSample(0), lastSave(0), power(0),
+    min(0), max(0), sum(0), count(0), peakThreshold(0), peakActive(false), peaks(0) {}
+
+  int8_t TaskIndex;
+  unsigned long lastSample;
+  unsigned long lastSave;
+  float power;             // Last sample, W
+  float min;               // Current interval
+  float max;
+  double sum;
+  unsigned long count;
+  float peakThreshold;     // W, 0 = no peak events
+  bool peakActive;
+  unsigned long peaks;
+} powerMeter[RTC_ENERGY_METERS];
+
+// Slot of the task, the energy saved in RTC memory for it is used again.
+// Returns -1 when all slots are in use.
+int powerMeterBegin(byte TaskIndex, float peakThreshold) {
+  int slot = -1;
+  for (byte i = 0; i < RTC_ENERGY_METERS; ++i)
+    if (RTC_Energy.TaskIndex[i] == TaskIndex) slot = i;
+  for (byte i = 0; slot < 0 && i < RTC_ENERGY_METERS; ++i) {
+    if (RTC_Energy.TaskIndex[i] < 0 || (powerMeter[i].TaskIndex < 0 && !Settings.TaskDeviceEnabled[RTC_Energy.TaskIndex[i]])) {
+      slot = i;
+      RTC_Energy.TaskIndex[i] = TaskIndex;
+      RTC_Energy.energy[i] = 0;
+    }
+  }
+  if (slot < 0) {
+    addLog(LOG_LEVEL_ERROR, F("Power: No free energy counter"));
+    return -1;
+  }
+  PowerMeterStruct& meter = powerMeter[slot];
+  meter = PowerMeterStruct();
+  meter.TaskIndex = TaskIndex;
+  meter.peakThreshold = peakThreshold;
+  meter.lastSave = millis();
+  saveEnergyToRTC();
+  return slot;
+}
+
+// The energy counter stays in RTC memory, for the next powerMeterBegin() of the task.
+void powerMeterEnd(int slot) {
+  if (slot < 0 || slot >= RTC_ENERGY_METERS) return;
+  saveEnergyToRTC();
+  powerMeter[slot] = PowerMeterStruct();
+}
+
+void powerMeterSample(int slot, float power) {
+  if (slot < 0 || slot >= RTC_ENERGY_METERS) return;
+  PowerMeterStruct& meter = powerMeter[slot];
+  if (meter.TaskIndex < 0) return;
+  const unsigned long now = millis();
+  if (meter.lastSample != 0) {
+    const long elapsed = timeDiff(meter.lastSample, now);
+    // Trapezoid of the last two samples
+    if (elapsed > 0 && elapsed < POWER_METER_MAX_GAP)
+      RTC_Energy.energy[slot] += (meter.power + power) / 2.0 * elapsed / 3600000.0;
+  }
+  meter.lastSample = now;
+  meter.power = power;
+
+  if (meter.count == 0 || power < meter.min) meter.min = power;
+  if (meter.count == 0 || power > meter.max) meter.max = power;
+  meter.sum += power;
+  ++meter.count;
+
+  if (meter.peakThreshold > 0) {
+    if (!meter.peakActive && power > meter.peakThreshold) {
+      meter.peakActive = true;
+      ++meter.peaks;
+      if (Settings.UseRules) {
+        String eventString = getTaskDeviceName(meter.TaskIndex);
+        eventString += F("#Peak=");
+        eventString += power;
+        rulesProcessing(eventString);
+      }
+    } else if (meter.peakActive && power < 0.9 * meter.peakThreshold) {
+      meter.peakActive = false;
+    }
+  }
+
+  if (timePassedSince(meter.lastSave) >= POWER_METER_SAVE_INTERVAL) {
+    meter.lastSave = now;
+    saveEnergyCounterToRTC(slot);
+  }
+}
+
+// Minimum, average and maximum power since the last call. False when there was no sample.
+bool powerMeterInterval(int slot, float& min, float& avg, float& max) {
+  if (slot < 0 || slot >= RTC_ENERGY_METERS || powerMeter[slot].count == 0) return false;
+  PowerMeterStruct& meter = powerMeter[slot];
+  min = meter.min;
+  max = meter.max;
+  avg = meter.sum / meter.count;
+  meter.count = 0;
+  meter.sum = 0;
+  return true;
+}
+
+// Energy in Wh
+double powerMeterEnergy(int slot) {
+  if (slot < 0 || slot >= RTC_ENERGY_METERS) return 0;
+  return RTC_Energy.energy[slot];
+}
+
+void powerMeterReset(int slot) {
+  if (slot < 0 || slot >= RTC_ENERGY_METERS) return;
+  RTC_Energy.energy[slot] = 0;
+  saveEnergyToRTC();
+}
+
+// Send the interval statistics to the rules as <task>#Energy=<kWh>, #PowerMin, #PowerAvg and #PowerMax.
+// Returns the average power, or the last sample when there was none in the interval.
+float powerMeterReport(int slot) {
+  if (slot < 0 || slot >= RTC_ENERGY_METERS) return 0;
+  const PowerMeterStruct& meter = powerMeter[slot];
+  float min = meter.power, avg = meter.power, max = meter.power;
+  powerMeterInterval(slot, min, avg, max);
+  if (Settings.UseRules && meter.TaskIndex >= 0) {
+    const String taskName = getTaskDeviceName(meter.TaskIndex);
+    String eventString = taskName;
+    eventString += F("#Energy=");
+    eventString += toString(powerMeterEnergy(slot) / 1000.0, 3);
+    rulesProcessing(eventString);
+    eventString = taskName;
+    eventString += F("#PowerMin=");
+    eventString += min;
+    rulesProcessing(eventString);
+    eventString = taskName;
+    eventString += F("#PowerAvg=");
+    eventString += avg;
+    rulesProcessing(eventString);
+    eventString = taskName;
+    eventString += F("#PowerMax=");
+    eventString += max;
+    rulesProcessing(eventString);
+  }
+  if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+    String log = F("Power: ");
+    log += min;
+    log += '/';
+    log += avg;
+    log += '/';
+    log += max;
+    log += F(" W, ");
+    log += toString(powerMeterEnergy(slot) / 1000.0, 3);
+    log += F(" kWh");
+    addLog(LOG_LEVEL_INFO, log);
+  }
+  return avg;
+}
+
+// Task page fields, stored in TaskDevicePluginConfig[configIndex].
+void powerMeterWebformLoad(struct EventStruct *event, byte configIndex, int slot) {
+  addFormSubHeader(F("Energy"));
+  addFormNumericBox(F("Peak threshold"), F("powermeter_peak"), Settings.TaskDevicePluginConfig[event->TaskIndex][configIndex], 0, 30000);
+  addUnit(F("W"));
+  addFormNote(F("Above it the rules get taskname#Peak at once, 0 = off. Each read sends #Energy (kWh), #PowerMin, #PowerAvg and #PowerMax"));
+  if (slot >= 0 && slot < RTC_ENERGY_METERS) {
+    String note = F("Energy: ");
+    note += toString(powerMeterEnergy(slot) / 1000.0, 3);
+    note += F(" kWh, peaks: ");
+    note += powerMeter[slot].peaks;
+    note += F(". Command energyreset sets it to 0");
+    addFormNote(note);
+  }
+}
+
+void powerMeterWebformSave(struct EventStruct *event, byte configIndex) {
+  Settings.TaskDevicePluginConfig[event->TaskIndex][configIndex] = getFormItemInt(F("powermeter_peak"));
+}
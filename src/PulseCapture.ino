@@ -0,0 +1,180 @@
+//********************************************************************************
+// Pulse capture
+// Records the edges on a GPIO in the background, so a plugin can decode a
+// waveform (DHT bit stream, ultrasonic echo) afterwards instead of busy waiting
+// on the pin with interrupts disabled.
+//   pulseCaptureStart()     claim a channel and start recording
+//   pulseCaptureStop()      stop recording, returns the number of edges
+//   pulseCaptureSegment()   duration and level between two recorded edges
+// On ESP32 the RMT receiver records the levels, which ends a frame after
+// idleTime usec without a change. On ESP8266 an edge interrupt stores a time stamp.
+//********************************************************************************
+#define PULSE_CAPTURE_CHANNELS        2
+#define PULSE_CAPTURE_MAX_EDGES      96    // DHT: 84 edges
+#if defined(ESP32)
+  #include <driver/rmt.h>
+  #define PULSE_CAPTURE_RMT_CHANNEL   RMT_CHANNEL_4   // First one used, the lower ones are left for LED drivers
+  #define PULSE_CAPTURE_RMT_FILTER    100             // APB clock cycles, shorter pulses are noise
+#endif
+
+struct PulseCaptureStruct
+{
+  PulseCaptureStruct() : start(0), count(0), pin(-1), owner(-1), active(false) {}
+
+  uint32_t times[PULSE_CAPTURE_MAX_EDGES];   // usec since the start of the capture
+  uint8_t levels[PULSE_CAPTURE_MAX_EDGES];   // Level after the edge
+  unsigned long start;
+  volatile byte count;
+  int8_t pin;
+  int8_t owner;                              // TaskIndex
+  bool active;
+} pulseCapture[PULSE_CAPTURE_CHANNELS];
+
+struct PulseCaptureStatsStruct
+{
+  PulseCaptureStatsStruct() : captures(0), busy(0), overflows(0) {}
+
+  unsigned long captures;
+  unsigned long busy;        // No free channel
+  unsigned long overflows;   // More edges than PULSE_CAPTURE_MAX_EDGES
+} pulseCaptureStats;
+
+#if defined(ESP8266)
+void pulseCaptureEdge(byte channel) ICACHE_RAM_ATTR;
+void pulseCaptureInterrupt0() ICACHE_RAM_ATTR;
+void pulseCaptureInterrupt1() ICACHE_RAM_ATTR;
+
+void pulseCaptureEdge(byte channel) {
+  PulseCaptureStruct& capture = pulseCapture[channel];
+  const byte count = capture.count;
+  if (count >= PULSE_CAPTURE_MAX_EDGES) return;
+  capture.times[count] = micros() - capture.start;
+  capture.levels[count] = digitalRead(capture.pin);
+  capture.count = count + 1;
+}
+
+void pulseCaptureInterrupt0() {
+  pulseCaptureEdge(0);
+}
+
+void pulseCaptureInterrupt1() {
+  pulseCaptureEdge(1);
+}
+#endif
+
+// Returns the channel, or -1 when all channels are in use.
+int pulseCaptureStart(byte TaskIndex, int8_t pin, unsigned int idleTime) {
+  if (pin < 0) return -1;
+  int channel = 0;
+  while (channel < PULSE_CAPTURE_CHANNELS && pulseCapture[channel].active) ++channel;
+  if (channel == PULSE_CAPTURE_CHANNELS) {
+    ++pulseCaptureStats.busy;
+    return -1;
+  }
+  PulseCaptureStruct& capture = pulseCapture[channel];
+  capture.pin = pin;
+  capture.owner = TaskIndex;
+  capture.count = 0;
+  capture.start = micros();
+  #if defined(ESP32)
+    const rmt_channel_t rmtChannel = static_cast<rmt_channel_t>(PULSE_CAPTURE_RMT_CHANNEL + channel);
+    rmt_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.rmt_mode = RMT_MODE_RX;
+    config.channel = rmtChannel;
+    config.gpio_num = static_cast<gpio_num_t>(pin);
+    config.clk_div = 80;  // 1 usec per tick
+    config.mem_block_num = 1;
+    config.rx_config.filter_en = true;
+    config.rx_config.filter_ticks_thresh = PULSE_CAPTURE_RMT_FILTER;
+    config.rx_config.idle_threshold = idleTime;
+    if (rmt_config(&config) != ESP_OK || rmt_driver_install(rmtChannel, 1024, 0) != ESP_OK) {
+      addLog(LOG_LEVEL_ERROR, F("Pulse: RMT setup failed"));
+      return -1;
+    }
+    rmt_rx_start(rmtChannel, true);
+  #else
+    if (channel == 0) attachInterrupt(pin, pulseCaptureInterrupt0, CHANGE);
+    else              attachInterrupt(pin, pulseCaptureInterrupt1, CHANGE);
+  #endif
+  capture.active = true;
+  ++pulseCaptureStats.captures;
+  return channel;
+}
+
+// The recorded edges stay available until the channel is started again.
+byte pulseCaptureStop(int channel) {
+  if (channel < 0 || channel >= PULSE_CAPTURE_CHANNELS || !pulseCapture[channel].active) return 0;
+  PulseCaptureStruct& capture = pulseCapture[channel];
+  #if defined(ESP32)
+    const rmt_channel_t rmtChannel = static_cast<rmt_channel_t>(PULSE_CAPTURE_RMT_CHANNEL + channel);
+    RingbufHandle_t ringbuffer = NULL;
+    rmt_get_ringbuf_handle(rmtChannel, &ringbuffer);
+    size_t size = 0;
+    rmt_item32_t* items = ringbuffer == NULL ? NULL : static_cast<rmt_item32_t*>(xRingbufferReceive(ringbuffer, &size, 0));
+    if (items != NULL) {
+      // Each item holds two levels with their duration, a duration of 0 ends the frame
+      // (the idle level, which is left open like the last level on ESP8266).
+      uint32_t time = 0;
+      byte count = 0;
+      const size_t nrHalves = (size / sizeof(rmt_item32_t)) * 2;
+      for (size_t i = 0; i < nrHalves; ++i) {
+        const rmt_item32_t& item = items[i / 2];
+        const uint32_t duration = (i & 1) ? item.duration1 : item.duration0;
+        if (duration == 0) break;
+        // One spare entry for the closing edge
+        if (count >= PULSE_CAPTURE_MAX_EDGES - 1) {
+          ++pulseCaptureStats.overflows;
+          break;
+        }
+        capture.times[count] = time;
+        capture.levels[count] = (i & 1) ? item.level1 : item.level0;
+        ++count;
+        time += duration;
+      }
+      // Closing edge, so the last level before the idle level has a duration as well.
+      if (count > 0) {
+        capture.times[count] = time;
+        capture.levels[count] = !capture.levels[count - 1];
+        ++count;
+      }
+      capture.count = count;
+      vRingbufferReturnItem(ringbuffer, items);
+    }
+    rmt_rx_stop(rmtChannel);
+    rmt_driver_uninstall(rmtChannel);
+  #else
+    detachInterrupt(capture.pin);
+    if (capture.count >= PULSE_CAPTURE_MAX_EDGES) ++pulseCaptureStats.overflows;
+  #endif
+  capture.active = false;
+  return capture.count;
+}
+
+// Duration in usec of the level after edge 'segment', -1 when there is no next edge.
+long pulseCaptureSegment(int channel, byte segment, bool& level) {
+  if (channel < 0 || channel >= PULSE_CAPTURE_CHANNELS) return -1;
+  const PulseCaptureStruct& capture = pulseCapture[channel];
+  if (capture.active || segment + 1 >= capture.count) return -1;
+  level = capture.levels[segment] != 0;
+  return capture.times[segment + 1] - capture.times[segment];
+}
+
+// Release a channel without using the result, e.g. at PLUGIN_EXIT.
+void pulseCaptureCancel(byte TaskIndex) {
+  for (int channel = 0; channel < PULSE_CAPTURE_CHANNELS; ++channel) {
+    if (pulseCapture[channel].active && pulseCapture[channel].owner == TaskIndex)
+      pulseCaptureStop(channel);
+  }
+}
+
+// Pulse capture stats as: captures/no free channel/overflows
+String getPulseCaptureStats() {
+  String result;
+  result += pulseCaptureStats.captures;
+  result += '/';
+  result += pulseCaptureStats.busy;
+  result += '/';
+  result += pulseCaptureStats.overflows;
+  return result;
+}
@@ -0,0 +1,204 @@
+//********************************************************************************
+// RTC memory (ESP8266)
+// The user part of the RTC memory is 128 blocks of 4 bytes, from block 64. It
+// holds the regions below in this order, each is followed by the getChecksum()
+// of its data. The blocks are computed from the sizes of the structs, so a
+// change of a region moves the ones after it: raise RTC_LAYOUT_VERSION then,
+// a boot finding another version in RTCStruct starts as a cold boot.
+// saveRTCRegion() writes the whole region. For frequent small updates mark the
+// changed fields with setRTCRegionDirty(), and write them with flushRTCRegion():
+// only their blocks and the checksum are written, e.g. 3 blocks for an energy
+// counter of a power meter instead of 7. flushRTCMemory() writes all regions
+// left dirty, it is called before deep sleep and reboot.
+// On ESP32 the RTC memory is not used, reads and writes return false.
+//********************************************************************************
+#define RTC_USER_BLOCK_FIRST    64
+#define RTC_USER_BLOCK_END      192
+
+struct RTCRegionStruct
+{
+  byte* data;
+  uint16_t size;     // bytes, a multiple of 4
+  byte block;        // First block, the checksum is in the block after the data
+  uint64_t dirty;    // Bit per block of the data
+};
+
+struct RTCMemoryStruct
+{
+  RTCMemoryStruct() : initialized(false), blocksUsed(0), writes(0), blocksWritten(0), checksumErrors(0) {}
+
+  RTCRegionStruct region[RTC_REGIONS];
+  bool initialized;
+  byte blocksUsed;
+  unsigned long writes;
+  unsigned long blocksWritten;
+  unsigned long checksumErrors;
+} rtcMemory;
+
+#if defined(ESP8266)
+static_assert(sizeof(RTCStruct) % 4 == 0 && sizeof(UserVar) % 4 == 0 && sizeof(RTC_WiFiStruct) % 4 == 0 &&
+              sizeof(RTC_EnergyStruct) % 4 == 0 && sizeof(RTC_SleepStruct) % 4 == 0 &&
+              sizeof(RTC_SampleStruct) % 4 == 0 && sizeof(RTC_BootProfileStruct) % 4 == 0,
+              "RTC regions are written in blocks of 4 bytes");
+static_assert((sizeof(RTCStruct) + sizeof(UserVar) + sizeof(RTC_WiFiStruct) + sizeof(RTC_EnergyStruct) +
+               sizeof(RTC_SleepStruct) + sizeof(RTC_SampleStruct) + sizeof(RTC_BootProfileStruct)) / 4 + RTC_REGIONS <=
+              RTC_USER_BLOCK_END - RTC_USER_BLOCK_FIRST, "RTC memory is 128 blocks from block 64");
+#endif
+
+void setRTCRegion(byte id, void* data, uint16_t size)
+{
+  RTCRegionStruct& region = rtcMemory.region[id];
+  region.data = static_cast<byte*>(data);
+  region.size = size;
+  region.block = RTC_USER_BLOCK_FIRST + rtcMemory.blocksUsed;
+  region.dirty = 0;
+  rtcMemory.blocksUsed += size / 4 + 1;
+}
+
+struct RTCRegionStruct* getRTCRegion(byte id)
+{
+  if (!rtcMemory.initialized) {
+    // In the order of the ids
+    setRTCRegion(RTC_REGION_STRUCT, &RTC, sizeof(RTC));
+    setRTCRegion(RTC_REGION_USERVAR, &UserVar, sizeof(UserVar));
+    setRTCRegion(RTC_REGION_WIFI, &RTC_WiFi, sizeof(RTC_WiFi));
+    setRTCRegion(RTC_REGION_ENERGY, &RTC_Energy, sizeof(RTC_Energy));
+    setRTCRegion(RTC_REGION_SLEEP, &RTC_Sleep, sizeof(RTC_Sleep));
+    setRTCRegion(RTC_REGION_SAMPLES, &RTC_Samples, sizeof(RTC_Samples));
+    setRTCRegion(RTC_REGION_BOOT, &RTC_BootProfile, sizeof(RTC_BootProfile));
+    rtcMemory.initialized = true;
+  }
+  if (id >= RTC_REGIONS) return NULL;
+  return &rtcMemory.region[id];
+}
+
+String getRTCRegionName(byte id)
+{
+  switch (id) {
+    case RTC_REGION_STRUCT:  return F("RTC");
+    case RTC_REGION_USERVAR: return F("UserVar");
+    case RTC_REGION_WIFI:    return F("WiFi");
+    case RTC_REGION_ENERGY:  return F("Energy");
+    case RTC_REGION_SLEEP:   return F("Sleep");
+    case RTC_REGION_SAMPLES: return F("Samples");
+    case RTC_REGION_BOOT:    return F("Boot");
+  }
+  return getWebString(WEB_STR_UNKNOWN);
+}
+
+#if defined(ESP8266)
+bool writeRTCBlocks(byte block, const byte* data, uint16_t size)
+{
+  ++rtcMemory.writes;
+  rtcMemory.blocksWritten += size / 4;
+  return system_rtc_mem_write(block, data, size);
+}
+
+bool writeRTCRegionChecksum(struct RTCRegionStruct& region)
+{
+  const uint32_t sum = getChecksum(region.data, region.size);
+  return writeRTCBlocks(region.block + region.size / 4, (const byte*)&sum, sizeof(sum));
+}
+#endif
+
+// Read the region from RTC memory. Returns false when the checksum does not match,
+// the data is as read then.
+boolean readRTCRegion(byte id)
+{
+  #if defined(ESP32)
+    return false;
+  #else
+    RTCRegionStruct* region = getRTCRegion(id);
+    if (region == NULL) return false;
+    region->dirty = 0;
+    uint32_t sum = 0;
+    if (!system_rtc_mem_read(region->block, region->data, region->size) ||
+        !system_rtc_mem_read(region->block + region->size / 4, (byte*)&sum, sizeof(sum)))
+      return false;
+    if (sum != getChecksum(region->data, region->size)) {
+      String log = F("RTC  : Checksum error in ");
+      log += getRTCRegionName(id);
+      addLog(LOG_LEVEL_DEBUG, log);
+      ++rtcMemory.checksumErrors;
+      return false;
+    }
+    return true;
+  #endif
+}
+
+// Write the whole region with its checksum.
+boolean saveRTCRegion(byte id)
+{
+  #if defined(ESP32)
+    return false;
+  #else
+    RTCRegionStruct* region = getRTCRegion(id);
+    if (region == NULL) return false;
+    region->dirty = 0;
+    return writeRTCBlocks(region->block, region->data, region->size) && writeRTCRegionChecksum(*region);
+  #endif
+}
+
+// Mark a changed field of the region data, written by the next flushRTCRegion().
+void setRTCRegionDirty(byte id, const void* field, size_t size)
+{
+  RTCRegionStruct* region = getRTCRegion(id);
+  if (region == NULL || size == 0) return;
+  const int offset = static_cast<const byte*>(field) - region->data;
+  if (offset < 0 || offset + size > region->size) {
+    // Not within the region, write all of it
+    region->dirty = ~0ULL;
+    return;
+  }
+  for (int block = offset / 4; block <= static_cast<int>((offset + size - 1) / 4); ++block)
+    region->dirty |= 1ULL << block;
+}
+
+// Write the dirty blocks of the region, in runs of adjacent blocks, and the checksum.
+boolean flushRTCRegion(byte id)
+{
+  #if defined(ESP32)
+    return false;
+  #else
+    RTCRegionStruct* region = getRTCRegion(id);
+    if (region == NULL) return false;
+    if (region->dirty == 0) return true;
+    const byte blocks = region->size / 4;
+    if (blocks > 64 || region->dirty == ~0ULL) return saveRTCRegion(id);
+    bool success = true;
+    byte block = 0;
+    while (block < blocks) {
+      if ((region->dirty & (1ULL << block)) == 0) {
+        ++block;
+        continue;
+      }
+      byte end = block + 1;
+      while (end < blocks && (region->dirty & (1ULL << end)) != 0) ++end;
+      success &= writeRTCBlocks(region->block + block, region->data + 4 * block, 4 * (end - block));
+      block = end;
+    }
+    region->dirty = 0;
+    return writeRTCRegionChecksum(*region) && success;
+  #endif
+}
+
+void flushRTCMemory()
+{
+  for (byte id = 0; id < RTC_REGIONS; ++id)
+    flushRTCRegion(id);
+}
+
+// RTC memory as: blocks used/blocks written/checksum errors, empty on ESP32.
+String getRTCMemoryStats()
+{
+  String result;
+  #if defined(ESP8266)
+  getRTCRegion(0);
+  result += rtcMemory.blocksUsed;
+  result += '/';
+  result += rtcMemory.blocksWritten;
+  result += '/';
+  result += rtcMemory.checksumErrors;
+  #endif
+  return result;
+}
@@ -0,0 +1,143 @@
+//********************************************************************************
+// Scheduled radio (Settings.RadioOffMax)
+// For nodes on mains power which run hot, or should stay out of the air: the
+// WiFi radio is switched off between the sends of the tasks, instead of the
+// modem sleep of a connected station. When nothing was sent for RADIO_IDLE_MSEC,
+// the controller queues and batches are empty and the next task send is far
+// enough away, MQTT is disconnected cleanly (no last will, no keep-alive timing
+// out while off), and the radio is off until RADIO_WAKE_LEAD msec before the
+// next TASK_DEVICE_TIMER of a task sending to a controller, at most RadioOffMax
+// sec. The reconnect uses the cached BSSID, channel and IP config of
+// saveWiFiConnection(), as after deep sleep.
+// A send of an event driven task (e.g. a switch) wakes the radio at once, the
+// sample waits in the controller queue, which is needed for this mode. A web
+// page keeps the radio on for RADIO_WEB_STAY_ON msec, MQTT commands and web
+// pages only get through while the radio is on.
+//********************************************************************************
+#define RADIO_IDLE_MSEC          2000   // No send since, before the radio goes off
+#define RADIO_WAKE_LEAD          3000   // msec before the next send, to reconnect
+#define RADIO_OFF_MIN           10000   // msec, a shorter off time is not worth the reconnect
+#define RADIO_WEB_STAY_ON       60000   // msec after a web page
+
+struct ScheduledRadioStruct
+{
+  ScheduledRadioStruct() : off(false), offSince(0), lastActivity(0), offCount(0), offTotal(0) {}
+
+  bool off;
+  unsigned long offSince;      // millis()
+  unsigned long lastActivity;  // millis() of the last web page
+  unsigned long offCount;
+  unsigned long offTotal;      // sec, before the current off time
+} scheduledRadio;
+
+bool scheduledRadioOff() {
+  return scheduledRadio.off;
+}
+
+// Called for each web page.
+void scheduledRadioActivity() {
+  scheduledRadio.lastActivity = millis();
+}
+
+// msec until the next timed read of a task which sends to a controller, max_msec when there is none.
+unsigned long msecUntilNextTaskSend(unsigned long max_msec) {
+  unsigned long result = max_msec;
+  for (byte TaskIndex = 0; TaskIndex < TASKS_MAX; TaskIndex++) {
+    if (!Settings.TaskDeviceEnabled[TaskIndex] || Settings.TaskDeviceNumber[TaskIndex] == 0) continue;
+    bool sends = false;
+    for (byte x = 0; x < CONTROLLER_MAX && !sends; x++)
+      sends = Settings.TaskDeviceSendData[x][TaskIndex] && Settings.ControllerEnabled[x] && Settings.Protocol[x];
+    unsigned long timer;
+    if (!sends || !msecTimerHandler.getTimer(getMixedId(TASK_DEVICE_TIMER, TaskIndex), timer)) continue;
+    const long passed = timePassedSince(timer);
+    if (passed >= 0) return 0;
+    if (static_cast<unsigned long>(-passed) < result) result = -passed;
+  }
+  return result;
+}
+
+bool controllerDataPending() {
+  for (byte x = 0; x < CONTROLLER_MAX; x++) {
+    if (ControllerQueue[x].count != 0 || ControllerQueue[x].onFile() != 0 || ControllerBatch[x].count != 0)
+      return true;
+  }
+  return false;
+}
+
+bool scheduledRadioMayGoOff() {
+  if (Settings.RadioOffMax == 0 || Settings.ControllerQueueDepth == 0 || isDeepSleepEnabled()) return false;
+  if (!WiFiConnected() || wifiSetup || WifiIsAP(WiFi.getMode())) return false;
+  #ifdef FEATURE_ARDUINO_OTA
+  if (ArduinoOTAtriggered) return false;
+  #endif
+  if (timePassedSince(lastSend) < RADIO_IDLE_MSEC) return false;
+  if (scheduledRadio.lastActivity != 0 && timePassedSince(scheduledRadio.lastActivity) < RADIO_WEB_STAY_ON) return false;
+  return !controllerDataPending();
+}
+
+void scheduledRadioSleep(unsigned long msec) {
+  if (MQTTclient.connected()) {
+    MQTTclient.disconnect();
+    updateMQTTclient_connected();
+  }
+  // Age of the IP config, for the fast reconnect
+  if (RTC_WiFi.channel != 0) {
+    RTC_WiFi.ipAge += timePassedSince(lastGetIPmoment) / 1000;
+    saveWiFiToRTC();
+    wifiFastConnect = true;
+  }
+  scheduledRadio.off = true;
+  scheduledRadio.offSince = millis();
+  ++scheduledRadio.offCount;
+  setTimer(RADIO_TIMER, 0, msec);
+  if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+    String log = F("WIFI : Radio off for ");
+    log += msec / 1000;
+    log += F(" sec");
+    addLog(LOG_LEVEL_INFO, log);
+  }
+  WifiDisconnect();
+  #if defined(ESP8266)
+  WiFi.forceSleepBegin();
+  #else
+  setWifiMode(WIFI_OFF);
+  #endif
+}
+
+// From the RADIO_TIMER, or when data is to be sent.
+void scheduledRadioWake() {
+  if (!scheduledRadio.off) return;
+  scheduledRadio.off = false;
+  scheduledRadio.offTotal += timePassedSince(scheduledRadio.offSince) / 1000;
+  msecTimerHandler.remove(getMixedId(RADIO_TIMER, 0));
+  addLog(LOG_LEVEL_INFO, F("WIFI : Radio on"));
+  #if defined(ESP8266)
+  WiFi.forceSleepWake();
+  delay(1);
+  #endif
+  wifi_connect_attempt = 0;
+  WiFiConnectRelaxed();
+}
+
+// Called once per second.
+void processScheduledRadio() {
+  if (scheduledRadio.off) {
+    if (Settings.RadioOffMax == 0 || isDeepSleepEnabled()) scheduledRadioWake();
+    return;
+  }
+  if (!scheduledRadioMayGoOff()) return;
+  const unsigned long maxOff = 1000UL * Settings.RadioOffMax;
+  const unsigned long next = msecUntilNextTaskSend(maxOff + RADIO_WAKE_LEAD);
+  if (next < RADIO_WAKE_LEAD + RADIO_OFF_MIN) return;
+  scheduledRadioSleep(next - RADIO_WAKE_LEAD);
+}
+
+// Radio off as: times/sec off, empty when not used.
+String getScheduledRadioStats() {
+  String result;
+  if (Settings.RadioOffMax == 0 && scheduledRadio.offCount == 0) return result;
+  result += scheduledRadio.offCount;
+  result += '/';
+  result += scheduledRadio.offTotal + (scheduledRadio.off ? timePassedSince(scheduledRadio.offSince) / 1000 : 0);
+  return result;
+}
@@ -1,10 +1,3 @@
-#define TIMER_ID_SHIFT    28
-
-#define CONST_INTERVAL_TIMER 1
-#define GENERIC_TIMER        2
-#define SYSTEM_TIMER         3
-#define TASK_DEVICE_TIMER    4
-
 void setTimer(unsigned long id) {
   setTimer(GENERIC_TIMER, id, 0);
 }
@@ -35,40 +28,168 @@ void setIntervalTimer(unsigned long id, unsigned long lasttimer) {
   setNewTimerAt(getMixedId(CONST_INTERVAL_TIMER, id), timer);
 }
 
-void setTimer(unsigned long timerType, unsigned long id, unsigned long msecFromNow) {
-  setNewTimerAt(getMixedId(timerType, id), millis() + msecFromNow);
+// Next sysinfo message, see sendSysInfoUDP()
+void setNodeAnnounceTimer(unsigned long msecFromNow) {
+  setTimer(NODE_ANNOUNCE_TIMER, 0, msecFromNow);
+}
+
+// Retransmit of a group command waiting for acknowledgements, see sendUDPGroupCommand()
+void setUDPGroupTimer(unsigned long slot, unsigned long msecFromNow) {
+  setTimer(UDP_GROUP_TIMER, slot, msecFromNow);
+}
+
+void clearUDPGroupTimer(unsigned long slot) {
+  msecTimerHandler.remove(getMixedId(UDP_GROUP_TIMER, slot));
+}
+
+void setHostCheckTimer(unsigned long msecFromNow) {
+  setTimer(HOST_CHECK_TIMER, 0, msecFromNow);
+}
+
+// End of the current step of an output sequencer slot, at an absolute time.
+void setOutputSequencerTimer(unsigned long slot, unsigned long timer) {
+  setNewTimerAt(getMixedId(OUTPUT_SEQUENCER_TIMER, slot), timer);
+}
+
+void clearOutputSequencerTimer(unsigned long slot) {
+  msecTimerHandler.remove(getMixedId(OUTPUT_SEQUENCER_TIMER, slot));
+}
+
+// Rules#Timer=<timerNr> after msecFromNow, see timerset. Also resumes a paused timer.
+void setRulesTimer(unsigned int timerNr, unsigned long msecFromNow) {
+  RulesTimerPaused.erase(timerNr);
+  setTimer(RULES_TIMER, timerNr, msecFromNow);
+}
+
+void clearRulesTimer(unsigned int timerNr) {
+  RulesTimerPaused.erase(timerNr);
+  msecTimerHandler.remove(getMixedId(RULES_TIMER, timerNr));
+}
+
+// Keep the remaining time of a running timer. Returns false when it is not running.
+bool pauseRulesTimer(unsigned int timerNr) {
+  unsigned long timer;
+  if (!msecTimerHandler.getTimer(getMixedId(RULES_TIMER, timerNr), timer)) return false;
+  const long remaining = -timePassedSince(timer);
+  msecTimerHandler.remove(getMixedId(RULES_TIMER, timerNr));
+  RulesTimerPaused[timerNr] = remaining > 0 ? remaining : 0;
+  return true;
+}
+
+// Continue a paused timer. Returns false when it is not paused.
+bool resumeRulesTimer(unsigned int timerNr) {
+  std::map<unsigned int, unsigned long>::iterator it = RulesTimerPaused.find(timerNr);
+  if (it == RulesTimerPaused.end()) return false;
+  setRulesTimer(timerNr, it->second);
+  return true;
+}
+
+bool rulesTimerPaused(unsigned int timerNr) {
+  return RulesTimerPaused.find(timerNr) != RulesTimerPaused.end();
+}
+
+void process_rules_timer(unsigned long timerNr) {
+  if (!Settings.UseRules) return;
+  String event = F("Rules#Timer=");
+  event += timerNr;
+  rulesProcessing(event);
+}
+
+bool setTimer(unsigned long timerType, unsigned long id, unsigned long msecFromNow) {
+  return setNewTimerAt(getMixedId(timerType, id), millis() + msecFromNow);
 }
 
-void setSystemTimer(unsigned long timer, byte plugin, short taskIndex, int Par1, int Par2, int Par3, int Par4, int Par5)
+// Returns false when the pool is full, the timer is then not set (counted in overflowCount).
+bool setSystemTimer(unsigned long timer, byte plugin, short taskIndex, int Par1, int Par2, int Par3, int Par4, int Par5)
 {
   // plugin number and par1 form a unique key that can be used to restart a timer
   const unsigned long systemTimerId = createSystemTimerId(plugin, Par1);
-  systemTimerStruct timer_data;
+  const int slot = systemTimers.acquire(systemTimerId);
+  if (slot < 0) {
+    if (loglevelActiveFor(LOG_LEVEL_ERROR)) {
+      String log = F("Scheduler: System timer pool full, timer of plugin ");
+      log += plugin;
+      log += F(" task ");
+      log += taskIndex + 1;
+      log += F(" not set");
+      addLog(LOG_LEVEL_ERROR, log);
+    }
+    return false;
+  }
+  systemTimerStruct& timer_data = systemTimers.slots[slot];
+  timer_data.plugin = plugin;
   timer_data.TaskIndex = taskIndex;
   timer_data.Par1 = Par1;
   timer_data.Par2 = Par2;
   timer_data.Par3 = Par3;
   timer_data.Par4 = Par4;
   timer_data.Par5 = Par5;
-  systemTimers[systemTimerId] = timer_data;
-  setTimer(SYSTEM_TIMER, systemTimerId, timer);
+  if (!setTimer(SYSTEM_TIMER, slot, timer)) {
+    // Scheduler full, already logged by setNewTimerAt()
+    systemTimers.release(slot);
+    return false;
+  }
+  timer_data.timer = millis() + timer;
+  return true;
+}
+
+bool clearSystemTimer(byte plugin, int Par1)
+{
+  const int slot = systemTimers.find(createSystemTimerId(plugin, Par1));
+  if (slot < 0) return false;
+  msecTimerHandler.remove(getMixedId(SYSTEM_TIMER, slot));
+  systemTimers.release(slot);
+  return true;
+}
+
+String getSystemTimerPoolStats() {
+  String result;
+  result += systemTimers.inUse;
+  result += '/';
+  result += systemTimers.highWater;
+  result += '/';
+  result += SYSTEM_TIMER_POOL_SIZE;
+  result += '/';
+  result += systemTimers.overflowCount;
+  return result;
 }
 
-void setNewTimerAt(unsigned long id, unsigned long timer) {
+// Dropped timers are logged at most once per TIMER_DROPPED_LOG_INTERVAL msec.
+#define TIMER_DROPPED_LOG_INTERVAL  10000
+unsigned long lastTimerDroppedLog = 0;
+bool timerDroppedLogged = false;
+
+// Returns false when the scheduler is full, the timer is then not set.
+bool setNewTimerAt(unsigned long id, unsigned long timer) {
   START_TIMER;
-  msecTimerHandler.registerAt(id, timer);
+  const bool set = msecTimerHandler.registerAt(id, timer);
   STOP_TIMER(SET_NEW_TIMER);
+  if (!set && (!timerDroppedLogged || timePassedSince(lastTimerDroppedLog) >= TIMER_DROPPED_LOG_INTERVAL)) {
+    timerDroppedLogged = true;
+    lastTimerDroppedLog = millis();
+    if (loglevelActiveFor(LOG_LEVEL_ERROR)) {
+      String log = F("Scheduler: Full, timer type ");
+      log += (id >> TIMER_ID_SHIFT);
+      log += F(" id ");
+      log += (id & ((1UL << TIMER_ID_SHIFT) - 1));
+      log += F(" not set (");
+      log += msecTimerHandler.getDroppedCount();
+      log += F(" dropped)");
+      addLog(LOG_LEVEL_ERROR, log);
+    }
+  }
+  return set;
 }
 
 unsigned long createSystemTimerId(byte plugin, int Par1) {
-  const unsigned long mask = (1 << TIMER_ID_SHIFT) -1;
+  const unsigned long mask = (1UL << TIMER_ID_SHIFT) -1;
   const unsigned long mixed = (Par1 << 8) + plugin;
   return (mixed & mask);
 }
 
 /* // Not (yet) used
 void splitSystemTimerId(const unsigned long mixed_id, byte& plugin, int& Par1) {
-  const unsigned long mask = (1 << TIMER_ID_SHIFT) -1;
+  const unsigned long mask = (1UL << TIMER_ID_SHIFT) -1;
   plugin = mixed_id & 0xFF;
   Par1 = (mixed_id & mask) >> 8;
 }
@@ -78,13 +199,60 @@ unsigned long getMixedId(unsigned long timerType, unsigned long id) {
   return (timerType << TIMER_ID_SHIFT) + id;
 }
 
+#ifdef FEATURE_SCHEDULER_PROBE
+// Probes: a timer of each type with the highest id, counted by the type it is
+// dispatched as instead of calling its handler (schedulerprobe command).
+// Only in the test builds, see platformio.ini.
+#define SCHEDULER_PROBE_ID   ((1UL << TIMER_ID_SHIFT) - 1)
+static_assert(UDP_GROUP_TIMER < 32, "One bit per timer type in the probe masks");
+
+uint32_t schedulerProbesArmed = 0;  // Bit per timer type
+uint32_t schedulerProbesFired = 0;
+
+// Arm a probe of each type, or only of onlyType when not 0.
+void armSchedulerProbes(unsigned long onlyType) {
+  schedulerProbesArmed = 0;
+  schedulerProbesFired = 0;
+  for (unsigned long timerType = CONST_INTERVAL_TIMER; timerType <= UDP_GROUP_TIMER; ++timerType) {
+    if (onlyType != 0 && timerType != onlyType) continue;
+    setTimer(timerType, SCHEDULER_PROBE_ID, 0);
+    schedulerProbesArmed |= 1UL << timerType;
+  }
+}
+
+// Like {"armed":1048574,"fired":1048574}, the bits of the timer types
+String getSchedulerProbeResult() {
+  String result = F("{\"armed\":");
+  result += schedulerProbesArmed;
+  result += F(",\"fired\":");
+  result += schedulerProbesFired;
+  result += '}';
+  return result;
+}
+#endif // FEATURE_SCHEDULER_PROBE
+
+void handle_schedule() HOT_IRAM_ATTR;
+
 void handle_schedule() {
   unsigned long timer;
+  // Edge triggered events first, they should not wait for the next poll.
+  processInterruptEvents();
+  processRulesQueueBudget();
   const unsigned long mixed_id = msecTimerHandler.getNextId(timer);
   if (mixed_id == 0) return;
   const unsigned long timerType = (mixed_id >> TIMER_ID_SHIFT);
-  const unsigned long mask = (1 << TIMER_ID_SHIFT) -1;
+  const unsigned long mask = (1UL << TIMER_ID_SHIFT) -1;
   const unsigned long id = mixed_id & mask;
+#ifdef FEATURE_SCHEDULER_PROBE
+  if (id == SCHEDULER_PROBE_ID) {
+    if (timerType < 32) schedulerProbesFired |= 1UL << timerType;
+    return;
+  }
+#endif
+  dispatchTimerType = timerType;
+  dispatchTimerId = id;
+  stallReportedInTimer = false;
+  DISPATCH_START;
 
   switch (timerType) {
     case CONST_INTERVAL_TIMER:
@@ -97,13 +265,102 @@ void handle_schedule() {
     case TASK_DEVICE_TIMER:
       process_task_device_timer(id, timer);
       break;
+    case CONTROLLER_QUEUE_TIMER:
+      process_controller_queue(id);
+      break;
+    case MQTT_BATCH_TIMER:
+      process_mqtt_batch(id);
+      break;
+    case CONTROLLER_TIMER:
+      process_controller_timer(id);
+      break;
+    case NTP_TIMER:
+      process_ntp_timer();
+      break;
+    case NODE_ANNOUNCE_TIMER:
+      process_node_announce();
+      break;
+    case HOST_CHECK_TIMER:
+      process_host_check();
+      break;
+    case OUTPUT_SEQUENCER_TIMER:
+      processOutputSequencer(id);
+      break;
+    case RULES_TIMER:
+      process_rules_timer(id);
+      break;
+    case CLOCK_TIMER:
+      process_clock_timer();
+      break;
+    case NODE_SNAPSHOT_TIMER:
+      process_node_snapshot(id);
+      break;
+    case TASK_INIT_TIMER:
+      process_task_init(id);
+      break;
+    case NOTIFICATION_TIMER:
+      process_notification_timer(id);
+      break;
+    case SLEEP_SAMPLES_TIMER:
+      process_sleep_samples_timer();
+      break;
+    case RADIO_TIMER:
+      scheduledRadioWake();
+      break;
+    case UDP_GROUP_TIMER:
+      process_udp_group_timer(id);
+      break;
   }
+  DISPATCH_DONE(DISPATCH_SCHEDULER, timerType, id);
+  dispatchTimerType = 0;
+}
+
+// Like "Task timer 3"
+String getSchedulerTimerName(unsigned long timerType, unsigned long id) {
+  String name;
+  switch (timerType) {
+    case CONST_INTERVAL_TIMER:   name = F("Interval timer "); break;
+    case SYSTEM_TIMER:           name = F("System timer "); break;
+    case TASK_DEVICE_TIMER:      name = F("Task timer "); break;
+    case CONTROLLER_QUEUE_TIMER: name = F("Controller queue "); break;
+    case MQTT_BATCH_TIMER:       name = F("MQTT batch "); break;
+    case CONTROLLER_TIMER:       name = F("Controller timer "); break;
+    case NTP_TIMER:              name = F("NTP reply "); break;
+    case NODE_ANNOUNCE_TIMER:    name = F("Node announce "); break;
+    case HOST_CHECK_TIMER:       name = F("Host check "); break;
+    case OUTPUT_SEQUENCER_TIMER: name = F("Output sequencer "); break;
+    case RULES_TIMER:            name = F("Rules timer "); break;
+    case CLOCK_TIMER:            name = F("Clock "); break;
+    case NODE_SNAPSHOT_TIMER:    name = F("Node snapshot "); break;
+    case TASK_INIT_TIMER:        name = F("Task init "); break;
+    case NOTIFICATION_TIMER:     name = F("Notification "); break;
+    case SLEEP_SAMPLES_TIMER:    name = F("Sleep samples "); break;
+    case RADIO_TIMER:            name = F("Radio "); break;
+    case UDP_GROUP_TIMER:        name = F("UDP group command "); break;
+    default:                     name = F("Timer "); break;
+  }
+  name += id;
+  return name;
+}
+
+// Keep the time critical plugin calls running while blocked, e.g. waiting for
+// the web server to send a chunk. All other timers wait for the main loop, so
+// this is safe to call from within page handlers.
+void handle_schedule_while_waiting() {
+  if (timePassedSince(lastRun50TimesPerSecond) < 20) return;
+  const byte loadedTaskIndex = ExtraTaskSettings.TaskIndex;
+  run50TimesPerSecond();
+  // The caller may still use the task settings it loaded.
+  if (loadedTaskIndex < TASKS_MAX)
+    LoadTaskSettings(loadedTaskIndex);
 }
 
 void process_interval_timer(unsigned long id) {
   switch (id) {
     case TIMER_20MSEC:
-      run50TimesPerSecond();
+      // May already have run while waiting in handle_schedule_while_waiting()
+      if (timePassedSince(lastRun50TimesPerSecond) >= 10)
+        run50TimesPerSecond();
       break;
     case TIMER_100MSEC:
       if(!UseRTOSMultitasking)
@@ -125,9 +382,13 @@ void process_interval_timer(unsigned long id) {
 }
 
 void process_system_timer(unsigned long id) {
+  if (!systemTimers.isUsed(id)) return;
   START_TIMER;
-  const systemTimerStruct timer_data = systemTimers[id];
-  struct EventStruct TempEvent;
+  const systemTimerStruct timer_data = systemTimers.slots[id];
+  // Release the slot before calling the plugin, so it may set the timer again.
+  systemTimers.release(id);
+  PooledEvent pooled;
+  struct EventStruct& TempEvent = *pooled.event;
   TempEvent.TaskIndex = timer_data.TaskIndex;
   TempEvent.Par1 = timer_data.Par1;
   TempEvent.Par2 = timer_data.Par2;
@@ -136,6 +397,10 @@ void process_system_timer(unsigned long id) {
   TempEvent.Par5 = timer_data.Par5;
   // TD-er: Not sure if we have to keep original source for notifications.
   TempEvent.Source = VALUE_SOURCE_SYSTEM;
+  if (timer_data.TaskIndex >= 0 && timer_data.TaskIndex < TASKS_MAX) {
+    TempEvent.BaseVarIndex = timer_data.TaskIndex * VARS_PER_TASK;
+    TempEvent.sensorType = Device[getDeviceIndex_from_TaskIndex(timer_data.TaskIndex)].VType;
+  }
   const int y = getPluginId(timer_data.TaskIndex);
 /*
   String log = F("proc_system_timer: Pluginid: ");
@@ -148,12 +413,99 @@ void process_system_timer(unsigned long id) {
 */
   if (y >= 0) {
     String dummy;
-    Plugin_ptr[y](PLUGIN_TIMER_IN, &TempEvent, dummy);
+    I2C_setTaskClock(TempEvent.TaskIndex);
+    getPluginFunction(y)(PLUGIN_TIMER_IN, &TempEvent, dummy);
+    I2C_clearTaskClock();
   }
-  systemTimers.erase(id);
   STOP_TIMER(PROC_SYS_TIMER);
 }
 
+/*********************************************************************************************\
+ * Controller timers, calls CPLUGIN_TIMER_IN of the controller plugin.
+\*********************************************************************************************/
+void setControllerTimer(byte controllerIndex, unsigned long msecFromNow) {
+  setTimer(CONTROLLER_TIMER, controllerIndex, msecFromNow);
+}
+
+void process_controller_timer(unsigned long controllerIndex) {
+  if (controllerIndex >= CONTROLLER_MAX) return;
+  if (!Settings.ControllerEnabled[controllerIndex] || !Settings.Protocol[controllerIndex]) return;
+  struct EventStruct TempEvent;
+  TempEvent.ControllerIndex = controllerIndex;
+  TempEvent.ProtocolIndex = getProtocolIndex_from_ControllerIndex(controllerIndex);
+  CPluginSendCall(CPLUGIN_TIMER_IN, &TempEvent);
+}
+
+/*********************************************************************************************\
+ * Task phases
+ * Each periodic task gets a fixed offset within its read interval, so tasks with the same
+ * interval do not all read in the same loop. After the first read at boot the task timer
+ * runs at the times where millis() modulo the interval equals the phase.
+ * The planner places the tasks in index order, each at the step of the interval farthest
+ * from the tasks placed before. Tasks on the same bus (I2C, or the same first GPIO as for
+ * 1-Wire and serial sensors) count at half the distance, so these are spread most.
+ * The phases only depend on the settings, so they are the same after a reboot.
+ * Triggered tasks (see TaskTrigger.ino) and deep sleep keep the plain interval.
+\*********************************************************************************************/
+#define TASK_PHASE_STEPS  32
+
+long taskPhase[TASKS_MAX];  // msec, -1 when not planned
+
+// -1 no bus, 0 the I2C bus, otherwise the first GPIO plus 1.
+int taskPhaseBus(byte TaskIndex) {
+  if (Settings.TaskDeviceDataFeed[TaskIndex] != 0) return -1;
+  const byte DeviceIndex = getDeviceIndex_from_TaskIndex(TaskIndex);
+  if (Device[DeviceIndex].Type == DEVICE_TYPE_I2C) return 0;
+  if (Settings.TaskDevicePin1[TaskIndex] >= 0) return Settings.TaskDevicePin1[TaskIndex] + 1;
+  return -1;
+}
+
+// Distance of two phases, when one interval is a multiple of the other. -1 when they do not line up.
+long taskPhaseDistance(long phase1, unsigned long interval1, long phase2, unsigned long interval2) {
+  const unsigned long period = interval1 < interval2 ? interval1 : interval2;
+  const unsigned long longest = interval1 < interval2 ? interval2 : interval1;
+  if (period == 0 || longest % period != 0) return -1;
+  const long diff = labs(phase1 - phase2) % period;
+  return diff < static_cast<long>(period) - diff ? diff : period - diff;
+}
+
+void planTaskPhases() {
+  for (byte x = 0; x < TASKS_MAX; x++) {
+    taskPhase[x] = -1;
+    const unsigned long interval = taskReadInterval(x);
+    if (Settings.TaskDeviceNumber[x] == 0 || interval == 0 || Settings.TaskDeviceTriggerMask[x] != 0)
+      continue;
+    const int bus = taskPhaseBus(x);
+    long bestPhase = 0;
+    long bestScore = -1;
+    for (byte step = 0; step < TASK_PHASE_STEPS; step++) {
+      const long phase = interval * step / TASK_PHASE_STEPS;
+      long score = LONG_MAX;
+      for (byte y = 0; y < x; y++) {
+        if (taskPhase[y] < 0) continue;
+        long distance = taskPhaseDistance(phase, interval, taskPhase[y], taskReadInterval(y));
+        if (distance < 0) continue;
+        if (bus < 0 || taskPhaseBus(y) != bus) distance *= 2;
+        if (distance < score) score = distance;
+      }
+      if (score > bestScore) {
+        bestScore = score;
+        bestPhase = phase;
+      }
+    }
+    taskPhase[x] = bestPhase;
+  }
+}
+
+// Next run of the task timer after the run at lasttimer, at least half an interval later.
+unsigned long nextTaskPhaseTimer(unsigned long task_index, unsigned long lasttimer, unsigned long interval) {
+  if (task_index >= TASKS_MAX || taskPhase[task_index] < 0 || isDeepSleepEnabled())
+    return lasttimer + interval;
+  const unsigned long earliest = lasttimer + interval / 2;
+  const unsigned long offset = (earliest - taskPhase[task_index]) % interval;
+  return offset == 0 ? earliest : earliest + interval - offset;
+}
+
 void schedule_task_device_timer_at_init(unsigned long task_index) {
   unsigned long runAt = millis();
   if (!isDeepSleepEnabled()) {
@@ -183,12 +535,90 @@ void schedule_task_device_timer(unsigned long task_index, unsigned long runAt) {
 }
 
 void process_task_device_timer(unsigned long task_index, unsigned long lasttimer) {
-  unsigned long newtimer = Settings.TaskDeviceTimer[task_index];
+  if (isTaskGroupFollower(task_index)) {
+    taskTriggerDone(task_index);
+    return;  // Read by the first task of its group, see TaskGroup.ino
+  }
+  // The sample interval when the task aggregates its reads, see SensorAggregate.ino
+  unsigned long newtimer = taskReadInterval(task_index);
   if (newtimer != 0) {
-    newtimer = lasttimer + (newtimer * 1000);
+    newtimer = nextTaskPhaseTimer(task_index, lasttimer, newtimer);
     schedule_task_device_timer(task_index, newtimer);
   }
   START_TIMER;
-  SensorSendTask(task_index);
+  if (isTaskGroupLeader(task_index))
+    runTaskGroup(task_index);
+  else
+    SensorSendTask(task_index);
   STOP_TIMER(SENSOR_SEND_TASK);
 }
+
+/*********************************************************************************************\
+ * Interrupt events
+\*********************************************************************************************/
+// Only call from an interrupt handler. Returns false when the queue is full.
+bool pushInterruptEvent(byte TaskIndex, byte type, uint32_t value) {
+  InterruptEventQueueStruct& queue = interruptEventQueue;
+  const uint16_t head = queue.head;
+  if (static_cast<uint16_t>(head - queue.tail) >= INTERRUPT_EVENT_QUEUE_SIZE) {
+    ++queue.dropped;
+    return false;
+  }
+  InterruptEventStruct& item = queue.events[head & INTERRUPT_EVENT_QUEUE_MASK];
+  item.timestamp = micros();
+  item.value = value;
+  item.TaskIndex = TaskIndex;
+  item.type = type;
+  __sync_synchronize();  // Event complete before it is published
+  queue.head = head + 1;
+  #ifdef USE_RTOS_MULTITASKING
+  // Wake the loop task from its idle sleep.
+  if (rtosTaskStats[RTOS_TASK_LOOP].handle != NULL) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(rtosTaskStats[RTOS_TASK_LOOP].handle, &woken);
+    if (woken) portYIELD_FROM_ISR();
+  }
+  #endif
+  return true;
+}
+
+bool interruptEventPending() {
+  return interruptEventQueue.head != interruptEventQueue.tail;
+}
+
+// Send the queued events to their task, called from handle_schedule() and backgroundtasks().
+void processInterruptEvents() {
+  InterruptEventQueueStruct& queue = interruptEventQueue;
+  for (byte count = 0; count < INTERRUPT_EVENT_BURST && queue.tail != queue.head; ++count) {
+    const uint16_t used = queue.head - queue.tail;
+    if (used > queue.maxUsed) queue.maxUsed = used;
+    __sync_synchronize();
+    const InterruptEventStruct item = queue.events[queue.tail & INTERRUPT_EVENT_QUEUE_MASK];
+    __sync_synchronize();  // Copied before the slot is released
+    ++queue.tail;
+    ++queue.processed;
+    const unsigned long latency = usecPassedSince(item.timestamp);
+    if (latency > queue.maxLatency) queue.maxLatency = latency;
+    if (item.TaskIndex >= TASKS_MAX || !Settings.TaskDeviceEnabled[item.TaskIndex]) continue;
+    struct EventStruct TempEvent;
+    TempEvent.TaskIndex = item.TaskIndex;
+    TempEvent.Par1 = item.type;
+    TempEvent.Par2 = item.value;
+    TempEvent.Data = (byte*)&item;
+    START_TIMER;
+    PluginCall(PLUGIN_INTERRUPT_EVENT, &TempEvent, dummyString);
+    STOP_TIMER(PLUGIN_CALL_INTERRUPT);
+  }
+}
+
+String getInterruptEventStats() {
+  String result;
+  result += interruptEventQueue.processed;
+  result += '/';
+  result += interruptEventQueue.dropped;
+  result += '/';
+  result += interruptEventQueue.maxUsed;
+  result += '/';
+  result += interruptEventQueue.maxLatency;
+  return result;
+}
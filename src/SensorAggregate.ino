@@ -0,0 +1,151 @@
+//********************************************************************************
+// Sampling faster than the task interval
+// With a sample interval set (Settings.TaskDeviceSampleInterval, msec) the task
+// timer reads the plugin at that rate, see process_task_device_timer(). The
+// values of each read (after the formulas) are added to running statistics by
+// taskAggregateDue(), which returns false until the task interval has passed.
+// Then UserVar gets the aggregate chosen per value (ExtraTaskSettings
+// TaskDeviceAggregation: mean, minimum, maximum, last, sum or standard
+// deviation) and the values are sent once, like a plain read.
+// The mean and deviation are updated per sample (Welford), nothing is stored.
+//********************************************************************************
+#define TASK_AGGREGATE_MEAN      0
+#define TASK_AGGREGATE_MIN       1
+#define TASK_AGGREGATE_MAX       2
+#define TASK_AGGREGATE_LAST      3
+#define TASK_AGGREGATE_SUM       4
+#define TASK_AGGREGATE_STDDEV    5
+#define TASK_AGGREGATE_NR_TYPES  6
+
+struct SensorAggregateValueStruct
+{
+  float mean;
+  float m2;      // Sum of the squared differences from the mean
+  float min;
+  float max;
+  float last;
+};
+
+struct SensorAggregateStruct
+{
+  SensorAggregateStruct() : values(NULL), windowStart(0), count(0) {}
+
+  SensorAggregateValueStruct* values;  // VARS_PER_TASK, allocated while the task samples
+  unsigned long windowStart;
+  unsigned int count;
+} sensorAggregate[TASKS_MAX];
+
+struct SensorAggregateStatsStruct
+{
+  SensorAggregateStatsStruct() : samples(0), sent(0) {}
+
+  unsigned long samples;
+  unsigned long sent;
+} sensorAggregateStats;
+
+// Whether the task reads faster than it sends.
+bool taskSampling(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return false;
+  const unsigned long sampleInterval = Settings.TaskDeviceSampleInterval[TaskIndex];
+  return sampleInterval != 0 && sampleInterval < Settings.TaskDeviceTimer[TaskIndex] * 1000UL;
+}
+
+// msec between the runs of the task timer, 0 when the task has no interval.
+unsigned long taskReadInterval(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return 0;
+  if (taskSampling(TaskIndex)) return Settings.TaskDeviceSampleInterval[TaskIndex];
+  return Settings.TaskDeviceTimer[TaskIndex] * 1000UL;
+}
+
+String getTaskAggregateName(byte type) {
+  switch (type) {
+    case TASK_AGGREGATE_MEAN:   return F("Mean");
+    case TASK_AGGREGATE_MIN:    return F("Min");
+    case TASK_AGGREGATE_MAX:    return F("Max");
+    case TASK_AGGREGATE_LAST:   return F("Last");
+    case TASK_AGGREGATE_SUM:    return F("Sum");
+    case TASK_AGGREGATE_STDDEV: return F("Std. deviation");
+  }
+  return F("Mean");
+}
+
+// Drop the samples of the current window, e.g. when the task settings were changed.
+void taskAggregateReset(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return;
+  SensorAggregateStruct& aggregate = sensorAggregate[TaskIndex];
+  if (aggregate.values != NULL && !taskSampling(TaskIndex)) {
+    delete[] aggregate.values;
+    aggregate.values = NULL;
+  }
+  aggregate.count = 0;
+}
+
+// Called with the values of a read in UserVar and ExtraTaskSettings loaded.
+// Returns true when UserVar holds values to send: the read itself, or the aggregates of the interval.
+bool taskAggregateDue(struct EventStruct *event) {
+  const byte TaskIndex = event->TaskIndex;
+  if (!taskSampling(TaskIndex)) return true;
+  SensorAggregateStruct& aggregate = sensorAggregate[TaskIndex];
+  if (aggregate.values == NULL) {
+    aggregate.values = new SensorAggregateValueStruct[VARS_PER_TASK];
+    aggregate.count = 0;
+  }
+  if (aggregate.count == 0) aggregate.windowStart = millis();
+  ++aggregate.count;
+  ++sensorAggregateStats.samples;
+  for (byte varNr = 0; varNr < VARS_PER_TASK; varNr++) {
+    SensorAggregateValueStruct& value = aggregate.values[varNr];
+    const float sample = UserVar[event->BaseVarIndex + varNr];
+    if (aggregate.count == 1) {
+      value.mean = sample;
+      value.m2 = 0;
+      value.min = sample;
+      value.max = sample;
+    } else {
+      const float delta = sample - value.mean;
+      value.mean += delta / aggregate.count;
+      value.m2 += delta * (sample - value.mean);
+      if (sample < value.min) value.min = sample;
+      if (sample > value.max) value.max = sample;
+    }
+    value.last = sample;
+  }
+
+  // The window ends with the sample closest to the task interval
+  const unsigned long interval = Settings.TaskDeviceTimer[TaskIndex] * 1000UL;
+  const unsigned long elapsed = timePassedSince(aggregate.windowStart) + Settings.TaskDeviceSampleInterval[TaskIndex];
+  if (elapsed + Settings.TaskDeviceSampleInterval[TaskIndex] / 2 < interval) return false;
+
+  for (byte varNr = 0; varNr < VARS_PER_TASK; varNr++) {
+    const SensorAggregateValueStruct& value = aggregate.values[varNr];
+    float result = value.mean;
+    switch (ExtraTaskSettings.TaskDeviceAggregation[varNr]) {
+      case TASK_AGGREGATE_MIN:    result = value.min; break;
+      case TASK_AGGREGATE_MAX:    result = value.max; break;
+      case TASK_AGGREGATE_LAST:   result = value.last; break;
+      case TASK_AGGREGATE_SUM:    result = value.mean * aggregate.count; break;
+      case TASK_AGGREGATE_STDDEV: result = aggregate.count > 1 ? sqrt(value.m2 / (aggregate.count - 1)) : 0; break;
+    }
+    UserVar[event->BaseVarIndex + varNr] = result;
+  }
+  if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+    String log = F("Sensor: Task ");
+    log += TaskIndex + 1;
+    log += F(" aggregated ");
+    log += aggregate.count;
+    log += F(" samples");
+    addLog(LOG_LEVEL_DEBUG, log);
+  }
+  aggregate.count = 0;
+  ++sensorAggregateStats.sent;
+  return true;
+}
+
+// Aggregate stats as: samples/sent
+String getTaskAggregateStats() {
+  String result;
+  result += sensorAggregateStats.samples;
+  result += '/';
+  result += sensorAggregateStats.sent;
+  return result;
+}
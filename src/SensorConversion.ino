@@ -0,0 +1,120 @@
+//********************************************************************************
+// Two phase sensor reads
+// A plugin which has to wait for a conversion of the sensor does not delay() in
+// PLUGIN_READ, but starts the conversion, calls startTaskConversion() and returns
+// false. After the wait the plugin gets PLUGIN_TIMER_IN, for which
+// isTaskConversionTimer() returns true. It then collects the values in UserVar
+// and calls completeTaskConversion(), which applies the formulas and sends the
+// values like SensorSendTask() does for a plain read. To wait again (e.g. for a
+// second conversion or to poll a ready flag) call startTaskConversion() again
+// from PLUGIN_TIMER_IN, with the next step.
+//********************************************************************************
+#define TASK_CONVERSION_TIMER_PAR1   0x7F00   // System timer key, plus TaskIndex. Above the GPIO and plugin keys.
+#define TASK_CONVERSION_TIMEOUT      5000     // msec, a conversion not completed by then is dropped
+
+struct TaskConversionStruct
+{
+  TaskConversionStruct() : started(0), pending(false) {}
+
+  float preValue[VARS_PER_TASK];  // Values before the read, for the formulas
+  unsigned long started;
+  bool pending;
+} taskConversion[TASKS_MAX];
+
+struct TaskConversionStatsStruct
+{
+  TaskConversionStatsStruct() : started(0), completed(0), failed(0), overlaps(0), timeouts(0), waitMsec(0) {}
+
+  unsigned long started;
+  unsigned long completed;
+  unsigned long failed;
+  unsigned long overlaps;   // Reads skipped while the previous conversion was still running
+  unsigned long timeouts;
+  unsigned long waitMsec;   // Total wait time spent in the scheduler instead of a delay()
+} taskConversionStats;
+
+// Wait waitMsec before the plugin gets PLUGIN_TIMER_IN with event->Par2 = step.
+void startTaskConversion(struct EventStruct *event, byte pluginId, unsigned long waitMsec, int step) {
+  const byte TaskIndex = event->TaskIndex;
+  if (TaskIndex >= TASKS_MAX) return;
+  TaskConversionStruct& conversion = taskConversion[TaskIndex];
+  if (!conversion.pending) {
+    const byte varIndex = TaskIndex * VARS_PER_TASK;
+    for (byte varNr = 0; varNr < VARS_PER_TASK; varNr++)
+      conversion.preValue[varNr] = UserVar[varIndex + varNr];
+    conversion.started = millis();
+    conversion.pending = true;
+    ++taskConversionStats.started;
+  }
+  taskConversionStats.waitMsec += waitMsec;
+  if (!setSystemTimer(waitMsec, pluginId, TaskIndex, TASK_CONVERSION_TIMER_PAR1 + TaskIndex, step, 0, 0, 0)) {
+    // No PLUGIN_TIMER_IN will follow, do not wait for the timeout.
+    completeTaskConversion(event, false);
+  }
+}
+
+bool isTaskConversionTimer(struct EventStruct *event) {
+  if (event->TaskIndex >= TASKS_MAX) return false;
+  return taskConversion[event->TaskIndex].pending &&
+         event->Par1 == (TASK_CONVERSION_TIMER_PAR1 + event->TaskIndex);
+}
+
+// Time since the conversion was started, to limit polling.
+unsigned long taskConversionDuration(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX || !taskConversion[TaskIndex].pending) return 0;
+  return timePassedSince(taskConversion[TaskIndex].started);
+}
+
+// Send the values collected in UserVar, or only end the conversion when the read failed.
+void completeTaskConversion(struct EventStruct *event, bool success) {
+  const byte TaskIndex = event->TaskIndex;
+  if (TaskIndex >= TASKS_MAX || !taskConversion[TaskIndex].pending) return;
+  taskConversion[TaskIndex].pending = false;
+  if (!success || !Settings.TaskDeviceEnabled[TaskIndex]) {
+    ++taskConversionStats.failed;
+    taskGroupDone(TaskIndex, false);
+    return;
+  }
+  ++taskConversionStats.completed;
+  LoadTaskSettings(TaskIndex);
+  event->BaseVarIndex = TaskIndex * VARS_PER_TASK;
+  SensorSendTaskValues(event, taskConversion[TaskIndex].preValue);
+}
+
+// Called before PLUGIN_READ. Returns true while the previous conversion still runs.
+bool taskConversionPending(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return false;
+  TaskConversionStruct& conversion = taskConversion[TaskIndex];
+  if (!conversion.pending) return false;
+  if (timePassedSince(conversion.started) < TASK_CONVERSION_TIMEOUT) {
+    ++taskConversionStats.overlaps;
+    return true;
+  }
+  conversion.pending = false;
+  ++taskConversionStats.timeouts;
+  taskGroupDone(TaskIndex, false);
+  if (loglevelActiveFor(LOG_LEVEL_ERROR)) {
+    String log = F("Sensor: Conversion timeout for task ");
+    log += TaskIndex + 1;
+    addLog(LOG_LEVEL_ERROR, log);
+  }
+  return false;
+}
+
+// Conversion stats as: started/completed/failed/overlaps/timeouts, wait time not blocked
+String getTaskConversionStats() {
+  String result;
+  result += taskConversionStats.started;
+  result += '/';
+  result += taskConversionStats.completed;
+  result += '/';
+  result += taskConversionStats.failed;
+  result += '/';
+  result += taskConversionStats.overlaps;
+  result += '/';
+  result += taskConversionStats.timeouts;
+  result += F(", ");
+  result += taskConversionStats.waitMsec;
+  result += F(" ms not blocked");
+  return result;
+}
@@ -0,0 +1,170 @@
+//********************************************************************************
+// Duty cycle of streaming sensors
+// Particle sensors (SDS011, PMSx003) send a frame every second while their fan
+// runs. With a long task interval the sensor is put to sleep between the reads:
+//   - a system timer wakes it the warm-up time plus the burst before the next
+//     run of the task timer. The plugin gets PLUGIN_TIMER_IN, for which
+//     dutyCycleWakeTimer() returns true, and sends the wake command,
+//   - the frames of the warm-up are ignored, the next DUTY_CYCLE_SAMPLES are
+//     averaged by dutyCycleSample(), which returns true when the burst is
+//     complete and the plugin puts the sensor to sleep again,
+//   - PLUGIN_READ takes the average with dutyCycleRead(), which sets the wake
+//     timer for the next interval. When the task timer runs before the burst
+//     is complete, the read is done at the end of the burst with
+//     schedule_task_device_timer(), so the next reads follow it.
+// While the sensor sleeps the plugin does not need to read the serial port.
+// With a task interval too short for a sleep the sensor runs continuously and
+// dutyCycleRead() returns the average of the frames since the previous read.
+//********************************************************************************
+#define DUTY_CYCLE_TIMER_PAR1      0x7E00   // System timer key, plus TaskIndex. Below the conversion keys.
+#define DUTY_CYCLE_SAMPLES         5        // Frames averaged per read
+#define DUTY_CYCLE_MIN_SLEEP       10000    // msec, a shorter sleep is not worth the warm-up
+#define DUTY_CYCLE_MARGIN          2000     // msec, the burst ends this long before the read
+#define DUTY_CYCLE_VALUES          3
+
+enum {
+  DUTY_CYCLE_OFF,          // Not used by the task
+  DUTY_CYCLE_CONTINUOUS,   // Interval too short, never sleeps
+  DUTY_CYCLE_SLEEP,
+  DUTY_CYCLE_WARMUP,
+  DUTY_CYCLE_BURST,
+  DUTY_CYCLE_DONE          // Burst averaged, sleeping until the read
+};
+
+struct SensorDutyCycleStruct
+{
+  SensorDutyCycleStruct() : state(DUTY_CYCLE_OFF), readPending(false), wakeTimerMissing(false), pluginId(0), count(0),
+    warmup(0), stateStart(0), burstMsec(0) {}
+
+  byte state;
+  bool readPending;        // The task timer ran during the warm-up or burst
+  bool wakeTimerMissing;   // Sleeping without a wake timer, the system timer pool was full
+  byte pluginId;
+  byte count;
+  unsigned long warmup;    // msec
+  unsigned long stateStart;
+  unsigned long burstMsec; // Duration of the last burst
+  float sum[DUTY_CYCLE_VALUES];
+} sensorDutyCycle[TASKS_MAX];
+
+// Start with the sensor awake, in the warm-up. A warm-up of 0 keeps it running continuously.
+void dutyCycleBegin(struct EventStruct *event, byte pluginId, unsigned long warmupMsec) {
+  const byte TaskIndex = event->TaskIndex;
+  if (TaskIndex >= TASKS_MAX) return;
+  SensorDutyCycleStruct& cycle = sensorDutyCycle[TaskIndex];
+  clearSystemTimer(cycle.pluginId, DUTY_CYCLE_TIMER_PAR1 + TaskIndex);
+  cycle = SensorDutyCycleStruct();
+  cycle.pluginId = pluginId;
+  cycle.warmup = warmupMsec;
+  cycle.burstMsec = DUTY_CYCLE_SAMPLES * 1000;
+  const unsigned long interval = Settings.TaskDeviceTimer[TaskIndex] * 1000;
+  if (warmupMsec == 0 || interval < warmupMsec + cycle.burstMsec + DUTY_CYCLE_MARGIN + DUTY_CYCLE_MIN_SLEEP) {
+    cycle.state = DUTY_CYCLE_CONTINUOUS;
+  } else {
+    cycle.state = DUTY_CYCLE_WARMUP;
+    cycle.stateStart = millis();
+  }
+}
+
+void dutyCycleEnd(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return;
+  clearSystemTimer(sensorDutyCycle[TaskIndex].pluginId, DUTY_CYCLE_TIMER_PAR1 + TaskIndex);
+  sensorDutyCycle[TaskIndex] = SensorDutyCycleStruct();
+}
+
+// True while the sensor sleeps, its frames need not be read.
+bool dutyCycleAsleep(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return false;
+  const byte state = sensorDutyCycle[TaskIndex].state;
+  return state == DUTY_CYCLE_SLEEP || state == DUTY_CYCLE_DONE;
+}
+
+// A frame of the sensor. Returns true when it completed the burst, the sensor can be put to sleep.
+bool dutyCycleSample(struct EventStruct *event, const float* values, byte valueCount) {
+  const byte TaskIndex = event->TaskIndex;
+  if (TaskIndex >= TASKS_MAX) return false;
+  SensorDutyCycleStruct& cycle = sensorDutyCycle[TaskIndex];
+  if (cycle.state == DUTY_CYCLE_WARMUP) {
+    if (timePassedSince(cycle.stateStart) < (long)cycle.warmup) return false;
+    cycle.state = DUTY_CYCLE_BURST;
+    cycle.stateStart = millis();
+    cycle.count = 0;
+  }
+  if (cycle.state != DUTY_CYCLE_BURST && cycle.state != DUTY_CYCLE_CONTINUOUS) return false;
+  if (cycle.count == 0)
+    for (byte i = 0; i < DUTY_CYCLE_VALUES; ++i) cycle.sum[i] = 0;
+  for (byte i = 0; i < valueCount && i < DUTY_CYCLE_VALUES; ++i) cycle.sum[i] += values[i];
+  if (cycle.count < 255) ++cycle.count;
+  if (cycle.state == DUTY_CYCLE_CONTINUOUS || cycle.count < DUTY_CYCLE_SAMPLES) return false;
+
+  cycle.burstMsec = timePassedSince(cycle.stateStart);
+  cycle.state = DUTY_CYCLE_DONE;
+  if (cycle.readPending) {
+    cycle.readPending = false;
+    schedule_task_device_timer(TaskIndex, millis());
+  }
+  return true;
+}
+
+// PLUGIN_READ: the average of the burst in UserVar. When the burst is not complete the
+// read is done again at its end and false is returned.
+bool dutyCycleRead(struct EventStruct *event, byte valueCount) {
+  const byte TaskIndex = event->TaskIndex;
+  if (TaskIndex >= TASKS_MAX) return false;
+  SensorDutyCycleStruct& cycle = sensorDutyCycle[TaskIndex];
+  if (cycle.wakeTimerMissing && cycle.state == DUTY_CYCLE_SLEEP) {
+    // Try again to wake the sensor, now.
+    cycle.wakeTimerMissing = !setSystemTimer(0, cycle.pluginId, TaskIndex, DUTY_CYCLE_TIMER_PAR1 + TaskIndex, 0, 0, 0, 0);
+  }
+  if (cycle.state == DUTY_CYCLE_WARMUP || cycle.state == DUTY_CYCLE_BURST) {
+    cycle.readPending = true;
+    return false;
+  }
+  if (cycle.count == 0) return false;
+  for (byte i = 0; i < valueCount && i < DUTY_CYCLE_VALUES; ++i)
+    UserVar[event->BaseVarIndex + i] = cycle.sum[i] / cycle.count;
+  cycle.count = 0;
+
+  if (cycle.state == DUTY_CYCLE_DONE) {
+    // Wake up in time for the next run of the task timer
+    const unsigned long interval = Settings.TaskDeviceTimer[TaskIndex] * 1000;
+    const unsigned long awake = cycle.warmup + cycle.burstMsec + DUTY_CYCLE_MARGIN;
+    const unsigned long sleep = interval > awake ? interval - awake : 0;
+    cycle.state = DUTY_CYCLE_SLEEP;
+    cycle.wakeTimerMissing = !setSystemTimer(sleep, cycle.pluginId, TaskIndex, DUTY_CYCLE_TIMER_PAR1 + TaskIndex, 0, 0, 0, 0);
+    if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+      String log = F("Sensor: Task ");
+      log += TaskIndex + 1;
+      log += F(" sleeps ");
+      log += sleep;
+      log += F(" ms");
+      addLog(LOG_LEVEL_DEBUG, log);
+    }
+  }
+  return true;
+}
+
+// PLUGIN_TIMER_IN: true for the wake timer, the plugin then wakes the sensor.
+bool dutyCycleWakeTimer(struct EventStruct *event) {
+  const byte TaskIndex = event->TaskIndex;
+  if (TaskIndex >= TASKS_MAX || event->Par1 != (DUTY_CYCLE_TIMER_PAR1 + TaskIndex)) return false;
+  SensorDutyCycleStruct& cycle = sensorDutyCycle[TaskIndex];
+  if (cycle.state != DUTY_CYCLE_SLEEP) return false;
+  cycle.state = DUTY_CYCLE_WARMUP;
+  cycle.stateStart = millis();
+  return true;
+}
+
+// Task page fields, the warm-up stored in TaskDevicePluginConfig[configIndex] in seconds.
+void dutyCycleWebformLoad(struct EventStruct *event, byte configIndex) {
+  addFormNumericBox(F("Sleep with warm-up"), F("dutycycle_warmup"), Settings.TaskDevicePluginConfig[event->TaskIndex][configIndex], 0, 120);
+  addUnit(F("sec"));
+  String note = F("0 = continuous. Otherwise the sensor sleeps between the reads and is woken this long plus ");
+  note += DUTY_CYCLE_SAMPLES;
+  note += F(" frames (averaged) before the read. Needs a connected TX pin and an interval of at least the warm-up plus 20 sec");
+  addFormNote(note);
+}
+
+void dutyCycleWebformSave(struct EventStruct *event, byte configIndex) {
+  Settings.TaskDevicePluginConfig[event->TaskIndex][configIndex] = getFormItemInt(F("dutycycle_warmup"));
+}
@@ -0,0 +1,112 @@
+//********************************************************************************
+// Report by exception
+// SensorSendTaskValues() asks taskReportDue() before sendData(), so a read which
+// did not change any value by more than its deadband is not sent to the
+// controllers, the rules and the value logger. The values are compared to the
+// ones of the last report, a slow drift is sent once it adds up to the deadband.
+// Settings per task (ExtraTaskSettings):
+//   - TaskDeviceDeadband / TaskDeviceDeadbandPercent per value, an absolute
+//     change or a change in % of the value last sent. With both 0 every change
+//     of the value is sent,
+//   - TaskDeviceMinReportInterval, no report within that time after the last,
+//   - TaskDeviceMaxReportInterval, a report after that time even without a change.
+// With none of them set every read is sent, as before.
+// Plugins which call sendData() themselves (e.g. switches) are not filtered.
+// In a deep sleep wake without RF a due report is held or kept as a sample,
+// see SleepWake.ino.
+//********************************************************************************
+
+struct TaskReportStruct
+{
+  TaskReportStruct() : lastReport(0), reported(false) {}
+
+  float value[VARS_PER_TASK];   // As last sent
+  unsigned long lastReport;
+  bool reported;
+} taskReport[TASKS_MAX];
+
+struct TaskReportStatsStruct
+{
+  TaskReportStatsStruct() : sent(0), suppressed(0), silence(0) {}
+
+  unsigned long sent;         // Reads sent by a filtering task
+  unsigned long suppressed;   // Within the deadband or the minimum interval
+  unsigned long silence;      // Sent for the maximum interval only
+} taskReportStats;
+
+// Whether the task uses any of the report settings. ExtraTaskSettings must be loaded.
+bool taskReportFiltered() {
+  if (ExtraTaskSettings.TaskDeviceMinReportInterval != 0 || ExtraTaskSettings.TaskDeviceMaxReportInterval != 0)
+    return true;
+  for (byte varNr = 0; varNr < VARS_PER_TASK; varNr++) {
+    if (ExtraTaskSettings.TaskDeviceDeadband[varNr] > 0 || ExtraTaskSettings.TaskDeviceDeadbandPercent[varNr] > 0)
+      return true;
+  }
+  return false;
+}
+
+bool taskReportValueChanged(float value, float last, float deadband, float percent) {
+  if (isnan(value) || isnan(last)) return isnan(value) != isnan(last);
+  const float change = fabs(value - last);
+  if (deadband <= 0 && percent <= 0) return change != 0;
+  if (deadband > 0 && change > deadband) return true;
+  if (percent > 0 && change > fabs(last) * percent / 100.0) return true;
+  return false;
+}
+
+// Called with the values of a read in UserVar and ExtraTaskSettings loaded. Returns true when they are to be sent.
+bool taskReportDue(struct EventStruct *event) {
+  const byte TaskIndex = event->TaskIndex;
+  if (TaskIndex >= TASKS_MAX) return true;
+  if (!taskReportFiltered()) return sleepWakeHoldReport(event) == SLEEP_REPORT_SEND;
+  TaskReportStruct& report = taskReport[TaskIndex];
+  const byte valueCount = getValueCountFromSensorType(event->sensorType);
+  const unsigned long elapsed = timePassedSince(report.lastReport);
+
+  bool due = !report.reported;
+  if (!due && ExtraTaskSettings.TaskDeviceMinReportInterval != 0 &&
+      elapsed < ExtraTaskSettings.TaskDeviceMinReportInterval * 1000UL) {
+    ++taskReportStats.suppressed;
+    return false;
+  }
+  for (byte varNr = 0; !due && varNr < valueCount && varNr < VARS_PER_TASK; varNr++) {
+    due = taskReportValueChanged(UserVar[event->BaseVarIndex + varNr], report.value[varNr],
+                                 ExtraTaskSettings.TaskDeviceDeadband[varNr], ExtraTaskSettings.TaskDeviceDeadbandPercent[varNr]);
+  }
+  if (!due && ExtraTaskSettings.TaskDeviceMaxReportInterval != 0 &&
+      elapsed >= ExtraTaskSettings.TaskDeviceMaxReportInterval * 1000UL) {
+    due = true;
+    ++taskReportStats.silence;
+  }
+  if (!due) {
+    ++taskReportStats.suppressed;
+    return false;
+  }
+  const byte hold = sleepWakeHoldReport(event);
+  if (hold == SLEEP_REPORT_HELD)
+    return false;  // Sent in the wake with RF, see SleepWake.ino
+
+  for (byte varNr = 0; varNr < VARS_PER_TASK; varNr++)
+    report.value[varNr] = UserVar[event->BaseVarIndex + varNr];
+  report.lastReport = millis();
+  report.reported = true;
+  ++taskReportStats.sent;
+  return hold == SLEEP_REPORT_SEND;
+}
+
+// The next read of the task is sent regardless, e.g. after its settings were changed.
+void taskReportReset(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return;
+  taskReport[TaskIndex].reported = false;
+}
+
+// Report stats as: sent/suppressed/sent for the max. interval
+String getTaskReportStats() {
+  String result;
+  result += taskReportStats.sent;
+  result += '/';
+  result += taskReportStats.suppressed;
+  result += '/';
+  result += taskReportStats.silence;
+  return result;
+}
@@ -0,0 +1,200 @@
+//********************************************************************************
+// ADC sampling
+// Samples one analog input at a fixed rate in the background, for signals that
+// change faster than a task reads them (current clamps, vibration).
+// On ESP32 the I2S peripheral reads ADC1 (GPIO 32-39) by DMA, other pins use a
+// timer like on ESP8266. The samples go through a ring buffer and are added to
+// the statistics of the current window from backgroundtasks(). The task takes
+// the window with adcSamplingResult(), which starts the next one.
+//********************************************************************************
+#define ADC_SAMPLING_RING_SIZE     512    // Samples, power of 2
+#define ADC_SAMPLING_BURST         256    // Max. samples handled per call
+#if defined(ESP32)
+  #include <Ticker.h>
+  #include <driver/i2s.h>
+  #include <driver/adc.h>
+  #define ADC_SAMPLING_RATE_MAX    20000
+  #define ADC_SAMPLING_I2S_MIN      1000  // Lower rates use the timer
+  #define ADC_SAMPLING_I2S_PORT    I2S_NUM_0
+#else
+  #define ADC_SAMPLING_RATE_MAX     1000  // Timer resolution of 1 msec
+#endif
+
+struct AdcSamplingStruct
+{
+  AdcSamplingStruct() : ring(NULL), head(0), tail(0), owner(-1), pin(-1), rate(0), useI2S(false),
+    count(0), sum(0), sumSquares(0), minValue(0), maxValue(0), samples(0), dropped(0) {}
+
+  uint16_t* ring;
+  volatile unsigned int head;   // Written by the sampler only
+  volatile unsigned int tail;   // Written by processAdcSampling() only
+  int owner;                    // TaskIndex, -1 when not running
+  int pin;
+  unsigned int rate;            // Samples per second
+  bool useI2S;
+  Ticker ticker;
+
+  // Current window
+  unsigned long count;
+  uint64_t sum;
+  uint64_t sumSquares;
+  uint16_t minValue;
+  uint16_t maxValue;
+
+  unsigned long samples;
+  volatile unsigned long dropped;  // Ring full
+} adcSampling;
+
+void adcSamplingPush(uint16_t value) {
+  const unsigned int head = adcSampling.head;
+  if (head - adcSampling.tail >= ADC_SAMPLING_RING_SIZE) {
+    ++adcSampling.dropped;
+    return;
+  }
+  adcSampling.ring[head & (ADC_SAMPLING_RING_SIZE - 1)] = value;
+  adcSampling.head = head + 1;
+}
+
+// Ticker callback, not an interrupt: on ESP8266 it runs between loop() passes,
+// on ESP32 in the timer task.
+void adcSamplingTimer() {
+  #if defined(ESP8266)
+    adcSamplingPush(analogRead(A0));
+  #else
+    adcSamplingPush(analogRead(adcSampling.pin));
+  #endif
+}
+
+// Start sampling for a task, rate in samples per second.
+bool adcSamplingBegin(byte TaskIndex, int pin, unsigned int rate) {
+  adcSamplingEnd(adcSampling.owner);
+  if (rate == 0) return false;
+  if (rate > ADC_SAMPLING_RATE_MAX) rate = ADC_SAMPLING_RATE_MAX;
+  adcSampling.ring = (uint16_t*)allocBuffer(MEM_POOL_ADC, ADC_SAMPLING_RING_SIZE * sizeof(uint16_t));
+  if (adcSampling.ring == NULL) {
+    addLog(LOG_LEVEL_ERROR, F("ADC  : Not enough memory for sampling"));
+    return false;
+  }
+  adcSampling.head = adcSampling.tail = 0;
+  adcSampling.pin = pin;
+  adcSampling.rate = rate;
+  adcSampling.samples = adcSampling.dropped = 0;
+  adcSamplingClearWindow();
+  adcSampling.useI2S = false;
+  #if defined(ESP32)
+    const int8_t channel = digitalPinToAnalogChannel(pin);
+    if (rate >= ADC_SAMPLING_I2S_MIN && channel >= 0 && channel < ADC1_CHANNEL_MAX) {
+      i2s_config_t config;
+      memset(&config, 0, sizeof(config));
+      config.mode = static_cast<i2s_mode_t>(I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN);
+      config.sample_rate = rate;
+      config.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT;
+      config.channel_format = I2S_CHANNEL_FMT_ONLY_RIGHT;
+      config.communication_format = I2S_COMM_FORMAT_I2S_MSB;
+      config.dma_buf_count = 4;
+      config.dma_buf_len = 256;
+      if (i2s_driver_install(ADC_SAMPLING_I2S_PORT, &config, 0, NULL) == ESP_OK) {
+        adc1_config_width(ADC_WIDTH_BIT_12);
+        adc1_config_channel_atten(static_cast<adc1_channel_t>(channel), ADC_ATTEN_DB_11);
+        i2s_set_adc_mode(ADC_UNIT_1, static_cast<adc1_channel_t>(channel));
+        i2s_adc_enable(ADC_SAMPLING_I2S_PORT);
+        adcSampling.useI2S = true;
+      }
+    }
+  #endif
+  if (!adcSampling.useI2S) {
+    uint32_t interval = 1000 / rate;
+    if (interval == 0) interval = 1;
+    adcSampling.rate = 1000 / interval;
+    adcSampling.ticker.attach_ms(interval, adcSamplingTimer);
+  }
+  adcSampling.owner = TaskIndex;
+  if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+    String log = F("ADC  : Sampling at ");
+    log += adcSampling.rate;
+    log += adcSampling.useI2S ? F(" Hz by I2S DMA") : F(" Hz by timer");
+    addLog(LOG_LEVEL_INFO, log);
+  }
+  return true;
+}
+
+// Stop sampling, only when the task still owns the sampler.
+void adcSamplingEnd(int TaskIndex) {
+  if (adcSampling.owner < 0 || adcSampling.owner != TaskIndex) return;
+  #if defined(ESP32)
+    if (adcSampling.useI2S) {
+      i2s_adc_disable(ADC_SAMPLING_I2S_PORT);
+      i2s_driver_uninstall(ADC_SAMPLING_I2S_PORT);
+      adcSampling.useI2S = false;
+    }
+  #endif
+  adcSampling.ticker.detach();
+  adcSampling.owner = -1;
+  freeBuffer(MEM_POOL_ADC, adcSampling.ring, ADC_SAMPLING_RING_SIZE * sizeof(uint16_t));
+  adcSampling.ring = NULL;
+}
+
+void adcSamplingClearWindow() {
+  adcSampling.count = 0;
+  adcSampling.sum = 0;
+  adcSampling.sumSquares = 0;
+  adcSampling.minValue = 0xFFFF;
+  adcSampling.maxValue = 0;
+}
+
+// Called from backgroundtasks(): move the DMA samples into the ring and add the ring to the window.
+void processAdcSampling() {
+  if (adcSampling.owner < 0) return;
+  #if defined(ESP32)
+    if (adcSampling.useI2S) {
+      uint16_t buffer[64];
+      int bytes;
+      while ((bytes = i2s_read_bytes(ADC_SAMPLING_I2S_PORT, reinterpret_cast<char*>(buffer), sizeof(buffer), 0)) > 0) {
+        for (int i = 0; i < bytes / 2; ++i)
+          adcSamplingPush(buffer[i] & 0x0FFF);  // Upper 4 bits hold the channel
+        if (adcSampling.head - adcSampling.tail >= ADC_SAMPLING_BURST) break;
+      }
+    }
+  #endif
+  unsigned int tail = adcSampling.tail;
+  for (unsigned int n = 0; n < ADC_SAMPLING_BURST && tail != adcSampling.head; ++n, ++tail) {
+    const uint16_t value = adcSampling.ring[tail & (ADC_SAMPLING_RING_SIZE - 1)];
+    ++adcSampling.count;
+    adcSampling.sum += value;
+    adcSampling.sumSquares += static_cast<uint32_t>(value) * value;
+    if (value < adcSampling.minValue) adcSampling.minValue = value;
+    if (value > adcSampling.maxValue) adcSampling.maxValue = value;
+  }
+  adcSampling.samples += tail - adcSampling.tail;
+  adcSampling.tail = tail;
+}
+
+// Statistics of the window since the last call, in ADC counts. rms is the AC part
+// (standard deviation), as needed for a current clamp. False when there are no samples.
+bool adcSamplingResult(byte TaskIndex, float& mean, float& rms, float& minValue, float& maxValue) {
+  if (adcSampling.owner != TaskIndex) return false;
+  processAdcSampling();
+  if (adcSampling.count == 0) return false;
+  const double n = adcSampling.count;
+  const double avg = adcSampling.sum / n;
+  double variance = adcSampling.sumSquares / n - avg * avg;
+  if (variance < 0) variance = 0;
+  mean = avg;
+  rms = sqrt(variance);
+  minValue = adcSampling.minValue;
+  maxValue = adcSampling.maxValue;
+  adcSamplingClearWindow();
+  return true;
+}
+
+// ADC sampling stats as: rate/samples/dropped
+String getAdcSamplingStats() {
+  if (adcSampling.owner < 0) return F("-");
+  String result;
+  result += adcSampling.rate;
+  result += '/';
+  result += adcSampling.samples;
+  result += '/';
+  result += adcSampling.dropped;
+  return result;
+}
@@ -1,12 +1,44 @@
 /********************************************************************************************\
 * Get data from Serial Interface
+* The received lines wait in a ring of SERIAL_INPUT_LINES lines, a line is executed when the
+* output of the previous one has left to the transmit buffer. The console output is put in a
+* transmit ring by serialConsoleWrite() and sent from processSerialConsole() as the UART
+* FIFO has room, so a long reply does not stall the loop on Serial.print().
+* While the line ring is full the host is asked to pause with XOFF, XON resumes.
+* In batch mode (serialbatch,1) a line can hold several commands separated by ';'.
 \*********************************************************************************************/
 #define INPUT_BUFFER_SIZE          128
+#define SERIAL_INPUT_LINES           4
+#define SERIAL_TX_BUFFER_SIZE     2048    // Power of 2
+#define SERIAL_TX_MIN_ROOM         256    // Free space needed before the next line is executed
+#define SERIAL_XON                0x11
+#define SERIAL_XOFF               0x13
 
 byte SerialInByte;
 int SerialInByteCounter = 0;
 char InputBuffer_Serial[INPUT_BUFFER_SIZE + 2];
 
+struct SerialConsoleStruct
+{
+  SerialConsoleStruct() : lineHead(0), lineTail(0), tx(NULL), txHead(0), txTail(0),
+    xoff(false), batch(false), executing(false), received(0), commands(0), dropped(0), waits(0) {}
+
+  char lines[SERIAL_INPUT_LINES][INPUT_BUFFER_SIZE + 1];
+  byte lineHead;           // Positions only increase, head - tail lines are queued
+  byte lineTail;
+  uint8_t* tx;              // Transmit ring, allocated at the first output
+  unsigned int txHead;
+  unsigned int txTail;
+  bool xoff;               // XOFF sent to the host
+  bool batch;
+  bool executing;
+
+  unsigned long received;   // Lines
+  unsigned long commands;   // Executed
+  unsigned long dropped;    // Lines or bytes of output which did not fit
+  unsigned long waits;      // Writes which had to wait for the UART
+} serialConsole;
+
 void serial()
 {
   while (Serial.available())
@@ -15,7 +47,8 @@ void serial()
     SerialInByte = Serial.read();
     if (SerialInByte == 255) // binary data...
     {
-      Serial.flush();
+      while (Serial.read() >= 0) {}
+      SerialInByteCounter = 0;
       return;
     }
 
@@ -28,18 +61,177 @@ void serial()
     if (SerialInByte == '\r' || SerialInByte == '\n')
     {
       if (SerialInByteCounter == 0)   //empty command?
-        break;
+        continue;
       InputBuffer_Serial[SerialInByteCounter] = 0; // serial data completed
-      Serial.write('>');
-      Serial.println(InputBuffer_Serial);
-      String action = InputBuffer_Serial;
-      struct EventStruct TempEvent;
-      parseCommandString(&TempEvent, action);
-      TempEvent.Source = VALUE_SOURCE_SERIAL;
-      if (!PluginCall(PLUGIN_WRITE, &TempEvent, action))
-        ExecuteCommand(VALUE_SOURCE_SERIAL, InputBuffer_Serial);
       SerialInByteCounter = 0;
-      InputBuffer_Serial[0] = 0; // serial data processed, clear buffer
+      if (static_cast<byte>(serialConsole.lineHead - serialConsole.lineTail) >= SERIAL_INPUT_LINES) {
+        ++serialConsole.dropped;
+        continue;
+      }
+      strcpy(serialConsole.lines[serialConsole.lineHead % SERIAL_INPUT_LINES], InputBuffer_Serial);
+      ++serialConsole.lineHead;
+      ++serialConsole.received;
+      if (static_cast<byte>(serialConsole.lineHead - serialConsole.lineTail) >= SERIAL_INPUT_LINES && !serialConsole.xoff) {
+        Serial.write(SERIAL_XOFF);
+        serialConsole.xoff = true;
+      }
+    }
+  }
+  processSerialConsole();
+}
+
+void serialExecuteCommand(char* command)
+{
+  String action = command;
+  struct EventStruct TempEvent;
+  parseCommandString(&TempEvent, action);
+  TempEvent.Source = VALUE_SOURCE_SERIAL;
+  if (!PluginCall(PLUGIN_WRITE, &TempEvent, action))
+    ExecuteCommand(VALUE_SOURCE_SERIAL, command);
+  ++serialConsole.commands;
+}
+
+// Run one queued line, when its output fits in the transmit ring.
+void serialExecuteLine()
+{
+  if (serialConsole.lineHead == serialConsole.lineTail || serialConsole.executing) return;
+  if (serialConsole.tx != NULL && serialConsoleTxRoom() < SERIAL_TX_MIN_ROOM) return;
+  char* line = serialConsole.lines[serialConsole.lineTail % SERIAL_INPUT_LINES];
+  serialConsole.executing = true;
+  serialConsoleWrite(reinterpret_cast<const uint8_t*>(">"), 1, true);
+  serialConsolePrintln(line);
+  if (serialConsole.batch) {
+    char* next = line;
+    while (next != NULL) {
+      char* command = next;
+      next = strchr(command, ';');
+      if (next != NULL) *next++ = 0;
+      while (*command == ' ') ++command;
+      if (*command != 0) serialExecuteCommand(command);
     }
+  } else {
+    serialExecuteCommand(line);
   }
+  serialConsole.executing = false;
+  ++serialConsole.lineTail;
+  if (serialConsole.xoff && serialConsole.lineHead == serialConsole.lineTail) {
+    Serial.write(SERIAL_XON);
+    serialConsole.xoff = false;
+  }
+}
+
+// Called from backgroundtasks() (or the RTOS serial task): send the queued output and run the next line.
+void processSerialConsole()
+{
+  serialConsoleFlush();
+  serialExecuteLine();
+}
+
+bool serialConsolePending()
+{
+  return serialConsole.txHead != serialConsole.txTail || serialConsole.lineHead != serialConsole.lineTail;
+}
+
+void setSerialBatchMode(bool batch)
+{
+  serialConsole.batch = batch;
+}
+
+unsigned int serialConsoleTxRoom()
+{
+  if (serialConsole.tx == NULL) return SERIAL_TX_BUFFER_SIZE;
+  return SERIAL_TX_BUFFER_SIZE - (serialConsole.txHead - serialConsole.txTail);
+}
+
+// Room in the UART FIFO. On ESP32 Serial.write() puts the data in the driver buffer.
+unsigned int serialTxFifoRoom()
+{
+  #if defined(ESP8266)
+    return Serial.availableForWrite();
+  #else
+    return SERIAL_TX_MIN_ROOM;
+  #endif
+}
+
+// Move the transmit ring into the UART FIFO, as far as it has room.
+void serialConsoleFlush()
+{
+  while (serialConsole.txHead != serialConsole.txTail) {
+    const unsigned int room = serialTxFifoRoom();
+    if (room == 0) return;
+    const unsigned int tail = serialConsole.txTail & (SERIAL_TX_BUFFER_SIZE - 1);
+    unsigned int count = serialConsole.txHead - serialConsole.txTail;
+    if (count > SERIAL_TX_BUFFER_SIZE - tail) count = SERIAL_TX_BUFFER_SIZE - tail;  // Up to the end of the ring
+    if (count > room) count = room;
+    Serial.write(serialConsole.tx + tail, count);
+    serialConsole.txTail += count;
+  }
+}
+
+// Console output. With wait the data is never dropped: when the ring is full the UART
+// is waited for. Without it, e.g. for log lines, what does not fit is dropped.
+void serialConsoleWrite(const uint8_t* data, size_t length, bool wait)
+{
+  serialConsoleFlush();
+  if (serialConsole.txHead == serialConsole.txTail && serialTxFifoRoom() >= length) {
+    Serial.write(data, length);
+    return;
+  }
+  if (serialConsole.tx == NULL) {
+    serialConsole.tx = static_cast<uint8_t*>(allocBuffer(MEM_POOL_SERIAL, SERIAL_TX_BUFFER_SIZE));
+    if (serialConsole.tx == NULL) {
+      // No ring, write directly
+      Serial.write(data, length);
+      return;
+    }
+  }
+  while (length > 0) {
+    const unsigned int room = serialConsoleTxRoom();
+    if (room == 0) {
+      if (!wait) {
+        serialConsole.dropped += length;
+        return;
+      }
+      ++serialConsole.waits;
+      delay(0);
+      serialConsoleFlush();
+      continue;
+    }
+    const unsigned int head = serialConsole.txHead & (SERIAL_TX_BUFFER_SIZE - 1);
+    unsigned int count = length;
+    if (count > room) count = room;
+    if (count > SERIAL_TX_BUFFER_SIZE - head) count = SERIAL_TX_BUFFER_SIZE - head;
+    memcpy(serialConsole.tx + head, data, count);
+    serialConsole.txHead += count;
+    data += count;
+    length -= count;
+  }
+  serialConsoleFlush();
+}
+
+void serialConsolePrint(const String& text)
+{
+  serialConsoleWrite(reinterpret_cast<const uint8_t*>(text.c_str()), text.length(), true);
+}
+
+void serialConsolePrintln(const String& text)
+{
+  serialConsolePrint(text);
+  serialConsoleWrite(reinterpret_cast<const uint8_t*>("\r\n"), 2, true);
+}
+
+// Serial console stats as: lines/commands/queued output bytes/dropped/waits
+String getSerialConsoleStats()
+{
+  String result;
+  result += serialConsole.received;
+  result += '/';
+  result += serialConsole.commands;
+  result += '/';
+  result += serialConsole.txHead - serialConsole.txTail;
+  result += '/';
+  result += serialConsole.dropped;
+  result += '/';
+  result += serialConsole.waits;
+  return result;
 }
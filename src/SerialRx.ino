@@ -0,0 +1,206 @@
+//********************************************************************************
+// Hardware serial receive buffer
+// A task claims the serial port with serialRxBegin() and reads it with
+// serialRxAvailable() / serialRxRead() / serialRxReadBytes().
+// The received bytes are moved from the UART buffer of the core into a larger
+// ring buffer on every poll: every RTOS_SERIAL_POLL_MSEC from the RTOS serial
+// task on ESP32, from backgroundtasks() otherwise. On ESP8266 the interrupt
+// filled buffer of the core is enlarged as well, to bridge long loop passes.
+// The owning task gets PLUGIN_INTERRUPT_EVENT with event->Par1:
+//   SERIAL_RX_EVENT_FRAME  the frame end character was received
+//   SERIAL_RX_EVENT_IDLE   the line was silent for the idle time after receiving data
+// and event->Par2 set to the number of bytes available.
+//********************************************************************************
+#define SERIAL_RX_BUFFER_MIN        256    // Power of 2
+#ifdef MEM_USE_PSRAM
+  #define SERIAL_RX_BUFFER_MAX    16384    // The ring is put in PSRAM, see allocBuffer()
+#else
+  #define SERIAL_RX_BUFFER_MAX     4096
+#endif
+#define SERIAL_RX_IDLE_CHARS          4    // Default idle time, in character times
+#define SERIAL_RX_EVENT_FRAME      0xF0    // Interrupt event types, above the plugin specific ones
+#define SERIAL_RX_EVENT_IDLE       0xF1
+#define SERIAL_RX_NO_FRAME_END       -1
+
+struct SerialRxStruct
+{
+  SerialRxStruct() : ring(NULL), mask(0), head(0), tail(0), owner(-1), frameEnd(SERIAL_RX_NO_FRAME_END),
+    idleTime(0), lastByte(0), dataSinceIdle(false), frameReceived(false),
+    bytes(0), frames(0), idles(0), overruns(0), maxUsed(0) {}
+
+  uint8_t* ring;
+  unsigned int mask;
+  unsigned int head;            // Positions only increase, head - tail bytes are in use
+  unsigned int tail;
+  int owner;                    // TaskIndex, -1 when the serial console reads the port
+  int frameEnd;
+  unsigned long idleTime;       // usec
+  unsigned long lastByte;       // micros() of the last fill with data
+  bool dataSinceIdle;
+  bool frameReceived;
+  unsigned long bytes;
+  unsigned long frames;
+  unsigned long idles;
+  unsigned long overruns;       // Bytes lost in the ring, or overruns of the core buffer
+  unsigned int maxUsed;
+} serialRx;
+
+// Start the serial port for a task. bufferSize is rounded up to a power of 2.
+// idleTime is in usec, 0 for SERIAL_RX_IDLE_CHARS character times at the baud rate.
+bool serialRxBegin(byte TaskIndex, unsigned long baudrate, uint32_t config,
+                   unsigned int bufferSize, int frameEnd, unsigned long idleTime) {
+  serialRxEnd(serialRx.owner);
+  unsigned int size = SERIAL_RX_BUFFER_MIN;
+  while (size < bufferSize && size < SERIAL_RX_BUFFER_MAX) size <<= 1;
+  while ((serialRx.ring = (uint8_t*)allocBuffer(MEM_POOL_SERIAL, size)) == NULL && size > SERIAL_RX_BUFFER_MIN) size >>= 1;
+  if (serialRx.ring == NULL) {
+    addLog(LOG_LEVEL_ERROR, F("Serial: Not enough memory for the receive buffer"));
+    return false;
+  }
+  serialRx.mask = size - 1;
+  serialRx.head = serialRx.tail = 0;
+  serialRx.frameEnd = frameEnd;
+  if (idleTime == 0 && baudrate > 0)
+    idleTime = (SERIAL_RX_IDLE_CHARS * 10 * 1000000UL) / baudrate;
+  serialRx.idleTime = idleTime;
+  serialRx.dataSinceIdle = false;
+  serialRx.frameReceived = false;
+  serialRx.bytes = serialRx.frames = serialRx.idles = serialRx.overruns = 0;
+  serialRx.maxUsed = 0;
+  #if defined(ESP8266)
+    #if !defined(ARDUINO_ESP8266_RELEASE_2_3_0)
+      Serial.setRxBufferSize(size / 2);
+    #endif
+    Serial.begin(baudrate, (SerialConfig)config);
+  #endif
+  #if defined(ESP32)
+    Serial.begin(baudrate, config);
+  #endif
+  serialRx.owner = TaskIndex;
+  if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+    String log = F("Serial: RX buffer ");
+    log += size;
+    log += F(" bytes for task ");
+    log += TaskIndex + 1;
+    addLog(LOG_LEVEL_INFO, log);
+  }
+  return true;
+}
+
+// Release the port again, only when the task still owns it.
+void serialRxEnd(int TaskIndex) {
+  if (serialRx.owner < 0 || serialRx.owner != TaskIndex) return;
+  serialRx.owner = -1;
+  freeBuffer(MEM_POOL_SERIAL, serialRx.ring, serialRx.mask + 1);
+  serialRx.ring = NULL;
+}
+
+// Move the received bytes into the ring and look for the frame end.
+void serialRxFill() {
+  if (serialRx.owner < 0) return;
+  int available = Serial.available();
+  if (available <= 0) return;
+  unsigned int head = serialRx.head;
+  while (available-- > 0) {
+    const int c = Serial.read();
+    if (c < 0) break;
+    if (head - serialRx.tail > serialRx.mask) {
+      ++serialRx.overruns;  // Ring full, reader too slow
+      continue;
+    }
+    serialRx.ring[head & serialRx.mask] = c;
+    ++head;
+    ++serialRx.bytes;
+    if (c == serialRx.frameEnd) serialRx.frameReceived = true;
+  }
+  #if defined(ESP8266) && !defined(ARDUINO_ESP8266_RELEASE_2_3_0)
+  if (Serial.hasOverrun())
+    ++serialRx.overruns;
+  #endif
+  serialRx.head = head;
+  serialRx.lastByte = micros();
+  serialRx.dataSinceIdle = true;
+  const unsigned int used = head - serialRx.tail;
+  if (used > serialRx.maxUsed) serialRx.maxUsed = used;
+}
+
+// Data received, or an idle line or a frame still to be reported.
+bool serialRxPending() {
+  if (serialRx.owner < 0) return Serial.available() > 0;
+  return Serial.available() > 0 || serialRx.dataSinceIdle || serialRx.frameReceived;
+}
+
+// Fill the ring and notify the owning task, called with the RTOS state lock held.
+void serialRxProcess() {
+  serialRxFill();
+  if (serialRx.owner < 0) return;
+  if (serialRx.frameReceived) {
+    serialRx.frameReceived = false;
+    ++serialRx.frames;
+    serialRxNotify(SERIAL_RX_EVENT_FRAME);
+  }
+  if (serialRx.dataSinceIdle && usecPassedSince(serialRx.lastByte) >= static_cast<long>(serialRx.idleTime)) {
+    serialRx.dataSinceIdle = false;
+    ++serialRx.idles;
+    serialRxNotify(SERIAL_RX_EVENT_IDLE);
+  }
+}
+
+void serialRxNotify(byte type) {
+  if (serialRx.owner < 0 || !Settings.TaskDeviceEnabled[serialRx.owner]) return;
+  InterruptEventStruct item;
+  item.timestamp = serialRx.lastByte;
+  item.value = serialRxAvailable();
+  item.TaskIndex = serialRx.owner;
+  item.type = type;
+  struct EventStruct TempEvent;
+  TempEvent.TaskIndex = item.TaskIndex;
+  TempEvent.Par1 = item.type;
+  TempEvent.Par2 = item.value;
+  TempEvent.Data = (byte*)&item;
+  START_TIMER;
+  PluginCall(PLUGIN_INTERRUPT_EVENT, &TempEvent, dummyString);
+  STOP_TIMER(PLUGIN_CALL_INTERRUPT);
+}
+
+// Without an owner the serial port is read directly.
+int serialRxAvailable() {
+  if (serialRx.owner < 0) return Serial.available();
+  return serialRx.head - serialRx.tail;
+}
+
+int serialRxRead() {
+  if (serialRx.owner < 0) return Serial.read();
+  const unsigned int tail = serialRx.tail;
+  if (tail == serialRx.head) return -1;
+  const uint8_t c = serialRx.ring[tail & serialRx.mask];
+  serialRx.tail = tail + 1;
+  return c;
+}
+
+unsigned int serialRxReadBytes(uint8_t* data, unsigned int length) {
+  if (serialRx.owner < 0) return Serial.readBytes(reinterpret_cast<char*>(data), length);
+  unsigned int count = 0;
+  int c;
+  while (count < length && (c = serialRxRead()) >= 0)
+    data[count++] = c;
+  return count;
+}
+
+// Serial receive stats as: received/frames/idle/overruns/max used/size
+String getSerialRxStats() {
+  if (serialRx.owner < 0) return F("-");
+  String result;
+  result += serialRx.bytes;
+  result += '/';
+  result += serialRx.frames;
+  result += '/';
+  result += serialRx.idles;
+  result += '/';
+  result += serialRx.overruns;
+  result += '/';
+  result += serialRx.maxUsed;
+  result += '/';
+  result += serialRx.mask + 1;
+  return result;
+}
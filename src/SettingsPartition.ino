@@ -0,0 +1,203 @@
+//********************************************************************************
+// Settings partition (ESP32, built with -DFEATURE_SETTINGS_PARTITION)
+// A copy of config.dat in a raw data partition labelled "settings", see
+// partitions_esp32_settings.csv. The partition is memory mapped, so
+// LoadFromFile() of config.dat is a memcpy() instead of a SPIFFS lookup.
+// SPIFFS keeps the file as before (download, upload, backups), every write to
+// it goes to the copy as well, erasing only the sectors which changed.
+// The first sector is a journal of 32 bit words: a save marks the next word
+// dirty (0x0000FFFF) before and clean (0) after writing, with bits cleared
+// only. So it is erased once per 1022 saves instead of at every save. The copy
+// is used when the last word is clean. It is rebuilt from config.dat at boot
+// when it is not, e.g. after a save was interrupted, or config.dat was
+// replaced (upload, snapshot, reset), see clearSettingsCrc().
+// Without the partition, or on ESP8266, the settings are read from SPIFFS.
+//********************************************************************************
+#if defined(ESP32) && defined(FEATURE_SETTINGS_PARTITION)
+  #define USES_SETTINGS_PARTITION
+  #include <esp_partition.h>
+#endif
+
+#define SETTINGS_PART_LABEL        "settings"
+#define SETTINGS_PART_MAGIC        0x31535345  // "ESS1"
+#define SETTINGS_PART_DATA         SPI_FLASH_SEC_SIZE  // The journal sector, the data follows
+#define SETTINGS_PART_JOURNAL      (SPI_FLASH_SEC_SIZE / sizeof(uint32_t) - 2)  // After magic and size
+#define SETTINGS_JOURNAL_FREE      0xFFFFFFFF
+#define SETTINGS_JOURNAL_DIRTY     0x0000FFFF
+#define SETTINGS_JOURNAL_CLEAN     0x00000000
+
+#ifdef USES_SETTINGS_PARTITION
+struct SettingsPartitionStruct
+{
+  SettingsPartitionStruct() : partition(NULL), mapped(NULL), size(0), journalPos(0), valid(false),
+    reads(0), erases(0) {}
+
+  const esp_partition_t* partition;
+  const uint32_t* mapped;        // The whole partition
+  spi_flash_mmap_handle_t handle;
+  uint32_t size;                 // Of config.dat
+  uint16_t journalPos;           // Next free journal word
+  bool valid;
+  unsigned long reads;
+  unsigned long erases;          // Data sectors
+} settingsPartition;
+
+const byte* getSettingsPartitionData() {
+  return reinterpret_cast<const byte*>(settingsPartition.mapped) + SETTINGS_PART_DATA;
+}
+
+bool writeSettingsJournal(uint32_t mark) {
+  SettingsPartitionStruct& part = settingsPartition;
+  if (mark == SETTINGS_JOURNAL_DIRTY && part.journalPos >= SETTINGS_PART_JOURNAL) {
+    const uint32_t header[2] = { SETTINGS_PART_MAGIC, part.size };
+    if (esp_partition_erase_range(part.partition, 0, SPI_FLASH_SEC_SIZE) != ESP_OK ||
+        esp_partition_write(part.partition, 0, header, sizeof(header)) != ESP_OK)
+      return false;
+    part.journalPos = 0;
+  }
+  const size_t address = (2 + part.journalPos) * sizeof(uint32_t);
+  if (esp_partition_write(part.partition, address, &mark, sizeof(mark)) != ESP_OK)
+    return false;
+  if (mark == SETTINGS_JOURNAL_CLEAN) ++part.journalPos;
+  return true;
+}
+
+// Write the sectors of the copy which differ from data (zeros when NULL) at offset.
+bool writeSettingsPartitionData(int offset, const byte* data, int datasize) {
+  byte* sector = new byte[SPI_FLASH_SEC_SIZE];
+  if (sector == NULL) return false;
+  const byte* onFlash = getSettingsPartitionData();
+  bool success = true;
+  int pos = 0;
+  while (success && pos < datasize) {
+    const int sectorStart = (offset + pos) & ~(SPI_FLASH_SEC_SIZE - 1);
+    int length = sectorStart + SPI_FLASH_SEC_SIZE - (offset + pos);
+    if (length > datasize - pos) length = datasize - pos;
+    memcpy(sector, onFlash + sectorStart, SPI_FLASH_SEC_SIZE);
+    byte* target = sector + (offset + pos - sectorStart);
+    if (data == NULL) memset(target, 0, length);
+    else memcpy(target, data + pos, length);
+    if (memcmp(sector, onFlash + sectorStart, SPI_FLASH_SEC_SIZE) != 0) {
+      const size_t address = SETTINGS_PART_DATA + sectorStart;
+      success = esp_partition_erase_range(settingsPartition.partition, address, SPI_FLASH_SEC_SIZE) == ESP_OK &&
+                esp_partition_write(settingsPartition.partition, address, sector, SPI_FLASH_SEC_SIZE) == ESP_OK;
+      ++settingsPartition.erases;
+    }
+    pos += length;
+  }
+  delete[] sector;
+  return success;
+}
+
+// Copy config.dat to the partition, with the journal marked dirty while writing.
+bool rebuildSettingsPartition(fs::File& f) {
+  SettingsPartitionStruct& part = settingsPartition;
+  if (part.mapped[0] != SETTINGS_PART_MAGIC || part.mapped[1] != part.size)
+    part.journalPos = SETTINGS_PART_JOURNAL;  // Erased with the new header
+  if (!writeSettingsJournal(SETTINGS_JOURNAL_DIRTY)) return false;
+  byte buffer[256];
+  for (uint32_t pos = 0; pos < part.size; pos += sizeof(buffer)) {
+    const int length = part.size - pos < sizeof(buffer) ? part.size - pos : sizeof(buffer);
+    if (f.read(buffer, length) != static_cast<size_t>(length)) return false;
+    if (!writeSettingsPartitionData(pos, buffer, length)) return false;
+    delay(0);
+  }
+  return writeSettingsJournal(SETTINGS_JOURNAL_CLEAN);
+}
+#endif
+
+// Called by fileSystemCheck() after SPIFFS is mounted.
+void initSettingsPartition() {
+  #ifdef USES_SETTINGS_PARTITION
+  SettingsPartitionStruct& part = settingsPartition;
+  part.partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, SETTINGS_PART_LABEL);
+  if (part.partition == NULL) {
+    addLog(LOG_LEVEL_INFO, F("FS   : No settings partition"));
+    return;
+  }
+  fs::File f = SPIFFS.open(FILE_CONFIG, "r");
+  if (!f) return;
+  part.size = f.size();
+  if (SETTINGS_PART_DATA + part.size > part.partition->size) {
+    addLog(LOG_LEVEL_ERROR, F("FS   : Settings partition too small"));
+    f.close();
+    return;
+  }
+  const void* mapped = NULL;
+  if (esp_partition_mmap(part.partition, 0, part.partition->size, SPI_FLASH_MMAP_DATA, &mapped, &part.handle) != ESP_OK) {
+    addLog(LOG_LEVEL_ERROR, F("FS   : Settings partition not mapped"));
+    f.close();
+    return;
+  }
+  part.mapped = static_cast<const uint32_t*>(mapped);
+
+  part.journalPos = 0;
+  while (part.journalPos < SETTINGS_PART_JOURNAL && part.mapped[2 + part.journalPos] != SETTINGS_JOURNAL_FREE)
+    ++part.journalPos;
+  part.valid = part.mapped[0] == SETTINGS_PART_MAGIC && part.mapped[1] == part.size &&
+               part.journalPos > 0 && part.mapped[2 + part.journalPos - 1] == SETTINGS_JOURNAL_CLEAN;
+  if (!part.valid) {
+    // A dirty mark left is completed by the rebuild
+    if (part.journalPos > 0 && part.mapped[2 + part.journalPos - 1] == SETTINGS_JOURNAL_DIRTY)
+      --part.journalPos;
+    part.valid = rebuildSettingsPartition(f);
+    addLog(part.valid ? LOG_LEVEL_INFO : LOG_LEVEL_ERROR,
+           part.valid ? F("FS   : Settings partition rebuilt") : F("FS   : Settings partition rebuild failed"));
+  }
+  f.close();
+  #endif
+}
+
+// Returns false when the data is to be read from SPIFFS.
+bool readSettingsPartition(const char* fname, int offset, byte* memAddress, int datasize) {
+  #ifdef USES_SETTINGS_PARTITION
+  SettingsPartitionStruct& part = settingsPartition;
+  if (!part.valid || offset + datasize > static_cast<int>(part.size) || strcmp(fname, FILE_CONFIG) != 0)
+    return false;
+  memcpy(memAddress, getSettingsPartitionData() + offset, datasize);
+  ++part.reads;
+  return true;
+  #else
+  return false;
+  #endif
+}
+
+// Called after data (zeros when NULL) was written to fname on SPIFFS.
+void writeSettingsPartition(const char* fname, int offset, const byte* data, int datasize) {
+  #ifdef USES_SETTINGS_PARTITION
+  SettingsPartitionStruct& part = settingsPartition;
+  if (!part.valid || strcmp(fname, FILE_CONFIG) != 0) return;
+  if (offset + datasize > static_cast<int>(part.size)) {
+    invalidateSettingsPartition();
+    return;
+  }
+  // A failed write leaves the dirty mark, the copy is rebuilt at the next boot
+  if (!writeSettingsJournal(SETTINGS_JOURNAL_DIRTY) || !writeSettingsPartitionData(offset, data, datasize) ||
+      !writeSettingsJournal(SETTINGS_JOURNAL_CLEAN)) {
+    part.valid = false;
+    addLog(LOG_LEVEL_ERROR, F("FS   : Settings partition write failed"));
+  }
+  #endif
+}
+
+// config.dat was replaced, read it from SPIFFS until the copy is rebuilt at the next boot.
+void invalidateSettingsPartition() {
+  #ifdef USES_SETTINGS_PARTITION
+  if (!settingsPartition.valid) return;
+  settingsPartition.valid = false;
+  writeSettingsJournal(SETTINGS_JOURNAL_DIRTY);
+  #endif
+}
+
+// Settings partition as: reads/sectors written, empty when not used.
+String getSettingsPartitionStats() {
+  String result;
+  #ifdef USES_SETTINGS_PARTITION
+  if (settingsPartition.partition == NULL) return result;
+  if (!settingsPartition.valid) return F("Not in use");
+  result += settingsPartition.reads;
+  result += '/';
+  result += settingsPartition.erases;
+  #endif
+  return result;
+}
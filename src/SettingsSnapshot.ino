@@ -0,0 +1,450 @@
+//********************************************************************************
+// Settings snapshot (/snapshot)
+// One file with all settings regions (config.dat laid out per SettingsType,
+// security.dat, notification.dat) and the rules files, to clone a configuration
+// to other nodes. GET exports it, POST (upload) imports it. Import writes only
+// the SPIFFS pages that differ, so no factory reset or reboot cycle is needed:
+// the tasks get PLUGIN_EXIT before and are started again after the import.
+// Controllers and network settings take effect after a reboot (reboot=1).
+//
+// Format, all values little endian:
+//   header   "ESPS", uint16 format, uint16 region count, uint32 PID,
+//            uint16 settings VERSION, uint16 BUILD, uint32 config.dat size
+//   regions  uint8 file, uint8 reserved, uint16 encoded size, uint32 offset,
+//            uint16 size, uint16 reserved, uint32 CRC32 of the data,
+//            followed by the encoded data
+//   trailer  uint32 CRC32 of everything before it
+// The data is compressed with a run length encoding of zeros, as most of the
+// settings files are unused space: a control byte c < 0x80 is followed by c+1
+// literal bytes, c >= 0x80 stands for (c & 0x7F)+1 zero bytes.
+// A rules file missing in the snapshot is removed on import.
+//********************************************************************************
+#define SNAPSHOT_FORMAT            1
+#define SNAPSHOT_CHUNK_SIZE     1024   // Max. size of a region, larger settings are split
+#define SNAPSHOT_OUT_SIZE        512   // Bytes sent to the client at once
+#define SNAPSHOT_HEADER_SIZE      20
+#define SNAPSHOT_REGION_HEADER    16
+#define SNAPSHOT_FILE_CONFIG       0
+#define SNAPSHOT_FILE_SECURITY     1
+#define SNAPSHOT_FILE_NOTIFICATION 2
+#define SNAPSHOT_FILE_RULES        3   // + rules set index
+
+// Output state of the export, see snapshotWrite()
+byte* snapshotChunk = NULL;          // SNAPSHOT_CHUNK_SIZE bytes of region data
+byte* snapshotOut = NULL;            // SNAPSHOT_OUT_SIZE bytes, allocated with snapshotChunk
+unsigned int snapshotOutLength = 0;
+uint32_t snapshotCrc = 0;
+unsigned long snapshotBytes = 0;
+uint16_t snapshotRegions = 0;
+bool snapshotSend = false;           // false: only count the bytes and regions
+
+String getSnapshotFileName(byte file) {
+  switch (file) {
+    case SNAPSHOT_FILE_CONFIG:       return F(FILE_CONFIG);
+    case SNAPSHOT_FILE_SECURITY:     return F(FILE_SECURITY);
+    case SNAPSHOT_FILE_NOTIFICATION: return F(FILE_NOTIFICATION);
+  }
+  #if defined(ESP8266)
+    String fileName = F("rules");
+  #endif
+  #if defined(ESP32)
+    String fileName = F("/rules");
+  #endif
+  fileName += file - SNAPSHOT_FILE_RULES + 1;
+  fileName += F(".txt");
+  return fileName;
+}
+
+void snapshotFlush() {
+  if (snapshotSend && snapshotOutLength != 0) {
+    waitForWebClientTX(snapshotOutLength);
+    WebServer.client().write(static_cast<const uint8_t*>(snapshotOut), snapshotOutLength);
+  }
+  snapshotOutLength = 0;
+}
+
+void snapshotWrite(const byte* data, unsigned int length) {
+  snapshotCrc = crc32Update(snapshotCrc, data, length);
+  snapshotBytes += length;
+  if (!snapshotSend) return;
+  while (length > 0) {
+    unsigned int part = SNAPSHOT_OUT_SIZE - snapshotOutLength;
+    if (part > length) part = length;
+    memcpy(snapshotOut + snapshotOutLength, data, part);
+    snapshotOutLength += part;
+    data += part;
+    length -= part;
+    if (snapshotOutLength == SNAPSHOT_OUT_SIZE) snapshotFlush();
+  }
+}
+
+void snapshotWriteValue(uint32_t value, byte size) {
+  byte bytes[4];
+  for (byte i = 0; i < size; ++i)
+    bytes[i] = (value >> (8 * i)) & 0xFF;
+  snapshotWrite(bytes, size);
+}
+
+// Returns the encoded size, data is only written when emit is set.
+unsigned int encodeSnapshotData(const byte* data, unsigned int size, bool emit) {
+  unsigned int encoded = 0;
+  unsigned int pos = 0;
+  while (pos < size) {
+    unsigned int run = 0;
+    while (pos + run < size && data[pos + run] == 0 && run < 128) ++run;
+    if (run > 0) {
+      if (emit) snapshotWriteValue(0x80 | (run - 1), 1);
+      encoded += 1;
+      pos += run;
+      continue;
+    }
+    // Literals up to the next run of at least 2 zeros.
+    unsigned int literal = 0;
+    while (pos + literal < size && literal < 128 &&
+           !(data[pos + literal] == 0 && (pos + literal + 1 >= size || data[pos + literal + 1] == 0))) {
+      ++literal;
+    }
+    if (literal == 0) literal = 1; // Single zero at the end
+    if (emit) {
+      snapshotWriteValue(literal - 1, 1);
+      snapshotWrite(data + pos, literal);
+    }
+    encoded += 1 + literal;
+    pos += literal;
+  }
+  return encoded;
+}
+
+// Add the data at offset of an open file as one or more regions.
+void addSnapshotRegions(byte file, fs::File& f, int offset, int size) {
+  do {
+    const int chunk = size > SNAPSHOT_CHUNK_SIZE ? SNAPSHOT_CHUNK_SIZE : size;
+    int bytesRead = 0;
+    if (chunk > 0 && f.seek(offset, fs::SeekSet))
+      bytesRead = f.read(snapshotChunk, chunk);
+    if (bytesRead < chunk) memset(snapshotChunk + bytesRead, 0, chunk - bytesRead);
+    const unsigned int encodedSize = encodeSnapshotData(snapshotChunk, chunk, false);
+    ++snapshotRegions;
+    snapshotWriteValue(file, 1);
+    snapshotWriteValue(0, 1);
+    snapshotWriteValue(encodedSize, 2);
+    snapshotWriteValue(offset, 4);
+    snapshotWriteValue(chunk, 2);
+    snapshotWriteValue(0, 2);
+    snapshotWriteValue(crc32Update(0, snapshotChunk, chunk), 4);
+    if (snapshotSend) {
+      encodeSnapshotData(snapshotChunk, chunk, true);
+    } else {
+      // Counting only
+      snapshotBytes += encodedSize;
+    }
+    offset += chunk;
+    size -= chunk;
+    delay(0);
+  } while (size > 0);
+}
+
+void addSnapshotFile(byte file) {
+  const String fileName = getSnapshotFileName(file);
+  fs::File f = SPIFFS.open(fileName, "r");
+  if (!f) return;
+  switch (file) {
+    case SNAPSHOT_FILE_CONFIG:
+      for (byte st = BasicSettings_Type; st < NotificationSettings_Type; ++st) {
+        int max_index, offset, max_size, struct_size;
+        getSettingsParameters(static_cast<SettingsType>(st), 0, max_index, offset, max_size, struct_size);
+        for (int index = 0; index < max_index; ++index) {
+          getSettingsParameters(static_cast<SettingsType>(st), index, offset, max_size);
+          addSnapshotRegions(file, f, offset, max_size);
+        }
+      }
+      break;
+    case SNAPSHOT_FILE_NOTIFICATION:
+      for (int index = 0; index < NOTIFICATION_MAX; ++index) {
+        int offset, max_size;
+        getSettingsParameters(NotificationSettings_Type, index, offset, max_size);
+        addSnapshotRegions(file, f, offset, max_size);
+      }
+      break;
+    default:
+      addSnapshotRegions(file, f, 0, f.size());
+      break;
+  }
+  f.close();
+}
+
+// Writes the whole snapshot when snapshotSend is set, else only counts its size.
+void writeSnapshot() {
+  snapshotCrc = 0;
+  snapshotBytes = 0;
+  snapshotOutLength = 0;
+  const uint16_t regions = snapshotRegions;
+  snapshotRegions = 0;
+  snapshotWrite((const byte*)"ESPS", 4);
+  snapshotWriteValue(SNAPSHOT_FORMAT, 2);
+  snapshotWriteValue(regions, 2);
+  snapshotWriteValue(ESP_PROJECT_PID, 4);
+  snapshotWriteValue(VERSION, 2);
+  snapshotWriteValue(BUILD, 2);
+  snapshotWriteValue(getFileSize(BasicSettings_Type), 4);
+  for (byte file = 0; file < SNAPSHOT_FILE_RULES + RULESETS_MAX; ++file)
+    addSnapshotFile(file);
+  const uint32_t crc = snapshotCrc;
+  snapshotWriteValue(crc, 4);
+  snapshotFlush();
+}
+
+void handle_snapshot() {
+  checkRAM(F("handle_snapshot"));
+  if (!isLoggedIn()) return;
+  closeCachedReadFile();
+  snapshotChunk = (byte*)allocBuffer(MEM_POOL_SETTINGS, SNAPSHOT_CHUNK_SIZE + SNAPSHOT_OUT_SIZE);
+  if (snapshotChunk == NULL) {
+    WebServer.send(503, getWebString(WEB_STR_TEXT_PLAIN), F("Not enough memory"));
+    return;
+  }
+  snapshotOut = snapshotChunk + SNAPSHOT_CHUNK_SIZE;
+  // First pass gets the region count and the size.
+  snapshotSend = false;
+  snapshotRegions = 0;
+  writeSnapshot();
+
+  String str = F("attachment; filename=snapshot_");
+  str += Settings.Name;
+  str += F("_U");
+  str += Settings.Unit;
+  str += F("_Build");
+  str += BUILD;
+  str += F(".bin");
+  WebServer.sendHeader(F("Content-Disposition"), str);
+  WebServer.setContentLength(snapshotBytes);
+  WebServer.send(200, getWebString(WEB_STR_OCTET_STREAM), "");
+  if (WebServer.method() != HTTP_HEAD) {
+    snapshotSend = true;
+    writeSnapshot();
+    snapshotSend = false;
+  }
+  freeBuffer(MEM_POOL_SETTINGS, snapshotChunk, SNAPSHOT_CHUNK_SIZE + SNAPSHOT_OUT_SIZE);
+  snapshotChunk = NULL;
+  snapshotOut = NULL;
+}
+
+//********************************************************************************
+// Import
+//********************************************************************************
+fs::File snapshotUploadFile;
+String snapshotResult;
+uint32_t snapshotRulesCrc[RULESETS_MAX];  // Of the rules files in the snapshot, set by the check
+size_t snapshotRulesSize[RULESETS_MAX];
+
+// Upload handler of POST /snapshot, the snapshot is stored first and applied when complete.
+void handle_snapshot_upload() {
+  if (!isLoggedIn()) return;
+  HTTPUpload& upload = WebServer.upload();
+  if (upload.status == UPLOAD_FILE_START) {
+    snapshotResult = String();
+    closeCachedReadFile();
+    SPIFFS.remove(FILE_SNAPSHOT_TMP);
+    snapshotUploadFile = SPIFFS.open(FILE_SNAPSHOT_TMP, "w");
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    if (snapshotUploadFile &&
+        snapshotUploadFile.write(upload.buf, upload.currentSize) != upload.currentSize) {
+      snapshotResult = F("Not enough space to store the snapshot");
+    }
+  } else if (upload.status == UPLOAD_FILE_END || upload.status == UPLOAD_FILE_ABORTED) {
+    if (snapshotUploadFile) snapshotUploadFile.close();
+    if (upload.status == UPLOAD_FILE_ABORTED) snapshotResult = F("Upload aborted");
+  }
+}
+
+uint32_t readSnapshotValue(fs::File& f, byte size) {
+  uint32_t value = 0;
+  for (byte i = 0; i < size; ++i) {
+    const int b = f.read();
+    if (b < 0) return 0;
+    value |= static_cast<uint32_t>(b) << (8 * i);
+  }
+  return value;
+}
+
+// CRC32 of a file, 1 when it does not exist or does not have the expected size.
+uint32_t getFileCrc32(const String& fileName, size_t expectedSize) {
+  fs::File f = SPIFFS.open(fileName, "r");
+  if (!f || f.size() != expectedSize) return 1;
+  uint32_t crc = 0;
+  byte buf[128];
+  size_t bytesRead;
+  while ((bytesRead = f.read(buf, sizeof(buf))) > 0)
+    crc = crc32Update(crc, buf, bytesRead);
+  f.close();
+  return crc;
+}
+
+bool decodeSnapshotData(fs::File& f, unsigned int encodedSize, byte* data, unsigned int size) {
+  unsigned int pos = 0;
+  while (encodedSize > 0) {
+    const int c = f.read();
+    if (c < 0) return false;
+    --encodedSize;
+    const unsigned int count = (c & 0x7F) + 1;
+    if (pos + count > size) return false;
+    if (c & 0x80) {
+      memset(data + pos, 0, count);
+    } else {
+      if (count > encodedSize || f.read(data + pos, count) != count) return false;
+      encodedSize -= count;
+    }
+    pos += count;
+  }
+  return pos == size;
+}
+
+// Check the snapshot in FILE_SNAPSHOT_TMP and, when apply is set, write the differences.
+String processSnapshot(bool apply, int& changedBytes) {
+  changedBytes = 0;
+  fs::File f = SPIFFS.open(FILE_SNAPSHOT_TMP, "r");
+  if (!f) return F("No snapshot");
+  const size_t fileSize = f.size();
+  if (fileSize < SNAPSHOT_HEADER_SIZE + 4) return F("Not a snapshot");
+  if (!apply) {
+    // Whole file CRC
+    uint32_t crc = 0;
+    size_t remaining = fileSize - 4;
+    while (remaining > 0) {
+      const size_t part = remaining > SNAPSHOT_CHUNK_SIZE ? SNAPSHOT_CHUNK_SIZE : remaining;
+      if (f.read(snapshotChunk, part) != part) return F("Read error");
+      crc = crc32Update(crc, snapshotChunk, part);
+      remaining -= part;
+    }
+    if (readSnapshotValue(f, 4) != crc) return F("Checksum error");
+    f.seek(0, fs::SeekSet);
+  }
+  char magic[4];
+  f.read((uint8_t*)magic, 4);
+  const uint16_t format = readSnapshotValue(f, 2);
+  const uint16_t regions = readSnapshotValue(f, 2);
+  const uint32_t pid = readSnapshotValue(f, 4);
+  const uint16_t version = readSnapshotValue(f, 2);
+  readSnapshotValue(f, 2); // Build
+  const uint32_t configSize = readSnapshotValue(f, 4);
+  if (memcmp(magic, "ESPS", 4) != 0 || format != SNAPSHOT_FORMAT) return F("Not a snapshot");
+  if (pid != ESP_PROJECT_PID || version != VERSION || configSize != (uint32_t)getFileSize(BasicSettings_Type))
+    return F("Snapshot is made with another settings layout");
+
+  bool rulesInSnapshot[RULESETS_MAX] = { false };
+  byte openFile = 0xFF;        // Rules file being written
+  bool skipFile = false;       // Rules file is unchanged
+  fs::File rulesFile;
+  if (!apply) {
+    for (byte x = 0; x < RULESETS_MAX; ++x) {
+      snapshotRulesCrc[x] = 0;
+      snapshotRulesSize[x] = 0;
+    }
+  }
+  for (uint16_t r = 0; r < regions; ++r) {
+    const byte file = readSnapshotValue(f, 1);
+    readSnapshotValue(f, 1);
+    const unsigned int encodedSize = readSnapshotValue(f, 2);
+    const uint32_t offset = readSnapshotValue(f, 4);
+    const unsigned int size = readSnapshotValue(f, 2);
+    readSnapshotValue(f, 2);
+    const uint32_t crc = readSnapshotValue(f, 4);
+    if (file >= SNAPSHOT_FILE_RULES + RULESETS_MAX || size > SNAPSHOT_CHUNK_SIZE)
+      return F("Invalid region");
+    if (!decodeSnapshotData(f, encodedSize, snapshotChunk, size) ||
+        crc32Update(0, snapshotChunk, size) != crc)
+      return F("Region checksum error");
+    const String fileName = getSnapshotFileName(file);
+    if (file < SNAPSHOT_FILE_RULES) {
+      fs::File target = SPIFFS.open(fileName, "r");
+      const size_t targetSize = target ? target.size() : 0;
+      if (target) target.close();
+      if (offset + size > targetSize) return String(F("Region outside ")) + fileName;
+      if (apply) {
+        int changed = 0;
+        String err = writeChangedBlocks(fileName.c_str(), offset, snapshotChunk, size, changed);
+        if (err.length()) return err;
+        changedBytes += changed;
+      }
+    } else {
+      const byte ruleSet = file - SNAPSHOT_FILE_RULES;
+      rulesInSnapshot[ruleSet] = true;
+      if (!apply) {
+        snapshotRulesCrc[ruleSet] = crc32Update(snapshotRulesCrc[ruleSet], snapshotChunk, size);
+        snapshotRulesSize[ruleSet] += size;
+      } else {
+        if (file != openFile) {
+          if (rulesFile) rulesFile.close();
+          openFile = file;
+          skipFile = getFileCrc32(fileName, snapshotRulesSize[ruleSet]) == snapshotRulesCrc[ruleSet];
+          // Rules are small, a changed file is written again as a whole.
+          if (!skipFile) rulesFile = SPIFFS.open(fileName, "w");
+        }
+        if (!skipFile) {
+          if (!rulesFile || rulesFile.write(snapshotChunk, size) != size)
+            return String(F("Cannot write ")) + fileName;
+          changedBytes += size;
+        }
+      }
+    }
+    delay(0);
+  }
+  if (rulesFile) rulesFile.close();
+  f.close();
+  if (apply) {
+    for (byte x = 0; x < RULESETS_MAX; ++x) {
+      const String fileName = getSnapshotFileName(SNAPSHOT_FILE_RULES + x);
+      if (!rulesInSnapshot[x] && SPIFFS.exists(fileName))
+        SPIFFS.remove(fileName);
+    }
+  }
+  return String();
+}
+
+void handle_snapshot_post() {
+  checkRAM(F("handle_snapshot_post"));
+  if (!isLoggedIn()) return;
+  int changedBytes = 0;
+  bool tasksStopped = false;
+  snapshotChunk = (byte*)allocBuffer(MEM_POOL_SETTINGS, SNAPSHOT_CHUNK_SIZE);
+  if (snapshotChunk == NULL) {
+    snapshotResult = F("Not enough memory");
+  } else if (snapshotResult.length() == 0) {
+    closeCachedReadFile();
+    // Check everything before writing anything.
+    snapshotResult = processSnapshot(false, changedBytes);
+    if (snapshotResult.length() == 0) {
+      // Stopped with their current settings, started with the imported ones.
+      exitAllTasks();
+      tasksStopped = true;
+      snapshotResult = processSnapshot(true, changedBytes);
+      // Regions were written directly, take over their CRCs on the next load.
+      clearSettingsCrc();
+    }
+  }
+  freeBuffer(MEM_POOL_SETTINGS, snapshotChunk, SNAPSHOT_CHUNK_SIZE);
+  snapshotChunk = NULL;
+  SPIFFS.remove(FILE_SNAPSHOT_TMP);
+  if (tasksStopped) {
+    clearFileETagCache();  // Rules files
+    // Also after a failed import, with the settings as they are now on file.
+    LoadSettings();
+    checkRuleSets();
+    scheduleTaskInitAll();
+  }
+
+  if (snapshotResult.length() != 0) {
+    addLog(LOG_LEVEL_ERROR, String(F("SNAP : ")) + snapshotResult);
+    WebServer.send(400, getWebString(WEB_STR_TEXT_PLAIN), snapshotResult);
+    snapshotResult = String();
+    return;
+  }
+  String log = F("SNAP : Snapshot applied, bytes changed: ");
+  log += changedBytes;
+  addLog(LOG_LEVEL_INFO, log);
+  if (WebServer.arg(F("reboot")) == F("1")) {
+    log += F(", rebooting");
+    cmd_within_mainloop = CMD_REBOOT;
+  }
+  WebServer.send(200, getWebString(WEB_STR_TEXT_PLAIN), log);
+}
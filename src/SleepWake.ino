@@ -0,0 +1,188 @@
+//********************************************************************************
+// Sensor first deep sleep (ESP8266, Settings.DeepSleepSensorFirst)
+// A deep sleep wake normally brings up WiFi, and waits for it, also when the
+// new reads are within the deadband of the ones sent last (SensorReport.ino).
+// With this option the ESP sleeps with WAKE_RF_DISABLED: it wakes without RF,
+// reads the tasks and compares them to the values sent last, which are kept in
+// RTC memory with their age, so the deadband and the max. report interval of
+// a task work across the wakes. The ESP sleeps again as soon as all tasks are
+// read. Only when a task has something to send, it sleeps 100 msec and wakes
+// with RF, where those tasks are read again once WiFi is connected, and sent
+// regardless. With DeepSleepBatchWakes the reads are kept as samples instead,
+// see SleepWakeSamples.ino.
+// Only the tasks using the report settings benefit: every read of the others
+// is to be sent, so they wake the RF each time, as do more than
+// RTC_SLEEP_TASKS filtering tasks. The rules see the reads of the wake with RF.
+// On ESP32 the RTC memory is not used, every wake is with RF.
+//********************************************************************************
+#define SLEEP_WAKE_RF_USEC      100000   // Sleep before the wake with RF to send
+
+struct SleepWakeStruct
+{
+  SleepWakeStruct() : withoutRF(false), readsPending(0), sendTasks(0) {}
+
+  bool withoutRF;          // This wake
+  uint32_t readsPending;   // Tasks not yet read in this wake
+  uint32_t sendTasks;      // Held in the wake without RF, read again when WiFi is connected
+} sleepWake;
+
+boolean saveSleepWakeToRTC()
+{
+  #if defined(ESP32)
+    return false;
+  #else
+    return saveRTCRegion(RTC_REGION_SLEEP);
+  #endif
+}
+
+void clearSleepWakeRTC()
+{
+  memset(&RTC_Sleep, 0, sizeof(RTC_Sleep));
+  for (byte i = 0; i < RTC_SLEEP_TASKS; ++i)
+    RTC_Sleep.TaskIndex[i] = -1;
+}
+
+boolean readSleepWakeFromRTC()
+{
+  #if defined(ESP32)
+    return false;
+  #else
+    if (readRTCRegion(RTC_REGION_SLEEP))
+      return true;
+    clearSleepWakeRTC();
+    return false;
+  #endif
+}
+
+// Called by setup() after the settings are loaded, on every boot.
+void sleepWakeBoot(bool wokeWithoutRF)
+{
+  #if defined(ESP8266)
+  sleepWake.withoutRF = wokeWithoutRF;
+  sleepSamplesBoot();
+  if (lastBootCause != BOOT_CAUSE_DEEP_SLEEP || !Settings.DeepSleepSensorFirst || !readSleepWakeFromRTC()) {
+    clearSleepWakeRTC();
+    if (wokeWithoutRF) {
+      // No RF and nothing to compare with, start over with RF
+      ESP.deepSleep(SLEEP_WAKE_RF_USEC, WAKE_RF_DEFAULT);
+    }
+    return;
+  }
+  if (wokeWithoutRF && !isDeepSleepEnabled()) {
+    // Deep sleep cancelled by GPIO16, the RF is needed to change the settings
+    addLog(LOG_LEVEL_INFO, F("SLEEP: Deep sleep cancelled, rebooting with RF"));
+    ESP.deepSleep(SLEEP_WAKE_RF_USEC, WAKE_RF_DEFAULT);
+  }
+
+  // The last reports, as if sent by this boot
+  for (byte i = 0; i < RTC_SLEEP_TASKS; ++i) {
+    const int8_t TaskIndex = RTC_Sleep.TaskIndex[i];
+    if (TaskIndex < 0 || TaskIndex >= TASKS_MAX) continue;
+    TaskReportStruct& report = taskReport[TaskIndex];
+    for (byte varNr = 0; varNr < VARS_PER_TASK; varNr++)
+      report.value[varNr] = RTC_Sleep.value[i][varNr];
+    const uint32_t maxAge = 0x7FFFFFFF / 1000;
+    report.lastReport = millis() - 1000 * (RTC_Sleep.reportAge[i] < maxAge ? RTC_Sleep.reportAge[i] : maxAge);
+    report.reported = true;
+  }
+
+  if (wokeWithoutRF) {
+    for (byte TaskIndex = 0; TaskIndex < TASKS_MAX; TaskIndex++) {
+      if (Settings.TaskDeviceEnabled[TaskIndex] && Settings.TaskDeviceNumber[TaskIndex] != 0 &&
+          Settings.TaskDeviceDataFeed[TaskIndex] == 0)
+        sleepWake.readsPending |= 1UL << TaskIndex;
+    }
+  } else {
+    // Due in the wake without RF, see sleepWakeConnected()
+    sleepWake.sendTasks = RTC_Sleep.pendingTasks;
+    RTC_Sleep.pendingTasks = 0;
+    RTC_Sleep.wakesWithoutRF = 0;
+  }
+  #endif
+}
+
+// Whether this is a wake without RF: no WiFi, and no sending.
+bool sleepWakeWithoutRF()
+{
+  return sleepWake.withoutRF;
+}
+
+// Called by taskReportDue() when the task is due, returns SLEEP_REPORT_xxx.
+byte sleepWakeHoldReport(struct EventStruct *event)
+{
+  const byte TaskIndex = event->TaskIndex;
+  if (!sleepWake.withoutRF || TaskIndex >= TASKS_MAX) return SLEEP_REPORT_SEND;
+  if (storeSleepSample(event)) return SLEEP_REPORT_STORED;
+  RTC_Sleep.pendingTasks |= 1UL << TaskIndex;
+  return SLEEP_REPORT_HELD;
+}
+
+// Called by loop() when WiFi is connected in a wake with RF.
+void sleepWakeConnected()
+{
+  sendSleepSamplesStart();
+  // The reads at boot were before the connection
+  for (byte TaskIndex = 0; TaskIndex < TASKS_MAX; TaskIndex++) {
+    if ((sleepWake.sendTasks & (1UL << TaskIndex)) == 0) continue;
+    taskReportReset(TaskIndex);
+    schedule_task_device_timer(TaskIndex, millis());
+  }
+  sleepWake.sendTasks = 0;
+}
+
+// Called when a read of the task is done, successful or not.
+void sleepWakeTaskRead(byte TaskIndex)
+{
+  if (TaskIndex < TASKS_MAX)
+    sleepWake.readsPending &= ~(1UL << TaskIndex);
+}
+
+// Called by readyForSleep() in a wake without RF.
+bool sleepWakeReadsDone()
+{
+  return sleepWake.readsPending == 0 || RTC_Sleep.pendingTasks != 0;
+}
+
+// Called by deepSleepStart(). Returns whether the next wake is with RF, and may shorten the sleep.
+bool sleepWakePrepare(int delay, uint32_t& sleepUsec)
+{
+  #if defined(ESP8266)
+  if (!Settings.DeepSleepSensorFirst || !isDeepSleepEnabled()) return true;
+  // The wake after one with RF is without, also when the samples could not be sent
+  const bool wakeWithRF = sleepWake.withoutRF && (RTC_Sleep.pendingTasks != 0 || sleepSamplesDue());
+  if (wakeWithRF) {
+    sleepUsec = SLEEP_WAKE_RF_USEC;
+    delay = 0;
+  }
+  // The last reports, the filtering tasks first
+  byte slot = 0;
+  for (byte TaskIndex = 0; TaskIndex < TASKS_MAX && slot < RTC_SLEEP_TASKS; TaskIndex++) {
+    const TaskReportStruct& report = taskReport[TaskIndex];
+    if (!report.reported) continue;
+    RTC_Sleep.TaskIndex[slot] = TaskIndex;
+    for (byte varNr = 0; varNr < VARS_PER_TASK; varNr++)
+      RTC_Sleep.value[slot][varNr] = report.value[varNr];
+    RTC_Sleep.reportAge[slot] = timePassedSince(report.lastReport) / 1000 + delay;
+    ++slot;
+  }
+  for (; slot < RTC_SLEEP_TASKS; ++slot)
+    RTC_Sleep.TaskIndex[slot] = -1;
+  if (!wakeWithRF) ++RTC_Sleep.wakesWithoutRF;
+  saveSleepWakeToRTC();
+  sleepSamplesPrepare(delay, wakeWithRF);
+
+  if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+    String log = F("SLEEP: Next wake ");
+    if (wakeWithRF) {
+      log += RTC_Sleep.pendingTasks != 0 ? F("with RF to send") : F("with RF to send the samples");
+    } else {
+      log += F("without RF, #");
+      log += RTC_Sleep.wakesWithoutRF;
+    }
+    addLog(LOG_LEVEL_INFO, log);
+  }
+  return wakeWithRF;
+  #else
+  return true;
+  #endif
+}
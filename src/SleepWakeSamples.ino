@@ -0,0 +1,222 @@
+//********************************************************************************
+// Samples of the deep sleep wakes without RF, sent in batches
+// With Settings.DeepSleepBatchWakes set, a due report in a wake without RF (see
+// SleepWake.ino) does not wake the RF: its values are kept as a timestamped
+// record in RTC memory, and with DeepSleepBatchFlash the records which do not
+// fit there are appended to FILE_SLEEP_SAMPLES on SPIFFS. The ESP wakes with
+// RF after DeepSleepBatchWakes wakes, or when the records are full. There the
+// records are sent oldest first, to the controllers which send batches of
+// timestamped records (see addControllerBatchRecord()), and the batches are
+// flushed before the next sleep. Other controllers get the reads of the wake
+// with RF only, as before.
+// The time of a record is counted in seconds over the wakes and sleeps, so the
+// clock only needs to be known when the records are sent (NTP).
+// Every record has its own checksum, a record found damaged is skipped.
+//********************************************************************************
+#define SLEEP_SAMPLES_FILE_MAX    4096   // bytes
+#define SLEEP_SAMPLES_TIME_WAIT  10000   // msec to wait for the time at the wake with RF
+#define SLEEP_SAMPLES_TIME_POLL    100   // msec
+
+struct SleepSamplesStruct
+{
+  SleepSamplesStruct() : fileRecords(0), stored(0), sendStart(0), sent(0), damaged(0) {}
+
+  unsigned long fileRecords;
+  unsigned long stored;      // Records taken in this wake
+  unsigned long sendStart;   // millis() of the wait for the time
+  unsigned long sent;        // Records sent in this wake
+  unsigned long damaged;
+} sleepSamples;
+
+uint16_t getSampleRecordChecksum(RTC_SampleRecord& record)
+{
+  return getChecksum16((byte*)&record, offsetof(RTC_SampleRecord, checksum)) ^
+         getChecksum16((byte*)record.value, sizeof(record.value));
+}
+
+boolean saveSleepSamplesToRTC()
+{
+  #if defined(ESP32)
+    return false;
+  #else
+    return saveRTCRegion(RTC_REGION_SAMPLES);
+  #endif
+}
+
+boolean readSleepSamplesFromRTC()
+{
+  #if defined(ESP32)
+    return false;
+  #else
+    if (readRTCRegion(RTC_REGION_SAMPLES) && RTC_Samples.count <= RTC_SAMPLE_RECORDS)
+      return true;
+    memset(&RTC_Samples, 0, sizeof(RTC_Samples));
+    return false;
+  #endif
+}
+
+void clearSleepSamples()
+{
+  memset(&RTC_Samples, 0, sizeof(RTC_Samples));
+  if (sleepSamples.fileRecords != 0 || SPIFFS.exists(FILE_SLEEP_SAMPLES))
+    SPIFFS.remove(FILE_SLEEP_SAMPLES);
+  sleepSamples.fileRecords = 0;
+}
+
+// Called by sleepWakeBoot() after a deep sleep, with the RTC data of the sleep valid.
+void sleepSamplesBoot()
+{
+  if (Settings.DeepSleepBatchWakes == 0 || !readSleepSamplesFromRTC()) {
+    clearSleepSamples();
+    return;
+  }
+  if (Settings.DeepSleepBatchFlash) {
+    fs::File f = SPIFFS.open(FILE_SLEEP_SAMPLES, "r");
+    if (f) {
+      sleepSamples.fileRecords = f.size() / sizeof(RTC_SampleRecord);
+      f.close();
+    }
+  }
+}
+
+// Keep the values of the read as a sample. Returns false when there is no room.
+bool storeSleepSample(struct EventStruct *event)
+{
+  if (Settings.DeepSleepBatchWakes == 0 || event->TaskIndex >= TASKS_MAX) return false;
+  RTC_SampleRecord record;
+  record.clock = RTC_Samples.clock + millis() / 1000;
+  record.TaskIndex = event->TaskIndex;
+  record.unused = 0;
+  for (byte varNr = 0; varNr < VARS_PER_TASK; varNr++)
+    record.value[varNr] = UserVar[event->BaseVarIndex + varNr];
+  record.checksum = getSampleRecordChecksum(record);
+
+  if (RTC_Samples.count < RTC_SAMPLE_RECORDS) {
+    RTC_Samples.record[RTC_Samples.count++] = record;
+    ++sleepSamples.stored;
+    return true;
+  }
+  if (!Settings.DeepSleepBatchFlash || (sleepSamples.fileRecords + 1) * sizeof(record) > SLEEP_SAMPLES_FILE_MAX)
+    return false;
+  // The oldest go to the file, so the file and then RTC memory are in time order
+  fs::File f = SPIFFS.open(FILE_SLEEP_SAMPLES, sleepSamples.fileRecords == 0 ? "w" : "a");
+  if (!f) return false;
+  const size_t written = f.write(reinterpret_cast<const uint8_t*>(RTC_Samples.record), sizeof(RTC_Samples.record));
+  f.close();
+  if (written != sizeof(RTC_Samples.record)) {
+    addLog(LOG_LEVEL_ERROR, F("SLEEP: Could not write samples file"));
+    return false;
+  }
+  sleepSamples.fileRecords += RTC_SAMPLE_RECORDS;
+  RTC_Samples.record[0] = record;
+  RTC_Samples.count = 1;
+  ++sleepSamples.stored;
+  return true;
+}
+
+// Whether the samples are to be sent at the next wake.
+bool sleepSamplesDue()
+{
+  if (RTC_Samples.count == 0 && sleepSamples.fileRecords == 0) return false;
+  if (RTC_Samples.wakes + 1 >= Settings.DeepSleepBatchWakes) return true;
+  // Full, when the records of another wake like this one would not fit
+  if (RTC_Samples.count + sleepSamples.stored <= RTC_SAMPLE_RECORDS) return false;
+  return !Settings.DeepSleepBatchFlash ||
+         (sleepSamples.fileRecords + RTC_SAMPLE_RECORDS + sleepSamples.stored) * sizeof(RTC_SampleRecord) > SLEEP_SAMPLES_FILE_MAX;
+}
+
+// Called by sleepWakePrepare() before the sleep of delay sec.
+void sleepSamplesPrepare(int delay, bool wakeWithRF)
+{
+  if (Settings.DeepSleepBatchWakes == 0) return;
+  RTC_Samples.clock += millis() / 1000 + delay;
+  if (!wakeWithRF && RTC_Samples.wakes < 255) ++RTC_Samples.wakes;
+  saveSleepSamplesToRTC();
+}
+
+// Called when WiFi is connected in a wake with RF.
+void sendSleepSamplesStart()
+{
+  if (RTC_Samples.count == 0 && sleepSamples.fileRecords == 0) return;
+  sleepSamples.sendStart = millis();
+  setTimer(SLEEP_SAMPLES_TIMER, 0, 0);
+}
+
+void process_sleep_samples_timer()
+{
+  // The controllers need the time of the records
+  if (year() < 2000) {
+    if (timePassedSince(sleepSamples.sendStart) < SLEEP_SAMPLES_TIME_WAIT)
+      setTimer(SLEEP_SAMPLES_TIMER, 0, SLEEP_SAMPLES_TIME_POLL);
+    else
+      addLog(LOG_LEVEL_ERROR, F("SLEEP: No time, samples kept"));
+    return;
+  }
+  if (sleepSamples.fileRecords != 0) {
+    fs::File f = SPIFFS.open(FILE_SLEEP_SAMPLES, "r");
+    RTC_SampleRecord record;
+    while (f && f.read(reinterpret_cast<uint8_t*>(&record), sizeof(record)) == sizeof(record))
+      sendSleepSample(record);
+    if (f) f.close();
+  }
+  for (byte i = 0; i < RTC_Samples.count; ++i)
+    sendSleepSample(RTC_Samples.record[i]);
+  if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+    String log = F("SLEEP: Samples sent: ");
+    log += sleepSamples.sent;
+    if (sleepSamples.damaged != 0) {
+      log += F(", damaged: ");
+      log += sleepSamples.damaged;
+    }
+    addLog(LOG_LEVEL_INFO, log);
+  }
+  clearSleepSamples();
+  saveSleepSamplesToRTC();
+}
+
+// Send the record to the controllers of its task which send timestamped batches.
+void sendSleepSample(RTC_SampleRecord& record)
+{
+  const byte TaskIndex = record.TaskIndex;
+  if (record.checksum != getSampleRecordChecksum(record) || TaskIndex >= TASKS_MAX) {
+    ++sleepSamples.damaged;
+    return;
+  }
+  if (!Settings.TaskDeviceEnabled[TaskIndex]) return;
+  const byte DeviceIndex = getDeviceIndex_from_TaskIndex(TaskIndex);
+  LoadTaskSettings(TaskIndex);
+  PooledEvent pooled;
+  struct EventStruct& TempEvent = *pooled.event;
+  TempEvent.TaskIndex = TaskIndex;
+  TempEvent.BaseVarIndex = TaskIndex * VARS_PER_TASK;
+  TempEvent.sensorType = Device[DeviceIndex].VType;
+
+  const uint32_t age = RTC_Samples.clock + millis() / 1000 - record.clock;
+  controllerSampleMillis = millis() - 1000 * (age < 0x7FFFFFFF / 1000 ? age : 0x7FFFFFFF / 1000);
+  if (controllerSampleMillis == 0) controllerSampleMillis = 1;
+  for (byte x = 0; x < CONTROLLER_MAX; x++) {
+    if (!Settings.TaskDeviceSendData[x][TaskIndex] || !Settings.ControllerEnabled[x] || !Settings.Protocol[x] ||
+        !controllerBatching(x))
+      continue;
+    TempEvent.ControllerIndex = x;
+    TempEvent.idx = Settings.TaskDeviceID[x][TaskIndex];
+    TempEvent.ProtocolIndex = getProtocolIndex_from_ControllerIndex(x);
+    // The controller reads the values of the sample, as for the controller queue
+    setControllerSampleValues(x, TaskIndex, record.value);
+    CPluginSendCall(CPLUGIN_PROTOCOL_SEND, &TempEvent);
+    clearControllerSampleValues(x);
+  }
+  controllerSampleMillis = 0;
+  ++sleepSamples.sent;
+}
+
+// Samples as: in RTC memory/on file, empty when not used
+String getSleepSamplesStats()
+{
+  String result;
+  if (Settings.DeepSleepBatchWakes == 0) return result;
+  result += RTC_Samples.count;
+  result += '/';
+  result += sleepSamples.fileRecords;
+  return result;
+}
@@ -119,14 +119,92 @@ String formatToHex_decimal(unsigned long value, unsigned long factor) {
   return result;
 }
 
+/*********************************************************************************************\
+   Format a float (or double) with a fixed number of decimals into buffer, without allocating a String.
+   Same text as String(value, decimals) without the leading spaces.
+   buffer must hold FORMAT_VALUE_BUFFER_SIZE chars, returns the length.
+  \*********************************************************************************************/
+unsigned int formatFloat(double value, byte decimals, char* buffer)
+{
+  if (isnan(value)) {
+    strcpy_P(buffer, PSTR("nan"));
+    return 3;
+  }
+  if (isinf(value)) {
+    strcpy_P(buffer, PSTR("inf"));
+    return 3;
+  }
+  static const uint32_t decimalFactor[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+  if (decimals > 8) decimals = 8;
+  const double scaled = fabs(value) * decimalFactor[decimals] + 0.5;
+  if (scaled >= 1e18) {
+    // Out of range for the fixed point path
+    dtostrf(value, 0, decimals, buffer);
+    return strlen(buffer);
+  }
+  // Digits in reverse order, at least one before the decimal point.
+  char digits[20];
+  byte count = 0;
+  if (scaled < 4294967295.0) {
+    uint32_t fixed = static_cast<uint32_t>(scaled);
+    do {
+      digits[count++] = '0' + fixed % 10;
+      fixed /= 10;
+    } while (fixed != 0 || count <= decimals);
+  } else {
+    uint64_t fixed = static_cast<uint64_t>(scaled);
+    do {
+      digits[count++] = '0' + fixed % 10;
+      fixed /= 10;
+    } while (fixed != 0 || count <= decimals);
+  }
+  char* pos = buffer;
+  if (value < 0) *pos++ = '-';
+  while (count > decimals)
+    *pos++ = digits[--count];
+  if (decimals > 0) {
+    *pos++ = '.';
+    while (count > 0)
+      *pos++ = digits[--count];
+  }
+  *pos = 0;
+  return pos - buffer;
+}
+
+// All digits of a 64 bit integer, the String class has no conversion for it.
+unsigned int formatInt64(int64_t value, char* buffer)
+{
+  uint64_t magnitude = value < 0 ? -static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+  char digits[20];
+  byte count = 0;
+  do {
+    digits[count++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude != 0);
+  char* pos = buffer;
+  if (value < 0) *pos++ = '-';
+  while (count > 0)
+    *pos++ = digits[--count];
+  *pos = 0;
+  return pos - buffer;
+}
+
+// A task value in its type: integers with all digits, floats and doubles with the decimals.
+unsigned int formatTaskValue(const TaskValueSnapshot& snapshot, byte varNr, byte decimals, char* buffer)
+{
+  if (snapshot.isInteger(varNr))
+    return formatInt64(snapshot.getInt64(varNr), buffer);
+  return formatFloat(snapshot.getDouble(varNr), decimals, buffer);
+}
+
 /*********************************************************************************************\
    Workaround for removing trailing white space when String() converts a float with 0 decimals
   \*********************************************************************************************/
 String toString(float value, byte decimals)
 {
-  String sValue = String(value, decimals);
-  sValue.trim();
-  return sValue;
+  char buffer[FORMAT_VALUE_BUFFER_SIZE];
+  formatFloat(value, decimals, buffer);
+  return String(buffer);
 }
 
 String toString(WiFiMode_t mode)
@@ -155,10 +233,11 @@ String toString(WiFiMode_t mode)
 /*********************************************************************************************\
    Format a value to the set number of decimals
   \*********************************************************************************************/
-String doFormatUserVar(byte TaskIndex, byte rel_index, bool mustCheck, bool& isvalid) {
+// Into buffer of FORMAT_VALUE_BUFFER_SIZE chars, returns the length.
+unsigned int doFormatUserVar(byte TaskIndex, byte rel_index, bool mustCheck, bool& isvalid, char* buffer) {
   isvalid = true;
-  const byte BaseVarIndex = TaskIndex * VARS_PER_TASK;
-  const byte DeviceIndex = getDeviceIndex(Settings.TaskDeviceNumber[TaskIndex]);
+  buffer[0] = 0;
+  const byte DeviceIndex = getDeviceIndex_from_TaskIndex(TaskIndex);
   if (Device[DeviceIndex].ValueCount <= rel_index) {
     isvalid = false;
     String log = F("No sensor value for TaskIndex: ");
@@ -166,22 +245,39 @@ String doFormatUserVar(byte TaskIndex, byte rel_index, bool mustCheck, bool& isv
     log += F(" varnumber: ");
     log += rel_index;
     addLog(LOG_LEVEL_ERROR, log);
-    return "";
+    return 0;
   }
+  TaskValueSnapshot snapshot;
+  getTaskValueSnapshot(TaskIndex, snapshot);
   if (Device[DeviceIndex].VType == SENSOR_TYPE_LONG) {
-    return String((unsigned long)UserVar[BaseVarIndex] + ((unsigned long)UserVar[BaseVarIndex + 1] << 16));
+    ultoa(snapshot.getLong(), buffer, 10);
+    return strlen(buffer);
   }
-  float f(UserVar[BaseVarIndex + rel_index]);
-  if (mustCheck && !isValidFloat(f)) {
+  if (mustCheck && !isValidFloat(snapshot.values[rel_index])) {
     isvalid = false;
     String log = F("Invalid float value for TaskIndex: ");
     log += TaskIndex;
     log += F(" varnumber: ");
     log += rel_index;
     addLog(LOG_LEVEL_DEBUG, log);
-    f = 0;
+    return formatFloat(0, ExtraTaskSettings.TaskDeviceValueDecimals[rel_index], buffer);
   }
-  return toString(f, ExtraTaskSettings.TaskDeviceValueDecimals[rel_index]);
+  return formatTaskValue(snapshot, rel_index, ExtraTaskSettings.TaskDeviceValueDecimals[rel_index], buffer);
+}
+
+String doFormatUserVar(byte TaskIndex, byte rel_index, bool mustCheck, bool& isvalid) {
+  char buffer[FORMAT_VALUE_BUFFER_SIZE];
+  doFormatUserVar(TaskIndex, rel_index, mustCheck, isvalid, buffer);
+  return String(buffer);
+}
+
+unsigned int formatUserVarNoCheck(byte TaskIndex, byte rel_index, char* buffer) {
+  bool isvalid;
+  return doFormatUserVar(TaskIndex, rel_index, false, isvalid, buffer);
+}
+
+unsigned int formatUserVarNoCheck(struct EventStruct *event, byte rel_index, char* buffer) {
+  return formatUserVarNoCheck(event->TaskIndex, rel_index, buffer);
 }
 
 String formatUserVarNoCheck(byte TaskIndex, byte rel_index) {
@@ -362,13 +458,75 @@ int getParamStartPos(const String& string, byte indexFind)
 }
 
 //escapes special characters in strings for use in html-forms
+// Entity for a character which must be escaped in HTML, NULL for other characters.
+const char* htmlEscapeSequence(char c)
+{
+  switch (c) {
+    case '&':  return "&amp;";
+    case '"':  return "&quot;";
+    case '\'': return "&#039;";
+    case '<':  return "&lt;";
+    case '>':  return "&gt;";
+  }
+  return NULL;
+}
+
+// Escaped in place, the text is moved from the end to make room for the entities.
 void htmlEscape(String & html)
 {
-  html.replace("&",  F("&amp;"));
-  html.replace("\"", F("&quot;"));
-  html.replace("'",  F("&#039;"));
-  html.replace("<",  F("&lt;"));
-  html.replace(">",  F("&gt;"));
+  const unsigned int length = html.length();
+  unsigned int escapedLength = length;
+  for (unsigned int i = 0; i < length; ++i) {
+    const char* sequence = htmlEscapeSequence(html[i]);
+    if (sequence != NULL) escapedLength += strlen(sequence) - 1;
+  }
+  if (escapedLength == length) return;
+  if (!html.reserve(escapedLength)) return;
+  while (html.length() < escapedLength)
+    html += ' ';
+  unsigned int dest = escapedLength;
+  for (unsigned int i = length; i > 0 && dest > i; --i) {
+    const char c = html[i - 1];
+    const char* sequence = htmlEscapeSequence(c);
+    if (sequence == NULL) {
+      html[--dest] = c;
+    } else {
+      const unsigned int sequenceLength = strlen(sequence);
+      dest -= sequenceLength;
+      memcpy(&html[dest], sequence, sequenceLength);
+    }
+  }
+}
+
+// URL encoded text is appended, without a temporary String.
+void appendURLEncoded(String& dest, const char* msg)
+{
+  static const char hex[] = "0123456789abcdef";
+  unsigned int length = 0;
+  for (const char* c = msg; *c != '\0'; ++c)
+    length += isURLSafeChar(*c) ? 1 : 3;
+  dest.reserve(dest.length() + length);
+  while (*msg != '\0') {
+    const uint8_t c = *msg;
+    if (isURLSafeChar(c)) {
+      dest += static_cast<char>(c);
+    } else {
+      dest += '%';
+      dest += hex[c >> 4];
+      dest += hex[c & 15];
+    }
+    msg++;
+  }
+}
+
+// Unreserved characters of RFC 3986
+boolean isURLSafeChar(char c)
+{
+  return ('a' <= c && c <= 'z')
+         || ('A' <= c && c <= 'Z')
+         || ('0' <= c && c <= '9')
+         || ('-' == c) || ('_' == c)
+         || ('.' == c) || ('~' == c);
 }
 
 /********************************************************************************************\
@@ -470,85 +628,207 @@ void parseSpecialCharacters(String& s, boolean useURLencode)
 
 // Simple macro to create the replacement string only when needed.
 #define SMART_REPL(T,S) if (s.indexOf(T) != -1) { repl((T), (S), s, useURLencode);}
-#define SMART_REPL_T(T,S) if (s.indexOf(T) != -1) { (S((T), s, useURLencode));}
+/********************************************************************************************\
+  System variables, found by a binary search on the name between the '%' characters.
+  Keep the table sorted by strcmp() order (upper case before lower case).
+  \*********************************************************************************************/
+#define SYSVAR_NAME_LENGTH_MAX  12  // Of the names in the table
+#define SYSVAR_TOKEN_LENGTH_MAX 31  // Between the '%', sunrise and sunset include any offset, e.g. %sunrise-10800s%
+
+enum SystemVariable {
+  SYSVAR_CR, SYSVAR_LF, SYSVAR_N, SYSVAR_R, SYSVAR_SP,
+  SYSVAR_BSSID, SYSVAR_IP, SYSVAR_IP4, SYSVAR_LCLTIME, SYSVAR_LCLTIME_AM, SYSVAR_MAC, SYSVAR_MAC_INT,
+  SYSVAR_RSSI, SYSVAR_SSID, SYSVAR_SYSDAY, SYSVAR_SYSHEAP, SYSVAR_SYSHOUR, SYSVAR_SYSLOAD,
+  SYSVAR_SYSLOAD0, SYSVAR_SYSLOAD1,
+  SYSVAR_SYSMIN, SYSVAR_SYSMONTH, SYSVAR_SYSNAME, SYSVAR_SYSSEC, SYSVAR_SYSSEC_D, SYSVAR_SYSTIME,
+  SYSVAR_SYSTIME_AM, SYSVAR_SYSTM_HM, SYSVAR_SYSTM_HM_AM, SYSVAR_SYSWEEKDAY, SYSVAR_SYSWEEKDAY_S,
+  SYSVAR_SYSYEAR, SYSVAR_SYSYEARS, SYSVAR_UNIT, SYSVAR_UNIXTIME, SYSVAR_UPTIME, SYSVAR_VCC, SYSVAR_WI_CH,
+  SYSVAR_SUNRISE, SYSVAR_SUNSET  // With an optional offset, not in the table
+};
+
+struct SystemVariableName {
+  char name[SYSVAR_NAME_LENGTH_MAX + 1];
+  byte id;
+};
+
+const SystemVariableName systemVariableNames[] PROGMEM = {
+  { "CR",           SYSVAR_CR },
+  { "LF",           SYSVAR_LF },
+  { "N",            SYSVAR_N },
+  { "R",            SYSVAR_R },
+  { "SP",           SYSVAR_SP },
+  { "bssid",        SYSVAR_BSSID },
+  { "ip",           SYSVAR_IP },
+  { "ip4",          SYSVAR_IP4 },
+  { "lcltime",      SYSVAR_LCLTIME },
+  { "lcltime_am",   SYSVAR_LCLTIME_AM },
+  { "mac",          SYSVAR_MAC },
+#if defined(ESP8266)
+  { "mac_int",      SYSVAR_MAC_INT },
+#endif
+  { "rssi",         SYSVAR_RSSI },
+  { "ssid",         SYSVAR_SSID },
+  { "sysday",       SYSVAR_SYSDAY },
+  { "sysheap",      SYSVAR_SYSHEAP },
+  { "syshour",      SYSVAR_SYSHOUR },
+  { "sysload",      SYSVAR_SYSLOAD },
+#if defined(ESP32)
+  { "sysload0",     SYSVAR_SYSLOAD0 },
+  { "sysload1",     SYSVAR_SYSLOAD1 },
+#endif
+  { "sysmin",       SYSVAR_SYSMIN },
+  { "sysmonth",     SYSVAR_SYSMONTH },
+  { "sysname",      SYSVAR_SYSNAME },
+  { "syssec",       SYSVAR_SYSSEC },
+  { "syssec_d",     SYSVAR_SYSSEC_D },
+  { "systime",      SYSVAR_SYSTIME },
+  { "systime_am",   SYSVAR_SYSTIME_AM },
+  { "systm_hm",     SYSVAR_SYSTM_HM },
+  { "systm_hm_am",  SYSVAR_SYSTM_HM_AM },
+  { "sysweekday",   SYSVAR_SYSWEEKDAY },
+  { "sysweekday_s", SYSVAR_SYSWEEKDAY_S },
+  { "sysyear",      SYSVAR_SYSYEAR },
+  { "sysyears",     SYSVAR_SYSYEARS },
+  { "unit",         SYSVAR_UNIT },
+  { "unixtime",     SYSVAR_UNIXTIME },
+  { "uptime",       SYSVAR_UPTIME },
+#if FEATURE_ADC_VCC
+  { "vcc",          SYSVAR_VCC },
+#endif
+  { "wi_ch",        SYSVAR_WI_CH }
+};
+
+// Id of the system variable with this name (zero terminated, without '%'), or -1.
+int findSystemVariable(const char* name)
+{
+  if (strncmp_P(name, PSTR("sunrise"), 7) == 0) return SYSVAR_SUNRISE;
+  if (strncmp_P(name, PSTR("sunset"), 6) == 0) return SYSVAR_SUNSET;
+  int first = 0;
+  int last = sizeof(systemVariableNames) / sizeof(systemVariableNames[0]) - 1;
+  while (first <= last) {
+    const int middle = (first + last) / 2;
+    const int compare = strcmp_P(name, systemVariableNames[middle].name);
+    if (compare == 0) return pgm_read_byte(&systemVariableNames[middle].id);
+    if (compare < 0)
+      last = middle - 1;
+    else
+      first = middle + 1;
+  }
+  return -1;
+}
+
+String formatTimeUnit(const __FlashStringHelper* format, int value)
+{
+  char valueString[8];
+  snprintf_P(valueString, sizeof(valueString), (PGM_P)format, value);
+  return valueString;
+}
+
+// Only called for the variables present, so only those values are computed.
+String getSystemVariableValue(int id, const char* name)
+{
+  const bool disconnected = wifiStatus == ESPEASY_WIFI_DISCONNECTED;
+  switch (id) {
+    case SYSVAR_CR:           return F("\r");
+    case SYSVAR_LF:           return F("\n");
+    case SYSVAR_N:            return F("\\n");
+    case SYSVAR_R:            return F("\\r");
+    case SYSVAR_SP:           return F(" ");
+    case SYSVAR_BSSID:        return disconnected ? F("00:00:00:00:00:00") : WiFi.BSSIDstr();
+    case SYSVAR_IP:           return WiFi.localIP().toString();
+    case SYSVAR_IP4:          return String(WiFi.localIP()[3]); // 4th IP octet
+    case SYSVAR_LCLTIME:      return getDateTimeString('-',':',' ');
+    case SYSVAR_LCLTIME_AM:   return getDateTimeString_ampm('-',':',' ');
+    case SYSVAR_MAC:          return WiFi.macAddress();
+#if defined(ESP8266)
+    case SYSVAR_MAC_INT:      return String(ESP.getChipId()); // Last 24 bit of MAC address as integer, to be used in rules.
+#endif
+    case SYSVAR_RSSI:         return String(disconnected ? 0 : WiFi.RSSI());
+    case SYSVAR_SSID:         return disconnected ? F("--") : WiFi.SSID();
+    case SYSVAR_SYSDAY:       return formatTimeUnit(F("%02d"), day());
+    case SYSVAR_SYSHEAP:      return String(ESP.getFreeHeap());
+    case SYSVAR_SYSHOUR:      return formatTimeUnit(F("%02d"), hour());
+    case SYSVAR_SYSLOAD:      return String(getCPUload());
+#if defined(ESP32)
+    case SYSVAR_SYSLOAD0:     return String(getCoreLoad(0));  // Load per core
+    case SYSVAR_SYSLOAD1:     return String(getCoreLoad(1));
+#endif
+    case SYSVAR_SYSMIN:       return formatTimeUnit(F("%02d"), minute());
+    case SYSVAR_SYSMONTH:     return formatTimeUnit(F("%02d"), month());
+    case SYSVAR_SYSNAME:      return Settings.Name;
+    case SYSVAR_SYSSEC:       return formatTimeUnit(F("%02d"), second());
+    case SYSVAR_SYSSEC_D:     return String(((hour()*60) + minute())*60 + second());
+    case SYSVAR_SYSTIME:      return getTimeString(':');
+    case SYSVAR_SYSTIME_AM:   return getTimeString_ampm(':');
+    case SYSVAR_SYSTM_HM:     return getTimeString(':', false);
+    case SYSVAR_SYSTM_HM_AM:  return getTimeString_ampm(':', false);
+    case SYSVAR_SYSWEEKDAY:   return String(weekday());
+    case SYSVAR_SYSWEEKDAY_S: return weekday_str();
+    case SYSVAR_SYSYEAR:      return formatTimeUnit(F("%04d"), year());
+    case SYSVAR_SYSYEARS:     return formatTimeUnit(F("%02d"), year()%100);
+    case SYSVAR_UNIT:         return String(Settings.Unit);
+    case SYSVAR_UNIXTIME:     return String(getUnixTime());
+    case SYSVAR_UPTIME:       return String(wdcounter / 2);
+#if FEATURE_ADC_VCC
+    case SYSVAR_VCC:          return String(vcc);
+#endif
+    case SYSVAR_WI_CH:        return String(disconnected ? 0 : WiFi.channel());
+    case SYSVAR_SUNRISE:
+    case SYSVAR_SUNSET:
+    {
+      // The offset is part of the name, e.g. %sunrise-1h%
+      String format = '%';
+      format += name;
+      format += '%';
+      const int offset = getSecOffset(format);
+      return id == SYSVAR_SUNRISE ? getSunriseTimeString(':', offset) : getSunsetTimeString(':', offset);
+    }
+  }
+  return String();
+}
+
 void parseSystemVariables(String& s, boolean useURLencode)
 {
   parseSpecialCharacters(s, useURLencode);
-  if (s.indexOf('%') == -1)
+  int start = s.indexOf('%');
+  if (start == -1)
     return; // Nothing to replace
 
-  #if FEATURE_ADC_VCC
-    repl(F("%vcc%"), String(vcc), s, useURLencode);
-  #endif
-  repl(F("%CR%"), F("\r"), s, useURLencode);
-  repl(F("%LF%"), F("\n"), s, useURLencode);
-  repl(F("%SP%"), F(" "), s, useURLencode); //space
-  repl(F("%R%"), F("\\r"), s, useURLencode);
-  repl(F("%N%"), F("\\n"), s, useURLencode);
-  SMART_REPL(F("%ip4%"),WiFi.localIP().toString().substring(WiFi.localIP().toString().lastIndexOf('.')+1)) //4th IP octet
-  SMART_REPL(F("%ip%"),WiFi.localIP().toString())
-  SMART_REPL(F("%rssi%"), String((wifiStatus == ESPEASY_WIFI_DISCONNECTED) ? 0 : WiFi.RSSI()))
-  SMART_REPL(F("%ssid%"), (wifiStatus == ESPEASY_WIFI_DISCONNECTED) ? F("--") : WiFi.SSID())
-  SMART_REPL(F("%bssid%"), (wifiStatus == ESPEASY_WIFI_DISCONNECTED) ? F("00:00:00:00:00:00") : WiFi.BSSIDstr())
-  SMART_REPL(F("%wi_ch%"), String((wifiStatus == ESPEASY_WIFI_DISCONNECTED) ? 0 : WiFi.channel()))
-  SMART_REPL(F("%unit%"), String(Settings.Unit))
-  SMART_REPL(F("%mac%"), String(WiFi.macAddress()))
-  #if defined(ESP8266)
-    SMART_REPL(F("%mac_int%"), String(ESP.getChipId()))  // Last 24 bit of MAC address as integer, to be used in rules.
-  #endif
-
-  if (s.indexOf(F("%sys")) != -1) {
-    SMART_REPL(F("%sysload%"), String(getCPUload()))
-    SMART_REPL(F("%sysheap%"), String(ESP.getFreeHeap()));
-    SMART_REPL(F("%systm_hm%"), getTimeString(':', false))
-    SMART_REPL(F("%systm_hm_am%"), getTimeString_ampm(':', false))
-    SMART_REPL(F("%systime%"), getTimeString(':'))
-    SMART_REPL(F("%systime_am%"), getTimeString_ampm(':'))
-    repl(F("%sysname%"), Settings.Name, s, useURLencode);
-
-    // valueString is being used by the macro.
-    char valueString[5];
-    #define SMART_REPL_TIME(T,F,V) if (s.indexOf(T) != -1) { sprintf_P(valueString, (F), (V)); repl((T),valueString, s, useURLencode);}
-    SMART_REPL_TIME(F("%syshour%"), PSTR("%02d"), hour())
-    SMART_REPL_TIME(F("%sysmin%"), PSTR("%02d"), minute())
-    SMART_REPL_TIME(F("%syssec%"),PSTR("%02d"), second())
-    SMART_REPL_TIME(F("%syssec_d%"),PSTR("%d"), ((hour()*60) + minute())*60 + second());
-    SMART_REPL_TIME(F("%sysday%"), PSTR("%02d"), day())
-    SMART_REPL_TIME(F("%sysmonth%"),PSTR("%02d"), month())
-    SMART_REPL_TIME(F("%sysyear%"), PSTR("%04d"), year())
-    SMART_REPL_TIME(F("%sysyears%"),PSTR("%02d"), year()%100)
-    SMART_REPL(F("%sysweekday%"), String(weekday()))
-    SMART_REPL(F("%sysweekday_s%"), weekday_str())
-    #undef SMART_REPL_TIME
-  }
-  SMART_REPL(F("%lcltime%"), getDateTimeString('-',':',' '))
-  SMART_REPL(F("%lcltime_am%"), getDateTimeString_ampm('-',':',' '))
-  SMART_REPL(F("%uptime%"), String(wdcounter / 2))
-  SMART_REPL(F("%unixtime%"), String(getUnixTime()))
-  SMART_REPL_T(F("%sunset"), replSunSetTimeString)
-  SMART_REPL_T(F("%sunrise"), replSunRiseTimeString)
-}
-
-String getReplacementString(const String& format, String& s) {
-  int startpos = s.indexOf(format);
-  int endpos = s.indexOf('%', startpos + 1);
-  String R = s.substring(startpos, endpos + 1);
-  String log = F("ReplacementString SunTime: ");
-  log += R;
-  log += F(" offset: ");
-  log += getSecOffset(R);
-  addLog(LOG_LEVEL_DEBUG, log);
-  return R;
-}
-
-void replSunRiseTimeString(const String& format, String& s, boolean useURLencode) {
-  String R = getReplacementString(format, s);
-  repl(R, getSunriseTimeString(':', getSecOffset(R)), s, useURLencode);
-}
-
-void replSunSetTimeString(const String& format, String& s, boolean useURLencode) {
-  String R = getReplacementString(format, s);
-  repl(R, getSunsetTimeString(':', getSecOffset(R)), s, useURLencode);
+  // Single pass, text between two '%' is looked up once, unknown names are kept.
+  String result;
+  result.reserve(s.length() + 16);
+  const char* str = s.c_str();
+  const int length = s.length();
+  int pos = 0;
+  while (start != -1) {
+    const char* end = strchr(str + start + 1, '%');
+    if (end == NULL) break;
+    const int nameLength = end - (str + start + 1);
+    int id = -1;
+    char name[SYSVAR_TOKEN_LENGTH_MAX + 1];
+    if (nameLength > 0 && nameLength <= SYSVAR_TOKEN_LENGTH_MAX) {
+      memcpy(name, str + start + 1, nameLength);
+      name[nameLength] = 0;
+      id = findSystemVariable(name);
+    }
+    if (id < 0) {
+      // The closing '%' may be the start of the next variable.
+      start = end - str;
+      continue;
+    }
+    result.concat(s.substring(pos, start));
+    const String value = getSystemVariableValue(id, name);
+    if (useURLencode)
+      appendURLEncoded(result, value.c_str());
+    else
+      result += value;
+    pos = end + 1 - str;
+    start = s.indexOf('%', pos);
+  }
+  if (pos == 0) return; // Nothing replaced
+  if (pos < length)
+    result.concat(s.substring(pos));
+  s = result;
 }
 
 void parseEventVariables(String& s, struct EventStruct *event, boolean useURLencode)
@@ -558,7 +838,9 @@ void parseEventVariables(String& s, struct EventStruct *event, boolean useURLenc
   SMART_REPL(F("%id%"), String(event->idx))
   if (s.indexOf(F("%val")) != -1) {
     if (event->sensorType == SENSOR_TYPE_LONG) {
-      SMART_REPL(F("%val1%"), String((unsigned long)UserVar[event->BaseVarIndex] + ((unsigned long)UserVar[event->BaseVarIndex + 1] << 16)))
+      TaskValueSnapshot snapshot;
+      getTaskValueSnapshot(event->TaskIndex, snapshot);
+      SMART_REPL(F("%val1%"), String(snapshot.getLong()))
     } else {
       SMART_REPL(F("%val1%"), formatUserVarNoCheck(event, 0))
       SMART_REPL(F("%val2%"), formatUserVarNoCheck(event, 1))
@@ -576,7 +858,6 @@ void parseEventVariables(String& s, struct EventStruct *event, boolean useURLenc
   }
 
 }
-#undef SMART_REPL_T
 #undef SMART_REPL
 
 bool getConvertArgument(const String& marker, const String& s, float& argument, int& startIndex, int& endIndex) {
@@ -623,3 +904,176 @@ void parseStandardConversions(String& s, boolean useURLencode) {
   SMART_CONV(F("%c_s2dhms%"), secondsToDayHourMinuteSecond(arg))
   #undef SMART_CONV
 }
+
+/********************************************************************************************\
+  Controller templates
+  A controller compiles its templates once, at CPLUGIN_INIT. compileControllerTemplate() replaces
+  the special characters and the constant system variables (%LF%, ...) right away, the other
+  variables by CONTROLLER_TEMPLATE_TOKEN and a code. appendControllerTemplate() then copies the
+  text and appends the current value of each variable, without a search and replace per send.
+  In a controller template %unixtime% is the time of the sample, see getControllerSampleTime().
+  \*********************************************************************************************/
+#define CONTROLLER_TEMPLATE_TOKEN    '\x01'
+#define CONTROLLER_TEMPLATE_TSKNAME  't'
+#define CONTROLLER_TEMPLATE_VALNAME  'n'
+#define CONTROLLER_TEMPLATE_VALUE    'v'
+#define CONTROLLER_TEMPLATE_ID       'i'
+#define CONTROLLER_TEMPLATE_VAL      '1'   // '1'..'4': %val1%..%val4%
+#define CONTROLLER_TEMPLATE_VNAME    'a'   // 'a'..'d': %vname1%..%vname4%
+#define CONTROLLER_TEMPLATE_START    'A'   // 'A'..'D': %1%..%4%
+#define CONTROLLER_TEMPLATE_END      'E'   // 'E'..'H': %/1%..%/4%
+#define CONTROLLER_TEMPLATE_SYSVAR   0x80  // Plus the SystemVariable id
+
+// Code of the variable (name without '%'), 0 when unknown.
+byte getControllerTemplateCode(const char* name, bool sections)
+{
+  if (strcmp_P(name, PSTR("tskname")) == 0) return CONTROLLER_TEMPLATE_TSKNAME;
+  if (strcmp_P(name, PSTR("valname")) == 0) return CONTROLLER_TEMPLATE_VALNAME;
+  if (strcmp_P(name, PSTR("value")) == 0)   return CONTROLLER_TEMPLATE_VALUE;
+  if (strcmp_P(name, PSTR("id")) == 0)      return CONTROLLER_TEMPLATE_ID;
+  const size_t length = strlen(name);
+  const char last = name[length - 1];
+  if (last >= '1' && last <= '4') {
+    const byte n = last - '1';
+    if (length == 4 && strncmp_P(name, PSTR("val"), 3) == 0)   return CONTROLLER_TEMPLATE_VAL + n;
+    if (length == 6 && strncmp_P(name, PSTR("vname"), 5) == 0) return CONTROLLER_TEMPLATE_VNAME + n;
+    if (sections && length == 1)                   return CONTROLLER_TEMPLATE_START + n;
+    if (sections && length == 2 && name[0] == '/') return CONTROLLER_TEMPLATE_END + n;
+  }
+  const int id = findSystemVariable(name);
+  if (id >= 0) return CONTROLLER_TEMPLATE_SYSVAR + id;
+  return 0;
+}
+
+// With sections the parts between %n% and %/n% are left out for a task with less than n values.
+void compileControllerTemplate(ControllerTemplateStruct& tmpl, const String& source, bool urlEncode, bool sections)
+{
+  String s = source;
+  parseSpecialCharacters(s, urlEncode);
+  tmpl.urlEncode = urlEncode;
+  tmpl.sections = sections;
+  tmpl.conversions = s.indexOf(F("%c_")) != -1;
+  String& compiled = tmpl.compiled;
+  compiled = "";
+  compiled.reserve(s.length());
+  const char* str = s.c_str();
+  int pos = 0;
+  int start = s.indexOf('%');
+  while (start != -1) {
+    const char* end = strchr(str + start + 1, '%');
+    if (end == NULL) break;
+    const int nameLength = end - (str + start + 1);
+    byte code = 0;
+    char name[SYSVAR_TOKEN_LENGTH_MAX + 1];
+    if (nameLength > 0 && nameLength <= SYSVAR_TOKEN_LENGTH_MAX) {
+      memcpy(name, str + start + 1, nameLength);
+      name[nameLength] = 0;
+      code = getControllerTemplateCode(name, sections);
+    }
+    if (code == 0) {
+      // Kept as text, the closing '%' may be the start of the next variable.
+      start = end - str;
+      continue;
+    }
+    compiled.concat(s.substring(pos, start));
+    const int id = code - CONTROLLER_TEMPLATE_SYSVAR;
+    if (code >= CONTROLLER_TEMPLATE_SYSVAR && id <= SYSVAR_SP) {
+      const String value = getSystemVariableValue(id, name);
+      if (urlEncode)
+        appendURLEncoded(compiled, value.c_str());
+      else
+        compiled += value;
+    } else {
+      compiled += CONTROLLER_TEMPLATE_TOKEN;
+      compiled += (char)code;
+      if (code >= CONTROLLER_TEMPLATE_SYSVAR && (id == SYSVAR_SUNRISE || id == SYSVAR_SUNSET)) {
+        // With the offset in the name, e.g. %sunrise-1h%
+        compiled += name;
+        compiled += '%';
+      }
+    }
+    pos = end + 1 - str;
+    start = s.indexOf('%', pos);
+  }
+  compiled.concat(s.substring(pos));
+  tmpl.valid = true;
+}
+
+void appendControllerTemplateValue(String& dest, const char* value, bool urlEncode)
+{
+  if (urlEncode)
+    appendURLEncoded(dest, value);
+  else
+    dest += value;
+}
+
+// Append the template for the event. varIndex and formattedValue are the value of %valname% and
+// %value%, with varIndex CONTROLLER_TEMPLATE_NO_VALUE these (and a '/' in front) are left out.
+void appendControllerTemplate(String& dest, const ControllerTemplateStruct& tmpl, struct EventStruct *event,
+                              byte varIndex, const char* formattedValue)
+{
+  // The conversions need the values in place, so these are done on a copy.
+  String converted;
+  String& out = tmpl.conversions ? converted : dest;
+  LoadTaskSettings(event->TaskIndex);
+  const byte valueCount = getValueCountFromSensorType(event->sensorType);
+  char buffer[FORMAT_VALUE_BUFFER_SIZE];
+  const char* str = tmpl.compiled.c_str();
+  for (const char* c = str; *c != 0; ++c) {
+    if (*c != CONTROLLER_TEMPLATE_TOKEN) {
+      out += *c;
+      continue;
+    }
+    const byte code = *(++c);
+    if (code == 0) break;
+    if (code >= CONTROLLER_TEMPLATE_SYSVAR) {
+      const int id = code - CONTROLLER_TEMPLATE_SYSVAR;
+      String name;
+      if (id == SYSVAR_SUNRISE || id == SYSVAR_SUNSET) {
+        while (c[1] != 0 && c[1] != '%') name += *(++c);
+        if (c[1] == '%') ++c;
+      }
+      if (id == SYSVAR_UNIXTIME)
+        out += getControllerSampleTime();
+      else
+        appendControllerTemplateValue(out, getSystemVariableValue(id, name.c_str()).c_str(), tmpl.urlEncode);
+      continue;
+    }
+    switch (code) {
+      case CONTROLLER_TEMPLATE_TSKNAME:
+        appendControllerTemplateValue(out, ExtraTaskSettings.TaskDeviceName, tmpl.urlEncode);
+        break;
+      case CONTROLLER_TEMPLATE_VALNAME:
+        if (varIndex < VARS_PER_TASK)
+          appendControllerTemplateValue(out, ExtraTaskSettings.TaskDeviceValueNames[varIndex], tmpl.urlEncode);
+        else if (c - 2 >= str && c[-2] == '/' && out.endsWith("/"))
+          out.remove(out.length() - 1);
+        break;
+      case CONTROLLER_TEMPLATE_VALUE:
+        if (varIndex < VARS_PER_TASK && formattedValue != NULL)
+          out += formattedValue;
+        break;
+      case CONTROLLER_TEMPLATE_ID:
+        out += event->idx;
+        break;
+      default:
+        if (code >= CONTROLLER_TEMPLATE_VAL && code < CONTROLLER_TEMPLATE_VAL + VARS_PER_TASK) {
+          formatUserVarNoCheck(event, code - CONTROLLER_TEMPLATE_VAL, buffer);
+          appendControllerTemplateValue(out, buffer, tmpl.urlEncode);
+        } else if (code >= CONTROLLER_TEMPLATE_VNAME && code < CONTROLLER_TEMPLATE_VNAME + VARS_PER_TASK) {
+          appendControllerTemplateValue(out, ExtraTaskSettings.TaskDeviceValueNames[code - CONTROLLER_TEMPLATE_VNAME], tmpl.urlEncode);
+        } else if (code >= CONTROLLER_TEMPLATE_START && code < CONTROLLER_TEMPLATE_START + VARS_PER_TASK &&
+                   code - CONTROLLER_TEMPLATE_START >= valueCount) {
+          // Skip to the end of the section
+          const char endToken[3] = { CONTROLLER_TEMPLATE_TOKEN, (char)(code - CONTROLLER_TEMPLATE_START + CONTROLLER_TEMPLATE_END), 0 };
+          const char* sectionEnd = strstr(c, endToken);
+          if (sectionEnd != NULL) c = sectionEnd + 1;
+        }
+        break;
+    }
+  }
+  if (tmpl.conversions) {
+    parseStandardConversions(converted, tmpl.urlEncode);
+    dest += converted;
+  }
+}
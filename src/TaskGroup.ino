@@ -0,0 +1,174 @@
+//********************************************************************************
+// Task groups
+// Tasks which are to be sampled at the same moment (e.g. vibration, current and
+// temperature for correlation) get the same Settings.TaskDeviceGroup. Only the
+// timer of the first task of the group runs: it reads all enabled tasks of the
+// group in the same scheduler call, in task order, without other timers or web
+// requests in between. A plugin with a two phase read (see SensorConversion.ino)
+// only starts its conversion there, so the conversions of the group run at the
+// same time. The samples of the group are sent with the time of the group read
+// (controllerSampleMillis), and when the last task of the group has its values
+// TaskGroup#<n>=<unix time of the read> is sent to the rules.
+// The skew is measured in usec: from the first to the last start of a read, and
+// from the first to the last task whose values were collected.
+// A member of a group is only read with its group, not by its own interval or
+// a task trigger. Without the controller queue, sendData() applies the message
+// delay between the reads, so groups are meant for a ControllerQueueDepth > 0.
+//********************************************************************************
+#define TASK_GROUPS          4
+
+struct TaskGroupStruct
+{
+  TaskGroupStruct() : members(0), pending(0), startMillis(0), startMicros(0), firstDone(0), lastDone(0),
+    readSkew(0), readSkewMax(0), collectSkew(0), collectSkewMax(0), samples(0), failed(0), incomplete(0) {}
+
+  uint32_t members;              // bit n = task n+1
+  uint32_t pending;              // Read, values not yet collected
+  unsigned long startMillis;     // Of the group read
+  unsigned long startMicros;
+  unsigned long firstDone;       // micros()
+  unsigned long lastDone;
+  unsigned long readSkew;        // usec, of the last sample
+  unsigned long readSkewMax;
+  unsigned long collectSkew;
+  unsigned long collectSkewMax;
+  unsigned long samples;
+  unsigned long failed;          // Samples with a failed read of a task
+  unsigned long incomplete;      // Not complete by the next read of the group
+} taskGroup[TASK_GROUPS];
+
+// Group of the task 0..TASK_GROUPS-1, or -1 when not in a group.
+int getTaskGroup(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return -1;
+  const byte group = Settings.TaskDeviceGroup[TaskIndex];
+  if (group == 0 || group > TASK_GROUPS || Settings.TaskDeviceNumber[TaskIndex] == 0) return -1;
+  return group - 1;
+}
+
+// Called after each load and save of the settings.
+void rebuildTaskGroups() {
+  for (byte g = 0; g < TASK_GROUPS; ++g) {
+    taskGroup[g].members = 0;
+    taskGroup[g].pending = 0;
+  }
+  for (byte x = 0; x < TASKS_MAX; ++x) {
+    const int g = getTaskGroup(x);
+    if (g >= 0 && Settings.TaskDeviceEnabled[x]) taskGroup[g].members |= 1UL << x;
+  }
+}
+
+// The first task of the group, which runs the timer of the group.
+bool isTaskGroupLeader(byte TaskIndex) {
+  const int g = getTaskGroup(TaskIndex);
+  if (g < 0) return false;
+  return taskGroup[g].members != 0 && __builtin_ctz(taskGroup[g].members) == TaskIndex;
+}
+
+// Read by its group, not by its own timer.
+bool isTaskGroupFollower(byte TaskIndex) {
+  const int g = getTaskGroup(TaskIndex);
+  return g >= 0 && (taskGroup[g].members & (1UL << TaskIndex)) && !isTaskGroupLeader(TaskIndex);
+}
+
+// Called from the task timer of the first task of the group.
+void runTaskGroup(byte TaskIndex) {
+  const int g = getTaskGroup(TaskIndex);
+  if (g < 0) return;
+  TaskGroupStruct& group = taskGroup[g];
+  if (group.pending != 0) {
+    ++group.incomplete;
+    group.pending = 0;
+  }
+  for (byte x = 0; x < TASKS_MAX; ++x) {
+    if ((group.members & (1UL << x)) && Settings.TaskDeviceEnabled[x])
+      group.pending |= 1UL << x;
+  }
+  group.startMillis = millis();
+  if (group.startMillis == 0) group.startMillis = 1;
+  group.startMicros = micros();
+  group.firstDone = group.lastDone = 0;
+  unsigned long lastStart = group.startMicros;
+  const uint32_t toRead = group.pending;
+  for (byte x = 0; x < TASKS_MAX; ++x) {
+    if ((toRead & (1UL << x)) == 0) continue;
+    lastStart = micros();
+    SensorSendTask(x);
+    // Not read (e.g. init not ready), or the read failed without a conversion to wait for
+    if ((group.pending & (1UL << x)) && !taskConversion[x].pending)
+      taskGroupDone(x, false);
+  }
+  group.readSkew = lastStart - group.startMicros;
+  if (group.readSkew > group.readSkewMax) group.readSkewMax = group.readSkew;
+}
+
+// millis() of the group read for the samples of the task, 0 when not read by its group.
+unsigned long taskGroupSampleMillis(byte TaskIndex) {
+  const int g = getTaskGroup(TaskIndex);
+  if (g < 0 || (taskGroup[g].pending & (1UL << TaskIndex)) == 0) return 0;
+  return taskGroup[g].startMillis;
+}
+
+// Called when the values of the task were collected, or its read failed.
+void taskGroupDone(byte TaskIndex, bool success) {
+  const int g = getTaskGroup(TaskIndex);
+  if (g < 0) return;
+  TaskGroupStruct& group = taskGroup[g];
+  const uint32_t bit = 1UL << TaskIndex;
+  if ((group.pending & bit) == 0) return;
+  group.pending &= ~bit;
+  const unsigned long now = micros();
+  if (success) {
+    if (group.firstDone == 0) group.firstDone = now;
+    group.lastDone = now;
+  } else {
+    ++group.failed;
+  }
+  if (group.pending != 0) return;
+
+  ++group.samples;
+  group.collectSkew = group.firstDone == 0 ? 0 : group.lastDone - group.firstDone;
+  if (group.collectSkew > group.collectSkewMax) group.collectSkewMax = group.collectSkew;
+  if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+    String log = F("Task : Group ");
+    log += g + 1;
+    log += F(" read skew ");
+    log += group.readSkew;
+    log += F(" usec, collected within ");
+    log += group.collectSkew;
+    log += F(" usec");
+    addLog(LOG_LEVEL_DEBUG, log);
+  }
+  if (Settings.UseRules) {
+    String event = F("TaskGroup#");
+    event += g + 1;
+    event += '=';
+    event += getUnixTime() - timePassedSince(group.startMillis) / 1000;
+    rulesProcessing(event);
+  }
+}
+
+// Group stats per group as: samples/failed/incomplete/read skew/max/collect skew/max (usec), empty when not used.
+String getTaskGroupStats() {
+  String result;
+  for (byte g = 0; g < TASK_GROUPS; ++g) {
+    const TaskGroupStruct& group = taskGroup[g];
+    if (group.members == 0) continue;
+    if (result.length() != 0) result += F(", ");
+    result += g + 1;
+    result += F(": ");
+    result += group.samples;
+    result += '/';
+    result += group.failed;
+    result += '/';
+    result += group.incomplete;
+    result += '/';
+    result += group.readSkew;
+    result += '/';
+    result += group.readSkewMax;
+    result += '/';
+    result += group.collectSkew;
+    result += '/';
+    result += group.collectSkewMax;
+  }
+  return result;
+}
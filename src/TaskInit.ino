@@ -0,0 +1,137 @@
+//********************************************************************************
+// Task init at boot
+// PluginInit() no longer calls PLUGIN_INIT of all tasks within setup(), it
+// queues a TASK_INIT_TIMER per task, and the scheduler runs one init per loop.
+// So the network starts first, and a slow init does not hold up the others:
+// each task starts its reads as soon as its own init is done.
+// A plugin with a slow init (e.g. a warm up, or a bus search) can split it:
+// it calls taskInitDeferred() in PLUGIN_INIT, continues in PLUGIN_TIMER_IN
+// (setPluginTaskTimer()), and calls taskInitDone() when done or failed.
+// Until then the task is not read and gets no periodic calls. Without these
+// calls a task is ready when PLUGIN_INIT returns, as before.
+// The state and the init time per task are shown on the devices page.
+//********************************************************************************
+#define TASK_INIT_NONE       0   // No init yet, or after PLUGIN_EXIT
+#define TASK_INIT_PENDING    1   // Waiting for its TASK_INIT_TIMER
+#define TASK_INIT_BUSY       2   // In PLUGIN_INIT, or deferred by the plugin
+#define TASK_INIT_READY      3
+#define TASK_INIT_FAILED     4
+
+struct TaskInitStruct
+{
+  TaskInitStruct() : start(0), state(TASK_INIT_NONE), deferred(false) {}
+
+  unsigned long start;   // micros() at PLUGIN_INIT
+  byte state;
+  bool deferred;
+} taskInit[TASKS_MAX];
+
+void setTaskInitTimer(unsigned long task_index, unsigned long msecFromNow) {
+  setTimer(TASK_INIT_TIMER, task_index, msecFromNow);
+}
+
+// Called by PluginInit(), instead of PLUGIN_INIT_ALL.
+void scheduleTaskInitAll() {
+  for (byte y = 0; y < TASKS_MAX; y++) {
+    if (!Settings.TaskDeviceEnabled[y] || Settings.TaskDeviceNumber[y] == 0) continue;
+    if (Settings.TaskDeviceDataFeed[y] != 0 || getPluginId(y) < 0) continue;
+    taskInit[y].state = TASK_INIT_PENDING;
+    // In task order, the scheduler runs one timer per call
+    setTaskInitTimer(y, y);
+  }
+}
+
+// PLUGIN_EXIT of every task with a local feed, e.g. before its settings are replaced.
+// scheduleTaskInitAll() starts them again.
+void exitAllTasks() {
+  for (byte y = 0; y < TASKS_MAX; y++) {
+    if (Settings.TaskDeviceNumber[y] == 0 || Settings.TaskDeviceDataFeed[y] != 0) continue;
+    PooledEvent pooled;
+    struct EventStruct& TempEvent = *pooled.event;
+    TempEvent.TaskIndex = y;
+    PluginCall(PLUGIN_EXIT, &TempEvent, dummyString);
+  }
+}
+
+void process_task_init(unsigned long task_index) {
+  if (task_index >= TASKS_MAX || taskInit[task_index].state != TASK_INIT_PENDING) return;
+  if (!Settings.TaskDeviceEnabled[task_index]) {
+    taskInit[task_index].state = TASK_INIT_NONE;
+    return;
+  }
+  PooledEvent pooled;
+  struct EventStruct& TempEvent = *pooled.event;
+  TempEvent.TaskIndex = task_index;
+  PluginCall(PLUGIN_INIT, &TempEvent, dummyString);
+}
+
+// Called by PluginCall() before PLUGIN_INIT.
+void taskInitStart(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return;
+  taskInit[TaskIndex].state = TASK_INIT_BUSY;
+  taskInit[TaskIndex].deferred = false;
+  taskInit[TaskIndex].start = micros();
+}
+
+// Called by PluginCall() after PLUGIN_INIT.
+void taskInitReturned(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return;
+  TaskInitStruct& init = taskInit[TaskIndex];
+  if (init.state == TASK_INIT_BUSY && !init.deferred) {
+    init.state = TASK_INIT_READY;
+    taskInitDuration[TaskIndex] = usecPassedSince(init.start);
+    logSlowTaskInit(TaskIndex);
+  }
+}
+
+// From PLUGIN_INIT: the init continues later, the task waits for taskInitDone().
+void taskInitDeferred(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX || taskInit[TaskIndex].state != TASK_INIT_BUSY) return;
+  taskInit[TaskIndex].deferred = true;
+  // Not read before it is ready, taskInitDone() schedules the first read
+  msecTimerHandler.remove(getMixedId(TASK_DEVICE_TIMER, TaskIndex));
+}
+
+// End of the init of the task, also to be called from PLUGIN_INIT when the sensor is not found.
+void taskInitDone(byte TaskIndex, bool success) {
+  if (TaskIndex >= TASKS_MAX) return;
+  TaskInitStruct& init = taskInit[TaskIndex];
+  if (init.state != TASK_INIT_BUSY) return;
+  init.state = success ? TASK_INIT_READY : TASK_INIT_FAILED;
+  taskInitDuration[TaskIndex] = usecPassedSince(init.start);
+  logSlowTaskInit(TaskIndex);
+  if (init.deferred && success) schedule_task_device_timer(TaskIndex, millis());
+  init.deferred = false;
+  if (!success) {
+    msecTimerHandler.remove(getMixedId(TASK_DEVICE_TIMER, TaskIndex));
+    String log = F("Task : Init of task ");
+    log += TaskIndex + 1;
+    log += F(" failed");
+    addLog(LOG_LEVEL_ERROR, log);
+  }
+}
+
+// Called by PluginCall() after PLUGIN_EXIT.
+void taskInitClear(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return;
+  taskInit[TaskIndex].state = TASK_INIT_NONE;
+  taskInit[TaskIndex].deferred = false;
+}
+
+// Whether the task may be read and get its periodic calls.
+bool taskInitReady(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return false;
+  const byte state = taskInit[TaskIndex].state;
+  return state == TASK_INIT_NONE || state == TASK_INIT_READY;
+}
+
+String getTaskInitStateName(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return "";
+  switch (taskInit[TaskIndex].state) {
+    case TASK_INIT_PENDING: return F("Pending");
+    case TASK_INIT_BUSY:    return F("Initialising");
+    case TASK_INIT_READY:   return F("Ready");
+    case TASK_INIT_FAILED:  return F("Failed");
+  }
+  return "";
+}
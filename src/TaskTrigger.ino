@@ -0,0 +1,97 @@
+//********************************************************************************
+// Task triggers
+// A task can run after other tasks instead of (or besides) its own interval,
+// e.g. a dummy or a formula task using [Other#Value]. The upstream tasks are
+// set per task in Settings.TaskDeviceTriggerMask (bit n = task n+1). From these
+// rebuildTaskTriggers() makes the list of dependents per task after each load
+// and save of the settings, dropping the triggers which would close a loop.
+// sendData() calls taskTriggerDependents(), which schedules the task timer of
+// each dependent to run at once. A dependent already scheduled is not scheduled
+// again, so when several of its inputs send in the same loop it runs once.
+// Its own interval still applies, counted from the last run.
+//********************************************************************************
+
+struct TaskTriggerStruct
+{
+  TaskTriggerStruct() : pending(0), triggered(0), coalesced(0), cycles(0) {
+    for (byte i = 0; i < TASKS_MAX; ++i) dependents[i] = 0;
+  }
+
+  uint32_t dependents[TASKS_MAX];  // Tasks to run after the task sent its values
+  uint32_t pending;                // Scheduled by a trigger, not yet run
+  unsigned long triggered;
+  unsigned long coalesced;
+  byte cycles;                     // Triggers dropped at the last rebuild
+} taskTrigger;
+
+// Depth first through the dependents, a dependent still on the path closes a loop.
+void visitTaskTriggers(byte TaskIndex, byte* state) {
+  state[TaskIndex] = 1;
+  for (byte dep = 0; dep < TASKS_MAX; ++dep) {
+    const uint32_t bit = 1UL << dep;
+    if ((taskTrigger.dependents[TaskIndex] & bit) == 0) continue;
+    if (state[dep] == 1) {
+      taskTrigger.dependents[TaskIndex] &= ~bit;
+      ++taskTrigger.cycles;
+      String log = F("Task : Trigger of task ");
+      log += dep + 1;
+      log += F(" by task ");
+      log += TaskIndex + 1;
+      log += F(" ignored, it would loop");
+      addLog(LOG_LEVEL_ERROR, log);
+    } else if (state[dep] == 0) {
+      visitTaskTriggers(dep, state);
+    }
+  }
+  state[TaskIndex] = 2;
+}
+
+void rebuildTaskTriggers() {
+  for (byte i = 0; i < TASKS_MAX; ++i) taskTrigger.dependents[i] = 0;
+  for (byte dep = 0; dep < TASKS_MAX; ++dep) {
+    if (Settings.TaskDeviceNumber[dep] == 0) continue;
+    for (byte upstream = 0; upstream < TASKS_MAX; ++upstream) {
+      if (upstream != dep && (Settings.TaskDeviceTriggerMask[dep] & (1UL << upstream)))
+        taskTrigger.dependents[upstream] |= 1UL << dep;
+    }
+  }
+  taskTrigger.cycles = 0;
+  byte state[TASKS_MAX] = {0};
+  for (byte i = 0; i < TASKS_MAX; ++i)
+    if (state[i] == 0) visitTaskTriggers(i, state);
+  taskTrigger.pending = 0;
+}
+
+// Called from sendData(), schedules the tasks triggered by the task.
+void taskTriggerDependents(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX || taskTrigger.dependents[TaskIndex] == 0) return;
+  const unsigned long now = millis();
+  for (byte dep = 0; dep < TASKS_MAX; ++dep) {
+    const uint32_t bit = 1UL << dep;
+    if ((taskTrigger.dependents[TaskIndex] & bit) == 0 || !Settings.TaskDeviceEnabled[dep]) continue;
+    if (taskTrigger.pending & bit) {
+      ++taskTrigger.coalesced;
+      continue;
+    }
+    taskTrigger.pending |= bit;
+    ++taskTrigger.triggered;
+    schedule_task_device_timer(dep, now);
+  }
+}
+
+// Called when the task runs, the next trigger schedules it again.
+void taskTriggerDone(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX) return;
+  taskTrigger.pending &= ~(1UL << TaskIndex);
+}
+
+// Trigger stats as: triggered/coalesced/loops dropped
+String getTaskTriggerStats() {
+  String result;
+  result += taskTrigger.triggered;
+  result += '/';
+  result += taskTrigger.coalesced;
+  result += '/';
+  result += taskTrigger.cycles;
+  return result;
+}
@@ -17,10 +17,23 @@ uint32_t syncInterval = 3600;  // time sync will be attempted after this many se
 uint32_t sysTime = 0;
 uint32_t prevMillis = 0;
 uint32_t nextSyncTime = 0;
-timeStruct tsRise, tsSet;
+uint32_t sunRiseUTC = 0;
+uint32_t sunSetUTC = 0;
 timeStruct sunRise;
 timeStruct sunSet;
 
+// Date and location of sunRise and sunSet, these are computed once per local day.
+struct sunCacheStruct {
+  sunCacheStruct() : valid(false), Year(0), Month(0), Day(0), latitude(0.0), longitude(0.0) {}
+
+  bool valid;
+  uint8_t Year;
+  uint8_t Month;
+  uint8_t Day;
+  float latitude;
+  float longitude;
+} sunCache;
+
 byte PrevMinutes = 0;
 
 float sunDeclination(int doy) {
@@ -63,6 +76,7 @@ void calcSunRiseAndSet() {
 	float da = diurnalArc(dec, Settings.Latitude);
 	float rise = 12 - da - eqt - Settings.Longitude / 15.0;
 	float set = 12 + da - eqt - Settings.Longitude / 15.0;
+  timeStruct tsRise, tsSet;
   tsRise.Hour = (int)rise;
   tsRise.Minute = (rise - (int)rise) * 60.0;
   tsSet.Hour = (int)set;
@@ -70,16 +84,41 @@ void calcSunRiseAndSet() {
   tsRise.Day = tsSet.Day = tm.Day;
   tsRise.Month = tsSet.Month = tm.Month;
   tsRise.Year = tsSet.Year = tm.Year;
-  breakTime(toLocal(makeTime(tsRise)), sunRise);
-  breakTime(toLocal(makeTime(tsSet)), sunSet);
+  sunRiseUTC = makeTime(tsRise);
+  sunSetUTC = makeTime(tsSet);
+  breakTime(toLocal(sunRiseUTC), sunRise);
+  breakTime(toLocal(sunSetUTC), sunSet);
+}
+
+// Called by now() when the local time changed, computes the sun times on a new day or location.
+void updateSunRiseAndSet() {
+  if (sunCache.valid && sunCache.Day == tm.Day && sunCache.Month == tm.Month && sunCache.Year == tm.Year &&
+      sunCache.latitude == Settings.Latitude && sunCache.longitude == Settings.Longitude)
+    return;
+  calcSunRiseAndSet();
+  sunCache.valid = true;
+  sunCache.Year = tm.Year;
+  sunCache.Month = tm.Month;
+  sunCache.Day = tm.Day;
+  sunCache.latitude = Settings.Latitude;
+  sunCache.longitude = Settings.Longitude;
+}
+
+// The local times depend on the time zone rules.
+void invalidateSunRiseAndSet() {
+  sunCache.valid = false;
 }
 
 timeStruct getSunRise(int secOffset) {
-	return addSeconds(tsRise, secOffset, true);
+	timeStruct result;
+	breakTime(toLocal(sunRiseUTC + secOffset), result);
+	return result;
 }
 
 timeStruct getSunSet(int secOffset) {
-	return addSeconds(tsSet, secOffset, true);
+	timeStruct result;
+	breakTime(toLocal(sunSetUTC + secOffset), result);
+	return result;
 }
 
 timeStruct addSeconds(const timeStruct& ts, int seconds, bool toLocalTime) {
@@ -148,6 +187,7 @@ void setTime(unsigned long t) {
   applyTimeZone(t);
   nextSyncTime = (uint32_t)t + syncInterval;
   prevMillis = millis();  // restart counting from now (thanks to Korman for this fix)
+  bootProfileStep(BOOT_STEP_TIME);
   if (Settings.UseRules)
   {
     static bool firstUpdate = true;
@@ -161,6 +201,12 @@ uint32_t getUnixTime() {
   return sysTime;
 }
 
+// Unix time in msec of a millis() timestamp, 0 when the time is not set.
+uint64_t getUnixTimeMsec(unsigned long timestamp) {
+  if (sysTime == 0) return 0;
+  return static_cast<uint64_t>(sysTime) * 1000 + timeDiff(prevMillis, timestamp);
+}
+
 int getSecOffset(const String& format) {
 	int position_minus = format.indexOf('-');
 	int position_plus = format.indexOf('+');
@@ -208,23 +254,24 @@ String getSunsetTimeString(char delimiter, int secOffset) {
 
 unsigned long now() {
   // calculate number of seconds passed since last call to now()
-  bool timeSynced = false;
   const long msec_passed = timePassedSince(prevMillis);
   const long seconds_passed = msec_passed / 1000;
   sysTime += seconds_passed;
   prevMillis += seconds_passed * 1000;
   if (nextSyncTime <= sysTime) {
     // nextSyncTime & sysTime are in seconds
-    unsigned long  t = getNtpTime();
-    if (t != 0) {
-      timeSynced = true;
-      setTime(t);
-    }
+    // The time is set when the reply arrives, see process_ntp_timer()
+    startNtpRequest();
   }
+  // Within a second, or between time changes, this is a comparison
+  static bool tmValid = false;
+  static uint32_t tmLocal = 0;
   uint32_t localSystime = toLocal(sysTime);
-  breakTime(localSystime, tm);
-  if (timeSynced) {
-    calcSunRiseAndSet();
+  if (!tmValid || localSystime != tmLocal) {
+    breakTime(localSystime, tm);
+    tmLocal = localSystime;
+    tmValid = true;
+    updateSunRiseAndSet();
   }
   return (unsigned long)localSystime;
 }
@@ -289,7 +336,23 @@ String weekday_str()
 void initTime()
 {
   nextSyncTime = 0;
+  setClockTimer();
+}
+
+// Run process_clock_timer() at the start of the next minute.
+void setClockTimer()
+{
   now();
+  const long msec = (60 - tm.Second) * 1000L - timePassedSince(prevMillis);
+  setTimer(CLOCK_TIMER, 0, msec > 0 ? msec : 0);
+}
+
+// Clock events, the timer is started again by initTime() when NTP is enabled.
+void process_clock_timer()
+{
+  if (!Settings.UseNTP) return;
+  checkTime();
+  setClockTimer();
 }
 
 void checkTime()
@@ -313,56 +376,84 @@ void checkTime()
       if (minute() < 10)
         event += "0";
       event += minute();
-      rulesProcessing(event);
+      // Skip the rules when none of them is for this time
+      if (rulesClockEventWanted(string2TimeLong(event.substring(11))))
+        rulesProcessing(event);
     }
   }
 }
 
 
-unsigned long getNtpTime()
+/********************************************************************************************\
+  NTP client
+  The request is sent from now() and the reply is picked up by the scheduler (NTP_TIMER),
+  so the main loop does not wait for the server.
+  \*********************************************************************************************/
+#define NTP_PACKET_SIZE         48   // NTP time is in the first 48 bytes of message
+#define NTP_REPLY_TIMEOUT     1000   // msec
+#define NTP_POLL_INTERVAL       10   // msec between checks for the reply
+#define NTP_POOL_SERVERS         3   // 0.pool.ntp.org ... 2.pool.ntp.org
+#define NTP_UNIX_OFFSET 2208988800UL // seconds between 1900 and 1970
+
+WiFiUDP ntpUDP;
+bool ntpPending = false;
+unsigned long ntpSendMoment = 0;    // millis() of the request
+byte ntpFailures = 0;               // Selects the next server on failures
+String ntpServerName;
+IPAddress ntpServerIP;              // Only replies from this address are accepted
+
+// Statistics of the last replies, shown on the sysinfo page
+bool ntpSynced = false;
+long ntpOffset = 0;                 // msec the clock was corrected at the last sync
+unsigned long ntpJitter = 0;        // msec, average change of the offset
+unsigned long ntpRTT = 0;           // msec, round trip without the server processing time
+unsigned long ntpReplies = 0;
+unsigned long ntpTimeouts = 0;
+unsigned long ntpRejected = 0;      // Packets that are no reply of the queried server
+
+// The configured host first, the pool servers when it fails.
+String getNtpServerName(byte failures)
 {
+  const bool hostSet = Settings.NTPHost[0] != 0;
+  const byte count = NTP_POOL_SERVERS + (hostSet ? 1 : 0);
+  byte index = failures % count;
+  if (hostSet) {
+    if (index == 0) return Settings.NTPHost;
+    --index;
+  }
+  String name = String(index);
+  name += F(".pool.ntp.org");
+  return name;
+}
+
+// Send a request, returns false when it could not be sent.
+bool startNtpRequest()
+{
+  if (ntpPending) return true;
   if (!Settings.UseNTP || !WiFiConnected(10)) {
-    return 0;
+    return false;
   }
+  // When the server does not reply, retry soon with the next one.
+  nextSyncTime = sysTime + (Settings.NTPHost[0] != 0 ? 20 : 5);
   IPAddress timeServerIP;
+  ntpServerName = getNtpServerName(ntpFailures);
   String log = F("NTP  : NTP host ");
-  if (Settings.NTPHost[0] != 0) {
-    WiFi.hostByName(Settings.NTPHost, timeServerIP);
-    log += Settings.NTPHost;
-    // When single set host fails, retry again in a minute
-    nextSyncTime = sysTime + 20;
-  }
-  else {
-    // Have to do a lookup eacht time, since the NTP pool always returns another IP
-    String ntpServerName = String(random(0, 3));
-    ntpServerName += F(".pool.ntp.org");
-    WiFi.hostByName(ntpServerName.c_str(), timeServerIP);
-    log += ntpServerName;
-    // When pool host fails, retry can be much sooner
-    nextSyncTime = sysTime + 5;
-  }
-
-  log += F(" (");
-  log += timeServerIP.toString();
-  log += F(")");
-
-  if (!hostReachable(timeServerIP)) {
+  log += ntpServerName;
+  if (!resolveHostByName(ntpServerName.c_str(), timeServerIP) || !hostReachable(timeServerIP)) {
     log += F(" unreachable");
     addLog(LOG_LEVEL_INFO, log);
-    return 0;
+    ++ntpFailures;
+    return false;
   }
-
-  WiFiUDP udp;
-  udp.begin(123);
-
-  const int NTP_PACKET_SIZE = 48; // NTP time is in the first 48 bytes of message
-  byte packetBuffer[NTP_PACKET_SIZE]; //buffer to hold incoming & outgoing packets
-
-  log += F(" queried");
+  log += F(" (");
+  log += timeServerIP.toString();
+  log += F(") queried");
   addLog(LOG_LEVEL_DEBUG_MORE, log);
 
-  while (udp.parsePacket() > 0) ; // discard any previously received packets
+  ntpUDP.begin(123);
+  while (ntpUDP.parsePacket() > 0) ; // discard any previously received packets
 
+  byte packetBuffer[NTP_PACKET_SIZE];
   memset(packetBuffer, 0, NTP_PACKET_SIZE);
   packetBuffer[0] = 0b11100011;   // LI, Version, Mode
   packetBuffer[1] = 0;     // Stratum, or type of clock
@@ -372,33 +463,137 @@ unsigned long getNtpTime()
   packetBuffer[13]  = 0x4E;
   packetBuffer[14]  = 49;
   packetBuffer[15]  = 52;
-  udp.beginPacket(timeServerIP, 123); //NTP requests are to port 123
-  udp.write(packetBuffer, NTP_PACKET_SIZE);
-  udp.endPacket();
-
-  uint32_t beginWait = millis();
-  while (!timeOutReached(beginWait + 1000)) {
-    int size = udp.parsePacket();
-    if (size >= NTP_PACKET_SIZE) {
-      udp.read(packetBuffer, NTP_PACKET_SIZE);  // read packet into the buffer
-      unsigned long secsSince1900;
-      // convert four bytes starting at location 40 to a long integer
-      secsSince1900 =  (unsigned long)packetBuffer[40] << 24;
-      secsSince1900 |= (unsigned long)packetBuffer[41] << 16;
-      secsSince1900 |= (unsigned long)packetBuffer[42] << 8;
-      secsSince1900 |= (unsigned long)packetBuffer[43];
-			if (loglevelActiveFor(LOG_LEVEL_DEBUG_MORE)) {
-	      String log = F("NTP  : NTP replied: ");
-	      log += timePassedSince(beginWait);
-	      log += F(" mSec");
-	      addLog(LOG_LEVEL_DEBUG_MORE, log);
-			}
-      return secsSince1900 - 2208988800UL;
+  ntpUDP.beginPacket(timeServerIP, 123); //NTP requests are to port 123
+  ntpUDP.write(packetBuffer, NTP_PACKET_SIZE);
+  ntpUDP.endPacket();
+  ntpServerIP = timeServerIP;
+  ntpSendMoment = millis();
+  ntpPending = true;
+  setTimer(NTP_TIMER, 0, NTP_POLL_INTERVAL);
+  return true;
+}
+
+// NTP timestamp (seconds since 1900 and 32 bit fraction) at offset in the packet, in msec.
+uint64_t getNtpTimestampMsec(const byte* packet, byte offset)
+{
+  uint32_t seconds = 0;
+  uint32_t fraction = 0;
+  for (byte i = 0; i < 4; ++i) {
+    seconds = (seconds << 8) | packet[offset + i];
+    fraction = (fraction << 8) | packet[offset + 4 + i];
+  }
+  return static_cast<uint64_t>(seconds) * 1000 + ((static_cast<uint64_t>(fraction) * 1000) >> 32);
+}
+
+// Called by the scheduler until the reply is received or the timeout is reached.
+// A server reply (mode 4) of the queried server, from port 123, with its clock synchronized.
+bool validNtpReply(const byte* packet)
+{
+  if (ntpUDP.remoteIP() != ntpServerIP || ntpUDP.remotePort() != 123) return false;
+  if ((packet[0] & 0x07) != 4) return false;
+  // Stratum 0 is a kiss-o'-death, leap indicator 3 an unsynchronized server clock.
+  return packet[1] != 0 && (packet[0] >> 6) != 3;
+}
+
+void process_ntp_timer()
+{
+  if (!ntpPending) return;
+  byte packetBuffer[NTP_PACKET_SIZE];
+  int size = ntpUDP.parsePacket();
+  while (size >= NTP_PACKET_SIZE) {
+    ntpUDP.read(packetBuffer, NTP_PACKET_SIZE);
+    if (validNtpReply(packetBuffer)) break;
+    ++ntpRejected;
+    if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+      String log = F("NTP  : Ignored packet from ");
+      log += ntpUDP.remoteIP().toString();
+      log += ':';
+      log += ntpUDP.remotePort();
+      addLog(LOG_LEVEL_DEBUG, log);
     }
-    delay(10);
+    size = ntpUDP.parsePacket();
+  }
+  if (size < NTP_PACKET_SIZE) {
+    if (timePassedSince(ntpSendMoment) < NTP_REPLY_TIMEOUT) {
+      setTimer(NTP_TIMER, 0, NTP_POLL_INTERVAL);
+      return;
+    }
+    ntpPending = false;
+    ntpUDP.stop();
+    ++ntpTimeouts;
+    ++ntpFailures;
+    addLog(LOG_LEVEL_DEBUG_MORE, F("NTP  : No reply"));
+    // Next attempt should not use a cached address of a server that does not reply.
+    invalidateHostByName(ntpServerName.c_str());
+    return;
+  }
+  const unsigned long receiveMoment = millis();
+  ntpUDP.stop();
+  ntpPending = false;
+
+  // Round trip, without the time between the receive (t2) and transmit (t3) timestamps of the server.
+  const uint64_t serverReceive = getNtpTimestampMsec(packetBuffer, 32);
+  const uint64_t serverTransmit = getNtpTimestampMsec(packetBuffer, 40);
+  const unsigned long roundTrip = timeDiff(ntpSendMoment, receiveMoment);
+  const unsigned long serverTime = serverTransmit >= serverReceive ? serverTransmit - serverReceive : 0;
+  ntpRTT = roundTrip > serverTime ? roundTrip - serverTime : 0;
+
+  // The reply took about half the round trip to arrive.
+  const uint64_t unixMsec = serverTransmit + ntpRTT / 2 - static_cast<uint64_t>(NTP_UNIX_OFFSET) * 1000;
+  if (ntpSynced) {
+    const uint64_t clockMsec = static_cast<uint64_t>(sysTime) * 1000 + timePassedSince(prevMillis);
+    const long offset = static_cast<long>(static_cast<int64_t>(unixMsec - clockMsec));
+    const unsigned long change = abs(offset - ntpOffset);
+    ntpJitter = ntpReplies > 1 ? (3 * ntpJitter + change) / 4 : change;
+    ntpOffset = offset;
+  }
+  ntpSynced = true;
+  ++ntpReplies;
+  ntpFailures = 0;
+
+  setTime(static_cast<unsigned long>(unixMsec / 1000));
+  // Count the next second from the moment it started.
+  prevMillis -= static_cast<uint32_t>(unixMsec % 1000);
+  now();
+  // The clock may have jumped, the next minute starts at another moment.
+  if (Settings.UseNTP)
+    setClockTimer();
+
+  if (loglevelActiveFor(LOG_LEVEL_DEBUG_MORE)) {
+    String log = F("NTP  : NTP replied: RTT ");
+    log += ntpRTT;
+    log += F(" mSec offset ");
+    log += ntpOffset;
+    log += F(" mSec");
+    addLog(LOG_LEVEL_DEBUG_MORE, log);
   }
-  addLog(LOG_LEVEL_DEBUG_MORE, F("NTP  : No reply"));
-  return 0;
+}
+
+// Like "12 ms / 3 ms / 25 ms (pool.ntp.org)"
+String getNtpStats()
+{
+  String result;
+  if (!ntpSynced) {
+    result = F("Not synced");
+  } else {
+    result += ntpOffset;
+    result += F(" ms / ");
+    result += ntpJitter;
+    result += F(" ms / ");
+    result += ntpRTT;
+    result += F(" ms (");
+    result += ntpServerName;
+    result += ')';
+  }
+  if (ntpTimeouts != 0) {
+    result += F(" Timeouts: ");
+    result += ntpTimeouts;
+  }
+  if (ntpRejected != 0) {
+    result += F(" Ignored: ");
+    result += ntpRejected;
+  }
+  return result;
 }
 
 
@@ -407,6 +602,11 @@ unsigned long getNtpTime()
   Unsigned long Timer timeOut check
 \*********************************************************************************************/
 
+long timeDiff(const unsigned long prev, const unsigned long next) HOT_IRAM_ATTR;
+long timePassedSince(unsigned long timestamp) HOT_IRAM_ATTR;
+long usecPassedSince(unsigned long timestamp) HOT_IRAM_ATTR;
+boolean timeOutReached(unsigned long timer) HOT_IRAM_ATTR;
+
 // Return the time difference as a signed value, taking into account the timers may overflow.
 // Returned timediff is between -24.9 days and +24.9 days.
 // Returned value is positive when "next" is after "prev"
@@ -0,0 +1,322 @@
+//********************************************************************************
+// Time series store
+// Keeps a history of task values in a fixed size SPIFFS file, fed from sendData().
+// There are three tiers, each a ring of SPIFFS pages: raw samples (at most one
+// per task every TIMESERIES_RAW_INTERVAL) and min/max/avg per 5 minutes and per hour.
+// Records are collected in a RAM page per tier and only written when the page is
+// full (or before sleep/reboot), so flash writes are page sized, append only and
+// bounded by the number of tasks. Queried with /timeseries.
+//********************************************************************************
+#ifdef FEATURE_TIMESERIES
+
+#define TIMESERIES_RAW_INTERVAL       60    // sec, min. time between raw samples of a task
+#define TIMESERIES_RAW_PAGES          64    // 21 samples per page
+#define TIMESERIES_5MIN_PAGES         64    // 12 records per page
+#define TIMESERIES_HOUR_PAGES         32    // 12 records per page
+#define TIMESERIES_PAGE_SIZE         SPIFFS_BLOCK_SIZE
+
+#define TIMESERIES_TIER_RAW            0
+#define TIMESERIES_TIER_5MIN           1
+#define TIMESERIES_TIER_HOUR           2
+#define TIMESERIES_TIER_COUNT          3
+
+// Page: uint32_t sequence (0 = never written), followed by records of the tier.
+// A record with time 0 is unused. All times are UTC unix time, for the tiers the
+// start of the period.
+struct TimeSeriesSample {
+  uint32_t time;
+  uint8_t  task;
+  uint8_t  valueNr;
+  uint16_t reserved;
+  float    value;
+};
+
+struct TimeSeriesAggregate {
+  uint32_t time;
+  uint8_t  task;
+  uint8_t  valueNr;
+  uint16_t count;
+  float    min;
+  float    max;
+  float    avg;
+};
+
+struct TimeSeriesAccumulator {
+  float    min;
+  float    max;
+  float    sum;
+  uint16_t count;
+};
+
+struct TimeSeriesTier {
+  TimeSeriesTier() : page(0), used(0), sequence(1), dirty(false) {}
+
+  uint16_t page;      // Page in the ring being filled
+  uint8_t  used;      // Records in buffer
+  uint32_t sequence;  // Sequence of the page being filled
+  bool     dirty;     // buffer has records not written yet
+  byte     buffer[TIMESERIES_PAGE_SIZE];
+};
+
+TimeSeriesTier timeSeriesTiers[TIMESERIES_TIER_COUNT];
+TimeSeriesAccumulator timeSeriesAcc[2][TASKS_MAX * VARS_PER_TASK]; // 5 min and hour
+uint32_t timeSeriesPeriod[2] = { 0, 0 };
+uint32_t timeSeriesLastRaw[TASKS_MAX] = { 0 };
+bool timeSeriesReady = false;
+bool timeSeriesFailed = false;
+
+uint16_t getTimeSeriesPages(byte tier) {
+  switch (tier) {
+    case TIMESERIES_TIER_RAW:  return TIMESERIES_RAW_PAGES;
+    case TIMESERIES_TIER_5MIN: return TIMESERIES_5MIN_PAGES;
+  }
+  return TIMESERIES_HOUR_PAGES;
+}
+
+uint8_t getTimeSeriesRecordSize(byte tier) {
+  return (tier == TIMESERIES_TIER_RAW) ? sizeof(TimeSeriesSample) : sizeof(TimeSeriesAggregate);
+}
+
+uint8_t getTimeSeriesRecordsPerPage(byte tier) {
+  return (TIMESERIES_PAGE_SIZE - sizeof(uint32_t)) / getTimeSeriesRecordSize(tier);
+}
+
+uint32_t getTimeSeriesInterval(byte tier) {
+  switch (tier) {
+    case TIMESERIES_TIER_5MIN: return 300;
+    case TIMESERIES_TIER_HOUR: return 3600;
+  }
+  return 0;
+}
+
+int getTimeSeriesPageOffset(byte tier, uint16_t page) {
+  int offset = 0;
+  for (byte i = 0; i < tier; ++i)
+    offset += getTimeSeriesPages(i) * TIMESERIES_PAGE_SIZE;
+  return offset + page * TIMESERIES_PAGE_SIZE;
+}
+
+int getTimeSeriesFileSize() {
+  return getTimeSeriesPageOffset(TIMESERIES_TIER_COUNT, 0);
+}
+
+uint32_t getTimeSeriesSequence(const byte* page) {
+  uint32_t sequence;
+  memcpy(&sequence, page, sizeof(sequence));
+  return sequence;
+}
+
+uint32_t getTimeSeriesRecordTime(const byte* record) {
+  uint32_t time;
+  memcpy(&time, record, sizeof(time));
+  return time;
+}
+
+void clearTimeSeriesBuffer(byte tier) {
+  TimeSeriesTier& t = timeSeriesTiers[tier];
+  memset(t.buffer, 0, TIMESERIES_PAGE_SIZE);
+  memcpy(t.buffer, &t.sequence, sizeof(t.sequence));
+  t.used = 0;
+  t.dirty = false;
+}
+
+size_t getSpiffsFreeBytes() {
+#if defined(ESP8266)
+  fs::FSInfo fs_info;
+  SPIFFS.info(fs_info);
+  return fs_info.totalBytes - fs_info.usedBytes;
+#endif
+#if defined(ESP32)
+  return SPIFFS.totalBytes() - SPIFFS.usedBytes();
+#endif
+}
+
+// Open (or create) the store and find the page being filled for every tier.
+bool initTimeSeries() {
+  if (timeSeriesReady) return true;
+  if (timeSeriesFailed) return false;
+  const int fileSize = getTimeSeriesFileSize();
+  fs::File f = SPIFFS.open(FILE_TIMESERIES, "r");
+  if (!f || (int)f.size() != fileSize) {
+    if (f) f.close();
+    SPIFFS.remove(FILE_TIMESERIES);
+    if (getSpiffsFreeBytes() < (size_t)fileSize + 4 * TIMESERIES_PAGE_SIZE) {
+      addLog(LOG_LEVEL_ERROR, F("TS   : Not enough SPIFFS space for the time series store"));
+      timeSeriesFailed = true;
+      return false;
+    }
+    f = SPIFFS.open(FILE_TIMESERIES, "w");
+    if (!f || !writeBlocks(f, 0, NULL, fileSize)) {
+      if (f) f.close();
+      FileError(__LINE__, FILE_TIMESERIES);
+      timeSeriesFailed = true;
+      return false;
+    }
+    f.close();
+    for (byte tier = 0; tier < TIMESERIES_TIER_COUNT; ++tier) {
+      timeSeriesTiers[tier] = TimeSeriesTier();
+      clearTimeSeriesBuffer(tier);
+    }
+    addLog(LOG_LEVEL_INFO, String(F("TS   : Created time series store, bytes: ")) + fileSize);
+    timeSeriesReady = true;
+    return true;
+  }
+  for (byte tier = 0; tier < TIMESERIES_TIER_COUNT; ++tier) {
+    TimeSeriesTier& t = timeSeriesTiers[tier];
+    t = TimeSeriesTier();
+    uint32_t maxSequence = 0;
+    for (uint16_t page = 0; page < getTimeSeriesPages(tier); ++page) {
+      uint32_t sequence = 0;
+      f.seek(getTimeSeriesPageOffset(tier, page), fs::SeekSet);
+      f.read((uint8_t*)&sequence, sizeof(sequence));
+      if (sequence > maxSequence) {
+        maxSequence = sequence;
+        t.page = page;
+      }
+    }
+    if (maxSequence == 0) {
+      clearTimeSeriesBuffer(tier);
+      continue;
+    }
+    // Continue filling the newest page.
+    f.seek(getTimeSeriesPageOffset(tier, t.page), fs::SeekSet);
+    f.read(t.buffer, TIMESERIES_PAGE_SIZE);
+    t.sequence = maxSequence;
+    const uint8_t recordSize = getTimeSeriesRecordSize(tier);
+    while (t.used < getTimeSeriesRecordsPerPage(tier) &&
+           getTimeSeriesRecordTime(t.buffer + sizeof(uint32_t) + t.used * recordSize) != 0) {
+      ++t.used;
+    }
+    if (t.used == getTimeSeriesRecordsPerPage(tier)) {
+      t.page = (t.page + 1) % getTimeSeriesPages(tier);
+      ++t.sequence;
+      clearTimeSeriesBuffer(tier);
+    }
+  }
+  f.close();
+  timeSeriesReady = true;
+  return true;
+}
+
+bool writeTimeSeriesPage(byte tier) {
+  TimeSeriesTier& t = timeSeriesTiers[tier];
+  fs::File f = SPIFFS.open(FILE_TIMESERIES, "r+");
+  const int offset = getTimeSeriesPageOffset(tier, t.page);
+  bool success = f && f.seek(offset, fs::SeekSet) && writeBlocks(f, offset, t.buffer, TIMESERIES_PAGE_SIZE);
+  if (f) f.close();
+  if (!success) {
+    // File removed or SPIFFS full, recreate on the next sample.
+    FileError(__LINE__, FILE_TIMESERIES);
+    timeSeriesReady = false;
+    return false;
+  }
+  t.dirty = false;
+  return true;
+}
+
+void appendTimeSeriesRecord(byte tier, const void* record) {
+  TimeSeriesTier& t = timeSeriesTiers[tier];
+  const uint8_t recordSize = getTimeSeriesRecordSize(tier);
+  memcpy(t.buffer + sizeof(uint32_t) + t.used * recordSize, record, recordSize);
+  ++t.used;
+  t.dirty = true;
+  if (t.used < getTimeSeriesRecordsPerPage(tier)) return;
+  if (!writeTimeSeriesPage(tier)) {
+    // Drop the page, the store is opened again on the next sample.
+    clearTimeSeriesBuffer(tier);
+    return;
+  }
+  t.page = (t.page + 1) % getTimeSeriesPages(tier);
+  ++t.sequence;
+  clearTimeSeriesBuffer(tier);
+}
+
+void addToTimeSeriesAccumulator(byte acc, byte index, float min, float max, float sum, uint16_t count) {
+  TimeSeriesAccumulator& a = timeSeriesAcc[acc][index];
+  if (a.count == 0) {
+    a.min = min;
+    a.max = max;
+    a.sum = sum;
+  } else {
+    if (min < a.min) a.min = min;
+    if (max > a.max) a.max = max;
+    a.sum += sum;
+  }
+  a.count += count;
+}
+
+// Write the aggregates of the finished period of the 5 min (acc 0) or hour (acc 1) tier.
+void closeTimeSeriesPeriod(byte acc) {
+  const byte tier = acc + TIMESERIES_TIER_5MIN;
+  const uint32_t periodStart = timeSeriesPeriod[acc] * getTimeSeriesInterval(tier);
+  for (byte index = 0; index < TASKS_MAX * VARS_PER_TASK; ++index) {
+    TimeSeriesAccumulator& a = timeSeriesAcc[acc][index];
+    if (a.count == 0) continue;
+    TimeSeriesAggregate record;
+    record.time = periodStart;
+    record.task = index / VARS_PER_TASK;
+    record.valueNr = index % VARS_PER_TASK;
+    record.count = a.count;
+    record.min = a.min;
+    record.max = a.max;
+    record.avg = a.sum / a.count;
+    appendTimeSeriesRecord(tier, &record);
+    if (acc == 0) {
+      // The hour tier is made of the 5 minute aggregates.
+      const uint32_t hour = periodStart / getTimeSeriesInterval(TIMESERIES_TIER_HOUR);
+      if (hour != timeSeriesPeriod[1]) {
+        if (timeSeriesPeriod[1] != 0) closeTimeSeriesPeriod(1);
+        timeSeriesPeriod[1] = hour;
+      }
+      addToTimeSeriesAccumulator(1, index, a.min, a.max, a.sum, a.count);
+    }
+    a.count = 0;
+  }
+}
+
+// Add the current values of a task, called from sendData().
+void addTimeSeriesValues(byte TaskIndex) {
+  if (TaskIndex >= TASKS_MAX || year() < 2000) return;
+  const byte DeviceIndex = getDeviceIndex_from_TaskIndex(TaskIndex);
+  if (!initTimeSeries()) return;
+  const uint32_t time = getUnixTime();
+  const uint32_t period = time / getTimeSeriesInterval(TIMESERIES_TIER_5MIN);
+  if (period != timeSeriesPeriod[0]) {
+    if (timeSeriesPeriod[0] != 0) closeTimeSeriesPeriod(0);
+    timeSeriesPeriod[0] = period;
+  }
+  const bool storeRaw = timeSeriesLastRaw[TaskIndex] == 0 ||
+                        (time - timeSeriesLastRaw[TaskIndex]) >= TIMESERIES_RAW_INTERVAL;
+  if (storeRaw) timeSeriesLastRaw[TaskIndex] = time;
+  TaskValueSnapshot snapshot;
+  getTaskValueSnapshot(TaskIndex, snapshot);
+  for (byte varNr = 0; varNr < Device[DeviceIndex].ValueCount && varNr < VARS_PER_TASK; ++varNr) {
+    float value = snapshot.values[varNr];
+    if (Device[DeviceIndex].VType == SENSOR_TYPE_LONG) {
+      if (varNr != 0) break;
+      value = snapshot.getLong();
+    }
+    if (!isValidFloat(value)) continue;
+    if (storeRaw) {
+      TimeSeriesSample sample;
+      sample.time = time;
+      sample.task = TaskIndex;
+      sample.valueNr = varNr;
+      sample.reserved = 0;
+      sample.value = value;
+      appendTimeSeriesRecord(TIMESERIES_TIER_RAW, &sample);
+    }
+    addToTimeSeriesAccumulator(0, BaseVarIndex + varNr, value, value, value, 1);
+  }
+}
+
+// Write the partly filled pages, before sleep or reboot.
+void flushTimeSeries() {
+  if (!timeSeriesReady) return;
+  for (byte tier = 0; tier < TIMESERIES_TIER_COUNT; ++tier) {
+    if (timeSeriesTiers[tier].dirty)
+      writeTimeSeriesPage(tier);
+  }
+}
+
+#endif // FEATURE_TIMESERIES
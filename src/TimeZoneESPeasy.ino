@@ -12,6 +12,12 @@ uint32_t m_stdUTC = 0;       // std time start for given/current year, given in
 uint32_t m_dstLoc = 0;       // dst start for given/current year, given in local time
 uint32_t m_stdLoc = 0;       // std time start for given/current year, given in local time
 
+// The UTC offset between two time changes, as found by the last toLocal() outside of it.
+// Within the interval toLocal() is an addition, m_offsetUntilUTC is the next time change.
+uint32_t m_offsetFromUTC = 0;
+uint32_t m_offsetUntilUTC = 0;   // Exclusive, the interval is empty when equal
+int16_t  m_offsetMinutes = 0;
+
 /*
 // Examples time zones
 // Australia Eastern Time Zone (Sydney, Melbourne)
@@ -84,6 +90,8 @@ void applyTimeZone(uint32_t curTime) {
 void setTimeZone(const TimeChangeRule& dstStart, const TimeChangeRule& stdStart, uint32_t curTime) {
   m_dst = dstStart;
   m_std = stdStart;
+  m_offsetFromUTC = m_offsetUntilUTC = 0;
+  invalidateSunRiseAndSet();
   if (calcTimeChanges(year(curTime))) {
     logTimeZoneInfo();
   }
@@ -206,13 +214,38 @@ bool calcTimeChanges(int yr)
  *----------------------------------------------------------------------*/
 uint32_t toLocal(uint32_t utc)
 {
+    if (utc >= m_offsetFromUTC && utc < m_offsetUntilUTC)
+        return utc + m_offsetMinutes * SECS_PER_MIN;
+
     // recalculate the time change points if needed
-    if (year(utc) != year(m_dstUTC)) calcTimeChanges(year(utc));
+    const int yr = year(utc);
+    if (yr != year(m_dstUTC)) calcTimeChanges(yr);
 
-    if (utcIsDST(utc))
-        return utc + m_dst.offset * SECS_PER_MIN;
-    else
-        return utc + m_std.offset * SECS_PER_MIN;
+    m_offsetMinutes = utcIsDST(utc) ? m_dst.offset : m_std.offset;
+    setOffsetInterval(utc, yr);
+    return utc + m_offsetMinutes * SECS_PER_MIN;
+}
+
+/*----------------------------------------------------------------------*
+ * The interval around utc without a time change, within its year, for  *
+ * the next toLocal() calls.                                            *
+ *----------------------------------------------------------------------*/
+void setOffsetInterval(uint32_t utc, int yr)
+{
+    timeStruct tm;
+    tm.Day = 1;
+    tm.Month = 1;
+    tm.Year = yr - 1970;
+    uint32_t from = makeTime(tm);
+    ++tm.Year;
+    uint32_t until = makeTime(tm);
+    const uint32_t changes[2] = { m_dstUTC, m_stdUTC };
+    for (byte i = 0; i < 2; ++i) {
+        if (changes[i] <= utc && changes[i] > from) from = changes[i];
+        if (changes[i] > utc && changes[i] < until) until = changes[i];
+    }
+    m_offsetFromUTC = from;
+    m_offsetUntilUTC = until;
 }
 
 
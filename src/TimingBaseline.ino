@@ -0,0 +1,215 @@
+//********************************************************************************
+// Timing baseline
+// The p90 of the plugin and misc timing stats is saved as a reference in
+// FILE_TIMING_BASELINE, with the build it was taken on (timingbaseline,save or the
+// button on the timing stats page). Plugins are stored by plugin number, so the
+// baseline still matches after a build with another plugin set.
+// Before the stats are logged and cleared (TIMER_STATISTICS) each stat with at
+// least TIMING_BASELINE_MIN_COUNT calls is compared with its baseline. A p90 above
+// the threshold percentage of the baseline is a regression: logged once per stat
+// per boot, and System#PerfRegression=<percent of the baseline> is sent for the
+// worst one. The timing stats page shows the baseline and marks the regressions.
+//********************************************************************************
+#define TIMING_BASELINE_MAGIC        0x54424C31  // "TBL1"
+#define TIMING_BASELINE_MIN_COUNT    20          // calls in the stats before they are compared
+#define TIMING_BASELINE_MIN_USEC     100         // p90 of the baseline taken as at least this
+#define TIMING_BASELINE_THRESHOLD    150         // default, % of the baseline p90
+#define TIMING_BASELINE_BUILD_SIZE   48
+#define TIMING_BASELINE_PLUGIN_KEY   0x10000UL   // | plugin number << 5 | function, misc stats are their id
+#define TIMING_BASELINE_NO_KEY       0xFFFFFFFFUL
+
+struct TimingBaselineHeader
+{
+  uint32_t magic;
+  uint16_t threshold;
+  uint16_t count;
+  uint32_t time;                                 // Unix time it was saved
+  char build[TIMING_BASELINE_BUILD_SIZE];
+};
+
+struct TimingBaselineRecord
+{
+  uint32_t key;
+  uint32_t p90;
+};
+
+struct TimingBaselineEntry
+{
+  TimingBaselineEntry() : p90(0), reported(false) {}
+
+  uint32_t p90;
+  bool reported;
+};
+
+std::map<uint32_t, TimingBaselineEntry> timingBaseline;
+bool timingBaselineLoaded = false;
+uint16_t timingBaselineThreshold = TIMING_BASELINE_THRESHOLD;
+uint32_t timingBaselineTime = 0;
+String timingBaselineBuild;
+unsigned long timingRegressions = 0;
+
+uint32_t getPluginTimingBaselineKey(int pluginStatsKey) {
+  return TIMING_BASELINE_PLUGIN_KEY | (static_cast<uint32_t>(getPluginNumber(pluginStatsKey / 32)) << 5) | (pluginStatsKey % 32);
+}
+
+// Like "P_33 PLUGIN_READ", or the name of the misc stat
+String getTimingBaselineKeyName(uint32_t key) {
+  if ((key & TIMING_BASELINE_PLUGIN_KEY) == 0) return getMiscStatsName(key);
+  String name = F("P_");
+  name += (key >> 5) & 0xFF;
+  name += ' ';
+  name += getPluginFunctionName(key & 31);
+  name.trim();
+  return name;
+}
+
+void loadTimingBaseline() {
+  if (timingBaselineLoaded) return;
+  timingBaselineLoaded = true;
+  timingBaseline.clear();
+  if (!SPIFFS.exists(FILE_TIMING_BASELINE)) return;
+  fs::File f = SPIFFS.open(FILE_TIMING_BASELINE, "r");
+  if (!f) return;
+  TimingBaselineHeader header;
+  if (f.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header) || header.magic != TIMING_BASELINE_MAGIC) {
+    f.close();
+    addLog(LOG_LEVEL_ERROR, F("PERF : Invalid timing baseline"));
+    return;
+  }
+  header.build[TIMING_BASELINE_BUILD_SIZE - 1] = 0;
+  timingBaselineBuild = header.build;
+  timingBaselineThreshold = header.threshold;
+  timingBaselineTime = header.time;
+  TimingBaselineRecord record;
+  for (uint16_t i = 0; i < header.count; ++i) {
+    if (f.read(reinterpret_cast<uint8_t*>(&record), sizeof(record)) != sizeof(record)) break;
+    timingBaseline[record.key].p90 = record.p90;
+  }
+  f.close();
+}
+
+// Save the p90 of the current stats with enough calls, returns the number of stats saved.
+// threshold: in %, the default for 100 or less
+int saveTimingBaseline(uint16_t threshold) {
+  loadTimingBaseline();
+  timingBaseline.clear();
+  for (auto& x: pluginStats) {
+    if (x.second.getCount() >= TIMING_BASELINE_MIN_COUNT)
+      timingBaseline[getPluginTimingBaselineKey(x.first)].p90 = x.second.getPercentile(90);
+  }
+  for (auto& x: miscStats) {
+    if (x.second.getCount() >= TIMING_BASELINE_MIN_COUNT)
+      timingBaseline[x.first].p90 = x.second.getPercentile(90);
+  }
+  timingBaselineThreshold = threshold > 100 ? threshold : TIMING_BASELINE_THRESHOLD;
+  timingBaselineTime = getUnixTime();
+  timingBaselineBuild = getSystemBuildString();
+
+  TimingBaselineHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = TIMING_BASELINE_MAGIC;
+  header.threshold = timingBaselineThreshold;
+  header.count = timingBaseline.size();
+  header.time = timingBaselineTime;
+  strncpy(header.build, timingBaselineBuild.c_str(), TIMING_BASELINE_BUILD_SIZE - 1);
+  fs::File f = SPIFFS.open(FILE_TIMING_BASELINE, "w");
+  if (!f) {
+    addLog(LOG_LEVEL_ERROR, F("PERF : Cannot save the timing baseline"));
+    return 0;
+  }
+  f.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+  for (auto& x: timingBaseline) {
+    const TimingBaselineRecord record = { x.first, x.second.p90 };
+    f.write(reinterpret_cast<const uint8_t*>(&record), sizeof(record));
+  }
+  f.close();
+  if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+    String log = F("PERF : Timing baseline of ");
+    log += timingBaseline.size();
+    log += F(" stats saved, threshold ");
+    log += timingBaselineThreshold;
+    log += '%';
+    addLog(LOG_LEVEL_INFO, log);
+  }
+  return timingBaseline.size();
+}
+
+void clearTimingBaseline() {
+  timingBaseline.clear();
+  timingBaselineLoaded = true;
+  timingBaselineBuild = "";
+  timingBaselineTime = 0;
+  timingRegressions = 0;
+  SPIFFS.remove(FILE_TIMING_BASELINE);
+}
+
+// Baseline p90 of the stat, 0 when not in the baseline.
+uint32_t getTimingBaselineP90(uint32_t key) {
+  loadTimingBaseline();
+  auto it = timingBaseline.find(key);
+  return it == timingBaseline.end() ? 0 : it->second.p90;
+}
+
+// p90 of the stats in % of the baseline, 0 when not compared (no baseline, too few calls).
+unsigned long getTimingBaselinePercent(uint32_t key, const TimingStats& stats) {
+  const uint32_t p90 = getTimingBaselineP90(key);
+  if (p90 == 0 || stats.getCount() < TIMING_BASELINE_MIN_COUNT) return 0;
+  const uint32_t base = p90 < TIMING_BASELINE_MIN_USEC ? TIMING_BASELINE_MIN_USEC : p90;
+  return (100UL * stats.getPercentile(90)) / base;
+}
+
+bool isTimingRegression(uint32_t key, const TimingStats& stats) {
+  return getTimingBaselinePercent(key, stats) > timingBaselineThreshold;
+}
+
+void checkTimingRegression(uint32_t key, const TimingStats& stats, unsigned long& worst) {
+  const unsigned long percent = getTimingBaselinePercent(key, stats);
+  if (percent <= timingBaselineThreshold) return;
+  TimingBaselineEntry& entry = timingBaseline[key];
+  if (entry.reported) return;
+  entry.reported = true;
+  ++timingRegressions;
+  if (percent > worst) worst = percent;
+  if (loglevelActiveFor(LOG_LEVEL_ERROR)) {
+    String log = F("PERF : Regression ");
+    log += getTimingBaselineKeyName(key);
+    log += F(" p90 ");
+    log += stats.getPercentile(90);
+    log += F(" usec, baseline ");
+    log += entry.p90;
+    log += F(" usec (");
+    log += percent;
+    log += F("%) of ");
+    log += timingBaselineBuild;
+    addLog(LOG_LEVEL_ERROR, log);
+  }
+}
+
+// Called before the timing stats are logged and cleared.
+void checkTimingBaseline() {
+  loadTimingBaseline();
+  if (timingBaseline.empty()) return;
+  unsigned long worst = 0;
+  for (auto& x: pluginStats)
+    checkTimingRegression(getPluginTimingBaselineKey(x.first), x.second, worst);
+  for (auto& x: miscStats)
+    checkTimingRegression(x.first, x.second, worst);
+  if (worst != 0 && Settings.UseRules) {
+    String event = F("System#PerfRegression=");
+    event += worst;
+    rulesProcessing(event);
+  }
+}
+
+// Baseline as: stats/threshold %/regressions, empty when there is none.
+String getTimingBaselineStats() {
+  loadTimingBaseline();
+  String result;
+  if (timingBaseline.empty()) return result;
+  result += timingBaseline.size();
+  result += '/';
+  result += timingBaselineThreshold;
+  result += '/';
+  result += timingRegressions;
+  return result;
+}
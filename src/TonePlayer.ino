@@ -0,0 +1,294 @@
+//********************************************************************************
+// Tone player
+// Plays tones and RTTTL melodies in the background, so the tone and rtttl
+// commands return at once. A melody is parsed once into a list of notes, which
+// a periodic Ticker plays: on ESP8266 by analogWrite() at the note frequency,
+// on ESP32 by a LEDC channel.
+// Melodies wait in a queue while another one is playing, tonePlayerStop() ends
+// the one playing and drops the queue.
+// The Ticker callback and the loop share counters which each have one writer,
+// the loop frees the notes of the finished melodies in processTonePlayer().
+//********************************************************************************
+#define TONE_PLAYER_QUEUE          4    // Melodies, including the one playing
+#define TONE_PLAYER_MAX_NOTES    256
+#define TONE_PLAYER_TICK_MS        5    // Note duration resolution
+#define TONE_PLAYER_DUTY         100    // ESP8266 analogWrite() range 0-1023
+#define TONE_PLAYER_LEDC_BITS     10
+
+struct TonePlayerNote
+{
+  uint16_t frequency;   // 0 is a pause
+  uint16_t duration;    // msec
+};
+
+struct TonePlayerMelody
+{
+  TonePlayerMelody() : notes(NULL), count(0), pin(-1), channel(-1) {}
+
+  TonePlayerNote* notes;
+  uint16_t count;
+  int8_t pin;
+  int8_t channel;       // ESP32 LEDC channel
+};
+
+struct TonePlayerStruct
+{
+  TonePlayerStruct() : queued(0), played(0), freed(0), stopRequests(0), stopsHandled(0),
+    position(0), remaining(0), running(false), notes(0), rejected(0) {}
+
+  TonePlayerMelody queue[TONE_PLAYER_QUEUE];
+  volatile unsigned long queued;        // Written by the loop
+  volatile unsigned long played;        // Written by the Ticker
+  unsigned long freed;                  // Loop only
+  volatile unsigned long stopRequests;  // Written by the loop
+  unsigned long stopsHandled;           // Ticker only
+  uint16_t position;                    // Next note of the melody playing
+  unsigned int remaining;               // msec of the current note
+  bool running;                         // Ticker attached
+  Ticker ticker;
+
+  volatile unsigned long notes;         // Played
+  unsigned long rejected;               // Invalid or queue full
+} tonePlayer;
+
+void tonePlayerOutput(const struct TonePlayerMelody& melody, uint16_t frequency) {
+  #if defined(ESP32)
+    if (melody.channel >= 0)
+      ledcWriteTone(melody.channel, frequency);
+  #else
+    if (frequency > 0) {
+      analogWriteFreq(frequency);
+      //NOTE: analogwrite reserves IRAM and uninitalized ram.
+      analogWrite(melody.pin, TONE_PLAYER_DUTY);
+    } else {
+      analogWrite(melody.pin, 0);
+    }
+  #endif
+}
+
+// Ticker callback, not an interrupt: on ESP8266 it runs between loop() passes,
+// on ESP32 in the timer task.
+void tonePlayerTick() {
+  if (tonePlayer.stopRequests != tonePlayer.stopsHandled) {
+    tonePlayer.stopsHandled = tonePlayer.stopRequests;
+    if (tonePlayer.played != tonePlayer.queued)
+      tonePlayerOutput(tonePlayer.queue[tonePlayer.played % TONE_PLAYER_QUEUE], 0);
+    tonePlayer.played = tonePlayer.queued;
+    tonePlayer.position = 0;
+    tonePlayer.remaining = 0;
+    return;
+  }
+  if (tonePlayer.remaining > TONE_PLAYER_TICK_MS) {
+    tonePlayer.remaining -= TONE_PLAYER_TICK_MS;
+    return;
+  }
+  tonePlayer.remaining = 0;
+  while (tonePlayer.played != tonePlayer.queued) {
+    const TonePlayerMelody& melody = tonePlayer.queue[tonePlayer.played % TONE_PLAYER_QUEUE];
+    if (tonePlayer.position < melody.count) {
+      const TonePlayerNote& note = melody.notes[tonePlayer.position++];
+      tonePlayerOutput(melody, note.frequency);
+      tonePlayer.remaining = note.duration;
+      ++tonePlayer.notes;
+      return;
+    }
+    tonePlayerOutput(melody, 0);
+    tonePlayer.position = 0;
+    ++tonePlayer.played;
+  }
+}
+
+#if defined(ESP32)
+// LEDC channel of a pin, shared with analogWriteESP32(). -1 when all are in use.
+int8_t tonePlayerChannel(int8_t pin) {
+  for (byte x = 0; x < 16; x++)
+    if (ledChannelPin[x] == pin) return x;
+  for (byte x = 0; x < 16; x++) {
+    if (ledChannelPin[x] == -1) {
+      ledChannelPin[x] = pin;
+      ledcSetup(x, 1000, TONE_PLAYER_LEDC_BITS);
+      ledcAttachPin(pin, x);
+      return x;
+    }
+  }
+  return -1;
+}
+#endif
+
+// Queue a list of notes allocated with allocBuffer(MEM_POOL_TONE), the player frees it.
+bool tonePlayerQueue(int8_t pin, struct TonePlayerNote* notes, uint16_t count) {
+  processTonePlayer();
+  if (pin < 0 || count == 0 || tonePlayer.queued - tonePlayer.freed >= TONE_PLAYER_QUEUE) {
+    freeBuffer(MEM_POOL_TONE, notes, count * sizeof(TonePlayerNote));
+    ++tonePlayer.rejected;
+    return false;
+  }
+  TonePlayerMelody& melody = tonePlayer.queue[tonePlayer.queued % TONE_PLAYER_QUEUE];
+  melody.notes = notes;
+  melody.count = count;
+  melody.pin = pin;
+  #if defined(ESP32)
+    melody.channel = tonePlayerChannel(pin);
+  #endif
+  ++tonePlayer.queued;
+  if (!tonePlayer.running) {
+    tonePlayer.running = true;
+    tonePlayer.ticker.attach_ms(TONE_PLAYER_TICK_MS, tonePlayerTick);
+  }
+  return true;
+}
+
+// Called from backgroundtasks(): free the finished melodies, stop the Ticker when idle.
+void processTonePlayer() {
+  while (tonePlayer.freed != tonePlayer.played) {
+    TonePlayerMelody& melody = tonePlayer.queue[tonePlayer.freed % TONE_PLAYER_QUEUE];
+    freeBuffer(MEM_POOL_TONE, melody.notes, melody.count * sizeof(TonePlayerNote));
+    melody.notes = NULL;
+    melody.count = 0;
+    ++tonePlayer.freed;
+  }
+  if (tonePlayer.running && tonePlayer.played == tonePlayer.queued &&
+      tonePlayer.stopRequests == tonePlayer.stopsHandled) {
+    tonePlayer.ticker.detach();
+    tonePlayer.running = false;
+  }
+}
+
+bool tonePlayerTone(int8_t pin, unsigned int frequency, unsigned long duration) {
+  TonePlayerNote* note = static_cast<TonePlayerNote*>(allocBuffer(MEM_POOL_TONE, sizeof(TonePlayerNote)));
+  if (note == NULL) {
+    ++tonePlayer.rejected;
+    return false;
+  }
+  note->frequency = frequency;
+  note->duration = duration > 0xFFFF ? 0xFFFF : duration;
+  return tonePlayerQueue(pin, note, 1);
+}
+
+// Parse a RTTTL string (name:d=N,o=N,b=NNN:notes) and queue it.
+// Returns false when it is not valid or the queue is full.
+bool tonePlayerRtttl(int8_t pin, const char* p) {
+  static const uint16_t frequencies[] = {
+    262, 277, 294, 311, 330, 349, 370, 392, 415, 440, 466, 494,
+    523, 554, 587, 622, 659, 698, 740, 784, 831, 880, 932, 988,
+    1047, 1109, 1175, 1245, 1319, 1397, 1480, 1568, 1661, 1760, 1865, 1976,
+    2093, 2217, 2349, 2489, 2637, 2794, 2960, 3136, 3322, 3520, 3729, 3951
+  };
+  // Note letters a-g as semitone above c
+  static const byte semitones[] = { 9, 11, 0, 2, 4, 5, 7 };
+
+  p = strchr(p, ':');                    // ignore name
+  if (p == NULL) {
+    ++tonePlayer.rejected;
+    return false;
+  }
+  p++;
+
+  byte default_dur = 4;
+  byte default_oct = 6;
+  int bpm = 63;
+  // format: d=N,o=N,b=NNN:
+  while (*p && *p != ':') {
+    const char key = *p;
+    int num = 0;
+    if (p[1] == '=') p += 2;
+    else p++;
+    while (isdigit(*p)) num = (num * 10) + (*p++ - '0');
+    if (key == 'd' && num > 0) default_dur = num;
+    if (key == 'o' && num >= 4 && num <= 7) default_oct = num;
+    if (key == 'b' && num > 0) bpm = num;
+    if (*p == ',') p++;
+    else if (*p != ':') break;
+  }
+  if (*p != ':') {
+    ++tonePlayer.rejected;
+    return false;
+  }
+  p++;
+
+  uint16_t count = 1;
+  for (const char* c = p; *c; ++c)
+    if (*c == ',') ++count;
+  if (count > TONE_PLAYER_MAX_NOTES) {
+    ++tonePlayer.rejected;
+    return false;
+  }
+  TonePlayerNote* notes = static_cast<TonePlayerNote*>(allocBuffer(MEM_POOL_TONE, count * sizeof(TonePlayerNote)));
+  if (notes == NULL) {
+    ++tonePlayer.rejected;
+    return false;
+  }
+
+  // BPM usually expresses the number of quarter notes per minute
+  const long wholenote = (60 * 1000L / bpm) * 4;  // this is the time for whole note (in milliseconds)
+  uint16_t n = 0;
+  while (*p && n < count) {
+    while (*p == ' ') p++;
+    // first, get note duration, if available
+    int num = 0;
+    while (isdigit(*p)) num = (num * 10) + (*p++ - '0');
+    long duration = wholenote / (num ? num : default_dur);
+
+    // now get the note, 0 is a pause
+    int note = -1;
+    if (*p >= 'a' && *p <= 'g') note = semitones[*p - 'a'];
+    else if (*p != 'p') break;
+    p++;
+    // now, get optional '#' sharp
+    if (*p == '#') {
+      note++;
+      p++;
+    }
+    // now, get optional '.' dotted note
+    if (*p == '.') {
+      duration += duration / 2;
+      p++;
+    }
+    // now, get scale
+    int scale = default_oct;
+    if (isdigit(*p)) scale = *p++ - '0';
+    // dotted after the scale is used as well
+    if (*p == '.') {
+      duration += duration / 2;
+      p++;
+    }
+    while (*p == ' ') p++;
+    if (*p == ',') p++;       // skip comma for next note (or we may be at the end)
+    else if (*p) break;
+
+    int index = (scale - 4) * 12 + note;
+    notes[n].frequency = (note < 0 || index < 0 || index >= static_cast<int>(sizeof(frequencies) / sizeof(frequencies[0]))) ? 0 : frequencies[index];
+    notes[n].duration = duration > 0xFFFF ? 0xFFFF : duration;
+    ++n;
+  }
+  if (*p || n == 0) {
+    freeBuffer(MEM_POOL_TONE, notes, count * sizeof(TonePlayerNote));
+    ++tonePlayer.rejected;
+    return false;
+  }
+  // A trailing comma leaves unused notes, they are skipped as pauses without duration
+  if (n < count) {
+    for (uint16_t i = n; i < count; ++i) {
+      notes[i].frequency = 0;
+      notes[i].duration = 0;
+    }
+  }
+  return tonePlayerQueue(pin, notes, count);
+}
+
+// Stop the melody playing and drop the queue.
+void tonePlayerStop() {
+  if (!tonePlayer.running) return;
+  ++tonePlayer.stopRequests;
+}
+
+// Tone player stats as: queued/notes/rejected
+String getTonePlayerStats() {
+  String result;
+  result += tonePlayer.queued - tonePlayer.played;
+  result += '/';
+  result += tonePlayer.notes;
+  result += '/';
+  result += tonePlayer.rejected;
+  return result;
+}
@@ -0,0 +1,51 @@
+#ifdef FEATURE_TRACE
+//********************************************************************************
+// Execution trace
+// Keeps the most recent scheduler dispatches, plugin calls, controller sends, web
+// handlers and rules events with their start time and duration (usec).
+// /trace streams them as Chrome trace JSON, to open in chrome://tracing or ui.perfetto.dev
+// /trace?freeze=<msec> stops recording after a loop which took longer than that, so
+// the events leading up to it are kept. /trace?resume=1 starts recording again.
+//********************************************************************************
+#ifdef ESP32
+  #define TRACE_MAX_EVENTS  512
+#else
+  #define TRACE_MAX_EVENTS  128
+#endif
+
+struct traceEventStruct {
+  uint32_t start;
+  uint32_t duration;
+  byte category;  // DISPATCH_xxx
+  byte id;
+  byte arg;
+};
+
+traceEventStruct traceEvents[TRACE_MAX_EVENTS];
+unsigned int traceHead = 0;
+unsigned int traceCount = 0;
+bool traceFrozen = false;
+unsigned long traceFreezeLoopUsec = 0;  // 0 = never freeze
+
+void traceEvent(byte category, byte id, byte arg, unsigned long start) {
+  if (traceFrozen) return;
+  traceEventStruct& event = traceEvents[traceHead];
+  event.start = start;
+  event.duration = usecPassedSince(start);
+  event.category = category;
+  event.id = id;
+  event.arg = arg;
+  traceHead = (traceHead + 1) % TRACE_MAX_EVENTS;
+  if (traceCount < TRACE_MAX_EVENTS) ++traceCount;
+}
+
+// Called with the duration of every loop.
+void checkTraceFreeze(long loopUsec) {
+  if (traceFreezeLoopUsec == 0 || traceFrozen || loopUsec < static_cast<long>(traceFreezeLoopUsec)) return;
+  traceFrozen = true;
+  String log = F("TRACE: Frozen after a loop of ");
+  log += loopUsec / 1000;
+  log += F(" msec");
+  addLog(LOG_LEVEL_INFO, log);
+}
+#endif
@@ -0,0 +1,150 @@
+//********************************************************************************
+// Server-sent events (/events)
+// Pushes task values when they are sent (event "taskvalues") and, with ?log=1,
+// new web log lines (event "log"), over one long lived connection per client.
+//********************************************************************************
+#define WEB_EVENTS_MAX_CLIENTS      2      // Each client keeps a TCP connection and its buffers
+#define WEB_EVENTS_KEEPALIVE    15000      // msec between keep alive comments
+#define WEB_EVENTS_LOG_BURST        5      // Max. log lines per client per call
+
+struct WebEventClient {
+  WebEventClient() : logSequence(0), lastSend(0), active(false), sendLog(false) {}
+
+  WiFiClient client;
+  unsigned long logSequence; // Last log line sent
+  unsigned long lastSend;
+  bool active;
+  bool sendLog;
+};
+
+WebEventClient webEventClients[WEB_EVENTS_MAX_CLIENTS];
+byte webEventClientCount = 0;
+unsigned long webEventsDropped = 0;
+
+void handle_events() {
+  if (!clientIPallowed()) return;
+  int slot = -1;
+  for (byte i = 0; i < WEB_EVENTS_MAX_CLIENTS; ++i) {
+    if (!webEventClients[i].active) {
+      slot = i;
+      break;
+    }
+  }
+  if (slot < 0) {
+    WebServer.send(503, getWebString(WEB_STR_TEXT_PLAIN), F("Too many event clients"));
+    return;
+  }
+  if (!socketAvailable(SOCKET_WEB_EVENTS)) {
+    WebServer.send(503, getWebString(WEB_STR_TEXT_PLAIN), F("No connection available"));
+    return;
+  }
+  WebEventClient& subscriber = webEventClients[slot];
+  registerSocketClient(subscriber.client, SOCKET_WEB_EVENTS);
+  subscriber.client = WebServer.client();
+  subscriber.client.setNoDelay(true);
+  subscriber.active = true;
+  subscriber.sendLog = WebServer.arg(F("log")) == F("1");
+  subscriber.logSequence = Logging.lastSequence();
+  subscriber.lastSend = millis();
+  subscriber.client.print(F("HTTP/1.1 200 OK\r\n"
+                            "Content-Type: text/event-stream\r\n"
+                            "Cache-Control: no-cache\r\n"
+                            "Connection: keep-alive\r\n"
+                            "Access-Control-Allow-Origin: *\r\n"
+                            "\r\n"
+                            "retry: 5000\n\n"));
+  ++webEventClientCount;
+  addLog(LOG_LEVEL_INFO, String(F("WEB  : Event client connected: ")) + subscriber.client.remoteIP().toString());
+}
+
+// Send one event to the client in this slot. Returns false when the TCP send
+// buffer has no room, events are then skipped so a slow client never blocks.
+bool sendWebEvent(byte slot, const __FlashStringHelper* event, const String& data) {
+  WebEventClient& subscriber = webEventClients[slot];
+  if (!subscriber.active || !subscriber.client.connected()) return false;
+  const int length = data.length() + 24;
+#if defined(ESP8266)
+  if (subscriber.client.availableForWrite() < length) return false;
+#endif
+  String message;
+  message.reserve(length);
+  message = F("event: ");
+  message += event;
+  message += F("\ndata: ");
+  message += data;
+  message += F("\n\n");
+  subscriber.client.print(message);
+  subscriber.lastSend = millis();
+  return true;
+}
+
+// Push the task values to all event clients, called from sendData().
+void sendWebEventTaskValues(struct EventStruct *event) {
+  if (webEventClientCount == 0) return;
+  const byte TaskIndex = event->TaskIndex;
+  if (TaskIndex >= TASKS_MAX) return;
+  const byte DeviceIndex = getDeviceIndex(Settings.TaskDeviceNumber[TaskIndex]);
+  String data;
+  data.reserve(64 + Device[DeviceIndex].ValueCount * 48);
+  data = '{';
+  data += to_json_object_value(F("TaskNumber"), String(TaskIndex + 1));
+  data += ',';
+  data += to_json_object_value(F("TaskName"), String(ExtraTaskSettings.TaskDeviceName));
+  data += ',';
+  data += to_json_object_value(F("Sequence"), String(lastTaskValueSequence[TaskIndex]));
+  data += F(",\"TaskValues\":[");
+  for (byte x = 0; x < Device[DeviceIndex].ValueCount; ++x) {
+    if (x != 0) data += ',';
+    data += '{';
+    data += to_json_object_value(F("ValueNumber"), String(x + 1));
+    data += ',';
+    data += to_json_object_value(F("Name"), String(ExtraTaskSettings.TaskDeviceValueNames[x]));
+    data += ',';
+    data += to_json_object_value(F("Value"), formatUserVarNoCheck(TaskIndex, x));
+    data += '}';
+  }
+  data += F("]}");
+  for (byte i = 0; i < WEB_EVENTS_MAX_CLIENTS; ++i) {
+    if (webEventClients[i].active && !sendWebEvent(i, F("taskvalues"), data))
+      ++webEventsDropped;
+  }
+}
+
+// Send new log lines and keep alive messages, remove disconnected clients.
+// Called from backgroundtasks().
+void processWebEvents() {
+  if (webEventClientCount == 0) return;
+  for (byte i = 0; i < WEB_EVENTS_MAX_CLIENTS; ++i) {
+    WebEventClient& subscriber = webEventClients[i];
+    if (!subscriber.active) continue;
+    if (!subscriber.client.connected()) {
+      // Release the connection and its buffers.
+      subscriber.client.stop();
+      subscriber.client = WiFiClient();
+      subscriber.active = false;
+      --webEventClientCount;
+      continue;
+    }
+    if (subscriber.sendLog) {
+      const unsigned long oldest = Logging.firstSequence();
+      if (subscriber.logSequence + 1 < oldest) {
+        // Lines were overwritten before they could be sent.
+        webEventsDropped += oldest - 1 - subscriber.logSequence;
+        subscriber.logSequence = oldest - 1;
+      }
+      for (byte line = 0; line < WEB_EVENTS_LOG_BURST && subscriber.logSequence < Logging.lastSequence(); ++line) {
+        String data;
+        if (Logging.getLogjsonBySequence(subscriber.logSequence + 1, data)) {
+          data.replace('\n', ' ');
+          // No room, try again next call.
+          if (!sendWebEvent(i, F("log"), data)) break;
+        }
+        ++subscriber.logSequence;
+      }
+    }
+    if (timePassedSince(subscriber.lastSend) > WEB_EVENTS_KEEPALIVE) {
+      subscriber.client.print(F(":\n\n"));
+      subscriber.lastSend = millis();
+    }
+  }
+}
@@ -0,0 +1,173 @@
+//********************************************************************************
+// Cache of the options of the web form selectors
+// The GPIO, plugin and task selectors were built from flash strings (and for the
+// tasks by loading the settings of each task) at every render, while a devices or
+// hardware page has a dozen of them. Their <option> lists are now built once, and
+// streamed into TXBuffer with the " selected" added for the choice (by
+// addCachedSelectorOptions() in WebServer.ino, where TXBuffer is defined).
+// The plugin list does not change after boot, the task list is invalidated when
+// settings or task settings are loaded or saved (invalidateWebOptions()), and a
+// GPIO list is rebuilt when the I2C pins or the use of the serial port changed.
+// The cache is freed WEB_OPTIONS_KEEP msec after its last use, so the memory is
+// only taken while someone is using the web interface.
+//********************************************************************************
+#define WEB_OPTIONS_KEEP         60000   // msec after the last use
+
+struct WebOptionsCacheStruct
+{
+  WebOptionsCacheStruct() : tasksValid(false), lastUse(0) {
+    for (byte i = 0; i < 2; ++i) {
+      pinsSda[i] = pinsScl[i] = -2;
+      pinsSerial[i] = false;
+    }
+  }
+
+  String devices;
+  String tasks;
+  String pins[2];        // Not for I2C, for I2C
+  int8_t pinsSda[2];     // Settings the GPIO lists were built for
+  int8_t pinsScl[2];
+  bool pinsSerial[2];
+  bool tasksValid;
+  unsigned long lastUse;
+};
+
+WebOptionsCacheStruct* webOptionsCache = NULL;
+unsigned long webOptionsHits = 0;
+unsigned long webOptionsBuilds = 0;
+
+// Allocates the cache on first use.
+void useWebOptionsCache() {
+  if (webOptionsCache == NULL)
+    webOptionsCache = new WebOptionsCacheStruct();
+  webOptionsCache->lastUse = millis();
+}
+
+// Called when settings or task settings are loaded or saved.
+void invalidateWebOptions() {
+  if (webOptionsCache != NULL)
+    webOptionsCache->tasksValid = false;
+}
+
+// Called once per second.
+void processWebOptionsCache() {
+  if (webOptionsCache != NULL && timePassedSince(webOptionsCache->lastUse) > WEB_OPTIONS_KEEP) {
+    delete webOptionsCache;
+    webOptionsCache = NULL;
+  }
+}
+
+// Same markup as addSelector_Item(), without the selection.
+void appendSelectorOption(String& result, const String& option, int index, boolean disabled) {
+  result += F("<option value=");
+  result += index;
+  if (disabled)
+    result += F(" disabled");
+  result += '>';
+  result += option;
+  result += getWebString(WEB_STR_OPTION_END);
+}
+
+const String& getDeviceSelectOptions() {
+  useWebOptionsCache();
+  WebOptionsCacheStruct& cache = *webOptionsCache;
+  if (cache.devices.length() != 0) {
+    ++webOptionsHits;
+    return cache.devices;
+  }
+  ++webOptionsBuilds;
+  String deviceName;
+  appendSelectorOption(cache.devices, getWebString(WEB_STR_NONE), 0, false);
+  // DeviceIndex_sorted is in alphabetic order
+  for (byte x = 0; x < DeviceIndex_sorted.size(); x++)
+  {
+    byte deviceIndex = DeviceIndex_sorted[x];
+    if (getPluginNumber(deviceIndex) != 0)
+      deviceName = getPluginNameFromDeviceIndex(deviceIndex);
+
+#ifdef PLUGIN_BUILD_DEV
+    int num = getPluginNumber(deviceIndex);
+    String plugin = F("P");
+    if (num < 10) plugin += F("0");
+    if (num < 100) plugin += F("0");
+    plugin += num;
+    plugin += F(" - ");
+    deviceName = plugin + deviceName;
+#endif
+
+    appendSelectorOption(cache.devices, deviceName, Device[deviceIndex].Number, false);
+  }
+  return cache.devices;
+}
+
+// The names of all tasks, loads the settings of each task when built.
+const String& getTaskSelectOptions() {
+  useWebOptionsCache();
+  WebOptionsCacheStruct& cache = *webOptionsCache;
+  if (cache.tasksValid) {
+    ++webOptionsHits;
+    return cache.tasks;
+  }
+  ++webOptionsBuilds;
+  cache.tasks = "";
+  String deviceName;
+  String taskName;
+  String option;
+  for (byte x = 0; x < TASKS_MAX; x++)
+  {
+    deviceName = "";
+    if (Settings.TaskDeviceNumber[x] != 0 )
+    {
+      byte DeviceIndex = getDeviceIndex(Settings.TaskDeviceNumber[x]);
+
+      if (getPluginNumber(DeviceIndex) != 0)
+        deviceName = getPluginNameFromDeviceIndex(DeviceIndex);
+    }
+    LoadTaskSettings(x);
+    option = String(x + 1);
+    option += F(" - ");
+    option += deviceName;
+    option += F(" - ");
+    taskName = ExtraTaskSettings.TaskDeviceName;
+    htmlEscape(taskName);
+    option += taskName;
+    appendSelectorOption(cache.tasks, option, x, Settings.TaskDeviceNumber[x] == 0);
+  }
+  cache.tasksValid = true;
+  return cache.tasks;
+}
+
+const String& getPinSelectOptions(boolean forI2C) {
+  useWebOptionsCache();
+  WebOptionsCacheStruct& cache = *webOptionsCache;
+  const byte i = forI2C ? 1 : 0;
+  if (cache.pins[i].length() != 0 && cache.pinsSda[i] == Settings.Pin_i2c_sda &&
+      cache.pinsScl[i] == Settings.Pin_i2c_scl && cache.pinsSerial[i] == Settings.UseSerial) {
+    ++webOptionsHits;
+    return cache.pins[i];
+  }
+  ++webOptionsBuilds;
+  cache.pins[i] = "";
+  buildPinSelectOptions(cache.pins[i], forI2C);
+  cache.pinsSda[i] = Settings.Pin_i2c_sda;
+  cache.pinsScl[i] = Settings.Pin_i2c_scl;
+  cache.pinsSerial[i] = Settings.UseSerial;
+  return cache.pins[i];
+}
+
+// Web options as: cache hits/builds/bytes, empty when not used.
+String getWebOptionsStats() {
+  String result;
+  if (webOptionsBuilds == 0) return result;
+  result += webOptionsHits;
+  result += '/';
+  result += webOptionsBuilds;
+  result += '/';
+  unsigned int bytes = 0;
+  if (webOptionsCache != NULL) {
+    bytes = webOptionsCache->devices.length() + webOptionsCache->tasks.length() +
+            webOptionsCache->pins[0].length() + webOptionsCache->pins[1].length();
+  }
+  result += bytes;
+  return result;
+}
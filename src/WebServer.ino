@@ -7,9 +7,152 @@
 #define _HEAD false
 #define _TAIL true
 #define CHUNKED_BUFFER_SIZE          400
+#define WEBSERVER_TX_TIMEOUT         2000  // msec to wait for room in the TCP send buffer
+#define WEB_HEAP_RESERVE             3000  // Free heap to keep when serving API routes (/json, /control)
+#define WEB_HEAP_RESERVE_PAGE        5000  // Free heap to keep when rendering HTML pages
+#define WEB_HEAP_ESTIMATE_DEFAULT    4000  // Heap needed by a route until it has been measured
+#define WEB_HEAP_ESTIMATE_MAX        8000  // Upper limit, so a single peak cannot lock out a route
+#define FILELIST_PAGE_SIZE           50    // Default number of files per page in the file lists
+#ifndef TCP_MSS
+  #define TCP_MSS                    1460
+#endif
+#ifndef TCP_SND_BUF
+  #define TCP_SND_BUF                2920  // lwIP default, 2 * TCP_MSS
+#endif
 
 void sendContentBlocking(String& data);
-void sendHeaderBlocking(bool json);
+void sendHeaderBlocking(bool json, const __FlashStringHelper* contentType);
+
+#if defined(ESP32)
+//********************************************************************************
+// Deferred responses (ESP32)
+// A page streamed via TXBuffer is rendered into memory, after which its client is
+// handed over to a response slot. The web server then accepts the next request,
+// while the slots are sent whenever their TCP send buffer has room. This way a
+// slow client on a poor WiFi connection only delays its own page.
+//********************************************************************************
+#define WEB_RESPONSE_SLOTS           3      // Also counted in SOCKET_RESERVED_WEBSERVER
+#define WEB_RESPONSE_MAX_SIZE    16384      // Larger pages continue as a blocking stream
+#define WEB_RESPONSE_TIMEOUT     10000      // msec without progress before a client is dropped
+
+struct WebResponseSlot {
+  WebResponseSlot() : pos(0), lastProgress(0), active(false) {}
+
+  WiFiClient client;
+  String data;               // Chunked encoded response body
+  unsigned int pos;          // Bytes of data already sent
+  unsigned long lastProgress;
+  bool active;
+};
+
+WebResponseSlot webResponseSlots[WEB_RESPONSE_SLOTS];
+int webResponseCapture = -1;  // Slot the current page is rendered into
+unsigned long webResponsesDeferred = 0;
+unsigned long webResponsesBlocking = 0;
+unsigned long webResponsesDropped = 0;
+
+// Render the current page into a free slot. When all slots are in use, or the
+// heap is low, the page is sent while rendering, like on ESP8266.
+void webResponseBeginCapture() {
+  webResponseCapture = -1;
+  if (ESP.getFreeHeap() > WEB_RESPONSE_MAX_SIZE + WEB_HEAP_RESERVE_PAGE) {
+    for (byte i = 0; i < WEB_RESPONSE_SLOTS; ++i) {
+      if (!webResponseSlots[i].active) {
+        webResponseSlots[i].data = "";
+        webResponseSlots[i].pos = 0;
+        webResponseCapture = i;
+        return;
+      }
+    }
+  }
+  ++webResponsesBlocking;
+}
+
+// Add a chunk to the captured page. Returns false when the chunk must be sent directly.
+bool webResponseCaptureChunk(const String& chunk) {
+  if (webResponseCapture < 0) return false;
+  WebResponseSlot& slot = webResponseSlots[webResponseCapture];
+  const unsigned int length = chunk.length();
+  if (slot.data.length() + length + 8 > WEB_RESPONSE_MAX_SIZE) {
+    // Too large to keep, send what is rendered so far and continue blocking.
+    WebServer.client().write(reinterpret_cast<const uint8_t*>(slot.data.c_str()), slot.data.length());
+    slot.data = "";
+    webResponseCapture = -1;
+    ++webResponsesBlocking;
+    return false;
+  }
+  slot.data += formatToHex(length, "");
+  slot.data += F("\r\n");
+  slot.data += chunk;
+  slot.data += F("\r\n");
+  return true;
+}
+
+// Page is complete, take over the client and let the web server continue.
+void webResponseEndCapture() {
+  if (webResponseCapture < 0) return;
+  WebResponseSlot& slot = webResponseSlots[webResponseCapture];
+  webResponseCapture = -1;
+  slot.client = WebServer.client();
+  slot.pos = 0;
+  slot.lastProgress = millis();
+  slot.active = true;
+  WebServer.releaseClient();
+  ++webResponsesDeferred;
+  processWebResponses();
+}
+
+void releaseWebResponse(struct WebResponseSlot& slot) {
+  slot.client.stop();
+  slot.client = WiFiClient();
+  slot.data = "";
+  slot.active = false;
+}
+
+// Send as much of the deferred responses as the TCP send buffers accept, without blocking.
+// Called from backgroundtasks() and the RTOS servers task.
+void processWebResponses() {
+  for (byte i = 0; i < WEB_RESPONSE_SLOTS; ++i) {
+    WebResponseSlot& slot = webResponseSlots[i];
+    if (!slot.active) continue;
+    const unsigned int remaining = slot.data.length() - slot.pos;
+    if (remaining > 0) {
+      const int sent = send(slot.client.fd(), slot.data.c_str() + slot.pos, remaining > TCP_MSS ? TCP_MSS : remaining, MSG_DONTWAIT);
+      if (sent > 0) {
+        slot.pos += sent;
+        slot.lastProgress = millis();
+      } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+        ++webResponsesDropped;
+        releaseWebResponse(slot);
+        continue;
+      }
+    }
+    if (slot.pos >= slot.data.length()) {
+      releaseWebResponse(slot);
+    } else if (timeOutReached(slot.lastProgress + WEB_RESPONSE_TIMEOUT)) {
+      ++webResponsesDropped;
+      addLog(LOG_LEVEL_DEBUG, String(F("WEB  : Client too slow, response dropped: ")) + slot.client.remoteIP().toString());
+      releaseWebResponse(slot);
+    }
+  }
+}
+
+// Deferred responses as: pending/deferred/blocking/dropped
+String getWebResponseStats() {
+  byte pending = 0;
+  for (byte i = 0; i < WEB_RESPONSE_SLOTS; ++i)
+    if (webResponseSlots[i].active) ++pending;
+  String result;
+  result += pending;
+  result += '/';
+  result += webResponsesDeferred;
+  result += '/';
+  result += webResponsesBlocking;
+  result += '/';
+  result += webResponsesDropped;
+  return result;
+}
+#endif
 
 class StreamingBuffer {
 private:
@@ -25,25 +168,31 @@ public:
   unsigned int sentBytes;
   uint32_t flashStringCalls;
   uint32_t flashStringData;
+  uint32_t waitTime;   // msec spent waiting for the client during this request
+  uint32_t maxWait;    // longest single wait during this request
+  uint32_t chunks;
+  uint32_t minFreeHeap;
   String buf;
 
   StreamingBuffer(void) : lowMemorySkip(false),
     initialRam(0), beforeTXRam(0), duringTXRam(0), finalRam(0), maxCoreUsage(0),
-    maxServerUsage(0), sentBytes(0), flashStringCalls(0), flashStringData(0)
+    maxServerUsage(0), sentBytes(0), flashStringCalls(0), flashStringData(0),
+    waitTime(0), maxWait(0), chunks(0), minFreeHeap(0xFFFFFFFF)
   {
     buf.reserve(CHUNKED_BUFFER_SIZE + 50);
     buf = "";
   }
-  StreamingBuffer operator= (String& a)                 { flush(); return addString(a); }
-  StreamingBuffer operator= (const String& a)           { flush(); return addString(a); }
-  StreamingBuffer operator+= (char a)                   { return addString(String(a)); }
-  StreamingBuffer operator+= (long unsigned int  a)     { return addString(String(a)); }
-  StreamingBuffer operator+= (float a)                  { return addString(String(a)); }
-  StreamingBuffer operator+= (int a)                    { return addString(String(a)); }
-  StreamingBuffer operator+= (uint32_t a)               { return addString(String(a)); }
-  StreamingBuffer operator+= (const String& a)          { return addString(a); }
-
-  StreamingBuffer operator+= (PGM_P str) {
+  // Numbers are formatted on the stack, like String(a) would but without the allocation.
+  StreamingBuffer& operator= (String& a)                 { flush(); return addString(a); }
+  StreamingBuffer& operator= (const String& a)           { flush(); return addString(a); }
+  StreamingBuffer& operator+= (char a)                   { addChars(&a, 1); return *this; }
+  StreamingBuffer& operator+= (long unsigned int  a)     { char str[12]; ultoa(a, str, 10); return addCString(str); }
+  StreamingBuffer& operator+= (float a)                  { char str[34]; dtostrf(a, 0, 2, str); return addCString(str); }
+  StreamingBuffer& operator+= (int a)                    { char str[12]; itoa(a, str, 10); return addCString(str); }
+  StreamingBuffer& operator+= (uint32_t a)               { char str[12]; ultoa(a, str, 10); return addCString(str); }
+  StreamingBuffer& operator+= (const String& a)          { return addString(a); }
+
+  StreamingBuffer& operator+= (PGM_P str) {
     ++flashStringCalls;
     if (!str) return *this; // return if the pointer is void
     if (lowMemorySkip) return *this;
@@ -67,7 +216,7 @@ public:
   }
 
 
-  StreamingBuffer addString(const String& a) {
+  StreamingBuffer& addString(const String& a) {
     if (lowMemorySkip) return *this;
     int flush_step = CHUNKED_BUFFER_SIZE - this->buf.length();
     if (flush_step < 1) flush_step = 0;
@@ -86,6 +235,39 @@ public:
     return *this;
   }
 
+  StreamingBuffer& addCString(const char* str) {
+    addChars(str, strlen(str));
+    return *this;
+  }
+
+  // HTML escaped, see htmlEscape(). Plain parts are added as they are, so no escaped copy is made.
+  StreamingBuffer& addHtmlEscaped(const char* data, unsigned int length) {
+    unsigned int start = 0;
+    for (unsigned int pos = 0; pos < length; ++pos) {
+      const char* sequence = htmlEscapeSequence(data[pos]);
+      if (sequence == NULL) continue;
+      addChars(data + start, pos - start);
+      addCString(sequence);
+      start = pos + 1;
+    }
+    addChars(data + start, length - start);
+    return *this;
+  }
+
+  StreamingBuffer& addHtmlEscaped(const char* str)     { return addHtmlEscaped(str, strlen(str)); }
+  StreamingBuffer& addHtmlEscaped(const String& str)   { return addHtmlEscaped(str.c_str(), str.length()); }
+
+  // Add characters without creating a temporary String.
+  void addChars(const char* data, unsigned int length) {
+    if (lowMemorySkip) return;
+    for (unsigned int pos = 0; pos < length; ++pos) {
+      if (this->buf.length() >= CHUNKED_BUFFER_SIZE)
+        sendContentBlocking(this->buf);
+      this->buf += data[pos];
+    }
+    checkFull();
+  }
+
   void flush() {
     if (lowMemorySkip) {
       this->buf = "";
@@ -110,12 +292,20 @@ public:
     startStream(true);
   }
 
+  void startTextStream(const __FlashStringHelper* contentType) {
+    startStream(false, contentType);
+  }
+
 private:
   void startStream(bool json) {
+    startStream(json, json ? F("application/json") : getWebString(WEB_STR_TEXT_HTML));
+  }
+
+  void startStream(bool json, const __FlashStringHelper* contentType) {
     maxCoreUsage = maxServerUsage = 0;
     initialRam = ESP.getFreeHeap();
     beforeTXRam = initialRam;
-    sentBytes = 0;
+    resetRequestStats();
     buf = "";
     if (beforeTXRam < 3000) {
       lowMemorySkip = true;
@@ -124,8 +314,12 @@ private:
          tcpCleanup();
        #endif
       return;
-    } else
-      sendHeaderBlocking(json);
+    } else {
+      sendHeaderBlocking(json, contentType);
+      #if defined(ESP32)
+        webResponseBeginCapture();
+      #endif
+    }
   }
 
   void trackTotalMem() {
@@ -136,8 +330,17 @@ private:
 
 public:
 
+  // Statistics of a single request, also used by runWebRoute()
+  void resetRequestStats() {
+    sentBytes = 0;
+    waitTime = maxWait = 0;
+    chunks = 0;
+    minFreeHeap = ESP.getFreeHeap();
+  }
+
   void trackCoreMem() {
     duringTXRam = ESP.getFreeHeap();
+    if (duringTXRam < minFreeHeap) minFreeHeap = duringTXRam;
     if ((initialRam - duringTXRam) > maxCoreUsage)
       maxCoreUsage = (initialRam - duringTXRam);
   }
@@ -147,7 +350,19 @@ public:
       if (buf.length() > 0) sendContentBlocking(buf);
       buf = "";
       sendContentBlocking(buf);
+      #if defined(ESP32)
+        webResponseEndCapture();
+      #endif
       finalRam = ESP.getFreeHeap();
+      if (waitTime > 0 && loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+        String log = F("WEB  : TX wait ");
+        log += waitTime;
+        log += F(" ms, max ");
+        log += maxWait;
+        log += F(" ms, sent ");
+        log += sentBytes;
+        addLog(LOG_LEVEL_DEBUG, log);
+      }
       /*
       if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
         String log = String("Ram usage: Webserver only: ") + maxServerUsage +
@@ -173,6 +388,9 @@ void sendContentBlocking(String& data) {
   if (TXBuffer.beforeTXRam > freeBeforeSend)
     TXBuffer.beforeTXRam = freeBeforeSend;
   TXBuffer.duringTXRam = freeBeforeSend;
+  if (freeBeforeSend < TXBuffer.minFreeHeap)
+    TXBuffer.minFreeHeap = freeBeforeSend;
+  if (length > 0) ++TXBuffer.chunks;
 #if defined(ESP8266) && defined(ARDUINO_ESP8266_RELEASE_2_3_0)
   String size = formatToHex(length) + "\r\n";
   // do chunked transfer encoding ourselves (WebServer doesn't support it)
@@ -180,20 +398,15 @@ void sendContentBlocking(String& data) {
   if (length > 0) WebServer.sendContent(data);
   WebServer.sendContent("\r\n");
 #else  // ESP8266 2.4.0rc2 and higher and the ESP32 webserver supports chunked http transfer
-  unsigned int timeout = 0;
-  if (freeBeforeSend < 5000) timeout = 100;
-  if (freeBeforeSend < 4000) timeout = 1000;
-  const uint32_t beginWait = millis();
-  WebServer.sendContent(data);
-  while ((ESP.getFreeHeap() < freeBeforeSend) &&
-         !timeOutReached(beginWait + timeout)) {
-    if (ESP.getFreeHeap() < TXBuffer.duringTXRam)
-      TXBuffer.duringTXRam = ESP.getFreeHeap();
-    ;
-    TXBuffer.trackCoreMem();
-    checkRAM(F("duringDataTX"));
-    delay(1);
+  #if defined(ESP32)
+  if (!webResponseCaptureChunk(data))
+  #endif
+  {
+    // Chunk header and trailer add at most 8 bytes
+    waitForWebClientTX(length + 8);
+    WebServer.sendContent(data);
   }
+  TXBuffer.trackCoreMem();
 #endif
 
   TXBuffer.sentBytes += length;
@@ -201,12 +414,12 @@ void sendContentBlocking(String& data) {
   yield();
 }
 
-void sendHeaderBlocking(bool json) {
+void sendHeaderBlocking(bool json, const __FlashStringHelper* contentType) {
   checkRAM(F("sendHeaderBlocking"));
   WebServer.client().flush();
 #if defined(ESP8266) && defined(ARDUINO_ESP8266_RELEASE_2_3_0)
   WebServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
-  WebServer.sendHeader(F("Content-Type"), json ? F("application/json") : F("text/html"), true);
+  WebServer.sendHeader(F("Content-Type"), contentType, true);
   WebServer.sendHeader(F("Accept-Ranges"), F("none"));
   WebServer.sendHeader(F("Cache-Control"), F("no-cache"));
   WebServer.sendHeader(F("Transfer-Encoding"), F("chunked"));
@@ -214,71 +427,163 @@ void sendHeaderBlocking(bool json) {
     WebServer.sendHeader(F("Access-Control-Allow-Origin"),"*");
   WebServer.send(200);
 #else
-  unsigned int timeout = 0;
-  uint32_t freeBeforeSend = ESP.getFreeHeap();
-  if (freeBeforeSend < 5000) timeout = 100;
-  if (freeBeforeSend < 4000) timeout = 1000;
-  const uint32_t beginWait = millis();
   WebServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
-  WebServer.sendHeader(F("Content-Type"), json ? F("application/json") : F("text/html"), true);
+  WebServer.sendHeader(F("Content-Type"), contentType, true);
   WebServer.sendHeader(F("Cache-Control"), F("no-cache"));
   if (json)
     WebServer.sendHeader(F("Access-Control-Allow-Origin"),"*");
   WebServer.send(200);
-  // dont wait on 2.3.0. Memory returns just too slow.
-  while ((ESP.getFreeHeap() < freeBeforeSend) &&
-         !timeOutReached(beginWait + timeout)) {
-    checkRAM(F("duringHeaderTX"));
-    delay(1);
-  }
 #endif
   yield();
 }
 
+// Room left in the TCP send buffer of the current web client.
+int webClientAvailableForWrite() {
+#if defined(ESP8266)
+  return WebServer.client().availableForWrite();
+#else
+  // The ESP32 client write blocks until the data is queued.
+  return TCP_SND_BUF;
+#endif
+}
+
+// Wait until the TCP send buffer can take 'size' bytes, instead of writing
+// into a full buffer which keeps allocating heap until the client ACKs.
+// While waiting, the time critical plugin calls keep running.
+void waitForWebClientTX(unsigned int size) {
+  if (size > TCP_SND_BUF) size = TCP_SND_BUF;
+  if (webClientAvailableForWrite() >= static_cast<int>(size)) return;
+  START_TIMER;
+  const uint32_t beginWait = millis();
+  while (webClientAvailableForWrite() < static_cast<int>(size) &&
+         WebServer.client().connected() &&
+         !timeOutReached(beginWait + WEBSERVER_TX_TIMEOUT)) {
+    TXBuffer.trackCoreMem();
+    checkRAM(F("duringDataTX"));
+    handle_schedule_while_waiting();
+    delay(0);
+  }
+  const uint32_t waited = timePassedSince(beginWait);
+  TXBuffer.waitTime += waited;
+  if (waited > TXBuffer.maxWait) TXBuffer.maxWait = waited;
+  STOP_TIMER(WEB_TX_WAIT_STATS);
+}
+
+//********************************************************************************
+// Page template from SPIFFS or PROGMEM, read one character at a time.
+//********************************************************************************
+#define PAGE_TEMPLATE_VAR_MAX        16  // Longest {{var}} name
+#define PAGE_TEMPLATE_READ_SIZE      64
+
+class PageTemplateReader {
+public:
+  PageTemplateReader(fs::File& file, PGM_P progmem) :
+    _file(file), _progmem(progmem), _pos(0), _length(0), _peeked(-1) {}
+
+  int read() {
+    const int c = peek();
+    _peeked = -1;
+    return c;
+  }
+
+  int peek() {
+    if (_peeked < 0) _peeked = next();
+    return _peeked;
+  }
+
+private:
+  int next() {
+    if (_file) {
+      if (_pos >= _length) {
+        _length = _file.read(_buf, sizeof(_buf));
+        _pos = 0;
+        if (_length == 0) return -1;
+      }
+      return _buf[_pos++];
+    }
+    if (_progmem == NULL) return -1;
+    const char c = pgm_read_byte(_progmem + _pos);
+    if (c == 0) return -1;
+    ++_pos;
+    return c;
+  }
+
+  fs::File& _file;
+  PGM_P _progmem;
+  unsigned int _pos;
+  unsigned int _length;
+  int _peeked;
+  uint8_t _buf[PAGE_TEMPLATE_READ_SIZE];
+};
+
+// Stream the template to TXBuffer, up to {{content}} or for the tail everything after it.
+// Variables are resolved while sending, so the template is never kept in memory.
 void sendHeadandTail(const String& tmplName, boolean Tail = false) {
-  String pageTemplate = "";
-  int indexStart, indexEnd;
-  String varName;  //, varValue;
   String fileName = tmplName;
   fileName += F(".htm");
   fs::File f = SPIFFS.open(fileName, "r+");
-
-  if (f) {
-    pageTemplate.reserve(f.size());
-    while (f.available()) pageTemplate += (char)f.read();
-    f.close();
-  } else {
-    getWebPageTemplateDefault(tmplName, pageTemplate);
-  }
+  PageTemplateReader reader(f, f ? NULL : getWebPageTemplateDefault(tmplName));
   checkRAM(F("sendWebPage"));
   // web activity timer
   lastWeb = millis();
 
-  if (Tail) {
-    TXBuffer += pageTemplate.substring(
-        11 + // Size of "{{content}}"
-        pageTemplate.indexOf(F("{{content}}")));  // advance beyond content key
-  } else {
-    while ((indexStart = pageTemplate.indexOf(F("{{"))) >= 0) {
-      TXBuffer += pageTemplate.substring(0, indexStart);
-      pageTemplate = pageTemplate.substring(indexStart);
-      if ((indexEnd = pageTemplate.indexOf(F("}}"))) > 0) {
-        varName = pageTemplate.substring(2, indexEnd);
-        pageTemplate = pageTemplate.substring(indexEnd + 2);
-        varName.toLowerCase();
-
-        if (varName == F("content")) {  // is var == page content?
-          break;  // send first part of result only
-        } else if (varName == F("error")) {
+  char chunk[PAGE_TEMPLATE_READ_SIZE];
+  byte chunkLength = 0;
+  char varName[PAGE_TEMPLATE_VAR_MAX + 1];
+  bool sending = !Tail;
+  bool contentFound = false;
+  int c;
+  while ((c = reader.read()) >= 0) {
+    if (c == '{' && reader.peek() == '{' && !contentFound) {
+      reader.read();
+      byte length = 0;
+      bool closed = false;
+      while (length < PAGE_TEMPLATE_VAR_MAX && reader.peek() >= 0) {
+        const char n = reader.read();
+        if (n == '}' && reader.peek() == '}') {
+          reader.read();
+          closed = true;
+          break;
+        }
+        varName[length++] = n;
+      }
+      varName[length] = 0;
+      if (sending) {
+        TXBuffer.addChars(chunk, chunkLength);
+        chunkLength = 0;
+      }
+      if (!closed) {
+        // no closing "}}", eat "{{"
+        if (sending) TXBuffer.addChars(varName, length);
+        continue;
+      }
+      for (byte i = 0; i < length; ++i)
+        varName[i] = tolower(varName[i]);
+
+      if (strcmp_P(varName, PSTR("content")) == 0) {  // is var == page content?
+        if (!Tail) break;  // send first part of result only
+        contentFound = true;
+        sending = true;
+      } else if (sending) {
+        if (strcmp_P(varName, PSTR("error")) == 0) {
           getErrorNotifications();
         } else {
           getWebPageTemplateVar(varName);
         }
-      } else {  // no closing "}}"
-        pageTemplate = pageTemplate.substring(2);  // eat "{{"
       }
+      continue;
+    }
+    if (!sending) continue;
+    chunk[chunkLength++] = c;
+    if (chunkLength == sizeof(chunk)) {
+      TXBuffer.addChars(chunk, chunkLength);
+      chunkLength = 0;
     }
   }
+  if (chunkLength > 0)
+    TXBuffer.addChars(chunk, chunkLength);
+  if (f) f.close();
+
   if (shouldReboot) {
     //we only add this here as a seperate chucnk to prevent using too much memory at once
     TXBuffer += jsReboot;
@@ -435,7 +740,7 @@ void addHtmlError(String error){
     }
     TXBuffer += F("\"><span class=\"closebtn\" onclick=\"this.parentElement.style.display='none';\">&times;</span>");
     TXBuffer += error;
-    TXBuffer += F("</div>");
+    TXBuffer += getWebString(WEB_STR_DIV_END);
   }
   else
   {
@@ -450,52 +755,131 @@ void addHtml(const String html) {
   TXBuffer += html;
 }
 
+// Register a page handler which keeps statistics in WebRouteStats
+void addWebRoute(const __FlashStringHelper* uri, byte route, void (*handler)()) {
+  WebServer.on(uri, [route, handler]() { runWebRoute(route, handler); });
+}
+
+// API routes are small and polled by other systems, they get a smaller heap reserve than pages.
+bool isLightWebRoute(byte route) {
+  return route == WEB_ROUTE_JSON || route == WEB_ROUTE_CONTROL || route == WEB_ROUTE_LOG_JSON;
+}
+
+// Admission control: estimate the heap a route needs from its statistics and
+// reply "503 Retry-After" right away when it will not fit, instead of starting
+// a render which would be skipped halfway.
+bool webRouteAdmitted(byte route) {
+  webRouteStatsStruct& stats = WebRouteStats[route];
+  uint32_t estimate = stats.render.isEmpty() ? WEB_HEAP_ESTIMATE_DEFAULT : stats.heapUseEstimate;
+  if (estimate > WEB_HEAP_ESTIMATE_MAX) estimate = WEB_HEAP_ESTIMATE_MAX;
+  const bool light = isLightWebRoute(route);
+  const uint32_t needed = estimate + (light ? WEB_HEAP_RESERVE : WEB_HEAP_RESERVE_PAGE);
+  const uint32_t freeHeap = ESP.getFreeHeap();
+  if (freeHeap >= needed) return true;
+  ++stats.rejected;
+  if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+    String log = F("WEB  : Low memory, rejected ");
+    log += getWebRouteName(route);
+    log += F(" free: ");
+    log += freeHeap;
+    log += F(" needed: ");
+    log += needed;
+    addLog(LOG_LEVEL_DEBUG, log);
+  }
+  WebServer.sendHeader(F("Retry-After"), light ? F("1") : F("3"));
+  WebServer.send(503, getWebString(WEB_STR_TEXT_PLAIN), F("Low memory, retry later"));
+  return false;
+}
+
+void runWebRoute(byte route, void (*handler)()) {
+  if (!webRouteAdmitted(route)) return;
+  const uint32_t freeAtStart = ESP.getFreeHeap();
+  TXBuffer.resetRequestStats();
+  START_TIMER;
+  handler();
+  DISPATCH_END(DISPATCH_WEB, route, 0, statisticsTimerStart);
+  webRouteStatsStruct& stats = WebRouteStats[route];
+  stats.render.add(usecPassedSince(statisticsTimerStart));
+  TXBuffer.trackCoreMem();
+  stats.bytesSent += TXBuffer.sentBytes;
+  stats.chunks += TXBuffer.chunks;
+  stats.blockedTotal += TXBuffer.waitTime;
+  if (TXBuffer.maxWait > stats.blockedMax) stats.blockedMax = TXBuffer.maxWait;
+  if (TXBuffer.minFreeHeap < stats.minFreeHeap) stats.minFreeHeap = TXBuffer.minFreeHeap;
+  const uint32_t heapUse = freeAtStart > TXBuffer.minFreeHeap ? freeAtStart - TXBuffer.minFreeHeap : 0;
+  if (heapUse > stats.maxHeapUse) stats.maxHeapUse = heapUse;
+  if (stats.render.getCount() <= 1)
+    stats.heapUseEstimate = heapUse;
+  else
+    stats.heapUseEstimate = (3 * stats.heapUseEstimate + heapUse) / 4;
+}
+
 void WebServerInit()
 {
+  // Headers used to serve cached and compressed static files
+  static const char* headerKeys[] = { "If-None-Match", "Accept-Encoding", "Range" };
+  WebServer.collectHeaders(headerKeys, 3);
+
   // Prepare webserver pages
-  WebServer.on(F("/"), handle_root);
-  WebServer.on(F("/config"), handle_config);
-  WebServer.on(F("/controllers"), handle_controllers);
+  addWebRoute(F("/"), WEB_ROUTE_ROOT, handle_root);
+  addWebRoute(F("/config"), WEB_ROUTE_CONFIG, handle_config);
+  addWebRoute(F("/controllers"), WEB_ROUTE_CONTROLLERS, handle_controllers);
   WebServer.on(F("/hardware"), handle_hardware);
-  WebServer.on(F("/devices"), handle_devices);
+  addWebRoute(F("/devices"), WEB_ROUTE_DEVICES, handle_devices);
   WebServer.on(F("/notifications"), handle_notifications);
   WebServer.on(F("/log"), handle_log);
-  WebServer.on(F("/logjson"), handle_log_JSON);
+  addWebRoute(F("/logjson"), WEB_ROUTE_LOG_JSON, handle_log_JSON);
   WebServer.on(F("/tools"), handle_tools);
   WebServer.on(F("/i2cscanner"), handle_i2cscanner);
   WebServer.on(F("/wifiscanner"), handle_wifiscanner);
   WebServer.on(F("/login"), handle_login);
-  WebServer.on(F("/control"), handle_control);
+  addWebRoute(F("/control"), WEB_ROUTE_CONTROL, handle_control);
   WebServer.on(F("/download"), handle_download);
   WebServer.on(F("/upload"), HTTP_GET, handle_upload);
   WebServer.on(F("/upload"), HTTP_POST, handle_upload_post, handleFileUpload);
-  WebServer.onNotFound(handleNotFound);
+  WebServer.on(F("/snapshot"), HTTP_GET, handle_snapshot);
+  WebServer.on(F("/snapshot"), HTTP_POST, handle_snapshot_post, handle_snapshot_upload);
+  WebServer.onNotFound([]() { runWebRoute(WEB_ROUTE_FILE, handleNotFound); });
   WebServer.on(F("/filelist"), handle_filelist);
 #ifdef FEATURE_SD
   WebServer.on(F("/SDfilelist"), handle_SDfilelist);
 #endif
   WebServer.on(F("/advanced"), handle_advanced);
   WebServer.on(F("/setup"), handle_setup);
-  WebServer.on(F("/json"), handle_json);
+  addWebRoute(F("/json"), WEB_ROUTE_JSON, handle_json);
+  WebServer.on(F("/events"), handle_events);
+  addWebRoute(F("/metrics"), WEB_ROUTE_METRICS, handle_metrics);
+#ifdef FEATURE_TIMESERIES
+  WebServer.on(F("/timeseries"), handle_timeseries);
+#endif
+#ifdef FEATURE_TRACE
+  WebServer.on(F("/trace"), handle_trace);
+#endif
   WebServer.on(F("/rules"), handle_rules);
-  WebServer.on(F("/sysinfo"), handle_sysinfo);
+  addWebRoute(F("/sysinfo"), WEB_ROUTE_SYSINFO, handle_sysinfo);
   WebServer.on(F("/pinstates"), handle_pinstates);
+  WebServer.on(F("/timingstats"), handle_timingstats);
   WebServer.on(F("/favicon.ico"), handle_favicon);
+  WebServer.on(F("/esp.css"), handle_css);
 
   #if defined(ESP8266)
     if (getFlashRealSizeInBytes() > 524288)
-      httpUpdater.setup(&WebServer);
   #endif
+    {
+      WebServer.on(F("/update"), HTTP_GET, handle_update);
+      WebServer.on(F("/update"), HTTP_POST, handle_update_post, handle_update_upload);
+    }
 
   #if defined(ESP8266)
-  if (Settings.UseSSDP)
-  {
-    WebServer.on(F("/ssdp.xml"), HTTP_GET, []() {
-      WiFiClient client(WebServer.client());
-      SSDP_schema(client);
-    });
-    SSDP_begin();
-  }
+  // SSDP itself is started by SSDP_manage()
+  WebServer.on(F("/ssdp.xml"), HTTP_GET, []() {
+    if (!Settings.UseSSDP) {
+      handleNotFound();
+      return;
+    }
+    WiFiClient client(WebServer.client());
+    SSDP_schema(client);
+  });
   #endif
 }
 
@@ -517,107 +901,106 @@ void setWebserverRunning(bool state) {
 }
 
 
-void getWebPageTemplateDefault(const String& tmplName, String& tmpl)
+//********************************************************************************
+// Default page templates, used when there is no <name>.htm on SPIFFS
+//********************************************************************************
+static const char pgTmplAP[] PROGMEM =
+  "<!DOCTYPE html><html lang='en'>"
+  "<head>"
+  "<meta charset='utf-8'/>"
+  "<meta name='viewport' content='width=device-width, initial-scale=1.0'>"
+  "<title>{{name}}</title>"
+  "{{css}}"
+  "</head>"
+  "<body>"
+  "<header class='apheader'>"
+  "<h1>Welcome to ESP Easy Mega AP</h1>"
+  "</header>"
+  "<section>"
+  "<span class='message error'>"
+  "{{error}}"
+  "</span>"
+  "{{content}}"
+  "</section>"
+  "<footer>"
+  "<br>"
+  "<h6>Powered by <a href='http://www.letscontrolit.com' style='font-size: 15px; text-decoration: none'>www.letscontrolit.com</a></h6>"
+  "</footer>"
+  "</body>";
+
+static const char pgTmplMsg[] PROGMEM =
+  "<!DOCTYPE html><html lang='en'>"
+  "<head>"
+  "<meta charset='utf-8'/>"
+  "<meta name='viewport' content='width=device-width, initial-scale=1.0'>"
+  "<title>{{name}}</title>"
+  "{{css}}"
+  "</head>"
+  "<body>"
+  "<header class='headermenu'>"
+  "<h1>ESP Easy Mega: {{name}}</h1><div class='menu_button'>&#9776;</div><BR>"
+  "</header>"
+  "<section>"
+  "<span class='message error'>"
+  "{{error}}"
+  "</span>"
+  "{{content}}"
+  "</section>"
+  "<footer>"
+  "<br>"
+  "<h6>Powered by <a href='http://www.letscontrolit.com' style='font-size: 15px; text-decoration: none'>www.letscontrolit.com</a></h6>"
+  "</footer>"
+  "</body>";
+
+static const char pgTmplDsh[] PROGMEM =
+  "<!DOCTYPE html><html lang='en'>"
+  "<head>"
+  "<meta charset='utf-8'/>"
+  "<title>{{name}}</title>"
+  "<meta name='viewport' content='width=device-width, initial-scale=1.0'>"
+  "{{js}}"
+  "{{css}}"
+  "</head>"
+  "<body>"
+  "{{content}}"
+  "</body></html>";
+
+static const char pgTmplStd[] PROGMEM =
+  "<!DOCTYPE html><html lang='en'>"
+  "<head>"
+  "<meta charset='utf-8'/>"
+  "<title>{{name}}</title>"
+  "<meta name='viewport' content='width=device-width, initial-scale=1.0'>"
+  "{{js}}"
+  "{{css}}"
+  "</head>"
+  "<body class='bodymenu'>"
+  "<span class='message' id='rbtmsg'></span>"
+  "<header class='headermenu'>"
+  "<h1>ESP Easy Mega: {{name}} {{logo}}</h1><div class='menu_button'>&#9776;</div><BR>"
+  "{{menu}}"
+  "</header>"
+  "<section>"
+  "<span class='message error'>"
+  "{{error}}"
+  "</span>"
+  "{{content}}"
+  "</section>"
+  "<footer>"
+  "<br>"
+  "<h6>Powered by <a href='http://www.letscontrolit.com' style='font-size: 15px; text-decoration: none'>www.letscontrolit.com</a></h6>"
+  "</footer>"
+  "</body></html>";
+
+PGM_P getWebPageTemplateDefault(const String& tmplName)
 {
-  if (tmplName == F("TmplAP"))
-  {
-    tmpl += F(
-              "<!DOCTYPE html><html lang='en'>"
-              "<head>"
-              "<meta charset='utf-8'/>"
-              "<meta name='viewport' content='width=device-width, initial-scale=1.0'>"
-              "<title>{{name}}</title>"
-              "{{css}}"
-              "</head>"
-              "<body>"
-              "<header class='apheader'>"
-              "<h1>Welcome to ESP Easy Mega AP</h1>"
-              "</header>"
-              "<section>"
-              "<span class='message error'>"
-              "{{error}}"
-              "</span>"
-              "{{content}}"
-              "</section>"
-              "<footer>"
-                "<br>"
-                "<h6>Powered by <a href='http://www.letscontrolit.com' style='font-size: 15px; text-decoration: none'>www.letscontrolit.com</a></h6>"
-              "</footer>"
-              "</body>"            );
-  }
-  else if (tmplName == F("TmplMsg"))
-  {
-    tmpl += F(
-              "<!DOCTYPE html><html lang='en'>"
-              "<head>"
-              "<meta charset='utf-8'/>"
-              "<meta name='viewport' content='width=device-width, initial-scale=1.0'>"
-              "<title>{{name}}</title>"
-              "{{css}}"
-              "</head>"
-              "<body>"
-              "<header class='headermenu'>"
-              "<h1>ESP Easy Mega: {{name}}</h1><div class='menu_button'>&#9776;</div><BR>"
-              "</header>"
-              "<section>"
-              "<span class='message error'>"
-              "{{error}}"
-              "</span>"
-              "{{content}}"
-              "</section>"
-              "<footer>"
-                "<br>"
-                "<h6>Powered by <a href='http://www.letscontrolit.com' style='font-size: 15px; text-decoration: none'>www.letscontrolit.com</a></h6>"
-              "</footer>"
-              "</body>"
-            );
-  }
-  else if (tmplName == F("TmplDsh"))
-  {
-    tmpl += F(
-      "<!DOCTYPE html><html lang='en'>"
-      "<head>"
-        "<meta charset='utf-8'/>"
-        "<title>{{name}}</title>"
-        "<meta name='viewport' content='width=device-width, initial-scale=1.0'>"
-        "{{js}}"
-        "{{css}}"
-        "</head>"
-        "<body>"
-        "{{content}}"
-        "</body></html>"
-            );
-  }
-  else   //all other template names e.g. TmplStd
-  {
-    tmpl += F(
-      "<!DOCTYPE html><html lang='en'>"
-      "<head>"
-        "<meta charset='utf-8'/>"
-        "<title>{{name}}</title>"
-        "<meta name='viewport' content='width=device-width, initial-scale=1.0'>"
-        "{{js}}"
-        "{{css}}"
-      "</head>"
-      "<body class='bodymenu'>"
-        "<span class='message' id='rbtmsg'></span>"
-        "<header class='headermenu'>"
-          "<h1>ESP Easy Mega: {{name}} {{logo}}</h1><div class='menu_button'>&#9776;</div><BR>"
-          "{{menu}}"
-        "</header>"
-        "<section>"
-        "<span class='message error'>"
-        "{{error}}"
-        "</span>"
-        "{{content}}"
-        "</section>"
-        "<footer>"
-          "<br>"
-          "<h6>Powered by <a href='http://www.letscontrolit.com' style='font-size: 15px; text-decoration: none'>www.letscontrolit.com</a></h6>"
-        "</footer>"
-      "</body></html>"
-            );
-  }
+  if (tmplName == getWebString(WEB_STR_TMPL_AP))
+    return pgTmplAP;
+  if (tmplName == F("TmplMsg"))
+    return pgTmplMsg;
+  if (tmplName == getWebString(WEB_STR_TMPL_DSH))
+    return pgTmplDsh;
+  return pgTmplStd;  //all other template names e.g. TmplStd
 }
 
 
@@ -642,22 +1025,22 @@ void getErrorNotifications() {
 
 static byte navMenuIndex = 0;
 
-void getWebPageTemplateVar(const String& varName )
+void getWebPageTemplateVar(const char* varName)
 {
  // Serial.print(varName); Serial.print(" : free: "); Serial.print(ESP.getFreeHeap());   Serial.print("var len before:  "); Serial.print (varValue.length()) ;Serial.print("after:  ");
  //varValue = F("");
 
-  if (varName == F("name"))
+  if (strcmp_P(varName, PSTR("name")) == 0)
   {
     TXBuffer += Settings.Name;
   }
 
-  else if (varName == F("unit"))
+  else if (strcmp_P(varName, PSTR("unit")) == 0)
   {
     TXBuffer += String(Settings.Unit);
   }
 
-  else if (varName == F("menu"))
+  else if (strcmp_P(varName, PSTR("menu")) == 0)
   {
     static const __FlashStringHelper* gpMenu[8][2] = {
       F("Main"), F("."),                      //0
@@ -684,13 +1067,13 @@ void getWebPageTemplateVar(const String& varName )
       TXBuffer += gpMenu[i][1];
       TXBuffer += F("'>");
       TXBuffer += gpMenu[i][0];
-      TXBuffer += F("</a>");
+      TXBuffer += getWebString(WEB_STR_A_END);
     }
 
-    TXBuffer += F("</div>");
+    TXBuffer += getWebString(WEB_STR_DIV_END);
   }
 
-  else if (varName == F("logo"))
+  else if (strcmp_P(varName, PSTR("logo")) == 0)
   {
     if (SPIFFS.exists(F("esp.png")))
     {
@@ -698,24 +1081,14 @@ void getWebPageTemplateVar(const String& varName )
     }
   }
 
-  else if (varName == F("css"))
+  else if (strcmp_P(varName, PSTR("css")) == 0)
   {
-    if (SPIFFS.exists(F("esp.css")))   //now css is written in writeDefaultCSS() to SPIFFS and always present
-    //if (0) //TODO
-    {
-      TXBuffer = F("<link rel=\"stylesheet\" type=\"text/css\" href=\"esp.css\">");
-    }
-   else
-    {
-      TXBuffer += F("<style>");
-      // Send CSS per chunk to avoid sending either too short or too large strings.
-      TXBuffer += pgDefaultCSS;
-      TXBuffer += F("</style>");
-    }
+    // Served by handle_css(), from SPIFFS or the built-in CSS, so the browser can cache it.
+    TXBuffer = F("<link rel=\"stylesheet\" type=\"text/css\" href=\"esp.css\">");
   }
 
 
-  else if (varName == F("js"))
+  else if (strcmp_P(varName, PSTR("js")) == 0)
   {
     TXBuffer += F(
                   "<script><!--\n"
@@ -723,12 +1096,12 @@ void getWebPageTemplateVar(const String& varName )
                   "\n//--></script>");
   }
 
-  else if (varName == F("error"))
+  else if (strcmp_P(varName, PSTR("error")) == 0)
   {
     //print last error - not implemented yet
   }
 
-  else if (varName == F("debug"))
+  else if (strcmp_P(varName, PSTR("debug")) == 0)
   {
     //print debug messages - not implemented yet
   }
@@ -804,7 +1177,7 @@ void handle_root() {
    if (!isLoggedIn()) return;
    navMenuIndex = 0;
    TXBuffer.startStream();
-   sendHeadandTail(F("TmplStd"),_HEAD);
+   sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_HEAD);
 
   int freeMem = ESP.getFreeHeap();
   String sCommand = WebServer.arg(F("cmd"));
@@ -894,22 +1267,24 @@ void handle_root() {
     addButton(F("sysinfo"), F("More info"));
 
     TXBuffer += F("</table><BR><BR><table class='multirow'><TR><TH>Node List:<TH>Name<TH>Build<TH>Type<TH>IP<TH>Age");
-    for (byte x = 0; x < UNIT_MAX; x++)
+    uint32_t nodes = activeNodes;
+    while (nodes != 0)
     {
-      if (Nodes[x].ip[0] != 0)
+      const byte x = __builtin_ctz(nodes);
+      nodes &= nodes - 1;
       {
-        char url[80];
-        sprintf_P(url, PSTR("<a class='button link' href='http://%u.%u.%u.%u'>%u.%u.%u.%u</a>"), Nodes[x].ip[0], Nodes[x].ip[1], Nodes[x].ip[2], Nodes[x].ip[3], Nodes[x].ip[0], Nodes[x].ip[1], Nodes[x].ip[2], Nodes[x].ip[3]);
+        char ip[20];
+        formatIP(Nodes[x].ip, ip);
         html_TR_TD(); TXBuffer += F("Unit ");
-        TXBuffer += String(x);
+        TXBuffer += static_cast<int>(x);
         html_TD();
         if (x != Settings.Unit)
-          TXBuffer += Nodes[x].nodeName;
+          TXBuffer.addHtmlEscaped(Nodes[x].nodeName != NULL ? Nodes[x].nodeName : "");
         else
-          TXBuffer += Settings.Name;
+          TXBuffer.addHtmlEscaped(Settings.Name);
         html_TD();
         if (Nodes[x].build)
-          TXBuffer += String(Nodes[x].build);
+          TXBuffer += static_cast<int>(Nodes[x].build);
         html_TD();
         if (Nodes[x].nodeType)
           switch (Nodes[x].nodeType)
@@ -931,17 +1306,21 @@ void handle_root() {
               break;
           }
         html_TD();
-        TXBuffer += url;
+        TXBuffer += F("<a class='button link' href='http://");
+        TXBuffer.addCString(ip);
+        TXBuffer += F("'>");
+        TXBuffer.addCString(ip);
+        TXBuffer += getWebString(WEB_STR_A_END);
         html_TD();
-        TXBuffer += String( Nodes[x].age);
+        TXBuffer += static_cast<uint32_t>(Nodes[x].getAge());
       }
     }
 
-    TXBuffer += F("</table></form>");
+    TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
 
     printWebString = "";
     printToWeb = false;
-    sendHeadandTail(F("TmplStd"),_TAIL);
+    sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_TAIL);
     TXBuffer.endStream();
 
   }
@@ -989,7 +1368,7 @@ void handle_config() {
 
    navMenuIndex = 1;
    TXBuffer.startStream();
-   sendHeadandTail(F("TmplStd"),_HEAD);
+   sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_HEAD);
 
   if (timerAPoff)
     timerAPoff = millis() + 2000L;  //user has reached the main page - AP can be switched off in 2..3 sec
@@ -1056,6 +1435,9 @@ void handle_config() {
     }
 
     Settings.deepSleepOnFail = isFormItemChecked(F("deepsleeponfail"));
+    Settings.DeepSleepSensorFirst = isFormItemChecked(F("deepsleepsensorfirst"));
+    Settings.DeepSleepBatchWakes = getFormItemInt(F("deepsleepbatchwakes"), Settings.DeepSleepBatchWakes);
+    Settings.DeepSleepBatchFlash = isFormItemChecked(F("deepsleepbatchflash"));
     str2ip(espip, Settings.IP);
     str2ip(espgateway, Settings.Gateway);
     str2ip(espsubnet, Settings.Subnet);
@@ -1119,13 +1501,21 @@ void handle_config() {
 
   addFormCheckBox(F("Sleep on connection failure"), F("deepsleeponfail"), Settings.deepSleepOnFail);
 
+  #if defined(ESP8266)
+  addFormCheckBox(F("Wake without WiFi"), F("deepsleepsensorfirst"), Settings.DeepSleepSensorFirst);
+  addFormNote(F("Read the tasks first, wake with WiFi only when a task has to send (set a deadband or report interval)"));
+  addFormNumericBox(F("Batch wakes"), F("deepsleepbatchwakes"), Settings.DeepSleepBatchWakes, 0, 255);
+  addFormCheckBox(F("Batch samples on flash"), F("deepsleepbatchflash"), Settings.DeepSleepBatchFlash);
+  addFormNote(F("Collect the reads of this many wakes without WiFi, sent to the controllers with batches (timestamped). 0 = send at the next wake"));
+  #endif
+
   addFormSeparator(2);
 
   TXBuffer += F("<TR><TD style='width:150px;' align='left'><TD>");
   addSubmitButton();
-  TXBuffer += F("</table></form>");
+  TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
 
-  sendHeadandTail(F("TmplStd"),_TAIL);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_TAIL);
   TXBuffer.endStream();
 }
 
@@ -1138,7 +1528,7 @@ void handle_controllers() {
   if (!isLoggedIn()) return;
   navMenuIndex = 2;
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"),_HEAD);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_HEAD);
 
   struct EventStruct TempEvent;
 
@@ -1164,6 +1554,7 @@ void handle_controllers() {
   if (protocol != -1 && !controllerNotSet)
   {
     ControllerSettingsStruct ControllerSettings;
+    bool initController = false;
     //submitted changed protocol
     if (Settings.Protocol[controllerindex] != protocol)
     {
@@ -1177,7 +1568,7 @@ void handle_controllers() {
         byte ProtocolIndex = getProtocolIndex(Settings.Protocol[controllerindex]);
         ControllerSettings.Port = Protocol[ProtocolIndex].defaultPort;
         if (Protocol[ProtocolIndex].usesTemplate)
-          CPlugin_ptr[ProtocolIndex](CPLUGIN_PROTOCOL_TEMPLATE, &TempEvent, dummyString);
+          getCPluginFunction(ProtocolIndex)(CPLUGIN_PROTOCOL_TEMPLATE, &TempEvent, dummyString);
         strncpy(ControllerSettings.Subscribe, TempEvent.String1.c_str(), sizeof(ControllerSettings.Subscribe));
         strncpy(ControllerSettings.Publish, TempEvent.String2.c_str(), sizeof(ControllerSettings.Publish));
         strncpy(ControllerSettings.MQTTLwtTopic, TempEvent.String3.c_str(), sizeof(ControllerSettings.MQTTLwtTopic));
@@ -1195,6 +1586,9 @@ void handle_controllers() {
         //SecuritySettings.ControllerPassword[controllerindex]
 
         ClearCustomControllerSettings(controllerindex);
+        TempEvent.ControllerIndex = controllerindex;
+        TempEvent.ProtocolIndex = ProtocolIndex;
+        initController = true;
       }
 
     }
@@ -1209,13 +1603,15 @@ void handle_controllers() {
         byte ProtocolIndex = getProtocolIndex(Settings.Protocol[controllerindex]);
         TempEvent.ControllerIndex = controllerindex;
         TempEvent.ProtocolIndex = ProtocolIndex;
-        CPlugin_ptr[ProtocolIndex](CPLUGIN_WEBFORM_SAVE, &TempEvent, dummyString);
+        getCPluginFunction(ProtocolIndex)(CPLUGIN_WEBFORM_SAVE, &TempEvent, dummyString);
         ControllerSettings.UseDNS = usedns.toInt();
         if (ControllerSettings.UseDNS)
         {
           strncpy(ControllerSettings.HostName, controllerhostname.c_str(), sizeof(ControllerSettings.HostName));
           IPAddress IP;
-          WiFi.hostByName(ControllerSettings.HostName, IP);
+          // Hostname may point to another host now.
+          invalidateHostByName(ControllerSettings.HostName);
+          resolveHostByName(ControllerSettings.HostName, IP);
           for (byte x = 0; x < 4; x++)
             ControllerSettings.IP[x] = IP[x];
         }
@@ -1235,12 +1631,16 @@ void handle_controllers() {
         strncpy(ControllerSettings.MQTTLwtTopic, MQTTLwtTopic.c_str(), sizeof(ControllerSettings.MQTTLwtTopic));
         strncpy(ControllerSettings.LWTMessageConnect, lwtmessageconnect.c_str(), sizeof(ControllerSettings.LWTMessageConnect));
         strncpy(ControllerSettings.LWTMessageDisconnect, lwtmessagedisconnect.c_str(), sizeof(ControllerSettings.LWTMessageDisconnect));
-
-        CPlugin_ptr[ProtocolIndex](CPLUGIN_INIT, &TempEvent, dummyString);
+        initController = true;
       }
     }
+    // Host or port may have changed, so do not reuse the kept-alive connection.
+    closeControllerConnection(controllerindex);
     addHtmlError(SaveControllerSettings(controllerindex, (byte*)&ControllerSettings, sizeof(ControllerSettings)));
     addHtmlError(SaveSettings());
+    // After the save, the controller compiles its templates from the new settings
+    if (initController)
+      getCPluginFunction(TempEvent.ProtocolIndex)(CPLUGIN_INIT, &TempEvent, dummyString);
   }
 
   TXBuffer += F("<form name='frmselect' method='post'>");
@@ -1268,7 +1668,7 @@ void handle_controllers() {
         html_TD();
         byte ProtocolIndex = getProtocolIndex(Settings.Protocol[x]);
         String ProtocolName = "";
-        CPlugin_ptr[ProtocolIndex](CPLUGIN_GET_DEVICENAME, 0, ProtocolName);
+        getCPluginFunction(ProtocolIndex)(CPLUGIN_GET_DEVICENAME, 0, ProtocolName);
         TXBuffer += ProtocolName;
 
         html_TD();
@@ -1280,7 +1680,7 @@ void handle_controllers() {
         html_TD(3);
       }
     }
-    TXBuffer += F("</table></form>");
+    TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
   }
   else
   {
@@ -1293,7 +1693,7 @@ void handle_controllers() {
     for (byte x = 0; x <= protocolCount; x++)
     {
       String ProtocolName = "";
-      CPlugin_ptr[x](CPLUGIN_GET_DEVICENAME, 0, ProtocolName);
+      getCPluginFunction(x)(CPLUGIN_GET_DEVICENAME, 0, ProtocolName);
       boolean disabled = false;// !((controllerindex == 0) || !Protocol[x].usesMQTT);
       addSelector_Item(ProtocolName,
                        Protocol[x].Number,
@@ -1401,7 +1801,7 @@ void handle_controllers() {
 
       TempEvent.ControllerIndex = controllerindex;
       TempEvent.ProtocolIndex = ProtocolIndex;
-      CPlugin_ptr[ProtocolIndex](CPLUGIN_WEBFORM_LOAD, &TempEvent,TXBuffer.buf);
+      getCPluginFunction(ProtocolIndex)(CPLUGIN_WEBFORM_LOAD, &TempEvent,TXBuffer.buf);
 
     }
 
@@ -1410,10 +1810,10 @@ void handle_controllers() {
     html_TD();
     TXBuffer += F("<a class='button link' href=\"controllers\">Close</a>");
     addSubmitButton();
-    TXBuffer += F("</table></form>");
+    TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
   }
 
-  sendHeadandTail(F("TmplStd"),_TAIL);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_TAIL);
   TXBuffer.endStream();
 }
 
@@ -1439,7 +1839,7 @@ void html_TD() {
 
 void html_TD(int td_cnt) {
   for (int i = 0; i < td_cnt; ++i) {
-    TXBuffer += F("<TD>");
+    TXBuffer += getWebString(WEB_STR_TD);
   }
 }
 
@@ -1464,7 +1864,7 @@ void handle_notifications() {
   if (!isLoggedIn()) return;
   navMenuIndex = 6;
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"),_HEAD);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_HEAD);
 
   struct EventStruct TempEvent;
   // char tmpString[64];
@@ -1499,7 +1899,7 @@ void handle_notifications() {
     {
       if (Settings.Notification != 0)
       {
-        byte NotificationProtocolIndex = getNotificationProtocolIndex(Settings.Notification[notificationindex]);
+        byte NotificationProtocolIndex = getNotificationProtocolIndex_from_NotifierIndex(notificationindex);
         if (NotificationProtocolIndex!=NPLUGIN_NOT_FOUND)
           NPlugin_ptr[NotificationProtocolIndex](NPLUGIN_WEBFORM_SAVE, 0, dummyString);
         NotificationSettings.Port = getFormItemInt(F("port"), 0);
@@ -1521,7 +1921,7 @@ void handle_notifications() {
     addHtmlError(SaveSettings());
     if (WebServer.hasArg(F("test"))) {
       // Perform tests with the settings in the form.
-      byte NotificationProtocolIndex = getNotificationProtocolIndex(Settings.Notification[notificationindex]);
+      byte NotificationProtocolIndex = getNotificationProtocolIndex_from_NotifierIndex(notificationindex);
       if (NotificationProtocolIndex != NPLUGIN_NOT_FOUND)
       {
         // TempEvent.NotificationProtocolIndex = NotificationProtocolIndex;
@@ -1554,7 +1954,7 @@ void handle_notifications() {
         addEnabled(Settings.NotificationEnabled[x]);
 
         html_TD();
-        byte NotificationProtocolIndex = getNotificationProtocolIndex(Settings.Notification[x]);
+        byte NotificationProtocolIndex = getNotificationProtocolIndex_from_NotifierIndex(x);
         String NotificationName = F("(plugin not found?)");
         if (NotificationProtocolIndex!=NPLUGIN_NOT_FOUND)
         {
@@ -1570,7 +1970,7 @@ void handle_notifications() {
         html_TD(3);
       }
     }
-    TXBuffer += F("</table></form>");
+    TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
   }
   else
   {
@@ -1579,7 +1979,7 @@ void handle_notifications() {
     byte choice = Settings.Notification[notificationindex];
     html_TD();
     addSelector_Head(F("notification"), true);
-    addSelector_Item(F("- None -"), 0, false, false, F(""));
+    addSelector_Item(getWebString(WEB_STR_NONE), 0, false, false, F(""));
     for (byte x = 0; x <= notificationCount; x++)
     {
       String NotificationName = "";
@@ -1602,7 +2002,7 @@ void handle_notifications() {
       NotificationSettingsStruct NotificationSettings;
       LoadNotificationSettings(notificationindex, (byte*)&NotificationSettings, sizeof(NotificationSettings));
 
-      byte NotificationProtocolIndex = getNotificationProtocolIndex(Settings.Notification[notificationindex]);
+      byte NotificationProtocolIndex = getNotificationProtocolIndex_from_NotifierIndex(notificationindex);
       if (NotificationProtocolIndex!=NPLUGIN_NOT_FOUND)
       {
 
@@ -1621,7 +2021,7 @@ void handle_notifications() {
 
           html_TR_TD(); TXBuffer += F("Body:<TD><textarea name='body' rows='20' size=512 wrap='off'>");
           TXBuffer += NotificationSettings.Body;
-          TXBuffer += F("</textarea>");
+          TXBuffer += getWebString(WEB_STR_TEXTAREA_END);
         }
 
         if (Notification[NotificationProtocolIndex].usesGPIO > 0)
@@ -1645,9 +2045,9 @@ void handle_notifications() {
     TXBuffer += F("<a class='button link' href=\"notifications\">Close</a>");
     addSubmitButton();
     addSubmitButton(F("Test"), F("test"));
-    TXBuffer += F("</table></form>");
+    TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
   }
-  sendHeadandTail(F("TmplStd"),_TAIL);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_TAIL);
   TXBuffer.endStream();
 }
 
@@ -1660,7 +2060,7 @@ void handle_hardware() {
   if (!isLoggedIn()) return;
   navMenuIndex = 3;
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"),_HEAD);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_HEAD);
   if (isFormItem(F("psda")))
   {
     Settings.Pin_status_led  = getFormItemInt(F("pled"));
@@ -1728,9 +2128,9 @@ void handle_hardware() {
   html_TD();
   addSubmitButton();
   html_TR_TD();
-  TXBuffer += F("</table></form>");
+  TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
 
-  sendHeadandTail(F("TmplStd"),_TAIL);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_TAIL);
   TXBuffer.endStream();
 
 }
@@ -1777,7 +2177,7 @@ void handle_devices() {
   if (!isLoggedIn()) return;
   navMenuIndex = 4;
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"),_HEAD);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_HEAD);
 
 
   // char tmpString[41];
@@ -1794,9 +2194,9 @@ void handle_devices() {
 
   unsigned long taskdevicetimer = getFormItemInt(F("TDT"),0);
   // String taskdeviceid[CONTROLLER_MAX];
-  // String taskdevicepin1 = WebServer.arg(F("taskdevicepin1"));   // "taskdevicepin*" should not be changed because it is uses by plugins and expected to be saved by this code
-  // String taskdevicepin2 = WebServer.arg(F("taskdevicepin2"));
-  // String taskdevicepin3 = WebServer.arg(F("taskdevicepin3"));
+  // String taskdevicepin1 = WebServer.arg(getWebString(WEB_STR_TASKDEVICEPIN1));   // "taskdevicepin*" should not be changed because it is uses by plugins and expected to be saved by this code
+  // String taskdevicepin2 = WebServer.arg(getWebString(WEB_STR_TASKDEVICEPIN2));
+  // String taskdevicepin3 = WebServer.arg(getWebString(WEB_STR_TASKDEVICEPIN3));
   // String taskdevicepin1pullup = WebServer.arg(F("TDPPU"));
   // String taskdevicepin1inversed = WebServer.arg(F("TDPI"));
   // String taskdevicename = WebServer.arg(F("TDN"));
@@ -1901,6 +2301,23 @@ void handle_devices() {
       Settings.TaskDeviceEnabled[taskIndex] = isFormItemChecked(F("TDE"));
       strcpy(ExtraTaskSettings.TaskDeviceName, WebServer.arg(F("TDN")).c_str());
       Settings.TaskDevicePort[taskIndex] =  getFormItemInt(F("TDP"), 0);
+      if (Device[DeviceIndex].TimerOption)
+      {
+        Settings.TaskDeviceSampleInterval[taskIndex] = getFormItemInt(F("TDSI"), 0);
+        uint32_t triggerMask = 0;
+        for (byte upstream = 0; upstream < TASKS_MAX; upstream++)
+        {
+          if (upstream != taskIndex && isFormItemChecked(String(F("TDTR")) + (upstream + 1)))
+            triggerMask |= 1UL << upstream;
+        }
+        Settings.TaskDeviceTriggerMask[taskIndex] = triggerMask;
+        Settings.TaskDeviceGroup[taskIndex] = getFormItemInt(F("TDGRP"), 0);
+      }
+      if (Device[DeviceIndex].SendDataOption)
+      {
+        ExtraTaskSettings.TaskDeviceMinReportInterval = getFormItemInt(F("TDRMIN"), 0);
+        ExtraTaskSettings.TaskDeviceMaxReportInterval = getFormItemInt(F("TDRMAX"), 0);
+      }
 
       for (byte controllerNr = 0; controllerNr < CONTROLLER_MAX; controllerNr++)
       {
@@ -1909,9 +2326,9 @@ void handle_devices() {
         Settings.TaskDeviceSendData[controllerNr][taskIndex] = isFormItemChecked(String(F("TDSD")) + (controllerNr + 1));
       }
 
-      update_whenset_FormItemInt(F("taskdevicepin1"), Settings.TaskDevicePin1[taskIndex]);
-      update_whenset_FormItemInt(F("taskdevicepin2"), Settings.TaskDevicePin2[taskIndex]);
-      update_whenset_FormItemInt(F("taskdevicepin3"), Settings.TaskDevicePin3[taskIndex]);
+      update_whenset_FormItemInt(getWebString(WEB_STR_TASKDEVICEPIN1), Settings.TaskDevicePin1[taskIndex]);
+      update_whenset_FormItemInt(getWebString(WEB_STR_TASKDEVICEPIN2), Settings.TaskDevicePin2[taskIndex]);
+      update_whenset_FormItemInt(getWebString(WEB_STR_TASKDEVICEPIN3), Settings.TaskDevicePin3[taskIndex]);
 
       if (Device[DeviceIndex].PullUpOption)
         Settings.TaskDevicePin1PullUp[taskIndex] = isFormItemChecked(F("TDPPU"));
@@ -1919,12 +2336,22 @@ void handle_devices() {
       if (Device[DeviceIndex].InverseLogicOption)
         Settings.TaskDevicePin1Inversed[taskIndex] = isFormItemChecked(F("TDPI"));
 
+      if (Device[DeviceIndex].Type == DEVICE_TYPE_I2C)
+        Settings.TaskDeviceI2CClock[taskIndex] = getFormItemInt(F("TDI2CCLK"), 0);
+
       for (byte varNr = 0; varNr < Device[DeviceIndex].ValueCount; varNr++)
       {
 
         strcpy(ExtraTaskSettings.TaskDeviceFormula[varNr], WebServer.arg(String(F("TDF")) + (varNr + 1)).c_str());
         ExtraTaskSettings.TaskDeviceValueDecimals[varNr] = getFormItemInt(String(F("TDVD")) + (varNr + 1));
         strcpy(ExtraTaskSettings.TaskDeviceValueNames[varNr], WebServer.arg(String(F("TDVN")) + (varNr + 1)).c_str());
+        if (Device[DeviceIndex].SendDataOption)
+        {
+          ExtraTaskSettings.TaskDeviceDeadband[varNr] = getFormItemFloat(String(F("TDDB")) + (varNr + 1));
+          ExtraTaskSettings.TaskDeviceDeadbandPercent[varNr] = getFormItemFloat(String(F("TDDBP")) + (varNr + 1));
+        }
+        if (Device[DeviceIndex].TimerOption)
+          ExtraTaskSettings.TaskDeviceAggregation[varNr] = getFormItemInt(String(F("TDAG")) + (varNr + 1), 0);
 
         // taskdeviceformula[varNr].toCharArray(tmpString, 41);
         // strcpy(ExtraTaskSettings.TaskDeviceFormula[varNr], tmpString);
@@ -1955,7 +2382,7 @@ void handle_devices() {
             Settings.ControllerEnabled[TempEvent.ControllerIndex] && Settings.Protocol[TempEvent.ControllerIndex])
             {
               TempEvent.ProtocolIndex = getProtocolIndex(Settings.Protocol[TempEvent.ControllerIndex]);
-              CPlugin_ptr[TempEvent.ProtocolIndex](CPLUGIN_TASK_CHANGE_NOTIFICATION, &TempEvent, dummyString);
+              getCPluginFunction(TempEvent.ProtocolIndex)(CPLUGIN_TASK_CHANGE_NOTIFICATION, &TempEvent, dummyString);
             }
         }
     }
@@ -1965,6 +2392,8 @@ void handle_devices() {
 
     if (taskdevicenumber != 0 && Settings.TaskDeviceEnabled[taskIndex])
       PluginCall(PLUGIN_INIT, &TempEvent, dummyString);
+    else if (getPluginTaskData(taskIndex) != NULL)
+      PluginCall(PLUGIN_EXIT, &TempEvent, dummyString);  // Disabled, release its data
   }
 
   // show all tasks as table
@@ -1990,7 +2419,7 @@ void handle_devices() {
       TXBuffer += F("\">&gt;</a>");
     }
 
-    TXBuffer += F("<TH style='width:50px;'>Task<TH style='width:100px;'>Enabled<TH>Device<TH>Name<TH>Port<TH style='width:100px;'>Ctr (IDX)<TH style='width:70px;'>GPIO<TH>Values");
+    TXBuffer += F("<TH style='width:50px;'>Task<TH style='width:100px;'>Enabled<TH>Device<TH>Name<TH>Port<TH style='width:100px;'>Ctr (IDX)<TH style='width:70px;'>GPIO<TH style='width:70px;'>Phase<TH style='width:90px;'>Init<TH>Values");
 
     String deviceName;
 
@@ -2016,7 +2445,7 @@ void handle_devices() {
         html_TD();
         TXBuffer += getPluginNameFromDeviceIndex(DeviceIndex);
         html_TD();
-        TXBuffer += ExtraTaskSettings.TaskDeviceName;
+        TXBuffer.addHtmlEscaped(ExtraTaskSettings.TaskDeviceName);
         html_TD();
 
         byte customConfig = false;
@@ -2036,7 +2465,7 @@ void handle_devices() {
             if (Settings.TaskDeviceSendData[controllerNr][x])
             {
               if (doBR)
-                TXBuffer += F("<BR>");
+                TXBuffer += getWebString(WEB_STR_BR);
               TXBuffer += getControllerSymbol(controllerNr);
               if (Protocol[ProtocolIndex].usesID && Settings.Protocol[controllerNr] != 0)
               {
@@ -2084,6 +2513,24 @@ void handle_devices() {
           }
         }
 
+        // Offset of the reads within the interval, see planTaskPhases()
+        html_TD();
+        if (taskPhase[x] >= 0)
+        {
+          TXBuffer += toString(taskPhase[x] / 1000.0, 1);
+          TXBuffer += F(" s");
+        }
+
+        // State and duration of the last PLUGIN_INIT, see TaskInit.ino
+        html_TD();
+        TXBuffer += getTaskInitStateName(x);
+        if (taskInitDuration[x] != 0)
+        {
+          TXBuffer += getWebString(WEB_STR_BR);
+          TXBuffer += taskInitDuration[x] / 1000;
+          TXBuffer += F(" ms");
+        }
+
         html_TD();
         byte customValues = false;
         customValues = PluginCall(PLUGIN_WEBFORM_SHOW_VALUES, &TempEvent,TXBuffer.buf);
@@ -2100,24 +2547,25 @@ void handle_devices() {
               TXBuffer  += '_';
               TXBuffer  += varNr;
               TXBuffer  += F("'>");
-              TXBuffer += ExtraTaskSettings.TaskDeviceValueNames[varNr];
+              TXBuffer.addHtmlEscaped(ExtraTaskSettings.TaskDeviceValueNames[varNr]);
               TXBuffer += F(":</div><div class='div_r' id='value_");
               TXBuffer  += x;
               TXBuffer  += '_';
               TXBuffer  += varNr;
               TXBuffer  += F("'>");
-              TXBuffer += formatUserVarNoCheck(x, varNr);
+              char formatted[FORMAT_VALUE_BUFFER_SIZE];
+              TXBuffer.addChars(formatted, formatUserVarNoCheck(x, varNr, formatted));
               TXBuffer += "</div>";
             }
           }
         }
       }
       else {
-        html_TD(6);
+        html_TD(8);
       }
 
     } // next
-    TXBuffer += F("</table></form>");
+    TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
 
   }
   // Show edit form if a specific entry is chosen with the edit button
@@ -2195,11 +2643,19 @@ void handle_devices() {
 
         if (Device[DeviceIndex].connectedToGPIOpins()) {
           if (Device[DeviceIndex].Type >= DEVICE_TYPE_SINGLE)
-            addFormPinSelect(TempEvent.String1, F("taskdevicepin1"), Settings.TaskDevicePin1[taskIndex]);
+            addFormPinSelect(TempEvent.String1, getWebString(WEB_STR_TASKDEVICEPIN1), Settings.TaskDevicePin1[taskIndex]);
           if (Device[DeviceIndex].Type >= DEVICE_TYPE_DUAL)
-            addFormPinSelect( TempEvent.String2, F("taskdevicepin2"), Settings.TaskDevicePin2[taskIndex]);
+            addFormPinSelect( TempEvent.String2, getWebString(WEB_STR_TASKDEVICEPIN2), Settings.TaskDevicePin2[taskIndex]);
           if (Device[DeviceIndex].Type == DEVICE_TYPE_TRIPLE)
-            addFormPinSelect(TempEvent.String3, F("taskdevicepin3"), Settings.TaskDevicePin3[taskIndex]);
+            addFormPinSelect(TempEvent.String3, getWebString(WEB_STR_TASKDEVICEPIN3), Settings.TaskDevicePin3[taskIndex]);
+        }
+
+        if (Device[DeviceIndex].Type == DEVICE_TYPE_I2C)
+        {
+          String clockOptions[4] = { F("Default (100 kHz)"), F("100 kHz"), F("400 kHz"), F("1 MHz") };
+          int clockValues[4] = { 0, 1, 4, 10 };
+          addFormSelector(F("I2C Clock"), F("TDI2CCLK"), 4, clockOptions, clockValues, Settings.TaskDeviceI2CClock[taskIndex]);
+          addFormNote(F("Used for the transfers of this task only. Not every device supports 400 kHz or 1 MHz."));
         }
       }
 
@@ -2253,6 +2709,38 @@ void handle_devices() {
         addUnit(F("sec"));
         if (Device[DeviceIndex].TimerOptional)
           TXBuffer += F(" (Optional for this Device)");
+
+        addFormNumericBox(F("Sample Interval"), F("TDSI"), Settings.TaskDeviceSampleInterval[taskIndex], 0, 65535);
+        addUnit(F("ms"));
+        addFormNote(F("Read this often and send the aggregate of each value once per interval. 0 = send every read"));
+
+        // Upstream tasks, see TaskTrigger.ino
+        addRowLabel(F("Run after Task"));
+        for (byte upstream = 0; upstream < TASKS_MAX; upstream++)
+        {
+          if (upstream == taskIndex || Settings.TaskDeviceNumber[upstream] == 0)
+            continue;
+          addCheckBox(String(F("TDTR")) + (upstream + 1), Settings.TaskDeviceTriggerMask[taskIndex] & (1UL << upstream));
+          TXBuffer += upstream + 1;
+        }
+        addFormNote(F("Read at once when one of these tasks sent new values, e.g. for a formula using their values"));
+
+        // Task groups, see TaskGroup.ino
+        String groupOptions[TASK_GROUPS + 1];
+        groupOptions[0] = getWebString(WEB_STR_NONE);
+        for (byte g = 1; g <= TASK_GROUPS; g++)
+          groupOptions[g] = String(F("Group ")) + g;
+        addFormSelector(F("Read Group"), F("TDGRP"), TASK_GROUPS + 1, groupOptions, NULL, Settings.TaskDeviceGroup[taskIndex]);
+        addFormNote(F("Read together with the other tasks of the group, at the interval of its first task"));
+      }
+
+      if (Device[DeviceIndex].SendDataOption && !Device[DeviceIndex].Custom && Device[DeviceIndex].ValueCount > 0)
+      {
+        addFormNumericBox(F("Min. Report Interval"), F("TDRMIN"), ExtraTaskSettings.TaskDeviceMinReportInterval, 0, 65535);
+        addUnit(F("sec"));
+        addFormNumericBox(F("Max. Report Interval"), F("TDRMAX"), ExtraTaskSettings.TaskDeviceMaxReportInterval, 0, 65535);
+        addUnit(F("sec"));
+        addFormNote(F("With these or a deadband set, a read is only sent when a value changed beyond its deadband, or after the max. interval. 0 = not used"));
       }
 
       //section: Values
@@ -2276,6 +2764,18 @@ void handle_devices() {
           TXBuffer += F("<TH style='width:30px;' align='left'>Decimals");
         }
 
+        const bool aggregate = Device[DeviceIndex].TimerOption && taskSampling(taskIndex);
+        if (aggregate)
+        {
+          TXBuffer += F("<TH align='left'>Aggregate");
+        }
+
+        if (Device[DeviceIndex].SendDataOption)
+        {
+          TXBuffer += F("<TH style='width:30px;' align='left'>Deadband");
+          TXBuffer += F("<TH style='width:30px;' align='left'>Deadband %");
+        }
+
         //table body
         for (byte varNr = 0; varNr < Device[DeviceIndex].ValueCount; varNr++)
         {
@@ -2301,6 +2801,29 @@ void handle_devices() {
             id += (varNr + 1);
             addNumericBox(id, ExtraTaskSettings.TaskDeviceValueDecimals[varNr], 0, 6);
           }
+
+          if (aggregate)
+          {
+            html_TD();
+            String options[TASK_AGGREGATE_NR_TYPES];
+            for (byte i = 0; i < TASK_AGGREGATE_NR_TYPES; i++)
+              options[i] = getTaskAggregateName(i);
+            String id = F("TDAG");   //="taskdeviceaggregation"
+            id += (varNr + 1);
+            addSelector(id, TASK_AGGREGATE_NR_TYPES, options, NULL, NULL, ExtraTaskSettings.TaskDeviceAggregation[varNr], false);
+          }
+
+          if (Device[DeviceIndex].SendDataOption)
+          {
+            html_TD();
+            String id = F("TDDB");   //="taskdevicedeadband"
+            id += (varNr + 1);
+            addFloatNumberBox(id, ExtraTaskSettings.TaskDeviceDeadband[varNr], 0, 100000);
+            html_TD();
+            id = F("TDDBP");
+            id += (varNr + 1);
+            addFloatNumberBox(id, ExtraTaskSettings.TaskDeviceDeadbandPercent[varNr], 0, 100);
+          }
         }
       }
     }
@@ -2318,7 +2841,7 @@ void handle_devices() {
     if (Settings.TaskDeviceNumber[taskIndex] != 0 )
       addSubmitButton(F("Delete"), F("del"));
 
-    TXBuffer += F("</table></form>");
+    TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
   }
 
 
@@ -2328,114 +2851,21 @@ void handle_devices() {
     log += String(TXBuffer.sentBytes);
     addLog(LOG_LEVEL_DEBUG_DEV, log);
   }
-  sendHeadandTail(F("TmplStd"),_TAIL);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_TAIL);
   TXBuffer.endStream();
 }
 
 
-byte sortedIndex[DEVICES_MAX + 1];
 //********************************************************************************
 // Add a device select dropdown list
 //********************************************************************************
 void addDeviceSelect(String name,  int choice)
 {
-  // first get the list in alphabetic order
-  for (byte x = 0; x <= deviceCount; x++)
-    sortedIndex[x] = x;
-  sortDeviceArray();
-
-  String deviceName;
-
   addSelector_Head(name, true);
-  addSelector_Item(F("- None -"), 0, false, false, F(""));
-  for (byte x = 0; x <= deviceCount; x++)
-  {
-    byte deviceIndex = sortedIndex[x];
-    if (Plugin_id[deviceIndex] != 0)
-      deviceName = getPluginNameFromDeviceIndex(deviceIndex);
-
-#ifdef PLUGIN_BUILD_DEV
-    int num = Plugin_id[deviceIndex];
-    String plugin = F("P");
-    if (num < 10) plugin += F("0");
-    if (num < 100) plugin += F("0");
-    plugin += num;
-    plugin += F(" - ");
-    deviceName = plugin + deviceName;
-#endif
-
-    addSelector_Item(deviceName,
-                     Device[deviceIndex].Number,
-                     choice == Device[deviceIndex].Number,
-                     false,
-                     F(""));
-  }
+  addCachedSelectorOptions(getDeviceSelectOptions(), choice);
   addSelector_Foot();
 }
 
-//********************************************************************************
-// Device Sort routine, switch array entries
-//********************************************************************************
-void switchArray(byte value)
-{
-  byte temp;
-  temp = sortedIndex[value - 1];
-  sortedIndex[value - 1] = sortedIndex[value];
-  sortedIndex[value] = temp;
-}
-
-
-//********************************************************************************
-// Device Sort routine, compare two array entries
-//********************************************************************************
-boolean arrayLessThan(const String& ptr_1, const String& ptr_2)
-{
-  unsigned int i = 0;
-  while (i < ptr_1.length())    // For each character in string 1, starting with the first:
-  {
-    if (ptr_2.length() < i)    // If string 2 is shorter, then switch them
-    {
-      return true;
-    }
-    else
-    {
-      const char check1 = (char)ptr_1[i];  // get the same char from string 1 and string 2
-      const char check2 = (char)ptr_2[i];
-      if (check1 == check2) {
-        // they're equal so far; check the next char !!
-        i++;
-      } else {
-        return (check2 > check1);
-      }
-    }
-  }
-  return false;
-}
-
-
-//********************************************************************************
-// Device Sort routine, actual sorting
-//********************************************************************************
-void sortDeviceArray()
-{
-  int innerLoop ;
-  int mainLoop ;
-  for ( mainLoop = 1; mainLoop <= deviceCount; mainLoop++)
-  {
-    innerLoop = mainLoop;
-    while (innerLoop  >= 1)
-    {
-      if (arrayLessThan(
-        getPluginNameFromDeviceIndex(sortedIndex[innerLoop]),
-        getPluginNameFromDeviceIndex(sortedIndex[innerLoop - 1])))
-      {
-        switchArray(innerLoop);
-      }
-      innerLoop--;
-    }
-  }
-}
-
 void addFormPinSelect(const String& label, const String& id, int choice)
 {
   addRowLabel(label);
@@ -2451,18 +2881,28 @@ void addFormPinSelectI2C(const String& label, const String& id, int choice)
 
 
 //********************************************************************************
-// Add a GPIO pin select dropdown list for both 8266 and 8285
+// Add a GPIO pin select dropdown list, the options are cached, see getPinSelectOptions()
+//********************************************************************************
+void addPinSelect(boolean forI2C, String name,  int choice)
+{
+  addSelector_Head(name, false);
+  addCachedSelectorOptions(getPinSelectOptions(forI2C), choice);
+  addSelector_Foot();
+}
+
+//********************************************************************************
+// The GPIO pin options for both 8266 and 8285
 //********************************************************************************
 #if defined(ESP8285)
 // Code for the ESP8285
 
 //********************************************************************************
-// Add a GPIO pin select dropdown list
+// The GPIO pin options
 //********************************************************************************
-void addPinSelect(boolean forI2C, String name,  int choice)
+void buildPinSelectOptions(String& result, boolean forI2C)
 {
   String options[18];
-  options[0] = F("- None -");
+  options[0] = getWebString(WEB_STR_NONE);
   options[1] = F("GPIO-0 (D3)");
   options[2] = F("GPIO-1 (D10)");
   options[3] = F("GPIO-2 (D4)");
@@ -2499,7 +2939,7 @@ void addPinSelect(boolean forI2C, String name,  int choice)
   optionValues[15] = 14;
   optionValues[16] = 15;
   optionValues[17] = 16;
-  renderHTMLForPinSelect(options, optionValues, forI2C, name, choice, 18);
+  renderPinSelectOptions(result, options, optionValues, forI2C, 18);
 
 }
 
@@ -2508,12 +2948,12 @@ void addPinSelect(boolean forI2C, String name,  int choice)
 // Code for the ESP8266
 
 //********************************************************************************
-// Add a GPIO pin select dropdown list
+// The GPIO pin options
 //********************************************************************************
-void addPinSelect(boolean forI2C, String name,  int choice)
+void buildPinSelectOptions(String& result, boolean forI2C)
 {
   String options[14];
-  options[0] = F("- None -");
+  options[0] = getWebString(WEB_STR_NONE);
   options[1] = F("GPIO-0 (D3)");
   options[2] = F("GPIO-1 (D10)");
   options[3] = F("GPIO-2 (D4)");
@@ -2542,19 +2982,19 @@ void addPinSelect(boolean forI2C, String name,  int choice)
   optionValues[11] = 14;
   optionValues[12] = 15;
   optionValues[13] = 16;
-  renderHTMLForPinSelect(options, optionValues, forI2C, name, choice, 14);
+  renderPinSelectOptions(result, options, optionValues, forI2C, 14);
 }
 #endif
 
 #if defined(ESP32)
 //********************************************************************************
-// Add a GPIO pin select dropdown list
+// The GPIO pin options
 //********************************************************************************
-void addPinSelect(boolean forI2C, String name,  int choice)
+void buildPinSelectOptions(String& result, boolean forI2C)
 {
   String options[PIN_D_MAX+1];
   int optionValues[PIN_D_MAX+1];
-  options[0] = F("- None -");
+  options[0] = getWebString(WEB_STR_NONE);
   optionValues[0] = -1;
   for(byte x=1; x < PIN_D_MAX+1; x++)
   {
@@ -2562,7 +3002,7 @@ void addPinSelect(boolean forI2C, String name,  int choice)
     options[x] += x;
     optionValues[x] = x;
   }
-  renderHTMLForPinSelect(options, optionValues, forI2C, name, choice, PIN_D_MAX+1);
+  renderPinSelectOptions(result, options, optionValues, forI2C, PIN_D_MAX+1);
 }
 #endif
 
@@ -2570,10 +3010,9 @@ void addPinSelect(boolean forI2C, String name,  int choice)
 #endif
 
 //********************************************************************************
-// Helper function actually rendering dropdown list for addPinSelect()
+// Helper function actually rendering the options for addPinSelect()
 //********************************************************************************
-void renderHTMLForPinSelect(String options[], int optionValues[], boolean forI2C, String name,  int choice, int count) {
-  addSelector_Head(name, false);
+void renderPinSelectOptions(String& result, String options[], int optionValues[], boolean forI2C, int count) {
   for (byte x = 0; x < count; x++)
   {
     boolean disabled = false;
@@ -2585,13 +3024,8 @@ void renderHTMLForPinSelect(String options[], int optionValues[], boolean forI2C
       if (Settings.UseSerial && ((optionValues[x] == 1) || (optionValues[x] == 3)))
         disabled = true;
     }
-    addSelector_Item(options[x],
-                     optionValues[x],
-                     choice == optionValues[x],
-                     disabled,
-                     F(""));
+    appendSelectorOption(result, options[x], optionValues[x], disabled);
   }
-  addSelector_Foot();
 }
 
 
@@ -2637,7 +3071,7 @@ void addSelector(const String& id, int optionCount, const String options[], cons
     TXBuffer += F("<option value=");
     TXBuffer += index;
     if (selectedIndex == index)
-      TXBuffer += F(" selected");
+      TXBuffer += getWebString(WEB_STR_SELECTED);
     if (attr)
     {
       TXBuffer += F(" ");
@@ -2645,9 +3079,9 @@ void addSelector(const String& id, int optionCount, const String options[], cons
     }
     TXBuffer += ">";
     TXBuffer += options[x];
-    TXBuffer += F("</option>");
+    TXBuffer += getWebString(WEB_STR_OPTION_END);
   }
-  TXBuffer += F("</select>");
+  TXBuffer += getWebString(WEB_STR_SELECT_END);
 }
 
 
@@ -2666,7 +3100,7 @@ void addSelector_Item(const String& option, int index, boolean selected, boolean
   TXBuffer += F("<option value=");
   TXBuffer += index;
   if (selected)
-    TXBuffer += F(" selected");
+    TXBuffer += getWebString(WEB_STR_SELECTED);
   if (disabled)
     TXBuffer += F(" disabled");
   if (attr && attr.length() > 0)
@@ -2676,13 +3110,35 @@ void addSelector_Item(const String& option, int index, boolean selected, boolean
   }
   TXBuffer += ">";
   TXBuffer += option;
-  TXBuffer += F("</option>");
+  TXBuffer += getWebString(WEB_STR_OPTION_END);
+}
+
+
+// Stream the cached options (see WebOptions.ino), with the option of choice selected.
+void addCachedSelectorOptions(const String& options, int choice) {
+  String marker = F("<option value=");
+  marker += choice;
+  const char* data = options.c_str();
+  int pos = options.indexOf(marker);
+  while (pos >= 0) {
+    const char next = data[pos + marker.length()];
+    if (next == '>' || next == ' ') break;
+    pos = options.indexOf(marker, pos + 1);
+  }
+  if (pos < 0) {
+    TXBuffer.addChars(data, options.length());
+    return;
+  }
+  const int split = pos + marker.length();
+  TXBuffer.addChars(data, split);
+  TXBuffer += getWebString(WEB_STR_SELECTED);
+  TXBuffer.addChars(data + split, options.length() - split);
 }
 
 
 void addSelector_Foot()
 {
-  TXBuffer += F("</select>");
+  TXBuffer += getWebString(WEB_STR_SELECT_END);
 }
 
 
@@ -2707,7 +3163,7 @@ void addButton(const String &url, const String &label)
   TXBuffer += url;
   TXBuffer += F("'>");
   TXBuffer += label;
-  TXBuffer += F("</a>");
+  TXBuffer += getWebString(WEB_STR_A_END);
 }
 
 void addWideButton(const String &url, const String &label, const String &color)
@@ -2718,7 +3174,7 @@ void addWideButton(const String &url, const String &label, const String &color)
   TXBuffer += url;
   TXBuffer += F("'>");
   TXBuffer += label;
-  TXBuffer += F("</a>");
+  TXBuffer += getWebString(WEB_STR_A_END);
 }
 
 void addSubmitButton()
@@ -2791,7 +3247,7 @@ void addFormNote(const String& text)
   html_TD();
   TXBuffer += F("<div class='note'>Note: ");
   TXBuffer += text;
-  TXBuffer += F("</div>");
+  TXBuffer += getWebString(WEB_STR_DIV_END);
 }
 
 
@@ -2896,7 +3352,7 @@ void addTextBox(const String& id, const String&  value, int maxlength)
   TXBuffer += F("' maxlength=");
   TXBuffer += maxlength;
   TXBuffer += F(" value='");
-  TXBuffer += value;
+  TXBuffer.addHtmlEscaped(value);
   TXBuffer += F("'>");
 }
 
@@ -2971,39 +3427,11 @@ void addEnabled(boolean enabled)
 //********************************************************************************
 void addTaskSelect(String name,  int choice)
 {
-  String deviceName;
-
   TXBuffer += F("<select id='selectwidth' name='");
   TXBuffer += name;
   TXBuffer += F("' onchange='return dept_onchange(frmselect)'>");
-
-  for (byte x = 0; x < TASKS_MAX; x++)
-  {
-    deviceName = "";
-    if (Settings.TaskDeviceNumber[x] != 0 )
-    {
-      byte DeviceIndex = getDeviceIndex(Settings.TaskDeviceNumber[x]);
-
-      if (Plugin_id[DeviceIndex] != 0)
-        deviceName = getPluginNameFromDeviceIndex(DeviceIndex);
-    }
-    LoadTaskSettings(x);
-    TXBuffer += F("<option value='");
-    TXBuffer += x;
-    TXBuffer += "'";
-    if (choice == x)
-      TXBuffer += F(" selected");
-    if (Settings.TaskDeviceNumber[x] == 0)
-      TXBuffer += F(" disabled");
-    TXBuffer += ">";
-    TXBuffer += x + 1;
-    TXBuffer += F(" - ");
-    TXBuffer += deviceName;
-    TXBuffer += F(" - ");
-    TXBuffer += ExtraTaskSettings.TaskDeviceName;
-    TXBuffer += F("</option>");
-  }
-}
+  addCachedSelectorOptions(getTaskSelectOptions(), choice);
+}
 
 
 
@@ -3020,14 +3448,14 @@ void addTaskValueSelect(String name, int choice, byte TaskIndex)
 
   for (byte x = 0; x < Device[DeviceIndex].ValueCount; x++)
   {
-    TXBuffer += F("<option value='");
+    TXBuffer += getWebString(WEB_STR_OPTION_VALUE);
     TXBuffer += x;
     TXBuffer += "'";
     if (choice == x)
-      TXBuffer += F(" selected");
+      TXBuffer += getWebString(WEB_STR_SELECTED);
     TXBuffer += ">";
-    TXBuffer += ExtraTaskSettings.TaskDeviceValueNames[x];
-    TXBuffer += F("</option>");
+    TXBuffer.addHtmlEscaped(ExtraTaskSettings.TaskDeviceValueNames[x]);
+    TXBuffer += getWebString(WEB_STR_OPTION_END);
   }
 }
 
@@ -3040,7 +3468,7 @@ void handle_log() {
   if (!isLoggedIn()) return;
   navMenuIndex = 7;
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"),_HEAD);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_HEAD);
 
   TXBuffer += F("<table class=\"normal\"><TR><TH id=\"headline\" align=\"left\">Log");
   addCopyButton(F("copyText"), F(""), F("Copy log to clipboard"));
@@ -3051,53 +3479,81 @@ void handle_log() {
 
   TXBuffer += jsFetchAndParseLog;
 
-  sendHeadandTail(F("TmplStd"),_TAIL);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_TAIL);
   TXBuffer.endStream();
   }
 
 //********************************************************************************
 // Web Interface JSON log page
+// With ?since=N only the lines after sequence number N are sent, without
+// consuming them, so several clients can follow the log. The reply contains the
+// "Sequence" to use for the next request.
+// Without since, lines are read from the shared read position, as before.
 //********************************************************************************
 void handle_log_JSON() {
   TXBuffer.startJsonStream();
+  const bool useCursor = WebServer.hasArg(F("since"));
+  const unsigned long since = useCursor ? WebServer.arg(F("since")).toInt() : 0;
   String webrequest = WebServer.arg(F("view"));
-  TXBuffer += F("{\"Log\": {");
+  JsonWriter json(writeJsonToTXBuffer, NULL);
+  json.setLineBreaks(true);
+  json.beginObject();
+  json.key(F("Log"));
+  json.beginObject();
   if (webrequest == F("legend")) {
-    TXBuffer += F("\"Legend\": [");
+    json.key(F("Legend"));
+    json.beginArray();
     for (byte i = 0; i < LOG_LEVEL_NRELEMENTS; ++i) {
-      if (i != 0)
-        TXBuffer += ',';
-      TXBuffer += '{';
       int loglevel;
-      stream_next_json_object_value(F("label"), getLogLevelDisplayString(i, loglevel));
-      stream_last_json_object_value(F("loglevel"), String(loglevel));
+      const String label = getLogLevelDisplayString(i, loglevel);
+      json.beginObject();
+      json.member(F("label"), label);
+      json.member(F("loglevel"), loglevel);
+      json.endObject();
     }
-    TXBuffer += F("],\n");
+    json.endArray();
   }
-  TXBuffer += F("\"Entries\": [");
+  json.key(F("Entries"));
+  json.beginArray();
   bool logLinesAvailable = true;
   int nrEntries = 0;
   unsigned long firstTimeStamp = 0;
   unsigned long lastTimeStamp = 0;
+  const unsigned long lastSequence = Logging.lastSequence();
+  if (useCursor) {
+    logLinesAvailable = false;
+    unsigned long sequence = since + 1;
+    if (sequence < Logging.firstSequence()) sequence = Logging.firstSequence();
+    for (; sequence <= lastSequence; ++sequence) {
+      const int index = Logging.getIndexBySequence(sequence);
+      if (index < 0) continue;
+      lastTimeStamp = Logging.getTimeStamp(index);
+      if (nrEntries == 0) {
+        firstTimeStamp = lastTimeStamp;
+      }
+      Logging.writeLogJsonLine(json, index);
+      ++nrEntries;
+    }
+  }
   while (logLinesAvailable) {
-    String reply = Logging.get_logjson_formatted(logLinesAvailable, lastTimeStamp);
-    if (reply.length() > 0) {
-      TXBuffer += reply;
+    // Lines are consumed from the shared read position.
+    const int index = Logging.readNextIndex(logLinesAvailable, lastTimeStamp);
+    if (index >= 0) {
+      Logging.writeLogJsonLine(json, index);
       if (nrEntries == 0) {
         firstTimeStamp = lastTimeStamp;
       }
       ++nrEntries;
     }
-    // Do we need to do something here and maybe limit number of lines at once?
   }
-  TXBuffer += F("],\n");
+  json.endArray();
   long logTimeSpan = timeDiff(firstTimeStamp, lastTimeStamp);
   long refreshSuggestion = 1000;
   long newOptimum = 1000;
   if (nrEntries > 2 && logTimeSpan > 1) {
     // May need to lower the TTL for refresh when time needed
     // to fill half the log is lower than current TTL
-    newOptimum = logTimeSpan * (LOG_STRUCT_MESSAGE_LINES / 2);
+    newOptimum = logTimeSpan * (Logging.size() / 2);
     newOptimum = newOptimum / (nrEntries - 1);
   }
   if (newOptimum < refreshSuggestion) refreshSuggestion = newOptimum;
@@ -3105,12 +3561,15 @@ void handle_log_JSON() {
     // Reload times no lower than 100 msec.
     refreshSuggestion = 100;
   }
-  stream_next_json_object_value(F("TTL"), String(refreshSuggestion));
-  stream_next_json_object_value(F("timeHalfBuffer"), String(newOptimum));
-  stream_next_json_object_value(F("nrEntries"), String(nrEntries));
-  stream_next_json_object_value(F("SettingsWebLogLevel"), String(Settings.WebLogLevel));
-  stream_last_json_object_value(F("logTimeSpan"), String(logTimeSpan));
-  TXBuffer += F("}\n");
+  json.member(F("TTL"), refreshSuggestion);
+  json.member(F("timeHalfBuffer"), newOptimum);
+  json.member(F("nrEntries"), nrEntries);
+  json.member(F("SettingsWebLogLevel"), Settings.WebLogLevel);
+  json.member(F("Sequence"), lastSequence);
+  json.member(F("logTimeSpan"), logTimeSpan);
+  json.endObject();
+  json.endObject();
+  json.raw('\n');
   TXBuffer.endStream();
 }
 
@@ -3121,7 +3580,7 @@ void handle_tools() {
   if (!isLoggedIn()) return;
   navMenuIndex = 7;
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"),_HEAD);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_HEAD);
 
 
   String webrequest = WebServer.arg(F("cmd"));
@@ -3157,7 +3616,7 @@ void handle_tools() {
     {
       TXBuffer += F("<TR><TD colspan='2'>Command Output<BR><textarea readonly rows='10' wrap='on'>");
       TXBuffer += printWebString;
-      TXBuffer += F("</textarea>");
+      TXBuffer += getWebString(WEB_STR_TEXTAREA_END);
     }
 
   addFormSubHeader(F("System"));
@@ -3192,6 +3651,17 @@ void handle_tools() {
   html_TD();
   TXBuffer += F("Show Pin state buffer");
 
+  html_TR_TD_height(30);
+  addWideButton(F("timingstats"), F("Timing stats"), F(""));
+  html_TD();
+  TXBuffer += F("Show timing statistics of plugins, controllers and system functions");
+#ifdef FEATURE_TRACE
+  html_TR_TD_height(30);
+  addWideButton(F("trace"), F("Trace"), F(""));
+  html_TD();
+  TXBuffer += F("Download the last events as Chrome trace (chrome://tracing, ui.perfetto.dev)");
+#endif
+
   addFormSubHeader(F("Wifi"));
 
   html_TR_TD_height(30);
@@ -3229,23 +3699,35 @@ void handle_tools() {
   html_TD();
   TXBuffer += F("Saves a settings file");
 
-#if defined(ESP8266)
+  html_TR_TD_height(30);
+  addWideButton(F("snapshot"), F("Snapshot"), F(""));
+  html_TD();
+  TXBuffer += F("Saves all settings and rules in one file");
+  addFormNote(F("(POST it to /snapshot on another node to apply it)"));
+
   {
+    #if defined(ESP8266)
     const uint32_t flashSize = getFlashRealSizeInBytes();
-    if (flashSize > 524288)
+    #else
+    const uint32_t flashSize = 0;
+    #endif
+    if (flashSize == 0 || flashSize > 524288)
     {
       addFormSubHeader(F("Firmware"));
       html_TR_TD_height(30);
       addWideButton(F("update"), F("Load"), F(""));
       addHelpButton(F("EasyOTA"));
       html_TD();
+      #ifdef ESP32
+      TXBuffer += F("Load a new firmware, .bin or gzip compressed .bin.gz");
+      #else
       TXBuffer += F("Load a new firmware");
-      if (flashSize <= 1048576) {
+      #endif
+      if (flashSize != 0 && flashSize <= 1048576) {
         TXBuffer += F(" <b>WARNING</b> only use 2-step OTA update and sketch < 604 kB");
       }
     }
   }
-#endif
 
   addFormSubHeader(F("Filesystem"));
 
@@ -3266,8 +3748,8 @@ void handle_tools() {
   TXBuffer += F("Show files on SD-Card");
 #endif
 
-  TXBuffer += F("</table></form>");
-  sendHeadandTail(F("TmplStd"),_TAIL);
+  TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_TAIL);
   TXBuffer.endStream();
   printWebString = "";
   printToWeb = false;
@@ -3282,7 +3764,7 @@ void handle_pinstates() {
   if (!isLoggedIn()) return;
   navMenuIndex = 7;
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"),_HEAD);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_HEAD);
 
 
 
@@ -3293,8 +3775,10 @@ void handle_pinstates() {
   TXBuffer += F("<table class='multirow' border=1px frame='box' rules='all'><TH>Plugin");
   addHelpButton(F("Official_plugin_list"));
   TXBuffer += F("<TH>GPIO<TH>Mode<TH>Value/State");
-  for (byte x = 0; x < PINSTATE_TABLE_MAX; x++)
-    if (pinStates[x].plugin != 0)
+  // since=<sequence>: only the pins changed after it
+  const unsigned long since = getFormItemInt(F("since"), 0);
+  for (byte x = 0; x < pinStateCount; x++)
+    if (pinStates[x].sequence > since)
     {
       html_TR_TD(); TXBuffer += F("P");
       if (pinStates[x].plugin < 100)
@@ -3309,162 +3793,570 @@ void handle_pinstates() {
       html_TD();
       TXBuffer += pinStates[x].index;
       html_TD();
-      byte mode = pinStates[x].mode;
-      switch (mode)
-      {
-        case PIN_MODE_UNDEFINED:
-          TXBuffer += F("undefined");
-          break;
-        case PIN_MODE_INPUT:
-          TXBuffer += F("input");
-          break;
-        case PIN_MODE_OUTPUT:
-          TXBuffer += F("output");
-          break;
-        case PIN_MODE_PWM:
-          TXBuffer += F("PWM");
-          break;
-        case PIN_MODE_SERVO:
-          TXBuffer += F("servo");
-          break;
-      }
+      TXBuffer += getPinModeString(pinStates[x].mode);
       html_TD();
       TXBuffer += pinStates[x].value;
     }
 
-  TXBuffer += F("</table>");
-    sendHeadandTail(F("TmplStd"),_TAIL);
+  TXBuffer += getWebString(WEB_STR_TABLE_END);
+  TXBuffer += F("<BR>Change sequence: ");
+  TXBuffer += pinStateSequence;
+    sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_TAIL);
     TXBuffer.endStream();
 }
 
 
+//********************************************************************************
+// Web Interface timing statistics, collected since the last log of the statistics
+//********************************************************************************
+void handle_timingstats() {
+  checkRAM(F("handle_timingstats"));
+  if (!isLoggedIn()) return;
+  navMenuIndex = 7;
+  TXBuffer.startStream();
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_HEAD);
+
+  // With reset=1 all statistics are cleared after showing them, to measure a fixed period.
+  const bool resetOnRead = WebServer.arg(F("reset")) == F("1");
+  // baseline=save (optional threshold=<percent>) or baseline=clear, see TimingBaseline.ino
+  const String baseline = WebServer.arg(F("baseline"));
+  if (baseline == F("save")) saveTimingBaseline(getFormItemInt(F("threshold"), TIMING_BASELINE_THRESHOLD));
+  if (baseline == F("clear")) clearTimingBaseline();
+  TXBuffer += F("<table class='multirow' border=1px frame='box' rules='all'><TH>Description<TH>Function<TH>#calls<TH>min (usec)<TH>avg (usec)"
+                "<TH>p50 (usec)<TH>p90 (usec)<TH>p99 (usec)<TH>max (usec)<TH>baseline p90 (usec)");
+  for (auto& x: pluginStats) {
+    if (x.second.isEmpty()) continue;
+    const int pluginId = x.first/32;
+    String P_name;
+    getPluginFunction(pluginId)(PLUGIN_GET_DEVICENAME, NULL, P_name);
+    String description = F("P_");
+    description += pluginId + 1;
+    description += '_';
+    description += P_name;
+    addTimingStatsRow(description, getPluginFunctionName(x.first%32), x.second, getPluginTimingBaselineKey(x.first));
+  }
+  for (byte x = 0; x < CONTROLLER_MAX; x++) {
+    const controllerStatsStruct& stats = ControllerStats[x];
+    if (stats.isEmpty()) continue;
+    const String description = getControllerStatsLabel(x);
+    for (byte i = 0; i < CONTROLLER_STATS_COUNT; ++i) {
+      if (!stats.stats[i].isEmpty())
+        addTimingStatsRow(description, getControllerStatsName(i), stats.stats[i], TIMING_BASELINE_NO_KEY);
+    }
+    html_TR_TD(); TXBuffer += description;
+    html_TD(); TXBuffer += F("Failures / bytes sent");
+    html_TD(); TXBuffer += stats.failures;
+    html_TD(); TXBuffer += stats.bytesSent;
+    html_TD(); html_TD(); html_TD(); html_TD(); html_TD(); html_TD();
+  }
+  for (auto& x: miscStats) {
+    if (x.second.isEmpty()) continue;
+    String detail;
+    if (x.first == LOADFILE_STATS) detail = String(loadFileBytes) + getWebString(WEB_STR_BYTES);
+    if (x.first == SAVEFILE_STATS) detail = String(saveFileBytes) + getWebString(WEB_STR_BYTES);
+    addTimingStatsRow(getMiscStatsName(x.first), detail, x.second, x.first);
+  }
+  TXBuffer += getWebString(WEB_STR_TABLE_END);
+  if (timingBaselineBuild.length() != 0) {
+    TXBuffer += F("Baseline of ");
+    TXBuffer += timingBaselineBuild;
+    if (timingBaselineTime != 0) {
+      timeStruct ts;
+      breakTime(toLocal(timingBaselineTime), ts);
+      TXBuffer += F(" taken ");
+      TXBuffer += getDateTimeString(ts, '-', ':', ' ', false);
+    }
+    TXBuffer += F(", <span style=\"color:red\">p90</span> above ");
+    TXBuffer += timingBaselineThreshold;
+    TXBuffer += F("% of the baseline is a regression. ");
+    TXBuffer += F("<a class='button link' href='/timingstats?baseline=clear'>Clear baseline</a>");
+  }
+  TXBuffer += F("<a class='button link' href='/timingstats?baseline=save'>Save as baseline</a><BR>");
+
+  TXBuffer += F("<BR><table class='multirow' border=1px frame='box' rules='all'><TH>Page<TH>#calls<TH>avg (usec)<TH>max (usec)"
+                "<TH>avg bytes<TH>avg chunks<TH>blocked avg/max (msec)<TH>min free heap<TH>max heap use<TH>rejected");
+  for (byte x = 0; x < WEB_ROUTE_COUNT; x++) {
+    const webRouteStatsStruct& stats = WebRouteStats[x];
+    if (stats.isEmpty()) continue;
+    unsigned long minVal, maxVal;
+    const unsigned int c = stats.render.getMinMax(minVal, maxVal);
+    const unsigned int calls = c > 0 ? c : 1;
+    html_TR_TD(); TXBuffer += getWebRouteName(x);
+    html_TD(); TXBuffer += c;
+    html_TD(); TXBuffer += stats.render.getAvg();
+    html_TD(); TXBuffer += maxVal;
+    html_TD(); TXBuffer += stats.bytesSent / calls;
+    html_TD(); TXBuffer += stats.chunks / calls;
+    html_TD(); TXBuffer += stats.blockedTotal / calls;
+    TXBuffer += F(" / ");
+    TXBuffer += stats.blockedMax;
+    html_TD(); TXBuffer += stats.minFreeHeap;
+    html_TD(); TXBuffer += stats.maxHeapUse;
+    html_TD(); TXBuffer += stats.rejected;
+  }
+  TXBuffer += getWebString(WEB_STR_TABLE_END);
+
+  TXBuffer += F("<BR><table class='multirow' border=1px frame='box' rules='all'><TH>Heap use<TH>Function<TH>#calls"
+                "<TH>#calls less free heap<TH>avg free heap change<TH>max decrease<TH>max block decrease");
+  for (auto& x: taskHeapStats) {
+    String description = F("Task ");
+    description += x.first / 32 + 1;
+    description += ' ';
+    description += getTaskDeviceName(x.first / 32);
+    addHeapStatsRow(description, getPluginFunctionName(x.first % 32), x.second);
+  }
+  for (auto& x: controllerHeapStats) {
+    addHeapStatsRow(getControllerStatsLabel(x.first / 32), getCPluginFunctionName(x.first % 32), x.second);
+  }
+  TXBuffer += getWebString(WEB_STR_TABLE_END);
+
+  if (!stallStats.empty()) {
+    TXBuffer += F("<BR><table class='multirow' border=1px frame='box' rules='all'><TH>Stalls<TH>count<TH>max (ms)");
+    for (auto& x: stallStats) {
+      html_TR_TD(); TXBuffer += getDispatchName(x.first >> 16, x.first & 0xFF, (x.first >> 8) & 0xFF);
+      html_TD(); TXBuffer += x.second.count;
+      html_TD(); TXBuffer += x.second.maxUsec / 1000;
+    }
+    TXBuffer += getWebString(WEB_STR_TABLE_END);
+  }
+
+  TXBuffer += F("<BR><table class='multirow' border=1px frame='box' rules='all'><TH>Boot step<TH>msec<TH>last boot");
+  for (byte step = 0; step < BOOT_STEPS; ++step) {
+    const long msec = getBootStepMsec(RTC_BootProfile.msec, step);
+    const long lastMsec = lastBootProfileValid ? getBootStepMsec(lastBootProfile.msec, step) : -1;
+    if (msec < 0 && lastMsec < 0) continue;
+    html_TR_TD(); TXBuffer += getBootStepName(step);
+    html_TD(); if (msec >= 0) TXBuffer += msec;
+    html_TD(); if (lastMsec >= 0) TXBuffer += lastMsec;
+  }
+  for (byte x = 0; x < TASKS_MAX; ++x) {
+    if (taskInitDuration[x] == 0) continue;
+    html_TR_TD(); TXBuffer += F("Init task ");
+    TXBuffer += x + 1;
+    html_TD(); TXBuffer += taskInitDuration[x] / 1000;
+    html_TD();
+  }
+  TXBuffer += getWebString(WEB_STR_TABLE_END);
+  if (resetOnRead) {
+    resetTimingStats();
+    TXBuffer += F("<BR>Statistics are cleared, reload to see the values since this page was shown.");
+  } else {
+    TXBuffer += F("<BR><a class='button link' href='/timingstats?reset=1'>Show and clear</a>");
+  }
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_TAIL);
+  TXBuffer.endStream();
+}
+
+// baselineKey: of the stat in the timing baseline, or TIMING_BASELINE_NO_KEY
+void addTimingStatsRow(const String& description, const String& function, const TimingStats& stats, uint32_t baselineKey)
+{
+  unsigned long minVal, maxVal;
+  const unsigned int c = stats.getMinMax(minVal, maxVal);
+  html_TR_TD(); TXBuffer += description;
+  html_TD(); TXBuffer += function;
+  html_TD(); TXBuffer += c;
+  html_TD(); TXBuffer += minVal;
+  html_TD(); TXBuffer += stats.getAvg();
+  html_TD(); TXBuffer += stats.getPercentile(50);
+  html_TD();
+  const bool regression = baselineKey != TIMING_BASELINE_NO_KEY && isTimingRegression(baselineKey, stats);
+  if (regression) TXBuffer += F("<span style=\"color:red\">");
+  TXBuffer += stats.getPercentile(90);
+  if (regression) TXBuffer += F("</span>");
+  html_TD(); TXBuffer += stats.getPercentile(99);
+  html_TD(); TXBuffer += maxVal;
+  html_TD();
+  const uint32_t baselineP90 = baselineKey != TIMING_BASELINE_NO_KEY ? getTimingBaselineP90(baselineKey) : 0;
+  if (baselineP90 != 0) TXBuffer += baselineP90;
+}
+
+
+void addHeapStatsRow(const String& description, const String& function, const heapStatsStruct& stats)
+{
+  html_TR_TD(); TXBuffer += description;
+  html_TD(); TXBuffer += function;
+  html_TD(); TXBuffer += stats.calls;
+  html_TD(); TXBuffer += stats.retainedCalls;
+  html_TD(); TXBuffer += stats.calls > 0 ? static_cast<float>(stats.heapDeltaTotal) / stats.calls : 0.0f;
+  html_TD(); TXBuffer += static_cast<int>(-stats.heapDeltaMin);
+  html_TD();
+  if (getMaxFreeBlock() == 0)
+    TXBuffer += F("n/a");
+  else
+    TXBuffer += stats.maxBlockDropMax;
+}
+
+
+#ifdef FEATURE_TIMESERIES
+//********************************************************************************
+// Web Interface time series download, see TimeSeries.ino
+//********************************************************************************
+// /timeseries?tier=raw|5m|1h&task=<nr>&value=<nr>&since=<unix time>
+// Streams the matching records, oldest first:
+// {"Tier":"5m","Interval":300,"Fields":[...],"Records":[[...],...]}
+void handle_timeseries() {
+  if (!isLoggedIn()) return;
+  byte tier = TIMESERIES_TIER_RAW;
+  const String tierArg = WebServer.arg(F("tier"));
+  if (tierArg == F("5m")) tier = TIMESERIES_TIER_5MIN;
+  else if (tierArg == F("1h")) tier = TIMESERIES_TIER_HOUR;
+  else if (tierArg.length() != 0 && tierArg != F("raw")) {
+    WebServer.send(400, getWebString(WEB_STR_TEXT_PLAIN), F("Unknown tier"));
+    return;
+  }
+  const int taskNr = getFormItemInt(F("task"), 0);
+  const int valueNr = getFormItemInt(F("value"), 0);
+  const uint32_t since = WebServer.hasArg(F("since")) ? WebServer.arg(F("since")).toInt() : 0;
+  if (!initTimeSeries()) {
+    WebServer.send(503, getWebString(WEB_STR_TEXT_PLAIN), F("Time series store not available"));
+    return;
+  }
+
+  TXBuffer.startJsonStream();
+  TXBuffer += '{';
+  TXBuffer += to_json_object_value(F("Tier"), tier == TIMESERIES_TIER_RAW ? F("raw") : (tier == TIMESERIES_TIER_5MIN ? F("5m") : F("1h")));
+  TXBuffer += ',';
+  TXBuffer += to_json_object_value(F("Interval"), String(getTimeSeriesInterval(tier)));
+  if (tier == TIMESERIES_TIER_RAW)
+    TXBuffer += F(",\"Fields\":[\"Time\",\"TaskNumber\",\"ValueNumber\",\"Value\"]");
+  else
+    TXBuffer += F(",\"Fields\":[\"Time\",\"TaskNumber\",\"ValueNumber\",\"Count\",\"Min\",\"Max\",\"Avg\"]");
+  TXBuffer += F(",\"Records\":[");
+
+  const TimeSeriesTier& t = timeSeriesTiers[tier];
+  const uint16_t pages = getTimeSeriesPages(tier);
+  const uint8_t recordSize = getTimeSeriesRecordSize(tier);
+  byte page[TIMESERIES_PAGE_SIZE];
+  bool first = true;
+  fs::File f = SPIFFS.open(FILE_TIMESERIES, "r");
+  for (uint16_t i = 1; i <= pages; ++i) {
+    const uint16_t p = (t.page + i) % pages;
+    const byte* data = page;
+    if (p == t.page) {
+      // Page being filled, the newest records are only in RAM.
+      data = t.buffer;
+    } else {
+      if (!f) continue;
+      f.seek(getTimeSeriesPageOffset(tier, p), fs::SeekSet);
+      if (f.read(page, TIMESERIES_PAGE_SIZE) != TIMESERIES_PAGE_SIZE) continue;
+    }
+    if (getTimeSeriesSequence(data) == 0) continue;
+    for (uint8_t r = 0; r < getTimeSeriesRecordsPerPage(tier); ++r) {
+      const byte* record = data + sizeof(uint32_t) + r * recordSize;
+      const uint32_t time = getTimeSeriesRecordTime(record);
+      if (time == 0 || time < since) continue;
+      if (taskNr > 0 && record[4] != taskNr - 1) continue;
+      if (valueNr > 0 && record[5] != valueNr - 1) continue;
+      String line;
+      line.reserve(64);
+      if (!first) line += ',';
+      first = false;
+      line += '[';
+      line += time;
+      line += ',';
+      line += record[4] + 1;
+      line += ',';
+      line += record[5] + 1;
+      if (tier == TIMESERIES_TIER_RAW) {
+        TimeSeriesSample sample;
+        memcpy(&sample, record, sizeof(sample));
+        line += ',';
+        line += toString(sample.value, 3);
+      } else {
+        TimeSeriesAggregate aggregate;
+        memcpy(&aggregate, record, sizeof(aggregate));
+        line += ',';
+        line += aggregate.count;
+        line += ',';
+        line += toString(aggregate.min, 3);
+        line += ',';
+        line += toString(aggregate.max, 3);
+        line += ',';
+        line += toString(aggregate.avg, 3);
+      }
+      line += ']';
+      TXBuffer += line;
+    }
+  }
+  if (f) f.close();
+  TXBuffer += F("]}");
+  TXBuffer.endStream();
+}
+#endif // FEATURE_TIMESERIES
+
+
+#ifdef FEATURE_TRACE
+//********************************************************************************
+// Web Interface execution trace download, see Trace.ino
+//********************************************************************************
+String getTraceCategoryName(byte category) {
+  switch (category) {
+    case DISPATCH_SCHEDULER:  return F("scheduler");
+    case DISPATCH_PLUGIN:     return F("plugin");
+    case DISPATCH_CONTROLLER: return F("controller");
+    case DISPATCH_WEB:        return F("web");
+    case DISPATCH_RULES:      return F("rules");
+  }
+  return F("unknown");
+}
+
+void handle_trace() {
+  checkRAM(F("handle_trace"));
+  if (!isLoggedIn()) return;
+  if (WebServer.hasArg(F("freeze")) || WebServer.hasArg(F("resume"))) {
+    if (WebServer.hasArg(F("freeze")))
+      traceFreezeLoopUsec = getFormItemInt(F("freeze"), 0) * 1000ul;
+    if (WebServer.arg(F("resume")) == F("1"))
+      traceFrozen = false;
+    String reply = traceFrozen ? F("Trace frozen") : F("Trace recording");
+    reply += F(", freeze on loops > ");
+    reply += traceFreezeLoopUsec / 1000;
+    reply += F(" msec (0 = off)");
+    WebServer.send(200, getWebString(WEB_STR_TEXT_PLAIN), reply);
+    return;
+  }
+  // Do not record the events of streaming the trace itself.
+  const bool wasFrozen = traceFrozen;
+  traceFrozen = true;
+  TXBuffer.startJsonStream();
+  TXBuffer += F("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  for (unsigned int i = 0; i < traceCount; ++i) {
+    const traceEventStruct& event = traceEvents[(traceHead + TRACE_MAX_EVENTS - traceCount + i) % TRACE_MAX_EVENTS];
+    if (i != 0) TXBuffer += F(",\n");
+    TXBuffer += F("{\"ph\":\"X\",\"pid\":1,\"tid\":1,");
+    TXBuffer += to_json_object_value(F("name"), getDispatchName(event.category, event.id, event.arg));
+    TXBuffer += ',';
+    TXBuffer += to_json_object_value(F("cat"), getTraceCategoryName(event.category));
+    TXBuffer += F(",\"ts\":");
+    TXBuffer += event.start;
+    TXBuffer += F(",\"dur\":");
+    TXBuffer += event.duration;
+    TXBuffer += '}';
+  }
+  TXBuffer += F("]}");
+  TXBuffer.endStream();
+  traceFrozen = wasFrozen;
+}
+#endif // FEATURE_TRACE
+
+//********************************************************************************
+// Web Interface Prometheus metrics (/metrics)
+// Written to TXBuffer line by line in the text exposition format.
+// The timing statistics are cleared every statistics interval by logStatistics(),
+// so their _count and _sum are counters which reset often, use rate() on them.
+//********************************************************************************
+void addMetricHeader(const __FlashStringHelper* name, const __FlashStringHelper* type, const __FlashStringHelper* help) {
+  TXBuffer += F("# HELP espeasy_");
+  TXBuffer += name;
+  TXBuffer += ' ';
+  TXBuffer += help;
+  TXBuffer += F("\n# TYPE espeasy_");
+  TXBuffer += name;
+  TXBuffer += ' ';
+  TXBuffer += type;
+  TXBuffer += '\n';
+}
+
+// Writes: espeasy_<name><suffix>{<labels>,quantile="0.<quantile>"} followed by a space.
+// Labels and quantile are left out when empty or 0.
+void addMetricName(const __FlashStringHelper* name, const __FlashStringHelper* suffix, const String& labels, byte quantile) {
+  TXBuffer += F("espeasy_");
+  TXBuffer += name;
+  TXBuffer += suffix;
+  if (labels.length() != 0 || quantile != 0) {
+    TXBuffer += '{';
+    TXBuffer += labels;
+    if (quantile != 0) {
+      if (labels.length() != 0) TXBuffer += ',';
+      TXBuffer += F("quantile=\"0.");
+      TXBuffer += static_cast<int>(quantile % 10 == 0 ? quantile / 10 : quantile);
+      TXBuffer += '"';
+    }
+    TXBuffer += '}';
+  }
+  TXBuffer += ' ';
+}
+
+void addMetric(const __FlashStringHelper* name, const __FlashStringHelper* type, const __FlashStringHelper* help, unsigned long value) {
+  addMetricHeader(name, type, help);
+  addMetricName(name, F(""), String(), 0);
+  TXBuffer += value;
+  TXBuffer += '\n';
+}
+
+void addMetric(const __FlashStringHelper* name, const __FlashStringHelper* type, const __FlashStringHelper* help, float value) {
+  addMetricHeader(name, type, help);
+  addMetricName(name, F(""), String(), 0);
+  TXBuffer += value;
+  TXBuffer += '\n';
+}
+
+void addLabeledMetric(const __FlashStringHelper* name, const String& labels, unsigned long value) {
+  addMetricName(name, F(""), labels, 0);
+  TXBuffer += value;
+  TXBuffer += '\n';
+}
+
+void addTimingStatsMetric(const __FlashStringHelper* name, const String& labels, const TimingStats& stats) {
+  if (stats.isEmpty()) return;
+  const byte percentiles[] = { 50, 90, 99 };
+  for (byte i = 0; i < sizeof(percentiles); ++i) {
+    addMetricName(name, F(""), labels, percentiles[i]);
+    TXBuffer += stats.getPercentile(percentiles[i]);
+    TXBuffer += '\n';
+  }
+  addMetricName(name, F("_sum"), labels, 0);
+  TXBuffer += stats.getAvg() * stats.getCount();
+  TXBuffer += '\n';
+  addMetricName(name, F("_count"), labels, 0);
+  TXBuffer += static_cast<uint32_t>(stats.getCount());
+  TXBuffer += '\n';
+}
+
+void handle_metrics() {
+  checkRAM(F("handle_metrics"));
+  if (!clientIPallowed()) return;
+  TXBuffer.startTextStream(F("text/plain; version=0.0.4"));
+
+  addMetric(F("uptime_seconds"), F("counter"), F("Time since boot"), millis() / 1000);
+  addMetric(F("loop_count_per_second"), F("gauge"), F("Main loop runs per second"), static_cast<unsigned long>(getLoopCountPerSec()));
+  addMetric(F("cpu_load_percent"), F("gauge"), F("Load of the main loop"), getCPUload());
+  addMetric(F("idle_percent"), F("gauge"), F("Time the scheduler had nothing to do"), msecTimerHandler.getIdleTimePct());
+  addMetric(F("scheduler_queue_length"), F("gauge"), F("Timers scheduled"), static_cast<unsigned long>(msecTimerHandler.getQueueLength()));
+  addMetric(F("scheduler_queue_length_max"), F("gauge"), F("Max. timers scheduled since boot"), msecTimerHandler.getMaxQueueLength());
+  addMetric(F("scheduler_timers_dropped"), F("counter"), F("Timers not set, the scheduler was full"), msecTimerHandler.getDroppedCount());
+  addMetric(F("free_heap_bytes"), F("gauge"), F("Free heap"), FreeMem());
+  addMetric(F("min_free_heap_bytes"), F("gauge"), F("Lowest free heap seen"), static_cast<unsigned long>(lowestRAM));
+  addMetricHeader(F("min_free_heap_function_bytes"), F("gauge"), F("Lowest free heap seen by checkRAM, with the function"));
+  {
+    String labels = F("function=\"");
+    String function = lowestRAMfunction;
+    function.replace('"', '\'');
+    labels += function;
+    labels += '"';
+    addLabeledMetric(F("min_free_heap_function_bytes"), labels, static_cast<unsigned long>(lowestRAM));
+  }
+  addMetric(F("min_free_heap_sampled_bytes"), F("gauge"), F("Lowest free heap of the samples each second"), static_cast<unsigned long>(heapTrend.minFree));
+  {
+    const uint32_t maxBlock = findMaxFreeBlock();
+    addMetric(F("max_free_block_bytes"), F("gauge"), F("Largest free heap block"), static_cast<unsigned long>(maxBlock));
+    addMetric(F("min_max_free_block_bytes"), F("gauge"), F("Lowest largest free heap block of the samples each second"), static_cast<unsigned long>(heapTrend.minBlock));
+    addMetric(F("heap_fragmentation_percent"), F("gauge"), F("100 - largest free block * 100 / free heap"), static_cast<unsigned long>(getHeapFragmentation(FreeMem(), maxBlock)));
+    addMetric(F("max_heap_fragmentation_percent"), F("gauge"), F("Highest fragmentation of the samples each second"), static_cast<unsigned long>(heapTrend.maxFragmentation));
+  }
+  addMetric(F("wifi_reconnects_total"), F("counter"), F("WiFi reconnects"), static_cast<unsigned long>(wifi_reconnects < 0 ? 0 : wifi_reconnects));
+  addMetric(F("connection_failures"), F("gauge"), F("Failed controller connections, cleared on success"), connectionFailures);
+
+  addMetricHeader(F("controller_queue_length"), F("gauge"), F("Samples waiting in the controller queue"));
+  for (byte x = 0; x < CONTROLLER_MAX; x++) {
+    if (Settings.Protocol[x] == 0) continue;
+    String labels = F("controller=\"");
+    labels += getControllerStatsLabel(x);
+    labels += '"';
+    addLabeledMetric(F("controller_queue_length"), labels, static_cast<unsigned long>(ControllerQueue[x].count + ControllerQueue[x].onFile()));
+  }
+  addMetricHeader(F("controller_queue_dropped_total"), F("counter"), F("Samples dropped from a full controller queue"));
+  for (byte x = 0; x < CONTROLLER_MAX; x++) {
+    if (Settings.Protocol[x] == 0) continue;
+    String labels = F("controller=\"");
+    labels += getControllerStatsLabel(x);
+    labels += '"';
+    addLabeledMetric(F("controller_queue_dropped_total"), labels, ControllerQueue[x].dropped);
+  }
+  addMetricHeader(F("controller_refused_total"), F("counter"), F("Requests answered with another status than 200"));
+  for (byte x = 0; x < CONTROLLER_MAX; x++) {
+    if (Settings.Protocol[x] == 0) continue;
+    String labels = F("controller=\"");
+    labels += getControllerStatsLabel(x);
+    labels += '"';
+    addLabeledMetric(F("controller_refused_total"), labels, ControllerRateLimit[x].refused);
+  }
+
+  addMetricHeader(F("plugin_call_usec"), F("summary"), F("Duration of plugin calls"));
+  for (auto& x: pluginStats) {
+    String labels = F("plugin=\"P_");
+    labels += getPluginNumber(x.first / 32);
+    labels += F("\",function=\"");
+    labels += getPluginFunctionName(x.first % 32);
+    labels.trim();
+    labels += '"';
+    addTimingStatsMetric(F("plugin_call_usec"), labels, x.second);
+  }
+  addMetricHeader(F("controller_usec"), F("summary"), F("Duration of controller connects, sends and replies"));
+  for (byte x = 0; x < CONTROLLER_MAX; x++) {
+    if (ControllerStats[x].isEmpty()) continue;
+    for (byte i = 0; i < CONTROLLER_STATS_COUNT; ++i) {
+      String labels = F("controller=\"");
+      labels += getControllerStatsLabel(x);
+      labels += F("\",stat=\"");
+      labels += getControllerStatsName(i);
+      labels.trim();
+      labels += '"';
+      addTimingStatsMetric(F("controller_usec"), labels, ControllerStats[x].stats[i]);
+    }
+  }
+  addMetricHeader(F("misc_usec"), F("summary"), F("Duration of system functions"));
+  for (auto& x: miscStats) {
+    String labels = F("function=\"");
+    labels += getMiscStatsName(x.first);
+    labels.trim();
+    labels += '"';
+    addTimingStatsMetric(F("misc_usec"), labels, x.second);
+  }
+  addMetricHeader(F("web_render_usec"), F("summary"), F("Duration of web page handlers"));
+  for (byte x = 0; x < WEB_ROUTE_COUNT; x++) {
+    String labels = F("route=\"");
+    labels += getWebRouteName(x);
+    labels += '"';
+    addTimingStatsMetric(F("web_render_usec"), labels, WebRouteStats[x].render);
+  }
+  TXBuffer.endStream();
+}
+
+
 //********************************************************************************
 // Web Interface I2C scanner
+// Shows the result of the background scan, see I2C_startScan(). A new scan is
+// started for old results or with rescan=1, the page reloads until it is done.
 //********************************************************************************
 void handle_i2cscanner() {
   checkRAM(F("handle_i2cscanner"));
   if (!isLoggedIn()) return;
   navMenuIndex = 7;
+  if (!I2C_scanValid() || I2C_scanAge() > I2C_SCAN_MAX_AGE || WebServer.hasArg(F("rescan")))
+    I2C_startScan(false);
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"),_HEAD);
-
-  char *TempString = (char*)malloc(80);
-
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_HEAD);
 
+  if (I2C_scanRunning())
+  {
+    TXBuffer += F("<script>setTimeout(function(){location.href='i2cscanner';},500);</script>");
+  }
+  if (!I2C_scanValid())
+  {
+    TXBuffer += F("Scanning I2C bus: ");
+    TXBuffer += I2C_scanProgress();
+    TXBuffer += '/';
+    TXBuffer += I2C_SCAN_LAST_ADDRESS;
+    sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_TAIL);
+    TXBuffer.endStream();
+    return;
+  }
 
   TXBuffer += F("<table class='multirow' border=1px frame='box' rules='all'><TH>I2C Addresses in use<TH>Supported devices");
 
-  byte error, address;
-  int nDevices;
-  nDevices = 0;
-  for (address = 1; address <= 127; address++ )
+  int nDevices = 0;
+  for (byte address = 1; address <= I2C_SCAN_LAST_ADDRESS; address++ )
   {
-    Wire.beginTransmission(address);
-    error = Wire.endTransmission();
-    if (error == 0)
+    if (I2C_scanFound(address))
     {
       TXBuffer += "<TR><TD>";
       TXBuffer += formatToHex(address);
       TXBuffer += "<TD>";
-      switch (address)
-      {
-        case 0x20:
-        case 0x21:
-        case 0x22:
-        case 0x25:
-        case 0x26:
-        case 0x27:
-          TXBuffer += F("PCF8574<BR>MCP23017<BR>LCD");
-          break;
-        case 0x23:
-          TXBuffer += F("PCF8574<BR>MCP23017<BR>LCD<BR>BH1750");
-          break;
-        case 0x24:
-          TXBuffer += F("PCF8574<BR>MCP23017<BR>LCD<BR>PN532");
-          break;
-        case 0x29:
-          TXBuffer += F("TSL2561");
-          break;
-        case 0x38:
-        case 0x3A:
-        case 0x3B:
-        case 0x3E:
-        case 0x3F:
-          TXBuffer += F("PCF8574A");
-          break;
-        case 0x39:
-          TXBuffer += F("PCF8574A<BR>TSL2561<BR>APDS9960");
-          break;
-        case 0x3C:
-        case 0x3D:
-          TXBuffer += F("PCF8574A<BR>OLED");
-          break;
-        case 0x40:
-          TXBuffer += F("SI7021<BR>HTU21D<BR>INA219<BR>PCA9685");
-          break;
-        case 0x41:
-        case 0x42:
-        case 0x43:
-          TXBuffer += F("INA219");
-          break;
-        case 0x44:
-        case 0x45:
-          TXBuffer += F("SHT30/31/35");
-          break;
-        case 0x48:
-        case 0x4A:
-        case 0x4B:
-          TXBuffer += F("PCF8591<BR>ADS1115<BR>LM75A");
-          break;
-        case 0x49:
-          TXBuffer += F("PCF8591<BR>ADS1115<BR>TSL2561<BR>LM75A");
-          break;
-        case 0x4C:
-        case 0x4E:
-        case 0x4F:
-          TXBuffer += F("PCF8591<BR>LM75A");
-          break;
-        case 0x4D:
-          TXBuffer += F("PCF8591<BR>MCP3221<BR>LM75A");
-          break;
-        case 0x5A:
-          TXBuffer += F("MLX90614<BR>MPR121");
-          break;
-        case 0x5B:
-          TXBuffer += F("MPR121");
-          break;
-        case 0x5C:
-          TXBuffer += F("DHT12<BR>AM2320<BR>BH1750<BR>MPR121");
-          break;
-        case 0x5D:
-          TXBuffer += F("MPR121");
-          break;
-        case 0x60:
-          TXBuffer += F("Adafruit Motorshield v2<BR>SI1145");
-          break;
-        case 0x70:
-          TXBuffer += F("Adafruit Motorshield v2 (Catchall)<BR>HT16K33");
-          break;
-        case 0x71:
-        case 0x72:
-        case 0x73:
-        case 0x74:
-        case 0x75:
-          TXBuffer += F("HT16K33");
-          break;
-        case 0x76:
-          TXBuffer += F("BME280<BR>BMP280<BR>MS5607<BR>MS5611<BR>HT16K33");
-          break;
-        case 0x77:
-          TXBuffer += F("BMP085<BR>BMP180<BR>BME280<BR>BMP280<BR>MS5607<BR>MS5611<BR>HT16K33");
-          break;
-        case 0x7f:
-          TXBuffer += F("Arduino PME");
-          break;
-      }
+      TXBuffer += getKnownI2Cdevices(address);
       nDevices++;
     }
-    else if (error == 4)
+    else if (I2C_scanError(address))
     {
       html_TR_TD(); TXBuffer += F("Unknown error at address ");
       TXBuffer += formatToHex(address);
@@ -3474,10 +4366,102 @@ void handle_i2cscanner() {
   if (nDevices == 0)
     TXBuffer += F("<TR>No I2C devices found");
 
-  TXBuffer += F("</table>");
-  sendHeadandTail(F("TmplStd"),_TAIL);
+  TXBuffer += F("</table><BR>Scanned ");
+  TXBuffer += I2C_scanAge() / 1000;
+  TXBuffer += F(" s ago, in ");
+  TXBuffer += I2C_scanDuration();
+  TXBuffer += F(" ms");
+  if (I2C_scanRunning())
+  {
+    TXBuffer += F(", new scan running: ");
+    TXBuffer += I2C_scanProgress();
+    TXBuffer += '/';
+    TXBuffer += I2C_SCAN_LAST_ADDRESS;
+  }
+  else
+  {
+    TXBuffer += getWebString(WEB_STR_BR);
+    addButton(F("i2cscanner?rescan=1"), F("Scan again"));
+  }
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_TAIL);
   TXBuffer.endStream();
-  free(TempString);
+}
+
+// Devices supported by ESPEasy which may use the I2C address
+String getKnownI2Cdevices(byte address) {
+  switch (address)
+  {
+    case 0x20:
+    case 0x21:
+    case 0x22:
+    case 0x25:
+    case 0x26:
+    case 0x27:
+      return F("PCF8574<BR>MCP23017<BR>LCD");
+    case 0x23:
+      return F("PCF8574<BR>MCP23017<BR>LCD<BR>BH1750");
+    case 0x24:
+      return F("PCF8574<BR>MCP23017<BR>LCD<BR>PN532");
+    case 0x29:
+      return F("TSL2561");
+    case 0x38:
+    case 0x3A:
+    case 0x3B:
+    case 0x3E:
+    case 0x3F:
+      return F("PCF8574A");
+    case 0x39:
+      return F("PCF8574A<BR>TSL2561<BR>APDS9960");
+    case 0x3C:
+    case 0x3D:
+      return F("PCF8574A<BR>OLED");
+    case 0x40:
+      return F("SI7021<BR>HTU21D<BR>INA219<BR>PCA9685");
+    case 0x41:
+    case 0x42:
+    case 0x43:
+      return F("INA219");
+    case 0x44:
+    case 0x45:
+      return F("SHT30/31/35");
+    case 0x48:
+    case 0x4A:
+    case 0x4B:
+      return F("PCF8591<BR>ADS1115<BR>LM75A");
+    case 0x49:
+      return F("PCF8591<BR>ADS1115<BR>TSL2561<BR>LM75A");
+    case 0x4C:
+    case 0x4E:
+    case 0x4F:
+      return F("PCF8591<BR>LM75A");
+    case 0x4D:
+      return F("PCF8591<BR>MCP3221<BR>LM75A");
+    case 0x5A:
+      return F("MLX90614<BR>MPR121");
+    case 0x5B:
+      return F("MPR121");
+    case 0x5C:
+      return F("DHT12<BR>AM2320<BR>BH1750<BR>MPR121");
+    case 0x5D:
+      return F("MPR121");
+    case 0x60:
+      return F("Adafruit Motorshield v2<BR>SI1145");
+    case 0x70:
+      return F("Adafruit Motorshield v2 (Catchall)<BR>HT16K33");
+    case 0x71:
+    case 0x72:
+    case 0x73:
+    case 0x74:
+    case 0x75:
+      return F("HT16K33");
+    case 0x76:
+      return F("BME280<BR>BMP280<BR>MS5607<BR>MS5611<BR>HT16K33");
+    case 0x77:
+      return F("BMP085<BR>BMP180<BR>BME280<BR>BMP280<BR>MS5607<BR>MS5611<BR>HT16K33");
+    case 0x7f:
+      return F("Arduino PME");
+  }
+  return "";
 }
 
 
@@ -3489,23 +4473,35 @@ void handle_wifiscanner() {
   if (!isLoggedIn()) return;
   navMenuIndex = 7;
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"),_HEAD);
-  TXBuffer += F("<table class='multirow'><TR><TH>SSID<TH>BSSID<TH>info");
-
-  int n = WiFi.scanNetworks(false, true);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_HEAD);
+  TXBuffer += F("<table class='multirow'><TR><TH>SSID<TH>BSSID<TH>info<TH>Last seen");
+
+  if (!isWiFiScanCacheComplete() || WebServer.hasArg(F("rescan")))
+    scanAllWiFiChannels();
+
+  // Strongest first
+  byte order[WIFI_SCAN_CACHE_SIZE];
+  byte n = 0;
+  for (byte x = 0; x < WIFI_SCAN_CACHE_SIZE; ++x) {
+    if (!isWiFiScanCacheEntryValid(x)) continue;
+    byte pos = n++;
+    for (; pos > 0 && WiFiScanCache[order[pos - 1]].rssiX4 < WiFiScanCache[x].rssiX4; --pos)
+      order[pos] = order[pos - 1];
+    order[pos] = x;
+  }
   if (n == 0)
     TXBuffer += F("No Access Points found");
-  else
+  for (byte i = 0; i < n; ++i)
   {
-    for (int i = 0; i < n; ++i)
-    {
-      html_TR_TD();
-      TXBuffer += formatScanResult(i, "<TD>");
-    }
+    html_TR_TD();
+    TXBuffer += formatScanCacheResult(order[i], "<TD>");
+    TXBuffer += getWebString(WEB_STR_TD);
+    TXBuffer += static_cast<unsigned long>(timePassedSince(WiFiScanCache[order[i]].lastSeen) / 1000);
+    TXBuffer += F(" s ago");
   }
 
-  TXBuffer += F("</table>");
-  sendHeadandTail(F("TmplStd"),_TAIL);
+  TXBuffer += getWebString(WEB_STR_TABLE_END);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_TAIL);
   TXBuffer.endStream();
 }
 
@@ -3517,7 +4513,7 @@ void handle_login() {
   checkRAM(F("handle_login"));
   if (!clientIPallowed()) return;
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"),_HEAD);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_HEAD);
 
   String webrequest = WebServer.arg(F("password"));
   char command[80];
@@ -3534,7 +4530,7 @@ void handle_login() {
   html_TD();
   addSubmitButton();
   html_TR_TD();
-  TXBuffer += F("</table></form>");
+  TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
 
   if (webrequest.length() != 0)
   {
@@ -3556,7 +4552,7 @@ void handle_login() {
     }
   }
 
-  sendHeadandTail(F("TmplStd"),_TAIL);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_TAIL);
   TXBuffer.endStream();
   printWebString = "";
   printToWeb = false;
@@ -3570,7 +4566,7 @@ void handle_control() {
   checkRAM(F("handle_control"));
   if (!clientIPallowed()) return;
   //TXBuffer.startStream(true); // true= json
-  // sendHeadandTail(F("TmplStd"),_HEAD);
+  // sendHeadandTail(getWebString(WEB_STR_TMPL_STD),_HEAD);
   String webrequest = WebServer.arg(F("cmd"));
 
   // in case of event, store to buffer and return...
@@ -3578,6 +4574,7 @@ void handle_control() {
   if (command == F("event"))
   {
     eventBuffer = webrequest.substring(6);
+    notifyEventBuffer();
     WebServer.send(200, "text/html", "OK");
     return;
   }
@@ -3619,14 +4616,28 @@ void handle_control() {
    Streaming versions directly to TXBuffer
   \*********************************************************************************************/
 
+// Output function of a JsonWriter, see handle_json()
+void writeJsonToTXBuffer(void* context, const char* data, unsigned int length) {
+  TXBuffer.addChars(data, length);
+}
+
+// Same output as to_json_object_value(), without building the String first.
 void stream_to_json_object_value(const String& object, const String& value) {
-  TXBuffer += F("\"");
+  TXBuffer += '"';
   TXBuffer += object;
   TXBuffer += F("\":");
   if (value.length() == 0 || !isFloat(value)) {
-    TXBuffer += F("\"");
-    TXBuffer += value;
-    TXBuffer += F("\"");
+    TXBuffer += '"';
+    if (value.indexOf('\n') == -1 && value.indexOf('"') == -1 && value.indexOf(F("Pragma")) == -1) {
+      TXBuffer += value;
+    } else {
+      String tmpValue(value);
+      tmpValue.replace('\n', '^');
+      tmpValue.replace('"', '\'');
+      tmpValue.replace(F("Pragma"), F("Bugje!"));
+      TXBuffer += tmpValue;
+    }
+    TXBuffer += '"';
   } else {
     TXBuffer += value;
   }
@@ -3638,28 +4649,52 @@ String jsonBool(bool value) {
 
 // Add JSON formatted data directly to the TXbuffer, including a trailing comma.
 void stream_next_json_object_value(const String& object, const String& value) {
-  TXBuffer += to_json_object_value(object, value);
-  TXBuffer += ",\n";
+  stream_to_json_object_value(object, value);
+  TXBuffer += F(",\n");
 }
 
 // Add JSON formatted data directly to the TXbuffer, including a closing '}'
 void stream_last_json_object_value(const String& object, const String& value) {
-  TXBuffer += to_json_object_value(object, value);
-  TXBuffer += "\n}";
+  stream_to_json_object_value(object, value);
+  TXBuffer += F("\n}");
 }
 
 
+// Check if a number is in a comma separated list (e.g. "1,3,4"), an empty list contains all.
+bool isInJsonNumberList(const String& list, int number) {
+  if (list.length() == 0) return true;
+  int pos = 0;
+  while (pos < static_cast<int>(list.length())) {
+    int end = list.indexOf(',', pos);
+    if (end < 0) end = list.length();
+    if (list.substring(pos, end).toInt() == number) return true;
+    pos = end + 1;
+  }
+  return false;
+}
+
 //********************************************************************************
 // Web Interface JSON page (no password!)
+// Optional arguments:
+//   tasknr=N       Only task N, without the surrounding object
+//   tasks=1,3      Only these tasks
+//   values=1,2     Only these value numbers of each task
+//   view=sensorupdate  Only task values, view=system only System, WiFi and I2C
+//   since=N        Only tasks changed after sequence N (see "Sequence" in the reply)
+// Without System and WiFi section the reply has an ETag, so unchanged data returns 304.
 //********************************************************************************
 void handle_json()
 {
   const int taskNr = getFormItemInt(F("tasknr"), -1);
   const bool showSpecificTask = taskNr > 0;
+  const String taskList = WebServer.arg(F("tasks"));
+  const String valueList = WebServer.arg(F("values"));
+  const unsigned long since = WebServer.hasArg(F("since")) ? WebServer.arg(F("since")).toInt() : 0;
   bool showSystem = true;
   bool showWifi = true;
   bool showDataAcquisition = true;
   bool showTaskDetails = true;
+  bool showSensors = true;
   {
     String view = WebServer.arg("view");
     if (view.length() != 0) {
@@ -3668,57 +4703,92 @@ void handle_json()
         showWifi = false;
         showDataAcquisition = false;
         showTaskDetails = false;
+      } else if (view == F("system")) {
+        showSensors = false;
       }
     }
   }
+  if (showSpecificTask && (taskNr > TASKS_MAX)) {
+    WebServer.send(404, getWebString(WEB_STR_TEXT_PLAIN), F("Unknown task"));
+    return;
+  }
+  if (showSpecificTask || (!showSystem && !showWifi)) {
+    // Only task values and settings, which are tracked by taskValueSequence.
+    String etag = F("\"");
+    etag += String(taskValueSequence, HEX);
+    etag += '"';
+    if (handleNotModified(etag)) return;
+  }
   TXBuffer.startJsonStream();
+  JsonWriter json(writeJsonToTXBuffer, NULL);
+  json.setLineBreaks(true);
   if (!showSpecificTask)
   {
-    TXBuffer += '{';
+    json.beginObject();
     if (showSystem) {
-      TXBuffer += F("\"System\":{\n");
-      stream_next_json_object_value(F("Build"), String(BUILD));
-      stream_next_json_object_value(F("Git Build"), String(BUILD_GIT));
-      stream_next_json_object_value(F("System libraries"), getSystemLibraryString());
-      stream_next_json_object_value(F("Plugins"), String(deviceCount + 1));
-      stream_next_json_object_value(F("Plugin description"), getPluginDescriptionString());
-      stream_next_json_object_value(F("Local time"), getDateTimeString('-',':',' '));
-      stream_next_json_object_value(F("Unit"), String(Settings.Unit));
-      stream_next_json_object_value(F("Name"), String(Settings.Name));
-      stream_next_json_object_value(F("Uptime"), String(wdcounter / 2));
-      stream_next_json_object_value(F("Last boot cause"), getLastBootCauseString());
-      stream_next_json_object_value(F("Reset Reason"), getResetReasonString());
+      json.key(F("System"));
+      json.beginObject();
+      json.member(F("Build"), BUILD);
+      json.member(F("Git Build"), F(BUILD_GIT));
+      json.member(F("System libraries"), getSystemLibraryString());
+      json.member(F("Plugins"), deviceCount + 1);
+      json.member(F("Plugin description"), getPluginDescriptionString());
+      json.member(F("Local time"), getDateTimeString('-',':',' '));
+      json.member(F("Unit"), Settings.Unit);
+      json.member(F("Name"), Settings.Name);
+      json.member(F("Uptime"), wdcounter / 2);
+      json.member(F("Last boot cause"), getLastBootCauseString());
+      json.member(F("Reset Reason"), getResetReasonString());
 
       if (wdcounter > 0)
       {
-          stream_next_json_object_value(F("Load"), String(getCPUload()));
-          stream_next_json_object_value(F("Load LC"), String(getLoopCountPerSec()));
+          json.member(F("Load"), getCPUload(), 2);
+          json.member(F("Load LC"), getLoopCountPerSec());
       }
 
-      stream_last_json_object_value(F("Free RAM"), String(ESP.getFreeHeap()));
-      TXBuffer += F(",\n");
+      json.member(F("Free RAM"), ESP.getFreeHeap());
+      json.endObject();
     }
     if (showWifi) {
-      TXBuffer += F("\"WiFi\":{\n");
+      json.key(F("WiFi"));
+      json.beginObject();
       #if defined(ESP8266)
-        stream_next_json_object_value(F("Hostname"), WiFi.hostname());
+        json.member(F("Hostname"), WiFi.hostname());
       #endif
-      stream_next_json_object_value(F("IP config"), useStaticIP() ? F("Static") : F("DHCP"));
-      stream_next_json_object_value(F("IP"), WiFi.localIP().toString());
-      stream_next_json_object_value(F("Subnet Mask"), WiFi.subnetMask().toString());
-      stream_next_json_object_value(F("Gateway IP"), WiFi.gatewayIP().toString());
-      stream_next_json_object_value(F("MAC address"), WiFi.macAddress());
-      stream_next_json_object_value(F("DNS 1"), WiFi.dnsIP(0).toString());
-      stream_next_json_object_value(F("DNS 2"), WiFi.dnsIP(1).toString());
-      stream_next_json_object_value(F("SSID"), WiFi.SSID());
-      stream_next_json_object_value(F("BSSID"), WiFi.BSSIDstr());
-      stream_next_json_object_value(F("Channel"), String(WiFi.channel()));
-      stream_next_json_object_value(F("Connected msec"), String(timeDiff(lastConnectMoment, millis())));
-      stream_next_json_object_value(F("Last Disconnect Reason"), String(lastDisconnectReason));
-      stream_next_json_object_value(F("Last Disconnect Reason str"), getLastDisconnectReason());
-      stream_next_json_object_value(F("Number reconnects"), String(wifi_reconnects));
-      stream_last_json_object_value(F("RSSI"), String(WiFi.RSSI()));
-      TXBuffer += F(",\n");
+      json.member(F("IP config"), useStaticIP() ? F("Static") : F("DHCP"));
+      json.member(F("IP"), WiFi.localIP().toString());
+      json.member(F("Subnet Mask"), WiFi.subnetMask().toString());
+      json.member(F("Gateway IP"), WiFi.gatewayIP().toString());
+      json.member(F("MAC address"), WiFi.macAddress());
+      json.member(F("DNS 1"), WiFi.dnsIP(0).toString());
+      json.member(F("DNS 2"), WiFi.dnsIP(1).toString());
+      json.member(F("SSID"), WiFi.SSID());
+      json.member(F("BSSID"), WiFi.BSSIDstr());
+      json.member(F("Channel"), WiFi.channel());
+      json.member(F("Connected msec"), timeDiff(lastConnectMoment, millis()));
+      json.member(F("Last Disconnect Reason"), lastDisconnectReason);
+      json.member(F("Last Disconnect Reason str"), getLastDisconnectReason());
+      json.member(F("Number reconnects"), wifi_reconnects);
+      json.member(F("RSSI"), WiFi.RSSI());
+      json.endObject();
+    }
+    if (showSystem) {
+      // Cached result of the background scan, see handle_i2cscanner()
+      json.key(F("I2C"));
+      json.beginObject();
+      json.memberBool(F("Scan running"), I2C_scanRunning());
+      if (I2C_scanValid()) {
+        json.member(F("Scan age msec"), I2C_scanAge());
+        json.member(F("Scan duration msec"), I2C_scanDuration());
+        json.key(F("Devices"));
+        json.beginArray();
+        for (byte address = 1; address <= I2C_SCAN_LAST_ADDRESS; address++) {
+          if (I2C_scanFound(address))
+            json.value(formatToHex(address));
+        }
+        json.endArray();
+      }
+      json.endObject();
     }
   }
 
@@ -3729,76 +4799,160 @@ void handle_json()
     firstTaskIndex = taskNr - 1;
     lastTaskIndex = taskNr - 1;
   }
-  byte lastActiveTaskIndex = 0;
-  for (byte TaskIndex = firstTaskIndex; TaskIndex <= lastTaskIndex; TaskIndex++) {
-    if (Settings.TaskDeviceNumber[TaskIndex])
-      lastActiveTaskIndex = TaskIndex;
-  }
+  if (!showSensors) lastTaskIndex = 0;
 
-  if (!showSpecificTask) TXBuffer += F("\"Sensors\":[\n");
+  if (!showSpecificTask && showSensors) {
+    json.key(F("Sensors"));
+    json.beginArray();
+  }
   unsigned long ttl_json = 60; // The shortest interval per enabled task (with output values) in seconds
-  for (byte TaskIndex = firstTaskIndex; TaskIndex <= lastActiveTaskIndex; TaskIndex++)
+  for (byte TaskIndex = firstTaskIndex; showSensors && TaskIndex <= lastTaskIndex; TaskIndex++)
   {
-    if (Settings.TaskDeviceNumber[TaskIndex])
+    if (Settings.TaskDeviceNumber[TaskIndex] &&
+        (showSpecificTask || isJsonTaskSelected(TaskIndex, taskList, since)))
     {
       byte DeviceIndex = getDeviceIndex(Settings.TaskDeviceNumber[TaskIndex]);
       const unsigned long taskInterval = Settings.TaskDeviceTimer[TaskIndex];
-      LoadTaskSettings(TaskIndex);
-      TXBuffer += F("{\n");
+      JsonTaskCacheStruct local;
+      const JsonTaskCacheStruct& task = getJsonTask(TaskIndex, local);
+      TaskValueSnapshot snapshot;
+      getTaskValueSnapshot(TaskIndex, snapshot);
+      json.beginObject();
       // For simplicity, do the optional values first.
       if (Device[DeviceIndex].ValueCount != 0) {
         if (ttl_json > taskInterval && taskInterval > 0 && Settings.TaskDeviceEnabled[TaskIndex]) {
           ttl_json = taskInterval;
         }
-        TXBuffer += F("\"TaskValues\": [\n");
+        json.key(F("TaskValues"));
+        json.beginArray();
         for (byte x = 0; x < Device[DeviceIndex].ValueCount; x++)
         {
-          TXBuffer += F("{");
-          stream_next_json_object_value(F("ValueNumber"), String(x + 1));
-          stream_next_json_object_value(F("Name"), String(ExtraTaskSettings.TaskDeviceValueNames[x]));
-          stream_next_json_object_value(F("NrDecimals"), String(ExtraTaskSettings.TaskDeviceValueDecimals[x]));
-          stream_last_json_object_value(F("Value"), formatUserVarNoCheck(TaskIndex, x));
-          if (x < (Device[DeviceIndex].ValueCount - 1))
-            TXBuffer += F(",\n");
+          if (!isInJsonNumberList(valueList, x + 1)) continue;
+          json.beginObject();
+          json.member(F("ValueNumber"), x + 1);
+          json.member(F("Name"), task.valueNames[x]);
+          json.member(F("NrDecimals"), task.decimals[x]);
+          json.memberNumber(F("Value"), task.formatted[x]);
+          // msec since the value changed
+          if (snapshot.changed[x] != 0)
+            json.member(F("Age"), timePassedSince(snapshot.changed[x]));
+          json.endObject();
         }
-        TXBuffer += F("],\n");
+        json.endArray();
       }
       if (showSpecificTask) {
-        stream_next_json_object_value(F("TTL"), String(ttl_json * 1000));
+        json.member(F("TTL"), ttl_json * 1000);
       }
       if (showDataAcquisition) {
-        TXBuffer += F("\"DataAcquisition\": [\n");
+        json.key(F("DataAcquisition"));
+        json.beginArray();
         for (byte x = 0; x < CONTROLLER_MAX; x++)
         {
-          TXBuffer += F("{");
-          stream_next_json_object_value(F("Controller"), String(x + 1));
-          stream_next_json_object_value(F("IDX"), String(Settings.TaskDeviceID[x][TaskIndex]));
-          stream_last_json_object_value(F("Enabled"), jsonBool(Settings.TaskDeviceSendData[x][TaskIndex]));
-          if (x < (CONTROLLER_MAX - 1))
-            TXBuffer += F(",\n");
+          json.beginObject();
+          json.member(F("Controller"), x + 1);
+          json.member(F("IDX"), Settings.TaskDeviceID[x][TaskIndex]);
+          json.member(F("Enabled"), jsonBool(Settings.TaskDeviceSendData[x][TaskIndex]));
+          json.endObject();
         }
-        TXBuffer += F("],\n");
+        json.endArray();
       }
       if (showTaskDetails) {
-        stream_next_json_object_value(F("TaskInterval"), String(taskInterval));
-        stream_next_json_object_value(F("Type"), getPluginNameFromDeviceIndex(DeviceIndex));
-        stream_next_json_object_value(F("TaskName"), String(ExtraTaskSettings.TaskDeviceName));
+        json.member(F("TaskInterval"), taskInterval);
+        json.member(F("Type"), getPluginNameFromDeviceIndex(DeviceIndex));
+        json.member(F("TaskName"), task.taskName);
       }
-      stream_next_json_object_value(F("TaskEnabled"), jsonBool(Settings.TaskDeviceEnabled[TaskIndex]));
-      stream_last_json_object_value(F("TaskNumber"), String(TaskIndex + 1));
-      if (TaskIndex != lastActiveTaskIndex)
-        TXBuffer += F(",");
-      TXBuffer += F("\n");
+      // Kept as text, like before the JSON writer.
+      json.member(F("TaskEnabled"), jsonBool(Settings.TaskDeviceEnabled[TaskIndex]));
+      json.member(F("TaskNumber"), TaskIndex + 1);
+      json.endObject();
     }
   }
   if (!showSpecificTask) {
-    TXBuffer += F("],\n");
-    stream_last_json_object_value(F("TTL"), String(ttl_json * 1000));
+    if (showSensors) json.endArray();
+    json.member(F("Sequence"), taskValueSequence);
+    json.member(F("TTL"), ttl_json * 1000);
+    json.endObject();
   }
 
   TXBuffer.endStream();
 }
 
+// Task shown in the /json sensor list, for the given tasks=... and since=... arguments.
+bool isJsonTaskSelected(byte TaskIndex, const String& taskList, unsigned long since) {
+  if (!Settings.TaskDeviceNumber[TaskIndex]) return false;
+  if (since != 0 && lastTaskValueSequence[TaskIndex] <= since) return false;
+  return isInJsonNumberList(taskList, TaskIndex + 1);
+}
+
+//********************************************************************************
+// Cache of the task names and formatted values of /json
+// Freed JSON_TASK_CACHE_KEEP msec after the last request, so it only takes
+// memory while /json is polled.
+//********************************************************************************
+#define JSON_TASK_CACHE_KEEP     60000   // msec after the last use
+
+JsonTaskCacheStruct* jsonTaskCache[TASKS_MAX] = {NULL};
+unsigned long jsonTaskCacheLastUse = 0;
+unsigned long jsonTaskCacheHits = 0;
+unsigned long jsonTaskCacheBuilds = 0;
+
+// The cached entry of the task, or local filled in when no memory could be allocated.
+// The values are formatted again when the task published new ones, see publishTaskValues().
+const JsonTaskCacheStruct& getJsonTask(byte TaskIndex, JsonTaskCacheStruct& local) {
+  jsonTaskCacheLastUse = millis();
+  if (jsonTaskCache[TaskIndex] == NULL)
+    jsonTaskCache[TaskIndex] = new JsonTaskCacheStruct();
+  JsonTaskCacheStruct& entry = jsonTaskCache[TaskIndex] != NULL ? *jsonTaskCache[TaskIndex] : local;
+  const byte DeviceIndex = getDeviceIndex(Settings.TaskDeviceNumber[TaskIndex]);
+  const byte valueCount = Device[DeviceIndex].ValueCount;
+  const bool settingsValid = &entry != &local && entry.sequence == lastTaskValueSequence[TaskIndex] &&
+                             entry.deviceNumber == Settings.TaskDeviceNumber[TaskIndex];
+  if (!settingsValid) {
+    ++jsonTaskCacheBuilds;
+    LoadTaskSettings(TaskIndex);
+    entry.sequence = lastTaskValueSequence[TaskIndex];
+    entry.deviceNumber = Settings.TaskDeviceNumber[TaskIndex];
+    entry.taskName = ExtraTaskSettings.TaskDeviceName;
+    for (byte x = 0; x < VARS_PER_TASK; x++) {
+      entry.valueNames[x] = x < valueCount ? ExtraTaskSettings.TaskDeviceValueNames[x] : "";
+      entry.decimals[x] = ExtraTaskSettings.TaskDeviceValueDecimals[x];
+    }
+    entry.published = 1;
+  } else {
+    ++jsonTaskCacheHits;
+  }
+  // Published without sendData() too, e.g. by a command or a received value
+  const uint32_t published = taskValueSeqLock[TaskIndex].sequence;
+  if (entry.published != published || (published & 1)) {
+    // The decimals of the settings
+    if (settingsValid) LoadTaskSettings(TaskIndex);
+    for (byte x = 0; x < valueCount && x < VARS_PER_TASK; x++)
+      formatUserVarNoCheck(TaskIndex, x, entry.formatted[x]);
+    entry.published = published;
+  }
+  return entry;
+}
+
+// Called once per second.
+void processJsonTaskCache() {
+  if (jsonTaskCacheLastUse == 0 || timePassedSince(jsonTaskCacheLastUse) <= JSON_TASK_CACHE_KEEP) return;
+  jsonTaskCacheLastUse = 0;
+  for (byte x = 0; x < TASKS_MAX; x++) {
+    delete jsonTaskCache[x];
+    jsonTaskCache[x] = NULL;
+  }
+}
+
+// Json cache as: tasks taken from the cache/tasks built, empty when not used.
+String getJsonTaskCacheStats() {
+  String result;
+  if (jsonTaskCacheBuilds == 0) return result;
+  result += jsonTaskCacheHits;
+  result += '/';
+  result += jsonTaskCacheBuilds;
+  return result;
+}
+
 //********************************************************************************
 // Web Interface config page
 //********************************************************************************
@@ -3807,7 +4961,7 @@ void handle_advanced() {
   if (!isLoggedIn()) return;
   navMenuIndex = 7;
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"));
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD));
 
   char tmpString[81];
 
@@ -3852,6 +5006,9 @@ void handle_advanced() {
     Settings.DST = isFormItemChecked(F("dst"));
     Settings.WDI2CAddress = getFormItemInt(F("wdi2caddress"));
     Settings.UseSSDP = isFormItemChecked(F("usessdp"));
+    #if defined(ESP8266)
+    SSDP_manage();
+    #endif
     Settings.WireClockStretchLimit = getFormItemInt(F("wireclockstretchlimit"));
     Settings.UseRules = isFormItemChecked(F("userules"));
     Settings.ConnectionFailuresThreshold = getFormItemInt(F("cft"));
@@ -3861,6 +5018,15 @@ void handle_advanced() {
     Settings.MQTTUseUnitNameAsClientId = isFormItemChecked(F("mqttuseunitnameasclientid"));
     Settings.Latitude = getFormItemFloat(F("latitude"));
     Settings.Longitude = getFormItemFloat(F("longitude"));
+    Settings.EcoPowerMode = isFormItemChecked(F("ecopowermode"));
+    Settings.RadioOffMax = getFormItemInt(F("radiooffmax"));
+    Settings.StallBudget = getFormItemInt(F("stallbudget"));
+    Settings.StallEvent = isFormItemChecked(F("stallevent"));
+    Settings.ControllerQueueDepth = getFormItemInt(F("ctrlqueuedepth"));
+    Settings.ControllerQueueDropPolicy = getFormItemInt(F("ctrlqueuedrop"));
+    Settings.ControllerBacklogFileSize = getFormItemInt(F("ctrlbacklogsize"));
+    Settings.ControllerDiagnostic = isFormItemChecked(F("ctrldiag"));
+    setWiFiSleepMode();
 
     addHtmlError(SaveSettings());
     if (Settings.UseNTP)
@@ -3881,6 +5047,18 @@ void handle_advanced() {
   addFormNumericBox( F("Message Interval"), F("messagedelay"), Settings.MessageDelay, 0, INT_MAX);
   addUnit(F("ms"));
   addFormCheckBox(F("MQTT usage unit name as ClientId"), F("mqttuseunitnameasclientid"), Settings.MQTTUseUnitNameAsClientId);
+  addFormNumericBox(F("Controller Queue Depth"), F("ctrlqueuedepth"), Settings.ControllerQueueDepth, 0, CONTROLLER_QUEUE_MAX_DEPTH);
+  addFormNote(F("0 = send directly, blocking the loop during the send"));
+  {
+    String options[2] = { F("Drop oldest"), F("Drop newest") };
+    int optionValues[2] = { CONTROLLER_QUEUE_DROP_OLDEST, CONTROLLER_QUEUE_DROP_NEWEST };
+    addFormSelector(F("When Queue Full"), F("ctrlqueuedrop"), 2, options, optionValues, Settings.ControllerQueueDropPolicy);
+  }
+  addFormNumericBox(F("Controller Backlog File"), F("ctrlbacklogsize"), Settings.ControllerBacklogFileSize, 0, 256);
+  addUnit(F("kB"));
+  addFormNote(F("Keep samples on SPIFFS while a controller is offline, 0 = RAM queue only"));
+  addFormCheckBox(F("Controller Diagnostics"), F("ctrldiag"), Settings.ControllerDiagnostic);
+  addFormNote(F("Tag every sample sent with a sequence number and its time, for load tests"));
 
   addFormSubHeader(F("NTP Settings"));
 
@@ -3945,14 +5123,22 @@ void handle_advanced() {
   #if defined(ESP32)
     addFormCheckBox(F("Enable RTOS Multitasking"), F("usertosmultitasking"), Settings.UseRTOSMultitasking);
   #endif
+  addFormCheckBox(F("Eco Power Mode (sleep when idle)"), F("ecopowermode"), Settings.EcoPowerMode);
+  addFormNumericBox(F("Radio Off Between Sends"), F("radiooffmax"), Settings.RadioOffMax, 0, 3600);
+  addUnit(F("sec max"));
+  addFormNote(F("WiFi off until just before the next task send, needs the controller queue, 0 = always on"));
+  addFormNumericBox(F("Stall Budget"), F("stallbudget"), Settings.StallBudget, 0, 60000);
+  addUnit(F("ms"));
+  addFormNote(F("Log plugin calls, controller sends, pages and rules events taking longer, 0 = off"));
+  addFormCheckBox(F("Send System#Stall event"), F("stallevent"), Settings.StallEvent);
 
   addFormSeparator(2);
 
   TXBuffer += F("<TR><TD style='width:150px;' align='left'><TD>");
   addSubmitButton();
   TXBuffer += F("<input type='hidden' name='edit' value='1'>");
-  TXBuffer += F("</table></form>");
-  sendHeadandTail(F("TmplStd"),true);
+  TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),true);
   TXBuffer.endStream();
 }
 
@@ -3980,9 +5166,9 @@ void addFormDstSelect(bool isStart, uint16_t choice) {
   TimeChangeRule rule(isStart ? tmpstart : tmpend, 0);
   addRowLabel(weeklabel);
   addSelector(weekid, 5, week, weekValues, NULL, rule.week, false);
-  TXBuffer += F("<BR>");
+  TXBuffer += getWebString(WEB_STR_BR);
   addSelector(dowid, 7, dow, dowValues, NULL, rule.dow, false);
-  TXBuffer += F("<BR>");
+  TXBuffer += getWebString(WEB_STR_BR);
   addSelector(monthid, 12, month, monthValues, NULL, rule.month, false);
 
   addFormNumericBox(hourlabel, hourid, rule.hour, 0, 23);
@@ -4027,6 +5213,7 @@ void addLogFacilitySelect(String name, int choice)
 boolean isLoggedIn()
 {
   if (!clientIPallowed()) return false;
+  scheduledRadioActivity();
   if (SecuritySettings.Password[0] == 0)
     WebLoggedIn = true;
 
@@ -4052,7 +5239,7 @@ void handle_download()
   if (!isLoggedIn()) return;
   navMenuIndex = 7;
 //  TXBuffer.startStream();
-//  sendHeadandTail(F("TmplStd"));
+//  sendHeadandTail(getWebString(WEB_STR_TMPL_STD));
 
 
   fs::File dataFile = SPIFFS.open(F(FILE_CONFIG), "r");
@@ -4073,7 +5260,8 @@ void handle_download()
   str += F(".dat");
 
   WebServer.sendHeader(F("Content-Disposition"), str);
-  WebServer.streamFile(dataFile, F("application/octet-stream"));
+  streamFileRange(dataFile, getWebString(WEB_STR_OCTET_STREAM));
+  dataFile.close();
 }
 
 
@@ -4085,10 +5273,10 @@ void handle_upload() {
   if (!isLoggedIn()) return;
   navMenuIndex = 7;
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"));
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD));
 
   TXBuffer += F("<form enctype='multipart/form-data' method='post'><p>Upload settings file:<br><input type='file' name='datafile' size='40'></p><div><input class='button link' type='submit' value='Upload'></div><input type='hidden' name='edit' value='1'></form>");
-  sendHeadandTail(F("TmplStd"),true);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),true);
   TXBuffer.endStream();
   printWebString = "";
   printToWeb = false;
@@ -4104,7 +5292,7 @@ void handle_upload_post() {
 
   navMenuIndex = 7;
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"));
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD));
 
 
 
@@ -4122,7 +5310,7 @@ void handle_upload_post() {
 
 
   TXBuffer += F("Upload finished");
-  sendHeadandTail(F("TmplStd"),true);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),true);
   TXBuffer.endStream();
   printWebString = "";
   printToWeb = false;
@@ -4184,7 +5372,11 @@ void handleFileUpload() {
       if (valid)
       {
         // once we're safe, remove file and create empty one...
+        closeCachedReadFile();
+        if (strcasecmp(upload.filename.c_str(), FILE_CONFIG) == 0 || strcasecmp(upload.filename.c_str(), FILE_NOTIFICATION) == 0)
+          clearSettingsCrc();
         SPIFFS.remove((char *)upload.filename.c_str());
+        clearFileETagCache();
         uploadFile = SPIFFS.open(upload.filename.c_str(), "w");
         // dont count manual uploads: flashCount();
       }
@@ -4199,6 +5391,7 @@ void handleFileUpload() {
   else if (upload.status == UPLOAD_FILE_END)
   {
     if (uploadFile) uploadFile.close();
+    checkRuleSets();
     if (loglevelActiveFor(LOG_LEVEL_INFO)) {
       String log = F("Upload: END, Size: ");
       log += upload.totalSize;
@@ -4223,19 +5416,19 @@ bool loadFromFS(boolean spiffs, String path) {
 
   statusLED(true);
 
-  String dataType = F("text/plain");
+  String dataType = getWebString(WEB_STR_TEXT_PLAIN);
   if (path.endsWith(F("/"))) path += F("index.htm");
 
   if (path.endsWith(F(".src"))) path = path.substring(0, path.lastIndexOf("."));
-  else if (path.endsWith(F(".htm"))) dataType = F("text/html");
+  else if (path.endsWith(F(".htm"))) dataType = getWebString(WEB_STR_TEXT_HTML);
   else if (path.endsWith(F(".css"))) dataType = F("text/css");
   else if (path.endsWith(F(".js"))) dataType = F("application/javascript");
   else if (path.endsWith(F(".png"))) dataType = F("image/png");
   else if (path.endsWith(F(".gif"))) dataType = F("image/gif");
   else if (path.endsWith(F(".jpg"))) dataType = F("image/jpeg");
   else if (path.endsWith(F(".ico"))) dataType = F("image/x-icon");
-  else if (path.endsWith(F(".txt"))) dataType = F("application/octet-stream");
-  else if (path.endsWith(F(".dat"))) dataType = F("application/octet-stream");
+  else if (path.endsWith(F(".txt"))) dataType = getWebString(WEB_STR_OCTET_STREAM);
+  else if (path.endsWith(F(".dat"))) dataType = getWebString(WEB_STR_OCTET_STREAM);
   else if (path.endsWith(F(".esp"))) return handle_custom(path);
   if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
     String log = F("HTML : Request file ");
@@ -4246,18 +5439,26 @@ bool loadFromFS(boolean spiffs, String path) {
   path = path.substring(1);
   if (spiffs)
   {
+    // Send a compressed version when there is one, streamFile() sets the gzip encoding for .gz files.
+    String gzPath = path;
+    gzPath += F(".gz");
+    if (SPIFFS.exists(gzPath) && (clientAcceptsGzip() || !SPIFFS.exists(path)))
+      path = gzPath;
     fs::File dataFile = SPIFFS.open(path.c_str(), "r");
     if (!dataFile)
       return false;
 
     //prevent reloading stuff on every click
-    WebServer.sendHeader(F("Cache-Control"), F("max-age=3600, public"));
-    WebServer.sendHeader(F("Vary"),"*");
-    WebServer.sendHeader(F("ETag"), F("\"2.0.0\""));
+    if (handleNotModified(getFileETag(path, dataFile))) {
+      dataFile.close();
+      return true;
+    }
 
     if (path.endsWith(F(".dat")))
       WebServer.sendHeader(F("Content-Disposition"), F("attachment;"));
-    WebServer.streamFile(dataFile, dataType);
+    if (path.endsWith(F(".gz")) && dataType != F("application/x-gzip") && dataType != getWebString(WEB_STR_OCTET_STREAM))
+      WebServer.sendHeader(F("Content-Encoding"), F("gzip"));
+    streamFileRange(dataFile, dataType);
     dataFile.close();
   }
   else
@@ -4268,7 +5469,7 @@ bool loadFromFS(boolean spiffs, String path) {
       return false;
     if (path.endsWith(F(".DAT")))
       WebServer.sendHeader(F("Content-Disposition"), F("attachment;"));
-    WebServer.streamFile(dataFile, dataType);
+    streamFileRange(dataFile, dataType);
     dataFile.close();
 #endif
   }
@@ -4276,6 +5477,100 @@ bool loadFromFS(boolean spiffs, String path) {
   return true;
 }
 
+//********************************************************************************
+// File download with a single byte range ("Range: bytes=start-end"), so large
+// files like value logs can be resumed.
+// Returns false when the range is invalid, the reply (416) has then been sent.
+//********************************************************************************
+bool getRequestRange(size_t fileSize, size_t& start, size_t& length) {
+  start = 0;
+  length = fileSize;
+  String range = WebServer.header(F("Range"));
+  if (range.length() == 0) return true;
+  if (!range.startsWith(F("bytes=")) || range.indexOf(',') != -1) {
+    // Unknown unit or multiple ranges, send the complete file
+    return true;
+  }
+  const int dash = range.indexOf('-');
+  if (dash < 0) return true;
+  const String first = range.substring(6, dash);
+  const String last = range.substring(dash + 1);
+  size_t end = fileSize == 0 ? 0 : fileSize - 1;
+  if (first.length() == 0) {
+    // Suffix range, the last N bytes
+    const size_t suffix = last.toInt();
+    start = suffix < fileSize ? fileSize - suffix : 0;
+  } else {
+    start = first.toInt();
+    if (last.length() != 0 && static_cast<size_t>(last.toInt()) < end)
+      end = last.toInt();
+  }
+  if (start >= fileSize || start > end) {
+    String contentRange = F("bytes */");
+    contentRange += fileSize;
+    WebServer.sendHeader(F("Content-Range"), contentRange);
+    WebServer.send(416, getWebString(WEB_STR_TEXT_PLAIN), F("Range not satisfiable"));
+    return false;
+  }
+  length = end - start + 1;
+  return true;
+}
+
+// Send the headers and 'length' bytes from data, read with a buffer of one TCP segment.
+void sendFileData(Stream& data, size_t start, size_t length, size_t fileSize, const String& contentType) {
+  WebServer.sendHeader(F("Accept-Ranges"), F("bytes"));
+  int code = 200;
+  if (length != fileSize) {
+    code = 206;
+    String contentRange = F("bytes ");
+    contentRange += start;
+    contentRange += '-';
+    contentRange += start + length - 1;
+    contentRange += '/';
+    contentRange += fileSize;
+    WebServer.sendHeader(F("Content-Range"), contentRange);
+  }
+  WebServer.setContentLength(length);
+  WebServer.send(code, contentType, "");
+  if (WebServer.method() == HTTP_HEAD) return;
+
+  size_t bufferSize = TCP_MSS;
+  uint8_t* buffer = (uint8_t*)allocBuffer(MEM_POOL_WEB, bufferSize);
+  if (buffer == NULL) {
+    // Low on memory, try a smaller buffer.
+    bufferSize = 256;
+    buffer = (uint8_t*)allocBuffer(MEM_POOL_WEB, bufferSize);
+    if (buffer == NULL) return;
+  }
+  size_t remaining = length;
+  while (remaining > 0 && WebServer.client().connected()) {
+    const size_t toRead = remaining < bufferSize ? remaining : bufferSize;
+    const size_t bytesRead = data.readBytes(buffer, toRead);
+    if (bytesRead == 0) break;
+    waitForWebClientTX(bytesRead);
+    if (WebServer.client().write(static_cast<const uint8_t*>(buffer), bytesRead) != bytesRead) break;
+    remaining -= bytesRead;
+  }
+  freeBuffer(MEM_POOL_WEB, buffer, bufferSize);
+}
+
+void streamFileRange(fs::File& file, const String& contentType) {
+  size_t start, length;
+  if (!getRequestRange(file.size(), start, length)) return;
+  if (start != 0) file.seek(start, fs::SeekSet);
+  sendFileData(file, start, length, file.size(), contentType);
+}
+
+#if defined(FEATURE_SD) && defined(ESP8266)
+// The ESP8266 SD library has its own File class.
+void streamFileRange(File& file, const String& contentType) {
+  size_t start, length;
+  if (!getRequestRange(file.size(), start, length)) return;
+  if (start != 0) file.seek(start);
+  sendFileData(file, start, length, file.size(), contentType);
+}
+#endif
+
 //********************************************************************************
 // Web Interface custom page handler
 //********************************************************************************
@@ -4300,19 +5595,19 @@ boolean handle_custom(String path) {
     if (unit && unit != Settings.Unit)
     {
       TXBuffer.startStream();
-      sendHeadandTail(F("TmplDsh"),_HEAD);
+      sendHeadandTail(getWebString(WEB_STR_TMPL_DSH),_HEAD);
       char url[40];
       sprintf_P(url, PSTR("http://%u.%u.%u.%u/dashboard.esp"), Nodes[unit].ip[0], Nodes[unit].ip[1], Nodes[unit].ip[2], Nodes[unit].ip[3]);
       TXBuffer += F("<meta http-equiv=\"refresh\" content=\"0; URL=");
       TXBuffer += url;
       TXBuffer += F("\">");
-      sendHeadandTail(F("TmplDsh"),_TAIL);
+      sendHeadandTail(getWebString(WEB_STR_TMPL_DSH),_TAIL);
       TXBuffer.endStream();
       return true;
     }
 
     TXBuffer.startStream();
-    sendHeadandTail(F("TmplDsh"),_HEAD);
+    sendHeadandTail(getWebString(WEB_STR_TMPL_DSH),_HEAD);
     TXBuffer += F("<script><!--\n"
              "function dept_onchange(frmselect) {frmselect.submit();}"
              "\n//--></script>");
@@ -4396,8 +5691,10 @@ boolean handle_custom(String path) {
           {
             LoadTaskSettings(x);
             byte DeviceIndex = getDeviceIndex(Settings.TaskDeviceNumber[x]);
+            TaskValueSnapshot snapshot;
+            getTaskValueSnapshot(x, snapshot);
             html_TR_TD();
-            TXBuffer += ExtraTaskSettings.TaskDeviceName;
+            TXBuffer.addHtmlEscaped(ExtraTaskSettings.TaskDeviceName);
             for (byte varNr = 0; varNr < VARS_PER_TASK; varNr++)
               {
                 if ((Settings.TaskDeviceNumber[x] != 0) && (varNr < Device[DeviceIndex].ValueCount) && ExtraTaskSettings.TaskDeviceValueNames[varNr][0] !=0)
@@ -4405,22 +5702,53 @@ boolean handle_custom(String path) {
                   if (varNr > 0)
                     html_TR_TD();
                   html_TD();
-                  TXBuffer += ExtraTaskSettings.TaskDeviceValueNames[varNr];
+                  TXBuffer.addHtmlEscaped(ExtraTaskSettings.TaskDeviceValueNames[varNr]);
                   html_TD();
-                  TXBuffer += String(UserVar[x * VARS_PER_TASK + varNr], ExtraTaskSettings.TaskDeviceValueDecimals[varNr]);
+                  char formatted[FORMAT_VALUE_BUFFER_SIZE];
+                  TXBuffer.addChars(formatted, formatTaskValue(snapshot, varNr, ExtraTaskSettings.TaskDeviceValueDecimals[varNr], formatted));
                 }
               }
           }
       }
     }
   }
-  sendHeadandTail(F("TmplDsh"),_TAIL);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_DSH),_TAIL);
   TXBuffer.endStream();
   return true;
 }
 
 
 
+//********************************************************************************
+// Paging of the file lists, arguments offset and limit
+//********************************************************************************
+void getFileListPage(int& offset, int& limit) {
+  offset = getFormItemInt(F("offset"), 0);
+  limit = getFormItemInt(F("limit"), FILELIST_PAGE_SIZE);
+  if (offset < 0) offset = 0;
+  if (limit <= 0) limit = FILELIST_PAGE_SIZE;
+}
+
+// url must end with '?' or '&'
+void addFileListPageButtons(const String& url, int offset, int limit, bool more) {
+  if (offset > 0) {
+    String prev = url;
+    prev += F("offset=");
+    prev += (offset > limit) ? offset - limit : 0;
+    prev += F("&limit=");
+    prev += limit;
+    addButton(prev, F("&lt;"));
+  }
+  if (more) {
+    String next = url;
+    next += F("offset=");
+    next += offset + limit;
+    next += F("&limit=");
+    next += limit;
+    addButton(next, F("&gt;"));
+  }
+}
+
 //********************************************************************************
 // Web Interface file list
 //********************************************************************************
@@ -4429,7 +5757,7 @@ void handle_filelist() {
   if (!clientIPallowed()) return;
   navMenuIndex = 7;
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"));
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD));
 
 #if defined(ESP8266)
 
@@ -4437,17 +5765,28 @@ void handle_filelist() {
 
   if (fdelete.length() > 0)
   {
+    closeCachedReadFile();
     SPIFFS.remove(fdelete);
+    clearFileETagCache();
     checkRuleSets();
   }
 
 
 
+  int offset, limit;
+  getFileListPage(offset, limit);
+  int index = 0;
+  bool more = false;
   TXBuffer += F("<table class='multirow' border=1px frame='box' rules='all'><TH style='width:50px;'><TH>Filename<TH style='width:80px;'>Size");
 
   fs::Dir dir = SPIFFS.openDir("");
   while (dir.next())
   {
+    if (index++ < offset) continue;
+    if (index > offset + limit) {
+      more = true;
+      break;
+    }
     html_TR_TD();
     if (dir.fileName() != F(FILE_CONFIG) && dir.fileName() != F(FILE_SECURITY) && dir.fileName() != F(FILE_NOTIFICATION))
     {
@@ -4460,14 +5799,20 @@ void handle_filelist() {
     TXBuffer += dir.fileName();
     TXBuffer += F("\">");
     TXBuffer += dir.fileName();
-    TXBuffer += F("</a>");
-    fs::File f = dir.openFile("r");
+    TXBuffer += getWebString(WEB_STR_A_END);
     html_TD();
+#if defined(ARDUINO_ESP8266_RELEASE_2_3_0)
+    fs::File f = dir.openFile("r");
     TXBuffer += f.size();
+    f.close();
+#else
+    TXBuffer += dir.fileSize();
+#endif
   }
-  TXBuffer += F("</table></form>");
+  TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
+  addFileListPageButtons(F("filelist?"), offset, limit, more);
   TXBuffer += F("<BR><a class='button link' href=\"/upload\">Upload</a><BR><BR>");
-    sendHeadandTail(F("TmplStd"),true);
+    sendHeadandTail(getWebString(WEB_STR_TMPL_STD),true);
     TXBuffer.endStream();
 #endif
 #if defined(ESP32)
@@ -4475,19 +5820,30 @@ void handle_filelist() {
 
   if (fdelete.length() > 0)
   {
+    closeCachedReadFile();
     SPIFFS.remove(fdelete);
+    clearFileETagCache();
+    checkRuleSets();
     // flashCount();
   }
 
 
 
+  int offset, limit;
+  getFileListPage(offset, limit);
+  int index = 0;
+  bool more = false;
   TXBuffer += F("<table class='multirow' border=1px frame='box' rules='all'><TH><TH>Filename<TH>Size");
 
   File root = SPIFFS.open("/");
   File file = root.openNextFile();
   while (file)
   {
-    if(!file.isDirectory()){
+    if (!file.isDirectory() && index++ >= offset) {
+      if (index > offset + limit) {
+        more = true;
+        break;
+      }
       html_TR_TD();
       if (strcmp(file.name(), FILE_CONFIG) != 0 && strcmp(file.name(), FILE_SECURITY) != 0 && strcmp(file.name(), FILE_NOTIFICATION) != 0)
       {
@@ -4500,15 +5856,16 @@ void handle_filelist() {
       TXBuffer += file.name();
       TXBuffer += F("\">");
       TXBuffer += file.name();
-      TXBuffer += F("</a>");
+      TXBuffer += getWebString(WEB_STR_A_END);
       html_TD();
       TXBuffer += file.size();
-      file = root.openNextFile();
     }
+    file = root.openNextFile();
   }
-  TXBuffer += F("</table></form>");
+  TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
+  addFileListPageButtons(F("filelist?"), offset, limit, more);
   TXBuffer += F("<BR><a class='button link' href=\"/upload\">Upload</a><BR><BR>");
-    sendHeadandTail(F("TmplStd"),true);
+    sendHeadandTail(getWebString(WEB_STR_TMPL_STD),true);
     TXBuffer.endStream();
 #endif
 }
@@ -4523,7 +5880,7 @@ void handle_SDfilelist() {
   if (!clientIPallowed()) return;
   navMenuIndex = 7;
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"));
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD));
 
 
   String fdelete = "";
@@ -4587,16 +5944,30 @@ void handle_SDfilelist() {
 
   String subheader = "SD Card: " + current_dir;
   addFormSubHeader(subheader);
-  TXBuffer += F("<BR>");
+  TXBuffer += getWebString(WEB_STR_BR);
   TXBuffer += F("<table class='multirow' border=1px frame='box' rules='all'><TH style='width:50px;'><TH>Name<TH>Size");
   html_TR_TD();
   TXBuffer += F("<TD><a href=\"SDfilelist?chgto=");
   TXBuffer += parent_dir;
   TXBuffer += F("\">..");
-  TXBuffer += F("</a>");
+  TXBuffer += getWebString(WEB_STR_A_END);
   html_TD();
+  int offset, limit;
+  getFileListPage(offset, limit);
+  int index = 0;
+  bool more = false;
   while (entry)
   {
+    if (index++ < offset) {
+      entry.close();
+      entry = root.openNextFile();
+      continue;
+    }
+    if (index > offset + limit) {
+      more = true;
+      entry.close();
+      break;
+    }
     if (entry.isDirectory())
     {
       char SDcardChildDir[80];
@@ -4623,7 +5994,7 @@ void handle_SDfilelist() {
       TXBuffer += F("/");
       TXBuffer += F("\">");
       TXBuffer += entry.name();
-      TXBuffer += F("</a>");
+      TXBuffer += getWebString(WEB_STR_A_END);
       html_TD();
       TXBuffer += F("dir");
       dir_has_entry.close();
@@ -4645,7 +6016,7 @@ void handle_SDfilelist() {
       TXBuffer += entry.name();
       TXBuffer += F("\">");
       TXBuffer += entry.name();
-      TXBuffer += F("</a>");
+      TXBuffer += getWebString(WEB_STR_A_END);
       html_TD();
       TXBuffer += entry.size();
     }
@@ -4653,9 +6024,10 @@ void handle_SDfilelist() {
     entry = root.openNextFile();
   }
   root.close();
-  TXBuffer += F("</table></form>");
+  TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
+  addFileListPageButtons(String(F("SDfilelist?chgto=")) + current_dir + '&', offset, limit, more);
   //TXBuffer += F("<BR><a class='button link' href=\"/upload\">Upload</a>");
-     sendHeadandTail(F("TmplStd"),true);
+     sendHeadandTail(getWebString(WEB_STR_TMPL_STD),true);
     TXBuffer.endStream();
 }
 #endif
@@ -4669,7 +6041,7 @@ void handleNotFound() {
 
   if (wifiSetup)
   {
-    WebServer.send(200, F("text/html"), F("<meta HTTP-EQUIV='REFRESH' content='0; url=/setup'>"));
+    WebServer.send(200, getWebString(WEB_STR_TEXT_HTML), F("<meta HTTP-EQUIV='REFRESH' content='0; url=/setup'>"));
     return;
   }
 
@@ -4690,7 +6062,7 @@ void handleNotFound() {
     message += WebServer.arg(i);
     message += F("\n");
   }
-  WebServer.send(404, F("text/plain"), message);
+  WebServer.send(404, getWebString(WEB_STR_TEXT_PLAIN), message);
 }
 
 
@@ -4701,7 +6073,7 @@ void handle_setup() {
   checkRAM(F("handle_setup"));
   // Do not check client IP range allowed.
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplAP"));
+  sendHeadandTail(getWebString(WEB_STR_TMPL_AP));
 
   addHeader(false,TXBuffer.buf);
 
@@ -4718,7 +6090,7 @@ void handle_setup() {
     TXBuffer += host;
     TXBuffer += F("/config'>Proceed to main config</a><BR><BR>");
 
-    sendHeadandTail(F("TmplAP"),true);
+    sendHeadandTail(getWebString(WEB_STR_TMPL_AP),true);
     TXBuffer.endStream();
 
     wifiSetup = false;
@@ -4780,7 +6152,7 @@ void handle_setup() {
         TXBuffer += formatScanResult(i, "<BR>");
         TXBuffer += F("");
       }
-      TXBuffer += F("</table>");
+      TXBuffer += getWebString(WEB_STR_TABLE_END);
     }
 
     TXBuffer += F("<BR><label class='container2'>other SSID:<input type='radio' name='ssid' id='other_ssid' value='other' ><span class='dotmark'></span></label>");
@@ -4834,7 +6206,7 @@ void handle_setup() {
   }
 
   TXBuffer += F("</form>");
-   sendHeadandTail(F("TmplAP"),true);
+   sendHeadandTail(getWebString(WEB_STR_TMPL_AP),true);
   TXBuffer.endStream();
   delay(10);
 }
@@ -4848,7 +6220,7 @@ void handle_rules() {
   if (!isLoggedIn()) return;
   navMenuIndex = 5;
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"));
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD));
   static byte currentSet = 1;
 
   const byte rulesSet = getFormItemInt(F("set"), 1);
@@ -4892,6 +6264,7 @@ void handle_rules() {
         // }
         // else
         // {
+          clearFileETagCache();
           fs::File f = SPIFFS.open(fileName, "w");
           if (f)
           {
@@ -4959,13 +6332,14 @@ void handle_rules() {
     else
     {
        html_TR_TD(); TXBuffer += F("<textarea name='rules' rows='30' wrap='off'>");
+      char buf[RULES_BUFFER_SIZE];
       while (f.available())
       {
-        String c((char)f.read());
-        htmlEscape(c);
-         TXBuffer += c;
+        const int len = f.read(reinterpret_cast<uint8_t*>(buf), sizeof(buf));
+        if (len <= 0) break;
+        TXBuffer.addHtmlEscaped(buf, len);
       }
-       TXBuffer += F("</textarea>");
+       TXBuffer += getWebString(WEB_STR_TEXTAREA_END);
     }
     f.close();
   }
@@ -4981,8 +6355,8 @@ void handle_rules() {
    html_TR_TD();
   addSubmitButton();
   addButton(fileName, F("Download to file"));
-   TXBuffer += F("</table></form>");
-  sendHeadandTail(F("TmplStd"),true);
+   TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD),true);
   TXBuffer.endStream();
 
   checkRuleSets();
@@ -4996,7 +6370,7 @@ void handle_sysinfo() {
   checkRAM(F("handle_sysinfo"));
   if (!isLoggedIn()) return;
   TXBuffer.startStream();
-  sendHeadandTail(F("TmplStd"));
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD));
 
   int freeMem = ESP.getFreeHeap();
 
@@ -5019,6 +6393,10 @@ void handle_sysinfo() {
 
      html_TR_TD(); TXBuffer += F("Local Time<TD>");
      TXBuffer += getDateTimeString('-', ':', ' ');
+
+     html_TR_TD(); TXBuffer += F("NTP<TD>");
+     TXBuffer += getNtpStats();
+     TXBuffer += F(" (offset/jitter/RTT)");
   }
 
    html_TR_TD(); TXBuffer += F("Uptime<TD>");
@@ -5038,6 +6416,198 @@ void handle_sysinfo() {
      TXBuffer += F("% (LC=");
      TXBuffer += getLoopCountPerSec();
      TXBuffer += F(")");
+     if (Settings.EcoPowerMode) {
+       TXBuffer += F(" Sleep: ");
+       TXBuffer += getSleepTimePct();
+       TXBuffer += F("% / Active: ");
+       TXBuffer += getCPUload();
+       TXBuffer += '%';
+     }
+  }
+
+#if defined(ESP32)
+   html_TR_TD(); TXBuffer += F("Core Load<TD>");
+   for (byte core = 0; core < portNUM_PROCESSORS; ++core) {
+     if (core != 0) TXBuffer += F(" / ");
+     TXBuffer += F("Core ");
+     TXBuffer += static_cast<int>(core);
+     TXBuffer += F(": ");
+     TXBuffer += getCoreLoad(core);
+     TXBuffer += '%';
+   }
+#endif
+
+#ifdef USE_RTOS_MULTITASKING
+  for (byte i = 0; i < RTOS_TASK_COUNT; ++i) {
+    if (rtosTaskStats[i].handle == NULL) continue;
+    html_TR_TD(); TXBuffer += getRTOSTaskName(i);
+    TXBuffer += F("<TD>Core ");
+    TXBuffer += static_cast<int>(rtosTaskStats[i].core);
+    TXBuffer += F(" Load: ");
+    TXBuffer += rtosTaskStats[i].load;
+    TXBuffer += F("% Runs/s: ");
+    TXBuffer += rtosTaskStats[i].runsPerSec;
+    TXBuffer += F(" Stack free: ");
+    TXBuffer += static_cast<uint32_t>(getRTOSTaskStackFree(i));
+    TXBuffer += getWebString(WEB_STR_BYTES);
+  }
+#endif
+
+   html_TR_TD(); TXBuffer += F("Rules Queue<TD>");
+   TXBuffer += getRulesQueueStats();
+   TXBuffer += F(" (depth/max depth/coalesced/full/dropped/avg latency/max latency usec)");
+
+   html_TR_TD(); TXBuffer += F("UDP Packets<TD>");
+   TXBuffer += getUDPStats();
+   TXBuffer += F(" (received/processed/truncated/dropped)");
+
+   if (getUDPGroupStats().length() != 0) {
+     html_TR_TD(); TXBuffer += F("UDP Group Commands<TD>");
+     TXBuffer += getUDPGroupStats();
+     TXBuffer += F(" (sent/retransmits/acknowledged/failed/received/max round trip msec)");
+   }
+
+   html_TR_TD(); TXBuffer += F("TCP Sockets<TD>");
+   TXBuffer += getSocketStats();
+   TXBuffer += F(" (active/budget (MQTT/controller/events/Ser2Net/P1/other) refused)");
+
+#if defined(ESP32)
+   html_TR_TD(); TXBuffer += F("Web Responses<TD>");
+   TXBuffer += getWebResponseStats();
+   TXBuffer += F(" (pending/deferred/blocking/dropped)");
+#endif
+
+#if defined(ESP8266)
+   html_TR_TD(); TXBuffer += F("SSDP<TD>");
+   TXBuffer += getSSDPStats();
+   TXBuffer += F(" (responses/dropped)");
+#endif
+
+   if (Settings.Pin_i2c_sda != -1) {
+     html_TR_TD(); TXBuffer += F("I2C Bus<TD>");
+     TXBuffer += getI2CStats();
+     TXBuffer += F(" (transfers/s, transfers/NACK/busy/queued/queue full/max queued, time saved by faster task clocks)");
+   }
+
+   html_TR_TD(); TXBuffer += F("Serial RX<TD>");
+   TXBuffer += getSerialRxStats();
+   TXBuffer += F(" (received/frames/idle/overruns/max used/size)");
+
+   html_TR_TD(); TXBuffer += F("ADC Sampling<TD>");
+   TXBuffer += getAdcSamplingStats();
+   TXBuffer += F(" (rate/samples/dropped)");
+
+   html_TR_TD(); TXBuffer += F("Pulse Capture<TD>");
+   TXBuffer += getPulseCaptureStats();
+   TXBuffer += F(" (captures/no free channel/overflows)");
+
+   html_TR_TD(); TXBuffer += F("Bit-bang<TD>");
+   TXBuffer += getBitBangStats();
+   TXBuffer += F(" (transfers/ready events/errors)");
+
+   #ifdef USES_NEOPIXEL_OUTPUT
+   html_TR_TD(); TXBuffer += F("NeoPixel Output<TD>");
+   TXBuffer += getNeoPixelOutputStats();
+   TXBuffer += F(" (frames/merged/blocking)");
+   #endif
+
+   html_TR_TD(); TXBuffer += F("Tone Player<TD>");
+   TXBuffer += getTonePlayerStats();
+   TXBuffer += F(" (queued/notes/rejected)");
+
+   html_TR_TD(); TXBuffer += F("Output Sequencer<TD>");
+   TXBuffer += getOutputSequencerStats();
+   TXBuffer += F(" (slots/steps/patterns/rejected)");
+
+   html_TR_TD(); TXBuffer += F("Modbus TCP<TD>");
+   TXBuffer += getModbusTCPStats();
+   TXBuffer += F(" (requests/replies/registers/errors/timeouts/connects)");
+
+   html_TR_TD(); TXBuffer += F("Modbus RTU<TD>");
+   TXBuffer += getModbusRTUStats();
+   TXBuffer += F(" (requests/replies/CRC errors/exceptions/timeouts/rejected)");
+
+   html_TR_TD(); TXBuffer += F("Meter Bus<TD>");
+   TXBuffer += getMeterBusStats();
+   TXBuffer += F(" (requests/replies/timeouts/errors/rejected)");
+
+   #ifdef USES_P035
+   html_TR_TD(); TXBuffer += F("IR Transmit<TD>");
+   TXBuffer += Plugin_035_getStats();
+   TXBuffer += F(" (waiting/sent/dropped)");
+   #endif
+
+   html_TR_TD(); TXBuffer += F("Sensor Conversions<TD>");
+   TXBuffer += getTaskConversionStats();
+   TXBuffer += F(" (started/completed/failed/overlaps/timeouts)");
+
+   html_TR_TD(); TXBuffer += F("Controller Batches<TD>");
+   TXBuffer += getControllerBatchStats();
+   TXBuffer += F(" (requests/records/dropped)");
+
+   html_TR_TD(); TXBuffer += F("Sample Aggregation<TD>");
+   TXBuffer += getTaskAggregateStats();
+   TXBuffer += F(" (samples/sent)");
+
+   html_TR_TD(); TXBuffer += F("Report by Exception<TD>");
+   TXBuffer += getTaskReportStats();
+   TXBuffer += F(" (sent/suppressed/sent for max. interval)");
+
+   html_TR_TD(); TXBuffer += F("Task Triggers<TD>");
+   TXBuffer += getTaskTriggerStats();
+   TXBuffer += F(" (triggered/coalesced/loops dropped)");
+
+   if (getTaskGroupStats().length() != 0) {
+     html_TR_TD(); TXBuffer += F("Task Groups<TD>");
+     TXBuffer += getTaskGroupStats();
+     TXBuffer += F(" (samples/failed/incomplete/read skew/max/collect skew/max usec)");
+   }
+
+   html_TR_TD(); TXBuffer += F("Task Data<TD>");
+   TXBuffer += getPluginTaskDataStats();
+   TXBuffer += F(" (bytes/tasks)");
+  for (byte x = 0; x < TASKS_MAX; x++) {
+    if (getPluginTaskData(x) != NULL) {
+       html_TR_TD(); TXBuffer += F("Task ");
+       TXBuffer += x + 1;
+       TXBuffer += F(" Data<TD>");
+       TXBuffer += getPluginTaskDataSize(x);
+       TXBuffer += getWebString(WEB_STR_BYTES);
+    }
+  }
+
+   html_TR_TD(); TXBuffer += F("Interrupt Events<TD>");
+   TXBuffer += getInterruptEventStats();
+   TXBuffer += F(" (processed/dropped/max queued/max latency usec)");
+
+   html_TR_TD(); TXBuffer += F("DNS Cache<TD>");
+   TXBuffer += getDnsCacheStats();
+   TXBuffer += F(" (hits/misses/failed/entries)");
+
+   html_TR_TD(); TXBuffer += F("System Timers<TD>");
+   TXBuffer += getSystemTimerPoolStats();
+   TXBuffer += F(" (in use/high water/size/overflow)");
+
+  if (Settings.ControllerQueueDepth != 0) {
+    for (byte x = 0; x < CONTROLLER_MAX; x++) {
+      if (Settings.ControllerEnabled[x] && Settings.Protocol[x]) {
+         html_TR_TD(); TXBuffer += F("Controller ");
+         TXBuffer += x + 1;
+         TXBuffer += F(" Queue<TD>");
+         TXBuffer += getControllerQueueStats(x);
+         TXBuffer += F(" (queued/max/dropped/sent/avg ms/max ms/on file)");
+      }
+    }
+  }
+
+  for (byte x = 0; x < CONTROLLER_MAX; x++) {
+    if (ControllerConnections[x].connects != 0) {
+       html_TR_TD(); TXBuffer += F("Controller ");
+       TXBuffer += x + 1;
+       TXBuffer += F(" HTTP<TD>");
+       TXBuffer += getControllerConnectionStats(x);
+       TXBuffer += F(" (requests/connects/reused %/failed/avg ms/max ms)");
+    }
   }
 
    html_TR_TD(); TXBuffer += F("Free Mem<TD>");
@@ -5048,6 +6618,94 @@ void handle_sysinfo() {
    TXBuffer += lowestRAMfunction;
    TXBuffer += F(")");
 
+  if (getHeapTrendStats().length() != 0) {
+     html_TR_TD(); TXBuffer += F("Heap Trend<TD>");
+     TXBuffer += getHeapTrendStats();
+     TXBuffer += F(" (largest block/lowest/fragmentation %/max %)");
+  }
+
+  if (getTimingBaselineStats().length() != 0) {
+     html_TR_TD(); TXBuffer += F("Timing Baseline<TD>");
+     TXBuffer += getTimingBaselineStats();
+     TXBuffer += F(" (stats/threshold %/regressions)");
+  }
+
+#ifdef MEM_USE_PSRAM
+  if (psramAvailable()) {
+     html_TR_TD(); TXBuffer += F("Free PSRAM<TD>");
+     TXBuffer += static_cast<uint32_t>(heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+  }
+#endif
+  for (byte pool = 0; pool < MEM_POOL_NR; ++pool) {
+     html_TR_TD(); TXBuffer += F("Buffers ");
+     TXBuffer += getMemPoolName(pool);
+     TXBuffer += getWebString(WEB_STR_TD);
+     TXBuffer += getMemPoolStats(pool);
+     TXBuffer += F(" (internal/PSRAM/max bytes failed)");
+  }
+  for (byte cls = 0; cls < MEM_BLOCK_CLASSES; ++cls) {
+     html_TR_TD(); TXBuffer += F("Blocks ");
+     TXBuffer += memBlockSize[cls];
+     TXBuffer += getWebString(WEB_STR_TD);
+     TXBuffer += getMemBlockStats(cls);
+     TXBuffer += F(" (in use/max/blocks from heap)");
+  }
+   html_TR_TD(); TXBuffer += F("Blocks Larger<TD>");
+   TXBuffer += memBlockLarge;
+   TXBuffer += F(" (from heap)");
+
+   if (getSettingsPartitionStats().length() != 0) {
+     html_TR_TD(); TXBuffer += F("Settings Partition<TD>");
+     TXBuffer += getSettingsPartitionStats();
+     TXBuffer += F(" (reads/sectors written)");
+   }
+
+   if (getRTCMemoryStats().length() != 0) {
+     html_TR_TD(); TXBuffer += F("RTC Memory<TD>");
+     TXBuffer += getRTCMemoryStats();
+     TXBuffer += F(" (blocks used/written/checksum errors)");
+   }
+
+   if (getLastBootProfileStats().length() != 0) {
+     html_TR_TD(); TXBuffer += F("Last Boot<TD>");
+     TXBuffer += getLastBootProfileStats();
+     TXBuffer += F(" (msec to setup end/WiFi/time/first send)");
+   }
+
+   if (getScheduledRadioStats().length() != 0) {
+     html_TR_TD(); TXBuffer += F("Radio Off<TD>");
+     TXBuffer += getScheduledRadioStats();
+     TXBuffer += F(" (times/sec)");
+   }
+
+   if (getJsonTaskCacheStats().length() != 0) {
+     html_TR_TD(); TXBuffer += F("Json Tasks<TD>");
+     TXBuffer += getJsonTaskCacheStats();
+     TXBuffer += F(" (from cache/rebuilt)");
+   }
+
+   if (getWebOptionsStats().length() != 0) {
+     html_TR_TD(); TXBuffer += F("Web Options<TD>");
+     TXBuffer += getWebOptionsStats();
+     TXBuffer += F(" (cache hits/builds/bytes)");
+   }
+
+   if (Settings.DeepSleepBatchWakes != 0) {
+     html_TR_TD(); TXBuffer += F("Sleep Samples<TD>");
+     TXBuffer += getSleepSamplesStats();
+     TXBuffer += F(" (in RTC/on flash)");
+   }
+
+   #ifdef USES_N001
+   html_TR_TD(); TXBuffer += F("Email Queue<TD>");
+   TXBuffer += getNPlugin_001_stats();
+   TXBuffer += F(" (queued/sent/failed/dropped)");
+   #endif
+
+   html_TR_TD(); TXBuffer += F("Events<TD>");
+   TXBuffer += getEventPoolStats();
+   TXBuffer += F(" (in use/max/events from heap)");
+
    html_TR_TD(); TXBuffer += F("Boot<TD>");
    TXBuffer += getLastBootCauseString();
    TXBuffer += F(" (");
@@ -5120,6 +6778,10 @@ void handle_sysinfo() {
   TXBuffer += Serial.available();
   TXBuffer += F(")");
 
+  html_TR_TD(); TXBuffer += F("Serial Console<TD>");
+  TXBuffer += getSerialConsoleStats();
+  TXBuffer += F(" (lines/commands/queued/dropped/waits)");
+
   html_TR_TD(); TXBuffer += F("STA MAC<TD>");
 
   uint8_t mac[] = {0, 0, 0, 0, 0, 0};
@@ -5257,7 +6919,7 @@ void handle_sysinfo() {
       case FM_DIO:   TXBuffer += F("DIO");  break;
       case FM_DOUT:  TXBuffer += F("DOUT"); break;
       default:
-          TXBuffer += F("Unknown"); break;
+          TXBuffer += getWebString(WEB_STR_UNKNOWN); break;
     }
   #endif
 
@@ -5300,18 +6962,18 @@ void handle_sysinfo() {
    TXBuffer += F("</H3></TD></TR>");
 
    html_TR_TD(); TXBuffer += F("Data Partition Table<TD>");
-//   TXBuffer += getPartitionTableHeader(F(" - "), F("<BR>"));
-//   TXBuffer += getPartitionTable(ESP_PARTITION_TYPE_DATA, F(" - "), F("<BR>"));
+//   TXBuffer += getPartitionTableHeader(F(" - "), getWebString(WEB_STR_BR));
+//   TXBuffer += getPartitionTable(ESP_PARTITION_TYPE_DATA, F(" - "), getWebString(WEB_STR_BR));
    getPartitionTableSVG(ESP_PARTITION_TYPE_DATA, 0x5856e6);
 
    html_TR_TD(); TXBuffer += F("App Partition Table<TD>");
-//   TXBuffer += getPartitionTableHeader(F(" - "), F("<BR>"));
-//   TXBuffer += getPartitionTable(ESP_PARTITION_TYPE_APP , F(" - "), F("<BR>"));
+//   TXBuffer += getPartitionTableHeader(F(" - "), getWebString(WEB_STR_BR));
+//   TXBuffer += getPartitionTable(ESP_PARTITION_TYPE_APP , F(" - "), getWebString(WEB_STR_BR));
    getPartitionTableSVG(ESP_PARTITION_TYPE_APP, 0xab56e6);
   #endif
 
-   TXBuffer += F("</table></form>");
-   sendHeadandTail(F("TmplStd"),true);
+   TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
+   sendHeadandTail(getWebString(WEB_STR_TMPL_STD),true);
   TXBuffer.endStream();
 }
 
@@ -5320,23 +6982,8 @@ void handle_sysinfo() {
 //********************************************************************************
 String URLEncode(const char* msg)
 {
-  const char *hex = "0123456789abcdef";
-  String encodedMsg = "";
-
-  while (*msg != '\0') {
-    if ( ('a' <= *msg && *msg <= 'z')
-         || ('A' <= *msg && *msg <= 'Z')
-         || ('0' <= *msg && *msg <= '9')
-         || ('-' == *msg) || ('_' == *msg)
-         || ('.' == *msg) || ('~' == *msg) ) {
-      encodedMsg += *msg;
-    } else {
-      encodedMsg += '%';
-      encodedMsg += hex[*msg >> 4];
-      encodedMsg += hex[*msg & 15];
-    }
-    msg++;
-  }
+  String encodedMsg;
+  appendURLEncoded(encodedMsg, msg);
   return encodedMsg;
 }
 
@@ -5360,7 +7007,104 @@ String getValueSymbol(byte index)
 
 void handle_favicon() {
   checkRAM(F("handle_favicon"));
-  WebServer.send_P(200, PSTR("image/x-icon"), favicon_8b_ico, favicon_8b_ico_len);
+  sendStaticData(PSTR("image/x-icon"), F(favicon_8b_ico_etag), favicon_8b_ico, favicon_8b_ico_len,
+                 favicon_8b_ico_gz, favicon_8b_ico_gz_len);
+}
+
+void handle_css() {
+  checkRAM(F("handle_css"));
+  if (SPIFFS.exists(F("esp.css")) && loadFromFS(true, F("/esp.css"))) return;
+  sendStaticData(PSTR("text/css"), F(pgDefaultCSS_etag), pgDefaultCSS, strlen_P(pgDefaultCSS),
+                 pgDefaultCSS_gz, pgDefaultCSS_gz_len);
+}
+
+//********************************************************************************
+// Static data, compressed variants are generated at build time by static_data_gz.py
+//********************************************************************************
+bool clientAcceptsGzip() {
+  return WebServer.header(F("Accept-Encoding")).indexOf(F("gzip")) != -1;
+}
+
+// Set the ETag and reply 304 Not Modified when the browser already has this version.
+bool handleNotModified(const String& etag) {
+  WebServer.sendHeader(F("ETag"), etag);
+  WebServer.sendHeader(F("Cache-Control"), F("no-cache"));
+  WebServer.sendHeader(F("Vary"), F("Accept-Encoding"));
+  if (WebServer.header(F("If-None-Match")) != etag) return false;
+  WebServer.send(304);
+  return true;
+}
+
+void sendStaticData(PGM_P contentType, const String& etag, PGM_P data, unsigned int length,
+                    PGM_P gzData, unsigned int gzLength) {
+  if (handleNotModified(etag)) return;
+  if (clientAcceptsGzip()) {
+    WebServer.sendHeader(F("Content-Encoding"), F("gzip"));
+    WebServer.send_P(200, contentType, gzData, gzLength);
+  } else {
+    WebServer.send_P(200, contentType, data, length);
+  }
+}
+
+// ETags of the files served last, so a request does not read the whole file again.
+// Cleared by clearFileETagCache() when a file is uploaded, deleted or written through
+// the web pages or commands. The .dat files are written by the firmware itself, so
+// their ETag is not cached.
+#define FILE_ETAG_CACHE_SIZE  8
+
+struct FileETagCacheStruct
+{
+  FileETagCacheStruct() : size(0) {}
+
+  String fileName;
+  size_t size;
+  String etag;
+} fileETagCache[FILE_ETAG_CACHE_SIZE];
+byte fileETagCacheNext = 0;
+
+void clearFileETagCache() {
+  for (byte i = 0; i < FILE_ETAG_CACHE_SIZE; ++i) {
+    fileETagCache[i].fileName = String();
+    fileETagCache[i].etag = String();
+  }
+}
+
+String getFileETag(const String& path, fs::File& file) {
+  const bool cacheable = !path.endsWith(F(".dat"));
+  if (cacheable) {
+    for (byte i = 0; i < FILE_ETAG_CACHE_SIZE; ++i) {
+      if (fileETagCache[i].size == file.size() && fileETagCache[i].fileName == path)
+        return fileETagCache[i].etag;
+    }
+  }
+  const String etag = getFileETag(file);
+  if (cacheable) {
+    FileETagCacheStruct& entry = fileETagCache[fileETagCacheNext];
+    fileETagCacheNext = (fileETagCacheNext + 1) % FILE_ETAG_CACHE_SIZE;
+    entry.fileName = path;
+    entry.size = file.size();
+    entry.etag = etag;
+  }
+  return etag;
+}
+
+// ETag of a file, a hash (FNV-1a) of its content.
+String getFileETag(fs::File& file) {
+  uint32_t hash = 2166136261UL;
+  uint8_t buf[64];
+  size_t length;
+  while ((length = file.read(buf, sizeof(buf))) > 0) {
+    for (size_t i = 0; i < length; ++i) {
+      hash ^= buf[i];
+      hash *= 16777619UL;
+    }
+  }
+  file.seek(0, SeekSet);
+  String etag = "\"";
+  etag += String(hash, HEX);
+  etag += file.size();
+  etag += '"';
+  return etag;
 }
 
 void createSvgRectPath(unsigned int color, int xoffset, int yoffset, int size, int height, int range, float SVG_BAR_WIDTH) {
@@ -464,13 +464,14 @@ static const char jsFetchAndParseLog[] PROGMEM = {
       "textToDisplay = 'Fetching log entries...';"
     "}"
     "document.getElementById('copyText_1').innerHTML = textToDisplay;"
+    "var logSequence = 0;"
     "loopDeLoop(1000, 0);"
 
     "const logLevel = new Array('Unused','Error','Info','Debug','Debug More','Undefined','Undefined','Undefined','Undefined','Debug Dev');"
 
     "function loopDeLoop(timeForNext, activeRequests) {"
       "const maximumRequests = 1;"
-      "const url = '/logjson';"
+      "const url = '/logjson?since=';"
       "if (isNaN(activeRequests)){activeRequests = maximumRequests;}"
     	"if (timeForNext == null){timeForNext = 1000;}"
       //to make sure we don't run to often... JS seems to like it that way.
@@ -495,7 +496,7 @@ static const char jsFetchAndParseLog[] PROGMEM = {
         "if (activeRequests > maximumRequests) {"
         		 "check = 1;"
         "} else {"
-    		"fetch(url).then(function(response) {"
+    		"fetch(url + logSequence).then(function(response) {"
     			"if (response.status !== 200) {"
     				"console.log('Looks like there was a problem. Status Code: ' + response.status);"
     				"return;"
@@ -518,6 +519,7 @@ static const char jsFetchAndParseLog[] PROGMEM = {
     						"}"
     				"}"
     				"timeForNext = data.Log.TTL;"
+            "logSequence = data.Log.Sequence;"
             "if (logEntriesChunk !== '') {"
                 "if (document.getElementById('copyText_1').innerHTML == 'Fetching log entries...') {"
                   "document.getElementById('copyText_1').innerHTML = '';"
@@ -0,0 +1,183 @@
+#ifndef WEBSTATICDATA_GZ_h
+#define WEBSTATICDATA_GZ_h
+
+// Generated by static_data_gz.py from WebStaticData.h, do not edit.
+
+// pgDefaultCSS: 6787 bytes, 1736 bytes compressed
+#define pgDefaultCSS_etag "\"0b958aa0ed102ab6\""
+static const unsigned int pgDefaultCSS_gz_len = 1736;
+static const char pgDefaultCSS_gz[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0xff, 0xd5, 0x58,
+  0x59, 0x6f, 0xdb, 0x38, 0x10, 0x7e, 0xce, 0xbf, 0x20, 0x10, 0x14, 0x69,
+  0x17, 0x91, 0x20, 0xcb, 0xb7, 0xfd, 0xd2, 0x6e, 0x12, 0x3f, 0xed, 0xfe,
+  0x86, 0x80, 0x96, 0x28, 0x8b, 0xb0, 0x2c, 0x1a, 0x14, 0x1d, 0x3b, 0x15,
+  0xbc, 0xbf, 0x7d, 0x87, 0xa4, 0x0e, 0x52, 0xa2, 0xd2, 0xf4, 0x5a, 0x60,
+  0xe1, 0x1c, 0x16, 0x87, 0x9a, 0xfb, 0x1b, 0xce, 0xf0, 0x0f, 0x54, 0x26,
+  0x2c, 0x17, 0x5e, 0x82, 0x0f, 0x34, 0x7b, 0x5d, 0xa1, 0x02, 0xe7, 0x85,
+  0x57, 0x10, 0x4e, 0x93, 0x35, 0x52, 0x84, 0x82, 0x7e, 0x25, 0x2b, 0x34,
+  0x0a, 0x8f, 0x62, 0x8d, 0x0e, 0x98, 0xef, 0x68, 0xbe, 0x42, 0xc1, 0xf1,
+  0xb2, 0x46, 0x47, 0x1c, 0xc7, 0x34, 0xdf, 0x55, 0x4f, 0x5b, 0x76, 0x91,
+  0x5b, 0xd5, 0xc2, 0x96, 0xf1, 0x98, 0x70, 0x0f, 0x96, 0xd6, 0xe8, 0x9a,
+  0x8e, 0x2a, 0x09, 0x15, 0xa3, 0x99, 0x64, 0x14, 0xb1, 0x8c, 0xf1, 0x15,
+  0xba, 0x0d, 0xe6, 0x8f, 0x2d, 0xd7, 0xc5, 0xf1, 0x82, 0x82, 0x4a, 0xea,
+  0x99, 0xd0, 0x5d, 0x2a, 0x24, 0xab, 0x2c, 0x96, 0x4c, 0x42, 0x9b, 0x89,
+  0xad, 0x0d, 0xf2, 0x26, 0x96, 0x42, 0x33, 0xa5, 0x10, 0x8e, 0xf6, 0x3b,
+  0xce, 0x4e, 0x79, 0xec, 0xd5, 0xd2, 0x26, 0x93, 0x49, 0x2b, 0x7a, 0xb3,
+  0xd9, 0x0c, 0xc8, 0x1a, 0xbf, 0x21, 0x0b, 0xd4, 0xbf, 0x28, 0x71, 0x7d,
+  0xa9, 0x93, 0x01, 0xa9, 0x4f, 0x4f, 0x4f, 0xad, 0x54, 0xa5, 0x82, 0x53,
+  0xea, 0xcc, 0x96, 0x1a, 0xf4, 0xdc, 0x74, 0xf5, 0xb7, 0x27, 0x21, 0x58,
+  0x8e, 0xca, 0x5a, 0x99, 0x9e, 0x7c, 0xa5, 0x9e, 0x53, 0x09, 0xc5, 0xc1,
+  0x32, 0x5d, 0x90, 0x8b, 0xf0, 0x62, 0x12, 0x31, 0x8e, 0x05, 0x65, 0xc0,
+  0x2d, 0x67, 0x39, 0x59, 0xd7, 0xb1, 0xe3, 0x38, 0xa6, 0xa7, 0xa2, 0x36,
+  0x4a, 0xad, 0x55, 0x3b, 0x6a, 0x35, 0xfc, 0x8c, 0xe6, 0x7b, 0x54, 0x22,
+  0xeb, 0xd9, 0x3f, 0xd3, 0x98, 0xa0, 0x32, 0xa6, 0xc5, 0x31, 0xc3, 0x90,
+  0x4d, 0x34, 0x87, 0x55, 0xe2, 0x6d, 0x33, 0x16, 0xed, 0xd7, 0x08, 0x88,
+  0x22, 0x95, 0xb6, 0x05, 0x1f, 0x2a, 0xf9, 0x38, 0xa3, 0x3b, 0x10, 0x1d,
+  0x91, 0x5c, 0x10, 0x6e, 0xb3, 0xf6, 0x39, 0x89, 0x51, 0xd9, 0x37, 0x05,
+  0x96, 0xdb, 0x8d, 0x29, 0xc9, 0x8e, 0xa8, 0x6c, 0x5c, 0x10, 0x82, 0x0b,
+  0x0c, 0x8d, 0xbd, 0x42, 0xbc, 0x66, 0xe0, 0xcc, 0x82, 0x65, 0x34, 0x6e,
+  0x16, 0x6b, 0x2d, 0x8c, 0x7d, 0x15, 0xeb, 0x1d, 0xc7, 0xaf, 0x3d, 0x0f,
+  0x4c, 0xa5, 0xb2, 0xb5, 0xc0, 0x55, 0xca, 0x5e, 0x08, 0x37, 0xd5, 0x02,
+  0x77, 0x8e, 0x67, 0x4b, 0xd8, 0x41, 0xf3, 0xe3, 0x49, 0xdc, 0xa3, 0x82,
+  0x64, 0x24, 0x82, 0xff, 0xd2, 0x3c, 0xcc, 0x09, 0x7e, 0x2b, 0x5a, 0x0b,
+  0x43, 0x05, 0xdb, 0xe1, 0xfd, 0x00, 0x12, 0x42, 0x7e, 0xca, 0x2c, 0xad,
+  0x5f, 0x5f, 0xff, 0x46, 0x40, 0x14, 0x45, 0xb5, 0x15, 0x55, 0x14, 0x0f,
+  0xf8, 0x52, 0x73, 0x9d, 0x06, 0x0a, 0xe4, 0xfa, 0x69, 0xa1, 0x3c, 0xd2,
+  0xee, 0xcc, 0x4f, 0x87, 0xad, 0x64, 0x3a, 0xb4, 0x7f, 0xa4, 0x1f, 0xae,
+  0xb7, 0xda, 0x37, 0x6a, 0xf1, 0x1b, 0xdc, 0x7b, 0x6e, 0xba, 0xea, 0x77,
+  0xbf, 0xa9, 0xbf, 0x1f, 0x01, 0x86, 0x30, 0xe4, 0x1c, 0x37, 0xb2, 0xb0,
+  0x4a, 0xbf, 0x8a, 0xa9, 0x97, 0x91, 0x04, 0x70, 0x37, 0x9e, 0x4a, 0x99,
+  0x3a, 0x38, 0xd5, 0xd2, 0xc4, 0x58, 0x11, 0xec, 0x58, 0xd7, 0x39, 0x56,
+  0x50, 0x8d, 0x10, 0x4e, 0x32, 0xc0, 0xca, 0x0b, 0x04, 0x22, 0x3a, 0xf1,
+  0x42, 0x4a, 0x3d, 0x32, 0xaa, 0x32, 0xb7, 0x5f, 0x2a, 0x01, 0xdf, 0xdb,
+  0x3d, 0x15, 0xde, 0xa9, 0x90, 0x01, 0xd3, 0xca, 0x57, 0x10, 0xf3, 0x0e,
+  0xec, 0xab, 0x7b, 0xbd, 0x70, 0x2d, 0x3b, 0x96, 0x4c, 0x33, 0x55, 0x1c,
+  0x00, 0x03, 0x8d, 0x96, 0x78, 0x0b, 0x89, 0x71, 0x12, 0xb0, 0x8d, 0x1d,
+  0x71, 0x44, 0x05, 0x38, 0x20, 0x70, 0x68, 0x2c, 0x99, 0xa4, 0x24, 0xda,
+  0x83, 0xbd, 0x7b, 0xf7, 0xeb, 0xda, 0x05, 0x6b, 0xa4, 0x9d, 0x03, 0x5f,
+  0xd2, 0xaa, 0x64, 0x85, 0xca, 0x75, 0x35, 0x9c, 0xab, 0xa7, 0xdf, 0x90,
+  0xb3, 0xc8, 0x05, 0x0e, 0xc3, 0xf6, 0x2a, 0x1b, 0xb4, 0x07, 0xfe, 0x41,
+  0xa6, 0x3d, 0xef, 0x49, 0x10, 0x8d, 0x08, 0xf5, 0x12, 0x94, 0x1a, 0xfb,
+  0xfd, 0xc1, 0x1a, 0x6a, 0x78, 0x6d, 0x85, 0x13, 0x21, 0xf3, 0x4c, 0x72,
+  0x84, 0x02, 0xb6, 0x42, 0x77, 0x77, 0x66, 0xb6, 0xb4, 0x8e, 0x6c, 0x12,
+  0x71, 0x20, 0x7a, 0x4e, 0x1d, 0x6a, 0xee, 0xdd, 0x2c, 0x36, 0xdf, 0xee,
+  0xef, 0xd6, 0xb1, 0x9a, 0x4b, 0x87, 0xaa, 0xf0, 0x8d, 0x5b, 0x60, 0x21,
+  0x15, 0xa7, 0x3a, 0x86, 0xa3, 0xc0, 0xac, 0xec, 0x2a, 0x2c, 0xe8, 0x9c,
+  0x52, 0x41, 0xba, 0xc1, 0x09, 0x24, 0x0f, 0xf5, 0x1b, 0xb4, 0x59, 0x2d,
+  0x38, 0xb4, 0x09, 0x09, 0xe3, 0x07, 0x00, 0x05, 0x13, 0x58, 0x90, 0x8f,
+  0x93, 0x69, 0x4c, 0x76, 0x9f, 0x74, 0x12, 0x0f, 0x53, 0x87, 0x29, 0x86,
+  0x59, 0xe1, 0x0f, 0x40, 0x77, 0x69, 0xac, 0x6c, 0x19, 0x94, 0x6a, 0x90,
+  0x10, 0xfe, 0x0f, 0xe0, 0x1b, 0xfe, 0x0c, 0x7e, 0x63, 0x26, 0x7e, 0x04,
+  0xbd, 0x33, 0x0b, 0xbd, 0xb3, 0xdf, 0x86, 0x5e, 0xc7, 0x41, 0x6a, 0x5a,
+  0xde, 0x45, 0x6f, 0x63, 0xcd, 0x3b, 0xb0, 0x1b, 0xf6, 0x81, 0xd3, 0xbc,
+  0x3e, 0x04, 0xdd, 0xc6, 0x5f, 0xbf, 0x00, 0xb7, 0xc3, 0xf2, 0xdf, 0x01,
+  0xdb, 0xb0, 0xb7, 0x59, 0xc5, 0x4a, 0x75, 0x03, 0x3a, 0x5a, 0x0b, 0x03,
+  0xb5, 0x0b, 0x13, 0xb5, 0xf2, 0xe1, 0xc6, 0xe1, 0xd7, 0x1b, 0xb3, 0x21,
+  0xa9, 0x60, 0x7c, 0xbd, 0x15, 0x0c, 0x17, 0xe2, 0x40, 0x8a, 0x02, 0xef,
+  0xe0, 0x38, 0x7f, 0xa1, 0x05, 0xdd, 0xd2, 0x4c, 0x25, 0x54, 0x4a, 0x63,
+  0x38, 0xb7, 0x01, 0x31, 0x00, 0x97, 0xa6, 0x8c, 0x07, 0x3d, 0x54, 0x79,
+  0x23, 0x5d, 0xdc, 0x07, 0x3c, 0x5a, 0x7f, 0x4f, 0x12, 0x18, 0x16, 0x5c,
+  0x0d, 0x9d, 0xb3, 0x80, 0xa3, 0xf6, 0x74, 0xd7, 0xed, 0xaa, 0xe1, 0xfb,
+  0x84, 0x5e, 0xa0, 0xbd, 0xfb, 0xea, 0xd1, 0x3c, 0x26, 0x17, 0xa0, 0xd7,
+  0x0e, 0x09, 0x17, 0xa1, 0xce, 0x32, 0x8d, 0xec, 0xb1, 0xec, 0x11, 0x2c,
+  0xd0, 0xce, 0x75, 0x16, 0xff, 0x44, 0x7f, 0x64, 0x79, 0xcb, 0x2f, 0x52,
+  0x76, 0xb6, 0x5d, 0xa6, 0xbe, 0x67, 0xa4, 0x2d, 0x0d, 0x38, 0xa7, 0x87,
+  0xaa, 0x75, 0x4e, 0x70, 0x4c, 0x68, 0x8e, 0x02, 0x7f, 0x5a, 0xdc, 0xab,
+  0x07, 0x06, 0x29, 0x2d, 0x9f, 0x50, 0x08, 0x7f, 0xd6, 0xe8, 0x3b, 0xb6,
+  0x5e, 0x3f, 0xd7, 0xfc, 0xf7, 0xe4, 0x35, 0xe1, 0x18, 0x14, 0xaa, 0xdf,
+  0x29, 0x13, 0xce, 0x0e, 0x00, 0x8f, 0xa6, 0xbc, 0x7d, 0xb0, 0x4a, 0xc4,
+  0x15, 0x20, 0xdf, 0x52, 0xc7, 0x36, 0xd5, 0x5f, 0x02, 0xfd, 0xfa, 0xf9,
+  0x77, 0xf0, 0x74, 0xeb, 0x2b, 0xcd, 0xea, 0x30, 0x77, 0xbd, 0x6e, 0xb2,
+  0x0f, 0x3a, 0xa2, 0xbb, 0xea, 0xfe, 0x0a, 0x96, 0x7e, 0x46, 0x5e, 0x48,
+  0xf6, 0x1c, 0x40, 0x99, 0x68, 0xa6, 0xa1, 0x91, 0xfc, 0xac, 0x1b, 0xda,
+  0xc8, 0xa4, 0x3d, 0x6c, 0x36, 0xcb, 0x69, 0x4b, 0x0b, 0x0d, 0xda, 0xf2,
+  0xf1, 0xe1, 0x69, 0xf3, 0xd4, 0xd2, 0xc6, 0x06, 0xed, 0xcb, 0x64, 0xf3,
+  0x30, 0x5f, 0xb6, 0xb4, 0x89, 0xc9, 0x33, 0xfc, 0xf2, 0xe7, 0xd8, 0xa0,
+  0x2d, 0x4d, 0xda, 0x66, 0x0a, 0xcd, 0xb0, 0xa2, 0xb1, 0xdd, 0x0b, 0x25,
+  0x67, 0x59, 0x1d, 0x6e, 0xba, 0x9a, 0x3a, 0xe0, 0x18, 0xce, 0xe5, 0x67,
+  0x8d, 0x6e, 0xac, 0x61, 0xfe, 0xee, 0xaf, 0x53, 0x44, 0x63, 0x8c, 0x1e,
+  0x58, 0x0e, 0x60, 0x20, 0x77, 0xf7, 0xe8, 0x6f, 0x96, 0xe3, 0x88, 0xdd,
+  0xa3, 0x03, 0xcb, 0x59, 0x01, 0x9e, 0x81, 0x7c, 0x6e, 0x8a, 0x0b, 0x9a,
+  0x8e, 0xab, 0x12, 0xd0, 0x74, 0xe6, 0xd0, 0xba, 0x07, 0x66, 0x2d, 0x72,
+  0xf6, 0xe6, 0x08, 0xc9, 0x42, 0x9e, 0x64, 0xec, 0x0c, 0xc5, 0xf3, 0x24,
+  0x18, 0x2c, 0xbc, 0x89, 0x44, 0xeb, 0x90, 0xb8, 0x9a, 0x83, 0xd2, 0x80,
+  0xdc, 0x01, 0xb1, 0xdf, 0x6f, 0x6a, 0x23, 0xec, 0x9b, 0x73, 0x84, 0xc0,
+  0x80, 0x75, 0x3f, 0x87, 0x4e, 0x05, 0x67, 0x48, 0x8e, 0x2b, 0x3f, 0x70,
+  0xb9, 0x60, 0x9b, 0x7b, 0xbb, 0x58, 0x2c, 0xdc, 0xa3, 0xbf, 0x2d, 0x2b,
+  0x36, 0x64, 0x4d, 0xcc, 0xda, 0xaf, 0x82, 0xd3, 0xd9, 0xcc, 0xbb, 0x9b,
+  0x6d, 0x7a, 0xd9, 0x54, 0x6b, 0x99, 0x54, 0xd6, 0xf8, 0x6d, 0x54, 0xfe,
+  0x49, 0x18, 0xd8, 0x45, 0x31, 0xc3, 0xc7, 0x02, 0xa2, 0x56, 0x7f, 0x6b,
+  0xb8, 0x1e, 0x4e, 0x99, 0xa0, 0x1c, 0x0a, 0xe3, 0x7f, 0xe2, 0x90, 0x56,
+  0x5a, 0xcf, 0x25, 0xce, 0xa3, 0xc6, 0xe5, 0xa7, 0x96, 0xc7, 0x90, 0xa7,
+  0x8c, 0x1d, 0xab, 0x5c, 0xa4, 0x5e, 0x94, 0xd2, 0x2c, 0xfe, 0x08, 0xc0,
+  0xcc, 0x3f, 0xb9, 0xb2, 0xe3, 0xf1, 0xe9, 0x69, 0x26, 0x4d, 0xe9, 0xbe,
+  0xfd, 0xcb, 0x3c, 0x0d, 0xa1, 0x13, 0xa4, 0x65, 0xd7, 0xde, 0x17, 0x55,
+  0x50, 0xa2, 0x02, 0xec, 0x56, 0xcd, 0x50, 0x4a, 0xa0, 0x26, 0xf2, 0x03,
+  0x8c, 0xdf, 0x66, 0x03, 0xa8, 0x4f, 0xd0, 0x7e, 0xf7, 0xc7, 0xb5, 0x73,
+  0x8c, 0x3e, 0x70, 0x69, 0xdf, 0xe2, 0xc9, 0xdb, 0xb7, 0x51, 0x38, 0x10,
+  0xcb, 0xcd, 0x42, 0x7e, 0xd6, 0xed, 0xcd, 0x9e, 0x2e, 0xaf, 0x70, 0x98,
+  0x56, 0xa3, 0xc3, 0xed, 0xe3, 0x23, 0x0c, 0x47, 0xc6, 0xc1, 0x7d, 0xf5,
+  0xf1, 0x51, 0x6b, 0x68, 0x38, 0xfe, 0x3d, 0x32, 0xae, 0xfe, 0x96, 0xc5,
+  0xaf, 0xda, 0x2c, 0x73, 0x16, 0x5f, 0xce, 0xd4, 0xf0, 0x27, 0x09, 0x5b,
+  0xcc, 0x4d, 0x93, 0x69, 0x9e, 0x12, 0x4e, 0x45, 0x65, 0xf4, 0x54, 0x75,
+  0x2c, 0x7a, 0x23, 0x1c, 0x17, 0x19, 0xc3, 0x60, 0xab, 0x74, 0x83, 0xe3,
+  0xaa, 0x4c, 0x2b, 0xa4, 0x12, 0xd8, 0x72, 0xb8, 0xea, 0xa0, 0x3c, 0x55,
+  0x34, 0x64, 0xf3, 0x77, 0xe6, 0xf8, 0xd8, 0x9d, 0x95, 0xd4, 0x24, 0x73,
+  0x84, 0x5a, 0x92, 0x8b, 0x6e, 0x8b, 0xa1, 0xb8, 0xeb, 0x5f, 0xd7, 0xf5,
+  0x0e, 0xd2, 0xb7, 0x87, 0xc1, 0xe0, 0x15, 0x9c, 0xd6, 0xdd, 0xc7, 0x91,
+  0x1c, 0x56, 0x3a, 0x99, 0xe5, 0xf2, 0x9b, 0x03, 0x5a, 0xd0, 0x9d, 0xa9,
+  0x90, 0x54, 0x54, 0xcd, 0xb1, 0x2e, 0x7a, 0x03, 0x0c, 0x55, 0x76, 0x37,
+  0x9b, 0x9f, 0xeb, 0xcb, 0x46, 0xbb, 0x09, 0xbe, 0xfa, 0x72, 0xad, 0xa9,
+  0xe0, 0x44, 0x36, 0x91, 0xb0, 0x96, 0x24, 0xcd, 0xa2, 0xbc, 0x9f, 0x93,
+  0xb3, 0x09, 0x7d, 0x79, 0xce, 0x3a, 0xfe, 0xd7, 0xab, 0xbc, 0x59, 0x55,
+  0x39, 0xd9, 0xde, 0xad, 0x86, 0x56, 0x3e, 0x2a, 0x0f, 0x06, 0xdf, 0x71,
+  0x43, 0x16, 0x2c, 0x82, 0x26, 0x8c, 0x75, 0x0b, 0xac, 0x04, 0x6e, 0xa5,
+  0xcd, 0x19, 0xc1, 0x5c, 0x16, 0x18, 0x91, 0xca, 0x65, 0x9c, 0x11, 0x2e,
+  0xcc, 0x8b, 0xc3, 0x60, 0x80, 0x69, 0x32, 0x99, 0x8c, 0xc7, 0xb3, 0x2e,
+  0xdf, 0xce, 0xa0, 0x39, 0xaa, 0x52, 0xee, 0x8c, 0x79, 0x0e, 0xec, 0xde,
+  0xc5, 0x37, 0x89, 0xf0, 0x68, 0xfe, 0x4e, 0xbe, 0x51, 0xc6, 0x0a, 0xb2,
+  0x15, 0xcd, 0xcd, 0x6f, 0xd5, 0x9d, 0x6b, 0xb2, 0xcd, 0xc1, 0x51, 0x4e,
+  0x6d, 0x67, 0x1b, 0x4d, 0x73, 0xa8, 0x1c, 0xae, 0x2e, 0x68, 0x9b, 0xd9,
+  0x50, 0xe9, 0xdb, 0x9b, 0x35, 0x55, 0xb2, 0x57, 0x68, 0x0b, 0xfc, 0x71,
+  0x61, 0x2a, 0xd5, 0xc9, 0xaa, 0x6d, 0x86, 0xd5, 0xb8, 0x53, 0xc0, 0xbc,
+  0x0b, 0xfb, 0xcb, 0xba, 0x35, 0xf0, 0x2e, 0x75, 0x73, 0x60, 0x15, 0xc7,
+  0xeb, 0xe7, 0x03, 0x89, 0x29, 0x46, 0x45, 0x24, 0x73, 0x09, 0x1a, 0xe5,
+  0x18, 0x7d, 0x34, 0xfa, 0x80, 0xe5, 0x0c, 0x14, 0xfa, 0x84, 0x4a, 0x5d,
+  0x49, 0x2a, 0x51, 0x6d, 0x0d, 0xe8, 0x0c, 0x59, 0x43, 0x99, 0x5b, 0x8d,
+  0x60, 0xee, 0x1b, 0xe7, 0xaa, 0xd8, 0x94, 0xa8, 0x7f, 0xf3, 0x87, 0x9a,
+  0x72, 0x53, 0x76, 0x67, 0x41, 0x63, 0x93, 0xf3, 0x86, 0x01, 0x21, 0x2b,
+  0xf3, 0x91, 0x65, 0xb5, 0x59, 0xbb, 0xcb, 0xa1, 0xf7, 0xeb, 0x90, 0xd4,
+  0x1d, 0xd5, 0x1b, 0xfc, 0x90, 0x31, 0x52, 0xa9, 0x9c, 0xb0, 0xea, 0xb0,
+  0x71, 0x4e, 0xa4, 0xa3, 0x12, 0xb9, 0x2a, 0xbe, 0xb5, 0x09, 0xe1, 0x72,
+  0x60, 0x98, 0xb3, 0x65, 0xd6, 0x7c, 0xe6, 0x0d, 0x50, 0x7b, 0x3a, 0xd7,
+  0x25, 0xb3, 0x72, 0x94, 0x0d, 0x64, 0x7d, 0x29, 0x0c, 0x3f, 0xff, 0x02,
+  0xb4, 0xaf, 0x54, 0x81, 0x83, 0x1a, 0x00, 0x00
+};
+
+// favicon_8b_ico: 1150 bytes, 238 bytes compressed
+#define favicon_8b_ico_etag "\"f59188d66fc48cae\""
+static const unsigned int favicon_8b_ico_gz_len = 238;
+static const char favicon_8b_ico_gz[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0xff, 0x63, 0x60,
+  0x60, 0x04, 0x42, 0x01, 0x01, 0x06, 0x20, 0xa9, 0xc0, 0x90, 0xc1, 0xc2,
+  0xc0, 0x20, 0xc6, 0xc0, 0xc0, 0xa0, 0x01, 0xc4, 0x40, 0x21, 0xa0, 0x08,
+  0x44, 0x1c, 0x0c, 0x80, 0x72, 0x42, 0xdc, 0x10, 0x0c, 0x03, 0xef, 0x0f,
+  0x74, 0x0a, 0xfe, 0xfb, 0xfd, 0x63, 0xcd, 0x7f, 0x20, 0xf8, 0xf7, 0xeb,
+  0x2b, 0x18, 0xc3, 0x00, 0x8c, 0x8f, 0x8c, 0x61, 0xe0, 0xcf, 0xe7, 0x97,
+  0x6b, 0x60, 0x7a, 0x3f, 0x9e, 0x98, 0xfa, 0xff, 0xfd, 0xa1, 0x2e, 0xb8,
+  0x1c, 0x3a, 0x1f, 0xd9, 0x3c, 0x90, 0x38, 0x08, 0x83, 0xd8, 0x20, 0x33,
+  0x40, 0xe2, 0x20, 0xfe, 0x8d, 0x64, 0x86, 0xff, 0xef, 0xf7, 0x34, 0x80,
+  0xd5, 0x81, 0x68, 0x30, 0x1f, 0x6a, 0x06, 0xcc, 0x5e, 0x90, 0xf8, 0xcd,
+  0x4c, 0x06, 0x30, 0xc6, 0x26, 0x87, 0xcf, 0x0c, 0x42, 0xfa, 0x89, 0x31,
+  0x03, 0xec, 0x7e, 0xa0, 0x18, 0x08, 0x23, 0x87, 0x07, 0xd8, 0xbf, 0xe8,
+  0x7a, 0xf0, 0xb8, 0x03, 0x39, 0x3c, 0xf0, 0xfa, 0x9f, 0x40, 0x78, 0x20,
+  0xbb, 0x81, 0x54, 0x33, 0xb0, 0xc5, 0x37, 0xb9, 0xee, 0x40, 0xf1, 0x3f,
+  0x19, 0xee, 0x00, 0xe9, 0x47, 0x51, 0x43, 0x84, 0x19, 0x20, 0x3d, 0x78,
+  0xc3, 0x90, 0x80, 0x19, 0x44, 0xf9, 0x9f, 0x80, 0x19, 0xc8, 0xfa, 0x49,
+  0x76, 0x07, 0xd4, 0xff, 0xbf, 0x3f, 0x3e, 0x5b, 0x83, 0x9e, 0x2e, 0x40,
+  0x7e, 0x83, 0xf9, 0x0f, 0x66, 0x06, 0x36, 0x3e, 0x28, 0xef, 0x81, 0xf2,
+  0x20, 0xc8, 0x0c, 0x6c, 0x79, 0x14, 0x1f, 0x1f, 0xa6, 0x97, 0x81, 0x42,
+  0x00, 0x00, 0x18, 0xa6, 0x1c, 0x6b, 0x7e, 0x04, 0x00, 0x00
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef WEBSTRINGS_h
+#define WEBSTRINGS_h
+
+/*********************************************************************************************\
+ * Shared flash strings
+ * Every F("...") is a flash copy of its own, the linker does not merge them. The strings
+ * below were repeated all over the web pages and plugins, so they are kept once, and
+ * taken by index:
+ *   TXBuffer += getWebString(WEB_STR_TABLE_FORM_END);
+ *   strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], getWebStringP(WEB_STR_TEMPERATURE));
+ * flash_strings.py (run before each build) lists the literals still repeated in src/.
+ * Add a string here at the end of its group, the index is not stored anywhere.
+\*********************************************************************************************/
+#define WEB_STRINGS(X) \
+  X(TMPL_STD,         "TmplStd") \
+  X(TMPL_DSH,         "TmplDsh") \
+  X(TMPL_AP,          "TmplAP") \
+  X(BR,               "<BR>") \
+  X(TD,               "<TD>") \
+  X(TABLE_END,        "</table>") \
+  X(TABLE_FORM_END,   "</table></form>") \
+  X(A_END,            "</a>") \
+  X(DIV_END,          "</div>") \
+  X(TEXTAREA_END,     "</textarea>") \
+  X(OPTION_VALUE,     "<option value='") \
+  X(OPTION_END,       "</option>") \
+  X(SELECT_END,       "</select>") \
+  X(SELECTED,         " selected") \
+  X(NONE,             "- None -") \
+  X(TEXT_PLAIN,       "text/plain") \
+  X(TEXT_HTML,        "text/html") \
+  X(OCTET_STREAM,     "application/octet-stream") \
+  X(I2C_ADDR,         "i2c_addr") \
+  X(TASKDEVICEPIN1,   "taskdevicepin1") \
+  X(TASKDEVICEPIN2,   "taskdevicepin2") \
+  X(TASKDEVICEPIN3,   "taskdevicepin3") \
+  X(BYTES,            " bytes") \
+  X(UNKNOWN,          "Unknown") \
+  X(HTTP_CONNECTING,  "HTTP : connecting to ") \
+  X(HTTP_CONN_FAILED, "HTTP : connection failed") \
+  X(HTTP_200_OK,      "HTTP/1.1 200 OK") \
+  X(CONTENT_LENGTH,   "Content-Length: ") \
+  X(KEEP_ALIVE,       "Connection: keep-alive\r\n") \
+  X(TEMPERATURE,      "Temperature") \
+  X(HUMIDITY,         "Humidity") \
+  X(PRESSURE,         "Pressure")
+
+#define WEB_STRING_ENUM(id, text)  WEB_STR_##id,
+#define WEB_STRING_TEXT(id, text)  static const char webString_##id[] PROGMEM = text;
+#define WEB_STRING_PTR(id, text)   webString_##id,
+
+enum WebStringId {
+  WEB_STRINGS(WEB_STRING_ENUM)
+  WEB_STR_NR
+};
+
+WEB_STRINGS(WEB_STRING_TEXT)
+
+static const char* const webStrings[WEB_STR_NR] PROGMEM = {
+  WEB_STRINGS(WEB_STRING_PTR)
+};
+
+inline PGM_P getWebStringP(byte id) {
+  if (id >= WEB_STR_NR) return PSTR("");
+  return (PGM_P)pgm_read_ptr(&webStrings[id]);
+}
+
+inline const __FlashStringHelper* getWebString(byte id) {
+  return PGMT(getWebStringP(id));
+}
+
+#endif
@@ -0,0 +1,270 @@
+//********************************************************************************
+// Firmware update (/update)
+// The image of the upload is written to the OTA part of the flash while it
+// comes in, the same as ESP8266HTTPUpdateServer did, and:
+//   - with /update?md5=<32 hex digits> (of the uncompressed .bin) the updater
+//     checks the MD5 of what it wrote before the image is accepted. The MD5 of
+//     the image is shown on the result page anyway,
+//   - on ESP32 a gzip compressed image (firmware.bin.gz) is inflated on the fly
+//     by the inflater in ROM, with its 32 kB window from allocBuffer(). The
+//     CRC32 and the size in the gzip trailer are checked as well.
+// ESP8266 has no RAM for the window, a compressed image is refused there.
+// ArduinoOTA is not affected, it sends the plain image.
+//********************************************************************************
+#ifdef ESP32
+  #include <rom/miniz.h>
+#endif
+#include <StreamString.h>
+
+#define WEB_UPDATE_GZIP_TRAILER    8   // CRC32 and size of the uncompressed data
+
+struct WebUpdateStruct
+{
+  WebUpdateStruct() : active(false), done(false), gzip(false), received(0), written(0)
+  #ifdef ESP32
+    , inflater(NULL), window(NULL), windowPos(0), crc(0), inflated(false), trailerLength(0)
+  #endif
+    {}
+
+  bool active;            // Update.begin() done
+  bool done;              // Update.end() accepted the image
+  bool gzip;
+  unsigned long received;
+  unsigned long written;  // Uncompressed
+  String error;
+  #ifdef ESP32
+  tinfl_decompressor* inflater;
+  byte* window;           // TINFL_LZ_DICT_SIZE, also the output buffer of the inflater
+  size_t windowPos;
+  uint32_t crc;
+  bool inflated;          // End of the deflate data, the trailer follows
+  byte trailer[WEB_UPDATE_GZIP_TRAILER];
+  byte trailerLength;
+  #endif
+} webUpdate;
+
+// Length of the gzip header at the start of data, 0 when it is not complete in data.
+size_t getGzipHeaderLength(const uint8_t* data, size_t length) {
+  if (length < 10 || data[2] != 8) return 0;  // Only deflate
+  const byte flags = data[3];
+  size_t pos = 10;
+  if (flags & 0x04) {  // FEXTRA
+    if (pos + 2 > length) return 0;
+    pos += 2 + (data[pos] | (data[pos + 1] << 8));
+  }
+  for (byte field = 0x08; field <= 0x10; field <<= 1) {  // FNAME and FCOMMENT, zero terminated
+    if ((flags & field) == 0) continue;
+    while (pos < length && data[pos] != 0) ++pos;
+    ++pos;
+  }
+  if (flags & 0x02) pos += 2;  // FHCRC
+  return pos <= length ? pos : 0;
+}
+
+bool webUpdateWrite(uint8_t* data, size_t length) {
+  if (Update.write(data, length) != length) {
+    StreamString error;
+    Update.printError(error);
+    webUpdate.error = F("Write failed: ");
+    webUpdate.error += error;
+    return false;
+  }
+  webUpdate.written += length;
+  return true;
+}
+
+#ifdef ESP32
+bool webUpdateInflate(const uint8_t* data, size_t length) {
+  while (!webUpdate.inflated) {
+    size_t inSize = length;
+    size_t outSize = TINFL_LZ_DICT_SIZE - webUpdate.windowPos;
+    const tinfl_status status = tinfl_decompress(webUpdate.inflater, data, &inSize, webUpdate.window,
+                                                 webUpdate.window + webUpdate.windowPos, &outSize, TINFL_FLAG_HAS_MORE_INPUT);
+    data += inSize;
+    length -= inSize;
+    if (outSize != 0) {
+      byte* out = webUpdate.window + webUpdate.windowPos;
+      webUpdate.crc = crc32Update(webUpdate.crc, out, outSize);
+      if (!webUpdateWrite(out, outSize)) return false;
+      webUpdate.windowPos = (webUpdate.windowPos + outSize) & (TINFL_LZ_DICT_SIZE - 1);
+    }
+    if (status < TINFL_STATUS_DONE) {
+      webUpdate.error = F("Invalid compressed data");
+      return false;
+    }
+    if (status == TINFL_STATUS_DONE) webUpdate.inflated = true;
+    else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && length == 0) break;
+  }
+  while (length > 0 && webUpdate.trailerLength < WEB_UPDATE_GZIP_TRAILER) {
+    webUpdate.trailer[webUpdate.trailerLength++] = *data++;
+    --length;
+  }
+  return true;
+}
+
+bool webUpdateCheckGzipTrailer() {
+  uint32_t crc = 0, size = 0;
+  for (byte i = 0; i < 4; ++i) {
+    crc |= static_cast<uint32_t>(webUpdate.trailer[i]) << (8 * i);
+    size |= static_cast<uint32_t>(webUpdate.trailer[i + 4]) << (8 * i);
+  }
+  if (!webUpdate.inflated || webUpdate.trailerLength != WEB_UPDATE_GZIP_TRAILER) {
+    webUpdate.error = F("Compressed image incomplete");
+  } else if (crc != webUpdate.crc || size != webUpdate.written) {
+    webUpdate.error = F("Compressed image CRC error");
+  }
+  return webUpdate.error.length() == 0;
+}
+#endif
+
+void webUpdateRelease() {
+  #ifdef ESP32
+  freeBuffer(MEM_POOL_WEB, webUpdate.inflater, sizeof(tinfl_decompressor));
+  freeBuffer(MEM_POOL_WEB, webUpdate.window, TINFL_LZ_DICT_SIZE);
+  webUpdate.inflater = NULL;
+  webUpdate.window = NULL;
+  #endif
+}
+
+// First data of the upload, a gzip image is recognized by its magic number.
+bool webUpdateStart(const uint8_t* data, size_t length) {
+  webUpdate.gzip = length >= 2 && data[0] == 0x1F && data[1] == 0x8B;
+  size_t headerLength = 0;
+  if (webUpdate.gzip) {
+    #ifdef ESP32
+    headerLength = getGzipHeaderLength(data, length);
+    webUpdate.inflater = static_cast<tinfl_decompressor*>(allocBuffer(MEM_POOL_WEB, sizeof(tinfl_decompressor)));
+    webUpdate.window = static_cast<byte*>(allocBuffer(MEM_POOL_WEB, TINFL_LZ_DICT_SIZE));
+    if (headerLength == 0) {
+      webUpdate.error = F("Invalid gzip header");
+      return false;
+    }
+    if (webUpdate.inflater == NULL || webUpdate.window == NULL) {
+      webUpdate.error = F("Not enough memory to inflate");
+      return false;
+    }
+    tinfl_init(webUpdate.inflater);
+    #else
+    webUpdate.error = F("Compressed images are not supported on ESP8266, upload the .bin");
+    return false;
+    #endif
+  }
+
+  #if defined(ESP8266)
+  WiFiUDP::stopAll();
+  const uint32_t maxSketchSpace = (ESP.getFreeSketchSpace() - 0x1000) & 0xFFFFF000;
+  #else
+  const uint32_t maxSketchSpace = UPDATE_SIZE_UNKNOWN;
+  #endif
+  if (!Update.begin(maxSketchSpace)) {
+    StreamString error;
+    Update.printError(error);
+    webUpdate.error = error;
+    return false;
+  }
+  webUpdate.active = true;
+  const String md5 = WebServer.arg(F("md5"));
+  if (md5.length() != 0 && !Update.setMD5(md5.c_str())) {
+    webUpdate.error = F("Invalid MD5");
+    return false;
+  }
+  addLog(LOG_LEVEL_INFO, webUpdate.gzip ? F("OTA  : Compressed image upload") : F("OTA  : Image upload"));
+  return webUpdateData(data + headerLength, length - headerLength);
+}
+
+bool webUpdateData(const uint8_t* data, size_t length) {
+  #ifdef ESP32
+  if (webUpdate.gzip) return webUpdateInflate(data, length);
+  #endif
+  return webUpdateWrite(const_cast<uint8_t*>(data), length);
+}
+
+// Upload handler of POST /update
+void handle_update_upload() {
+  if (!isLoggedIn()) return;
+  HTTPUpload& upload = WebServer.upload();
+  if (upload.status == UPLOAD_FILE_START) {
+    webUpdateRelease();
+    webUpdate = WebUpdateStruct();
+    closeCachedReadFile();
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    if (webUpdate.error.length() != 0) return;
+    const bool first = webUpdate.received == 0;
+    webUpdate.received += upload.currentSize;
+    if (first ? !webUpdateStart(upload.buf, upload.currentSize) : !webUpdateData(upload.buf, upload.currentSize))
+      Update.end();
+  } else if (upload.status == UPLOAD_FILE_END) {
+    if (webUpdate.error.length() != 0 || !webUpdate.active) return;
+    #ifdef ESP32
+    if (webUpdate.gzip && !webUpdateCheckGzipTrailer()) {
+      Update.end();
+      return;
+    }
+    #endif
+    if (Update.end(true)) {
+      webUpdate.done = true;
+    } else {
+      StreamString error;
+      Update.printError(error);
+      webUpdate.error = error;
+    }
+  } else if (upload.status == UPLOAD_FILE_ABORTED) {
+    if (webUpdate.active) Update.end();
+    webUpdate.error = F("Upload aborted");
+  }
+  delay(0);
+}
+
+void handle_update() {
+  if (!isLoggedIn()) return;
+  navMenuIndex = 7;
+  TXBuffer.startStream();
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD));
+  TXBuffer += F("<form enctype='multipart/form-data' method='post' onsubmit=\"this.action='/update?md5='+this.md5.value\">");
+  #ifdef ESP32
+  TXBuffer += F("<p>Firmware image (.bin or .bin.gz):<br>");
+  #else
+  TXBuffer += F("<p>Firmware image (.bin):<br>");
+  #endif
+  TXBuffer += F("<input type='file' name='image' size='40'></p>");
+  TXBuffer += F("<p>MD5 of the .bin (optional):<br><input type='text' name='md5' size='32' maxlength='32'></p>");
+  TXBuffer += F("<div><input class='button link' type='submit' value='Update'></div></form>");
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD), true);
+  TXBuffer.endStream();
+}
+
+void handle_update_post() {
+  checkRAM(F("handle_update_post"));
+  if (!isLoggedIn()) return;
+  webUpdateRelease();
+  if (!webUpdate.done && webUpdate.error.length() == 0)
+    webUpdate.error = F("No image");
+
+  navMenuIndex = 7;
+  TXBuffer.startStream();
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD));
+  if (webUpdate.done) {
+    String log = F("OTA  : Update OK, ");
+    log += webUpdate.written;
+    log += getWebString(WEB_STR_BYTES);
+    if (webUpdate.gzip) {
+      log += F(" from ");
+      log += webUpdate.received;
+      log += F(" compressed");
+    }
+    log += F(", MD5 ");
+    log += Update.md5String();
+    addLog(LOG_LEVEL_INFO, log);
+    TXBuffer += log.substring(7);
+    TXBuffer += F("<BR>Rebooting...");
+    cmd_within_mainloop = CMD_REBOOT;
+  } else {
+    addLog(LOG_LEVEL_ERROR, String(F("OTA  : ")) + webUpdate.error);
+    TXBuffer += F("<font color=\"red\">Update failed: ");
+    TXBuffer += webUpdate.error;
+    TXBuffer += F("</font>");
+  }
+  sendHeadandTail(getWebString(WEB_STR_TMPL_STD), true);
+  TXBuffer.endStream();
+  webUpdate = WebUpdateStruct();
+}
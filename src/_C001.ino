@@ -22,6 +22,7 @@ boolean CPlugin_001(byte function, struct EventStruct *event, String& string)
         Protocol[protocolCount].usesPassword = true;
         Protocol[protocolCount].defaultPort = 8080;
         Protocol[protocolCount].usesID = true;
+        Protocol[protocolCount].reportsSendResult = true;
         break;
       }
 
@@ -55,33 +56,22 @@ boolean CPlugin_001(byte function, struct EventStruct *event, String& string)
           }
 
           // boolean success = false;
-          addLog(LOG_LEVEL_DEBUG, String(F("HTTP : connecting to "))+ControllerSettings.getHostPortString());
+          addLog(LOG_LEVEL_DEBUG, String(getWebString(WEB_STR_HTTP_CONNECTING))+ControllerSettings.getHostPortString());
 
 
-          // Use WiFiClient class to create TCP connections
-          WiFiClient client;
-          if (!ControllerSettings.connectToHost(client))
-          {
-            connectionFailures++;
-
-            addLog(LOG_LEVEL_ERROR, F("HTTP : connection failed"));
-            return false;
-          }
-          statusLED(true);
-          if (connectionFailures)
-            connectionFailures--;
-
           // We now create a URI for the request
           String url = F("/json.htm?type=command&param=udevice&idx=");
           url += event->idx;
 
+          TaskValueSnapshot snapshot;
+          getTaskValueSnapshot(event->TaskIndex, snapshot);
           switch (event->sensorType)
           {
             case SENSOR_TYPE_SWITCH:
               url = F("/json.htm?type=command&param=switchlight&idx=");
               url += event->idx;
               url += F("&switchcmd=");
-              if (UserVar[event->BaseVarIndex] == 0)
+              if (snapshot.values[0] == 0)
                 url += F("Off");
               else
                 url += F("On");
@@ -90,11 +80,11 @@ boolean CPlugin_001(byte function, struct EventStruct *event, String& string)
               url = F("/json.htm?type=command&param=switchlight&idx=");
               url += event->idx;
               url += F("&switchcmd=");
-              if (UserVar[event->BaseVarIndex] == 0) {
+              if (snapshot.values[0] == 0) {
                 url += ("Off");
               } else {
                 url += F("Set%20Level&level=");
-                url += UserVar[event->BaseVarIndex];
+                url += snapshot.values[0];
               }
               break;
 
@@ -133,30 +123,26 @@ boolean CPlugin_001(byte function, struct EventStruct *event, String& string)
           request += ControllerSettings.getHost();
           request += F("\r\n");
           request += authHeader;
-          request += F("Connection: close\r\n\r\n");
-          client.print(request);
-
-          unsigned long timer = millis() + 200;
-          while (!client.available() && !timeOutReached(timer))
-            yield();
-
-          // Read all the lines of the reply from server and log them
-          while (client.available()) {
-            // String line = client.readStringUntil('\n');
-            String line;
-            safeReadStringUntil(client, line, '\n');
-            addLog(LOG_LEVEL_DEBUG_MORE, line);
-            if (line.startsWith(F("HTTP/1.1 200 OK")) )
-            {
-              addLog(LOG_LEVEL_DEBUG, F("HTTP : Success"));
-              success = true;
-            }
-            yield();
+          request += F("Connection: keep-alive\r\n\r\n");
+
+          // Use the kept-alive connection of this controller, or create a new one
+          String line;
+          if (!sendControllerHttpRequest(event->ControllerIndex, ControllerSettings, request, line))
+          {
+            connectionFailures++;
+
+            addLog(LOG_LEVEL_ERROR, getWebString(WEB_STR_HTTP_CONN_FAILED));
+            return false;
           }
-          addLog(LOG_LEVEL_DEBUG, F("HTTP : closing connection"));
+          statusLED(true);
+          if (connectionFailures)
+            connectionFailures--;
 
-          client.flush();
-          client.stop();
+          if (line.startsWith(getWebString(WEB_STR_HTTP_200_OK)) )
+          {
+            addLog(LOG_LEVEL_DEBUG, F("HTTP : Success"));
+            success = true;
+          }
         } // if ixd !=0
         else
         {
@@ -9,6 +9,71 @@
 
 #include <ArduinoJson.h>
 
+// Values of a message, taken once as the JSON is written twice (see MQTTpublishJson()).
+struct C002_JsonStruct
+{
+  C002_JsonStruct(struct EventStruct *event) : idx(event->idx), sensorType(event->sensorType), rssi(mapRSSItoDomoticz()), battery(0) {
+    #if FEATURE_ADC_VCC
+      battery = mapVccToDomoticz();
+    #endif
+    getTaskValueSnapshot(event->TaskIndex, snapshot);
+    if (sensorType != SENSOR_TYPE_SWITCH && sensorType != SENSOR_TYPE_DIMMER)
+      svalue = formatDomoticzSensorType(event);
+  }
+
+  int idx;
+  byte sensorType;
+  int rssi;
+  int battery;
+  TaskValueSnapshot snapshot;
+  String svalue;
+};
+
+void C002_writeJson(JsonWriter& root, void* context)
+{
+  const C002_JsonStruct& data = *static_cast<const C002_JsonStruct*>(context);
+  root.beginObject();
+  root.member(F("idx"), data.idx);
+  root.member(F("RSSI"), data.rssi);
+  #if FEATURE_ADC_VCC
+    root.member(F("Battery"), data.battery);
+  #endif
+
+  switch (data.sensorType)
+  {
+    case SENSOR_TYPE_SWITCH:
+      root.member(F("command"), F("switchlight"));
+      if (data.snapshot.values[0] == 0)
+        root.member(F("switchcmd"), F("Off"));
+      else
+        root.member(F("switchcmd"), F("On"));
+      break;
+    case SENSOR_TYPE_DIMMER:
+      root.member(F("command"), F("switchlight"));
+      if (data.snapshot.values[0] == 0)
+        root.member(F("switchcmd"), F("Off"));
+      else
+        root.member(F("Set%20Level"), data.snapshot.values[0], 2);
+      break;
+
+    case SENSOR_TYPE_SINGLE:
+    case SENSOR_TYPE_LONG:
+    case SENSOR_TYPE_DUAL:
+    case SENSOR_TYPE_TRIPLE:
+    case SENSOR_TYPE_QUAD:
+    case SENSOR_TYPE_TEMP_HUM:
+    case SENSOR_TYPE_TEMP_BARO:
+    case SENSOR_TYPE_TEMP_EMPTY_BARO:
+    case SENSOR_TYPE_TEMP_HUM_BARO:
+    case SENSOR_TYPE_WIND:
+    default:
+      root.member(F("nvalue"), 0);
+      root.member(F("svalue"), data.svalue);
+      break;
+  }
+  root.endObject();
+}
+
 boolean CPlugin_002(byte function, struct EventStruct *event, String& string)
 {
   boolean success = false;
@@ -40,6 +105,12 @@ boolean CPlugin_002(byte function, struct EventStruct *event, String& string)
         break;
       }
 
+    case CPLUGIN_INIT:
+      {
+        initControllerPublishTemplate(event->ControllerIndex, false);
+        break;
+      }
+
     case CPLUGIN_PROTOCOL_RECV:
       {
         // char json[512];
@@ -104,6 +175,13 @@ boolean CPlugin_002(byte function, struct EventStruct *event, String& string)
                           break;
                       }
                       action += pwmValue;
+                    } else if (nvalue != 0 && Settings.TaskDevicePluginConfig[x][0] > 0) {
+                      // Pulse time set, played by the output sequencer
+                      UserVar[baseVar] = nvalue;
+                      action = F("pulse,");
+                      action += Settings.TaskDevicePin1[x];
+                      action += F(",1,");
+                      action += Settings.TaskDevicePluginConfig[x][0];
                     } else {
                       UserVar[baseVar] = nvalue;
                       action = F("gpio,");
@@ -121,6 +199,7 @@ boolean CPlugin_002(byte function, struct EventStruct *event, String& string)
                   TempEvent.TaskIndex = x;
                   parseCommandString(&TempEvent, action);
                   PluginCall(PLUGIN_WRITE, &TempEvent, action);
+                  publishTaskValues(x);
                   // trigger rulesprocessing
                   if (Settings.UseRules)
                     createRuleEvents(x);
@@ -143,57 +222,18 @@ boolean CPlugin_002(byte function, struct EventStruct *event, String& string)
             success = false;
             break;
           }
-          StaticJsonBuffer<200> jsonBuffer;
-
-          JsonObject& root = jsonBuffer.createObject();
-          root[F("idx")] = event->idx;
-          root[F("RSSI")] = mapRSSItoDomoticz();
-          #if FEATURE_ADC_VCC
-            root[F("Battery")] = mapVccToDomoticz();
-          #endif
-
-          switch (event->sensorType)
-          {
-            case SENSOR_TYPE_SWITCH:
-              root[F("command")] = String(F("switchlight"));
-              if (UserVar[event->BaseVarIndex] == 0)
-                root[F("switchcmd")] = String(F("Off"));
-              else
-                root[F("switchcmd")] = String(F("On"));
-              break;
-            case SENSOR_TYPE_DIMMER:
-              root[F("command")] = String(F("switchlight"));
-              if (UserVar[event->BaseVarIndex] == 0)
-                root[F("switchcmd")] = String(F("Off"));
-              else
-                root[F("Set%20Level")] = UserVar[event->BaseVarIndex];
-              break;
-
-            case SENSOR_TYPE_SINGLE:
-            case SENSOR_TYPE_LONG:
-            case SENSOR_TYPE_DUAL:
-            case SENSOR_TYPE_TRIPLE:
-            case SENSOR_TYPE_QUAD:
-            case SENSOR_TYPE_TEMP_HUM:
-            case SENSOR_TYPE_TEMP_BARO:
-            case SENSOR_TYPE_TEMP_EMPTY_BARO:
-            case SENSOR_TYPE_TEMP_HUM_BARO:
-            case SENSOR_TYPE_WIND:
-            default:
-              root[F("nvalue")] = 0;
-              root[F("svalue")] = formatDomoticzSensorType(event);
-              break;
+          C002_JsonStruct data(event);
+          if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+            String log = F("MQTT : ");
+            JsonWriter json(log);
+            C002_writeJson(json, &data);
+            addLog(LOG_LEVEL_DEBUG, log);
           }
 
-          String json;
-          root.printTo(json);
-          String log = F("MQTT : ");
-          log += json;
-          addLog(LOG_LEVEL_DEBUG, log);
-
-          String pubname = ControllerSettings.Publish;
-          parseControllerVariables(pubname, event, false);
-          if (!MQTTpublish(event->ControllerIndex, pubname.c_str(), json.c_str(), Settings.MQTTRetainFlag))
+          String pubname;
+          appendControllerTemplate(pubname, getControllerPublishTemplate(event->ControllerIndex, ControllerSettings, false),
+                                   event, CONTROLLER_TEMPLATE_NO_VALUE, NULL);
+          if (!MQTTpublishJson(event->ControllerIndex, pubname.c_str(), C002_writeJson, &data, Settings.MQTTRetainFlag))
           {
             connectionFailures++;
           }
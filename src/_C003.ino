@@ -39,6 +39,7 @@ boolean CPlugin_003(byte function, struct EventStruct *event, String& string)
         char log[80];
         addLog(LOG_LEVEL_DEBUG, String(F("TELNT : connecting to ")) + ControllerSettings.getHostPortString());
         // Use WiFiClient class to create TCP connections
+        SocketLease lease(SOCKET_CONTROLLER);
         WiFiClient client;
         if (!ControllerSettings.connectToHost(client))
         {
@@ -55,7 +56,10 @@ boolean CPlugin_003(byte function, struct EventStruct *event, String& string)
         String url = F("variableset ");
         url += event->idx;
         url += ",";
-        url += formatUserVarNoCheck(event, 0);
+        char value[FORMAT_VALUE_BUFFER_SIZE];
+        formatUserVarNoCheck(event, 0, value);
+        url += value;
+        appendControllerDiagTag(url, event->ControllerIndex);
         url += "\n";
 
         // strcpy_P(log, PSTR("TELNT: Sending enter"));
@@ -7,6 +7,17 @@
 #define CPLUGIN_ID_004         4
 #define CPLUGIN_NAME_004       "ThingSpeak"
 
+// Custom controller settings
+struct C004_ConfigStruct
+{
+  C004_ConfigStruct() : ChannelId(0) {}
+  rateLimitConfigStruct       RateLimit;
+  controllerBatchConfigStruct Batch;      // Sent to /channels/<id>/bulk_update.json
+  unsigned long               ChannelId;  // Needed for the bulk update
+};
+
+unsigned long C004_channel[CONTROLLER_MAX];
+
 boolean CPlugin_004(byte function, struct EventStruct *event, String& string)
 {
   boolean success = false;
@@ -21,6 +32,7 @@ boolean CPlugin_004(byte function, struct EventStruct *event, String& string)
         Protocol[protocolCount].usesPassword = true;
         Protocol[protocolCount].defaultPort = 80;
         Protocol[protocolCount].usesID = true;
+        Protocol[protocolCount].reportsSendResult = true;
         break;
       }
 
@@ -44,96 +56,208 @@ boolean CPlugin_004(byte function, struct EventStruct *event, String& string)
             success = false;
             break;
         }
+        break;
+      }
+
+    case CPLUGIN_INIT:
+      {
+        initControllerRateLimit(event->ControllerIndex, THINGSPEAK_MIN_INTERVAL);
+        C004_ConfigStruct config;
+        LoadCustomControllerSettings(event->ControllerIndex, (byte*)&config, sizeof(config));
+        if (config.ChannelId == 0)
+          config.Batch.MaxRecords = 0;
+        initControllerBatch(event->ControllerIndex, config.Batch);
+        C004_channel[event->ControllerIndex] = config.ChannelId;
+        break;
+      }
+
+    case CPLUGIN_WEBFORM_LOAD:
+      {
+        addControllerRateLimitForm(event->ControllerIndex, THINGSPEAK_MIN_INTERVAL);
+        C004_ConfigStruct config;
+        LoadCustomControllerSettings(event->ControllerIndex, (byte*)&config, sizeof(config));
+        addFormNumericBox(F("Channel ID"), F("c004channel"), config.ChannelId, 0, INT_MAX);
+        addFormNote(F("Needed for batches, sent as bulk update"));
+        addControllerBatchForm(config.Batch);
+        break;
+      }
+
+    case CPLUGIN_WEBFORM_SAVE:
+      {
+        saveControllerRateLimit(event->ControllerIndex);
+        C004_ConfigStruct config;
+        LoadCustomControllerSettings(event->ControllerIndex, (byte*)&config, sizeof(config));
+        config.ChannelId = getFormItemInt(F("c004channel"), 0);
+        readControllerBatchForm(config.Batch);
+        SaveCustomControllerSettings(event->ControllerIndex, (byte*)&config, sizeof(config));
+        break;
+      }
+
+    case CPLUGIN_TIMER_IN:
+      {
+        if (!controllerRequestAllowed(event->ControllerIndex))
+          break;
+        if (controllerBatchDue(event->ControllerIndex))
+          C004_sendBatch(event->ControllerIndex);
+        else
+          C004_send(event->ControllerIndex);
+        break;
       }
 
     case CPLUGIN_PROTOCOL_SEND:
       {
-        ControllerSettingsStruct ControllerSettings;
-        LoadControllerSettings(event->ControllerIndex, (byte*)&ControllerSettings, sizeof(ControllerSettings));
-
-        // boolean success = false;
-        addLog(LOG_LEVEL_DEBUG, String(F("HTTP : connecting to "))+ControllerSettings.getHostPortString());
-        char log[80];
-        // Use WiFiClient class to create TCP connections
-        WiFiClient client;
-        if (!ControllerSettings.connectToHost(client))
-        {
-          connectionFailures++;
-          if (loglevelActiveFor(LOG_LEVEL_ERROR)) {
-            strcpy_P(log, PSTR("HTTP : connection failed"));
-            addLog(LOG_LEVEL_ERROR, log);
-          }
-          return false;
-        }
-        statusLED(true);
-        if (connectionFailures)
-          connectionFailures--;
-
-        String postDataStr = F("api_key=");
-        postDataStr += SecuritySettings.ControllerPassword[event->ControllerIndex]; // used for API key
-
-        byte valueCount = getValueCountFromSensorType(event->sensorType);
-        for (byte x = 0; x < valueCount; x++)
-        {
-          postDataStr += F("&field");
-          postDataStr += event->idx + x;
-          postDataStr += "=";
-          postDataStr += formatUserVarNoCheck(event, x);
-        }
-        String hostName = F("api.thingspeak.com"); // PM_CZ: HTTP requests must contain host headers.
-        if (ControllerSettings.UseDNS)
-          hostName = ControllerSettings.HostName;
-
-        String postStr = F("POST /update HTTP/1.1\r\n");
-        postStr += F("Host: ");
-        postStr += hostName;
-        postStr += F("\r\n");
-        postStr += F("Connection: close\r\n");
-
-        postStr += F("Content-Type: application/x-www-form-urlencoded\r\n");
-        postStr += F("Content-Length: ");
-        postStr += postDataStr.length();
-        postStr += F("\r\n\r\n");
-        postStr += postDataStr;
-
-        // This will send the request to the server
-        client.print(postStr);
-
-        unsigned long timer = millis() + 200;
-        while (!client.available() && !timeOutReached(timer))
-          delay(1);
-
-        // Read all the lines of the reply from server and print them to Serial
-        while (client.available()) {
-          //   String line = client.readStringUntil('\n');
-          String line;
-          safeReadStringUntil(client, line, '\n');
-
-          if (loglevelActiveFor(LOG_LEVEL_DEBUG_MORE)) {
-            line.toCharArray(log, 80);
-            addLog(LOG_LEVEL_DEBUG_MORE, log);
-          }
-          if (line.substring(0, 15) == F("HTTP/1.1 200 OK"))
-          {
-            if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
-              strcpy_P(log, PSTR("HTTP : Success!"));
-              addLog(LOG_LEVEL_DEBUG, log);
-            }
-            success = true;
+        success = true;
+        if (controllerBatching(event->ControllerIndex)) {
+          // {"created_at":"2018-06-14T12:12:22Z","field1":value,...}
+          String record = F("{\"created_at\":\"");
+          record += getControllerSampleTimeISO();
+          record += '"';
+          const byte valueCount = getValueCountFromSensorType(event->sensorType);
+          for (byte x = 0; x < valueCount; x++) {
+            String field = F("field");
+            field += event->idx + x;
+            record += ',';
+            record += to_json_object_value(field, formatUserVarNoCheck(event, x));
           }
-          delay(1);
+          record += '}';
+          // The bulk update has the same minimum interval as an update
+          if (addControllerBatchRecord(event->ControllerIndex, record, ',') && controllerRequestAllowed(event->ControllerIndex))
+            success = C004_sendBatch(event->ControllerIndex);
+          break;
         }
-        if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
-          strcpy_P(log, PSTR("HTTP : closing connection"));
-          addLog(LOG_LEVEL_DEBUG, log);
-        }
-
-        client.flush();
-        client.stop();
+        // ThingSpeak refuses updates sent too often, merge the values until the next request may be sent.
+        if (mergeControllerValues(event))
+          success = C004_send(event->ControllerIndex);
         break;
       }
 
   }
   return success;
 }
+
+// Send the pending fields of the controller in a single update.
+bool C004_send(byte controllerIndex)
+{
+  const rateLimitStruct& limit = ControllerRateLimit[controllerIndex];
+  if (limit.fieldCount == 0) return true;
+
+  ControllerSettingsStruct ControllerSettings;
+  LoadControllerSettings(controllerIndex, (byte*)&ControllerSettings, sizeof(ControllerSettings));
+
+  addLog(LOG_LEVEL_DEBUG, String(getWebString(WEB_STR_HTTP_CONNECTING))+ControllerSettings.getHostPortString());
+  char log[80];
+  String postDataStr = F("api_key=");
+  postDataStr += SecuritySettings.ControllerPassword[controllerIndex]; // used for API key
+
+  for (byte i = 0; i < limit.fieldCount; i++)
+  {
+    postDataStr += F("&field");
+    postDataStr += limit.fields[i].field;
+    postDataStr += "=";
+    postDataStr += formatControllerField(limit.fields[i], limit.mergeMode);
+  }
+  String hostName = F("api.thingspeak.com"); // PM_CZ: HTTP requests must contain host headers.
+  if (ControllerSettings.UseDNS)
+    hostName = ControllerSettings.HostName;
+
+  String postStr = F("POST /update HTTP/1.1\r\n");
+  postStr += F("Host: ");
+  postStr += hostName;
+  postStr += F("\r\n");
+  postStr += getWebString(WEB_STR_KEEP_ALIVE);
+
+  postStr += F("Content-Type: application/x-www-form-urlencoded\r\n");
+  postStr += getWebString(WEB_STR_CONTENT_LENGTH);
+  postStr += postDataStr.length();
+  postStr += F("\r\n\r\n");
+  postStr += postDataStr;
+
+  // Use the kept-alive connection of this controller, or create a new one
+  String line;
+  if (!sendControllerHttpRequest(controllerIndex, ControllerSettings, postStr, line))
+  {
+    connectionFailures++;
+    if (loglevelActiveFor(LOG_LEVEL_ERROR)) {
+      strcpy_P(log, getWebStringP(WEB_STR_HTTP_CONN_FAILED));
+      addLog(LOG_LEVEL_ERROR, log);
+    }
+    markControllerRequest(controllerIndex, false);
+    return false;
+  }
+  statusLED(true);
+  if (connectionFailures)
+    connectionFailures--;
+
+  markControllerRequest(controllerIndex, true);
+  if (line.substring(0, 15) == getWebString(WEB_STR_HTTP_200_OK))
+  {
+    if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+      strcpy_P(log, PSTR("HTTP : Success!"));
+      addLog(LOG_LEVEL_DEBUG, log);
+    }
+    return true;
+  }
+  logControllerRefused(controllerIndex, line);
+  return false;
+}
+
+// Send the batch of the controller as a single bulk update, every record has its own time.
+bool C004_sendBatch(byte controllerIndex)
+{
+  const controllerBatchStruct& batch = ControllerBatch[controllerIndex];
+  if (batch.count == 0) return true;
+
+  ControllerSettingsStruct ControllerSettings;
+  LoadControllerSettings(controllerIndex, (byte*)&ControllerSettings, sizeof(ControllerSettings));
+
+  String body = F("{\"write_api_key\":\"");
+  body += SecuritySettings.ControllerPassword[controllerIndex];
+  body += F("\",\"updates\":[");
+  body += batch.body;
+  body += F("]}");
+
+  String hostName = F("api.thingspeak.com");
+  if (ControllerSettings.UseDNS)
+    hostName = ControllerSettings.HostName;
+
+  String request = F("POST /channels/");
+  request += C004_channel[controllerIndex];
+  request += F("/bulk_update.json HTTP/1.1\r\n");
+  request += F("Host: ");
+  request += hostName;
+  request += F("\r\n");
+  request += getWebString(WEB_STR_KEEP_ALIVE);
+  request += F("Content-Type: application/json\r\n");
+  request += getWebString(WEB_STR_CONTENT_LENGTH);
+  request += body.length();
+  request += F("\r\n\r\n");
+  request += body;
+
+  String line;
+  if (!sendControllerHttpRequest(controllerIndex, ControllerSettings, request, line))
+  {
+    connectionFailures++;
+    addLog(LOG_LEVEL_ERROR, getWebString(WEB_STR_HTTP_CONN_FAILED));
+    markControllerRequest(controllerIndex, false);
+    markControllerBatchSent(controllerIndex, false);
+    return false;
+  }
+  statusLED(true);
+  if (connectionFailures)
+    connectionFailures--;
+
+  markControllerRequest(controllerIndex, true);
+  const bool success = line.startsWith(F("HTTP/1.1 2"));
+  if (!success)
+    logControllerRefused(controllerIndex, line);
+  if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+    String log = F("HTTP : Bulk update of ");
+    log += batch.count;
+    log += success ? F(" records sent") : F(" records refused");
+    addLog(LOG_LEVEL_DEBUG, log);
+  }
+  // A refused batch would be refused again, it is not kept.
+  markControllerBatchSent(controllerIndex, true);
+  return success;
+}
 #endif
@@ -31,6 +31,25 @@ boolean CPlugin_005(byte function, struct EventStruct *event, String& string)
         break;
       }
 
+    case CPLUGIN_INIT:
+      {
+        initMQTTPayloadConfig(event->ControllerIndex);
+        initControllerPublishTemplate(event->ControllerIndex, false);
+        break;
+      }
+
+    case CPLUGIN_WEBFORM_LOAD:
+      {
+        addMQTTPayloadConfigForm(event->ControllerIndex);
+        break;
+      }
+
+    case CPLUGIN_WEBFORM_SAVE:
+      {
+        saveMQTTPayloadConfig(event->ControllerIndex);
+        break;
+      }
+
     case CPLUGIN_PROTOCOL_TEMPLATE:
       {
         event->String1 = F("/%sysname%/#");
@@ -74,6 +93,7 @@ boolean CPlugin_005(byte function, struct EventStruct *event, String& string)
             String command = parseString(cmd, 1);
             if (command == F("event")) {
             eventBuffer = cmd.substring(6);
+            notifyEventBuffer();
             } else if (!PluginCall(PLUGIN_WRITE, &TempEvent, cmd)) {
               remoteConfig(&TempEvent, cmd);
             }
@@ -95,25 +115,7 @@ boolean CPlugin_005(byte function, struct EventStruct *event, String& string)
         if (ExtraTaskSettings.TaskDeviceValueNames[0][0] == 0)
           PluginCall(PLUGIN_GET_DEVICEVALUENAMES, event, dummyString);
 
-        String pubname = ControllerSettings.Publish;
-        parseControllerVariables(pubname, event, false);
-
-        String value = "";
-        // byte DeviceIndex = getDeviceIndex(Settings.TaskDeviceNumber[event->TaskIndex]);
-        byte valueCount = getValueCountFromSensorType(event->sensorType);
-        for (byte x = 0; x < valueCount; x++)
-        {
-          String tmppubname = pubname;
-          tmppubname.replace(F("%valname%"), ExtraTaskSettings.TaskDeviceValueNames[x]);
-          value = formatUserVarNoCheck(event, x);
-
-          MQTTpublish(event->ControllerIndex, tmppubname.c_str(), value.c_str(), Settings.MQTTRetainFlag);
-          String log = F("MQTT : ");
-          log += tmppubname;
-          log += " ";
-          log += value;
-          addLog(LOG_LEVEL_DEBUG, log);
-        }
+        MQTTpublishTaskValues(event, ControllerSettings);
         break;
       }
   }
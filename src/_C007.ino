@@ -7,6 +7,13 @@
 #define CPLUGIN_ID_007         7
 #define CPLUGIN_NAME_007       "Emoncms"
 
+// Custom controller settings
+struct C007_ConfigStruct
+{
+  rateLimitConfigStruct       RateLimit;
+  controllerBatchConfigStruct Batch;   // Sent to /input/bulk.json
+};
+
 boolean CPlugin_007(byte function, struct EventStruct *event, String& string)
 {
   boolean success = false;
@@ -30,99 +37,197 @@ boolean CPlugin_007(byte function, struct EventStruct *event, String& string)
         break;
       }
 
+    case CPLUGIN_INIT:
+      {
+        initControllerRateLimit(event->ControllerIndex, 0);
+        C007_ConfigStruct config;
+        LoadCustomControllerSettings(event->ControllerIndex, (byte*)&config, sizeof(config));
+        initControllerBatch(event->ControllerIndex, config.Batch);
+        break;
+      }
+
+    case CPLUGIN_WEBFORM_LOAD:
+      {
+        addControllerRateLimitForm(event->ControllerIndex, 0);
+        C007_ConfigStruct config;
+        LoadCustomControllerSettings(event->ControllerIndex, (byte*)&config, sizeof(config));
+        addControllerBatchForm(config.Batch);
+        break;
+      }
+
+    case CPLUGIN_WEBFORM_SAVE:
+      {
+        saveControllerRateLimit(event->ControllerIndex);
+        C007_ConfigStruct config;
+        LoadCustomControllerSettings(event->ControllerIndex, (byte*)&config, sizeof(config));
+        readControllerBatchForm(config.Batch);
+        SaveCustomControllerSettings(event->ControllerIndex, (byte*)&config, sizeof(config));
+        break;
+      }
+
+    case CPLUGIN_TIMER_IN:
+      {
+        if (controllerBatchDue(event->ControllerIndex))
+          C007_sendBatch(event->ControllerIndex);
+        else if (controllerRequestAllowed(event->ControllerIndex))
+          C007_send(event->ControllerIndex);
+        break;
+      }
+
     case CPLUGIN_PROTOCOL_SEND:
       {
-        if (!WiFiConnected(100)) {
-          success = false;
-          break;
-        }
         const byte valueCount = getValueCountFromSensorType(event->sensorType);
         if (valueCount == 0 || valueCount > 3) {
           addLog(LOG_LEVEL_ERROR, F("emoncms : Unknown sensortype or too many sensor values"));
           break;
         }
-
-        ControllerSettingsStruct ControllerSettings;
-        LoadControllerSettings(event->ControllerIndex, (byte*)&ControllerSettings, sizeof(ControllerSettings));
-
-        // boolean success = false;
-        addLog(LOG_LEVEL_DEBUG, String(F("HTTP : connecting to "))+ControllerSettings.getHostPortString());
-        char log[80];
-        // Use WiFiClient class to create TCP connections
-        WiFiClient client;
-        if (!ControllerSettings.connectToHost(client))
-        {
-          connectionFailures++;
-          strcpy_P(log, PSTR("HTTP : connection failed"));
-          addLog(LOG_LEVEL_ERROR, log);
-          return false;
+        success = true;
+        if (controllerBatching(event->ControllerIndex)) {
+          // [time,node,{"field1":value,...}]
+          String record = F("[");
+          record += getControllerSampleTime();
+          record += ',';
+          record += Settings.Unit;
+          record += F(",{");
+          for (byte x = 0; x < valueCount; x++) {
+            if (x != 0) record += ',';
+            String field = F("field");
+            field += event->idx + x;
+            record += to_json_object_value(field, formatUserVarNoCheck(event, x));
+          }
+          record += F("}]");
+          if (addControllerBatchRecord(event->ControllerIndex, record, ','))
+            success = C007_sendBatch(event->ControllerIndex);
+          break;
         }
-        statusLED(true);
-        if (connectionFailures)
-          connectionFailures--;
+        if (mergeControllerValues(event))
+          success = C007_send(event->ControllerIndex);
+        break;
+      }
+
+  }
+  return success;
+}
 
-        String postDataStr = F("GET /emoncms/input/post.json?node=");
+// Send the pending fields of the controller in a single post.
+bool C007_send(byte controllerIndex)
+{
+  const rateLimitStruct& limit = ControllerRateLimit[controllerIndex];
+  if (limit.fieldCount == 0) return true;
+  if (!WiFiConnected(100)) {
+    markControllerRequest(controllerIndex, false);
+    return false;
+  }
 
-        postDataStr += Settings.Unit;
-        postDataStr += F("&json=");
+  ControllerSettingsStruct ControllerSettings;
+  LoadControllerSettings(controllerIndex, (byte*)&ControllerSettings, sizeof(ControllerSettings));
 
-        for (byte i = 0; i < valueCount; ++i) {
-          postDataStr += (i == 0) ? F("{") : F(",");
-          postDataStr += F("field");
-          postDataStr += event->idx + i;
-          postDataStr += ":";
-          postDataStr += formatUserVarNoCheck(event, i);
-        }
-        postDataStr += "}";
-        postDataStr += F("&apikey=");
-        postDataStr += SecuritySettings.ControllerPassword[event->ControllerIndex]; // "0UDNN17RW6XAS2E5" // api key
-
-        String postStr = F(" HTTP/1.1\r\n");
-        postStr += F("Host: ");
-        postStr += ControllerSettings.getHost();
-        postStr += F("\r\n");
-        postStr += F("Connection: close\r\n");
-        postStr += F("\r\n");
-
-        postDataStr += postStr;
-
-        if (Settings.SerialLogLevel >= LOG_LEVEL_DEBUG_MORE)
-          Serial.println(postDataStr);
-
-        // This will send the request to the server
-        client.print(postDataStr);
-
-        unsigned long timer = millis() + 200;
-        while (!client.available() && !timeOutReached(timer))
-          delay(1);
-
-        // Read all the lines of the reply from server and print them to Serial
-        while (client.available()) {
-          //   String line = client.readStringUntil('\n');
-          String line;
-          safeReadStringUntil(client, line, '\n');
-
-          if (loglevelActiveFor(LOG_LEVEL_DEBUG_MORE)) {
-            line.toCharArray(log, 80);
-            addLog(LOG_LEVEL_DEBUG_MORE, log);
-          }
-          if (line.substring(0, 15) == F("HTTP/1.1 200 OK"))
-          {
-            strcpy_P(log, PSTR("HTTP : Success!"));
-            addLog(LOG_LEVEL_DEBUG, log);
-            success = true;
-          }
-          delay(1);
-        }
-        strcpy_P(log, PSTR("HTTP : closing connection"));
-        addLog(LOG_LEVEL_DEBUG, log);
+  addLog(LOG_LEVEL_DEBUG, String(getWebString(WEB_STR_HTTP_CONNECTING))+ControllerSettings.getHostPortString());
+  char log[80];
+  String postDataStr = F("GET /emoncms/input/post.json?node=");
 
-        client.flush();
-        client.stop();
-        break;
-      }
+  postDataStr += Settings.Unit;
+  postDataStr += F("&json=");
+
+  for (byte i = 0; i < limit.fieldCount; ++i) {
+    postDataStr += (i == 0) ? F("{") : F(",");
+    postDataStr += F("field");
+    postDataStr += limit.fields[i].field;
+    postDataStr += ":";
+    postDataStr += formatControllerField(limit.fields[i], limit.mergeMode);
+  }
+  postDataStr += "}";
+  postDataStr += F("&apikey=");
+  postDataStr += SecuritySettings.ControllerPassword[controllerIndex]; // "0UDNN17RW6XAS2E5" // api key
+
+  String postStr = F(" HTTP/1.1\r\n");
+  postStr += F("Host: ");
+  postStr += ControllerSettings.getHost();
+  postStr += F("\r\n");
+  postStr += getWebString(WEB_STR_KEEP_ALIVE);
+  postStr += F("\r\n");
+
+  postDataStr += postStr;
 
+  if (Settings.SerialLogLevel >= LOG_LEVEL_DEBUG_MORE)
+    Serial.println(postDataStr);
+
+  // Use the kept-alive connection of this controller, or create a new one
+  String line;
+  if (!sendControllerHttpRequest(controllerIndex, ControllerSettings, postDataStr, line))
+  {
+    connectionFailures++;
+    strcpy_P(log, getWebStringP(WEB_STR_HTTP_CONN_FAILED));
+    addLog(LOG_LEVEL_ERROR, log);
+    markControllerRequest(controllerIndex, false);
+    return false;
+  }
+  statusLED(true);
+  if (connectionFailures)
+    connectionFailures--;
+
+  markControllerRequest(controllerIndex, true);
+  if (line.substring(0, 15) == getWebString(WEB_STR_HTTP_200_OK))
+  {
+    strcpy_P(log, PSTR("HTTP : Success!"));
+    addLog(LOG_LEVEL_DEBUG, log);
+    return true;
+  }
+  logControllerRefused(controllerIndex, line);
+  return false;
+}
+
+// Send the batch of the controller as a single bulk post, every record has its own time.
+bool C007_sendBatch(byte controllerIndex)
+{
+  const controllerBatchStruct& batch = ControllerBatch[controllerIndex];
+  if (batch.count == 0) return true;
+  if (!WiFiConnected(100)) {
+    markControllerBatchSent(controllerIndex, false);
+    return false;
+  }
+
+  ControllerSettingsStruct ControllerSettings;
+  LoadControllerSettings(controllerIndex, (byte*)&ControllerSettings, sizeof(ControllerSettings));
+
+  String request = F("POST /emoncms/input/bulk.json?apikey=");
+  request += SecuritySettings.ControllerPassword[controllerIndex];
+  request += F(" HTTP/1.1\r\n");
+  request += F("Host: ");
+  request += ControllerSettings.getHost();
+  request += F("\r\n");
+  request += getWebString(WEB_STR_KEEP_ALIVE);
+  request += F("Content-Type: application/x-www-form-urlencoded\r\n");
+  request += getWebString(WEB_STR_CONTENT_LENGTH);
+  request += batch.body.length() + 7;  // data=[...]
+  request += F("\r\n\r\n");
+  request += F("data=[");
+  request += batch.body;
+  request += ']';
+
+  String line;
+  if (!sendControllerHttpRequest(controllerIndex, ControllerSettings, request, line))
+  {
+    connectionFailures++;
+    addLog(LOG_LEVEL_ERROR, getWebString(WEB_STR_HTTP_CONN_FAILED));
+    markControllerBatchSent(controllerIndex, false);
+    return false;
+  }
+  statusLED(true);
+  if (connectionFailures)
+    connectionFailures--;
+
+  const bool success = line.substring(0, 15) == getWebString(WEB_STR_HTTP_200_OK);
+  if (!success)
+    logControllerRefused(controllerIndex, line);
+  if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+    String log = F("HTTP : Bulk of ");
+    log += batch.count;
+    log += success ? F(" records sent") : F(" records refused");
+    addLog(LOG_LEVEL_DEBUG, log);
   }
+  // A refused batch would be refused again, it is not kept.
+  markControllerBatchSent(controllerIndex, true);
   return success;
 }
 #endif
@@ -39,6 +39,12 @@ boolean CPlugin_008(byte function, struct EventStruct *event, String& string)
         break;
       }
 
+    case CPLUGIN_INIT:
+      {
+        initControllerPublishTemplate(event->ControllerIndex, true);
+        break;
+      }
+
     case CPLUGIN_PROTOCOL_SEND:
       {
         byte valueCount = getValueCountFromSensorType(event->sensorType);
@@ -87,65 +93,37 @@ boolean HTTPSend(struct EventStruct *event, byte varIndex, const String& formatt
   }
 
   // boolean success = false;
-  addLog(LOG_LEVEL_DEBUG, String(F("HTTP : connecting to "))+ControllerSettings.getHostPortString());
-
-  // Use WiFiClient class to create TCP connections
-  WiFiClient client;
-  if (!ControllerSettings.connectToHost(client))
-  {
-    connectionFailures++;
-    addLog(LOG_LEVEL_ERROR, F("HTTP : connection failed"));
-    return false;
-  }
-  statusLED(true);
-  if (connectionFailures)
-    connectionFailures--;
+  addLog(LOG_LEVEL_DEBUG, String(getWebString(WEB_STR_HTTP_CONNECTING))+ControllerSettings.getHostPortString());
 
   if (ExtraTaskSettings.TaskDeviceValueNames[0][0] == 0)
     PluginCall(PLUGIN_GET_DEVICEVALUENAMES, event, dummyString);
 
   String url = "/";
-  url += ControllerSettings.Publish;
-  parseControllerVariables(url, event, true);
-
-  url.replace(F("%valname%"), URLEncode(ExtraTaskSettings.TaskDeviceValueNames[varIndex]));
-  url.replace(F("%value%"), formattedValue);
+  appendControllerTemplate(url, getControllerPublishTemplate(event->ControllerIndex, ControllerSettings, true),
+                           event, varIndex, formattedValue.c_str());
 
   // url.toCharArray(log, 80);
   addLog(LOG_LEVEL_DEBUG_MORE, url);
 
-  // This will send the request to the server
-  client.print(String(F("GET ")) + url + F(" HTTP/1.1\r\n") +
-               F("Host: ") + ControllerSettings.getHost() + F("\r\n") + authHeader +
-               F("Connection: close\r\n\r\n"));
-
-  unsigned long timer = millis() + 200;
-  while (!client.available() && !timeOutReached(timer))
-    yield();
-
-  // Read all the lines of the reply from server and print them to Serial
-  while (client.available()) {
-    // String line = client.readStringUntil('\n');
-    String line;
-    safeReadStringUntil(client, line, '\n');
-
-    // line.toCharArray(log, 80);
-    addLog(LOG_LEVEL_DEBUG_MORE, line);
-    if (line.startsWith(F("HTTP/1.1 200 OK")))
-    {
-      // strcpy_P(log, PSTR("HTTP : Success!"));
-      // addLog(LOG_LEVEL_DEBUG, log);
-      addLog(LOG_LEVEL_DEBUG, F("HTTP : Success!"));
-      // success = true;
-    }
-    delay(1);
+  // Use the kept-alive connection of this controller, or create a new one
+  String request = String(F("GET ")) + url + F(" HTTP/1.1\r\n") +
+                   F("Host: ") + ControllerSettings.getHost() + F("\r\n") + authHeader +
+                   F("Connection: keep-alive\r\n\r\n");
+  String line;
+  if (!sendControllerHttpRequest(event->ControllerIndex, ControllerSettings, request, line))
+  {
+    connectionFailures++;
+    addLog(LOG_LEVEL_ERROR, getWebString(WEB_STR_HTTP_CONN_FAILED));
+    return false;
   }
-  // strcpy_P(log, PSTR("HTTP : closing connection"));
-  // addLog(LOG_LEVEL_DEBUG, log);
-  addLog(LOG_LEVEL_DEBUG, F("HTTP : closing connection"));
+  statusLED(true);
+  if (connectionFailures)
+    connectionFailures--;
 
-  client.flush();
-  client.stop();
+  if (line.startsWith(getWebString(WEB_STR_HTTP_200_OK)))
+  {
+    addLog(LOG_LEVEL_DEBUG, F("HTTP : Success!"));
+  }
 
   return(true);
 }
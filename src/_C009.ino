@@ -140,14 +140,19 @@ void FHEMHTTPsend(String & url, String & buffer, byte index)
     authHeader = String(F("Authorization: Basic ")) + encoder.encode(auth) + " \r\n";
   }
 
-  addLog(LOG_LEVEL_DEBUG, String(F("HTTP : connecting to "))+ControllerSettings.getHostPortString());
+  addLog(LOG_LEVEL_DEBUG, String(getWebString(WEB_STR_HTTP_CONNECTING))+ControllerSettings.getHostPortString());
 
-  // Use WiFiClient class to create TCP connections
-  WiFiClient client;
-  if (!ControllerSettings.connectToHost(client)) {
+  // Use the kept-alive connection of this controller, or create a new one
+  int len = buffer.length();
+  String request = String("POST ") + url + F(" HTTP/1.1\r\n") +
+                   getWebString(WEB_STR_CONTENT_LENGTH)+ len + F("\r\n") +
+                   F("Host: ") + ControllerSettings.getHost() + F("\r\n") + authHeader +
+                   F("Connection: keep-alive\r\n\r\n")
+                   + buffer;
+  String line;
+  if (!sendControllerHttpRequest(index, ControllerSettings, request, line)) {
     connectionFailures++;
-    // strcpy_P(log, PSTR("HTTP : connection failed"));
-    addLog(LOG_LEVEL_ERROR, F("HTTP : connection failed"));
+    addLog(LOG_LEVEL_ERROR, getWebString(WEB_STR_HTTP_CONN_FAILED));
     return;
   }
 
@@ -155,41 +160,11 @@ void FHEMHTTPsend(String & url, String & buffer, byte index)
   if (connectionFailures)
     connectionFailures--;
 
-  // This will send the request to the server
-  int len = buffer.length();
-  client.print(String("POST ") + url + F(" HTTP/1.1\r\n") +
-              F("Content-Length: ")+ len + F("\r\n") +
-              F("Host: ") + ControllerSettings.getHost() + F("\r\n") + authHeader +
-              F("Connection: close\r\n\r\n")
-              + buffer);
-
-  unsigned long timer = millis() + 200;
-  while (!client.available() && !timeOutReached(timer))
-    yield();
-
-  // Read all the lines of the reply from server and print them to Serial
-  while (client.available()) {
-    // String line = client.readStringUntil('\n');
-    String line;
-    safeReadStringUntil(client, line, '\n');
-
-    // String helper = line;
-    // line.toCharArray(log, 80);
-    addLog(LOG_LEVEL_DEBUG_MORE, line);
-
-    if (line.startsWith(F("HTTP/1.1 200 OK"))) {
-      // strcpy_P(log, PSTR("HTTP : Success"));
-      addLog(LOG_LEVEL_DEBUG_MORE, F("HTTP : Success"));
-      // success = true;
-    }
-    else if (line.startsWith(F("HTTP/1.1 4"))) {
-      addLog(LOG_LEVEL_ERROR, String(F("HTTP : Error: "))+line);
-    }
-    yield();
+  if (line.startsWith(getWebString(WEB_STR_HTTP_200_OK))) {
+    addLog(LOG_LEVEL_DEBUG_MORE, F("HTTP : Success"));
+  }
+  else if (line.startsWith(F("HTTP/1.1 4"))) {
+    addLog(LOG_LEVEL_ERROR, String(F("HTTP : Error: "))+line);
   }
-  // strcpy_P(log, PSTR("HTTP : closing connection"));
-  addLog(LOG_LEVEL_DEBUG, F("HTTP : closing connection"));
-  client.flush();
-  client.stop();
 }
 #endif
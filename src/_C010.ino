@@ -7,6 +7,24 @@
 #define CPLUGIN_ID_010         10
 #define CPLUGIN_NAME_010       "Generic UDP"
 
+#define C010_MAX_DATAGRAM      1472  // Ethernet MTU minus IP and UDP header
+
+struct C010_ConfigStruct
+{
+  C010_ConfigStruct() : Bundle(false) {}
+  boolean       Bundle;  // Combine the values sent in one scheduler run into a single datagram
+};
+
+struct C010_controllerStruct
+{
+  C010_controllerStruct() : initialized(false) {}
+
+  C010_ConfigStruct config;
+  String bundle;            // Messages waiting to be sent, separated by a newline
+  bool initialized;
+} C010_controllers[CONTROLLER_MAX];
+
+
 boolean CPlugin_010(byte function, struct EventStruct *event, String& string)
 {
   boolean success = false;
@@ -38,16 +56,62 @@ boolean CPlugin_010(byte function, struct EventStruct *event, String& string)
         break;
       }
 
+    case CPLUGIN_INIT:
+      {
+        ControllerSettingsStruct ControllerSettings;
+        LoadControllerSettings(event->ControllerIndex, (byte*)&ControllerSettings, sizeof(ControllerSettings));
+        C010_init(event->ControllerIndex, ControllerSettings);
+        break;
+      }
+
+    case CPLUGIN_WEBFORM_LOAD:
+      {
+        C010_ConfigStruct config;
+        LoadCustomControllerSettings(event->ControllerIndex, (byte*)&config, sizeof(config));
+        addFormCheckBox(F("Bundle Values"), F("c010bundle"), config.Bundle);
+        addFormNote(F("Values sent at the same time are combined in one datagram, one message per line"));
+        break;
+      }
+
+    case CPLUGIN_WEBFORM_SAVE:
+      {
+        C010_ConfigStruct config;
+        config.Bundle = isFormItemChecked(F("c010bundle"));
+        SaveCustomControllerSettings(event->ControllerIndex, (byte*)&config, sizeof(config));
+        break;
+      }
+
+    case CPLUGIN_TIMER_IN:
+      {
+        ControllerSettingsStruct ControllerSettings;
+        LoadControllerSettings(event->ControllerIndex, (byte*)&ControllerSettings, sizeof(ControllerSettings));
+        C010_flushBundle(event->ControllerIndex, ControllerSettings);
+        break;
+      }
+
     case CPLUGIN_PROTOCOL_SEND:
       {
+        ControllerSettingsStruct ControllerSettings;
+        LoadControllerSettings(event->ControllerIndex, (byte*)&ControllerSettings, sizeof(ControllerSettings));
+        C010_controllerStruct& state = C010_controllers[event->ControllerIndex];
+        if (!state.initialized)
+          C010_init(event->ControllerIndex, ControllerSettings);
+
+        if (ExtraTaskSettings.TaskDeviceValueNames[0][0] == 0)
+          PluginCall(PLUGIN_GET_DEVICEVALUENAMES, event, dummyString);
+
         byte valueCount = getValueCountFromSensorType(event->sensorType);
         for (byte x = 0; x < valueCount; x++)
         {
           bool isvalid;
           String formattedValue = formatUserVar(event, x, isvalid);
-          if (isvalid)
-            C010_Send(event, x, formattedValue);
-          if (valueCount > 1)
+          if (isvalid) {
+            if (state.config.Bundle)
+              C010_addToBundle(event, x, formattedValue, ControllerSettings);
+            else
+              C010_Send(event, x, formattedValue, ControllerSettings);
+          }
+          if (valueCount > 1 && !state.config.Bundle)
           {
             delayBackground(Settings.MessageDelay);
             // unsigned long timer = millis() + Settings.MessageDelay;
@@ -64,31 +128,91 @@ boolean CPlugin_010(byte function, struct EventStruct *event, String& string)
 
 
 //********************************************************************************
-// Generic UDP message
+// Compile the publish template, so it is not parsed for every value.
 //********************************************************************************
-void C010_Send(struct EventStruct *event, byte varIndex, const String& formattedValue)
+void C010_init(byte controllerIndex, ControllerSettingsStruct& ControllerSettings)
 {
-  ControllerSettingsStruct ControllerSettings;
-  LoadControllerSettings(event->ControllerIndex, (byte*)&ControllerSettings, sizeof(ControllerSettings));
-
-  // boolean success = false;
-  addLog(LOG_LEVEL_DEBUG, String(F("UDP  : sending to ")) + ControllerSettings.getHostPortString());
-  statusLED(true);
-
-  if (ExtraTaskSettings.TaskDeviceValueNames[0][0] == 0)
-    PluginCall(PLUGIN_GET_DEVICEVALUENAMES, event, dummyString);
+  C010_controllerStruct& state = C010_controllers[controllerIndex];
+  LoadCustomControllerSettings(controllerIndex, (byte*)&state.config, sizeof(state.config));
+  compileControllerTemplate(ControllerPublishTemplate[controllerIndex], ControllerSettings.Publish, false, false);
+  state.bundle = "";
+  if (state.config.Bundle)
+    state.bundle.reserve(C010_MAX_DATAGRAM);
+  state.initialized = true;
+}
 
-  String msg = "";
-  msg += ControllerSettings.Publish;
-  parseControllerVariables(msg, event, false);
-  msg.replace(F("%valname%"), ExtraTaskSettings.TaskDeviceValueNames[varIndex]);
-  msg.replace(F("%value%"), formattedValue);
+void C010_appendMessage(String& msg, struct EventStruct *event, byte varIndex, const String& formattedValue,
+                        ControllerSettingsStruct& ControllerSettings)
+{
+  appendControllerTemplate(msg, ControllerPublishTemplate[event->ControllerIndex], event, varIndex, formattedValue.c_str());
+  appendControllerDiagTag(msg, event->ControllerIndex);
+}
 
+void C010_sendDatagram(byte controllerIndex, const String& msg, ControllerSettingsStruct& ControllerSettings)
+{
   if (wifiStatus == ESPEASY_WIFI_SERVICES_INITIALIZED) {
     ControllerSettings.beginPacket(portUDP);
     portUDP.write((uint8_t*)msg.c_str(),msg.length());
     portUDP.endPacket();
+    ControllerStats[controllerIndex].bytesSent += msg.length();
+  }
+}
+
+//********************************************************************************
+// Bundle messages until the next scheduler run, or until the datagram is full
+//********************************************************************************
+void C010_addToBundle(struct EventStruct *event, byte varIndex, const String& formattedValue,
+                      ControllerSettingsStruct& ControllerSettings)
+{
+  const byte controllerIndex = event->ControllerIndex;
+  String& bundle = C010_controllers[controllerIndex].bundle;
+  const unsigned int start = bundle.length();
+  if (start == 0) {
+    // Send from the scheduler, after all values ready now have been added.
+    setControllerTimer(controllerIndex, 0);
+  } else {
+    bundle += '\n';
+  }
+  C010_appendMessage(bundle, event, varIndex, formattedValue, ControllerSettings);
+  if (bundle.length() > C010_MAX_DATAGRAM && start != 0) {
+    String message = bundle.substring(start + 1);
+    bundle.remove(start);
+    C010_flushBundle(controllerIndex, ControllerSettings);
+    bundle = message;
+    setControllerTimer(controllerIndex, 0);
+  }
+}
+
+void C010_flushBundle(byte controllerIndex, ControllerSettingsStruct& ControllerSettings)
+{
+  String& bundle = C010_controllers[controllerIndex].bundle;
+  if (bundle.length() == 0) return;
+  if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+    String log = F("UDP  : sending ");
+    log += bundle.length();
+    log += F(" bytes to ");
+    log += ControllerSettings.getHostPortString();
+    addLog(LOG_LEVEL_DEBUG, log);
   }
+  statusLED(true);
+  C010_sendDatagram(controllerIndex, bundle, ControllerSettings);
+  bundle = "";
+}
+
+
+//********************************************************************************
+// Generic UDP message
+//********************************************************************************
+void C010_Send(struct EventStruct *event, byte varIndex, const String& formattedValue,
+               ControllerSettingsStruct& ControllerSettings)
+{
+  // boolean success = false;
+  addLog(LOG_LEVEL_DEBUG, String(F("UDP  : sending to ")) + ControllerSettings.getHostPortString());
+  statusLED(true);
+
+  String msg = "";
+  C010_appendMessage(msg, event, varIndex, formattedValue, ControllerSettings);
+  C010_sendDatagram(event->ControllerIndex, msg, ControllerSettings);
 
   if (loglevelActiveFor(LOG_LEVEL_DEBUG_MORE)) {
     char log[80];
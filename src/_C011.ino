@@ -12,7 +12,7 @@
 #define C011_HTTP_METHOD_MAX_LEN          16
 #define C011_HTTP_URI_MAX_LEN             240
 #define C011_HTTP_HEADER_MAX_LEN          256
-#define C011_HTTP_BODY_MAX_LEN            512
+#define C011_HTTP_BODY_MAX_LEN            508   // The batch settings use the last 4 bytes of the 1k settings
 
 struct C011_ConfigStruct
 {
@@ -20,7 +20,18 @@ struct C011_ConfigStruct
   char          HttpUri[C011_HTTP_URI_MAX_LEN];
   char          HttpHeader[C011_HTTP_HEADER_MAX_LEN];
   char          HttpBody[C011_HTTP_BODY_MAX_LEN];
+  controllerBatchConfigStruct Batch;  // Bodies of the samples joined by a line feed, e.g. InfluxDB line protocol
 };
+static_assert(sizeof(C011_ConfigStruct) <= DAT_CUSTOM_CONTROLLER_SIZE, "C011 settings do not fit");
+
+// Compiled at CPLUGIN_INIT. The parts between %n% and %/n% are only sent for a task with n values, e.g.
+// %1%%vname1%,Standort=%tskname% Wert=%val1%%/1%%2%%LF%%vname2%,Standort=%tskname% Wert=%val2%%/2%
+struct C011_templatesStruct
+{
+  ControllerTemplateStruct uri;
+  ControllerTemplateStruct header;
+  ControllerTemplateStruct body;
+} C011_templates[CONTROLLER_MAX];
 
 boolean CPlugin_011(byte function, struct EventStruct *event, String& string)
 {
@@ -51,19 +62,19 @@ boolean CPlugin_011(byte function, struct EventStruct *event, String& string)
 
         C011_ConfigStruct customConfig;
 
-        LoadCustomControllerSettings(event->ControllerIndex,(byte*)&customConfig, sizeof(customConfig));
+        C011_loadConfig(event->ControllerIndex, customConfig);
         String methods[] = { F("GET"), F("POST"), F("PUT"), F("HEAD"), F("PATCH") };
         string += F("<TR><TD>HTTP Method :<TD><select name='P011httpmethod'>");
         for (byte i = 0; i < 5; i++)
         {
-          string += F("<option value='");
+          string += getWebString(WEB_STR_OPTION_VALUE);
           string += methods[i] + "'";
           string += methods[i].equals(customConfig.HttpMethod) ? F(" selected='selected'") : F("");
           string += F(">");
           string += methods[i];
-          string += F("</option>");
+          string += getWebString(WEB_STR_OPTION_END);
         }
-        string += F("</select>");
+        string += getWebString(WEB_STR_SELECT_END);
 
         string += F("<TR><TD>HTTP URI:<TD><input type='text' name='P011httpuri' size=80 maxlength='");
         string += C011_HTTP_URI_MAX_LEN-1;
@@ -78,7 +89,7 @@ boolean CPlugin_011(byte function, struct EventStruct *event, String& string)
         escapeBuffer=customConfig.HttpHeader;
         htmlEscape(escapeBuffer);
         string += escapeBuffer;
-        string += F("</textarea>");
+        string += getWebString(WEB_STR_TEXTAREA_END);
 
         string += F("<TR><TD>HTTP Body:<TD><textarea name='P011httpbody' rows='8' cols='50' maxlength='");
         string += C011_HTTP_BODY_MAX_LEN-1;
@@ -86,7 +97,10 @@ boolean CPlugin_011(byte function, struct EventStruct *event, String& string)
         escapeBuffer=customConfig.HttpBody;
         htmlEscape(escapeBuffer);
         string += escapeBuffer;
-        string += F("</textarea>");
+        string += getWebString(WEB_STR_TEXTAREA_END);
+
+        addControllerBatchForm(customConfig.Batch);
+        addFormNote(F("A batch is sent as the bodies of its samples, one per line. Use %unixtime% in the body for the time of the sample"));
         break;
       }
 
@@ -102,12 +116,45 @@ boolean CPlugin_011(byte function, struct EventStruct *event, String& string)
         strlcpy(customConfig.HttpUri, httpuri.c_str(), sizeof(customConfig.HttpUri));
         strlcpy(customConfig.HttpHeader, httpheader.c_str(), sizeof(customConfig.HttpHeader));
         strlcpy(customConfig.HttpBody, httpbody.c_str(), sizeof(customConfig.HttpBody));
+        readControllerBatchForm(customConfig.Batch);
         SaveCustomControllerSettings(event->ControllerIndex,(byte*)&customConfig, sizeof(customConfig));
         break;
       }
 
+    case CPLUGIN_INIT:
+      {
+        C011_ConfigStruct customConfig;
+        C011_loadConfig(event->ControllerIndex, customConfig);
+        initControllerBatch(event->ControllerIndex, customConfig.Batch);
+        C011_compileTemplates(event->ControllerIndex, customConfig);
+        break;
+      }
+
+    case CPLUGIN_TIMER_IN:
+      {
+        if (controllerBatchDue(event->ControllerIndex))
+          HTTPSend011Batch(event->ControllerIndex);
+        break;
+      }
+
     case CPLUGIN_PROTOCOL_SEND:
       {
+        if (controllerBatching(event->ControllerIndex))
+        {
+          C011_ConfigStruct customConfig;
+          C011_loadConfig(event->ControllerIndex, customConfig);
+          if (ExtraTaskSettings.TaskDeviceValueNames[0][0] == 0)
+            PluginCall(PLUGIN_GET_DEVICEVALUENAMES, event, dummyString);
+          if (!C011_templates[event->ControllerIndex].body.valid)
+            C011_compileTemplates(event->ControllerIndex, customConfig);
+          String record;
+          appendControllerTemplate(record, C011_templates[event->ControllerIndex].body, event, CONTROLLER_TEMPLATE_NO_VALUE, NULL);
+          record.trim();
+          success = true;
+          if (addControllerBatchRecord(event->ControllerIndex, record, '\n'))
+            success = HTTPSend011Batch(event->ControllerIndex);
+          break;
+        }
       	HTTPSend011(event);
       }
 
@@ -127,57 +174,24 @@ boolean HTTPSend011(struct EventStruct *event)
   ControllerSettingsStruct ControllerSettings;
   LoadControllerSettings(event->ControllerIndex, (byte*)&ControllerSettings, sizeof(ControllerSettings));
 
-  String authHeader = "";
-  if ((SecuritySettings.ControllerUser[event->ControllerIndex][0] != 0) && (SecuritySettings.ControllerPassword[event->ControllerIndex][0] != 0))
-  {
-    base64 encoder;
-    String auth = SecuritySettings.ControllerUser[event->ControllerIndex];
-    auth += ":";
-    auth += SecuritySettings.ControllerPassword[event->ControllerIndex];
-    authHeader = F("Authorization: Basic ");
-    authHeader += encoder.encode(auth);
-    authHeader += F(" \r\n");
-  }
-
   C011_ConfigStruct customConfig;
-  LoadCustomControllerSettings(event->ControllerIndex,(byte*)&customConfig, sizeof(customConfig));
+  C011_loadConfig(event->ControllerIndex, customConfig);
 
-  boolean success = false;
-  addLog(LOG_LEVEL_DEBUG, String(F("HTTP : connecting to "))+
+  addLog(LOG_LEVEL_DEBUG, String(getWebString(WEB_STR_HTTP_CONNECTING))+
       ControllerSettings.getHostPortString());
 
-  // Use WiFiClient class to create TCP connections
-  WiFiClient client;
-  if (!ControllerSettings.connectToHost(client))
-  {
-    connectionFailures++;
-    addLog(LOG_LEVEL_ERROR, F("HTTP : connection failed"));
-    return false;
-  }
-  statusLED(true);
-  if (connectionFailures)
-    connectionFailures--;
-
   if (ExtraTaskSettings.TaskDeviceValueNames[0][0] == 0)
     PluginCall(PLUGIN_GET_DEVICEVALUENAMES, event, dummyString);
 
-  String payload = String(customConfig.HttpMethod) + " /";
-  payload += customConfig.HttpUri;
-  payload += F(" HTTP/1.1\r\n");
-  payload += F("Host: ");
-  payload += ControllerSettings.getHostPortString();
-  payload += F("\r\n");
-  payload += authHeader;
-  payload += F("Connection: close\r\n");
-
-  if (strlen(customConfig.HttpHeader) > 0)
-    payload += customConfig.HttpHeader;
-  ReplaceTokenByValue(payload, event);
+  const C011_templatesStruct& templates = C011_templates[event->ControllerIndex];
+  if (!templates.body.valid)
+    C011_compileTemplates(event->ControllerIndex, customConfig);
+  String payload = C011_requestHead(event->ControllerIndex, ControllerSettings, customConfig, event);
 
   if (strlen(customConfig.HttpBody) > 0)
   {
-    String body = String(customConfig.HttpBody);
-    ReplaceTokenByValue(body, event);
+    String body;
+    appendControllerTemplate(body, templates.body, event, CONTROLLER_TEMPLATE_NO_VALUE, NULL);
     payload += F("\r\nContent-Length: ");
     payload += String(body.length());
     payload += F("\r\n\r\n");
@@ -185,102 +199,118 @@ boolean HTTPSend011(struct EventStruct *event)
   }
   payload += F("\r\n");
 
-  // This will send the request to the server
-  client.print(payload);
-  addLog(LOG_LEVEL_DEBUG_MORE, payload);
+  return C011_sendRequest(event->ControllerIndex, ControllerSettings, payload);
+}
 
-  unsigned long timer = millis() + 200;
-  while (!client.available() && !timeOutReached(timer))
-    yield();
-
-  // Read all the lines of the reply from server and print them to Serial
-  while (client.available()) {
-    // String line = client.readStringUntil('\n');
-    String line;
-    safeReadStringUntil(client, line, '\n');
-
-
-    // line.toCharArray(log, 80);
-    addLog(LOG_LEVEL_DEBUG_MORE, line);
-    if (line.startsWith(F("HTTP/1.1 2")))
-    {
-      addLog(LOG_LEVEL_DEBUG, F("HTTP : Success!"));
-      success = true;
-    }
-    yield();
+// Send the batch in a single request, the bodies of the samples one per line.
+// Only the system variables are replaced in the URI and the header.
+boolean HTTPSend011Batch(byte controllerIndex)
+{
+  const controllerBatchStruct& batch = ControllerBatch[controllerIndex];
+  if (batch.count == 0) return true;
+  if (!WiFiConnected(100)) {
+    markControllerBatchSent(controllerIndex, false);
+    return false;
   }
-  addLog(LOG_LEVEL_DEBUG, F("HTTP : closing connection"));
+  ControllerSettingsStruct ControllerSettings;
+  LoadControllerSettings(controllerIndex, (byte*)&ControllerSettings, sizeof(ControllerSettings));
 
-  client.flush();
-  client.stop();
+  C011_ConfigStruct customConfig;
+  C011_loadConfig(controllerIndex, customConfig);
+
+  String payload = C011_requestHead(controllerIndex, ControllerSettings, customConfig, NULL);
+  parseSystemVariables(payload, false);
+  payload += F("\r\nContent-Length: ");
+  payload += batch.body.length();
+  payload += F("\r\n\r\n");
+  payload += batch.body;
+  payload += F("\r\n");
 
-  return(success);
+  const boolean success = C011_sendRequest(controllerIndex, ControllerSettings, payload);
+  if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+    String log = F("HTTP : Batch of ");
+    log += batch.count;
+    log += success ? F(" samples sent") : F(" samples not sent");
+    addLog(LOG_LEVEL_DEBUG, log);
+  }
+  // Only kept when the server could not be reached, a refused batch would be refused again.
+  markControllerBatchSent(controllerIndex, success || WiFiConnected(100));
+  return success;
 }
 
-// parses the string and returns only the the number of name/values we want
-// according to the parameter numberOfValuesWanted
-void DeleteNotNeededValues(String &s, byte numberOfValuesWanted)
+void C011_loadConfig(byte controllerIndex, struct C011_ConfigStruct& customConfig)
 {
-	numberOfValuesWanted++;
-	for (byte i=1; i < 5; i++)
-	{
-    String startToken=String(F("%")) + i + F("%");
-    String endToken=String(F("%/")) + i + F("%");
-
-    //do we want to keep this one?
-    if (i<numberOfValuesWanted)
-    {
-      //yes, so just remove the tokens
-      s.replace(startToken, "");
-      s.replace(endToken, "");
-    }
-    else
-    {
-      //remove all the whole strings including tokes
-      int startIndex=s.indexOf(startToken);
-      int endIndex=s.indexOf(endToken);
-      while(startIndex != -1 && endIndex != -1  && endIndex>startIndex)
-  		{
-        String p = s.substring(startIndex,endIndex+4);
-        //remove the whole string including tokens
-				s.replace(p, F(""));
-
-        //find next ones
-        startIndex=s.indexOf(startToken);
-        endIndex=s.indexOf(endToken);
-  		}
-    }
-	}
+  LoadCustomControllerSettings(controllerIndex, (byte*)&customConfig, sizeof(customConfig));
+  if (strnlen(customConfig.HttpBody, C011_HTTP_BODY_MAX_LEN) == C011_HTTP_BODY_MAX_LEN)
+  {
+    // Longer body of older settings, its end overlaps the batch settings
+    customConfig.HttpBody[C011_HTTP_BODY_MAX_LEN - 1] = 0;
+    customConfig.Batch = controllerBatchConfigStruct();
+  }
 }
 
+void C011_compileTemplates(byte controllerIndex, const struct C011_ConfigStruct& customConfig)
+{
+  C011_templatesStruct& templates = C011_templates[controllerIndex];
+  compileControllerTemplate(templates.uri, customConfig.HttpUri, true, true);
+  compileControllerTemplate(templates.header, customConfig.HttpHeader, true, true);
+  compileControllerTemplate(templates.body, customConfig.HttpBody, true, true);
+}
 
-//********************************************************************************
-// Replace the token in a string by real value.
-//
-// Example:
-// %1%%vname1%____%tskname%____%val1%%/1%%2%%__%%vname2%____%tskname%____%val2%%/2%
-// will become in case of a sensor with 1 value:
-// SENSORVALUENAME1____TASKNAME1____VALUE1  <- everything not between %1% and %/1% will be discarded
-// in case of a sensor with 2 values:
-// SENSORVALUENAME1____TASKNAME1____VALUE1__SENSORVALUENAME2____TASKNAME2____VALUE2
-//********************************************************************************
-void ReplaceTokenByValue(String& s, struct EventStruct *event)
+// Request line and headers. Without an event the variables of the URI and the header are not replaced.
+String C011_requestHead(byte controllerIndex, const ControllerSettingsStruct& ControllerSettings, const C011_ConfigStruct& customConfig,
+                        struct EventStruct *event)
 {
-// example string:
-// write?db=testdb&type=%1%%vname1%%/1%%2%;%vname2%%/2%%3%;%vname3%%/3%%4%;%vname4%%/4%&value=%1%%val1%%/1%%2%;%val2%%/2%%3%;%val3%%/3%%4%;%val4%%/4%
-//	%1%%vname1%,Standort=%tskname% Wert=%val1%%/1%%2%%LF%%vname2%,Standort=%tskname% Wert=%val2%%/2%%3%%LF%%vname3%,Standort=%tskname% Wert=%val3%%/3%%4%%LF%%vname4%,Standort=%tskname% Wert=%val4%%/4%
-	addLog(LOG_LEVEL_DEBUG_MORE, F("HTTP before parsing: "));
-	addLog(LOG_LEVEL_DEBUG_MORE, s);
-  const byte valueCount = getValueCountFromSensorType(event->sensorType);
-  DeleteNotNeededValues(s,valueCount);
+  const C011_templatesStruct& templates = C011_templates[controllerIndex];
+  String payload = String(customConfig.HttpMethod) + " /";
+  if (event != NULL)
+    appendControllerTemplate(payload, templates.uri, event, CONTROLLER_TEMPLATE_NO_VALUE, NULL);
+  else
+    payload += customConfig.HttpUri;
+  payload += F(" HTTP/1.1\r\n");
+  payload += F("Host: ");
+  payload += ControllerSettings.getHostPortString();
+  payload += F("\r\n");
+  if ((SecuritySettings.ControllerUser[controllerIndex][0] != 0) && (SecuritySettings.ControllerPassword[controllerIndex][0] != 0))
+  {
+    base64 encoder;
+    String auth = SecuritySettings.ControllerUser[controllerIndex];
+    auth += ":";
+    auth += SecuritySettings.ControllerPassword[controllerIndex];
+    payload += F("Authorization: Basic ");
+    payload += encoder.encode(auth);
+    payload += F(" \r\n");
+  }
+  payload += getWebString(WEB_STR_KEEP_ALIVE);
 
-	addLog(LOG_LEVEL_DEBUG_MORE, F("HTTP after parsing: "));
-	addLog(LOG_LEVEL_DEBUG_MORE, s);
+  if (event != NULL)
+    appendControllerTemplate(payload, templates.header, event, CONTROLLER_TEMPLATE_NO_VALUE, NULL);
+  else
+    payload += customConfig.HttpHeader;
+  return payload;
+}
 
-  parseControllerVariables(s, event, true);
+boolean C011_sendRequest(byte controllerIndex, ControllerSettingsStruct& ControllerSettings, const String& payload)
+{
+  // Use the kept-alive connection of this controller, or create a new one
+  addLog(LOG_LEVEL_DEBUG_MORE, payload);
+  String line;
+  if (!sendControllerHttpRequest(controllerIndex, ControllerSettings, payload, line))
+  {
+    connectionFailures++;
+    addLog(LOG_LEVEL_ERROR, getWebString(WEB_STR_HTTP_CONN_FAILED));
+    return false;
+  }
+  statusLED(true);
+  if (connectionFailures)
+    connectionFailures--;
 
-	addLog(LOG_LEVEL_DEBUG_MORE, F("HTTP after replacements: "));
-	addLog(LOG_LEVEL_DEBUG_MORE, s);
+  if (line.startsWith(F("HTTP/1.1 2")))
+  {
+    addLog(LOG_LEVEL_DEBUG, F("HTTP : Success!"));
+    return true;
+  }
+  return false;
 }
 
 #endif
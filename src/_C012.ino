@@ -23,6 +23,7 @@ boolean CPlugin_012(byte function, struct EventStruct *event, String& string)
         Protocol[protocolCount].usesPassword = true;
         Protocol[protocolCount].defaultPort = 80;
         Protocol[protocolCount].usesID = true;
+        Protocol[protocolCount].reportsSendResult = true;
         break;
       }
 
@@ -48,31 +49,52 @@ boolean CPlugin_012(byte function, struct EventStruct *event, String& string)
   return success;
 }
 
+// All values of the task go over the kept-alive connection of the controller, one request per pin.
 boolean CPlugin_012_send(struct EventStruct *event, int nrValues) {
-  String postDataStr = F("");
+  String postDataStr;
   boolean success = true;
+  char value[FORMAT_VALUE_BUFFER_SIZE];
   for (int i = 0; i < nrValues && success; ++i) {
     postDataStr = F("update/V") ;
     postDataStr += event->idx + i;
     postDataStr += F("?value=");
-    postDataStr += formatUserVarNoCheck(event, i);
+    formatUserVarNoCheck(event, i, value);
+    postDataStr += value;
     success = Blynk_get(postDataStr, event->ControllerIndex);
   }
   return success;
 }
 
-
+// A get or update of the Blynk HTTP API, over the persistent connection of the controller
+// (see sendControllerHttpRequest()), so a send of several pins or the blynkget commands of
+// the rules connect once. The request and latency stats are those of the controller.
 boolean Blynk_get(const String& command, byte controllerIndex, float *data )
 {
   if (wifiStatus != ESPEASY_WIFI_SERVICES_INITIALIZED) {
     return false;
   }
+  if (SecuritySettings.ControllerPassword[controllerIndex][0] == 0) {
+    addLog(LOG_LEVEL_ERROR, F("Blynk : no auth token"));
+    return false;
+  }
 
   ControllerSettingsStruct ControllerSettings;
   LoadControllerSettings(controllerIndex, (byte*)&ControllerSettings, sizeof(ControllerSettings));
-  // Use WiFiClient class to create TCP connections
-  WiFiClient client;
-  if ((SecuritySettings.ControllerPassword[controllerIndex][0] == 0) || !ControllerSettings.connectToHost(client))
+
+  String request = F("GET /");
+  request += SecuritySettings.ControllerPassword[controllerIndex];
+  request += '/';
+  request += command;
+  request += F(" HTTP/1.1\r\nHost: ");
+  request += ControllerSettings.getHost();
+  request += F("\r\n");
+  request += getWebString(WEB_STR_KEEP_ALIVE);
+  request += F("\r\n");
+  addLog(LOG_LEVEL_DEBUG, request);
+
+  String line;
+  String body;
+  if (!sendControllerHttpRequest(controllerIndex, ControllerSettings, request, line, data ? &body : NULL))
   {
     connectionFailures++;
     addLog(LOG_LEVEL_ERROR, F("Blynk : connection failed"));
@@ -81,70 +103,36 @@ boolean Blynk_get(const String& command, byte controllerIndex, float *data )
   if (connectionFailures)
     connectionFailures--;
 
-  // We now create a URI for the request
-  char request[300] = {0};
-  sprintf_P(request,
-            PSTR("GET /%s/%s HTTP/1.1\r\n Host: %s \r\n Connection: close\r\n\r\n"),
-            SecuritySettings.ControllerPassword[controllerIndex],
-            command.c_str(),
-            ControllerSettings.getHost().c_str());
-  addLog(LOG_LEVEL_DEBUG, request);
-  client.print(request);
-
-  unsigned long timer = millis() + 200;
-  while (!client.available() && !timeOutReached(timer))
-    yield();
-
   boolean success = false;
-  char log[80] = {0};
-
-  // Read all the lines of the reply from server and log them
-  while (client.available()) {
-    String line;
-    safeReadStringUntil(client, line, '\n');
-    addLog(LOG_LEVEL_DEBUG_MORE, line);
-    // success ?
-    if (line.substring(0, 15) == F("HTTP/1.1 200 OK")) {
-      strcpy_P(log, PSTR("HTTP : Success"));
-      success = true;
-    }
-    else if (line.substring(0, 24) == F("HTTP/1.1 400 Bad Request")) {
-      strcpy_P(log, PSTR("HTTP : Unauthorized"));
-    }
-    else if (line.substring(0, 25) == F("HTTP/1.1 401 Unauthorized")) {
-      strcpy_P(log, PSTR("HTTP : Unauthorized"));
-    }
-    addLog(LOG_LEVEL_DEBUG, log);
+  if (line.startsWith(getWebString(WEB_STR_HTTP_200_OK))) {
+    addLog(LOG_LEVEL_DEBUG, F("HTTP : Success"));
+    success = true;
+  }
+  else if (line.startsWith(F("HTTP/1.1 400")) || line.startsWith(F("HTTP/1.1 401"))) {
+    addLog(LOG_LEVEL_DEBUG, F("HTTP : Unauthorized"));
+  }
 
-    // data only
-    if (data && line.startsWith("["))
-    {
-      String strValue = line;
-      byte pos = strValue.indexOf('"',2);
-      strValue = strValue.substring(2, pos);
+  // data only, the reply is like ["12.3"]
+  if (success && data)
+  {
+    success = false;
+    const int start = body.indexOf('"');
+    const int pos = body.indexOf('"', start + 1);
+    if (body.startsWith("[") && start >= 0 && pos > start) {
+      String strValue = body.substring(start + 1, pos);
       strValue.trim();
-      float value = strValue.toFloat();
-      *data = value;
+      *data = strValue.toFloat();
       success = true;
 
-      char value_char[5] = {0};
-      strValue.toCharArray(value_char, 5);
-      sprintf_P(log, PSTR("Blynk get - %s => %s"),command.c_str(), value_char   );
-      addLog(LOG_LEVEL_DEBUG, log);
+      if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+        String log = F("Blynk get - ");
+        log += command;
+        log += F(" => ");
+        log += strValue;
+        addLog(LOG_LEVEL_DEBUG, log);
+      }
     }
-    yield();
   }
-  strcpy_P(log, PSTR("HTTP : closing connection"));
-  addLog(LOG_LEVEL_DEBUG, log);
-
-  client.flush();
-  client.stop();
-
-  // important - backgroudtasks - free mem
-  timer = millis() + Settings.MessageDelay;
-  while (!timeOutReached(timer))
-              backgroundtasks();
-
   return success;
 }
 #endif
@@ -9,6 +9,15 @@
 
 WiFiUDP C013_portUDP;
 
+#if defined(ESP8266)
+extern "C" {
+  #include <espnow.h>
+}
+#endif
+#if defined(ESP32)
+  #include <esp_now.h>
+#endif
+
 struct infoStruct
 {
   byte header = 255;
@@ -33,6 +42,76 @@ struct dataStruct
   float Values[VARS_PER_TASK];
 };
 
+// Delta frame, only the values flagged in changedMask are sent, packed from Values[0]
+struct deltaStruct
+{
+  byte header = 255;
+  byte ID = 6;
+  byte sourcelUnit;
+  byte destUnit;
+  byte sourceTaskIndex;
+  byte destTaskIndex;
+  uint16_t sequence;
+  byte changedMask;
+  float Values[VARS_PER_TASK];
+};
+
+#define C013_SEND_UNICAST       0   // One message per known node
+#define C013_SEND_BROADCAST     1   // One broadcast message for all nodes
+#define C013_FRAME_FULL         0   // All values, understood by all ESPEasy versions
+#define C013_FRAME_DELTA        1   // Only changed values, with sequence number
+#define C013_KEYFRAME_INTERVAL  10  // Every n-th delta frame carries all values
+#define C013_UNICAST_INTERVAL   10  // msec between unicast messages
+#define C013_ALL_VALUES         ((1 << VARS_PER_TASK) - 1)
+#define C013_TRANSPORT_UDP      0   // Via the access point
+#define C013_TRANSPORT_ESPNOW   1   // Directly between the nodes, on the channel of the access point
+#define C013_ESPNOW_QUEUE_SIZE  4   // Received frames waiting for backgroundtasks()
+
+struct C013_ConfigStruct
+{
+  C013_ConfigStruct() : SendMode(C013_SEND_UNICAST), FrameType(C013_FRAME_FULL), Transport(C013_TRANSPORT_UDP) {}
+  byte          SendMode;
+  byte          FrameType;
+  byte          Transport;
+} C013_config;
+
+// Frames received by the ESP-NOW callback, which runs in the WiFi stack and may not do the processing itself.
+struct C013_espnowFrameStruct
+{
+  byte mac[6];
+  byte length;
+  byte data[sizeof(infoStruct)];  // Largest frame
+};
+
+C013_espnowFrameStruct C013_espnowQueue[C013_ESPNOW_QUEUE_SIZE];
+volatile byte C013_espnowQueueHead = 0;  // Written by the callback
+volatile byte C013_espnowQueueTail = 0;  // Written by C013_processESPNowQueue()
+unsigned long C013_espnowDropped = 0;
+bool C013_espnowActive = false;
+
+struct C013_taskStateStruct
+{
+  C013_taskStateStruct() :
+    sequence(0), pendingMask(0), nextDataUnit(0), nextInfoUnit(0), framesSinceKey(0),
+    rxSequence(0), rxValid(false) {
+    for (byte i = 0; i < VARS_PER_TASK; ++i) lastSent[i] = 0.0;
+  }
+
+  // Sending side, source task
+  float lastSent[VARS_PER_TASK];
+  uint16_t sequence;
+  byte pendingMask;     // Values still to be sent to the remaining nodes
+  byte nextDataUnit;    // Next node for unicast data, 0 = none pending
+  byte nextInfoUnit;    // Next node for unicast task info, 0 = none pending
+  byte framesSinceKey;
+
+  // Receiving side, destination task
+  uint16_t rxSequence;
+  bool rxValid;
+} C013_taskState[TASKS_MAX];
+
+byte C013_controllerIndex = CONTROLLER_MAX;
+
 
 boolean CPlugin_013(byte function, struct EventStruct *event, String& string)
 {
@@ -69,6 +148,51 @@ boolean CPlugin_013(byte function, struct EventStruct *event, String& string)
     case CPLUGIN_INIT:
       {
         //C013_portUDP.begin(Settings.UDPPort);
+        C013_controllerIndex = event->ControllerIndex;
+        LoadCustomControllerSettings(event->ControllerIndex, (byte*)&C013_config, sizeof(C013_config));
+        if (C013_config.Transport == C013_TRANSPORT_ESPNOW)
+          C013_initESPNow();
+        break;
+      }
+
+    case CPLUGIN_WEBFORM_LOAD:
+      {
+        C013_ConfigStruct config;
+        LoadCustomControllerSettings(event->ControllerIndex, (byte*)&config, sizeof(config));
+        {
+          String options[2] = { F("Unicast to each node"), F("Broadcast") };
+          int optionValues[2] = { C013_SEND_UNICAST, C013_SEND_BROADCAST };
+          addFormSelector(F("Send Mode"), F("c013sendmode"), 2, options, optionValues, config.SendMode);
+        }
+        {
+          String options[2] = { F("All values"), F("Changed values") };
+          int optionValues[2] = { C013_FRAME_FULL, C013_FRAME_DELTA };
+          addFormSelector(F("Data Frame"), F("c013frametype"), 2, options, optionValues, config.FrameType);
+          addFormNote(F("Changed values need all receiving nodes to run a build supporting it"));
+        }
+        {
+          String options[2] = { F("WiFi UDP"), F("ESP-NOW") };
+          int optionValues[2] = { C013_TRANSPORT_UDP, C013_TRANSPORT_ESPNOW };
+          addFormSelector(F("Transport"), F("c013transport"), 2, options, optionValues,
+                          config.Transport == C013_TRANSPORT_ESPNOW ? C013_TRANSPORT_ESPNOW : C013_TRANSPORT_UDP);
+          addFormNote(F("ESP-NOW: all nodes must use the same WiFi channel, not encrypted, reboot to activate"));
+        }
+        break;
+      }
+
+    case CPLUGIN_WEBFORM_SAVE:
+      {
+        C013_ConfigStruct config;
+        config.SendMode = getFormItemInt(F("c013sendmode"), C013_SEND_UNICAST);
+        config.FrameType = getFormItemInt(F("c013frametype"), C013_FRAME_FULL);
+        config.Transport = getFormItemInt(F("c013transport"), C013_TRANSPORT_UDP);
+        SaveCustomControllerSettings(event->ControllerIndex, (byte*)&config, sizeof(config));
+        break;
+      }
+
+    case CPLUGIN_TIMER_IN:
+      {
+        C013_SendPending();
         break;
       }
 
@@ -106,11 +230,30 @@ void C013_Send(struct EventStruct *event, byte varIndex, float value, unsigned l
   C013_SendUDPTaskData(0, event->TaskIndex, event->TaskIndex);
 }
 
+// ESP-NOW does not need the access point, so it keeps working when the AP is down.
+bool C013_transportReady(unsigned long timeout)
+{
+  if (C013_espnowActive)
+    return true;
+  return timeout == 0 ? WiFiConnected() : WiFiConnected(timeout);
+}
+
 void C013_SendUDPTaskInfo(byte destUnit, byte sourceTaskIndex, byte destTaskIndex)
 {
-  if (!WiFiConnected(100)) {
+  if (!C013_transportReady(100) || sourceTaskIndex >= TASKS_MAX) {
+    return;
+  }
+  if (destUnit != 0 || C013_config.SendMode == C013_SEND_BROADCAST) {
+    C013_sendUDPTaskInfoTo(destUnit != 0 ? destUnit : 255, sourceTaskIndex, destTaskIndex);
     return;
   }
+  // Unicast sweep is done from the scheduler, see C013_SendPending()
+  C013_taskState[sourceTaskIndex].nextInfoUnit = 1;
+  C013_schedulePending(0);
+}
+
+void C013_sendUDPTaskInfoTo(byte unit, byte sourceTaskIndex, byte destTaskIndex)
+{
   struct infoStruct infoReply;
   infoReply.sourcelUnit = Settings.Unit;
   infoReply.sourceTaskIndex = sourceTaskIndex;
@@ -120,53 +263,129 @@ void C013_SendUDPTaskInfo(byte destUnit, byte sourceTaskIndex, byte destTaskInde
   strcpy(infoReply.taskName, getTaskDeviceName(infoReply.sourceTaskIndex).c_str());
   for (byte x = 0; x < VARS_PER_TASK; x++)
     strcpy(infoReply.ValueNames[x], ExtraTaskSettings.TaskDeviceValueNames[x]);
+  infoReply.destUnit = unit;
+  C013_sendUDP(unit, (byte*)&infoReply, sizeof(infoStruct));
+}
 
-  byte firstUnit = 1;
-  byte lastUnit = UNIT_MAX - 1;
-  if (destUnit != 0)
-  {
-    firstUnit = destUnit;
-    lastUnit = destUnit;
+void C013_SendUDPTaskData(byte destUnit, byte sourceTaskIndex, byte destTaskIndex)
+{
+  if (!C013_transportReady(100) || sourceTaskIndex >= TASKS_MAX) {
+    return;
   }
-  for (byte x = firstUnit; x <= lastUnit; x++)
-  {
-    if (x != Settings.Unit){
-      infoReply.destUnit = x;
-      C013_sendUDP(x, (byte*)&infoReply, sizeof(infoStruct));
-      delay(10);
+  C013_taskStateStruct& state = C013_taskState[sourceTaskIndex];
+  const bool pending = state.nextDataUnit != 0;
+  TaskValueSnapshot snapshot;
+  getTaskValueSnapshot(sourceTaskIndex, snapshot);
+  byte changedMask = C013_ALL_VALUES;
+  if (C013_config.FrameType == C013_FRAME_DELTA && state.framesSinceKey != 0) {
+    changedMask = 0;
+    for (byte x = 0; x < VARS_PER_TASK; x++) {
+      const float value = snapshot.values[x];
+      if (memcmp(&value, &state.lastSent[x], sizeof(float)) != 0)
+        changedMask |= (1 << x);
     }
   }
-  delay(50);
+  for (byte x = 0; x < VARS_PER_TASK; x++)
+    state.lastSent[x] = snapshot.values[x];
+  state.framesSinceKey = (state.framesSinceKey + 1) % C013_KEYFRAME_INTERVAL;
+
+  if (pending) {
+    // Previous frame is not yet sent to all nodes, merge it and restart the sweep.
+    // It keeps its sequence number, so nodes that already got it do not see a gap.
+    state.pendingMask |= changedMask;
+  } else {
+    state.pendingMask = changedMask;
+    ++state.sequence;
+  }
+
+  if (destUnit != 0 || C013_config.SendMode == C013_SEND_BROADCAST) {
+    C013_sendUDPTaskDataTo(destUnit != 0 ? destUnit : 255, sourceTaskIndex, destTaskIndex);
+    if (!pending) state.pendingMask = 0;
+    return;
+  }
+  state.nextDataUnit = 1;
+  C013_schedulePending(0);
 }
 
-void C013_SendUDPTaskData(byte destUnit, byte sourceTaskIndex, byte destTaskIndex)
+void C013_sendUDPTaskDataTo(byte unit, byte sourceTaskIndex, byte destTaskIndex)
 {
-  if (!WiFiConnected(100)) {
+  const C013_taskStateStruct& state = C013_taskState[sourceTaskIndex];
+  if (C013_config.FrameType != C013_FRAME_DELTA) {
+    struct dataStruct dataReply;
+    dataReply.sourcelUnit = Settings.Unit;
+    dataReply.sourceTaskIndex = sourceTaskIndex;
+    dataReply.destTaskIndex = destTaskIndex;
+    dataReply.destUnit = unit;
+    for (byte x = 0; x < VARS_PER_TASK; x++)
+      dataReply.Values[x] = state.lastSent[x];
+    C013_sendUDP(unit, (byte*) &dataReply, sizeof(dataStruct));
     return;
   }
-  struct dataStruct dataReply;
-  dataReply.sourcelUnit = Settings.Unit;
-  dataReply.sourceTaskIndex = sourceTaskIndex;
-  dataReply.destTaskIndex = destTaskIndex;
-  for (byte x = 0; x < VARS_PER_TASK; x++)
-    dataReply.Values[x] = UserVar[dataReply.sourceTaskIndex * VARS_PER_TASK + x];
+  struct deltaStruct deltaReply;
+  deltaReply.sourcelUnit = Settings.Unit;
+  deltaReply.sourceTaskIndex = sourceTaskIndex;
+  deltaReply.destTaskIndex = destTaskIndex;
+  deltaReply.destUnit = unit;
+  deltaReply.sequence = state.sequence;
+  deltaReply.changedMask = state.pendingMask;
+  byte count = 0;
+  for (byte x = 0; x < VARS_PER_TASK; x++) {
+    if (state.pendingMask & (1 << x))
+      deltaReply.Values[count++] = state.lastSent[x];
+  }
+  C013_sendUDP(unit, (byte*) &deltaReply, offsetof(deltaStruct, Values) + count * sizeof(float));
+}
 
-  byte firstUnit = 1;
-  byte lastUnit = UNIT_MAX - 1;
-  if (destUnit != 0)
-  {
-    firstUnit = destUnit;
-    lastUnit = destUnit;
+void C013_schedulePending(unsigned long msecFromNow)
+{
+  if (C013_controllerIndex < CONTROLLER_MAX)
+    setControllerTimer(C013_controllerIndex, msecFromNow);
+}
+
+// Send a single pending unicast message and schedule the next one.
+void C013_SendPending()
+{
+  if (!C013_transportReady(0)) {
+    return;
   }
-  for (byte x = firstUnit; x <= lastUnit; x++)
-  {
-    if (x != Settings.Unit){
-      dataReply.destUnit = x;
-      C013_sendUDP(x, (byte*) &dataReply, sizeof(dataStruct));
-      delay(10);
+  bool morePending = false;
+  bool sent = false;
+  for (byte task = 0; task < TASKS_MAX; task++) {
+    C013_taskStateStruct& state = C013_taskState[task];
+    if (!sent) {
+      if (state.nextInfoUnit != 0) {
+        const byte unit = C013_nextUnicastNode(state.nextInfoUnit);
+        if (unit != 0) {
+          C013_sendUDPTaskInfoTo(unit, task, task);
+          sent = true;
+        }
+      } else if (state.nextDataUnit != 0) {
+        const byte unit = C013_nextUnicastNode(state.nextDataUnit);
+        if (unit != 0) {
+          C013_sendUDPTaskDataTo(unit, task, task);
+          sent = true;
+        }
+        if (state.nextDataUnit == 0) state.pendingMask = 0;
+      }
     }
+    if (state.nextInfoUnit != 0 || state.nextDataUnit != 0)
+      morePending = true;
   }
-  delay(50);
+  if (morePending)
+    C013_schedulePending(C013_UNICAST_INTERVAL);
+}
+
+// Find the next known node, starting at cursor. The cursor is moved past it, or set to 0 at the end.
+byte C013_nextUnicastNode(byte& cursor)
+{
+  for (byte x = cursor; x < UNIT_MAX; x++) {
+    if (x != Settings.Unit && Nodes[x].ip[0] != 0) {
+      cursor = (x + 1 < UNIT_MAX) ? x + 1 : 0;
+      return x;
+    }
+  }
+  cursor = 0;
+  return 0;
 }
 
 /*********************************************************************************************\
@@ -174,12 +393,16 @@ void C013_SendUDPTaskData(byte destUnit, byte sourceTaskIndex, byte destTaskInde
   \*********************************************************************************************/
 void C013_sendUDP(byte unit, byte* data, byte size)
 {
-  if (!WiFiConnected(100)) {
-    return;
-  }
   if (unit != 255)
     if (Nodes[unit].ip[0] == 0)
       return;
+  if (C013_espnowActive) {
+    C013_sendESPNow(unit, data, size);
+    return;
+  }
+  if (!WiFiConnected(100)) {
+    return;
+  }
   if (loglevelActiveFor(LOG_LEVEL_DEBUG_MORE)) {
     String log = F("C013 : Send UDP message to ");
     log += unit;
@@ -198,9 +421,114 @@ void C013_sendUDP(byte unit, byte* data, byte size)
   C013_portUDP.endPacket();
 }
 
+/*********************************************************************************************\
+   ESP-NOW transport, same frames as UDP (unit 255=broadcast)
+   Peers are the nodes known from the sysinfo messages, by the MAC address in Nodes[].
+  \*********************************************************************************************/
+const byte C013_broadcastMAC[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+#if defined(ESP8266)
+void C013_onESPNowReceive(uint8_t *mac, uint8_t *data, uint8_t length)
+#endif
+#if defined(ESP32)
+void C013_onESPNowReceive(const uint8_t *mac, const uint8_t *data, int length)
+#endif
+{
+  const byte next = (C013_espnowQueueHead + 1) % C013_ESPNOW_QUEUE_SIZE;
+  if (length < 2 || length > static_cast<int>(sizeof(infoStruct)) || data[0] != 255 || next == C013_espnowQueueTail) {
+    ++C013_espnowDropped;
+    return;
+  }
+  C013_espnowFrameStruct& frame = C013_espnowQueue[C013_espnowQueueHead];
+  memcpy(frame.mac, mac, 6);
+  memcpy(frame.data, data, length);
+  frame.length = length;
+  C013_espnowQueueHead = next;
+}
+
+bool C013_addESPNowPeer(const byte* mac)
+{
+#if defined(ESP8266)
+  if (esp_now_is_peer_exist(const_cast<uint8_t*>(mac)) > 0)
+    return true;
+  return esp_now_add_peer(const_cast<uint8_t*>(mac), ESP_NOW_ROLE_COMBO, 0, NULL, 0) == 0;
+#endif
+#if defined(ESP32)
+  if (esp_now_is_peer_exist(mac))
+    return true;
+  esp_now_peer_info_t peer;
+  memset(&peer, 0, sizeof(peer));
+  memcpy(peer.peer_addr, mac, 6);
+  peer.channel = 0;  // Current channel
+  peer.ifidx = ESP_IF_WIFI_STA;
+  peer.encrypt = false;
+  return esp_now_add_peer(&peer) == ESP_OK;
+#endif
+}
+
+void C013_initESPNow()
+{
+  if (C013_espnowActive)
+    return;
+  if (esp_now_init() != 0) {
+    addLog(LOG_LEVEL_ERROR, F("C013 : ESP-NOW init failed, using UDP"));
+    return;
+  }
+#if defined(ESP8266)
+  esp_now_set_self_role(ESP_NOW_ROLE_COMBO);
+#endif
+  esp_now_register_recv_cb(C013_onESPNowReceive);
+  C013_addESPNowPeer(C013_broadcastMAC);
+  C013_espnowActive = true;
+  addLog(LOG_LEVEL_INFO, F("C013 : ESP-NOW active"));
+}
+
+void C013_sendESPNow(byte unit, byte* data, byte size)
+{
+  const byte* mac = C013_broadcastMAC;
+  if (unit != 255) {
+    mac = Nodes[unit].mac;
+    if ((mac[0] | mac[1] | mac[2] | mac[3] | mac[4] | mac[5]) == 0)
+      return;  // MAC not known yet
+    if (!C013_addESPNowPeer(mac)) {
+      addLog(LOG_LEVEL_ERROR, F("C013 : ESP-NOW peer list full"));
+      return;
+    }
+  }
+  if (loglevelActiveFor(LOG_LEVEL_DEBUG_MORE)) {
+    String log = F("C013 : Send ESP-NOW message to ");
+    log += unit;
+    addLog(LOG_LEVEL_DEBUG_MORE, log);
+  }
+  statusLED(true);
+  esp_now_send(const_cast<uint8_t*>(mac), data, size);
+}
+
+// Handle the frames received by the callback, called from backgroundtasks().
+void C013_processESPNowQueue()
+{
+  while (C013_espnowQueueTail != C013_espnowQueueHead) {
+    const C013_espnowFrameStruct& frame = C013_espnowQueue[C013_espnowQueueTail];
+    // Zero padded, C013_Receive() copies the full frame struct.
+    byte data[sizeof(infoStruct)] = { 0 };
+    memcpy(data, frame.data, frame.length);
+    const byte sourceUnit = data[2];
+    // Keep the sending node in the list while the AP is down and no sysinfo is received.
+    if (sourceUnit < UNIT_MAX && Nodes[sourceUnit].ip[0] != 0 && memcmp(Nodes[sourceUnit].mac, frame.mac, 6) == 0)
+      Nodes[sourceUnit].lastSeen = millis();
+    C013_espnowQueueTail = (C013_espnowQueueTail + 1) % C013_ESPNOW_QUEUE_SIZE;
+
+    struct EventStruct TempEvent;
+    TempEvent.Data = data;
+    TempEvent.Par2 = frame.length;
+    C013_Receive(&TempEvent);
+  }
+}
+
+// event->Par2 is the length of the frame in event->Data.
 void C013_Receive(struct EventStruct *event) {
   if (loglevelActiveFor(LOG_LEVEL_DEBUG_MORE)) {
-    if (event->Data[1] > 1 && event->Data[1] < 6)
+    if (event->Data[1] > 1 && event->Data[1] < 7)
     {
       String log = (F("C013 : msg "));
       for (byte x = 1; x < 6; x++)
@@ -252,7 +580,11 @@ void C013_Receive(struct EventStruct *event) {
     case 5: // sensor data
       {
         struct dataStruct dataReply;
+        if (event->Par2 < static_cast<int>(sizeof(dataStruct)))
+          break;
         memcpy((byte*)&dataReply, (byte*)event->Data, sizeof(dataStruct));
+        if (dataReply.destTaskIndex >= TASKS_MAX)
+          break;
 
         // only if this task has a remote feed, update values
         if (Settings.TaskDeviceDataFeed[dataReply.destTaskIndex] != 0)
@@ -261,11 +593,65 @@ void C013_Receive(struct EventStruct *event) {
           {
             UserVar[dataReply.destTaskIndex * VARS_PER_TASK + x] = dataReply.Values[x];
           }
+          publishTaskValues(dataReply.destTaskIndex);
           if (Settings.UseRules)
             createRuleEvents(dataReply.destTaskIndex);
         }
         break;
       }
+
+    case 6: // sensor data, changed values only
+      {
+        struct deltaStruct deltaReply;
+        if (event->Par2 < static_cast<int>(offsetof(deltaStruct, Values)))
+          break;
+        memcpy((byte*)&deltaReply, (byte*)event->Data, offsetof(deltaStruct, Values));
+        if (deltaReply.destTaskIndex >= TASKS_MAX)
+          break;
+        // The frame must hold a value for each bit of the mask.
+        byte valueCount = 0;
+        for (byte x = 0; x < VARS_PER_TASK; x++) {
+          if (deltaReply.changedMask & (1 << x)) ++valueCount;
+        }
+        const int frameSize = offsetof(deltaStruct, Values) + valueCount * sizeof(float);
+        if (event->Par2 < frameSize) {
+          addLog(LOG_LEVEL_DEBUG, F("C013 : Delta frame too short"));
+          break;
+        }
+        memcpy((byte*)deltaReply.Values, (byte*)event->Data + offsetof(deltaStruct, Values), valueCount * sizeof(float));
+
+        // only if this task has a remote feed, update values
+        if (Settings.TaskDeviceDataFeed[deltaReply.destTaskIndex] != 0)
+        {
+          C013_taskStateStruct& state = C013_taskState[deltaReply.destTaskIndex];
+          if (state.rxValid && deltaReply.sequence != state.rxSequence) {
+            const uint16_t lost = deltaReply.sequence - state.rxSequence - 1;
+            // A large gap means the sender restarted.
+            if (lost != 0 && lost < 0x8000) {
+              if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
+                String log = F("C013 : Lost ");
+                log += lost;
+                log += F(" frames from unit ");
+                log += deltaReply.sourcelUnit;
+                addLog(LOG_LEVEL_DEBUG, log);
+              }
+            }
+          }
+          state.rxSequence = deltaReply.sequence;
+          state.rxValid = true;
+
+          byte count = 0;
+          for (byte x = 0; x < VARS_PER_TASK; x++)
+          {
+            if (deltaReply.changedMask & (1 << x))
+              UserVar[deltaReply.destTaskIndex * VARS_PER_TASK + x] = deltaReply.Values[count++];
+          }
+          publishTaskValues(deltaReply.destTaskIndex);
+          if (Settings.UseRules)
+            createRuleEvents(deltaReply.destTaskIndex);
+        }
+        break;
+      }
   }
 }
 #endif
@@ -4,7 +4,9 @@
 // 2=Dry
 // 3=Wet
 String humStatDomoticz(struct EventStruct *event, byte rel_index){
-  const int hum = UserVar[event->BaseVarIndex + rel_index];
+  TaskValueSnapshot snapshot;
+  getTaskValueSnapshot(event->TaskIndex, snapshot);
+  const int hum = snapshot.values[rel_index];
   if (hum < 30) { return formatUserVarDomoticz(2); }
   if (hum < 40) { return formatUserVarDomoticz(0); }
   if (hum < 59) { return formatUserVarDomoticz(1); }
@@ -31,9 +33,11 @@ int mapVccToDomoticz() {
 
 // Format including trailing semi colon
 String formatUserVarDomoticz(struct EventStruct *event, byte rel_index) {
-  String text = formatUserVarNoCheck(event, rel_index);
-  text += F(";");
-  return text;
+  char text[FORMAT_VALUE_BUFFER_SIZE + 1];
+  const unsigned int length = formatUserVarNoCheck(event, rel_index, text);
+  text[length] = ';';
+  text[length + 1] = 0;
+  return String(text);
 }
 
 String formatUserVarDomoticz(int value) {
@@ -46,13 +50,15 @@ String formatUserVarDomoticz(int value) {
 
 String formatDomoticzSensorType(struct EventStruct *event) {
   String values;
+  TaskValueSnapshot snapshot;
+  getTaskValueSnapshot(event->TaskIndex, snapshot);
   switch (event->sensorType)
   {
     case SENSOR_TYPE_SINGLE:                      // single value sensor, used for Dallas, BH1750, etc
       values  = formatUserVarDomoticz(event, 0);
       break;
     case SENSOR_TYPE_LONG:                      // single LONG value, stored in two floats (rfid tags)
-      values  = (unsigned long)UserVar[event->BaseVarIndex] + ((unsigned long)UserVar[event->BaseVarIndex + 1] << 16);
+      values  = snapshot.getLong();
       break;
     case SENSOR_TYPE_DUAL:                       // any sensor that uses two simple values
       values  = formatUserVarDomoticz(event, 0);
@@ -105,12 +111,12 @@ String formatDomoticzSensorType(struct EventStruct *event) {
       // WindDir in degrees; WindDir as text; Wind speed average ; Wind speed gust; 0
       // http://www.domoticz.com/wiki/Domoticz_API/JSON_URL%27s#Wind
       values  = formatUserVarDomoticz(event, 0);           // WB = Wind bearing (0-359)
-      values += getBearing(UserVar[event->BaseVarIndex]);  // WD = Wind direction (S, SW, NNW, etc.)
+      values += getBearing(snapshot.values[0]);  // WD = Wind direction (S, SW, NNW, etc.)
       values += ";";  // Needed after getBearing
       // Domoticz expects the wind speed in (m/s * 10)
-      values += toString((UserVar[event->BaseVarIndex + 1] * 10),ExtraTaskSettings.TaskDeviceValueDecimals[1]);
+      values += toString((snapshot.values[1] * 10),ExtraTaskSettings.TaskDeviceValueDecimals[1]);
       values += ";"; // WS = 10 * Wind speed [m/s]
-      values += toString((UserVar[event->BaseVarIndex + 2] * 10),ExtraTaskSettings.TaskDeviceValueDecimals[2]);
+      values += toString((snapshot.values[2] * 10),ExtraTaskSettings.TaskDeviceValueDecimals[2]);
       values += ";"; // WG = 10 * Gust [m/s]
       values += formatUserVarDomoticz(0);  // Temperature
       values += formatUserVarDomoticz(0);  // Temperature Windchill
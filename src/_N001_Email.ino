@@ -7,7 +7,62 @@
 #define NPLUGIN_ID_001         1
 #define NPLUGIN_NAME_001       "Email (SMTP)"
 
-#define NPLUGIN_001_TIMEOUT 5000
+// Mails are queued by NPLUGIN_NOTIFY and sent in the background: the SMTP
+// dialogue is a state machine run by NPLUGIN_TIMER_IN, which reads the replies
+// as far as they came in and returns. The connection stays open a while after
+// a mail, so a burst of mails to the same server uses one connection. A failed
+// mail is retried with a growing delay, and dropped after NPLUGIN_001_RETRIES.
+// The DNS lookup and the connect still block, as with the controllers.
+#define NPLUGIN_001_TIMEOUT      5000   // msec to wait for a reply
+#define NPLUGIN_001_POLL           20   // msec between reads while waiting
+#define NPLUGIN_001_KEEP_OPEN   10000   // msec the connection is kept for the next mail
+#define NPLUGIN_001_QUEUE_MAX       4
+#define NPLUGIN_001_RETRIES         3
+#define NPLUGIN_001_RETRY_DELAY  5000   // msec, doubles per retry
+
+#define NPLUGIN_001_IDLE            0
+#define NPLUGIN_001_GREETING        1
+#define NPLUGIN_001_EHLO            2
+#define NPLUGIN_001_AUTH            3
+#define NPLUGIN_001_AUTH_USER       4
+#define NPLUGIN_001_AUTH_PASS       5
+#define NPLUGIN_001_MAIL_FROM       6
+#define NPLUGIN_001_RCPT_TO         7
+#define NPLUGIN_001_DATA            8
+#define NPLUGIN_001_BODY            9
+#define NPLUGIN_001_OPEN           10   // Connected, between mails
+
+struct NPlugin_001_mail_struct
+{
+  NPlugin_001_mail_struct() : NotificationIndex(0), retries(0) {}
+
+  byte NotificationIndex;
+  String subject;
+  String body;
+  byte retries;
+};
+
+struct NPlugin_001_struct
+{
+  NPlugin_001_struct() : settings(NULL), settingsIndex(0), head(0), count(0), state(NPLUGIN_001_IDLE),
+    deadline(0), retryAt(0), leased(false), sent(0), failed(0), dropped(0), connects(0) {}
+
+  NPlugin_001_mail_struct queue[NPLUGIN_001_QUEUE_MAX];
+  WiFiClient client;
+  NotificationSettingsStruct* settings;   // Of the connection
+  byte settingsIndex;
+  String line;                            // Reply being read
+  byte head;
+  byte count;
+  byte state;
+  unsigned long deadline;                 // Of the reply, or of the open connection
+  unsigned long retryAt;
+  bool leased;
+  unsigned long sent;
+  unsigned long failed;                   // Attempts
+  unsigned long dropped;                  // After all retries, or queue full
+  unsigned long connects;
+} NPlugin_001_data;
 
 boolean NPlugin_001(byte function, struct EventStruct *event, String& string)
 {
@@ -57,7 +112,14 @@ boolean NPlugin_001(byte function, struct EventStruct *event, String& string)
           body = NotificationSettings.Body;
         subject = parseTemplate(subject, subject.length());
         body = parseTemplate(body, body.length());
-        NPlugin_001_send(NotificationSettings, subject, body);
+        NPlugin_001_queue(event->NotificationIndex, subject, body);
+        success = true;
+        break;
+      }
+
+    case NPLUGIN_TIMER_IN:
+      {
+        NPlugin_001_process();
         success = true;
         break;
       }
@@ -66,115 +128,257 @@ boolean NPlugin_001(byte function, struct EventStruct *event, String& string)
   return success;
 }
 
-boolean NPlugin_001_send(const NotificationSettingsStruct& notificationsettings, const String& aSub, String& aMesg) {
-//  String& aDomain , String aTo, String aFrom, String aSub, String aMesg, String aHost, int aPort)
-  boolean myStatus = false;
+void NPlugin_001_schedule(unsigned long msecFromNow) {
+  setNotificationTimer(getNotificationProtocolIndex(NPLUGIN_ID_001), msecFromNow);
+}
 
-  // Use WiFiClient class to create TCP connections
-  WiFiClient client;
-  String aHost = notificationsettings.Server;
-  addLog(LOG_LEVEL_DEBUG, String(F("EMAIL: Connecting to "))+aHost + notificationsettings.Port);
-  if (!client.connect(aHost.c_str(), notificationsettings.Port)) {
-    addLog(LOG_LEVEL_ERROR, String(F("EMAIL: Error connecting to "))+aHost + notificationsettings.Port);
-    myStatus = false;
+void NPlugin_001_queue(byte NotificationIndex, const String& subject, String& body) {
+  NPlugin_001_struct& data = NPlugin_001_data;
+  if (data.count == NPLUGIN_001_QUEUE_MAX) {
+    ++data.dropped;
+    addLog(LOG_LEVEL_ERROR, F("EMAIL: Queue full, mail dropped"));
+    return;
   }
-  else {
-    String mailheader = F(
-      "From: $nodename <$emailfrom>\r\n"
-      "To: $ato\r\n"
-      "Subject: $subject\r\n"
-      "Reply-To: $nodename <$emailfrom>\r\n"
-      "MIME-VERSION: 1.0\r\n"
-      "Content-type: text/html; charset=UTF-8\r\n"
-      "X-Mailer: EspEasy v$espeasyversion\r\n\r\n"
-    );
-
-    mailheader.replace(String(F("$nodename")), Settings.Name);
-    mailheader.replace(String(F("$emailfrom")), notificationsettings.Sender);
-    mailheader.replace(String(F("$ato")), notificationsettings.Receiver);
-    mailheader.replace(String(F("$subject")), aSub);
-    mailheader.replace(String(F("$espeasyversion")), String(BUILD));
-    aMesg.replace(F("\r"), F("<br/>")); // re-write line breaks for Content-type: text/html
-
-    // Wait for Client to Start Sending
-    // The MTA Exchange
-    while (true) {
-
-      if (!NPlugin_001_MTA(client, "",                                    F("220 "))) break;
-      if (!NPlugin_001_MTA(client, String(F("EHLO ")) + notificationsettings.Domain,          F("250 "))) break;
-      if (!NPlugin_001_Auth(client, notificationsettings.User, notificationsettings.Pass)) break;
-      if (!NPlugin_001_MTA(client, String(F("MAIL FROM:<")) + notificationsettings.Sender + ">", F("250 "))) break;
-      if (!NPlugin_001_MTA(client, String(F("RCPT TO:<")) + notificationsettings.Receiver + ">", F("250 "))) break;
-      if (!NPlugin_001_MTA(client, F("DATA"),                             F("354 "))) break;
-      if (!NPlugin_001_MTA(client, mailheader + aMesg + String(F("\r\n.\r\n")), F("250 "))) break;
-
-      myStatus = true;
-      break;
-
-    }
-
-    client.flush();
-    client.stop();
+  NPlugin_001_mail_struct& mail = data.queue[(data.head + data.count) % NPLUGIN_001_QUEUE_MAX];
+  mail.NotificationIndex = NotificationIndex;
+  mail.subject = subject;
+  mail.body = body;
+  mail.body.replace(F("\r"), F("<br/>")); // re-write line breaks for Content-type: text/html
+  mail.retries = 0;
+  ++data.count;
+  if (data.state == NPLUGIN_001_IDLE || data.state == NPLUGIN_001_OPEN)
+    NPlugin_001_schedule(0);
+}
 
-    if (myStatus == true) {
-      addLog(LOG_LEVEL_INFO, F("EMAIL: Connection Closed Successfully"));
-    }
-    else {
-      String log = F("EMAIL: Connection Closed With Error. Used header: ");
-      log += mailheader;
-      addLog(LOG_LEVEL_ERROR, log);
-    }
-  }
-  return myStatus;
+void NPlugin_001_pop() {
+  NPlugin_001_struct& data = NPlugin_001_data;
+  if (data.count == 0) return;
+  NPlugin_001_mail_struct& mail = data.queue[data.head];
+  mail.subject = String();
+  mail.body = String();
+  data.head = (data.head + 1) % NPLUGIN_001_QUEUE_MAX;
+  --data.count;
 }
 
-boolean NPlugin_001_Auth(WiFiClient& client, String user, String pass) {
-  if (user.length() == 0 || pass.length() == 0) {
-    // No user/password given.
-    return true;
+bool NPlugin_001_connect(byte NotificationIndex) {
+  NPlugin_001_struct& data = NPlugin_001_data;
+  if (!socketAvailable(SOCKET_OTHER)) return false;
+  if (data.settings == NULL) data.settings = new NotificationSettingsStruct;
+  if (data.settings == NULL) return false;
+  LoadNotificationSettings(NotificationIndex, (byte*)data.settings, sizeof(NotificationSettingsStruct));
+  data.settingsIndex = NotificationIndex;
+  acquireSocketLease(SOCKET_OTHER);
+  data.leased = true;
+  ++data.connects;
+  const String host = data.settings->Server;
+  addLog(LOG_LEVEL_DEBUG, String(F("EMAIL: Connecting to ")) + host + data.settings->Port);
+  IPAddress hostIP;
+  if (!resolveHostByName(host.c_str(), hostIP) || !data.client.connect(hostIP, data.settings->Port)) {
+    addLog(LOG_LEVEL_ERROR, String(F("EMAIL: Error connecting to ")) + host + data.settings->Port);
+    return false;
   }
-  if (!NPlugin_001_MTA(client, String(F("AUTH LOGIN")), F("334 "))) return false;
-  base64 encoder;
-  String auth;
-  auth = encoder.encode(user);
-  if (!NPlugin_001_MTA(client, auth, F("334 "))) return false;
-  auth = encoder.encode(pass);
-  if (!NPlugin_001_MTA(client, auth, F("235 "))) return false;
-
+  data.line = "";
   return true;
 }
 
-boolean NPlugin_001_MTA(WiFiClient& client, String aStr, const String &aWaitForPattern)
-{
-  addLog(LOG_LEVEL_DEBUG, aStr);
+void NPlugin_001_close() {
+  NPlugin_001_struct& data = NPlugin_001_data;
+  if (data.client.connected() && data.state == NPLUGIN_001_OPEN)
+    data.client.print(F("QUIT\r\n"));
+  data.client.stop();
+  if (data.leased) releaseSocketLease(SOCKET_OTHER);
+  data.leased = false;
+  delete data.settings;
+  data.settings = NULL;
+  data.line = String();
+  data.state = NPLUGIN_001_IDLE;
+}
 
-  if (aStr.length() ) client.println(aStr);
+// Send a command, the reply is handled in the next state.
+void NPlugin_001_command(const String& command, byte nextState, bool logCommand = true) {
+  NPlugin_001_struct& data = NPlugin_001_data;
+  if (logCommand) addLog(LOG_LEVEL_DEBUG, command);
+  data.client.print(command);
+  data.client.print(F("\r\n"));
+  data.state = nextState;
+  data.deadline = millis() + NPLUGIN_001_TIMEOUT;
+}
 
-  yield();
+void NPlugin_001_mailFrom() {
+  NPlugin_001_command(String(F("MAIL FROM:<")) + NPlugin_001_data.settings->Sender + '>', NPLUGIN_001_MAIL_FROM);
+}
 
-  // Wait For Response
-  unsigned long timer = millis() + NPLUGIN_001_TIMEOUT;
-  while (true) {
-    if (timeOutReached(timer)) {
-      String log = F("Plugin_001_MTA: timeout. ");
-      log += aStr;
-      addLog(LOG_LEVEL_ERROR, log);
-      return false;
-    }
+// The mail in front failed, it is retried later.
+void NPlugin_001_fail(const String& reason) {
+  NPlugin_001_struct& data = NPlugin_001_data;
+  addLog(LOG_LEVEL_ERROR, String(F("EMAIL: ")) + reason);
+  NPlugin_001_close();
+  ++data.failed;
+  if (data.count == 0) return;
+  NPlugin_001_mail_struct& mail = data.queue[data.head];
+  if (++mail.retries > NPLUGIN_001_RETRIES) {
+    ++data.dropped;
+    addLog(LOG_LEVEL_ERROR, F("EMAIL: Mail dropped after retries"));
+    NPlugin_001_pop();
+    data.retryAt = millis();
+    if (data.count != 0) NPlugin_001_schedule(0);
+    return;
+  }
+  const unsigned long retryDelay = NPLUGIN_001_RETRY_DELAY << (mail.retries - 1);
+  data.retryAt = millis() + retryDelay;
+  NPlugin_001_schedule(retryDelay);
+}
 
-    yield();
+// A complete reply line of the server.
+void NPlugin_001_reply(const String& line) {
+  NPlugin_001_struct& data = NPlugin_001_data;
+  addLog(LOG_LEVEL_DEBUG, line);
+  if (line.length() < 3 || (line.length() > 3 && line[3] == '-'))
+    return;  // Continued in the next line
+  int expected = 250;
+  switch (data.state) {
+    case NPLUGIN_001_GREETING:  expected = 220; break;
+    case NPLUGIN_001_AUTH:
+    case NPLUGIN_001_AUTH_USER: expected = 334; break;
+    case NPLUGIN_001_AUTH_PASS: expected = 235; break;
+    case NPLUGIN_001_DATA:      expected = 354; break;
+  }
+  if (line.substring(0, 3).toInt() != expected) {
+    NPlugin_001_fail(String(F("Unexpected reply: ")) + line);
+    return;
+  }
 
-    // String line = client.readStringUntil('\n');
-    String line;
-    safeReadStringUntil(client, line, '\n');
+  const NotificationSettingsStruct& settings = *data.settings;
+  base64 encoder;
+  switch (data.state) {
+    case NPLUGIN_001_GREETING:
+      NPlugin_001_command(String(F("EHLO ")) + settings.Domain, NPLUGIN_001_EHLO);
+      break;
+    case NPLUGIN_001_EHLO:
+      if (settings.User[0] == 0 || settings.Pass[0] == 0)
+        NPlugin_001_mailFrom();
+      else
+        NPlugin_001_command(F("AUTH LOGIN"), NPLUGIN_001_AUTH);
+      break;
+    case NPLUGIN_001_AUTH:
+      NPlugin_001_command(encoder.encode(String(settings.User)), NPLUGIN_001_AUTH_USER, false);
+      break;
+    case NPLUGIN_001_AUTH_USER:
+      NPlugin_001_command(encoder.encode(String(settings.Pass)), NPLUGIN_001_AUTH_PASS, false);
+      break;
+    case NPLUGIN_001_AUTH_PASS:
+      NPlugin_001_mailFrom();
+      break;
+    case NPLUGIN_001_MAIL_FROM:
+      NPlugin_001_command(String(F("RCPT TO:<")) + settings.Receiver + '>', NPLUGIN_001_RCPT_TO);
+      break;
+    case NPLUGIN_001_RCPT_TO:
+      NPlugin_001_command(F("DATA"), NPLUGIN_001_DATA);
+      break;
+    case NPLUGIN_001_DATA:
+      {
+        const NPlugin_001_mail_struct& mail = data.queue[data.head];
+        String mailheader = F(
+          "From: $nodename <$emailfrom>\r\n"
+          "To: $ato\r\n"
+          "Subject: $subject\r\n"
+          "Reply-To: $nodename <$emailfrom>\r\n"
+          "MIME-VERSION: 1.0\r\n"
+          "Content-type: text/html; charset=UTF-8\r\n"
+          "X-Mailer: EspEasy v$espeasyversion\r\n\r\n"
+        );
+        mailheader.replace(String(F("$nodename")), Settings.Name);
+        mailheader.replace(String(F("$emailfrom")), settings.Sender);
+        mailheader.replace(String(F("$ato")), settings.Receiver);
+        mailheader.replace(String(F("$subject")), mail.subject);
+        mailheader.replace(String(F("$espeasyversion")), String(BUILD));
+        data.client.print(mailheader);
+        data.client.print(mail.body);
+        NPlugin_001_command(F("\r\n."), NPLUGIN_001_BODY, false);
+        break;
+      }
+    case NPLUGIN_001_BODY:
+      ++data.sent;
+      addLog(LOG_LEVEL_INFO, F("EMAIL: Mail sent"));
+      NPlugin_001_pop();
+      data.state = NPLUGIN_001_OPEN;
+      data.deadline = millis() + NPLUGIN_001_KEEP_OPEN;
+      break;
+  }
+}
 
-    addLog(LOG_LEVEL_DEBUG, line);
+// Called by NPLUGIN_TIMER_IN, runs the dialogue as far as the replies are in.
+void NPlugin_001_process() {
+  NPlugin_001_struct& data = NPlugin_001_data;
+  if (data.state == NPLUGIN_001_IDLE) {
+    if (data.count == 0) return;
+    if (!timeOutReached(data.retryAt)) return;  // Scheduled at the retry
+    if (!NPlugin_001_connect(data.queue[data.head].NotificationIndex)) {
+      NPlugin_001_fail(F("Not connected"));
+      return;
+    }
+    data.state = NPLUGIN_001_GREETING;
+    data.deadline = millis() + NPLUGIN_001_TIMEOUT;
+  }
+
+  if (data.state == NPLUGIN_001_OPEN) {
+    if (!data.client.connected()) {
+      NPlugin_001_close();
+      if (data.count != 0) NPlugin_001_schedule(0);
+      return;
+    }
+    if (data.count != 0) {
+      if (data.queue[data.head].NotificationIndex == data.settingsIndex) {
+        NPlugin_001_mailFrom();
+      } else {
+        NPlugin_001_close();  // Mail for another server
+        NPlugin_001_schedule(0);
+        return;
+      }
+    } else {
+      if (timeOutReached(data.deadline)) {
+        NPlugin_001_close();
+        addLog(LOG_LEVEL_INFO, F("EMAIL: Connection Closed"));
+      } else {
+        NPlugin_001_schedule(-timePassedSince(data.deadline));
+      }
+      return;
+    }
+  }
 
-    if (line.indexOf(aWaitForPattern) >= 0) {
-      return true;
+  while (data.client.available() && data.state != NPLUGIN_001_IDLE && data.state != NPLUGIN_001_OPEN) {
+    const char c = data.client.read();
+    if (c == '\n') {
+      NPlugin_001_reply(data.line);
+      data.line = "";
+    } else if (c != '\r' && data.line.length() < 512) {
+      data.line += c;
     }
   }
+  if (data.state == NPLUGIN_001_IDLE) return;  // Failed, the retry is scheduled
+  if (data.state == NPLUGIN_001_OPEN) {
+    NPlugin_001_schedule(0);  // Next mail, or wait for one
+    return;
+  }
+  if (timeOutReached(data.deadline)) {
+    NPlugin_001_fail(F("Timeout"));
+    return;
+  }
+  NPlugin_001_schedule(NPLUGIN_001_POLL);
+}
 
-  return false;
+// Email queue as: queued/sent/failed attempts/dropped
+String getNPlugin_001_stats() {
+  const NPlugin_001_struct& data = NPlugin_001_data;
+  String result;
+  result += data.count;
+  result += '/';
+  result += data.sent;
+  result += '/';
+  result += data.failed;
+  result += '/';
+  result += data.dropped;
+  if (data.state != NPLUGIN_001_IDLE) result += F(" (connected)");
+  return result;
 }
 #endif
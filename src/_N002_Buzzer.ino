@@ -47,10 +47,7 @@ boolean NPlugin_002(byte function, struct EventStruct *event, String& string)
         NotificationSettingsStruct NotificationSettings;
         LoadNotificationSettings(event->NotificationIndex, (byte*)&NotificationSettings, sizeof(NotificationSettings));
         //this reserves IRAM and uninitialized RAM
-        #ifndef ESP32
-        // Buzzer not compatible with ESP32 due to lack of tone command.
         tone(NotificationSettings.Pin1, 500, 500);
-        #endif
         success = true;
       }
 
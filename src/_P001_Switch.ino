@@ -18,6 +18,18 @@
 #define PLUGIN_001_BUTTON_TYPE_NORMAL_SWITCH 0
 #define PLUGIN_001_BUTTON_TYPE_PUSH_ACTIVE_LOW 1
 #define PLUGIN_001_BUTTON_TYPE_PUSH_ACTIVE_HIGH 2
+#define PLUGIN_001_INTERRUPT_MAX 4  // Tasks using edge capture, one interrupt handler each
+#define PLUGIN_001_PATTERN_MAX 16   // Durations of a pulsepattern command
+
+// Edge capture: the interrupt handler queues the pin level with a timestamp
+// (pushInterruptEvent), the task gets it as PLUGIN_INTERRUPT_EVENT with Par2 = level.
+int8_t Plugin_001_interruptTask[PLUGIN_001_INTERRUPT_MAX] = { -1, -1, -1, -1 };
+int8_t Plugin_001_interruptPin[PLUGIN_001_INTERRUPT_MAX];
+void Plugin_001_edge_interrupt1() ICACHE_RAM_ATTR;
+void Plugin_001_edge_interrupt2() ICACHE_RAM_ATTR;
+void Plugin_001_edge_interrupt3() ICACHE_RAM_ATTR;
+void Plugin_001_edge_interrupt4() ICACHE_RAM_ATTR;
+void Plugin_001_edge(byte slot) ICACHE_RAM_ATTR;
 
 boolean Plugin_001_read_switch_state(struct EventStruct *event) {
   return digitalRead(Settings.TaskDevicePin1[event->TaskIndex]) == HIGH;
@@ -30,6 +42,7 @@ boolean Plugin_001(byte function, struct EventStruct *event, String& string)
   static boolean outputstate[TASKS_MAX];
   static int8_t PinMonitor[GPIO_MAX];
   static int8_t PinMonitorState[GPIO_MAX];
+  static unsigned long lastEdge[TASKS_MAX];  // micros() of the last accepted state change
 
   switch (function)
   {
@@ -47,6 +60,7 @@ boolean Plugin_001(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].TimerOptional = true;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND;
         break;
       }
 
@@ -89,6 +103,13 @@ boolean Plugin_001(byte function, struct EventStruct *event, String& string)
         addFormCheckBox(F("Send Boot state"),F("plugin_001_boot"),
         		Settings.TaskDevicePluginConfig[event->TaskIndex][3]);
 
+        addFormCheckBox(F("Interrupt edge capture"), F("plugin_001_interrupt"),
+            Settings.TaskDevicePluginConfig[event->TaskIndex][4]);
+        addFormNote(F("Reacts on every edge, instead of sampling the pin 10x per second. Max. 4 tasks."));
+
+        addFormNumericBox(F("Debounce"), F("plugin_001_debounce"), Settings.TaskDevicePluginConfig[event->TaskIndex][5], 0, 1000);
+        addUnit(F("ms"));
+
         success = true;
         break;
       }
@@ -104,6 +125,8 @@ boolean Plugin_001(byte function, struct EventStruct *event, String& string)
         Settings.TaskDevicePluginConfig[event->TaskIndex][2] = getFormItemInt(F("plugin_001_button"));
 
         Settings.TaskDevicePluginConfig[event->TaskIndex][3] = isFormItemChecked(F("plugin_001_boot"));
+        Settings.TaskDevicePluginConfig[event->TaskIndex][4] = isFormItemChecked(F("plugin_001_interrupt"));
+        Settings.TaskDevicePluginConfig[event->TaskIndex][5] = getFormItemInt(F("plugin_001_debounce"));
 
         success = true;
         break;
@@ -123,6 +146,11 @@ boolean Plugin_001(byte function, struct EventStruct *event, String& string)
 
         setPinState(PLUGIN_ID_001, Settings.TaskDevicePin1[event->TaskIndex], PIN_MODE_INPUT, 0);
 
+        Plugin_001_detach(event->TaskIndex);
+        if (Settings.TaskDevicePluginConfig[event->TaskIndex][4])
+          Plugin_001_attach(event->TaskIndex, Settings.TaskDevicePin1[event->TaskIndex]);
+        lastEdge[event->TaskIndex] = micros();
+
         switchstate[event->TaskIndex] = Plugin_001_read_switch_state(event);
         outputstate[event->TaskIndex] = switchstate[event->TaskIndex];
 
@@ -170,12 +198,36 @@ boolean Plugin_001(byte function, struct EventStruct *event, String& string)
         break;
       }
 
+    case PLUGIN_EXIT:
+      {
+        Plugin_001_detach(event->TaskIndex);
+        break;
+      }
+
+    // The 10 per second poll remains in edge capture mode, for events dropped when the queue was full.
+    case PLUGIN_INTERRUPT_EVENT:
     case PLUGIN_TEN_PER_SECOND:
       {
-        const boolean state = Plugin_001_read_switch_state(event);
+        boolean state;
+        unsigned long edgeTime;
+        if (function == PLUGIN_INTERRUPT_EVENT) {
+          const InterruptEventStruct* item = reinterpret_cast<const InterruptEventStruct*>(event->Data);
+          state = event->Par2 != 0;
+          edgeTime = item->timestamp;
+          // Contact bounce: ignore changes too soon after the last accepted one, the poll picks up the final level.
+          const unsigned long debounce = Settings.TaskDevicePluginConfig[event->TaskIndex][5] * 1000UL;
+          if (state != switchstate[event->TaskIndex] && (edgeTime - lastEdge[event->TaskIndex]) < debounce) {
+            success = true;
+            break;
+          }
+        } else {
+          state = Plugin_001_read_switch_state(event);
+          edgeTime = micros();
+        }
         if (state != switchstate[event->TaskIndex])
         {
           switchstate[event->TaskIndex] = state;
+          lastEdge[event->TaskIndex] = edgeTime;
           const boolean currentOutputState = outputstate[event->TaskIndex];
           boolean new_outputState = currentOutputState;
           switch(Settings.TaskDevicePluginConfig[event->TaskIndex][2]) {
@@ -210,11 +262,7 @@ boolean Plugin_001(byte function, struct EventStruct *event, String& string)
               }
             }
             UserVar[event->BaseVarIndex] = output_value;
-            String log = F("SW   : Switch state ");
-            log += state ? F("1") : F("0");
-            log += F(" Output value ");
-            log += output_value;
-            addLog(LOG_LEVEL_INFO, log);
+            addLogFmt(LOG_LEVEL_INFO, LOG_FMT_SW_SWITCH_STATE, state ? 1 : 0, output_value);
             sendData(event);
           }
         }
@@ -226,9 +274,7 @@ boolean Plugin_001(byte function, struct EventStruct *event, String& string)
       {
         // We do not actually read the pin state as this is already done 10x/second
         // Instead we just send the last known state stored in Uservar
-        String log = F("SW   : State ");
-        log += UserVar[event->BaseVarIndex];
-        addLog(LOG_LEVEL_INFO, log);
+        addLogFmt(LOG_LEVEL_INFO, LOG_FMT_SW_STATE, logFmtFloat(UserVar[event->BaseVarIndex]));
         success = true;
         break;
       }
@@ -243,6 +289,7 @@ boolean Plugin_001(byte function, struct EventStruct *event, String& string)
           success = true;
           if (event->Par1 >= 0 && event->Par1 <= PIN_D_MAX)
           {
+            Plugin_001_stopPulse(event->Par1);
             if (event->Par2 == 2) {
               pinMode(event->Par1, INPUT);
               setPinState(PLUGIN_ID_001, event->Par1, PIN_MODE_INPUT, 0);
@@ -309,11 +356,14 @@ boolean Plugin_001(byte function, struct EventStruct *event, String& string)
           success = true;
           if (event->Par1 >= 0 && event->Par1 <= PIN_D_MAX)
           {
-            pinMode(event->Par1, OUTPUT);
-            digitalWrite(event->Par1, event->Par2);
-            delay(event->Par3);
-            digitalWrite(event->Par1, !event->Par2);
-            setPinState(PLUGIN_ID_001, event->Par1, PIN_MODE_OUTPUT, event->Par2);
+            const uint32_t step = OUTPUT_SEQUENCER_STEP(1, event->Par3);
+            if (!Plugin_001_sequence(event->Par1, event->Par2, &step, 1)) {
+              pinMode(event->Par1, OUTPUT);
+              digitalWrite(event->Par1, event->Par2);
+              delay(event->Par3);
+              digitalWrite(event->Par1, !event->Par2);
+              setPinState(PLUGIN_ID_001, event->Par1, PIN_MODE_OUTPUT, !event->Par2);
+            }
             log = String(F("SW   : GPIO ")) + String(event->Par1) + String(F(" Pulsed for ")) + String(event->Par3) + String(F(" mS"));
             addLog(LOG_LEVEL_INFO, log);
             SendStatus(event->Source, getPinStateJSON(SEARCH_PIN_STATE, PLUGIN_ID_001, event->Par1, log, 0));
@@ -329,12 +379,15 @@ boolean Plugin_001(byte function, struct EventStruct *event, String& string)
             const bool pinStateHigh = event->Par2 != 0;
             const uint16_t pinStateValue = pinStateHigh ? 1 : 0;
             const uint16_t inversePinStateValue = pinStateHigh ? 0 : 1;
-            pinMode(event->Par1, OUTPUT);
-            digitalWrite(event->Par1, pinStateValue);
-            setPinState(PLUGIN_ID_001, event->Par1, PIN_MODE_OUTPUT, pinStateValue);
             unsigned long timer = time_in_msec ? event->Par3 : event->Par3 * 1000;
-            // Create a future system timer call to set the GPIO pin back to its normal value.
-            setSystemTimer(timer, PLUGIN_ID_001, event->TaskIndex, event->Par1, inversePinStateValue);
+            const uint32_t step = OUTPUT_SEQUENCER_STEP(1, timer);
+            if (!Plugin_001_sequence(event->Par1, pinStateValue, &step, 1)) {
+              pinMode(event->Par1, OUTPUT);
+              digitalWrite(event->Par1, pinStateValue);
+              setPinState(PLUGIN_ID_001, event->Par1, PIN_MODE_OUTPUT, pinStateValue);
+              // Create a future system timer call to set the GPIO pin back to its normal value.
+              setSystemTimer(timer, PLUGIN_ID_001, event->TaskIndex, event->Par1, inversePinStateValue);
+            }
             log = String(F("SW   : GPIO ")) + String(event->Par1) +
                   String(F(" Pulse set for ")) + String(event->Par3) + String(time_in_msec ? F(" msec") : F(" sec"));
             addLog(LOG_LEVEL_INFO, log);
@@ -342,6 +395,30 @@ boolean Plugin_001(byte function, struct EventStruct *event, String& string)
           }
         }
 
+        // pulsepattern,<gpio>,<state>,<msec>,<msec>,... alternates between state and its inverse
+        if (command == F("pulsepattern"))
+        {
+          success = true;
+          if (event->Par1 >= 0 && event->Par1 <= PIN_D_MAX)
+          {
+            uint32_t steps[PLUGIN_001_PATTERN_MAX];
+            byte count = 0;
+            String duration = parseString(string, 4);
+            while (duration.length() > 0 && count < PLUGIN_001_PATTERN_MAX) {
+              steps[count] = OUTPUT_SEQUENCER_STEP((count & 1) ? 0 : 1, duration.toInt());
+              ++count;
+              duration = parseString(string, 4 + count);
+            }
+            log = String(F("SW   : GPIO ")) + String(event->Par1);
+            if (count > 0 && Plugin_001_sequence(event->Par1, event->Par2, steps, count))
+              log += String(F(" Pulse pattern of ")) + String(count) + String(F(" steps"));
+            else
+              log += F(" Pulse pattern not started");
+            addLog(LOG_LEVEL_INFO, log);
+            SendStatus(event->Source, getPinStateJSON(SEARCH_PIN_STATE, PLUGIN_ID_001, event->Par1, log, 0));
+          }
+        }
+
         if (command == F("servo"))
         {
           success = true;
@@ -376,6 +453,12 @@ boolean Plugin_001(byte function, struct EventStruct *event, String& string)
             success = true;
             SendStatus(event->Source, getPinStateJSON(SEARCH_PIN_STATE, PLUGIN_ID_001, event->Par2, dummyString, 0));
           }
+          // status,changed,<sequence>: the pins of all plugins changed after the sequence of the last reply
+          if (parseString(string, 2) == F("changed"))
+          {
+            success = true;
+            SendStatus(event->Source, getPinStatesChangedJSON(event->Par2));
+          }
         }
 
         if (command == F("monitor"))
@@ -394,7 +477,6 @@ boolean Plugin_001(byte function, struct EventStruct *event, String& string)
           outputstate[event->Par1] = event->Par2;
         }
 
-        // FIXME: Absolutely no error checking in play_rtttl, until then keep it only in testing
         //play a tune via a RTTTL string, look at https://www.letscontrolit.com/forum/viewtopic.php?f=4&t=343&hilit=speaker&start=10 for more info.
         if (command == F("rtttl"))
         {
@@ -406,14 +488,25 @@ boolean Plugin_001(byte function, struct EventStruct *event, String& string)
             String tmpString=string;
             tmpString.replace('-', '#');
             // tmpString.toCharArray(sng, 1024);
-            play_rtttl(event->Par1, tmpString.c_str());
+            const bool queued = play_rtttl(event->Par1, tmpString.c_str());
             setPinState(PLUGIN_ID_001, event->Par1, PIN_MODE_OUTPUT, event->Par2);
             log = String(F("SW   : ")) + string;
+            if (!queued) log += F(" not played, invalid or queue full");
             addLog(LOG_LEVEL_INFO, log);
             SendStatus(event->Source, getPinStateJSON(SEARCH_PIN_STATE, PLUGIN_ID_001, event->Par1, log, 0));
           }
         }
 
+        //stop the tone or melody playing and drop the queued ones.
+        if (command == F("tonestop"))
+        {
+          success = true;
+          tonePlayerStop();
+          log = String(F("SW   : ")) + string;
+          addLog(LOG_LEVEL_INFO, log);
+          SendStatus(event->Source, log);
+        }
+
         //play a tone on pin par1, with frequency par2 and duration par3.
         if (command == F("tone"))
         {
@@ -443,6 +536,78 @@ boolean Plugin_001(byte function, struct EventStruct *event, String& string)
 }
 
 
+/*********************************************************************************************\
+ * Edge capture interrupt handlers
+\*********************************************************************************************/
+void Plugin_001_edge(byte slot)
+{
+  pushInterruptEvent(Plugin_001_interruptTask[slot], 0, digitalRead(Plugin_001_interruptPin[slot]));
+}
+void Plugin_001_edge_interrupt1()
+{
+  Plugin_001_edge(0);
+}
+void Plugin_001_edge_interrupt2()
+{
+  Plugin_001_edge(1);
+}
+void Plugin_001_edge_interrupt3()
+{
+  Plugin_001_edge(2);
+}
+void Plugin_001_edge_interrupt4()
+{
+  Plugin_001_edge(3);
+}
+
+bool Plugin_001_attach(byte TaskIndex, int8_t pin)
+{
+  if (pin < 0) return false;
+  for (byte slot = 0; slot < PLUGIN_001_INTERRUPT_MAX; slot++) {
+    if (Plugin_001_interruptTask[slot] != -1) continue;
+    Plugin_001_interruptPin[slot] = pin;
+    Plugin_001_interruptTask[slot] = TaskIndex;
+    switch (slot) {
+      case 0: attachInterrupt(pin, Plugin_001_edge_interrupt1, CHANGE); break;
+      case 1: attachInterrupt(pin, Plugin_001_edge_interrupt2, CHANGE); break;
+      case 2: attachInterrupt(pin, Plugin_001_edge_interrupt3, CHANGE); break;
+      case 3: attachInterrupt(pin, Plugin_001_edge_interrupt4, CHANGE); break;
+    }
+    return true;
+  }
+  addLog(LOG_LEVEL_ERROR, F("SW   : Error, only 4 tasks can use edge capture, polling the pin."));
+  return false;
+}
+
+// Play steps on a GPIO by the output sequencer, the active level of the steps is 'state'.
+// A pattern still playing on the pin is replaced. False when no sequencer is free.
+boolean Plugin_001_sequence(int8_t pin, byte state, const uint32_t* steps, byte count)
+{
+  const int8_t pins[1] = { pin };
+  clearSystemTimer(PLUGIN_ID_001, pin);
+  const int slot = outputSequencerBegin(PLUGIN_ID_001, -1, pins, 1, state == 0, true);
+  if (slot < 0) return false;
+  if (outputSequencerQueue(slot, steps, count)) return true;
+  outputSequencerEnd(slot);
+  return false;
+}
+
+// A gpio command ends the pulses playing on the pin.
+void Plugin_001_stopPulse(int8_t pin)
+{
+  outputSequencerEnd(outputSequencerFind(PLUGIN_ID_001, -1, pin));
+  clearSystemTimer(PLUGIN_ID_001, pin);
+}
+
+void Plugin_001_detach(byte TaskIndex)
+{
+  for (byte slot = 0; slot < PLUGIN_001_INTERRUPT_MAX; slot++) {
+    if (Plugin_001_interruptTask[slot] != TaskIndex) continue;
+    detachInterrupt(Plugin_001_interruptPin[slot]);
+    Plugin_001_interruptTask[slot] = -1;
+  }
+}
+
 #if defined(ESP32)
 void analogWriteESP32(int pin, int value)
 {
@@ -7,6 +7,9 @@
 #define PLUGIN_ID_002         2
 #define PLUGIN_NAME_002       "Analog input - internal"
 #define PLUGIN_VALUENAME1_002 "Analog"
+#define PLUGIN_VALUENAME2_002 "RMS"
+#define PLUGIN_VALUENAME3_002 "Min"
+#define PLUGIN_VALUENAME4_002 "Max"
 
 uint32_t Plugin_002_OversamplingValue = 0;
 uint16_t Plugin_002_OversamplingCount = 0;
@@ -27,10 +30,11 @@ boolean Plugin_002(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].PullUpOption = false;
         Device[deviceCount].InverseLogicOption = false;
         Device[deviceCount].FormulaOption = true;
-        Device[deviceCount].ValueCount = 1;
+        Device[deviceCount].ValueCount = 4;
         Device[deviceCount].SendDataOption = true;
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND;
         break;
       }
 
@@ -43,6 +47,9 @@ boolean Plugin_002(byte function, struct EventStruct *event, String& string)
     case PLUGIN_GET_DEVICEVALUENAMES:
       {
         strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_002));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], PSTR(PLUGIN_VALUENAME2_002));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[2], PSTR(PLUGIN_VALUENAME3_002));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[3], PSTR(PLUGIN_VALUENAME4_002));
         break;
       }
 
@@ -55,6 +62,17 @@ boolean Plugin_002(byte function, struct EventStruct *event, String& string)
 
         addFormCheckBox(F("Oversampling"), F("plugin_002_oversampling"), Settings.TaskDevicePluginConfig[event->TaskIndex][0]);
 
+        addFormSubHeader(F("Background Sampling"));
+
+        addFormNumericBox(F("Sample rate"), F("plugin_002_rate"), Settings.TaskDevicePluginConfig[event->TaskIndex][1], 0, ADC_SAMPLING_RATE_MAX);
+        addUnit(F("Hz"));
+        addFormNote(F("0 = off. Sends mean, RMS (AC part), min and max of the samples taken since the last read."));
+        {
+          String outputOptions[2] = { F("Max"), F("Peak-to-peak") };
+          int outputValues[2] = { 0, 1 };
+          addFormSelector(F("Fourth value"), F("plugin_002_fourth"), 2, outputOptions, outputValues, Settings.TaskDevicePluginConfig[event->TaskIndex][2]);
+        }
+
         addFormSubHeader(F("Two Point Calibration"));
 
         addFormCheckBox(F("Calibration Enabled"), F("plugin_002_cal"), Settings.TaskDevicePluginConfig[event->TaskIndex][3]);
@@ -74,6 +92,8 @@ boolean Plugin_002(byte function, struct EventStruct *event, String& string)
     case PLUGIN_WEBFORM_SAVE:
       {
         Settings.TaskDevicePluginConfig[event->TaskIndex][0] = isFormItemChecked(F("plugin_002_oversampling"));
+        Settings.TaskDevicePluginConfig[event->TaskIndex][1] = getFormItemInt(F("plugin_002_rate"));
+        Settings.TaskDevicePluginConfig[event->TaskIndex][2] = getFormItemInt(F("plugin_002_fourth"));
 
         Settings.TaskDevicePluginConfig[event->TaskIndex][3] = isFormItemChecked(F("plugin_002_cal"));
 
@@ -87,9 +107,31 @@ boolean Plugin_002(byte function, struct EventStruct *event, String& string)
         break;
       }
 
+    case PLUGIN_INIT:
+      {
+        adcSamplingEnd(event->TaskIndex);
+        if (Settings.TaskDevicePluginConfig[event->TaskIndex][1] > 0)
+        {
+          #if defined(ESP8266)
+            adcSamplingBegin(event->TaskIndex, A0, Settings.TaskDevicePluginConfig[event->TaskIndex][1]);
+          #endif
+          #if defined(ESP32)
+            adcSamplingBegin(event->TaskIndex, Settings.TaskDevicePin1[event->TaskIndex], Settings.TaskDevicePluginConfig[event->TaskIndex][1]);
+          #endif
+        }
+        success = true;
+        break;
+      }
+
+    case PLUGIN_EXIT:
+      {
+        adcSamplingEnd(event->TaskIndex);
+        break;
+      }
+
     case PLUGIN_TEN_PER_SECOND:
       {
-        if (Settings.TaskDevicePluginConfig[event->TaskIndex][0])   //Oversampling?
+        if (Settings.TaskDevicePluginConfig[event->TaskIndex][0] && Settings.TaskDevicePluginConfig[event->TaskIndex][1] == 0)   //Oversampling?
         {
           #if defined(ESP8266)
             Plugin_002_OversamplingValue += analogRead(A0);
@@ -107,6 +149,30 @@ boolean Plugin_002(byte function, struct EventStruct *event, String& string)
       {
         String log = F("ADC  : Analog value: ");
 
+        float mean, rms, minValue, maxValue;
+        if (adcSamplingResult(event->TaskIndex, mean, rms, minValue, maxValue))
+        {
+          event->sensorType = SENSOR_TYPE_QUAD;
+          UserVar[event->BaseVarIndex] = Plugin_002_calibrate(event, mean);
+          UserVar[event->BaseVarIndex + 1] = rms * Plugin_002_calibrationSlope(event);
+          UserVar[event->BaseVarIndex + 2] = Plugin_002_calibrate(event, minValue);
+          UserVar[event->BaseVarIndex + 3] = Plugin_002_calibrate(event, maxValue);
+          if (Settings.TaskDevicePluginConfig[event->TaskIndex][2] == 1)
+            UserVar[event->BaseVarIndex + 3] -= UserVar[event->BaseVarIndex + 2];
+          if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+            log += String(UserVar[event->BaseVarIndex], 3);
+            log += F(" RMS: ");
+            log += String(UserVar[event->BaseVarIndex + 1], 3);
+            log += F(" min: ");
+            log += String(UserVar[event->BaseVarIndex + 2], 3);
+            log += Settings.TaskDevicePluginConfig[event->TaskIndex][2] == 1 ? F(" p-p: ") : F(" max: ");
+            log += String(UserVar[event->BaseVarIndex + 3], 3);
+            addLog(LOG_LEVEL_INFO, log);
+          }
+          success = true;
+          break;
+        }
+
         if (Plugin_002_OversamplingCount > 0)
         {
           UserVar[event->BaseVarIndex] = (float)Plugin_002_OversamplingValue / Plugin_002_OversamplingCount;
@@ -128,20 +194,12 @@ boolean Plugin_002(byte function, struct EventStruct *event, String& string)
           log += value;
         }
 
-        if (Settings.TaskDevicePluginConfig[event->TaskIndex][3])   //Calibration?
+        const float raw = UserVar[event->BaseVarIndex];
+        UserVar[event->BaseVarIndex] = Plugin_002_calibrate(event, raw);
+        if (UserVar[event->BaseVarIndex] != raw)
         {
-          int adc1 = Settings.TaskDevicePluginConfigLong[event->TaskIndex][0];
-          int adc2 = Settings.TaskDevicePluginConfigLong[event->TaskIndex][1];
-          float out1 = Settings.TaskDevicePluginConfigFloat[event->TaskIndex][0];
-          float out2 = Settings.TaskDevicePluginConfigFloat[event->TaskIndex][1];
-          if (adc1 != adc2)
-          {
-            float normalized = (float)(UserVar[event->BaseVarIndex] - adc1) / (float)(adc2 - adc1);
-            UserVar[event->BaseVarIndex] = normalized * (out2 - out1) + out1;
-
-            log += F(" = ");
-            log += String(UserVar[event->BaseVarIndex], 3);
-          }
+          log += F(" = ");
+          log += String(UserVar[event->BaseVarIndex], 3);
         }
 
         addLog(LOG_LEVEL_INFO,log);
@@ -151,4 +209,35 @@ boolean Plugin_002(byte function, struct EventStruct *event, String& string)
   }
   return success;
 }
+
+// Two point calibration, when enabled
+float Plugin_002_calibrate(struct EventStruct *event, float value)
+{
+  if (Settings.TaskDevicePluginConfig[event->TaskIndex][3])   //Calibration?
+  {
+    int adc1 = Settings.TaskDevicePluginConfigLong[event->TaskIndex][0];
+    int adc2 = Settings.TaskDevicePluginConfigLong[event->TaskIndex][1];
+    float out1 = Settings.TaskDevicePluginConfigFloat[event->TaskIndex][0];
+    float out2 = Settings.TaskDevicePluginConfigFloat[event->TaskIndex][1];
+    if (adc1 != adc2)
+    {
+      float normalized = (float)(value - adc1) / (float)(adc2 - adc1);
+      return normalized * (out2 - out1) + out1;
+    }
+  }
+  return value;
+}
+
+// Output units per ADC count, to scale a difference like the RMS value
+float Plugin_002_calibrationSlope(struct EventStruct *event)
+{
+  if (Settings.TaskDevicePluginConfig[event->TaskIndex][3])
+  {
+    int adc1 = Settings.TaskDevicePluginConfigLong[event->TaskIndex][0];
+    int adc2 = Settings.TaskDevicePluginConfigLong[event->TaskIndex][1];
+    if (adc1 != adc2)
+      return (Settings.TaskDevicePluginConfigFloat[event->TaskIndex][1] - Settings.TaskDevicePluginConfigFloat[event->TaskIndex][0]) / (float)(adc2 - adc1);
+  }
+  return 1.0;
+}
 #endif // USES_P002
@@ -15,16 +15,46 @@ void Plugin_003_pulse_interrupt1() ICACHE_RAM_ATTR;
 void Plugin_003_pulse_interrupt2() ICACHE_RAM_ATTR;
 void Plugin_003_pulse_interrupt3() ICACHE_RAM_ATTR;
 void Plugin_003_pulse_interrupt4() ICACHE_RAM_ATTR;
+void Plugin_003_pulsecheck(byte Index) HOT_IRAM_ATTR;
 //this takes 20 bytes of IRAM per handler
 // void Plugin_003_pulse_interrupt5() ICACHE_RAM_ATTR;
 // void Plugin_003_pulse_interrupt6() ICACHE_RAM_ATTR;
 // void Plugin_003_pulse_interrupt7() ICACHE_RAM_ATTR;
 // void Plugin_003_pulse_interrupt8() ICACHE_RAM_ATTR;
 
-unsigned long Plugin_003_pulseCounter[TASKS_MAX];
-unsigned long Plugin_003_pulseTotalCounter[TASKS_MAX];
-unsigned long Plugin_003_pulseTime[TASKS_MAX];
-unsigned long Plugin_003_pulseTimePrevious[TASKS_MAX];
+// The counters of a task, kept over a new PLUGIN_INIT. Written by the interrupt.
+struct P003_data_struct : public PluginTaskData_base
+{
+  P003_data_struct() : pulseCounter(0), pulseTotalCounter(0), pulseTime(0), pulseTimePrevious(0) {}
+
+  volatile unsigned long pulseCounter;
+  volatile unsigned long pulseTotalCounter;
+  volatile unsigned long pulseTime;
+  volatile unsigned long pulseTimePrevious;
+};
+
+struct P003_data_struct* Plugin_003_data(byte TaskIndex)
+{
+  return static_cast<P003_data_struct*>(getPluginTaskData(TaskIndex));
+}
+
+#if defined(ESP32)
+  // Hardware pulse counter, used when the debounce time is 0. The counter wraps at
+  // PLUGIN_003_PCNT_LIMIT and is polled 10x per second, so it counts up to 327k edges
+  // per second. The glitch filter ignores levels shorter than its number of APB clock
+  // cycles (80 MHz), which limits a square wave to 80 MHz / (2 * cycles): 39 kHz for
+  // the default of 1023 cycles (12.8 usec). The filter is selected per task, in
+  // TaskDevicePluginConfig[3], an index in Plugin_003_pcntFilters.
+  #include <driver/pcnt.h>
+  #define PLUGIN_003_PCNT_LIMIT   32767
+  #define PLUGIN_003_PCNT_POLLS      10   // Per second
+  #define PLUGIN_003_PCNT_FILTERS     4
+  const uint16_t Plugin_003_pcntFilters[PLUGIN_003_PCNT_FILTERS] = { 1023, 512, 128, 0 };  // APB clock cycles, 0 = off
+
+  int8_t Plugin_003_pcntTask[PCNT_UNIT_MAX] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+  int16_t Plugin_003_pcntLast[PCNT_UNIT_MAX];
+  unsigned long Plugin_003_pcntLastPulse[PCNT_UNIT_MAX];
+#endif
 
 boolean Plugin_003(byte function, struct EventStruct *event, String& string)
 {
@@ -46,6 +76,9 @@ boolean Plugin_003(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].SendDataOption = true;
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].GlobalSyncOption = true;
+        #if defined(ESP32)
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND;
+        #endif
         break;
       }
 
@@ -67,6 +100,17 @@ boolean Plugin_003(byte function, struct EventStruct *event, String& string)
       {
       	addFormNumericBox(F("Debounce Time (mSec)"), F("plugin_003")
       			, Settings.TaskDevicePluginConfig[event->TaskIndex][0]);
+        #if defined(ESP32)
+        addFormNote(F("0 uses the hardware pulse counter, for high pulse rates (not with Mode Type LOW)"));
+        {
+          String filters[PLUGIN_003_PCNT_FILTERS];
+          for (byte x = 0; x < PLUGIN_003_PCNT_FILTERS; ++x)
+            filters[x] = Plugin_003_pcntFilterName(x);
+          addFormSelector(F("Glitch Filter"), F("plugin_003_filter"), PLUGIN_003_PCNT_FILTERS, filters, NULL,
+                          Settings.TaskDevicePluginConfig[event->TaskIndex][3]);
+          addFormNote(F("Hardware pulse counter only, levels shorter than the filter are ignored"));
+        }
+        #endif
 
         byte choice = Settings.TaskDevicePluginConfig[event->TaskIndex][1];
         byte choice2 = Settings.TaskDevicePluginConfig[event->TaskIndex][2];
@@ -98,25 +142,31 @@ boolean Plugin_003(byte function, struct EventStruct *event, String& string)
         Settings.TaskDevicePluginConfig[event->TaskIndex][0] = getFormItemInt(F("plugin_003"));
         Settings.TaskDevicePluginConfig[event->TaskIndex][1] = getFormItemInt(F("plugin_003_countertype"));
         Settings.TaskDevicePluginConfig[event->TaskIndex][2] = getFormItemInt(F("plugin_003_raisetype"));
+        #if defined(ESP32)
+        Settings.TaskDevicePluginConfig[event->TaskIndex][3] = getFormItemInt(F("plugin_003_filter"));
+        #endif
         success = true;
         break;
       }
 
     case PLUGIN_WEBFORM_SHOW_VALUES:
       {
+        P003_data_struct* data = Plugin_003_data(event->TaskIndex);
+        if (data == NULL)
+          break;
         string += F("<div class=\"div_l\">");
         string += ExtraTaskSettings.TaskDeviceValueNames[0];
         string += F(":</div><div class=\"div_r\">");
-        string += Plugin_003_pulseCounter[event->TaskIndex];
+        string += data->pulseCounter;
         string += F("</div><div class=\"div_br\"></div><div class=\"div_l\">");
         string += ExtraTaskSettings.TaskDeviceValueNames[1];
         string += F(":</div><div class=\"div_r\">");
-        string += Plugin_003_pulseTotalCounter[event->TaskIndex];
+        string += data->pulseTotalCounter;
         string += F("</div><div class=\"div_br\"></div><div class=\"div_l\">");
         string += ExtraTaskSettings.TaskDeviceValueNames[2];
         string += F(":</div><div class=\"div_r\">");
-        string += Plugin_003_pulseTime[event->TaskIndex];
-        string += F("</div>");
+        string += data->pulseTime;
+        string += getWebString(WEB_STR_DIV_END);
         success = true;
         break;
       }
@@ -127,47 +177,90 @@ boolean Plugin_003(byte function, struct EventStruct *event, String& string)
         log += Settings.TaskDevicePin1[event->TaskIndex];
         addLog(LOG_LEVEL_INFO,log);
         pinMode(Settings.TaskDevicePin1[event->TaskIndex], INPUT_PULLUP);
+        if (Plugin_003_data(event->TaskIndex) == NULL)
+          initPluginTaskData(event->TaskIndex, new P003_data_struct(), sizeof(P003_data_struct));
+        if (Plugin_003_data(event->TaskIndex) == NULL)
+          break;
+        #if defined(ESP32)
+        Plugin_003_pcntRelease(event->TaskIndex);
+        if (Settings.TaskDevicePluginConfig[event->TaskIndex][0] == 0 &&
+            Plugin_003_pcntInit(Settings.TaskDevicePin1[event->TaskIndex], event->TaskIndex, Settings.TaskDevicePluginConfig[event->TaskIndex][2],
+                                Settings.TaskDevicePluginConfig[event->TaskIndex][3])) {
+          success = true;
+          break;
+        }
+        #endif
         success = Plugin_003_pulseinit(Settings.TaskDevicePin1[event->TaskIndex], event->TaskIndex,Settings.TaskDevicePluginConfig[event->TaskIndex][2]);
         break;
       }
 
+    case PLUGIN_EXIT:
+      {
+        // Before the core deletes the counters
+        detachInterrupt(Settings.TaskDevicePin1[event->TaskIndex]);
+        #if defined(ESP32)
+        Plugin_003_pcntRelease(event->TaskIndex);
+        #endif
+        break;
+      }
+
+    #if defined(ESP32)
+    case PLUGIN_TEN_PER_SECOND:
+      {
+        Plugin_003_pcntUpdate(event->TaskIndex);
+        success = true;
+        break;
+      }
+    #endif
+
     case PLUGIN_READ:
       {
-        UserVar[event->BaseVarIndex] = Plugin_003_pulseCounter[event->TaskIndex];
-        UserVar[event->BaseVarIndex+1] = Plugin_003_pulseTotalCounter[event->TaskIndex];
-        UserVar[event->BaseVarIndex+2] = Plugin_003_pulseTime[event->TaskIndex];
+        P003_data_struct* data = Plugin_003_data(event->TaskIndex);
+        if (data == NULL)
+          break;
+        #if defined(ESP32)
+        Plugin_003_pcntUpdate(event->TaskIndex);
+        #endif
+        UserVar[event->BaseVarIndex] = data->pulseCounter;
+        UserVar[event->BaseVarIndex+1] = data->pulseTotalCounter;
+        UserVar[event->BaseVarIndex+2] = data->pulseTime;
 
         switch (Settings.TaskDevicePluginConfig[event->TaskIndex][1])
         {
           case 0:
           {
             event->sensorType = SENSOR_TYPE_SINGLE;
-            UserVar[event->BaseVarIndex] = Plugin_003_pulseCounter[event->TaskIndex];
+            UserVar[event->BaseVarIndex] = data->pulseCounter;
             break;
           }
           case 1:
           {
             event->sensorType = SENSOR_TYPE_TRIPLE;
-            UserVar[event->BaseVarIndex] = Plugin_003_pulseCounter[event->TaskIndex];
-            UserVar[event->BaseVarIndex+1] = Plugin_003_pulseTotalCounter[event->TaskIndex];
-            UserVar[event->BaseVarIndex+2] = Plugin_003_pulseTime[event->TaskIndex];
+            UserVar[event->BaseVarIndex] = data->pulseCounter;
+            UserVar[event->BaseVarIndex+1] = data->pulseTotalCounter;
+            UserVar[event->BaseVarIndex+2] = data->pulseTime;
             break;
           }
           case 2:
           {
             event->sensorType = SENSOR_TYPE_SINGLE;
-            UserVar[event->BaseVarIndex] = Plugin_003_pulseTotalCounter[event->TaskIndex];
+            UserVar[event->BaseVarIndex] = data->pulseTotalCounter;
             break;
           }
           case 3:
           {
             event->sensorType = SENSOR_TYPE_DUAL;
-            UserVar[event->BaseVarIndex] = Plugin_003_pulseCounter[event->TaskIndex];
-            UserVar[event->BaseVarIndex+1] = Plugin_003_pulseTotalCounter[event->TaskIndex];
+            UserVar[event->BaseVarIndex] = data->pulseCounter;
+            UserVar[event->BaseVarIndex+1] = data->pulseTotalCounter;
             break;
           }
         }
-        Plugin_003_pulseCounter[event->TaskIndex] = 0;
+        // The total as integer, a float loses counts above 2^24
+        if (Settings.TaskDevicePluginConfig[event->TaskIndex][1] == 2)
+          setTaskValueInt64(event->TaskIndex, 0, data->pulseTotalCounter);
+        else if (Settings.TaskDevicePluginConfig[event->TaskIndex][1] != 0)
+          setTaskValueInt64(event->TaskIndex, 1, data->pulseTotalCounter);
+        data->pulseCounter = 0;
         success = true;
         break;
       }
@@ -181,13 +274,17 @@ boolean Plugin_003(byte function, struct EventStruct *event, String& string)
 \*********************************************************************************************/
 void Plugin_003_pulsecheck(byte Index)
 {
-  const unsigned long PulseTime=timePassedSince(Plugin_003_pulseTimePrevious[Index]);
+  // Read directly, with FEATURE_IRAM_HOT the interrupt then does not call code in flash
+  P003_data_struct* data = static_cast<P003_data_struct*>(pluginTaskData[Index].data);
+  if (data == NULL)
+    return;
+  const unsigned long PulseTime=timePassedSince(data->pulseTimePrevious);
   if(PulseTime > (unsigned long)Settings.TaskDevicePluginConfig[Index][0]) // check with debounce time for this task
     {
-      Plugin_003_pulseCounter[Index]++;
-      Plugin_003_pulseTotalCounter[Index]++;
-      Plugin_003_pulseTime[Index] = PulseTime;
-      Plugin_003_pulseTimePrevious[Index]=millis();
+      data->pulseCounter++;
+      data->pulseTotalCounter++;
+      data->pulseTime = PulseTime;
+      data->pulseTimePrevious=millis();
     }
 }
 
@@ -268,4 +365,107 @@ bool Plugin_003_pulseinit(byte Par1, byte Index, byte Mode)
 
   return(true);
 }
+
+#if defined(ESP32)
+/*********************************************************************************************\
+ * Hardware pulse counter (PCNT), no CPU time per pulse
+\*********************************************************************************************/
+uint16_t Plugin_003_pcntFilterCycles(int filter)
+{
+  return (filter >= 0 && filter < PLUGIN_003_PCNT_FILTERS) ? Plugin_003_pcntFilters[filter] : Plugin_003_pcntFilters[0];
+}
+
+// The filter and the highest square wave frequency it passes, e.g. "12.8 usec (max. 39 kHz)"
+String Plugin_003_pcntFilterName(int filter)
+{
+  const uint16_t cycles = Plugin_003_pcntFilterCycles(filter);
+  // Without filter the polling of the counter is the limit.
+  const unsigned long maxHz = cycles == 0 ? static_cast<unsigned long>(PLUGIN_003_PCNT_LIMIT) * PLUGIN_003_PCNT_POLLS
+                                          : 80000000UL / (2UL * cycles);
+  String name;
+  if (cycles == 0) {
+    name = F("Off");
+  } else {
+    name = toString(cycles / 80.0, 1);
+    name += F(" usec");
+  }
+  name += F(" (max. ");
+  name += maxHz / 1000;
+  name += F(" kHz)");
+  return name;
+}
+
+bool Plugin_003_pcntInit(int8_t pin, byte TaskIndex, byte Mode, int filter)
+{
+  if (pin < 0 || (Mode != RISING && Mode != FALLING && Mode != CHANGE))
+    return false;
+  int unit = 0;
+  while (unit < PCNT_UNIT_MAX && Plugin_003_pcntTask[unit] != -1) ++unit;
+  if (unit == PCNT_UNIT_MAX) {
+    addLog(LOG_LEVEL_ERROR, F("PULSE: No hardware counter left, using the interrupt"));
+    return false;
+  }
+  pcnt_config_t config;
+  memset(&config, 0, sizeof(config));
+  config.pulse_gpio_num = pin;
+  config.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+  config.channel = PCNT_CHANNEL_0;
+  config.unit = static_cast<pcnt_unit_t>(unit);
+  config.pos_mode = (Mode == FALLING) ? PCNT_COUNT_DIS : PCNT_COUNT_INC;
+  config.neg_mode = (Mode == RISING) ? PCNT_COUNT_DIS : PCNT_COUNT_INC;
+  config.lctrl_mode = PCNT_MODE_KEEP;
+  config.hctrl_mode = PCNT_MODE_KEEP;
+  config.counter_h_lim = PLUGIN_003_PCNT_LIMIT;
+  config.counter_l_lim = 0;
+  if (pcnt_unit_config(&config) != ESP_OK)
+    return false;
+  const uint16_t filterCycles = Plugin_003_pcntFilterCycles(filter);
+  if (filterCycles != 0) {
+    pcnt_set_filter_value(config.unit, filterCycles);
+    pcnt_filter_enable(config.unit);
+  } else {
+    pcnt_filter_disable(config.unit);
+  }
+  pcnt_counter_pause(config.unit);
+  pcnt_counter_clear(config.unit);
+  pcnt_counter_resume(config.unit);
+  Plugin_003_pcntTask[unit] = TaskIndex;
+  Plugin_003_pcntLast[unit] = 0;
+  Plugin_003_pcntLastPulse[unit] = millis();
+  String log = F("PULSE: Hardware counter ");
+  log += unit;
+  addLog(LOG_LEVEL_INFO, log);
+  return true;
+}
+
+void Plugin_003_pcntRelease(byte TaskIndex)
+{
+  for (int unit = 0; unit < PCNT_UNIT_MAX; ++unit) {
+    if (Plugin_003_pcntTask[unit] != TaskIndex) continue;
+    pcnt_counter_pause(static_cast<pcnt_unit_t>(unit));
+    Plugin_003_pcntTask[unit] = -1;
+  }
+}
+
+// Add the pulses counted since the last call. The time between pulses is the
+// average over that period, there is no time stamp per pulse.
+void Plugin_003_pcntUpdate(byte TaskIndex)
+{
+  for (int unit = 0; unit < PCNT_UNIT_MAX; ++unit) {
+    if (Plugin_003_pcntTask[unit] != TaskIndex) continue;
+    int16_t value = 0;
+    if (pcnt_get_counter_value(static_cast<pcnt_unit_t>(unit), &value) != ESP_OK) return;
+    long pulses = value - Plugin_003_pcntLast[unit];
+    if (pulses < 0) pulses += PLUGIN_003_PCNT_LIMIT;  // Wrapped at the limit
+    Plugin_003_pcntLast[unit] = value;
+    P003_data_struct* data = Plugin_003_data(TaskIndex);
+    if (pulses == 0 || data == NULL) return;
+    data->pulseCounter += pulses;
+    data->pulseTotalCounter += pulses;
+    data->pulseTime = timePassedSince(Plugin_003_pcntLastPulse[unit]) / pulses;
+    Plugin_003_pcntLastPulse[unit] = millis();
+    return;
+  }
+}
+#endif
 #endif // USES_P003
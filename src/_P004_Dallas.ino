@@ -13,10 +13,35 @@
 #define PLUGIN_004
 #define PLUGIN_ID_004         4
 #define PLUGIN_NAME_004       "Environment - DS18b20"
-#define PLUGIN_VALUENAME1_004 "Temperature"
+#define PLUGIN_VALUENAME1_004 WEB_STR_TEMPERATURE
+
+#include <map>
 
 int8_t Plugin_004_DallasPin;
 
+// ROM address and resolution of a task, cached at PLUGIN_INIT
+struct P004_sensor {
+    P004_sensor() : pin(-1), resolution(12) {
+        memset(rom, 0, sizeof(rom));
+    }
+
+    uint8_t rom[8];
+    int8_t pin;
+    byte resolution;
+};
+
+// All sensors on one GPIO convert together, started by the first task that reads.
+// Tasks reading while the conversion runs share it.
+struct P004_bus {
+    P004_bus() : readyAt(0), converting(false) {}
+
+    unsigned long readyAt;
+    bool converting;
+};
+
+std::map<byte, P004_sensor> Plugin_004_sensors;
+std::map<int8_t, P004_bus> Plugin_004_buses;
+
 boolean Plugin_004(byte function, struct EventStruct * event, String& string)
 {
     boolean success = false;
@@ -47,7 +72,7 @@ boolean Plugin_004(byte function, struct EventStruct * event, String& string)
 
         case PLUGIN_GET_DEVICEVALUENAMES:
         {
-            strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_004));
+            strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], getWebStringP(PLUGIN_VALUENAME1_004));
             break;
         }
 
@@ -131,51 +156,93 @@ boolean Plugin_004(byte function, struct EventStruct * event, String& string)
         }
         case PLUGIN_INIT:
         {
+            Plugin_004_sensors.erase(event->TaskIndex);
             Plugin_004_DallasPin = Settings.TaskDevicePin1[event->TaskIndex];
             if (Plugin_004_DallasPin != -1){
-              uint8_t addr[8];
-              Plugin_004_get_addr(addr, event->TaskIndex);
-              Plugin_004_DS_startConvertion(addr);
-              delay(800); //give it time to do intial conversion
+              P004_sensor& sensor = Plugin_004_sensors[event->TaskIndex];
+              Plugin_004_get_addr(sensor.rom, event->TaskIndex);
+              sensor.pin = Plugin_004_DallasPin;
+              if (sensor.rom[0] != 0) {
+                  sensor.resolution = Plugin_004_DS_getResolution(sensor.rom);
+                  if (sensor.resolution == 0) sensor.resolution = 12;
+              }
+              // First read soon, tasks on the same bus then share the conversion.
+              schedule_task_device_timer(event->TaskIndex, millis() + 100);
             }
             success = true;
             break;
         }
 
-        case PLUGIN_READ:
+        case PLUGIN_EXIT:
         {
-            if (ExtraTaskSettings.TaskDevicePluginConfigLong[0] != 0){
-                uint8_t addr[8];
-                Plugin_004_get_addr(addr, event->TaskIndex);
-
-                Plugin_004_DallasPin = Settings.TaskDevicePin1[event->TaskIndex];
-                float value = 0;
-                String log  = F("DS   : Temperature: ");
+            Plugin_004_sensors.erase(event->TaskIndex);
+            break;
+        }
 
-                if (Plugin_004_DS_readTemp(addr, &value))
-                {
-                    UserVar[event->BaseVarIndex] = value;
-                    log    += UserVar[event->BaseVarIndex];
-                    success = true;
-                }
-                else
+        case PLUGIN_READ:
+        {
+            // Start or join the conversion of the bus, the value is read in PLUGIN_TIMER_IN.
+            auto it = Plugin_004_sensors.find(event->TaskIndex);
+            if (it == Plugin_004_sensors.end() || it->second.rom[0] == 0)
+                break;
+            Plugin_004_DallasPin = it->second.pin;
+            P004_bus& bus = Plugin_004_buses[Plugin_004_DallasPin];
+            if (!bus.converting || timeOutReached(bus.readyAt))
+            {
+                if (!Plugin_004_DS_startConvertionAll())
                 {
                     UserVar[event->BaseVarIndex] = NAN;
-                    log += F("Error!");
+                    addLog(LOG_LEVEL_INFO, F("DS   : No devices on the bus"));
+                    break;
                 }
-                Plugin_004_DS_startConvertion(addr);
+                bus.converting = true;
+                bus.readyAt = millis() + Plugin_004_conversionTime(Plugin_004_DallasPin);
+            }
+            long wait = timeDiff(millis(), bus.readyAt);
+            if (wait < 1) wait = 1;
+            startTaskConversion(event, PLUGIN_ID_004, wait, 0);
+            break;
+        }
 
+        case PLUGIN_TIMER_IN:
+        {
+            if (!isTaskConversionTimer(event))
+                break;
+            auto it = Plugin_004_sensors.find(event->TaskIndex);
+            if (it == Plugin_004_sensors.end())
+            {
+                completeTaskConversion(event, false);
+                break;
+            }
+            P004_sensor& sensor = it->second;
+            Plugin_004_DallasPin = sensor.pin;
+            float value = 0;
+            String log  = F("DS   : Temperature: ");
+            const bool read = Plugin_004_DS_readTemp(sensor.rom, &value);
+            if (read)
+            {
+                UserVar[event->BaseVarIndex] = value;
+                log += UserVar[event->BaseVarIndex];
+            }
+            else
+            {
+                UserVar[event->BaseVarIndex] = NAN;
+                log += F("Error!");
+            }
+            if (loglevelActiveFor(LOG_LEVEL_INFO))
+            {
                 log += (" (");
                 for (byte x = 0; x < 8; x++)
                 {
                     if (x != 0)
                         log += "-";
-                    log += String(ExtraTaskSettings.TaskDevicePluginConfigLong[x], HEX);
+                    log += String(sensor.rom[x], HEX);
                 }
-
                 log += ')';
                 addLog(LOG_LEVEL_INFO, log);
             }
+            completeTaskConversion(event, read);
+            success = true;
             break;
         }
     }
@@ -227,6 +294,32 @@ void Plugin_004_DS_startConvertion(uint8_t ROM[8])
     Plugin_004_DS_write(0x44); // Take temperature mesurement
 }
 
+/*********************************************************************************************\
+*  Dallas Start Temperature Conversion of all devices on the bus (Skip ROM).
+*  Returns false when no device answered the reset.
+\*********************************************************************************************/
+boolean Plugin_004_DS_startConvertionAll()
+{
+    if (!Plugin_004_DS_reset())
+        return false;
+    Plugin_004_DS_write(0xCC); // Skip ROM, address all devices
+    Plugin_004_DS_write(0x44); // Take temperature mesurement
+    return true;
+}
+
+// Duration of a conversion of the bus, set by the highest resolution of its sensors.
+unsigned long Plugin_004_conversionTime(int8_t pin)
+{
+    byte resolution = 9;
+    for (auto it = Plugin_004_sensors.begin(); it != Plugin_004_sensors.end(); ++it)
+    {
+        if (it->second.pin == pin && it->second.resolution > resolution)
+            resolution = it->second.resolution;
+    }
+    if (resolution > 12) resolution = 12;
+    return (750UL >> (12 - resolution)) + 1;
+}
+
 /*********************************************************************************************\
 *  Dallas Read temperature from scratchpad
 \*********************************************************************************************/
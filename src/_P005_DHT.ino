@@ -6,10 +6,16 @@
 #define PLUGIN_005
 #define PLUGIN_ID_005         5
 #define PLUGIN_NAME_005       "Environment - DHT11/12/22  SONOFF2301/7021"
-#define PLUGIN_VALUENAME1_005 "Temperature"
-#define PLUGIN_VALUENAME2_005 "Humidity"
+#define PLUGIN_VALUENAME1_005 WEB_STR_TEMPERATURE
+#define PLUGIN_VALUENAME2_005 WEB_STR_HUMIDITY
+
+#define PLUGIN_005_STEP_START     0
+#define PLUGIN_005_STEP_DATA      1
+#define PLUGIN_005_CAPTURE_MSEC  10   // Response and 40 bits take less than 5 msec
+#define PLUGIN_005_CAPTURE_IDLE 500   // usec, longest level is 80 usec
 
 uint8_t Plugin_005_DHT_Pin;
+int8_t Plugin_005_captureChannel[TASKS_MAX];
 
 boolean Plugin_005(byte function, struct EventStruct *event, String& string)
 {
@@ -41,8 +47,8 @@ boolean Plugin_005(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_GET_DEVICEVALUENAMES:
       {
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_005));
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], PSTR(PLUGIN_VALUENAME2_005));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], getWebStringP(PLUGIN_VALUENAME1_005));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], getWebStringP(PLUGIN_VALUENAME2_005));
         break;
       }
 
@@ -67,92 +73,52 @@ boolean Plugin_005(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_READ:
       {
-        byte dht_dat[5];
-        byte i;
-        boolean error = false;
-
         byte Par3 = Settings.TaskDevicePluginConfig[event->TaskIndex][0];
         Plugin_005_DHT_Pin = Settings.TaskDevicePin1[event->TaskIndex];
 
         pinMode(Plugin_005_DHT_Pin, OUTPUT);
         digitalWrite(Plugin_005_DHT_Pin, LOW);              // Pull low
-        if(Par3 == 11 || Par3 == 22 || Par3 == 12)  delay(18);
+        if (Par3 == 11) {
+          // At least 18 msec, a longer start signal is fine. Continued in PLUGIN_TIMER_IN.
+          startTaskConversion(event, PLUGIN_ID_005, 18, PLUGIN_005_STEP_START);
+          break;
+        }
+        if(Par3 == 22 || Par3 == 12)  delay(18);
         else if (Par3 == 23 )         delayMicroseconds(900);
         else if (Par3 == 70 )         delayMicroseconds(500);
-        pinMode(Plugin_005_DHT_Pin, INPUT);                 // change pin to input
-        delayMicroseconds(50);
-
-        error = waitState(0);
-        if(error)
-        {   logError(event, F("DHT  : no Reading !"));
-            break;
-        }
-        error = waitState(1);
-        if(error)
-        {   logError(event, F("DHT  : no Reading !"));
-            break;
-        }
-        noInterrupts();
-        error = waitState(0);
-        if(error)
-        {   logError(event, F("DHT  : no Reading !"));
-            break;
-        }
-        for (i = 0; i < 5; i++)
-        {
-            byte data = Plugin_005_read_dht_dat();
-            if(data == -1)
-            {   logError(event, F("DHT  : protocol timeout!"));
-                break;
-            }
-            dht_dat[i] = data;
-        }
-        interrupts();
-
-              // Checksum calculation is a Rollover Checksum by design!
-        byte dht_check_sum = (dht_dat[0] + dht_dat[1] + dht_dat[2] + dht_dat[3]) & 0xFF; // check check_sum
-        if (dht_dat[4] != dht_check_sum)
-        {
-            logError(event, F("DHT  : checksum error!"));
-            break;
-        }
+        if (Plugin_005_startCapture(event))
+          break;
+        success = Plugin_005_read(event, Par3);
+        break;
+      }
 
-        float temperature = NAN;
-        float humidity = NAN;
-        if (Par3 == 11)
-        {
-          temperature = float(dht_dat[2]); // Temperature
-          humidity = float(dht_dat[0]); // Humidity
-        }
-        else if (Par3 == 12)
-        {
-            temperature = float(dht_dat[2]*10 + (dht_dat[3] & 0x7f)) / 10.0; // Temperature
-            if (dht_dat[3] & 0x80) { temperature = -temperature; } // Negative temperature
-            humidity = float(dht_dat[0]*10+dht_dat[1]) / 10.0; // Humidity
+    case PLUGIN_TIMER_IN:
+      {
+        if (!isTaskConversionTimer(event)) {
+          break;
         }
-        else if (Par3 == 22 || Par3 == 23 || Par3 == 70)
-        {
-          if (dht_dat[2] & 0x80) // negative temperature
-            temperature = -0.1 * word(dht_dat[2] & 0x7F, dht_dat[3]);
-          else
-            temperature = 0.1 * word(dht_dat[2], dht_dat[3]);
-          humidity = 0.1 * word(dht_dat[0], dht_dat[1]); // Humidity
+        success = true;
+        byte Par3 = Settings.TaskDevicePluginConfig[event->TaskIndex][0];
+        Plugin_005_DHT_Pin = Settings.TaskDevicePin1[event->TaskIndex];
+        if (event->Par2 == PLUGIN_005_STEP_START) {
+          if (!Plugin_005_startCapture(event))
+            completeTaskConversion(event, Plugin_005_read(event, Par3));
+          break;
         }
-
-        if (temperature == NAN || humidity == NAN)
-        {     logError(event, F("DHT  : invalid NAN reading !"));
-              break;
+        byte dht_dat[5];
+        pulseCaptureStop(Plugin_005_captureChannel[event->TaskIndex]);
+        if (!Plugin_005_decode(Plugin_005_captureChannel[event->TaskIndex], dht_dat)) {
+          logError(event, F("DHT  : no Reading !"));
+          completeTaskConversion(event, false);
+          break;
         }
+        completeTaskConversion(event, Plugin_005_setValues(event, Par3, dht_dat));
+        break;
+      }
 
-        UserVar[event->BaseVarIndex] = temperature;
-        UserVar[event->BaseVarIndex + 1] = humidity;
-        String log = F("DHT  : Temperature: ");
-        log += UserVar[event->BaseVarIndex];
-        addLog(LOG_LEVEL_INFO, log);
-        log = F("DHT  : Humidity: ");
-        log += UserVar[event->BaseVarIndex + 1];
-        addLog(LOG_LEVEL_INFO, log);
-        success = true;
+    case PLUGIN_EXIT:
+      {
+        pulseCaptureCancel(event->TaskIndex);
         break;
       }
   }
@@ -160,6 +126,141 @@ boolean Plugin_005(byte function, struct EventStruct *event, String& string)
 }
 
 
+/*********************************************************************************************\
+* DHT sub to record the response in the background, after the start signal
+\*********************************************************************************************/
+boolean Plugin_005_startCapture(struct EventStruct *event)
+{
+  const int channel = pulseCaptureStart(event->TaskIndex, Plugin_005_DHT_Pin, PLUGIN_005_CAPTURE_IDLE);
+  if (channel < 0) return false;
+  Plugin_005_captureChannel[event->TaskIndex] = channel;
+  pinMode(Plugin_005_DHT_Pin, INPUT);                 // release the line, the sensor answers
+  startTaskConversion(event, PLUGIN_ID_005, PLUGIN_005_CAPTURE_MSEC, PLUGIN_005_STEP_DATA);
+  return true;
+}
+
+/*********************************************************************************************\
+* DHT sub to decode the recorded response
+* Each bit is a 50 usec low level and a high level of 26-28 usec (0) or 70 usec (1).
+* The data bits are the last 40 high levels, before them are the release of the
+* line and the 80 usec response of the sensor.
+\*********************************************************************************************/
+boolean Plugin_005_decode(int channel, byte dht_dat[5])
+{
+  uint8_t highs[PULSE_CAPTURE_MAX_EDGES / 2 + 1];
+  byte nrHighs = 0;
+  bool level;
+  long duration;
+  for (byte segment = 0; (duration = pulseCaptureSegment(channel, segment, level)) >= 0; ++segment)
+  {
+    if (level && nrHighs < sizeof(highs))
+      highs[nrHighs++] = duration > 255 ? 255 : duration;
+  }
+  if (nrHighs < 41)
+    return false;
+  memset(dht_dat, 0, 5);
+  const byte first = nrHighs - 40;
+  for (byte bit = 0; bit < 40; ++bit)
+  {
+    if (highs[first + bit] > 49)
+      dht_dat[bit / 8] |= (1 << (7 - (bit % 8)));
+  }
+  return true;
+}
+
+/*********************************************************************************************\
+* DHT sub to read the sensor after the start signal, busy waiting on the pin
+\*********************************************************************************************/
+boolean Plugin_005_read(struct EventStruct *event, byte Par3)
+{
+  byte dht_dat[5];
+  byte i;
+  boolean error = false;
+
+  pinMode(Plugin_005_DHT_Pin, INPUT);                 // change pin to input
+  delayMicroseconds(50);
+
+  error = waitState(0);
+  if(error)
+  {   logError(event, F("DHT  : no Reading !"));
+      return false;
+  }
+  error = waitState(1);
+  if(error)
+  {   logError(event, F("DHT  : no Reading !"));
+      return false;
+  }
+  noInterrupts();
+  error = waitState(0);
+  if(error)
+  {   interrupts();
+      logError(event, F("DHT  : no Reading !"));
+      return false;
+  }
+  for (i = 0; i < 5; i++)
+  {
+      byte data = Plugin_005_read_dht_dat();
+      if(data == -1)
+      {   logError(event, F("DHT  : protocol timeout!"));
+          break;
+      }
+      dht_dat[i] = data;
+  }
+  interrupts();
+  return Plugin_005_setValues(event, Par3, dht_dat);
+}
+
+/*********************************************************************************************\
+* DHT sub to convert the received data
+\*********************************************************************************************/
+boolean Plugin_005_setValues(struct EventStruct *event, byte Par3, byte dht_dat[5])
+{
+  // Checksum calculation is a Rollover Checksum by design!
+  byte dht_check_sum = (dht_dat[0] + dht_dat[1] + dht_dat[2] + dht_dat[3]) & 0xFF; // check check_sum
+  if (dht_dat[4] != dht_check_sum)
+  {
+      logError(event, F("DHT  : checksum error!"));
+      return false;
+  }
+
+  float temperature = NAN;
+  float humidity = NAN;
+  if (Par3 == 11)
+  {
+    temperature = float(dht_dat[2]); // Temperature
+    humidity = float(dht_dat[0]); // Humidity
+  }
+  else if (Par3 == 12)
+  {
+      temperature = float(dht_dat[2]*10 + (dht_dat[3] & 0x7f)) / 10.0; // Temperature
+      if (dht_dat[3] & 0x80) { temperature = -temperature; } // Negative temperature
+      humidity = float(dht_dat[0]*10+dht_dat[1]) / 10.0; // Humidity
+  }
+  else if (Par3 == 22 || Par3 == 23 || Par3 == 70)
+  {
+    if (dht_dat[2] & 0x80) // negative temperature
+      temperature = -0.1 * word(dht_dat[2] & 0x7F, dht_dat[3]);
+    else
+      temperature = 0.1 * word(dht_dat[2], dht_dat[3]);
+    humidity = 0.1 * word(dht_dat[0], dht_dat[1]); // Humidity
+  }
+
+  if (temperature == NAN || humidity == NAN)
+  {     logError(event, F("DHT  : invalid NAN reading !"));
+        return false;
+  }
+
+  UserVar[event->BaseVarIndex] = temperature;
+  UserVar[event->BaseVarIndex + 1] = humidity;
+  String log = F("DHT  : Temperature: ");
+  log += UserVar[event->BaseVarIndex];
+  addLog(LOG_LEVEL_INFO, log);
+  log = F("DHT  : Humidity: ");
+  log += UserVar[event->BaseVarIndex + 1];
+  addLog(LOG_LEVEL_INFO, log);
+  return true;
+}
+
 /*********************************************************************************************\
 * DHT sub to log an error
 \*********************************************************************************************/
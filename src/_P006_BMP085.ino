@@ -6,8 +6,8 @@
 #define PLUGIN_006
 #define PLUGIN_ID_006        6
 #define PLUGIN_NAME_006       "Environment - BMP085/180"
-#define PLUGIN_VALUENAME1_006 "Temperature"
-#define PLUGIN_VALUENAME2_006 "Pressure"
+#define PLUGIN_VALUENAME1_006 WEB_STR_TEMPERATURE
+#define PLUGIN_VALUENAME2_006 WEB_STR_PRESSURE
 
 
 // TODO this will not work if we have more than one of this task!
@@ -43,8 +43,8 @@ boolean Plugin_006(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_GET_DEVICEVALUENAMES:
       {
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_006));
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], PSTR(PLUGIN_VALUENAME2_006));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], getWebStringP(PLUGIN_VALUENAME1_006));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], getWebStringP(PLUGIN_VALUENAME2_006));
         break;
       }
 
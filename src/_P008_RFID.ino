@@ -8,16 +8,75 @@
 #define PLUGIN_NAME_008       "RFID - Wiegand"
 #define PLUGIN_VALUENAME1_008 "Tag"
 
+// The interrupt handlers collect the bits of a frame. A gap of more than
+// P008_BIT_TIMEOUT usec between two bits ends the frame: a frame of the
+// Wiegand size is checked on its parity bits in the interrupt, and its code
+// pushed as an interrupt event right after the last bit, so the tag is sent
+// within a loop run. Shorter frames (4 or 8 bit keys of a keypad) are pushed
+// by the next bit after the gap, or taken by PLUGIN_FIFTY_PER_SECOND after the
+// gap. No hardware timer is used for the timeout: timer1 is taken by the PWM.
+#define P008_BIT_TIMEOUT       25000   // usec, a bit takes ~2 msec
+#define P008_KEY_TIMEOUT        5000   // msec after the last key, the keys are discarded
+#define P008_EVENT_TAG             0   // value: code without the parity bits
+#define P008_EVENT_FRAME           1   // value: bits (low 24) | bit count << 24
+
 void Plugin_008_interrupt1() ICACHE_RAM_ATTR;
 void Plugin_008_interrupt2() ICACHE_RAM_ATTR;
+void Plugin_008_addBit(byte bit) ICACHE_RAM_ATTR;
+byte Plugin_008_parity(uint32_t bits) ICACHE_RAM_ATTR;
 
 volatile byte Plugin_008_bitCount = 0;     // Count the number of bits received.
-uint64_t Plugin_008_keyBuffer = 0;    // A 64-bit-long keyBuffer into which the number is stored.
-byte Plugin_008_timeoutCount = 0;
+volatile uint64_t Plugin_008_keyBuffer = 0;    // A 64-bit-long keyBuffer into which the number is stored.
+volatile unsigned long Plugin_008_lastBit = 0; // micros()
+volatile unsigned long Plugin_008_parityErrors = 0;
+unsigned long Plugin_008_parityErrorsLogged = 0;
 byte Plugin_008_WiegandSize = 26;          // size of a tag via wiegand (26-bits or 36-bits)
+byte Plugin_008_taskIndex = TASKS_MAX;     // Task to send the interrupt event to
+uint32_t Plugin_008_keys = 0;              // Keys pressed, 4 bit each
+unsigned long Plugin_008_lastKey = 0;      // millis()
 
 boolean Plugin_008_init = false;
 
+// The code of a frame (without the parity bits) or the keys is sent.
+void Plugin_008_send(struct EventStruct *event, uint32_t code, byte bitCount)
+{
+  event->sensorType = SENSOR_TYPE_LONG;
+  UserVar[event->BaseVarIndex] = (code & 0xFFFF);
+  UserVar[event->BaseVarIndex + 1] = ((code >> 16) & 0xFFFF);
+  String log = F("RFID : Tag: ");
+  log += code;
+  log += F(" Bits: ");
+  log += bitCount;
+  addLog(LOG_LEVEL_INFO, log);
+  sendData(event);
+}
+
+// A frame shorter than the Wiegand size: a key of a keypad, or noise.
+void Plugin_008_frame(struct EventStruct *event, uint32_t bits, byte bitCount)
+{
+  byte key;
+  if (bitCount == 4)
+    key = bits & 0xF;
+  else if (bitCount == 8 && ((bits >> 4) & 0xF) == (~bits & 0xF))
+    key = bits & 0xF;  // 8 bit keypad, the key followed by its complement
+  else {
+    String log = F("RFID : reset bits: ");
+    log += bitCount;
+    addLog(LOG_LEVEL_INFO, log);
+    return;
+  }
+  if (Plugin_008_keys != 0 && timePassedSince(Plugin_008_lastKey) > P008_KEY_TIMEOUT)
+    Plugin_008_keys = 0;
+  Plugin_008_lastKey = millis();
+  if (key == 11) {
+    // a number of keys were pressed and finished by #
+    Plugin_008_send(event, Plugin_008_keys, bitCount);
+    Plugin_008_keys = 0;
+  } else {
+    Plugin_008_keys = (Plugin_008_keys << 4) | key;
+  }
+}
+
 boolean Plugin_008(byte function, struct EventStruct *event, String& string)
 {
   boolean success = false;
@@ -37,6 +96,7 @@ boolean Plugin_008(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].SendDataOption = true;
         Device[deviceCount].TimerOption = false;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_FIFTY_PER_SECOND;
         break;
       }
 
@@ -56,6 +116,11 @@ boolean Plugin_008(byte function, struct EventStruct *event, String& string)
       {
         Plugin_008_init = true;
         Plugin_008_WiegandSize = Settings.TaskDevicePluginConfig[event->TaskIndex][0];
+        if (Plugin_008_WiegandSize != 34) Plugin_008_WiegandSize = 26;
+        Plugin_008_taskIndex = event->TaskIndex;
+        Plugin_008_keyBuffer = 0;
+        Plugin_008_bitCount = 0;
+        Plugin_008_keys = 0;
         pinMode(Settings.TaskDevicePin1[event->TaskIndex], INPUT_PULLUP);
         pinMode(Settings.TaskDevicePin2[event->TaskIndex], INPUT_PULLUP);
         attachInterrupt(Settings.TaskDevicePin1[event->TaskIndex], Plugin_008_interrupt1, FALLING);
@@ -64,63 +129,56 @@ boolean Plugin_008(byte function, struct EventStruct *event, String& string)
         break;
       }
 
-    case PLUGIN_ONCE_A_SECOND:
+    case PLUGIN_EXIT:
       {
-        if (Plugin_008_init)
-        {
-          if (Plugin_008_bitCount > 0)
-          {
-            if (Plugin_008_bitCount % 4 == 0 && ((Plugin_008_keyBuffer & 0xF) == 11))
-            {
-              // a number of keys were pressed and finished by #
-              Plugin_008_keyBuffer = Plugin_008_keyBuffer >> 4;  // Strip #
-              UserVar[event->BaseVarIndex] = (Plugin_008_keyBuffer & 0xFFFF);
-              UserVar[event->BaseVarIndex + 1] = ((Plugin_008_keyBuffer >> 16) & 0xFFFF);
-            }
-            else if (Plugin_008_bitCount == Plugin_008_WiegandSize)
-            {
-              // read a tag
-              Plugin_008_keyBuffer = Plugin_008_keyBuffer >> 1;          // Strip leading and trailing parity bits from the keyBuffer
-              if (Plugin_008_WiegandSize == 26)
-                Plugin_008_keyBuffer &= 0xFFFFFF;
-              else
-                Plugin_008_keyBuffer &= 0xFFFFFFFF;
-              UserVar[event->BaseVarIndex] = (Plugin_008_keyBuffer & 0xFFFF);
-              UserVar[event->BaseVarIndex + 1] = ((Plugin_008_keyBuffer >> 16) & 0xFFFF);
-            }
-            else
-            {
-              // not enough bits, maybe next time
-              Plugin_008_timeoutCount++;
-              if (Plugin_008_timeoutCount > 5)
-              {
-                String log = F("RFID : reset bits: ");
-                log += Plugin_008_bitCount;
-                addLog(LOG_LEVEL_INFO, log );
-                // reset after ~5 sec
-                Plugin_008_keyBuffer = 0;
-                Plugin_008_bitCount = 0;
-                Plugin_008_timeoutCount = 0;
-              }
-              break;
-            }
-            // reset everything
-            unsigned long bitCount = Plugin_008_bitCount;    // copy for log
-            unsigned long keyBuffer = Plugin_008_keyBuffer;  // copy for log
-            Plugin_008_keyBuffer = 0;
-            Plugin_008_bitCount = 0;
-            Plugin_008_timeoutCount = 0;
-            // write log
-            String log = F("RFID : Tag: ");
-            log += keyBuffer;
-            log += F(" Bits: ");
-            log += bitCount;
-            addLog(LOG_LEVEL_INFO, log);
-            sendData(event);
-          }
+        detachInterrupt(Settings.TaskDevicePin1[event->TaskIndex]);
+        detachInterrupt(Settings.TaskDevicePin2[event->TaskIndex]);
+        Plugin_008_init = false;
+        Plugin_008_taskIndex = TASKS_MAX;
+        break;
+      }
+
+    // A frame completed in the interrupt, the tag with valid parity right after its last bit.
+    case PLUGIN_INTERRUPT_EVENT:
+      {
+        const InterruptEventStruct* item = reinterpret_cast<const InterruptEventStruct*>(event->Data);
+        if (item == NULL || !Plugin_008_init)
+          break;
+        if (event->Par1 == P008_EVENT_TAG)
+          Plugin_008_send(event, item->value, Plugin_008_WiegandSize);
+        else
+          Plugin_008_frame(event, item->value & 0xFFFFFF, item->value >> 24);
+        success = true;
+        break;
+      }
+
+    // The last frame of a burst, when no next bit ended it.
+    case PLUGIN_FIFTY_PER_SECOND:
+      {
+        if (!Plugin_008_init)
+          break;
+        if (Plugin_008_parityErrors != Plugin_008_parityErrorsLogged) {
+          Plugin_008_parityErrorsLogged = Plugin_008_parityErrors;
+          String log = F("RFID : Parity error, count: ");
+          log += Plugin_008_parityErrorsLogged;
+          addLog(LOG_LEVEL_INFO, log);
+        }
+        if (Plugin_008_bitCount == 0)
+          break;
+        noInterrupts();
+        const byte bitCount = Plugin_008_bitCount;
+        const uint32_t bits = Plugin_008_keyBuffer;
+        const bool ended = bitCount != 0 && (micros() - Plugin_008_lastBit) > P008_BIT_TIMEOUT;
+        if (ended) {
+          Plugin_008_keyBuffer = 0;
+          Plugin_008_bitCount = 0;
         }
+        interrupts();
+        if (ended)
+          Plugin_008_frame(event, bits, bitCount);
         break;
       }
+
       case PLUGIN_WEBFORM_LOAD:
         {
           byte choice = Settings.TaskDevicePluginConfig[event->TaskIndex][0];
@@ -133,16 +191,16 @@ boolean Plugin_008(byte function, struct EventStruct *event, String& string)
           string += F("<TR><TD>Wiegand Type:<TD><select name='plugin_008_type'>");
           for (byte x = 0; x < 2; x++)
           {
-            string += F("<option value='");
+            string += getWebString(WEB_STR_OPTION_VALUE);
             string += optionValues[x];
             string += "'";
             if (choice == optionValues[x])
-              string += F(" selected");
+              string += getWebString(WEB_STR_SELECTED);
             string += ">";
             string += options[x];
-            string += F("</option>");
+            string += getWebString(WEB_STR_OPTION_END);
           }
-          string += F("</select>");
+          string += getWebString(WEB_STR_SELECT_END);
 
           success = true;
           break;
@@ -159,14 +217,54 @@ boolean Plugin_008(byte function, struct EventStruct *event, String& string)
   return success;
 }
 
+// Parity of the bits, 1 for an odd number of ones.
+byte Plugin_008_parity(uint32_t bits)
+{
+  bits ^= bits >> 16;
+  bits ^= bits >> 8;
+  bits ^= bits >> 4;
+  bits ^= bits >> 2;
+  bits ^= bits >> 1;
+  return bits & 1;
+}
+
+void Plugin_008_addBit(byte bit)
+{
+  const unsigned long now = micros();
+  if (Plugin_008_bitCount != 0 && (now - Plugin_008_lastBit) > P008_BIT_TIMEOUT) {
+    // The bits before the gap are a frame, not yet taken by the loop
+    if (Plugin_008_bitCount <= 24)
+      pushInterruptEvent(Plugin_008_taskIndex, P008_EVENT_FRAME,
+                         static_cast<uint32_t>(Plugin_008_keyBuffer) | (static_cast<uint32_t>(Plugin_008_bitCount) << 24));
+    Plugin_008_keyBuffer = 0;
+    Plugin_008_bitCount = 0;
+  }
+  Plugin_008_lastBit = now;
+  Plugin_008_keyBuffer = (Plugin_008_keyBuffer << 1) | bit;
+  if (++Plugin_008_bitCount != Plugin_008_WiegandSize)
+    return;
+
+  // Even parity over the first half of the code, odd parity over the second half.
+  const byte codeBits = Plugin_008_WiegandSize - 2;
+  const byte half = codeBits / 2;
+  const uint64_t frame = Plugin_008_keyBuffer;
+  const uint32_t code = (frame >> 1) & ((1ULL << codeBits) - 1);
+  const byte evenBit = (frame >> (Plugin_008_WiegandSize - 1)) & 1;
+  const byte oddBit = frame & 1;
+  if (Plugin_008_parity(code >> half) == evenBit && Plugin_008_parity(code & ((1UL << half) - 1)) != oddBit)
+    pushInterruptEvent(Plugin_008_taskIndex, P008_EVENT_TAG, code);
+  else
+    ++Plugin_008_parityErrors;
+  Plugin_008_keyBuffer = 0;
+  Plugin_008_bitCount = 0;
+}
+
 /*********************************************************************/
 void Plugin_008_interrupt1()
 /*********************************************************************/
 {
   // We've received a 1 bit. (bit 0 = high, bit 1 = low)
-  Plugin_008_keyBuffer = Plugin_008_keyBuffer << 1;     // Left shift the number (effectively multiplying by 2)
-  Plugin_008_keyBuffer += 1;         // Add the 1 (not necessary for the zeroes)
-  Plugin_008_bitCount++;         // Increment the bit count
+  Plugin_008_addBit(1);
 }
 
 /*********************************************************************/
@@ -174,7 +272,6 @@ void Plugin_008_interrupt2()
 /*********************************************************************/
 {
   // We've received a 0 bit. (bit 0 = low, bit 1 = high)
-  Plugin_008_keyBuffer = Plugin_008_keyBuffer << 1;     // Left shift the number (effectively multiplying by 2)
-  Plugin_008_bitCount++;           // Increment the bit count
+  Plugin_008_addBit(0);
 }
 #endif // USES_P008
@@ -30,6 +30,7 @@ boolean Plugin_009(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].TimerOptional = true;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND;
         break;
       }
 
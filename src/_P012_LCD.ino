@@ -15,6 +15,7 @@ LiquidCrystal_I2C *lcd=NULL;
 int Plugin_012_cols = 16;
 int Plugin_012_rows = 2;
 int Plugin_012_mode = 1;
+char Plugin_012_shown[4][20];   // What the display shows, only changed characters are written
 
 #define PLUGIN_012
 #define PLUGIN_ID_012         12
@@ -41,6 +42,7 @@ boolean Plugin_012(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].ValueCount = 0;
         Device[deviceCount].SendDataOption = false;
         Device[deviceCount].TimerOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND | PLUGIN_CALLBACK_ONCE_A_SECOND;
         break;
       }
 
@@ -96,7 +98,7 @@ boolean Plugin_012(byte function, struct EventStruct *event, String& string)
 
 
         addRowLabel(F("Display button"));
-        addPinSelect(false, F("taskdevicepin3"), Settings.TaskDevicePin3[event->TaskIndex]);
+        addPinSelect(false, getWebString(WEB_STR_TASKDEVICEPIN3), Settings.TaskDevicePin3[event->TaskIndex]);
 
 
         char tmpString[128];
@@ -157,8 +159,9 @@ boolean Plugin_012(byte function, struct EventStruct *event, String& string)
 
         // Setup LCD display
         lcd->init();                      // initialize the lcd
+        P012_clearShown();
         lcd->backlight();
-        lcd->print(F("ESP Easy"));
+        P012_print(0, 0, F("ESP Easy"));
         displayTimer = Settings.TaskDevicePluginConfig[event->TaskIndex][2];
         if (Settings.TaskDevicePin3[event->TaskIndex] != -1)
           pinMode(Settings.TaskDevicePin3[event->TaskIndex], INPUT_PULLUP);
@@ -203,8 +206,7 @@ boolean Plugin_012(byte function, struct EventStruct *event, String& string)
           if (lcd && tmpString.length())
           {
             String newString = P012_parseTemplate(tmpString, Plugin_012_cols);
-            lcd->setCursor(0, x);
-            lcd->print(newString);
+            P012_print(0, x, newString);
           }
         }
         success = false;
@@ -231,6 +233,7 @@ boolean Plugin_012(byte function, struct EventStruct *event, String& string)
           }
           else if (tmpString.equalsIgnoreCase(F("Clear"))){
               lcd->clear();
+              P012_clearShown();
           }
         }
         else if (lcd && tmpString.equalsIgnoreCase(F("LCD")))
@@ -245,47 +248,27 @@ boolean Plugin_012(byte function, struct EventStruct *event, String& string)
 
           //clear line before writing new string
           if (Plugin_012_mode == 2){
-              lcd->setCursor(colPos, rowPos);
-              for (byte i = colPos; i < Plugin_012_cols; i++) {
-                  lcd->print(F(" "));
+              while (static_cast<int>(tmpString.length()) < Plugin_012_cols - colPos) {
+                  tmpString += ' ';
               }
           }
 
           // truncate message exceeding cols
-          lcd->setCursor(colPos, rowPos);
           if(Plugin_012_mode == 1 || Plugin_012_mode == 2){
-              lcd->setCursor(colPos, rowPos);
-              for (byte i = 0; i < Plugin_012_cols - colPos; i++) {
-                  if(tmpString[i]){
-                     lcd->print(tmpString[i]);
-                  }
-              }
+              P012_print(colPos, rowPos, tmpString);
           }
 
           // message exceeding cols will continue to next line
           else{
               // Fix Weird (native) lcd display behaviour that split long string into row 1,3,2,4, instead of 1,2,3,4
-              boolean stillProcessing = 1;
-              byte charCount = 1;
-              while(stillProcessing) {
-                   if (++colPos > Plugin_012_cols) {    // have we printed 20 characters yet (+1 for the logic)
-                        rowPos += 1;
-                        lcd->setCursor(0,rowPos);   // move cursor down
-                        colPos = 1;
-                   }
-
-                   //dont print if "lower" than the lcd
-                   if(rowPos < Plugin_012_rows  ){
-                       lcd->print(tmpString[charCount - 1]);
-                   }
-
-                   if (!tmpString[charCount]) {   // no more chars to process?
-                        stillProcessing = 0;
-                   }
-                   charCount += 1;
+              unsigned int pos = 0;
+              while (rowPos < Plugin_012_rows && pos < tmpString.length()) {
+                   const String part = tmpString.substring(pos, pos + Plugin_012_cols - colPos);
+                   P012_print(colPos, rowPos, part);
+                   pos += part.length();
+                   colPos = 0;
+                   rowPos++;
               }
-              //lcd->print(tmpString.c_str());
-              // end fix
           }
 
         }
@@ -305,4 +288,36 @@ String P012_parseTemplate(String &tmpString, byte lineSize) {
   result.replace(degree, degree_lcd);
   return result;
 }
+
+// The display is cleared, e.g. by init() or clear()
+void P012_clearShown() {
+  memset(Plugin_012_shown, ' ', sizeof(Plugin_012_shown));
+}
+
+// Write text at col, row, truncated at the end of the line. Only the characters
+// which differ from what the display shows are written. A single unchanged
+// character between two changes is written again, that costs as much as a
+// setCursor() to skip it.
+void P012_print(int col, int row, const String& text) {
+  if (!lcd || row < 0 || row >= Plugin_012_rows || col < 0 || col >= Plugin_012_cols) return;
+  int end = col + text.length();
+  if (end > Plugin_012_cols) end = Plugin_012_cols;
+  char* shown = Plugin_012_shown[row];
+  int i = col;
+  while (i < end) {
+    if (shown[i] == text[i - col]) {
+      ++i;
+      continue;
+    }
+    int lastChanged = i;
+    for (int j = i + 1; j < end && j - lastChanged <= 2; ++j) {
+      if (shown[j] != text[j - col]) lastChanged = j;
+    }
+    lcd->setCursor(i, row);
+    for (; i <= lastChanged; ++i) {
+      shown[i] = text[i - col];
+      lcd->write(static_cast<uint8_t>(shown[i]));
+    }
+  }
+}
 #endif // USES_P012
@@ -31,6 +31,9 @@ struct P_013_sensordef {
 
 std::map<unsigned int, P_013_sensordef> P_013_sensordefs;
 
+// Pulse capture channel recording the echo of a task, -1 when no ping is running.
+std::map<unsigned int, int> P_013_captureChannels;
+
 
 
 
@@ -54,6 +57,7 @@ boolean Plugin_013(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].SendDataOption = true;
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND;
         break;
       }
 
@@ -123,19 +127,6 @@ boolean Plugin_013(byte function, struct EventStruct *event, String& string)
         log += P_013_sensordefs.size();
         addLog(LOG_LEVEL_INFO, log);
 
-        unsigned long tmpmillis = millis();
-        unsigned long tmpmicros = micros();
-        delay(100);
-        long millispassed = timePassedSince(tmpmillis);
-        long microspassed = usecPassedSince(tmpmicros);
-
-        log = F("ULTRASONIC : micros() test: ");
-        log += millispassed;
-        log += F(" msec, ");
-        log += microspassed;
-        log += F(" usec, ");
-        addLog(LOG_LEVEL_INFO, log);
-
 
         success = true;
         break;
@@ -143,6 +134,8 @@ boolean Plugin_013(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_EXIT:
       {
+        pulseCaptureCancel(event->TaskIndex);
+        P_013_captureChannels.erase(event->TaskIndex);
         P_013_sensordefs.erase(event->TaskIndex);
         break;
       }
@@ -151,20 +144,23 @@ boolean Plugin_013(byte function, struct EventStruct *event, String& string)
       {
         if (Settings.TaskDevicePluginConfig[event->TaskIndex][0] == 1)
         {
-          float value = Plugin_013_read(event->TaskIndex);
-          String log = F("ULTRASONIC : TaskNr: ");
-          log += event->TaskIndex +1;
-          log += F(" Distance: ");
-          if (value > 0)
+          // The echo is recorded in the background and measured in PLUGIN_TIMER_IN.
+          if (Plugin_013_startPing(event->TaskIndex))
           {
-            UserVar[event->BaseVarIndex] = value;
-            log += UserVar[event->BaseVarIndex];
-            success = true;
+            startTaskConversion(event, PLUGIN_ID_013, Plugin_013_pingTime(event->TaskIndex), 0);
+            break;
           }
-          else
-            log += F("No reading!");
+          success = Plugin_013_log_value(event, Plugin_013_read(event->TaskIndex));
+        }
+        break;
+      }
 
-        addLog(LOG_LEVEL_INFO,log);
+    case PLUGIN_TIMER_IN:
+      {
+        if (isTaskConversionTimer(event))
+        {
+          completeTaskConversion(event, Plugin_013_log_value(event, Plugin_013_pingResult(event->TaskIndex)));
+          success = true;
         }
         break;
       }
@@ -174,7 +170,10 @@ boolean Plugin_013(byte function, struct EventStruct *event, String& string)
         if (Settings.TaskDevicePluginConfig[event->TaskIndex][0] == 2)
         {
           byte state = 0;
-          float value = Plugin_013_read(event->TaskIndex);
+          // Echo of the ping started at the previous call, then start the next ping.
+          float value = Plugin_013_pingResult(event->TaskIndex);
+          if (!Plugin_013_startPing(event->TaskIndex) && value == 0)
+            value = Plugin_013_read(event->TaskIndex);
           if (value > 0)
           {
             if (value < Settings.TaskDevicePluginConfig[event->TaskIndex][1])
@@ -209,4 +208,78 @@ float Plugin_013_read(unsigned int taskIndex)
   delay(1);
   return distance;
 }
+
+/*********************************************************************/
+boolean Plugin_013_log_value(struct EventStruct *event, float value)
+/*********************************************************************/
+{
+  String log = F("ULTRASONIC : TaskNr: ");
+  log += event->TaskIndex +1;
+  log += F(" Distance: ");
+  boolean success = false;
+  if (value > 0)
+  {
+    UserVar[event->BaseVarIndex] = value;
+    log += UserVar[event->BaseVarIndex];
+    success = true;
+  }
+  else
+    log += F("No reading!");
+  addLog(LOG_LEVEL_INFO,log);
+  return success;
+}
+
+/*********************************************************************/
+// Time in msec for the sensor to start and return the echo of the max. distance.
+unsigned long Plugin_013_pingTime(unsigned int taskIndex)
+/*********************************************************************/
+{
+  if (P_013_sensordefs.count(taskIndex) == 0 || P_013_sensordefs[taskIndex].sonar == NULL) return 1;
+  return (P_013_sensordefs[taskIndex].sonar->getMaxEchoTime() + MAX_SENSOR_DELAY) / 1000 + 2;
+}
+
+/*********************************************************************/
+// Trigger the sensor and record the echo pin, false when no capture channel is free.
+boolean Plugin_013_startPing(unsigned int taskIndex)
+/*********************************************************************/
+{
+  if (P_013_sensordefs.count(taskIndex) == 0 || P_013_sensordefs[taskIndex].sonar == NULL) return false;
+  const byte TRIG_Pin = Settings.TaskDevicePin1[taskIndex];
+  const byte IRQ_Pin = Settings.TaskDevicePin2[taskIndex];
+  unsigned long idleTime = P_013_sensordefs[taskIndex].sonar->getMaxEchoTime() + MAX_SENSOR_DELAY + 1000;
+  if (idleTime > 65535) idleTime = 65535;
+  const int channel = pulseCaptureStart(taskIndex, IRQ_Pin, idleTime);
+  if (channel < 0) return false;
+  P_013_captureChannels[taskIndex] = channel;
+  digitalWrite(TRIG_Pin, LOW);
+  delayMicroseconds(4);
+  digitalWrite(TRIG_Pin, HIGH);
+  delayMicroseconds(10);
+  digitalWrite(TRIG_Pin, LOW);
+  return true;
+}
+
+/*********************************************************************/
+// Distance in cm from the recorded echo pulse, 0 when there was no echo.
+float Plugin_013_pingResult(unsigned int taskIndex)
+/*********************************************************************/
+{
+  auto it = P_013_captureChannels.find(taskIndex);
+  if (it == P_013_captureChannels.end() || it->second < 0) return 0;
+  const int channel = it->second;
+  it->second = -1;
+  pulseCaptureStop(channel);
+  if (P_013_sensordefs.count(taskIndex) == 0 || P_013_sensordefs[taskIndex].sonar == NULL) return 0;
+  bool level;
+  long duration;
+  for (byte segment = 0; (duration = pulseCaptureSegment(channel, segment, level)) >= 0; ++segment)
+  {
+    if (level)
+    {
+      if (duration > static_cast<long>(P_013_sensordefs[taskIndex].sonar->getMaxEchoTime())) return 0;
+      return duration / US_ROUNDTRIP_CM;
+    }
+  }
+  return 0;
+}
 #endif // USES_P013
@@ -3,6 +3,16 @@
 //#################################### Plugin 016: Input IR #############################################
 //#######################################################################################################
 
+/*
+   The receiver library records the edges of a frame from its pin interrupt. When a frame is
+   complete its timer calls Plugin_016_frameReceived(), which copies the frame into a ring and
+   restarts the receiver right away, so the next frame (e.g. a repeat) is already recorded while
+   this one is decoded. An interrupt event hands the frame to the task on the next loop, there it
+   is decoded with only the protocols checked on the task page.
+   Holding a button sends the same code (or a NEC repeat frame) every 40..110 msec. Only the
+   first one is sent as a value, the repeats within the repeat window are counted. When the
+   button is released the count is sent to the rules as <task>#Repeat=<count>.
+*/
 
 #ifdef ESP8266  // Needed for precompile issues.
 #include <IRremoteESP8266.h>
@@ -16,6 +26,59 @@ decode_results results;
 #define PLUGIN_NAME_016       "Communication - TSOP4838"
 #define PLUGIN_VALUENAME1_016 "IR"
 
+#define P016_RAW_FRAMES       4     // Frames waiting to be decoded, power of 2
+#define P016_REPEAT_MSEC    150     // Default repeat window
+#define P016_EVENT_FRAME      1
+
+struct P016_ReceiverStruct
+{
+  P016_ReceiverStruct() : frames(NULL), head(0), tail(0), TaskIndex(0), protocols(IR_PROTOCOLS_ALL),
+    repeatWindow(P016_REPEAT_MSEC), code(0), type(UNUSED), lastFrame(0), holding(false), repeats(0),
+    received(0), decoded(0), repeated(0), dropped(0) {}
+
+  irparams_t* frames;          // Ring, filled from the receive timer
+  volatile byte head;
+  volatile byte tail;
+  byte TaskIndex;
+  uint32_t protocols;          // IR_PROTOCOL_BIT() mask
+  unsigned int repeatWindow;   // msec, longer without a frame ends the hold
+
+  unsigned long code;          // Code of the button held
+  int type;
+  unsigned long lastFrame;
+  bool holding;
+  unsigned int repeats;
+
+  unsigned long received;
+  unsigned long decoded;
+  unsigned long repeated;
+  unsigned long dropped;       // Ring full
+} Plugin_016_rx;
+
+// The protocols which can be selected, with the bit used in the mask.
+const int Plugin_016_protocols[] PROGMEM = { NEC, SONY, RC5, RC6, RCMM, PANASONIC, LG, JVC, SAMSUNG, WHYNTER, DENON, MITSUBISHI, UNUSED };
+#define P016_PROTOCOL_COUNT (sizeof(Plugin_016_protocols) / sizeof(Plugin_016_protocols[0]))
+
+String Plugin_016_protocolName(int type)
+{
+  switch (type)
+  {
+    case NEC:        return F("NEC");
+    case SONY:       return F("Sony");
+    case RC5:        return F("RC5");
+    case RC6:        return F("RC6");
+    case RCMM:       return F("RC-MM");
+    case PANASONIC:  return F("Panasonic");
+    case LG:         return F("LG");
+    case JVC:        return F("JVC");
+    case SAMSUNG:    return F("Samsung");
+    case WHYNTER:    return F("Whynter");
+    case DENON:      return F("Denon");
+    case MITSUBISHI: return F("Mitsubishi");
+  }
+  return F("Unknown (hash)");
+}
+
 boolean Plugin_016(byte function, struct EventStruct *event, String& string)
 {
   boolean success = false;
@@ -35,6 +98,7 @@ boolean Plugin_016(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].SendDataOption = true;
         Device[deviceCount].TimerOption = false;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND;
         break;
       }
 
@@ -50,42 +114,122 @@ boolean Plugin_016(byte function, struct EventStruct *event, String& string)
         break;
       }
 
+    case PLUGIN_WEBFORM_LOAD:
+      {
+        // An empty mask (older settings) enables all protocols
+        uint32_t protocols = Settings.TaskDevicePluginConfigLong[event->TaskIndex][0];
+        if (protocols == 0)
+          protocols = IR_PROTOCOLS_ALL;
+        addFormSubHeader(F("Protocols"));
+        for (byte i = 0; i < P016_PROTOCOL_COUNT; i++)
+        {
+          const int type = pgm_read_dword(&Plugin_016_protocols[i]);
+          String id = F("plugin_016_protocol");
+          id += i;
+          addFormCheckBox(Plugin_016_protocolName(type), id, (protocols & IR_PROTOCOL_BIT(type)) != 0);
+        }
+        addFormNote(F("Only the checked protocols are decoded"));
+
+        addFormNumericBox(F("Repeat window"), F("plugin_016_repeat"), Settings.TaskDevicePluginConfig[event->TaskIndex][0], 0, 1000);
+        addUnit(F("ms"));
+        addFormNote(F("The same code within this time counts as a repeat, 0 = 150 ms"));
+
+        if (irReceiver != 0)
+        {
+          String stats = F("Frames: ");
+          stats += Plugin_016_rx.received;
+          stats += F(", decoded: ");
+          stats += Plugin_016_rx.decoded;
+          stats += F(", repeats: ");
+          stats += Plugin_016_rx.repeated;
+          stats += F(", dropped: ");
+          stats += Plugin_016_rx.dropped;
+          addFormNote(stats);
+        }
+        success = true;
+        break;
+      }
+
+    case PLUGIN_WEBFORM_SAVE:
+      {
+        uint32_t protocols = 0;
+        for (byte i = 0; i < P016_PROTOCOL_COUNT; i++)
+        {
+          String id = F("plugin_016_protocol");
+          id += i;
+          if (isFormItemChecked(id))
+            protocols |= IR_PROTOCOL_BIT(pgm_read_dword(&Plugin_016_protocols[i]));
+        }
+        Settings.TaskDevicePluginConfigLong[event->TaskIndex][0] = protocols;
+        Settings.TaskDevicePluginConfig[event->TaskIndex][0] = getFormItemInt(F("plugin_016_repeat"));
+        success = true;
+        break;
+      }
+
     case PLUGIN_INIT:
       {
         int irPin = Settings.TaskDevicePin1[event->TaskIndex];
+        P016_ReceiverStruct& rx = Plugin_016_rx;
         if (irReceiver == 0 && irPin != -1)
         {
           Serial.println(F("IR Init"));
+          rx = P016_ReceiverStruct();
+          rx.frames = static_cast<irparams_t*>(allocBuffer(MEM_POOL_IR, P016_RAW_FRAMES * sizeof(irparams_t)));
+          if (rx.frames == NULL)
+          {
+            addLog(LOG_LEVEL_ERROR, F("IR   : Not enough memory"));
+            break;
+          }
           irReceiver= new IRrecv(irPin);
+          irReceiver->setFrameCallback(Plugin_016_frameReceived);
           irReceiver->enableIRIn(); // Start the receiver
         }
         if (irReceiver != 0 && irPin == -1)
         {
           Serial.println(F("IR Removed"));
-          irReceiver->disableIRIn();
-          delete irReceiver;
-          irReceiver=0;
+          Plugin_016_end();
         }
+        rx.TaskIndex = event->TaskIndex;
+        rx.protocols = Settings.TaskDevicePluginConfigLong[event->TaskIndex][0];
+        if (rx.protocols == 0)
+          rx.protocols = IR_PROTOCOLS_ALL;
+        rx.repeatWindow = Settings.TaskDevicePluginConfig[event->TaskIndex][0];
+        if (rx.repeatWindow == 0)
+          rx.repeatWindow = P016_REPEAT_MSEC;
+        success = true;
+        break;
+      }
+
+    case PLUGIN_EXIT:
+      {
+        if (irReceiver != 0)
+          Plugin_016_end();
+        success = true;
+        break;
+      }
+
+    case PLUGIN_INTERRUPT_EVENT:
+      {
+        if (event->Par1 == P016_EVENT_FRAME)
+          Plugin_016_decode(event);
         success = true;
         break;
       }
 
     case PLUGIN_TEN_PER_SECOND:
       {
-        if (irReceiver->decode(&results))
+        // Released: no frame within the repeat window
+        P016_ReceiverStruct& rx = Plugin_016_rx;
+        if (rx.holding && timePassedSince(rx.lastFrame) > (long)rx.repeatWindow)
         {
-          unsigned long IRcode = results.value;
-          irReceiver->resume();
-          UserVar[event->BaseVarIndex] = (IRcode & 0xFFFF);
-          UserVar[event->BaseVarIndex + 1] = ((IRcode >> 16) & 0xFFFF);
-          String log = F("IR   : Code ");
-          log += String(IRcode, HEX);
-          log += F(" - Type: ");
-          log += results.decode_type;
-          log += F(" - Bits: ");
-          log += results.bits;
-          addLog(LOG_LEVEL_INFO, log);
-          sendData(event);
+          rx.holding = false;
+          if (rx.repeats != 0 && Settings.UseRules)
+          {
+            String eventString = getTaskDeviceName(event->TaskIndex);
+            eventString += F("#Repeat=");
+            eventString += rx.repeats;
+            rulesProcessing(eventString);
+          }
         }
         success = true;
         break;
@@ -94,4 +238,75 @@ boolean Plugin_016(byte function, struct EventStruct *event, String& string)
   return success;
 }
 
+// Called from the receive timer of the library when a frame is complete.
+void Plugin_016_frameReceived()
+{
+  P016_ReceiverStruct& rx = Plugin_016_rx;
+  if (irReceiver == 0)
+    return;
+  if (rx.frames == NULL || static_cast<byte>(rx.head - rx.tail) >= P016_RAW_FRAMES)
+  {
+    ++rx.dropped;
+    irReceiver->resume();
+    return;
+  }
+  irReceiver->copyFrame(&rx.frames[rx.head % P016_RAW_FRAMES]);
+  ++rx.head;
+  pushInterruptEvent(rx.TaskIndex, P016_EVENT_FRAME, 0);
+}
+
+void Plugin_016_decode(struct EventStruct *event)
+{
+  P016_ReceiverStruct& rx = Plugin_016_rx;
+  while (rx.tail != rx.head)
+  {
+    const bool decoded = irReceiver->decodeFrame(&results, &rx.frames[rx.tail % P016_RAW_FRAMES], rx.protocols);
+    ++rx.tail;
+    ++rx.received;
+    if (!decoded)
+      continue;
+    ++rx.decoded;
+
+    const unsigned long IRcode = results.value;
+    const bool repeat = rx.holding && timePassedSince(rx.lastFrame) <= (long)rx.repeatWindow &&
+                        (IRcode == REPEAT || (IRcode == rx.code && results.decode_type == rx.type));
+    if (repeat)
+    {
+      rx.lastFrame = millis();
+      ++rx.repeats;
+      ++rx.repeated;
+      continue;
+    }
+    if (IRcode == REPEAT)
+      continue;   // Repeat of a code which was not received
+
+    rx.code = IRcode;
+    rx.type = results.decode_type;
+    rx.lastFrame = millis();
+    rx.holding = true;
+    rx.repeats = 0;
+
+    UserVar[event->BaseVarIndex] = (IRcode & 0xFFFF);
+    UserVar[event->BaseVarIndex + 1] = ((IRcode >> 16) & 0xFFFF);
+    String log = F("IR   : Code ");
+    log += String(IRcode, HEX);
+    log += F(" - Type: ");
+    log += results.decode_type;
+    log += F(" - Bits: ");
+    log += results.bits;
+    addLog(LOG_LEVEL_INFO, log);
+    sendData(event);
+  }
+}
+
+void Plugin_016_end()
+{
+  irReceiver->setFrameCallback(NULL);
+  irReceiver->disableIRIn();
+  delete irReceiver;
+  irReceiver=0;
+  freeBuffer(MEM_POOL_IR, Plugin_016_rx.frames, P016_RAW_FRAMES * sizeof(irparams_t));
+  Plugin_016_rx.frames = NULL;
+}
+
 #endif // USES_P016
@@ -51,6 +51,7 @@ boolean Plugin_017(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].SendDataOption = true;
         Device[deviceCount].TimerOption = false;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND;
         break;
       }
 
@@ -68,7 +69,7 @@ boolean Plugin_017(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_WEBFORM_LOAD:
       {
-      	addFormPinSelect(F("Reset Pin"), F("taskdevicepin3"), Settings.TaskDevicePin3[event->TaskIndex]);
+      	addFormPinSelect(F("Reset Pin"), getWebString(WEB_STR_TASKDEVICEPIN3), Settings.TaskDevicePin3[event->TaskIndex]);
         success = true;
         break;
       }
@@ -80,15 +81,25 @@ boolean Plugin_017(byte function, struct EventStruct *event, String& string)
         // if (!Settings.WireClockStretchLimit)
         //   Wire.setClockStretchLimit(2000);
 
-        for(byte x=0; x < 3; x++)
-        {
-          if(Plugin_017_Init(Settings.TaskDevicePin3[event->TaskIndex]))
-            break;
-          delay(1000);
+        // Retry twice after 1 sec, in PLUGIN_TIMER_IN. The task is not polled before.
+        if (!Plugin_017_Init(Settings.TaskDevicePin3[event->TaskIndex])) {
+          taskInitDeferred(event->TaskIndex);
+          setSystemTimer(1000, PLUGIN_ID_017, event->TaskIndex, 1);
         }
         break;
       }
 
+    case PLUGIN_TIMER_IN:
+      {
+        if (Plugin_017_Init(Settings.TaskDevicePin3[event->TaskIndex]))
+          taskInitDone(event->TaskIndex, true);
+        else if (event->Par1 < 2)
+          setSystemTimer(1000, PLUGIN_ID_017, event->TaskIndex, event->Par1 + 1);
+        else
+          taskInitDone(event->TaskIndex, false);
+        break;
+      }
+
     case PLUGIN_TEN_PER_SECOND:
       {
         static unsigned long tempcounter = 0;
@@ -8,17 +8,82 @@
 #define PLUGIN_NAME_020       "Communication - Serial Server"
 #define PLUGIN_VALUENAME1_020 "Ser2Net"
 
-#define P020_BUFFER_SIZE 128
+#define P020_BUFFER_SIZE       128   // Message buffer for the event processing and logging
+#define P020_MAX_CLIENTS         4
+#define P020_DEFAULT_RING_KB     2   // Size of each ring buffer, when not set
+#define P020_MIN_RING_SIZE     256   // Smallest ring buffer tried when memory is short
+#define P020_SERIAL_RX_SIZE   1024   // Receive buffer of the serial port, see serialRxBegin()
+
 boolean Plugin_020_init = false;
 byte Plugin_020_SerialProcessing = 0;
 
-WiFiServer *ser2netServer;
-WiFiClient ser2netClient;
+// Ring buffer of a power of 2 size. Positions only increase, the index in the buffer
+// is the position masked, so head - tail is the number of bytes in use.
+struct P020_RingBuffer
+{
+  P020_RingBuffer() : data(NULL), mask(0), head(0), tail(0) {}
+  ~P020_RingBuffer() { release(); }
+
+  bool allocate(unsigned int size) {
+    release();
+    data = (uint8_t*)allocBuffer(MEM_POOL_SERIAL, size);
+    mask = (data == NULL) ? 0 : size - 1;
+    head = tail = 0;
+    return data != NULL;
+  }
+
+  void release() {
+    if (data != NULL) freeBuffer(MEM_POOL_SERIAL, data, size());
+    data = NULL;
+  }
+
+  unsigned int size() const                        { return mask + 1; }
+  unsigned int used() const                        { return head - tail; }
+  unsigned int room() const                        { return size() - used(); }
+  uint8_t* at(unsigned long pos)                   { return data + (pos & mask); }
+  // Bytes from pos to the end of the buffer, read and written in place.
+  unsigned int contiguous(unsigned long pos) const { return size() - (pos & mask); }
+
+  uint8_t* data;
+  unsigned long mask;
+  unsigned long head;
+  unsigned long tail;
+};
+
+struct P020_Ser2NetStruct
+{
+  P020_Ser2NetStruct() :
+    server(NULL), maxClients(1), rxWait(1), messageLength(0), lastSerialByte(0),
+    bytesToNet(0), bytesToSerial(0), netOverrunBytes(0), rejectedClients(0) {
+    for (byte i = 0; i < P020_MAX_CLIENTS; ++i) {
+      clientSent[i] = 0;
+      clientSince[i] = 0;
+    }
+  }
+
+  WiFiServer* server;
+  WiFiClient clients[P020_MAX_CLIENTS];
+  unsigned long clientSent[P020_MAX_CLIENTS];   // Position in serialRx sent to the client
+  unsigned long clientSince[P020_MAX_CLIENTS];  // 0 = slot free
+  byte maxClients;
+  P020_RingBuffer serialRx;   // Serial to network, shared by all clients
+  P020_RingBuffer netRx;      // Network to serial
+  int rxWait;                 // msec silence on the serial port ending a message
+  char message[P020_BUFFER_SIZE];
+  byte messageLength;
+  unsigned long lastSerialByte;
+
+  unsigned long bytesToNet;
+  unsigned long bytesToSerial;
+  unsigned long netOverrunBytes;  // Serial data not sent to a client which was too slow
+  unsigned long rejectedClients;
+};
+
+P020_Ser2NetStruct* Plugin_020_state = NULL;
 
 boolean Plugin_020(byte function, struct EventStruct *event, String& string)
 {
   boolean success = false;
-  static byte connectionState = 0;
 
   switch (function)
   {
@@ -29,6 +94,7 @@ boolean Plugin_020(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].Type = DEVICE_TYPE_SINGLE;
         Device[deviceCount].Custom = true;
         Device[deviceCount].TimerOption = false;
+        // Serial and network are handled from backgroundtasks(), see Plugin_020_process()
         break;
       }
 
@@ -63,7 +129,7 @@ boolean Plugin_020(byte function, struct EventStruct *event, String& string)
 
       	addFormNumericBox(F("Stop bits"), F("plugin_020_stop"), ExtraTaskSettings.TaskDevicePluginConfigLong[4]);
 
-      	addFormPinSelect(F("Reset target after boot"), F("taskdevicepin1"), Settings.TaskDevicePin1[event->TaskIndex]);
+      	addFormPinSelect(F("Reset target after boot"), getWebString(WEB_STR_TASKDEVICEPIN1), Settings.TaskDevicePin1[event->TaskIndex]);
 
       	addFormNumericBox(F("RX Receive Timeout (mSec)"), F("plugin_020_rxwait"), Settings.TaskDevicePluginConfig[event->TaskIndex][0]);
 
@@ -75,6 +141,14 @@ boolean Plugin_020(byte function, struct EventStruct *event, String& string)
         options2[2] = F("RFLink");
         addFormSelector(F("Event processing"), F("plugin_020_events"), 3, options2, NULL, choice2);
 
+        {
+          String options3[4] = { F("1 kB"), F("2 kB"), F("4 kB"), F("8 kB") };
+          int optionValues3[4] = { 1, 2, 4, 8 };
+          addFormSelector(F("Buffer size"), F("plugin_020_buffer"), 4, options3, optionValues3, Plugin_020_ringKB(event->TaskIndex));
+          addFormNote(F("For each direction"));
+        }
+        addFormNumericBox(F("Max. clients"), F("plugin_020_clients"), Plugin_020_maxClients(event->TaskIndex), 1, P020_MAX_CLIENTS);
+
         success = true;
         break;
       }
@@ -88,15 +162,60 @@ boolean Plugin_020(byte function, struct EventStruct *event, String& string)
         ExtraTaskSettings.TaskDevicePluginConfigLong[4] = getFormItemInt(F("plugin_020_stop"));
         Settings.TaskDevicePluginConfig[event->TaskIndex][0] = getFormItemInt(F("plugin_020_rxwait"));
         Settings.TaskDevicePluginConfig[event->TaskIndex][1] = getFormItemInt(F("plugin_020_events"));
+        Settings.TaskDevicePluginConfig[event->TaskIndex][2] = getFormItemInt(F("plugin_020_buffer"));
+        Settings.TaskDevicePluginConfig[event->TaskIndex][3] = getFormItemInt(F("plugin_020_clients"));
+        success = true;
+        break;
+      }
+
+    case PLUGIN_WEBFORM_SHOW_VALUES:
+      {
+        if (Plugin_020_state == NULL)
+          break;
+        const P020_Ser2NetStruct& state = *Plugin_020_state;
+        byte connected = 0;
+        for (byte i = 0; i < state.maxClients; ++i)
+          if (state.clientSince[i] != 0) ++connected;
+        string += F("<div class=\"div_l\">Clients:</div><div class=\"div_r\">");
+        string += connected;
+        string += '/';
+        string += state.maxClients;
+        string += F("</div><div class=\"div_br\"></div><div class=\"div_l\">Serial>Net:</div><div class=\"div_r\">");
+        string += state.bytesToNet;
+        string += F("</div><div class=\"div_br\"></div><div class=\"div_l\">Net>Serial:</div><div class=\"div_r\">");
+        string += state.bytesToSerial;
+        string += F("</div><div class=\"div_br\"></div><div class=\"div_l\">Overruns:</div><div class=\"div_r\">");
+        string += state.netOverrunBytes;
+        string += '/';
+        string += serialRx.overruns;
+        string += getWebString(WEB_STR_DIV_END);
         success = true;
         break;
       }
 
     case PLUGIN_INIT:
       {
+        Plugin_020_exit();
         LoadTaskSettings(event->TaskIndex);
         if ((ExtraTaskSettings.TaskDevicePluginConfigLong[0] != 0) && (ExtraTaskSettings.TaskDevicePluginConfigLong[1] != 0))
         {
+          Plugin_020_state = new P020_Ser2NetStruct();
+          P020_Ser2NetStruct& state = *Plugin_020_state;
+          unsigned int ringSize = Plugin_020_ringKB(event->TaskIndex) * 1024;
+          while (!(state.serialRx.allocate(ringSize) && state.netRx.allocate(ringSize)) && ringSize > P020_MIN_RING_SIZE)
+            ringSize /= 2;
+          if (state.serialRx.data == NULL || state.netRx.data == NULL) {
+            addLog(LOG_LEVEL_ERROR, F("Ser2N: Not enough memory for the buffers"));
+            Plugin_020_exit();
+            break;
+          }
+          state.maxClients = Plugin_020_maxClients(event->TaskIndex);
+          for (byte i = 0; i < state.maxClients; ++i)
+            registerSocketClient(state.clients[i], SOCKET_SER2NET);
+          state.rxWait = Settings.TaskDevicePluginConfig[event->TaskIndex][0];
+          if (state.rxWait <= 0)
+            state.rxWait = 1;
+
           #if defined(ESP8266)
             byte serialconfig = 0x10;
           #endif
@@ -107,22 +226,18 @@ boolean Plugin_020(byte function, struct EventStruct *event, String& string)
           serialconfig += (ExtraTaskSettings.TaskDevicePluginConfigLong[2] - 5) << 2;
           if (ExtraTaskSettings.TaskDevicePluginConfigLong[4] == 2)
             serialconfig += 0x20;
-          #if defined(ESP8266)
-            Serial.begin(ExtraTaskSettings.TaskDevicePluginConfigLong[1], (SerialConfig)serialconfig);
-          #endif
-          #if defined(ESP32)
-            Serial.begin(ExtraTaskSettings.TaskDevicePluginConfigLong[1], serialconfig);
-          #endif
-          ser2netServer = new WiFiServer(ExtraTaskSettings.TaskDevicePluginConfigLong[0]);
-          ser2netServer->begin();
+          // A message ends after the RX receive timeout of silence.
+          serialRxBegin(event->TaskIndex, ExtraTaskSettings.TaskDevicePluginConfigLong[1], serialconfig,
+                        P020_SERIAL_RX_SIZE, SERIAL_RX_NO_FRAME_END, state.rxWait * 1000UL);
+          state.server = new WiFiServer(ExtraTaskSettings.TaskDevicePluginConfigLong[0]);
+          state.server->begin();
 
           if (Settings.TaskDevicePin1[event->TaskIndex] != -1)
           {
             pinMode(Settings.TaskDevicePin1[event->TaskIndex], OUTPUT);
             digitalWrite(Settings.TaskDevicePin1[event->TaskIndex], LOW);
-            delay(500);
-            digitalWrite(Settings.TaskDevicePin1[event->TaskIndex], HIGH);
-            pinMode(Settings.TaskDevicePin1[event->TaskIndex], INPUT_PULLUP);
+            // Release the reset after 500 msec, in PLUGIN_TIMER_IN
+            setSystemTimer(500, PLUGIN_ID_020, event->TaskIndex, Settings.TaskDevicePin1[event->TaskIndex]);
           }
 
           Plugin_020_init = true;
@@ -132,150 +247,35 @@ boolean Plugin_020(byte function, struct EventStruct *event, String& string)
         break;
       }
 
-    case PLUGIN_TEN_PER_SECOND:
+    case PLUGIN_EXIT:
       {
-        if (Plugin_020_init)
-        {
-          size_t bytes_read;
-          if (ser2netServer->hasClient())
-          {
-            if (ser2netClient) ser2netClient.stop();
-            ser2netClient = ser2netServer->available();
-            addLog(LOG_LEVEL_ERROR, F("Ser2N: Client connected!"));
-          }
-
-          if (ser2netClient.connected())
-          {
-            connectionState = 1;
-            uint8_t net_buf[P020_BUFFER_SIZE];
-            int count = ser2netClient.available();
-            if (count > 0)
-            {
-              if (count > P020_BUFFER_SIZE)
-                count = P020_BUFFER_SIZE;
-              bytes_read = ser2netClient.read(net_buf, count);
-              Serial.write(net_buf, bytes_read);
-              Serial.flush(); // Waits for the transmission of outgoing serial data to complete
-
-              if (count == P020_BUFFER_SIZE) // if we have a full buffer, drop the last position to stuff with string end marker
-              {
-                count--;
-                addLog(LOG_LEVEL_ERROR, F("Ser2N: network buffer full!"));
-              }
-              net_buf[count] = 0; // before logging as a char array, zero terminate the last position to be safe.
-              char log[P020_BUFFER_SIZE + 40];
-              sprintf_P(log, PSTR("Ser2N: N>: %s"), (char*)net_buf);
-              addLog(LOG_LEVEL_DEBUG, log);
-            }
-          }
-          else
-          {
-            if (connectionState == 1) // there was a client connected before...
-            {
-              connectionState = 0;
-              // workaround see: https://github.com/esp8266/Arduino/issues/4497#issuecomment-373023864
-              ser2netClient = WiFiClient();
-              addLog(LOG_LEVEL_ERROR, F("Ser2N: Client disconnected!"));
-            }
-
-            while (Serial.available())
-              Serial.read();
-          }
+        Plugin_020_exit();
+        serialRxEnd(event->TaskIndex);
+        success = true;
+        break;
+      }
 
-          success = true;
-        }
+    case PLUGIN_TIMER_IN:
+      {
+        // End of the reset pulse started in PLUGIN_INIT
+        digitalWrite(event->Par1, HIGH);
+        pinMode(event->Par1, INPUT_PULLUP);
         break;
       }
 
     case PLUGIN_SERIAL_IN:
       {
-        uint8_t serial_buf[P020_BUFFER_SIZE];
-        int RXWait = Settings.TaskDevicePluginConfig[event->TaskIndex][0];
-        if (RXWait == 0)
-          RXWait = 1;
-        int timeOut = RXWait;
-        size_t bytes_read = 0;
-        while (timeOut > 0)
-        {
-          while (Serial.available()) {
-            if (bytes_read < P020_BUFFER_SIZE) {
-              serial_buf[bytes_read] = Serial.read();
-              bytes_read++;
-            }
-            else
-              Serial.read();  // when the buffer is full, just read remaining input, but do not store...
-
-            timeOut = RXWait; // if serial received, reset timeout counter
-          }
-          delay(1);
-          timeOut--;
-        }
-
-        if (bytes_read != P020_BUFFER_SIZE)
-        {
-          if (bytes_read > 0) {
-            if (Plugin_020_init && ser2netClient.connected())
-            {
-              ser2netClient.write((const uint8_t*)serial_buf, bytes_read);
-              ser2netClient.flush();
-            }
-          }
-        }
-        else // if we have a full buffer, drop the last position to stuff with string end marker
-        {
-          while (Serial.available()) // read possible remaining data to avoid sending rubbish...
-            Serial.read();
-          bytes_read--;
-          // and log buffer full situation
-          addLog(LOG_LEVEL_ERROR, F("Ser2N: serial buffer full!"));
-        }
-        serial_buf[bytes_read] = 0; // before logging as a char array, zero terminate the last position to be safe.
-        char log[P020_BUFFER_SIZE + 40];
-        sprintf_P(log, PSTR("Ser2N: S>: %s"), (char*)serial_buf);
-        addLog(LOG_LEVEL_DEBUG, log);
-
-        // We can also use the rules engine for local control!
-        if (Settings.UseRules)
-        {
-          String message = (char*)serial_buf;
-          int NewLinePos = message.indexOf(F("\r\n"));
-          if (NewLinePos > 0)
-            message = message.substring(0, NewLinePos);
-          String eventString = "";
+        // The serial data is for the network clients, not for the serial command handler.
+        Plugin_020_process();
+        success = true;
+        break;
+      }
 
-          switch (Plugin_020_SerialProcessing)
-          {
-            case 0:
-              {
-                break;
-              }
-
-            case 1: // Generic
-              {
-                eventString = F("!Serial#");
-                eventString += message;
-                break;
-              }
-
-            case 2: // RFLink
-              {
-                message = message.substring(6); // RFLink, strip 20;xx; from incoming message
-                if (message.startsWith("ESPEASY")) // Special treatment for gpio values, strip unneeded parts...
-                {
-                  message = message.substring(8); // Strip "ESPEASY;"
-                  eventString = F("RFLink#");
-                }
-                else
-                  eventString = F("!RFLink#"); // default event as it comes in, literal match needed in rules, using '!'
-                eventString += message;
-                break;
-              }
-          } // switch
-
-          if (eventString.length() > 0)
-            rulesProcessing(eventString);
-
-        } // if rules
+    case PLUGIN_INTERRUPT_EVENT:
+      {
+        // Idle line, the message is complete.
+        if (event->Par1 == SERIAL_RX_EVENT_IDLE)
+          Plugin_020_process();
         success = true;
         break;
       }
@@ -295,4 +295,244 @@ boolean Plugin_020(byte function, struct EventStruct *event, String& string)
   }
   return success;
 }
+
+byte Plugin_020_ringKB(byte taskIndex)
+{
+  const int kB = Settings.TaskDevicePluginConfig[taskIndex][2];
+  return (kB == 1 || kB == 2 || kB == 4 || kB == 8) ? kB : P020_DEFAULT_RING_KB;
+}
+
+byte Plugin_020_maxClients(byte taskIndex)
+{
+  const int clients = Settings.TaskDevicePluginConfig[taskIndex][3];
+  return (clients < 1 || clients > P020_MAX_CLIENTS) ? 1 : clients;
+}
+
+void Plugin_020_exit()
+{
+  Plugin_020_init = false;
+  if (Plugin_020_state == NULL)
+    return;
+  for (byte i = 0; i < P020_MAX_CLIENTS; ++i) {
+    Plugin_020_state->clients[i].stop();
+    unregisterSocketClient(Plugin_020_state->clients[i]);
+  }
+  if (Plugin_020_state->server != NULL) {
+    Plugin_020_state->server->close();
+    delete Plugin_020_state->server;
+  }
+  delete Plugin_020_state;
+  Plugin_020_state = NULL;
+}
+
+/*********************************************************************************************\
+   Move data between the serial port and the clients, called on every loop pass from
+   backgroundtasks(). Data is read and written in place in the ring buffers, no polling delay.
+  \*********************************************************************************************/
+void Plugin_020_process()
+{
+  if (!Plugin_020_init || Plugin_020_state == NULL)
+    return;
+  Plugin_020_acceptClients();
+  Plugin_020_serialToNet();
+  Plugin_020_netToSerial();
+  // A message ends when the serial port was silent for the RX receive timeout
+  P020_Ser2NetStruct& state = *Plugin_020_state;
+  if (state.messageLength != 0 && timePassedSince(state.lastSerialByte) >= state.rxWait)
+    Plugin_020_processMessage();
+}
+
+void Plugin_020_acceptClients()
+{
+  P020_Ser2NetStruct& state = *Plugin_020_state;
+  for (byte i = 0; i < state.maxClients; ++i) {
+    if (state.clientSince[i] != 0 && !state.clients[i].connected()) {
+      state.clients[i].stop();
+      // workaround see: https://github.com/esp8266/Arduino/issues/4497#issuecomment-373023864
+      state.clients[i] = WiFiClient();
+      state.clientSince[i] = 0;
+      addLog(LOG_LEVEL_ERROR, F("Ser2N: Client disconnected!"));
+    }
+  }
+  while (state.server->hasClient()) {
+    // A free slot, or else the client connected longest ago is replaced
+    byte slot = 0;
+    for (byte i = 0; i < state.maxClients; ++i) {
+      if (state.clientSince[i] == 0) {
+        slot = i;
+        break;
+      }
+      if (timePassedSince(state.clientSince[i]) > timePassedSince(state.clientSince[slot]))
+        slot = i;
+    }
+    if (state.clientSince[slot] != 0) {
+      state.clients[slot].stop();
+      ++state.rejectedClients;
+    } else if (!socketAvailable(SOCKET_SER2NET)) {
+      // No connection left for an additional client
+      state.server->available().stop();
+      ++state.rejectedClients;
+      continue;
+    }
+    state.clients[slot] = state.server->available();
+    state.clients[slot].setNoDelay(true);
+    state.clientSent[slot] = state.serialRx.head;
+    state.clientSince[slot] = millis();
+    if (state.clientSince[slot] == 0) state.clientSince[slot] = 1;
+    addLog(LOG_LEVEL_ERROR, F("Ser2N: Client connected!"));
+  }
+}
+
+void Plugin_020_serialToNet()
+{
+  P020_Ser2NetStruct& state = *Plugin_020_state;
+  P020_RingBuffer& ring = state.serialRx;
+  int available = serialRxAvailable();
+  while (available > 0) {
+    unsigned int chunk = ring.contiguous(ring.head);
+    if (chunk > static_cast<unsigned int>(available)) chunk = available;
+    uint8_t* data = ring.at(ring.head);
+    chunk = serialRxReadBytes(data, chunk);
+    if (chunk == 0) break;
+    ring.head += chunk;
+    available -= chunk;
+    state.lastSerialByte = millis();
+    Plugin_020_addToMessage(data, chunk);
+  }
+
+  for (byte i = 0; i < state.maxClients; ++i) {
+    if (state.clientSince[i] == 0) continue;
+    unsigned long& sent = state.clientSent[i];
+    if (ring.head - sent > ring.size()) {
+      // Client too slow, the oldest data was overwritten.
+      state.netOverrunBytes += ring.head - sent - ring.size();
+      sent = ring.head - ring.size();
+    }
+    while (sent != ring.head) {
+      unsigned int chunk = ring.contiguous(sent);
+      if (chunk > ring.head - sent) chunk = ring.head - sent;
+      #if defined(ESP8266)
+      const unsigned int room = state.clients[i].availableForWrite();
+      if (room == 0) break;
+      if (chunk > room) chunk = room;
+      #endif
+      const size_t written = state.clients[i].write(ring.at(sent), chunk);
+      if (written == 0) break;
+      sent += written;
+      state.bytesToNet += written;
+    }
+  }
+}
+
+void Plugin_020_netToSerial()
+{
+  P020_Ser2NetStruct& state = *Plugin_020_state;
+  P020_RingBuffer& ring = state.netRx;
+  for (byte i = 0; i < state.maxClients; ++i) {
+    if (state.clientSince[i] == 0) continue;
+    int available = state.clients[i].available();
+    // When the ring is full the data stays in the TCP buffers, so the sender is slowed down.
+    while (available > 0 && ring.room() > 0) {
+      unsigned int chunk = ring.contiguous(ring.head);
+      if (chunk > ring.room()) chunk = ring.room();
+      if (chunk > static_cast<unsigned int>(available)) chunk = available;
+      const int bytes_read = state.clients[i].read(ring.at(ring.head), chunk);
+      if (bytes_read <= 0) break;
+      if (loglevelActiveFor(LOG_LEVEL_DEBUG))
+        Plugin_020_logData(F("Ser2N: N>: "), ring.at(ring.head), bytes_read);
+      ring.head += bytes_read;
+      available -= bytes_read;
+    }
+  }
+  while (ring.used() > 0) {
+    unsigned int chunk = ring.contiguous(ring.tail);
+    if (chunk > ring.used()) chunk = ring.used();
+    #if defined(ESP8266)
+    // Only what fits in the UART FIFO, Serial.write() would wait for the rest.
+    const unsigned int room = Serial.availableForWrite();
+    if (room == 0) break;
+    if (chunk > room) chunk = room;
+    #endif
+    Serial.write(ring.at(ring.tail), chunk);
+    ring.tail += chunk;
+    state.bytesToSerial += chunk;
+  }
+}
+
+void Plugin_020_logData(const __FlashStringHelper* prefix, const uint8_t* data, unsigned int length)
+{
+  String log = prefix;
+  log.reserve(log.length() + length);
+  for (unsigned int i = 0; i < length; ++i)
+    log += static_cast<char>(data[i]);
+  addLog(LOG_LEVEL_DEBUG, log);
+}
+
+// Collect the serial data of a message for the rules events and the log.
+void Plugin_020_addToMessage(const uint8_t* data, unsigned int length)
+{
+  if (!Settings.UseRules && !loglevelActiveFor(LOG_LEVEL_DEBUG))
+    return;
+  P020_Ser2NetStruct& state = *Plugin_020_state;
+  for (unsigned int i = 0; i < length; ++i) {
+    state.message[state.messageLength++] = data[i];
+    if (state.messageLength == P020_BUFFER_SIZE - 1) {
+      addLog(LOG_LEVEL_ERROR, F("Ser2N: serial buffer full!"));
+      Plugin_020_processMessage();
+    }
+  }
+}
+
+void Plugin_020_processMessage()
+{
+  P020_Ser2NetStruct& state = *Plugin_020_state;
+  state.message[state.messageLength] = 0; // before logging as a char array, zero terminate the last position to be safe.
+  state.messageLength = 0;
+  char log[P020_BUFFER_SIZE + 40];
+  sprintf_P(log, PSTR("Ser2N: S>: %s"), state.message);
+  addLog(LOG_LEVEL_DEBUG, log);
+
+  // We can also use the rules engine for local control!
+  if (Settings.UseRules)
+  {
+    String message = state.message;
+    int NewLinePos = message.indexOf(F("\r\n"));
+    if (NewLinePos > 0)
+      message = message.substring(0, NewLinePos);
+    String eventString = "";
+
+    switch (Plugin_020_SerialProcessing)
+    {
+      case 0:
+        {
+          break;
+        }
+
+      case 1: // Generic
+        {
+          eventString = F("!Serial#");
+          eventString += message;
+          break;
+        }
+
+      case 2: // RFLink
+        {
+          message = message.substring(6); // RFLink, strip 20;xx; from incoming message
+          if (message.startsWith("ESPEASY")) // Special treatment for gpio values, strip unneeded parts...
+          {
+            message = message.substring(8); // Strip "ESPEASY;"
+            eventString = F("RFLink#");
+          }
+          else
+            eventString = F("!RFLink#"); // default event as it comes in, literal match needed in rules, using '!'
+          eventString += message;
+          break;
+        }
+    } // switch
+
+    if (eventString.length() > 0)
+      rulesProcessing(eventString);
+
+  } // if rules
+}
 #endif // USES_P020
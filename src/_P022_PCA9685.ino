@@ -21,6 +21,8 @@
 #define PCA9685_MIN_FREQUENCY   23.0 // Min possible PWM cycle frequency
 #define PCA9685_MAX_FREQUENCY   1500.0 // Max possible PWM cycle frequency
 #define PCA9685_ALLLED_REG          (byte)0xFA
+#define PCA9685_BUFFERS   4  // Devices with a channel buffer, writes to others are sent directly
+#define PCA9685_BURST     (I2C_TRANSACTION_MAX_DATA / 4)  // Adjacent channels per transfer (auto increment)
 
 /*
 is bit flag any bit rapresent the initialization state of PCA9685
@@ -30,6 +32,20 @@ es:  bit 3 is set 1 PCA9685 with address 0X40 + 0x03 is intin
 #define SET_INIT(state, bit) (state|= 1 << bit)
 long long initializeState; //
 
+/*
+Channel buffer of a PCA9685: Plugin_022_Set() only changes the buffer,
+Plugin_022_Commit() writes the changed channels, adjacent ones in one transfer.
+*/
+struct Plugin_022_BufferStruct
+{
+  Plugin_022_BufferStruct() : address(-1), dirty(0), known(0) {}
+
+  int address;
+  uint16_t value[PCA9685_MAX_PINS + 1];  // OFF time, the ON time is 0
+  uint16_t dirty;                        // Set since the last commit
+  uint16_t known;                        // The device has the value of the buffer
+} Plugin_022_buffers[PCA9685_BUFFERS];
+
 boolean Plugin_022(byte function, struct EventStruct *event, String& string)
 {
   boolean success = false;
@@ -75,14 +91,14 @@ boolean Plugin_022(byte function, struct EventStruct *event, String& string)
         {
           optionValues[i] = PCA9685_ADDRESS + i;
         }
-        addFormSelectorI2C(F("i2c_addr"), PCA9685_NUMS_ADDRESS, optionValues, address);
+        addFormSelectorI2C(getWebString(WEB_STR_I2C_ADDR), PCA9685_NUMS_ADDRESS, optionValues, address);
         success = true;
         break;
       }
 
     case PLUGIN_WEBFORM_SAVE:
       {
-        Settings.TaskDevicePort[event->TaskIndex] = getFormItemInt(F("i2c_addr"));
+        Settings.TaskDevicePort[event->TaskIndex] = getFormItemInt(getWebString(WEB_STR_I2C_ADDR));
         success = true;
         break;
       }
@@ -135,6 +151,49 @@ boolean Plugin_022(byte function, struct EventStruct *event, String& string)
             addLog(LOG_LEVEL_ERROR, log + String(F(" is invalid value.")));
           }
         }
+        // pcapwmmulti,<pin>,<pwm>,<pin>,<pwm>,...  All values are written at once
+        if (command == F("pcapwmmulti") || (istanceCommand && command == F("pwmmulti")))
+        {
+          success = true;
+          log = String(F("PCA 0x")) + String(address, HEX) + String(F(": PWM"));
+          int pins[PCA9685_MAX_PINS + 1];
+          int values[PCA9685_MAX_PINS + 1];
+          byte count = 0;
+          bool valid = true;
+          for (byte paramIdx = 2; valid; paramIdx += 2)
+          {
+            String pinParam = parseString(line, paramIdx);
+            if (pinParam.length() == 0)
+              break;
+            if (count > PCA9685_MAX_PINS ||
+                !validIntFromString(pinParam, pins[count]) ||
+                !validIntFromString(parseString(line, paramIdx + 1), values[count]) ||
+                pins[count] < 0 || pins[count] > PCA9685_MAX_PINS ||
+                values[count] < 0 || values[count] > PCA9685_MAX_PWM)
+            {
+              valid = false;
+              break;
+            }
+            log += String(F(" ")) + String(pins[count]) + String(F("=")) + String(values[count]);
+            ++count;
+          }
+          if (valid && count > 0)
+          {
+            if (!IS_INIT(initializeState, (address - PCA9685_ADDRESS))) Plugin_022_initialize(address);
+
+            for (byte i = 0; i < count; i++)
+              Plugin_022_Set(address, pins[i], values[i]);
+            Plugin_022_Commit(address);
+            for (byte i = 0; i < count; i++)
+              setPinState(PLUGIN_ID_022, pins[i], PIN_MODE_PWM, values[i]);
+            addLog(LOG_LEVEL_INFO, log);
+            SendStatus(event->Source, getPinStateJSON(SEARCH_PIN_STATE, PLUGIN_ID_022, pins[0], log, 0));
+          }
+          else{
+            addLog(LOG_LEVEL_ERROR, log + String(F(" invalid pin or pwm value.")));
+          }
+        }
+
         if (command == F("pcafrq") || (istanceCommand && command == F("frq")))
         {
           success = true;
@@ -297,19 +356,21 @@ boolean Plugin_022(byte function, struct EventStruct *event, String& string)
 //********************************************************************************
 // PCA9685 config
 //********************************************************************************
+// Direct transfers, after the queued PWM writes so the order is kept.
 void Plugin_022_writeRegister(int i2cAddress, int regAddress, byte data) {
-  Wire.beginTransmission(i2cAddress);
-  Wire.write(regAddress);
-  Wire.write(data);
-  Wire.endTransmission();
+  I2C_flushQueue();
+  I2C_write8_reg(i2cAddress, regAddress, data);
 }
 
 uint8_t Plugin_022_readRegister(int i2cAddress, int regAddress) {
   uint8_t res = 0;
-  Wire.requestFrom(i2cAddress,1,1);
+  I2C_flushQueue();
+  I2C_beginTransfer(i2cAddress);
+  const byte count = Wire.requestFrom(i2cAddress,1,1);
   while (Wire.available()) {
     res = Wire.read();
   }
+  I2C_endTransfer(count == 1 ? 0 : I2C_RESULT_SHORT_READ);
   return res;
 }
 
@@ -327,22 +388,104 @@ void Plugin_022_On(int address, int pin)
   Plugin_022_Write(address, pin, PCA9685_MAX_PWM);
 }
 
+// Queued, so a command setting many outputs does not wait for the bus.
+void Plugin_022_queueWrite(int i2cAddress, int regAddress, const uint16_t* values, byte count)
+{
+  I2CTransactionStruct transaction;
+  transaction.address = i2cAddress;
+  transaction.reg = regAddress;
+  transaction.writeLength = 4 * count;
+  for (byte i = 0; i < count; i++)
+  {
+    transaction.data[4 * i]     = 0;  // LED_ON
+    transaction.data[4 * i + 1] = 0;
+    transaction.data[4 * i + 2] = lowByte(values[i]);
+    transaction.data[4 * i + 3] = highByte(values[i]);
+  }
+  if (!I2C_queueTransaction(transaction)) {
+    I2C_flushQueue();
+    I2C_executeTransaction(transaction);
+  }
+}
+
+// The buffer of a device, NULL when all buffers are used by other devices.
+struct Plugin_022_BufferStruct* Plugin_022_getBuffer(int address)
+{
+  Plugin_022_BufferStruct* unused = NULL;
+  for (byte i = 0; i < PCA9685_BUFFERS; i++)
+  {
+    if (Plugin_022_buffers[i].address == address)
+      return &Plugin_022_buffers[i];
+    if (unused == NULL && Plugin_022_buffers[i].address < 0)
+      unused = &Plugin_022_buffers[i];
+  }
+  if (unused != NULL)
+  {
+    unused->address = address;
+    unused->dirty = 0;
+    unused->known = 0;
+  }
+  return unused;
+}
+
+// Set a channel in the buffer, sent by Plugin_022_Commit().
+void Plugin_022_Set(int address, int pin, int value)
+{
+  Plugin_022_BufferStruct* buffer = Plugin_022_getBuffer(address);
+  if (buffer == NULL)
+  {
+    const uint16_t offTime = value;
+    Plugin_022_queueWrite(address, PCA9685_LED0 + 4 * pin, &offTime, 1);
+    return;
+  }
+  const uint16_t mask = 1 << pin;
+  if ((buffer->known & mask) && !(buffer->dirty & mask) && buffer->value[pin] == value)
+    return;
+  buffer->value[pin] = value;
+  buffer->dirty |= mask;
+}
+
+// Write the channels set since the last commit, runs of adjacent channels in one transfer.
+void Plugin_022_Commit(int address)
+{
+  Plugin_022_BufferStruct* buffer = Plugin_022_getBuffer(address);
+  if (buffer == NULL)
+    return;
+  int pin = 0;
+  while (pin <= PCA9685_MAX_PINS)
+  {
+    if (!(buffer->dirty & (1 << pin)))
+    {
+      pin++;
+      continue;
+    }
+    const int first = pin;
+    while (pin <= PCA9685_MAX_PINS && (buffer->dirty & (1 << pin)) && pin - first < PCA9685_BURST)
+      pin++;
+    Plugin_022_queueWrite(address, PCA9685_LED0 + 4 * first, &buffer->value[first], pin - first);
+  }
+  buffer->known |= buffer->dirty;
+  buffer->dirty = 0;
+}
+
 void Plugin_022_Write(int address, int Par1, int Par2)
 {
-  int i2cAddress = address;
-  // boolean success = false;
-  int regAddress = Par1 == -1
-    ? PCA9685_ALLLED_REG
-    : PCA9685_LED0 + 4 * Par1;
-  uint16_t LED_ON = 0;
-  uint16_t LED_OFF = Par2;
-  Wire.beginTransmission(i2cAddress);
-  Wire.write(regAddress);
-  Wire.write(lowByte(LED_ON));
-  Wire.write(highByte(LED_ON));
-  Wire.write(lowByte(LED_OFF));
-  Wire.write(highByte(LED_OFF));
-  Wire.endTransmission();
+  if (Par1 != -1)
+  {
+    Plugin_022_Set(address, Par1, Par2);
+    Plugin_022_Commit(address);
+    return;
+  }
+  const uint16_t offTime = Par2;
+  Plugin_022_queueWrite(address, PCA9685_ALLLED_REG, &offTime, 1);
+  Plugin_022_BufferStruct* buffer = Plugin_022_getBuffer(address);
+  if (buffer != NULL)
+  {
+    for (byte i = 0; i <= PCA9685_MAX_PINS; i++)
+      buffer->value[i] = Par2;
+    buffer->known = 0xFFFF;
+    buffer->dirty = 0;
+  }
 }
 
 void Plugin_022_Frequency(int address, uint16_t freq)
@@ -372,5 +515,11 @@ void Plugin_022_initialize(int address)
   Plugin_022_writeRegister(i2cAddress, PLUGIN_022_PCA9685_MODE1, (byte)B10100000);  // set up for auto increment
   Plugin_022_writeRegister(i2cAddress, PCA9685_MODE2, (byte)0x10); // set to output
   SET_INIT(initializeState, (address - PCA9685_ADDRESS));
+  Plugin_022_BufferStruct* buffer = Plugin_022_getBuffer(address);
+  if (buffer != NULL)
+  {
+    buffer->known = 0;  // The reset turned all outputs off
+    buffer->dirty = 0;
+  }
 }
 #endif // USES_P022
@@ -14,15 +14,21 @@
 #define PLUGIN_NAME_023       "Display - OLED SSD1306"
 #define PLUGIN_VALUENAME1_023 "OLED"
 #define PLUGIN_023_MAX_DYSPALY 2
+#define PLUGIN_023_ROWS        8
+#define PLUGIN_023_COLS       16
+#define PLUGIN_023_DATA_CHUNK 16   // Data bytes per I2C transmission
 
 struct Plugin_023_OLED_SettingStruct
 {
   Plugin_023_OLED_SettingStruct(): address(0)
-  , type(0),font_width(0),displayTimer(0){}
+  , type(0),font_width(0),displayTimer(0){
+    memset(shownText, 0, sizeof(shownText));
+  }
   byte address;
   byte type;
   byte font_width;
   byte displayTimer;
+  char shownText[PLUGIN_023_ROWS][PLUGIN_023_COLS + 1];  // Text written from the first column of each row
 } OLED_Settings[PLUGIN_023_MAX_DYSPALY];
 
 enum
@@ -57,6 +63,7 @@ boolean Plugin_023(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].ValueCount = 0;
         Device[deviceCount].SendDataOption = false;
         Device[deviceCount].TimerOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND | PLUGIN_CALLBACK_ONCE_A_SECOND;
         break;
       }
 
@@ -101,7 +108,7 @@ boolean Plugin_023(byte function, struct EventStruct *event, String& string)
           addFormTextBox(String(F("Line ")) + (varNr + 1), String(F("Plugin_023_template")) + (varNr + 1), deviceTemplate[varNr], 64);
         }
 
-        addFormPinSelect(F("Display button"), F("taskdevicepin3"), Settings.TaskDevicePin3[event->TaskIndex]);
+        addFormPinSelect(F("Display button"), getWebString(WEB_STR_TASKDEVICEPIN3), Settings.TaskDevicePin3[event->TaskIndex]);
 
         addFormNumericBox(F("Display Timeout"), F("plugin_23_timer"), Settings.TaskDevicePluginConfig[event->TaskIndex][2]);
 
@@ -215,7 +222,13 @@ boolean Plugin_023(byte function, struct EventStruct *event, String& string)
           if (tmpString.length())
           {
             String newString = P023_parseTemplate(tmpString, 16);
-            Plugin_023_sendStrXY(OLED_Settings[index],newString.c_str(), x, 0);
+            // Unchanged lines are not sent again
+            if (strcmp(OLED_Settings[index].shownText[x], newString.c_str()) != 0)
+            {
+              START_TIMER;
+              Plugin_023_sendStrXY(OLED_Settings[index],newString.c_str(), x, 0);
+              STOP_TIMER(OLED_FRAME_STATS);
+            }
           }
         }
         success = false;
@@ -517,16 +530,27 @@ void Plugin_023_displayOff(struct Plugin_023_OLED_SettingStruct &oled)
 void Plugin_023_clear_display(struct Plugin_023_OLED_SettingStruct &oled)
 {
   unsigned char i, k;
+  uint8_t zeros[PLUGIN_023_DATA_CHUNK];
+  memset(zeros, 0, sizeof(zeros));
   for (k = 0; k < 8; k++)
   {
     Plugin_023_setXY(oled, k, 0);
+    for (i = 0; i < 128; i += PLUGIN_023_DATA_CHUNK) //clear all COL
     {
-      for (i = 0; i < 128; i++) //clear all COL
-      {
-        Plugin_023_SendChar(oled, 0);         //clear all COL
-      }
+      Plugin_023_sendData(oled, zeros, PLUGIN_023_DATA_CHUNK);
     }
   }
+  memset(oled.shownText, 0, sizeof(oled.shownText));
+}
+
+
+// Send display data in one transmission, at most PLUGIN_023_DATA_CHUNK bytes.
+void Plugin_023_sendData(struct Plugin_023_OLED_SettingStruct &oled, const uint8_t *data, byte length)
+{
+  Wire.beginTransmission(oled.address);  // begin transmitting
+  Wire.write(0x40);                      //data mode
+  Wire.write(data, length);
+  Wire.endTransmission();              // stop transmitting
 }
 
 
@@ -605,9 +629,20 @@ void Plugin_023_setXY(struct Plugin_023_OLED_SettingStruct &oled, unsigned char
 // This means we have 16 COLS (0-15) and 8 ROWS (0-7).
 void Plugin_023_sendStrXY(struct Plugin_023_OLED_SettingStruct &oled,  const char *string, int X, int Y)
 {
+  if (X >= 0 && X < PLUGIN_023_ROWS)
+  {
+    // Only text written from the first column is known for the whole row
+    if (Y == 0)
+      strncpy(oled.shownText[X], string, PLUGIN_023_COLS);
+    else
+      oled.shownText[X][0] = 0;
+    oled.shownText[X][PLUGIN_023_COLS] = 0;
+  }
+
   Plugin_023_setXY(oled, X, Y);
   unsigned char i = 0;
   unsigned char font_width = 0;
+  uint8_t glyph[8];
 
   while (*string)
   {
@@ -622,8 +657,9 @@ void Plugin_023_sendStrXY(struct Plugin_023_OLED_SettingStruct &oled,  const cha
 
     for (i = 0; i < font_width; i++)
     {
-      Plugin_023_SendChar(oled, pgm_read_byte(Plugin_023_myFont[*string - 0x20] + i));
+      glyph[i] = pgm_read_byte(Plugin_023_myFont[*string - 0x20] + i);
     }
+    Plugin_023_sendData(oled, glyph, font_width);
     string++;
   }
 }
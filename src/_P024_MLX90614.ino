@@ -8,7 +8,7 @@
 #define PLUGIN_024
 #define PLUGIN_ID_024 24
 #define PLUGIN_NAME_024 "Environment - MLX90614"
-#define PLUGIN_VALUENAME1_024 "Temperature"
+#define PLUGIN_VALUENAME1_024 WEB_STR_TEMPERATURE
 
 boolean Plugin_024_init = false;
 
@@ -63,7 +63,7 @@ boolean Plugin_024(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_GET_DEVICEVALUENAMES:
       {
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_024));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], getWebStringP(PLUGIN_VALUENAME1_024));
         break;
       }
 
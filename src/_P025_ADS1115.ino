@@ -11,12 +11,10 @@
 boolean Plugin_025_init = false;
 
 uint16_t readRegister025(uint8_t i2cAddress, uint8_t reg) {
-  Wire.beginTransmission(i2cAddress);
-  Wire.write((0x00));
-  Wire.endTransmission();
-  if (Wire.requestFrom(i2cAddress, (uint8_t)2) != 2)
+  uint8_t data[2];
+  if (!I2C_read_block(i2cAddress, reg, data, 2))
     return 0x8000;
-  return ((Wire.read() << 8) | Wire.read());
+  return I2C_block_BE16(data, 0);
 }
 
 boolean Plugin_025(byte function, struct EventStruct *event, String& string)
@@ -165,11 +163,7 @@ boolean Plugin_025(byte function, struct EventStruct *event, String& string)
 
         config |= (0x8000);   // Start a single conversion
 
-        Wire.beginTransmission(address);
-        Wire.write((uint8_t)(0x01));
-        Wire.write((uint8_t)(config >> 8));
-        Wire.write((uint8_t)(config & 0xFF));
-        Wire.endTransmission();
+        I2C_write16_reg(address, 0x01, config);
 
         String log = F("ADS1115 : Analog value: ");
 
@@ -265,32 +265,22 @@ boolean Plugin_027(byte function, struct EventStruct *event, String& string)
 }
 
 //**************************************************************************/
-// Sends a single command byte over I2C
+// Writes a 16 bit register over I2C
 //**************************************************************************/
 void Plugin_027_wireWriteRegister (uint8_t i2caddr, uint8_t reg, uint16_t value)
 {
-  Wire.beginTransmission(i2caddr);
-  Wire.write(reg);                       // Register
-  Wire.write((value >> 8) & 0xFF);       // Upper 8-bits
-  Wire.write(value & 0xFF);              // Lower 8-bits
-  Wire.endTransmission();
+  I2C_write16_reg(i2caddr, reg, value);
 }
 
 //**************************************************************************/
-// Reads a 16 bit values over I2C
+// Reads a 16 bit register over I2C, in one transfer with a repeated start.
+// The register holds the last finished conversion, so there is no need to wait.
+// The INA219 does not increment the register address, every register is a separate read.
 //**************************************************************************/
 void Plugin_027_wireReadRegister(uint8_t i2caddr, uint8_t reg, uint16_t *value)
 {
-
-  Wire.beginTransmission(i2caddr);
-  Wire.write(reg);                       // Register
-  Wire.endTransmission();
-
-  delay(1); // Max 12-bit conversion time is 586us per sample
-
-  Wire.requestFrom(i2caddr, (uint8_t)2);
-  // Shift values to create properly formed integer
-  *value = ((Wire.read() << 8) | Wire.read());
+  uint8_t data[2];
+  *value = I2C_read_block(i2caddr, reg, data, 2) ? I2C_block_BE16(data, 0) : 0;
 }
 
 //**************************************************************************/
@@ -10,9 +10,9 @@
 #define PLUGIN_028
 #define PLUGIN_ID_028        28
 #define PLUGIN_NAME_028       "Environment - BMx280"
-#define PLUGIN_VALUENAME1_028 "Temperature"
-#define PLUGIN_VALUENAME2_028 "Humidity"
-#define PLUGIN_VALUENAME3_028 "Pressure"
+#define PLUGIN_VALUENAME1_028 WEB_STR_TEMPERATURE
+#define PLUGIN_VALUENAME2_028 WEB_STR_HUMIDITY
+#define PLUGIN_VALUENAME3_028 WEB_STR_PRESSURE
 
 #define PLUGIN_028_BME280_DEVICE "BME280"
 #define PLUGIN_028_BMP280_DEVICE "BMP280"
@@ -53,6 +53,7 @@
 #define BMx280_REGISTER_HUMIDDATA        0xFD
 
 #define BME280_CONTROL_SETTING_HUMIDITY  0x02 // Oversampling: 2x H
+#define BME280_MEASUREMENT_TIME          1587 // msec, the "T63" moment, see Plugin_028_readHumidity()
 
 #define BME280_TEMP_PRESS_CALIB_DATA_ADDR	0x88
 #define BME280_HUMIDITY_CALIB_DATA_ADDR		0xE1
@@ -240,9 +241,9 @@ boolean Plugin_028(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_GET_DEVICEVALUENAMES:
       {
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_028));
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], PSTR(PLUGIN_VALUENAME2_028));
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[2], PSTR(PLUGIN_VALUENAME3_028));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], getWebStringP(PLUGIN_VALUENAME1_028));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], getWebStringP(PLUGIN_VALUENAME2_028));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[2], getWebStringP(PLUGIN_VALUENAME3_028));
         break;
       }
 
@@ -283,22 +284,29 @@ boolean Plugin_028(byte function, struct EventStruct *event, String& string)
         success = true;
         break;
       }
-    case PLUGIN_ONCE_A_SECOND:
+    case PLUGIN_READ:
       {
+        // Start a measurement, the values are sent when it is collected in PLUGIN_TIMER_IN.
         const uint8_t i2cAddress = Plugin_028_i2c_addr(event);
-        const float tempOffset = Settings.TaskDevicePluginConfig[event->TaskIndex][2] / 10.0;
-        Plugin_028_update_measurements(i2cAddress, tempOffset);
+        if (Plugin_028_start_measurement(i2cAddress)) {
+          startTaskConversion(event, PLUGIN_ID_028, BME280_MEASUREMENT_TIME, 0);
+        }
+        success = false;
         break;
       }
 
-    case PLUGIN_READ:
+    case PLUGIN_TIMER_IN:
       {
+        if (!isTaskConversionTimer(event)) {
+          break;
+        }
         const uint8_t i2cAddress = Plugin_028_i2c_addr(event);
-        P028_sensordata& sensor = P028_sensors[i2cAddress];
-        if (sensor.state != BMx_New_values) {
-          success = false;
+        const float tempOffset = Settings.TaskDevicePluginConfig[event->TaskIndex][2] / 10.0;
+        if (!Plugin_028_collect_measurement(i2cAddress, tempOffset)) {
+          completeTaskConversion(event, false);
           break;
         }
+        P028_sensordata& sensor = P028_sensors[i2cAddress];
         sensor.state = BMx_Values_read;
         if (!sensor.hasHumidity()) {
           // Patch the sensor type to output only the measured values.
@@ -334,6 +342,7 @@ boolean Plugin_028(byte function, struct EventStruct *event, String& string)
           log += UserVar[event->BaseVarIndex + 2];
           addLog(LOG_LEVEL_INFO, log);
         }
+        completeTaskConversion(event, true);
         success = true;
         break;
       }
@@ -348,39 +357,32 @@ boolean Plugin_028(byte function, struct EventStruct *event, String& string)
 }
 
 
-// Only perform the measurements with big interval to prevent the sensor from warming up.
-bool Plugin_028_update_measurements(const uint8_t i2cAddress, float tempOffset) {
+// The sensor sleeps between the measurements, to prevent it from warming up.
+bool Plugin_028_start_measurement(const uint8_t i2cAddress) {
   P028_sensordata& sensor = P028_sensors[i2cAddress];
-  const unsigned long current_time = millis();
   Plugin_028_check(i2cAddress); // Check id device is present
   if (!sensor.initialized()) {
     if (!Plugin_028_begin(i2cAddress)) {
       return false;
     }
     sensor.state = BMx_Initialized;
-    sensor.last_measurement = 0;
   }
-  if (sensor.state != BMx_Wait_for_samples) {
-    if (sensor.last_measurement != 0 &&
-        !timeOutReached(sensor.last_measurement + (Settings.MessageDelay * 1000))) {
-      // Timeout has not yet been reached.
-      return false;
-    }
-
-    sensor.last_measurement = current_time;
-    // Set the Sensor in sleep to be make sure that the following configs will be stored
-    I2C_write8_reg(i2cAddress, BMx280_REGISTER_CONTROL, 0x00);
-    if (sensor.hasHumidity()) {
-      I2C_write8_reg(i2cAddress, BMx280_REGISTER_CONTROLHUMID, BME280_CONTROL_SETTING_HUMIDITY);
-    }
-    I2C_write8_reg(i2cAddress, BMx280_REGISTER_CONFIG, sensor.get_config_settings());
-    I2C_write8_reg(i2cAddress, BMx280_REGISTER_CONTROL, sensor.get_control_settings());
-    sensor.state = BMx_Wait_for_samples;
-    return false;
+  sensor.last_measurement = millis();
+  // Set the Sensor in sleep to be make sure that the following configs will be stored
+  I2C_write8_reg(i2cAddress, BMx280_REGISTER_CONTROL, 0x00);
+  if (sensor.hasHumidity()) {
+    I2C_write8_reg(i2cAddress, BMx280_REGISTER_CONTROLHUMID, BME280_CONTROL_SETTING_HUMIDITY);
   }
+  I2C_write8_reg(i2cAddress, BMx280_REGISTER_CONFIG, sensor.get_config_settings());
+  I2C_write8_reg(i2cAddress, BMx280_REGISTER_CONTROL, sensor.get_control_settings());
+  sensor.state = BMx_Wait_for_samples;
+  return true;
+}
 
-  if (!timeOutReached(sensor.last_measurement + 1000)) {
-    // Must wait one second to make sure the filtered values stabilize.
+// Read the measurement started BME280_MEASUREMENT_TIME ago.
+bool Plugin_028_collect_measurement(const uint8_t i2cAddress, float tempOffset) {
+  P028_sensordata& sensor = P028_sensors[i2cAddress];
+  if (sensor.state != BMx_Wait_for_samples) {
     return false;
   }
   if (!Plugin_028_readUncompensatedData(i2cAddress)) {
@@ -389,11 +391,10 @@ bool Plugin_028_update_measurements(const uint8_t i2cAddress, float tempOffset)
   // Set to sleep mode again to prevent the sensor from heating up.
   I2C_write8_reg(i2cAddress, BMx280_REGISTER_CONTROL, 0x00);
 
-  sensor.last_measurement = current_time;
-  sensor.state = BMx_New_values;
   sensor.last_temp_val = Plugin_028_readTemperature(i2cAddress);
   sensor.last_press_val = ((float)Plugin_028_readPressure(i2cAddress)) / 100;
   sensor.last_hum_val = ((float)Plugin_028_readHumidity(i2cAddress));
+  sensor.state = BMx_New_values;
 
 
   String log;
@@ -475,6 +476,7 @@ bool Plugin_028_check(uint8_t i2cAddress) {
         // Store detected chip ID when chip found.
         if (sensor.sensorID != chip_id) {
           sensor.sensorID = static_cast<BMx_ChipId>(chip_id);
+          I2C_clear_calibration(i2cAddress);
           sensor.setUninitialized();
           String log = F("BMx280 : Detected ");
           log += sensor.getFullDeviceName();
@@ -506,8 +508,9 @@ bool Plugin_028_begin(uint8_t i2cAddress) {
   // Perform soft reset
   I2C_write8_reg(i2cAddress, BMx280_REGISTER_SOFTRESET, 0xB6);
   delay(2);  // Startup time is 2 ms (datasheet)
-  Plugin_028_readCoefficients(i2cAddress);
-  delay(65); //May be needed here as well to fix first wrong measurement?
+  if (!Plugin_028_readCoefficients(i2cAddress))
+    return false;
+  // No extra wait needed, the first measurement is only read after BME280_MEASUREMENT_TIME.
   return true;
 }
 
@@ -515,31 +518,40 @@ bool Plugin_028_begin(uint8_t i2cAddress) {
 //**************************************************************************/
 // Reads the factory-set coefficients
 //**************************************************************************/
-void Plugin_028_readCoefficients(uint8_t i2cAddress)
+// Two block reads, cached after the first time.
+bool Plugin_028_readCoefficients(uint8_t i2cAddress)
 {
   P028_sensordata& sensor = P028_sensors[i2cAddress];
-  sensor.calib.dig_T1 = I2C_read16_LE_reg(i2cAddress, BMx280_REGISTER_DIG_T1);
-  sensor.calib.dig_T2 = I2C_readS16_LE_reg(i2cAddress, BMx280_REGISTER_DIG_T2);
-  sensor.calib.dig_T3 = I2C_readS16_LE_reg(i2cAddress, BMx280_REGISTER_DIG_T3);
-
-  sensor.calib.dig_P1 = I2C_read16_LE_reg(i2cAddress, BMx280_REGISTER_DIG_P1);
-  sensor.calib.dig_P2 = I2C_readS16_LE_reg(i2cAddress, BMx280_REGISTER_DIG_P2);
-  sensor.calib.dig_P3 = I2C_readS16_LE_reg(i2cAddress, BMx280_REGISTER_DIG_P3);
-  sensor.calib.dig_P4 = I2C_readS16_LE_reg(i2cAddress, BMx280_REGISTER_DIG_P4);
-  sensor.calib.dig_P5 = I2C_readS16_LE_reg(i2cAddress, BMx280_REGISTER_DIG_P5);
-  sensor.calib.dig_P6 = I2C_readS16_LE_reg(i2cAddress, BMx280_REGISTER_DIG_P6);
-  sensor.calib.dig_P7 = I2C_readS16_LE_reg(i2cAddress, BMx280_REGISTER_DIG_P7);
-  sensor.calib.dig_P8 = I2C_readS16_LE_reg(i2cAddress, BMx280_REGISTER_DIG_P8);
-  sensor.calib.dig_P9 = I2C_readS16_LE_reg(i2cAddress, BMx280_REGISTER_DIG_P9);
+  uint8_t data[BME280_TEMP_PRESS_CALIB_DATA_LEN];
+  if (!I2C_read_calibration(i2cAddress, BME280_TEMP_PRESS_CALIB_DATA_ADDR, data, BME280_TEMP_PRESS_CALIB_DATA_LEN))
+    return false;
+  const uint8_t base = BME280_TEMP_PRESS_CALIB_DATA_ADDR;
+  sensor.calib.dig_T1 = I2C_block_LE16(data, BMx280_REGISTER_DIG_T1 - base);
+  sensor.calib.dig_T2 = (int16_t)I2C_block_LE16(data, BMx280_REGISTER_DIG_T2 - base);
+  sensor.calib.dig_T3 = (int16_t)I2C_block_LE16(data, BMx280_REGISTER_DIG_T3 - base);
+
+  sensor.calib.dig_P1 = I2C_block_LE16(data, BMx280_REGISTER_DIG_P1 - base);
+  sensor.calib.dig_P2 = (int16_t)I2C_block_LE16(data, BMx280_REGISTER_DIG_P2 - base);
+  sensor.calib.dig_P3 = (int16_t)I2C_block_LE16(data, BMx280_REGISTER_DIG_P3 - base);
+  sensor.calib.dig_P4 = (int16_t)I2C_block_LE16(data, BMx280_REGISTER_DIG_P4 - base);
+  sensor.calib.dig_P5 = (int16_t)I2C_block_LE16(data, BMx280_REGISTER_DIG_P5 - base);
+  sensor.calib.dig_P6 = (int16_t)I2C_block_LE16(data, BMx280_REGISTER_DIG_P6 - base);
+  sensor.calib.dig_P7 = (int16_t)I2C_block_LE16(data, BMx280_REGISTER_DIG_P7 - base);
+  sensor.calib.dig_P8 = (int16_t)I2C_block_LE16(data, BMx280_REGISTER_DIG_P8 - base);
+  sensor.calib.dig_P9 = (int16_t)I2C_block_LE16(data, BMx280_REGISTER_DIG_P9 - base);
 
   if (sensor.hasHumidity()) {
-    sensor.calib.dig_H1 = I2C_read8_reg(i2cAddress, BMx280_REGISTER_DIG_H1);
-    sensor.calib.dig_H2 = I2C_readS16_LE_reg(i2cAddress, BMx280_REGISTER_DIG_H2);
-    sensor.calib.dig_H3 = I2C_read8_reg(i2cAddress, BMx280_REGISTER_DIG_H3);
-    sensor.calib.dig_H4 = (I2C_read8_reg(i2cAddress, BMx280_REGISTER_DIG_H4) << 4) | (I2C_read8_reg(i2cAddress, BMx280_REGISTER_DIG_H4 + 1) & 0xF);
-    sensor.calib.dig_H5 = (I2C_read8_reg(i2cAddress, BMx280_REGISTER_DIG_H5 + 1) << 4) | (I2C_read8_reg(i2cAddress, BMx280_REGISTER_DIG_H5) >> 4);
-    sensor.calib.dig_H6 = (int8_t)I2C_read8_reg(i2cAddress, BMx280_REGISTER_DIG_H6);
+    sensor.calib.dig_H1 = data[BMx280_REGISTER_DIG_H1 - base];
+    if (!I2C_read_calibration(i2cAddress, BME280_HUMIDITY_CALIB_DATA_ADDR, data, BME280_HUMIDITY_CALIB_DATA_LEN))
+      return false;
+    const uint8_t hbase = BME280_HUMIDITY_CALIB_DATA_ADDR;
+    sensor.calib.dig_H2 = (int16_t)I2C_block_LE16(data, BMx280_REGISTER_DIG_H2 - hbase);
+    sensor.calib.dig_H3 = data[BMx280_REGISTER_DIG_H3 - hbase];
+    sensor.calib.dig_H4 = (data[BMx280_REGISTER_DIG_H4 - hbase] << 4) | (data[BMx280_REGISTER_DIG_H4 - hbase + 1] & 0xF);
+    sensor.calib.dig_H5 = (data[BMx280_REGISTER_DIG_H5 - hbase + 1] << 4) | (data[BMx280_REGISTER_DIG_H5 - hbase] >> 4);
+    sensor.calib.dig_H6 = (int8_t)data[BMx280_REGISTER_DIG_H6 - hbase];
   }
+  return true;
 }
 
 bool Plugin_028_readUncompensatedData(uint8_t i2cAddress) {
@@ -643,8 +655,8 @@ float Plugin_028_readHumidity(uint8_t i2cAddress)
   // The datasheet names this the "T63" moment.
   // 1 second = 63% of the time needed to perform a measurement.
   unsigned long difTime = millis() - sensor.last_measurement;
-  if (difTime < 1587) {
-    delay(1587 - difTime);
+  if (difTime < BME280_MEASUREMENT_TIME) {
+    delay(BME280_MEASUREMENT_TIME - difTime);
   }
   int32_t adc_H = sensor.uncompensated.humidity;
 
@@ -54,6 +54,18 @@ boolean Plugin_029(byte function, struct EventStruct *event, String& string)
         String id = F("TDID");   //="taskdeviceid"
         id += controllerNr + 1;
         addNumericBox(id, Settings.TaskDeviceID[controllerNr][event->TaskIndex], 0, 9999);
+
+        // Switching on plays a pulse by the output sequencer, e.g. for an impulse relay
+        addFormNumericBox(F("Pulse Time"), F("plugin_029_pulse"), Settings.TaskDevicePluginConfig[event->TaskIndex][0], 0, 30000);
+        addUnit(F("ms"));
+        addFormNote(F("0 = switch the GPIO on and off"));
+        success = true;
+        break;
+      }
+
+    case PLUGIN_WEBFORM_SAVE:
+      {
+        Settings.TaskDevicePluginConfig[event->TaskIndex][0] = getFormItemInt(F("plugin_029_pulse"));
         success = true;
         break;
       }
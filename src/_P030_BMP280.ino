@@ -6,8 +6,8 @@
 #define PLUGIN_030
 #define PLUGIN_ID_030        30
 #define PLUGIN_NAME_030       "Environment - BMP280"
-#define PLUGIN_VALUENAME1_030 "Temperature"
-#define PLUGIN_VALUENAME2_030 "Pressure"
+#define PLUGIN_VALUENAME1_030 WEB_STR_TEMPERATURE
+#define PLUGIN_VALUENAME2_030 WEB_STR_PRESSURE
 
 enum
 {
@@ -31,6 +31,9 @@ enum
 
   BMP280_REGISTER_CAL26              = 0xE1,  // R calibration stored in 0xE1-0xF0
 
+  BMP280_CALIB_DATA_LEN              = 24,    // 0x88 - 0x9F
+  BMP280_DATA_LEN                    = 6,     // Pressure and temperature, 0xF7 - 0xFC
+
   BMP280_REGISTER_CONTROL            = 0xF4,
   BMP280_REGISTER_CONFIG             = 0xF5,
   BMP280_REGISTER_PRESSUREDATA       = 0xF7,
@@ -95,8 +98,8 @@ boolean Plugin_030(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_GET_DEVICEVALUENAMES:
       {
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_030));
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], PSTR(PLUGIN_VALUENAME2_030));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], getWebStringP(PLUGIN_VALUENAME1_030));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], getWebStringP(PLUGIN_VALUENAME2_030));
         break;
       }
     case PLUGIN_WEBFORM_LOAD:
@@ -134,15 +137,16 @@ boolean Plugin_030(byte function, struct EventStruct *event, String& string)
           delay(65); // Ultra high resolution for BMP280 is 43.2 ms, add some extra time
         }
 
-        if (Plugin_030_init[idx])
+        int32_t adc_T, adc_P;
+        if (Plugin_030_init[idx] && Plugin_030_readData(adc_T, adc_P))
         {
-          UserVar[event->BaseVarIndex] = Plugin_030_readTemperature(idx);
+          UserVar[event->BaseVarIndex] = Plugin_030_readTemperature(idx, adc_T);
           int elev = Settings.TaskDevicePluginConfig[event->TaskIndex][1];
           if (elev)
           {
-             UserVar[event->BaseVarIndex + 1] = Plugin_030_pressureElevation((float)Plugin_030_readPressure(idx) / 100, elev);
+             UserVar[event->BaseVarIndex + 1] = Plugin_030_pressureElevation((float)Plugin_030_readPressure(idx, adc_P) / 100, elev);
           } else {
-             UserVar[event->BaseVarIndex + 1] = ((float)Plugin_030_readPressure(idx)) / 100;
+             UserVar[event->BaseVarIndex + 1] = ((float)Plugin_030_readPressure(idx, adc_P)) / 100;
           }
 
           String log = F("BMP280  : Address: 0x");
@@ -211,40 +215,59 @@ bool Plugin_030_begin(uint8_t a) {
   if (! Plugin_030_check(a))
     return false;
 
-  Plugin_030_readCoefficients(a & 0x1);
+  if (!Plugin_030_readCoefficients(a & 0x1))
+    return false;
   I2C_write8_reg(bmp280_i2caddr, BMP280_REGISTER_CONTROL, BMP280_CONTROL_SETTING);
   I2C_write8_reg(bmp280_i2caddr, BMP280_REGISTER_CONFIG, BMP280_CONFIG_SETTING);
   return true;
 }
 
 //**************************************************************************/
-// Reads the factory-set coefficients
+// Reads the factory-set coefficients, in one block read cached after the first time
 //**************************************************************************/
-void Plugin_030_readCoefficients(uint8_t idx)
+bool Plugin_030_readCoefficients(uint8_t idx)
 {
-  _bmp280_calib[idx].dig_T1 = I2C_read16_LE_reg(bmp280_i2caddr, BMP280_REGISTER_DIG_T1);
-  _bmp280_calib[idx].dig_T2 = I2C_readS16_LE_reg(bmp280_i2caddr, BMP280_REGISTER_DIG_T2);
-  _bmp280_calib[idx].dig_T3 = I2C_readS16_LE_reg(bmp280_i2caddr, BMP280_REGISTER_DIG_T3);
-
-  _bmp280_calib[idx].dig_P1 = I2C_read16_LE_reg(bmp280_i2caddr, BMP280_REGISTER_DIG_P1);
-  _bmp280_calib[idx].dig_P2 = I2C_readS16_LE_reg(bmp280_i2caddr, BMP280_REGISTER_DIG_P2);
-  _bmp280_calib[idx].dig_P3 = I2C_readS16_LE_reg(bmp280_i2caddr, BMP280_REGISTER_DIG_P3);
-  _bmp280_calib[idx].dig_P4 = I2C_readS16_LE_reg(bmp280_i2caddr, BMP280_REGISTER_DIG_P4);
-  _bmp280_calib[idx].dig_P5 = I2C_readS16_LE_reg(bmp280_i2caddr, BMP280_REGISTER_DIG_P5);
-  _bmp280_calib[idx].dig_P6 = I2C_readS16_LE_reg(bmp280_i2caddr, BMP280_REGISTER_DIG_P6);
-  _bmp280_calib[idx].dig_P7 = I2C_readS16_LE_reg(bmp280_i2caddr, BMP280_REGISTER_DIG_P7);
-  _bmp280_calib[idx].dig_P8 = I2C_readS16_LE_reg(bmp280_i2caddr, BMP280_REGISTER_DIG_P8);
-  _bmp280_calib[idx].dig_P9 = I2C_readS16_LE_reg(bmp280_i2caddr, BMP280_REGISTER_DIG_P9);
+  uint8_t data[BMP280_CALIB_DATA_LEN];
+  if (!I2C_read_calibration(bmp280_i2caddr, BMP280_REGISTER_DIG_T1, data, BMP280_CALIB_DATA_LEN))
+    return false;
+  const uint8_t base = BMP280_REGISTER_DIG_T1;
+  _bmp280_calib[idx].dig_T1 = I2C_block_LE16(data, BMP280_REGISTER_DIG_T1 - base);
+  _bmp280_calib[idx].dig_T2 = (int16_t)I2C_block_LE16(data, BMP280_REGISTER_DIG_T2 - base);
+  _bmp280_calib[idx].dig_T3 = (int16_t)I2C_block_LE16(data, BMP280_REGISTER_DIG_T3 - base);
+
+  _bmp280_calib[idx].dig_P1 = I2C_block_LE16(data, BMP280_REGISTER_DIG_P1 - base);
+  _bmp280_calib[idx].dig_P2 = (int16_t)I2C_block_LE16(data, BMP280_REGISTER_DIG_P2 - base);
+  _bmp280_calib[idx].dig_P3 = (int16_t)I2C_block_LE16(data, BMP280_REGISTER_DIG_P3 - base);
+  _bmp280_calib[idx].dig_P4 = (int16_t)I2C_block_LE16(data, BMP280_REGISTER_DIG_P4 - base);
+  _bmp280_calib[idx].dig_P5 = (int16_t)I2C_block_LE16(data, BMP280_REGISTER_DIG_P5 - base);
+  _bmp280_calib[idx].dig_P6 = (int16_t)I2C_block_LE16(data, BMP280_REGISTER_DIG_P6 - base);
+  _bmp280_calib[idx].dig_P7 = (int16_t)I2C_block_LE16(data, BMP280_REGISTER_DIG_P7 - base);
+  _bmp280_calib[idx].dig_P8 = (int16_t)I2C_block_LE16(data, BMP280_REGISTER_DIG_P8 - base);
+  _bmp280_calib[idx].dig_P9 = (int16_t)I2C_block_LE16(data, BMP280_REGISTER_DIG_P9 - base);
+  return true;
+}
+
+//**************************************************************************/
+// Reads pressure and temperature in one transfer, so both are of the same measurement
+//**************************************************************************/
+bool Plugin_030_readData(int32_t& adc_T, int32_t& adc_P)
+{
+  uint8_t data[BMP280_DATA_LEN];
+  if (!I2C_read_block(bmp280_i2caddr, BMP280_REGISTER_PRESSUREDATA, data, BMP280_DATA_LEN))
+    return false;
+  const uint8_t t = BMP280_REGISTER_TEMPDATA - BMP280_REGISTER_PRESSUREDATA;
+  adc_P = ((int32_t)data[0] << 16) | ((int32_t)data[1] << 8) | data[2];
+  adc_T = ((int32_t)data[t] << 16) | ((int32_t)data[t + 1] << 8) | data[t + 2];
+  return true;
 }
 
 //**************************************************************************/
 // Read temperature
 //**************************************************************************/
-float Plugin_030_readTemperature(uint8_t idx)
+float Plugin_030_readTemperature(uint8_t idx, int32_t adc_T)
 {
   int32_t var1, var2;
 
-  int32_t adc_T = I2C_read24_reg(bmp280_i2caddr, BMP280_REGISTER_TEMPDATA);
   adc_T >>= 4;
 
   var1  = ((((adc_T >> 3) - ((int32_t)_bmp280_calib[idx].dig_T1 << 1))) *
@@ -263,10 +286,9 @@ float Plugin_030_readTemperature(uint8_t idx)
 //**************************************************************************/
 // Read pressure
 //**************************************************************************/
-float Plugin_030_readPressure(uint8_t idx) {
+float Plugin_030_readPressure(uint8_t idx, int32_t adc_P) {
   int64_t var1, var2, p;
 
-  int32_t adc_P = I2C_read24_reg(bmp280_i2caddr, BMP280_REGISTER_PRESSUREDATA);
   adc_P >>= 4;
 
   var1 = ((int64_t)bmp280_t_fine) - 128000;
@@ -297,7 +319,12 @@ float Plugin_030_readPressure(uint8_t idx) {
 //**************************************************************************/
 float Plugin_030_readAltitude(float seaLevel)
 {
-  float atmospheric = Plugin_030_readPressure(bmp280_i2caddr & 0x01) / 100.0F;
+  int32_t adc_T, adc_P;
+  if (!Plugin_030_readData(adc_T, adc_P))
+    return 0;
+  const uint8_t idx = bmp280_i2caddr & 0x01;
+  Plugin_030_readTemperature(idx, adc_T);  // Sets bmp280_t_fine
+  float atmospheric = Plugin_030_readPressure(idx, adc_P) / 100.0F;
   return 44330.0 * (1.0 - pow(atmospheric / seaLevel, 0.1903));
 }
 
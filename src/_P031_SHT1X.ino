@@ -6,13 +6,22 @@
 #define PLUGIN_031
 #define PLUGIN_ID_031         31
 #define PLUGIN_NAME_031       "Environment - SHT1X"
-#define PLUGIN_VALUENAME1_031 "Temperature"
-#define PLUGIN_VALUENAME2_031 "Humidity"
+#define PLUGIN_VALUENAME1_031 WEB_STR_TEMPERATURE
+#define PLUGIN_VALUENAME2_031 WEB_STR_HUMIDITY
+
+#define SHT1X_STEP_TEMP       0
+#define SHT1X_STEP_RH         1
+#define SHT1X_POLL_MSEC      20
+#define SHT1X_MAX_WAIT      320   // Maximum 320ms for 14 bit measurement
+#define SHT1X_MAX_RETRIES     1   // Measurements repeated after a CRC error
 
 boolean Plugin_031_init = false;
 byte Plugin_031_DATA_Pin = 0;
 byte Plugin_031_CLOCK_Pin = 0;
 int input_mode;
+unsigned long Plugin_031_commandTime = 0;
+byte Plugin_031_command = 0;       // Last command sent, part of the CRC
+byte Plugin_031_retries = 0;
 
 enum {
   SHT1X_CMD_MEASURE_TEMP  = B00000011,
@@ -51,8 +60,8 @@ boolean Plugin_031(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_GET_DEVICEVALUENAMES:
       {
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_031));
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], PSTR(PLUGIN_VALUENAME2_031));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], getWebStringP(PLUGIN_VALUENAME1_031));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], getWebStringP(PLUGIN_VALUENAME2_031));
         break;
       }
 
@@ -93,22 +102,68 @@ boolean Plugin_031(byte function, struct EventStruct *event, String& string)
           addLog(LOG_LEVEL_ERROR, F("SHT1X : not yet initialized!"));
           break;
         }
-        UserVar[event->BaseVarIndex] = Plugin_031_readTemperature();
-        UserVar[event->BaseVarIndex+1] = Plugin_031_readRelHumidity(UserVar[event->BaseVarIndex]);
+        // The sensor pulls DATA low when the measurement is done, polled in PLUGIN_TIMER_IN.
+        Plugin_031_retries = 0;
+        Plugin_031_startMeasurement(SHT1X_CMD_MEASURE_TEMP);
+        startTaskConversion(event, PLUGIN_ID_031, SHT1X_POLL_MSEC, SHT1X_STEP_TEMP);
+        break;
+      }
+
+    case PLUGIN_TIMER_IN:
+      {
+        if (!isTaskConversionTimer(event)) {
+          break;
+        }
         success = true;
+        if (digitalRead(Plugin_031_DATA_Pin) != LOW) {
+          if (timePassedSince(Plugin_031_commandTime) < SHT1X_MAX_WAIT) {
+            startTaskConversion(event, PLUGIN_ID_031, SHT1X_POLL_MSEC, event->Par2);
+          } else {
+            addLog(LOG_LEVEL_ERROR, F("SHT1X : Data not ready"));
+            completeTaskConversion(event, false);
+          }
+          break;
+        }
+        int raw;
+        if (!Plugin_031_readData(16, raw)) {
+          bitBangError();
+          if (Plugin_031_retries < SHT1X_MAX_RETRIES) {
+            ++Plugin_031_retries;
+            addLog(LOG_LEVEL_DEBUG, F("SHT1X : CRC error, measuring again"));
+            Plugin_031_startMeasurement(Plugin_031_command);
+            startTaskConversion(event, PLUGIN_ID_031, SHT1X_POLL_MSEC, event->Par2);
+          } else {
+            addLog(LOG_LEVEL_ERROR, F("SHT1X : CRC error"));
+            completeTaskConversion(event, false);
+          }
+          break;
+        }
+        if (event->Par2 == SHT1X_STEP_TEMP) {
+          UserVar[event->BaseVarIndex] = Plugin_031_readTemperature(raw);
+          Plugin_031_startMeasurement(SHT1X_CMD_MEASURE_RH);
+          startTaskConversion(event, PLUGIN_ID_031, SHT1X_POLL_MSEC, SHT1X_STEP_RH);
+        } else {
+          UserVar[event->BaseVarIndex+1] = Plugin_031_readRelHumidity(raw, UserVar[event->BaseVarIndex]);
+          completeTaskConversion(event, true);
+        }
         break;
       }
   }
   return success;
 }
 
-float Plugin_031_readTemperature()
+void Plugin_031_startMeasurement(const byte cmd)
+{
+  Plugin_031_sendCommand(cmd);
+  Plugin_031_commandTime = millis();
+}
+
+// Convert the result of SHT1X_CMD_MEASURE_TEMP
+float Plugin_031_readTemperature(int raw)
 {
   float tempRaw, tempC;
 
-  Plugin_031_sendCommand(SHT1X_CMD_MEASURE_TEMP);
-  Plugin_031_awaitResult();
-  tempRaw = Plugin_031_readData(16);
+  tempRaw = raw;
 
   // Temperature conversion coefficients from SHT1X datasheet for version 4
   const float d1 = -39.7;  // 3.5V
@@ -125,13 +180,12 @@ float Plugin_031_readTemperature()
   return tempC;
 }
 
-float Plugin_031_readRelHumidity(float tempC)
+// Convert the result of SHT1X_CMD_MEASURE_RH
+float Plugin_031_readRelHumidity(int rawValue, float tempC)
 {
   float raw, rhLinear, rhTrue;
 
-  Plugin_031_sendCommand(SHT1X_CMD_MEASURE_RH);
-  Plugin_031_awaitResult();
-  raw = Plugin_031_readData(16);
+  raw = rawValue;
 
   // Temperature conversion coefficients from SHT1X datasheet for version 4
   const float c1 = -2.0468;
@@ -158,18 +212,20 @@ float Plugin_031_readRelHumidity(float tempC)
 void Plugin_031_reset()
 {
   delay(11);
-  for (int i=0; i<9; i++) {
-    digitalWrite(Plugin_031_CLOCK_Pin, HIGH);
-    digitalWrite(Plugin_031_CLOCK_Pin, LOW);
-  }
+  bitBangPulses(Plugin_031_CLOCK_Pin, 9);
   Plugin_031_sendCommand(SHT1X_CMD_SOFT_RESET);
   delay(11);
 }
 
 byte Plugin_031_readStatus()
 {
+  int status = 0;
   Plugin_031_sendCommand(SHT1X_CMD_READ_STATUS);
-  return Plugin_031_readData(8);
+  if (!Plugin_031_readData(8, status)) {
+    bitBangError();
+    addLog(LOG_LEVEL_ERROR, F("SHT1X : CRC error in status byte"));
+  }
+  return status;
 }
 
 void Plugin_031_sendCommand(const byte cmd)
@@ -186,7 +242,8 @@ void Plugin_031_sendCommand(const byte cmd)
   digitalWrite(Plugin_031_CLOCK_Pin, LOW);
 
   // Send the command (address must be 000b)
-  shiftOut(Plugin_031_DATA_Pin, Plugin_031_CLOCK_Pin, MSBFIRST, cmd);
+  bitBangShiftOut(Plugin_031_DATA_Pin, Plugin_031_CLOCK_Pin, cmd, 8);
+  Plugin_031_command = cmd;
 
   // Wait for ACK
   bool ackerror = false;
@@ -205,42 +262,54 @@ void Plugin_031_sendCommand(const byte cmd)
   }
 }
 
-void Plugin_031_awaitResult()
+void Plugin_031_sendAck()
 {
-  // Maximum 320ms for 14 bit measurement
-  for (int i=0; i<16; i++) {
-    if (digitalRead(Plugin_031_DATA_Pin) == LOW) return;
-    delay(20);
-  }
-  if (digitalRead(Plugin_031_DATA_Pin) != LOW) {
-    addLog(LOG_LEVEL_ERROR, F("SHT1X : Data not ready"));
+  pinMode(Plugin_031_DATA_Pin, OUTPUT);
+  digitalWrite(Plugin_031_DATA_Pin, LOW);
+  bitBangPulses(Plugin_031_CLOCK_Pin, 1);
+  pinMode(Plugin_031_DATA_Pin, input_mode);
+}
+
+// CRC-8 (x^8 + x^5 + x^4 + 1) over the command and the data bytes. The
+// status register is left at its default, so the CRC starts at 0.
+byte Plugin_031_crc(byte crc, byte value)
+{
+  crc ^= value;
+  for (byte i = 0; i < 8; i++) {
+    crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : (crc << 1);
   }
+  return crc;
 }
 
-int Plugin_031_readData(const int bits)
+// Returns false when the CRC sent by the sensor does not match.
+bool Plugin_031_readData(const int bits, int& val)
 {
-  int val = 0;
+  byte crc = Plugin_031_crc(0, Plugin_031_command);
+  val = 0;
 
   if (bits == 16) {
     // Read most significant byte
-    val = shiftIn(Plugin_031_DATA_Pin, Plugin_031_CLOCK_Pin, 8);
+    val = bitBangShiftIn(Plugin_031_DATA_Pin, Plugin_031_CLOCK_Pin, 8);
+    crc = Plugin_031_crc(crc, val);
     val <<= 8;
-
-    // Send ACK
-    pinMode(Plugin_031_DATA_Pin, OUTPUT);
-    digitalWrite(Plugin_031_DATA_Pin, LOW);
-    digitalWrite(Plugin_031_CLOCK_Pin, HIGH);
-    digitalWrite(Plugin_031_CLOCK_Pin, LOW);
-    pinMode(Plugin_031_DATA_Pin, input_mode);
+    Plugin_031_sendAck();
   }
 
   // Read least significant byte
-  val |= shiftIn(Plugin_031_DATA_Pin, Plugin_031_CLOCK_Pin, 8);
-
-  // Keep DATA pin high to skip CRC
-  digitalWrite(Plugin_031_CLOCK_Pin, HIGH);
-  digitalWrite(Plugin_031_CLOCK_Pin, LOW);
-
-  return val;
+  const byte lsb = bitBangShiftIn(Plugin_031_DATA_Pin, Plugin_031_CLOCK_Pin, 8);
+  crc = Plugin_031_crc(crc, lsb);
+  val |= lsb;
+  Plugin_031_sendAck();
+
+  // The sensor sends the CRC with the bits reversed, keep DATA high to end the transfer.
+  byte received = bitBangShiftIn(Plugin_031_DATA_Pin, Plugin_031_CLOCK_Pin, 8);
+  bitBangPulses(Plugin_031_CLOCK_Pin, 1);
+
+  byte reversed = 0;
+  for (byte i = 0; i < 8; i++) {
+    reversed = (reversed << 1) | (received & 1);
+    received >>= 1;
+  }
+  return reversed == crc;
 }
 #endif // USES_P031
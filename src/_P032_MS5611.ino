@@ -7,8 +7,8 @@
 #define PLUGIN_032
 #define PLUGIN_ID_032        32
 #define PLUGIN_NAME_032       "Environment - MS5611 (GY-63)"
-#define PLUGIN_VALUENAME1_032 "Temperature"
-#define PLUGIN_VALUENAME2_032 "Pressure"
+#define PLUGIN_VALUENAME1_032 WEB_STR_TEMPERATURE
+#define PLUGIN_VALUENAME2_032 WEB_STR_PRESSURE
 
 enum
 {
@@ -64,8 +64,8 @@ boolean Plugin_032(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_GET_DEVICEVALUENAMES:
       {
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_032));
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], PSTR(PLUGIN_VALUENAME2_032));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], getWebStringP(PLUGIN_VALUENAME1_032));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], getWebStringP(PLUGIN_VALUENAME2_032));
         break;
       }
     case PLUGIN_WEBFORM_LOAD:
@@ -6,8 +6,8 @@
 #define PLUGIN_034
 #define PLUGIN_ID_034         34
 #define PLUGIN_NAME_034       "Environment - DHT12 (I2C)"
-#define PLUGIN_VALUENAME1_034 "Temperature"
-#define PLUGIN_VALUENAME2_034 "Humidity"
+#define PLUGIN_VALUENAME1_034 WEB_STR_TEMPERATURE
+#define PLUGIN_VALUENAME2_034 WEB_STR_HUMIDITY
 
 boolean Plugin_034_init = false;
 
@@ -43,8 +43,8 @@ boolean Plugin_034(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_GET_DEVICEVALUENAMES:
       {
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_034));
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], PSTR(PLUGIN_VALUENAME2_034));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], getWebStringP(PLUGIN_VALUENAME1_034));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], getWebStringP(PLUGIN_VALUENAME2_034));
         break;
       }
 
@@ -12,6 +12,64 @@ IRsend *Plugin_035_irSender;
 #define PLUGIN_ID_035         35
 #define PLUGIN_NAME_035       "Communication - IR Transmit"
 
+// Transmit queue
+// IRSEND records the marks and spaces of the code (IRsend::setRecorder()) and
+// queues them, Plugin_035_process() sends them from backgroundtasks(). A frame
+// is still bit-banged, but a long space (between the frames of a code and its
+// repeats) is waited for in the background instead of with delay().
+#define P035_QUEUE_SIZE        4
+#define P035_MAX_TIMINGS     512        // Marks, spaces and carrier changes per code
+#define P035_GAP_USEC       8000        // Longer spaces are waited for in the background
+#define P035_MARK           0x80000000UL
+#define P035_CARRIER        0x40000000UL
+#define P035_TIMING_MASK    0x3FFFFFFFUL
+
+class Plugin_035_Recorder : public IRsendRecorder
+{
+public:
+  Plugin_035_Recorder() : timings(NULL), count(0), overflow(false) {}
+
+  void carrier(int khz) { add(P035_CARRIER | khz); }
+  void mark(unsigned int usec) { add(P035_MARK | usec); }
+  void space(unsigned long usec) { add(usec & P035_TIMING_MASK); }
+
+  // Consecutive marks or spaces are joined, empty ones are not stored.
+  void add(uint32_t timing) {
+    if ((timing & P035_TIMING_MASK) == 0 && !(timing & P035_CARRIER)) return;
+    if (count > 0 && !(timing & P035_CARRIER) &&
+        (timings[count - 1] & (P035_MARK | P035_CARRIER)) == (timing & (P035_MARK | P035_CARRIER))) {
+      timings[count - 1] += timing & P035_TIMING_MASK;
+      return;
+    }
+    if (count >= P035_MAX_TIMINGS) {
+      overflow = true;
+      return;
+    }
+    timings[count++] = timing;
+  }
+
+  uint32_t* timings;
+  uint16_t count;
+  bool overflow;
+};
+
+struct Plugin_035_QueueStruct
+{
+  Plugin_035_QueueStruct() : timings(NULL), count(0) {}
+
+  uint32_t* timings;
+  uint16_t count;
+} Plugin_035_queue[P035_QUEUE_SIZE];
+
+byte Plugin_035_queueFirst = 0;
+byte Plugin_035_queueCount = 0;
+uint16_t Plugin_035_position = 0;        // Next timing of the first code
+unsigned long Plugin_035_gapStart = 0;
+unsigned long Plugin_035_gapUsec = 0;    // Background wait before the next timing
+bool Plugin_035_receiverOff = false;
+unsigned long Plugin_035_sent = 0;
+unsigned long Plugin_035_dropped = 0;
+
 boolean Plugin_035(byte function, struct EventStruct *event, String& string)
 {
   boolean success = false;
@@ -49,6 +107,7 @@ boolean Plugin_035(byte function, struct EventStruct *event, String& string)
         if (Plugin_035_irSender != 0 && irPin == -1)
         {
           addLog(LOG_LEVEL_INFO, F("INIT: IR TX Removed"));
+          Plugin_035_clearQueue();
           delete Plugin_035_irSender;
           Plugin_035_irSender = 0;
         }
@@ -76,9 +135,14 @@ boolean Plugin_035(byte function, struct EventStruct *event, String& string)
         if (cmdCode.equalsIgnoreCase(F("IRSEND")) && Plugin_035_irSender != 0)
         {
           success = true;
-          #ifdef PLUGIN_016
-          if (irReceiver != 0) irReceiver->disableIRIn(); // Stop the receiver
-          #endif
+          Plugin_035_Recorder recorder;
+          recorder.timings = static_cast<uint32_t*>(allocBuffer(MEM_POOL_IR, P035_MAX_TIMINGS * sizeof(uint32_t)));
+          if (recorder.timings == NULL) {
+            ++Plugin_035_dropped;
+            addLog(LOG_LEVEL_ERROR, F("IRTX : Not enough memory"));
+            break;
+          }
+          Plugin_035_irSender->setRecorder(&recorder);
 
           if (GetArgv(command, TmpStr1, 100, 2)) IrType = TmpStr1;
 
@@ -95,19 +159,19 @@ boolean Plugin_035(byte function, struct EventStruct *event, String& string)
 
             printWebString += F("<a href='https://en.wikipedia.org/wiki/Base32#base32hex'>Base32Hex</a> RAW Code: ");
             printWebString += IrRaw;
-            printWebString += F("<BR>");
+            printWebString += getWebString(WEB_STR_BR);
 
             printWebString += F("kHz: ");
             printWebString += IrHz;
-            printWebString += F("<BR>");
+            printWebString += getWebString(WEB_STR_BR);
 
             printWebString += F("Pulse Len: ");
             printWebString += IrPLen;
-            printWebString += F("<BR>");
+            printWebString += getWebString(WEB_STR_BR);
 
             printWebString += F("Blank Len: ");
             printWebString += IrBLen;
-            printWebString += F("<BR>");
+            printWebString += getWebString(WEB_STR_BR);
 
             unsigned int buf[200];
             unsigned int idx = 0;
@@ -188,7 +252,7 @@ boolean Plugin_035(byte function, struct EventStruct *event, String& string)
                 printWebString += F("1");
             }
 
-            printWebString += F("<BR>");
+            printWebString += getWebString(WEB_STR_BR);
 
             Plugin_035_irSender->sendRaw(buf, idx+1, IrHz);
 
@@ -216,17 +280,27 @@ boolean Plugin_035(byte function, struct EventStruct *event, String& string)
             if (IrType.equalsIgnoreCase(F("PIONEER"))) Plugin_035_irSender->sendPioneer(IrCode, IrBits, IrRepeat, IrSecondCode);
           }
 
-          addLog(LOG_LEVEL_INFO, F("IRTX :IR Code Sent"));
+          Plugin_035_irSender->setRecorder(NULL);
+          const bool queued = !recorder.overflow && Plugin_035_queueCode(recorder.timings, recorder.count);
+          freeBuffer(MEM_POOL_IR, recorder.timings, P035_MAX_TIMINGS * sizeof(uint32_t));
+
+          String log = F("IRTX :IR Code ");
+          if (queued) {
+            log += F("queued, ");
+            log += Plugin_035_queueCount;
+            log += F(" waiting");
+            addLog(LOG_LEVEL_INFO, log);
+          } else {
+            ++Plugin_035_dropped;
+            log += recorder.overflow ? F("too long, dropped") : F("dropped, queue full");
+            addLog(LOG_LEVEL_ERROR, log);
+          }
           if (printToWeb)
           {
-            printWebString += F("IR Code Sent ");
+            printWebString += queued ? F("IR Code Queued ") : F("IR Code Dropped ");
             printWebString += IrType;
-            printWebString += F("<BR>");
+            printWebString += getWebString(WEB_STR_BR);
           }
-
-          #ifdef PLUGIN_016
-          if (irReceiver != 0) irReceiver->enableIRIn(); // Start the receiver
-          #endif
         }
         break;
       }
@@ -234,4 +308,101 @@ boolean Plugin_035(byte function, struct EventStruct *event, String& string)
   return success;
 }
 
+// Copies the recorded timings, false when the queue is full.
+bool Plugin_035_queueCode(const uint32_t* timings, uint16_t count)
+{
+  if (count == 0) return true;
+  if (Plugin_035_queueCount >= P035_QUEUE_SIZE) return false;
+  uint32_t* copy = static_cast<uint32_t*>(allocBuffer(MEM_POOL_IR, count * sizeof(uint32_t)));
+  if (copy == NULL) return false;
+  memcpy(copy, timings, count * sizeof(uint32_t));
+  Plugin_035_QueueStruct& entry = Plugin_035_queue[(Plugin_035_queueFirst + Plugin_035_queueCount) % P035_QUEUE_SIZE];
+  entry.timings = copy;
+  entry.count = count;
+  ++Plugin_035_queueCount;
+  return true;
+}
+
+void Plugin_035_popCode()
+{
+  Plugin_035_QueueStruct& entry = Plugin_035_queue[Plugin_035_queueFirst];
+  freeBuffer(MEM_POOL_IR, entry.timings, entry.count * sizeof(uint32_t));
+  entry.timings = NULL;
+  entry.count = 0;
+  Plugin_035_queueFirst = (Plugin_035_queueFirst + 1) % P035_QUEUE_SIZE;
+  --Plugin_035_queueCount;
+  Plugin_035_position = 0;
+}
+
+void Plugin_035_clearQueue()
+{
+  while (Plugin_035_queueCount > 0) {
+    Plugin_035_popCode();
+    ++Plugin_035_dropped;
+  }
+  Plugin_035_gapUsec = 0;
+}
+
+// Called from backgroundtasks(): send the queued codes, up to the next long space.
+void Plugin_035_process()
+{
+  if (Plugin_035_queueCount == 0) return;
+  if (Plugin_035_gapUsec != 0) {
+    if (micros() - Plugin_035_gapStart < Plugin_035_gapUsec) return;
+    Plugin_035_gapUsec = 0;
+  }
+  if (Plugin_035_irSender == 0) {
+    Plugin_035_clearQueue();
+    return;
+  }
+  if (!Plugin_035_receiverOff) {
+    #ifdef PLUGIN_016
+    if (irReceiver != 0) irReceiver->disableIRIn(); // Stop the receiver
+    #endif
+    Plugin_035_receiverOff = true;
+  }
+
+  const Plugin_035_QueueStruct& entry = Plugin_035_queue[Plugin_035_queueFirst];
+  while (Plugin_035_position < entry.count) {
+    const uint32_t timing = entry.timings[Plugin_035_position++];
+    const uint32_t usec = timing & P035_TIMING_MASK;
+    if (timing & P035_CARRIER) {
+      Plugin_035_irSender->enableIROut(usec);
+    } else if (timing & P035_MARK) {
+      Plugin_035_irSender->mark(usec);
+    } else if (usec >= P035_GAP_USEC) {
+      Plugin_035_irSender->space(0);
+      Plugin_035_gapStart = micros();
+      Plugin_035_gapUsec = usec;
+      return;
+    } else {
+      Plugin_035_irSender->space(usec);
+    }
+  }
+  Plugin_035_irSender->space(0);
+  Plugin_035_popCode();
+  ++Plugin_035_sent;
+  // Separate the next code from this one
+  Plugin_035_gapStart = micros();
+  Plugin_035_gapUsec = P035_GAP_USEC;
+  if (Plugin_035_queueCount == 0) {
+    #ifdef PLUGIN_016
+    if (irReceiver != 0) irReceiver->enableIRIn(); // Start the receiver
+    #endif
+    Plugin_035_receiverOff = false;
+  }
+}
+
+// IR transmit stats as: waiting/sent/dropped
+String Plugin_035_getStats()
+{
+  String result;
+  result += Plugin_035_queueCount;
+  result += '/';
+  result += Plugin_035_sent;
+  result += '/';
+  result += Plugin_035_dropped;
+  return result;
+}
+
 #endif // USES_P035
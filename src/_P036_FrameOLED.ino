@@ -40,7 +40,19 @@ static int8_t lastWiFiState = P36_WIFI_STATE_UNSET;
 
 OLEDDisplay *display=NULL;
 
-char P036_deviceTemplate[P36_Nlines][P36_Nchars];
+// The lines of the task, loaded in PLUGIN_INIT. See PluginTaskData.ino
+struct P036_data_struct : public PluginTaskData_base
+{
+  P036_data_struct() {
+    memset(deviceTemplate, 0, sizeof(deviceTemplate));
+  }
+
+  char deviceTemplate[P36_Nlines][P36_Nchars];
+};
+
+// Frame and lines on the display, so an unchanged line is not drawn again.
+int8_t P036_shownFrame = -1;
+String P036_shownLines[4];
 
 boolean Plugin_036(byte function, struct EventStruct *event, String& string)
 {
@@ -70,6 +82,7 @@ boolean Plugin_036(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].ValueCount = 0;
         Device[deviceCount].SendDataOption = false;
         Device[deviceCount].TimerOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND | PLUGIN_CALLBACK_ONCE_A_SECOND;
         break;
       }
 
@@ -138,14 +151,16 @@ boolean Plugin_036(byte function, struct EventStruct *event, String& string)
         optionValues3[4] = 32;
         addFormSelector(F("Scroll"), F("plugin_036_scroll"), 5, options3, optionValues3, choice3);
 
-        LoadCustomTaskSettings(event->TaskIndex, (byte*)&P036_deviceTemplate, sizeof(P036_deviceTemplate));
+        P036_data_struct* templates = new P036_data_struct();
+        LoadCustomTaskSettings(event->TaskIndex, (byte*)&templates->deviceTemplate, sizeof(templates->deviceTemplate));
 
         for (byte varNr = 0; varNr < P36_Nlines; varNr++)
         {
-          addFormTextBox(String(F("Line ")) + (varNr + 1), String(F("Plugin_036_template")) + (varNr + 1), P036_deviceTemplate[varNr], P36_Nchars);
+          addFormTextBox(String(F("Line ")) + (varNr + 1), String(F("Plugin_036_template")) + (varNr + 1), templates->deviceTemplate[varNr], P36_Nchars);
         }
+        delete templates;
 
-        addFormPinSelect(F("Display button"), F("taskdevicepin3"), Settings.TaskDevicePin3[event->TaskIndex]);
+        addFormPinSelect(F("Display button"), getWebString(WEB_STR_TASKDEVICEPIN3), Settings.TaskDevicePin3[event->TaskIndex]);
 
         addFormNumericBox(F("Display Timeout"), F("plugin_036_timer"), Settings.TaskDevicePluginConfig[event->TaskIndex][4]);
 
@@ -181,15 +196,17 @@ boolean Plugin_036(byte function, struct EventStruct *event, String& string)
         Settings.TaskDevicePluginConfig[event->TaskIndex][6] = getFormItemInt(F("plugin_036_contrast"));
 
         String argName;
+        P036_data_struct* templates = new P036_data_struct();
 
         for (byte varNr = 0; varNr < P36_Nlines; varNr++)
         {
           argName = F("Plugin_036_template");
           argName += varNr + 1;
-          strncpy(P036_deviceTemplate[varNr], WebServer.arg(argName).c_str(), sizeof(P036_deviceTemplate[varNr]));
+          strncpy(templates->deviceTemplate[varNr], WebServer.arg(argName).c_str(), sizeof(templates->deviceTemplate[varNr]));
         }
 
-        SaveCustomTaskSettings(event->TaskIndex, (byte*)&P036_deviceTemplate, sizeof(P036_deviceTemplate));
+        SaveCustomTaskSettings(event->TaskIndex, (byte*)&templates->deviceTemplate, sizeof(templates->deviceTemplate));
+        delete templates;
 
         success = true;
         break;
@@ -199,7 +216,9 @@ boolean Plugin_036(byte function, struct EventStruct *event, String& string)
       {
         lastWiFiState = P36_WIFI_STATE_UNSET;
         // Load the custom settings from flash
-        LoadCustomTaskSettings(event->TaskIndex, (byte*)&P036_deviceTemplate, sizeof(P036_deviceTemplate));
+        P036_data_struct* templates = new P036_data_struct();
+        LoadCustomTaskSettings(event->TaskIndex, (byte*)&templates->deviceTemplate, sizeof(templates->deviceTemplate));
+        initPluginTaskData(event->TaskIndex, templates, sizeof(P036_data_struct));
 
         //      Init the display and turn it on
         if (display)
@@ -215,6 +234,7 @@ boolean Plugin_036(byte function, struct EventStruct *event, String& string)
           display = new SH1106Wire(OLED_address, Settings.Pin_i2c_sda, Settings.Pin_i2c_scl);
         }
         display->init();		// call to local override of init function
+        I2C_restoreClock();   // The library sets 700 kHz for the whole bus, use the I2C Clock of the task instead
         display->displayOn();
 
         uint8_t OLED_contrast = Settings.TaskDevicePluginConfig[event->TaskIndex][6];
@@ -229,7 +249,8 @@ boolean Plugin_036(byte function, struct EventStruct *event, String& string)
         //      Display the device name, logo, time and wifi
         display_header();
         display_logo();
-        display->display();
+        P036_displayFrame();
+        P036_shownFrame = -1;
 
         //      Set up the display timer
         displayTimer = Settings.TaskDevicePluginConfig[event->TaskIndex][4];
@@ -291,7 +312,7 @@ boolean Plugin_036(byte function, struct EventStruct *event, String& string)
           // Display is on.
           if (display && display_wifibars()) {
             // WiFi symbol was updated.
-            display->display();
+            P036_displayFrame();
           }
         }
 
@@ -301,6 +322,10 @@ boolean Plugin_036(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_READ:
       {
+        P036_data_struct* templates = static_cast<P036_data_struct*>(getPluginTaskData(event->TaskIndex));
+        if (templates == NULL)
+          break;
+
         // Clear the init screen if this is the first call
         // if (firstcall)
         // {
@@ -321,7 +346,7 @@ boolean Plugin_036(byte function, struct EventStruct *event, String& string)
         //      Construct the outgoing string
         for (byte i = 0; i < linesPerFrame; i++)
         {
-          tmpString = P036_deviceTemplate[(linesPerFrame * frameCounter) + i];
+          tmpString = templates->deviceTemplate[(linesPerFrame * frameCounter) + i];
           oldString[i] = P36_parseTemplate(tmpString, 20);
           oldString[i].trim();
         }
@@ -347,7 +372,7 @@ boolean Plugin_036(byte function, struct EventStruct *event, String& string)
           //        Contruct incoming strings
           for (byte i = 0; i < linesPerFrame; i++)
           {
-            tmpString = P036_deviceTemplate[(linesPerFrame * frameCounter) + i];
+            tmpString = templates->deviceTemplate[(linesPerFrame * frameCounter) + i];
             newString[i] = P36_parseTemplate(tmpString, 20);
             newString[i].trim();
             if (newString[i].length() > 0) foundText = true;
@@ -366,10 +391,19 @@ boolean Plugin_036(byte function, struct EventStruct *event, String& string)
         display_header();
         display_indicator(currentFrameToDisplay, nrFramesToDisplay);
 //        display_indicator(frameCounter, NFrames);
-        display->display();
 
-        int scrollspeed = Settings.TaskDevicePluginConfig[event->TaskIndex][3];
-        display_scroll(oldString, newString, linesPerFrame, scrollspeed);
+        if (frameCounter == P036_shownFrame) {
+          // Only one frame with content, update the changed lines in place instead of scrolling.
+          display_lines(newString, linesPerFrame);
+        } else {
+          P036_displayFrame();
+          int scrollspeed = Settings.TaskDevicePluginConfig[event->TaskIndex][3];
+          display_scroll(oldString, newString, linesPerFrame, scrollspeed);
+        }
+        P036_shownFrame = frameCounter;
+        for (byte i = 0; i < 4; i++) {
+          P036_shownLines[i] = i < linesPerFrame ? newString[i] : String();
+        }
 
         success = true;
         break;
@@ -561,15 +595,17 @@ void display_indicator(int iframe, int frameCount) {
   }
 }
 
-void display_scroll(String outString[], String inString[], int nlines, int scrollspeed)
+// Push the frame buffer, only the changed parts are sent.
+void P036_displayFrame()
 {
+  START_TIMER;
+  display->display();
+  STOP_TIMER(OLED_FRAME_STATS);
+}
 
-  // outString contains the outgoing strings in this frame
-  // inString contains the incomng strings in this frame
-  // nlines is the number of lines in each frame
-
-  int ypos[4]; // ypos contains the heights of the various lines - this depends on the font and the number of lines
-
+// Set the font for nlines in a frame, ypos contains the heights of the lines.
+void display_lineLayout(int nlines, int ypos[])
+{
   if (nlines == 1)
   {
     display->setFont(ArialMT_Plain_24);
@@ -599,6 +635,39 @@ void display_scroll(String outString[], String inString[], int nlines, int scrol
     ypos[2] = 32;
     ypos[3] = 42;
   }
+}
+
+// Draw the lines of the frame on the display which differ from P036_shownLines.
+void display_lines(String lines[], int nlines)
+{
+  int ypos[4];
+  display_lineLayout(nlines, ypos);
+  display->setTextAlignment(TEXT_ALIGN_CENTER);
+
+  for (byte j = 0; j < nlines; j++)
+  {
+    if (lines[j] == P036_shownLines[j]) continue;
+
+    // Each line owns the band down to the next line, the scroll area is 12 - 54.
+    const int top = (j == 0) ? 12 : ypos[j];
+    const int bottom = (j + 1 < nlines) ? ypos[j + 1] : 54;
+    display->setColor(BLACK);
+    display->fillRect(0, top, 128, bottom - top);
+    display->setColor(WHITE);
+    display->drawString(64, ypos[j], lines[j]);
+  }
+  P036_displayFrame();
+}
+
+void display_scroll(String outString[], String inString[], int nlines, int scrollspeed)
+{
+
+  // outString contains the outgoing strings in this frame
+  // inString contains the incomng strings in this frame
+  // nlines is the number of lines in each frame
+
+  int ypos[4]; // ypos contains the heights of the various lines - this depends on the font and the number of lines
+  display_lineLayout(nlines, ypos);
 
   display->setTextAlignment(TEXT_ALIGN_CENTER);
 
@@ -622,7 +691,7 @@ void display_scroll(String outString[], String inString[], int nlines, int scrol
       display->drawString(-64 + (4 * i), ypos[j], inString[j]);
     }
 
-    display->display();
+    P036_displayFrame();
 
     delay(2);
     //NO, dont use background stuff, causes crashes in this plugin:
@@ -16,8 +16,6 @@
 #define PLUGIN_VALUENAME3_037 "Value3"
 #define PLUGIN_VALUENAME4_037 "Value4"
 
-#define PLUGIN_IMPORT 37		// This is a 'private' function used only by this import module
-
 // Declare a Wifi client for this plugin only
 
 // TODO TD-er: These must be kept in some vector to allow multiple instances of MQTT import.
@@ -25,6 +23,18 @@ WiFiClient espclient_037;
 PubSubClient *MQTTclient_037 = NULL;
 bool MQTTclient_037_connected = false;
 
+// Subscriptions of all MQTT import tasks, id is TaskIndex * VARS_PER_TASK + value index.
+MQTTTopicTrie Plugin_037_topics;
+
+// Incoming message, passed to every matching subscription
+struct Plugin_037_message {
+  const char* topic;
+  const char* payload;
+  float value;
+  bool parsed;  // Payload converted to value
+  bool valid;
+};
+
 void Plugin_037_update_connect_status() {
   bool connected = false;
   if (MQTTclient_037 != NULL) {
@@ -70,6 +80,7 @@ boolean Plugin_037(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].ValueCount = 4;
         Device[deviceCount].SendDataOption = false;
         Device[deviceCount].TimerOption = false;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND | PLUGIN_CALLBACK_ONCE_A_SECOND;
         break;
       }
 
@@ -183,77 +194,6 @@ boolean Plugin_037(byte function, struct EventStruct *event, String& string)
         success = false;
         break;
       }
-
-    case PLUGIN_IMPORT:
-      {
-        // This is a private option only used by the MQTT 037 callback function
-
-        //      Get the payload and check it out
-        LoadTaskSettings(event->TaskIndex);
-
-        String Payload = event->String2;
-        float floatPayload;
-        if (!string2float(Payload, floatPayload)) {
-          String log = F("IMPT : Bad Import MQTT Command ");
-          log += event->String1;
-          addLog(LOG_LEVEL_ERROR, log);
-          log = F("ERR  : Illegal Payload ");
-          log += Payload;
-          log += "  ";
-          log += getTaskDeviceName(event->TaskIndex);
-          addLog(LOG_LEVEL_INFO, log);
-          success = false;
-          break;
-        }
-
-        //      Get the Topic and see if it matches any of the subscriptions
-
-        String Topic = event->String1;
-
-        LoadCustomTaskSettings(event->TaskIndex, (byte*)&deviceTemplate, sizeof(deviceTemplate));
-
-        for (byte x = 0; x < 4; x++)
-        {
-          String subscriptionTopic = deviceTemplate[x];
-          subscriptionTopic.trim();
-          if (subscriptionTopic.length() == 0) continue;							// skip blank subscriptions
-
-          // Now check if the incoming topic matches one of our subscriptions
-          parseSystemVariables(subscriptionTopic, false);
-          if (MQTTCheckSubscription_037(Topic, subscriptionTopic))
-          {
-            UserVar[event->BaseVarIndex + x] = floatPayload;							// Save the new value
-
-            // Log the event
-
-            String log = F("IMPT : [");
-            log += getTaskDeviceName(event->TaskIndex);
-            log += F("#");
-            log += ExtraTaskSettings.TaskDeviceValueNames[x];
-            log += F("] : ");
-            log += floatPayload;
-            addLog(LOG_LEVEL_INFO, log);
-
-            // Generate event for rules processing - proposed by TridentTD
-
-            if (Settings.UseRules)
-            {
-              String RuleEvent = F("");
-              RuleEvent += getTaskDeviceName(event->TaskIndex);
-              RuleEvent += F("#");
-              RuleEvent += ExtraTaskSettings.TaskDeviceValueNames[x];
-              RuleEvent += F("=");
-              RuleEvent += floatPayload;
-              rulesProcessing(RuleEvent);
-            }
-
-            success = true;
-          }
-        }
-
-        break;
-
-      }
   }
 
   return success;
@@ -265,6 +205,7 @@ boolean MQTTSubscribe_037()
   // We do this because if the connection to the broker is lost, we want to resubscribe for all instances.
 
   char deviceTemplate[4][41];
+  Plugin_037_topics.clear();
 
   //	Loop over all tasks looking for a 037 instance
 
@@ -279,10 +220,12 @@ boolean MQTTSubscribe_037()
       for (byte x = 0; x < 4; x++)
       {
         String subscribeTo = deviceTemplate[x];
+        subscribeTo.trim();
 
         if (subscribeTo.length() > 0)
         {
           parseSystemVariables(subscribeTo, false);
+          Plugin_037_topics.add(subscribeTo.c_str(), y * VARS_PER_TASK + x);
           if (MQTTclient_037->subscribe(subscribeTo.c_str()))
           {
             String log = F("IMPT : [");
@@ -314,34 +257,73 @@ boolean MQTTSubscribe_037()
 void mqttcallback_037(char* c_topic, byte* b_payload, unsigned int length)
 {
   // Here we have incomng MQTT messages from the mqtt import module
-  String topic = c_topic;
-
   char cpayload[256];
+  if (length >= sizeof(cpayload)) length = sizeof(cpayload) - 1;
   strncpy(cpayload, (char*)b_payload, length);
   cpayload[length] = 0;
-  String payload = cpayload;		// convert byte to char string
-  payload.trim();
 
-  byte DeviceIndex = getDeviceIndex(PLUGIN_ID_037);   // This is the device index of 037 modules -there should be one!
+  // Call the import for every task value subscribed to this topic
+  Plugin_037_message message;
+  message.topic = c_topic;
+  message.payload = cpayload;
+  message.parsed = false;
+  message.valid = false;
+  Plugin_037_topics.match(c_topic, Plugin_037_import, &message);
+}
+
+//
+// Save the value of a matching subscription
+//
+void Plugin_037_import(uint16_t id, void* context)
+{
+  Plugin_037_message& message = *static_cast<Plugin_037_message*>(context);
+  const byte taskIndex = id / VARS_PER_TASK;
+  const byte varNr = id % VARS_PER_TASK;
+  if (taskIndex >= TASKS_MAX || Settings.TaskDeviceNumber[taskIndex] != PLUGIN_ID_037) return;
+
+  LoadTaskSettings(taskIndex);
+  if (!message.parsed) {
+    // Only convert the payload once, for all matching subscriptions.
+    String payload = message.payload;
+    payload.trim();
+    message.valid = string2float(payload, message.value);
+    message.parsed = true;
+  }
+  if (!message.valid) {
+    String log = F("IMPT : Bad Import MQTT Command ");
+    log += message.topic;
+    addLog(LOG_LEVEL_ERROR, log);
+    log = F("ERR  : Illegal Payload ");
+    log += message.payload;
+    log += "  ";
+    log += getTaskDeviceName(taskIndex);
+    addLog(LOG_LEVEL_INFO, log);
+    return;
+  }
 
-  // We generate a temp event structure to pass to the plugins
+  UserVar[taskIndex * VARS_PER_TASK + varNr] = message.value;							// Save the new value
 
-  struct EventStruct TempEvent;
+  // Log the event
 
-  TempEvent.String1 = topic;                            // This is the topic of the message
-  TempEvent.String2 = payload;                          // This is the payload
+  String log = F("IMPT : [");
+  log += getTaskDeviceName(taskIndex);
+  log += F("#");
+  log += ExtraTaskSettings.TaskDeviceValueNames[varNr];
+  log += F("] : ");
+  log += message.value;
+  addLog(LOG_LEVEL_INFO, log);
 
-  //  Here we loop over all tasks and call each 037 plugin with function PLUGIN_IMPORT
+  // Generate event for rules processing - proposed by TridentTD
 
-  for (byte y = 0; y < TASKS_MAX; y++)
+  if (Settings.UseRules)
   {
-    if (Settings.TaskDeviceNumber[y] == PLUGIN_ID_037)                // if we have found a 037 device, then give it something to think about!
-    {
-      TempEvent.TaskIndex = y;
-      LoadTaskSettings(y);
-      TempEvent.BaseVarIndex = y * VARS_PER_TASK;           // This is the index in Uservar where values for this task are stored
-      Plugin_ptr[DeviceIndex](PLUGIN_IMPORT, &TempEvent, payload);
-    }
+    String RuleEvent = F("");
+    RuleEvent += getTaskDeviceName(taskIndex);
+    RuleEvent += F("#");
+    RuleEvent += ExtraTaskSettings.TaskDeviceValueNames[varNr];
+    RuleEvent += F("=");
+    RuleEvent += message.value;
+    rulesProcessing(RuleEvent);
   }
 }
 
@@ -409,69 +391,4 @@ boolean MQTTConnect_037(String clientid)
   return MQTTclient_037->connected();
 }
 
-//
-// Check to see if Topic matches the MQTT subscription
-//
-boolean MQTTCheckSubscription_037(String Topic, String Subscription) {
-
-  String tmpTopic = Topic;
-  String tmpSub = Subscription;
-
-  tmpTopic.trim();
-  tmpSub.trim();
-
-  // Get rid of any initial /
-
-  if (tmpTopic.substring(0, 1) == "/")tmpTopic = tmpTopic.substring(1);
-  if (tmpSub.substring(0, 1) == "/")tmpSub = tmpSub.substring(1);
-
-  // Add trailing / if required
-
-  int lenTopic = tmpTopic.length();
-  if (tmpTopic.substring(lenTopic - 1, lenTopic) != "/")tmpTopic += F("/");
-
-  int lenSub = tmpSub.length();
-  if (tmpSub.substring(lenSub - 1, lenSub) != "/")tmpSub += F("/");
-
-  // Now get first part
-
-  int SlashTopic;
-  int SlashSub;
-  int count = 0;
-
-  String pTopic;
-  String pSub;
-
-  while (count < 10) {
-
-    //  Get locations of the first /
-
-    SlashTopic = tmpTopic.indexOf('/');
-    SlashSub = tmpSub.indexOf('/');
-
-    //  If no slashes found then match is OK
-    //  If only one slash found then not OK
-
-    if ((SlashTopic == -1) && (SlashSub == -1)) return true;
-    if ((SlashTopic == -1) && (SlashSub != -1)) return false;
-    if ((SlashTopic != -1) && (SlashSub == -1)) return false;
-
-    //  Get the values for the current subtopic
-
-    pTopic = tmpTopic.substring(0, SlashTopic);
-    pSub = tmpSub.substring(0, SlashSub);
-
-    //  And strip the subtopic from the topic
-
-    tmpTopic = tmpTopic.substring(SlashTopic + 1);
-    tmpSub = tmpSub.substring(SlashSub + 1);
-
-    //  If the subtopics match then OK - otherwise fail
-    if (pSub == "#")  return true;
-    if ((pTopic != pSub) && (pSub != "+"))return false;
-
-    count = count + 1;
-  }
-  return false;
-}
 #endif // USES_P037
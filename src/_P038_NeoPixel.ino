@@ -66,7 +66,7 @@ boolean Plugin_038(byte function, struct EventStruct *event, String& string)
         int indices[] = { 1, 2 };
 
       	addFormNumericBox(F("Led Count"), F("plugin_038_leds"), Settings.TaskDevicePluginConfig[event->TaskIndex][0],1,999);
-      	addFormPinSelect(F("GPIO"), F("taskdevicepin1"), Settings.TaskDevicePin1[event->TaskIndex]);
+      	addFormPinSelect(F("GPIO"), getWebString(WEB_STR_TASKDEVICEPIN1), Settings.TaskDevicePin1[event->TaskIndex]);
         addFormSelector(F("Strip Type"), F("plugin_038_strip"), 2, options, indices, Settings.TaskDevicePluginConfig[event->TaskIndex][1] );
 
       	success = true;
@@ -82,6 +82,13 @@ boolean Plugin_038(byte function, struct EventStruct *event, String& string)
         break;
       }
 
+    case PLUGIN_EXIT:
+      {
+        neoPixelEnd(event->TaskIndex);
+        success = true;
+        break;
+      }
+
     case PLUGIN_INIT:
       {
         if (!Plugin_038_pixels)
@@ -96,6 +103,7 @@ boolean Plugin_038(byte function, struct EventStruct *event, String& string)
 
           Plugin_038_pixels->begin(); // This initializes the NeoPixel library.
         }
+        neoPixelBegin(event->TaskIndex, Plugin_038_pixels, Settings.TaskDevicePluginConfig[event->TaskIndex][1] == 2 ? 4 : 3);
         MaxPixels = Settings.TaskDevicePluginConfig[event->TaskIndex][0];
         success = true;
         break;
@@ -119,7 +127,7 @@ boolean Plugin_038(byte function, struct EventStruct *event, String& string)
             // int Par4 = 0;
             // if (GetArgv(Line, TmpStr1, 5)) Par4 = str2int(TmpStr1);
             Plugin_038_pixels->setPixelColor(event->Par1 - 1, Plugin_038_pixels->Color(event->Par2, event->Par3, event->Par4, event->Par5));
-            Plugin_038_pixels->show(); // This sends the updated pixel color to the hardware.
+            neoPixelShow(Plugin_038_pixels); // This sends the updated pixel color to the hardware.
             success = true;
           }
 
@@ -133,7 +141,7 @@ boolean Plugin_038(byte function, struct EventStruct *event, String& string)
 					  {
                 Plugin_038_pixels->setPixelColor(i, Plugin_038_pixels->Color(event->Par1, event->Par2, event->Par3, event->Par4));
 					  }
-					  Plugin_038_pixels->show();
+					  neoPixelShow(Plugin_038_pixels);
 					  success = true;
           }
 
@@ -151,7 +159,7 @@ boolean Plugin_038(byte function, struct EventStruct *event, String& string)
 	  				{
 		  				Plugin_038_pixels->setPixelColor(i, Plugin_038_pixels->Color(event->Par3, event->Par4, event->Par5));
 			  		}
-				  	Plugin_038_pixels->show();
+				  	neoPixelShow(Plugin_038_pixels);
 					  success = true;
           }
         }
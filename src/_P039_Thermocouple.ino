@@ -39,7 +39,7 @@
 #define PLUGIN_039
 #define PLUGIN_ID_039         39
 #define PLUGIN_NAME_039       "Environment - Thermocouple"
-#define PLUGIN_VALUENAME1_039 "Temperature"
+#define PLUGIN_VALUENAME1_039 WEB_STR_TEMPERATURE
 
 uint8_t Plugin_039_SPI_CS_Pin = 15;  // D8
 bool Plugin_039_SensorAttached = true;
@@ -76,7 +76,7 @@ boolean Plugin_039(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_GET_DEVICEVALUENAMES:
       {
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_039));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], getWebStringP(PLUGIN_VALUENAME1_039));
         break;
       }
 
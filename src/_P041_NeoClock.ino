@@ -34,6 +34,7 @@ boolean Plugin_041(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].FormulaOption = false;
         Device[deviceCount].ValueCount = 0;
         Device[deviceCount].SendDataOption = false;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_ONCE_A_SECOND;
         break;
       }
 
@@ -70,6 +71,13 @@ boolean Plugin_041(byte function, struct EventStruct *event, String& string)
         break;
       }
 
+    case PLUGIN_EXIT:
+      {
+        neoPixelEnd(event->TaskIndex);
+        success = true;
+        break;
+      }
+
     case PLUGIN_INIT:
       {
         if (!Plugin_041_pixels)
@@ -77,6 +85,7 @@ boolean Plugin_041(byte function, struct EventStruct *event, String& string)
           Plugin_041_pixels = new Adafruit_NeoPixel(NUM_LEDS, Settings.TaskDevicePin1[event->TaskIndex], NEO_GRB + NEO_KHZ800);
           Plugin_041_pixels->begin(); // This initializes the NeoPixel library.
         }
+        neoPixelBegin(event->TaskIndex, Plugin_041_pixels, 3);
         Plugin_041_red = Settings.TaskDevicePluginConfig[event->TaskIndex][0];
         Plugin_041_green = Settings.TaskDevicePluginConfig[event->TaskIndex][1];
         Plugin_041_blue = Settings.TaskDevicePluginConfig[event->TaskIndex][2];
@@ -122,7 +131,7 @@ boolean Plugin_041(byte function, struct EventStruct *event, String& string)
         {
           for (int i = 0; i < NUM_LEDS; i++)
             Plugin_041_pixels->setPixelColor(i, Plugin_041_pixels->Color(event->Par1, event->Par2, event->Par3));
-          Plugin_041_pixels->show(); // This sends the updated pixel color to the hardware.
+          neoPixelShow(Plugin_041_pixels); // This sends the updated pixel color to the hardware.
           success = true;
         }
 
@@ -132,7 +141,7 @@ boolean Plugin_041(byte function, struct EventStruct *event, String& string)
           {
             resetAndBlack();
             Plugin_041_pixels->setPixelColor(i, Plugin_041_pixels->Color(event->Par1, event->Par2, event->Par3));
-            Plugin_041_pixels->show(); // This sends the updated pixel color to the hardware.
+            neoPixelShow(Plugin_041_pixels); // This sends the updated pixel color to the hardware.
             delay(200);
           }
           success = true;
@@ -151,7 +160,7 @@ void Plugin_041_update()
   byte Minutes = minute();
   resetAndBlack();
   timeToStrip(Hours, Minutes);
-  Plugin_041_pixels->show(); // This sends the updated pixel color to the hardware.
+  neoPixelShow(Plugin_041_pixels); // This sends the updated pixel color to the hardware.
 }
 
 
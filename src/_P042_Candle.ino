@@ -116,6 +116,7 @@ boolean Plugin_042(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].SendDataOption = true;
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].GlobalSyncOption = false;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_FIFTY_PER_SECOND | PLUGIN_CALLBACK_ONCE_A_SECOND;
         break;
       }
 
@@ -243,6 +244,13 @@ boolean Plugin_042(byte function, struct EventStruct *event, String& string)
         break;
       }
 
+    case PLUGIN_EXIT:
+      {
+        neoPixelEnd(event->TaskIndex);
+        success = true;
+        break;
+      }
+
     case PLUGIN_INIT:
       {
         Candle_red = Settings.TaskDevicePluginConfig[event->TaskIndex][0];
@@ -259,6 +267,7 @@ boolean Plugin_042(byte function, struct EventStruct *event, String& string)
         {
           GPIO_Set = Settings.TaskDevicePin1[event->TaskIndex] > -1;
           if (Candle_pixels) {
+            neoPixelEnd(event->TaskIndex);
             delete Candle_pixels;
           }
           Candle_pixels = new Adafruit_NeoPixel(NUM_PIXEL, Settings.TaskDevicePin1[event->TaskIndex], NEO_GRB + NEO_KHZ800);
@@ -269,6 +278,7 @@ boolean Plugin_042(byte function, struct EventStruct *event, String& string)
           log += Settings.TaskDevicePin1[event->TaskIndex];
           addLog(LOG_LEVEL_DEBUG, log);
         }
+        neoPixelBegin(event->TaskIndex, Candle_pixels, 3);
 
         success = true;
         break;
@@ -277,7 +287,7 @@ boolean Plugin_042(byte function, struct EventStruct *event, String& string)
     case PLUGIN_ONCE_A_SECOND:
       {
         Candle_pixels->setBrightness(Candle_bright);
-        Candle_pixels->show(); // This sends the updated pixel color to the hardware.
+        neoPixelShow(Candle_pixels); // This sends the updated pixel color to the hardware.
         success = true;
         break;
       }
@@ -346,7 +356,7 @@ boolean Plugin_042(byte function, struct EventStruct *event, String& string)
             }
         }
 
-        Candle_pixels->show();
+        neoPixelShow(Candle_pixels);
 
         success = true;
         break;
@@ -7,38 +7,94 @@
 //    Wemos D1 mini (see http://wemos.cc) and
 //    P1 wifi gateway shield (see https://circuits.io/circuits/2460082)
 //    see http://romix.macuser.nl for kits
+//
+//  The telegrams are parsed while they are received, one byte at a time: the CRC16 is updated
+//  on the fly and the bytes are relayed to the client at once, no telegram buffer is needed.
+//  Up to 4 OBIS codes can be picked from the lines, their values are set as task values when
+//  the CRC of the telegram is valid.
 //#######################################################################################################
 
 #define PLUGIN_044
 #define PLUGIN_ID_044         44
 #define PLUGIN_NAME_044       "Communication - P1 Wifi Gateway"
-#define PLUGIN_VALUENAME1_044 "P1WifiGateway"
+#define PLUGIN_VALUENAME1_044 "Obis1"
+#define PLUGIN_VALUENAME2_044 "Obis2"
+#define PLUGIN_VALUENAME3_044 "Obis3"
+#define PLUGIN_VALUENAME4_044 "Obis4"
 
 #define P044_STATUS_LED 12
 #define P044_BUFFER_SIZE 1024
-#define P044_NETBUF_SIZE 600
+#define P044_SERIAL_RX_SIZE 2048   // Holds a complete telegram, see serialRxBegin()
+#define P044_CHUNK_SIZE 128        // Relayed at once
+#define P044_MAX_TELEGRAM 4096     // Longer is not a telegram
+#define P044_LINE_SIZE 64          // Longer lines are relayed, but not searched for OBIS codes
+#define P044_OBIS_COUNT 4
+#define P044_OBIS_SIZE 16
 #define P044_DISABLED 0
 #define P044_WAITING 1
 #define P044_READING 2
 #define P044_CHECKSUM 3
-#define P044_DONE 4
 
-boolean Plugin_044_init = false;
-boolean serialdebug = false;
-char* Plugin_044_serial_buf;
-unsigned int bytes_read = 0;
-boolean CRCcheck = false;
-unsigned int currCRC = 0;
-int checkI = 0;
+struct P044_ParserStruct
+{
+  P044_ParserStruct() : state(P044_DISABLED), crc(0), telegramCRC(0), length(0), crcDigits(0),
+    lineLength(0), found(0), received(false), overruns(0),
+    telegrams(0), crcErrors(0), corrupt(0), overflows(0), overrunTelegrams(0)
+  {
+    memset(obis, 0, sizeof(obis));
+  }
 
-WiFiServer *P1GatewayServer;
-WiFiClient P1GatewayClient;
+  byte state;
+  uint16_t crc;              // Of the bytes from '/' up to and including '!'
+  uint16_t telegramCRC;      // The 4 hex digits after '!'
+  uint16_t length;
+  byte crcDigits;
+  char line[P044_LINE_SIZE];
+  byte lineLength;
+  byte found;                // Bit per OBIS code found in the telegram
+  bool received;             // Task values set since the last PLUGIN_READ
+  float values[P044_OBIS_COUNT];
+  unsigned long overruns;    // Of the serial receive buffer, at the start of the telegram
+  char obis[P044_OBIS_COUNT][P044_OBIS_SIZE];  // The custom task settings
+
+  unsigned long telegrams;         // Complete and valid
+  unsigned long crcErrors;
+  unsigned long corrupt;           // Invalid character
+  unsigned long overflows;         // Longer than P044_MAX_TELEGRAM
+  unsigned long overrunTelegrams;  // Bytes lost in the serial receive buffer
+};
+
+// Allocated in PLUGIN_INIT when the port and baud rate are set, see PluginTaskData.ino
+struct P044_data_struct : public PluginTaskData_base
+{
+  P044_data_struct(uint16_t port) : server(new WiFiServer(port)), CRCcheck(false), connectionState(0)
+  {
+    server->begin();
+  }
+
+  ~P044_data_struct()
+  {
+    unregisterSocketClient(client);
+    if (client) client.stop();
+    server->close();
+    delete server;
+  }
+
+  P044_ParserStruct parser;
+  WiFiServer *server;
+  WiFiClient client;
+  boolean CRCcheck;
+  byte connectionState;
+};
+
+struct P044_data_struct* Plugin_044_data(byte TaskIndex)
+{
+  return static_cast<P044_data_struct*>(getPluginTaskData(TaskIndex));
+}
 
 boolean Plugin_044(byte function, struct EventStruct *event, String& string)
 {
   boolean success = false;
-  static byte connectionState = 0;
-  static int state = P044_DISABLED;
 
   switch (function)
   {
@@ -47,8 +103,14 @@ boolean Plugin_044(byte function, struct EventStruct *event, String& string)
       {
         Device[++deviceCount].Number = PLUGIN_ID_044;
         Device[deviceCount].Type = DEVICE_TYPE_SINGLE;
+        Device[deviceCount].VType = SENSOR_TYPE_QUAD;
         Device[deviceCount].Custom = true;
-        Device[deviceCount].TimerOption = false;
+        Device[deviceCount].FormulaOption = true;
+        Device[deviceCount].ValueCount = P044_OBIS_COUNT;
+        Device[deviceCount].SendDataOption = true;
+        Device[deviceCount].TimerOption = true;
+        Device[deviceCount].TimerOptional = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND;
         break;
       }
 
@@ -61,6 +123,9 @@ boolean Plugin_044(byte function, struct EventStruct *event, String& string)
     case PLUGIN_GET_DEVICEVALUENAMES:
       {
         strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_044));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], PSTR(PLUGIN_VALUENAME2_044));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[2], PSTR(PLUGIN_VALUENAME3_044));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[3], PSTR(PLUGIN_VALUENAME4_044));
         break;
       }
 
@@ -80,9 +145,38 @@ boolean Plugin_044(byte function, struct EventStruct *event, String& string)
 
       	addFormNumericBox(F("Stop bits"), F("plugin_044_stop"), ExtraTaskSettings.TaskDevicePluginConfigLong[4]);
 
-      	addFormPinSelect(F("Reset target after boot"), F("taskdevicepin1"), Settings.TaskDevicePin1[event->TaskIndex]);
+      	addFormPinSelect(F("Reset target after boot"), getWebString(WEB_STR_TASKDEVICEPIN1), Settings.TaskDevicePin1[event->TaskIndex]);
+
+        addFormSubHeader(F("OBIS values"));
+        char obis[P044_OBIS_COUNT][P044_OBIS_SIZE];
+        LoadCustomTaskSettings(event->TaskIndex, (byte*)&obis, sizeof(obis));
+        for (byte varNr = 0; varNr < P044_OBIS_COUNT; varNr++)
+        {
+          obis[varNr][P044_OBIS_SIZE - 1] = 0;
+          String label = F("OBIS code ");
+          label += varNr + 1;
+          String id = F("plugin_044_obis");
+          id += varNr;
+          addFormTextBox(label, id, obis[varNr], P044_OBIS_SIZE - 1);
+        }
+        addFormNote(F("E.g. 1-0:1.8.1 for the energy delivered to the client (tariff 1), the last value between brackets is used"));
 
-      	addFormNumericBox(F("RX Receive Timeout (mSec)"), F("plugin_044_rxwait"), Settings.TaskDevicePluginConfig[event->TaskIndex][0]);
+        P044_data_struct* data = Plugin_044_data(event->TaskIndex);
+        if (data != NULL)
+        {
+          const P044_ParserStruct& parser = data->parser;
+          String stats = F("Telegrams: ");
+          stats += parser.telegrams;
+          stats += F(", CRC errors: ");
+          stats += parser.crcErrors;
+          stats += F(", corrupt: ");
+          stats += parser.corrupt;
+          stats += F(", too long: ");
+          stats += parser.overflows;
+          stats += F(", overruns: ");
+          stats += parser.overrunTelegrams;
+          addFormNote(stats);
+        }
 
         success = true;
         break;
@@ -95,7 +189,18 @@ boolean Plugin_044(byte function, struct EventStruct *event, String& string)
         ExtraTaskSettings.TaskDevicePluginConfigLong[2] = getFormItemInt(F("plugin_044_data"));
         ExtraTaskSettings.TaskDevicePluginConfigLong[3] = getFormItemInt(F("plugin_044_parity"));
         ExtraTaskSettings.TaskDevicePluginConfigLong[4] = getFormItemInt(F("plugin_044_stop"));
-        Settings.TaskDevicePluginConfig[event->TaskIndex][0] = getFormItemInt(F("plugin_044_rxwait"));
+
+        char obis[P044_OBIS_COUNT][P044_OBIS_SIZE];
+        for (byte varNr = 0; varNr < P044_OBIS_COUNT; varNr++)
+        {
+          String id = F("plugin_044_obis");
+          id += varNr;
+          String code = WebServer.arg(id);
+          code.trim();
+          strncpy(obis[varNr], code.c_str(), P044_OBIS_SIZE - 1);
+          obis[varNr][P044_OBIS_SIZE - 1] = 0;
+        }
+        SaveCustomTaskSettings(event->TaskIndex, (byte*)&obis, sizeof(obis));
 
         success = true;
         break;
@@ -103,6 +208,9 @@ boolean Plugin_044(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_INIT:
       {
+        // Closes the server of a previous init first, the new one may use the same port
+        clearPluginTaskData(event->TaskIndex);
+        P044_data_struct* data = NULL;
         pinMode(P044_STATUS_LED, OUTPUT);
         digitalWrite(P044_STATUS_LED, 0);
 
@@ -119,65 +227,86 @@ boolean Plugin_044(byte function, struct EventStruct *event, String& string)
           serialconfig += (ExtraTaskSettings.TaskDevicePluginConfigLong[2] - 5) << 2;
           if (ExtraTaskSettings.TaskDevicePluginConfigLong[4] == 2)
             serialconfig += 0x20;
-          #if defined(ESP8266)
-            Serial.begin(ExtraTaskSettings.TaskDevicePluginConfigLong[1], (SerialConfig)serialconfig);
-          #endif
-          #if defined(ESP32)
-            Serial.begin(ExtraTaskSettings.TaskDevicePluginConfigLong[1], serialconfig);
-          #endif
-          if (P1GatewayServer) P1GatewayServer->close();
-          P1GatewayServer = new WiFiServer(ExtraTaskSettings.TaskDevicePluginConfigLong[0]);
-          P1GatewayServer->begin();
-
-          if (!Plugin_044_serial_buf)
-            Plugin_044_serial_buf = (char *)malloc(P044_BUFFER_SIZE);
+          serialRxBegin(event->TaskIndex, ExtraTaskSettings.TaskDevicePluginConfigLong[1], serialconfig,
+                        P044_SERIAL_RX_SIZE, SERIAL_RX_NO_FRAME_END, 0);
+          data = new P044_data_struct(ExtraTaskSettings.TaskDevicePluginConfigLong[0]);
+          initPluginTaskData(event->TaskIndex, data, sizeof(P044_data_struct));
+          LoadCustomTaskSettings(event->TaskIndex, (byte*)&data->parser.obis, sizeof(data->parser.obis));
+          for (byte varNr = 0; varNr < P044_OBIS_COUNT; varNr++)
+            data->parser.obis[varNr][P044_OBIS_SIZE - 1] = 0;
 
           if (Settings.TaskDevicePin1[event->TaskIndex] != -1)
           {
             pinMode(Settings.TaskDevicePin1[event->TaskIndex], OUTPUT);
             digitalWrite(Settings.TaskDevicePin1[event->TaskIndex], LOW);
-            delay(500);
-            digitalWrite(Settings.TaskDevicePin1[event->TaskIndex], HIGH);
-            pinMode(Settings.TaskDevicePin1[event->TaskIndex], INPUT_PULLUP);
+            // Release the reset after 500 msec, in PLUGIN_TIMER_IN
+            setSystemTimer(500, PLUGIN_ID_044, event->TaskIndex, Settings.TaskDevicePin1[event->TaskIndex]);
           }
-
-          Plugin_044_init = true;
         }
-
-        blinkLED();
+        if (data == NULL)
+        {
+          success = true;
+          break;
+        }
 
         if (ExtraTaskSettings.TaskDevicePluginConfigLong[1] == 115200) {
           addLog(LOG_LEVEL_DEBUG, F("P1   : DSMR version 4 meter, CRC on"));
-          CRCcheck = true;
+          data->CRCcheck = true;
         } else {
           addLog(LOG_LEVEL_DEBUG, F("P1   : DSMR version 4 meter, CRC off"));
-          CRCcheck = false;
+          data->CRCcheck = false;
         }
 
-
-        state = P044_WAITING;
+        data->parser.state = P044_WAITING;
         success = true;
         break;
       }
 
     case PLUGIN_EXIT:
       {
-        if (P1GatewayServer) {
-          P1GatewayServer->close();
-          //FIXME: shouldnt P1P1GatewayServer be deleted?
-          P1GatewayServer = NULL;
-        }
+        // The server is closed and deleted with the task data
+        serialRxEnd(event->TaskIndex);
+        digitalWrite(P044_STATUS_LED, 0);
         success = true;
         break;
       }
 
+    case PLUGIN_READ:
+      {
+        // Send the values of the last valid telegram, once
+        P044_data_struct* data = Plugin_044_data(event->TaskIndex);
+        if (data != NULL)
+        {
+          success = data->parser.received;
+          data->parser.received = false;
+        }
+        break;
+      }
+
+    case PLUGIN_TIMER_IN:
+      {
+        // End of the reset pulse started in PLUGIN_INIT
+        digitalWrite(event->Par1, HIGH);
+        pinMode(event->Par1, INPUT_PULLUP);
+        break;
+      }
+
     case PLUGIN_TEN_PER_SECOND:
       {
-        if (Plugin_044_init)
+        P044_data_struct* data = Plugin_044_data(event->TaskIndex);
+        if (data != NULL)
         {
+          WiFiServer *P1GatewayServer = data->server;
+          WiFiClient& P1GatewayClient = data->client;
           size_t bytes_read;
-          if (P1GatewayServer->hasClient())
+          if (P1GatewayServer->hasClient() && !P1GatewayClient.connected() && !socketAvailable(SOCKET_P1_GATEWAY))
+          {
+            // Refused, no connection left
+            P1GatewayServer->available().stop();
+          }
+          else if (P1GatewayServer->hasClient())
           {
+            registerSocketClient(P1GatewayClient, SOCKET_P1_GATEWAY);
             if (P1GatewayClient) P1GatewayClient.stop();
             P1GatewayClient = P1GatewayServer->available();
             addLog(LOG_LEVEL_ERROR, F("P1   : Client connected!"));
@@ -185,7 +314,7 @@ boolean Plugin_044(byte function, struct EventStruct *event, String& string)
 
           if (P1GatewayClient.connected())
           {
-            connectionState = 1;
+            data->connectionState = 1;
             uint8_t net_buf[P044_BUFFER_SIZE];
             int count = P1GatewayClient.available();
             if (count > 0)
@@ -210,14 +339,11 @@ boolean Plugin_044(byte function, struct EventStruct *event, String& string)
           }
           else
           {
-            if (connectionState == 1) // there was a client connected before...
+            if (data->connectionState == 1) // there was a client connected before...
             {
-              connectionState = 0;
+              data->connectionState = 0;
               addLog(LOG_LEVEL_ERROR, F("P1   : Client disconnected!"));
             }
-
-            while (Serial.available())
-              Serial.read();
           }
 
           success = true;
@@ -227,214 +353,200 @@ boolean Plugin_044(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_SERIAL_IN:
       {
-        if (Plugin_044_init)
+        P044_data_struct* data = Plugin_044_data(event->TaskIndex);
+        if (data != NULL)
         {
-          if (P1GatewayClient.connected())
-          {
-            int RXWait = Settings.TaskDevicePluginConfig[event->TaskIndex][0];
-            if (RXWait == 0)
-              RXWait = 1;
-            int timeOut = RXWait;
-            while (timeOut > 0)
-            {
-              while (Serial.available() && state != P044_DONE) {
-                if (bytes_read < P044_BUFFER_SIZE - 5) {
-                  char  ch = Serial.read();
-                  digitalWrite(P044_STATUS_LED, 1);
-                  switch (state) {
-                    case P044_DISABLED: //ignore incoming data
-                      break;
-                    case P044_WAITING:
-                      if (ch == '/')  {
-                        Plugin_044_serial_buf[0] = ch;
-                        bytes_read=1;
-                        state = P044_READING;
-                      } // else ignore data
-                      break;
-                    case P044_READING:
-                      if (ch == '!') {
-                        if (CRCcheck) {
-                          state = P044_CHECKSUM;
-                        } else {
-                          state = P044_DONE;
-                        }
-                      }
-                      if (validP1char(ch)) {
-                        Plugin_044_serial_buf[bytes_read] = ch;
-                        bytes_read++;
-                      } else if (ch=='/') {
-                        addLog(LOG_LEVEL_DEBUG, F("P1   : Error: Start detected, discarded input."));
-                        Plugin_044_serial_buf[0] = ch;
-                        bytes_read = 1;
-                      } else {              // input is non-ascii
-                        addLog(LOG_LEVEL_DEBUG, F("P1   : Error: DATA corrupt, discarded input."));
-                        Serial.flush();
-                        bytes_read = 0;
-                        state = P044_WAITING;
-                      }
-                      break;
-                    case P044_CHECKSUM:
-                      checkI ++;
-                      if (checkI == 4) {
-                        checkI = 0;
-                        state = P044_DONE;
-                      }
-                      Plugin_044_serial_buf[bytes_read] = ch;
-                      bytes_read++;
-                      break;
-                    case P044_DONE:
-                      // Plugin_044_serial_buf[bytes_read]= '\n';
-                      // bytes_read++;
-                      // Plugin_044_serial_buf[bytes_read] = 0;
-                      break;
-                  }
-                }
-                else
-                {
-                  Serial.read();      // when the buffer is full, just read remaining input, but do not store...
-                  bytes_read = 0;
-                  state = P044_WAITING;    // reset
-                }
-                digitalWrite(P044_STATUS_LED, 0);
-                timeOut = RXWait; // if serial received, reset timeout counter
-              }
-              delay(1);
-              timeOut--;
-            }
-
-            if (state == P044_DONE) {
-              if (checkDatagram(bytes_read)) {
-                Plugin_044_serial_buf[bytes_read] = '\r';
-                bytes_read++;
-                Plugin_044_serial_buf[bytes_read] = '\n';
-                bytes_read++;
-                Plugin_044_serial_buf[bytes_read] = 0;
-                P1GatewayClient.write((const uint8_t*)Plugin_044_serial_buf, bytes_read);
-                P1GatewayClient.flush();
-                addLog(LOG_LEVEL_DEBUG, F("P1   : data send!"));
-                blinkLED();
-
-                if (Settings.UseRules)
-                {
-                  LoadTaskSettings(event->TaskIndex);
-                  String eventString = getTaskDeviceName(event->TaskIndex);
-                  eventString += F("#Data");
-                  rulesProcessing(eventString);
-                }
-
-              } else {
-                addLog(LOG_LEVEL_DEBUG, F("P1   : Error: Invalid CRC, dropped data"));
-              }
-
-              bytes_read = 0;
-              state = P044_WAITING;
-            }   // state == P044_DONE
-          }
+          Plugin_044_process(event, *data);
           success = true;
         }
         break;
       }
 
+    case PLUGIN_INTERRUPT_EVENT:
+      {
+        // Idle line, the rest of the telegram is in.
+        P044_data_struct* data = Plugin_044_data(event->TaskIndex);
+        if (data != NULL && event->Par1 == SERIAL_RX_EVENT_IDLE)
+          Plugin_044_process(event, *data);
+        success = true;
+        break;
+      }
+
   }
   return success;
 }
-void blinkLED() {
-  digitalWrite(P044_STATUS_LED, 1);
-  delay(500);
-  digitalWrite(P044_STATUS_LED, 0);
-}
+
 /*
    validP1char
        checks whether the incoming character is a valid one for a P1 datagram. Returns false if not, which signals corrupt datagram
 */
 bool validP1char(char ch) {
-  if ((ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch == '.') || (ch == '!') || (ch == ' ') || (ch == 92) || (ch == 13) || (ch == '\n') || (ch == '(') || (ch == ')') || (ch == '-') || (ch == '*') || (ch == ':') )
-  {
-    return true;
-  } else {
-    addLog(LOG_LEVEL_DEBUG, F("P1   : Error: invalid char read from P1"));
-    if (serialdebug) {
-      Serial.print(F("faulty char>"));
-      Serial.print(ch);
-      Serial.println(F("<"));
-    }
-    return false;
-  }
+  return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch == '.') || (ch == '!') || (ch == ' ') || (ch == 92) || (ch == 13) || (ch == '\n') || (ch == '(') || (ch == ')') || (ch == '-') || (ch == '*') || (ch == ':');
 }
 
-int FindCharInArrayRev(char array[], char c, int len) {
-  for (int i = len - 1; i >= 0; i--) {
-    if (array[i] == c) {
-      return i;
-    }
-  }
-  return -1;
+byte Plugin_044_hexDigit(char ch) {
+  if (ch >= '0' && ch <= '9') return ch - '0';
+  if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+  if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+  return 0xFF;
 }
 
 /*
-   CRC16
-      based on code written by Jan ten Hove
-     https://github.com/jantenhove/P1-Meter-ESP8266
+   A complete line of the telegram: keep the value of the OBIS codes looked for.
+   The last value between brackets is used, e.g. the meter reading of a gas meter line
+   0-1:24.2.1(101209112500W)(12785.123*m3)
 */
-unsigned int CRC16(unsigned int crc, unsigned char *buf, int len)
-{
-  for (int pos = 0; pos < len; pos++)
+void Plugin_044_line(struct P044_ParserStruct& parser) {
+  parser.line[parser.lineLength] = 0;
+  char* open = strchr(parser.line, '(');
+  if (open == NULL) return;
+  const size_t codeLength = open - parser.line;
+  for (byte varNr = 0; varNr < P044_OBIS_COUNT; varNr++)
   {
-    crc ^= (unsigned int)buf[pos];    // XOR byte into least sig. byte of crc
-
-    for (int i = 8; i != 0; i--) {    // Loop over each bit
-      if ((crc & 0x0001) != 0) {      // If the LSB is set
-        crc >>= 1;                    // Shift right and XOR 0xA001
-        crc ^= 0xA001;
-      }
-      else                            // Else LSB is not set
-        crc >>= 1;                    // Just shift right
+    if (parser.obis[varNr][0] == 0 || strlen(parser.obis[varNr]) != codeLength ||
+        strncmp(parser.line, parser.obis[varNr], codeLength) != 0)
+      continue;
+    char* value = strrchr(parser.line, '(') + 1;
+    char* end;
+    const double parsed = strtod(value, &end);
+    if (end != value && (*end == '*' || *end == ')')) {
+      parser.values[varNr] = parsed;
+      parser.found |= 1 << varNr;
     }
   }
-
-  return crc;
 }
 
-/*  checkDatagram
-      checks whether the P044_CHECKSUM of the data received from P1 matches the P044_CHECKSUM attached to the
-      telegram
-     based on code written by Jan ten Hove
-     https://github.com/jantenhove/P1-Meter-ESP8266
+/*
+   End of the telegram: count it and set the values when the CRC is valid.
 */
-bool checkDatagram(int len) {
-  int startChar = FindCharInArrayRev(Plugin_044_serial_buf, '/', len);
-  int endChar = FindCharInArrayRev(Plugin_044_serial_buf, '!', len);
-  bool validCRCFound = false;
-
-  if (!CRCcheck) return true;
-
-  if (serialdebug) {
-    Serial.print(F("input length: "));
-    Serial.println(len);
-    Serial.print("Start char \\ : ");
-    Serial.println(startChar);
-    Serial.print(F("End char ! : "));
-    Serial.println(endChar);
+void Plugin_044_telegramEnd(struct EventStruct *event, struct P044_ParserStruct& parser, boolean CRCcheck) {
+  parser.state = P044_WAITING;
+  digitalWrite(P044_STATUS_LED, 0);
+  if (serialRx.overruns != parser.overruns) {
+    ++parser.overrunTelegrams;
+    addLog(LOG_LEVEL_DEBUG, F("P1   : Error: Serial overrun, dropped data"));
+    return;
+  }
+  if (CRCcheck && parser.crc != parser.telegramCRC) {
+    ++parser.crcErrors;
+    addLog(LOG_LEVEL_DEBUG, F("P1   : Error: Invalid CRC, dropped data"));
+    return;
   }
+  ++parser.telegrams;
+  if (parser.found != 0) {
+    for (byte varNr = 0; varNr < P044_OBIS_COUNT; varNr++)
+      if (parser.found & (1 << varNr))
+        UserVar[event->BaseVarIndex + varNr] = parser.values[varNr];
+    parser.received = true;
+  }
+  addLog(LOG_LEVEL_DEBUG, F("P1   : data send!"));
 
-  if (endChar >= 0)
+  if (Settings.UseRules)
   {
-    currCRC = CRC16(0x0000, (unsigned char *) Plugin_044_serial_buf, endChar - startChar + 1);
-
-    char messageCRC[5];
-    strncpy(messageCRC, Plugin_044_serial_buf + endChar + 1, 4);
-    messageCRC[4] = 0;
-    if (serialdebug) {
-      for (int cnt = 0; cnt < len; cnt++)
-        Serial.print(Plugin_044_serial_buf[cnt]);
-    }
+    String eventString = getTaskDeviceName(event->TaskIndex);
+    eventString += F("#Data");
+    rulesProcessing(eventString);
+  }
+}
 
-    validCRCFound = (strtoul(messageCRC, NULL, 16) == currCRC);
-    if (!validCRCFound) {
-      addLog(LOG_LEVEL_DEBUG, F("P1   : Error: invalid CRC found"));
+/*
+   Parse the received bytes, one at a time. The bytes of a telegram are relayed to the
+   client in the chunks they are read in, from the '/' up to the CRC, followed by CR LF.
+   Without a client the telegrams are still parsed for the OBIS values.
+*/
+void Plugin_044_process(struct EventStruct *event, struct P044_data_struct& data)
+{
+  P044_ParserStruct& parser = data.parser;
+  WiFiClient& P1GatewayClient = data.client;
+  const bool relay = P1GatewayClient.connected();
+  uint8_t chunk[P044_CHUNK_SIZE];
+  unsigned int count;
+  while ((count = serialRxReadBytes(chunk, sizeof(chunk))) > 0)
+  {
+    // Start of the part of the chunk within a telegram
+    int relayStart = parser.state == P044_WAITING ? -1 : 0;
+    for (unsigned int i = 0; i < count; ++i)
+    {
+      const char ch = chunk[i];
+      if (parser.state == P044_DISABLED)
+        break;
+      if (parser.state == P044_WAITING) {
+        if (ch != '/')
+          continue;             // Ignore the data between telegrams
+        parser.state = P044_READING;
+        parser.crc = 0;
+        parser.length = 0;
+        parser.lineLength = 0;
+        parser.crcDigits = 0;
+        parser.telegramCRC = 0;
+        parser.found = 0;
+        parser.overruns = serialRx.overruns;
+        relayStart = i;
+        digitalWrite(P044_STATUS_LED, 1);
+      } else if (parser.state == P044_READING && ch == '/') {
+        // The rest of the previous telegram is lost, start again
+        addLog(LOG_LEVEL_DEBUG, F("P1   : Error: Start detected, discarded input."));
+        ++parser.corrupt;
+        if (relay && relayStart >= 0) {
+          P1GatewayClient.write(chunk + relayStart, i - relayStart);
+          P1GatewayClient.write((const uint8_t*)"\r\n", 2);
+        }
+        parser.state = P044_WAITING;
+        --i;
+        continue;
+      }
+
+      if (++parser.length > P044_MAX_TELEGRAM) {
+        addLog(LOG_LEVEL_DEBUG, F("P1   : Error: Telegram too long, discarded input."));
+        ++parser.overflows;
+        parser.state = P044_WAITING;
+        digitalWrite(P044_STATUS_LED, 0);
+      } else if (parser.state == P044_READING) {
+        if (!validP1char(ch)) {
+          addLog(LOG_LEVEL_DEBUG, F("P1   : Error: DATA corrupt, discarded input."));
+          ++parser.corrupt;
+          parser.state = P044_WAITING;
+          digitalWrite(P044_STATUS_LED, 0);
+        } else {
+          parser.crc = (parser.crc >> 8) ^ pgm_read_word(&modbusRTUCRCTable[(parser.crc ^ ch) & 0xFF]);
+          if (ch == '!') {
+            if (data.CRCcheck) {
+              parser.state = P044_CHECKSUM;
+            } else {
+              Plugin_044_telegramEnd(event, parser, data.CRCcheck);
+            }
+          } else if (ch == '\n') {
+            Plugin_044_line(parser);
+            parser.lineLength = 0;
+          } else if (ch != '\r' && parser.lineLength < P044_LINE_SIZE - 1) {
+            parser.line[parser.lineLength++] = ch;
+          }
+        }
+      } else if (parser.state == P044_CHECKSUM) {
+        const byte digit = Plugin_044_hexDigit(ch);
+        if (digit == 0xFF) {
+          addLog(LOG_LEVEL_DEBUG, F("P1   : Error: invalid CRC found"));
+          ++parser.crcErrors;
+          parser.state = P044_WAITING;
+          digitalWrite(P044_STATUS_LED, 0);
+        } else {
+          parser.telegramCRC = (parser.telegramCRC << 4) | digit;
+          if (++parser.crcDigits == 4)
+            Plugin_044_telegramEnd(event, parser, data.CRCcheck);
+        }
+      }
+
+      if (parser.state == P044_WAITING) {
+        // The telegram ended with this byte
+        if (relay) {
+          P1GatewayClient.write(chunk + relayStart, i + 1 - relayStart);
+          P1GatewayClient.write((const uint8_t*)"\r\n", 2);
+        }
+        relayStart = -1;
+      }
     }
-    currCRC = 0;
+    if (relay && relayStart >= 0 && parser.state != P044_WAITING)
+      P1GatewayClient.write(chunk + relayStart, count - relayStart);
   }
-  return validCRCFound;
 }
 #endif // USES_P044
@@ -135,6 +135,7 @@ boolean Plugin_046(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].FormulaOption = true;
         Device[deviceCount].SendDataOption = true;
         Device[deviceCount].ValueCount = 3;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND;
         break;
       }
 
@@ -234,9 +235,9 @@ boolean Plugin_046(byte function, struct EventStruct *event, String& string)
       {
         Settings.TaskDevicePluginConfig[event->TaskIndex][0] = getFormItemInt(F("plugin_046"));
         if (Settings.TaskDevicePluginConfig[event->TaskIndex][0] == 0) {
-          Settings.TaskDevicePluginConfig[event->TaskIndex][1] = getFormItemInt(F("taskdevicepin1"));
-          Settings.TaskDevicePluginConfig[event->TaskIndex][2] = getFormItemInt(F("taskdevicepin2"));
-          Settings.TaskDevicePluginConfig[event->TaskIndex][3] = getFormItemInt(F("taskdevicepin3"));
+          Settings.TaskDevicePluginConfig[event->TaskIndex][1] = getFormItemInt(getWebString(WEB_STR_TASKDEVICEPIN1));
+          Settings.TaskDevicePluginConfig[event->TaskIndex][2] = getFormItemInt(getWebString(WEB_STR_TASKDEVICEPIN2));
+          Settings.TaskDevicePluginConfig[event->TaskIndex][3] = getFormItemInt(getWebString(WEB_STR_TASKDEVICEPIN3));
           Settings.TaskDevicePluginConfig[event->TaskIndex][4] = getFormItemInt(F("taskdeviceport"));
         }
         success = true;
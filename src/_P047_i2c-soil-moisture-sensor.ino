@@ -13,7 +13,7 @@
 #define PLUGIN_047
 #define PLUGIN_ID_047        47
 #define PLUGIN_NAME_047       "Environment - Soil moisture sensor [TESTING]"
-#define PLUGIN_VALUENAME1_047 "Temperature"
+#define PLUGIN_VALUENAME1_047 WEB_STR_TEMPERATURE
 #define PLUGIN_VALUENAME2_047 "Moisture"
 #define PLUGIN_VALUENAME3_047 "Light"
 
@@ -67,7 +67,7 @@ boolean Plugin_047(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_GET_DEVICEVALUENAMES:
       {
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_047));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], getWebStringP(PLUGIN_VALUENAME1_047));
         strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], PSTR(PLUGIN_VALUENAME2_047));
         strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[2], PSTR(PLUGIN_VALUENAME3_047));
         break;
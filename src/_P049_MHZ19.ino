@@ -29,9 +29,10 @@
 #define PLUGIN_ID_049         49
 #define PLUGIN_NAME_049       "Gases - CO2 MH-Z19"
 #define PLUGIN_VALUENAME1_049 "PPM"
-#define PLUGIN_VALUENAME2_049 "Temperature" // Temperature in C
+#define PLUGIN_VALUENAME2_049 WEB_STR_TEMPERATURE // Temperature in C
 #define PLUGIN_VALUENAME3_049 "U" // Undocumented, minimum measurement per time period?
 #define PLUGIN_READ_TIMEOUT   3000
+#define PLUGIN_049_POLL_MSEC  20    // The response takes 10 msec at 9600 baud
 
 #define PLUGIN_049_FILTER_OFF        1
 #define PLUGIN_049_FILTER_OFF_ALLSAMPLES 2
@@ -45,8 +46,19 @@ boolean Plugin_049_ABC_Disable = false;
 boolean Plugin_049_ABC_MustApply = false;
 
 #include <ESPeasySoftwareSerial.h>
+#include <SerialFrameBuffer.h>
 ESPeasySoftwareSerial *Plugin_049_SoftSerial;
 
+// Start byte 0xFF, command, 6 data bytes and the checksum of the bytes after the start byte
+const SerialFrameFormat Plugin_049_format = {
+  { 0xFF }, { 0xFF }, 1,
+  9, SERIALFRAME_NO_LENGTH_FIELD, 0, 0,
+  SERIALFRAME_CHECKSUM_NEG_SUM8, 1,
+  0, 0
+};
+
+SerialFrameBuffer<9> Plugin_049_frame(Plugin_049_format);
+
 enum mhzCommands : byte { mhzCmdReadPPM,
                           mhzCmdCalibrateZero,
                           mhzCmdABCEnable,
@@ -103,7 +115,7 @@ const PROGMEM byte mhzCmdData[][3] = {
 #endif
   };
 
-byte mhzResp[9];    // 9 byte response buffer
+byte mhzResp[9];    // 9 byte command buffer
 
 enum
 {
@@ -193,7 +205,7 @@ boolean Plugin_049(byte function, struct EventStruct *event, String& string)
     case PLUGIN_GET_DEVICEVALUENAMES:
       {
         strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_049));
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], PSTR(PLUGIN_VALUENAME2_049));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], getWebStringP(PLUGIN_VALUENAME2_049));
         strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[2], PSTR(PLUGIN_VALUENAME3_049));
         break;
       }
@@ -241,7 +253,8 @@ boolean Plugin_049(byte function, struct EventStruct *event, String& string)
           // No guarantee the correct state is active on the sensor after reboot.
           Plugin_049_ABC_MustApply = true;
         }
-        Plugin_049_SoftSerial = new ESPeasySoftwareSerial(Settings.TaskDevicePin1[event->TaskIndex], Settings.TaskDevicePin2[event->TaskIndex]);
+        // Decode outside the interrupt, the edges of 2 responses fit
+        Plugin_049_SoftSerial = new ESPeasySoftwareSerial(Settings.TaskDevicePin1[event->TaskIndex], Settings.TaskDevicePin2[event->TaskIndex], false, 64, 180);
         Plugin_049_SoftSerial->begin(9600);
         addLog(LOG_LEVEL_INFO, F("MHZ19: Init OK "));
 
@@ -324,6 +337,11 @@ boolean Plugin_049(byte function, struct EventStruct *event, String& string)
 
         if (Plugin_049_init)
         {
+          // Drop what is left of an earlier response
+          while (Plugin_049_SoftSerial->available() > 0)
+            Plugin_049_SoftSerial->read();
+          Plugin_049_frame.Clear();
+
           //send read PPM command
           byte nbBytesSent = _P049_send_mhzCmd(mhzCmdReadPPM);
           if (nbBytesSent != 9) {
@@ -332,156 +350,132 @@ boolean Plugin_049(byte function, struct EventStruct *event, String& string)
               addLog(LOG_LEVEL_INFO, log);
           }
 
-          // get response
-          memset(mhzResp, 0, sizeof(mhzResp));
+          // The response is collected in PLUGIN_TIMER_IN
+          startTaskConversion(event, PLUGIN_ID_049, PLUGIN_049_POLL_MSEC, 0);
+        }
+        break;
+      }
 
-          long timer = millis() + PLUGIN_READ_TIMEOUT;
-          int counter = 0;
-          while (!timeOutReached(timer) && (counter < 9)) {
-            if (Plugin_049_SoftSerial->available() > 0) {
-              mhzResp[counter++] = Plugin_049_SoftSerial->read();
-            } else {
-              delay(10);
-            }
-          }
-          if (counter < 9){
-              addLog(LOG_LEVEL_INFO, F("MHZ19: Error, timeout while trying to read"));
+    case PLUGIN_TIMER_IN:
+      {
+        if (!isTaskConversionTimer(event))
+          break;
+        while (Plugin_049_SoftSerial->available() > 0) {
+          if (Plugin_049_frame.AddData(Plugin_049_SoftSerial->read())) {
+            completeTaskConversion(event, Plugin_049_processResponse(event));
+            return success;
           }
+        }
+        if (taskConversionDuration(event->TaskIndex) >= PLUGIN_READ_TIMEOUT) {
+          addLog(LOG_LEVEL_INFO, F("MHZ19: Error, timeout while trying to read"));
+          completeTaskConversion(event, false);
+        } else {
+          startTaskConversion(event, PLUGIN_ID_049, PLUGIN_049_POLL_MSEC, event->Par2 + 1);
+        }
+        break;
+      }
+  }
+  return success;
+}
 
-          unsigned int ppm = 0;
-          signed int temp = 0;
-          unsigned int s = 0;
-          float u = 0;
-          byte checksum = _P049_calculateChecksum(mhzResp);
-
-          if ( !(mhzResp[8] == checksum) ) {
-             String log = F("MHZ19: Read error: checksum = ");
-             log += String(checksum); log += " / "; log += String(mhzResp[8]);
-             log += " bytes read  => ";for (byte i = 0; i < 9; i++) {log += mhzResp[i];log += "/" ;}
-             addLog(LOG_LEVEL_ERROR, log);
-
-             // Sometimes there is a misalignment in the serial read
-             // and the starting byte 0xFF isn't the first read byte.
-             // This goes on forever.
-             // There must be a better way to handle this, but here
-             // we're trying to shift it so that 0xFF is the next byte
-             byte checksum_shift;
-             for (byte i = 1; i < 8; i++) {
-                checksum_shift = Plugin_049_SoftSerial->peek();
-                if (checksum_shift == 0xFF) {
-                  String log = F("MHZ19: Shifted ");
-                  log += i;
-                  log += F(" bytes to attempt to fix buffer alignment");
-                  addLog(LOG_LEVEL_ERROR, log);
-                  break;
-                } else {
-                 checksum_shift = Plugin_049_SoftSerial->read();
-                }
-             }
-             success = false;
-             break;
-
-          // Process responses to 0x86
-          } else if (mhzResp[0] == 0xFF && mhzResp[1] == 0x86 && mhzResp[8] == checksum)  {
-
-              //calculate CO2 PPM
-              unsigned int mhzRespHigh = (unsigned int) mhzResp[2];
-              unsigned int mhzRespLow = (unsigned int) mhzResp[3];
-              ppm = (256*mhzRespHigh) + mhzRespLow;
-
-              // set temperature (offset 40)
-              unsigned int mhzRespTemp = (unsigned int) mhzResp[4];
-              temp = mhzRespTemp - 40;
-
-              // set 's' (stability) value
-              unsigned int mhzRespS = (unsigned int) mhzResp[5];
-              s = mhzRespS;
-
-              // calculate 'u' value
-              unsigned int mhzRespUHigh = (unsigned int) mhzResp[6];
-              unsigned int mhzRespULow = (unsigned int) mhzResp[7];
-              u = (256*mhzRespUHigh) + mhzRespULow;
-
-              String log = F("MHZ19: ");
-
-              // During (and only ever at) sensor boot, 'u' is reported as 15000
-              // We log but don't process readings during that time
-              if (u == 15000) {
-
-                log += F("Bootup detected! ");
-                if (Plugin_049_ABC_Disable) {
-                  // After bootup of the sensor the ABC will be enabled.
-                  // Thus only actively disable after bootup.
-                  Plugin_049_ABC_MustApply = true;
-                  log += F("Will disable ABC when bootup complete. ");
-                }
-                success = false;
-              // Finally, stable readings are used for variables
-              } else {
-                const int filterValue = Settings.TaskDevicePluginConfig[event->TaskIndex][1];
-                if (Plugin_049_Check_and_ApplyFilter(UserVar[event->BaseVarIndex], ppm, s, filterValue, log)) {
-                  UserVar[event->BaseVarIndex] = (float)ppm;
-                  UserVar[event->BaseVarIndex + 1] = (float)temp;
-                  UserVar[event->BaseVarIndex + 2] = (float)u;
-                  if (s==0 || s==64) {
-                    // Reading is stable.
-                    if (Plugin_049_ABC_MustApply) {
-                      // Send ABC enable/disable command based on the desired state.
-                      if (Plugin_049_ABC_Disable) {
-                        _P049_send_mhzCmd(mhzCmdABCDisable);
-                        addLog(LOG_LEVEL_INFO, F("MHZ19: Sent sensor ABC Disable!"));
-                      } else {
-                        _P049_send_mhzCmd(mhzCmdABCEnable);
-                        addLog(LOG_LEVEL_INFO, F("MHZ19: Sent sensor ABC Enable!"));
-                      }
-                      Plugin_049_ABC_MustApply = false;
-                    }
-                  }
-                  success = true;
-                } else {
-                  success = false;
-                }
-              }
-
-              // Log values in all cases
-              log += F("PPM value: ");
-              log += ppm;
-              log += F(" Temp/S/U values: ");
-              log += temp;
-              log += F("/");
-              log += s;
-              log += F("/");
-              log += u;
-              addLog(LOG_LEVEL_INFO, log);
-              break;
-
-//#ifdef ENABLE_DETECTION_RANGE_COMMANDS
-          // Sensor responds with 0x99 whenever we send it a measurement range adjustment
-          } else if (mhzResp[0] == 0xFF && mhzResp[1] == 0x99 && mhzResp[8] == checksum)  {
-
-            addLog(LOG_LEVEL_INFO, F("MHZ19: Received measurement range acknowledgment! "));
-            addLog(LOG_LEVEL_INFO, F("Expecting sensor reset..."));
-            success = false;
-            break;
-//#endif
-
-          // log verbosely anything else that the sensor reports
-          } else {
-
-              String log = F("MHZ19: Unknown response:");
-              for (int i = 0; i < 9; ++i) {
-                log += F(" ");
-                log += String(mhzResp[i], HEX);
-              }
-              addLog(LOG_LEVEL_INFO, log);
-              success = false;
-              break;
-
+// A response with a valid checksum is in Plugin_049_frame, returns true when the values are set.
+boolean Plugin_049_processResponse(struct EventStruct *event)
+{
+  boolean success = false;
+  unsigned int ppm = 0;
+  signed int temp = 0;
+  unsigned int s = 0;
+  float u = 0;
+
+  // Process responses to 0x86
+  if (Plugin_049_frame.Get8(1) == 0x86)  {
+
+    //calculate CO2 PPM
+    unsigned int mhzRespHigh = (unsigned int) Plugin_049_frame.Get8(2);
+    unsigned int mhzRespLow = (unsigned int) Plugin_049_frame.Get8(3);
+    ppm = (256*mhzRespHigh) + mhzRespLow;
+
+    // set temperature (offset 40)
+    unsigned int mhzRespTemp = (unsigned int) Plugin_049_frame.Get8(4);
+    temp = mhzRespTemp - 40;
+
+    // set 's' (stability) value
+    unsigned int mhzRespS = (unsigned int) Plugin_049_frame.Get8(5);
+    s = mhzRespS;
+
+    // calculate 'u' value
+    unsigned int mhzRespUHigh = (unsigned int) Plugin_049_frame.Get8(6);
+    unsigned int mhzRespULow = (unsigned int) Plugin_049_frame.Get8(7);
+    u = (256*mhzRespUHigh) + mhzRespULow;
+
+    String log = F("MHZ19: ");
+
+    // During (and only ever at) sensor boot, 'u' is reported as 15000
+    // We log but don't process readings during that time
+    if (u == 15000) {
+
+      log += F("Bootup detected! ");
+      if (Plugin_049_ABC_Disable) {
+        // After bootup of the sensor the ABC will be enabled.
+        // Thus only actively disable after bootup.
+        Plugin_049_ABC_MustApply = true;
+        log += F("Will disable ABC when bootup complete. ");
+      }
+      success = false;
+    // Finally, stable readings are used for variables
+    } else {
+      const int filterValue = Settings.TaskDevicePluginConfig[event->TaskIndex][1];
+      if (Plugin_049_Check_and_ApplyFilter(UserVar[event->BaseVarIndex], ppm, s, filterValue, log)) {
+        UserVar[event->BaseVarIndex] = (float)ppm;
+        UserVar[event->BaseVarIndex + 1] = (float)temp;
+        UserVar[event->BaseVarIndex + 2] = (float)u;
+        if (s==0 || s==64) {
+          // Reading is stable.
+          if (Plugin_049_ABC_MustApply) {
+            // Send ABC enable/disable command based on the desired state.
+            if (Plugin_049_ABC_Disable) {
+              _P049_send_mhzCmd(mhzCmdABCDisable);
+              addLog(LOG_LEVEL_INFO, F("MHZ19: Sent sensor ABC Disable!"));
+            } else {
+              _P049_send_mhzCmd(mhzCmdABCEnable);
+              addLog(LOG_LEVEL_INFO, F("MHZ19: Sent sensor ABC Enable!"));
+            }
+            Plugin_049_ABC_MustApply = false;
           }
-
         }
-        break;
+        success = true;
+      } else {
+        success = false;
       }
+    }
+
+    // Log values in all cases
+    log += F("PPM value: ");
+    log += ppm;
+    log += F(" Temp/S/U values: ");
+    log += temp;
+    log += F("/");
+    log += s;
+    log += F("/");
+    log += u;
+    addLog(LOG_LEVEL_INFO, log);
+
+  // Sensor responds with 0x99 whenever we send it a measurement range adjustment
+  } else if (Plugin_049_frame.Get8(1) == 0x99)  {
+
+    addLog(LOG_LEVEL_INFO, F("MHZ19: Received measurement range acknowledgment! "));
+    addLog(LOG_LEVEL_INFO, F("Expecting sensor reset..."));
+
+  // log verbosely anything else that the sensor reports
+  } else {
+
+    String log = F("MHZ19: Unknown response:");
+    for (int i = 0; i < 9; ++i) {
+      log += F(" ");
+      log += String(Plugin_049_frame.Get8(i), HEX);
+    }
+    addLog(LOG_LEVEL_INFO, log);
+
   }
   return success;
 }
@@ -497,7 +491,6 @@ byte _P049_calculateChecksum(byte *array)
 
 size_t _P049_send_mhzCmd(byte CommandId)
 {
-  // The receive buffer "mhzResp" is re-used to send a command here:
   mhzResp[0] = 0xFF; // Start byte, fixed
   mhzResp[1] = 0x01; // Sensor number, 0x01 by default
   memcpy_P(&mhzResp[2], mhzCmdData[CommandId], sizeof(mhzCmdData[0]));
@@ -16,8 +16,8 @@
 #define PLUGIN_051
 #define PLUGIN_ID_051        51
 #define PLUGIN_NAME_051       "Environment - AM2320 [TESTING]"
-#define PLUGIN_VALUENAME1_051 "Temperature"
-#define PLUGIN_VALUENAME2_051 "Humidity"
+#define PLUGIN_VALUENAME1_051 WEB_STR_TEMPERATURE
+#define PLUGIN_VALUENAME2_051 WEB_STR_HUMIDITY
 
 
 
@@ -52,8 +52,8 @@ boolean Plugin_051(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_GET_DEVICEVALUENAMES:
       {
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_051));
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], PSTR(PLUGIN_VALUENAME2_051));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], getWebStringP(PLUGIN_VALUENAME1_051));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], getWebStringP(PLUGIN_VALUENAME2_051));
         break;
       }
 
@@ -23,10 +23,13 @@
 #define PLUGIN_NAME_052       "Gases - CO2 Senseair"
 #define PLUGIN_VALUENAME1_052 ""
 
-boolean Plugin_052_init = false;
+// Registers are read by the shared Modbus RTU master, the value comes with the reply event.
+#define PLUGIN_052_SLAVE       0xFE   // Any sensor
+#define PLUGIN_052_TAG_RELAY   0xFF   // Reply of the relay write, the reads use the sensor choice
 
-#include <ESPeasySoftwareSerial.h>
-ESPeasySoftwareSerial *Plugin_052_SoftSerial;
+boolean Plugin_052_init = false;
+int Plugin_052_bus = -1;
+byte Plugin_052_taskIndex = 0;
 
 boolean Plugin_052(byte function, struct EventStruct *event, String& string)
 {
@@ -100,7 +103,7 @@ boolean Plugin_052(byte function, struct EventStruct *event, String& string)
       {
           byte choiceSensor = Settings.TaskDevicePluginConfig[event->TaskIndex][0];
 
-          String optionsSensor[7] = { F("Error Status"), F("Carbon Dioxide"), F("Temperature"), F("Humidity"), F("Relay Status"), F("Temperature Adjustment"), F("ABC period") };
+          String optionsSensor[7] = { F("Error Status"), F("Carbon Dioxide"), getWebString(WEB_STR_TEMPERATURE), getWebString(WEB_STR_HUMIDITY), F("Relay Status"), F("Temperature Adjustment"), F("ABC period") };
           addFormSelector(F("Sensor"), F("plugin_052_sensor"), 7, optionsSensor, NULL, choiceSensor);
 
           /*
@@ -130,9 +133,11 @@ boolean Plugin_052(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_INIT:
       {
-        Plugin_052_init = true;
-        Plugin_052_SoftSerial = new ESPeasySoftwareSerial(Settings.TaskDevicePin1[event->TaskIndex],
-                                                   Settings.TaskDevicePin2[event->TaskIndex]);
+        modbusRTUEnd(Plugin_052_bus);
+        Plugin_052_bus = modbusRTUBegin(Settings.TaskDevicePin1[event->TaskIndex],
+                                        Settings.TaskDevicePin2[event->TaskIndex], 9600);
+        Plugin_052_init = Plugin_052_bus >= 0;
+        Plugin_052_taskIndex = event->TaskIndex;
 
         /*
         // ABC functionality disabled for now, due to a bug in the firmware.
@@ -143,230 +148,148 @@ boolean Plugin_052(byte function, struct EventStruct *event, String& string)
         Plugin_052_setABCperiod(periodInHours[choiceABCperiod]);
         */
 
-        success = true;
+        success = Plugin_052_init;
         break;
       }
 
-    case PLUGIN_READ:
+    case PLUGIN_EXIT:
       {
+        modbusRTUEnd(Plugin_052_bus);
+        Plugin_052_bus = -1;
+        Plugin_052_init = false;
+        break;
+      }
 
+    case PLUGIN_READ:
+      {
+        // Queue the read, the values are sent when the reply arrives.
         if (Plugin_052_init)
         {
-
-          String log = F("Senseair: ");
-          switch(Settings.TaskDevicePluginConfig[event->TaskIndex][0])
+          const byte choice = Settings.TaskDevicePluginConfig[event->TaskIndex][0];
+          uint8_t function = 0x04;
+          uint16_t reg = 0;
+          switch (choice)
           {
-              case 0:
-              {
-                  int errorWord = Plugin_052_readErrorStatus();
-                  for (size_t i = 0; i < 9; i++) {
-                    if (bitRead(errorWord,i)) {
-                      UserVar[event->BaseVarIndex] = i;
-                      log += F("error code = ");
-                      log += i;
-                      break;
-                    }
-                  }
-
-                  UserVar[event->BaseVarIndex] = -1;
-                  log += F("error code = ");
-                  log += -1;
-                  break;
-              }
-              case 1:
-              {
-                  int co2 = Plugin_052_readCo2();
-                  UserVar[event->BaseVarIndex] = co2;
-                  log += F("co2 = ");
-                  log += co2;
-                  break;
-              }
-              case 2:
-              {
-                  float temperature = Plugin_052_readTemperature();
-                  UserVar[event->BaseVarIndex] = (float)temperature;
-                  log += F("temperature = ");
-                  log += (float)temperature;
-                  break;
-              }
-              case 3:
-              {
-                  float relativeHumidity = Plugin_052_readRelativeHumidity();
-                  UserVar[event->BaseVarIndex] = (float)relativeHumidity;
-                  log += F("humidity = ");
-                  log += (float)relativeHumidity;
-                  break;
-              }
-              case 4:
-              {
-                  int relayStatus = Plugin_052_readRelayStatus();
-                  UserVar[event->BaseVarIndex] = relayStatus;
-                  log += F("relay status = ");
-                  log += relayStatus;
-                  break;
-              }
-              case 5:
-              {
-                  int temperatureAdjustment = Plugin_052_readTemperatureAdjustment();
-                  UserVar[event->BaseVarIndex] = temperatureAdjustment;
-                  log += F("temperature adjustment = ");
-                  log += temperatureAdjustment;
-                  break;
-              }
-              case 6:
-              {
-                  int period = Plugin_052_readABCperiod();
-                  UserVar[event->BaseVarIndex] = period;
-                  log += F("ABC period = ");
-                  log += period;
-                  break;
-              }
+            case 0: reg = 0x00; break;   // Error status
+            case 1: reg = 0x03; break;   // Carbon dioxide
+            case 2: reg = 0x04; break;   // Temperature
+            case 3: reg = 0x05; break;   // Humidity
+            case 4: reg = 0x1C; break;   // Relay status
+            case 5: reg = 0x0A; break;   // Temperature adjustment
+            case 6: function = 0x03; reg = 0x1F; break;   // ABC period
+            default: return false;
           }
-          addLog(LOG_LEVEL_INFO, log);
-
-          success = true;
-          break;
+          if (modbusRTUQueue(Plugin_052_bus, event->TaskIndex, PLUGIN_052_SLAVE, function, reg, 1, choice))
+            startTaskConversion(event, PLUGIN_ID_052, MODBUS_RTU_TIMEOUT * MODBUS_RTU_QUEUE, 0);
         }
         break;
       }
-  }
-  return success;
-}
 
-void Plugin_052_buildFrame(byte slaveAddress,
-              byte  functionCode,
-              short startAddress,
-              short numberOfRegisters,
-              byte frame[8])
-{
-  frame[0] = slaveAddress;
-  frame[1] = functionCode;
-  frame[2] = (byte)(startAddress >> 8);
-  frame[3] = (byte)(startAddress);
-  frame[4] = (byte)(numberOfRegisters >> 8);
-  frame[5] = (byte)(numberOfRegisters);
-  // CRC-calculation
-  byte checkSum[2] = {0};
-  Plugin_052_ModRTU_CRC(frame, 6, checkSum);
-  frame[6] = checkSum[0];
-  frame[7] = checkSum[1];
-}
-
-int Plugin_052_sendCommand(byte command[])
-{
-  byte recv_buf[7] = {0xff};
-  byte data_buf[2] = {0xff};
-  long value       = -1;
-
-  Plugin_052_SoftSerial->write(command, 8); //Send the byte array
-  delay(50);
-
-  // Read answer from sensor
-  int ByteCounter = 0;
-  while(Plugin_052_SoftSerial->available()) {
-    recv_buf[ByteCounter] = Plugin_052_SoftSerial->read();
-    ByteCounter++;
-  }
-
-  data_buf[0] = recv_buf[3];
-  data_buf[1] = recv_buf[4];
-  value = (data_buf[0] << 8) | (data_buf[1]);
+    case PLUGIN_TIMER_IN:
+      {
+        // No reply at all, e.g. the bus was ended
+        if (isTaskConversionTimer(event))
+          completeTaskConversion(event, false);
+        break;
+      }
 
-  return value;
-}
+    case PLUGIN_INTERRUPT_EVENT:
+      {
+        const ModbusRTUTransaction* reply = modbusRTUTransaction(event);
+        if (reply == NULL)
+          break;
+        success = true;
+        if (reply->status != MODBUS_RTU_STATUS_OK)
+        {
+          String log = F("Senseair: no valid reply, status ");
+          log += reply->status;
+          addLog(LOG_LEVEL_ERROR, log);
+          if (reply->tag != PLUGIN_052_TAG_RELAY)
+            completeTaskConversion(event, false);
+          break;
+        }
+        if (reply->tag == PLUGIN_052_TAG_RELAY)
+          break;
 
-int Plugin_052_readErrorStatus(void)
-{
-  int errorBits = 0;
-  int error_Status = -1;
-  byte frame[8] = {0};
-  Plugin_052_buildFrame(0xFE, 0x04, 0x00, 1, frame);
-  errorBits = Plugin_052_sendCommand(frame);
-  for (size_t i = 0; i < 15; i++) {
-    if (getBitOfInt(errorBits, i) == 1) {
-      error_Status = i;
-    }
+        const int value = reply->values[0];
+        String log = F("Senseair: ");
+        switch (reply->tag)
+        {
+            case 0:
+            {
+                int error_Status = -1;
+                for (size_t i = 0; i < 15; i++) {
+                  if (getBitOfInt(value, i) == 1) {
+                    error_Status = i;
+                  }
+                }
+                UserVar[event->BaseVarIndex] = error_Status;
+                log += F("error code = ");
+                log += error_Status;
+                break;
+            }
+            case 1:
+            {
+                UserVar[event->BaseVarIndex] = value;
+                log += F("co2 = ");
+                log += value;
+                break;
+            }
+            case 2:
+            {
+                float temperature = (float)value/100;
+                UserVar[event->BaseVarIndex] = temperature;
+                log += F("temperature = ");
+                log += temperature;
+                break;
+            }
+            case 3:
+            {
+                float relativeHumidity = (float)value/100;
+                UserVar[event->BaseVarIndex] = relativeHumidity;
+                log += F("humidity = ");
+                log += relativeHumidity;
+                break;
+            }
+            case 4:
+            {
+                int relayStatus = value >> 8 & 0x1;
+                UserVar[event->BaseVarIndex] = relayStatus;
+                log += F("relay status = ");
+                log += relayStatus;
+                break;
+            }
+            case 5:
+            {
+                UserVar[event->BaseVarIndex] = value;
+                log += F("temperature adjustment = ");
+                log += value;
+                break;
+            }
+            case 6:
+            {
+                UserVar[event->BaseVarIndex] = value;
+                log += F("ABC period = ");
+                log += value;
+                break;
+            }
+        }
+        addLog(LOG_LEVEL_INFO, log);
+        completeTaskConversion(event, true);
+        break;
+      }
   }
-  return error_Status;
-}
-
-int Plugin_052_readCo2(void)
-{
-  int co2 = 0;
-  byte frame[8] = {0};
-  Plugin_052_buildFrame(0xFE, 0x04, 0x03, 1, frame);
-  co2 = Plugin_052_sendCommand(frame);
-  return co2;
-}
-
-float Plugin_052_readTemperature(void)
-{
-  int temperatureX100 = 0;
-  float temperature = 0.0;
-  byte frame[8] = {0};
-  Plugin_052_buildFrame(0xFE, 0x04, 0x04, 1, frame);
-  temperatureX100 = Plugin_052_sendCommand(frame);
-  temperature = (float)temperatureX100/100;
-  return temperature;
-}
-
-float Plugin_052_readRelativeHumidity(void)
-{
-  int rhX100 = 0;
-  float rh = 0.0;
-  byte frame[8] = {0};
-  Plugin_052_buildFrame(0xFE, 0x04, 0x05, 1, frame);
-  rhX100 = Plugin_052_sendCommand(frame);
-  rh = (float)rhX100/100;
-  return rh;
-}
-
-int Plugin_052_readRelayStatus(void)
-{
-  int status = 0;
-  bool result;
-  byte frame[8] = {0};
-
-  Plugin_052_buildFrame(0xFE, 0x04, 0x1C, 1, frame);
-  status = Plugin_052_sendCommand(frame);
-  result = status >> 8 & 0x1;
-
-  return result;
-}
-
-int Plugin_052_readTemperatureAdjustment(void)
-{
-  int value = 0;
-  byte frame[8] = {0};
-
-  Plugin_052_buildFrame(0xFE, 0x04, 0x0A, 1, frame);
-  value = Plugin_052_sendCommand(frame);
-
-  return value;
+  return success;
 }
 
 void Plugin_052_setRelayStatus(int status) {
-  // int response;
-  byte frame[8] = {0};
+  uint16_t value = 0x7FFF;
   if (status == 0) {
-    Plugin_052_buildFrame(0xFE, 0x06, 0x18, 0x0000, frame);
+    value = 0x0000;
   } else if (status == 1){
-    Plugin_052_buildFrame(0xFE, 0x06, 0x18, 0x3FFF, frame);
-  } else {
-    Plugin_052_buildFrame(0xFE, 0x06, 0x18, 0x7FFF, frame);
+    value = 0x3FFF;
   }
-  Plugin_052_sendCommand(frame);
-}
-
-int Plugin_052_readABCperiod(void)
-{
-  int period = 0;
-  byte frame[8] = {0};
-
-  Plugin_052_buildFrame(0xFE, 0x03, 0x001F, 0x0001, frame);
-  period = Plugin_052_sendCommand(frame);
-
-  return period;
+  modbusRTUQueue(Plugin_052_bus, Plugin_052_taskIndex, PLUGIN_052_SLAVE, 0x06, 0x18, value, PLUGIN_052_TAG_RELAY);
 }
 
 /*
@@ -374,36 +297,10 @@ int Plugin_052_readABCperiod(void)
 // See https://github.com/letscontrolit/ESPEasy/issues/759
 void Plugin_052_setABCperiod(int period)
 {
-  byte frame[8] = {0};
-
-  Plugin_052_buildFrame(0xFE, 0x06, 0x001F, period, frame);
-  Plugin_052_sendCommand(frame);
+  modbusRTUQueue(Plugin_052_bus, Plugin_052_taskIndex, PLUGIN_052_SLAVE, 0x06, 0x001F, period, PLUGIN_052_TAG_RELAY);
 }
 */
 
-// Compute the MODBUS RTU CRC
-unsigned int Plugin_052_ModRTU_CRC(byte buf[], int len, byte checkSum[2])
-{
-  unsigned int crc = 0xFFFF;
-
-  for (int pos = 0; pos < len; pos++) {
-    crc ^= (unsigned int)buf[pos];          // XOR byte into least sig. byte of crc
-
-    for (int i = 8; i != 0; i--) {    // Loop over each bit
-      if ((crc & 0x0001) != 0) {      // If the LSB is set
-        crc >>= 1;                    // Shift right and XOR 0xA001
-        crc ^= 0xA001;
-      }
-      else                            // Else LSB is not set
-        crc >>= 1;                    // Just shift right
-    }
-  }
-  // Note, this number has low and high bytes swapped, so use it accordingly (or swap bytes)
-  checkSum[1] = (byte)((crc >> 8) & 0xFF);
-  checkSum[0] = (byte)(crc & 0xFF);
-  return crc;
-}
-
 int getBitOfInt(int reg, int pos)
 {
   // Create a mask
@@ -416,5 +313,5 @@ int getBitOfInt(int reg, int pos)
   int result = masked_register >> pos;
 
   return result;
-}
+}
 #endif // USES_P052
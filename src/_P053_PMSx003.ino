@@ -8,9 +8,12 @@
 // The PMSx003 are particle sensors. Particles are measured by blowing air through the enclosure and,
 // together with a laser, count the amount of particles. These sensors have an integrated microcontroller
 // that counts particles and transmits measurement data over the serial connection.
+// With the TX pin connected the sensor can sleep between the reads (SensorDutyCycle.ino), it is
+// woken the warm-up time before the read and the frames of a short burst are averaged.
 
 
 #include <ESPeasySoftwareSerial.h>
+#include <SerialFrameBuffer.h>
 
 #define PLUGIN_053
 #define PLUGIN_ID_053 53
@@ -21,108 +24,25 @@
 #define PMSx003_SIG1 0X42
 #define PMSx003_SIG2 0X4d
 #define PMSx003_SIZE 32
+#define PMSx003_CMD_SLEEP 0xE4  // Data 0 = sleep, 1 = wake up
+
+// Header, frame length field (without header and length) and the sum of all bytes before it.
+const SerialFrameFormat Plugin_053_format = {
+  { PMSx003_SIG1, PMSx003_SIG2 }, { 0xFF, 0xFF }, 2,
+  PMSx003_SIZE, 2, 2, 4,
+  SERIALFRAME_CHECKSUM_SUM16_BE, 0,
+  0, 0
+};
 
 ESPeasySoftwareSerial *swSerial = NULL;
+SerialFrameBuffer<PMSx003_SIZE> Plugin_053_frame(Plugin_053_format);
 boolean Plugin_053_init = false;
 boolean values_received = false;
 
-// Read 2 bytes from serial and make an uint16 of it. Additionally calculate
-// checksum for PMSx003. Assumption is that there is data available, otherwise
-// this function is blocking.
-void SerialRead16(uint16_t* value, uint16_t* checksum)
-{
-  uint8_t data_high, data_low;
-
-  // If swSerial is initialized, we are using soft serial
-  if (swSerial != NULL)
-  {
-    data_high = swSerial->read();
-    data_low = swSerial->read();
-  }
-  else
-  {
-    data_high = Serial.read();
-    data_low = Serial.read();
-  }
-
-  *value = data_low;
-  *value |= (data_high << 8);
-
-  if (checksum != NULL)
-  {
-    *checksum += data_high;
-    *checksum += data_low;
-  }
-
-#if 0
-  // Low-level logging to see data from sensor
-  String log = F("PMSx003 : byte high=0x");
-  log += String(data_high,HEX);
-  log += F(" byte low=0x");
-  log += String(data_low,HEX);
-  log += F(" result=0x");
-  log += String(*value,HEX);
-  addLog(LOG_LEVEL_INFO, log);
-#endif
-}
-
-void SerialFlush() {
-  if (swSerial != NULL) {
-    swSerial->flush();
-  } else {
-    Serial.flush();
-  }
-}
-
-boolean PacketAvailable(void)
-{
-  if (swSerial != NULL) // Software serial
-  {
-    // When there is enough data in the buffer, search through the buffer to
-    // find header (buffer may be out of sync)
-    if (!swSerial->available()) return false;
-    while ((swSerial->peek() != PMSx003_SIG1) && swSerial->available()) {
-      swSerial->read(); // Read until the buffer starts with the first byte of a message, or buffer empty.
-    }
-    if (swSerial->available() < PMSx003_SIZE) return false; // Not enough yet for a complete packet
-  }
-  else // Hardware serial
-  {
-    // When there is enough data in the buffer, search through the buffer to
-    // find header (buffer may be out of sync)
-    if (!Serial.available()) return false;
-    while ((Serial.peek() != PMSx003_SIG1) && Serial.available()) {
-      Serial.read(); // Read until the buffer starts with the first byte of a message, or buffer empty.
-    }
-    if (Serial.available() < PMSx003_SIZE) return false; // Not enough yet for a complete packet
-  }
-  return true;
-}
-
-boolean Plugin_053_process_data(struct EventStruct *event) {
-  uint16_t checksum = 0, checksum2 = 0;
-  uint16_t framelength = 0;
-  uint16 packet_header = 0;
-  SerialRead16(&packet_header, &checksum); // read PMSx003_SIG1 + PMSx003_SIG2
-  if (packet_header != ((PMSx003_SIG1 << 8) | PMSx003_SIG2)) {
-    // Not the start of the packet, stop reading.
-    return false;
-  }
-
-  SerialRead16(&framelength, &checksum);
-  if (framelength != (PMSx003_SIZE - 4))
-  {
-    if (loglevelActiveFor(LOG_LEVEL_ERROR)) {
-      String log = F("PMSx003 : invalid framelength - ");
-      log += framelength;
-      addLog(LOG_LEVEL_ERROR, log);
-    }
-    return false;
-  }
-
-  uint16_t data[13]; // byte data_low, data_high;
+void Plugin_053_process_data(struct EventStruct *event) {
+  uint16_t data[13];
   for (int i = 0; i < 13; i++)
-    SerialRead16(&data[i], &checksum);
+    data[i] = Plugin_053_frame.Get16BE(4 + 2 * i);
 
   if (loglevelActiveFor(LOG_LEVEL_DEBUG)) {
     String log = F("PMSx003 : pm1.0=");
@@ -156,19 +76,47 @@ boolean Plugin_053_process_data(struct EventStruct *event) {
     addLog(LOG_LEVEL_DEBUG_MORE, log);
   }
 
-  // Compare checksums
-  SerialRead16(&checksum2, NULL);
-  SerialFlush(); // Make sure no data is lost due to full buffer.
-  if (checksum == checksum2)
-  {
-    // Data is checked and good, fill in output
-    UserVar[event->BaseVarIndex]     = data[3];
-    UserVar[event->BaseVarIndex + 1] = data[4];
-    UserVar[event->BaseVarIndex + 2] = data[5];
-    values_received = true;
-    return true;
+  // Data is checked and good, fill in output
+  if (Plugin_053_dutyCycle(event)) {
+    const float values[3] = { data[3], data[4], data[5] };
+    if (dutyCycleSample(event, values, 3))
+      Plugin_053_command(PMSx003_CMD_SLEEP, 0);
+    return;
   }
-  return false;
+  UserVar[event->BaseVarIndex]     = data[3];
+  UserVar[event->BaseVarIndex + 1] = data[4];
+  UserVar[event->BaseVarIndex + 2] = data[5];
+  values_received = true;
+}
+
+boolean Plugin_053_dutyCycle(struct EventStruct *event) {
+  return Settings.TaskDevicePluginConfig[event->TaskIndex][0] > 0 && Settings.TaskDevicePin2[event->TaskIndex] >= 0;
+}
+
+// Command frame to the sensor: header, command, 16 bit data and the sum.
+void Plugin_053_command(byte command, uint16_t data) {
+  byte frame[7] = { PMSx003_SIG1, PMSx003_SIG2, command, static_cast<byte>(data >> 8), static_cast<byte>(data & 0xFF), 0, 0 };
+  const uint16_t sum = SerialFrameBuffer<PMSx003_SIZE>::Checksum(SERIALFRAME_CHECKSUM_SUM16_BE, frame, 5);
+  frame[5] = sum >> 8;
+  frame[6] = sum & 0xFF;
+  if (swSerial != NULL)
+    swSerial->write(frame, sizeof(frame));
+  else
+    Serial.write(frame, sizeof(frame));
+}
+
+// Feed the received bytes to the frame buffer, it finds the start of the frames.
+boolean Plugin_053_receive(struct EventStruct *event) {
+  boolean received = false;
+  int c;
+  while ((c = swSerial != NULL ? swSerial->read() : serialRxRead()) >= 0) {
+    if (Plugin_053_frame.AddData(c)) {
+      addLog(LOG_LEVEL_DEBUG_MORE, F("PMSx003 : Packet available"));
+      Plugin_053_process_data(event);
+      received = true;
+    }
+  }
+  return received;
 }
 
 boolean Plugin_053(byte function, struct EventStruct *event, String& string)
@@ -190,6 +138,7 @@ boolean Plugin_053(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].SendDataOption = true;
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND;
         success = true;
         break;
       }
@@ -218,6 +167,20 @@ boolean Plugin_053(byte function, struct EventStruct *event, String& string)
           break;
         }
 
+    case PLUGIN_WEBFORM_LOAD:
+      {
+        dutyCycleWebformLoad(event, 0);
+        success = true;
+        break;
+      }
+
+    case PLUGIN_WEBFORM_SAVE:
+      {
+        dutyCycleWebformSave(event, 0);
+        success = true;
+        break;
+      }
+
     case PLUGIN_INIT:
       {
         int rxPin = Settings.TaskDevicePin1[event->TaskIndex];
@@ -236,21 +199,21 @@ boolean Plugin_053(byte function, struct EventStruct *event, String& string)
           swSerial = NULL;
         }
 
+        Plugin_053_frame.Clear();
+
         // Hardware serial is RX on 3 and TX on 1
         if (rxPin == 3 && txPin == 1)
         {
           log = F("PMSx003 : using hardware serial");
           addLog(LOG_LEVEL_INFO, log);
-          Serial.begin(9600);
-          Serial.flush();
+          serialRxBegin(event->TaskIndex, 9600, SERIAL_8N1, 4 * PMSx003_SIZE, SERIAL_RX_NO_FRAME_END, 0);
         }
         else
         {
           log = F("PMSx003: using software serial");
           addLog(LOG_LEVEL_INFO, log);
-          swSerial = new ESPeasySoftwareSerial(rxPin, txPin, false, 96); // 96 Bytes buffer, enough for up to 3 packets.
+          swSerial = new ESPeasySoftwareSerial(rxPin, txPin, false, 96, 320); // 96 Bytes buffer, enough for up to 3 packets. Edges of a packet.
           swSerial->begin(9600);
-          swSerial->flush();
         }
 
         if (resetPin >= 0) // Reset if pin is configured
@@ -260,9 +223,15 @@ boolean Plugin_053(byte function, struct EventStruct *event, String& string)
           addLog(LOG_LEVEL_INFO, log);
           pinMode(resetPin, OUTPUT);
           digitalWrite(resetPin, LOW);
-          delay(250);
-          digitalWrite(resetPin, HIGH);
-          pinMode(resetPin, INPUT_PULLUP);
+          // Release the reset after 250 msec, in PLUGIN_TIMER_IN
+          setSystemTimer(250, PLUGIN_ID_053, event->TaskIndex, resetPin);
+        }
+
+        if (Plugin_053_dutyCycle(event)) {
+          Plugin_053_command(PMSx003_CMD_SLEEP, 1);
+          dutyCycleBegin(event, PLUGIN_ID_053, Settings.TaskDevicePluginConfig[event->TaskIndex][0] * 1000);
+        } else {
+          dutyCycleEnd(event->TaskIndex);
         }
 
         Plugin_053_init = true;
@@ -277,27 +246,60 @@ boolean Plugin_053(byte function, struct EventStruct *event, String& string)
             delete swSerial;
             swSerial=NULL;
           }
+          serialRxEnd(event->TaskIndex);
+          dutyCycleEnd(event->TaskIndex);
+          Plugin_053_init = false;
           break;
       }
 
-    // The update rate from the module is 200ms .. multiple seconds. Practise
-    // shows that we need to read the buffer many times per seconds to stay in
-    // sync.
+    case PLUGIN_TIMER_IN:
+      {
+        if (dutyCycleWakeTimer(event))
+        {
+          Plugin_053_command(PMSx003_CMD_SLEEP, 1);
+          break;
+        }
+        // End of the reset pulse started in PLUGIN_INIT
+        digitalWrite(event->Par1, HIGH);
+        pinMode(event->Par1, INPUT_PULLUP);
+        break;
+      }
+
+    // The update rate from the module is 200ms .. multiple seconds. The soft
+    // serial buffer holds 3 packets, so it is emptied 10 times per second.
     case PLUGIN_TEN_PER_SECOND:
       {
-        if (Plugin_053_init)
+        if (Plugin_053_init && swSerial != NULL && !dutyCycleAsleep(event->TaskIndex))
+          success = Plugin_053_receive(event);
+        break;
+      }
+
+    // Hardware serial, the data is for the sensor and not for the serial command handler.
+    case PLUGIN_SERIAL_IN:
+      {
+        if (Plugin_053_init && swSerial == NULL)
         {
-          // Check if a complete packet is available in the UART FIFO.
-          if (PacketAvailable())
-          {
-            addLog(LOG_LEVEL_DEBUG_MORE, F("PMSx003 : Packet available"));
-            success = Plugin_053_process_data(event);
-          }
+          Plugin_053_receive(event);
+          success = true;
         }
         break;
       }
+
+    case PLUGIN_INTERRUPT_EVENT:
+      {
+        // Idle line, the packet is complete.
+        if (Plugin_053_init && swSerial == NULL && event->Par1 == SERIAL_RX_EVENT_IDLE)
+          Plugin_053_receive(event);
+        success = true;
+        break;
+      }
     case PLUGIN_READ:
       {
+        if (Plugin_053_dutyCycle(event))
+        {
+          success = dutyCycleRead(event, 3);
+          break;
+        }
         // When new data is available, return true
         success = values_received;
         values_received = false;
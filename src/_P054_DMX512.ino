@@ -45,18 +45,40 @@
 // Pin 2: DMX- (cold)
 // Pin 3: DMX+ (hot)
 
-// Note: The ESP serial FIFO has size of 128 byte. Therefore it is rcommented to use DMX buffer sizes below 128
+// Frames are sent from backgroundtasks(), see Plugin_054_process(). The break is
+// made by the UART (TX break on ESP8266, inverted TX line on ESP32) without
+// re-initialising the port, and the 128 byte TX FIFO is refilled as it drains.
+// DMX allows the gaps between the slots this causes. The dmx command writes to
+// Plugin_054_DMXBuffer, which is copied at the start of each frame, so a frame
+// never holds a half applied command.
 
 
 //#include <*.h>   //no lib needed
+#if defined(ESP32)
+  #include <soc/uart_struct.h>
+#endif
 
 
 #define PLUGIN_054
 #define PLUGIN_ID_054         54
 #define PLUGIN_NAME_054       "Communication - DMX512 TX [TESTING]"
 
-byte* Plugin_054_DMXBuffer = 0;
+#define PLUGIN_054_REFRESH_DEFAULT  10   // Frames per second
+#define PLUGIN_054_REFRESH_MAX      44   // 512 channels take 22.7 ms
+#define PLUGIN_054_BREAK_USEC      120   // 88µs ... inf
+#define PLUGIN_054_MAB_USEC         12   // 8µs ... 1s
+#define PLUGIN_054_TX_FIFO         128
+#define PLUGIN_054_SLOT_USEC        44   // 11 bits at 250 kbaud
+
+byte* Plugin_054_DMXBuffer = 0;     // Written by the dmx command
+byte* Plugin_054_DMXFrame = 0;      // Copy which is being sent
 int16_t Plugin_054_DMXSize = 32;
+int16_t Plugin_054_sendPos = -1;    // Next slot to queue, 0 = start code, -1 = between frames
+unsigned long Plugin_054_refreshMsec = 1000 / PLUGIN_054_REFRESH_DEFAULT;
+unsigned long Plugin_054_frameStart = 0;
+unsigned long Plugin_054_drainedAt = 0;
+bool Plugin_054_drained = false;
+unsigned long Plugin_054_frames = 0;
 
 static inline void PLUGIN_054_Limit(int16_t& value, int16_t min, int16_t max)
 {
@@ -87,6 +109,7 @@ boolean Plugin_054(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].TimerOption = false;
         Device[deviceCount].TimerOptional = false;
         Device[deviceCount].GlobalSyncOption = true;
+        // Frames are sent from backgroundtasks(), see Plugin_054_process()
         break;
       }
 
@@ -102,6 +125,10 @@ boolean Plugin_054(byte function, struct EventStruct *event, String& string)
         Settings.TaskDevicePluginConfig[event->TaskIndex][0] = Plugin_054_DMXSize;
         addFormNote(F("Only GPIO-2 (D4) can be used as TX1!"));
         addFormNumericBox(F("Channels"), F("channels"), Plugin_054_DMXSize, 1, 512);
+        int refresh = Settings.TaskDevicePluginConfig[event->TaskIndex][1];
+        if (refresh == 0) refresh = PLUGIN_054_REFRESH_DEFAULT;
+        addFormNumericBox(F("Refresh Rate"), F("refresh"), refresh, 1, PLUGIN_054_REFRESH_MAX);
+        addUnit(F("Hz"));
         success = true;
         break;
       }
@@ -114,6 +141,9 @@ boolean Plugin_054(byte function, struct EventStruct *event, String& string)
         Plugin_054_DMXSize = getFormItemInt(F("channels"));
         PLUGIN_054_Limit (Plugin_054_DMXSize, 1, 512);
         Settings.TaskDevicePluginConfig[event->TaskIndex][0] = Plugin_054_DMXSize;
+        int16_t refresh = getFormItemInt(F("refresh"));
+        PLUGIN_054_Limit (refresh, 1, PLUGIN_054_REFRESH_MAX);
+        Settings.TaskDevicePluginConfig[event->TaskIndex][1] = refresh;
         success = true;
         break;
       }
@@ -123,11 +153,33 @@ boolean Plugin_054(byte function, struct EventStruct *event, String& string)
         Settings.TaskDevicePin1[event->TaskIndex] = 2;   //TX1 fix to GPIO2 (D4) == onboard LED
         Plugin_054_DMXSize = Settings.TaskDevicePluginConfig[event->TaskIndex][0];
 
-        if (Plugin_054_DMXBuffer)
-          delete [] Plugin_054_DMXBuffer;
+        int16_t refresh = Settings.TaskDevicePluginConfig[event->TaskIndex][1];
+        if (refresh == 0) refresh = PLUGIN_054_REFRESH_DEFAULT;
+        PLUGIN_054_Limit (refresh, 1, PLUGIN_054_REFRESH_MAX);
+        Plugin_054_refreshMsec = 1000 / refresh;
+
+        Plugin_054_free();
         Plugin_054_DMXBuffer = new byte[Plugin_054_DMXSize];
+        Plugin_054_DMXFrame = new byte[Plugin_054_DMXSize];
         memset(Plugin_054_DMXBuffer, 0, Plugin_054_DMXSize);
 
+        #if defined(ESP32)
+          Serial1.begin(250000, SERIAL_8N2, -1, Settings.TaskDevicePin1[event->TaskIndex]);
+        #else
+          Serial1.begin(250000, SERIAL_8N2);
+        #endif
+        Plugin_054_sendPos = -1;
+        Plugin_054_drained = false;
+        Plugin_054_frameStart = millis() - Plugin_054_refreshMsec;
+
+        success = true;
+        break;
+      }
+
+    case PLUGIN_EXIT:
+      {
+        Plugin_054_free();
+        Serial1.end();
         success = true;
         break;
       }
@@ -228,33 +280,88 @@ boolean Plugin_054(byte function, struct EventStruct *event, String& string)
         break;
       }
 
-    case PLUGIN_TEN_PER_SECOND:
-      {
-        if (Plugin_054_DMXBuffer)
-        {
-          int16_t sendPin = 2;   //TX1 fix to GPIO2 (D4) == onboard LED
+  }
+  return success;
+}
 
-          //empty serial from prev. transmit
-          Serial1.flush();
+void Plugin_054_free()
+{
+  Plugin_054_sendPos = -1;
+  if (Plugin_054_DMXBuffer)
+    delete [] Plugin_054_DMXBuffer;
+  if (Plugin_054_DMXFrame)
+    delete [] Plugin_054_DMXFrame;
+  Plugin_054_DMXBuffer = 0;
+  Plugin_054_DMXFrame = 0;
+}
 
-          //send break
-          Serial1.end();
-          pinMode(sendPin, OUTPUT);
-          digitalWrite(sendPin, LOW);
-          delayMicroseconds(120);   //88µs ... inf
-          digitalWrite(sendPin, HIGH);
-          delayMicroseconds(12);   //8µs ... 1s
+byte Plugin_054_txFifoCount()
+{
+  #if defined(ESP32)
+    return UART1.status.txfifo_cnt;
+  #else
+    return (USS(1) >> USTXC) & 0xFF;
+  #endif
+}
 
-          //send DMX data
-          Serial1.begin(250000, SERIAL_8N2);
-          Serial1.write(0);   //start byte
-          Serial1.write(Plugin_054_DMXBuffer, Plugin_054_DMXSize);
-        }
-        break;
-      }
+// Hold the TX line low for the break, then high for the mark after break.
+// The FIFO must be empty.
+void Plugin_054_sendBreak()
+{
+  #if defined(ESP32)
+    UART1.conf0.txd_inv = 1;
+    delayMicroseconds(PLUGIN_054_BREAK_USEC);
+    UART1.conf0.txd_inv = 0;
+  #else
+    USC0(1) |= (1 << UCBRK);
+    delayMicroseconds(PLUGIN_054_BREAK_USEC);
+    USC0(1) &= ~(1 << UCBRK);
+  #endif
+  delayMicroseconds(PLUGIN_054_MAB_USEC);
+}
+
+// Called from backgroundtasks(): start a frame at the refresh rate and keep the TX FIFO filled.
+void Plugin_054_process()
+{
+  if (!Plugin_054_DMXFrame)
+    return;
 
+  if (Plugin_054_sendPos < 0)
+  {
+    // The last slot of the previous frame leaves the shift register after the FIFO is empty.
+    if (Plugin_054_txFifoCount() != 0)
+    {
+      Plugin_054_drained = false;
+      return;
+    }
+    if (!Plugin_054_drained)
+    {
+      Plugin_054_drained = true;
+      Plugin_054_drainedAt = micros();
+    }
+    if (usecPassedSince(Plugin_054_drainedAt) < 2 * PLUGIN_054_SLOT_USEC)
+      return;
+    if (timePassedSince(Plugin_054_frameStart) < (long)Plugin_054_refreshMsec)
+      return;
+
+    Plugin_054_frameStart = millis();
+    memcpy(Plugin_054_DMXFrame, Plugin_054_DMXBuffer, Plugin_054_DMXSize);
+    Plugin_054_sendBreak();
+    Plugin_054_sendPos = 0;
+    ++Plugin_054_frames;
+  }
+
+  int16_t space = PLUGIN_054_TX_FIFO - Plugin_054_txFifoCount();
+  while (space-- > 0 && Plugin_054_sendPos <= Plugin_054_DMXSize)
+  {
+    Serial1.write(Plugin_054_sendPos == 0 ? 0 : Plugin_054_DMXFrame[Plugin_054_sendPos - 1]);   //start byte, then the channels
+    ++Plugin_054_sendPos;
+  }
+  if (Plugin_054_sendPos > Plugin_054_DMXSize)
+  {
+    Plugin_054_sendPos = -1;
+    Plugin_054_drained = false;
   }
-  return success;
 }
 
 #endif // USES_P054
@@ -53,27 +53,23 @@
 #define PLUGIN_ID_055         55
 #define PLUGIN_NAME_055       "Notify - Chiming [TESTING]"
 
-#define PLUGIN_055_FIFO_SIZE 64   // must be power of 2
-#define PLUGIN_055_FIFO_MASK (PLUGIN_055_FIFO_SIZE-1)
+// The tokens are compiled into strike and pause steps, which the output sequencer plays.
+#define PLUGIN_055_MAX_STEPS OUTPUT_SEQUENCER_STEPS
 
 class CPlugin_055_Data
 {
 public:
-  long millisStateEnd;
   long millisChimeTime;
   long millisPauseTime;
 
-  int pin[4];
+  int8_t pin[4];
   byte lowActive;
   byte chimeClock;
 
-  char FIFO[PLUGIN_055_FIFO_SIZE];
-  byte FIFO_IndexR;
-  byte FIFO_IndexW;
+  int sequencer;   // Output sequencer slot, -1 when none is free
 
-  void Plugin_055_Data()
+  CPlugin_055_Data()
   {
-    millisStateEnd = 0;
     millisChimeTime = 60;
     millisPauseTime = 400;
 
@@ -82,8 +78,7 @@ public:
     lowActive = false;
     chimeClock = true;
 
-    FIFO_IndexR = 0;
-    FIFO_IndexW = 0;
+    sequencer = -1;
   }
 };
 
@@ -189,17 +184,27 @@ boolean Plugin_055(byte function, struct EventStruct *event, String& string)
         {
           int pin = Settings.TaskDevicePin[i][event->TaskIndex];
           Plugin_055_Data->pin[i] = pin;
-          if (pin >= 0)
-          {
-            pinMode(pin, OUTPUT);
-            digitalWrite(pin, Plugin_055_Data->lowActive);
-          }
           log += pin;
           log += F(" ");
         }
         if (Plugin_055_Data->lowActive)
           log += F("!");
         addLog(LOG_LEVEL_INFO, log);
+        Plugin_055_Data->sequencer = outputSequencerBegin(PLUGIN_ID_055, event->TaskIndex, Plugin_055_Data->pin, 4,
+                                                          Plugin_055_Data->lowActive, false);
+
+        success = true;
+        break;
+      }
+
+    case PLUGIN_EXIT:
+      {
+        if (Plugin_055_Data)
+        {
+          outputSequencerEnd(Plugin_055_Data->sequencer);
+          delete Plugin_055_Data;
+          Plugin_055_Data = NULL;
+        }
 
         success = true;
         break;
@@ -282,171 +287,88 @@ boolean Plugin_055(byte function, struct EventStruct *event, String& string)
           break;
         }
 
-
-    case PLUGIN_FIFTY_PER_SECOND:
-    //case PLUGIN_TEN_PER_SECOND:
-      {
-        if (!Plugin_055_Data)
-          break;
-
-        long millisAct = millis();
-
-        if (Plugin_055_Data->millisStateEnd > 0)   // just striking?
-        {
-          if (timeDiff(millisAct, Plugin_055_Data->millisStateEnd) <= 0)   // end reached?
-          {
-            for (byte i=0; i<4; i++)
-            {
-              if (Plugin_055_Data->pin[i] >= 0)
-                digitalWrite(Plugin_055_Data->pin[i], Plugin_055_Data->lowActive);
-            }
-            Plugin_055_Data->millisStateEnd = 0;
-          }
-        }
-
-        if (Plugin_055_Data->millisStateEnd == 0)   // just finished?
-        {
-          if (! Plugin_055_IsEmptyFIFO())
-          {
-            char c = Plugin_055_ReadFIFO();
-
-            String log = F("Chime: Process '");
-            log += c;
-            log += "'";
-            addLog(LOG_LEVEL_DEBUG, log);
-
-            switch (c)
-            {
-              case 'a':
-              case 'b':
-              case 'c':
-              case 'd':
-              case 'e':
-              case 'f':
-              case 'A':
-              case 'B':
-              case 'C':
-              case 'D':
-              case 'E':
-              case 'F':
-                c -= 'A' - '0' - 10;
-                //vvv
-
-              case '0':   //strikes 1=1st bell, 2=2nd bell, 4=3rd bell, 8=4rd bell
-              case '1':
-              case '2':
-              case '3':
-              case '4':
-              case '5':
-              case '6':
-              case '7':
-              case '8':
-              case '9':
-              {
-                byte mask = 1;
-                for (byte i=0; i<4; i++)
-                {
-                  if (Plugin_055_Data->pin[i] >= 0)
-                    if (c & mask)
-                      digitalWrite(Plugin_055_Data->pin[i], !Plugin_055_Data->lowActive);
-                  mask <<= 1;
-                }
-                Plugin_055_Data->millisStateEnd = millisAct + Plugin_055_Data->millisChimeTime;
-                break;
-              }
-              case '=':   //long pause
-              case ' ':
-              case ',':
-                Plugin_055_Data->millisStateEnd = millisAct + Plugin_055_Data->millisPauseTime*3;
-                break;
-              case '-':   //single pause
-                Plugin_055_Data->millisStateEnd = millisAct + Plugin_055_Data->millisPauseTime;
-                break;
-              case '.':   //short pause
-                Plugin_055_Data->millisStateEnd = millisAct + Plugin_055_Data->millisPauseTime/3;
-                break;
-              case '|':   //shortest pause
-                Plugin_055_Data->millisStateEnd = millisAct + Plugin_055_Data->millisChimeTime/2;
-                break;
-              case '#':   //comment -> eat till FIFO is empty
-                while (Plugin_055_ReadFIFO());
-                break;
-              default:   //unknown char -> do nothing
-                break;
-            }
-          }
-
-        }
-        success = true;
-        break;
-      }
-
   }
   return success;
 }
 
-// FIFO functions
-
-void Plugin_055_WriteFIFO(char c)
-{
-  if (Plugin_055_Data->FIFO_IndexR == ((Plugin_055_Data->FIFO_IndexW+1) & PLUGIN_055_FIFO_MASK))   // FIFO full?
-    return;
-
-  Plugin_055_Data->FIFO[Plugin_055_Data->FIFO_IndexW] = c;
-  Plugin_055_Data->FIFO_IndexW++;
-  Plugin_055_Data->FIFO_IndexW &= PLUGIN_055_FIFO_MASK;
-}
-
-char Plugin_055_ReadFIFO()
-{
-  if (Plugin_055_IsEmptyFIFO())
-    return '\0';
-
-  char c = Plugin_055_Data->FIFO[Plugin_055_Data->FIFO_IndexR];
-  Plugin_055_Data->FIFO_IndexR++;
-  Plugin_055_Data->FIFO_IndexR &= PLUGIN_055_FIFO_MASK;
-
-  return c;
-}
-
-char Plugin_055_PeekFIFO()
-{
-  if (Plugin_055_IsEmptyFIFO())
-    return '\0';
-
-  return Plugin_055_Data->FIFO[Plugin_055_Data->FIFO_IndexR];
-}
-
-boolean Plugin_055_IsEmptyFIFO()
-{
-  return (Plugin_055_Data->FIFO_IndexR == Plugin_055_Data->FIFO_IndexW);
-}
+// Token functions
 
+// Compile tokens into strikes and pauses and queue them at the sequencer.
 void Plugin_055_AddStringFIFO(const String& param)
 {
-  if (param.length() == 0)
+  if (param.length() == 0 || Plugin_055_Data->sequencer < 0)
     return;
 
-  byte i = 0;
-  char c = param[i];
+  uint32_t steps[PLUGIN_055_MAX_STEPS];
+  byte count = 0;
   char c_last = '\0';
 
-  while (c != 0)
+  for (unsigned int i = 0; i < param.length() && count < PLUGIN_055_MAX_STEPS - 2; i++)
   {
+    char c = param[i];
+    if (c == '#')   //comment -> ignore the rest
+      break;
     if (isDigit(c) && isDigit(c_last))   // "11" is shortcut for "1-1" -> add pause
-      Plugin_055_WriteFIFO('-');
+      steps[count++] = Plugin_055_Step('-');
     if (c == '!')   //double strike -> add shortest pause and repeat last strike
     {
-      Plugin_055_WriteFIFO('|');
+      steps[count++] = Plugin_055_Step('|');
       c = c_last;
     }
-    Plugin_055_WriteFIFO(c);
+    const uint32_t step = Plugin_055_Step(c);
+    if (step != 0)
+      steps[count++] = step;
     c_last = c;
-
-    c = param[++i];
   }
+  steps[count++] = Plugin_055_Step('=');
+
+  if (!outputSequencerQueue(Plugin_055_Data->sequencer, steps, count))
+    addLog(LOG_LEVEL_ERROR, F("Chime: Queue full, tokens dropped"));
+}
 
-  Plugin_055_WriteFIFO('=');
+// Sequencer step of a token, 0 for unknown tokens.
+uint32_t Plugin_055_Step(char c)
+{
+  switch (c)
+  {
+    case 'a':
+    case 'b':
+    case 'c':
+    case 'd':
+    case 'e':
+    case 'f':
+    case 'A':
+    case 'B':
+    case 'C':
+    case 'D':
+    case 'E':
+    case 'F':
+      c -= 'A' - '0' - 10;
+      //vvv
+
+    case '0':   //strikes 1=1st bell, 2=2nd bell, 4=3rd bell, 8=4rd bell
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+      return OUTPUT_SEQUENCER_STEP(c & 0x0F, Plugin_055_Data->millisChimeTime);
+    case '=':   //long pause
+    case ' ':
+    case ',':
+      return OUTPUT_SEQUENCER_STEP(0, Plugin_055_Data->millisPauseTime*3);
+    case '-':   //single pause
+      return OUTPUT_SEQUENCER_STEP(0, Plugin_055_Data->millisPauseTime);
+    case '.':   //short pause
+      return OUTPUT_SEQUENCER_STEP(0, Plugin_055_Data->millisPauseTime/3);
+    case '|':   //shortest pause
+      return OUTPUT_SEQUENCER_STEP(0, Plugin_055_Data->millisChimeTime/2);
+  }
+  return 0;   //unknown char -> do nothing
 }
 
 //File I/O functions
@@ -461,6 +383,7 @@ void Plugin_055_WriteChime(const String& name, const String& tokens)
   log += fileName;
   log += F(" ");
 
+  clearFileETagCache();
   fs::File f = SPIFFS.open(fileName, "w");
   if (f)
   {
@@ -8,6 +8,9 @@
 
   This plugin reads the particle concentration from SDS011 Sensor
   DevicePin1 - RX on ESP, TX on SDS
+
+  With the TX pin connected the sensor can sleep between the reads (SensorDutyCycle.ino), it is
+  woken the warm-up time before the read and the frames of a short burst are averaged.
 */
 #ifdef ESP8266  // Needed for precompile issues.
 
@@ -44,6 +47,7 @@ boolean Plugin_056(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].TimerOptional = false;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_FIFTY_PER_SECOND;
         break;
       }
 
@@ -67,6 +71,7 @@ boolean Plugin_056(byte function, struct EventStruct *event, String& string)
                             0, 30);
           addUnit(F("Minutes"));
           addFormNote(F("0 = continous, 1..30 = Work 30 seconds and sleep n*60-30 seconds"));
+          dutyCycleWebformLoad(event, 1);
         }
         break;
       }
@@ -74,9 +79,12 @@ boolean Plugin_056(byte function, struct EventStruct *event, String& string)
         {
           if (Plugin_056_hasTxPin(event)) {
             // Communications to device should work.
-            const int newsleeptime = getFormItemInt(F("plugin_056_sleeptime"));
+            dutyCycleWebformSave(event, 1);
+            int newsleeptime = getFormItemInt(F("plugin_056_sleeptime"));
+            if (Plugin_056_dutyCycle(event))
+              newsleeptime = 0;  // Woken and put to sleep by the plugin, the sensor itself runs continuously
             if (Settings.TaskDevicePluginConfig[event->TaskIndex][0] != newsleeptime) {
-              Settings.TaskDevicePluginConfig[event->TaskIndex][0] = getFormItemInt(F("plugin_056_sleeptime"));
+              Settings.TaskDevicePluginConfig[event->TaskIndex][0] = newsleeptime;
               Plugin_056_setWorkingPeriod(newsleeptime);
             }
           }
@@ -103,6 +111,12 @@ boolean Plugin_056(byte function, struct EventStruct *event, String& string)
         log += serial_tx;
         addLog(LOG_LEVEL_INFO, log);
 
+        if (Plugin_056_dutyCycle(event)) {
+          Plugin_056_SDS->SetSleepMode(false);
+          dutyCycleBegin(event, PLUGIN_ID_056, Settings.TaskDevicePluginConfig[event->TaskIndex][1] * 1000);
+        } else {
+          dutyCycleEnd(event->TaskIndex);
+        }
         success = true;
         break;
       }
@@ -122,6 +136,9 @@ boolean Plugin_056(byte function, struct EventStruct *event, String& string)
       {
         if (!Plugin_056_SDS)
           break;
+        success = true;
+        if (dutyCycleAsleep(event->TaskIndex))
+          break;
 
         Plugin_056_SDS->Process();
 
@@ -135,7 +152,13 @@ boolean Plugin_056(byte function, struct EventStruct *event, String& string)
           log += pm10;
           addLog(LOG_LEVEL_DEBUG, log);
 
-          if (Settings.TaskDeviceTimer[event->TaskIndex] == 0)
+          if (Plugin_056_dutyCycle(event))
+          {
+            const float values[2] = { pm2_5, pm10 };
+            if (dutyCycleSample(event, values, 2))
+              Plugin_056_SDS->SetSleepMode(true);
+          }
+          else if (Settings.TaskDeviceTimer[event->TaskIndex] == 0)
           {
             UserVar[event->BaseVarIndex + 0] = pm2_5;
             UserVar[event->BaseVarIndex + 1] = pm10;
@@ -143,8 +166,13 @@ boolean Plugin_056(byte function, struct EventStruct *event, String& string)
             sendData(event);
           }
         }
+        break;
+      }
 
-        success = true;
+    case PLUGIN_TIMER_IN:
+      {
+        if (Plugin_056_SDS && dutyCycleWakeTimer(event))
+          Plugin_056_SDS->SetSleepMode(false);
         break;
       }
 
@@ -153,6 +181,11 @@ boolean Plugin_056(byte function, struct EventStruct *event, String& string)
         if (!Plugin_056_SDS)
           break;
 
+        if (Plugin_056_dutyCycle(event)) {
+          success = dutyCycleRead(event, 2);
+          break;
+        }
+
         float pm25, pm10;
         if (Plugin_056_SDS->ReadAverage(pm25, pm10)) {
           UserVar[event->BaseVarIndex + 0] = pm25;
@@ -171,6 +204,10 @@ boolean Plugin_056_hasTxPin(struct EventStruct *event) {
   return serial_tx >= 0;
 }
 
+boolean Plugin_056_dutyCycle(struct EventStruct *event) {
+  return Plugin_056_hasTxPin(event) && Settings.TaskDevicePluginConfig[event->TaskIndex][1] > 0;
+}
+
 String Plugin_056_ErrorToString(int error) {
   String log;
   if (error < 0) {
@@ -62,6 +62,7 @@ boolean Plugin_058(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].TimerOptional = true;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND;
         break;
       }
 
@@ -82,7 +83,7 @@ boolean Plugin_058(byte function, struct EventStruct *event, String& string)
         byte addr = CONFIG(0);
 
         int optionValues[8] = { 0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77 };
-        addFormSelectorI2C(F("i2c_addr"), 8, optionValues, addr);
+        addFormSelectorI2C(getWebString(WEB_STR_I2C_ADDR), 8, optionValues, addr);
 
         success = true;
         break;
@@ -90,7 +91,7 @@ boolean Plugin_058(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_WEBFORM_SAVE:
       {
-        CONFIG(0) = getFormItemInt(F("i2c_addr"));
+        CONFIG(0) = getFormItemInt(getWebString(WEB_STR_I2C_ADDR));
 
         success = true;
         break;
@@ -1,4 +1,4 @@
-#ifdef USES_P059
+#ifdef USES_P059
 //#######################################################################################################
 //#################################### Plugin 059: Rotary Encoder #######################################
 //#######################################################################################################
@@ -13,16 +13,52 @@
 
 // Note: Up to 4 encoders can be used simultaneously
 
+// The interrupt pushes one event for the first count after the last read, the
+// dispatch reads the latest position, so a fast turn gives one update per loop
+// run. The values are the counter, the velocity (counts/sec) and the acceleration
+// (counts/sec^2), which drop to 0 when no count was seen for P059_IDLE_MSEC.
+// A send needs a change of at least "Min. change" counts since the last send,
+// and is held back until "Min. send interval" msec after the last send; the
+// position when the encoder stops is always sent.
 
 
 #define PLUGIN_059
 #define PLUGIN_ID_059         59
 #define PLUGIN_NAME_059       "Switch Input - Rotary Encoder"
 #define PLUGIN_VALUENAME1_059 "Counter"
+#define PLUGIN_VALUENAME2_059 "Velocity"
+#define PLUGIN_VALUENAME3_059 "Acceleration"
+
+#define P059_IDLE_MSEC          250   // No count since, the encoder stopped
 
 #include <QEIx4.h>
 
-QEIx4* Plugin_059_QE = NULL;
+struct P059_data_struct : public PluginTaskData_base
+{
+  P059_data_struct() : QE(NULL), lastPos(0), lastMicros(0), velocity(0), acceleration(0),
+    sentPos(0), lastSend(0), pending(false), moving(false) {}
+
+  ~P059_data_struct() {
+    delete QE;
+  }
+
+  QEIx4* QE;
+  long lastPos;
+  unsigned long lastMicros;   // Of the last count
+  float velocity;
+  float acceleration;
+  long sentPos;
+  unsigned long lastSend;     // millis()
+  bool pending;               // Changed since the last send
+  bool moving;
+};
+
+struct P059_data_struct* Plugin_059_data(byte TaskIndex)
+{
+  return static_cast<P059_data_struct*>(getPluginTaskData(TaskIndex));
+}
+
+void Plugin_059_changed(void* arg) ICACHE_RAM_ATTR;
 
 #ifndef CONFIG
 #define CONFIG(n) (Settings.TaskDevicePluginConfig[event->TaskIndex][n])
@@ -34,6 +70,48 @@ QEIx4* Plugin_059_QE = NULL;
 #define PIN(n) (Settings.TaskDevicePin[n][event->TaskIndex])
 #endif
 
+// Velocity and acceleration from the counts since the last update.
+void Plugin_059_update(struct P059_data_struct* data, long pos, bool stopped)
+{
+  const unsigned long now = micros();
+  unsigned long usec = now - data->lastMicros;
+  if (usec < 1000) usec = 1000;
+  // Starting from rest, not from the time of the last count
+  if (!data->moving && usec > P059_IDLE_MSEC * 1000UL) usec = P059_IDLE_MSEC * 1000UL;
+  const float dt = usec / 1000000.0;
+  const float velocity = stopped ? 0.0 : (pos - data->lastPos) / dt;
+  data->acceleration = (velocity - data->velocity) / dt;
+  data->velocity = velocity;
+  data->lastPos = pos;
+  data->lastMicros = now;
+  data->moving = !stopped;
+  data->pending = true;
+}
+
+// Send when the change and the interval since the last send allow it.
+void Plugin_059_send(struct EventStruct *event, struct P059_data_struct* data)
+{
+  if (!data->pending) return;
+  if (data->moving && CONFIG_L(2) > 1 && labs(data->lastPos - data->sentPos) < CONFIG_L(2)) return;
+  if (CONFIG_L(3) > 0 && data->lastSend != 0 && timePassedSince(data->lastSend) < CONFIG_L(3)) return;
+  data->pending = false;
+  data->sentPos = data->lastPos;
+  data->lastSend = millis();
+  if (data->lastSend == 0) data->lastSend = 1;
+  UserVar[event->BaseVarIndex] = (float)data->lastPos;
+  UserVar[event->BaseVarIndex + 1] = data->velocity;
+  UserVar[event->BaseVarIndex + 2] = data->acceleration;
+  event->sensorType = SENSOR_TYPE_SWITCH;
+
+  if (loglevelActiveFor(LOG_LEVEL_INFO)) {
+    String log = F("QEI  : ");
+    log += data->lastPos;
+    addLog(LOG_LEVEL_INFO, log);
+  }
+
+  sendData(event);
+}
+
 
 boolean Plugin_059(byte function, struct EventStruct *event, String& string)
 {
@@ -50,11 +128,12 @@ boolean Plugin_059(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].PullUpOption = false;
         Device[deviceCount].InverseLogicOption = false;
         Device[deviceCount].FormulaOption = false;
-        Device[deviceCount].ValueCount = 1;
+        Device[deviceCount].ValueCount = 3;
         Device[deviceCount].SendDataOption = true;
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].TimerOptional = true;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND;
         break;
       }
 
@@ -67,6 +146,8 @@ boolean Plugin_059(byte function, struct EventStruct *event, String& string)
     case PLUGIN_GET_DEVICEVALUENAMES:
       {
         strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_059));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], PSTR(PLUGIN_VALUENAME2_059));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[2], PSTR(PLUGIN_VALUENAME3_059));
         break;
       }
 
@@ -90,6 +171,10 @@ boolean Plugin_059(byte function, struct EventStruct *event, String& string)
 
         addFormNumericBox(F("Limit min."), F("qei_limitmin"), CONFIG_L(0));
         addFormNumericBox(F("Limit max."), F("qei_limitmax"), CONFIG_L(1));
+        addFormNumericBox(F("Min. change"), F("qei_mindelta"), CONFIG_L(2), 0, 1000000);
+        addFormNote(F("Counts since the last send, 0 = every count"));
+        addFormNumericBox(F("Min. send interval"), F("qei_mininterval"), CONFIG_L(3), 0, 60000);
+        addFormNote(F("msec, 0 = no limit"));
 
         success = true;
         break;
@@ -101,6 +186,8 @@ boolean Plugin_059(byte function, struct EventStruct *event, String& string)
 
         CONFIG_L(0) = getFormItemInt(F("qei_limitmin"));
         CONFIG_L(1) = getFormItemInt(F("qei_limitmax"));
+        CONFIG_L(2) = getFormItemInt(F("qei_mindelta"));
+        CONFIG_L(3) = getFormItemInt(F("qei_mininterval"));
 
         success = true;
         break;
@@ -108,12 +195,18 @@ boolean Plugin_059(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_INIT:
       {
-        if (!Plugin_059_QE)
-          Plugin_059_QE = new QEIx4;
-
-        Plugin_059_QE->begin(PIN(0),PIN(1),PIN(2),CONFIG(0));
-        Plugin_059_QE->setLimit(CONFIG_L(0), CONFIG_L(1));
-        Plugin_059_QE->setIndexTrigger(true);
+        // The old encoder first, to free its slot of the 4 in the library
+        clearPluginTaskData(event->TaskIndex);
+        P059_data_struct* data = new P059_data_struct();
+        data->QE = new QEIx4;
+        initPluginTaskData(event->TaskIndex, data, sizeof(P059_data_struct) + sizeof(QEIx4));
+
+        data->QE->begin(PIN(0),PIN(1),PIN(2),CONFIG(0));
+        data->QE->setLimit(CONFIG_L(0), CONFIG_L(1));
+        data->QE->setIndexTrigger(true);
+        data->QE->setChangeCallback(Plugin_059_changed, (void*)(intptr_t)event->TaskIndex);
+        data->lastPos = data->sentPos = data->QE->read();
+        data->lastMicros = micros();
 
         ExtraTaskSettings.TaskDeviceValueDecimals[event->BaseVarIndex] = 0;
 
@@ -135,23 +228,20 @@ boolean Plugin_059(byte function, struct EventStruct *event, String& string)
         break;
       }
 
+    // Right after the first count since the last read, the 10 per second
+    // poll remains for events dropped when the queue was full, the stop of
+    // the encoder and the sends held back by the limits.
+    case PLUGIN_INTERRUPT_EVENT:
     case PLUGIN_TEN_PER_SECOND:
       {
-        if (Plugin_059_QE)
+        P059_data_struct* data = Plugin_059_data(event->TaskIndex);
+        if (data != NULL && data->QE != NULL)
         {
-          if (Plugin_059_QE->hasChanged())
-          {
-            long c = Plugin_059_QE->read();
-            UserVar[event->BaseVarIndex] = (float)c;
-            event->sensorType = SENSOR_TYPE_SWITCH;
-
-            String log = F("QEI  : ");
-            log += c;
-            addLog(LOG_LEVEL_INFO, log);
-
-            sendData(event);
-          }
-
+          if (data->QE->hasChanged())
+            Plugin_059_update(data, data->QE->read(), false);
+          else if (data->moving && (micros() - data->lastMicros) > P059_IDLE_MSEC * 1000UL)
+            Plugin_059_update(data, data->lastPos, true);
+          Plugin_059_send(event, data);
         }
         success = true;
         break;
@@ -159,9 +249,12 @@ boolean Plugin_059(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_READ:
       {
-        if (Plugin_059_QE)
+        P059_data_struct* data = Plugin_059_data(event->TaskIndex);
+        if (data != NULL && data->QE != NULL)
         {
-          UserVar[event->BaseVarIndex] = (float)Plugin_059_QE->read();
+          UserVar[event->BaseVarIndex] = (float)data->QE->read();
+          UserVar[event->BaseVarIndex + 1] = data->velocity;
+          UserVar[event->BaseVarIndex + 2] = data->acceleration;
         }
         success = true;
         break;
@@ -169,7 +262,8 @@ boolean Plugin_059(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_WRITE:
       {
-        if (Plugin_059_QE)
+        P059_data_struct* data = Plugin_059_data(event->TaskIndex);
+        if (data != NULL && data->QE != NULL)
         {
             String log = "";
             String command = parseString(string, 1);
@@ -179,7 +273,7 @@ boolean Plugin_059(byte function, struct EventStruct *event, String& string)
               {
                 log = String(F("QEI  : ")) + string;
                 addLog(LOG_LEVEL_INFO, log);
-                Plugin_059_QE->write(event->Par1);
+                data->QE->write(event->Par1);
               }
               success = true; // Command is handled.
             }
@@ -189,4 +283,10 @@ boolean Plugin_059(byte function, struct EventStruct *event, String& string)
   }
   return success;
 }
+
+// Called from the encoder interrupt.
+void Plugin_059_changed(void* arg)
+{
+  pushInterruptEvent((intptr_t)arg, 0, 0);
+}
 #endif // USES_P059
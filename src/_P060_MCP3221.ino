@@ -53,6 +53,7 @@ boolean Plugin_060(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].SendDataOption = true;
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND;
         break;
       }
 
@@ -73,7 +74,7 @@ boolean Plugin_060(byte function, struct EventStruct *event, String& string)
         byte addr = CONFIG(0);
 
         int optionValues[8] = { 0x4D, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4E, 0x4F };
-        addFormSelectorI2C(F("i2c_addr"), 8, optionValues, addr);
+        addFormSelectorI2C(getWebString(WEB_STR_I2C_ADDR), 8, optionValues, addr);
 
         addFormCheckBox(F("Oversampling"), F("plugin_060_oversampling"), CONFIG(1));
 
@@ -95,7 +96,7 @@ boolean Plugin_060(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_WEBFORM_SAVE:
       {
-        CONFIG(0) = getFormItemInt(F("i2c_addr"));
+        CONFIG(0) = getFormItemInt(getWebString(WEB_STR_I2C_ADDR));
 
         CONFIG(1) = isFormItemChecked(F("plugin_060_oversampling"));
 
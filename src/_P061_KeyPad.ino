@@ -85,6 +85,7 @@ boolean Plugin_061(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].TimerOptional = true;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_FIFTY_PER_SECOND;
         break;
       }
 
@@ -105,7 +106,7 @@ boolean Plugin_061(byte function, struct EventStruct *event, String& string)
         byte addr = CONFIG(0);
 
         int optionValues[16] = { 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F };
-        addFormSelectorI2C(F("i2c_addr"), (CONFIG(1) == 0) ? 8 : 16, optionValues, addr);
+        addFormSelectorI2C(getWebString(WEB_STR_I2C_ADDR), (CONFIG(1) == 0) ? 8 : 16, optionValues, addr);
         if (CONFIG(1) != 0)
           addFormNote(F("PCF8574 uses address 0x20+; PCF8574<b>A</b> uses address 0x38+"));
 
@@ -118,7 +119,7 @@ boolean Plugin_061(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_WEBFORM_SAVE:
       {
-        CONFIG(0) = getFormItemInt(F("i2c_addr"));
+        CONFIG(0) = getFormItemInt(getWebString(WEB_STR_I2C_ADDR));
 
         CONFIG(1) = getFormItemInt(F("chip"));
 
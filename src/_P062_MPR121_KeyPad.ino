@@ -50,6 +50,7 @@ boolean Plugin_062(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].TimerOptional = true;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND;
         break;
       }
 
@@ -70,7 +71,7 @@ boolean Plugin_062(byte function, struct EventStruct *event, String& string)
         byte addr = CONFIG(0);
 
         int optionValues[4] = { 0x5A, 0x5B, 0x5C, 0x5D };
-        addFormSelectorI2C(F("i2c_addr"), 4, optionValues, addr);
+        addFormSelectorI2C(getWebString(WEB_STR_I2C_ADDR), 4, optionValues, addr);
 
         addFormCheckBox(F("ScanCode"), F("scancode"), CONFIG(1));
 
@@ -80,7 +81,7 @@ boolean Plugin_062(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_WEBFORM_SAVE:
       {
-        CONFIG(0) = getFormItemInt(F("i2c_addr"));
+        CONFIG(0) = getFormItemInt(getWebString(WEB_STR_I2C_ADDR));
 
         CONFIG(1) = isFormItemChecked(F("scancode"));
 
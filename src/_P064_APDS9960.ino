@@ -57,6 +57,7 @@ boolean Plugin_064(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].TimerOptional = true;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_FIFTY_PER_SECOND;
         break;
       }
 
@@ -84,7 +85,7 @@ boolean Plugin_064(byte function, struct EventStruct *event, String& string)
         byte addr = 0x39;   // CONFIG(0); chip has only 1 address
 
         int optionValues[1] = { 0x39 };
-        addFormSelectorI2C(F("i2c_addr"), 1, optionValues, addr);  //Only for display I2C address
+        addFormSelectorI2C(getWebString(WEB_STR_I2C_ADDR), 1, optionValues, addr);  //Only for display I2C address
 
         success = true;
         break;
@@ -92,7 +93,7 @@ boolean Plugin_064(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_WEBFORM_SAVE:
       {
-        //CONFIG(0) = getFormItemInt(F("i2c_addr"));
+        //CONFIG(0) = getFormItemInt(getWebString(WEB_STR_I2C_ADDR));
 
         success = true;
         break;
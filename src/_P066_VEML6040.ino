@@ -70,7 +70,7 @@ boolean Plugin_066(byte function, struct EventStruct *event, String& string)
     case PLUGIN_WEBFORM_LOAD:
       {
         int optionValues[1] = { VEML6040_ADDR };
-        addFormSelectorI2C(F("i2c_addr"), 1, optionValues, VEML6040_ADDR);   //Only for display I2C address
+        addFormSelectorI2C(getWebString(WEB_STR_I2C_ADDR), 1, optionValues, VEML6040_ADDR);   //Only for display I2C address
 
         String optionsMode[6] = { F("40ms (16496)"), F("80ms (8248)"), F("160ms (4124)"), F("320ms (2062)"), F("640ms (1031)"), F("1280ms (515)") };
         addFormSelector(F("Integration Time (Max Lux)"), F("itime"), 6, optionsMode, NULL, CONFIG(1));
@@ -90,7 +90,7 @@ boolean Plugin_066(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_WEBFORM_SAVE:
       {
-        //CONFIG(0) = getFormItemInt(F("i2c_addr"));
+        //CONFIG(0) = getFormItemInt(getWebString(WEB_STR_I2C_ADDR));
         CONFIG(1) = getFormItemInt(F("itime"));
         CONFIG(2) = getFormItemInt(F("map"));
 
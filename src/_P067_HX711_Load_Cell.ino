@@ -46,34 +46,55 @@ boolean isReadyHX711(int16_t pinSCL, int16_t pinDOUT)
   return (!digitalRead(pinDOUT));
 }
 
-int32_t readHX711(int16_t pinSCL, int16_t pinDOUT, uint8_t mode)
+// Returns false when DOUT is not released after the gain pulses, the bits were then not clocked in sync.
+boolean readHX711(int16_t pinSCL, int16_t pinDOUT, uint8_t mode, int32_t& value)
 {
-  int32_t value = 0;
-  int32_t mask = 0x00800000;
+  value = bitBangShiftIn(pinDOUT, pinSCL, 24);
+  bitBangPulses(pinSCL, mode + 1);
 
-  for (byte i = 0; i < 24; i++)
+  if (!digitalRead(pinDOUT))
   {
-    digitalWrite(pinSCL, HIGH);
-    delayMicroseconds(1);
-    digitalWrite(pinSCL, LOW);
-    if (digitalRead(pinDOUT))
-      value |= mask;
-    delayMicroseconds(1);
-    mask >>= 1;
-  }
-
-  for (byte i = 0; i < (mode+1); i++)
-  {
-    digitalWrite(pinSCL, HIGH);
-    delayMicroseconds(1);
-    digitalWrite(pinSCL, LOW);
-    delayMicroseconds(1);
+    bitBangError();
+    return false;
   }
 
   if (value & 0x00800000)   //negative?
     value |= 0xFF000000;  //expand sign bit to 32 bit
 
-  return value;
+  return true;
+}
+
+void Plugin_067_sample(struct EventStruct *event)
+{
+  int16_t pinSCL = PIN(0);
+  int16_t pinDOUT = PIN(1);
+  int32_t value;
+
+  if (Plugin_067_OversamplingCount < 250)
+  if (pinSCL >= 0 && pinDOUT >= 0)
+  if (isReadyHX711(pinSCL, pinDOUT))
+  if (readHX711(pinSCL, pinDOUT, CONFIG(1), value))
+  {
+    if (CONFIG(0))   //Oversampling?
+    {
+      Plugin_067_OversamplingValue += value;
+      Plugin_067_OversamplingCount ++;
+    }
+    else   //use last value
+    {
+      Plugin_067_OversamplingValue = value;
+      Plugin_067_OversamplingCount = 1;
+    }
+  }
+}
+
+// Wait for the next conversion. DOUT may have dropped before the interrupt was
+// armed again (e.g. a dropped event), then there is no edge and it is read now.
+void Plugin_067_armReady(struct EventStruct *event)
+{
+  bitBangReadyArm(event->TaskIndex);
+  if (isReadyHX711(PIN(0), PIN(1)))
+    Plugin_067_sample(event);
 }
 
 
@@ -97,6 +118,7 @@ boolean Plugin_067(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].TimerOptional = false;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_FIFTY_PER_SECOND;
         break;
       }
 
@@ -191,34 +213,38 @@ boolean Plugin_067(byte function, struct EventStruct *event, String& string)
         if (pinSCL >= 0 && pinDOUT >= 0)
         {
           initHX711(pinSCL, pinDOUT);
+          // Falls back to polling when there is no free data ready interrupt
+          if (bitBangReadyBegin(event->TaskIndex, pinDOUT))
+            Plugin_067_armReady(event);
         }
 
         success = true;
         break;
       }
 
-    case PLUGIN_FIFTY_PER_SECOND:
+    case PLUGIN_EXIT:
       {
-        int16_t pinSCL = PIN(0);
-        int16_t pinDOUT = PIN(1);
+        bitBangReadyEnd(event->TaskIndex);
+        success = true;
+        break;
+      }
 
-        if (Plugin_067_OversamplingCount < 250)
-        if (pinSCL >= 0 && pinDOUT >= 0)
-        if (isReadyHX711(pinSCL, pinDOUT))
+    // Sent on the falling edge of DOUT, when the conversion is ready.
+    case PLUGIN_INTERRUPT_EVENT:
+      {
+        if (event->Par1 == BITBANG_EVENT_READY)
         {
-          int32_t value = readHX711(pinSCL, pinDOUT, CONFIG(1));
-
-          if (CONFIG(0))   //Oversampling?
-          {
-            Plugin_067_OversamplingValue += value;
-            Plugin_067_OversamplingCount ++;
-          }
-          else   //use last value
-          {
-            Plugin_067_OversamplingValue = value;
-            Plugin_067_OversamplingCount = 1;
-          }
+          Plugin_067_sample(event);
+          Plugin_067_armReady(event);
+          success = true;
         }
+        break;
+      }
+
+    case PLUGIN_FIFTY_PER_SECOND:
+      {
+        if (!bitBangReadyUsed(event->TaskIndex))
+          Plugin_067_sample(event);
 
         success = true;
         break;
@@ -228,6 +254,9 @@ boolean Plugin_067(byte function, struct EventStruct *event, String& string)
       {
         String log = F("HX711: Value: ");
 
+        if (bitBangReadyUsed(event->TaskIndex))
+          Plugin_067_armReady(event);
+
         if (Plugin_067_OversamplingCount > 0)
         {
           UserVar[event->BaseVarIndex + 1] = (float)Plugin_067_OversamplingValue / Plugin_067_OversamplingCount;
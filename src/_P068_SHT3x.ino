@@ -14,8 +14,8 @@
 #define PLUGIN_068
 #define PLUGIN_ID_068         68
 #define PLUGIN_NAME_068       "Environment - SHT30/31/35 [TESTING]"
-#define PLUGIN_VALUENAME1_068 "Temperature"
-#define PLUGIN_VALUENAME2_068 "Humidity"
+#define PLUGIN_VALUENAME1_068 WEB_STR_TEMPERATURE
+#define PLUGIN_VALUENAME2_068 WEB_STR_HUMIDITY
 
 //==============================================
 // SHT3X LIBRARY - SHT3X.h
@@ -124,15 +124,15 @@ boolean Plugin_068(byte function, struct EventStruct *event, String& string)
 
 		case PLUGIN_GET_DEVICEVALUENAMES:
 		{
-			strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_068));
-			strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], PSTR(PLUGIN_VALUENAME2_068));
+			strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], getWebStringP(PLUGIN_VALUENAME1_068));
+			strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], getWebStringP(PLUGIN_VALUENAME2_068));
 			break;
 		}
 
 		case PLUGIN_WEBFORM_LOAD:
 		{
 			int optionValues[2] = { 0x44, 0x45 };
-			addFormSelectorI2C(F("i2c_addr"), 2, optionValues, CONFIG(0));
+			addFormSelectorI2C(getWebString(WEB_STR_I2C_ADDR), 2, optionValues, CONFIG(0));
 
 			success = true;
 			break;
@@ -140,7 +140,7 @@ boolean Plugin_068(byte function, struct EventStruct *event, String& string)
 
 		case PLUGIN_WEBFORM_SAVE:
 		{
-			CONFIG(0) = getFormItemInt(F("i2c_addr"));
+			CONFIG(0) = getFormItemInt(getWebString(WEB_STR_I2C_ADDR));
 
 			success = true;
 			break;
@@ -14,7 +14,7 @@
 #define PLUGIN_069
 #define PLUGIN_ID_069         69
 #define PLUGIN_NAME_069       "Environment - LM75A"
-#define PLUGIN_VALUENAME1_069 "Temperature"
+#define PLUGIN_VALUENAME1_069 WEB_STR_TEMPERATURE
 
 
 #ifndef LM75A_h
@@ -143,14 +143,14 @@ boolean Plugin_069(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_GET_DEVICEVALUENAMES:
     {
-      strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_069));
+      strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], getWebStringP(PLUGIN_VALUENAME1_069));
       break;
     }
 
     case PLUGIN_WEBFORM_LOAD:
     {
       int optionValues[8] = { 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F };
-      addFormSelectorI2C(F("i2c_addr"), 8, optionValues, CONFIG(0));
+      addFormSelectorI2C(getWebString(WEB_STR_I2C_ADDR), 8, optionValues, CONFIG(0));
 
       success = true;
       break;
@@ -158,7 +158,7 @@ boolean Plugin_069(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_WEBFORM_SAVE:
     {
-      CONFIG(0) = getFormItemInt(F("i2c_addr"));
+      CONFIG(0) = getFormItemInt(getWebString(WEB_STR_I2C_ADDR));
 
       success = true;
       break;
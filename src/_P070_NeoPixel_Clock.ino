@@ -56,6 +56,7 @@ boolean Plugin_070(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].SendDataOption = false;
         Device[deviceCount].TimerOption = false;
         Device[deviceCount].GlobalSyncOption = false;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_ONCE_A_SECOND;
         break;
       }
 
@@ -117,6 +118,13 @@ boolean Plugin_070(byte function, struct EventStruct *event, String& string)
         break;
       }
 
+    case PLUGIN_EXIT:
+      {
+        neoPixelEnd(event->TaskIndex);
+        success = true;
+        break;
+      }
+
     case PLUGIN_INIT:
       {
         if (!Plugin_070_pixels)
@@ -124,6 +132,7 @@ boolean Plugin_070(byte function, struct EventStruct *event, String& string)
           Plugin_070_pixels = new Adafruit_NeoPixel(NUMBER_LEDS, Settings.TaskDevicePin1[event->TaskIndex], NEO_GRB + NEO_KHZ800);
           Plugin_070_pixels->begin(); // This initializes the NeoPixel library.
         }
+        neoPixelBegin(event->TaskIndex, Plugin_070_pixels, 3);
         Plugin_070_enabled = CONFIG(0);
         Plugin_070_brightness = CONFIG(1);
         Plugin_070_marks = CONFIG(2);
@@ -214,7 +223,7 @@ void Clock_update()
     int Seconds = second();
     timeToStrip(Hours, Minutes, Seconds);
   }
-  Plugin_070_pixels->show(); // This sends the updated pixel color to the hardware.
+  neoPixelShow(Plugin_070_pixels); // This sends the updated pixel color to the hardware.
 }
 
 void calculateMarks()
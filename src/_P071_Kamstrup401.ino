@@ -11,16 +11,19 @@
 //Device pin 2 = TX
 
 
-#include <ESPeasySoftwareSerial.h>
+// The request is queued on the meter bus (MeterBus.ino) at 300 baud, the reply of 80 characters
+// arrives at 1200 baud in about 700 msec. The values are sent when it is complete.
+
 #define PLUGIN_071
 #define PLUGIN_ID_071 71
 #define PLUGIN_NAME_071 "Communication - Kamstrup Multical 401 [TESTING]"
 #define PLUGIN_VALUENAME1_071 "Heat"
 #define PLUGIN_VALUENAME2_071 "Volume"
+#define PLUGIN_071_TIMEOUT      2000    // msec for the first byte of the reply
+#define PLUGIN_071_REPLY_LENGTH   79
 
 boolean Plugin_071_init = false;
-byte PIN_KAMSER_RX = 0;
-byte PIN_KAMSER_TX = 0;
+int Plugin_071_bus = -1;
 
 boolean Plugin_071(byte function, struct EventStruct *event, String& string)
 {
@@ -59,9 +62,20 @@ boolean Plugin_071(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_INIT:
       {
-        Plugin_071_init = true;
+        meterBusEnd(Plugin_071_bus);
+        Plugin_071_bus = meterBusBegin(Settings.TaskDevicePin1[event->TaskIndex],
+                                       Settings.TaskDevicePin2[event->TaskIndex]);
+        Plugin_071_init = Plugin_071_bus >= 0;
 
-        success = true;
+        success = Plugin_071_init;
+        break;
+      }
+
+    case PLUGIN_EXIT:
+      {
+        meterBusEnd(Plugin_071_bus);
+        Plugin_071_bus = -1;
+        Plugin_071_init = false;
         break;
       }
 
@@ -73,200 +87,111 @@ boolean Plugin_071(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_READ:
       {
-        PIN_KAMSER_RX = Settings.TaskDevicePin1[event->TaskIndex];
-        PIN_KAMSER_TX = Settings.TaskDevicePin2[event->TaskIndex];
-
-        ESPeasySoftwareSerial kamSer(PIN_KAMSER_RX, PIN_KAMSER_TX, false);  // Initialize serial
-
-        pinMode(PIN_KAMSER_RX,INPUT);
-        pinMode(PIN_KAMSER_TX,OUTPUT);
-
-        //read Kamstrup
-        byte sendmsg1[] = { 175,163,177 };            //   /#1 with even parity
-
-        byte r  = 0;
-        byte to = 0;
-        byte i;
-        char message[255];
-        int parityerrors;
-
-
-        kamSer.begin(300);
-        for (int x = 0; x < 3; x++) {
-          kamSer.write(sendmsg1[x]);
-        }
-
-        kamSer.flush();
-        //kamSer.end();
-        kamSer.begin(1200);
-
-        to = 0;
-        r = 0;
-        i = 0;
-        parityerrors = 0;
-        char *tmpstr;
-        double m_energy, m_volume;
-        float m_tempin, m_tempout, m_tempdiff, m_power;
-        long m_hours, m_flow;
-
-        while(r != 0x0A)
+        // Queue the read, the values are sent when the reply arrives.
+        if (Plugin_071_init)
         {
-          if (kamSer.available())
-          {
-            // receive byte
-            r = kamSer.read();
-            //Serial.println(r);
-            if (parity_check(r))
-            {
-               parityerrors += 1;
-            }
-            r = r & 127; // Mask MSB to remove parity
-
-            message[i++] = char(r);
-          }
-          else
-          {
-            to++;
-            delay(25);
-          }
-
-          if (i>=79)
-          {
-            if ( parityerrors == 0 )
-            {
-//              Serial.print("OK: " );
-//              Serial.println(message);
-              message[i] = 0;
-
-              tmpstr = strtok(message, " ");
-              if (tmpstr){
-               m_energy = atol(tmpstr)/3.6*1000;
-              }
-              else
-               m_energy = 0;
-
-              tmpstr = strtok(NULL, " ");
-              if (tmpstr)
-               m_volume = atol(tmpstr);
-              else
-               m_volume = 0;
-
-              tmpstr = strtok(NULL, " ");
-              if (tmpstr)
-               m_hours = atol(tmpstr);
-              else
-               m_hours = 0;
-
-              tmpstr = strtok(NULL, " ");
-              if (tmpstr)
-               m_tempin = atol(tmpstr)/100.0;
-              else
-               m_tempin = 0;
-
-              tmpstr = strtok(NULL, " ");
-              if (tmpstr)
-               m_tempout = atol(tmpstr)/100.0;
-              else
-               m_tempout = 0;
-
-              tmpstr = strtok(NULL, " ");
-              if (tmpstr)
-               m_tempdiff = atol(tmpstr)/100.0;
-              else
-               m_tempdiff = 0;
-
-              tmpstr = strtok(NULL, " ");
-              if (tmpstr)
-               m_power = atol(tmpstr)/10.0;
-              else
-               m_power = 0;
-
-              tmpstr = strtok(NULL, " ");
-              if (tmpstr)
-               m_flow = atol(tmpstr);
-              else
-               m_flow = 0;
-
-               String log = F("Kamstrup output: ");
-               log += m_energy;
-               log += F(" MJ;  ");
-               log += m_volume;
-               log += F(" L; ");
-               log += m_hours;
-               log += F(" h; ");
-               log += m_tempin;
-               log += F(" C; ");
-               log += m_tempout;
-               log += F(" C; ");
-               log += m_tempdiff;
-               log += F(" C; ");
-               log += m_power;
-               log += F(" ");
-               log += m_flow;
-               log += F(" L/H");
-//              addLog(LOG_LEVEL_INFO, log);
-
-              UserVar[event->BaseVarIndex] = m_energy; //gives energy in Wh
-              UserVar[event->BaseVarIndex+1] = m_volume;  //gives volume in liters
-
-              log = F("Kamstrup  : Heat value: ");
-              log += m_energy/1000;
-              log += F(" kWh");
-              addLog(LOG_LEVEL_INFO, log);
-              log = F("Kamstrup  : Volume value: ");
-              log += m_volume;
-              log += F(" Liter");
-              addLog(LOG_LEVEL_INFO, log);
-            }
-            else
-            {
-              message[i] = 0;
-              String log = F("ERR(PARITY):" );
-              Serial.print("par");
-              log += message;
-              addLog(LOG_LEVEL_INFO, log);
-              //UserVar[event->BaseVarIndex] = NAN;
-              //UserVar[event->BaseVarIndex + 1] = NAN;
-            }
-            break;
-          }
-          if (to>100)
-          {
-            message[i] = 0;
-            String log = F("ERR(TIMEOUT):" );
-            log += message;
-            addLog(LOG_LEVEL_INFO, log);
-
-            //UserVar[event->BaseVarIndex] = NAN;
-            //UserVar[event->BaseVarIndex + 1] = NAN;
-            break;
-          }
+          const uint8_t request[] = { '/', '#', '1' };
+          if (meterBusQueue(Plugin_071_bus, event->TaskIndex, request, sizeof(request), 300, 1200,
+                            METER_BUS_FRAME_LINE, 0x0A, METER_BUS_PARITY7, PLUGIN_071_TIMEOUT, 0))
+            startTaskConversion(event, PLUGIN_ID_071, 2 * PLUGIN_071_TIMEOUT, 0);
         }
+        break;
+      }
 
-        //end read Kamstrup
-
+    case PLUGIN_TIMER_IN:
+      {
+        // No reply at all, e.g. the port was ended
+        if (isTaskConversionTimer(event))
+          completeTaskConversion(event, false);
+        break;
+      }
 
+    case PLUGIN_INTERRUPT_EVENT:
+      {
+        const MeterBusTransaction* reply = meterBusTransaction(event);
+        if (reply == NULL)
+          break;
         success = true;
+        if (reply->status != METER_BUS_STATUS_OK || reply->replyLength < PLUGIN_071_REPLY_LENGTH)
+        {
+          String log = F("Kamstrup  : no valid reply, status ");
+          log += reply->status;
+          log += ' ';
+          log += reinterpret_cast<const char*>(reply->reply);
+          addLog(LOG_LEVEL_INFO, log);
+          completeTaskConversion(event, false);
+          break;
+        }
+        Plugin_071_parse(event, reinterpret_cast<const char*>(reply->reply));
+        completeTaskConversion(event, true);
         break;
       }
   }
   return success;
 }
 
-bool parity_check(unsigned input) {
-    bool inputparity = input & 128;
-    int x = input & 127;
-
-    int parity = 0;
-    while(x != 0) {
-        parity ^= x;
-        x >>= 1;
-    }
+// The reply holds the values separated by spaces:
+// energy (GJ/1000), volume, hours, temperature in, out and difference, power, flow.
+void Plugin_071_parse(struct EventStruct *event, const char* reply)
+{
+  char message[PLUGIN_071_REPLY_LENGTH + 1];
+  strncpy(message, reply, PLUGIN_071_REPLY_LENGTH);
+  message[PLUGIN_071_REPLY_LENGTH] = 0;
+
+  double m_energy, m_volume;
+  float m_tempin, m_tempout, m_tempdiff, m_power;
+  long m_hours, m_flow;
+
+  char *tmpstr = strtok(message, " ");
+  m_energy = tmpstr ? atol(tmpstr)/3.6*1000 : 0;
+  tmpstr = strtok(NULL, " ");
+  m_volume = tmpstr ? atol(tmpstr) : 0;
+  tmpstr = strtok(NULL, " ");
+  m_hours = tmpstr ? atol(tmpstr) : 0;
+  tmpstr = strtok(NULL, " ");
+  m_tempin = tmpstr ? atol(tmpstr)/100.0 : 0;
+  tmpstr = strtok(NULL, " ");
+  m_tempout = tmpstr ? atol(tmpstr)/100.0 : 0;
+  tmpstr = strtok(NULL, " ");
+  m_tempdiff = tmpstr ? atol(tmpstr)/100.0 : 0;
+  tmpstr = strtok(NULL, " ");
+  m_power = tmpstr ? atol(tmpstr)/10.0 : 0;
+  tmpstr = strtok(NULL, " ");
+  m_flow = tmpstr ? atol(tmpstr) : 0;
+
+  if (loglevelActiveFor(LOG_LEVEL_DEBUG))
+  {
+    String log = F("Kamstrup output: ");
+    log += m_energy;
+    log += F(" MJ;  ");
+    log += m_volume;
+    log += F(" L; ");
+    log += m_hours;
+    log += F(" h; ");
+    log += m_tempin;
+    log += F(" C; ");
+    log += m_tempout;
+    log += F(" C; ");
+    log += m_tempdiff;
+    log += F(" C; ");
+    log += m_power;
+    log += F(" ");
+    log += m_flow;
+    log += F(" L/H");
+    addLog(LOG_LEVEL_DEBUG, log);
+  }
 
-    if ( (parity & 0x1) != inputparity )
-      return(1);
-    else
-      return(0);
+  UserVar[event->BaseVarIndex] = m_energy; //gives energy in Wh
+  UserVar[event->BaseVarIndex+1] = m_volume;  //gives volume in liters
+
+  String log = F("Kamstrup  : Heat value: ");
+  log += m_energy/1000;
+  log += F(" kWh");
+  addLog(LOG_LEVEL_INFO, log);
+  log = F("Kamstrup  : Volume value: ");
+  log += m_volume;
+  log += F(" Liter");
+  addLog(LOG_LEVEL_INFO, log);
 }
 
 #endif // USES_P071
@@ -7,8 +7,8 @@
 #define PLUGIN_072
 #define PLUGIN_ID_072         72
 #define PLUGIN_NAME_072       "Environment - HDC1080 (I2C) [TESTING]"
-#define PLUGIN_VALUENAME1_072 "Temperature"
-#define PLUGIN_VALUENAME2_072 "Humidity"
+#define PLUGIN_VALUENAME1_072 WEB_STR_TEMPERATURE
+#define PLUGIN_VALUENAME2_072 WEB_STR_HUMIDITY
 
 boolean Plugin_072_init = false;
 
@@ -44,8 +44,8 @@ boolean Plugin_072(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_GET_DEVICEVALUENAMES:
       {
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_072));
-        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], PSTR(PLUGIN_VALUENAME2_072));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], getWebStringP(PLUGIN_VALUENAME1_072));
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[1], getWebStringP(PLUGIN_VALUENAME2_072));
         break;
       }
 
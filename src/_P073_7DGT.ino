@@ -45,13 +45,16 @@ p073_7dgt *Plugin_073_7dgt = NULL;
 //---------------------------------------------------
 
 uint8_t p073_showbuffer[8];
+byte    p073_shown[8];            // Segments on the display, to send only the changed digits
+bool    p073_shownValid = false;
 byte    p073_spidata[2];
 byte    p073_dotpos;
 bool    p073_shift;
 
 #define TM1637_POWER_ON   B10001000
 #define TM1637_POWER_OFF  B10000000
-#define TM1637_CLOCKDELAY 40
+#define TM1637_CLOCKDELAY 5      // usec per clock phase, the modules have 10k/100pF on the lines
+#define MAX7219_SPI_CLOCK 5000000
 #define TM1637_4DIGIT     4
 #define TM1637_6DIGIT     2
 
@@ -83,6 +86,7 @@ boolean Plugin_073(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].TimerOption = false;
         Device[deviceCount].TimerOptional = false;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_ONCE_A_SECOND;
         break;
       }
 
@@ -475,10 +479,28 @@ void p073_FillBufferWithDash()  // in case of error show all dashes
 //---- TM1637 specific functions ----
 //===================================
 
-#define CLK_HIGH()  digitalWrite(clk_pin, HIGH)
-#define CLK_LOW()   digitalWrite(clk_pin, LOW)
-#define DIO_HIGH()  pinMode(dio_pin, INPUT)
-#define DIO_LOW()   pinMode(dio_pin, OUTPUT)
+// Direct GPIO register writes, digitalWrite() and pinMode() take several usec each.
+// DIO is open drain: the output latch stays low and only the output enable is
+// switched, the pull-up makes the line high.
+#if defined(ESP32)
+  #include <soc/gpio_struct.h>
+  #define P073_FAST_PIN(p)    ((p) < 32)
+  #define P073_OUT_HIGH(p)    GPIO.out_w1ts = (1UL << (p))
+  #define P073_OUT_LOW(p)     GPIO.out_w1tc = (1UL << (p))
+  #define P073_RELEASE(p)     GPIO.enable_w1tc = (1UL << (p))
+  #define P073_DRIVE(p)       GPIO.enable_w1ts = (1UL << (p))
+#else
+  #define P073_FAST_PIN(p)    ((p) < 16)
+  #define P073_OUT_HIGH(p)    GPOS = (1 << (p))
+  #define P073_OUT_LOW(p)     GPOC = (1 << (p))
+  #define P073_RELEASE(p)     GPEC = (1 << (p))
+  #define P073_DRIVE(p)       GPES = (1 << (p))
+#endif
+
+#define CLK_HIGH()  if (P073_FAST_PIN(clk_pin)) { P073_OUT_HIGH(clk_pin); } else { digitalWrite(clk_pin, HIGH); }
+#define CLK_LOW()   if (P073_FAST_PIN(clk_pin)) { P073_OUT_LOW(clk_pin); } else { digitalWrite(clk_pin, LOW); }
+#define DIO_HIGH()  if (P073_FAST_PIN(dio_pin)) { P073_RELEASE(dio_pin); } else { pinMode(dio_pin, INPUT_PULLUP); }
+#define DIO_LOW()   if (P073_FAST_PIN(dio_pin)) { P073_DRIVE(dio_pin); } else { pinMode(dio_pin, OUTPUT); }
 
 void tm1637_i2cStart (uint8_t clk_pin, uint8_t dio_pin)
 {
@@ -511,8 +533,7 @@ void tm1637_i2cAck (uint8_t clk_pin, uint8_t dio_pin)
 {
   bool dummyAck = false;
   CLK_LOW();
-  pinMode(dio_pin, INPUT_PULLUP);
-  //DIO_HIGH();
+  DIO_HIGH();
   delayMicroseconds(TM1637_CLOCKDELAY);
   //while(digitalRead(dio_pin));
   dummyAck = digitalRead(dio_pin);
@@ -524,7 +545,7 @@ void tm1637_i2cAck (uint8_t clk_pin, uint8_t dio_pin)
   CLK_HIGH();
   delayMicroseconds(TM1637_CLOCKDELAY);
   CLK_LOW();
-  pinMode(dio_pin, OUTPUT);
+  DIO_LOW();
 }
 
 void tm1637_i2cWrite (uint8_t clk_pin, uint8_t dio_pin, uint8_t bytetoprint)
@@ -537,7 +558,7 @@ void tm1637_i2cWrite (uint8_t clk_pin, uint8_t dio_pin, uint8_t bytetoprint)
   for(i=0; i<8; i++)
   {
     CLK_LOW();
-    (bytetoprint & B00000001)? DIO_HIGH() : DIO_LOW();
+    if (bytetoprint & B00000001) { DIO_HIGH(); } else { DIO_LOW(); }
     delayMicroseconds(TM1637_CLOCKDELAY);
     bytetoprint = bytetoprint >> 1;
     CLK_HIGH();
@@ -545,17 +566,35 @@ void tm1637_i2cWrite (uint8_t clk_pin, uint8_t dio_pin, uint8_t bytetoprint)
   }
 }
 
-void tm1637_ClearDisplay (uint8_t clk_pin, uint8_t dio_pin)
+// Send the digits which differ from the display, from the first to the last
+// changed one in one auto increment write. segments[0] is at address 0xC0.
+void tm1637_WriteSegments (uint8_t clk_pin, uint8_t dio_pin, const byte segments[], byte count)
 {
+  int first = -1;
+  int last = -1;
+  for (byte i = 0; i < count; i++) {
+    if (p073_shownValid && p073_shown[i] == segments[i]) continue;
+    if (first < 0) first = i;
+    last = i;
+  }
+  if (first < 0) return;
   tm1637_i2cStart(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, 0xC0);   tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, 0);      tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, 0);      tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, 0);      tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, 0);      tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, 0);      tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, 0);      tm1637_i2cAck(clk_pin, dio_pin);
+  tm1637_i2cWrite(clk_pin, dio_pin, 0xC0 + first);                    tm1637_i2cAck(clk_pin, dio_pin);
+  for (int i = first; i <= last; i++) {
+    tm1637_i2cWrite(clk_pin, dio_pin, segments[i]);                   tm1637_i2cAck(clk_pin, dio_pin);
+  }
   tm1637_i2cStop(clk_pin, dio_pin);
+  // Only a write of all digits makes the whole cache valid
+  if (!p073_shownValid && (first != 0 || last != count - 1)) return;
+  memcpy(p073_shown + first, segments + first, last - first + 1);
+  p073_shownValid = true;
+}
+
+void tm1637_ClearDisplay (uint8_t clk_pin, uint8_t dio_pin)
+{
+  const byte segments[6] = {0, 0, 0, 0, 0, 0};
+  p073_shownValid = false;
+  tm1637_WriteSegments(clk_pin, dio_pin, segments, 6);
 }
 
 void tm1637_SetPowerBrightness (uint8_t clk_pin, uint8_t dio_pin, uint8_t brightlvl, bool poweron)
@@ -578,11 +617,10 @@ void tm1637_SetPowerBrightness (uint8_t clk_pin, uint8_t dio_pin, uint8_t bright
 void tm1637_InitDisplay(uint8_t clk_pin, uint8_t dio_pin)
 {
   pinMode(clk_pin, OUTPUT);
-  pinMode(dio_pin, OUTPUT);
+  pinMode(dio_pin, INPUT_PULLUP);
+  digitalWrite(dio_pin, LOW);   // Output latch low for DIO_LOW()
   CLK_HIGH();
   DIO_HIGH();
-//  pinMode(dio_pin, INPUT_PULLUP);
-//  pinMode(clk_pin, OUTPUT);
   tm1637_i2cStart(clk_pin, dio_pin);
   tm1637_i2cWrite(clk_pin, dio_pin, 0x40);
   tm1637_i2cAck(clk_pin, dio_pin);
@@ -592,72 +630,60 @@ void tm1637_InitDisplay(uint8_t clk_pin, uint8_t dio_pin)
 
 void tm1637_ShowTime6(uint8_t clk_pin, uint8_t dio_pin, bool sep)
 {
-  byte p073_datashowpos1;
-  tm1637_i2cStart(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, 0xC0);                                  tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, CharTableTM1637[p073_showbuffer[2]]);   tm1637_i2cAck(clk_pin, dio_pin);
+  byte segments[6];
+  segments[0] = CharTableTM1637[p073_showbuffer[2]];
   // add bit for colon on second digit if required
-    p073_datashowpos1 = CharTableTM1637[p073_showbuffer[1]];
-    if (sep) p073_datashowpos1 |= 0b10000000;
-  tm1637_i2cWrite(clk_pin, dio_pin, p073_datashowpos1);                     tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, CharTableTM1637[p073_showbuffer[0]]);   tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, CharTableTM1637[p073_showbuffer[5]]);   tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, CharTableTM1637[p073_showbuffer[4]]);   tm1637_i2cAck(clk_pin, dio_pin);
+  segments[1] = CharTableTM1637[p073_showbuffer[1]];
+  if (sep) segments[1] |= 0b10000000;
+  segments[2] = CharTableTM1637[p073_showbuffer[0]];
+  segments[3] = CharTableTM1637[p073_showbuffer[5]];
+  segments[4] = CharTableTM1637[p073_showbuffer[4]];
   // add bit for colon on fourth digit if required
-    p073_datashowpos1 = CharTableTM1637[p073_showbuffer[3]];
-    if (sep) p073_datashowpos1 |= 0b10000000;
-  tm1637_i2cWrite(clk_pin, dio_pin, p073_datashowpos1);                     tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cStop(clk_pin, dio_pin);
+  segments[5] = CharTableTM1637[p073_showbuffer[3]];
+  if (sep) segments[5] |= 0b10000000;
+  tm1637_WriteSegments(clk_pin, dio_pin, segments, 6);
 }
 
 void tm1637_ShowDate6(uint8_t clk_pin, uint8_t dio_pin, bool sep)
 {
-  byte p073_datashowpos1;
-  tm1637_i2cStart(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, 0xC0);                                  tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, CharTableTM1637[p073_showbuffer[2]]);   tm1637_i2cAck(clk_pin, dio_pin);
+  byte segments[6];
+  segments[0] = CharTableTM1637[p073_showbuffer[2]];
   // add bit for colon on second digit if required
-    p073_datashowpos1 = CharTableTM1637[p073_showbuffer[1]];
-    if (sep) p073_datashowpos1 |= 0b10000000;
-  tm1637_i2cWrite(clk_pin, dio_pin, p073_datashowpos1);                     tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, CharTableTM1637[p073_showbuffer[0]]);   tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, CharTableTM1637[p073_showbuffer[7]]);   tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, CharTableTM1637[p073_showbuffer[6]]);   tm1637_i2cAck(clk_pin, dio_pin);
+  segments[1] = CharTableTM1637[p073_showbuffer[1]];
+  if (sep) segments[1] |= 0b10000000;
+  segments[2] = CharTableTM1637[p073_showbuffer[0]];
+  segments[3] = CharTableTM1637[p073_showbuffer[7]];
+  segments[4] = CharTableTM1637[p073_showbuffer[6]];
   // add bit for colon on fourth digit if required
-    p073_datashowpos1 = CharTableTM1637[p073_showbuffer[3]];
-    if (sep) p073_datashowpos1 |= 0b10000000;
-  tm1637_i2cWrite(clk_pin, dio_pin, p073_datashowpos1);                     tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cStop(clk_pin, dio_pin);
+  segments[5] = CharTableTM1637[p073_showbuffer[3]];
+  if (sep) segments[5] |= 0b10000000;
+  tm1637_WriteSegments(clk_pin, dio_pin, segments, 6);
 }
 
 void tm1637_ShowTemp6(uint8_t clk_pin, uint8_t dio_pin, bool sep)
 {
-  tm1637_i2cStart(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, 0xC0);                                  tm1637_i2cAck(clk_pin, dio_pin);
+  byte segments[6];
   // add bit for colon on second digit if required
-    byte p073_datashowpos1 = CharTableTM1637[p073_showbuffer[5]];
-    if (sep) p073_datashowpos1 |= 0b10000000;
-  tm1637_i2cWrite(clk_pin, dio_pin, p073_datashowpos1);                     tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, CharTableTM1637[p073_showbuffer[4]]);   tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, CharTableTM1637[10]);                   tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, CharTableTM1637[10]);                   tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, CharTableTM1637[p073_showbuffer[7]]);   tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, CharTableTM1637[p073_showbuffer[6]]);   tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cStop(clk_pin, dio_pin);
+  segments[0] = CharTableTM1637[p073_showbuffer[5]];
+  if (sep) segments[0] |= 0b10000000;
+  segments[1] = CharTableTM1637[p073_showbuffer[4]];
+  segments[2] = CharTableTM1637[10];
+  segments[3] = CharTableTM1637[10];
+  segments[4] = CharTableTM1637[p073_showbuffer[7]];
+  segments[5] = CharTableTM1637[p073_showbuffer[6]];
+  tm1637_WriteSegments(clk_pin, dio_pin, segments, 6);
 }
 
 void tm1637_ShowTimeTemp4(uint8_t clk_pin, uint8_t dio_pin, bool sep, byte bufoffset)
 {
-  tm1637_i2cStart(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, 0xC0);                                            tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, CharTableTM1637[p073_showbuffer[0+bufoffset]]);   tm1637_i2cAck(clk_pin, dio_pin);
+  byte segments[4];
+  segments[0] = CharTableTM1637[p073_showbuffer[0+bufoffset]];
   // add bit for colon on second digit if required
-    byte p073_datashowpos1 = CharTableTM1637[p073_showbuffer[1+bufoffset]];
-    if (sep) p073_datashowpos1 |= 0b10000000;
-  tm1637_i2cWrite(clk_pin, dio_pin, p073_datashowpos1);                               tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, CharTableTM1637[p073_showbuffer[2+bufoffset]]);   tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, CharTableTM1637[p073_showbuffer[3+bufoffset]]);   tm1637_i2cAck(clk_pin, dio_pin);
-  tm1637_i2cStop(clk_pin, dio_pin);
+  segments[1] = CharTableTM1637[p073_showbuffer[1+bufoffset]];
+  if (sep) segments[1] |= 0b10000000;
+  segments[2] = CharTableTM1637[p073_showbuffer[2+bufoffset]];
+  segments[3] = CharTableTM1637[p073_showbuffer[3+bufoffset]];
+  tm1637_WriteSegments(clk_pin, dio_pin, segments, 4);
 }
 
 void tm1637_SwapDigitInBuffer() {
@@ -675,15 +701,12 @@ void tm1637_SwapDigitInBuffer() {
 
 void tm1637_ShowBuffer(uint8_t clk_pin, uint8_t dio_pin, byte digits)
 {
-  byte p073_datashowpos1;
-  tm1637_i2cStart(clk_pin, dio_pin);
-  tm1637_i2cWrite(clk_pin, dio_pin, 0xC0);                            tm1637_i2cAck(clk_pin, dio_pin);
-    for(int i=digits;i<8;i++) {
-    p073_datashowpos1 = CharTableTM1637[p073_showbuffer[i]];
-    if (p073_dotpos == i) p073_datashowpos1 |= 0b10000000;
-    tm1637_i2cWrite(clk_pin, dio_pin, p073_datashowpos1);             tm1637_i2cAck(clk_pin, dio_pin);
+  byte segments[8];
+  for(int i=digits;i<8;i++) {
+    segments[i-digits] = CharTableTM1637[p073_showbuffer[i]];
+    if (p073_dotpos == i) segments[i-digits] |= 0b10000000;
   }
-  tm1637_i2cStop(clk_pin, dio_pin);
+  tm1637_WriteSegments(clk_pin, dio_pin, segments, 8-digits);
 }
 
 //====================================
@@ -696,10 +719,25 @@ void tm1637_ShowBuffer(uint8_t clk_pin, uint8_t dio_pin, byte digits)
 #define OP_SHUTDOWN    12
 #define OP_DISPLAYTEST 15
 
+// Hardware SPI when the pins are the SPI pins and SPI is initialized (hardware settings).
+bool max7219_useHardwareSPI(uint8_t din_pin, uint8_t clk_pin)
+{
+  return Settings.InitSPI && din_pin == MOSI && clk_pin == SCK;
+}
+
 void max7219_spiTransfer (uint8_t din_pin, uint8_t clk_pin, uint8_t cs_pin, volatile byte opcode, volatile byte data)
 {
   p073_spidata[0]=(byte)0;  p073_spidata[1]=(byte)0;
   p073_spidata[1]=opcode;   p073_spidata[0]=data;
+  if (max7219_useHardwareSPI(din_pin, clk_pin)) {
+    SPI.beginTransaction(SPISettings(MAX7219_SPI_CLOCK, MSBFIRST, SPI_MODE0));
+    digitalWrite(cs_pin,LOW);
+    SPI.transfer(p073_spidata[1]);
+    SPI.transfer(p073_spidata[0]);
+    digitalWrite(cs_pin,HIGH);
+    SPI.endTransaction();
+    return;
+  }
   digitalWrite(cs_pin,LOW);
   shiftOut(din_pin,clk_pin,MSBFIRST,p073_spidata[1]);
   shiftOut(din_pin,clk_pin,MSBFIRST,p073_spidata[0]);
@@ -711,6 +749,8 @@ void max7219_ClearDisplay (uint8_t din_pin, uint8_t clk_pin, uint8_t cs_pin)
   for(int i=0;i<8;i++) {
     max7219_spiTransfer(din_pin, clk_pin, cs_pin, i+1, 0);
   }
+  memset(p073_shown, 0, sizeof(p073_shown));
+  p073_shownValid = true;
 }
 
 void max7219_SetPowerBrightness (uint8_t din_pin, uint8_t clk_pin, uint8_t cs_pin, uint8_t brightlvl, bool poweron)
@@ -728,13 +768,19 @@ void max7219_SetDigit(uint8_t din_pin, uint8_t clk_pin, uint8_t cs_pin, int dgtp
   p073_tempvalue = CharTableMAX7219[dgtvalue];
   if(showdot)
     p073_tempvalue |= 0b10000000;
+  // Digits which did not change are not sent
+  if (p073_shownValid && p073_shown[dgtpos] == p073_tempvalue)
+    return;
   max7219_spiTransfer(din_pin, clk_pin, cs_pin, dgtpos+1, p073_tempvalue);
+  p073_shown[dgtpos] = p073_tempvalue;
 }
 
 void max7219_InitDisplay(uint8_t din_pin, uint8_t clk_pin, uint8_t cs_pin)
 {
-  pinMode(din_pin, OUTPUT);
-  pinMode(clk_pin, OUTPUT);
+  if (!max7219_useHardwareSPI(din_pin, clk_pin)) {
+    pinMode(din_pin, OUTPUT);
+    pinMode(clk_pin, OUTPUT);
+  }
   pinMode(cs_pin, OUTPUT);
   digitalWrite(cs_pin, HIGH);
   max7219_spiTransfer(din_pin, clk_pin, cs_pin, OP_DISPLAYTEST, 0);
@@ -229,13 +229,17 @@ boolean Plugin_074(byte function, struct EventStruct *event, String& string)
       {
       	if (TSL2591_initialized)
       	{
-					// Simple data read example. Just read the infrared, fullspecrtrum diode
-					// or 'visible' (difference between the two) channels.
-					// This can take 100-600 milliseconds! Uncomment whichever of the following you want to read
+					// One integration for all channels, 'visible' is the difference of full spectrum and infrared.
+					// This can take 100-600 milliseconds!
 					float lux, full, visible, ir;
-					visible = tsl.getLuminosity(TSL2591_VISIBLE);
-					ir = tsl.getLuminosity(TSL2591_INFRARED);
-					full = tsl.getLuminosity(TSL2591_FULLSPECTRUM);
+					uint8_t data[4];
+					if (!Plugin_074_readChannels(data)) {
+						addLog(LOG_LEVEL_ERROR,F("TSL2591: Read failed"));
+						break;
+					}
+					full = I2C_block_LE16(data, 0);
+					ir = I2C_block_LE16(data, 2);
+					visible = full - ir;
 					lux = tsl.calculateLuxf(full, ir); // get LUX
 
 					UserVar[event->BaseVarIndex + 0] = lux;
@@ -263,4 +267,18 @@ boolean Plugin_074(byte function, struct EventStruct *event, String& string)
   }
   return success;
 }
+
+// Waits for the integration and reads both channels (CHAN0 low, high, CHAN1 low, high)
+// in one transfer, as the datasheet advises so they belong to the same integration.
+bool Plugin_074_readChannels(uint8_t* data)
+{
+  tsl.enable();
+  for (uint8_t d = 0; d <= tsl.getTiming(); d++)
+  {
+    delay(120);
+  }
+  const bool success = I2C_read_block(TSL2591_ADDR, TSL2591_COMMAND_BIT | TSL2591_REGISTER_CHAN0_LOW, data, 4);
+  tsl.disable();
+  return success;
+}
 #endif // USES_P074
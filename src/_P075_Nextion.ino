@@ -43,9 +43,17 @@
 #define B38400   1
 #define B57600   2
 #define B115200  3
+#define B230400  4              // Hardware serial only.
 #define DEFAULT_BAUD B9600
 #define SOFTSERIAL 0
 #define UARTSERIAL 1
+#define SOFTSERIAL_MAX_BAUD B38400
+
+// Output defines. Commands are queued in the ring and sent from backgroundtasks(),
+// see Plugin_075_process(), so a PLUGIN_READ with many lines does not wait for the serial port.
+#define P075_TX_RING_SIZE 256   // Outgoing bytes, power of 2.
+#define P075_SOFT_TX_USEC 1000  // Max. time per call spent sending by SoftSerial.
+#define P075_CACHE_SIZE   16    // Components of which the shown value is remembered.
 
 
 // Global vars
@@ -53,6 +61,24 @@ ESPeasySoftwareSerial *SoftSerial = NULL;
 char deviceTemplate[Nlines][Lenlines]; 
 int rxPin = -1;
 int txPin = -1;
+boolean HwSerial = SOFTSERIAL;                          // Serial mode, hardware uart or softserial.
+uint32_t AdvHwBaud = 9600UL;                            // Baud rate in use.
+const uint32_t BaudArray[B230400+1] = {9600UL, 38400UL, 57600UL, 115200UL, 230400UL};
+
+byte* P075_txRing = NULL;
+unsigned int P075_txHead = 0;
+unsigned int P075_txTail = 0;
+
+// Last literal value sent to a component attribute (e.g. t0.txt), as hashes of
+// the "t0.txt" part and of the whole command.
+struct P075_CacheStruct
+{
+  P075_CacheStruct() : component(0), command(0) {}
+
+  uint32_t component;
+  uint32_t command;
+} P075_cache[P075_CACHE_SIZE];
+byte P075_cacheNext = 0;
 
 
 // *****************************************************************************************************
@@ -63,10 +89,8 @@ boolean Plugin_075(byte function, struct EventStruct *event, String& string)
 {
   boolean success = false;
   static uint8_t BaudCode = 0;                          // Web GUI baud rate drop down. 9600 if 0, See array for other rates. 
-  static boolean HwSerial = SOFTSERIAL;                 // Serial mode, hardware uart or softserial.
   static boolean AdvHwSerial = false;                   // Web GUI checkbox flag; false = softserial mode, true = hardware UART serial.
   static boolean IncludeValues = false;                 // Web GUI checkbox flag; false = don't send idx & value data at interval.
-  uint32_t AdvHwBaud = 9600UL;
 
   switch (function) {
 
@@ -83,6 +107,7 @@ boolean Plugin_075(byte function, struct EventStruct *event, String& string)
       Device[deviceCount].TimerOption = true;
       Device[deviceCount].TimerOptional = true;         // Allow user to disable interval function.
       Device[deviceCount].GlobalSyncOption = true;
+      Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND | PLUGIN_CALLBACK_ONCE_A_SECOND;
       break;
     }
 
@@ -134,8 +159,9 @@ boolean Plugin_075(byte function, struct EventStruct *event, String& string)
         }
       }
 
-      if (Settings.TaskDevicePluginConfig[event->TaskIndex][0] == false) { // SoftSerial mode. 
-        Settings.TaskDevicePluginConfig[event->TaskIndex][1] = B9600;      // Reset to 9600 baud.
+      if (Settings.TaskDevicePluginConfig[event->TaskIndex][0] == false &&   // SoftSerial mode.
+        Settings.TaskDevicePluginConfig[event->TaskIndex][1] > SOFTSERIAL_MAX_BAUD) {
+        Settings.TaskDevicePluginConfig[event->TaskIndex][1] = SOFTSERIAL_MAX_BAUD; // Limit to 38400 baud.
       }
       
       if(rxPin <0 || txPin <0) {                                            // Missing serial I/O pins!
@@ -148,14 +174,16 @@ boolean Plugin_075(byte function, struct EventStruct *event, String& string)
       addFormCheckBox(F("Use Hardware Serial"), F("AdvHwSerial"), Settings.TaskDevicePluginConfig[event->TaskIndex][0]);
 
       byte choice = Settings.TaskDevicePluginConfig[event->TaskIndex][1];
-      String options[4];
+      String options[B230400+1];
       options[0] = F("9600");
       options[1] = F("38400");
       options[2] = F("57600");
       options[3] = F("115200");
+      options[4] = F("230400");
       
-      addFormSelector(F("Baud Rate"), F("plugin_075_baud"), 4, options, NULL, choice);      
-      addFormNote(F("Un-check box for Soft Serial communication (low performance mode, 9600 Baud)."));
+      addFormSelector(F("Baud Rate"), F("plugin_075_baud"), B230400+1, options, NULL, choice);      
+      addFormNote(F("The display is switched to this rate at init (baud= command), its stored default rate is not changed."));
+      addFormNote(F("Un-check box for Soft Serial communication (low performance mode, max. 38400 Baud)."));
       addFormNote(F("Hardware Serial is available when the GPIO pins are RX=D7 and TX=D8."));
       addFormNote(F("D8 (GPIO-15) requires a Buffer Circuit (PNP transistor) or ESP boot may fail."));
       addFormNote(F("Do <b>NOT</b> enable the Serial Log file on Tools->Advanced->Serial Port."));
@@ -225,9 +253,7 @@ boolean Plugin_075(byte function, struct EventStruct *event, String& string)
       BaudCode      = Settings.TaskDevicePluginConfig[event->TaskIndex][1];
       IncludeValues = Settings.TaskDevicePluginConfig[event->TaskIndex][2];
 
-      if(BaudCode > B115200) BaudCode = B9600;
-      const uint32_t BaudArray[4] = {9600UL, 38400UL, 57600UL, 115200UL};
-      AdvHwBaud = BaudArray[BaudCode];
+      if(BaudCode > B230400) BaudCode = B9600;
 
       if (Settings.TaskDevicePin1[event->TaskIndex] != -1) {
         rxPin = Settings.TaskDevicePin1[event->TaskIndex];
@@ -240,6 +266,11 @@ boolean Plugin_075(byte function, struct EventStruct *event, String& string)
         delete SoftSerial;
         SoftSerial = NULL;
       }
+      Plugin_075_clearCache();
+      if (P075_txRing == NULL) {
+        P075_txRing = static_cast<byte*>(allocBuffer(MEM_POOL_SERIAL, P075_TX_RING_SIZE));
+      }
+      P075_txHead = P075_txTail = 0;
 
       String log = F("NEXTION075 : serial pin config RX:");
       log += rxPin;
@@ -254,6 +285,8 @@ boolean Plugin_075(byte function, struct EventStruct *event, String& string)
       addLog(LOG_LEVEL_INFO, log);
 
       if(Settings.TaskDeviceEnabled[event->TaskIndex] == true) { // Plugin is enabled.
+        if (!AdvHwSerial && BaudCode > SOFTSERIAL_MAX_BAUD) BaudCode = SOFTSERIAL_MAX_BAUD;
+        AdvHwBaud = BaudArray[BaudCode];
       // Hardware serial is RX on 13 and TX on 15 (swapped hw serial)
         if (AdvHwSerial &&  rxPin == 13 && txPin == 15) {
             log = F("NEXTION075 : Using swap hardware serial");
@@ -282,11 +315,12 @@ boolean Plugin_075(byte function, struct EventStruct *event, String& string)
             addLog(LOG_LEVEL_INFO, log);
             HwSerial = SOFTSERIAL;
             if (SoftSerial == NULL) {
-                SoftSerial = new ESPeasySoftwareSerial(rxPin, txPin, false, RXBUFFSZ);
+                SoftSerial = new ESPeasySoftwareSerial(rxPin, txPin, false, RXBUFFSZ, RXBUFFSZ * 10);
             } 
             SoftSerial->begin(9600);
             SoftSerial->flush();
         }
+        Plugin_075_negotiateBaud(AdvHwBaud);
     }
     else {
     }
@@ -344,13 +378,13 @@ boolean Plugin_075(byte function, struct EventStruct *event, String& string)
               newString = parseTemplate(tmpString, 0);
             }
 
-            sendCommand(newString.c_str(), HwSerial);
-            
-            String log = F("NEXTION075 : Cmd Statement Line-");
-            log += String(x+1);
-            log += F(" Sent: ");
-            log += newString;
-            addLog(LOG_LEVEL_INFO, log);
+            if (sendCommand(newString.c_str(), HwSerial)) {   // Not sent when the display already shows it.
+              String log = F("NEXTION075 : Cmd Statement Line-");
+              log += String(x+1);
+              log += F(" Sent: ");
+              log += newString;
+              addLog(LOG_LEVEL_INFO, log);
+            }
           }
         }
 
@@ -413,6 +447,9 @@ boolean Plugin_075(byte function, struct EventStruct *event, String& string)
 
 
     case PLUGIN_EXIT: {
+        freeBuffer(MEM_POOL_SERIAL, P075_txRing, P075_TX_RING_SIZE);
+        P075_txRing = NULL;
+        P075_txHead = P075_txTail = 0;
         if (SoftSerial) {
             delete SoftSerial;
             SoftSerial=NULL;
@@ -457,7 +494,7 @@ boolean Plugin_075(byte function, struct EventStruct *event, String& string)
         if(charCount >= RXBUFFWARN) {                   // ESP8266 has 128 byte circular Rx buffer.
             log = F("NEXTION075 : RxD UART Buffer capacity warning,");
             log += String(charCount);
-            log += F(" bytes");
+            log += getWebString(WEB_STR_BYTES);
             addLog(LOG_LEVEL_INFO, log);
         }
       }
@@ -467,18 +504,23 @@ boolean Plugin_075(byte function, struct EventStruct *event, String& string)
         if(charCount >= RXBUFFWARN) {
             log = F("NEXTION075 : RxD SoftSerial Buffer capacity warning, ");
             log += String(charCount);
-            log += F(" bytes");
+            log += getWebString(WEB_STR_BYTES);
             addLog(LOG_LEVEL_INFO, log);
         }
       }
 
       while (charCount) {                               // This is the serial engine. It processes the serial Rx stream.
+        if(HwSerial == UARTSERIAL) c = Serial.peek();
+        else c = SoftSerial->peek();
+        if (c == 0x65 && charCount < 7) break;          // Touch event incomplete, the rest is read at the next call.
+
         if(HwSerial == UARTSERIAL) c = Serial.read();
         else c = SoftSerial->read();
 
-        if (c == 0x65) {
-          if (charCount < 6) delay((5/(AdvHwBaud/9600))+1); // Let's wait for a few more chars to arrive.
+        // Touch, page change, startup and ready: the components may not show the sent values anymore.
+        if (c == 0x65 || c == 0x66 || c == 0x00 || c == 0x88) Plugin_075_clearCache();
 
+        if (c == 0x65) {
           if (HwSerial == UARTSERIAL) charCount = Serial.available();
           else charCount = SoftSerial->available();
           if (charCount >= 6) {
@@ -590,31 +632,178 @@ boolean Plugin_075(byte function, struct EventStruct *event, String& string)
 }
 
 
-void sendCommand(const char *cmd, boolean SerialMode) 
+// Queue a command for the display. Returns false when it is not sent, also when
+// the component already shows the value.
+boolean sendCommand(const char *cmd, boolean SerialMode) 
 {
+    static const uint8_t endMarker[3] = {0xff, 0xff, 0xff};
+
     if(txPin < 0) {
         String log = F("NEXTION075 : Missing TxD Pin Number, aborted sendCommand");
         addLog(LOG_LEVEL_INFO, log);
+        return false;
     }
-    else if(SerialMode == UARTSERIAL) {                 // Send command using Hardware UART serial.
-        Serial.print(cmd);
-        Serial.write(0xff);
-        Serial.write(0xff);
-        Serial.write(0xff);
+    if(SerialMode == SOFTSERIAL && SoftSerial == NULL) {
+        String log = F("NEXTION075 : SoftSerial error, aborted sendCommand");
+        addLog(LOG_LEVEL_INFO, log);
+        return false;
     }
-    else {                                              // Send command using bit-bang soft serial.
-        if(SoftSerial != NULL){
-            SoftSerial->print(cmd);
-            SoftSerial->write(0xff);
-            SoftSerial->write(0xff);
-            SoftSerial->write(0xff);
+    if (Plugin_075_isShown(cmd)) return false;
+    Plugin_075_queue(reinterpret_cast<const uint8_t*>(cmd), strlen(cmd));
+    Plugin_075_queue(endMarker, 3);
+    return true;
+}
+
+
+// *****************************************************************************************************
+// Value cache
+// Only assignments of a literal (t0.txt="abc", n0.val=12) are remembered, a
+// command like n0.val=n1.val or t0.txt+="x" depends on what the display shows.
+// Other commands (page, ref, vis) make the display reload its components.
+// *****************************************************************************************************
+
+uint32_t Plugin_075_hash(const char *data, size_t len)
+{
+    uint32_t hash = 2166136261UL;                       // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619UL;
+    }
+    return hash;
+}
+
+void Plugin_075_clearCache()
+{
+    for (byte i = 0; i < P075_CACHE_SIZE; i++) {
+        P075_cache[i].component = 0;
+    }
+    P075_cacheNext = 0;
+}
+
+// Returns true when the command sets a component to the value it already shows,
+// otherwise the command is remembered as shown.
+boolean Plugin_075_isShown(const char *cmd)
+{
+    const char *assign = strchr(cmd, '=');
+    if (assign == NULL || assign == cmd) {
+        Plugin_075_clearCache();
+        return false;
+    }
+    const char prev = assign[-1];
+    const char first = assign[1];
+    if (prev == '+' || prev == '-' || prev == '=' ||
+       !(first == '"' || first == '-' || isdigit(first))) {
+        return false;                                   // Not a literal, always send.
+    }
+    const uint32_t component = Plugin_075_hash(cmd, assign - cmd) | 1;   // 0 is a free entry.
+    const uint32_t command = Plugin_075_hash(cmd, strlen(cmd));
+    for (byte i = 0; i < P075_CACHE_SIZE; i++) {
+        if (P075_cache[i].component == component) {
+            if (P075_cache[i].command == command) return true;
+            P075_cache[i].command = command;
+            return false;
         }
-        else {
-            String log = F("NEXTION075 : SoftSerial error, aborted sendCommand");
-            addLog(LOG_LEVEL_INFO, log);
+    }
+    P075_cache[P075_cacheNext].component = component;
+    P075_cache[P075_cacheNext].command = command;
+    P075_cacheNext = (P075_cacheNext + 1) % P075_CACHE_SIZE;
+    return false;
+}
+
+
+// *****************************************************************************************************
+// Output
+// *****************************************************************************************************
+
+void Plugin_075_writeRaw(const uint8_t *data, size_t len)
+{
+    if(HwSerial == UARTSERIAL) Serial.write(data, len);
+    else if(SoftSerial != NULL) SoftSerial->write(data, len);
+}
+
+void Plugin_075_queue(const uint8_t *data, size_t len)
+{
+    if (P075_txRing == NULL) {                          // Not enough memory, send directly.
+        Plugin_075_writeRaw(data, len);
+        return;
+    }
+    for (size_t i = 0; i < len; i++) {
+        while (P075_txHead - P075_txTail >= P075_TX_RING_SIZE) {
+            Plugin_075_process();                       // Ring full, wait for the serial port.
+            delay(0);
+        }
+        P075_txRing[P075_txHead & (P075_TX_RING_SIZE - 1)] = data[i];
+        P075_txHead++;
+    }
+}
+
+// Called from backgroundtasks(): send what fits in the UART FIFO, or by SoftSerial
+// (which bit-bangs each byte) as much as fits in P075_SOFT_TX_USEC.
+void Plugin_075_process()
+{
+    if (P075_txRing == NULL || P075_txHead == P075_txTail) return;
+    if(HwSerial == UARTSERIAL) {
+        int room = Serial.availableForWrite();
+        while (room-- > 0 && P075_txTail != P075_txHead) {
+            Serial.write(P075_txRing[P075_txTail & (P075_TX_RING_SIZE - 1)]);
+            P075_txTail++;
         }
     }
-    return;
+    else if(SoftSerial != NULL) {
+        const unsigned long start = micros();
+        do {
+            SoftSerial->write(P075_txRing[P075_txTail & (P075_TX_RING_SIZE - 1)]);
+            P075_txTail++;
+        } while (P075_txTail != P075_txHead && (micros() - start) < P075_SOFT_TX_USEC);
+    }
+    else {
+        P075_txTail = P075_txHead;                      // No serial port, drop.
+    }
+}
+
+
+// *****************************************************************************************************
+// Baud rate
+// The display starts at its stored default rate (bauds=, 9600 on a new display).
+// The baud= command is sent at every rate it may listen on, the configured rate
+// last. The leading end markers close what the display received at a wrong rate.
+// *****************************************************************************************************
+
+void Plugin_075_setBaud(uint32_t baud)
+{
+    if(HwSerial == UARTSERIAL) {
+        Serial.flush();
+        Serial.begin(baud);
+        if (rxPin == 13 && txPin == 15) Serial.swap();  // begin() restores the default pins.
+    }
+    else if(SoftSerial != NULL) {
+        SoftSerial->begin(baud);
+    }
+}
+
+void Plugin_075_negotiateBaud(uint32_t baud)
+{
+    static const uint8_t endMarker[3] = {0xff, 0xff, 0xff};
+    String cmd = F("baud=");
+    cmd += baud;
+    for (byte i = 0; i <= B230400 + 1; i++) {
+        const uint32_t rate = (i <= B230400) ? BaudArray[i] : baud;
+        if (i <= B230400 && rate == baud) continue;
+        if (i > B230400) delay(20);                     // The display needs some time to switch.
+        Plugin_075_setBaud(rate);
+        Plugin_075_writeRaw(endMarker, 3);
+        Plugin_075_writeRaw(reinterpret_cast<const uint8_t*>(cmd.c_str()), cmd.length());
+        Plugin_075_writeRaw(endMarker, 3);
+        if(HwSerial == UARTSERIAL) Serial.flush();
+    }
+    if(HwSerial == UARTSERIAL) {
+        while (Serial.available()) Serial.read();       // Error replies of the wrong rates.
+    }
+    else if(SoftSerial != NULL) {
+        while (SoftSerial->available()) SoftSerial->read();
+    }
+    String log = F("NEXTION075 : Baud rate ");
+    log += baud;
+    addLog(LOG_LEVEL_INFO, log);
 }
 
 #endif // USES_P075
@@ -12,6 +12,11 @@
 //
 // HLW8012 IC works with 5VDC (it seems at 3.3V is not stable in reading)
 //
+// The library measures the pulse widths in interrupts on CF and CF1, switching SEL between
+// current and voltage by itself. Reading the values does not wait then, the active power is
+// passed 10 times per second to the power meter (PowerMeter.ino) for the energy and the
+// min/max/average of each interval.
+//
 
 #include <HLW8012.h>
 HLW8012 *Plugin_076_hlw = NULL;
@@ -30,7 +35,7 @@ HLW8012 *Plugin_076_hlw = NULL;
 // This is the case for Itead's Sonoff POW, where the SEL_PIN drives a transistor that pulls down
 // the SEL pin in the HLW8012 when closed
 #define HLW_CURRENT_MODE         HIGH
-#define HLW_DELAYREADING         500
+#define HLW_PULSE_TIMEOUT        500000   // usec, no pulse within it is 0
 
 // These are the nominal values for the resistors in the circuit
 #define HLW_CURRENT_RESISTOR       0.001
@@ -39,6 +44,18 @@ HLW8012 *Plugin_076_hlw = NULL;
 //-----------------------------------------------------------------------------------------------
 
 byte StoredTaskIndex;
+int Plugin_076_meter = -1;
+
+void Plugin_076_cf_interrupt() ICACHE_RAM_ATTR;
+void Plugin_076_cf1_interrupt() ICACHE_RAM_ATTR;
+
+void Plugin_076_cf_interrupt() {
+  Plugin_076_hlw->cf_interrupt();
+}
+
+void Plugin_076_cf1_interrupt() {
+  Plugin_076_hlw->cf1_interrupt();
+}
 
 boolean Plugin_076(byte function, struct EventStruct *event, String& string)
 {
@@ -59,6 +76,7 @@ boolean Plugin_076(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].SendDataOption = true;
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].GlobalSyncOption = false;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND;
         break;
       }
 
@@ -86,6 +104,7 @@ boolean Plugin_076(byte function, struct EventStruct *event, String& string)
         addFormTextBox(F("Current Multiplier"), F("plugin_076_currmult"), String(hlwMultipliers[0], 2), 25);
         addFormTextBox(F("Voltage Multiplier"), F("plugin_076_voltmult"), String(hlwMultipliers[1], 2), 25);
         addFormTextBox(F("Power Multiplier"),   F("plugin_076_powmult"),  String(hlwMultipliers[2], 2), 25);
+        powerMeterWebformLoad(event, 0, Plugin_076_meter);
         success = true;
         break;
       }
@@ -101,6 +120,7 @@ boolean Plugin_076(byte function, struct EventStruct *event, String& string)
           arg1 = F("plugin_076_powmult");  tmpString = WebServer.arg(arg1);
           hlwMultipliers[2] = atof(tmpString.c_str());
         SaveCustomTaskSettings(event->TaskIndex, (byte*)&hlwMultipliers, sizeof(hlwMultipliers));
+        powerMeterWebformSave(event, 0);
         if (PLUGIN_076_DEBUG) {
           String log = F("HLW8012: Saved Calibration from Config Page");
           addLog(LOG_LEVEL_INFO, log);
@@ -120,9 +140,10 @@ boolean Plugin_076(byte function, struct EventStruct *event, String& string)
 
     case PLUGIN_READ:
       if (Plugin_076_hlw) {
-        Plugin_076_hlw->setMode(MODE_CURRENT); delay(HLW_DELAYREADING); double       hcurrent  = Plugin_076_hlw->getCurrent();
-        Plugin_076_hlw->setMode(MODE_VOLTAGE); delay(HLW_DELAYREADING); unsigned int hvoltage  = Plugin_076_hlw->getVoltage();
-        unsigned int hpower    = Plugin_076_hlw->getActivePower();
+        // Latest pulse widths, the library switches between current and voltage itself
+        double       hcurrent  = Plugin_076_hlw->getCurrent();
+        unsigned int hvoltage  = Plugin_076_hlw->getVoltage();
+        unsigned int hpower    = powerMeterReport(Plugin_076_meter);
         //unsigned int happpower = Plugin_076_hlw->getApparentPower();
         unsigned int hpowfact  = (int) (100 * Plugin_076_hlw->getPowerFactor());
         if (PLUGIN_076_DEBUG) {
@@ -142,13 +163,22 @@ boolean Plugin_076(byte function, struct EventStruct *event, String& string)
       }
       break;
 
+    case PLUGIN_TEN_PER_SECOND:
+      if (Plugin_076_hlw) {
+        powerMeterSample(Plugin_076_meter, Plugin_076_hlw->getActivePower());
+        success = true;
+      }
+      break;
+
     case PLUGIN_INIT:
       {
         if (!Plugin_076_hlw)
         {
           Plugin_076_hlw = new HLW8012;
           // This initializes the HWL8012 library.
-          Plugin_076_hlw->begin(Settings.TaskDevicePin3[event->TaskIndex], Settings.TaskDevicePin2[event->TaskIndex], Settings.TaskDevicePin1[event->TaskIndex], HLW_CURRENT_MODE, false, 1000000);
+          Plugin_076_hlw->begin(Settings.TaskDevicePin3[event->TaskIndex], Settings.TaskDevicePin2[event->TaskIndex], Settings.TaskDevicePin1[event->TaskIndex], HLW_CURRENT_MODE, true, HLW_PULSE_TIMEOUT);
+          attachInterrupt(Settings.TaskDevicePin3[event->TaskIndex], Plugin_076_cf_interrupt, CHANGE);
+          attachInterrupt(Settings.TaskDevicePin2[event->TaskIndex], Plugin_076_cf1_interrupt, CHANGE);
           if (PLUGIN_076_DEBUG) addLog(LOG_LEVEL_INFO, F("HLW8012: Init object done"));
           Plugin_076_hlw->setResistors(HLW_CURRENT_RESISTOR, HLW_VOLTAGE_RESISTOR_UP, HLW_VOLTAGE_RESISTOR_DOWN);
           if (PLUGIN_076_DEBUG) addLog(LOG_LEVEL_INFO, F("HLW8012: Init Basic Resistor Values done"));
@@ -166,10 +196,25 @@ boolean Plugin_076(byte function, struct EventStruct *event, String& string)
           if (PLUGIN_076_DEBUG) addLog(LOG_LEVEL_INFO, F("HLW8012: Applied Calibration after INIT"));
           StoredTaskIndex = event->TaskIndex; // store task index value in order to use it in the PLUGIN_WRITE routine
         }
+        Plugin_076_meter = powerMeterBegin(event->TaskIndex, Settings.TaskDevicePluginConfig[event->TaskIndex][0]);
         success = true;
         break;
       }
 
+    case PLUGIN_EXIT:
+      {
+        if (Plugin_076_hlw)
+        {
+          detachInterrupt(Settings.TaskDevicePin3[event->TaskIndex]);
+          detachInterrupt(Settings.TaskDevicePin2[event->TaskIndex]);
+          delete Plugin_076_hlw;
+          Plugin_076_hlw = NULL;
+        }
+        powerMeterEnd(Plugin_076_meter);
+        Plugin_076_meter = -1;
+        break;
+      }
+
     case PLUGIN_WRITE:
       {
         if (Plugin_076_hlw)
@@ -179,6 +224,12 @@ boolean Plugin_076(byte function, struct EventStruct *event, String& string)
           if (argIndex)
             tmpString = tmpString.substring(0, argIndex);
 
+          if (tmpString.equalsIgnoreCase(F("energyreset")))
+          {
+            powerMeterReset(Plugin_076_meter);
+            success = true;
+          }
+
           if (tmpString.equalsIgnoreCase(F("hlwreset")))
           {
             Plugin_076_hlw->resetMultipliers();
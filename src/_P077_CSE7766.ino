@@ -5,6 +5,8 @@
 //###################################### stefan@clumsy.ch      ##########################################
 //#######################################################################################################
 
+#include <SerialFrameBuffer.h>
+
 #define PLUGIN_077
 #define PLUGIN_ID_077         77
 #define PLUGIN_NAME_077       "Energy (AC) - CSE7766 [TESTING]"
@@ -14,6 +16,7 @@
 #define PLUGIN_VALUENAME4_077 "Pulses"
 
 boolean Plugin_077_init = false;
+int Plugin_077_meter = -1;   // Energy and interval statistics, see PowerMeter.ino
 
 #define CSE_NOT_CALIBRATED          0xAA
 #define CSE_PULSES_NOT_INITIALIZED  -1
@@ -29,7 +32,15 @@ boolean Plugin_077_init = false;
    unsigned long energy_current_calibration = HLW_IREF_PULSE;
 */
 
-uint8_t cse_receive_flag = 0;
+// Status byte (0x55, 0xAA when not calibrated, 0xFx on errors), 0x5A, 21 data bytes and their sum
+const SerialFrameFormat Plugin_077_format = {
+  { 0x00, 0x5A }, { 0x00, 0xFF }, 2,
+  24, SERIALFRAME_NO_LENGTH_FIELD, 0, 0,
+  SERIALFRAME_CHECKSUM_SUM8, 2,
+  0, 0
+};
+
+SerialFrameBuffer<24> Plugin_077_frame(Plugin_077_format);
 
 long voltage_cycle = 0;
 long current_cycle = 0;
@@ -38,9 +49,6 @@ long power_cycle_first = 0;
 long cf_pulses = 0;
 long cf_pulses_last_time = CSE_PULSES_NOT_INITIALIZED;
 long cf_frequency = 0;
-uint8_t serial_in_buffer[32];
-uint8_t serial_in_byte_counter = 0;
-uint8_t serial_in_byte = 0;
 float energy_voltage = 0;         // 123.1 V
 float energy_current = 0;         // 123.123 A
 float energy_power = 0;           // 123.1 W
@@ -64,6 +72,7 @@ boolean Plugin_077(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].TimerOption = true;
         Device[deviceCount].TimerOptional = true;
         Device[deviceCount].GlobalSyncOption = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND;
         break;
       }
 
@@ -94,6 +103,7 @@ boolean Plugin_077(byte function, struct EventStruct *event, String& string)
         addUnit(F("uSec"));
         addFormNote(F("Use 0 to read values stored on chip / default values"));
 
+        powerMeterWebformLoad(event, 3, Plugin_077_meter);
         success = true;
         break;
       }
@@ -103,6 +113,7 @@ boolean Plugin_077(byte function, struct EventStruct *event, String& string)
         Settings.TaskDevicePluginConfig[event->TaskIndex][0] = getFormItemInt(F("plugin_077_URef"));;
         Settings.TaskDevicePluginConfig[event->TaskIndex][1] = getFormItemInt(F("plugin_077_IRef"));
         Settings.TaskDevicePluginConfig[event->TaskIndex][2] = getFormItemInt(F("plugin_077_PRef"));
+        powerMeterWebformSave(event, 3);
         success = true;
         break;
       }
@@ -117,12 +128,22 @@ boolean Plugin_077(byte function, struct EventStruct *event, String& string)
         Settings.UseSerial = true; // Enable Serial port
         disableSerialLog(); // disable logging on serial port (used for CSE7766 communication)
         Settings.BaudRate = 4800; // set BaudRate for CSE7766
-        Serial.flush();
-        Serial.begin(Settings.BaudRate);
+        Plugin_077_frame.Clear();
+        serialRxBegin(event->TaskIndex, Settings.BaudRate, SERIAL_8N1, 256, SERIAL_RX_NO_FRAME_END, 0);
+        Plugin_077_meter = powerMeterBegin(event->TaskIndex, Settings.TaskDevicePluginConfig[event->TaskIndex][3]);
         success = true;
         break;
       }
 
+    case PLUGIN_EXIT:
+      {
+        serialRxEnd(event->TaskIndex);
+        powerMeterEnd(Plugin_077_meter);
+        Plugin_077_meter = -1;
+        Plugin_077_init = false;
+        break;
+      }
+
     /* currently not needed!
        case PLUGIN_TEN_PER_SECOND:
           {
@@ -151,76 +172,70 @@ boolean Plugin_077(byte function, struct EventStruct *event, String& string)
     case PLUGIN_READ:
       {
         addLog(LOG_LEVEL_DEBUG_DEV, F("CSE: plugin read"));
-//        sendData(event);
-//        Variables set in PLUGIN_SERIAL_IN as soon as there are new values!
-//        UserVar[event->BaseVarIndex] = energy_voltage;
-//        UserVar[event->BaseVarIndex + 1] = energy_power;
-//        UserVar[event->BaseVarIndex + 2] = energy_current;
-//        UserVar[event->BaseVarIndex + 3] = cf_pulses;
+        // The other values are set in PLUGIN_SERIAL_IN as soon as there are new values,
+        // the power is the average of the interval.
+        if (Plugin_077_init)
+          UserVar[event->BaseVarIndex + 1] = powerMeterReport(Plugin_077_meter);
         success = true;
         break;
       }
 
+    case PLUGIN_WRITE:
+      {
+        String command = parseString(string, 1);
+        if (Plugin_077_init && command == F("energyreset"))
+        {
+          powerMeterReset(Plugin_077_meter);
+          success = true;
+        }
+        break;
+      }
+
 
     case PLUGIN_SERIAL_IN:
       {
         if (Plugin_077_init) {
-          if (Serial.available() > 0) {
-            serial_in_byte = Serial.read();
-            success = true;
-
-            if (cse_receive_flag) {
-              serial_in_buffer[serial_in_byte_counter++] = serial_in_byte;
-              if (24 == serial_in_byte_counter) {
-                addLog(LOG_LEVEL_DEBUG_DEV, F("CSE: packet received"));
-                CseReceived(event);
-                cse_receive_flag = 0;
-                serial_in_byte_counter = 0;
-                // new packet received, update values
-                UserVar[event->BaseVarIndex] = energy_voltage;
-                UserVar[event->BaseVarIndex + 1] = energy_power;
-                UserVar[event->BaseVarIndex + 2] = energy_current;
-                UserVar[event->BaseVarIndex + 3] = cf_pulses;
-//                break;
-              }
-            } else {
-              if (0x5A == serial_in_byte) { // 0x5A - Packet header 2
-                cse_receive_flag = 1;
-                addLog(LOG_LEVEL_DEBUG_DEV, F("CSE: Header received"));
-              } else {
-                serial_in_byte_counter = 0;
-              }
-              serial_in_buffer[serial_in_byte_counter++] = serial_in_byte;
-            }
-            serial_in_byte = 0;           // Discard
-
-
-            //          String log = F("Variable: Tag: ");
-            //          log += key;
-            //          addLog(LOG_LEVEL_INFO, log);
-            //          success = true;
-          }
+          Plugin_077_receive(event);
+          success = true;
         }
         break;
       }
+
+    case PLUGIN_INTERRUPT_EVENT:
+      {
+        // Idle line, the packet is complete.
+        if (Plugin_077_init && event->Par1 == SERIAL_RX_EVENT_IDLE)
+          Plugin_077_receive(event);
+        success = true;
+        break;
+      }
   }
   return success;
 }
 
-void CseReceived(struct EventStruct *event)
+// Feed the received bytes to the frame buffer, every valid packet updates the values.
+void Plugin_077_receive(struct EventStruct *event)
 {
-  uint8_t header = serial_in_buffer[0];
-  if ((header & 0xFC) == 0xFC) {
-    addLog(LOG_LEVEL_DEBUG, F("CSE: Abnormal hardware"));
-    return;
+  int c;
+  while ((c = serialRxRead()) >= 0) {
+    if (!Plugin_077_frame.AddData(c)) continue;
+    addLog(LOG_LEVEL_DEBUG_DEV, F("CSE: packet received"));
+    if (!CseReceived(event)) continue;
+    powerMeterSample(Plugin_077_meter, energy_power);
+    UserVar[event->BaseVarIndex] = energy_voltage;
+    UserVar[event->BaseVarIndex + 1] = energy_power;
+    UserVar[event->BaseVarIndex + 2] = energy_current;
+    UserVar[event->BaseVarIndex + 3] = cf_pulses;
   }
+}
 
-  // Calculate checksum
-  uint8_t checksum = 0;
-  for (byte i = 2; i < 23; i++) checksum += serial_in_buffer[i];
-  if (checksum != serial_in_buffer[23]) {
-    addLog(LOG_LEVEL_DEBUG, F("CSE: Checksum Failure"));
-    return;
+bool CseReceived(struct EventStruct *event)
+{
+  // The checksum is checked by the frame buffer
+  uint8_t header = Plugin_077_frame.Get8(0);
+  if ((header & 0xFC) == 0xFC) {
+    addLog(LOG_LEVEL_DEBUG, F("CSE: Abnormal hardware"));
+    return false;
   }
 
 
@@ -228,31 +243,31 @@ void CseReceived(struct EventStruct *event)
   if (HLW_UREF_PULSE == Settings.TaskDevicePluginConfig[event->TaskIndex][0]) {
     long voltage_coefficient = 191200; // uSec
     if (CSE_NOT_CALIBRATED != header) {
-      voltage_coefficient = serial_in_buffer[2] << 16 | serial_in_buffer[3] << 8 | serial_in_buffer[4];
+      voltage_coefficient = Plugin_077_frame.Get24BE(2);
     }
     Settings.TaskDevicePluginConfig[event->TaskIndex][0] = voltage_coefficient / CSE_UREF;
   }
   if (HLW_IREF_PULSE == Settings.TaskDevicePluginConfig[event->TaskIndex][1]) {
     long current_coefficient = 16140; // uSec
     if (CSE_NOT_CALIBRATED != header) {
-      current_coefficient = serial_in_buffer[8] << 16 | serial_in_buffer[9] << 8 | serial_in_buffer[10];
+      current_coefficient = Plugin_077_frame.Get24BE(8);
     }
     Settings.TaskDevicePluginConfig[event->TaskIndex][1] = current_coefficient;
   }
   if (HLW_PREF_PULSE == Settings.TaskDevicePluginConfig[event->TaskIndex][2]) {
     long power_coefficient = 5364000; // uSec
     if (CSE_NOT_CALIBRATED != header) {
-      power_coefficient = serial_in_buffer[14] << 16 | serial_in_buffer[15] << 8 | serial_in_buffer[16];
+      power_coefficient = Plugin_077_frame.Get24BE(14);
     }
     Settings.TaskDevicePluginConfig[event->TaskIndex][2] = power_coefficient / CSE_PREF;
   }
 
 
-  uint8_t adjustement = serial_in_buffer[20];
-  voltage_cycle = serial_in_buffer[5] << 16 | serial_in_buffer[6] << 8 | serial_in_buffer[7];
-  current_cycle = serial_in_buffer[11] << 16 | serial_in_buffer[12] << 8 | serial_in_buffer[13];
-  power_cycle = serial_in_buffer[17] << 16 | serial_in_buffer[18] << 8 | serial_in_buffer[19];
-  cf_pulses = serial_in_buffer[21] << 8 | serial_in_buffer[22];
+  uint8_t adjustement = Plugin_077_frame.Get8(20);
+  voltage_cycle = Plugin_077_frame.Get24BE(5);
+  current_cycle = Plugin_077_frame.Get24BE(11);
+  power_cycle = Plugin_077_frame.Get24BE(17);
+  cf_pulses = Plugin_077_frame.Get16BE(21);
 
   if (loglevelActiveFor(LOG_LEVEL_DEBUG_DEV)) {
     String log = F("CSE: adjustement ");
@@ -322,6 +337,7 @@ void CseReceived(struct EventStruct *event)
     log += cf_pulses;
     addLog(LOG_LEVEL_DEBUG, log);
   }
+  return true;
 }
 
 #endif // USES_P077
@@ -0,0 +1,365 @@
+#ifdef USES_P078
+//#######################################################################################################
+//#################################### Plugin 078: Replay ###############################################
+//#######################################################################################################
+
+// Sensor replay, for load tests of the controllers, formulas, rules and aggregation without sensors.
+// As the Dummy device, but the values come from a file or a generator, each sample through
+// SensorSendTask(), so the formulas, the aggregation and sendData() run as for a real sensor.
+// - File: replay<task nr>.csv, one sample per line with up to 4 values separated by , ; space or tab.
+//   Lines starting with # are skipped. At the end it starts again, or stops.
+// - Generators: sine, sawtooth, square, random walk and counter, with the amplitude, offset and
+//   period. Value n is a quarter period after value n-1, the random walk has a fixed seed. The
+//   time of a sample is its number in the series, so each run gives the same values.
+// Samples per second 0 reads a sample at the task interval. Otherwise the samples are sent from
+// PLUGIN_FIFTY_PER_SECOND by the time since the start, at most P078_MAX_BURST per call. The
+// samples further behind are skipped and counted as dropped.
+// Command: replay,<task nr>,<1: start from the first sample, 0: stop>
+
+#define PLUGIN_078
+#define PLUGIN_ID_078         78
+#define PLUGIN_NAME_078       "Generic - Replay [TESTING]"
+#define PLUGIN_VALUENAME1_078 "Replay"
+
+#define P078_MAX_RATE         500   // samples per second
+#define P078_MAX_BURST         20   // samples per PLUGIN_FIFTY_PER_SECOND call
+#define P078_BUFFER_SIZE       64   // file read buffer
+#define P078_LINE_SIZE         64
+
+#define P078_SOURCE_FILE        0
+#define P078_SOURCE_SINE        1
+#define P078_SOURCE_SAWTOOTH    2
+#define P078_SOURCE_SQUARE      3
+#define P078_SOURCE_RANDOM_WALK 4
+#define P078_SOURCE_COUNTER     5
+#define P078_NR_SOURCES         6
+
+#ifndef CONFIG
+#define CONFIG(n) (Settings.TaskDevicePluginConfig[event->TaskIndex][n])
+#endif
+#define P078_SOURCE       CONFIG(1)
+#define P078_RATE         CONFIG(2)
+#define P078_LOOP         CONFIG(3)
+#define P078_AMPLITUDE    Settings.TaskDevicePluginConfigFloat[event->TaskIndex][0]
+#define P078_OFFSET       Settings.TaskDevicePluginConfigFloat[event->TaskIndex][1]
+#define P078_PERIOD       Settings.TaskDevicePluginConfigLong[event->TaskIndex][0]
+#define P078_DEFAULT_PERIOD  60000   // msec
+
+struct P078_data_struct : public PluginTaskData_base
+{
+  P078_data_struct() : running(false), index(0), sent(0), startMicros(0), dropped(0), rewinds(0),
+    seed(1), bufferLength(0), bufferPos(0) {
+    for (byte x = 0; x < VARS_PER_TASK; ++x) walk[x] = 0;
+  }
+
+  ~P078_data_struct() {
+    if (file) file.close();
+  }
+
+  bool running;
+  unsigned long index;         // Of the next sample
+  unsigned long sent;          // By the rate, since startMicros
+  unsigned long startMicros;
+  unsigned long dropped;
+  unsigned long rewinds;       // Of the file
+  uint32_t seed;               // Random walk
+  float walk[VARS_PER_TASK];
+  fs::File file;
+  byte buffer[P078_BUFFER_SIZE];
+  byte bufferLength;
+  byte bufferPos;
+};
+
+struct P078_data_struct* Plugin_078_data(byte TaskIndex)
+{
+  return static_cast<P078_data_struct*>(getPluginTaskData(TaskIndex));
+}
+
+String Plugin_078_fileName(byte TaskIndex)
+{
+  #if defined(ESP32)
+    String fileName = F("/replay");
+  #else
+    String fileName = F("replay");
+  #endif
+  fileName += TaskIndex + 1;
+  fileName += F(".csv");
+  return fileName;
+}
+
+// Start from the first sample.
+void Plugin_078_start(struct EventStruct *event, struct P078_data_struct* data)
+{
+  data->running = true;
+  data->index = 0;
+  data->sent = 0;
+  data->startMicros = micros();
+  data->seed = event->TaskIndex + 1;
+  for (byte x = 0; x < VARS_PER_TASK; ++x) data->walk[x] = 0;
+  if (P078_SOURCE != P078_SOURCE_FILE) return;
+  if (data->file) data->file.close();
+  data->bufferLength = data->bufferPos = 0;
+  data->file = SPIFFS.open(Plugin_078_fileName(event->TaskIndex), "r");
+  if (!data->file) {
+    data->running = false;
+    String log = F("Replay: No file ");
+    log += Plugin_078_fileName(event->TaskIndex);
+    addLog(LOG_LEVEL_ERROR, log);
+  }
+}
+
+// Next line of the file without the line end, false at the end of the file.
+bool Plugin_078_readLine(struct P078_data_struct* data, char* line)
+{
+  byte length = 0;
+  bool any = false;
+  while (true) {
+    if (data->bufferPos >= data->bufferLength) {
+      data->bufferLength = data->file.read(data->buffer, P078_BUFFER_SIZE);
+      data->bufferPos = 0;
+      if (data->bufferLength == 0) break;
+    }
+    const char c = data->buffer[data->bufferPos++];
+    any = true;
+    if (c == '\n') break;
+    if (c != '\r' && length < P078_LINE_SIZE - 1)
+      line[length++] = c;
+  }
+  line[length] = 0;
+  return any;
+}
+
+// Values of the next line of the file, false when there is none.
+bool Plugin_078_readFile(struct EventStruct *event, struct P078_data_struct* data)
+{
+  char line[P078_LINE_SIZE];
+  // At most one rewind, a file without samples does not loop
+  for (byte pass = 0; pass < 2; ++pass) {
+    while (Plugin_078_readLine(data, line)) {
+      if (line[0] == 0 || line[0] == '#') continue;
+      char* pos = line;
+      for (byte x = 0; x < VARS_PER_TASK; ++x) {
+        while (*pos == ' ' || *pos == '\t') ++pos;
+        if (*pos == 0) break;
+        UserVar[event->BaseVarIndex + x] = atof(pos);
+        while (*pos != 0 && *pos != ',' && *pos != ';' && *pos != ' ' && *pos != '\t') ++pos;
+        if (*pos != 0) ++pos;
+      }
+      return true;
+    }
+    if (!P078_LOOP) break;
+    data->file.seek(0, SeekSet);
+    data->bufferLength = data->bufferPos = 0;
+    ++data->rewinds;
+  }
+  return false;
+}
+
+// Value x of the generator at msec into the series.
+float Plugin_078_generate(struct EventStruct *event, struct P078_data_struct* data, byte x, unsigned long msec)
+{
+  const unsigned long period = P078_PERIOD > 0 ? P078_PERIOD : P078_DEFAULT_PERIOD;
+  const float phase = static_cast<float>((msec + x * period / 4) % period) / period;
+  switch (P078_SOURCE) {
+    case P078_SOURCE_SINE:     return P078_OFFSET + P078_AMPLITUDE * sin(2 * PI * phase);
+    case P078_SOURCE_SAWTOOTH: return P078_OFFSET + P078_AMPLITUDE * (2 * phase - 1);
+    case P078_SOURCE_SQUARE:   return P078_OFFSET + (phase < 0.5 ? P078_AMPLITUDE : -P078_AMPLITUDE);
+    case P078_SOURCE_RANDOM_WALK:
+      {
+        // Park-Miller, the same series for each start
+        data->seed = (static_cast<uint64_t>(data->seed) * 48271UL) % 2147483647UL;
+        data->walk[x] += P078_AMPLITUDE * (static_cast<float>(data->seed) / 1073741823.5 - 1) / 10;
+        return P078_OFFSET + data->walk[x];
+      }
+    case P078_SOURCE_COUNTER:  return P078_OFFSET + data->index;
+  }
+  return 0;
+}
+
+boolean Plugin_078(byte function, struct EventStruct *event, String& string)
+{
+  boolean success = false;
+
+  switch (function)
+  {
+
+    case PLUGIN_DEVICE_ADD:
+      {
+        Device[++deviceCount].Number = PLUGIN_ID_078;
+        Device[deviceCount].Type = DEVICE_TYPE_DUMMY;
+        Device[deviceCount].VType = SENSOR_TYPE_SINGLE;
+        Device[deviceCount].Ports = 0;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_FIFTY_PER_SECOND;
+        Device[deviceCount].PullUpOption = false;
+        Device[deviceCount].InverseLogicOption = false;
+        Device[deviceCount].FormulaOption = true;
+        Device[deviceCount].DecimalsOnly = true;
+        Device[deviceCount].ValueCount = 4;
+        Device[deviceCount].SendDataOption = true;
+        Device[deviceCount].TimerOption = true;
+        Device[deviceCount].TimerOptional = true;
+        Device[deviceCount].GlobalSyncOption = true;
+        break;
+      }
+
+    case PLUGIN_GET_DEVICENAME:
+      {
+        string = F(PLUGIN_NAME_078);
+        break;
+      }
+
+    case PLUGIN_GET_DEVICEVALUENAMES:
+      {
+        strcpy_P(ExtraTaskSettings.TaskDeviceValueNames[0], PSTR(PLUGIN_VALUENAME1_078));
+        break;
+      }
+
+    case PLUGIN_WEBFORM_LOAD:
+      {
+        byte choice = CONFIG(0);
+        String options[11];
+        options[0] = F("SENSOR_TYPE_SINGLE");
+        options[1] = F("SENSOR_TYPE_TEMP_HUM");
+        options[2] = F("SENSOR_TYPE_TEMP_BARO");
+        options[3] = F("SENSOR_TYPE_TEMP_HUM_BARO");
+        options[4] = F("SENSOR_TYPE_DUAL");
+        options[5] = F("SENSOR_TYPE_TRIPLE");
+        options[6] = F("SENSOR_TYPE_QUAD");
+        options[7] = F("SENSOR_TYPE_SWITCH");
+        options[8] = F("SENSOR_TYPE_DIMMER");
+        options[9] = F("SENSOR_TYPE_LONG");
+        options[10] = F("SENSOR_TYPE_WIND");
+        int optionValues[11];
+        optionValues[0] = SENSOR_TYPE_SINGLE;
+        optionValues[1] = SENSOR_TYPE_TEMP_HUM;
+        optionValues[2] = SENSOR_TYPE_TEMP_BARO;
+        optionValues[3] = SENSOR_TYPE_TEMP_HUM_BARO;
+        optionValues[4] = SENSOR_TYPE_DUAL;
+        optionValues[5] = SENSOR_TYPE_TRIPLE;
+        optionValues[6] = SENSOR_TYPE_QUAD;
+        optionValues[7] = SENSOR_TYPE_SWITCH;
+        optionValues[8] = SENSOR_TYPE_DIMMER;
+        optionValues[9] = SENSOR_TYPE_LONG;
+        optionValues[10] = SENSOR_TYPE_WIND;
+        addFormSelector(F("Simulate Data Type"), F("plugin_078_sensortype"), 11, options, optionValues, choice );
+
+        String sources[P078_NR_SOURCES];
+        sources[P078_SOURCE_FILE] = F("File ");
+        sources[P078_SOURCE_FILE] += Plugin_078_fileName(event->TaskIndex);
+        sources[P078_SOURCE_SINE] = F("Sine");
+        sources[P078_SOURCE_SAWTOOTH] = F("Sawtooth");
+        sources[P078_SOURCE_SQUARE] = F("Square");
+        sources[P078_SOURCE_RANDOM_WALK] = F("Random walk");
+        sources[P078_SOURCE_COUNTER] = F("Counter");
+        addFormSelector(F("Source"), F("plugin_078_source"), P078_NR_SOURCES, sources, NULL, P078_SOURCE);
+        addFormNumericBox(F("Samples per second"), F("plugin_078_rate"), P078_RATE, 0, P078_MAX_RATE);
+        addFormNote(F("0 = one sample per interval"));
+        addFormCheckBox(F("Start again at the end of the file"), F("plugin_078_loop"), P078_LOOP);
+        addFormFloatNumberBox(F("Amplitude"), F("plugin_078_amplitude"), P078_AMPLITUDE, -1000000.0, 1000000.0);
+        addFormFloatNumberBox(F("Offset"), F("plugin_078_offset"), P078_OFFSET, -1000000.0, 1000000.0);
+        addFormNumericBox(F("Period (msec)"), F("plugin_078_period"), P078_PERIOD > 0 ? P078_PERIOD : P078_DEFAULT_PERIOD, 1, 86400000);
+
+        P078_data_struct* data = Plugin_078_data(event->TaskIndex);
+        if (data != NULL) {
+          String note = data->running ? F("Running, sample ") : F("Stopped, sample ");
+          note += data->index;
+          note += F(", dropped ");
+          note += data->dropped;
+          note += F(", file rewinds ");
+          note += data->rewinds;
+          addFormNote(note);
+        }
+        success = true;
+        break;
+      }
+
+    case PLUGIN_WEBFORM_SAVE:
+      {
+        CONFIG(0) = getFormItemInt(F("plugin_078_sensortype"));
+        P078_SOURCE = getFormItemInt(F("plugin_078_source"));
+        P078_RATE = getFormItemInt(F("plugin_078_rate"));
+        if (P078_RATE < 0 || P078_RATE > P078_MAX_RATE) P078_RATE = 0;
+        P078_LOOP = isFormItemChecked(F("plugin_078_loop"));
+        P078_AMPLITUDE = getFormItemFloat(F("plugin_078_amplitude"));
+        P078_OFFSET = getFormItemFloat(F("plugin_078_offset"));
+        P078_PERIOD = getFormItemInt(F("plugin_078_period"));
+        success = true;
+        break;
+      }
+
+    case PLUGIN_INIT:
+      {
+        P078_data_struct* data = new P078_data_struct();
+        initPluginTaskData(event->TaskIndex, data, sizeof(P078_data_struct));
+        Plugin_078_start(event, data);
+        success = true;
+        break;
+      }
+
+    case PLUGIN_FIFTY_PER_SECOND:
+      {
+        P078_data_struct* data = Plugin_078_data(event->TaskIndex);
+        if (data == NULL || !data->running || P078_RATE <= 0)
+          break;
+        const unsigned long due = static_cast<uint64_t>(micros() - data->startMicros) * P078_RATE / 1000000UL;
+        if (due - data->sent > P078_MAX_BURST) {
+          data->dropped += due - data->sent - P078_MAX_BURST;
+          data->sent = due - P078_MAX_BURST;
+        }
+        const byte TaskIndex = event->TaskIndex;
+        while (data->sent < due && data->running) {
+          ++data->sent;
+          // Reloads ExtraTaskSettings, does not use this event
+          SensorSendTask(TaskIndex);
+        }
+        success = true;
+        break;
+      }
+
+    case PLUGIN_READ:
+      {
+        P078_data_struct* data = Plugin_078_data(event->TaskIndex);
+        if (data == NULL || !data->running)
+          break;
+        event->sensorType = CONFIG(0);
+        if (P078_SOURCE == P078_SOURCE_FILE) {
+          if (!Plugin_078_readFile(event, data)) {
+            data->running = false;
+            addLog(LOG_LEVEL_INFO, F("Replay: End of the file"));
+            break;
+          }
+        } else {
+          const unsigned long msec = P078_RATE > 0 ? data->index * 1000UL / P078_RATE
+                                                   : data->index * Settings.TaskDeviceTimer[event->TaskIndex] * 1000UL;
+          for (byte x = 0; x < VARS_PER_TASK; ++x)
+            UserVar[event->BaseVarIndex + x] = Plugin_078_generate(event, data, x, msec);
+        }
+        ++data->index;
+        success = true;
+        break;
+      }
+
+    case PLUGIN_WRITE:
+      {
+        String command = parseString(string, 1);
+        if (command == F("replay") && event->Par1 == event->TaskIndex + 1)
+        {
+          P078_data_struct* data = Plugin_078_data(event->TaskIndex);
+          if (data != NULL) {
+            if (event->Par2 == 0)
+              data->running = false;
+            else
+              Plugin_078_start(event, data);
+            String log = F("Replay: Task ");
+            log += event->Par1;
+            log += data->running ? F(" started") : F(" stopped");
+            addLog(LOG_LEVEL_INFO, log);
+          }
+          success = true;
+        }
+        break;
+      }
+  }
+  return success;
+}
+#endif // USES_P078
@@ -33,6 +33,7 @@ Hints for plugin development:
      - instructions on commands (if any)
      - examples: plugin usage, command usage,...
  - when a plugin is removed (deleted), make sure you free any memory it uses. Use PLUGIN_EXIT for that
+ - keep the state per task in a struct derived from PluginTaskData_base instead of static arrays, see PluginTaskData.ino. It is deleted after PLUGIN_EXIT
  - if your plugin creates log entries, prefix your entries with your plugin id: "[Pxxx] my plugin did this"
  - if your plugin takes input from user and/or accepts/sends http commands, make sure you properly handle non-alphanumeric characters correctly
  - After ESP boots, all devices can send data instantly. If your plugin is for a sensor which sends data, ensure it doesn't need a delay before receiving data
@@ -97,6 +98,7 @@ boolean Plugin_xxx(byte function, struct EventStruct *event, String& string)
         Device[deviceCount].TimerOptional = false;
         Device[deviceCount].GlobalSyncOption = true;
         Device[deviceCount].DecimalsOnly = true;
+        Device[deviceCount].PeriodicCallbacks = PLUGIN_CALLBACK_TEN_PER_SECOND | PLUGIN_CALLBACK_ONCE_A_SECOND;
         break;
     }
 
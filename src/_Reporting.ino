@@ -19,6 +19,9 @@ void ReportStatus()
   addLog(LOG_LEVEL_INFO, log);
 
 
+  SocketLease lease(SOCKET_OTHER);
+  if (!lease.granted)
+    return;
   WiFiClient client;
   if (!client.connect(host.c_str(), 80))
   {
@@ -43,7 +46,7 @@ void ReportStatus()
   payload += host;
   payload += F("\r\n");
   payload += F("Connection: close\r\n");
-  payload += F("Content-Length: ");
+  payload += getWebString(WEB_STR_CONTENT_LENGTH);
   payload += String(body.length());
   payload += F("\r\n\r\n");
   payload += body;
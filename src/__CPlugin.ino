@@ -1,137 +1,117 @@
 //********************************************************************************
-// Initialize all Controller CPlugins that where defined earlier
-// and initialize the function call pointer into the CCPlugin array
+// Table of the controller plugins that where defined earlier, generated in flash by the
+// preprocessor. The #ifdef chain is in number order, so the table is sorted by number.
 //********************************************************************************
 
-static const char ADDCPLUGIN_ERROR[] PROGMEM = "System: Error - To much C-Plugins";
-
-// Because of compiler-bug (multiline defines gives an error if file ending is CRLF) the define is striped to a single line
-/*
-#define ADDCPLUGIN(NNN) \
-  if (x < CPLUGIN_MAX) \
-  { \
-    CPlugin_id[x] = CPLUGIN_ID_##NNN; \
-    CPlugin_ptr[x++] = &CPlugin_##NNN; \
-  } \
-  else \
-    addLog(LOG_LEVEL_ERROR, FPSTR(ADDCPLUGIN_ERROR));
-*/
-#define ADDCPLUGIN(NNN) if (x < CPLUGIN_MAX) { CPlugin_id[x] = CPLUGIN_ID_##NNN; CPlugin_ptr[x++] = &CPlugin_##NNN; } else addLog(LOG_LEVEL_ERROR, FPSTR(ADDCPLUGIN_ERROR));
-
-
-void CPluginInit(void)
-{
-  byte x;
-
-  // Clear pointer table for all plugins
-  for (x = 0; x < CPLUGIN_MAX; x++)
-  {
-    CPlugin_ptr[x] = 0;
-    CPlugin_id[x] = 0;
-  }
-
-  x = 0;
+#define CPLUGIN_ENTRY(NNN) { CPLUGIN_ID_##NNN, &CPlugin_##NNN },
 
+const PluginRegistryEntry CPluginRegistry[] PROGMEM = {
 #ifdef CPLUGIN_001
-  ADDCPLUGIN(001)
+  CPLUGIN_ENTRY(001)
 #endif
 
 #ifdef CPLUGIN_002
-  ADDCPLUGIN(002)
+  CPLUGIN_ENTRY(002)
 #endif
 
 #ifdef CPLUGIN_003
-  ADDCPLUGIN(003)
+  CPLUGIN_ENTRY(003)
 #endif
 
 #ifdef CPLUGIN_004
-  ADDCPLUGIN(004)
+  CPLUGIN_ENTRY(004)
 #endif
 
 #ifdef CPLUGIN_005
-  ADDCPLUGIN(005)
+  CPLUGIN_ENTRY(005)
 #endif
 
 #ifdef CPLUGIN_006
-  ADDCPLUGIN(006)
+  CPLUGIN_ENTRY(006)
 #endif
 
 #ifdef CPLUGIN_007
-  ADDCPLUGIN(007)
+  CPLUGIN_ENTRY(007)
 #endif
 
 #ifdef CPLUGIN_008
-  ADDCPLUGIN(008)
+  CPLUGIN_ENTRY(008)
 #endif
 
 #ifdef CPLUGIN_009
-  ADDCPLUGIN(009)
+  CPLUGIN_ENTRY(009)
 #endif
 
 #ifdef CPLUGIN_010
-  ADDCPLUGIN(010)
+  CPLUGIN_ENTRY(010)
 #endif
 
 #ifdef CPLUGIN_011
-  ADDCPLUGIN(011)
+  CPLUGIN_ENTRY(011)
 #endif
 
 #ifdef CPLUGIN_012
-  ADDCPLUGIN(012)
+  CPLUGIN_ENTRY(012)
 #endif
 
 #ifdef CPLUGIN_013
-  ADDCPLUGIN(013)
+  CPLUGIN_ENTRY(013)
 #endif
 
 #ifdef CPLUGIN_014
-  ADDCPLUGIN(014)
+  CPLUGIN_ENTRY(014)
 #endif
 
 #ifdef CPLUGIN_015
-  ADDCPLUGIN(015)
+  CPLUGIN_ENTRY(015)
 #endif
 
 #ifdef CPLUGIN_016
-  ADDCPLUGIN(016)
+  CPLUGIN_ENTRY(016)
 #endif
 
 #ifdef CPLUGIN_017
-  ADDCPLUGIN(017)
+  CPLUGIN_ENTRY(017)
 #endif
 
 #ifdef CPLUGIN_018
-  ADDCPLUGIN(018)
+  CPLUGIN_ENTRY(018)
 #endif
 
 #ifdef CPLUGIN_019
-  ADDCPLUGIN(019)
+  CPLUGIN_ENTRY(019)
 #endif
 
 #ifdef CPLUGIN_020
-  ADDCPLUGIN(020)
+  CPLUGIN_ENTRY(020)
 #endif
 
 #ifdef CPLUGIN_021
-  ADDCPLUGIN(021)
+  CPLUGIN_ENTRY(021)
 #endif
 
 #ifdef CPLUGIN_022
-  ADDCPLUGIN(022)
+  CPLUGIN_ENTRY(022)
 #endif
 
 #ifdef CPLUGIN_023
-  ADDCPLUGIN(023)
+  CPLUGIN_ENTRY(023)
 #endif
 
 #ifdef CPLUGIN_024
-  ADDCPLUGIN(024)
+  CPLUGIN_ENTRY(024)
 #endif
 
 #ifdef CPLUGIN_025
-  ADDCPLUGIN(025)
+  CPLUGIN_ENTRY(025)
 #endif
+  { 0, NULL }  // End of the table
+};
+const byte CPluginRegistryCount = sizeof(CPluginRegistry) / sizeof(CPluginRegistry[0]) - 1;
+static_assert(sizeof(CPluginRegistry) / sizeof(CPluginRegistry[0]) - 1 <= CPLUGIN_MAX, "Too many controller plugins, increase CPLUGIN_MAX");
 
+void CPluginInit(void)
+{
   CPluginCall(CPLUGIN_PROTOCOL_ADD, 0);
   CPluginCall(CPLUGIN_INIT, 0);
 }
@@ -148,11 +128,10 @@ byte CPluginCall(byte Function, struct EventStruct *event)
   {
     // Unconditional calls to all plugins
     case CPLUGIN_PROTOCOL_ADD:
-      for (x = 0; x < CPLUGIN_MAX; x++)
-        if (CPlugin_id[x] != 0){
-          checkRAM(F("CPluginCallADD"),x);
-          CPlugin_ptr[x](Function, event, dummyString);
-        }
+      for (x = 0; x < CPluginRegistryCount; x++) {
+        checkRAM(F("CPluginCallADD"),x);
+        getCPluginFunction(x)(Function, event, dummyString);
+      }
       return true;
       break;
 
@@ -161,8 +140,11 @@ byte CPluginCall(byte Function, struct EventStruct *event)
     case CPLUGIN_UDP_IN:
       for (byte x=0; x < CONTROLLER_MAX; x++)
         if (Settings.Protocol[x] != 0 && Settings.ControllerEnabled[x]) {
-          event->ProtocolIndex = getProtocolIndex(Settings.Protocol[x]);
-          CPlugin_ptr[event->ProtocolIndex](Function, event, dummyString);
+          event->ControllerIndex = x;
+          event->ProtocolIndex = getProtocolIndex_from_ControllerIndex(x);
+          START_HEAP_STATS_CONTROLLER;
+          getCPluginFunction(event->ProtocolIndex)(Function, event, dummyString);
+          STOP_HEAP_STATS_CONTROLLER(x, Function);
         }
       return true;
       break;
@@ -171,6 +153,19 @@ byte CPluginCall(byte Function, struct EventStruct *event)
   return false;
 }
 
+// Call a controller plugin function which may send data, timed per controller.
+boolean CPluginSendCall(byte Function, struct EventStruct *event)
+{
+  START_HEAP_STATS_CONTROLLER;
+  START_TIMER;
+  const boolean success = getCPluginFunction(event->ProtocolIndex)(Function, event, dummyString);
+  STOP_TIMER_CONTROLLER(event->ControllerIndex, CONTROLLER_SEND_STATS);
+  STOP_HEAP_STATS_CONTROLLER(event->ControllerIndex, Function);
+  if (Function == CPLUGIN_PROTOCOL_SEND && !success && event->ControllerIndex < CONTROLLER_MAX)
+    ++ControllerStats[event->ControllerIndex].failures;
+  return success;
+}
+
 // Check if there is any controller enabled.
 bool anyControllerEnabled() {
   for (byte i=0; i < CONTROLLER_MAX; i++) {
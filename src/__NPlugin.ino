@@ -136,6 +136,20 @@ void NPluginInit(void)
   NPluginCall(NPLUGIN_PROTOCOL_ADD, 0);
 }
 
+// NPLUGIN_TIMER_IN of the notification plugin after msecFromNow, e.g. to continue sending in the background.
+void setNotificationTimer(byte NotificationProtocolIndex, unsigned long msecFromNow)
+{
+  if (NotificationProtocolIndex >= NPLUGIN_MAX) return;
+  setTimer(NOTIFICATION_TIMER, NotificationProtocolIndex, msecFromNow);
+}
+
+void process_notification_timer(unsigned long NotificationProtocolIndex)
+{
+  if (NotificationProtocolIndex >= NPLUGIN_MAX || NPlugin_id[NotificationProtocolIndex] == 0) return;
+  PooledEvent pooled;
+  NPlugin_ptr[NotificationProtocolIndex](NPLUGIN_TIMER_IN, pooled.event, dummyString);
+}
+
 byte NPluginCall(byte Function, struct EventStruct *event)
 {
   int x;
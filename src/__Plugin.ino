@@ -1,1074 +1,1099 @@
 //********************************************************************************
-// Initialize all plugins that where defined earlier
-// and initialize the function call pointer into the plugin array
+// Table of the plugins that where defined earlier, generated in flash by the
+// preprocessor. The #ifdef chain is in number order, so the table is sorted by number.
 //********************************************************************************
 
-static const char ADDPLUGIN_ERROR[] PROGMEM = "System: Error - To much Plugins";
-
-// Because of compiler-bug (multiline defines gives an error if file ending is CRLF) the define is striped to a single line
-/*
-#define ADDPLUGIN(NNN) \
-  if (x < PLUGIN_MAX) \
-  { \
-    Plugin_id[x] = PLUGIN_ID_##NNN; \
-    Plugin_ptr[x++] = &Plugin_##NNN; \
-  } \
-  else \
-    addLog(LOG_LEVEL_ERROR, FPSTR(ADDPLUGIN_ERROR));
-*/
-#define ADDPLUGIN(NNN) if (x < PLUGIN_MAX) { Plugin_id[x] = PLUGIN_ID_##NNN; Plugin_ptr[x++] = &Plugin_##NNN; } else addLog(LOG_LEVEL_ERROR, FPSTR(ADDPLUGIN_ERROR));
-
-
-void PluginInit(void)
-{
-  byte x;
-
-  // Clear pointer table for all plugins
-  for (x = 0; x < PLUGIN_MAX; x++)
-  {
-    Plugin_ptr[x] = 0;
-    Plugin_id[x] = 0;
-  }
-  // Clear the cache.
-  for (x = 0; x < TASKS_MAX; x++)
-  {
-    Task_id_to_Plugin_id[x] = -1;
-  }
-
-  x = 0;
+#define PLUGIN_ENTRY(NNN) { PLUGIN_ID_##NNN, &Plugin_##NNN },
 
+const PluginRegistryEntry PluginRegistry[] PROGMEM = {
 #ifdef PLUGIN_001
-  ADDPLUGIN(001)
+  PLUGIN_ENTRY(001)
 #endif
 
 #ifdef PLUGIN_002
-  ADDPLUGIN(002)
+  PLUGIN_ENTRY(002)
 #endif
 
 #ifdef PLUGIN_003
-  ADDPLUGIN(003)
+  PLUGIN_ENTRY(003)
 #endif
 
 #ifdef PLUGIN_004
-  ADDPLUGIN(004)
+  PLUGIN_ENTRY(004)
 #endif
 
 #ifdef PLUGIN_005
-  ADDPLUGIN(005)
+  PLUGIN_ENTRY(005)
 #endif
 
 #ifdef PLUGIN_006
-  ADDPLUGIN(006)
+  PLUGIN_ENTRY(006)
 #endif
 
 #ifdef PLUGIN_007
-  ADDPLUGIN(007)
+  PLUGIN_ENTRY(007)
 #endif
 
 #ifdef PLUGIN_008
-  ADDPLUGIN(008)
+  PLUGIN_ENTRY(008)
 #endif
 
 #ifdef PLUGIN_009
-  ADDPLUGIN(009)
+  PLUGIN_ENTRY(009)
 #endif
 
 #ifdef PLUGIN_010
-  ADDPLUGIN(010)
+  PLUGIN_ENTRY(010)
 #endif
 
 #ifdef PLUGIN_011
-  ADDPLUGIN(011)
+  PLUGIN_ENTRY(011)
 #endif
 
 #ifdef PLUGIN_012
-  ADDPLUGIN(012)
+  PLUGIN_ENTRY(012)
 #endif
 
 #ifdef PLUGIN_013
-  ADDPLUGIN(013)
+  PLUGIN_ENTRY(013)
 #endif
 
 #ifdef PLUGIN_014
-  ADDPLUGIN(014)
+  PLUGIN_ENTRY(014)
 #endif
 
 #ifdef PLUGIN_015
-  ADDPLUGIN(015)
+  PLUGIN_ENTRY(015)
 #endif
 
 #ifdef PLUGIN_016
-  ADDPLUGIN(016)
+  PLUGIN_ENTRY(016)
 #endif
 
 #ifdef PLUGIN_017
-  ADDPLUGIN(017)
+  PLUGIN_ENTRY(017)
 #endif
 
 #ifdef PLUGIN_018
-  ADDPLUGIN(018)
+  PLUGIN_ENTRY(018)
 #endif
 
 #ifdef PLUGIN_019
-  ADDPLUGIN(019)
+  PLUGIN_ENTRY(019)
 #endif
 
 #ifdef PLUGIN_020
-  ADDPLUGIN(020)
+  PLUGIN_ENTRY(020)
 #endif
 
 #ifdef PLUGIN_021
-  ADDPLUGIN(021)
+  PLUGIN_ENTRY(021)
 #endif
 
 #ifdef PLUGIN_022
-  ADDPLUGIN(022)
+  PLUGIN_ENTRY(022)
 #endif
 
 #ifdef PLUGIN_023
-  ADDPLUGIN(023)
+  PLUGIN_ENTRY(023)
 #endif
 
 #ifdef PLUGIN_024
-  ADDPLUGIN(024)
+  PLUGIN_ENTRY(024)
 #endif
 
 #ifdef PLUGIN_025
-  ADDPLUGIN(025)
+  PLUGIN_ENTRY(025)
 #endif
 
 #ifdef PLUGIN_026
-  ADDPLUGIN(026)
+  PLUGIN_ENTRY(026)
 #endif
 
 #ifdef PLUGIN_027
-  ADDPLUGIN(027)
+  PLUGIN_ENTRY(027)
 #endif
 
 #ifdef PLUGIN_028
-  ADDPLUGIN(028)
+  PLUGIN_ENTRY(028)
 #endif
 
 #ifdef PLUGIN_029
-  ADDPLUGIN(029)
+  PLUGIN_ENTRY(029)
 #endif
 
 #ifdef PLUGIN_030
-  ADDPLUGIN(030)
+  PLUGIN_ENTRY(030)
 #endif
 
 #ifdef PLUGIN_031
-  ADDPLUGIN(031)
+  PLUGIN_ENTRY(031)
 #endif
 
 #ifdef PLUGIN_032
-  ADDPLUGIN(032)
+  PLUGIN_ENTRY(032)
 #endif
 
 #ifdef PLUGIN_033
-  ADDPLUGIN(033)
+  PLUGIN_ENTRY(033)
 #endif
 
 #ifdef PLUGIN_034
-  ADDPLUGIN(034)
+  PLUGIN_ENTRY(034)
 #endif
 
 #ifdef PLUGIN_035
-  ADDPLUGIN(035)
+  PLUGIN_ENTRY(035)
 #endif
 
 #ifdef PLUGIN_036
-  ADDPLUGIN(036)
+  PLUGIN_ENTRY(036)
 #endif
 
 #ifdef PLUGIN_037
-  ADDPLUGIN(037)
+  PLUGIN_ENTRY(037)
 #endif
 
 #ifdef PLUGIN_038
-  ADDPLUGIN(038)
+  PLUGIN_ENTRY(038)
 #endif
 
 #ifdef PLUGIN_039
-  ADDPLUGIN(039)
+  PLUGIN_ENTRY(039)
 #endif
 
 #ifdef PLUGIN_040
-  ADDPLUGIN(040)
+  PLUGIN_ENTRY(040)
 #endif
 
 #ifdef PLUGIN_041
-  ADDPLUGIN(041)
+  PLUGIN_ENTRY(041)
 #endif
 
 #ifdef PLUGIN_042
-  ADDPLUGIN(042)
+  PLUGIN_ENTRY(042)
 #endif
 
 #ifdef PLUGIN_043
-  ADDPLUGIN(043)
+  PLUGIN_ENTRY(043)
 #endif
 
 #ifdef PLUGIN_044
-  ADDPLUGIN(044)
+  PLUGIN_ENTRY(044)
 #endif
 
 #ifdef PLUGIN_045
-  ADDPLUGIN(045)
+  PLUGIN_ENTRY(045)
 #endif
 
 #ifdef PLUGIN_046
-  ADDPLUGIN(046)
+  PLUGIN_ENTRY(046)
 #endif
 
 #ifdef PLUGIN_047
-  ADDPLUGIN(047)
+  PLUGIN_ENTRY(047)
 #endif
 
 #ifdef PLUGIN_048
-  ADDPLUGIN(048)
+  PLUGIN_ENTRY(048)
 #endif
 
 #ifdef PLUGIN_049
-  ADDPLUGIN(049)
+  PLUGIN_ENTRY(049)
 #endif
 
 #ifdef PLUGIN_050
-  ADDPLUGIN(050)
+  PLUGIN_ENTRY(050)
 #endif
 
 #ifdef PLUGIN_051
-  ADDPLUGIN(051)
+  PLUGIN_ENTRY(051)
 #endif
 
 #ifdef PLUGIN_052
-  ADDPLUGIN(052)
+  PLUGIN_ENTRY(052)
 #endif
 
 #ifdef PLUGIN_053
-  ADDPLUGIN(053)
+  PLUGIN_ENTRY(053)
 #endif
 
 #ifdef PLUGIN_054
-  ADDPLUGIN(054)
+  PLUGIN_ENTRY(054)
 #endif
 
 #ifdef PLUGIN_055
-  ADDPLUGIN(055)
+  PLUGIN_ENTRY(055)
 #endif
 
 #ifdef PLUGIN_056
-  ADDPLUGIN(056)
+  PLUGIN_ENTRY(056)
 #endif
 
 #ifdef PLUGIN_057
-  ADDPLUGIN(057)
+  PLUGIN_ENTRY(057)
 #endif
 
 #ifdef PLUGIN_058
-  ADDPLUGIN(058)
+  PLUGIN_ENTRY(058)
 #endif
 
 #ifdef PLUGIN_059
-  ADDPLUGIN(059)
+  PLUGIN_ENTRY(059)
 #endif
 
 #ifdef PLUGIN_060
-  ADDPLUGIN(060)
+  PLUGIN_ENTRY(060)
 #endif
 
 #ifdef PLUGIN_061
-  ADDPLUGIN(061)
+  PLUGIN_ENTRY(061)
 #endif
 
 #ifdef PLUGIN_062
-  ADDPLUGIN(062)
+  PLUGIN_ENTRY(062)
 #endif
 
 #ifdef PLUGIN_063
-  ADDPLUGIN(063)
+  PLUGIN_ENTRY(063)
 #endif
 
 #ifdef PLUGIN_064
-  ADDPLUGIN(064)
+  PLUGIN_ENTRY(064)
 #endif
 
 #ifdef PLUGIN_065
-  ADDPLUGIN(065)
+  PLUGIN_ENTRY(065)
 #endif
 
 #ifdef PLUGIN_066
-  ADDPLUGIN(066)
+  PLUGIN_ENTRY(066)
 #endif
 
 #ifdef PLUGIN_067
-  ADDPLUGIN(067)
+  PLUGIN_ENTRY(067)
 #endif
 
 #ifdef PLUGIN_068
-  ADDPLUGIN(068)
+  PLUGIN_ENTRY(068)
 #endif
 
 #ifdef PLUGIN_069
-  ADDPLUGIN(069)
+  PLUGIN_ENTRY(069)
 #endif
 
 #ifdef PLUGIN_070
-  ADDPLUGIN(070)
+  PLUGIN_ENTRY(070)
 #endif
 
 #ifdef PLUGIN_071
-  ADDPLUGIN(071)
+  PLUGIN_ENTRY(071)
 #endif
 
 #ifdef PLUGIN_072
-  ADDPLUGIN(072)
+  PLUGIN_ENTRY(072)
 #endif
 
 #ifdef PLUGIN_073
-  ADDPLUGIN(073)
+  PLUGIN_ENTRY(073)
 #endif
 
 #ifdef PLUGIN_074
-  ADDPLUGIN(074)
+  PLUGIN_ENTRY(074)
 #endif
 
 #ifdef PLUGIN_075
-  ADDPLUGIN(075)
+  PLUGIN_ENTRY(075)
 #endif
 
 #ifdef PLUGIN_076
-  ADDPLUGIN(076)
+  PLUGIN_ENTRY(076)
 #endif
 
 #ifdef PLUGIN_077
-  ADDPLUGIN(077)
+  PLUGIN_ENTRY(077)
 #endif
 
 #ifdef PLUGIN_078
-  ADDPLUGIN(078)
+  PLUGIN_ENTRY(078)
 #endif
 
 #ifdef PLUGIN_079
-  ADDPLUGIN(079)
+  PLUGIN_ENTRY(079)
 #endif
 
 #ifdef PLUGIN_080
-  ADDPLUGIN(080)
+  PLUGIN_ENTRY(080)
 #endif
 
 #ifdef PLUGIN_081
-  ADDPLUGIN(081)
+  PLUGIN_ENTRY(081)
 #endif
 
 #ifdef PLUGIN_082
-  ADDPLUGIN(082)
+  PLUGIN_ENTRY(082)
 #endif
 
 #ifdef PLUGIN_083
-  ADDPLUGIN(083)
+  PLUGIN_ENTRY(083)
 #endif
 
 #ifdef PLUGIN_084
-  ADDPLUGIN(084)
+  PLUGIN_ENTRY(084)
 #endif
 
 #ifdef PLUGIN_085
-  ADDPLUGIN(085)
+  PLUGIN_ENTRY(085)
 #endif
 
 #ifdef PLUGIN_086
-  ADDPLUGIN(086)
+  PLUGIN_ENTRY(086)
 #endif
 
 #ifdef PLUGIN_087
-  ADDPLUGIN(087)
+  PLUGIN_ENTRY(087)
 #endif
 
 #ifdef PLUGIN_088
-  ADDPLUGIN(088)
+  PLUGIN_ENTRY(088)
 #endif
 
 #ifdef PLUGIN_089
-  ADDPLUGIN(089)
+  PLUGIN_ENTRY(089)
 #endif
 
 #ifdef PLUGIN_090
-  ADDPLUGIN(090)
+  PLUGIN_ENTRY(090)
 #endif
 
 #ifdef PLUGIN_091
-  ADDPLUGIN(091)
+  PLUGIN_ENTRY(091)
 #endif
 
 #ifdef PLUGIN_092
-  ADDPLUGIN(092)
+  PLUGIN_ENTRY(092)
 #endif
 
 #ifdef PLUGIN_093
-  ADDPLUGIN(093)
+  PLUGIN_ENTRY(093)
 #endif
 
 #ifdef PLUGIN_094
-  ADDPLUGIN(094)
+  PLUGIN_ENTRY(094)
 #endif
 
 #ifdef PLUGIN_095
-  ADDPLUGIN(095)
+  PLUGIN_ENTRY(095)
 #endif
 
 #ifdef PLUGIN_096
-  ADDPLUGIN(096)
+  PLUGIN_ENTRY(096)
 #endif
 
 #ifdef PLUGIN_097
-  ADDPLUGIN(097)
+  PLUGIN_ENTRY(097)
 #endif
 
 #ifdef PLUGIN_098
-  ADDPLUGIN(098)
+  PLUGIN_ENTRY(098)
 #endif
 
 #ifdef PLUGIN_099
-  ADDPLUGIN(099)
+  PLUGIN_ENTRY(099)
 #endif
 
 #ifdef PLUGIN_100
-  ADDPLUGIN(100)
+  PLUGIN_ENTRY(100)
 #endif
 
 #ifdef PLUGIN_101
-  ADDPLUGIN(101)
+  PLUGIN_ENTRY(101)
 #endif
 
 #ifdef PLUGIN_102
-  ADDPLUGIN(102)
+  PLUGIN_ENTRY(102)
 #endif
 
 #ifdef PLUGIN_103
-  ADDPLUGIN(103)
+  PLUGIN_ENTRY(103)
 #endif
 
 #ifdef PLUGIN_104
-  ADDPLUGIN(104)
+  PLUGIN_ENTRY(104)
 #endif
 
 #ifdef PLUGIN_105
-  ADDPLUGIN(105)
+  PLUGIN_ENTRY(105)
 #endif
 
 #ifdef PLUGIN_106
-  ADDPLUGIN(106)
+  PLUGIN_ENTRY(106)
 #endif
 
 #ifdef PLUGIN_107
-  ADDPLUGIN(107)
+  PLUGIN_ENTRY(107)
 #endif
 
 #ifdef PLUGIN_108
-  ADDPLUGIN(108)
+  PLUGIN_ENTRY(108)
 #endif
 
 #ifdef PLUGIN_109
-  ADDPLUGIN(109)
+  PLUGIN_ENTRY(109)
 #endif
 
 #ifdef PLUGIN_110
-  ADDPLUGIN(110)
+  PLUGIN_ENTRY(110)
 #endif
 
 #ifdef PLUGIN_111
-  ADDPLUGIN(111)
+  PLUGIN_ENTRY(111)
 #endif
 
 #ifdef PLUGIN_112
-  ADDPLUGIN(112)
+  PLUGIN_ENTRY(112)
 #endif
 
 #ifdef PLUGIN_113
-  ADDPLUGIN(113)
+  PLUGIN_ENTRY(113)
 #endif
 
 #ifdef PLUGIN_114
-  ADDPLUGIN(114)
+  PLUGIN_ENTRY(114)
 #endif
 
 #ifdef PLUGIN_115
-  ADDPLUGIN(115)
+  PLUGIN_ENTRY(115)
 #endif
 
 #ifdef PLUGIN_116
-  ADDPLUGIN(116)
+  PLUGIN_ENTRY(116)
 #endif
 
 #ifdef PLUGIN_117
-  ADDPLUGIN(117)
+  PLUGIN_ENTRY(117)
 #endif
 
 #ifdef PLUGIN_118
-  ADDPLUGIN(118)
+  PLUGIN_ENTRY(118)
 #endif
 
 #ifdef PLUGIN_119
-  ADDPLUGIN(119)
+  PLUGIN_ENTRY(119)
 #endif
 
 #ifdef PLUGIN_120
-  ADDPLUGIN(120)
+  PLUGIN_ENTRY(120)
 #endif
 
 #ifdef PLUGIN_121
-  ADDPLUGIN(121)
+  PLUGIN_ENTRY(121)
 #endif
 
 #ifdef PLUGIN_122
-  ADDPLUGIN(122)
+  PLUGIN_ENTRY(122)
 #endif
 
 #ifdef PLUGIN_123
-  ADDPLUGIN(123)
+  PLUGIN_ENTRY(123)
 #endif
 
 #ifdef PLUGIN_124
-  ADDPLUGIN(124)
+  PLUGIN_ENTRY(124)
 #endif
 
 #ifdef PLUGIN_125
-  ADDPLUGIN(125)
+  PLUGIN_ENTRY(125)
 #endif
 
 #ifdef PLUGIN_126
-  ADDPLUGIN(126)
+  PLUGIN_ENTRY(126)
 #endif
 
 #ifdef PLUGIN_127
-  ADDPLUGIN(127)
+  PLUGIN_ENTRY(127)
 #endif
 
 #ifdef PLUGIN_128
-  ADDPLUGIN(128)
+  PLUGIN_ENTRY(128)
 #endif
 
 #ifdef PLUGIN_129
-  ADDPLUGIN(129)
+  PLUGIN_ENTRY(129)
 #endif
 
 #ifdef PLUGIN_130
-  ADDPLUGIN(130)
+  PLUGIN_ENTRY(130)
 #endif
 
 #ifdef PLUGIN_131
-  ADDPLUGIN(131)
+  PLUGIN_ENTRY(131)
 #endif
 
 #ifdef PLUGIN_132
-  ADDPLUGIN(132)
+  PLUGIN_ENTRY(132)
 #endif
 
 #ifdef PLUGIN_133
-  ADDPLUGIN(133)
+  PLUGIN_ENTRY(133)
 #endif
 
 #ifdef PLUGIN_134
-  ADDPLUGIN(134)
+  PLUGIN_ENTRY(134)
 #endif
 
 #ifdef PLUGIN_135
-  ADDPLUGIN(135)
+  PLUGIN_ENTRY(135)
 #endif
 
 #ifdef PLUGIN_136
-  ADDPLUGIN(136)
+  PLUGIN_ENTRY(136)
 #endif
 
 #ifdef PLUGIN_137
-  ADDPLUGIN(137)
+  PLUGIN_ENTRY(137)
 #endif
 
 #ifdef PLUGIN_138
-  ADDPLUGIN(138)
+  PLUGIN_ENTRY(138)
 #endif
 
 #ifdef PLUGIN_139
-  ADDPLUGIN(139)
+  PLUGIN_ENTRY(139)
 #endif
 
 #ifdef PLUGIN_140
-  ADDPLUGIN(140)
+  PLUGIN_ENTRY(140)
 #endif
 
 #ifdef PLUGIN_141
-  ADDPLUGIN(141)
+  PLUGIN_ENTRY(141)
 #endif
 
 #ifdef PLUGIN_142
-  ADDPLUGIN(142)
+  PLUGIN_ENTRY(142)
 #endif
 
 #ifdef PLUGIN_143
-  ADDPLUGIN(143)
+  PLUGIN_ENTRY(143)
 #endif
 
 #ifdef PLUGIN_144
-  ADDPLUGIN(144)
+  PLUGIN_ENTRY(144)
 #endif
 
 #ifdef PLUGIN_145
-  ADDPLUGIN(145)
+  PLUGIN_ENTRY(145)
 #endif
 
 #ifdef PLUGIN_146
-  ADDPLUGIN(146)
+  PLUGIN_ENTRY(146)
 #endif
 
 #ifdef PLUGIN_147
-  ADDPLUGIN(147)
+  PLUGIN_ENTRY(147)
 #endif
 
 #ifdef PLUGIN_148
-  ADDPLUGIN(148)
+  PLUGIN_ENTRY(148)
 #endif
 
 #ifdef PLUGIN_149
-  ADDPLUGIN(149)
+  PLUGIN_ENTRY(149)
 #endif
 
 #ifdef PLUGIN_150
-  ADDPLUGIN(150)
+  PLUGIN_ENTRY(150)
 #endif
 
 #ifdef PLUGIN_151
-  ADDPLUGIN(151)
+  PLUGIN_ENTRY(151)
 #endif
 
 #ifdef PLUGIN_152
-  ADDPLUGIN(152)
+  PLUGIN_ENTRY(152)
 #endif
 
 #ifdef PLUGIN_153
-  ADDPLUGIN(153)
+  PLUGIN_ENTRY(153)
 #endif
 
 #ifdef PLUGIN_154
-  ADDPLUGIN(154)
+  PLUGIN_ENTRY(154)
 #endif
 
 #ifdef PLUGIN_155
-  ADDPLUGIN(155)
+  PLUGIN_ENTRY(155)
 #endif
 
 #ifdef PLUGIN_156
-  ADDPLUGIN(156)
+  PLUGIN_ENTRY(156)
 #endif
 
 #ifdef PLUGIN_157
-  ADDPLUGIN(157)
+  PLUGIN_ENTRY(157)
 #endif
 
 #ifdef PLUGIN_158
-  ADDPLUGIN(158)
+  PLUGIN_ENTRY(158)
 #endif
 
 #ifdef PLUGIN_159
-  ADDPLUGIN(159)
+  PLUGIN_ENTRY(159)
 #endif
 
 #ifdef PLUGIN_160
-  ADDPLUGIN(160)
+  PLUGIN_ENTRY(160)
 #endif
 
 #ifdef PLUGIN_161
-  ADDPLUGIN(161)
+  PLUGIN_ENTRY(161)
 #endif
 
 #ifdef PLUGIN_162
-  ADDPLUGIN(162)
+  PLUGIN_ENTRY(162)
 #endif
 
 #ifdef PLUGIN_163
-  ADDPLUGIN(163)
+  PLUGIN_ENTRY(163)
 #endif
 
 #ifdef PLUGIN_164
-  ADDPLUGIN(164)
+  PLUGIN_ENTRY(164)
 #endif
 
 #ifdef PLUGIN_165
-  ADDPLUGIN(165)
+  PLUGIN_ENTRY(165)
 #endif
 
 #ifdef PLUGIN_166
-  ADDPLUGIN(166)
+  PLUGIN_ENTRY(166)
 #endif
 
 #ifdef PLUGIN_167
-  ADDPLUGIN(167)
+  PLUGIN_ENTRY(167)
 #endif
 
 #ifdef PLUGIN_168
-  ADDPLUGIN(168)
+  PLUGIN_ENTRY(168)
 #endif
 
 #ifdef PLUGIN_169
-  ADDPLUGIN(169)
+  PLUGIN_ENTRY(169)
 #endif
 
 #ifdef PLUGIN_170
-  ADDPLUGIN(170)
+  PLUGIN_ENTRY(170)
 #endif
 
 #ifdef PLUGIN_171
-  ADDPLUGIN(171)
+  PLUGIN_ENTRY(171)
 #endif
 
 #ifdef PLUGIN_172
-  ADDPLUGIN(172)
+  PLUGIN_ENTRY(172)
 #endif
 
 #ifdef PLUGIN_173
-  ADDPLUGIN(173)
+  PLUGIN_ENTRY(173)
 #endif
 
 #ifdef PLUGIN_174
-  ADDPLUGIN(174)
+  PLUGIN_ENTRY(174)
 #endif
 
 #ifdef PLUGIN_175
-  ADDPLUGIN(175)
+  PLUGIN_ENTRY(175)
 #endif
 
 #ifdef PLUGIN_176
-  ADDPLUGIN(176)
+  PLUGIN_ENTRY(176)
 #endif
 
 #ifdef PLUGIN_177
-  ADDPLUGIN(177)
+  PLUGIN_ENTRY(177)
 #endif
 
 #ifdef PLUGIN_178
-  ADDPLUGIN(178)
+  PLUGIN_ENTRY(178)
 #endif
 
 #ifdef PLUGIN_179
-  ADDPLUGIN(179)
+  PLUGIN_ENTRY(179)
 #endif
 
 #ifdef PLUGIN_180
-  ADDPLUGIN(180)
+  PLUGIN_ENTRY(180)
 #endif
 
 #ifdef PLUGIN_181
-  ADDPLUGIN(181)
+  PLUGIN_ENTRY(181)
 #endif
 
 #ifdef PLUGIN_182
-  ADDPLUGIN(182)
+  PLUGIN_ENTRY(182)
 #endif
 
 #ifdef PLUGIN_183
-  ADDPLUGIN(183)
+  PLUGIN_ENTRY(183)
 #endif
 
 #ifdef PLUGIN_184
-  ADDPLUGIN(184)
+  PLUGIN_ENTRY(184)
 #endif
 
 #ifdef PLUGIN_185
-  ADDPLUGIN(185)
+  PLUGIN_ENTRY(185)
 #endif
 
 #ifdef PLUGIN_186
-  ADDPLUGIN(186)
+  PLUGIN_ENTRY(186)
 #endif
 
 #ifdef PLUGIN_187
-  ADDPLUGIN(187)
+  PLUGIN_ENTRY(187)
 #endif
 
 #ifdef PLUGIN_188
-  ADDPLUGIN(188)
+  PLUGIN_ENTRY(188)
 #endif
 
 #ifdef PLUGIN_189
-  ADDPLUGIN(189)
+  PLUGIN_ENTRY(189)
 #endif
 
 #ifdef PLUGIN_190
-  ADDPLUGIN(190)
+  PLUGIN_ENTRY(190)
 #endif
 
 #ifdef PLUGIN_191
-  ADDPLUGIN(191)
+  PLUGIN_ENTRY(191)
 #endif
 
 #ifdef PLUGIN_192
-  ADDPLUGIN(192)
+  PLUGIN_ENTRY(192)
 #endif
 
 #ifdef PLUGIN_193
-  ADDPLUGIN(193)
+  PLUGIN_ENTRY(193)
 #endif
 
 #ifdef PLUGIN_194
-  ADDPLUGIN(194)
+  PLUGIN_ENTRY(194)
 #endif
 
 #ifdef PLUGIN_195
-  ADDPLUGIN(195)
+  PLUGIN_ENTRY(195)
 #endif
 
 #ifdef PLUGIN_196
-  ADDPLUGIN(196)
+  PLUGIN_ENTRY(196)
 #endif
 
 #ifdef PLUGIN_197
-  ADDPLUGIN(197)
+  PLUGIN_ENTRY(197)
 #endif
 
 #ifdef PLUGIN_198
-  ADDPLUGIN(198)
+  PLUGIN_ENTRY(198)
 #endif
 
 #ifdef PLUGIN_199
-  ADDPLUGIN(199)
+  PLUGIN_ENTRY(199)
 #endif
 
 #ifdef PLUGIN_200
-  ADDPLUGIN(200)
+  PLUGIN_ENTRY(200)
 #endif
 
 #ifdef PLUGIN_201
-  ADDPLUGIN(201)
+  PLUGIN_ENTRY(201)
 #endif
 
 #ifdef PLUGIN_202
-  ADDPLUGIN(202)
+  PLUGIN_ENTRY(202)
 #endif
 
 #ifdef PLUGIN_203
-  ADDPLUGIN(203)
+  PLUGIN_ENTRY(203)
 #endif
 
 #ifdef PLUGIN_204
-  ADDPLUGIN(204)
+  PLUGIN_ENTRY(204)
 #endif
 
 #ifdef PLUGIN_205
-  ADDPLUGIN(205)
+  PLUGIN_ENTRY(205)
 #endif
 
 #ifdef PLUGIN_206
-  ADDPLUGIN(206)
+  PLUGIN_ENTRY(206)
 #endif
 
 #ifdef PLUGIN_207
-  ADDPLUGIN(207)
+  PLUGIN_ENTRY(207)
 #endif
 
 #ifdef PLUGIN_208
-  ADDPLUGIN(208)
+  PLUGIN_ENTRY(208)
 #endif
 
 #ifdef PLUGIN_209
-  ADDPLUGIN(209)
+  PLUGIN_ENTRY(209)
 #endif
 
 #ifdef PLUGIN_210
-  ADDPLUGIN(210)
+  PLUGIN_ENTRY(210)
 #endif
 
 #ifdef PLUGIN_211
-  ADDPLUGIN(211)
+  PLUGIN_ENTRY(211)
 #endif
 
 #ifdef PLUGIN_212
-  ADDPLUGIN(212)
+  PLUGIN_ENTRY(212)
 #endif
 
 #ifdef PLUGIN_213
-  ADDPLUGIN(213)
+  PLUGIN_ENTRY(213)
 #endif
 
 #ifdef PLUGIN_214
-  ADDPLUGIN(214)
+  PLUGIN_ENTRY(214)
 #endif
 
 #ifdef PLUGIN_215
-  ADDPLUGIN(215)
+  PLUGIN_ENTRY(215)
 #endif
 
 #ifdef PLUGIN_216
-  ADDPLUGIN(216)
+  PLUGIN_ENTRY(216)
 #endif
 
 #ifdef PLUGIN_217
-  ADDPLUGIN(217)
+  PLUGIN_ENTRY(217)
 #endif
 
 #ifdef PLUGIN_218
-  ADDPLUGIN(218)
+  PLUGIN_ENTRY(218)
 #endif
 
 #ifdef PLUGIN_219
-  ADDPLUGIN(219)
+  PLUGIN_ENTRY(219)
 #endif
 
 #ifdef PLUGIN_220
-  ADDPLUGIN(220)
+  PLUGIN_ENTRY(220)
 #endif
 
 #ifdef PLUGIN_221
-  ADDPLUGIN(221)
+  PLUGIN_ENTRY(221)
 #endif
 
 #ifdef PLUGIN_222
-  ADDPLUGIN(222)
+  PLUGIN_ENTRY(222)
 #endif
 
 #ifdef PLUGIN_223
-  ADDPLUGIN(223)
+  PLUGIN_ENTRY(223)
 #endif
 
 #ifdef PLUGIN_224
-  ADDPLUGIN(224)
+  PLUGIN_ENTRY(224)
 #endif
 
 #ifdef PLUGIN_225
-  ADDPLUGIN(225)
+  PLUGIN_ENTRY(225)
 #endif
 
 #ifdef PLUGIN_226
-  ADDPLUGIN(226)
+  PLUGIN_ENTRY(226)
 #endif
 
 #ifdef PLUGIN_227
-  ADDPLUGIN(227)
+  PLUGIN_ENTRY(227)
 #endif
 
 #ifdef PLUGIN_228
-  ADDPLUGIN(228)
+  PLUGIN_ENTRY(228)
 #endif
 
 #ifdef PLUGIN_229
-  ADDPLUGIN(229)
+  PLUGIN_ENTRY(229)
 #endif
 
 #ifdef PLUGIN_230
-  ADDPLUGIN(230)
+  PLUGIN_ENTRY(230)
 #endif
 
 #ifdef PLUGIN_231
-  ADDPLUGIN(231)
+  PLUGIN_ENTRY(231)
 #endif
 
 #ifdef PLUGIN_232
-  ADDPLUGIN(232)
+  PLUGIN_ENTRY(232)
 #endif
 
 #ifdef PLUGIN_233
-  ADDPLUGIN(233)
+  PLUGIN_ENTRY(233)
 #endif
 
 #ifdef PLUGIN_234
-  ADDPLUGIN(234)
+  PLUGIN_ENTRY(234)
 #endif
 
 #ifdef PLUGIN_235
-  ADDPLUGIN(235)
+  PLUGIN_ENTRY(235)
 #endif
 
 #ifdef PLUGIN_236
-  ADDPLUGIN(236)
+  PLUGIN_ENTRY(236)
 #endif
 
 #ifdef PLUGIN_237
-  ADDPLUGIN(237)
+  PLUGIN_ENTRY(237)
 #endif
 
 #ifdef PLUGIN_238
-  ADDPLUGIN(238)
+  PLUGIN_ENTRY(238)
 #endif
 
 #ifdef PLUGIN_239
-  ADDPLUGIN(239)
+  PLUGIN_ENTRY(239)
 #endif
 
 #ifdef PLUGIN_240
-  ADDPLUGIN(240)
+  PLUGIN_ENTRY(240)
 #endif
 
 #ifdef PLUGIN_241
-  ADDPLUGIN(241)
+  PLUGIN_ENTRY(241)
 #endif
 
 #ifdef PLUGIN_242
-  ADDPLUGIN(242)
+  PLUGIN_ENTRY(242)
 #endif
 
 #ifdef PLUGIN_243
-  ADDPLUGIN(243)
+  PLUGIN_ENTRY(243)
 #endif
 
 #ifdef PLUGIN_244
-  ADDPLUGIN(244)
+  PLUGIN_ENTRY(244)
 #endif
 
 #ifdef PLUGIN_245
-  ADDPLUGIN(245)
+  PLUGIN_ENTRY(245)
 #endif
 
 #ifdef PLUGIN_246
-  ADDPLUGIN(246)
+  PLUGIN_ENTRY(246)
 #endif
 
 #ifdef PLUGIN_247
-  ADDPLUGIN(247)
+  PLUGIN_ENTRY(247)
 #endif
 
 #ifdef PLUGIN_248
-  ADDPLUGIN(248)
+  PLUGIN_ENTRY(248)
 #endif
 
 #ifdef PLUGIN_249
-  ADDPLUGIN(249)
+  PLUGIN_ENTRY(249)
 #endif
 
 #ifdef PLUGIN_250
-  ADDPLUGIN(250)
+  PLUGIN_ENTRY(250)
 #endif
 
 #ifdef PLUGIN_251
-  ADDPLUGIN(251)
+  PLUGIN_ENTRY(251)
 #endif
 
 #ifdef PLUGIN_252
-  ADDPLUGIN(252)
+  PLUGIN_ENTRY(252)
 #endif
 
 #ifdef PLUGIN_253
-  ADDPLUGIN(253)
+  PLUGIN_ENTRY(253)
 #endif
 
 #ifdef PLUGIN_254
-  ADDPLUGIN(254)
+  PLUGIN_ENTRY(254)
 #endif
 
 #ifdef PLUGIN_255
-  ADDPLUGIN(255)
+  PLUGIN_ENTRY(255)
 #endif
+  { 0, NULL }  // End of the table
+};
+const byte PluginRegistryCount = sizeof(PluginRegistry) / sizeof(PluginRegistry[0]) - 1;
+static_assert(sizeof(PluginRegistry) / sizeof(PluginRegistry[0]) - 1 <= PLUGIN_MAX, "Too many plugins, increase PLUGIN_MAX");
+
+void PluginInit(void)
+{
+  // Clear the cache.
+  for (byte x = 0; x < TASKS_MAX; x++)
+  {
+    Task_id_to_Plugin_id[x] = -1;
+  }
 
   PluginCall(PLUGIN_DEVICE_ADD, 0, dummyString);
-  PluginCall(PLUGIN_INIT_ALL, 0, dummyString);
+  buildDeviceIndexByNumber();
+  // Device[] is now known, so the periodic callback subscriptions can be collected.
+  updateTaskPluginCache();
+  buildSortedDeviceIndex();
+  // PLUGIN_INIT per task from the scheduler, see TaskInit.ino
+  scheduleTaskInitAll();
 
 }
 
+// Map the plugin numbers to the device index, Device[] does not change after boot.
+void buildDeviceIndexByNumber() {
+  byte maxNumber = 0;
+  for (int x = 0; x <= deviceCount; ++x) {
+    if (Device[x].Number > maxNumber) maxNumber = Device[x].Number;
+  }
+  DeviceIndex_by_Number.assign(maxNumber + 1, 0);
+  for (int x = deviceCount; x >= 0; --x) {
+    // First match wins, like the linear search did.
+    DeviceIndex_by_Number[Device[x].Number] = x;
+  }
+  DeviceIndex_by_Number[0] = 0;
+}
+
+// Sort the plugins by name for the device selector. The plugin set is fixed
+// at build time, so this is done once and each name is fetched only once.
+void buildSortedDeviceIndex() {
+  const int count = deviceCount + 1;
+  DeviceIndex_sorted.resize(count);
+  std::vector<String> names(count);
+  for (int x = 0; x < count; ++x) {
+    DeviceIndex_sorted[x] = x;
+    names[x] = getPluginNameFromDeviceIndex(x);
+  }
+  // Insertion sort, only a few dozen entries
+  for (int i = 1; i < count; ++i) {
+    const byte current = DeviceIndex_sorted[i];
+    int j = i;
+    while (j > 0 && names[current].compareTo(names[DeviceIndex_sorted[j - 1]]) < 0) {
+      DeviceIndex_sorted[j] = DeviceIndex_sorted[j - 1];
+      --j;
+    }
+    DeviceIndex_sorted[j] = current;
+  }
+}
+
+int getPluginId(byte taskId) HOT_IRAM_ATTR;
+int findPluginIndex(byte number) HOT_IRAM_ATTR;
+
 int getPluginId(byte taskId) {
   if (taskId < TASKS_MAX) {
     int retry = 1;
     while (retry >= 0) {
       int plugin = Task_id_to_Plugin_id[taskId];
-      if (plugin >= 0 && plugin < PLUGIN_MAX) {
-        if (Plugin_id[plugin] == Settings.TaskDeviceNumber[taskId])
+      if (plugin >= 0 && plugin < PluginRegistryCount) {
+        if (getPluginNumber(plugin) == Settings.TaskDeviceNumber[taskId])
           return plugin;
       }
       updateTaskPluginCache();
@@ -1078,16 +1103,60 @@ int getPluginId(byte taskId) {
   return -1;
 }
 
+// Index of the plugin in PluginRegistry, -1 when not built in.
+int findPluginIndex(byte number) {
+  if (number == 0) return -1;
+  int first = 0;
+  int last = PluginRegistryCount - 1;
+  while (first <= last) {
+    const int middle = (first + last) / 2;
+    const byte middleNumber = getPluginNumber(middle);
+    if (middleNumber == number) return middle;
+    if (number < middleNumber)
+      last = middle - 1;
+    else
+      first = middle + 1;
+  }
+  return -1;
+}
+
 void updateTaskPluginCache() {
   ++countFindPluginId; // Used for statistics.
-  Task_id_to_Plugin_id.resize(TASKS_MAX);
   for (byte y = 0; y < TASKS_MAX; ++y) {
-    Task_id_to_Plugin_id[y] = -1;
-    bool foundPlugin = false;
-    for (byte x = 0; x < PLUGIN_MAX && !foundPlugin; ++x) {
-      if (Plugin_id[x] != 0 && Plugin_id[x] == Settings.TaskDeviceNumber[y]) {
-        foundPlugin = true;
-        Task_id_to_Plugin_id[y] = x;
+    Task_id_to_Plugin_id[y] = findPluginIndex(Settings.TaskDeviceNumber[y]);
+    Task_id_to_DeviceIndex[y] = getDeviceIndex(Settings.TaskDeviceNumber[y]);
+  }
+  for (byte x = 0; x < CONTROLLER_MAX; ++x) {
+    Controller_id_to_ProtocolIndex[x] = getProtocolIndex(Settings.Protocol[x]);
+  }
+  for (byte x = 0; x < NOTIFICATION_MAX; ++x) {
+    Notification_id_to_NPluginIndex[x] = getNotificationProtocolIndex(Settings.Notification[x]);
+  }
+  updatePeriodicTaskList();
+  planTaskPhases();
+}
+
+// Index in periodicTaskList for the periodic plugin functions, -1 for all others.
+int getPeriodicCallbackType(byte Function) {
+  switch (Function) {
+    case PLUGIN_FIFTY_PER_SECOND: return 0;
+    case PLUGIN_TEN_PER_SECOND:   return 1;
+    case PLUGIN_ONCE_A_SECOND:    return 2;
+  }
+  return -1;
+}
+
+void updatePeriodicTaskList() {
+  for (byte i = 0; i < PLUGIN_CALLBACK_NR_TYPES; ++i) {
+    periodicTaskList.count[i] = 0;
+  }
+  for (byte y = 0; y < TASKS_MAX; ++y) {
+    if (Task_id_to_Plugin_id[y] < 0) continue;
+    const byte DeviceIndex = Task_id_to_DeviceIndex[y];
+    const byte subscribed = Device[DeviceIndex].PeriodicCallbacks;
+    for (byte i = 0; i < PLUGIN_CALLBACK_NR_TYPES; ++i) {
+      if (subscribed & (1 << i)) {
+        periodicTaskList.tasks[i][periodicTaskList.count[i]++] = y;
       }
     }
   }
@@ -1111,12 +1180,10 @@ byte PluginCall(byte Function, struct EventStruct *event, String& str)
     // Unconditional calls to all plugins
     case PLUGIN_DEVICE_ADD:
     case PLUGIN_UNCONDITIONAL_POLL:
-      for (byte x = 0; x < PLUGIN_MAX; x++) {
-        if (Plugin_id[x] != 0){
-          START_TIMER;
-          Plugin_ptr[x](Function, event, str);
-          STOP_TIMER_TASK(x,Function);
-        }
+      for (byte x = 0; x < PluginRegistryCount; x++) {
+        START_TIMER;
+        getPluginFunction(x)(Function, event, str);
+        STOP_TIMER_TASK(x,Function);
       }
       return true;
       break;
@@ -1133,24 +1200,29 @@ byte PluginCall(byte Function, struct EventStruct *event, String& str)
             {
               const int x = getPluginId(y);
               if (x >= 0) {
-                byte DeviceIndex = getDeviceIndex(Settings.TaskDeviceNumber[y]);
+                byte DeviceIndex = getDeviceIndex_from_TaskIndex(y);
                 TempEvent.TaskIndex = y;
                 TempEvent.BaseVarIndex = y * VARS_PER_TASK;
                 TempEvent.sensorType = Device[DeviceIndex].VType;
                 checkRAM(F("PluginCall_s"),x);
+                START_HEAP_STATS(Function);
+                I2C_setTaskClock(y);
                 START_TIMER;
-                bool retval = (Plugin_ptr[x](Function, &TempEvent, str));
+                bool retval = (getPluginFunction(x)(Function, &TempEvent, str));
+                I2C_clearTaskClock();
                 STOP_TIMER_TASK(x,Function);
+                STOP_HEAP_STATS_TASK(y,Function);
+                // The values may be changed by the plugin, publish them for the readers.
+                publishTaskValues(y);
                 if (retval) return true;
               }
             }
           }
         }
         // @FIXME TD-er: work-around as long as gpio command is still performed in P001_switch.
-        for (byte x = 0; x < PLUGIN_MAX; x++)
-          if (Plugin_id[x] != 0)
-            if (Plugin_ptr[x](Function, event, str))
-              return true;
+        for (byte x = 0; x < PluginRegistryCount; x++)
+          if (getPluginFunction(x)(Function, event, str))
+            return true;
       }
       break;
 
@@ -1164,14 +1236,19 @@ byte PluginCall(byte Function, struct EventStruct *event, String& str)
           {
             const int x = getPluginId(y);
             if (x >= 0) {
-              byte DeviceIndex = getDeviceIndex(Settings.TaskDeviceNumber[y]);
+              byte DeviceIndex = getDeviceIndex_from_TaskIndex(y);
               TempEvent.TaskIndex = y;
               TempEvent.BaseVarIndex = y * VARS_PER_TASK;
               //TempEvent.idx = Settings.TaskDeviceID[y]; todo check
               TempEvent.sensorType = Device[DeviceIndex].VType;
+              START_HEAP_STATS(Function);
+              I2C_setTaskClock(y);
               START_TIMER;
-              bool retval =  (Plugin_ptr[x](Function, &TempEvent, str));
+              bool retval =  (getPluginFunction(x)(Function, &TempEvent, str));
+              I2C_clearTaskClock();
               STOP_TIMER_TASK(x,Function);
+              STOP_HEAP_STATS_TASK(y,Function);
+              publishTaskValues(y);
               if (retval){
                 checkRAM(F("PluginCallUDP"),x);
                 return true;
@@ -1183,10 +1260,41 @@ byte PluginCall(byte Function, struct EventStruct *event, String& str)
         break;
       }
 
-    // Call to all plugins that are used in a task
+    // Call to all tasks running a plugin which subscribed to this periodic call
     case PLUGIN_ONCE_A_SECOND:
     case PLUGIN_TEN_PER_SECOND:
     case PLUGIN_FIFTY_PER_SECOND:
+      {
+        const int type = getPeriodicCallbackType(Function);
+        for (byte i = 0; i < periodicTaskList.count[type]; ++i)
+        {
+          const byte y = periodicTaskList.tasks[type][i];
+          if (Settings.TaskDeviceEnabled[y] && Settings.TaskDeviceDataFeed[y] == 0 && taskInitReady(y))
+          {
+            const int x = getPluginId(y);
+            if (x >= 0) {
+              byte DeviceIndex = getDeviceIndex_from_TaskIndex(y);
+              TempEvent.TaskIndex = y;
+              TempEvent.BaseVarIndex = y * VARS_PER_TASK;
+              TempEvent.sensorType = Device[DeviceIndex].VType;
+              TempEvent.OriginTaskIndex = event->TaskIndex;
+              checkRAM(F("PluginCall_s"),x);
+              START_HEAP_STATS(Function);
+              I2C_setTaskClock(y);
+              START_TIMER;
+              getPluginFunction(x)(Function, &TempEvent, str);
+              I2C_clearTaskClock();
+              STOP_TIMER_TASK(x,Function);
+              STOP_HEAP_STATS_TASK(y,Function);
+              publishTaskValues(y);
+            }
+          }
+        }
+        return true;
+        break;
+      }
+
+    // Call to all plugins that are used in a task
     case PLUGIN_INIT_ALL:
     case PLUGIN_CLOCK_IN:
     case PLUGIN_EVENT_OUT:
@@ -1201,7 +1309,7 @@ byte PluginCall(byte Function, struct EventStruct *event, String& str)
             {
               const int x = getPluginId(y);
               if (x >= 0) {
-                byte DeviceIndex = getDeviceIndex(Settings.TaskDeviceNumber[y]);
+                byte DeviceIndex = getDeviceIndex_from_TaskIndex(y);
                 TempEvent.TaskIndex = y;
                 TempEvent.BaseVarIndex = y * VARS_PER_TASK;
                 //TempEvent.idx = Settings.TaskDeviceID[y]; todo check
@@ -1211,10 +1319,20 @@ byte PluginCall(byte Function, struct EventStruct *event, String& str)
                 if (Function == PLUGIN_INIT) {
                   // Schedule the plugin to be read.
                   schedule_task_device_timer_at_init(TempEvent.TaskIndex);
+                  clearTaskValueTypes(TempEvent.TaskIndex);
                 }
+                if (Function == PLUGIN_INIT)
+                  taskInitStart(y);
+                START_HEAP_STATS(Function);
+                I2C_setTaskClock(y);
                 START_TIMER;
-                Plugin_ptr[x](Function, &TempEvent, str);
+                getPluginFunction(x)(Function, &TempEvent, str);
+                I2C_clearTaskClock();
                 STOP_TIMER_TASK(x,Function);
+                STOP_HEAP_STATS_TASK(y,Function);
+                publishTaskValues(y);
+                if (Function == PLUGIN_INIT)
+                  taskInitReturned(y);
               }
             }
           }
@@ -1233,15 +1351,17 @@ byte PluginCall(byte Function, struct EventStruct *event, String& str)
     case PLUGIN_GET_DEVICEVALUENAMES:
     case PLUGIN_GET_DEVICEGPIONAMES:
     case PLUGIN_READ:
+    case PLUGIN_INTERRUPT_EVENT:
     case PLUGIN_SET_CONFIG:
     case PLUGIN_GET_CONFIG:
     {
       const int x = getPluginId(event->TaskIndex);
       if (x >= 0) {
-        if (Plugin_id[x] != 0 ) {
+        if (getPluginNumber(x) != 0 ) {
           if (Function == PLUGIN_INIT) {
             // Schedule the plugin to be read.
             schedule_task_device_timer_at_init(event->TaskIndex);
+            clearTaskValueTypes(event->TaskIndex);
           }
           if (Function != PLUGIN_GET_DEVICEVALUENAMES) {
             // LoadTaskSettings may call PLUGIN_GET_DEVICEVALUENAMES.
@@ -1250,12 +1370,27 @@ byte PluginCall(byte Function, struct EventStruct *event, String& str)
 
           event->BaseVarIndex = event->TaskIndex * VARS_PER_TASK;
           checkRAM(F("PluginCall_init"),x);
+          if (Function == PLUGIN_INIT)
+            taskInitStart(event->TaskIndex);
+          START_HEAP_STATS(Function);
+          I2C_setTaskClock(event->TaskIndex);
           START_TIMER;
-          bool retval =  Plugin_ptr[x](Function, event, str);
+          bool retval =  getPluginFunction(x)(Function, event, str);
+          if (Function == PLUGIN_EXIT) {
+            clearPluginTaskData(event->TaskIndex);
+            taskInitClear(event->TaskIndex);
+          }
+          I2C_clearTaskClock();
           if (Function == PLUGIN_GET_DEVICEVALUENAMES) {
             ExtraTaskSettings.TaskIndex = event->TaskIndex;
           }
           STOP_TIMER_TASK(x,Function);
+          STOP_HEAP_STATS_TASK(event->TaskIndex,Function);
+          // After PLUGIN_READ the formulas are applied first, the values are published by sendData().
+          if (Function != PLUGIN_READ)
+            publishTaskValues(event->TaskIndex);
+          if (Function == PLUGIN_INIT)
+            taskInitReturned(event->TaskIndex);
           return retval;
         }
       }
@@ -444,6 +444,7 @@ To create/register a plugin, you have to :
     #define USES_P073   // 7DG
     #define USES_P074   // TSL2561
     #define USES_P075   // Nextion
+    #define USES_P078   // Replay
 #endif
 
 
@@ -553,3 +554,7 @@ To create/register a plugin, you have to :
 #include <the_required_lib.h>
 #endif
 */
+
+#if defined(USES_P038) || defined(USES_P041) || defined(USES_P042) || defined(USES_P070)
+  #define USES_NEOPIXEL_OUTPUT   // NeoPixelOutput.ino
+#endif
@@ -0,0 +1,117 @@
+#!/usr/bin/env python
+########################################################
+#
+# Generate gzip compressed copies of the static web data
+#
+# Reads the CSS and favicon from src/WebStaticData.h and writes
+# src/WebStaticData_gz.h, with a content hash to be used as ETag.
+# Run by PlatformIO before building (extra_scripts), or by hand:
+#   python static_data_gz.py
+#
+########################################################
+import gzip
+import hashlib
+import io
+import os
+import re
+
+try:
+    SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+except NameError:
+    SCRIPT_DIR = os.getcwd()  # PlatformIO runs the extra scripts from the project directory
+SRC_DIR = os.path.join(SCRIPT_DIR, 'src')
+INPUT = os.path.join(SRC_DIR, 'WebStaticData.h')
+OUTPUT = os.path.join(SRC_DIR, 'WebStaticData_gz.h')
+
+# name in WebStaticData.h, text (string literals) or binary (hex bytes)
+ASSETS = [
+    ('pgDefaultCSS', 'text'),
+    ('favicon_8b_ico', 'binary'),
+]
+
+ESCAPES = {'n': b'\n', 'r': b'\r', 't': b'\t', '0': b'\0', '\\': b'\\', '"': b'"', "'": b"'"}
+
+
+def array_body(source, name):
+    match = re.search(r'static const char ' + name + r'\[\] PROGMEM = \{(.*?)\n\};', source, re.S)
+    if not match:
+        raise Exception('Array %s not found in %s' % (name, INPUT))
+    return match.group(1)
+
+
+def parse_text(body):
+    data = b''
+    for literal in re.findall(r'"((?:[^"\\]|\\.)*)"', body):
+        i = 0
+        while i < len(literal):
+            c = literal[i]
+            if c == '\\':
+                data += ESCAPES[literal[i + 1]]
+                i += 2
+            else:
+                data += c.encode('utf-8')
+                i += 1
+    # C string, ends at the first NUL
+    return data.split(b'\0')[0]
+
+
+def parse_binary(body):
+    return bytearray(int(x, 16) for x in re.findall(r'0x([0-9a-fA-F]{2})', body))
+
+
+def compress(data):
+    buf = io.BytesIO()
+    # mtime=0 and no file name, so the output only changes when the content does
+    f = gzip.GzipFile(filename='', mode='wb', compresslevel=9, fileobj=buf, mtime=0)
+    f.write(bytes(data))
+    f.close()
+    return bytearray(buf.getvalue())
+
+
+def c_array(data):
+    lines = []
+    for i in range(0, len(data), 12):
+        lines.append('  ' + ', '.join('0x%02x' % b for b in data[i:i + 12]))
+    return ',\n'.join(lines)
+
+
+def generate():
+    with io.open(INPUT, 'r', encoding='utf-8') as f:
+        source = f.read()
+    out = []
+    out.append('#ifndef WEBSTATICDATA_GZ_h')
+    out.append('#define WEBSTATICDATA_GZ_h')
+    out.append('')
+    out.append('// Generated by static_data_gz.py from WebStaticData.h, do not edit.')
+    out.append('')
+    for name, kind in ASSETS:
+        body = array_body(source, name)
+        data = parse_text(body) if kind == 'text' else parse_binary(body)
+        gz = compress(data)
+        etag = hashlib.md5(bytes(data)).hexdigest()[:16]
+        out.append('// %s: %d bytes, %d bytes compressed' % (name, len(data), len(gz)))
+        out.append('#define %s_etag "\\"%s\\""' % (name, etag))
+        out.append('static const unsigned int %s_gz_len = %d;' % (name, len(gz)))
+        out.append('static const char %s_gz[] PROGMEM = {' % name)
+        out.append(c_array(gz))
+        out.append('};')
+        out.append('')
+    out.append('#endif')
+    content = u'\n'.join(out) + u'\n'
+
+    old = None
+    if os.path.exists(OUTPUT):
+        with io.open(OUTPUT, 'r', encoding='utf-8') as f:
+            old = f.read()
+    if old != content:
+        with io.open(OUTPUT, 'w', encoding='utf-8', newline='\n') as f:
+            f.write(content)
+        print('Generated %s' % OUTPUT)
+
+
+try:
+    Import('env')  # Run by PlatformIO
+except NameError:
+    pass
+
+generate()
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+
+from esptest import *
+import json
+import re
+
+# hardware requirements:
+# - node 0
+
+# benchmark:
+# - runs the on-device micro benchmark (command "benchmark") of Calculate(), parseTemplate(),
+#   ruleMatch(), conditionMatch(), parseString(), GetArgv(), timeStringToSeconds() and the scheduler
+# - compares the results with bench000.<environment>.json of the previous run and stores them
+#
+# not part of testall, run it by hand: ./bench000.py
+
+MSEC_PER_CASE=500
+MAX_SLOWDOWN=1.2  # fail when a case is more than 20% slower than the previous run
+
+
+def environment():
+    m=re.search("--environment +(\\S+)", config.nodes[0]['build_cmd'])
+    return m.group(1) if m else "unknown"
+
+
+@step()
+def prepare():
+    node[0].reboot()
+    node[0].pingwifi()
+
+
+@step()
+def benchmark():
+    results=json.loads(espeasy[0].command_output("benchmark,{}".format(MSEC_PER_CASE)))
+    filename="bench000.{}.json".format(environment())
+    previous={}
+    if os.path.exists(filename):
+        with open(filename) as f:
+            previous={ r['name']: r for r in json.load(f) }
+
+    slower=[]
+    for r in results:
+        line="{name:20} {per_sec:>9} calls/sec {usec:>9.2f} usec/call heap {heap:>6}".format(**r)
+        if r['name'] in previous:
+            ratio=r['usec']/previous[r['name']]['usec']
+            line+="  {:+.1f}%".format((ratio-1)*100)
+            if ratio>MAX_SLOWDOWN:
+                slower.append(r['name'])
+        log.info(line)
+
+    if slower:
+        raise(Exception("Slower than the previous run: "+", ".join(slower)))
+
+    # only a run without regressions becomes the new reference
+    with open(filename, "w") as f:
+        json.dump(results, f, indent=2)
+
+
+
+if __name__=='__main__':
+    completed()
@@ -0,0 +1,230 @@
+#!/usr/bin/env python3
+
+from esptest import *
+from benchmark import *
+import requests
+import socket
+import threading
+
+# hardware requirements:
+# - node 0
+# - node 1
+# - D6 connected to eachother (as for test001)
+# - node 0 has the UDP port (Tools > Advanced) set to config.udp_port
+
+# benchmark:
+# - latency from a GPIO edge on node 0 (gpio command) to the domoticz mqtt message of the switch on node 1
+# - /json and /control requests per second at saturation, with 1, 2 and 4 clients, with the latency
+# - UDP commands per second node 0 handles without losing any
+# - mqtt messages per second node 0 publishes (publish command over UDP)
+# - main loop runs per second while idle and under load of /json requests
+# - compares the results with bench001.<environment>.json of the previous run and stores them
+#
+# not part of testall, run it by hand: ./bench001.py
+
+EDGES=50                      # gpio edges for the latency distribution
+LOAD_SECONDS=10               # per request saturation run
+CLIENTS=[1, 2, 4]
+UDP_RATES=[10, 25, 50, 100]   # commands per second tried, for UDP_SECONDS each
+UDP_SECONDS=5
+MQTT_BURST=200                # publish commands sent at once
+
+
+results=[]
+info={}
+
+
+def add_result(name, value, unit, better='lower'):
+    results.append({ 'name': name, 'value': value, 'unit': unit, 'better': better })
+
+
+def add_distribution(name, values, unit):
+    d=distribution(values)
+    log.info("{}: {}".format(name, d))
+    for key in [ 'p50', 'p90', 'p99' ]:
+        add_result(name+"_"+key, d.get(key, 0), unit)
+
+
+def node_url(index, page):
+    return "http://{}/{}".format(config.nodes[index]['ip'], page)
+
+
+def loop_rate(index=0):
+    """loop runs per second from the metrics endpoint"""
+    r=requests.get(node_url(index, "metrics"), timeout=5)
+    m=re.search("^espeasy_loop_count_per_second (\\S+)", r.text, re.M)
+    return float(m.group(1)) if m else 0
+
+
+def send_udp(index, command):
+    sock=socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.sendto(command.encode(), (config.nodes[index]['ip'], config.udp_port))
+    sock.close()
+
+
+def count_mqtt(topic, expected, timeout):
+    """receive times of the mqtt messages on topic, until expected are received or the timeout"""
+    times=[]
+    end_time=time.time()+timeout
+    while len(times)<expected and time.time()<end_time:
+        try:
+            message=controller.mqtt_messages.get(block=True, timeout=max(0.01, end_time-time.time()))
+        except Exception:
+            break
+        if message.topic==topic:
+            times.append(time.time())
+    return times
+
+
+def saturate(page, clients, seconds):
+    """request page from clients threads for seconds. returns (requests per second, latencies in msec, errors)"""
+    latencies=[]
+    errors=[0]
+    stop_time=time.time()+seconds
+    lock=threading.Lock()
+
+    def client():
+        session=requests.Session()
+        while time.time()<stop_time:
+            start=time.time()
+            try:
+                session.get(node_url(0, page), timeout=5).raise_for_status()
+                with lock:
+                    latencies.append((time.time()-start)*1000)
+            except Exception:
+                with lock:
+                    errors[0]+=1
+
+    threads=[ threading.Thread(target=client) for c in range(clients) ]
+    start_time=time.time()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    return (len(latencies)/(time.time()-start_time), latencies, errors[0])
+
+
+
+@step()
+def prepare():
+    node[0].reboot()
+    node[0].pingserial()
+    node[1].reboot()
+    node[1].pingserial()
+    espeasy[0].controller_domoticz_mqtt()
+    espeasy[1].controller_domoticz_mqtt()
+    espeasy[1].post_device(1, """
+                TDNUM:1
+                TDN:
+                TDE:on
+                taskdevicepin1:12
+                plugin_001_type:1
+                plugin_001_button:0
+                TDSD1:on
+                TDID1:1001
+                TDT:0
+                TDVN1:Switch
+                edit:1
+            """)
+    node[0].pingwifi()
+    node[1].pingwifi()
+    system=requests.get(node_url(0, "json?view=system"), timeout=5).json()['System']
+    info['build']=system['Build']
+    info['git build']=system['Git Build']
+    pause(10)
+
+
+@step()
+def gpio_latency():
+    latencies=[]
+    state=0
+    for edge in range(EDGES):
+        state=1-state
+        controller.clear_mqtt()
+        start=time.time()
+        espeasy[0].control(cmd="gpio,12,{}".format(state))
+        values=controller.recv_domoticz_mqtt(SENSOR_TYPE_SWITCH, 1001, timeout=10)
+        latencies.append((time.time()-start)*1000)
+        test_is(values[0], state)
+    add_distribution("gpio_to_mqtt_msec", latencies, "msec")
+
+
+@step()
+def http_saturation():
+    for page in [ "json", "control?cmd=dummy" ]:
+        for clients in CLIENTS:
+            rate, latencies, errors=saturate(page, clients, LOAD_SECONDS)
+            name="{}_{}".format(page.split("?")[0], clients)
+            log.info("{}: {:.1f} requests/sec, {} errors".format(name, rate, errors))
+            add_result(name+"_per_sec", rate, "requests/sec", better='higher')
+            add_result(name+"_errors", errors, "errors")
+            add_distribution(name+"_latency_msec", latencies, "msec")
+
+
+@step()
+def udp_rate():
+    best=0
+    for rate in UDP_RATES:
+        count=rate*UDP_SECONDS
+        controller.clear_mqtt()
+        start=time.time()
+        for i in range(count):
+            send_udp(0, "publish,bench/udp,{}".format(i))
+            time.sleep(max(0, start+(i+1)/rate-time.time()))
+        received=count_mqtt("bench/udp", count, 10)
+        log.info("UDP {} commands/sec: {} of {} received".format(rate, len(received), count))
+        if len(received)<count:
+            break
+        best=rate
+    if best==0:
+        raise(Exception("No UDP command got through, is the UDP port set to {}?".format(config.udp_port)))
+    add_result("udp_commands_per_sec", best, "commands/sec", better='higher')
+
+
+@step()
+def mqtt_throughput():
+    controller.clear_mqtt()
+    for i in range(MQTT_BURST):
+        send_udp(0, "publish,bench/mqtt,{}".format(i))
+    received=count_mqtt("bench/mqtt", MQTT_BURST, 30)
+    rate=(len(received)-1)/(received[-1]-received[0]) if len(received)>1 and received[-1]>received[0] else 0
+    log.info("MQTT: {} of {} received, {:.1f} messages/sec".format(len(received), MQTT_BURST, rate))
+    add_result("mqtt_publish_per_sec", rate, "messages/sec", better='higher')
+    add_result("mqtt_publish_lost", MQTT_BURST-len(received), "messages")
+
+
+@step()
+def loop_under_load():
+    # the loop count is per second, so wait for a second without requests
+    pause(2)
+    idle=loop_rate()
+    # one client taking /json, the loop count is read in between
+    stop=[False]
+    def client():
+        session=requests.Session()
+        while not stop[0]:
+            try:
+                session.get(node_url(0, "json"), timeout=5)
+            except Exception:
+                pass
+    t=threading.Thread(target=client)
+    t.start()
+    samples=[]
+    for i in range(LOAD_SECONDS):
+        time.sleep(1)
+        samples.append(loop_rate())
+    stop[0]=True
+    t.join()
+    log.info("Loop runs/sec idle {:.0f}, under load {}".format(idle, samples))
+    add_result("loop_per_sec_idle", idle, "loops/sec", better='higher')
+    add_result("loop_per_sec_load", sum(samples)/len(samples), "loops/sec", better='higher')
+
+
+@step()
+def store():
+    compare_baseline("bench001", results, info=info)
+
+
+
+if __name__=='__main__':
+    completed()
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+
+from esptest import *
+from benchmark import *
+import json
+import requests
+import rulesgen
+
+# hardware requirements:
+# - node 0
+# - the serial and web log level below INFO, each event is logged at INFO
+
+# benchmark of the rules engine with synthetic rule sets (rulesgen.py):
+# - events per second and usec per event of the command rulesbenchmark (rulesProcessingNow()),
+#   for rule sets of 1 to 4 files of SIZES bytes
+# - with the compiled rule sets, and read from the files (how the cache is used after a change)
+# - heap and the lowest free heap during the run, bytes of the compiled rule sets
+# - compares the results with bench002.<environment>.json of the previous run and stores them
+#
+# not part of testall, run it by hand: ./bench002.py
+
+EVENTS=1000          # per run, from the file runs do EVENTS/10
+NAMES=4              # event names Bench#E<n>
+SIZES=[1024, 2048, 4096]
+FILES=[1, 4]
+MATCHING=0.25
+CONDITIONS=3
+TASK=("bench", "first")
+
+results=[]
+info={}
+
+
+def add_result(name, value, unit, better='lower'):
+    results.append({ 'name': name, 'value': value, 'unit': unit, 'better': better })
+
+
+def run_benchmark(events, fromfile):
+    output=espeasy[0].command_output("rulesbenchmark,{},{},{}".format(events, NAMES, 1 if fromfile else 0))
+    m=re.search("\\{.*\\}", output, re.S)
+    if not m:
+        raise(Exception("No result from rulesbenchmark: "+output))
+    return json.loads(m.group(0))
+
+
+def upload_rules(files, size):
+    # upload, the rules editor takes at most 2048 bytes
+    for i in range(4):
+        if i<files:
+            espeasy[0].upload("rules{}.txt".format(i+1), rulesgen.generate(size, NAMES, MATCHING, CONDITIONS, TASK, seed=i))
+        else:
+            espeasy[0].rules(i+1, "")
+
+
+
+@step()
+def prepare():
+    node[0].reboot()
+    node[0].pingserial()
+    node[0].pingwifi()
+    espeasy[0].control(cmd="rules,1")
+    # the task of the [bench#first] references
+    espeasy[0].post_device(1, """
+                TDNUM:33
+                TDN:{}
+                TDE:on
+                plugin_033_sensortype:1
+                TDT:60
+                TDVN1:{}
+                TDVD1:2
+                edit:1
+                page:1
+            """.format(*TASK))
+    espeasy[0].control(cmd="taskvalueset,1,1,42")
+    system=requests.get(node[0]._url+"json?view=system", timeout=5).json()['System']
+    info['build']=system['Build']
+    info['git build']=system['Git Build']
+
+
+@step()
+def rules_sets():
+    for size in SIZES:
+        for files in FILES:
+            upload_rules(files, size)
+            for fromfile in [ False, True ]:
+                r=run_benchmark(EVENTS//10 if fromfile else EVENTS, fromfile)
+                log.info("{} x {} bytes{}: {}".format(files, size, " from file" if fromfile else "", r))
+                name="rules_{}x{}{}".format(files, size, "_file" if fromfile else "")
+                add_result(name+"_usec", r['usec'], "usec/event")
+                add_result(name+"_usec_max", r['usec_max'], "usec")
+                add_result(name+"_per_sec", r['per_sec'], "events/sec", better='higher')
+                add_result(name+"_heap_used", r['heap']-r['heap_min'], "bytes")
+                if not fromfile:
+                    add_result(name+"_cache_bytes", r['cache_bytes'], "bytes")
+    upload_rules(0, 0)
+
+
+@step()
+def store():
+    compare_baseline("bench002", results, info=info)
+
+
+
+if __name__=='__main__':
+    completed()
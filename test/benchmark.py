@@ -0,0 +1,90 @@
+### helpers for the benchmarks (bench*.py)
+
+# results are lists of dicts with at least 'name' and 'value'. 'better' is 'higher' or 'lower'
+# (default: lower). they are compared with bench<nr>.<environment>.json of the previous run,
+# which is only replaced by a run without regressions.
+
+from espcore import *
+
+import json
+import math
+import os
+import re
+import time
+
+log=logging.getLogger("benchmark")
+
+MAX_CHANGE=1.2  # a regression is a result more than 20% worse than the previous run
+
+
+def environment(node_index=0):
+    """platformio environment the node was built with"""
+    m=re.search("--environment +(\\S+)", config.nodes[node_index]['build_cmd'])
+    return m.group(1) if m else "unknown"
+
+
+def baseline_filename(name, node_index=0):
+    return "{}.{}.json".format(name, environment(node_index))
+
+
+def percentile(values, p):
+    """nearest rank percentile of a list of numbers"""
+    if not values:
+        return 0
+    ordered=sorted(values)
+    rank=max(0, min(len(ordered)-1, int(math.ceil(p/100.0*len(ordered)))-1))
+    return ordered[rank]
+
+
+def distribution(values):
+    """summary of a list of samples"""
+    if not values:
+        return { 'count': 0 }
+    return {
+        'count': len(values),
+        'min'  : min(values),
+        'avg'  : sum(values)/len(values),
+        'p50'  : percentile(values, 50),
+        'p90'  : percentile(values, 90),
+        'p99'  : percentile(values, 99),
+        'max'  : max(values)
+    }
+
+
+def worse_by(result, previous):
+    """ratio how much worse the result is than the previous one, 1 = the same"""
+    if result.get('better', 'lower')=='higher':
+        return previous['value']/result['value'] if result['value'] else float('inf')
+    return result['value']/previous['value'] if previous['value'] else 1
+
+
+def compare_baseline(name, results, node_index=0, max_change=MAX_CHANGE, info=None):
+    """log the results against the previous run, store them when nothing got worse than max_change.
+    info (e.g. the build) is stored with the results. raises an exception on a regression."""
+    filename=baseline_filename(name, node_index)
+    previous={}
+    if os.path.exists(filename):
+        with open(filename) as f:
+            previous={ r['name']: r for r in json.load(f)['results'] }
+
+    worse=[]
+    for r in results:
+        line="{:30} {:>12.2f} {}".format(r['name'], r['value'], r.get('unit', ''))
+        if r['name'] in previous:
+            ratio=worse_by(r, previous[r['name']])
+            line+="  {:+.1f}% {}".format((ratio-1)*100, "worse" if ratio>1 else "better")
+            if ratio>max_change:
+                worse.append(r['name'])
+        log.info(line)
+
+    if worse:
+        raise(Exception("Worse than the previous run: "+", ".join(worse)))
+
+    with open(filename, "w") as f:
+        json.dump({
+            'environment': environment(node_index),
+            'time'       : time.strftime("%Y-%m-%d %H:%M:%S"),
+            'info'       : info or {},
+            'results'    : results
+        }, f, indent=2)
+    log.info("Stored as the new reference in "+filename)
@@ -46,3 +46,7 @@ mqtt_port=1883
 test_server="192.168.13.159"
 http_port=8080
 linebased_port=8181
+udp_controller_port=8383
+
+#UDP port of the nodes for the benchmarks (Tools > Advanced > UDP port on the node)
+udp_port=8266
@@ -20,6 +20,131 @@ SENSOR_TYPE_DIMMER               =  11
 SENSOR_TYPE_LONG                 =  20
 SENSOR_TYPE_WIND                 =  21
 
+CONTROLLER_NAMES={
+    1: "C001 Domoticz HTTP",
+    2: "C002 Domoticz MQTT",
+    3: "C003 Nodo telnet",
+    4: "C004 ThingSpeak",
+    5: "C005 OpenHAB MQTT",
+    6: "C006 PiDome MQTT",
+    7: "C007 Emoncms",
+    8: "C008 Generic HTTP",
+    9: "C009 FHEM HTTP",
+    10: "C010 Generic UDP",
+    11: "C011 Generic HTTP Advanced",
+    12: "C012 Blynk HTTP",
+    13: "C013 ESPEasy P2P",
+}
+
+# tag of the samples sent with Controller Diagnostics enabled on the node (see src/ControllerDiagnostic.ino)
+DIAG_TAG=re.compile("u=(\\d+),c=(\\d+),p=(\\d+),n=(\\d+)(?:-(\\d+))?,t=([0-9.]+),s=([0-9.]+)")
+
+
+class DiagStats:
+    """latency, loss, duplicates and rate of the tagged samples, per unit, controller and protocol.
+    latencies are from the clock of the node (NTP) to the clock of this host, so they include the offset between them."""
+
+    def __init__(self):
+        self.lock=threading.Lock()
+        self.clear()
+
+
+    def clear(self):
+        with self.lock:
+            self.controllers={}
+            self.untagged={}
+
+
+    def record(self, transport, text, channel, arrival=None):
+        """decode the tag in a received message. channel (topic, url) tells apart the messages of the values of one sample"""
+        if arrival is None:
+            arrival=time.time()
+        m=DIAG_TAG.search(text)
+        with self.lock:
+            if not m:
+                self.untagged[transport]=self.untagged.get(transport, 0)+1
+                return None
+            unit, controller, protocol, first=[ int(x) for x in m.groups()[0:4] ]
+            last=int(m.group(5)) if m.group(5) else first
+            sampled, sent=float(m.group(6)), float(m.group(7))
+            key=(unit, controller, protocol)
+            c=self.controllers.setdefault(key, {
+                'transport': transport,
+                'seen'     : set(),   # (sequence, channel)
+                'sequences': set(),
+                'latency'  : [],      # send to arrival, msec
+                'age'      : [],      # sample to send (queue, batch, backlog), msec
+                'arrivals' : [],
+                'messages' : 0,
+                'duplicates': 0,
+                'batches'  : 0
+            })
+            c['messages']+=1
+            c['arrivals'].append(arrival)
+            if last!=first:
+                c['batches']+=1
+            for n in range(first, last+1):
+                if (n, channel) in c['seen']:
+                    c['duplicates']+=1
+                c['seen'].add((n, channel))
+                c['sequences'].add(n)
+            # the times are 0 while the clock of the node is not set
+            if sent>0:
+                c['latency'].append((arrival-sent)*1000)
+                if sampled>0:
+                    c['age'].append((sent-sampled)*1000)
+            return key
+
+
+    def summary(self):
+        """stats per controller, as a list of dicts (json serializable)"""
+        from benchmark import distribution
+        result=[]
+        with self.lock:
+            for (unit, controller, protocol), c in sorted(self.controllers.items()):
+                sequences=c['sequences']
+                expected=max(sequences)-min(sequences)+1
+                arrivals=c['arrivals']
+                duration=arrivals[-1]-arrivals[0]
+                result.append({
+                    'unit'      : unit,
+                    'controller': controller,
+                    'protocol'  : CONTROLLER_NAMES.get(protocol, "C{:03}".format(protocol)),
+                    'transport' : c['transport'],
+                    'messages'  : c['messages'],
+                    'samples'   : len(sequences),
+                    'lost'      : expected-len(sequences),
+                    'loss'      : (expected-len(sequences))/expected,
+                    'duplicates': c['duplicates'],
+                    'batches'   : c['batches'],
+                    'rate'      : (c['messages']-1)/duration if duration>0 else 0,
+                    'latency'   : distribution(c['latency']),
+                    'age'       : distribution(c['age'])
+                })
+        return result
+
+
+    def save(self, filename):
+        with open(filename, "w") as f:
+            json.dump({ 'time': time.strftime("%Y-%m-%d %H:%M:%S"), 'controllers': self.summary(), 'untagged': self.untagged }, f, indent=2)
+
+
+def diag_report(summary, untagged={}):
+    """text report of DiagStats.summary()"""
+    lines=[]
+    lines.append("{:28} {:>4} {:>3} {:>8} {:>8} {:>6} {:>6} {:>8} {:>8} {:>8} {:>8} {:>8}".format(
+        "protocol", "unit", "ctr", "messages", "samples", "lost", "dupes", "msg/sec", "lat p50", "lat p99", "lat max", "age p99"))
+    for c in summary:
+        lines.append("{:28} {:>4} {:>3} {:>8} {:>8} {:>6} {:>6} {:>8.2f} {:>8.0f} {:>8.0f} {:>8.0f} {:>8.0f}".format(
+            c['protocol'], c['unit'], c['controller'], c['messages'], c['samples'], c['lost'], c['duplicates'], c['rate'],
+            c['latency'].get('p50', 0), c['latency'].get('p99', 0), c['latency'].get('max', 0), c['age'].get('p99', 0)))
+    for transport, count in sorted(untagged.items()):
+        lines.append("{} untagged {} messages".format(count, transport))
+    lines.append("latency: send to arrival in msec (node NTP clock to this host), age: sample to send in msec (queue, batch, backlog)")
+    return "\n".join(lines)
+
+
+
 class ControllerEmu:
     """class that emulates and decodes various types of controllers. run various threads in the background to recveive and queue stuff"""
 
@@ -27,12 +152,21 @@ class ControllerEmu:
 
     def __init__(self):
         self.log=logging.getLogger("controller")
+        self.diag=DiagStats()
         self.start_mqtt()
         self.start_http()
         self.start_linebased()
+        self.start_udp()
         self.log_enabled=True
 
 
+    def diag_report(self, filename=None):
+        """report of the samples tagged by the nodes (Controller Diagnostics), also stored as json in filename"""
+        if filename:
+            self.diag.save(filename)
+        return diag_report(self.diag.summary(), self.diag.untagged)
+
+
     def start_mqtt(self):
         """generic mqtt receiver. just queues all reqeived mqtt messages on all topics"""
         getLogger("mqtt").debug("Connecting to {mqtt_broker}".format(mqtt_broker=config.mqtt_broker))
@@ -49,6 +183,7 @@ class ControllerEmu:
             if self.log_enabled:
                 logging.getLogger("mqtt").debug("Received message '" + str(message.payload) + "' on topic '"
                     + message.topic + "' with QoS " + str(message.qos))
+            self.diag.record("mqtt", message.payload.decode(errors='replace'), message.topic)
             self.mqtt_messages.put(message)
 
         mqtt_client.on_message=mqtt_on_message
@@ -71,6 +206,7 @@ class ControllerEmu:
         def urlhandler(filename):
             if self.log_enabled:
                 logging.getLogger("http").debug(bottle.request.method+" "+str(dict(bottle.request.params)))
+            self.diag.record("http", bottle.request.headers.get('X-ESPEasy-Diag', ''), bottle.request.url)
             self.http_requests.put(bottle.request.copy())
 
 
@@ -103,6 +239,7 @@ class ControllerEmu:
                 line=line.rstrip()
                 if self.log_enabled:
                     logging.getLogger("linebased").debug("Recv from "+str(client_address)+" :"+line)
+                self.diag.record("linebased", line, "linebased")
                 self.linebased_lines.put( ( client_address, line ) )
 
             if self.log_enabled:
@@ -127,6 +264,36 @@ class ControllerEmu:
         accept_thread.start()
 
 
+    def start_udp(self):
+        """generic udp receiver, a line per message. for the generic udp controller"""
+        import socket
+
+        self.udp_messages=Queue()
+
+        def receive():
+            sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+            sock.bind(('', config.udp_controller_port))
+
+            while True:
+                data, address = sock.recvfrom(4096)
+                arrival=time.time()
+                for line in data.decode(errors='replace').splitlines():
+                    if self.log_enabled:
+                        logging.getLogger("udp").debug("Recv from "+str(address)+" :"+line)
+                    self.diag.record("udp", line, "udp", arrival)
+                    self.udp_messages.put( ( address, line ) )
+
+        udp_thread=threading.Thread(target=receive)
+        udp_thread.daemon=True
+        udp_thread.start()
+
+
+    def clear_udp(self):
+        """clear queue"""
+        while not self.udp_messages.empty():
+            self.udp_messages.get()
+
+
     def clear_linebased(self):
         """clear queue"""
         while not self.linebased_lines.empty():
@@ -137,6 +304,7 @@ class ControllerEmu:
         self.clear_http()
         self.clear_mqtt()
         self.clear_linebased()
+        self.clear_udp()
         time.sleep(sleep)
 
 
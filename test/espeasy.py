@@ -3,6 +3,9 @@
 ### I've created it in way that you can just copy/past form parameters from Chromium's header view
 
 from espcore import *
+import html
+import requests
+import re
 
 
 
@@ -25,6 +28,37 @@ class EspEasy:
         )
 
 
+    def command_output(self, cmd):
+        """run a command via the tools page and return its output"""
+        self._node.log.info("Command "+cmd)
+        r=self._node.http_post(
+            page="tools",
+
+            params="""
+                cmd:{cmd}
+            """.format(cmd=cmd),
+
+        )
+        m=re.search("<textarea[^>]*>(.*?)</textarea>", r.text, re.S)
+        if not m:
+            raise(Exception("No output for command "+cmd))
+        return html.unescape(m.group(1))
+
+
+    def rules(self, set, text):
+        """store a rules file (rules need to be enabled, command rules,1)"""
+        self._node.log.info("Rules set {}".format(set))
+        r=requests.post(self._node._url+"rules", data={ 'set': set, 'rules': text })
+        r.raise_for_status()
+
+
+    def upload(self, filename, data):
+        """store a file via /upload (no size limit as for the rules editor)"""
+        self._node.log.info("Upload {} ({} bytes)".format(filename, len(data)))
+        r=requests.post(self._node._url+"upload", files={ 'file': (filename, data) })
+        r.raise_for_status()
+
+
     def post_controller(self, index, data):
         """post controller form to espeasy"""
         self._node.http_post(
@@ -0,0 +1,60 @@
+//********************************************************************************
+// Minimal Arduino shim for the host build of the pure logic headers of src/.
+// Only what those headers use: String, byte, millis() and the time helpers of
+// TimeESPeasy.ino. The clock is a variable, so tests can move it (and wrap it).
+//********************************************************************************
+#ifndef HOST_ARDUINO_H_
+#define HOST_ARDUINO_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HOT_IRAM_ATTR
+
+// millis() and micros() of the device are 32 bit
+extern uint32_t hostMillis;
+
+inline unsigned long millis() { return hostMillis; }
+inline unsigned long micros() { return hostMillis * 1000UL; }
+inline void yield() {}
+
+// Same results as TimeESPeasy.ino, with the wrap around at 32 bit.
+inline long timeDiff(unsigned long prev, unsigned long next) {
+  return static_cast<int32_t>(static_cast<uint32_t>(next) - static_cast<uint32_t>(prev));
+}
+inline long timePassedSince(unsigned long timestamp) { return timeDiff(timestamp, millis()); }
+inline long usecPassedSince(unsigned long timestamp) { return timeDiff(timestamp, micros()); }
+inline boolean timeOutReached(unsigned long timer) { return timePassedSince(timer) >= 0; }
+inline boolean usecTimeOutReached(unsigned long timer) { return usecPassedSince(timer) >= 0; }
+
+class String {
+public:
+  String() {}
+  String(const char* s) : s_(s) {}
+
+  String& operator+=(const char* s) { s_ += s; return *this; }
+  String& operator+=(char c) { s_ += c; return *this; }
+  String& operator+=(unsigned long v) { s_ += std::to_string(v); return *this; }
+  String& operator+=(long v) { s_ += std::to_string(v); return *this; }
+  String& operator+=(unsigned int v) { s_ += std::to_string(v); return *this; }
+  String& operator+=(int v) { s_ += std::to_string(v); return *this; }
+  String& operator+=(float v) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%.2f", v);
+    s_ += buf;
+    return *this;
+  }
+
+  const char* c_str() const { return s_.c_str(); }
+  unsigned int length() const { return s_.length(); }
+
+private:
+  std::string s_;
+};
+
+#endif /* HOST_ARDUINO_H_ */
@@ -0,0 +1,159 @@
+//********************************************************************************
+// Host test and benchmark of msecTimerHandlerStruct (src/ESPEasyTimeTypes.h)
+// The heap and its id index are checked against a plain reference model with
+// random set/remove/expire operations, also across the 32 bit millis() wrap.
+// The benchmark reports operations per second and heap allocations, a timer
+// set or fired once the heap has grown must not allocate.
+//********************************************************************************
+#include "Arduino.h"
+#include "../../src/ESPEasyTimeTypes.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <new>
+
+uint32_t hostMillis = 0;
+
+static unsigned long allocations = 0;
+
+void* operator new(size_t size) {
+  ++allocations;
+  void* p = malloc(size);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static int failures = 0;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      ++failures; \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+    } \
+  } while (0)
+
+static unsigned long randomId(unsigned long range) {
+  return 1 + static_cast<unsigned long>(rand()) % range;
+}
+
+// All due timers must come out in timer order, as kept by the reference model.
+static void expireDue(msecTimerHandlerStruct& handler, std::map<unsigned long, unsigned long>& model) {
+  unsigned long lastTimer = 0;
+  bool first = true;
+  while (true) {
+    unsigned long timer = 0;
+    const unsigned long id = handler.getNextId(timer);
+    if (id == 0) break;
+    CHECK(model.count(id) == 1);
+    CHECK(model[id] == timer);
+    CHECK(timeOutReached(timer));
+    if (!first) CHECK(timeDiff(lastTimer, timer) >= 0);
+    lastTimer = timer;
+    first = false;
+    model.erase(id);
+  }
+  for (std::map<unsigned long, unsigned long>::const_iterator it = model.begin(); it != model.end(); ++it)
+    CHECK(!timeOutReached(it->second));
+}
+
+static void testRandom(uint32_t startMillis) {
+  hostMillis = startMillis;
+  msecTimerHandlerStruct handler;
+  std::map<unsigned long, unsigned long> model;
+  for (int round = 0; round < 200000; ++round) {
+    const unsigned long id = randomId(TIMER_HEAP_MAX_ITEMS);
+    switch (rand() % 4) {
+      case 0:
+      case 1: {
+        const unsigned long timer = millis() + rand() % 5000;
+        CHECK(handler.registerAt(id, timer));
+        model[id] = timer;
+        break;
+      }
+      case 2:
+        CHECK(handler.remove(id) == (model.erase(id) == 1));
+        break;
+      case 3:
+        hostMillis += rand() % 50;
+        expireDue(handler, model);
+        break;
+    }
+    CHECK(handler.getQueueLength() == model.size());
+    unsigned long timer = 0;
+    CHECK(handler.getTimer(id, timer) == (model.count(id) == 1));
+    if (model.count(id) == 1) CHECK(timer == model[id]);
+  }
+  hostMillis += 10000;
+  expireDue(handler, model);
+  CHECK(handler.getQueueLength() == 0);
+  CHECK(handler.getDroppedCount() == 0);
+}
+
+// Ids beyond TIMER_HEAP_MAX_ITEMS are not scheduled, but counted.
+static void testFull() {
+  hostMillis = 0;
+  msecTimerHandlerStruct handler;
+  for (unsigned long id = 1; id <= TIMER_HEAP_MAX_ITEMS + 10; ++id)
+    CHECK(handler.registerAt(id, 1000 + id) == (id <= TIMER_HEAP_MAX_ITEMS));
+  CHECK(handler.getQueueLength() == TIMER_HEAP_MAX_ITEMS);
+  CHECK(handler.getDroppedCount() == 10);
+  // An id already scheduled can still be moved.
+  CHECK(handler.registerAt(1, 5));
+  unsigned long timer = 0;
+  CHECK(handler.getTimer(1, timer) && timer == 5);
+  CHECK(handler.getDroppedCount() == 10);
+}
+
+static double elapsedSec(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Typical load: a few dozen periodic timers (tasks, controllers, system timers), each
+// set again when it fires.
+static void benchmark(unsigned long timers) {
+  hostMillis = 0;
+  msecTimerHandlerStruct handler;
+  for (unsigned long id = 1; id <= timers; ++id)
+    handler.registerAt(id, id * 7);
+  const unsigned long ops = 2000000;
+  const unsigned long allocStart = allocations;
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  unsigned long fired = 0;
+  for (unsigned long i = 0; i < ops; ++i) {
+    unsigned long timer = 0;
+    const unsigned long id = handler.getNextId(timer);
+    if (id == 0) {
+      ++hostMillis;
+      continue;
+    }
+    ++fired;
+    handler.registerAt(id, millis() + 10 + (id * 37) % 1000);
+  }
+  const double sec = elapsedSec(start);
+  printf("timerheap %3lu timers: %10.0f ops/sec, %lu fired, %lu allocations\n",
+         timers, ops / sec, fired, allocations - allocStart);
+  CHECK(allocations == allocStart);
+}
+
+int main(int argc, char** argv) {
+  srand(1);
+  testRandom(0);
+  testRandom(0xFFFFFFFFUL - 100000);  // millis() wraps during the test
+  testFull();
+  if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+    benchmark(16);
+    benchmark(64);
+    benchmark(TIMER_HEAP_MAX_ITEMS);
+  }
+  if (failures != 0) {
+    printf("timerheap: %d checks failed\n", failures);
+    return 1;
+  }
+  printf("timerheap: ok\n");
+  return 0;
+}
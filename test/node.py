@@ -249,3 +249,5 @@ class Node():
                 data=data_dict
             )
             r.raise_for_status()
+
+        return r
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+
+### synthetic rules files for the rules benchmark (bench002.py, command rulesbenchmark)
+
+# the command fires the events Bench#E0..Bench#E<names-1>. a rules set has a mix of blocks:
+# - blocks on other events, which an event has to skip (most blocks in real rule sets)
+# - blocks on Bench#E<n>, Bench#E<n>>50 and Bench#E<n><20 triggers
+# - if/elseif/else chains of <conditions> branches (the rules engine has a single if level),
+#   comparing %eventvalue%, [Task#Value] and %sysvar% values
+# - logentry actions (a command which does nothing) with markup to parse
+# files are filled with blocks up to the size, like the 2-4 kB files of real installations.
+
+import argparse
+import random
+
+OTHER_EVENTS=[ "System#Boot", "Clock#Time=All,{h:02}:{m:02}", "Rules#Timer={n}", "Switch{n}#State=1", "MQTT#Connected",
+    "Wifi#Connected", "Sensor{n}#Temperature>25", "Button{n}#Switch" ]
+SYSVARS=[ "%sysname%", "%systime%", "%uptime%", "%rssi%", "%sysload%", "%unixtime%" ]
+
+
+def action(rnd, task, depth):
+    """a logentry with markup"""
+    parts=[ "logentry,d{}".format(depth), rnd.choice(SYSVARS), "%eventvalue%" ]
+    if task:
+        parts.append("[{}#{}]".format(*task))
+    return ",".join(parts)
+
+
+def condition(rnd, task):
+    left=rnd.choice([ "%eventvalue%", "[{}#{}]".format(*task) if task else "%eventvalue%", "%uptime%" ])
+    return "{}{}{}".format(left, rnd.choice([ ">", "<", "=" ]), rnd.randint(0, 100))
+
+
+def block(rnd, trigger, conditions, task):
+    lines=[ "on {} do".format(trigger) ]
+    if conditions==0:
+        lines.append("  "+action(rnd, task, 0))
+    else:
+        lines.append("  if {}".format(condition(rnd, task)))
+        lines.append("    "+action(rnd, task, 1))
+        for c in range(1, conditions):
+            lines.append("  elseif {}".format(condition(rnd, task)))
+            lines.append("    "+action(rnd, task, c+1))
+        lines.append("  else")
+        lines.append("    "+action(rnd, task, 0))
+        lines.append("  endif")
+    lines.append("endon")
+    return "\n".join(lines)+"\n"
+
+
+def generate(size=3072, names=4, matching=0.25, conditions=2, task=None, seed=0):
+    """rules text of about size bytes. matching: fraction of the blocks on the Bench events,
+    task: (task name, value name) for [Task#Value] references"""
+    rnd=random.Random(seed)
+    text="// synthetic rules for rulesbenchmark, {} bytes {} names {} matching {} conditions\n".format(size, names, matching, conditions)
+    n=0
+    while True:
+        if rnd.random()<matching:
+            name="Bench#E{}".format(n % names)
+            trigger=rnd.choice([ name, name+">50", name+"<20" ])
+        else:
+            trigger=rnd.choice(OTHER_EVENTS).format(n=n, h=n % 24, m=n % 60)
+        b=block(rnd, trigger, rnd.randint(0, conditions), task)
+        if len(text)+len(b)>size:
+            break
+        text+=b
+        n+=1
+    # every name triggers at least one block
+    for i in range(names):
+        b=block(rnd, "Bench#E{}".format(i), conditions, task)
+        if len(text)+len(b)>size:
+            break
+        text+=b
+    return text
+
+
+if __name__=='__main__':
+    parser = argparse.ArgumentParser(description='Generate synthetic rules files for the command rulesbenchmark')
+    parser.add_argument('--files', type=int, default=4, help='rules files (RULESETS_MAX is 4). default: %(default)s')
+    parser.add_argument('--size', type=int, default=3072, help='bytes per file. default: %(default)s')
+    parser.add_argument('--names', type=int, default=4, help='event names Bench#E<n>. default: %(default)s')
+    parser.add_argument('--matching', type=float, default=0.25, help='fraction of the blocks on the Bench events. default: %(default)s')
+    parser.add_argument('--conditions', type=int, default=2, help='max. if/elseif branches per block. default: %(default)s')
+    parser.add_argument('--task', default=None, help='Task#Value for [Task#Value] references')
+    parser.add_argument('--seed', type=int, default=0, help='random seed. default: %(default)s')
+    args = parser.parse_args()
+
+    task=tuple(args.task.split("#")) if args.task else None
+    for i in range(args.files):
+        filename="rules{}.txt".format(i+1)
+        with open(filename, "w") as f:
+            f.write(generate(args.size, args.names, args.matching, args.conditions, task, args.seed+i))
+        print("Written "+filename)
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+
+from esptest import *
+from benchmark import environment
+import csv
+import random
+import requests
+import socket
+import threading
+
+# hardware requirements:
+# - node 0
+# - node 0 has the UDP port (Tools > Advanced) set to config.udp_port
+
+# soak test:
+# - drives node 0 for SOAK_HOURS with a mix of web requests, UDP commands, rules events and
+#   controller traffic (a dummy device sent every second with domoticz mqtt, publish commands)
+# - samples /metrics every SOAK_SAMPLE_SECONDS: free heap, largest free block, fragmentation,
+#   the lowest values, loop rate, reconnects. stored in soak.<environment>.csv as it runs
+# - fails when the node rebooted or could not be reached for SOAK_MAX_MISSED samples
+# - plot the csv with: ./soakplot soak.<environment>.csv
+#
+# not part of testall, run it by hand: SOAK_HOURS=72 ./soak.py
+# the load per kind in requests per minute can be changed with: SOAK_MIX="web=60,udp=120,event=60,publish=30"
+
+SOAK_HOURS=float(os.environ.get('SOAK_HOURS', 24))
+SAMPLE_SECONDS=int(os.environ.get('SOAK_SAMPLE_SECONDS', 60))
+MAX_MISSED=int(os.environ.get('SOAK_MAX_MISSED', 5))
+
+MIX={
+    'web':     120,  # pages in turn from WEB_PAGES
+    'udp':      60,  # commands over UDP, see UDP_COMMANDS
+    'event':    60,  # rules events with /control
+    'publish':  30,  # mqtt publish commands with /control
+}
+if 'SOAK_MIX' in os.environ:
+    for item in os.environ['SOAK_MIX'].split(","):
+        kind, rate=item.split("=")
+        MIX[kind.strip()]=float(rate)
+
+WEB_PAGES=[ "", "json", "devices", "sysinfo", "json?tasknr=1", "log", "controllers", "metrics" ]
+UDP_COMMANDS=[ "event,Soak#Udp={n}", "taskvalueset,1,2,{n}", "publish,soak/udp,{n}" ]
+
+METRICS=[ 'uptime_seconds', 'free_heap_bytes', 'min_free_heap_bytes', 'min_free_heap_sampled_bytes',
+    'max_free_block_bytes', 'min_max_free_block_bytes', 'heap_fragmentation_percent', 'max_heap_fragmentation_percent',
+    'loop_count_per_second', 'cpu_load_percent', 'wifi_reconnects_total', 'connection_failures' ]
+
+RULES="""
+on Soak#Event do
+  if %eventvalue%>50
+    taskvalueset,1,3,%eventvalue%
+  else
+    taskvalueset,1,4,%eventvalue%
+  endif
+endon
+
+on Soak#Udp do
+  event,Soak#Event=%eventvalue%
+endon
+"""
+
+node_url="http://{}/".format(config.nodes[0]['ip'])
+filename="soak.{}.csv".format(environment())
+
+
+def read_metrics():
+    """the metrics without labels, and the function of the lowest free heap"""
+    r=requests.get(node_url+"metrics", timeout=10)
+    r.raise_for_status()
+    result={}
+    for m in re.finditer("^espeasy_(\\w+) (\\S+)$", r.text, re.M):
+        result[m.group(1)]=float(m.group(2))
+    m=re.search('^espeasy_min_free_heap_function_bytes{function="(.*)"}', r.text, re.M)
+    result['min_free_heap_function']=m.group(1) if m else ""
+    return result
+
+
+class Load:
+    """sends a kind of load at a rate, from its own thread"""
+
+    def __init__(self, kind, per_minute, stop):
+        self.kind=kind
+        self.interval=60.0/per_minute
+        self.stop=stop
+        self.sent=0
+        self.errors=0
+        self.session=requests.Session()
+        self.sock=socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.thread=threading.Thread(target=self.run)
+        self.thread.daemon=True
+        self.thread.start()
+
+    def send(self, n):
+        if self.kind=='web':
+            self.session.get(node_url+WEB_PAGES[n % len(WEB_PAGES)], timeout=10).raise_for_status()
+        elif self.kind=='udp':
+            command=UDP_COMMANDS[n % len(UDP_COMMANDS)].format(n=n % 100)
+            self.sock.sendto(command.encode(), (config.nodes[0]['ip'], config.udp_port))
+        elif self.kind=='event':
+            self.session.get(node_url+"control", params={ 'cmd': "event,Soak#Event={}".format(random.randint(0, 100)) }, timeout=10).raise_for_status()
+        elif self.kind=='publish':
+            self.session.get(node_url+"control", params={ 'cmd': "publish,soak/publish,{}".format(n) }, timeout=10).raise_for_status()
+
+    def run(self):
+        next_time=time.time()
+        while not self.stop.is_set():
+            try:
+                self.send(self.sent)
+            except Exception:
+                self.errors+=1
+            self.sent+=1
+            # at the rate, without catching up after a stall of the node
+            next_time=max(next_time+self.interval, time.time())
+            self.stop.wait(max(0, next_time-time.time()))
+
+
+
+@step()
+def prepare():
+    node[0].reboot()
+    node[0].pingwifi()
+    espeasy[0].controller_domoticz_mqtt()
+    espeasy[0].device_p033(index=1, plugin_033_sensortype=SENSOR_TYPE_QUAD, TDID1=3000)
+    espeasy[0].control(cmd="rules,1")
+    espeasy[0].rules(1, RULES)
+    pause(10)
+
+
+@step()
+def soak():
+    stop=threading.Event()
+    loads=[ Load(kind, rate, stop) for kind, rate in MIX.items() if rate>0 ]
+    log.info("Soak test for {} hours, load per minute: {}, samples in {}".format(SOAK_HOURS, MIX, filename))
+
+    end_time=time.time()+SOAK_HOURS*3600
+    uptime=0
+    missed=0
+    try:
+        with open(filename, "w", newline='') as f:
+            writer=csv.writer(f)
+            writer.writerow([ 'time', 'elapsed_hours' ] + METRICS + [ 'min_free_heap_function' ] + [ kind+"_sent" for kind in MIX ] + [ kind+"_errors" for kind in MIX ])
+            start_time=time.time()
+            while time.time()<end_time:
+                time.sleep(SAMPLE_SECONDS)
+                try:
+                    metrics=read_metrics()
+                    missed=0
+                except Exception as e:
+                    missed+=1
+                    log.warning("No metrics: {}".format(e))
+                    if missed>=MAX_MISSED:
+                        raise(Exception("Node not reachable for {} samples".format(missed)))
+                    continue
+
+                if metrics['uptime_seconds']<uptime:
+                    raise(Exception("Node rebooted after {:.1f} hours".format(uptime/3600)))
+                uptime=metrics['uptime_seconds']
+
+                by_kind={ l.kind: l for l in loads }
+                writer.writerow([ time.strftime("%Y-%m-%d %H:%M:%S"), "{:.3f}".format((time.time()-start_time)/3600) ] +
+                    [ metrics.get(m, "") for m in METRICS ] + [ metrics['min_free_heap_function'] ] +
+                    [ by_kind[kind].sent if kind in by_kind else 0 for kind in MIX ] +
+                    [ by_kind[kind].errors if kind in by_kind else 0 for kind in MIX ])
+                f.flush()
+                log.info("{:.1f} h: free {:.0f} block {:.0f} ({:.0f}% fragmented, lowest block {:.0f}) loop {:.0f}/sec".format(
+                    (time.time()-start_time)/3600, metrics.get('free_heap_bytes', 0), metrics.get('max_free_block_bytes', 0),
+                    metrics.get('heap_fragmentation_percent', 0), metrics.get('min_max_free_block_bytes', 0),
+                    metrics.get('loop_count_per_second', 0)))
+    finally:
+        stop.set()
+        for l in loads:
+            l.thread.join()
+            log.info("{}: {} sent, {} errors".format(l.kind, l.sent, l.errors))
+
+
+
+if __name__=='__main__':
+    completed()
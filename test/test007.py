@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+
+from esptest import *
+import json
+
+# hardware requirements:
+# - node 0, running a test build (the schedulerprobe command needs -D FEATURE_SCHEDULER_PROBE)
+
+# tests:
+# - a timer of each scheduler timer type is dispatched as its own type (schedulerprobe command),
+#   also types 16 and up (notification, sleep samples, radio and UDP group command timers)
+# - a timer of the sleep samples type is dispatched as that type only, not as CONST_INTERVAL_TIMER
+# - a timer of the UDP group command type is dispatched as that type only, not as SYSTEM_TIMER
+
+CONST_INTERVAL_TIMER=1
+SYSTEM_TIMER=3
+SLEEP_SAMPLES_TIMER=17
+UDP_GROUP_TIMER=19
+LAST_TIMER_TYPE=UDP_GROUP_TIMER
+
+
+def probe(timer_type=None):
+    if timer_type is None:
+        espeasy[0].control(cmd="schedulerprobe")
+    else:
+        espeasy[0].control(cmd="schedulerprobe,%d" % timer_type)
+    pause(1)
+    return json.loads(espeasy[0].command_output("schedulerprobe,check"))
+
+
+@step()
+def prepare():
+    node[0].reboot()
+    node[0].pingserial()
+    node[0].pingwifi()
+
+
+@step()
+def timer_types():
+    result=probe()
+    for timer_type in range(1, LAST_TIMER_TYPE+1):
+        bit=1 << timer_type
+        test_is(result['armed'] & bit, bit)
+        test_is(result['fired'] & bit, bit)
+    test_is(result['fired'], result['armed'])
+
+
+@step()
+def sleep_samples_timer():
+    # type 17 wrapped to CONST_INTERVAL_TIMER (1) in the former 4 bit type field
+    result=probe(SLEEP_SAMPLES_TIMER)
+    test_is(result['armed'], 1 << SLEEP_SAMPLES_TIMER)
+    test_is(result['fired'], 1 << SLEEP_SAMPLES_TIMER)
+    test_is(result['fired'] & (1 << CONST_INTERVAL_TIMER), 0)
+
+
+
+@step()
+def udp_group_timer():
+    # type 19 wrapped to SYSTEM_TIMER (3) in the former 4 bit type field, so a retransmit
+    # ran process_system_timer() and clearing it removed a system timer
+    result=probe(UDP_GROUP_TIMER)
+    test_is(result['armed'], 1 << UDP_GROUP_TIMER)
+    test_is(result['fired'], 1 << UDP_GROUP_TIMER)
+    test_is(result['fired'] & (1 << SYSTEM_TIMER), 0)
+
+
+if __name__=='__main__':
+    completed()